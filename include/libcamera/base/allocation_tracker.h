@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Heap allocation tracking instrumentation
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace libcamera {
+
+class Thread;
+
+class AllocationTracker
+{
+public:
+	struct ThreadStats {
+		std::string name;
+		uint64_t allocations;
+	};
+
+	static bool enabled();
+
+	static uint64_t allocations();
+	static uint64_t threadAllocations();
+	static std::vector<ThreadStats> threadStats();
+
+private:
+	friend class Thread;
+
+	static void updateThreadName();
+};
+
+} /* namespace libcamera */
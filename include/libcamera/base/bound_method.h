@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <tuple>
 #include <type_traits>
@@ -16,6 +17,56 @@ namespace libcamera {
 
 class Object;
 
+namespace details {
+
+void *poolAllocate(std::size_t size);
+void poolDeallocate(void *ptr);
+
+/*
+ * Allocate small objects from per-thread pools of recycled blocks, for the
+ * objects created for every asynchronous method invocation.
+ */
+template<typename T>
+class PoolAllocator
+{
+public:
+	static_assert(alignof(T) <= alignof(std::max_align_t),
+		      "Over-aligned types are not supported");
+
+	using value_type = T;
+
+	PoolAllocator() = default;
+
+	template<typename U>
+	PoolAllocator([[maybe_unused]] const PoolAllocator<U> &other)
+	{
+	}
+
+	T *allocate(std::size_t n)
+	{
+		return static_cast<T *>(poolAllocate(n * sizeof(T)));
+	}
+
+	void deallocate(T *ptr, [[maybe_unused]] std::size_t n)
+	{
+		poolDeallocate(ptr);
+	}
+
+	template<typename U>
+	bool operator==([[maybe_unused]] const PoolAllocator<U> &other) const
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=([[maybe_unused]] const PoolAllocator<U> &other) const
+	{
+		return false;
+	}
+};
+
+} /* namespace details */
+
 enum ConnectionType {
 	ConnectionTypeAuto,
 	ConnectionTypeDirect,
@@ -72,6 +123,16 @@ public:
 	}
 	virtual ~BoundMethodBase() = default;
 
+	static void *operator new(std::size_t size)
+	{
+		return details::poolAllocate(size);
+	}
+
+	static void operator delete(void *ptr)
+	{
+		details::poolDeallocate(ptr);
+	}
+
 	template<typename T, std::enable_if_t<!std::is_same<Object, T>::value> * = nullptr>
 	bool match(T *obj) { return obj == obj_; }
 	bool match(Object *object) { return object == object_; }
@@ -145,7 +206,8 @@ public:
 		if (!this->object_)
 			return func_(args...);
 
-		auto pack = std::make_shared<PackType>(args...);
+		auto pack = std::allocate_shared<PackType>(details::PoolAllocator<PackType>(),
+							    args...);
 		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
 		return sync ? pack->returnValue() : R();
 	}
@@ -180,7 +242,8 @@ public:
 			return (obj->*func_)(args...);
 		}
 
-		auto pack = std::make_shared<PackType>(args...);
+		auto pack = std::allocate_shared<PackType>(details::PoolAllocator<PackType>(),
+							    args...);
 		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
 		return sync ? pack->returnValue() : R();
 	}
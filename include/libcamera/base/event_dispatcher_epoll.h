@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Epoll-based event dispatcher
+ */
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/unique_fd.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class EventNotifier;
+class Timer;
+
+class EventDispatcherEpoll final : public EventDispatcher
+{
+public:
+	EventDispatcherEpoll();
+	~EventDispatcherEpoll();
+
+	void registerEventNotifier(EventNotifier *notifier);
+	void unregisterEventNotifier(EventNotifier *notifier);
+
+	void registerTimer(Timer *timer);
+	void unregisterTimer(Timer *timer);
+
+	void processEvents();
+	void interrupt();
+
+private:
+	static constexpr unsigned int kMaxEvents = 32;
+
+	struct EventNotifierSetEpoll {
+		uint32_t events() const;
+		EventNotifier *notifiers[3];
+	};
+
+	void updateNotifiers(int fd, uint32_t previous, uint32_t events);
+	void armTimer();
+	void processInterrupt();
+	void processTimerfd();
+	void processNotifiers(int fd, uint32_t events);
+	void processTimers();
+
+	std::map<int, EventNotifierSetEpoll> notifiers_;
+	std::vector<int> staleFds_;
+
+	std::set<std::pair<utils::time_point, Timer *>> timers_;
+	std::unordered_map<Timer *, utils::time_point> deadlines_;
+	utils::time_point armedDeadline_;
+
+	UniqueFD epollfd_;
+	UniqueFD eventfd_;
+	UniqueFD timerfd_;
+
+	bool processingEvents_;
+};
+
+} /* namespace libcamera */
@@ -7,14 +7,15 @@
 
 #pragma once
 
-#include <list>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include <libcamera/base/private.h>
 
 #include <libcamera/base/event_dispatcher.h>
 #include <libcamera/base/unique_fd.h>
+#include <libcamera/base/utils.h>
 
 struct pollfd;
 
@@ -50,7 +51,8 @@ private:
 	void processTimers();
 
 	std::map<int, EventNotifierSetPoll> notifiers_;
-	std::list<Timer *> timers_;
+	std::multimap<utils::time_point, Timer *> timers_;
+	std::unordered_map<Timer *, decltype(timers_)::iterator> timerEntries_;
 	UniqueFD eventfd_;
 
 	bool processingEvents_;
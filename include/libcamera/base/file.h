@@ -50,6 +50,7 @@ public:
 
 	bool open(OpenMode mode);
 	bool isOpen() const { return fd_.isValid(); }
+	int fd() const { return fd_.get(); }
 	OpenMode openMode() const { return mode_; }
 	void close();
 
@@ -13,6 +13,7 @@
 #include <libcamera/base/private.h>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/utils.h>
 
 namespace libcamera {
@@ -104,13 +105,58 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
 		const char *fileName = __builtin_FILE(),
 		unsigned int line = __builtin_LINE());
 
+class LogRateLimiter
+{
+public:
+	LogRateLimiter(unsigned int burst, std::chrono::milliseconds interval);
+
+	bool acquire(const LogCategory &category, LogSeverity severity,
+		     const char *fileName = __builtin_FILE(),
+		     unsigned int line = __builtin_LINE());
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(LogRateLimiter)
+
+	const unsigned int burst_;
+	const std::chrono::milliseconds interval_;
+
+	Mutex mutex_;
+	utils::time_point start_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int count_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int suppressed_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
 #ifndef __DOXYGEN__
 #define _LOG_CATEGORY(name) logCategory##name
 
-#define _LOG1(severity) \
-	_log(nullptr, Log##severity).stream()
-#define _LOG2(category, severity) \
-	_log(&_LOG_CATEGORY(category)(), Log##severity).stream()
+#ifndef LIBCAMERA_LOG_MIN_SEVERITY
+#define LIBCAMERA_LOG_MIN_SEVERITY 0
+#endif
+
+class _LogVoid
+{
+public:
+	void operator&(std::ostream &) {}
+};
+
+/*
+ * Check the severity before constructing the message. The compile-time part is
+ * constant, messages below the minimum severity are removed by the compiler.
+ * Fatal messages are never discarded, as they abort execution.
+ */
+#define _LOG_ENABLED(cat, sev)						\
+	(sev >= LogFatal ||						\
+	 (sev >= LIBCAMERA_LOG_MIN_SEVERITY && sev >= (cat).severity()))
+
+#define _LOG1(severity)							\
+	!_LOG_ENABLED(LogCategory::defaultCategory(), Log##severity)	\
+		? static_cast<void>(0)					\
+		: _LogVoid() & _log(nullptr, Log##severity).stream()
+#define _LOG2(category, severity)					\
+	!_LOG_ENABLED(_LOG_CATEGORY(category)(), Log##severity)		\
+		? static_cast<void>(0)					\
+		: _LogVoid() & _log(&_LOG_CATEGORY(category)(),		\
+				    Log##severity).stream()
 
 /*
  * Expand the LOG() macro to _LOG1() or _LOG2() based on the number of
@@ -118,8 +164,33 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
  */
 #define _LOG_MACRO(_1, _2, NAME, ...) NAME
 #define LOG(...) _LOG_MACRO(__VA_ARGS__, _LOG2, _LOG1)(__VA_ARGS__)
+
+/*
+ * Every rate-limited call site owns a static LogRateLimiter instance, created
+ * on first use by the lambda. The limiter is only consulted for messages that
+ * pass the severity check.
+ */
+#define _LOG_LIMITER(burst, interval)					\
+	([]() -> LogRateLimiter & {					\
+		static LogRateLimiter limiter(burst, interval);		\
+		return limiter;						\
+	}())
+#define _LOG_LIMITED(burst, interval, category, severity)		\
+	!_LOG_ENABLED(_LOG_CATEGORY(category)(), Log##severity) ||	\
+	!_LOG_LIMITER(burst, interval).acquire(_LOG_CATEGORY(category)(), \
+					       Log##severity)		\
+		? static_cast<void>(0)					\
+		: _LogVoid() & _log(&_LOG_CATEGORY(category)(),		\
+				    Log##severity).stream()
+
+#define LOG_RATELIMITED(category, severity)				\
+	_LOG_LIMITED(10, std::chrono::milliseconds(5000), category, severity)
+#define LOG_ONCE(category, severity)					\
+	_LOG_LIMITED(1, std::chrono::milliseconds(0), category, severity)
 #else /* __DOXYGEN___ */
 #define LOG(category, severity)
+#define LOG_RATELIMITED(category, severity)
+#define LOG_ONCE(category, severity)
 #endif /* __DOXYGEN__ */
 
 #ifndef NDEBUG
@@ -16,6 +16,7 @@
 namespace libcamera {
 
 class BoundMethodBase;
+class MessageQueue;
 class Object;
 class Semaphore;
 class Thread;
@@ -40,10 +41,12 @@ public:
 	static Type registerMessageType();
 
 private:
+	friend class MessageQueue;
 	friend class Thread;
 
 	Type type_;
 	Object *receiver_;
+	Message *next_;
 
 	static std::atomic_uint nextUserType_;
 };
@@ -57,6 +60,16 @@ public:
 		      bool deleteMethod = false);
 	~InvokeMessage();
 
+	static void *operator new(std::size_t size)
+	{
+		return details::poolAllocate(size);
+	}
+
+	static void operator delete(void *ptr)
+	{
+		details::poolDeallocate(ptr);
+	}
+
 	Semaphore *semaphore() const { return semaphore_; }
 
 	void invoke();
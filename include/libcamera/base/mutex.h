@@ -23,10 +23,17 @@ namespace libcamera {
 class LIBCAMERA_TSA_CAPABILITY("mutex") Mutex final
 {
 public:
+	enum class Protocol {
+		None,
+		PriorityInherit,
+	};
+
 	constexpr Mutex()
 	{
 	}
 
+	explicit Mutex(Protocol protocol);
+
 	void lock() LIBCAMERA_TSA_ACQUIRE()
 	{
 		mutex_.lock();
@@ -120,6 +127,14 @@ private:
 
 class Mutex final
 {
+public:
+	enum class Protocol {
+		None,
+		PriorityInherit,
+	};
+
+	Mutex();
+	explicit Mutex(Protocol protocol);
 };
 
 class MutexLocker final
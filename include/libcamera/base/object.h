@@ -52,6 +52,7 @@ protected:
 	bool assertThreadBound(const char *message);
 
 private:
+	friend class MessageQueue;
 	friend class SignalBase;
 	friend class Thread;
 
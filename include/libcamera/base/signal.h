@@ -7,8 +7,8 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
-#include <list>
 #include <type_traits>
 #include <vector>
 
@@ -21,18 +21,64 @@ class Object;
 class SignalBase
 {
 public:
+	SignalBase();
+	~SignalBase();
+
 	void disconnect(Object *object);
 
 protected:
-	using SlotList = std::list<BoundMethodBase *>;
+	struct Slot {
+		BoundMethodBase *method;
+		std::atomic<bool> connected;
+	};
+
+	struct SlotArray {
+		std::vector<Slot *> slots;
+		std::vector<Slot *> removed;
+		SlotArray *next;
+	};
+
+	struct State {
+		std::atomic<SlotArray *> slots;
+		std::atomic<unsigned int> emissions;
+		std::atomic<SlotArray *> retired;
+		bool orphaned;
+	};
+
+	class Emission
+	{
+	public:
+		Emission(SignalBase *signal)
+			: state_(signal->state_)
+		{
+			state_->emissions.fetch_add(1, std::memory_order_seq_cst);
+			slots_ = state_->slots.load(std::memory_order_seq_cst);
+		}
+
+		~Emission()
+		{
+			/* The signal may have been destroyed by a slot. */
+			if (state_->emissions.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+			    state_->retired.load(std::memory_order_relaxed))
+				SignalBase::reclaim(state_);
+		}
+
+		const std::vector<Slot *> &slots() const { return slots_->slots; }
+
+	private:
+		State *state_;
+		const SlotArray *slots_;
+	};
 
 	void connect(BoundMethodBase *slot);
-	void disconnect(std::function<bool(SlotList::iterator &)> match);
-
-	SlotList slots();
+	void disconnect(std::function<bool(BoundMethodBase *)> match);
 
 private:
-	SlotList slots_;
+	void replace(SlotArray *slots);
+	static void retire(State *state, SlotArray *slots);
+	static void reclaim(State *state);
+
+	State *state_;
 };
 
 template<typename... Args>
@@ -97,7 +143,7 @@ public:
 
 	void disconnect()
 	{
-		SignalBase::disconnect([]([[maybe_unused]] SlotList::iterator &iter) {
+		SignalBase::disconnect([]([[maybe_unused]] BoundMethodBase *slot) {
 			return true;
 		});
 	}
@@ -105,17 +151,17 @@ public:
 	template<typename T>
 	void disconnect(T *obj)
 	{
-		SignalBase::disconnect([obj](SlotList::iterator &iter) {
-			return (*iter)->match(obj);
+		SignalBase::disconnect([obj](BoundMethodBase *slot) {
+			return slot->match(obj);
 		});
 	}
 
 	template<typename T, typename R>
 	void disconnect(T *obj, R (T::*func)(Args...))
 	{
-		SignalBase::disconnect([obj, func](SlotList::iterator &iter) {
+		SignalBase::disconnect([obj, func](BoundMethodBase *method) {
 			BoundMethodArgs<R, Args...> *slot =
-				static_cast<BoundMethodArgs<R, Args...> *>(*iter);
+				static_cast<BoundMethodArgs<R, Args...> *>(method);
 
 			if (!slot->match(obj))
 				return false;
@@ -133,9 +179,9 @@ public:
 	template<typename R>
 	void disconnect(R (*func)(Args...))
 	{
-		SignalBase::disconnect([func](SlotList::iterator &iter) {
+		SignalBase::disconnect([func](BoundMethodBase *method) {
 			BoundMethodArgs<R, Args...> *slot =
-				static_cast<BoundMethodArgs<R, Args...> *>(*iter);
+				static_cast<BoundMethodArgs<R, Args...> *>(method);
 
 			if (!slot->match(nullptr))
 				return false;
@@ -147,11 +193,18 @@ public:
 	void emit(Args... args)
 	{
 		/*
-		 * Make a copy of the slots list as the slot could call the
-		 * disconnect operation, invalidating the iterator.
+		 * The slots array stays valid for the duration of the emission,
+		 * even if a slot connects or disconnects slots. Skip the slots
+		 * disconnected during the emission.
 		 */
-		for (BoundMethodBase *slot : slots())
-			static_cast<BoundMethodArgs<void, Args...> *>(slot)->activate(args...);
+		Emission emission(this);
+
+		for (Slot *slot : emission.slots()) {
+			if (!slot->connected.load(std::memory_order_acquire))
+				continue;
+
+			static_cast<BoundMethodArgs<void, Args...> *>(slot->method)->activate(args...);
+		}
 	}
 };
 
@@ -8,8 +8,10 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <sys/types.h>
 #include <thread>
+#include <vector>
 
 #include <libcamera/base/private.h>
 
@@ -28,9 +30,20 @@ class ThreadMain;
 class Thread
 {
 public:
-	Thread();
+	enum class SchedulingPolicy {
+		Other,
+		Fifo,
+		RoundRobin,
+	};
+
+	Thread(const std::string &name = std::string());
 	virtual ~Thread();
 
+	const std::string &name() const;
+
+	int setScheduling(SchedulingPolicy policy, int priority);
+	int setThreadAffinity(const std::vector<unsigned int> &cpus);
+
 	void start();
 	void exit(int code = 0);
 	bool wait(utils::duration duration = utils::duration::max());
@@ -44,7 +57,8 @@ public:
 
 	EventDispatcher *eventDispatcher();
 
-	void dispatchMessages(Message::Type type = Message::Type::None);
+	void dispatchMessages(Message::Type type = Message::Type::None,
+			      Object *receiver = nullptr);
 
 protected:
 	int exec();
@@ -53,6 +67,7 @@ protected:
 private:
 	void startThread();
 	void finishThread();
+	void applySettings();
 
 	void postMessage(std::unique_ptr<Message> msg, Object *receiver);
 	void removeMessages(Object *receiver);
@@ -7,12 +7,15 @@
 
 #pragma once
 
+#include <chrono>
 #include <initializer_list>
+#include <map>
 #include <memory>
 #include <optional>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/flags.h>
@@ -56,6 +59,26 @@ public:
 	bool isValid() const;
 };
 
+class CameraStatistics
+{
+public:
+	struct StreamStatistics {
+		uint64_t framesCompleted = 0;
+		uint64_t framesDropped = 0;
+		uint64_t framesFailed = 0;
+	};
+
+	uint64_t requestsQueued = 0;
+	uint64_t requestsCompleted = 0;
+	uint64_t requestsCancelled = 0;
+
+	unsigned int queueDepth = 0;
+	unsigned int maxQueueDepth = 0;
+
+	std::map<const Stream *, StreamStatistics> streams;
+	std::map<std::string, uint64_t> counters;
+};
+
 class CameraConfiguration
 {
 public:
@@ -124,6 +147,7 @@ public:
 
 	Signal<Request *, FrameBuffer *> bufferCompleted;
 	Signal<Request *> requestCompleted;
+	Signal<const std::vector<Request *> &> requestsCompleted;
 	Signal<> disconnected;
 
 	int acquire();
@@ -145,12 +169,29 @@ public:
 
 	int configure(CameraConfiguration *config);
 
+	int setCompletionCoalescing(unsigned int maxRequests,
+				    std::chrono::microseconds maxDelay = {});
+
+	int setCompletionQueueEnabled(bool enable);
+	int completionQueueFd() const;
+	Request *dequeueCompletedRequest();
+
+	int setMailboxEnabled(bool enable);
+	Request *takeLatestRequest();
+
+	int setStandbyEnabled(bool enable,
+			      std::chrono::microseconds frameDuration = {});
+
 	std::unique_ptr<Request> createRequest(uint64_t cookie = 0);
+	std::vector<std::unique_ptr<Request>> createRequestPool(unsigned int count);
 	int queueRequest(Request *request);
+	int queueRequests(Span<Request *const> requests);
 
 	int start(const ControlList *controls = nullptr);
 	int stop();
 
+	CameraStatistics statistics() const;
+
 private:
 	LIBCAMERA_DISABLE_COPY(Camera)
 
@@ -163,6 +204,7 @@ private:
 	void requestComplete(Request *request);
 
 	friend class FrameBufferAllocator;
+	int checkBufferExport(Stream *stream);
 	int exportFrameBuffers(Stream *stream,
 			       std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 };
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Group of cameras capturing synchronized frames
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
+
+namespace libcamera {
+
+class Camera;
+class ControlList;
+class Request;
+
+class CameraGroup : public Extensible
+{
+	LIBCAMERA_DECLARE_PRIVATE()
+
+public:
+	CameraGroup(std::vector<std::shared_ptr<Camera>> cameras,
+		    std::chrono::nanoseconds tolerance);
+	~CameraGroup();
+
+	const std::vector<std::shared_ptr<Camera>> &cameras() const;
+	std::chrono::nanoseconds tolerance() const;
+
+	int start(const ControlList *controls = nullptr);
+	int stop();
+
+	int queueRequests(Span<Request *const> requests);
+
+	Signal<const std::vector<Request *> &> requestsCompleted;
+
+private:
+	LIBCAMERA_DISABLE_COPY(CameraGroup)
+};
+
+} /* namespace libcamera */
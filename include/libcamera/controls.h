@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -127,6 +128,8 @@ public:
 
 	ControlValue(const ControlValue &other);
 	ControlValue &operator=(const ControlValue &other);
+	ControlValue(ControlValue &&other) noexcept;
+	ControlValue &operator=(ControlValue &&other) noexcept;
 
 	ControlType type() const { return type_; }
 	bool isNone() const { return type_ == ControlTypeNone; }
@@ -197,11 +200,13 @@ public:
 		     std::size_t numElements = 1);
 
 private:
+	static constexpr std::size_t kInlineStorageSize = 64;
+
 	ControlType type_ : 8;
 	bool isArray_;
 	std::size_t numElements_ : 32;
 	union {
-		uint64_t value_;
+		uint64_t value_[kInlineStorageSize / sizeof(uint64_t)];
 		void *storage_;
 	};
 
@@ -338,18 +343,35 @@ public:
 	iterator find(unsigned int key);
 	const_iterator find(unsigned int key) const;
 
+	bool contains(unsigned int id) const
+	{
+		if (!indexed_)
+			return find(id) != end();
+
+		unsigned int offset = id - idBase_;
+		unsigned int word = offset / 64;
+		return word < idBits_.size() && ((idBits_[word] >> (offset % 64)) & 1);
+	}
+
 	const ControlIdMap &idmap() const { return *idmap_; }
 
 private:
 	bool validate();
+	void buildIndex();
 
 	const ControlIdMap *idmap_ = nullptr;
+
+	/* Bitmap of the numerical IDs of the controls, starting at idBase_. */
+	bool indexed_ = false;
+	unsigned int idBase_ = 0;
+	std::vector<uint64_t> idBits_;
 };
 
 class ControlList
 {
 private:
-	using ControlListMap = std::unordered_map<unsigned int, ControlValue>;
+	using ControlListEntry = std::pair<unsigned int, ControlValue>;
+	using ControlListStorage = std::vector<ControlListEntry>;
 
 public:
 	enum class MergePolicy {
@@ -361,8 +383,13 @@ public:
 	ControlList(const ControlIdMap &idmap, const ControlValidator *validator = nullptr);
 	ControlList(const ControlInfoMap &infoMap, const ControlValidator *validator = nullptr);
 
-	using iterator = ControlListMap::iterator;
-	using const_iterator = ControlListMap::const_iterator;
+	ControlList(const ControlList &other);
+	ControlList &operator=(const ControlList &other);
+	ControlList(ControlList &&other) = default;
+	ControlList &operator=(ControlList &&other) = default;
+
+	using iterator = ControlListStorage::iterator;
+	using const_iterator = ControlListStorage::const_iterator;
 
 	iterator begin() { return controls_.begin(); }
 	iterator end() { return controls_.end(); }
@@ -372,16 +399,17 @@ public:
 	bool empty() const { return controls_.empty(); }
 	std::size_t size() const { return controls_.size(); }
 
-	void clear() { controls_.clear(); }
+	void clear();
 	void merge(const ControlList &source, MergePolicy policy = MergePolicy::KeepExisting);
+	void merge(ControlList &&source, MergePolicy policy = MergePolicy::KeepExisting);
 
 	bool contains(unsigned int id) const;
 
 	template<typename T>
 	std::optional<T> get(const Control<T> &ctrl) const
 	{
-		const auto entry = controls_.find(ctrl.id());
-		if (entry == controls_.end())
+		const auto entry = lookup(ctrl.id());
+		if (entry == controls_.end() || entry->first != ctrl.id())
 			return std::nullopt;
 
 		const ControlValue &val = entry->second;
@@ -410,19 +438,25 @@ public:
 
 	const ControlValue &get(unsigned int id) const;
 	void set(unsigned int id, const ControlValue &value);
+	void set(unsigned int id, ControlValue &&value);
 
 	const ControlInfoMap *infoMap() const { return infoMap_; }
 	const ControlIdMap *idMap() const { return idmap_; }
 
 private:
+	const_iterator lookup(unsigned int id) const;
+	iterator lookup(unsigned int id);
+
 	const ControlValue *find(unsigned int id) const;
 	ControlValue *find(unsigned int id);
+	ControlValue &insert(unsigned int id, iterator pos);
 
 	const ControlValidator *validator_;
 	const ControlIdMap *idmap_;
 	const ControlInfoMap *infoMap_;
 
-	ControlListMap controls_;
+	ControlListStorage controls_;
+	ControlListStorage released_;
 };
 
 } /* namespace libcamera */
@@ -13,11 +13,12 @@
 
 #include <libcamera/base/class.h>
 
+#include <libcamera/stream.h>
+
 namespace libcamera {
 
 class Camera;
 class FrameBuffer;
-class Stream;
 
 class FrameBufferAllocator
 {
@@ -28,14 +29,29 @@ public:
 	int allocate(Stream *stream);
 	int free(Stream *stream);
 
+	void setPoolingEnabled(bool enable);
+
 	bool allocated() const { return !buffers_.empty(); }
 	const std::vector<std::unique_ptr<FrameBuffer>> &buffers(Stream *stream) const;
 
 private:
 	LIBCAMERA_DISABLE_COPY(FrameBufferAllocator)
 
+	struct PoolEntry {
+		Stream *stream;
+		StreamConfiguration config;
+		std::vector<std::unique_ptr<FrameBuffer>> buffers;
+	};
+
+	static bool isCompatible(const PoolEntry &entry,
+				 const StreamConfiguration &config);
+
 	std::shared_ptr<Camera> camera_;
 	std::map<Stream *, std::vector<std::unique_ptr<FrameBuffer>>> buffers_;
+
+	bool pooling_ = false;
+	std::map<Stream *, StreamConfiguration> configs_;
+	std::vector<PoolEntry> pool_;
 };
 
 } /* namespace libcamera */
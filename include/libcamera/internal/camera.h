@@ -9,17 +9,23 @@
 
 #include <atomic>
 #include <list>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/timer.h>
+
+#include <libcamera/controls.h>
 
 #include <libcamera/camera.h>
 
 namespace libcamera {
 
 class CameraControlValidator;
+class FrameBuffer;
 class PipelineHandler;
 class Stream;
 
@@ -39,8 +45,13 @@ public:
 
 	uint32_t requestSequence_;
 
+	CameraStatistics statistics_;
+	std::map<const Stream *, uint32_t> lastSequence_;
+
 	const CameraControlValidator *validator() const { return validator_.get(); }
 
+	void flushCompletedRequests();
+
 private:
 	enum State {
 		CameraAvailable,
@@ -58,6 +69,17 @@ private:
 			    bool allowDisconnected = false,
 			    const char *from = __builtin_FUNCTION()) const;
 
+	int validateRequest(const Request *request) const;
+
+	int startStandby(const ControlList *startControls);
+	void stopStandby();
+	bool isStandbyRequest(const Request *request) const;
+	void queueStandbyRequest(Request *request);
+	void requestQueued(Request *request);
+	void appRequestCompleted();
+	void signalRequest(Request *request);
+	void flushMailbox();
+
 	void disconnect();
 	void setState(State state);
 
@@ -70,6 +92,25 @@ private:
 	std::atomic<State> state_;
 
 	std::unique_ptr<CameraControlValidator> validator_;
+
+	unsigned int coalesceRequests_;
+	std::chrono::microseconds coalesceDelay_;
+	std::vector<Request *> completedRequests_;
+	Timer coalesceTimer_;
+
+	class CompletionQueue;
+	std::unique_ptr<CompletionQueue> completionQueue_;
+
+	bool mailbox_;
+	std::atomic<Request *> latestRequest_;
+
+	bool standby_;
+	std::chrono::microseconds standbyFrameDuration_;
+	std::vector<std::unique_ptr<FrameBuffer>> standbyBuffers_;
+	std::vector<std::unique_ptr<Request>> standbyRequests_;
+	std::vector<Request *> idleStandbyRequests_;
+	std::atomic<unsigned int> appRequests_;
+	ControlValue appFrameDurations_;
 };
 
 } /* namespace libcamera */
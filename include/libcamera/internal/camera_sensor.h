@@ -36,6 +36,21 @@ struct CameraSensorProperties;
 
 enum class Orientation;
 
+struct CameraSensorMode {
+	unsigned int code;
+	Size size;
+	unsigned int bitsPerPixel;
+
+	Rectangle analogCrop;
+	Size binning;
+
+	uint64_t pixelRate;
+	unsigned int minLineLength;
+	unsigned int minFrameLength;
+
+	float maxFrameRate() const;
+};
+
 class CameraSensor : protected Loggable
 {
 public:
@@ -56,8 +71,10 @@ public:
 	std::vector<Size> sizes(unsigned int mbusCode) const;
 	Size resolution() const;
 
+	const std::vector<CameraSensorMode> &modes() const { return modes_; }
+
 	V4L2SubdeviceFormat getFormat(const std::vector<unsigned int> &mbusCodes,
-				      const Size &size) const;
+				      const Size &size, float minFrameRate = 0.0f) const;
 	int setFormat(V4L2SubdeviceFormat *format,
 		      Transform transform = Transform::Identity);
 	int tryFormat(V4L2SubdeviceFormat *format) const;
@@ -94,6 +111,7 @@ private:
 	void initTestPatternModes();
 	int initProperties();
 	int discoverAncillaryDevices();
+	void initModes();
 	int applyTestPatternMode(controls::draft::TestPatternModeEnum mode);
 
 	const MediaEntity *entity_;
@@ -108,6 +126,7 @@ private:
 	V4L2Subdevice::Formats formats_;
 	std::vector<unsigned int> mbusCodes_;
 	std::vector<Size> sizes_;
+	std::vector<CameraSensorMode> modes_;
 	std::vector<controls::draft::TestPatternModeEnum> testPatternModes_;
 	controls::draft::TestPatternModeEnum testPatternMode_;
 
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Persistent cache of camera sensor capabilities
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <libcamera/base/class.h>
+
+#include "libcamera/internal/v4l2_subdevice.h"
+
+namespace libcamera {
+
+class MediaEntity;
+
+class CameraSensorCache
+{
+public:
+	CameraSensorCache();
+
+	bool isEnabled() const { return !path_.empty(); }
+
+	V4L2Subdevice::Formats formats(const MediaEntity *entity,
+				       unsigned int pad) const;
+	void setFormats(const MediaEntity *entity, unsigned int pad,
+			const V4L2Subdevice::Formats &formats);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(CameraSensorCache)
+
+	static std::string key(const MediaEntity *entity, unsigned int pad);
+
+	void load();
+	int save() const;
+
+	std::string path_;
+	std::map<std::string, V4L2Subdevice::Formats> sensors_;
+};
+
+} /* namespace libcamera */
@@ -9,6 +9,10 @@
 
 #include <map>
 #include <memory>
+#include <optional>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <libcamera/controls.h>
@@ -17,6 +21,9 @@ namespace libcamera {
 
 class ByteStreamBuffer;
 
+struct ipa_controls_header;
+struct ipa_control_value_entry;
+
 class ControlSerializer
 {
 public:
@@ -34,6 +41,7 @@ public:
 
 	int serialize(const ControlInfoMap &infoMap, ByteStreamBuffer &buffer);
 	int serialize(const ControlList &list, ByteStreamBuffer &buffer);
+	int serializeDelta(const ControlList &list, ByteStreamBuffer &buffer);
 
 	template<typename T>
 	T deserialize(ByteStreamBuffer &buffer);
@@ -41,8 +49,24 @@ public:
 	bool isCached(const ControlInfoMap &infoMap);
 
 private:
+	static constexpr unsigned int kFullListInterval = 64;
+
+	using ListKey = std::pair<uint32_t, uint32_t>;
+
+	struct ListState {
+		ControlList list;
+		uint32_t sequence = 0;
+	};
+
 	static size_t binarySize(const ControlValue &value);
 	static size_t binarySize(const ControlInfo &info);
+	static size_t binaryDeltaSize(const ControlList &list,
+				      const ControlList &reference);
+
+	int listKey(const ControlList &list, ListKey *key) const;
+	static void write(const ControlList &list, const ControlList *reference,
+			  const ListKey &key, uint32_t flags, uint32_t sequence,
+			  ByteStreamBuffer &buffer);
 
 	static void store(const ControlValue &value, ByteStreamBuffer &buffer);
 	static void store(const ControlInfo &info, ByteStreamBuffer &buffer);
@@ -57,6 +81,44 @@ private:
 	std::vector<std::unique_ptr<ControlIdMap>> controlIdMaps_;
 	std::map<unsigned int, ControlInfoMap> infoMaps_;
 	std::map<const ControlInfoMap *, unsigned int> infoMapHandles_;
+	std::map<ListKey, ListState> sentLists_;
+	std::map<ListKey, ListState> receivedLists_;
+};
+
+class ControlListView
+{
+public:
+	ControlListView(ByteStreamBuffer &buffer);
+
+	bool isValid() const { return hdr_ != nullptr; }
+
+	bool empty() const { return size() == 0; }
+	std::size_t size() const;
+
+	bool contains(unsigned int id) const;
+
+	template<typename T>
+	std::optional<T> get(const Control<T> &ctrl) const
+	{
+		static_assert(!details::is_span<T>::value,
+			      "Array controls must be retrieved as a ControlValue");
+
+		ControlValue value = get(ctrl.id());
+		if (value.isNone())
+			return std::nullopt;
+
+		return value.get<T>();
+	}
+
+	ControlValue get(unsigned int id) const;
+
+private:
+	const struct ipa_control_value_entry *find(unsigned int id) const;
+
+	const struct ipa_controls_header *hdr_;
+	const struct ipa_control_value_entry *entries_;
+	const uint8_t *values_;
+	std::size_t valuesSize_;
 };
 
 } /* namespace libcamera */
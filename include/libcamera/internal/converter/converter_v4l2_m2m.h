@@ -9,10 +9,10 @@
 #pragma once
 
 #include <functional>
-#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/log.h>
@@ -53,8 +53,7 @@ public:
 	int start();
 	void stop();
 
-	int queueBuffers(FrameBuffer *input,
-			 const std::map<unsigned int, FrameBuffer *> &outputs);
+	int queueBuffers(FrameBuffer *input, Span<FrameBuffer *const> outputs);
 
 private:
 	class Stream : protected Loggable
@@ -63,6 +62,7 @@ private:
 		Stream(V4L2M2MConverter *converter, unsigned int index);
 
 		bool isValid() const { return m2m_ != nullptr; }
+		std::unique_ptr<V4L2M2MDevice> releaseContext();
 
 		int configure(const StreamConfiguration &inputCfg,
 			      const StreamConfiguration &outputCfg);
@@ -89,10 +89,14 @@ private:
 		unsigned int outputBufferCount_;
 	};
 
+	std::unique_ptr<V4L2M2MDevice> acquireContext();
+	void releaseStreams();
+
 	std::unique_ptr<V4L2M2MDevice> m2m_;
 
 	std::vector<Stream> streams_;
-	std::map<FrameBuffer *, unsigned int> queue_;
+	std::vector<std::unique_ptr<V4L2M2MDevice>> contexts_;
+	std::vector<std::pair<FrameBuffer *, unsigned int>> queue_;
 };
 
 } /* namespace libcamera */
@@ -7,8 +7,12 @@
 
 #pragma once
 
+#include <array>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
 
 #include <libcamera/controls.h>
 
@@ -27,10 +31,10 @@ public:
 	DelayedControls(V4L2Device *device,
 			const std::unordered_map<uint32_t, ControlParams> &controlParams);
 
-	void reset();
+	void reset(unsigned int cookie = 0);
 
-	bool push(const ControlList &controls);
-	ControlList get(uint32_t sequence);
+	bool push(const ControlList &controls, unsigned int cookie = 0);
+	ControlList get(uint32_t sequence, unsigned int *cookie = nullptr);
 
 	void applyControls(uint32_t sequence);
 
@@ -52,30 +56,28 @@ private:
 	};
 
 	/* \todo Make the listSize configurable at instance creation time. */
-	static constexpr int listSize = 16;
-	class ControlRingBuffer : public std::array<Info, listSize>
+	static constexpr unsigned int listSize = 16;
+
+	int controlIndex(uint32_t id) const;
+	Info &value(unsigned int frame, unsigned int index)
 	{
-	public:
-		Info &operator[](unsigned int index)
-		{
-			return std::array<Info, listSize>::operator[](index % listSize);
-		}
+		return values_[(frame % listSize) * ids_.size() + index];
+	}
 
-		const Info &operator[](unsigned int index) const
-		{
-			return std::array<Info, listSize>::operator[](index % listSize);
-		}
-	};
+	bool pushControls(const ControlList &controls, unsigned int cookie);
 
 	V4L2Device *device_;
-	/* \todo Evaluate if we should index on ControlId * or unsigned int */
-	std::unordered_map<const ControlId *, ControlParams> controlParams_;
+	/* Controls and parameters, indexed by dense control index */
+	std::vector<const ControlId *> ids_;
+	std::vector<ControlParams> params_;
 	unsigned int maxDelay_;
 
+	Mutex mutex_;
 	uint32_t queueCount_;
 	uint32_t writeCount_;
-	/* \todo Evaluate if we should index on ControlId * or unsigned int */
-	std::unordered_map<const ControlId *, ControlRingBuffer> values_;
+	/* Frame-indexed ring of listSize frames of ids_.size() values each */
+	std::vector<Info> values_;
+	std::array<unsigned int, listSize> cookies_;
 };
 
 } /* namespace libcamera */
@@ -10,10 +10,15 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <queue>
 #include <set>
 #include <string>
 #include <sys/types.h>
 
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+
 #include "libcamera/internal/device_enumerator.h"
 
 struct udev;
@@ -26,7 +31,7 @@ class EventNotifier;
 class MediaDevice;
 class MediaEntity;
 
-class DeviceEnumeratorUdev final : public DeviceEnumerator
+class DeviceEnumeratorUdev final : public DeviceEnumerator, public Object
 {
 public:
 	DeviceEnumeratorUdev();
@@ -54,17 +59,32 @@ private:
 		DependencyMap deps_;
 	};
 
+	struct HotplugEvent {
+		bool add;
+		std::string subsystem;
+		std::string deviceNode;
+		dev_t devnum;
+		std::unique_ptr<MediaDevice> media;
+	};
+
 	int addUdevDevice(struct udev_device *dev);
+	int addMediaDevice(std::unique_ptr<MediaDevice> media);
 	int populateMediaDevice(MediaDevice *media, DependencyMap *deps);
 	std::string lookupDeviceNode(dev_t devnum);
 
 	int addV4L2Device(dev_t devnum);
 	void udevNotify();
+	void processHotplugEvents();
 
 	struct udev *udev_;
+	struct udev *monitorUdev_;
 	struct udev_monitor *monitor_;
 	EventNotifier *notifier_;
 
+	Thread hotplugThread_;
+	Mutex eventsLock_;
+	std::queue<HotplugEvent> events_ LIBCAMERA_TSA_GUARDED_BY(eventsLock_);
+
 	std::set<dev_t> orphans_;
 	std::list<MediaDeviceDeps> pending_;
 	std::map<dev_t, MediaDeviceDeps *> devMap_;
@@ -8,8 +8,12 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
+#include <vector>
 
+#include <libcamera/base/class.h>
 #include <libcamera/base/flags.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/unique_fd.h>
 
 namespace libcamera {
@@ -25,18 +29,57 @@ public:
 
 	using DmaBufAllocatorFlags = Flags<DmaBufAllocatorFlag>;
 
+	enum class AllocFlag {
+		HugePages = 1 << 0,
+	};
+
+	using AllocFlags = Flags<AllocFlag>;
+
 	DmaBufAllocator(DmaBufAllocatorFlags flags = DmaBufAllocatorFlag::CmaHeap);
 	~DmaBufAllocator();
 	bool isValid() const { return providerHandle_.isValid(); }
 	UniqueFD alloc(const char *name, std::size_t size);
+	std::vector<UniqueFD> alloc(const char *name, std::size_t size,
+				    unsigned int count, AllocFlags flags = {});
 
 private:
 	UniqueFD allocFromHeap(const char *name, std::size_t size);
 	UniqueFD allocFromUDmaBuf(const char *name, std::size_t size);
+	std::vector<UniqueFD> allocFromUDmaBuf(const char *name, std::size_t size,
+					       unsigned int count, AllocFlags flags);
+	UniqueFD createMemfd(const char *name, std::size_t size, bool hugePages);
+	UniqueFD createUDmaBuf(const char *name, const UniqueFD &memfd,
+			       std::size_t offset, std::size_t size);
 	UniqueFD providerHandle_;
 	DmaBufAllocatorFlag type_;
 };
 
+class DmaSyncer final
+{
+public:
+	enum class SyncType {
+		Read = 0,
+		Write,
+		ReadWrite,
+	};
+
+	explicit DmaSyncer(SharedFD fd, SyncType type = SyncType::ReadWrite);
+
+	DmaSyncer(DmaSyncer &&other) = default;
+	DmaSyncer &operator=(DmaSyncer &&other) = default;
+
+	~DmaSyncer();
+
+private:
+	LIBCAMERA_DISABLE_COPY(DmaSyncer)
+
+	void sync(uint64_t step);
+
+	SharedFD fd_;
+	uint64_t flags_ = 0;
+};
+
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(DmaBufAllocator::DmaBufAllocatorFlag)
+LIBCAMERA_FLAGS_ENABLE_OPERATORS(DmaBufAllocator::AllocFlag)
 
 } /* namespace libcamera */
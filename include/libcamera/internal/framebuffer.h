@@ -11,12 +11,16 @@
 #include <utility>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/unique_fd.h>
 
 #include <libcamera/fence.h>
 #include <libcamera/framebuffer.h>
 
 namespace libcamera {
 
+class FrameBufferMapping;
+
 class FrameBuffer::Private : public Extensible::Private
 {
 	LIBCAMERA_DECLARE_PUBLIC(FrameBuffer)
@@ -33,16 +37,25 @@ public:
 
 	void cancel() { metadata_.status = FrameMetadata::FrameCancelled; }
 
+	void signalCompletionFence();
+
 	FrameMetadata &metadata() { return metadata_; }
 
 private:
+	friend class MappedFrameBuffer;
+
 	std::vector<Plane> planes_;
 	FrameMetadata metadata_;
 	uint64_t cookie_;
 
 	std::unique_ptr<Fence> fence_;
+	UniqueFD completionFence_;
 	Request *request_;
 	bool isContiguous_;
+
+	mutable Mutex mappingLock_;
+	mutable std::shared_ptr<FrameBufferMapping> mapping_
+		LIBCAMERA_TSA_GUARDED_BY(mappingLock_);
 };
 
 } /* namespace libcamera */
@@ -41,6 +41,13 @@ void appendPOD(std::vector<uint8_t> &vec, T val)
 	memcpy(&*(vec.end() - byteWidth), &val, byteWidth);
 }
 
+template<typename T,
+	 std::enable_if_t<std::is_arithmetic_v<T>> * = nullptr>
+void writePOD(std::vector<uint8_t> &vec, size_t pos, T val)
+{
+	memcpy(vec.data() + pos, &val, sizeof(val));
+}
+
 template<typename T,
 	 std::enable_if_t<std::is_arithmetic_v<T>> * = nullptr>
 T readPOD(std::vector<uint8_t>::const_iterator it, size_t pos,
@@ -69,6 +76,10 @@ class IPADataSerializer
 public:
 	static std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
 	serialize(const T &data, ControlSerializer *cs = nullptr);
+	static void serialize(const T &data, std::vector<uint8_t> *dataVec,
+			      std::vector<SharedFD> *fdsVec,
+			      ControlSerializer *cs = nullptr);
+	static size_t serializedSize(const T &data, ControlSerializer *cs = nullptr);
 
 	static T deserialize(const std::vector<uint8_t> &data,
 			     ControlSerializer *cs = nullptr);
@@ -88,6 +99,29 @@ public:
 
 #ifndef __DOXYGEN__
 
+namespace {
+
+/*
+ * Serialize an element of a container, prefixed with its size in bytes and
+ * its number of fds. The element is serialized in place, and the prefix
+ * patched once its size is known.
+ */
+template<typename T>
+void serializeElement(const T &data, std::vector<uint8_t> *dataVec,
+		      std::vector<SharedFD> *fdsVec, ControlSerializer *cs)
+{
+	size_t pos = dataVec->size();
+	size_t fds = fdsVec->size();
+
+	dataVec->resize(pos + 8);
+	IPADataSerializer<T>::serialize(data, dataVec, fdsVec, cs);
+
+	writePOD<uint32_t>(*dataVec, pos, dataVec->size() - pos - 8);
+	writePOD<uint32_t>(*dataVec, pos + 4, fdsVec->size() - fds);
+}
+
+} /* namespace */
+
 /*
  * Serialization format for vector of type V:
  *
@@ -111,26 +145,34 @@ public:
 		std::vector<uint8_t> dataVec;
 		std::vector<SharedFD> fdsVec;
 
+		dataVec.reserve(serializedSize(data, cs));
+		serialize(data, &dataVec, &fdsVec, cs);
+
+		return { std::move(dataVec), std::move(fdsVec) };
+	}
+
+	static void serialize(const std::vector<V> &data, std::vector<uint8_t> *dataVec,
+			      std::vector<SharedFD> *fdsVec, ControlSerializer *cs = nullptr)
+	{
 		/* Serialize the length. */
 		uint32_t vecLen = data.size();
-		appendPOD<uint32_t>(dataVec, vecLen);
+		appendPOD<uint32_t>(*dataVec, vecLen);
 
 		/* Serialize the members. */
-		for (auto const &it : data) {
-			std::vector<uint8_t> dvec;
-			std::vector<SharedFD> fvec;
-
-			std::tie(dvec, fvec) =
-				IPADataSerializer<V>::serialize(it, cs);
-
-			appendPOD<uint32_t>(dataVec, dvec.size());
-			appendPOD<uint32_t>(dataVec, fvec.size());
+		for (auto const &it : data)
+			serializeElement<V>(it, dataVec, fdsVec, cs);
+	}
 
-			dataVec.insert(dataVec.end(), dvec.begin(), dvec.end());
-			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
+	static size_t serializedSize(const std::vector<V> &data, ControlSerializer *cs = nullptr)
+	{
+		if constexpr (std::is_arithmetic_v<V>) {
+			return 4 + data.size() * (8 + sizeof(V));
+		} else {
+			size_t size = 4;
+			for (auto const &it : data)
+				size += 8 + IPADataSerializer<V>::serializedSize(it, cs);
+			return size;
 		}
-
-		return { dataVec, fdsVec };
 	}
 
 	static std::vector<V> deserialize(std::vector<uint8_t> &data, ControlSerializer *cs = nullptr)
@@ -208,35 +250,35 @@ public:
 		std::vector<uint8_t> dataVec;
 		std::vector<SharedFD> fdsVec;
 
+		dataVec.reserve(serializedSize(data, cs));
+		serialize(data, &dataVec, &fdsVec, cs);
+
+		return { std::move(dataVec), std::move(fdsVec) };
+	}
+
+	static void serialize(const std::map<K, V> &data, std::vector<uint8_t> *dataVec,
+			      std::vector<SharedFD> *fdsVec, ControlSerializer *cs = nullptr)
+	{
 		/* Serialize the length. */
 		uint32_t mapLen = data.size();
-		appendPOD<uint32_t>(dataVec, mapLen);
+		appendPOD<uint32_t>(*dataVec, mapLen);
 
 		/* Serialize the members. */
 		for (auto const &it : data) {
-			std::vector<uint8_t> dvec;
-			std::vector<SharedFD> fvec;
-
-			std::tie(dvec, fvec) =
-				IPADataSerializer<K>::serialize(it.first, cs);
-
-			appendPOD<uint32_t>(dataVec, dvec.size());
-			appendPOD<uint32_t>(dataVec, fvec.size());
-
-			dataVec.insert(dataVec.end(), dvec.begin(), dvec.end());
-			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
-
-			std::tie(dvec, fvec) =
-				IPADataSerializer<V>::serialize(it.second, cs);
+			serializeElement<K>(it.first, dataVec, fdsVec, cs);
+			serializeElement<V>(it.second, dataVec, fdsVec, cs);
+		}
+	}
 
-			appendPOD<uint32_t>(dataVec, dvec.size());
-			appendPOD<uint32_t>(dataVec, fvec.size());
+	static size_t serializedSize(const std::map<K, V> &data, ControlSerializer *cs = nullptr)
+	{
+		size_t size = 4;
 
-			dataVec.insert(dataVec.end(), dvec.begin(), dvec.end());
-			fdsVec.insert(fdsVec.end(), fvec.begin(), fvec.end());
-		}
+		for (auto const &it : data)
+			size += 16 + IPADataSerializer<K>::serializedSize(it.first, cs)
+			      + IPADataSerializer<V>::serializedSize(it.second, cs);
 
-		return { dataVec, fdsVec };
+		return size;
 	}
 
 	static std::map<K, V> deserialize(std::vector<uint8_t> &data, ControlSerializer *cs = nullptr)
@@ -311,10 +353,23 @@ public:
 	serialize(const Flags<E> &data, [[maybe_unused]] ControlSerializer *cs = nullptr)
 	{
 		std::vector<uint8_t> dataVec;
-		dataVec.reserve(sizeof(Flags<E>));
+		dataVec.reserve(sizeof(uint32_t));
 		appendPOD<uint32_t>(dataVec, static_cast<typename Flags<E>::Type>(data));
 
-		return { dataVec, {} };
+		return { std::move(dataVec), {} };
+	}
+
+	static void serialize(const Flags<E> &data, std::vector<uint8_t> *dataVec,
+			      [[maybe_unused]] std::vector<SharedFD> *fdsVec,
+			      [[maybe_unused]] ControlSerializer *cs = nullptr)
+	{
+		appendPOD<uint32_t>(*dataVec, static_cast<typename Flags<E>::Type>(data));
+	}
+
+	static size_t serializedSize([[maybe_unused]] const Flags<E> &data,
+				     [[maybe_unused]] ControlSerializer *cs = nullptr)
+	{
+		return sizeof(uint32_t);
 	}
 
 	static Flags<E> deserialize(std::vector<uint8_t> &data,
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <map>
 #include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 #include <vector>
 
 #include <libcamera/base/log.h>
@@ -69,6 +72,17 @@ private:
 	std::vector<IPAModule *> modules_;
 
 #if HAVE_IPA_PUBKEY
+	struct SignatureStatus {
+		dev_t dev;
+		ino_t ino;
+		off_t size;
+		struct timespec mtime;
+		struct timespec ctime;
+		bool valid;
+	};
+
+	mutable std::map<const IPAModule *, SignatureStatus> signatures_;
+
 	static const uint8_t publicKeyData_[];
 	static const PubKey pubKey_;
 #endif
@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+#include <libcamera/base/utils.h>
+
 #include <libcamera/ipa/ipa_interface.h>
 
 namespace libcamera {
@@ -26,6 +30,11 @@ public:
 		ProxyRunning,
 	};
 
+	struct Statistics {
+		uint64_t calls;
+		utils::Duration processingTime;
+	};
+
 	IPAProxy(IPAModule *ipam);
 	~IPAProxy();
 
@@ -33,14 +42,20 @@ public:
 
 	std::string configurationFile(const std::string &file) const;
 
+	Statistics statistics() const;
+
 protected:
 	std::string resolvePath(const std::string &file) const;
+	void recordCall(utils::Duration duration);
 
 	bool valid_;
 	ProxyState state_;
 
 private:
 	IPAModule *ipam_;
+
+	std::atomic<uint64_t> calls_;
+	std::atomic<uint64_t> processingTime_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * System call restrictions for isolated IPA modules
+ */
+
+#pragma once
+
+namespace libcamera {
+
+class IPASandbox
+{
+public:
+	static int enter();
+};
+
+} /* namespace libcamera */
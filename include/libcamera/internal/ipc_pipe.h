@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 #include <libcamera/base/shared_fd.h>
@@ -16,6 +18,38 @@
 
 namespace libcamera {
 
+class IPCFdTable
+{
+public:
+	IPCFdTable();
+
+	void encode(const std::vector<SharedFD> &fds,
+		    IPCUnixSocket::Payload *payload);
+	int decode(IPCUnixSocket::Payload &payload, size_t *offset,
+		   std::vector<SharedFD> *fds);
+
+	void clear();
+
+private:
+	static constexpr uint32_t kNewHandle = 1u << 31;
+	static constexpr size_t kMaxEntries = 64;
+
+	struct Entry {
+		uint32_t handle;
+		SharedFD fd;
+		uint64_t lastUse;
+	};
+
+	void evict();
+
+	std::unordered_map<int, Entry> sent_;
+	std::unordered_map<uint32_t, SharedFD> received_;
+	std::vector<uint32_t> released_;
+
+	uint32_t nextHandle_;
+	uint64_t useCount_;
+};
+
 class IPCMessage
 {
 public:
@@ -24,12 +58,18 @@ public:
 		uint32_t cookie;
 	};
 
+	static constexpr uint32_t kCmdBatch = 0xffffffff;
+
 	IPCMessage();
 	IPCMessage(uint32_t cmd);
 	IPCMessage(const Header &header);
-	IPCMessage(IPCUnixSocket::Payload &payload);
+	IPCMessage(IPCUnixSocket::Payload &payload,
+		   IPCFdTable *fdTable = nullptr);
+
+	IPCUnixSocket::Payload payload(IPCFdTable *fdTable = nullptr) const;
 
-	IPCUnixSocket::Payload payload() const;
+	void append(const IPCMessage &message);
+	std::vector<IPCMessage> split() const;
 
 	Header &header() { return header_; }
 	std::vector<uint8_t> &data() { return data_; }
@@ -40,6 +80,12 @@ public:
 	const std::vector<SharedFD> &fds() const { return fds_; }
 
 private:
+	struct BatchEntry {
+		Header header;
+		uint32_t dataSize;
+		uint32_t numFds;
+	};
+
 	Header header_;
 
 	std::vector<uint8_t> data_;
@@ -59,10 +105,17 @@ public:
 
 	virtual int sendAsync(const IPCMessage &data) = 0;
 
+	void queueAsync(const IPCMessage &data);
+	bool hasQueued() const { return !batch_.data().empty(); }
+	int flush();
+
 	Signal<const IPCMessage &> recv;
 
 protected:
 	bool connected_;
+
+private:
+	IPCMessage batch_;
 };
 
 } /* namespace libcamera */
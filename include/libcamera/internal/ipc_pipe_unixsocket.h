@@ -9,6 +9,7 @@
 
 #include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "libcamera/internal/ipc_pipe.h"
@@ -29,6 +30,8 @@ public:
 
 	int sendAsync(const IPCMessage &data) override;
 
+	void clearFdTable() { fdTable_.clear(); }
+
 private:
 	struct CallData {
 		IPCUnixSocket::Payload *response;
@@ -39,9 +42,11 @@ private:
 	int call(const IPCUnixSocket::Payload &message,
 		 IPCUnixSocket::Payload *response, uint32_t seq);
 
+	std::string spareKey_;
 	std::unique_ptr<Process> proc_;
 	std::unique_ptr<IPCUnixSocket> socket_;
 	std::map<uint32_t, CallData> callData_;
+	IPCFdTable fdTable_;
 };
 
 } /* namespace libcamera */
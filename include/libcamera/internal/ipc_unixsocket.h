@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <memory>
 #include <stdint.h>
 #include <sys/types.h>
 #include <vector>
@@ -17,6 +18,7 @@
 namespace libcamera {
 
 class EventNotifier;
+class SharedMem;
 
 class IPCUnixSocket
 {
@@ -34,26 +36,52 @@ public:
 	void close();
 	bool isBound() const;
 
+	int setupSharedMemory();
+
 	int send(const Payload &payload);
 	int receive(Payload *payload);
 
 	Signal<> readyRead;
 
 private:
+	enum MessageType : uint8_t {
+		MessageSocket = 0,
+		MessageRing = 1,
+		MessageSetup = 2,
+	};
+
 	struct Header {
 		uint32_t data;
 		uint8_t fds;
+		uint8_t type;
 	};
 
+	struct Ring;
+	struct Rings;
+
 	int sendData(const void *buffer, size_t length, const int32_t *fds, unsigned int num);
 	int recvData(void *buffer, size_t length, int32_t *fds, unsigned int num);
 
+	int sendRing(const Payload &payload);
+	int receiveRing(Payload *payload);
+	int recvHeader();
+	void mapSharedMemory();
+	void closeFds();
+	void releaseSharedMemory();
+
 	void dataNotifier();
 
 	UniqueFD fd_;
 	bool headerReceived_;
 	struct Header header_;
+	std::vector<int32_t> fds_;
 	EventNotifier *notifier_;
+
+	std::unique_ptr<SharedMem> mem_;
+	Ring *tx_;
+	Ring *rx_;
+	uint64_t txHead_;
+	uint64_t rxTail_;
 };
 
 } /* namespace libcamera */
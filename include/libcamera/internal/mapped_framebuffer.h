@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <memory>
 #include <stdint.h>
 #include <vector>
 
@@ -16,8 +17,12 @@
 
 #include <libcamera/framebuffer.h>
 
+#include "libcamera/internal/dma_buf_allocator.h"
+
 namespace libcamera {
 
+class FrameBufferMapping;
+
 class MappedBuffer
 {
 public:
@@ -50,11 +55,21 @@ public:
 		Read = 1 << 0,
 		Write = 1 << 1,
 		ReadWrite = Read | Write,
+		Sync = 1 << 2,
 	};
 
 	using MapFlags = Flags<MapFlag>;
 
 	MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags);
+
+	void beginAccess();
+	void endAccess();
+
+private:
+	std::shared_ptr<FrameBufferMapping> mapping_;
+	std::vector<SharedFD> fds_;
+	DmaSyncer::SyncType syncType_ = DmaSyncer::SyncType::Read;
+	std::vector<DmaSyncer> syncers_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(MappedFrameBuffer::MapFlag)
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -22,6 +23,8 @@
 
 namespace libcamera {
 
+class MediaRequest;
+
 class MediaDevice : protected Loggable
 {
 public:
@@ -41,6 +44,8 @@ public:
 	const std::string &driver() const { return driver_; }
 	const std::string &deviceNode() const { return deviceNode_; }
 	const std::string &model() const { return model_; }
+	const std::string &serial() const { return serial_; }
+	const std::string &busInfo() const { return busInfo_; }
 	unsigned int version() const { return version_; }
 	unsigned int hwRevision() const { return hwRevision_; }
 
@@ -54,6 +59,8 @@ public:
 	MediaLink *link(const MediaPad *source, const MediaPad *sink);
 	int disableLinks();
 
+	std::unique_ptr<MediaRequest> allocateRequest();
+
 	Signal<> disconnected;
 
 protected:
@@ -80,6 +87,8 @@ private:
 	std::string driver_;
 	std::string deviceNode_;
 	std::string model_;
+	std::string serial_;
+	std::string busInfo_;
 	unsigned int version_;
 	unsigned int hwRevision_;
 
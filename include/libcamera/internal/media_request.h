@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Media Controller request
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/unique_fd.h>
+
+namespace libcamera {
+
+class EventNotifier;
+class MediaDevice;
+
+class MediaRequest
+{
+public:
+	enum class Status {
+		Idle,
+		Queued,
+		Complete,
+	};
+
+	MediaRequest(MediaDevice *media, UniqueFD fd);
+	~MediaRequest();
+
+	MediaDevice *media() const { return media_; }
+	int fd() const { return fd_.get(); }
+	Status status() const { return status_; }
+
+	int queue();
+	int reinit();
+
+	Signal<MediaRequest *> completed;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MediaRequest)
+
+	void requestReady();
+
+	MediaDevice *media_;
+	UniqueFD fd_;
+	std::unique_ptr<EventNotifier> notifier_;
+	Status status_;
+};
+
+} /* namespace libcamera */
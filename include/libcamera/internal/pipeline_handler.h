@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <queue>
 #include <set>
@@ -27,12 +28,14 @@ namespace libcamera {
 class Camera;
 class CameraConfiguration;
 class CameraManager;
+class CameraStatistics;
 class DeviceEnumerator;
 class DeviceMatch;
 class FrameBuffer;
 class MediaDevice;
 class PipelineHandler;
 class Request;
+class V4L2VideoDevice;
 
 class PipelineHandler : public std::enable_shared_from_this<PipelineHandler>,
 			public Object
@@ -45,7 +48,7 @@ public:
 	MediaDevice *acquireMediaDevice(DeviceEnumerator *enumerator,
 					const DeviceMatch &dm);
 
-	bool acquire();
+	bool acquire(Camera *camera);
 	void release(Camera *camera);
 
 	virtual std::unique_ptr<CameraConfiguration> generateConfiguration(Camera *camera,
@@ -61,10 +64,13 @@ public:
 
 	void registerRequest(Request *request);
 	void queueRequest(Request *request);
+	void queueRequests(const std::vector<Request *> &requests);
 
 	bool completeBuffer(Request *request, FrameBuffer *buffer);
 	void completeRequest(Request *request);
 
+	CameraStatistics statistics(Camera *camera);
+
 	std::string configurationFile(const std::string &subdir,
 				      const std::string &name) const;
 
@@ -77,8 +83,19 @@ protected:
 	virtual int queueRequestDevice(Camera *camera, Request *request) = 0;
 	virtual void stopDevice(Camera *camera) = 0;
 
+	virtual bool acquireDevice(Camera *camera);
 	virtual void releaseDevice(Camera *camera);
 
+	virtual void statisticsDevice(Camera *camera,
+				      std::map<std::string, uint64_t> *counters);
+
+	static void addStatistics(std::map<std::string, uint64_t> *counters,
+				  const std::string &name,
+				  const IPAProxy *ipa);
+	static void addStatistics(std::map<std::string, uint64_t> *counters,
+				  const std::string &name,
+				  const V4L2VideoDevice *video);
+
 	CameraManager *manager_;
 
 private:
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <list>
+#include <map>
+#include <memory>
 #include <signal.h>
 #include <string>
 #include <vector>
@@ -17,6 +20,7 @@
 namespace libcamera {
 
 class EventNotifier;
+class IPCUnixSocket;
 
 class Process final
 {
@@ -68,12 +72,25 @@ public:
 
 	const struct sigaction &oldsa() const;
 
+	void addSpare(const std::string &key, std::unique_ptr<Process> process,
+		      std::unique_ptr<IPCUnixSocket> socket);
+	bool takeSpare(const std::string &key, std::unique_ptr<Process> *process,
+		       std::unique_ptr<IPCUnixSocket> *socket);
+	void releaseSpare(const std::string &key);
+
 private:
+	struct Spare {
+		std::unique_ptr<Process> process;
+		std::unique_ptr<IPCUnixSocket> socket;
+	};
+
 	static ProcessManager *self_;
 
 	void sighandler();
 
 	std::list<Process *> processes_;
+	std::map<std::string, Spare> spares_;
+	std::map<std::string, unsigned int> spareUsers_;
 
 	struct sigaction oldsa_;
 
@@ -8,11 +8,14 @@
 #pragma once
 
 #include <chrono>
-#include <map>
 #include <memory>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/timer.h>
+#include <libcamera/base/unique_fd.h>
 
 #include <libcamera/request.h>
 
@@ -22,6 +25,7 @@ namespace libcamera {
 
 class Camera;
 class FrameBuffer;
+class Stream;
 
 class Request::Private : public Extensible::Private
 {
@@ -35,9 +39,11 @@ public:
 	bool hasPendingBuffers() const;
 
 	bool completeBuffer(FrameBuffer *buffer);
+	void skipBuffer(const Stream *stream);
 	void complete();
 	void cancel();
 	void reset();
+	void reserve(const std::set<const Stream *> &streams);
 
 	void prepare(std::chrono::milliseconds timeout = 0ms);
 	Signal<> prepared;
@@ -48,7 +54,9 @@ private:
 
 	void doCancelRequest();
 	void emitPrepareCompleted();
-	void notifierActivated(FrameBuffer *buffer);
+	bool processFences();
+	void fencesActivated();
+	void abortFences();
 	void timeout();
 
 	Camera *camera_;
@@ -56,8 +64,13 @@ private:
 	uint32_t sequence_ = 0;
 	bool prepared_ = false;
 
-	std::unordered_set<FrameBuffer *> pending_;
-	std::map<FrameBuffer *, std::unique_ptr<EventNotifier>> notifiers_;
+	std::vector<FrameBuffer *> pending_;
+	std::vector<Request::BufferMap::node_type> spareNodes_;
+	std::vector<Request::BufferMap::node_type> skippedNodes_;
+	std::vector<std::pair<const Stream *, FrameBuffer *>> streamBuffers_;
+	UniqueFD fencesFd_;
+	unsigned int pendingFences_ = 0;
+	std::unique_ptr<EventNotifier> notifier_;
 	std::unique_ptr<Timer> timer_;
 };
 
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * CPU based format converter
+ */
+
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/object.h>
+#include <libcamera/base/semaphore.h>
+#include <libcamera/base/span.h>
+#include <libcamera/base/thread.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+#include "libcamera/internal/converter.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+
+namespace libcamera {
+
+class FrameBuffer;
+class MappedBufferCache;
+struct StreamConfiguration;
+
+class ConverterCpu : public Converter, public Object
+{
+public:
+	/* Max. number of output streams */
+	static constexpr unsigned int kMaxStreams = 3;
+
+	ConverterCpu();
+	~ConverterCpu();
+
+	int loadConfiguration([[maybe_unused]] const std::string &filename) { return 0; }
+	bool isValid() const { return dmaHeap_.isValid(); }
+
+	std::vector<PixelFormat> formats(PixelFormat input);
+	SizeRange sizes(const Size &input);
+
+	std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &pixelFormat, const Size &size);
+
+	int configure(const StreamConfiguration &inputCfg,
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs);
+	int exportBuffers(unsigned int output, unsigned int count,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
+	int start();
+	void stop();
+
+	int queueBuffers(FrameBuffer *input, Span<FrameBuffer *const> outputs);
+
+private:
+	/* Max. number of stripes processed concurrently */
+	static constexpr unsigned int kMaxStripes = 8;
+
+	struct Output;
+
+	/*
+	 * Called to produce the lines [begin, end) of \a output from the input
+	 * planes \a in to the output planes \a out.
+	 */
+	using ConvertFn = void (*)(const Output &output,
+				   const std::array<const uint8_t *, 2> &in,
+				   unsigned int inStride,
+				   const std::array<uint8_t *, 2> &out,
+				   unsigned int begin, unsigned int end);
+
+	struct Output {
+		PixelFormat format;
+		Size size;
+		unsigned int stride;
+		std::vector<unsigned int> planeSizes;
+		/* Input column and line sampled by each output pixel */
+		std::vector<unsigned int> xMap;
+		std::vector<unsigned int> yMap;
+		ConvertFn convert;
+	};
+
+	struct Job {
+		FrameBuffer *input;
+		std::array<FrameBuffer *, kMaxStreams> outputs;
+	};
+
+	class Worker : public Object
+	{
+	public:
+		Worker(ConverterCpu *converter)
+			: converter_(converter)
+		{
+		}
+
+		void process(Job job);
+		void sync() {}
+
+	private:
+		ConverterCpu *converter_;
+	};
+
+	class StripeWorker : public Object
+	{
+	public:
+		StripeWorker(ConverterCpu *converter)
+			: converter_(converter)
+		{
+		}
+
+		void process(unsigned int stripe);
+
+	private:
+		ConverterCpu *converter_;
+	};
+
+	template<typename Src>
+	static ConvertFn convertFn(const PixelFormat &format, bool scaled);
+
+	template<typename Src, bool scaled>
+	static void convertNV12(const Output &output,
+				const std::array<const uint8_t *, 2> &in,
+				unsigned int inStride,
+				const std::array<uint8_t *, 2> &out,
+				unsigned int begin, unsigned int end);
+	template<typename Src, bool scaled>
+	static void convertYUYV(const Output &output,
+				const std::array<const uint8_t *, 2> &in,
+				unsigned int inStride,
+				const std::array<uint8_t *, 2> &out,
+				unsigned int begin, unsigned int end);
+	template<typename Src, unsigned int R, unsigned int B, bool scaled>
+	static void convertRGB(const Output &output,
+			       const std::array<const uint8_t *, 2> &in,
+			       unsigned int inStride,
+			       const std::array<uint8_t *, 2> &out,
+			       unsigned int begin, unsigned int end);
+	static void copy(const Output &output,
+			 const std::array<const uint8_t *, 2> &in,
+			 unsigned int inStride,
+			 const std::array<uint8_t *, 2> &out,
+			 unsigned int begin, unsigned int end);
+
+	ConvertFn selectConvertFn(const PixelFormat &format, bool scaled) const;
+	void configureStripes();
+
+	void process(const Job &job);
+	void processStripe(unsigned int stripe);
+	void jobDone(Job job);
+	void dispatchJob();
+	void cancelJob(const Job &job);
+
+	DmaBufAllocator dmaHeap_;
+
+	PixelFormat inputFormat_;
+	Size inputSize_;
+	unsigned int inputStride_;
+	std::vector<Output> outputs_;
+
+	/* The planes of the frame being processed */
+	std::array<const uint8_t *, 2> inputPlanes_;
+	std::array<std::array<uint8_t *, 2>, kMaxStreams> outputPlanes_;
+
+	std::unique_ptr<MappedBufferCache> inputMappings_;
+	std::unique_ptr<MappedBufferCache> outputMappings_;
+
+	unsigned int maxStripes_;
+	unsigned int stripeCount_;
+	std::vector<std::unique_ptr<Thread>> stripeThreads_;
+	std::vector<std::unique_ptr<StripeWorker>> stripeWorkers_;
+	Semaphore stripesDone_;
+
+	Thread thread_;
+	std::unique_ptr<Worker> worker_;
+
+	std::deque<Job> pendingJobs_;
+	bool busy_;
+	bool running_;
+};
+
+} /* namespace libcamera */
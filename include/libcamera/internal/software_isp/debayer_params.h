@@ -17,12 +17,31 @@ namespace libcamera {
 
 struct DebayerParams {
 	static constexpr unsigned int kRGBLookupSize = 256;
+	static constexpr unsigned int kGammaLookupSize = 1024;
+
+	struct CcmColumn {
+		int16_t r;
+		int16_t g;
+		int16_t b;
+	};
 
 	using ColorLookupTable = std::array<uint8_t, kRGBLookupSize>;
+	using CcmLookupTable = std::array<CcmColumn, kRGBLookupSize>;
+	using GammaLookupTable = std::array<uint8_t, kGammaLookupSize>;
 
 	ColorLookupTable red;
 	ColorLookupTable green;
 	ColorLookupTable blue;
+
+	bool ccmEnabled;
+	CcmLookupTable redCcm;
+	CcmLookupTable greenCcm;
+	CcmLookupTable blueCcm;
+	GammaLookupTable gammaLut;
 };
 
+static constexpr unsigned int kDebayerParamsBufferCount = 4;
+
+using DebayerParamsBuffers = std::array<DebayerParams, kDebayerParamsBufferCount>;
+
 } /* namespace libcamera */
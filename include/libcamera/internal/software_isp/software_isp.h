@@ -7,21 +7,27 @@
 
 #pragma once
 
+#include <array>
+#include <deque>
 #include <functional>
 #include <initializer_list>
-#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 #include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
+#include <libcamera/transform.h>
 
 #include <libcamera/ipa/soft_ipa_interface.h>
 #include <libcamera/ipa/soft_ipa_proxy.h>
@@ -34,7 +40,7 @@
 
 namespace libcamera {
 
-class DebayerCpu;
+class Debayer;
 class FrameBuffer;
 class PixelFormat;
 struct StreamConfiguration;
@@ -44,9 +50,19 @@ LOG_DECLARE_CATEGORY(SoftwareIsp)
 class SoftwareIsp
 {
 public:
-	SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor);
+	struct Statistics {
+		uint64_t framesProcessed;
+		uint64_t framesDropped;
+		utils::Duration processingTime;
+		IPAProxy::Statistics ipa;
+	};
+
+	SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor,
+		    bool lazyIPA = false);
 	~SoftwareIsp();
 
+	int loadIPA();
+
 	int loadConfiguration([[maybe_unused]] const std::string &filename) { return 0; }
 
 	bool isValid() const;
@@ -60,38 +76,89 @@ public:
 
 	int configure(const StreamConfiguration &inputCfg,
 		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
-		      const ControlInfoMap &sensorControls);
+		      const ControlInfoMap &sensorControls,
+		      Transform transform = Transform::Identity);
+
+	unsigned int maxOutputs() const;
+	bool supportsTransform(Transform transform) const;
+	Rectangle cropWindow(const Rectangle &crop) const;
 
 	int exportBuffers(unsigned int output, unsigned int count,
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 
-	void processStats(const ControlList &sensorControls);
+	void processStats(const uint32_t frame, const uint32_t bufferId,
+			  const ControlList &sensorControls);
 
 	int start();
 	void stop();
 
-	int queueBuffers(FrameBuffer *input,
-			 const std::map<unsigned int, FrameBuffer *> &outputs);
+	int queueBuffers(FrameBuffer *input, Span<FrameBuffer *const> outputs,
+			 const Rectangle &crop = {});
+	void queueStats(FrameBuffer *input);
+
+	void process(FrameBuffer *input, FrameBuffer *output,
+		     FrameBuffer *secondary = nullptr,
+		     const Rectangle &crop = {});
 
-	void process(FrameBuffer *input, FrameBuffer *output);
+	Statistics statistics();
 
 	Signal<FrameBuffer *> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
-	Signal<> ispStatsReady;
+	Signal<uint32_t, uint32_t> ispStatsReady;
 	Signal<const ControlList &> setSensorControls;
 
 private:
-	void saveIspParams();
+	/* Frames waiting for processing when a drop policy is selected */
+	static constexpr unsigned int kDefaultQueueDepth = 2;
+
+	enum class DropPolicy {
+		None,
+		DropOldest,
+		DropNewest,
+		StatsOnly,
+	};
+
+	/* A frame waiting for processing, \a params is null for statistics only */
+	struct Job {
+		FrameBuffer *input;
+		FrameBuffer *output;
+		FrameBuffer *secondary;
+		const DebayerParams *params;
+		Rectangle crop;
+	};
+
+	std::unique_ptr<Debayer> createDebayer();
+	void parseDropPolicy();
+
+	void dispatchJob() LIBCAMERA_TSA_REQUIRES(lock_);
+	void trimJobs(std::vector<Job> *dropped) LIBCAMERA_TSA_REQUIRES(lock_);
+	void cancelJob(const Job &job);
+
+	void saveIspParams(uint32_t frame, uint32_t bufferId);
 	void setSensorCtrls(const ControlList &sensorControls);
-	void statsReady();
+	void statsReady(uint32_t frame, uint32_t bufferId);
 	void inputReady(FrameBuffer *input);
 	void outputReady(FrameBuffer *output);
 
-	std::unique_ptr<DebayerCpu> debayer_;
+	PipelineHandler *pipe_;
+	const CameraSensor *sensor_;
+
+	std::unique_ptr<Debayer> debayer_;
 	Thread ispWorkerThread_;
-	SharedMemObject<DebayerParams> sharedParams_;
-	DebayerParams debayerParams_;
+	SharedMemObject<DebayerParamsBuffers> sharedParams_;
+	std::array<std::optional<uint32_t>, kDebayerParamsBufferCount> paramsFrames_;
+	unsigned int lastParamsBufferId_;
 	DmaBufAllocator dmaHeap_;
+	unsigned int numOutputs_;
+
+	DropPolicy dropPolicy_;
+	unsigned int maxQueuedFrames_;
+
+	Mutex lock_;
+	std::deque<Job> pendingJobs_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	bool busy_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	bool running_ LIBCAMERA_TSA_GUARDED_BY(lock_);
+	uint64_t framesDropped_ LIBCAMERA_TSA_GUARDED_BY(lock_);
 
 	std::unique_ptr<ipa::soft::IPAProxySoft> ipa_;
 };
@@ -44,6 +44,47 @@ struct SwIspStats {
 	 * \brief A histogram of luminance values
 	 */
 	Histogram yHistogram;
+	/**
+	 * \brief Number of zone columns in the zones grid
+	 */
+	static constexpr unsigned int kZoneGridWidth = 16;
+	/**
+	 * \brief Number of zone rows in the zones grid
+	 */
+	static constexpr unsigned int kZoneGridHeight = 12;
+	/**
+	 * \brief Sums of the sampled pixels in a zone of the statistics window
+	 *
+	 * The sums are expressed in the same units as sumR_, sumG_ and sumB_,
+	 * the zone means are obtained by dividing them by the count of samples.
+	 */
+	struct Zone {
+		uint32_t sumR;
+		uint32_t sumG;
+		uint32_t sumB;
+		uint32_t count;
+	};
+	/**
+	 * \brief Grid of zones covering the statistics window, in raster order
+	 *
+	 * The zones are only filled when enabled with SwStatsCpu::setSampling(),
+	 * and are all zero otherwise.
+	 */
+	std::array<Zone, kZoneGridWidth * kZoneGridHeight> zones;
 };
 
+/**
+ * \brief Number of statistics buffers shared between the Software ISP and IPA
+ *
+ * Statistics for a frame are stored in the buffer at index (frame sequence %
+ * kSwIspStatsBufferCount). The IPA shall process the statistics before the
+ * buffer gets reused kSwIspStatsBufferCount frames later.
+ */
+static constexpr unsigned int kSwIspStatsBufferCount = 4;
+
+/**
+ * \brief Ring of statistics buffers shared between the Software ISP and IPA
+ */
+using SwIspStatsBuffers = std::array<SwIspStats, kSwIspStatsBufferCount>;
+
 } /* namespace libcamera */
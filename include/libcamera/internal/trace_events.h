@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * In-process tracing backend with Chrome trace events
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+
+#include <sys/types.h>
+
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class TraceEventType
+{
+public:
+	enum Phase {
+		Instant,
+		Begin,
+		End,
+		AsyncBegin,
+		AsyncEnd,
+	};
+
+	TraceEventType(const char *name);
+
+	const char *name() const { return name_; }
+	const std::string &spanName() const { return spanName_; }
+	Phase phase() const { return phase_; }
+
+private:
+	const char *name_;
+	std::string spanName_;
+	Phase phase_;
+};
+
+class TraceEvent
+{
+public:
+	TraceEvent(const TraceEventType &type);
+
+	template<typename T,
+		 std::enable_if_t<std::is_integral_v<T>> * = nullptr>
+	void addArg(const char *name, T value)
+	{
+		if constexpr (std::is_signed_v<T>)
+			addSigned(name, value);
+		else
+			addUnsigned(name, value);
+	}
+
+	void addArg(const char *name, const char *value);
+	void addArgHex(const char *name, uint64_t value);
+	void addArgEnum(const char *name, const char *str, int64_t value);
+
+	void commit();
+
+private:
+	void addSigned(const char *name, int64_t value);
+	void addUnsigned(const char *name, uint64_t value);
+	void addKey(const char *name);
+
+	const TraceEventType &type_;
+	utils::time_point timestamp_;
+	std::string args_;
+	uint64_t id_;
+};
+
+class TraceEvents
+{
+public:
+	static TraceEvents *instance();
+	static bool enabled();
+
+	pid_t pid() const { return pid_; }
+
+	void write(const std::string &event, pid_t tid);
+
+private:
+	TraceEvents();
+	~TraceEvents();
+
+	void flush() LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	std::atomic<bool> enabled_;
+	FILE *file_;
+	pid_t pid_;
+
+	Mutex mutex_;
+	std::string buffer_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::unordered_set<pid_t> threads_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
+
+/*
+ * Translate the lttng tracepoint definitions to inline functions that record
+ * trace events. Every tracepoint becomes a libcamera::trace_events::<name>()
+ * function, and every event class a function shared by its instances.
+ */
+
+#define _TP_NARGS(...) _TP_NARGS_(__VA_ARGS__, 20, 19, 18, 17, 16, 15, 14, \
+				  13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define _TP_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, \
+		   _14, _15, _16, _17, _18, _19, _20, N, ...) N
+
+#define _TP_CAT(a, b) _TP_CAT_(a, b)
+#define _TP_CAT_(a, b) a##b
+
+#define _TP_PARAMS(...) _TP_CAT(_TP_PARAMS_, _TP_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define _TP_PARAMS_2(t, n) t n
+#define _TP_PARAMS_4(t, n, ...) t n, _TP_PARAMS_2(__VA_ARGS__)
+#define _TP_PARAMS_6(t, n, ...) t n, _TP_PARAMS_4(__VA_ARGS__)
+#define _TP_PARAMS_8(t, n, ...) t n, _TP_PARAMS_6(__VA_ARGS__)
+#define _TP_PARAMS_10(t, n, ...) t n, _TP_PARAMS_8(__VA_ARGS__)
+#define _TP_PARAMS_12(t, n, ...) t n, _TP_PARAMS_10(__VA_ARGS__)
+#define _TP_PARAMS_14(t, n, ...) t n, _TP_PARAMS_12(__VA_ARGS__)
+#define _TP_PARAMS_16(t, n, ...) t n, _TP_PARAMS_14(__VA_ARGS__)
+#define _TP_PARAMS_18(t, n, ...) t n, _TP_PARAMS_16(__VA_ARGS__)
+#define _TP_PARAMS_20(t, n, ...) t n, _TP_PARAMS_18(__VA_ARGS__)
+
+#define _TP_NAMES(...) _TP_CAT(_TP_NAMES_, _TP_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define _TP_NAMES_2(t, n) n
+#define _TP_NAMES_4(t, n, ...) n, _TP_NAMES_2(__VA_ARGS__)
+#define _TP_NAMES_6(t, n, ...) n, _TP_NAMES_4(__VA_ARGS__)
+#define _TP_NAMES_8(t, n, ...) n, _TP_NAMES_6(__VA_ARGS__)
+#define _TP_NAMES_10(t, n, ...) n, _TP_NAMES_8(__VA_ARGS__)
+#define _TP_NAMES_12(t, n, ...) n, _TP_NAMES_10(__VA_ARGS__)
+#define _TP_NAMES_14(t, n, ...) n, _TP_NAMES_12(__VA_ARGS__)
+#define _TP_NAMES_16(t, n, ...) n, _TP_NAMES_14(__VA_ARGS__)
+#define _TP_NAMES_18(t, n, ...) n, _TP_NAMES_16(__VA_ARGS__)
+#define _TP_NAMES_20(t, n, ...) n, _TP_NAMES_18(__VA_ARGS__)
+
+#define TP_ARGS(...) (__VA_ARGS__)
+#define TP_FIELDS(...) __VA_ARGS__
+#define TP_ENUM_VALUES(...) __VA_ARGS__
+
+#define ctf_integer(type, field, expr) \
+	_event.addArg(#field, static_cast<type>(expr));
+#define ctf_integer_hex(type, field, expr) \
+	_event.addArgHex(#field, static_cast<type>(expr));
+#define ctf_string(field, expr) \
+	_event.addArg(#field, static_cast<const char *>(expr));
+#define ctf_enum(provider, name, type, field, expr) \
+	_event.addArgEnum(#field, \
+			  ::libcamera::trace_events::enum_##name(static_cast<int64_t>(expr)), \
+			  static_cast<type>(expr));
+#define ctf_enum_value(str, value) \
+	case value:                \
+		return str;
+
+#define TRACEPOINT_ENUM(provider, name, values)                             \
+	namespace libcamera::trace_events {                                 \
+	inline const char *enum_##name(int64_t value)                       \
+	{                                                                   \
+		switch (value) {                                            \
+			values                                              \
+		default:                                                    \
+			return nullptr;                                     \
+		}                                                           \
+	}                                                                   \
+	}
+
+#define TRACEPOINT_EVENT_CLASS(provider, cls, args, fields)                 \
+	namespace libcamera::trace_events {                                 \
+	inline void cls##_class(const ::libcamera::TraceEventType &_type,   \
+				_TP_PARAMS args)                            \
+	{                                                                   \
+		if (!::libcamera::TraceEvents::enabled())                   \
+			return;                                             \
+		::libcamera::TraceEvent _event(_type);                      \
+		fields                                                      \
+		_event.commit();                                            \
+	}                                                                   \
+	}
+
+#define TRACEPOINT_EVENT_INSTANCE(provider, cls, name, args)                \
+	namespace libcamera::trace_events {                                 \
+	inline void name(_TP_PARAMS args)                                   \
+	{                                                                   \
+		static const ::libcamera::TraceEventType _type(#name);      \
+		cls##_class(_type, _TP_NAMES args);                         \
+	}                                                                   \
+	}
+
+#define TRACEPOINT_EVENT(provider, name, args, fields)                      \
+	TRACEPOINT_EVENT_CLASS(provider, name, args, fields)                \
+	TRACEPOINT_EVENT_INSTANCE(provider, name, name, args)
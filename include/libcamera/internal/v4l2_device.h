@@ -27,6 +27,8 @@
 namespace libcamera {
 
 class EventNotifier;
+class MediaRequest;
+class Thread;
 
 class V4L2Device : protected Loggable
 {
@@ -37,7 +39,7 @@ public:
 	const ControlInfoMap &controls() const { return controls_; }
 
 	ControlList getControls(const std::vector<uint32_t> &ids);
-	int setControls(ControlList *ctrls);
+	int setControls(ControlList *ctrls, MediaRequest *request = nullptr);
 
 	const struct v4l2_query_ext_ctrl *controlInfo(uint32_t id) const;
 
@@ -45,6 +47,7 @@ public:
 	std::string devicePath() const;
 
 	int setFrameStartEnabled(bool enable);
+	int setFrameStartThreadEnabled(bool enable);
 	Signal<uint32_t> frameStart;
 
 	void updateControlInfo();
@@ -88,6 +91,7 @@ private:
 
 	EventNotifier *fdEventNotifier_;
 	bool frameStartEnabled_;
+	std::unique_ptr<Thread> frameStartThread_;
 };
 
 } /* namespace libcamera */
@@ -7,10 +7,12 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <linux/v4l2-subdev.h>
@@ -183,6 +185,8 @@ private:
 
 	std::string model_;
 	struct V4L2SubdeviceCapability caps_;
+
+	std::map<std::pair<unsigned int, unsigned int>, Formats> formatsCache_;
 };
 
 bool operator==(const V4L2Subdevice::Stream &lhs, const V4L2Subdevice::Stream &rhs);
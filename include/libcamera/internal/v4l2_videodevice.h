@@ -9,17 +9,20 @@
 
 #include <array>
 #include <atomic>
+#include <map>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <linux/videodev2.h>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/flags.h>
 #include <libcamera/base/log.h>
 #include <libcamera/base/signal.h>
 #include <libcamera/base/timer.h>
@@ -40,6 +43,7 @@ namespace libcamera {
 class EventNotifier;
 class MediaDevice;
 class MediaEntity;
+class MediaRequest;
 
 struct V4L2Capability final : v4l2_capability {
 	const char *driver() const
@@ -124,6 +128,12 @@ struct V4L2Capability final : v4l2_capability {
 class V4L2BufferCache
 {
 public:
+	struct Statistics {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+	};
+
 	V4L2BufferCache(unsigned int numEntries);
 	V4L2BufferCache(const std::vector<std::unique_ptr<FrameBuffer>> &buffers);
 	~V4L2BufferCache();
@@ -131,6 +141,9 @@ public:
 	bool isEmpty() const;
 	int get(const FrameBuffer &buffer);
 	void put(unsigned int index);
+	int pin(const FrameBuffer &buffer);
+
+	const Statistics &statistics() const { return stats_; }
 
 private:
 	class Entry
@@ -140,9 +153,12 @@ private:
 		Entry(bool free, uint64_t lastUsed, const FrameBuffer &buffer);
 
 		bool operator==(const FrameBuffer &buffer) const;
+		bool empty() const { return planes_.empty(); }
 
 		bool free_;
+		bool pinned_;
 		uint64_t lastUsed_;
+		uint64_t key_;
 
 	private:
 		struct Plane {
@@ -158,10 +174,13 @@ private:
 		std::vector<Plane> planes_;
 	};
 
+	static uint64_t key(const FrameBuffer &buffer);
+	void assign(unsigned int index, const FrameBuffer &buffer, bool free);
+
 	std::atomic<uint64_t> lastUsedCounter_;
 	std::vector<Entry> cache_;
-	/* \todo Expose the miss counter through an instrumentation API. */
-	unsigned int missCounter_;
+	std::unordered_map<uint64_t, unsigned int> index_;
+	Statistics stats_;
 };
 
 class V4L2DeviceFormat
@@ -189,6 +208,17 @@ class V4L2VideoDevice : public V4L2Device
 public:
 	using Formats = std::map<V4L2PixelFormat, std::vector<SizeRange>>;
 
+	enum class BufferFlag {
+		NonCoherent = 1 << 0,
+	};
+
+	using BufferFlags = Flags<BufferFlag>;
+
+	struct Statistics {
+		V4L2BufferCache::Statistics cache;
+		uint64_t dequeueTimeouts = 0;
+	};
+
 	explicit V4L2VideoDevice(const std::string &deviceNode);
 	explicit V4L2VideoDevice(const MediaEntity *entity);
 	~V4L2VideoDevice();
@@ -211,13 +241,16 @@ public:
 	int setSelection(unsigned int target, Rectangle *rect);
 
 	int allocateBuffers(unsigned int count,
-			    std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+			    std::vector<std::unique_ptr<FrameBuffer>> *buffers,
+			    BufferFlags flags = {});
 	int exportBuffers(unsigned int count,
-			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers,
+			  BufferFlags flags = {});
 	int importBuffers(unsigned int count);
+	int pinBuffer(const FrameBuffer *buffer);
 	int releaseBuffers();
 
-	int queueBuffer(FrameBuffer *buffer);
+	int queueBuffer(FrameBuffer *buffer, MediaRequest *request = nullptr);
 	Signal<FrameBuffer *> bufferReady;
 
 	int streamOn();
@@ -226,6 +259,8 @@ public:
 	void setDequeueTimeout(utils::Duration timeout);
 	Signal<> dequeueTimeout;
 
+	Statistics statistics() const;
+
 	static std::unique_ptr<V4L2VideoDevice>
 	fromEntityName(const MediaDevice *media, const std::string &entity);
 
@@ -257,9 +292,11 @@ private:
 	std::vector<V4L2PixelFormat> enumPixelformats(uint32_t code);
 	std::vector<SizeRange> enumSizes(V4L2PixelFormat pixelFormat);
 
-	int requestBuffers(unsigned int count, enum v4l2_memory memoryType);
+	int requestBuffers(unsigned int count, enum v4l2_memory memoryType,
+			   BufferFlags flags = {});
 	int createBuffers(unsigned int count,
-			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers,
+			  BufferFlags flags);
 	std::unique_ptr<FrameBuffer> createBuffer(unsigned int index);
 	UniqueFD exportDmabufFd(unsigned int index, unsigned int plane);
 
@@ -275,6 +312,7 @@ private:
 	V4L2DeviceFormat format_;
 	const PixelFormatInfo *formatInfo_;
 	std::unordered_set<V4L2PixelFormat> pixelFormats_;
+	std::map<uint32_t, Formats> formatsCache_;
 
 	enum v4l2_buf_type bufferType_;
 	enum v4l2_memory memoryType_;
@@ -283,14 +321,18 @@ private:
 	std::map<unsigned int, FrameBuffer *> queuedBuffers_;
 
 	EventNotifier *fdBufferNotifier_;
+	bool nonBlocking_;
 
 	State state_;
 	std::optional<unsigned int> firstFrame_;
 
 	Timer watchdog_;
 	utils::Duration watchdogDuration_;
+	uint64_t dequeueTimeouts_;
 };
 
+LIBCAMERA_FLAGS_ENABLE_OPERATORS(V4L2VideoDevice::BufferFlag)
+
 class V4L2M2MDevice
 {
 public:
@@ -9,6 +9,7 @@
 
 #include <iterator>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -234,6 +235,7 @@ class YamlParser final
 public:
 	static std::unique_ptr<YamlObject> parse(File &file);
 	static std::unique_ptr<YamlObject> parse(std::string json);
+	static std::shared_ptr<const YamlObject> parseCached(File &file);
 };
 
 } /* namespace libcamera */
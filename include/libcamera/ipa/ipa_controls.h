@@ -17,6 +17,9 @@ extern "C" {
 
 #define IPA_CONTROLS_FORMAT_VERSION	1
 
+#define IPA_CONTROLS_FLAG_TRACKED	(1 << 0)
+#define IPA_CONTROLS_FLAG_DELTA		(1 << 1)
+
 enum ipa_controls_id_map_type {
 	IPA_CONTROL_ID_MAP_CONTROLS,
 	IPA_CONTROL_ID_MAP_PROPERTIES,
@@ -30,7 +33,8 @@ struct ipa_controls_header {
 	uint32_t size;
 	uint32_t data_offset;
 	enum ipa_controls_id_map_type id_map_type;
-	uint32_t reserved[2];
+	uint32_t flags;
+	uint32_t sequence;
 };
 
 struct ipa_control_value_entry {
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <limits>
 #include <map>
 #include <memory>
 #include <ostream>
@@ -48,6 +49,7 @@ struct StreamConfiguration {
 	unsigned int frameSize;
 
 	unsigned int bufferCount;
+	unsigned int frameRateDivisor;
 
 	std::optional<ColorSpace> colorSpace;
 
@@ -74,14 +76,18 @@ std::ostream &operator<<(std::ostream &out, StreamRole role);
 class Stream
 {
 public:
+	static constexpr unsigned int kInvalidIndex = std::numeric_limits<unsigned int>::max();
+
 	Stream();
 
 	const StreamConfiguration &configuration() const { return configuration_; }
+	unsigned int index() const { return index_; }
 
 protected:
 	friend class Camera;
 
 	StreamConfiguration configuration_;
+	unsigned int index_;
 };
 
 } /* namespace libcamera */
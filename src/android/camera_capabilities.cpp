@@ -10,18 +10,29 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <ctype.h>
+#include <errno.h>
+#include <fstream>
 #include <map>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
 #include <type_traits>
+#include <unistd.h>
 
 #include <hardware/camera3.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
+#include <libcamera/camera_manager.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
 #include <libcamera/property_ids.h>
 
+#include "libcamera/internal/camera.h"
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/pipeline_handler.h"
 
 using namespace libcamera;
 
@@ -414,10 +425,20 @@ int CameraCapabilities::initialize(std::shared_ptr<Camera> camera,
 		return ret;
 	}
 
-	ret = initializeStreamConfigurations();
+	/*
+	 * Probing the stream configurations validates hundreds of camera
+	 * configurations, use the results cached by a previous run if
+	 * available.
+	 */
+	ret = loadStreamConfigurations();
 	if (ret) {
-		camera_->release();
-		return ret;
+		ret = initializeStreamConfigurations();
+		if (ret) {
+			camera_->release();
+			return ret;
+		}
+
+		saveStreamConfigurations();
 	}
 
 	ret = initializeStaticMetadata();
@@ -655,6 +676,9 @@ int CameraCapabilities::initializeStreamConfigurations()
 			if (ret)
 				return ret;
 
+			probedFormat_ = cfg.pixelFormat;
+			probedSize_ = cfg.size;
+
 			const ControlInfoMap &controls = camera_->controls();
 			const auto frameDurations = controls.find(
 				&controls::FrameDurationLimits);
@@ -756,6 +780,190 @@ int CameraCapabilities::initializeStreamConfigurations()
 	return 0;
 }
 
+/*
+ * The stream configurations cache stores the results of
+ * initializeStreamConfigurations() in a text file per camera, in the
+ * directory specified by the LIBCAMERA_ANDROID_CACHE_DIR environment
+ * variable. The file starts with the camera ID, the pipeline handler name and
+ * the libcamera version, and the cache is discarded when any of them changes.
+ */
+std::string CameraCapabilities::cacheFilePath() const
+{
+	const char *dir = utils::secure_getenv("LIBCAMERA_ANDROID_CACHE_DIR");
+	if (!dir || *dir == '\0')
+		return {};
+
+	/* The camera IDs contain path separators, replace them. */
+	std::string name = camera_->id();
+	std::replace_if(name.begin(), name.end(),
+			[](char c) { return !isalnum(c) && c != '-' && c != '.'; },
+			'_');
+
+	return std::string(dir) + "/libcamera-hal-" + name + ".cache";
+}
+
+int CameraCapabilities::loadStreamConfigurations()
+{
+	const std::string path = cacheFilePath();
+	if (path.empty())
+		return -ENOENT;
+
+	std::ifstream file(path);
+	if (!file)
+		return -ENOENT;
+
+	const std::string pipeline = camera_->_d()->pipe()->name();
+	bool camera = false, pipe = false, version = false;
+	std::map<int, PixelFormat> formatsMap;
+	std::vector<Camera3StreamConfiguration> streamConfigurations;
+	bool rawStreamAvailable = false;
+	int64_t maxFrameDuration = 0;
+	unsigned int maxJpegBufferSize = 0;
+	PixelFormat probedFormat;
+	Size probedSize;
+
+	const auto parseSize = [](const std::string &str, Size *size) {
+		return sscanf(str.c_str(), "%ux%u", &size->width, &size->height) == 2;
+	};
+
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string key;
+		fields >> key;
+
+		if (key == "camera") {
+			std::string value;
+			std::getline(fields >> std::ws, value);
+			camera = value == camera_->id();
+		} else if (key == "pipeline") {
+			std::string value;
+			fields >> value;
+			pipe = value == pipeline;
+		} else if (key == "version") {
+			std::string value;
+			fields >> value;
+			version = value == CameraManager::version();
+		} else if (key == "raw") {
+			fields >> rawStreamAvailable;
+		} else if (key == "max-frame-duration") {
+			fields >> maxFrameDuration;
+		} else if (key == "max-jpeg-buffer-size") {
+			fields >> maxJpegBufferSize;
+		} else if (key == "probed") {
+			std::string format, size;
+			fields >> format >> size;
+			probedFormat = PixelFormat::fromString(format);
+			if (!parseSize(size, &probedSize))
+				fields.setstate(std::ios::failbit);
+		} else if (key == "format") {
+			int androidFormat;
+			std::string format;
+			fields >> androidFormat >> format;
+			formatsMap[androidFormat] = PixelFormat::fromString(format);
+		} else if (key == "stream") {
+			Camera3StreamConfiguration entry;
+			std::string size;
+			fields >> size >> entry.androidFormat
+			       >> entry.minFrameDurationNsec
+			       >> entry.maxFrameDurationNsec;
+			if (!parseSize(size, &entry.resolution))
+				fields.setstate(std::ios::failbit);
+			streamConfigurations.push_back(entry);
+		}
+
+		if (fields.fail()) {
+			LOG(HAL, Warning) << "Invalid cache entry '" << line
+					  << "' in " << path;
+			return -EINVAL;
+		}
+	}
+
+	if (!camera || !pipe || !version) {
+		LOG(HAL, Debug) << "Discarding stale cache " << path;
+		return -ESTALE;
+	}
+
+	if (formatsMap.empty() || streamConfigurations.empty() ||
+	    !probedFormat.isValid())
+		return -EINVAL;
+
+	/*
+	 * Apply the last configuration of the probing, for the camera controls
+	 * used to initialize the static metadata to match.
+	 */
+	std::unique_ptr<CameraConfiguration> cameraConfig =
+		camera_->generateConfiguration({ StreamRole::StillCapture });
+	if (!cameraConfig)
+		return -EINVAL;
+
+	StreamConfiguration &cfg = cameraConfig->at(0);
+	cfg.pixelFormat = probedFormat;
+	cfg.size = probedSize;
+
+	if (cameraConfig->validate() != CameraConfiguration::Valid ||
+	    camera_->configure(cameraConfig.get()))
+		return -EINVAL;
+
+	formatsMap_ = std::move(formatsMap);
+	streamConfigurations_ = std::move(streamConfigurations);
+	rawStreamAvailable_ = rawStreamAvailable;
+	maxFrameDuration_ = maxFrameDuration;
+	maxJpegBufferSize_ = maxJpegBufferSize;
+	probedFormat_ = probedFormat;
+	probedSize_ = probedSize;
+
+	LOG(HAL, Debug) << "Loaded stream configurations from " << path;
+
+	return 0;
+}
+
+void CameraCapabilities::saveStreamConfigurations() const
+{
+	const std::string path = cacheFilePath();
+	if (path.empty() || !probedFormat_.isValid())
+		return;
+
+	/* Write to a temporary file and rename it, to never leave a partial cache. */
+	const std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::trunc);
+
+		file << "camera " << camera_->id() << "\n"
+		     << "pipeline " << camera_->_d()->pipe()->name() << "\n"
+		     << "version " << CameraManager::version() << "\n"
+		     << "raw " << rawStreamAvailable_ << "\n"
+		     << "max-frame-duration " << maxFrameDuration_ << "\n"
+		     << "max-jpeg-buffer-size " << maxJpegBufferSize_ << "\n"
+		     << "probed " << probedFormat_ << " " << probedSize_ << "\n";
+
+		for (const auto &[androidFormat, pixelFormat] : formatsMap_)
+			file << "format " << androidFormat << " " << pixelFormat << "\n";
+
+		for (const Camera3StreamConfiguration &entry : streamConfigurations_)
+			file << "stream " << entry.resolution << " "
+			     << entry.androidFormat << " "
+			     << entry.minFrameDurationNsec << " "
+			     << entry.maxFrameDurationNsec << "\n";
+
+		if (!file.flush()) {
+			LOG(HAL, Warning) << "Failed to write cache " << tmpPath;
+			file.close();
+			unlink(tmpPath.c_str());
+			return;
+		}
+	}
+
+	if (rename(tmpPath.c_str(), path.c_str())) {
+		LOG(HAL, Warning) << "Failed to create cache " << path << ": "
+				  << strerror(errno);
+		unlink(tmpPath.c_str());
+		return;
+	}
+
+	LOG(HAL, Debug) << "Saved stream configurations to " << path;
+}
+
 int CameraCapabilities::initializeStaticMetadata()
 {
 	staticMetadata_ = std::make_unique<CameraMetadata>(64, 1024);
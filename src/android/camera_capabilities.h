@@ -10,6 +10,7 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -63,6 +64,9 @@ private:
 	std::vector<libcamera::Size>
 	initializeRawResolutions(const libcamera::PixelFormat &pixelFormat);
 	int initializeStreamConfigurations();
+	std::string cacheFilePath() const;
+	int loadStreamConfigurations();
+	void saveStreamConfigurations() const;
 
 	int initializeStaticMetadata();
 
@@ -76,6 +80,9 @@ private:
 	std::set<camera_metadata_enum_android_request_available_capabilities> capabilities_;
 
 	std::vector<Camera3StreamConfiguration> streamConfigurations_;
+	/* The last configuration applied while probing the streams */
+	libcamera::PixelFormat probedFormat_;
+	libcamera::Size probedSize_;
 	std::map<int, libcamera::PixelFormat> formatsMap_;
 	std::unique_ptr<CameraMetadata> staticMetadata_;
 	unsigned int maxJpegBufferSize_;
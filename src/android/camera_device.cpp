@@ -10,7 +10,6 @@
 #include <algorithm>
 #include <fstream>
 #include <set>
-#include <sys/mman.h>
 #include <unistd.h>
 #include <vector>
 
@@ -24,6 +23,8 @@
 #include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 
+#include "libcamera/internal/formats.h"
+
 #include "system/graphics.h"
 
 #include "camera_buffer.h"
@@ -31,6 +32,7 @@
 #include "camera_ops.h"
 #include "camera_request.h"
 #include "hal_framebuffer.h"
+#include "yuv/post_processor_yuv.h"
 
 using namespace libcamera;
 
@@ -163,6 +165,324 @@ void sortCamera3StreamConfigs(std::vector<Camera3StreamConfig> &unsortedConfigs,
 	unsortedConfigs = sortedConfigs;
 }
 
+/*
+ * Relative cost of a byte processed by the CPU compared to a byte written to
+ * memory by the camera hardware. The post-processors read the source frame
+ * and write the destination frame through the CPU caches, which costs both
+ * CPU time and memory bandwidth. Only the order of magnitude matters.
+ */
+constexpr uint64_t kCpuByteCost = 4;
+
+/* Maximum number of non-JPEG streams to evaluate alternative layouts for. */
+constexpr unsigned int kMaxLayoutStreams = 6;
+
+/* Maximum number of candidate layouts to validate against the camera. */
+constexpr unsigned int kMaxLayoutAttempts = 16;
+
+/*
+ * \struct Camera3StreamInfo
+ * \brief A non-JPEG camera3_stream requested by the Android HAL client
+ */
+struct Camera3StreamInfo {
+	camera3_stream_t *stream;
+	PixelFormat format;
+	Size size;
+};
+
+/*
+ * \struct StreamLayout
+ * \brief Association of the Android streams with libcamera streams
+ * \var owners For each non-JPEG stream, the index of the Direct stream it is
+ * mapped from, or -1 if the stream is Direct
+ * \var jpegOwner The index of the Direct stream the JPEG stream is mapped
+ * from, or -1 if it is produced from an Internal stream
+ * \var cost The estimated cost of producing the streams
+ */
+struct StreamLayout {
+	std::vector<int> owners;
+	int jpegOwner;
+	uint64_t cost;
+};
+
+uint64_t frameBytes(const PixelFormat &format, const Size &size)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(format);
+
+	/* Assume 16 bits per pixel for formats with an unknown layout. */
+	if (!info.isValid())
+		return static_cast<uint64_t>(size.width) * size.height * 2;
+
+	return info.frameSize(size);
+}
+
+/*
+ * A stream can be mapped from a source stream of the same format and size,
+ * or downscaled from a larger NV12 stream by the YUV post-processor. The whole
+ * frame is scaled, restrict scaling to sources with the same aspect ratio
+ * (within 1%) to avoid distorting the image.
+ */
+bool isMappable(const Camera3StreamInfo &src, const Camera3StreamInfo &dst)
+{
+	if (src.format != dst.format)
+		return false;
+
+	if (src.size == dst.size)
+		return true;
+
+	if (src.format != formats::NV12)
+		return false;
+
+	if (src.size.width < dst.size.width || src.size.height < dst.size.height)
+		return false;
+
+	uint64_t srcRatio = static_cast<uint64_t>(src.size.width) * dst.size.height;
+	uint64_t dstRatio = static_cast<uint64_t>(dst.size.width) * src.size.height;
+	uint64_t diff = srcRatio > dstRatio ? srcRatio - dstRatio : dstRatio - srcRatio;
+
+	return diff * 100 <= srcRatio;
+}
+
+/*
+ * Estimate the cost of a layout. Direct and Internal streams cost the bytes
+ * written by the camera, mapped streams the bytes read and written by the
+ * post-processor, weighted by kCpuByteCost unless a hardware scaler is
+ * available. The JPEG encoding cost is identical for all layouts and is
+ * ignored.
+ */
+uint64_t layoutCost(const std::vector<Camera3StreamInfo> &infos,
+		    const StreamLayout &layout, const camera3_stream_t *jpegStream,
+		    bool hwScaler)
+{
+	uint64_t cost = 0;
+
+	for (unsigned int i = 0; i < infos.size(); ++i) {
+		const Camera3StreamInfo &info = infos[i];
+		int owner = layout.owners[i];
+
+		if (owner < 0) {
+			cost += frameBytes(info.format, info.size);
+			continue;
+		}
+
+		const Camera3StreamInfo &source = infos[owner];
+		uint64_t bytes = frameBytes(source.format, source.size) +
+				 frameBytes(info.format, info.size);
+		bool scaler = hwScaler && info.format == formats::NV12;
+
+		cost += scaler ? bytes : bytes * kCpuByteCost;
+	}
+
+	if (jpegStream && layout.jpegOwner < 0)
+		cost += frameBytes(formats::NV12,
+				   Size(jpegStream->width, jpegStream->height));
+
+	return cost;
+}
+
+/*
+ * Enumerate all the assignments of the non-JPEG streams, starting at \a index,
+ * where every stream is either Direct or mapped from a Direct stream.
+ */
+void enumerateOwners(const std::vector<Camera3StreamInfo> &infos,
+		     std::vector<int> &owners, unsigned int index,
+		     std::vector<std::vector<int>> *candidates)
+{
+	if (index == infos.size()) {
+		for (int owner : owners) {
+			if (owner >= 0 && owners[owner] >= 0)
+				return;
+		}
+
+		candidates->push_back(owners);
+		return;
+	}
+
+	owners[index] = -1;
+	enumerateOwners(infos, owners, index + 1, candidates);
+
+	for (unsigned int i = 0; i < infos.size(); ++i) {
+		if (i == index || !isMappable(infos[i], infos[index]))
+			continue;
+
+		owners[index] = i;
+		enumerateOwners(infos, owners, index + 1, candidates);
+	}
+
+	owners[index] = -1;
+}
+
+/*
+ * The default layout maps streams to the first Direct stream of the same
+ * format and size, and the JPEG stream to the first Direct stream of the same
+ * size.
+ */
+StreamLayout defaultStreamLayout(const std::vector<Camera3StreamInfo> &infos,
+				 const camera3_stream_t *jpegStream)
+{
+	StreamLayout layout{ std::vector<int>(infos.size(), -1), -1, 0 };
+
+	for (unsigned int i = 0; i < infos.size(); ++i) {
+		for (unsigned int j = 0; j < i; ++j) {
+			if (layout.owners[j] < 0 &&
+			    infos[j].size == infos[i].size &&
+			    infos[j].format == infos[i].format) {
+				layout.owners[i] = j;
+				break;
+			}
+		}
+	}
+
+	if (!jpegStream)
+		return layout;
+
+	for (unsigned int i = 0; i < infos.size(); ++i) {
+		/*
+		 * \todo The PixelFormat must also be compatible with the
+		 * encoder.
+		 */
+		if (layout.owners[i] < 0 &&
+		    infos[i].size.width == jpegStream->width &&
+		    infos[i].size.height == jpegStream->height) {
+			layout.jpegOwner = i;
+			break;
+		}
+	}
+
+	return layout;
+}
+
+std::vector<Camera3StreamConfig>
+layoutStreamConfigs(const std::vector<Camera3StreamInfo> &infos,
+		    const StreamLayout &layout, camera3_stream_t *jpegStream)
+{
+	std::vector<Camera3StreamConfig> streamConfigs;
+	std::vector<unsigned int> configIndex(infos.size());
+
+	for (unsigned int i = 0; i < infos.size(); ++i) {
+		if (layout.owners[i] >= 0)
+			continue;
+
+		Camera3StreamConfig streamConfig;
+		streamConfig.streams = { { infos[i].stream, CameraStream::Type::Direct } };
+		streamConfig.config.size = infos[i].size;
+		streamConfig.config.pixelFormat = infos[i].format;
+
+		configIndex[i] = streamConfigs.size();
+		streamConfigs.push_back(std::move(streamConfig));
+	}
+
+	for (unsigned int i = 0; i < infos.size(); ++i) {
+		int owner = layout.owners[i];
+		if (owner < 0)
+			continue;
+
+		streamConfigs[configIndex[owner]].streams.push_back(
+			{ infos[i].stream, CameraStream::Type::Mapped });
+	}
+
+	if (jpegStream) {
+		if (layout.jpegOwner >= 0) {
+			streamConfigs[configIndex[layout.jpegOwner]].streams.push_back(
+				{ jpegStream, CameraStream::Type::Mapped });
+		} else {
+			/*
+			 * \todo The pixelFormat should be a 'best-fit' choice
+			 * and may require a validation cycle. This is not yet
+			 * handled, and should be considered as part of any
+			 * stream configuration reworks.
+			 */
+			Camera3StreamConfig streamConfig;
+			streamConfig.streams = { { jpegStream, CameraStream::Type::Internal } };
+			streamConfig.config.size.width = jpegStream->width;
+			streamConfig.config.size.height = jpegStream->height;
+			streamConfig.config.pixelFormat = formats::NV12;
+			streamConfigs.push_back(std::move(streamConfig));
+		}
+	}
+
+	sortCamera3StreamConfigs(streamConfigs, jpegStream);
+
+	return streamConfigs;
+}
+
+/*
+ * Select the cheapest layout supported by the camera. The candidate layouts
+ * are validated in increasing cost order, and the default layout is used if
+ * none of them is valid, or if there are too many streams to evaluate the
+ * alternatives.
+ */
+StreamLayout selectStreamLayout(Camera *camera,
+				const std::vector<Camera3StreamInfo> &infos,
+				camera3_stream_t *jpegStream)
+{
+	StreamLayout defaultLayout = defaultStreamLayout(infos, jpegStream);
+
+	if (infos.size() > kMaxLayoutStreams)
+		return defaultLayout;
+
+	std::vector<std::vector<int>> owners;
+	std::vector<int> current(infos.size(), -1);
+	enumerateOwners(infos, current, 0, &owners);
+
+	bool hwScaler = !!PostProcessorYuv::converterDevice();
+	std::vector<StreamLayout> layouts;
+
+	defaultLayout.cost = layoutCost(infos, defaultLayout, jpegStream, hwScaler);
+	layouts.push_back(defaultLayout);
+
+	for (const std::vector<int> &candidate : owners) {
+		std::vector<int> jpegOwners = { -1 };
+
+		if (jpegStream) {
+			for (unsigned int i = 0; i < infos.size(); ++i) {
+				if (candidate[i] < 0 &&
+				    infos[i].size.width == jpegStream->width &&
+				    infos[i].size.height == jpegStream->height)
+					jpegOwners.push_back(i);
+			}
+		}
+
+		for (int jpegOwner : jpegOwners) {
+			if (candidate == defaultLayout.owners &&
+			    jpegOwner == defaultLayout.jpegOwner)
+				continue;
+
+			StreamLayout layout{ candidate, jpegOwner, 0 };
+			layout.cost = layoutCost(infos, layout, jpegStream, hwScaler);
+			layouts.push_back(std::move(layout));
+		}
+	}
+
+	if (layouts.size() == 1)
+		return defaultLayout;
+
+	/* The stable sort favours the default layout when costs are equal. */
+	std::stable_sort(layouts.begin(), layouts.end(),
+			 [](const StreamLayout &a, const StreamLayout &b) {
+				 return a.cost < b.cost;
+			 });
+
+	unsigned int attempts = 0;
+	for (const StreamLayout &layout : layouts) {
+		if (attempts++ == kMaxLayoutAttempts)
+			break;
+
+		std::unique_ptr<CameraConfiguration> config =
+			camera->generateConfiguration();
+		if (!config)
+			break;
+
+		for (const Camera3StreamConfig &streamConfig :
+		     layoutStreamConfigs(infos, layout, jpegStream))
+			config->addConfiguration(streamConfig.config);
+
+		if (config->validate() == CameraConfiguration::Valid)
+			return layout;
+	}
+
+	return defaultLayout;
+}
+
 const char *rotationToString(int rotation)
 {
 	switch (rotation) {
@@ -248,6 +568,8 @@ bool validateCropRotate(const camera3_stream_configuration_t &streamList)
 
 CameraDevice::CameraDevice(unsigned int id, std::shared_ptr<Camera> camera)
 	: id_(id), state_(State::Stopped), camera_(std::move(camera)),
+	  pendingCompletions_(0), resultEntryCapacity_(88), resultDataCapacity_(166),
+	  resultMetadataCount_(0), resultMetadataResizes_(0),
 	  facing_(CAMERA_FACING_FRONT), orientation_(0)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
@@ -426,6 +748,13 @@ void CameraDevice::flush()
 
 	camera_->stop();
 
+	/*
+	 * Internal buffers are allocated on demand, release the idle ones
+	 * until the camera is restarted.
+	 */
+	for (CameraStream &cameraStream : streams_)
+		cameraStream.releaseBuffers();
+
 	MutexLocker stateLock(stateMutex_);
 	state_ = State::Stopped;
 }
@@ -443,6 +772,15 @@ void CameraDevice::stop()
 
 	streams_.clear();
 
+	{
+		MutexLocker resultLock(resultMetadataMutex_);
+		if (resultMetadataCount_)
+			LOG(HAL, Debug)
+				<< resultMetadataResizes_ << " out of "
+				<< resultMetadataCount_
+				<< " result metadata packs have been resized";
+	}
+
 	state_ = State::Stopped;
 }
 
@@ -554,8 +892,8 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	streams_.clear();
 	streams_.reserve(stream_list->num_streams);
 
-	std::vector<Camera3StreamConfig> streamConfigs;
-	streamConfigs.reserve(stream_list->num_streams);
+	std::vector<Camera3StreamInfo> streamInfos;
+	streamInfos.reserve(stream_list->num_streams);
 
 	/* First handle all non-MJPEG streams. */
 	camera3_stream_t *jpegStream = nullptr;
@@ -615,95 +953,51 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		 */
 		stream->usage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
 
-		/*
-		 * If a CameraStream with the same size and format as the
-		 * current stream has already been requested, associate the two.
-		 */
-		auto iter = std::find_if(
-			streamConfigs.begin(), streamConfigs.end(),
-			[&size, &format](const Camera3StreamConfig &streamConfig) {
-				return streamConfig.config.size == size &&
-				       streamConfig.config.pixelFormat == format;
-			});
-		if (iter != streamConfigs.end()) {
-			/* Add usage to copy the buffer in streams[0] to stream. */
-			iter->streams[0].stream->usage |= GRALLOC_USAGE_SW_READ_OFTEN;
-			stream->usage |= GRALLOC_USAGE_SW_WRITE_OFTEN;
-			iter->streams.push_back({ stream, CameraStream::Type::Mapped });
-			continue;
-		}
-
-		Camera3StreamConfig streamConfig;
-		streamConfig.streams = { { stream, CameraStream::Type::Direct } };
-		streamConfig.config.size = size;
-		streamConfig.config.pixelFormat = format;
-		streamConfigs.push_back(std::move(streamConfig));
+		streamInfos.push_back({ stream, format, size });
 	}
 
-	/* Now handle the MJPEG streams, adding a new stream if required. */
-	if (jpegStream) {
-		CameraStream::Type type;
-		int index = -1;
-
-		/* Search for a compatible stream in the non-JPEG ones. */
-		for (size_t i = 0; i < streamConfigs.size(); ++i) {
-			Camera3StreamConfig &streamConfig = streamConfigs[i];
-			const auto &cfg = streamConfig.config;
-
-			/*
-			 * \todo The PixelFormat must also be compatible with
-			 * the encoder.
-			 */
-			if (cfg.size.width != jpegStream->width ||
-			    cfg.size.height != jpegStream->height)
-				continue;
-
-			LOG(HAL, Info)
-				<< "Android JPEG stream mapped to libcamera stream " << i;
+	/*
+	 * Select how to produce the streams, either directly by the camera or
+	 * by post-processing another stream, based on an estimate of their
+	 * CPU and memory bandwidth cost and on the configurations supported by
+	 * the camera.
+	 */
+	StreamLayout layout = selectStreamLayout(camera_.get(), streamInfos,
+						 jpegStream);
 
-			type = CameraStream::Type::Mapped;
-			index = i;
+	/* Add usage to copy the source buffers to the mapped streams. */
+	for (unsigned int i = 0; i < streamInfos.size(); ++i) {
+		int owner = layout.owners[i];
+		if (owner < 0)
+			continue;
 
-			/*
-			 * The source stream will be read by software to
-			 * produce the JPEG stream.
-			 */
-			camera3_stream_t *stream = streamConfig.streams[0].stream;
-			stream->usage |= GRALLOC_USAGE_SW_READ_OFTEN;
-			break;
-		}
+		streamInfos[owner].stream->usage |= GRALLOC_USAGE_SW_READ_OFTEN;
+		streamInfos[i].stream->usage |= GRALLOC_USAGE_SW_WRITE_OFTEN;
+	}
 
+	if (jpegStream) {
 		/*
-		 * Without a compatible match for JPEG encoding we must
-		 * introduce a new stream to satisfy the request requirements.
+		 * The source stream will be read by software to produce the
+		 * JPEG stream.
 		 */
-		if (index < 0) {
-			/*
-			 * \todo The pixelFormat should be a 'best-fit' choice
-			 * and may require a validation cycle. This is not yet
-			 * handled, and should be considered as part of any
-			 * stream configuration reworks.
-			 */
-			Camera3StreamConfig streamConfig;
-			streamConfig.config.size.width = jpegStream->width;
-			streamConfig.config.size.height = jpegStream->height;
-			streamConfig.config.pixelFormat = formats::NV12;
-			streamConfigs.push_back(std::move(streamConfig));
-
-			LOG(HAL, Info) << "Adding " << streamConfig.config.toString()
-				       << " for MJPEG support";
-
-			type = CameraStream::Type::Internal;
-			index = streamConfigs.size() - 1;
-		}
+		if (layout.jpegOwner >= 0)
+			streamInfos[layout.jpegOwner].stream->usage |=
+				GRALLOC_USAGE_SW_READ_OFTEN;
 
 		/* The JPEG stream will be produced by software. */
 		jpegStream->usage |= GRALLOC_USAGE_SW_WRITE_OFTEN;
+	}
+
+	std::vector<Camera3StreamConfig> streamConfigs =
+		layoutStreamConfigs(streamInfos, layout, jpegStream);
 
-		streamConfigs[index].streams.push_back({ jpegStream, type });
+	LOG(HAL, Info) << "Selected stream layout with cost " << layout.cost;
+	for (const auto &streamConfig : streamConfigs) {
+		LOG(HAL, Info) << " - " << streamConfig.config.toString()
+			       << " for " << streamConfig.streams.size()
+			       << " stream(s)";
 	}
 
-	sortCamera3StreamConfigs(streamConfigs, jpegStream);
 	for (const auto &streamConfig : streamConfigs) {
 		config->addConfiguration(streamConfig.config);
 
@@ -767,33 +1061,10 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	}
 
 	config_ = std::move(config);
-	return 0;
-}
-
-std::unique_ptr<HALFrameBuffer>
-CameraDevice::createFrameBuffer(const buffer_handle_t camera3buffer,
-				PixelFormat pixelFormat, const Size &size)
-{
-	CameraBuffer buf(camera3buffer, pixelFormat, size, PROT_READ);
-	if (!buf.isValid()) {
-		LOG(HAL, Fatal) << "Failed to create CameraBuffer";
-		return nullptr;
-	}
 
-	std::vector<FrameBuffer::Plane> planes(buf.numPlanes());
-	for (size_t i = 0; i < buf.numPlanes(); ++i) {
-		SharedFD fd{ camera3buffer->data[i] };
-		if (!fd.isValid()) {
-			LOG(HAL, Fatal) << "No valid fd";
-			return nullptr;
-		}
-
-		planes[i].fd = fd;
-		planes[i].offset = buf.offset(i);
-		planes[i].length = buf.size(i);
-	}
+	configureResultMetadata();
 
-	return std::make_unique<HALFrameBuffer>(planes, camera3buffer);
+	return 0;
 }
 
 int CameraDevice::processControls(Camera3RequestDescriptor *descriptor)
@@ -991,16 +1262,14 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 
 		case CameraStream::Type::Direct:
 			/*
-			 * Create a libcamera buffer using the dmabuf
-			 * descriptors of the camera3Buffer for each stream and
-			 * associate it with the Camera3RequestDescriptor for
-			 * lifetime management only.
+			 * Get a libcamera buffer wrapping the dmabuf
+			 * descriptors of the camera3Buffer from the stream's
+			 * buffer cache, and associate it with the
+			 * Camera3RequestDescriptor.
 			 */
 			buffer.frameBuffer =
-				createFrameBuffer(*buffer.camera3Buffer,
-						  cameraStream->configuration().pixelFormat,
-						  cameraStream->configuration().size);
-			frameBuffer = buffer.frameBuffer.get();
+				cameraStream->frameBuffer(*buffer.camera3Buffer);
+			frameBuffer = buffer.frameBuffer;
 			acquireFence = std::move(buffer.fence);
 			LOG(HAL, Debug) << ss.str() << " (direct)";
 			break;
@@ -1262,14 +1531,43 @@ void CameraDevice::requestComplete(Request *request)
  * capture (or have been generated via post-processing) and the request is ready
  * to be sent back to the framework.
  *
+ * Results are delivered by a single thread at a time, without holding any lock
+ * while calling back into the framework. If another thread is already
+ * delivering results, it is notified of the completion and delivers the
+ * descriptor on its behalf, and the function returns immediately.
+ *
+ * The process_capture_result() callback may thus be called from any thread
+ * that completes a descriptor, including the libcamera camera manager thread,
+ * the post-processor threads and the caller of processCaptureRequest(). The
+ * calls never overlap, and results are always delivered in the order in which
+ * the requests have been queued.
+ *
  * \context This function is \threadsafe.
  */
 void CameraDevice::completeDescriptor(Camera3RequestDescriptor *descriptor)
 {
-	MutexLocker lock(descriptorsMutex_);
-	descriptor->complete_ = true;
+	descriptor->complete_.store(true, std::memory_order_release);
+
+	if (pendingCompletions_.fetch_add(1, std::memory_order_acq_rel))
+		return;
 
-	sendCaptureResults();
+	/*
+	 * This thread is now the delivering thread. Loop until no completion
+	 * has been signalled while sending the results, all the completions
+	 * counted before sending are covered by that pass.
+	 */
+	unsigned int completions = pendingCompletions_.load(std::memory_order_acquire);
+	while (true) {
+		sendCaptureResults();
+
+		unsigned int count =
+			pendingCompletions_.fetch_sub(completions,
+						      std::memory_order_acq_rel);
+		if (count == completions)
+			break;
+
+		completions = count - completions;
+	}
 }
 
 /**
@@ -1283,13 +1581,27 @@ void CameraDevice::completeDescriptor(Camera3RequestDescriptor *descriptor)
  * Stop iterating if the descriptor at the front of the queue is not complete.
  *
  * This function should never be called directly in the codebase. Use
- * completeDescriptor() instead.
+ * completeDescriptor() instead, which guarantees that a single thread sends
+ * results at a time.
  */
 void CameraDevice::sendCaptureResults()
 {
-	while (!descriptors_.empty() && !descriptors_.front()->isPending()) {
-		auto descriptor = std::move(descriptors_.front());
-		descriptors_.pop();
+	while (true) {
+		std::unique_ptr<Camera3RequestDescriptor> descriptor;
+
+		/*
+		 * Only hold the lock to pop the descriptor, the result is sent
+		 * without blocking processCaptureRequest() or the completion
+		 * of other descriptors.
+		 */
+		{
+			MutexLocker lock(descriptorsMutex_);
+			if (descriptors_.empty() || descriptors_.front()->isPending())
+				break;
+
+			descriptor = std::move(descriptors_.front());
+			descriptors_.pop();
+		}
 
 		camera3_capture_result_t captureResult = {};
 
@@ -1326,6 +1638,12 @@ void CameraDevice::sendCaptureResults()
 			captureResult.partial_result = 1;
 
 		callbacks_->process_capture_result(callbacks_, &captureResult);
+
+		/*
+		 * The framework copies the result metadata in the callback,
+		 * recycle the pack for the next requests.
+		 */
+		releaseResultMetadata(std::move(descriptor->resultMetadata_));
 	}
 }
 
@@ -1415,7 +1733,7 @@ void CameraDevice::notifyError(uint32_t frameNumber, camera3_stream_t *stream,
  * Produce a set of fixed result metadata.
  */
 std::unique_ptr<CameraMetadata>
-CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) const
+CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor)
 {
 	const ControlList &metadata = descriptor.request_->metadata();
 	const CameraMetadata &settings = descriptor.settings_;
@@ -1438,9 +1756,8 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 	 * ANDROID_JPEG_THUMBNAIL_SIZE (int32 x 2) = 8 bytes
 	 * Total bytes for JPEG metadata: 82
 	 */
-	std::unique_ptr<CameraMetadata> resultMetadata =
-		std::make_unique<CameraMetadata>(88, 166);
-	if (!resultMetadata->isValid()) {
+	std::unique_ptr<CameraMetadata> resultMetadata = allocateResultMetadata();
+	if (!resultMetadata) {
 		LOG(HAL, Error) << "Failed to allocate result metadata";
 		return nullptr;
 	}
@@ -1612,3 +1929,123 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 
 	return resultMetadata;
 }
+
+/*
+ * \brief Size the result metadata packs for the current configuration
+ *
+ * Result metadata packs are recycled across requests to avoid allocating and
+ * growing a new pack for every frame. Size them to hold all the result keys
+ * reported in the static metadata, and preallocate enough of them to cover
+ * the pipeline depth.
+ */
+void CameraDevice::configureResultMetadata()
+{
+	const CameraMetadata *staticMetadata = capabilities_.staticMetadata();
+	camera_metadata_ro_entry_t entry;
+	size_t entryCapacity = 88;
+	size_t dataCapacity = 166;
+	unsigned int depth = 1;
+
+	if (staticMetadata->getEntry(ANDROID_REQUEST_AVAILABLE_RESULT_KEYS, &entry)) {
+		entryCapacity = std::max(entryCapacity, entry.count);
+
+		/*
+		 * Account for the data of the entries that don't fit in the
+		 * entry itself, assuming a single element per tag. Arrays make
+		 * the packs grow on the first frames, and the grown packs are
+		 * kept.
+		 */
+		size_t dataSize = 0;
+		for (size_t i = 0; i < entry.count; i++) {
+			int type = get_camera_metadata_tag_type(entry.data.i32[i]);
+			if (type >= 0)
+				dataSize += calculate_camera_metadata_entry_data_size(type, 1);
+		}
+		dataCapacity = std::max(dataCapacity, dataSize);
+	}
+
+	if (staticMetadata->getEntry(ANDROID_REQUEST_PIPELINE_MAX_DEPTH, &entry))
+		depth = std::max<unsigned int>(depth, entry.data.u8[0]);
+
+	MutexLocker lock(resultMetadataMutex_);
+
+	resultEntryCapacity_ = entryCapacity;
+	resultDataCapacity_ = dataCapacity;
+	resultMetadataCount_ = 0;
+	resultMetadataResizes_ = 0;
+
+	resultMetadataPool_.clear();
+	resultMetadataPool_.reserve(depth);
+
+	for (unsigned int i = 0; i < depth; i++) {
+		auto metadata = std::make_unique<CameraMetadata>(entryCapacity,
+								 dataCapacity);
+		if (!metadata->isValid())
+			break;
+
+		resultMetadataPool_.push_back(std::move(metadata));
+	}
+}
+
+/*
+ * \brief Get an empty result metadata pack
+ *
+ * Reuse a pack from the pool when available, or allocate a new one sized to
+ * the largest usage seen so far.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return An empty result metadata pack, or nullptr if allocation failed
+ */
+std::unique_ptr<CameraMetadata> CameraDevice::allocateResultMetadata()
+{
+	MutexLocker lock(resultMetadataMutex_);
+
+	resultMetadataCount_++;
+
+	if (!resultMetadataPool_.empty()) {
+		std::unique_ptr<CameraMetadata> metadata =
+			std::move(resultMetadataPool_.back());
+		resultMetadataPool_.pop_back();
+		return metadata;
+	}
+
+	auto metadata = std::make_unique<CameraMetadata>(resultEntryCapacity_,
+							 resultDataCapacity_);
+	if (!metadata->isValid())
+		return nullptr;
+
+	return metadata;
+}
+
+/*
+ * \brief Return a result metadata pack to the pool
+ * \param[in] metadata The result metadata pack
+ *
+ * Packs that had to be resized raise the capacity of the packs allocated
+ * afterwards, packs smaller than that capacity are freed.
+ *
+ * \context This function is \threadsafe.
+ */
+void CameraDevice::releaseResultMetadata(std::unique_ptr<CameraMetadata> metadata)
+{
+	if (!metadata || !metadata->isValid())
+		return;
+
+	MutexLocker lock(resultMetadataMutex_);
+
+	auto [entryCapacity, dataCapacity] = metadata->capacity();
+
+	if (metadata->resized()) {
+		resultMetadataResizes_++;
+		resultEntryCapacity_ = std::max(resultEntryCapacity_, entryCapacity);
+		resultDataCapacity_ = std::max(resultDataCapacity_, dataCapacity);
+	}
+
+	if (entryCapacity < resultEntryCapacity_ ||
+	    dataCapacity < resultDataCapacity_)
+		return;
+
+	metadata->clear();
+	resultMetadataPool_.push_back(std::move(metadata));
+}
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <queue>
@@ -84,10 +85,6 @@ private:
 
 	void stop() LIBCAMERA_TSA_EXCLUDES(stateMutex_);
 
-	std::unique_ptr<HALFrameBuffer>
-	createFrameBuffer(const buffer_handle_t camera3buffer,
-			  libcamera::PixelFormat pixelFormat,
-			  const libcamera::Size &size);
 	void abortRequest(Camera3RequestDescriptor *descriptor) const;
 	bool isValidRequest(camera3_capture_request_t *request) const;
 	void notifyShutter(uint32_t frameNumber, uint64_t timestamp);
@@ -96,11 +93,17 @@ private:
 	int processControls(Camera3RequestDescriptor *descriptor);
 	void completeDescriptor(Camera3RequestDescriptor *descriptor)
 		LIBCAMERA_TSA_EXCLUDES(descriptorsMutex_);
-	void sendCaptureResults() LIBCAMERA_TSA_REQUIRES(descriptorsMutex_);
+	void sendCaptureResults() LIBCAMERA_TSA_EXCLUDES(descriptorsMutex_);
 	void setBufferStatus(Camera3RequestDescriptor::StreamBuffer &buffer,
 			     Camera3RequestDescriptor::Status status);
 	std::unique_ptr<CameraMetadata> getResultMetadata(
-		const Camera3RequestDescriptor &descriptor) const;
+		const Camera3RequestDescriptor &descriptor);
+	void configureResultMetadata()
+		LIBCAMERA_TSA_EXCLUDES(resultMetadataMutex_);
+	std::unique_ptr<CameraMetadata> allocateResultMetadata()
+		LIBCAMERA_TSA_EXCLUDES(resultMetadataMutex_);
+	void releaseResultMetadata(std::unique_ptr<CameraMetadata> metadata)
+		LIBCAMERA_TSA_EXCLUDES(resultMetadataMutex_);
 
 	unsigned int id_;
 	camera3_device_t camera3Device_;
@@ -120,6 +123,18 @@ private:
 	libcamera::Mutex descriptorsMutex_ LIBCAMERA_TSA_ACQUIRED_AFTER(stateMutex_);
 	std::queue<std::unique_ptr<Camera3RequestDescriptor>> descriptors_
 		LIBCAMERA_TSA_GUARDED_BY(descriptorsMutex_);
+	/* Number of completions not yet handled by the delivering thread. */
+	std::atomic<unsigned int> pendingCompletions_;
+
+	/* Protects the result metadata packs recycled across requests. */
+	libcamera::Mutex resultMetadataMutex_
+		LIBCAMERA_TSA_ACQUIRED_AFTER(descriptorsMutex_);
+	std::vector<std::unique_ptr<CameraMetadata>> resultMetadataPool_
+		LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	size_t resultEntryCapacity_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	size_t resultDataCapacity_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	unsigned int resultMetadataCount_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	unsigned int resultMetadataResizes_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
 
 	std::string maker_;
 	std::string model_;
@@ -13,6 +13,10 @@
 #include <libcamera/property_ids.h>
 
 #include "camera_device.h"
+#if !defined(OS_CHROMEOS)
+#include "jpeg/encoder_v4l2_m2m.h"
+#endif
+#include "yuv/post_processor_yuv.h"
 
 using namespace libcamera;
 
@@ -69,6 +73,15 @@ int CameraHalManager::init()
 		return ret;
 	}
 
+	/*
+	 * Look for hardware JPEG encoders and scalers now, to keep the device
+	 * scans out of stream configuration.
+	 */
+#if !defined(OS_CHROMEOS)
+	EncoderV4L2M2M::probe();
+#endif
+	PostProcessorYuv::converterDevice();
+
 	return 0;
 }
 
@@ -65,6 +65,32 @@ std::tuple<size_t, size_t> CameraMetadata::usage() const
 	return { currentEntryCount, currentDataCount };
 }
 
+std::tuple<size_t, size_t> CameraMetadata::capacity() const
+{
+	size_t entryCapacity = get_camera_metadata_entry_capacity(metadata_);
+	size_t dataCapacity = get_camera_metadata_data_capacity(metadata_);
+
+	return { entryCapacity, dataCapacity };
+}
+
+/*
+ * \brief Remove all entries from the metadata container
+ *
+ * The container keeps its memory and capacity, so that it can be filled again
+ * without any allocation.
+ */
+void CameraMetadata::clear()
+{
+	if (!valid_)
+		return;
+
+	auto [entryCapacity, dataCapacity] = capacity();
+	metadata_ = place_camera_metadata(metadata_,
+					  get_camera_metadata_size(metadata_),
+					  entryCapacity, dataCapacity);
+	resized_ = false;
+}
+
 bool CameraMetadata::getEntry(uint32_t tag, camera_metadata_ro_entry_t *entry) const
 {
 	if (find_camera_metadata_ro_entry(metadata_, tag, entry))
@@ -24,8 +24,11 @@ public:
 	CameraMetadata &operator=(const CameraMetadata &other);
 
 	std::tuple<size_t, size_t> usage() const;
+	std::tuple<size_t, size_t> capacity() const;
 	bool resized() const { return resized_; }
 
+	void clear();
+
 	bool isValid() const { return valid_; }
 	bool getEntry(uint32_t tag, camera_metadata_ro_entry_t *entry) const;
 
@@ -158,7 +158,7 @@ Camera3RequestDescriptor::~Camera3RequestDescriptor() = default;
  *
  * \var Camera3RequestDescriptor::StreamBuffer::frameBuffer
  * \brief Encapsulate the dmabuf handle inside a libcamera::FrameBuffer for
- * direct streams
+ * direct streams, owned by the CameraStream buffer cache
  *
  * \var Camera3RequestDescriptor::StreamBuffer::fence
  * \brief Acquire fence of the buffer
@@ -173,7 +173,8 @@ Camera3RequestDescriptor::~Camera3RequestDescriptor() = default;
  * \brief Pointer to the source frame buffer used for post-processing
  *
  * \var Camera3RequestDescriptor::StreamBuffer::dstBuffer
- * \brief Pointer to the destination frame buffer used for post-processing
+ * \brief Pointer to the destination frame buffer used for post-processing,
+ * owned by the CameraStream buffer cache
  *
  * \var Camera3RequestDescriptor::StreamBuffer::request
  * \brief Back pointer to the Camera3RequestDescriptor to which the StreamBuffer belongs
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <vector>
@@ -45,12 +46,12 @@ public:
 
 		CameraStream *stream;
 		buffer_handle_t *camera3Buffer;
-		std::unique_ptr<HALFrameBuffer> frameBuffer;
+		HALFrameBuffer *frameBuffer = nullptr;
 		libcamera::UniqueFD fence;
 		Status status = Status::Success;
 		libcamera::FrameBuffer *internalBuffer = nullptr;
 		const libcamera::FrameBuffer *srcBuffer = nullptr;
-		std::unique_ptr<CameraBuffer> dstBuffer;
+		CameraBuffer *dstBuffer = nullptr;
 		Camera3RequestDescriptor *request;
 
 	private:
@@ -66,7 +67,7 @@ public:
 				 const camera3_capture_request_t *camera3Request);
 	~Camera3RequestDescriptor();
 
-	bool isPending() const { return !complete_; }
+	bool isPending() const { return !complete_.load(std::memory_order_acquire); }
 
 	uint32_t frameNumber_ = 0;
 
@@ -76,7 +77,7 @@ public:
 	std::unique_ptr<libcamera::Request> request_;
 	std::unique_ptr<CameraMetadata> resultMetadata_;
 
-	bool complete_ = false;
+	std::atomic<bool> complete_ = false;
 	Status status_ = Status::Success;
 
 private:
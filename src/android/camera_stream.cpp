@@ -7,12 +7,18 @@
 
 #include "camera_stream.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
+#include <libcamera/base/utils.h>
+
 #include <libcamera/formats.h>
 
 #include "jpeg/post_processor_jpeg.h"
@@ -56,7 +62,7 @@ CameraStream::CameraStream(CameraDevice *const cameraDevice,
 			   CameraStream *const sourceStream, unsigned int index)
 	: cameraDevice_(cameraDevice), config_(config), type_(type),
 	  camera3Stream_(camera3Stream), sourceStream_(sourceStream),
-	  index_(index)
+	  index_(index), nextWorker_(0)
 {
 }
 
@@ -92,40 +98,62 @@ int CameraStream::configure()
 		output.size.width = camera3Stream_->width;
 		output.size.height = camera3Stream_->height;
 
-		switch (outFormat) {
-		case formats::NV12:
-			postProcessor_ = std::make_unique<PostProcessorYuv>();
-			break;
+		/*
+		 * JPEG encoding of large frames can take longer than the frame
+		 * duration. Use multiple workers, each with its own
+		 * post-processor instance, to encode frames in parallel. The
+		 * capture results are still delivered in order by the
+		 * CameraDevice, regardless of the order in which the workers
+		 * complete.
+		 */
+		unsigned int numWorkers = 1;
+		if (outFormat == formats::MJPEG)
+			numWorkers = jpegWorkers();
 
-		case formats::MJPEG:
-			postProcessor_ = std::make_unique<PostProcessorJpeg>(cameraDevice_);
-			break;
+		for (unsigned int i = 0; i < numWorkers; ++i) {
+			std::unique_ptr<PostProcessor> postProcessor;
 
-		default:
-			LOG(HAL, Error) << "Unsupported format: " << outFormat;
-			return -EINVAL;
-		}
+			switch (outFormat) {
+			case formats::NV12:
+				postProcessor = std::make_unique<PostProcessorYuv>();
+				break;
 
-		int ret = postProcessor_->configure(configuration(), output);
-		if (ret)
-			return ret;
+			case formats::MJPEG:
+				postProcessor = std::make_unique<PostProcessorJpeg>(cameraDevice_);
+				break;
+
+			default:
+				LOG(HAL, Error) << "Unsupported format: " << outFormat;
+				return -EINVAL;
+			}
+
+			int ret = postProcessor->configure(configuration(), output);
+			if (ret)
+				return ret;
 
-		worker_ = std::make_unique<PostProcessorWorker>(postProcessor_.get());
-		postProcessor_->processComplete.connect(
-			this, [&](Camera3RequestDescriptor::StreamBuffer *streamBuffer,
-				  PostProcessor::Status status) {
-				Camera3RequestDescriptor::Status bufferStatus;
+			postProcessor->processComplete.connect(
+				this, [&](Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+					  PostProcessor::Status status) {
+					Camera3RequestDescriptor::Status bufferStatus;
 
-				if (status == PostProcessor::Status::Success)
-					bufferStatus = Camera3RequestDescriptor::Status::Success;
-				else
-					bufferStatus = Camera3RequestDescriptor::Status::Error;
+					if (status == PostProcessor::Status::Success)
+						bufferStatus = Camera3RequestDescriptor::Status::Success;
+					else
+						bufferStatus = Camera3RequestDescriptor::Status::Error;
 
-				cameraDevice_->streamProcessingComplete(streamBuffer,
-									bufferStatus);
-			});
+					cameraDevice_->streamProcessingComplete(streamBuffer,
+										bufferStatus);
+				});
 
-		worker_->start();
+			workers_.push_back(std::make_unique<PostProcessorWorker>(postProcessor.get()));
+			postProcessors_.push_back(std::move(postProcessor));
+		}
+
+		for (std::unique_ptr<PostProcessorWorker> &worker : workers_)
+			worker->start();
+
+		LOG(HAL, Debug)
+			<< "Using " << numWorkers << " post-processing worker(s)";
 	}
 
 	allocator_ = std::make_unique<PlatformFrameBufferAllocator>(cameraDevice_);
@@ -136,6 +164,30 @@ int CameraStream::configure()
 	return 0;
 }
 
+unsigned int CameraStream::jpegWorkers()
+{
+	/*
+	 * Default to two workers when multiple CPU cores are available, to
+	 * keep up with burst captures without competing with the rest of the
+	 * camera stack for CPU time.
+	 */
+	unsigned int workers = std::clamp(std::thread::hardware_concurrency(),
+					  1U, 2U);
+
+	const char *env = utils::secure_getenv("LIBCAMERA_ANDROID_JPEG_WORKERS");
+	if (env) {
+		char *end;
+		unsigned long value = strtoul(env, &end, 10);
+		if (*end == '\0' && value > 0 && value <= 8)
+			workers = value;
+		else
+			LOG(HAL, Warning)
+				<< "Invalid JPEG workers count '" << env << "'";
+	}
+
+	return workers;
+}
+
 int CameraStream::waitFence(int fence)
 {
 	/*
@@ -182,26 +234,131 @@ int CameraStream::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 		streamBuffer->fence.reset();
 	}
 
-	const StreamConfiguration &output = configuration();
-	streamBuffer->dstBuffer = std::make_unique<CameraBuffer>(
-		*streamBuffer->camera3Buffer, output.pixelFormat, output.size,
-		PROT_READ | PROT_WRITE);
-	if (!streamBuffer->dstBuffer->isValid()) {
-		LOG(HAL, Error) << "Failed to create destination buffer";
-		return -EINVAL;
+	{
+		MutexLocker locker(*mutex_);
+
+		CachedBuffer &cached = cachedBuffer(*streamBuffer->camera3Buffer);
+		if (!cached.cameraBuffer) {
+			const StreamConfiguration &output = configuration();
+			auto buffer = std::make_unique<CameraBuffer>(
+				*streamBuffer->camera3Buffer, output.pixelFormat,
+				output.size, PROT_READ | PROT_WRITE);
+			if (!buffer->isValid()) {
+				LOG(HAL, Error) << "Failed to create destination buffer";
+				return -EINVAL;
+			}
+
+			cached.cameraBuffer = std::move(buffer);
+		}
+
+		streamBuffer->dstBuffer = cached.cameraBuffer.get();
 	}
 
-	worker_->queueRequest(streamBuffer);
+	workers_[nextWorker_]->queueRequest(streamBuffer);
+	nextWorker_ = (nextWorker_ + 1) % workers_.size();
 
 	return 0;
 }
 
-void CameraStream::flush()
+/*
+ * \brief Get the libcamera frame buffer for a buffer handle
+ * \param[in] camera3Buffer The buffer handle
+ *
+ * The frame buffer is created the first time the handle is seen, and reused
+ * for the following requests.
+ *
+ * \return The frame buffer, or nullptr if it can't be created
+ */
+HALFrameBuffer *CameraStream::frameBuffer(buffer_handle_t camera3Buffer)
 {
-	if (!postProcessor_)
-		return;
+	MutexLocker locker(*mutex_);
+
+	CachedBuffer &cached = cachedBuffer(camera3Buffer);
+	if (!cached.frameBuffer)
+		cached.frameBuffer = createFrameBuffer(camera3Buffer);
+
+	return cached.frameBuffer.get();
+}
+
+std::unique_ptr<HALFrameBuffer>
+CameraStream::createFrameBuffer(buffer_handle_t camera3Buffer)
+{
+	const StreamConfiguration &cfg = configuration();
+	CameraBuffer buf(camera3Buffer, cfg.pixelFormat, cfg.size, PROT_READ);
+	if (!buf.isValid()) {
+		LOG(HAL, Fatal) << "Failed to create CameraBuffer";
+		return nullptr;
+	}
+
+	std::vector<FrameBuffer::Plane> planes(buf.numPlanes());
+	for (size_t i = 0; i < buf.numPlanes(); ++i) {
+		SharedFD fd{ camera3Buffer->data[i] };
+		if (!fd.isValid()) {
+			LOG(HAL, Fatal) << "No valid fd";
+			return nullptr;
+		}
+
+		planes[i].fd = fd;
+		planes[i].offset = buf.offset(i);
+		planes[i].length = buf.size(i);
+	}
+
+	return std::make_unique<HALFrameBuffer>(planes, camera3Buffer);
+}
+
+/*
+ * \brief Find or create the cache entry for a buffer handle
+ * \param[in] camera3Buffer The buffer handle
+ *
+ * Handles, and the file descriptors they contain, may be reused by the
+ * framework for new buffers. Identify the buffer memory by the inode of its
+ * first file descriptor, and replace the entry when it doesn't match.
+ *
+ * The cache holds up to max_buffers entries, which is the maximum number of
+ * buffers the framework can have in flight for the stream. As requests
+ * complete in order, the least recently used entry is never in use when a new
+ * one is needed.
+ *
+ * \return The cache entry for \a camera3Buffer, moved to the front
+ */
+CameraStream::CachedBuffer &CameraStream::cachedBuffer(buffer_handle_t camera3Buffer)
+{
+	ino_t inode = 0;
+	for (int i = 0; i < camera3Buffer->numFds; i++) {
+		struct stat st;
+		if (camera3Buffer->data[i] != -1 &&
+		    !fstat(camera3Buffer->data[i], &st)) {
+			inode = st.st_ino;
+			break;
+		}
+	}
+
+	auto it = std::find_if(bufferCache_.begin(), bufferCache_.end(),
+			       [&](const CachedBuffer &entry) {
+				       return entry.handle == camera3Buffer;
+			       });
+	if (it != bufferCache_.end()) {
+		if (it->inode == inode) {
+			bufferCache_.splice(bufferCache_.begin(), bufferCache_, it);
+			return bufferCache_.front();
+		}
+
+		bufferCache_.erase(it);
+	}
+
+	size_t maxEntries = std::max(camera3Stream_->max_buffers, 1u);
+	while (bufferCache_.size() >= maxEntries)
+		bufferCache_.pop_back();
 
-	worker_->flush();
+	bufferCache_.push_front({ camera3Buffer, inode, nullptr, nullptr });
+
+	return bufferCache_.front();
+}
+
+void CameraStream::flush()
+{
+	for (std::unique_ptr<PostProcessorWorker> &worker : workers_)
+		worker->flush();
 }
 
 FrameBuffer *CameraStream::getBuffer()
@@ -224,6 +381,9 @@ FrameBuffer *CameraStream::getBuffer()
 		auto frameBuffer = allocator_->allocate(HAL_PIXEL_FORMAT_YCBCR_420_888,
 							configuration().size,
 							camera3Stream_->usage);
+		if (!frameBuffer)
+			return nullptr;
+
 		allocatedBuffers_.push_back(std::move(frameBuffer));
 		buffers_.emplace_back(allocatedBuffers_.back().get());
 	}
@@ -244,6 +404,33 @@ void CameraStream::putBuffer(FrameBuffer *buffer)
 	buffers_.push_back(buffer);
 }
 
+/*
+ * The internal buffer pool is populated on demand by getBuffer() and only
+ * grows to the number of buffers in flight, but would otherwise keep its peak
+ * size until the stream is destroyed. Free the buffers that are not in use,
+ * buffers still in flight are kept and return to the pool as usual.
+ */
+void CameraStream::releaseBuffers()
+{
+	if (!allocator_)
+		return;
+
+	MutexLocker locker(*mutex_);
+
+	for (FrameBuffer *buffer : buffers_) {
+		auto it = std::find_if(allocatedBuffers_.begin(), allocatedBuffers_.end(),
+				       [&](const std::unique_ptr<FrameBuffer> &b) {
+					       return b.get() == buffer;
+				       });
+		allocatedBuffers_.erase(it);
+	}
+
+	LOG(HAL, Debug) << "Released " << buffers_.size() << " internal buffer(s), "
+			<< allocatedBuffers_.size() << " in use";
+
+	buffers_.clear();
+}
+
 /**
  * \class CameraStream::PostProcessorWorker
  * \brief Post-process a CameraStream in an internal thread
@@ -255,9 +442,13 @@ void CameraStream::putBuffer(FrameBuffer *buffer)
  * requests is maintained by the PostProcessorWorker and it will run the
  * post-processing on an internal thread as soon as any request is available on
  * its queue.
+ *
+ * Streams that use multiple workers to post-process frames in parallel
+ * distribute the requests to the workers in a round-robin fashion, each worker
+ * having its own PostProcessor instance.
  */
 CameraStream::PostProcessorWorker::PostProcessorWorker(PostProcessor *postProcessor)
-	: postProcessor_(postProcessor)
+	: Thread("PostProcessor"), postProcessor_(postProcessor)
 {
 }
 
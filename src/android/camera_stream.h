@@ -7,8 +7,10 @@
 
 #pragma once
 
+#include <list>
 #include <memory>
 #include <queue>
+#include <sys/types.h>
 #include <vector>
 
 #include <hardware/camera3.h>
@@ -24,6 +26,7 @@
 #include "camera_request.h"
 #include "post_processor.h"
 
+class CameraBuffer;
 class CameraDevice;
 class PlatformFrameBufferAllocator;
 
@@ -128,8 +131,10 @@ public:
 
 	int configure();
 	int process(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	HALFrameBuffer *frameBuffer(buffer_handle_t camera3Buffer);
 	libcamera::FrameBuffer *getBuffer();
 	void putBuffer(libcamera::FrameBuffer *buffer);
+	void releaseBuffers();
 	void flush();
 
 private:
@@ -164,7 +169,23 @@ private:
 		State state_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = State::Stopped;
 	};
 
+	/*
+	 * Android cycles through a fixed set of buffers for each stream. Keep
+	 * the libcamera frame buffers and CameraBuffer mappings created for
+	 * them across requests, indexed by buffer handle.
+	 */
+	struct CachedBuffer {
+		buffer_handle_t handle;
+		ino_t inode;
+		std::unique_ptr<HALFrameBuffer> frameBuffer;
+		std::unique_ptr<CameraBuffer> cameraBuffer;
+	};
+
+	static unsigned int jpegWorkers();
 	int waitFence(int fence);
+	std::unique_ptr<HALFrameBuffer> createFrameBuffer(buffer_handle_t camera3Buffer);
+	CachedBuffer &cachedBuffer(buffer_handle_t camera3Buffer)
+		LIBCAMERA_TSA_REQUIRES(*mutex_);
 
 	CameraDevice *const cameraDevice_;
 	const libcamera::CameraConfiguration *config_;
@@ -176,12 +197,15 @@ private:
 	std::unique_ptr<PlatformFrameBufferAllocator> allocator_;
 	std::vector<std::unique_ptr<libcamera::FrameBuffer>> allocatedBuffers_;
 	std::vector<libcamera::FrameBuffer *> buffers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	/* Most recently used first. */
+	std::list<CachedBuffer> bufferCache_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 	/*
 	 * The class has to be MoveConstructible as instances are stored in
 	 * an std::vector in CameraDevice.
 	 */
 	std::unique_ptr<libcamera::Mutex> mutex_;
-	std::unique_ptr<PostProcessor> postProcessor_;
+	std::vector<std::unique_ptr<PostProcessor>> postProcessors_;
 
-	std::unique_ptr<PostProcessorWorker> worker_;
+	std::vector<std::unique_ptr<PostProcessorWorker>> workers_;
+	unsigned int nextWorker_;
 };
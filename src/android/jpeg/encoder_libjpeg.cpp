@@ -7,11 +7,14 @@
 
 #include "encoder_libjpeg.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdlib.h>
 #include <string.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
@@ -68,6 +71,57 @@ const struct JPEGPixelFormatInfo &findPixelInfo(const PixelFormat &format)
 	return iter->second;
 }
 
+/*
+ * Minimum image size, in pixels, above which images are encoded in multiple
+ * stripes in parallel. Smaller images, such as thumbnails, are encoded fast
+ * enough that the threads overhead isn't worth it.
+ */
+constexpr unsigned int kStripesMinPixels = 2000000;
+constexpr unsigned int kMaxStripes = 8;
+
+/*
+ * Find the entropy-coded data in a JPEG image produced by libjpeg, right after
+ * the SOS marker segment, and the position of the SOF0 marker if requested.
+ * Return 0 if the image is malformed.
+ */
+size_t findScanData(const uint8_t *data, size_t size, size_t *sofOffset)
+{
+	/* Skip the SOI marker. */
+	size_t pos = 2;
+
+	while (pos + 4 <= size) {
+		if (data[pos] != 0xff)
+			return 0;
+
+		uint8_t marker = data[pos + 1];
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+
+		if (marker == 0xc0 && sofOffset)
+			*sofOffset = pos;
+
+		pos += 2 + length;
+
+		if (marker == 0xda)
+			return pos <= size ? pos : 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Split interleaved chroma samples into separate planes. The loop is kept
+ * trivial for the compiler to vectorize it.
+ */
+void deinterleave(const uint8_t *__restrict src0, const uint8_t *__restrict src1,
+		  uint8_t *__restrict dst0, uint8_t *__restrict dst1,
+		  unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		dst0[i] = src0[2 * i];
+		dst1[i] = src1[2 * i];
+	}
+}
+
 } /* namespace */
 
 EncoderLibJpeg::EncoderLibJpeg()
@@ -102,81 +156,150 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 	nv_ = pixelFormatInfo_->numPlanes() == 2;
 	nvSwap_ = info.nvSwap;
 
+	if (nv_) {
+		unsigned int c_stride = pixelFormatInfo_->stride(cfg.size.width, 1);
+
+		horzSubSample_ = 2 * cfg.size.width / c_stride;
+		vertSubSample_ = pixelFormatInfo_->planes[1].verticalSubSampling;
+	}
+
+	setRawDataInput(compress_);
+
+	/*
+	 * Large images are encoded in horizontal stripes of whole MCU rows in
+	 * parallel, see encodeStripes().
+	 */
+	mcuHeight_ = compress_.comp_info[0].v_samp_factor * DCTSIZE;
+	unsigned int mcuRows = (cfg.size.height + mcuHeight_ - 1) / mcuHeight_;
+
+	numStripes_ = 1;
+	if (cfg.size.width * cfg.size.height >= kStripesMinPixels)
+		numStripes_ = std::min({ std::thread::hardware_concurrency(),
+					 kMaxStripes, mcuRows });
+	numStripes_ = std::max(numStripes_, 1U);
+
 	return 0;
 }
 
-void EncoderLibJpeg::compressRGB(const std::vector<Span<uint8_t>> &planes)
+/*
+ * NV formats are passed to libjpeg as raw data, with the sampling factors of
+ * the luma component matching the chroma subsampling of the format. This must
+ * be called after jpeg_set_defaults().
+ */
+void EncoderLibJpeg::setRawDataInput(struct jpeg_compress_struct &compress) const
+{
+	if (!nv_)
+		return;
+
+	compress.raw_data_in = TRUE;
+	compress.comp_info[0].h_samp_factor = horzSubSample_;
+	compress.comp_info[0].v_samp_factor = vertSubSample_;
+	compress.comp_info[1].h_samp_factor = 1;
+	compress.comp_info[1].v_samp_factor = 1;
+	compress.comp_info[2].h_samp_factor = 1;
+	compress.comp_info[2].v_samp_factor = 1;
+}
+
+void EncoderLibJpeg::compressRGB(struct jpeg_compress_struct &compress,
+				 const std::vector<Span<uint8_t>> &planes,
+				 unsigned int yOffset) const
 {
 	unsigned char *src = const_cast<unsigned char *>(planes[0].data());
 	/* \todo Stride information should come from buffer configuration. */
-	unsigned int stride = pixelFormatInfo_->stride(compress_.image_width, 0);
+	unsigned int stride = pixelFormatInfo_->stride(compress.image_width, 0);
 
 	JSAMPROW row_pointer[1];
 
-	while (compress_.next_scanline < compress_.image_height) {
-		row_pointer[0] = &src[compress_.next_scanline * stride];
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+	while (compress.next_scanline < compress.image_height) {
+		row_pointer[0] = &src[(compress.next_scanline + yOffset) * stride];
+		jpeg_write_scanlines(&compress, row_pointer, 1);
 	}
 }
 
 /*
  * Compress the incoming buffer from a supported NV format.
- * This naively unpacks the semi-planar NV12 to a YUV888 format for libjpeg.
+ *
+ * The image is handed to libjpeg as raw, already downsampled, data one iMCU
+ * row at a time. Luma rows are passed straight from the source buffer, only
+ * the interleaved chroma plane is split into separate Cb and Cr rows.
  */
-void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
+void EncoderLibJpeg::compressNV(struct jpeg_compress_struct &compress,
+				const std::vector<Span<uint8_t>> &planes,
+				unsigned int yOffset) const
 {
-	uint8_t tmprowbuf[compress_.image_width * 3];
+	const unsigned int width = compress.image_width;
+	const unsigned int height = compress.image_height;
+
+	unsigned int y_stride = pixelFormatInfo_->stride(width, 0);
+	unsigned int c_stride = pixelFormatInfo_->stride(width, 1);
 
 	/*
-	 * \todo Use the raw api, and only unpack the cb/cr samples to new line
-	 * buffers. If possible, see if we can set appropriate pixel strides
-	 * too to save even that copy.
-	 *
-	 * Possible hints at:
-	 * https://sourceforge.net/p/libjpeg/mailman/message/30815123/
+	 * libjpeg reads whole blocks, rows must be padded to a multiple of
+	 * DCTSIZE samples and the image to a whole number of iMCU rows.
 	 */
-	unsigned int y_stride = pixelFormatInfo_->stride(compress_.image_width, 0);
-	unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+	const jpeg_component_info &yInfo = compress.comp_info[0];
+	const jpeg_component_info &cInfo = compress.comp_info[1];
 
-	unsigned int horzSubSample = 2 * compress_.image_width / c_stride;
-	unsigned int vertSubSample = pixelFormatInfo_->planes[1].verticalSubSampling;
+	const unsigned int yWidth = yInfo.width_in_blocks * DCTSIZE;
+	const unsigned int yRows = yInfo.v_samp_factor * DCTSIZE;
+	const unsigned int cWidth = cInfo.width_in_blocks * DCTSIZE;
+	const unsigned int cRows = cInfo.v_samp_factor * DCTSIZE;
 
-	unsigned int c_inc = horzSubSample == 1 ? 2 : 0;
-	unsigned int cb_pos = nvSwap_ ? 1 : 0;
-	unsigned int cr_pos = nvSwap_ ? 0 : 1;
+	const unsigned int cSamples = (width + horzSubSample_ - 1) / horzSubSample_;
+	const unsigned int cHeight = (height + vertSubSample_ - 1) / vertSubSample_;
 
-	const unsigned char *src = planes[0].data();
-	const unsigned char *src_c = planes[1].data();
+	const unsigned char *src_y = planes[0].data() + yOffset * y_stride;
+	const unsigned char *src_c = planes[1].data() + yOffset / vertSubSample_ * c_stride;
+	const unsigned int cb_pos = nvSwap_ ? 1 : 0;
+	const unsigned int cr_pos = nvSwap_ ? 0 : 1;
 
-	JSAMPROW row_pointer[1];
-	row_pointer[0] = &tmprowbuf[0];
-
-	for (unsigned int y = 0; y < compress_.image_height; y++) {
-		unsigned char *dst = &tmprowbuf[0];
-
-		const unsigned char *src_y = src + y * y_stride;
-		const unsigned char *src_cb = src_c + (y / vertSubSample) * c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample) * c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < compress_.image_width; x += 2) {
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 3;
-
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 3;
+	/*
+	 * Luma rows are copied only when they need to be padded, which isn't
+	 * the case for widths multiple of DCTSIZE.
+	 */
+	std::vector<unsigned char> ybuf(yWidth > width ? yWidth * yRows : 0);
+	std::vector<unsigned char> cbbuf(cWidth * cRows);
+	std::vector<unsigned char> crbuf(cWidth * cRows);
+
+	std::vector<JSAMPROW> yrows(yRows);
+	std::vector<JSAMPROW> cbrows(cRows);
+	std::vector<JSAMPROW> crrows(cRows);
+	JSAMPARRAY data[3] = { yrows.data(), cbrows.data(), crrows.data() };
+
+	for (unsigned int row = 0; row < height; row += yRows) {
+		for (unsigned int i = 0; i < yRows; i++) {
+			/* Replicate the last row to fill the last iMCU row. */
+			unsigned int y = std::min(row + i, height - 1);
+			const unsigned char *line = src_y + y * y_stride;
+
+			if (ybuf.empty()) {
+				yrows[i] = const_cast<JSAMPROW>(line);
+				continue;
+			}
+
+			unsigned char *dst = &ybuf[i * yWidth];
+			memcpy(dst, line, width);
+			memset(dst + width, line[width - 1], yWidth - width);
+			yrows[i] = dst;
 		}
 
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+		unsigned int crow = row / vertSubSample_;
+
+		for (unsigned int i = 0; i < cRows; i++) {
+			unsigned int y = std::min(crow + i, cHeight - 1);
+			const unsigned char *line = src_c + y * c_stride;
+			unsigned char *cb = &cbbuf[i * cWidth];
+			unsigned char *cr = &crbuf[i * cWidth];
+
+			deinterleave(line + cb_pos, line + cr_pos, cb, cr, cSamples);
+			memset(cb + cSamples, cb[cSamples - 1], cWidth - cSamples);
+			memset(cr + cSamples, cr[cSamples - 1], cWidth - cSamples);
+
+			cbrows[i] = cb;
+			crrows[i] = cr;
+		}
+
+		jpeg_write_raw_data(&compress, data, yRows);
 	}
 }
 
@@ -200,6 +323,11 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 			   Span<uint8_t> dest, Span<const uint8_t> exifData,
 			   unsigned int quality)
 {
+	ASSERT(src.size() == pixelFormatInfo_->numPlanes());
+
+	if (numStripes_ > 1)
+		return encodeStripes(src, dest, exifData, quality);
+
 	unsigned char *destination = dest.data();
 	unsigned long size = dest.size();
 
@@ -226,14 +354,195 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
 			 << "x" << compress_.image_height;
 
-	ASSERT(src.size() == pixelFormatInfo_->numPlanes());
-
 	if (nv_)
-		compressNV(src);
+		compressNV(compress_, src, 0);
 	else
-		compressRGB(src);
+		compressRGB(compress_, src, 0);
 
 	jpeg_finish_compress(&compress_);
 
 	return size;
 }
+
+void EncoderLibJpeg::encodeStripe(const std::vector<Span<uint8_t>> &src,
+				  Stripe &stripe, Span<const uint8_t> exifData,
+				  unsigned int quality) const
+{
+	struct jpeg_compress_struct compress;
+	struct jpeg_error_mgr jerr;
+
+	compress.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&compress);
+
+	unsigned int y = stripe.row * mcuHeight_;
+
+	compress.image_width = compress_.image_width;
+	compress.image_height = std::min(stripe.rows * mcuHeight_,
+					 compress_.image_height - y);
+	compress.in_color_space = compress_.in_color_space;
+	compress.input_components = compress_.input_components;
+
+	jpeg_set_defaults(&compress);
+	setRawDataInput(compress);
+	jpeg_set_quality(&compress, quality, TRUE);
+
+	/*
+	 * Insert a restart marker after every MCU row. This resets the DC
+	 * predictors at the stripe boundaries, which makes the entropy-coded
+	 * data of the stripes independent.
+	 */
+	compress.restart_in_rows = 1;
+
+	/* Let libjpeg allocate the output buffer, it's freed by the caller. */
+	stripe.data = nullptr;
+	stripe.size = 0;
+	jpeg_mem_dest(&compress, &stripe.data, &stripe.size);
+
+	jpeg_start_compress(&compress, TRUE);
+
+	if (exifData.size())
+		jpeg_write_marker(&compress, JPEG_APP0 + 1,
+				  static_cast<const JOCTET *>(exifData.data()),
+				  exifData.size());
+
+	if (nv_)
+		compressNV(compress, src, y);
+	else
+		compressRGB(compress, src, y);
+
+	jpeg_finish_compress(&compress);
+	jpeg_destroy_compress(&compress);
+}
+
+/*
+ * Encode the image in horizontal stripes in parallel, and assemble them into
+ * a single baseline JPEG image.
+ *
+ * Each stripe is encoded as a separate image with a restart interval of one
+ * MCU row. As all stripes use the default quantization and Huffman tables,
+ * their entropy-coded data can be concatenated, separated by restart markers,
+ * after the headers of the first stripe with the image height patched in the
+ * SOF0 segment. Restart markers are numbered modulo 8 in the whole image, the
+ * markers of each stripe are renumbered accordingly.
+ */
+int EncoderLibJpeg::encodeStripes(const std::vector<Span<uint8_t>> &src,
+				  Span<uint8_t> dest, Span<const uint8_t> exifData,
+				  unsigned int quality)
+{
+	unsigned int mcuRows = (compress_.image_height + mcuHeight_ - 1) / mcuHeight_;
+	std::vector<Stripe> stripes(numStripes_);
+
+	for (unsigned int i = 0; i < numStripes_; ++i) {
+		stripes[i].row = mcuRows * i / numStripes_;
+		stripes[i].rows = mcuRows * (i + 1) / numStripes_ - stripes[i].row;
+	}
+
+	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
+			 << "x" << compress_.image_height << " in "
+			 << numStripes_ << " stripes";
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numStripes_; ++i)
+		threads.emplace_back(&EncoderLibJpeg::encodeStripe, this,
+				     std::cref(src), std::ref(stripes[i]),
+				     Span<const uint8_t>{}, quality);
+
+	/* The Exif data belongs in the headers, taken from the first stripe. */
+	encodeStripe(src, stripes[0], exifData, quality);
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	int ret = assembleStripes(stripes, dest);
+
+	for (Stripe &stripe : stripes)
+		free(stripe.data);
+
+	return ret;
+}
+
+int EncoderLibJpeg::assembleStripes(const std::vector<Stripe> &stripes,
+				    Span<uint8_t> dest) const
+{
+	size_t out = 0;
+	bool overflow = false;
+
+	auto write = [&](const uint8_t *data, size_t size) {
+		if (overflow || dest.size() - out < size) {
+			overflow = true;
+			return;
+		}
+
+		memcpy(dest.data() + out, data, size);
+		out += size;
+	};
+
+	auto writeRestart = [&](unsigned int row) {
+		const uint8_t marker[2] = { 0xff, static_cast<uint8_t>(0xd0 | (row % 8)) };
+		write(marker, sizeof(marker));
+	};
+
+	for (const Stripe &stripe : stripes) {
+		size_t sof = 0;
+		size_t start = findScanData(stripe.data, stripe.size, &sof);
+		if (!start || !sof || stripe.size < start + 2 ||
+		    stripe.data[stripe.size - 2] != 0xff ||
+		    stripe.data[stripe.size - 1] != 0xd9) {
+			LOG(JPEG, Error) << "Malformed JPEG stripe";
+			return -EINVAL;
+		}
+
+		if (&stripe == &stripes.front()) {
+			/* Copy the headers and patch the image height. */
+			write(stripe.data, start);
+			if (overflow)
+				break;
+
+			dest[sof + 5] = compress_.image_height >> 8;
+			dest[sof + 6] = compress_.image_height & 0xff;
+		} else {
+			/* Separate the stripe from the previous one. */
+			writeRestart(stripe.row - 1);
+		}
+
+		/*
+		 * Copy the entropy-coded data and renumber the restart markers.
+		 * Other 0xff bytes are followed by a stuffed 0x00 byte.
+		 */
+		const uint8_t *data = stripe.data;
+		const size_t end = stripe.size - 2;
+		unsigned int row = stripe.row;
+		size_t pos = start;
+
+		while (pos < end && !overflow) {
+			const void *ff = memchr(data + pos, 0xff, end - pos);
+			size_t length = ff ? static_cast<const uint8_t *>(ff) - (data + pos)
+					   : end - pos;
+
+			write(data + pos, length);
+			pos += length;
+
+			if (pos + 1 >= end) {
+				write(data + pos, end - pos);
+				break;
+			}
+
+			if ((data[pos + 1] & 0xf8) == 0xd0)
+				writeRestart(row++);
+			else
+				write(data + pos, 2);
+
+			pos += 2;
+		}
+	}
+
+	const uint8_t eoi[2] = { 0xff, 0xd9 };
+	write(eoi, sizeof(eoi));
+
+	if (overflow) {
+		LOG(JPEG, Error) << "Destination buffer too small for JPEG image";
+		return -ENOSPC;
+	}
+
+	return out;
+}
@@ -31,8 +31,30 @@ public:
 		   unsigned int quality);
 
 private:
-	void compressRGB(const std::vector<libcamera::Span<uint8_t>> &planes);
-	void compressNV(const std::vector<libcamera::Span<uint8_t>> &planes);
+	struct Stripe {
+		unsigned int row;
+		unsigned int rows;
+		unsigned char *data;
+		unsigned long size;
+	};
+
+	void setRawDataInput(struct jpeg_compress_struct &compress) const;
+	void compressRGB(struct jpeg_compress_struct &compress,
+			 const std::vector<libcamera::Span<uint8_t>> &planes,
+			 unsigned int yOffset) const;
+	void compressNV(struct jpeg_compress_struct &compress,
+			const std::vector<libcamera::Span<uint8_t>> &planes,
+			unsigned int yOffset) const;
+
+	void encodeStripe(const std::vector<libcamera::Span<uint8_t>> &src,
+			  Stripe &stripe, libcamera::Span<const uint8_t> exifData,
+			  unsigned int quality) const;
+	int encodeStripes(const std::vector<libcamera::Span<uint8_t>> &src,
+			  libcamera::Span<uint8_t> dest,
+			  libcamera::Span<const uint8_t> exifData,
+			  unsigned int quality);
+	int assembleStripes(const std::vector<Stripe> &stripes,
+			    libcamera::Span<uint8_t> dest) const;
 
 	struct jpeg_compress_struct compress_;
 	struct jpeg_error_mgr jerr_;
@@ -41,4 +63,9 @@ private:
 
 	bool nv_;
 	bool nvSwap_;
+	unsigned int horzSubSample_;
+	unsigned int vertSubSample_;
+
+	unsigned int mcuHeight_;
+	unsigned int numStripes_;
 };
@@ -0,0 +1,494 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * JPEG encoding using a V4L2 memory-to-memory encoder
+ */
+
+#include "encoder_v4l2_m2m.h"
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <initializer_list>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "../camera_buffer.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+LOG_DECLARE_CATEGORY(JPEG)
+
+namespace {
+
+/* Hardware encoders take a few tens of milliseconds even for large images. */
+constexpr std::chrono::milliseconds kEncodeTimeout = 1000ms;
+
+bool hasFormat(int fd, uint32_t type, std::initializer_list<uint32_t> fourccs)
+{
+	for (unsigned int index = 0;; index++) {
+		struct v4l2_fmtdesc desc = {};
+		desc.index = index;
+		desc.type = type;
+
+		if (ioctl(fd, VIDIOC_ENUM_FMT, &desc) < 0)
+			return false;
+
+		if (std::find(fourccs.begin(), fourccs.end(), desc.pixelformat) !=
+		    fourccs.end())
+			return true;
+	}
+}
+
+/*
+ * Check if the video device at \a node is a memory-to-memory device that
+ * encodes NV12 to JPEG. Accesses the device directly with ioctls instead of
+ * a V4L2M2MDevice, to quietly skip all the other video devices.
+ */
+bool isJpegEncoder(const std::string &node)
+{
+	UniqueFD fd(open(node.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC));
+	if (!fd.isValid())
+		return false;
+
+	V4L2Capability caps;
+	if (ioctl(fd.get(), VIDIOC_QUERYCAP, &caps) < 0 || !caps.isM2M())
+		return false;
+
+	bool mplane = caps.isMultiplanar();
+	uint32_t outputType = mplane ? V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE
+				     : V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	uint32_t captureType = mplane ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+				      : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (!hasFormat(fd.get(), captureType, { V4L2_PIX_FMT_JPEG }) ||
+	    !hasFormat(fd.get(), outputType, { V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12M }))
+		return false;
+
+	LOG(JPEG, Info)
+		<< "Found V4L2 JPEG encoder " << caps.driver() << " at " << node;
+
+	return true;
+}
+
+std::string findEncoder()
+{
+	std::vector<std::string> nodes;
+
+	DIR *dir = opendir("/dev");
+	if (!dir)
+		return {};
+
+	while (struct dirent *entry = readdir(dir)) {
+		if (!strncmp(entry->d_name, "video", 5))
+			nodes.push_back(std::string("/dev/") + entry->d_name);
+	}
+
+	closedir(dir);
+
+	std::sort(nodes.begin(), nodes.end());
+
+	for (const std::string &node : nodes) {
+		if (isJpegEncoder(node))
+			return node;
+	}
+
+	return {};
+}
+
+/*
+ * Copy the JPEG image produced by the encoder to the destination buffer, and
+ * insert the Exif data in an APP1 segment right after the SOI marker. A JFIF
+ * APP0 segment, if any, is dropped as Exif and JFIF are mutually exclusive.
+ */
+int writeJpeg(Span<const uint8_t> jpeg, Span<const uint8_t> exifData,
+	      Span<uint8_t> dest)
+{
+	if (jpeg.size() < 4 || jpeg[0] != 0xff || jpeg[1] != 0xd8) {
+		LOG(JPEG, Error) << "Invalid JPEG image from encoder";
+		return -EINVAL;
+	}
+
+	/* The segment length includes the two length bytes. */
+	if (exifData.size() > 0xffff - 2) {
+		LOG(JPEG, Error) << "Exif data too large";
+		return -EINVAL;
+	}
+
+	size_t pos = 2;
+	if (exifData.size() && jpeg.size() >= 6 && jpeg[2] == 0xff && jpeg[3] == 0xe0)
+		pos += 2 + ((jpeg[4] << 8) | jpeg[5]);
+
+	size_t exifSize = exifData.size() ? exifData.size() + 4 : 0;
+	if (pos >= jpeg.size() || 2 + exifSize + jpeg.size() - pos > dest.size()) {
+		LOG(JPEG, Error) << "Destination buffer too small for JPEG image";
+		return -ENOSPC;
+	}
+
+	uint8_t *out = dest.data();
+	out[0] = 0xff;
+	out[1] = 0xd8;
+	out += 2;
+
+	if (exifSize) {
+		out[0] = 0xff;
+		out[1] = 0xe1;
+		out[2] = (exifData.size() + 2) >> 8;
+		out[3] = (exifData.size() + 2) & 0xff;
+		memcpy(out + 4, exifData.data(), exifData.size());
+		out += exifSize;
+	}
+
+	memcpy(out, jpeg.data() + pos, jpeg.size() - pos);
+	out += jpeg.size() - pos;
+
+	return out - dest.data();
+}
+
+} /* namespace */
+
+/*
+ * The worker owns the V4L2 device and lives in the encoder thread, whose event
+ * loop dequeues the buffers. The caller queues a frame through the worker and
+ * waits for both buffers to complete.
+ */
+class EncoderV4L2M2M::Worker : public Object
+{
+public:
+	Worker(const std::string &deviceNode)
+		: deviceNode_(deviceNode), quality_(0), pending_(0),
+		  result_(0), bytesused_(0)
+	{
+	}
+
+	int configure(const StreamConfiguration &cfg);
+	int queue(FrameBuffer *source, unsigned int quality);
+	void cancel();
+	void stop();
+
+	int wait();
+	Span<const uint8_t> jpeg(unsigned int size) const;
+
+private:
+	void restart();
+	void setQuality(unsigned int quality);
+
+	void outputBufferReady(FrameBuffer *buffer);
+	void captureBufferReady(FrameBuffer *buffer);
+
+	std::string deviceNode_;
+	std::unique_ptr<V4L2M2MDevice> m2m_;
+	std::vector<std::unique_ptr<FrameBuffer>> captureBuffers_;
+	std::unique_ptr<MappedFrameBuffer> captureMap_;
+	unsigned int quality_;
+
+	Mutex mutex_;
+	ConditionVariable cv_;
+	unsigned int pending_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int result_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int bytesused_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+int EncoderV4L2M2M::Worker::configure(const StreamConfiguration &cfg)
+{
+	stop();
+
+	m2m_ = std::make_unique<V4L2M2MDevice>(deviceNode_);
+	int ret = m2m_->open();
+	if (ret) {
+		m2m_.reset();
+		return ret;
+	}
+
+	V4L2VideoDevice *output = m2m_->output();
+	V4L2VideoDevice *capture = m2m_->capture();
+
+	/* The source buffers are imported as-is, their layout must match. */
+	V4L2PixelFormat videoFormat = output->toV4L2PixelFormat(cfg.pixelFormat);
+
+	V4L2DeviceFormat format;
+	format.fourcc = videoFormat;
+	format.size = cfg.size;
+	format.planesCount = 1;
+	format.planes[0].bpl = cfg.stride;
+
+	ret = output->setFormat(&format);
+	if (ret < 0 || format.fourcc != videoFormat || format.size != cfg.size ||
+	    format.planes[0].bpl != cfg.stride) {
+		LOG(JPEG, Info)
+			<< "Input format " << cfg.toString()
+			<< " not supported by V4L2 JPEG encoder";
+		stop();
+		return -EINVAL;
+	}
+
+	videoFormat = V4L2PixelFormat(V4L2_PIX_FMT_JPEG);
+	format = {};
+	format.fourcc = videoFormat;
+	format.size = cfg.size;
+
+	ret = capture->setFormat(&format);
+	if (ret < 0 || format.fourcc != videoFormat || format.size != cfg.size) {
+		LOG(JPEG, Info)
+			<< "Output size " << cfg.size
+			<< " not supported by V4L2 JPEG encoder";
+		stop();
+		return -EINVAL;
+	}
+
+	ret = output->importBuffers(std::max(cfg.bufferCount, 1U));
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	/*
+	 * The compressed image is small compared to the source frame, encode
+	 * it to a single internal buffer and copy it to the destination along
+	 * with the Exif data.
+	 */
+	ret = capture->allocateBuffers(1, &captureBuffers_);
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	captureMap_ = std::make_unique<MappedFrameBuffer>(captureBuffers_[0].get(),
+							  MappedFrameBuffer::MapFlag::Read);
+	if (!captureMap_->isValid()) {
+		ret = captureMap_->error();
+		stop();
+		return ret;
+	}
+
+	output->bufferReady.connect(this, &Worker::outputBufferReady);
+	capture->bufferReady.connect(this, &Worker::captureBufferReady);
+
+	ret = output->streamOn();
+	if (ret >= 0)
+		ret = capture->streamOn();
+	if (ret < 0) {
+		stop();
+		return ret;
+	}
+
+	return 0;
+}
+
+int EncoderV4L2M2M::Worker::queue(FrameBuffer *source, unsigned int quality)
+{
+	if (!m2m_)
+		return -ENODEV;
+
+	if (quality != quality_)
+		setQuality(quality);
+
+	{
+		MutexLocker locker(mutex_);
+		pending_ = 2;
+		result_ = 0;
+		bytesused_ = 0;
+	}
+
+	int ret = m2m_->capture()->queueBuffer(captureBuffers_[0].get());
+	if (ret >= 0)
+		ret = m2m_->output()->queueBuffer(source);
+	if (ret < 0) {
+		LOG(JPEG, Error) << "Failed to queue buffers to V4L2 JPEG encoder";
+		cancel();
+		return ret;
+	}
+
+	return 0;
+}
+
+/* Return the buffers still queued to the device. */
+void EncoderV4L2M2M::Worker::cancel()
+{
+	{
+		MutexLocker locker(mutex_);
+		pending_ = 0;
+	}
+
+	restart();
+}
+
+void EncoderV4L2M2M::Worker::stop()
+{
+	if (!m2m_)
+		return;
+
+	{
+		MutexLocker locker(mutex_);
+		pending_ = 0;
+	}
+
+	m2m_->capture()->streamOff();
+	m2m_->output()->streamOff();
+
+	captureMap_.reset();
+	captureBuffers_.clear();
+
+	m2m_->capture()->releaseBuffers();
+	m2m_->output()->releaseBuffers();
+
+	m2m_.reset();
+	quality_ = 0;
+}
+
+int EncoderV4L2M2M::Worker::wait()
+{
+	MutexLocker locker(mutex_);
+
+	bool done = cv_.wait_for(locker, kEncodeTimeout,
+				 [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+					 return !pending_;
+				 });
+	if (!done)
+		return -ETIMEDOUT;
+
+	return result_ < 0 ? result_ : bytesused_;
+}
+
+Span<const uint8_t> EncoderV4L2M2M::Worker::jpeg(unsigned int size) const
+{
+	Span<const uint8_t> plane = captureMap_->planes()[0];
+	return plane.first(std::min<size_t>(size, plane.size()));
+}
+
+void EncoderV4L2M2M::Worker::restart()
+{
+	m2m_->capture()->streamOff();
+	m2m_->output()->streamOff();
+	m2m_->output()->streamOn();
+	m2m_->capture()->streamOn();
+}
+
+void EncoderV4L2M2M::Worker::setQuality(unsigned int quality)
+{
+	/* Not all encoders expose the quality, resort to their default. */
+	const ControlInfoMap &controls = m2m_->capture()->controls();
+	if (controls.find(V4L2_CID_JPEG_COMPRESSION_QUALITY) != controls.end()) {
+		ControlList ctrls(controls);
+		ctrls.set(V4L2_CID_JPEG_COMPRESSION_QUALITY,
+			  static_cast<int32_t>(quality));
+
+		if (m2m_->capture()->setControls(&ctrls))
+			LOG(JPEG, Warning) << "Failed to set JPEG quality";
+	}
+
+	quality_ = quality;
+}
+
+void EncoderV4L2M2M::Worker::outputBufferReady(FrameBuffer *buffer)
+{
+	MutexLocker locker(mutex_);
+
+	if (!pending_)
+		return;
+
+	if (buffer->metadata().status != FrameMetadata::FrameSuccess)
+		result_ = -EIO;
+
+	if (!--pending_)
+		cv_.notify_one();
+}
+
+void EncoderV4L2M2M::Worker::captureBufferReady(FrameBuffer *buffer)
+{
+	const FrameMetadata &metadata = buffer->metadata();
+
+	MutexLocker locker(mutex_);
+
+	if (!pending_)
+		return;
+
+	if (metadata.status != FrameMetadata::FrameSuccess)
+		result_ = -EIO;
+	else
+		bytesused_ = metadata.planes()[0].bytesused;
+
+	if (!--pending_)
+		cv_.notify_one();
+}
+
+EncoderV4L2M2M::EncoderV4L2M2M(const std::string &deviceNode)
+	: thread_("JpegEncoder")
+{
+	worker_ = std::make_unique<Worker>(deviceNode);
+	worker_->moveToThread(&thread_);
+	thread_.start();
+}
+
+EncoderV4L2M2M::~EncoderV4L2M2M()
+{
+	worker_->invokeMethod(&Worker::stop, ConnectionTypeBlocking);
+
+	thread_.exit();
+	thread_.wait();
+}
+
+/*
+ * Find the first V4L2 memory-to-memory JPEG encoder in the system. The device
+ * nodes are scanned once, the first call should happen at HAL initialization
+ * time to keep it out of stream configuration.
+ *
+ * Return the device node path, or an empty string if no encoder is available.
+ */
+const std::string &EncoderV4L2M2M::probe()
+{
+	static const std::string deviceNode = findEncoder();
+
+	return deviceNode;
+}
+
+int EncoderV4L2M2M::configure(const StreamConfiguration &cfg)
+{
+	return worker_->invokeMethod(&Worker::configure, ConnectionTypeBlocking,
+				     cfg);
+}
+
+int EncoderV4L2M2M::encode(Camera3RequestDescriptor::StreamBuffer *buffer,
+			   Span<const uint8_t> exifData, unsigned int quality)
+{
+	/*
+	 * The source dmabuf is imported by the device. The buffer is only
+	 * read, but V4L2VideoDevice requires a mutable FrameBuffer.
+	 */
+	FrameBuffer *source = const_cast<FrameBuffer *>(buffer->srcBuffer);
+
+	int ret = worker_->invokeMethod(&Worker::queue, ConnectionTypeBlocking,
+					source, quality);
+	if (ret < 0)
+		return ret;
+
+	ret = worker_->wait();
+	if (ret < 0) {
+		LOG(JPEG, Error)
+			<< "V4L2 JPEG encoding failed: " << strerror(-ret);
+
+		/* Reclaim the source buffer before handing it back. */
+		worker_->invokeMethod(&Worker::cancel, ConnectionTypeBlocking);
+		return ret;
+	}
+
+	return writeJpeg(worker_->jpeg(ret), exifData,
+			 buffer->dstBuffer->plane(0));
+}
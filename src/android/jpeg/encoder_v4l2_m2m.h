@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * JPEG encoding using a V4L2 memory-to-memory encoder
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <libcamera/base/thread.h>
+
+#include <libcamera/geometry.h>
+
+#include "encoder.h"
+
+class EncoderV4L2M2M : public Encoder
+{
+public:
+	EncoderV4L2M2M(const std::string &deviceNode);
+	~EncoderV4L2M2M();
+
+	static const std::string &probe();
+
+	int configure(const libcamera::StreamConfiguration &cfg) override;
+	int encode(Camera3RequestDescriptor::StreamBuffer *buffer,
+		   libcamera::Span<const uint8_t> exifData,
+		   unsigned int quality) override;
+
+private:
+	class Worker;
+
+	libcamera::Thread thread_;
+	std::unique_ptr<Worker> worker_;
+};
@@ -41,6 +41,10 @@ enum class _ExifTag {
  * Calls to generate() must check the return code to determine if any error
  * occurred during the construction of the Exif data, and if successful the
  * data can be obtained using the data() function.
+ *
+ * An instance can be reused for multiple images, by updating the properties
+ * that differ and calling generate() again. Setting a property replaces its
+ * previous value, and the clear*() functions remove optional properties.
  */
 Exif::Exif()
 	: valid_(false), data_(nullptr), order_(EXIF_BYTE_ORDER_INTEL),
@@ -155,6 +159,15 @@ ExifEntry *Exif::createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 	return entry;
 }
 
+void Exif::removeEntry(ExifIfd ifd, ExifTag tag)
+{
+	ExifContent *content = data_->ifd[ifd];
+	ExifEntry *entry = exif_content_get_entry(content, tag);
+
+	if (entry)
+		exif_content_remove_entry(content, entry);
+}
+
 void Exif::setByte(ExifIfd ifd, ExifTag tag, uint8_t item)
 {
 	ExifEntry *entry = createEntry(ifd, tag, EXIF_FORMAT_BYTE, 1, 1);
@@ -408,6 +421,15 @@ void Exif::setGPSMethod(const std::string &method)
 		  EXIF_FORMAT_UNDEFINED, method, NoEncoding);
 }
 
+void Exif::clearGPS()
+{
+	ExifContent *content = data_->ifd[EXIF_IFD_GPS];
+
+	while (content->count)
+		exif_content_remove_entry(content,
+					  content->entries[content->count - 1]);
+}
+
 void Exif::setOrientation(int orientation)
 {
 	int value;
@@ -441,6 +463,16 @@ void Exif::setThumbnail(std::vector<unsigned char> &&thumbnail,
 	setShort(EXIF_IFD_0, EXIF_TAG_COMPRESSION, compression);
 }
 
+void Exif::clearThumbnail()
+{
+	data_->data = nullptr;
+	data_->size = 0;
+
+	thumbnailData_.clear();
+
+	removeEntry(EXIF_IFD_0, EXIF_TAG_COMPRESSION);
+}
+
 void Exif::setFocalLength(float length)
 {
 	ExifRational rational = { static_cast<ExifLong>(length * 1000), 1000 };
@@ -459,6 +491,11 @@ void Exif::setAperture(float size)
 	setRational(EXIF_IFD_EXIF, EXIF_TAG_FNUMBER, rational);
 }
 
+void Exif::clearAperture()
+{
+	removeEntry(EXIF_IFD_EXIF, EXIF_TAG_FNUMBER);
+}
+
 void Exif::setISO(uint16_t iso)
 {
 	setShort(EXIF_IFD_EXIF, EXIF_TAG_ISO_SPEED_RATINGS, iso);
@@ -63,15 +63,18 @@ public:
 	void setSize(const libcamera::Size &size);
 	void setThumbnail(std::vector<unsigned char> &&thumbnail,
 			  Compression compression);
+	void clearThumbnail();
 	void setTimestamp(time_t timestamp, std::chrono::milliseconds msec);
 
 	void setGPSDateTimestamp(time_t timestamp);
 	void setGPSLocation(const double *coords);
 	void setGPSMethod(const std::string &method);
+	void clearGPS();
 
 	void setFocalLength(float length);
 	void setExposureTime(uint64_t nsec);
 	void setAperture(float size);
+	void clearAperture();
 	void setISO(uint16_t iso);
 	void setFlash(Flash flash);
 	void setWhiteBalance(WhiteBalance wb);
@@ -83,6 +86,7 @@ private:
 	ExifEntry *createEntry(ExifIfd ifd, ExifTag tag);
 	ExifEntry *createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 			       unsigned long components, unsigned int size);
+	void removeEntry(ExifIfd ifd, ExifTag tag);
 
 	void setByte(ExifIfd ifd, ExifTag tag, uint8_t item);
 	void setShort(ExifIfd ifd, ExifTag tag, uint16_t item);
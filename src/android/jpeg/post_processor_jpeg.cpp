@@ -8,6 +8,9 @@
 #include "post_processor_jpeg.h"
 
 #include <chrono>
+#include <optional>
+#include <string.h>
+#include <thread>
 
 #include "../camera_device.h"
 #include "../camera_metadata.h"
@@ -16,20 +19,74 @@
 #include "encoder_jea.h"
 #else /* !defined(OS_CHROMEOS) */
 #include "encoder_libjpeg.h"
+#include "encoder_v4l2_m2m.h"
 #endif
-#include "exif.h"
 
 #include <libcamera/base/log.h>
 
 #include <libcamera/formats.h>
 
+#include "libcamera/internal/mapped_framebuffer.h"
+
 using namespace libcamera;
 using namespace std::chrono_literals;
 
 LOG_DEFINE_CATEGORY(JPEG)
 
+namespace {
+
+/*
+ * Insert the Exif data in an APP1 segment of the JPEG image stored at the
+ * beginning of the buffer, after the SOI marker and the JFIF APP0 segment if
+ * any, where libjpeg writes it. Return the new size of the image, or a
+ * negative error code.
+ */
+int insertExif(Span<uint8_t> buffer, size_t jpegSize,
+	       Span<const uint8_t> exifData)
+{
+	if (exifData.empty())
+		return jpegSize;
+
+	if (exifData.size() > 0xffff - 2) {
+		LOG(JPEG, Error) << "Exif data too large";
+		return -EINVAL;
+	}
+
+	if (jpegSize < 4 || buffer[0] != 0xff || buffer[1] != 0xd8) {
+		LOG(JPEG, Error) << "Invalid JPEG image";
+		return -EINVAL;
+	}
+
+	size_t pos = 2;
+	if (buffer[2] == 0xff && buffer[3] == 0xe0) {
+		if (jpegSize < 6)
+			return -EINVAL;
+
+		pos += 2 + ((buffer[4] << 8) | buffer[5]);
+	}
+
+	size_t segmentSize = exifData.size() + 4;
+	if (pos > jpegSize || jpegSize + segmentSize > buffer.size()) {
+		LOG(JPEG, Error) << "No space left to insert Exif data";
+		return -ENOSPC;
+	}
+
+	uint8_t *segment = buffer.data() + pos;
+	memmove(segment + segmentSize, segment, jpegSize - pos);
+
+	segment[0] = 0xff;
+	segment[1] = 0xe1;
+	segment[2] = (exifData.size() + 2) >> 8;
+	segment[3] = (exifData.size() + 2) & 0xff;
+	memcpy(segment + 4, exifData.data(), exifData.size());
+
+	return jpegSize + segmentSize;
+}
+
+} /* namespace */
+
 PostProcessorJpeg::PostProcessorJpeg(CameraDevice *const device)
-	: cameraDevice_(device)
+	: cameraDevice_(device), softwareEncoder_(nullptr), hardwareEncoder_(false)
 {
 }
 
@@ -47,39 +104,74 @@ int PostProcessorJpeg::configure(const StreamConfiguration &inCfg,
 	}
 
 	streamSize_ = outCfg.size;
+	inputConfig_ = inCfg;
 
 	thumbnailer_.configure(inCfg.size, inCfg.pixelFormat);
 
+	/* Set the EXIF tags that don't change from frame to frame. */
+	exif_.setMake(cameraDevice_->maker());
+	exif_.setModel(cameraDevice_->model());
+	exif_.setSize(streamSize_);
+	exif_.setFlash(Exif::Flash::FlashNotPresent);
+	exif_.setWhiteBalance(Exif::WhiteBalance::Auto);
+	exif_.setFocalLength(1.0);
+
 #if defined(OS_CHROMEOS)
 	encoder_ = std::make_unique<EncoderJea>();
+
+	return encoder_->configure(inCfg);
 #else /* !defined(OS_CHROMEOS) */
-	encoder_ = std::make_unique<EncoderLibJpeg>();
+	/*
+	 * Prefer the V4L2 memory-to-memory encoder when the system has one,
+	 * and fall back to libjpeg for the streams it can't handle.
+	 */
+	const std::string &encoderNode = EncoderV4L2M2M::probe();
+	if (!encoderNode.empty()) {
+		encoder_ = std::make_unique<EncoderV4L2M2M>(encoderNode);
+		if (!encoder_->configure(inCfg)) {
+			hardwareEncoder_ = true;
+			return 0;
+		}
+
+		LOG(JPEG, Info)
+			<< "Using software JPEG encoder for " << inCfg.toString();
+	}
+
+	return configureSoftwareEncoder();
 #endif
+}
 
-	return encoder_->configure(inCfg);
+int PostProcessorJpeg::configureSoftwareEncoder()
+{
+	auto encoder = std::make_unique<EncoderLibJpeg>();
+	int ret = encoder->configure(inputConfig_);
+
+	softwareEncoder_ = encoder.get();
+	encoder_ = std::move(encoder);
+	hardwareEncoder_ = false;
+
+	return ret;
 }
 
-void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
+void PostProcessorJpeg::generateThumbnail(const std::vector<Span<uint8_t>> &source,
 					  const Size &targetSize,
 					  unsigned int quality,
 					  std::vector<unsigned char> *thumbnail)
 {
-	/* Stores the raw scaled-down thumbnail bytes. */
-	std::vector<unsigned char> rawThumbnail;
-
-	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail);
+	/* Stores the raw scaled-down thumbnail bytes, reused across frames. */
+	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail_);
 
 	StreamConfiguration thCfg;
 	thCfg.size = targetSize;
 	thCfg.pixelFormat = thumbnailer_.pixelFormat();
 	int ret = thumbnailEncoder_.configure(thCfg);
 
-	if (!rawThumbnail.empty() && !ret) {
+	if (!rawThumbnail_.empty() && !ret) {
 		/*
 		 * \todo Avoid value-initialization of all elements of the
 		 * vector.
 		 */
-		thumbnail->resize(rawThumbnail.size());
+		thumbnail->resize(rawThumbnail_.size());
 
 		/*
 		 * Split planes manually as the encoder expects a vector of
@@ -93,8 +185,8 @@ void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 		const PixelFormatInfo &formatNV12 = PixelFormatInfo::info(formats::NV12);
 		size_t yPlaneSize = formatNV12.planeSize(targetSize, 0);
 		size_t uvPlaneSize = formatNV12.planeSize(targetSize, 1);
-		thumbnailPlanes.push_back({ rawThumbnail.data(), yPlaneSize });
-		thumbnailPlanes.push_back({ rawThumbnail.data() + yPlaneSize, uvPlaneSize });
+		thumbnailPlanes.push_back({ rawThumbnail_.data(), yPlaneSize });
+		thumbnailPlanes.push_back({ rawThumbnail_.data() + yPlaneSize, uvPlaneSize });
 
 		int jpeg_size = thumbnailEncoder_.encode(thumbnailPlanes,
 							 *thumbnail, {}, quality);
@@ -111,55 +203,71 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	ASSERT(encoder_);
 
 	const FrameBuffer &source = *streamBuffer->srcBuffer;
-	CameraBuffer *destination = streamBuffer->dstBuffer.get();
+	CameraBuffer *destination = streamBuffer->dstBuffer;
 
 	ASSERT(destination->numPlanes() == 1);
 
+	/*
+	 * The source frame is mapped at most once, and shared between the
+	 * thumbnailer and the software encoder. Hardware encoders import the
+	 * frame buffer directly.
+	 */
+	std::optional<MappedFrameBuffer> mapped;
+	if (softwareEncoder_)
+		mapped.emplace(&source, MappedFrameBuffer::MapFlag::Read);
+
 	const CameraMetadata &requestMetadata = streamBuffer->request->settings_;
 	CameraMetadata *resultMetadata = streamBuffer->request->resultMetadata_.get();
 	camera_metadata_ro_entry_t entry;
 	int ret;
 
-	/* Set EXIF metadata for various tags. */
-	Exif exif;
-	exif.setMake(cameraDevice_->maker());
-	exif.setModel(cameraDevice_->model());
-
+	/*
+	 * Update the per-frame EXIF tags, the static ones have been set at
+	 * configuration time.
+	 */
 	ret = requestMetadata.getEntry(ANDROID_JPEG_ORIENTATION, &entry);
 
 	const uint32_t jpegOrientation = ret ? *entry.data.i32 : 0;
 	resultMetadata->addEntry(ANDROID_JPEG_ORIENTATION, jpegOrientation);
-	exif.setOrientation(jpegOrientation);
+	exif_.setOrientation(jpegOrientation);
 
-	exif.setSize(streamSize_);
 	/*
 	 * We set the frame's EXIF timestamp as the time of encode.
 	 * Since the precision we need for EXIF timestamp is only one
 	 * second, it is good enough.
 	 */
-	exif.setTimestamp(std::time(nullptr), 0ms);
+	exif_.setTimestamp(std::time(nullptr), 0ms);
 
 	ret = resultMetadata->getEntry(ANDROID_SENSOR_EXPOSURE_TIME, &entry);
-	exif.setExposureTime(ret ? *entry.data.i64 : 0);
+	exif_.setExposureTime(ret ? *entry.data.i64 : 0);
 	ret = requestMetadata.getEntry(ANDROID_LENS_APERTURE, &entry);
 	if (ret)
-		exif.setAperture(*entry.data.f);
+		exif_.setAperture(*entry.data.f);
+	else
+		exif_.clearAperture();
 
 	ret = resultMetadata->getEntry(ANDROID_SENSOR_SENSITIVITY, &entry);
-	exif.setISO(ret ? *entry.data.i32 : 100);
+	exif_.setISO(ret ? *entry.data.i32 : 100);
 
-	exif.setFlash(Exif::Flash::FlashNotPresent);
-	exif.setWhiteBalance(Exif::WhiteBalance::Auto);
-
-	exif.setFocalLength(1.0);
+	exif_.clearGPS();
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_TIMESTAMP, &entry);
 	if (ret) {
-		exif.setGPSDateTimestamp(*entry.data.i64);
+		exif_.setGPSDateTimestamp(*entry.data.i64);
 		resultMetadata->addEntry(ANDROID_JPEG_GPS_TIMESTAMP,
 					 *entry.data.i64);
 	}
 
+	/*
+	 * The thumbnail is generated in a separate thread, concurrently with
+	 * the encoding of the main image. The EXIF data is then inserted in
+	 * the encoded image once complete.
+	 */
+	exif_.clearThumbnail();
+
+	std::vector<unsigned char> thumbnail;
+	std::thread thumbnailThread;
+
 	ret = requestMetadata.getEntry(ANDROID_JPEG_THUMBNAIL_SIZE, &entry);
 	if (ret) {
 		const int32_t *data = entry.data.i32;
@@ -171,10 +279,20 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, quality);
 
 		if (thumbnailSize != Size(0, 0)) {
-			std::vector<unsigned char> thumbnail;
-			generateThumbnail(source, thumbnailSize, quality, &thumbnail);
-			if (!thumbnail.empty())
-				exif.setThumbnail(std::move(thumbnail), Exif::Compression::JPEG);
+			if (!mapped)
+				mapped.emplace(&source, MappedFrameBuffer::MapFlag::Read);
+
+			if (mapped->isValid())
+				thumbnailThread = std::thread([this, &mapped, &thumbnail,
+							       thumbnailSize, quality]() {
+					generateThumbnail(mapped->planes(),
+							  thumbnailSize, quality,
+							  &thumbnail);
+				});
+			else
+				LOG(JPEG, Error)
+					<< "Failed to map FrameBuffer : "
+					<< strerror(mapped->error());
 		}
 
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_SIZE, data, 2);
@@ -182,7 +300,7 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_COORDINATES, &entry);
 	if (ret) {
-		exif.setGPSLocation(entry.data.d);
+		exif_.setGPSLocation(entry.data.d);
 		resultMetadata->addEntry(ANDROID_JPEG_GPS_COORDINATES,
 					 entry.data.d, 3);
 	}
@@ -190,19 +308,61 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_PROCESSING_METHOD, &entry);
 	if (ret) {
 		std::string method(entry.data.u8, entry.data.u8 + entry.count);
-		exif.setGPSMethod(method);
+		exif_.setGPSMethod(method);
 		resultMetadata->addEntry(ANDROID_JPEG_GPS_PROCESSING_METHOD,
 					 entry.data.u8, entry.count);
 	}
 
-	if (exif.generate() != 0)
-		LOG(JPEG, Error) << "Failed to generate valid EXIF data";
+	Span<const uint8_t> exifData;
+	if (!thumbnailThread.joinable()) {
+		if (exif_.generate() != 0)
+			LOG(JPEG, Error) << "Failed to generate valid EXIF data";
+
+		exifData = exif_.data();
+	}
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_QUALITY, &entry);
 	const uint8_t quality = ret ? *entry.data.u8 : 95;
 	resultMetadata->addEntry(ANDROID_JPEG_QUALITY, quality);
 
-	int jpeg_size = encoder_->encode(streamBuffer, exif.data(), quality);
+	int jpeg_size;
+	if (mapped && mapped->isValid() && softwareEncoder_)
+		jpeg_size = softwareEncoder_->encode(mapped->planes(),
+						     destination->plane(0),
+						     exifData, quality);
+	else
+		jpeg_size = encoder_->encode(streamBuffer, exifData, quality);
+
+	if (jpeg_size < 0 && hardwareEncoder_) {
+		/*
+		 * Switch the stream to the software encoder for good, a failing
+		 * hardware encoder is unlikely to recover.
+		 */
+		LOG(JPEG, Warning)
+			<< "Hardware JPEG encoding failed, using software encoder";
+
+		if (!configureSoftwareEncoder())
+			jpeg_size = encoder_->encode(streamBuffer, exifData, quality);
+	}
+
+	const size_t jpegBufferSize =
+		destination->jpegBufferSize(cameraDevice_->maxJpegBufferSize());
+
+	if (thumbnailThread.joinable()) {
+		thumbnailThread.join();
+
+		if (!thumbnail.empty())
+			exif_.setThumbnail(std::move(thumbnail), Exif::Compression::JPEG);
+
+		Span<uint8_t> jpeg = destination->plane(0).first(jpegBufferSize -
+								  sizeof(struct camera3_jpeg_blob));
+
+		if (exif_.generate() != 0)
+			LOG(JPEG, Error) << "Failed to generate valid EXIF data";
+		else if (jpeg_size >= 0)
+			jpeg_size = insertExif(jpeg, jpeg_size, exif_.data());
+	}
+
 	if (jpeg_size < 0) {
 		LOG(JPEG, Error) << "Failed to encode stream image";
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
@@ -210,8 +370,7 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	}
 
 	/* Fill in the JPEG blob header. */
-	uint8_t *resultPtr = destination->plane(0).data()
-			   + destination->jpegBufferSize(cameraDevice_->maxJpegBufferSize())
+	uint8_t *resultPtr = destination->plane(0).data() + jpegBufferSize
 			   - sizeof(struct camera3_jpeg_blob);
 	auto *blob = reinterpret_cast<struct camera3_jpeg_blob *>(resultPtr);
 	blob->jpeg_blob_id = CAMERA3_JPEG_BLOB_ID;
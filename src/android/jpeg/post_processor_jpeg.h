@@ -9,6 +9,7 @@
 
 #include "../post_processor.h"
 #include "encoder_libjpeg.h"
+#include "exif.h"
 #include "thumbnailer.h"
 
 #include <libcamera/geometry.h>
@@ -25,14 +26,20 @@ public:
 	void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) override;
 
 private:
-	void generateThumbnail(const libcamera::FrameBuffer &source,
+	int configureSoftwareEncoder();
+	void generateThumbnail(const std::vector<libcamera::Span<uint8_t>> &source,
 			       const libcamera::Size &targetSize,
 			       unsigned int quality,
 			       std::vector<unsigned char> *thumbnail);
 
 	CameraDevice *const cameraDevice_;
 	std::unique_ptr<Encoder> encoder_;
+	EncoderLibJpeg *softwareEncoder_;
 	libcamera::Size streamSize_;
+	libcamera::StreamConfiguration inputConfig_;
+	bool hardwareEncoder_;
 	EncoderLibJpeg thumbnailEncoder_;
 	Thumbnailer thumbnailer_;
+	std::vector<unsigned char> rawThumbnail_;
+	Exif exif_;
 };
@@ -7,12 +7,12 @@
 
 #include "thumbnailer.h"
 
+#include <libyuv/scale.h>
+
 #include <libcamera/base/log.h>
 
 #include <libcamera/formats.h>
 
-#include "libcamera/internal/mapped_framebuffer.h"
-
 using namespace libcamera;
 
 LOG_DEFINE_CATEGORY(Thumbnailer)
@@ -37,20 +37,19 @@ void Thumbnailer::configure(const Size &sourceSize, PixelFormat pixelFormat)
 	valid_ = true;
 }
 
-void Thumbnailer::createThumbnail(const FrameBuffer &source,
+/*
+ * Scale the NV12 \a source planes down to \a targetSize with a box filter,
+ * which averages all the source pixels covered by each destination pixel. The
+ * destination vector is only resized, callers can reuse it across frames to
+ * avoid reallocating it.
+ */
+void Thumbnailer::createThumbnail(const std::vector<Span<uint8_t>> &source,
 				  const Size &targetSize,
 				  std::vector<unsigned char> *destination)
 {
-	MappedFrameBuffer frame(&source, MappedFrameBuffer::MapFlag::Read);
-	if (!frame.isValid()) {
-		LOG(Thumbnailer, Error)
-			<< "Failed to map FrameBuffer : "
-			<< strerror(frame.error());
-		return;
-	}
-
 	if (!valid_) {
 		LOG(Thumbnailer, Error) << "Config is unconfigured or invalid.";
+		destination->clear();
 		return;
 	}
 
@@ -59,38 +58,19 @@ void Thumbnailer::createThumbnail(const FrameBuffer &source,
 	const unsigned int tw = targetSize.width;
 	const unsigned int th = targetSize.height;
 
-	ASSERT(frame.planes().size() == 2);
+	ASSERT(source.size() == 2);
 	ASSERT(tw % 2 == 0 && th % 2 == 0);
 
-	/* Image scaling block implementing nearest-neighbour algorithm. */
-	unsigned char *src = frame.planes()[0].data();
-	unsigned char *srcC = frame.planes()[1].data();
-	unsigned char *srcCb, *srcCr;
-	unsigned char *dstY, *srcY;
-
 	size_t dstSize = (th * tw) + ((th / 2) * tw);
 	destination->resize(dstSize);
 	unsigned char *dst = destination->data();
 	unsigned char *dstC = dst + th * tw;
 
-	for (unsigned int y = 0; y < th; y += 2) {
-		unsigned int sourceY = (sh * y + th / 2) / th;
-
-		dstY = dst + y * tw;
-		srcY = src + sw * sourceY;
-		srcCb = srcC + (sourceY / 2) * sw + 0;
-		srcCr = srcC + (sourceY / 2) * sw + 1;
-
-		for (unsigned int x = 0; x < tw; x += 2) {
-			unsigned int sourceX = (sw * x + tw / 2) / tw;
-
-			dstY[x] = srcY[sourceX];
-			dstY[tw + x] = srcY[sw + sourceX];
-			dstY[x + 1] = srcY[sourceX + 1];
-			dstY[tw + x + 1] = srcY[sw + sourceX + 1];
-
-			dstC[(y / 2) * tw + x + 0] = srcCb[(sourceX / 2) * 2];
-			dstC[(y / 2) * tw + x + 1] = srcCr[(sourceX / 2) * 2];
-		}
+	int ret = libyuv::NV12Scale(source[0].data(), sw, source[1].data(), sw,
+				    sw, sh, dst, tw, dstC, tw, tw, th,
+				    libyuv::FilterMode::kFilterBox);
+	if (ret) {
+		LOG(Thumbnailer, Error) << "Failed to scale thumbnail";
+		destination->clear();
 	}
 }
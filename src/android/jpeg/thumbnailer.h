@@ -7,7 +7,10 @@
 
 #pragma once
 
-#include <libcamera/framebuffer.h>
+#include <vector>
+
+#include <libcamera/base/span.h>
+
 #include <libcamera/geometry.h>
 
 #include "libcamera/internal/formats.h"
@@ -19,7 +22,7 @@ public:
 
 	void configure(const libcamera::Size &sourceSize,
 		       libcamera::PixelFormat pixelFormat);
-	void createThumbnail(const libcamera::FrameBuffer &source,
+	void createThumbnail(const std::vector<libcamera::Span<uint8_t>> &source,
 			     const libcamera::Size &targetSize,
 			     std::vector<unsigned char> *dest);
 	const libcamera::PixelFormat &pixelFormat() const { return pixelFormat_; }
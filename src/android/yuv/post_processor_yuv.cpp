@@ -7,21 +7,237 @@
 
 #include "post_processor_yuv.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string.h>
+#include <vector>
+
 #include <libyuv/scale.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/shared_fd.h>
 
 #include <libcamera/formats.h>
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
 
+#include "libcamera/internal/converter.h"
+#include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/media_device.h"
 
 using namespace libcamera;
+using namespace std::chrono_literals;
 
 LOG_DEFINE_CATEGORY(YUV)
 
+namespace {
+
+constexpr std::chrono::milliseconds kScaleTimeout = 1000ms;
+
+std::shared_ptr<MediaDevice> findConverter()
+{
+	std::unique_ptr<DeviceEnumerator> enumerator = DeviceEnumerator::create();
+	if (!enumerator || enumerator->enumerate())
+		return nullptr;
+
+	for (ConverterFactoryBase *factory : ConverterFactoryBase::factories()) {
+		for (const std::string &compatible : factory->compatibles()) {
+			std::shared_ptr<MediaDevice> media =
+				enumerator->search(DeviceMatch(compatible));
+			if (!media)
+				continue;
+
+			LOG(YUV, Info)
+				<< "Found hardware scaler " << compatible;
+			return media;
+		}
+	}
+
+	return nullptr;
+}
+
+} /* namespace */
+
+/*
+ * The scaler owns a libcamera converter, and lives in the scaler thread whose
+ * event loop completes the buffers. The post-processor worker queues a frame
+ * through the scaler and waits for both buffers to complete.
+ */
+class PostProcessorYuv::Scaler : public Object
+{
+public:
+	Scaler()
+		: pending_(0), result_(0)
+	{
+	}
+
+	int configure(MediaDevice *media, const StreamConfiguration &inCfg,
+		      const StreamConfiguration &outCfg, unsigned int *stride);
+	int queue(FrameBuffer *input, FrameBuffer *output);
+	void cancel();
+	void stop();
+
+	int wait();
+
+private:
+	void bufferReady(FrameBuffer *buffer);
+
+	std::unique_ptr<Converter> converter_;
+
+	Mutex mutex_;
+	ConditionVariable cv_;
+	unsigned int pending_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int result_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+int PostProcessorYuv::Scaler::configure(MediaDevice *media,
+					const StreamConfiguration &inCfg,
+					const StreamConfiguration &outCfg,
+					unsigned int *stride)
+{
+	converter_ = ConverterFactoryBase::create(media);
+	if (!converter_ || !converter_->isValid()) {
+		converter_.reset();
+		return -ENODEV;
+	}
+
+	std::vector<PixelFormat> formats = converter_->formats(inCfg.pixelFormat);
+	if (std::find(formats.begin(), formats.end(), outCfg.pixelFormat) == formats.end() ||
+	    !converter_->sizes(inCfg.size).contains(outCfg.size)) {
+		converter_.reset();
+		return -EINVAL;
+	}
+
+	StreamConfiguration output = outCfg;
+	std::tie(output.stride, output.frameSize) =
+		converter_->strideAndFrameSize(output.pixelFormat, output.size);
+	output.bufferCount = std::max(output.bufferCount, 1U);
+
+	std::vector<std::reference_wrapper<StreamConfiguration>> outputs{ output };
+	int ret = converter_->configure(inCfg, outputs);
+	if (ret < 0) {
+		converter_.reset();
+		return ret;
+	}
+
+	converter_->inputBufferReady.connect(this, &Scaler::bufferReady);
+	converter_->outputBufferReady.connect(this, &Scaler::bufferReady);
+
+	ret = converter_->start();
+	if (ret < 0) {
+		converter_.reset();
+		return ret;
+	}
+
+	*stride = output.stride;
+
+	return 0;
+}
+
+int PostProcessorYuv::Scaler::queue(FrameBuffer *input, FrameBuffer *output)
+{
+	{
+		MutexLocker locker(mutex_);
+		pending_ = 2;
+		result_ = 0;
+	}
+
+	int ret = converter_->queueBuffers(input, { &output, 1 });
+	if (ret < 0) {
+		cancel();
+		return ret;
+	}
+
+	return 0;
+}
+
+/* Return the buffers still queued to the device. */
+void PostProcessorYuv::Scaler::cancel()
+{
+	{
+		MutexLocker locker(mutex_);
+		pending_ = 0;
+	}
+
+	converter_->stop();
+	converter_->start();
+}
+
+void PostProcessorYuv::Scaler::stop()
+{
+	if (!converter_)
+		return;
+
+	{
+		MutexLocker locker(mutex_);
+		pending_ = 0;
+	}
+
+	converter_->stop();
+	converter_.reset();
+}
+
+int PostProcessorYuv::Scaler::wait()
+{
+	MutexLocker locker(mutex_);
+
+	bool done = cv_.wait_for(locker, kScaleTimeout,
+				 [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+					 return !pending_;
+				 });
+	if (!done)
+		return -ETIMEDOUT;
+
+	return result_;
+}
+
+void PostProcessorYuv::Scaler::bufferReady(FrameBuffer *buffer)
+{
+	MutexLocker locker(mutex_);
+
+	if (!pending_)
+		return;
+
+	if (buffer->metadata().status != FrameMetadata::FrameSuccess)
+		result_ = -EIO;
+
+	if (!--pending_)
+		cv_.notify_one();
+}
+
+PostProcessorYuv::PostProcessorYuv()
+	: scalerThread_("YuvScaler")
+{
+}
+
+PostProcessorYuv::~PostProcessorYuv()
+{
+	if (!scaler_)
+		return;
+
+	scaler_->invokeMethod(&Scaler::stop, ConnectionTypeBlocking);
+
+	scalerThread_.exit();
+	scalerThread_.wait();
+}
+
+/*
+ * Find a media device implementing a converter, usually a V4L2 M2M scaler.
+ * The devices are enumerated once, the first call should happen at HAL
+ * initialization time to keep it out of stream configuration.
+ */
+std::shared_ptr<MediaDevice> PostProcessorYuv::converterDevice()
+{
+	static std::shared_ptr<MediaDevice> media = findConverter();
+
+	return media;
+}
+
 int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 				const StreamConfiguration &outCfg)
 {
@@ -46,20 +262,101 @@ int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 	}
 
 	calculateLengths(inCfg, outCfg);
+
+	if (configureScaler(inCfg, outCfg) < 0)
+		LOG(YUV, Debug) << "Scaling " << inCfg.toString() << " on the CPU";
+
+	return 0;
+}
+
+int PostProcessorYuv::configureScaler(const StreamConfiguration &inCfg,
+				      const StreamConfiguration &outCfg)
+{
+	std::shared_ptr<MediaDevice> media = converterDevice();
+	if (!media)
+		return -ENODEV;
+
+	scaler_ = std::make_unique<Scaler>();
+	scaler_->moveToThread(&scalerThread_);
+	scalerThread_.start();
+
+	int ret = scaler_->invokeMethod(&Scaler::configure,
+					ConnectionTypeBlocking, media.get(),
+					inCfg, outCfg, &scalerStride_);
+	if (ret < 0) {
+		scalerThread_.exit();
+		scalerThread_.wait();
+		scaler_.reset();
+		return ret;
+	}
+
 	return 0;
 }
 
+/*
+ * Scale the frame with the hardware scaler, from the source dma-buf to the
+ * destination dma-buf, without touching the pixels with the CPU.
+ */
+int PostProcessorYuv::scale(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	const CameraBuffer &destination = *streamBuffer->dstBuffer;
+	const buffer_handle_t handle = *streamBuffer->camera3Buffer;
+
+	/* The gralloc buffer layout must match the scaler output format. */
+	if (destination.stride(0) != scalerStride_)
+		return -EINVAL;
+
+	std::vector<FrameBuffer::Plane> planes(destination.numPlanes());
+	for (unsigned int i = 0; i < planes.size(); i++) {
+		planes[i].fd = SharedFD(handle->data[i]);
+		planes[i].offset = destination.offset(i);
+		planes[i].length = destination.size(i);
+	}
+
+	FrameBuffer output(planes);
+	FrameBuffer *input = const_cast<FrameBuffer *>(streamBuffer->srcBuffer);
+
+	int ret = scaler_->invokeMethod(&Scaler::queue, ConnectionTypeBlocking,
+					input, &output);
+	if (ret < 0)
+		return ret;
+
+	ret = scaler_->wait();
+	if (ret < 0) {
+		LOG(YUV, Error) << "Hardware scaling failed: " << strerror(-ret);
+
+		/* Reclaim the buffers before handing them back. */
+		scaler_->invokeMethod(&Scaler::cancel, ConnectionTypeBlocking);
+	}
+
+	return ret;
+}
+
 void PostProcessorYuv::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 {
 	const FrameBuffer &source = *streamBuffer->srcBuffer;
-	CameraBuffer *destination = streamBuffer->dstBuffer.get();
+	CameraBuffer *destination = streamBuffer->dstBuffer;
 
 	if (!isValidBuffers(source, *destination)) {
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
 		return;
 	}
 
-	const MappedFrameBuffer sourceMapped(&source, MappedFrameBuffer::MapFlag::Read);
+	if (scaler_) {
+		if (!scale(streamBuffer)) {
+			processComplete.emit(streamBuffer, PostProcessor::Status::Success);
+			return;
+		}
+
+		LOG(YUV, Debug) << "Falling back to CPU scaling";
+	}
+
+	/*
+	 * The mapping is cached in the frame buffer and reused for the next
+	 * frames, synchronize it for CPU access explicitly.
+	 */
+	const MappedFrameBuffer sourceMapped(&source, MappedFrameBuffer::MapFlag::Read |
+						      MappedFrameBuffer::MapFlag::Sync);
 	if (!sourceMapped.isValid()) {
 		LOG(YUV, Error) << "Failed to mmap camera frame buffer";
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
@@ -112,12 +409,12 @@ bool PostProcessorYuv::isValidBuffers(const FrameBuffer &source,
 			<< sourceLength_[1] << "}";
 		return false;
 	}
-	if (destination.plane(0).size() < destinationLength_[0] ||
-	    destination.plane(1).size() < destinationLength_[1]) {
+	if (destination.size(0) < destinationLength_[0] ||
+	    destination.size(1) < destinationLength_[1]) {
 		LOG(YUV, Error)
 			<< "The destination planes lengths are too small, actual size: {"
-			<< destination.plane(0).size() << ", "
-			<< destination.plane(1).size()
+			<< destination.size(0) << ", "
+			<< destination.size(1)
 			<< "}, expected size: {"
 			<< sourceLength_[0] << ", "
 			<< sourceLength_[1] << "}";
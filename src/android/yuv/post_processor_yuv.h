@@ -7,24 +7,40 @@
 
 #pragma once
 
+#include <memory>
+
 #include "../post_processor.h"
 
+#include <libcamera/base/thread.h>
+
 #include <libcamera/geometry.h>
 
+namespace libcamera {
+class MediaDevice;
+} /* namespace libcamera */
+
 class PostProcessorYuv : public PostProcessor
 {
 public:
-	PostProcessorYuv() = default;
+	PostProcessorYuv();
+	~PostProcessorYuv();
+
+	static std::shared_ptr<libcamera::MediaDevice> converterDevice();
 
 	int configure(const libcamera::StreamConfiguration &incfg,
 		      const libcamera::StreamConfiguration &outcfg) override;
 	void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) override;
 
 private:
+	class Scaler;
+
 	bool isValidBuffers(const libcamera::FrameBuffer &source,
 			    const CameraBuffer &destination) const;
 	void calculateLengths(const libcamera::StreamConfiguration &inCfg,
 			      const libcamera::StreamConfiguration &outCfg);
+	int configureScaler(const libcamera::StreamConfiguration &inCfg,
+			    const libcamera::StreamConfiguration &outCfg);
+	int scale(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
 
 	libcamera::Size sourceSize_;
 	libcamera::Size destinationSize_;
@@ -32,4 +48,8 @@ private:
 	unsigned int destinationLength_[2] = {};
 	unsigned int sourceStride_[2] = {};
 	unsigned int destinationStride_[2] = {};
+
+	libcamera::Thread scalerThread_;
+	std::unique_ptr<Scaler> scaler_;
+	unsigned int scalerStride_ = 0;
 };
@@ -0,0 +1,289 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Capture latency benchmark
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fstream>
+#include <iomanip>
+#include <time.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/request.h>
+
+using namespace libcamera;
+
+namespace {
+
+uint64_t clockTime(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+double toMs(uint64_t ns)
+{
+	return ns / 1000000.0;
+}
+
+/* Camera ids may contain backslashes, e.g. for ACPI device paths. */
+std::string jsonEscape(const std::string &str)
+{
+	std::string escaped;
+
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+
+	return escaped;
+}
+
+} /* namespace */
+
+Benchmark::Percentiles::Percentiles(std::vector<uint64_t> samples)
+	: p50(0), p95(0), p99(0), max(0)
+{
+	if (samples.empty())
+		return;
+
+	std::sort(samples.begin(), samples.end());
+
+	/* Use the nearest-rank method. */
+	auto percentile = [&](unsigned int p) {
+		size_t rank = (samples.size() * p + 99) / 100;
+		return samples[std::max<size_t>(rank, 1) - 1];
+	};
+
+	p50 = percentile(50);
+	p95 = percentile(95);
+	p99 = percentile(99);
+	max = samples.back();
+}
+
+Benchmark::Benchmark()
+	: lastSensorTimestamp_(0), startTime_(0), stopTime_(0),
+	  startCpuTime_(0), stopCpuTime_(0)
+{
+}
+
+/*
+ * The sensor timestamps are expressed in the CLOCK_MONOTONIC time base, use
+ * the same clock for all the measurements.
+ */
+uint64_t Benchmark::now()
+{
+	return clockTime(CLOCK_MONOTONIC);
+}
+
+void Benchmark::start()
+{
+	queued_.clear();
+	requestLatency_.clear();
+	sensorLatency_.clear();
+	frameInterval_.clear();
+	lastSensorTimestamp_ = 0;
+
+	startAllocations_ = AllocationTracker::threadStats();
+	stopAllocations_.clear();
+
+	startTime_ = now();
+	stopTime_ = 0;
+	startCpuTime_ = clockTime(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void Benchmark::stop()
+{
+	/* Keep the time of the first call, when the capture limit is reached. */
+	if (stopTime_)
+		return;
+
+	stopTime_ = now();
+	stopCpuTime_ = clockTime(CLOCK_PROCESS_CPUTIME_ID);
+
+	stopAllocations_ = AllocationTracker::threadStats();
+}
+
+void Benchmark::requestQueued(const Request *request)
+{
+	queued_[request] = now();
+}
+
+/*
+ * Record the measurements for a completed request, the completed timestamp
+ * being sampled in the request completion handler.
+ */
+void Benchmark::requestCompleted(Request *request, uint64_t completed)
+{
+	auto iter = queued_.find(request);
+	if (iter != queued_.end()) {
+		requestLatency_.push_back(completed - iter->second);
+		queued_.erase(iter);
+	}
+
+	const auto &buffers = request->buffers();
+	uint64_t timestamp = request->metadata().get(controls::SensorTimestamp)
+				     .value_or(buffers.empty() ? 0
+					       : buffers.begin()->second->metadata().timestamp);
+	if (!timestamp)
+		return;
+
+	if (completed > timestamp)
+		sensorLatency_.push_back(completed - timestamp);
+
+	if (lastSensorTimestamp_ && timestamp > lastSensorTimestamp_)
+		frameInterval_.push_back(timestamp - lastSensorTimestamp_);
+
+	lastSensorTimestamp_ = timestamp;
+}
+
+Benchmark::Results Benchmark::results() const
+{
+	Percentiles interval(frameInterval_);
+
+	/* The jitter is the deviation of the frame interval from its median. */
+	std::vector<uint64_t> jitter;
+	jitter.reserve(frameInterval_.size());
+	for (uint64_t value : frameInterval_)
+		jitter.push_back(value > interval.p50 ? value - interval.p50
+						      : interval.p50 - value);
+
+	unsigned int frames = requestLatency_.size();
+	double duration = (stopTime_ - startTime_) / 1000000000.0;
+	double fps = duration > 0 ? frames / duration : 0.0;
+	double cpuUsage = stopTime_ > startTime_
+			? 100.0 * (stopCpuTime_ - startCpuTime_) / (stopTime_ - startTime_)
+			: 0.0;
+
+	/*
+	 * Compute the allocations performed by each thread during the capture,
+	 * the first entry accumulating all threads.
+	 */
+	std::vector<std::pair<std::string, double>> allocations;
+	if (AllocationTracker::enabled() && frames) {
+		allocations.emplace_back("total", 0.0);
+
+		for (const ThreadStats &stop : stopAllocations_) {
+			uint64_t count = stop.allocations;
+
+			auto start = std::find_if(startAllocations_.begin(),
+						  startAllocations_.end(),
+						  [&](const ThreadStats &s) {
+							  return s.name == stop.name;
+						  });
+			if (start != startAllocations_.end())
+				count -= start->allocations;
+
+			if (!count)
+				continue;
+
+			allocations.emplace_back(stop.name,
+						 static_cast<double>(count) / frames);
+			allocations[0].second += allocations.back().second;
+		}
+	}
+
+	return {
+		frames, duration, fps, cpuUsage,
+		Percentiles(requestLatency_),
+		Percentiles(sensorLatency_),
+		interval,
+		Percentiles(jitter),
+		std::move(allocations),
+	};
+}
+
+void Benchmark::report(std::ostream &out) const
+{
+	Results r = results();
+
+	out << std::fixed << std::setprecision(2)
+	    << "Benchmark: " << r.frames << " frames in " << r.duration
+	    << " s (" << r.fps << " fps), CPU usage " << r.cpuUsage << "%"
+	    << std::endl;
+
+	auto line = [&](const char *name, const Percentiles &p) {
+		out << "  " << std::left << std::setw(28) << name << std::right
+		    << " p50 " << std::setw(8) << toMs(p.p50)
+		    << " p95 " << std::setw(8) << toMs(p.p95)
+		    << " p99 " << std::setw(8) << toMs(p.p99)
+		    << " max " << std::setw(8) << toMs(p.max) << " ms"
+		    << std::endl;
+	};
+
+	line("request latency", r.requestLatency);
+	line("sensor to completion", r.sensorLatency);
+	line("frame interval", r.frameInterval);
+	line("frame jitter", r.frameJitter);
+
+	if (r.allocations.empty())
+		return;
+
+	out << "  allocations per request" << std::endl;
+	for (const auto &[name, count] : r.allocations)
+		out << "    " << std::left << std::setw(26) << name << std::right
+		    << " " << std::setw(8) << count << std::endl;
+}
+
+int Benchmark::writeJson(const std::string &filename,
+			 const std::string &name) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+		return -errno;
+
+	Results r = results();
+
+	auto entry = [&](const char *key, const Percentiles &p, bool last) {
+		file << "\t\t\"" << key << "\": { "
+		     << "\"p50\": " << toMs(p.p50) << ", "
+		     << "\"p95\": " << toMs(p.p95) << ", "
+		     << "\"p99\": " << toMs(p.p99) << ", "
+		     << "\"max\": " << toMs(p.max) << " }"
+		     << (last ? "" : ",") << std::endl;
+	};
+
+	file << std::fixed << std::setprecision(3)
+	     << "{" << std::endl
+	     << "\t\"camera\": \"" << jsonEscape(name) << "\"," << std::endl
+	     << "\t\"frames\": " << r.frames << "," << std::endl
+	     << "\t\"duration\": " << r.duration << "," << std::endl
+	     << "\t\"fps\": " << r.fps << "," << std::endl
+	     << "\t\"cpu-usage\": " << r.cpuUsage << "," << std::endl
+	     << "\t\"latency-ms\": {" << std::endl;
+
+	entry("request", r.requestLatency, false);
+	entry("sensor-to-completion", r.sensorLatency, false);
+	entry("frame-interval", r.frameInterval, false);
+	entry("frame-jitter", r.frameJitter, true);
+
+	file << "\t}";
+
+	if (!r.allocations.empty()) {
+		file << "," << std::endl
+		     << "\t\"allocations-per-request\": {" << std::endl;
+
+		for (unsigned int i = 0; i < r.allocations.size(); i++) {
+			const auto &[thread, count] = r.allocations[i];
+			file << "\t\t\"" << jsonEscape(thread) << "\": " << count
+			     << (i + 1 < r.allocations.size() ? "," : "")
+			     << std::endl;
+		}
+
+		file << "\t}";
+	}
+
+	file << std::endl
+	     << "}" << std::endl;
+
+	return file.good() ? 0 : -EIO;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Capture latency benchmark
+ */
+
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/allocation_tracker.h>
+
+namespace libcamera {
+class Request;
+} /* namespace libcamera */
+
+class Benchmark
+{
+public:
+	Benchmark();
+
+	static uint64_t now();
+
+	void start();
+	void stop();
+
+	void requestQueued(const libcamera::Request *request);
+	void requestCompleted(libcamera::Request *request,
+			      uint64_t completed);
+
+	void report(std::ostream &out) const;
+	int writeJson(const std::string &filename, const std::string &name) const;
+
+private:
+	struct Percentiles {
+		Percentiles(std::vector<uint64_t> samples);
+
+		uint64_t p50;
+		uint64_t p95;
+		uint64_t p99;
+		uint64_t max;
+	};
+
+	struct Results {
+		unsigned int frames;
+		double duration;
+		double fps;
+		double cpuUsage;
+
+		Percentiles requestLatency;
+		Percentiles sensorLatency;
+		Percentiles frameInterval;
+		Percentiles frameJitter;
+
+		/* Heap allocations per completed request, per thread name. */
+		std::vector<std::pair<std::string, double>> allocations;
+	};
+
+	using ThreadStats = libcamera::AllocationTracker::ThreadStats;
+
+	Results results() const;
+
+	/* Queue time of the requests in flight, in nanoseconds. */
+	std::map<const libcamera::Request *, uint64_t> queued_;
+
+	std::vector<uint64_t> requestLatency_;
+	std::vector<uint64_t> sensorLatency_;
+	std::vector<uint64_t> frameInterval_;
+	uint64_t lastSensorTimestamp_;
+
+	uint64_t startTime_;
+	uint64_t stopTime_;
+	uint64_t startCpuTime_;
+	uint64_t stopCpuTime_;
+
+	std::vector<ThreadStats> startAllocations_;
+	std::vector<ThreadStats> stopAllocations_;
+};
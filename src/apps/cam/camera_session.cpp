@@ -9,6 +9,7 @@
 #include <iostream>
 #include <limits.h>
 #include <sstream>
+#include <string.h>
 
 #include <libcamera/control_ids.h>
 #include <libcamera/property_ids.h>
@@ -16,6 +17,7 @@
 #include "../common/event_loop.h"
 #include "../common/stream_options.h"
 
+#include "benchmark.h"
 #include "camera_session.h"
 #include "capture_script.h"
 #include "file_sink.h"
@@ -204,6 +206,9 @@ int CameraSession::start()
 	captureLimit_ = options_[OptCapture].toInteger();
 	printMetadata_ = options_.isSet(OptMetadata);
 
+	if (options_.isSet(OptBenchmark))
+		benchmark_ = std::make_unique<Benchmark>();
+
 	ret = camera_->configure(config_.get());
 	if (ret < 0) {
 		std::cout << "Failed to configure camera" << std::endl;
@@ -230,11 +235,29 @@ int CameraSession::start()
 #endif
 
 	if (options_.isSet(OptFile)) {
+		std::unique_ptr<FileSink> sink;
+
 		if (!options_[OptFile].toString().empty())
-			sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_,
-							   options_[OptFile]);
+			sink = std::make_unique<FileSink>(camera_.get(), streamNames_,
+							  options_[OptFile]);
 		else
-			sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_);
+			sink = std::make_unique<FileSink>(camera_.get(), streamNames_);
+
+#ifdef HAVE_TIFF
+		if (options_.isSet(OptDngCompression)) {
+			std::string compression = options_[OptDngCompression].toString();
+
+			if (compression == "deflate") {
+				sink->setDngCompression(DNGWriter::Compression::Deflate);
+			} else if (compression != "none") {
+				std::cerr << "Invalid DNG compression " << compression
+					  << std::endl;
+				return -EINVAL;
+			}
+		}
+#endif
+
+		sink_ = std::move(sink);
 	}
 
 	if (sink_) {
@@ -259,6 +282,24 @@ void CameraSession::stop()
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	if (benchmark_) {
+		benchmark_->stop();
+
+		std::cout << "cam" << cameraIndex_ << ": ";
+		benchmark_->report(std::cout);
+
+		std::string filename = options_[OptBenchmark].toString();
+		if (!filename.empty()) {
+			ret = benchmark_->writeJson(filename, camera_->id());
+			if (ret < 0)
+				std::cerr << "Failed to write benchmark results to "
+					  << filename << ": " << strerror(-ret)
+					  << std::endl;
+		}
+
+		benchmark_.reset();
+	}
+
 	if (sink_) {
 		ret = sink_->stop();
 		if (ret)
@@ -337,6 +378,9 @@ int CameraSession::startCapture()
 		return ret;
 	}
 
+	if (benchmark_)
+		benchmark_->start();
+
 	for (std::unique_ptr<Request> &request : requests_) {
 		ret = queueRequest(request.get());
 		if (ret < 0) {
@@ -370,6 +414,9 @@ int CameraSession::queueRequest(Request *request)
 
 	queueCount_++;
 
+	if (benchmark_)
+		benchmark_->requestQueued(request);
+
 	return camera_->queueRequest(request);
 }
 
@@ -378,14 +425,22 @@ void CameraSession::requestComplete(Request *request)
 	if (request->status() == Request::RequestCancelled)
 		return;
 
+	/*
+	 * Sample the completion time here, the event loop may not process the
+	 * request immediately.
+	 */
+	uint64_t completed = benchmark_ ? Benchmark::now() : 0;
+
 	/*
 	 * Defer processing of the completed request to the event loop, to avoid
 	 * blocking the camera manager thread.
 	 */
-	EventLoop::instance()->callLater([this, request]() { processRequest(request); });
+	EventLoop::instance()->callLater([this, request, completed]() {
+		processRequest(request, completed);
+	});
 }
 
-void CameraSession::processRequest(Request *request)
+void CameraSession::processRequest(Request *request, uint64_t completed)
 {
 	/*
 	 * If we've reached the capture limit, we're done. This doesn't
@@ -430,12 +485,17 @@ void CameraSession::processRequest(Request *request)
 		}
 	}
 
+	if (benchmark_)
+		benchmark_->requestCompleted(request, completed);
+
 	if (sink_) {
 		if (!sink_->processRequest(request))
 			requeue = false;
 	}
 
-	std::cout << info.str() << std::endl;
+	/* Writing to the console for every frame would skew the benchmark. */
+	if (!benchmark_)
+		std::cout << info.str() << std::endl;
 
 	if (printMetadata_) {
 		const ControlList &requestMetadata = request->metadata();
@@ -452,6 +512,9 @@ void CameraSession::processRequest(Request *request)
 	 */
 	captureCount_++;
 	if (captureLimit_ && captureCount_ >= captureLimit_) {
+		if (benchmark_)
+			benchmark_->stop();
+
 		captureDone.emit();
 		return;
 	}
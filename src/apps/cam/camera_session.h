@@ -23,6 +23,7 @@
 
 #include "../common/options.h"
 
+class Benchmark;
 class CaptureScript;
 class FrameSink;
 
@@ -54,7 +55,7 @@ private:
 
 	int queueRequest(libcamera::Request *request);
 	void requestComplete(libcamera::Request *request);
-	void processRequest(libcamera::Request *request);
+	void processRequest(libcamera::Request *request, uint64_t completed);
 	void sinkRelease(libcamera::Request *request);
 
 	const OptionsParser::Options &options_;
@@ -62,6 +63,7 @@ private:
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 
 	std::unique_ptr<CaptureScript> script_;
+	std::unique_ptr<Benchmark> benchmark_;
 
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::unique_ptr<FrameSink> sink_;
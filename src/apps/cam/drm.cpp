@@ -307,7 +307,7 @@ FrameBuffer::~FrameBuffer()
 }
 
 AtomicRequest::AtomicRequest(Device *dev)
-	: dev_(dev), valid_(true)
+	: dev_(dev), valid_(true), timestamp_(0)
 {
 	request_ = drmModeAtomicAlloc();
 	if (!request_)
@@ -706,11 +706,15 @@ void Device::drmEvent()
 
 void Device::pageFlipComplete([[maybe_unused]] int fd,
 			      [[maybe_unused]] unsigned int sequence,
-			      [[maybe_unused]] unsigned int tv_sec,
-			      [[maybe_unused]] unsigned int tv_usec,
+			      unsigned int tv_sec, unsigned int tv_usec,
 			      void *user_data)
 {
 	AtomicRequest *request = static_cast<AtomicRequest *>(user_data);
+
+	/* The page flip events are timestamped with CLOCK_MONOTONIC. */
+	request->timestamp_ = static_cast<uint64_t>(tv_sec) * 1000000000ULL
+			    + static_cast<uint64_t>(tv_usec) * 1000;
+
 	request->device()->requestComplete.emit(request);
 }
 
@@ -259,6 +259,7 @@ public:
 
 	Device *device() const { return dev_; }
 	bool isValid() const { return valid_; }
+	uint64_t timestamp() const { return timestamp_; }
 
 	int addProperty(const Object *object, const std::string &property,
 			uint64_t value);
@@ -272,11 +273,15 @@ private:
 	AtomicRequest &operator=(const AtomicRequest &) = delete;
 	AtomicRequest &operator=(const AtomicRequest &&) = delete;
 
+	friend class Device;
+
 	int addProperty(uint32_t object, uint32_t property, uint64_t value);
 
 	Device *dev_;
 	bool valid_;
 	drmModeAtomicReq *request_;
+	/* Time at which the request was applied, in nanoseconds */
+	uint64_t timestamp_;
 	std::list<std::unique_ptr<Blob>> blobs_;
 };
 
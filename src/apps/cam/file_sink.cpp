@@ -5,17 +5,22 @@
  * File Sink
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/camera.h>
 
 #include "../common/dng_writer.h"
+#include "../common/event_loop.h"
 #include "../common/image.h"
 #include "../common/ppm_writer.h"
 
@@ -23,19 +28,23 @@
 
 using namespace libcamera;
 
+/* Number of frames of disk space to reserve ahead in the stream files. */
+static constexpr unsigned int kPreallocatedFrames = 32;
+
 FileSink::FileSink([[maybe_unused]] const libcamera::Camera *camera,
 		   const std::map<const libcamera::Stream *, std::string> &streamNames,
 		   const std::string &pattern)
 	:
 #ifdef HAVE_TIFF
-	  camera_(camera),
+	  camera_(camera), dngCompression_(DNGWriter::Compression::None),
 #endif
-	  streamNames_(streamNames), pattern_(pattern)
+	  streamNames_(streamNames), pattern_(pattern), running_(false)
 {
 }
 
 FileSink::~FileSink()
 {
+	stop();
 }
 
 int FileSink::configure(const libcamera::CameraConfiguration &config)
@@ -56,12 +65,112 @@ void FileSink::mapBuffer(FrameBuffer *buffer)
 	mappedBuffers_[buffer] = std::move(image);
 }
 
+int FileSink::start()
+{
+	if (running_)
+		return 0;
+
+	running_ = true;
+	thread_ = std::thread(&FileSink::writerThread, this);
+
+	return 0;
+}
+
+int FileSink::stop()
+{
+	if (!running_)
+		return 0;
+
+	/* Write the pending requests before stopping. */
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		running_ = false;
+	}
+	cv_.notify_one();
+
+	thread_.join();
+
+	closeStreamFiles();
+
+	return 0;
+}
+
 bool FileSink::processRequest(Request *request)
 {
-	for (auto [stream, buffer] : request->buffers())
-		writeBuffer(stream, buffer, request->metadata());
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		queue_.push_back(request);
+	}
+	cv_.notify_one();
+
+	return false;
+}
+
+void FileSink::writerThread()
+{
+	while (true) {
+		Request *request;
+
+		{
+			std::unique_lock<std::mutex> locker(mutex_);
+			cv_.wait(locker, [&] { return !queue_.empty() || !running_; });
+
+			if (queue_.empty())
+				return;
+
+			request = queue_.front();
+			queue_.pop_front();
+		}
+
+		for (auto [stream, buffer] : request->buffers())
+			writeBuffer(stream, buffer, request->metadata());
+
+		/* Release the request from the event loop. */
+		EventLoop::instance()->callLater([this, request]() {
+			requestProcessed.emit(request);
+		});
+	}
+}
+
+FileSink::StreamFile *FileSink::streamFile(const std::string &filename)
+{
+	auto iter = streamFiles_.find(filename);
+	if (iter != streamFiles_.end())
+		return &iter->second;
+
+	int fd = open(filename.c_str(), O_CREAT | O_WRONLY | O_APPEND,
+		      S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	if (fd == -1) {
+		int ret = -errno;
+		std::cerr << "failed to open file " << filename << ": "
+			  << strerror(-ret) << std::endl;
+		return nullptr;
+	}
+
+	struct stat st;
+	off_t size = fstat(fd, &st) ? 0 : st.st_size;
+
+	StreamFile &file = streamFiles_[filename];
+	file.fd = fd;
+	file.size = size;
+	file.allocated = size;
 
-	return true;
+	return &file;
+}
+
+void FileSink::closeStreamFiles()
+{
+	for (auto &[filename, file] : streamFiles_) {
+		/* Release the disk space reserved beyond the frames. */
+		if (file.allocated > file.size &&
+		    ftruncate(file.fd, file.size) < 0)
+			std::cerr << "failed to truncate file " << filename
+				  << ": " << strerror(errno) << std::endl;
+
+		close(file.fd);
+	}
+
+	streamFiles_.clear();
 }
 
 void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
@@ -96,7 +205,8 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 	if (dng) {
 		ret = DNGWriter::write(filename.c_str(), camera_,
 				       stream->configuration(), metadata,
-				       buffer, image->data(0).data());
+				       buffer, image->data(0).data(),
+				       dngCompression_);
 		if (ret < 0)
 			std::cerr << "failed to write DNG file `" << filename
 				  << "'" << std::endl;
@@ -114,15 +224,12 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 		return;
 	}
 
-	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
-		  (pos == std::string::npos ? O_APPEND : O_TRUNC),
-		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-	if (fd == -1) {
-		ret = -errno;
-		std::cerr << "failed to open file " << filename << ": "
-			  << strerror(-ret) << std::endl;
-		return;
-	}
+	/*
+	 * Gather the planes, to write the whole frame with a single system
+	 * call.
+	 */
+	std::vector<struct iovec> iovs;
+	size_t length = 0;
 
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
 		/*
@@ -133,26 +240,60 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 		const unsigned int bytesused = buffer->metadata().planes()[i].bytesused;
 
 		Span<uint8_t> data = image->data(i);
-		const unsigned int length = std::min<unsigned int>(bytesused, data.size());
+		const unsigned int size = std::min<unsigned int>(bytesused, data.size());
 
 		if (bytesused > data.size())
 			std::cerr << "payload size " << bytesused
 				  << " larger than plane size " << data.size()
 				  << std::endl;
 
-		ret = ::write(fd, data.data(), length);
-		if (ret < 0) {
+		iovs.push_back({ data.data(), size });
+		length += size;
+	}
+
+	/*
+	 * Frames are appended to a file kept open for the whole capture when
+	 * the file name has no '#', reserving disk space for the next frames
+	 * to avoid extending the file allocation at every write.
+	 */
+	StreamFile *file = nullptr;
+	if (pos == std::string::npos) {
+		file = streamFile(filename);
+		if (!file)
+			return;
+
+		fd = file->fd;
+
+		if (file->size + static_cast<off_t>(length) > file->allocated) {
+			off_t chunk = static_cast<off_t>(length) * kPreallocatedFrames;
+			if (!fallocate(fd, FALLOC_FL_KEEP_SIZE, file->allocated, chunk))
+				file->allocated += chunk;
+		}
+	} else {
+		fd = open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+			  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd == -1) {
 			ret = -errno;
-			std::cerr << "write error: " << strerror(-ret)
-				  << std::endl;
-			break;
-		} else if (ret != (int)length) {
-			std::cerr << "write error: only " << ret
-				  << " bytes written instead of "
-				  << length << std::endl;
-			break;
+			std::cerr << "failed to open file " << filename << ": "
+				  << strerror(-ret) << std::endl;
+			return;
 		}
 	}
 
-	close(fd);
+	ssize_t written = ::writev(fd, iovs.data(), iovs.size());
+	if (written < 0) {
+		ret = -errno;
+		std::cerr << "write error: " << strerror(-ret) << std::endl;
+	} else if (static_cast<size_t>(written) != length) {
+		std::cerr << "write error: only " << written
+			  << " bytes written instead of " << length
+			  << std::endl;
+	}
+
+	if (file) {
+		if (written > 0)
+			file->size += written;
+	} else {
+		close(fd);
+	}
 }
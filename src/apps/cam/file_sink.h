@@ -7,12 +7,19 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <thread>
 
 #include <libcamera/stream.h>
 
+#include "../common/dng_writer.h"
+
 #include "frame_sink.h"
 
 class Image;
@@ -29,17 +36,53 @@ public:
 
 	void mapBuffer(libcamera::FrameBuffer *buffer) override;
 
+	int start() override;
+	int stop() override;
+
 	bool processRequest(libcamera::Request *request) override;
 
+#ifdef HAVE_TIFF
+	void setDngCompression(DNGWriter::Compression compression)
+	{
+		dngCompression_ = compression;
+	}
+#endif
+
 private:
+	struct StreamFile {
+		int fd;
+		off_t size;
+		off_t allocated;
+	};
+
+	void writerThread();
 	void writeBuffer(const libcamera::Stream *stream,
 			 libcamera::FrameBuffer *buffer,
 			 const libcamera::ControlList &metadata);
+	StreamFile *streamFile(const std::string &filename);
+	void closeStreamFiles();
 
 #ifdef HAVE_TIFF
 	const libcamera::Camera *camera_;
+	DNGWriter::Compression dngCompression_;
 #endif
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::string pattern_;
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<Image>> mappedBuffers_;
+
+	/*
+	 * Files written without a '#' in their name receive all the frames,
+	 * they are kept open for the whole capture.
+	 */
+	std::map<std::string, StreamFile> streamFiles_;
+
+	/*
+	 * Requests are written by a dedicated thread, in completion order,
+	 * to keep the file system latency out of the event loop.
+	 */
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<libcamera::Request *> queue_;
+	bool running_;
 };
@@ -17,14 +17,18 @@
 #include <string.h>
 
 #include <libcamera/camera.h>
+#include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
 #include <libcamera/framebuffer.h>
+#include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "drm.h"
 
 KMSSink::KMSSink(const std::string &connectorName)
-	: connector_(nullptr), crtc_(nullptr), plane_(nullptr), mode_(nullptr)
+	: connector_(nullptr), crtc_(nullptr), plane_(nullptr), mode_(nullptr),
+	  displayed_(0), replaced_(0), latencyCount_(0), latencySum_(0),
+	  latencyMin_(UINT64_MAX), latencyMax_(0)
 {
 	int ret = dev_.init();
 	if (ret < 0)
@@ -110,38 +114,55 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 	crtc_ = nullptr;
 	plane_ = nullptr;
 	mode_ = nullptr;
+	modes_.clear();
 
 	const libcamera::StreamConfiguration &cfg = config.at(0);
 
-	/* Find the best mode for the stream size. */
+	/*
+	 * Prefer the native mode of the display, the frames being scaled by the
+	 * plane when it supports scaling. Fall back to the mode closest to the
+	 * stream size otherwise.
+	 */
 	const std::vector<DRM::Mode> &modes = connector_->modes();
+	const DRM::Mode *preferred = nullptr;
+	const DRM::Mode *closest = nullptr;
 
 	unsigned int cfgArea = cfg.size.width * cfg.size.height;
 	unsigned int bestDistance = UINT_MAX;
 
 	for (const DRM::Mode &mode : modes) {
+		if (!preferred && (mode.type & DRM_MODE_TYPE_PREFERRED))
+			preferred = &mode;
+
 		unsigned int modeArea = mode.hdisplay * mode.vdisplay;
 		unsigned int distance = modeArea > cfgArea ? modeArea - cfgArea
 				      : cfgArea - modeArea;
 
 		if (distance < bestDistance) {
-			mode_ = &mode;
+			closest = &mode;
 			bestDistance = distance;
 
 			/*
 			 * If the sizes match exactly, there will be no better
 			 * match.
 			 */
-			if (distance == 0)
+			if (distance == 0 && preferred)
 				break;
 		}
 	}
 
-	if (!mode_) {
+	if (!closest) {
 		std::cerr << "No modes\n";
 		return -EINVAL;
 	}
 
+	if (preferred)
+		modes_.push_back(preferred);
+	if (closest != preferred)
+		modes_.push_back(closest);
+
+	mode_ = modes_.front();
+
 	int ret = configurePipeline(cfg.pixelFormat);
 	if (ret < 0)
 		return ret;
@@ -295,8 +316,7 @@ int KMSSink::configurePipeline(const libcamera::PixelFormat &format)
 	std::cout
 		<< "Using KMS plane " << plane_->id() << ", CRTC " << crtc_->id()
 		<< ", connector " << connector_->name()
-		<< " (" << connector_->id() << "), mode " << mode_->hdisplay
-		<< "x" << mode_->vdisplay << "@" << mode_->vrefresh << std::endl;
+		<< " (" << connector_->id() << ")" << std::endl;
 
 	return 0;
 }
@@ -307,6 +327,13 @@ int KMSSink::start()
 	if (ret < 0)
 		return ret;
 
+	displayed_ = 0;
+	replaced_ = 0;
+	latencyCount_ = 0;
+	latencySum_ = 0;
+	latencyMin_ = UINT64_MAX;
+	latencyMax_ = 0;
+
 	/* Disable all CRTCs and planes to start from a known valid state. */
 	DRM::AtomicRequest request(&dev_);
 
@@ -348,6 +375,8 @@ int KMSSink::stop()
 		return ret;
 	}
 
+	printStatistics();
+
 	/* Free all buffers. */
 	pending_.reset();
 	queued_.reset();
@@ -383,12 +412,12 @@ bool KMSSink::testModeSet(DRM::FrameBuffer *drmBuffer,
 				  DRM::AtomicRequest::FlagTestOnly);
 }
 
-bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
+/*
+ * Test the compositions that scale the frame buffer to the mode_ size, from
+ * most to least desirable, to select the best one.
+ */
+bool KMSSink::testScaledComposition(DRM::FrameBuffer *drmBuffer)
 {
-	/*
-	 * Test composition options, from most to least desirable, to select the
-	 * best one.
-	 */
 	const libcamera::Rectangle framebuffer{ size_ };
 	const libcamera::Rectangle display{ 0, 0, mode_->hdisplay, mode_->vdisplay };
 
@@ -420,9 +449,23 @@ bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
 		return true;
 	}
 
+	return false;
+}
+
+/*
+ * Test the compositions that display the frame buffer unscaled on the mode_,
+ * from most to least desirable, to select the best one.
+ */
+bool KMSSink::testUnscaledComposition(DRM::FrameBuffer *drmBuffer)
+{
+	const libcamera::Rectangle framebuffer{ size_ };
+	const libcamera::Rectangle display{ 0, 0, mode_->hdisplay, mode_->vdisplay };
+
 	/* 3. Center the frame buffer on the display. */
-	src = display.size().centeredTo(framebuffer.center()).boundedTo(framebuffer);
-	dst = framebuffer.size().centeredTo(display.center()).boundedTo(display);
+	libcamera::Rectangle src = display.size().centeredTo(framebuffer.center())
+						 .boundedTo(framebuffer);
+	libcamera::Rectangle dst = framebuffer.size().centeredTo(display.center())
+						     .boundedTo(display);
 
 	if (testModeSet(drmBuffer, src, dst)) {
 		std::cout << "KMS: centered output" << std::endl;
@@ -445,15 +488,37 @@ bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
 	return false;
 }
 
-bool KMSSink::processRequest(libcamera::Request *camRequest)
+bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
 {
 	/*
-	 * Perform a very crude rate adaptation by simply dropping the request
-	 * if the display queue is full.
+	 * Scaling the frame buffer in the plane is preferred on any candidate
+	 * mode, the unscaled compositions are only used as a last resort.
 	 */
-	if (pending_)
-		return true;
+	bool found = false;
+
+	for (const DRM::Mode *mode : modes_) {
+		mode_ = mode;
+		found = testScaledComposition(drmBuffer);
+		if (found)
+			break;
+	}
+
+	for (auto iter = modes_.begin(); !found && iter != modes_.end(); ++iter) {
+		mode_ = *iter;
+		found = testUnscaledComposition(drmBuffer);
+	}
+
+	if (!found)
+		return false;
+
+	std::cout << "KMS: mode " << mode_->hdisplay << "x" << mode_->vdisplay
+		  << "@" << mode_->vrefresh << std::endl;
+
+	return true;
+}
 
+bool KMSSink::processRequest(libcamera::Request *camRequest)
+{
 	libcamera::FrameBuffer *buffer = camRequest->buffers().begin()->second;
 	auto iter = buffers_.find(buffer);
 	if (iter == buffers_.end())
@@ -496,26 +561,56 @@ bool KMSSink::processRequest(libcamera::Request *camRequest)
 		flags |= DRM::AtomicRequest::FlagAllowModeset;
 	}
 
-	pending_ = std::make_unique<Request>(std::move(drmRequest), camRequest);
+	auto request = std::make_unique<Request>(std::move(drmRequest), camRequest);
+	std::unique_ptr<Request> replaced;
 
-	std::lock_guard<std::mutex> lock(lock_);
+	{
+		std::lock_guard<std::mutex> lock(lock_);
 
-	if (!queued_) {
-		int ret = pending_->drmRequest_->commit(flags);
-		if (ret < 0) {
-			std::cerr
-				<< "Failed to commit atomic request: "
-				<< strerror(-ret) << std::endl;
-			/* \todo Implement error handling */
+		if (!queued_) {
+			int ret = request->drmRequest_->commit(flags);
+			if (ret < 0) {
+				std::cerr
+					<< "Failed to commit atomic request: "
+					<< strerror(-ret) << std::endl;
+				/* \todo Implement error handling */
+			}
+
+			queued_ = std::move(request);
+		} else {
+			/*
+			 * The display is still busy with the queued request,
+			 * perform rate adaptation by replacing the pending
+			 * request, if any, with the newer one.
+			 */
+			replaced = std::move(pending_);
+			pending_ = std::move(request);
 		}
+	}
 
-		queued_ = std::move(pending_);
+	if (replaced) {
+		replaced_++;
+		requestProcessed.emit(replaced->camRequest_);
 	}
 
 	return false;
 }
 
-void KMSSink::requestComplete([[maybe_unused]] DRM::AtomicRequest *request)
+void KMSSink::printStatistics()
+{
+	std::cout << "KMS: " << displayed_ << " frames displayed, " << replaced_
+		  << " replaced in the flip queue" << std::endl;
+
+	if (!latencyCount_)
+		return;
+
+	std::cout << "KMS: capture to display latency min "
+		  << latencyMin_ / 1000 << " us, avg "
+		  << latencySum_ / latencyCount_ / 1000 << " us, max "
+		  << latencyMax_ / 1000 << " us" << std::endl;
+}
+
+void KMSSink::requestComplete(DRM::AtomicRequest *request)
 {
 	std::lock_guard<std::mutex> lock(lock_);
 
@@ -528,6 +623,21 @@ void KMSSink::requestComplete([[maybe_unused]] DRM::AtomicRequest *request)
 	/* The queued request becomes active. */
 	active_ = std::move(queued_);
 
+	/* The sensor timestamp is the start of exposure of the first line. */
+	const libcamera::ControlList &metadata = active_->camRequest_->metadata();
+	uint64_t sensorTimestamp = metadata.get(libcamera::controls::SensorTimestamp)
+					   .value_or(0);
+	if (sensorTimestamp && request->timestamp() > sensorTimestamp) {
+		uint64_t latency = request->timestamp() - sensorTimestamp;
+
+		latencyCount_++;
+		latencySum_ += latency;
+		latencyMin_ = std::min(latencyMin_, latency);
+		latencyMax_ = std::max(latencyMax_, latency);
+	}
+
+	displayed_++;
+
 	/* Queue the pending request, if any. */
 	if (pending_) {
 		pending_->drmRequest_->commit(DRM::AtomicRequest::FlagAsync);
@@ -13,6 +13,7 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <libcamera/base/signal.h>
 
@@ -54,7 +55,10 @@ private:
 	bool testModeSet(DRM::FrameBuffer *drmBuffer,
 			 const libcamera::Rectangle &src,
 			 const libcamera::Rectangle &dst);
+	bool testScaledComposition(DRM::FrameBuffer *drmBuffer);
+	bool testUnscaledComposition(DRM::FrameBuffer *drmBuffer);
 	bool setupComposition(DRM::FrameBuffer *drmBuffer);
+	void printStatistics();
 
 	void requestComplete(DRM::AtomicRequest *request);
 
@@ -64,6 +68,8 @@ private:
 	const DRM::Crtc *crtc_;
 	const DRM::Plane *plane_;
 	const DRM::Mode *mode_;
+	/* Candidate modes, from the most to the least desirable */
+	std::vector<const DRM::Mode *> modes_;
 
 	libcamera::PixelFormat format_;
 	libcamera::Size size_;
@@ -76,8 +82,22 @@ private:
 
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<DRM::FrameBuffer>> buffers_;
 
+	/*
+	 * The flip queue holds the request committed to the display, waiting
+	 * for the next vertical blanking, and the most recent request waiting
+	 * for it to complete. Newer camera requests replace the pending one,
+	 * to display the freshest frame.
+	 */
 	std::mutex lock_;
 	std::unique_ptr<Request> pending_;
 	std::unique_ptr<Request> queued_;
 	std::unique_ptr<Request> active_;
+
+	/* Capture to display latency statistics, in nanoseconds */
+	unsigned int displayed_;
+	unsigned int replaced_;
+	unsigned int latencyCount_;
+	uint64_t latencySum_;
+	uint64_t latencyMin_;
+	uint64_t latencyMax_;
 };
@@ -150,6 +150,8 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "to write files, using the default file name. Otherwise it sets the\n"
 			 "full file path and name. The first '#' character in the file name\n"
 			 "is expanded to the camera index, stream name and frame sequence number.\n"
+			 "Without a '#', all frames are appended to a single stream file, with\n"
+			 "disk space reserved ahead of the writes.\n"
 #ifdef HAVE_TIFF
 			 "If the file name ends with '.dng', then the frame will be written to\n"
 			 "the output file(s) in DNG format.\n"
@@ -159,6 +161,14 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "The default file name is 'frame-#.bin'.",
 			 "file", ArgumentOptional, "filename", false,
 			 OptCamera);
+#ifdef HAVE_TIFF
+	parser.addOption(OptDngCompression, OptionString,
+			 "Set the compression of the DNG files written with --file\n"
+			 "Supported values are 'none' (default) and 'deflate'. The RAW data of\n"
+			 "deflate compressed files can only be read by DNG 1.4 readers.",
+			 "dng-compression", ArgumentRequired, "compression", false,
+			 OptCamera);
+#endif
 #ifdef HAVE_SDL
 	parser.addOption(OptSDL, OptionNone, "Display viewfinder through SDL",
 			 "sdl", ArgumentNone, "", false, OptCamera);
@@ -178,6 +188,13 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "Load a capture session configuration script from a file",
 			 "script", ArgumentRequired, "script", false,
 			 OptCamera);
+	parser.addOption(OptBenchmark, OptionString,
+			 "Measure the capture latencies instead of printing the frames information.\n"
+			 "The request latency, sensor to completion latency, frame interval and\n"
+			 "frame jitter percentiles are printed when the capture stops. If a file\n"
+			 "name is given, the results are also written to it in JSON format.",
+			 "benchmark", ArgumentOptional, "filename", false,
+			 OptCamera);
 
 	options_ = parser.parse(argc, argv);
 	if (!options_.valid())
@@ -24,4 +24,6 @@ enum {
 	OptStrictFormats = 257,
 	OptMetadata = 258,
 	OptCaptureScript = 259,
+	OptBenchmark = 260,
+	OptDngCompression = 261,
 };
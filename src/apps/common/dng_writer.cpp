@@ -8,10 +8,16 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <map>
+#include <thread>
+#include <vector>
 
 #include <tiffio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
@@ -183,6 +189,14 @@ void thumbScanlineSBGGRxxP(const FormatInfo &info, void *output,
 	}
 }
 
+static inline void unpackGroupIPU3(uint16_t *out, const uint8_t *in)
+{
+	out[0] = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
+	out[1] = (in[2] & 0x0f) << 12 | (in[1] & 0xfc) << 4;
+	out[2] = (in[3] & 0x3f) << 10 | (in[2] & 0xf0) << 2;
+	out[3] = (in[4] & 0xff) <<  8 | (in[3] & 0xc0) << 0;
+}
+
 void packScanlineIPU3(void *output, const void *input, unsigned int width)
 {
 	const uint8_t *in = static_cast<const uint8_t *>(input);
@@ -195,6 +209,27 @@ void packScanlineIPU3(void *output, const void *input, unsigned int width)
 	 * \todo Improve packing to keep the 10-bit sample size.
 	 */
 	unsigned int x = 0;
+
+	/*
+	 * Unpack the complete blocks of 25 pixels stored in 32 bytes without
+	 * checking the width for every pixel, the compiler can then unroll and
+	 * vectorize the groups.
+	 */
+	for (; x + 25 <= width; x += 25) {
+		for (unsigned int i = 0; i < 6; i++) {
+			unpackGroupIPU3(out, in);
+			out += 4;
+			in += 5;
+		}
+
+		*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
+		in += 2;
+	}
+
+	if (x >= width)
+		return;
+
+	/* Unpack the last partial block. */
 	while (true) {
 		for (unsigned int i = 0; i < 6; i++) {
 			*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
@@ -282,6 +317,123 @@ void thumbScanlineIPU3([[maybe_unused]] const FormatInfo &info, void *output,
 	}
 }
 
+/*
+ * The PiSP compressed RAW formats store 8 pixels in two little-endian 32-bit
+ * words, the first one holding the even pixels and the second one the odd
+ * pixels. Each word stores four quantized samples, with the quantization mode
+ * in its two LSBs. The samples are offset by the compression offset before
+ * compression.
+ */
+static constexpr unsigned int kPiSPCompressionOffset = 2048;
+
+static uint16_t dequantizePiSP(int q, unsigned int qmode)
+{
+	switch (qmode) {
+	case 0:
+		return (q < 320) ? 16 * q : 32 * (q - 160);
+	case 1:
+		return 64 * q;
+	case 2:
+		return 128 * q;
+	default:
+		return (q < 94) ? 256 * q : std::min(0xffff, 512 * (q - 47));
+	}
+}
+
+static void decompressSubBlockPiSP(uint16_t *out, uint32_t word)
+{
+	unsigned int qmode = word & 3;
+	int q[4];
+
+	if (qmode < 3) {
+		int field0 = (word >> 2) & 511;
+		int field1 = (word >> 11) & 127;
+		int field2 = (word >> 18) & 127;
+		int field3 = (word >> 25) & 127;
+
+		if (qmode == 2 && field0 >= 384) {
+			q[1] = field0;
+			q[2] = field1 + 384;
+		} else {
+			q[1] = (field1 >= 64) ? field0 : field0 + 64 - field1;
+			q[2] = (field1 >= 64) ? field0 + field1 - 64 : field0;
+		}
+
+		int p1 = std::max(0, q[1] - 64);
+		int p2 = std::max(0, q[2] - 64);
+		if (qmode == 2) {
+			p1 = std::min(384, p1);
+			p2 = std::min(384, p2);
+		}
+
+		q[0] = p1 + field2;
+		q[3] = p2 + field3;
+	} else {
+		int pack0 = (word >> 2) & 32767;
+		int pack1 = (word >> 17) & 32767;
+
+		q[0] = (pack0 & 15) + 16 * ((pack0 >> 8) / 11);
+		q[1] = (pack0 >> 4) % 176;
+		q[2] = (pack1 & 15) + 16 * ((pack1 >> 8) / 11);
+		q[3] = (pack1 >> 4) % 176;
+	}
+
+	for (unsigned int i = 0; i < 4; i++) {
+		unsigned int value = dequantizePiSP(q[i], qmode) + kPiSPCompressionOffset;
+		out[i * 2] = std::min(value, 0xffffu);
+	}
+}
+
+static void decompressBlockPiSP(uint16_t *out, const uint8_t *in)
+{
+	uint32_t word0 = in[0] | in[1] << 8 | in[2] << 16 |
+			 static_cast<uint32_t>(in[3]) << 24;
+	uint32_t word1 = in[4] | in[5] << 8 | in[6] << 16 |
+			 static_cast<uint32_t>(in[7]) << 24;
+
+	decompressSubBlockPiSP(out, word0);
+	decompressSubBlockPiSP(out + 1, word1);
+}
+
+void packScanlinePiSPComp1(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint16_t *out = static_cast<uint16_t *>(output);
+
+	for (unsigned int x = 0; x < width; x += 8) {
+		uint16_t block[8];
+
+		decompressBlockPiSP(block, in);
+		std::copy(block, block + std::min(8U, width - x), out);
+
+		in += 8;
+		out += 8;
+	}
+}
+
+void thumbScanlinePiSPComp1([[maybe_unused]] const FormatInfo &info,
+			    void *output, const void *input, unsigned int width,
+			    unsigned int stride)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint8_t *out = static_cast<uint8_t *>(output);
+
+	/* Compressed blocks store 8 pixels in 8 bytes, skip 16 pixels. */
+	for (unsigned int x = 0; x < width; x++) {
+		uint16_t block0[8];
+		uint16_t block1[8];
+
+		decompressBlockPiSP(block0, in);
+		decompressBlockPiSP(block1, in + stride);
+
+		uint8_t value = (block0[0] + block0[1] + block1[0] + block1[1]) >> 10;
+		*out++ = value;
+		*out++ = value;
+		*out++ = value;
+		in += 16;
+	}
+}
+
 static const std::map<PixelFormat, FormatInfo> formatInfo = {
 	{ formats::SBGGR8, {
 		.bitsPerSample = 8,
@@ -378,14 +530,84 @@ static const std::map<PixelFormat, FormatInfo> formatInfo = {
 		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
 		.packScanline = packScanlineIPU3,
 		.thumbScanline = thumbScanlineIPU3,
+	} },	{ formats::BGGR_PISP_COMP1, {
+		.bitsPerSample = 16,
+		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
+		.packScanline = packScanlinePiSPComp1,
+		.thumbScanline = thumbScanlinePiSPComp1,
+	} },
+	{ formats::GBRG_PISP_COMP1, {
+		.bitsPerSample = 16,
+		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
+		.packScanline = packScanlinePiSPComp1,
+		.thumbScanline = thumbScanlinePiSPComp1,
+	} },
+	{ formats::GRBG_PISP_COMP1, {
+		.bitsPerSample = 16,
+		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
+		.packScanline = packScanlinePiSPComp1,
+		.thumbScanline = thumbScanlinePiSPComp1,
+	} },
+	{ formats::RGGB_PISP_COMP1, {
+		.bitsPerSample = 16,
+		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
+		.packScanline = packScanlinePiSPComp1,
+		.thumbScanline = thumbScanlinePiSPComp1,
 	} },
 };
 
+/* Size of the RAW image strips, processed in parallel */
+static constexpr unsigned int kStripSize = 256 * 1024;
+
+/*
+ * Call func with all the indices in [0, count[, distributed dynamically over
+ * one thread per CPU.
+ */
+template<typename Func>
+static void parallelFor(unsigned int count, Func func)
+{
+	unsigned int numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+	numThreads = std::min(numThreads, count);
+
+	std::atomic<unsigned int> next = 0;
+	auto worker = [&]() {
+		for (unsigned int i; (i = next++) < count;)
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numThreads; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+#ifdef HAVE_ZLIB
+static std::vector<uint8_t> deflateStrip(const uint8_t *data, size_t size)
+{
+	uLongf length = compressBound(size);
+	std::vector<uint8_t> output(length);
+
+	/*
+	 * The sensor noise makes RAW data compress poorly beyond the fastest
+	 * level, favour speed for bursts.
+	 */
+	if (compress2(output.data(), &length, data, size, Z_BEST_SPEED) != Z_OK)
+		return {};
+
+	output.resize(length);
+	return output;
+}
+#endif
+
 int DNGWriter::write(const char *filename, const Camera *camera,
 		     const StreamConfiguration &config,
 		     const ControlList &metadata,
 		     [[maybe_unused]] const FrameBuffer *buffer,
-		     const void *data)
+		     const void *data, Compression compression)
 {
 	const ControlList &cameraProperties = camera->properties();
 
@@ -396,6 +618,13 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	}
 	const FormatInfo *info = &it->second;
 
+#ifndef HAVE_ZLIB
+	if (compression == Compression::Deflate) {
+		std::cerr << "Deflate compression not supported" << std::endl;
+		return -ENOTSUP;
+	}
+#endif
+
 	TIFF *tif = TIFFOpen(filename, "w");
 	if (!tif) {
 		std::cerr << "Failed to open tiff file" << std::endl;
@@ -418,9 +647,13 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	 * the whole file are stored here.
 	 */
 	const uint8_t version[] = { 1, 2, 0, 0 };
+	/* Deflate compression of integer images requires DNG 1.4. */
+	const uint8_t deflateVersion[] = { 1, 4, 0, 0 };
 
-	TIFFSetField(tif, TIFFTAG_DNGVERSION, version);
-	TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, version);
+	TIFFSetField(tif, TIFFTAG_DNGVERSION,
+		     compression == Compression::Deflate ? deflateVersion : version);
+	TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION,
+		     compression == Compression::Deflate ? deflateVersion : version);
 	TIFFSetField(tif, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
 	TIFFSetField(tif, TIFFTAG_MAKE, "libcamera");
 
@@ -534,7 +767,9 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width);
 	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height);
 	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, info->bitsPerSample);
-	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(tif, TIFFTAG_COMPRESSION,
+		     compression == Compression::Deflate ? COMPRESSION_ADOBE_DEFLATE
+							 : COMPRESSION_NONE);
 	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
 	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
@@ -590,19 +825,71 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_BLACKLEVEL, 4, &blackLevel);
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
-	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(&scanline, row, config.size.width);
+	/*
+	 * Write RAW content. The image is split in strips that are packed, and
+	 * compressed if requested, in parallel. libtiff then writes them in
+	 * order, the compressed strips being passed through as raw data.
+	 */
+	const unsigned int rowSize = sizeof(scanline);
+	const unsigned int rowsPerStrip =
+		std::clamp(kStripSize / rowSize, 1U, config.size.height);
+	const unsigned int numStrips =
+		(config.size.height + rowsPerStrip - 1) / rowsPerStrip;
+
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+
+	std::vector<uint8_t> image(static_cast<size_t>(rowSize) * config.size.height);
+	std::vector<std::vector<uint8_t>> strips(numStrips);
+
+	parallelFor(numStrips, [&](unsigned int strip) {
+		const unsigned int first = strip * rowsPerStrip;
+		const unsigned int last = std::min(first + rowsPerStrip,
+						   config.size.height);
+
+		const uint8_t *in = static_cast<const uint8_t *>(data)
+				  + static_cast<size_t>(first) * config.stride;
+		uint8_t *out = image.data() + static_cast<size_t>(first) * rowSize;
+
+		for (unsigned int y = first; y < last; y++) {
+			info->packScanline(out, in, config.size.width);
+			in += config.stride;
+			out += rowSize;
+		}
 
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
+#ifdef HAVE_ZLIB
+		if (compression == Compression::Deflate)
+			strips[strip] = deflateStrip(image.data() + static_cast<size_t>(first) * rowSize,
+						     static_cast<size_t>(last - first) * rowSize);
+#endif
+	});
+
+	for (unsigned int strip = 0; strip < numStrips; strip++) {
+		const unsigned int first = strip * rowsPerStrip;
+		const unsigned int rows = std::min(rowsPerStrip,
+						   config.size.height - first);
+		tmsize_t ret;
+
+		if (compression == Compression::Deflate) {
+			if (strips[strip].empty()) {
+				std::cerr << "Failed to compress RAW strip"
+					  << std::endl;
+				TIFFClose(tif);
+				return -EINVAL;
+			}
+
+			ret = TIFFWriteRawStrip(tif, strip, strips[strip].data(),
+						strips[strip].size());
+		} else {
+			ret = TIFFWriteEncodedStrip(tif, strip,
+						    image.data() + static_cast<size_t>(first) * rowSize,
+						    static_cast<tmsize_t>(rows) * rowSize);
+		}
+
+		if (ret < 0) {
+			std::cerr << "Failed to write RAW strip" << std::endl;
 			TIFFClose(tif);
 			return -EINVAL;
 		}
-
-		row += config.stride;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
@@ -25,6 +25,9 @@ StreamKeyValueParser::StreamKeyValueParser()
 		  ArgumentRequired);
 	addOption("colorspace", OptionString, "Color space",
 		  ArgumentRequired);
+	addOption("divisor", OptionInteger,
+		  "Frame rate divisor, capture one frame out of divisor",
+		  ArgumentRequired);
 }
 
 KeyValueParser::Options StreamKeyValueParser::parse(const char *arguments)
@@ -96,6 +99,9 @@ int StreamKeyValueParser::updateConfiguration(CameraConfiguration *config,
 
 		if (opts.isSet("colorspace"))
 			cfg.colorSpace = ColorSpace::fromString(opts["colorspace"].toString());
+
+		if (opts.isSet("divisor"))
+			cfg.frameRateDivisor = opts["divisor"];
 	}
 
 	return 0;
@@ -20,3 +20,8 @@ void Environment::setup(CameraManager *cm, std::string cameraId)
 	cm_ = cm;
 	cameraId_ = cameraId;
 }
+
+void Environment::setThresholds(const PerformanceThresholds &thresholds)
+{
+	thresholds_ = thresholds;
+}
@@ -9,19 +9,40 @@
 
 #include <libcamera/libcamera.h>
 
+/*
+ * Limits checked by the performance tests. The defaults are deliberately
+ * lenient, platforms can tighten them from the command line.
+ */
+struct PerformanceThresholds {
+	/* Maximum deviation from the requested frame rate, in percent */
+	unsigned int frameRateTolerance = 5;
+	/* Maximum durations, in milliseconds */
+	unsigned int configureLatency = 500;
+	unsigned int startLatency = 500;
+	unsigned int stopLatency = 500;
+	unsigned int firstFrameLatency = 1000;
+	/* Maximum rate of dropped frames under CPU load, in percent */
+	unsigned int dropRate = 1;
+	/* Number of CPU load threads, 0 for one per CPU */
+	unsigned int loadThreads = 0;
+};
+
 class Environment
 {
 public:
 	static Environment *get();
 
 	void setup(libcamera::CameraManager *cm, std::string cameraId);
+	void setThresholds(const PerformanceThresholds &thresholds);
 
 	const std::string &cameraId() const { return cameraId_; }
 	libcamera::CameraManager *cm() const { return cm_; }
+	const PerformanceThresholds &thresholds() const { return thresholds_; }
 
 private:
 	Environment() = default;
 
 	std::string cameraId_;
 	libcamera::CameraManager *cm_;
+	PerformanceThresholds thresholds_;
 };
@@ -7,13 +7,17 @@
 
 #include "capture.h"
 
+#include <algorithm>
+
 #include <gtest/gtest.h>
 
 using namespace libcamera;
+using namespace std::chrono;
 
 Capture::Capture(std::shared_ptr<Camera> camera)
 	: loop_(nullptr), camera_(camera),
-	  allocator_(std::make_unique<FrameBufferAllocator>(camera))
+	  allocator_(std::make_unique<FrameBufferAllocator>(camera)),
+	  configureLatency_(0), startLatency_(0), stopLatency_(0)
 {
 }
 
@@ -36,7 +40,11 @@ void Capture::configure(StreamRole role)
 		FAIL() << "Configuration not valid";
 	}
 
-	if (camera_->configure(config_.get())) {
+	auto begin = steady_clock::now();
+	int ret = camera_->configure(config_.get());
+	configureLatency_ = duration_cast<microseconds>(steady_clock::now() - begin);
+
+	if (ret) {
 		config_.reset();
 		FAIL() << "Failed to configure camera";
 	}
@@ -52,7 +60,11 @@ void Capture::start()
 
 	camera_->requestCompleted.connect(this, &Capture::requestComplete);
 
-	ASSERT_EQ(camera_->start(), 0) << "Failed to start camera";
+	startTime_ = steady_clock::now();
+	int ret = camera_->start();
+	startLatency_ = duration_cast<microseconds>(steady_clock::now() - startTime_);
+
+	ASSERT_EQ(ret, 0) << "Failed to start camera";
 }
 
 void Capture::stop()
@@ -60,7 +72,9 @@ void Capture::stop()
 	if (!config_ || !allocator_->allocated())
 		return;
 
+	auto begin = steady_clock::now();
 	camera_->stop();
+	stopLatency_ = duration_cast<microseconds>(steady_clock::now() - begin);
 
 	camera_->requestCompleted.disconnect(this);
 
@@ -141,6 +155,126 @@ void CaptureBalanced::requestComplete(Request *request)
 		loop_->exit(-EINVAL);
 }
 
+/* CapturePerformance */
+
+CapturePerformance::CapturePerformance(std::shared_ptr<Camera> camera)
+	: Capture(camera), frameDuration_(0), firstFrameLatency_(0)
+{
+}
+
+/*
+ * Capture numRequests frames, with a fixed frame duration in microseconds
+ * if frameDuration is not zero, recording the sensor timestamp and sequence
+ * number of every frame.
+ */
+void CapturePerformance::capture(unsigned int numRequests, int64_t frameDuration)
+{
+	frameDuration_ = frameDuration;
+	queueCount_ = 0;
+	captureCount_ = 0;
+	captureLimit_ = numRequests;
+	failedCount_ = 0;
+	firstFrameLatency_ = microseconds(0);
+	timestamps_.clear();
+	sequences_.clear();
+
+	start();
+
+	Stream *stream = config_->at(0).stream();
+	const std::vector<std::unique_ptr<FrameBuffer>> &buffers = allocator_->buffers(stream);
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		std::unique_ptr<Request> request = camera_->createRequest();
+		ASSERT_TRUE(request) << "Can't create request";
+
+		ASSERT_EQ(request->addBuffer(stream, buffer.get()), 0) << "Can't set buffer for request";
+
+		ASSERT_EQ(queueRequest(request.get()), 0) << "Failed to queue request";
+
+		requests_.push_back(std::move(request));
+	}
+
+	/* Run capture session. */
+	loop_ = new EventLoop();
+	int status = loop_->exec();
+	stop();
+	delete loop_;
+
+	ASSERT_EQ(status, 0);
+	ASSERT_EQ(captureCount_, captureLimit_);
+}
+
+/*
+ * Compute the frame rate from the sensor timestamps, skipping the first
+ * frames to let the pipeline settle.
+ */
+double CapturePerformance::frameRate(unsigned int skip) const
+{
+	if (timestamps_.size() < skip + 2)
+		return 0.0;
+
+	uint64_t first = timestamps_[skip];
+	uint64_t last = timestamps_.back();
+	if (last <= first)
+		return 0.0;
+
+	return (timestamps_.size() - skip - 1) * 1000000000.0 / (last - first);
+}
+
+/*
+ * Compute the ratio of frames lost by the camera, from the gaps in the
+ * sequence numbers and the requests that failed to complete.
+ */
+double CapturePerformance::dropRate() const
+{
+	if (sequences_.empty())
+		return failedCount_ ? 1.0 : 0.0;
+
+	auto [min, max] = std::minmax_element(sequences_.begin(), sequences_.end());
+	unsigned int expected = *max - *min + 1;
+	unsigned int dropped = expected - std::min<unsigned int>(sequences_.size(), expected);
+
+	return static_cast<double>(dropped + failedCount_) / (expected + failedCount_);
+}
+
+int CapturePerformance::queueRequest(Request *request)
+{
+	queueCount_++;
+	if (queueCount_ > captureLimit_)
+		return 0;
+
+	if (frameDuration_)
+		request->controls().set(controls::FrameDurationLimits,
+					{ frameDuration_, frameDuration_ });
+
+	return camera_->queueRequest(request);
+}
+
+void CapturePerformance::requestComplete(Request *request)
+{
+	if (!captureCount_)
+		firstFrameLatency_ = duration_cast<microseconds>(steady_clock::now() - startTime_);
+
+	if (request->status() == Request::Status::RequestComplete) {
+		const FrameMetadata &metadata = request->buffers().begin()->second->metadata();
+		timestamps_.push_back(request->metadata().get(controls::SensorTimestamp)
+					      .value_or(metadata.timestamp));
+		sequences_.push_back(metadata.sequence);
+	} else {
+		failedCount_++;
+	}
+
+	captureCount_++;
+	if (captureCount_ >= captureLimit_) {
+		loop_->exit(0);
+		return;
+	}
+
+	request->reuse(Request::ReuseBuffers);
+	if (queueRequest(request))
+		loop_->exit(-EINVAL);
+}
+
 /* CaptureUnbalanced */
 
 CaptureUnbalanced::CaptureUnbalanced(std::shared_ptr<Camera> camera)
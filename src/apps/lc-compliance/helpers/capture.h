@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <stdint.h>
+#include <vector>
 
 #include <libcamera/libcamera.h>
 
@@ -18,6 +21,10 @@ class Capture
 public:
 	void configure(libcamera::StreamRole role);
 
+	std::chrono::microseconds configureLatency() const { return configureLatency_; }
+	std::chrono::microseconds startLatency() const { return startLatency_; }
+	std::chrono::microseconds stopLatency() const { return stopLatency_; }
+
 protected:
 	Capture(std::shared_ptr<libcamera::Camera> camera);
 	virtual ~Capture();
@@ -33,6 +40,14 @@ protected:
 	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 	std::vector<std::unique_ptr<libcamera::Request>> requests_;
+
+	/* Time at which Camera::start() was called */
+	std::chrono::steady_clock::time_point startTime_;
+
+private:
+	std::chrono::microseconds configureLatency_;
+	std::chrono::microseconds startLatency_;
+	std::chrono::microseconds stopLatency_;
 };
 
 class CaptureBalanced : public Capture
@@ -51,6 +66,33 @@ private:
 	unsigned int captureLimit_;
 };
 
+class CapturePerformance : public Capture
+{
+public:
+	CapturePerformance(std::shared_ptr<libcamera::Camera> camera);
+
+	void capture(unsigned int numRequests, int64_t frameDuration = 0);
+
+	double frameRate(unsigned int skip) const;
+	double dropRate() const;
+	std::chrono::microseconds firstFrameLatency() const { return firstFrameLatency_; }
+
+private:
+	int queueRequest(libcamera::Request *request);
+	void requestComplete(libcamera::Request *request) override;
+
+	int64_t frameDuration_;
+
+	unsigned int queueCount_;
+	unsigned int captureCount_;
+	unsigned int captureLimit_;
+	unsigned int failedCount_;
+
+	std::chrono::microseconds firstFrameLatency_;
+	std::vector<uint64_t> timestamps_;
+	std::vector<uint32_t> sequences_;
+};
+
 class CaptureUnbalanced : public Capture
 {
 public:
@@ -25,6 +25,7 @@ enum {
 	OptList = 'l',
 	OptFilter = 'f',
 	OptHelp = 'h',
+	OptThresholds = 't',
 };
 
 /*
@@ -80,6 +81,33 @@ static int initCamera(CameraManager *cm, OptionsParser::Options options)
 	return 0;
 }
 
+static void initThresholds(const OptionsParser::Options &options)
+{
+	PerformanceThresholds thresholds;
+
+	if (options.isSet(OptThresholds)) {
+		const KeyValueParser::Options &values =
+			options[OptThresholds].toKeyValues();
+
+		const std::map<std::string, unsigned int *> keys = {
+			{ "frame-rate-tolerance", &thresholds.frameRateTolerance },
+			{ "configure-latency", &thresholds.configureLatency },
+			{ "start-latency", &thresholds.startLatency },
+			{ "stop-latency", &thresholds.stopLatency },
+			{ "first-frame-latency", &thresholds.firstFrameLatency },
+			{ "drop-rate", &thresholds.dropRate },
+			{ "load-threads", &thresholds.loadThreads },
+		};
+
+		for (const auto &[key, value] : keys) {
+			if (values.isSet(key))
+				*value = values[key].toInteger();
+		}
+	}
+
+	Environment::get()->setThresholds(thresholds);
+}
+
 static int initGtestParameters(char *arg0, OptionsParser::Options options)
 {
 	const std::map<std::string, std::string> gtestFlags = { { "list", "--gtest_list_tests" },
@@ -138,6 +166,29 @@ static int initGtest(char *arg0, OptionsParser::Options options)
 
 static int parseOptions(int argc, char **argv, OptionsParser::Options *options)
 {
+	KeyValueParser thresholdsParser;
+	thresholdsParser.addOption("frame-rate-tolerance", OptionInteger,
+				   "Maximum frame rate deviation, in percent",
+				   ArgumentRequired);
+	thresholdsParser.addOption("configure-latency", OptionInteger,
+				   "Maximum Camera::configure() duration, in ms",
+				   ArgumentRequired);
+	thresholdsParser.addOption("start-latency", OptionInteger,
+				   "Maximum Camera::start() duration, in ms",
+				   ArgumentRequired);
+	thresholdsParser.addOption("stop-latency", OptionInteger,
+				   "Maximum Camera::stop() duration, in ms",
+				   ArgumentRequired);
+	thresholdsParser.addOption("first-frame-latency", OptionInteger,
+				   "Maximum delay to the first frame after start, in ms",
+				   ArgumentRequired);
+	thresholdsParser.addOption("drop-rate", OptionInteger,
+				   "Maximum dropped frames under CPU load, in percent",
+				   ArgumentRequired);
+	thresholdsParser.addOption("load-threads", OptionInteger,
+				   "Number of CPU load threads (0 for one per CPU)",
+				   ArgumentRequired);
+
 	OptionsParser parser;
 	parser.addOption(OptCamera, OptionString,
 			 "Specify which camera to operate on, by id", "camera",
@@ -148,6 +199,8 @@ static int parseOptions(int argc, char **argv, OptionsParser::Options *options)
 			 ArgumentRequired, "filter");
 	parser.addOption(OptHelp, OptionNone, "Display this help message",
 			 "help");
+	parser.addOption(OptThresholds, &thresholdsParser,
+			 "Set the performance tests thresholds", "thresholds");
 
 	*options = parser.parse(argc, argv);
 	if (!options->valid())
@@ -172,6 +225,8 @@ int main(int argc, char **argv)
 	if (ret < 0)
 		return EXIT_FAILURE;
 
+	initThresholds(options);
+
 	std::unique_ptr<CameraManager> cm = std::make_unique<CameraManager>();
 
 	/* No need to initialize the camera if we'll just list tests */
@@ -0,0 +1,310 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Test camera performance
+ */
+
+#include "capture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "environment.h"
+
+using namespace libcamera;
+using namespace std::chrono;
+
+namespace {
+
+const std::vector<StreamRole> ROLES = {
+	StreamRole::Raw,
+	StreamRole::StillCapture,
+	StreamRole::VideoRecording,
+	StreamRole::Viewfinder
+};
+
+enum class FrameDurationLimit {
+	Minimum,
+	Maximum,
+};
+
+const std::vector<FrameDurationLimit> FRAME_DURATION_LIMITS = {
+	FrameDurationLimit::Minimum,
+	FrameDurationLimit::Maximum,
+};
+
+/* Frames ignored at the start of a capture, while the pipeline settles. */
+constexpr unsigned int kSettleFrames = 10;
+/* Number of frames measured for the frame rate and drop rate. */
+constexpr unsigned int kMeasureFrames = 120;
+/* Upper bound of the frame rate measurement duration, in microseconds. */
+constexpr int64_t kMaxMeasureDuration = 10000000;
+
+std::string roleName(StreamRole role)
+{
+	static const std::map<StreamRole, std::string> rolesMap = {
+		{ StreamRole::Raw, "Raw" },
+		{ StreamRole::StillCapture, "StillCapture" },
+		{ StreamRole::VideoRecording, "VideoRecording" },
+		{ StreamRole::Viewfinder, "Viewfinder" }
+	};
+
+	return rolesMap.at(role);
+}
+
+/* Keep CPUs busy with spinning threads for the lifetime of the object. */
+class CpuLoad
+{
+public:
+	CpuLoad(unsigned int numThreads)
+		: running_(true)
+	{
+		if (!numThreads)
+			numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+
+		for (unsigned int i = 0; i < numThreads; i++)
+			threads_.emplace_back([this]() {
+				while (running_.load(std::memory_order_relaxed))
+					;
+			});
+	}
+
+	~CpuLoad()
+	{
+		running_.store(false, std::memory_order_relaxed);
+		for (std::thread &thread : threads_)
+			thread.join();
+	}
+
+private:
+	std::atomic<bool> running_;
+	std::vector<std::thread> threads_;
+};
+
+} /* namespace */
+
+class Performance
+{
+protected:
+	void acquireCamera();
+	void releaseCamera();
+
+	std::shared_ptr<Camera> camera_;
+};
+
+void Performance::acquireCamera()
+{
+	Environment *env = Environment::get();
+
+	camera_ = env->cm()->get(env->cameraId());
+
+	ASSERT_EQ(camera_->acquire(), 0);
+}
+
+void Performance::releaseCamera()
+{
+	if (!camera_)
+		return;
+
+	camera_->release();
+	camera_.reset();
+}
+
+class FrameRate : public Performance,
+		  public testing::TestWithParam<std::tuple<StreamRole, FrameDurationLimit>>
+{
+public:
+	static std::string nameParameters(const testing::TestParamInfo<FrameRate::ParamType> &info);
+
+protected:
+	void SetUp() override { acquireCamera(); }
+	void TearDown() override { releaseCamera(); }
+};
+
+std::string FrameRate::nameParameters(const testing::TestParamInfo<FrameRate::ParamType> &info)
+{
+	FrameDurationLimit limit = std::get<1>(info.param);
+
+	return roleName(std::get<0>(info.param)) + "_" +
+	       (limit == FrameDurationLimit::Minimum ? "MinFrameDuration"
+						     : "MaxFrameDuration");
+}
+
+class Latency : public Performance, public testing::TestWithParam<StreamRole>
+{
+public:
+	static std::string nameParameters(const testing::TestParamInfo<Latency::ParamType> &info)
+	{
+		return roleName(info.param);
+	}
+
+protected:
+	void SetUp() override { acquireCamera(); }
+	void TearDown() override { releaseCamera(); }
+};
+
+/*
+ * Test the sustained frame rate
+ *
+ * Makes sure the camera delivers frames at the rate requested through the
+ * FrameDurationLimits control, at both ends of the advertised range. Example
+ * failure is a pipeline that can't keep up with the sensor at the shortest
+ * frame duration.
+ */
+TEST_P(FrameRate, Sustained)
+{
+	auto [role, limit] = GetParam();
+	const PerformanceThresholds &thresholds = Environment::get()->thresholds();
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(role);
+
+	auto iter = camera_->controls().find(&controls::FrameDurationLimits);
+	if (iter == camera_->controls().end()) {
+		std::cout << "FrameDurationLimits not supported by camera" << std::endl;
+		GTEST_SKIP();
+	}
+
+	const ControlInfo &info = iter->second;
+	int64_t frameDuration = limit == FrameDurationLimit::Minimum
+			      ? info.min().get<int64_t>()
+			      : info.max().get<int64_t>();
+	ASSERT_GT(frameDuration, 0) << "Invalid frame duration limit";
+
+	/* Bound the test duration for long exposures. */
+	unsigned int numFrames = std::clamp<int64_t>(kMaxMeasureDuration / frameDuration,
+						     2, kMeasureFrames);
+
+	capture.capture(kSettleFrames + numFrames, frameDuration);
+
+	double expected = 1000000.0 / frameDuration;
+	double fps = capture.frameRate(kSettleFrames);
+
+	RecordProperty("ExpectedFrameRate", std::to_string(expected));
+	RecordProperty("FrameRate", std::to_string(fps));
+
+	double tolerance = expected * thresholds.frameRateTolerance / 100;
+	EXPECT_GE(fps, expected - tolerance) << "Frame rate too low";
+	EXPECT_LE(fps, expected + tolerance) << "Frame rate too high";
+}
+
+/*
+ * Test the configuration latency
+ *
+ * Makes sure Camera::configure() completes in a bounded time. Example failure
+ * is a pipeline handler that waits on the hardware synchronously for each
+ * stream it configures.
+ */
+TEST_P(Latency, Configure)
+{
+	StreamRole role = GetParam();
+	const PerformanceThresholds &thresholds = Environment::get()->thresholds();
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(role);
+
+	RecordProperty("ConfigureLatency", std::to_string(capture.configureLatency().count()));
+
+	EXPECT_LE(capture.configureLatency(), milliseconds(thresholds.configureLatency));
+}
+
+/*
+ * Test the start and stop latencies
+ *
+ * Makes sure Camera::start() and Camera::stop() complete in a bounded time
+ * over multiple cycles. Example failure is a pipeline handler that reloads
+ * its firmware or tuning data on every start.
+ */
+TEST_P(Latency, StartStop)
+{
+	StreamRole role = GetParam();
+	const PerformanceThresholds &thresholds = Environment::get()->thresholds();
+	unsigned int numRepeats = 3;
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(role);
+
+	for (unsigned int starts = 0; starts < numRepeats; starts++) {
+		capture.capture(kSettleFrames);
+
+		RecordProperty("StartLatency" + std::to_string(starts),
+			       std::to_string(capture.startLatency().count()));
+		RecordProperty("StopLatency" + std::to_string(starts),
+			       std::to_string(capture.stopLatency().count()));
+
+		EXPECT_LE(capture.startLatency(), milliseconds(thresholds.startLatency));
+		EXPECT_LE(capture.stopLatency(), milliseconds(thresholds.stopLatency));
+	}
+}
+
+/*
+ * Test the latency to the first frame
+ *
+ * Makes sure the first request completes in a bounded time after
+ * Camera::start() is called. Example failure is a pipeline that drops a
+ * large number of frames while its algorithms converge.
+ */
+TEST_P(Latency, FirstFrame)
+{
+	StreamRole role = GetParam();
+	const PerformanceThresholds &thresholds = Environment::get()->thresholds();
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(role);
+
+	capture.capture(1);
+
+	RecordProperty("FirstFrameLatency", std::to_string(capture.firstFrameLatency().count()));
+
+	EXPECT_LE(capture.firstFrameLatency(), milliseconds(thresholds.firstFrameLatency));
+}
+
+/*
+ * Test the frame drop rate under CPU load
+ *
+ * Makes sure the camera keeps delivering all frames when the system is busy.
+ * Example failure is a pipeline handler that misses its hardware deadlines
+ * when its threads are not scheduled in time.
+ */
+TEST_P(Latency, DropRateUnderLoad)
+{
+	StreamRole role = GetParam();
+	const PerformanceThresholds &thresholds = Environment::get()->thresholds();
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(role);
+
+	double dropRate;
+
+	{
+		CpuLoad load(thresholds.loadThreads);
+
+		capture.capture(kSettleFrames + kMeasureFrames);
+		dropRate = capture.dropRate() * 100;
+	}
+
+	RecordProperty("DropRate", std::to_string(dropRate));
+
+	EXPECT_LE(dropRate, thresholds.dropRate) << "Too many frames dropped";
+}
+
+INSTANTIATE_TEST_SUITE_P(PerformanceTests,
+			 FrameRate,
+			 testing::Combine(testing::ValuesIn(ROLES),
+					  testing::ValuesIn(FRAME_DURATION_LIMITS)),
+			 FrameRate::nameParameters);
+
+INSTANTIATE_TEST_SUITE_P(PerformanceTests,
+			 Latency,
+			 testing::ValuesIn(ROLES),
+			 Latency::nameParameters);
@@ -24,14 +24,23 @@ const vec3 yuv2rgb_offset = vec3(
 void main(void)
 {
 	vec3 yuv;
+	vec2 uv;
+
+	/*
+	 * The chroma plane is stored in a luminance-alpha texture when
+	 * uploaded, and in a RG texture when imported from a dmabuf.
+	 */
+#if defined(TEXTURE_RG)
+	uv = texture2D(tex_u, textureOut).rg;
+#else
+	uv = texture2D(tex_u, textureOut).ra;
+#endif
 
 	yuv.x = texture2D(tex_y, textureOut).r;
 #if defined(YUV_PATTERN_UV)
-	yuv.y = texture2D(tex_u, textureOut).r;
-	yuv.z = texture2D(tex_u, textureOut).a;
+	yuv.yz = uv;
 #elif defined(YUV_PATTERN_VU)
-	yuv.y = texture2D(tex_u, textureOut).a;
-	yuv.z = texture2D(tex_u, textureOut).r;
+	yuv.yz = uv.yx;
 #else
 #error Invalid pattern
 #endif
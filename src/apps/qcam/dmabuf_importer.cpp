@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Import dmabufs as EGL images for the OpenGL viewfinder
+ */
+
+#include "dmabuf_importer.h"
+
+#include <string.h>
+
+#include <QOpenGLContext>
+
+#include <libcamera/framebuffer.h>
+
+static bool hasExtension(const char *extensions, const char *name)
+{
+	if (!extensions)
+		return false;
+
+	size_t len = strlen(name);
+	for (const char *pos = extensions; (pos = strstr(pos, name)); pos += len) {
+		if ((pos == extensions || pos[-1] == ' ') &&
+		    (pos[len] == ' ' || pos[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Create an importer for the current OpenGL context. Return nullptr if the
+ * context isn't an EGL context, or if it doesn't support importing dmabufs.
+ */
+std::unique_ptr<DmaBufImporter> DmaBufImporter::create()
+{
+	QOpenGLContext *context = QOpenGLContext::currentContext();
+	if (!context || !context->hasExtension("GL_OES_EGL_image"))
+		return nullptr;
+
+	EGLDisplay display = eglGetCurrentDisplay();
+	if (display == EGL_NO_DISPLAY)
+		return nullptr;
+
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (!hasExtension(extensions, "EGL_EXT_image_dma_buf_import"))
+		return nullptr;
+
+	std::unique_ptr<DmaBufImporter> importer(new DmaBufImporter(display));
+	if (!importer->eglCreateImageKHR_ || !importer->eglDestroyImageKHR_ ||
+	    !importer->glEGLImageTargetTexture2DOES_)
+		return nullptr;
+
+	return importer;
+}
+
+DmaBufImporter::DmaBufImporter(EGLDisplay display)
+	: display_(display)
+{
+	eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+		eglGetProcAddress("eglCreateImageKHR"));
+	eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+		eglGetProcAddress("eglDestroyImageKHR"));
+	glEGLImageTargetTexture2DOES_ = reinterpret_cast<ImageTargetTexture2DOES>(
+		eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+}
+
+DmaBufImporter::~DmaBufImporter()
+{
+	clear();
+}
+
+/*
+ * Bind a plane of the buffer to the GL_TEXTURE_2D target of the active texture
+ * unit. The plane is imported as a single plane image of the fourcc DRM format,
+ * with the given size in texels and stride in bytes.
+ */
+bool DmaBufImporter::bindTexture(const libcamera::FrameBuffer *buffer,
+				 unsigned int plane, uint32_t fourcc,
+				 unsigned int width, unsigned int height,
+				 unsigned int stride)
+{
+	auto key = std::make_pair(buffer, plane);
+	auto iter = images_.find(key);
+	if (iter == images_.end()) {
+		EGLImageKHR image = importPlane(buffer, plane, fourcc, width,
+						height, stride);
+		if (image == EGL_NO_IMAGE_KHR)
+			return false;
+
+		iter = images_.emplace(key, image).first;
+	}
+
+	glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, iter->second);
+
+	return true;
+}
+
+void DmaBufImporter::clear()
+{
+	for (const auto &[key, image] : images_)
+		eglDestroyImageKHR_(display_, image);
+
+	images_.clear();
+}
+
+EGLImageKHR DmaBufImporter::importPlane(const libcamera::FrameBuffer *buffer,
+					unsigned int plane, uint32_t fourcc,
+					unsigned int width, unsigned int height,
+					unsigned int stride)
+{
+	if (plane >= buffer->planes().size())
+		return EGL_NO_IMAGE_KHR;
+
+	const libcamera::FrameBuffer::Plane &bufferPlane = buffer->planes()[plane];
+
+	const EGLint attribs[] = {
+		EGL_WIDTH, static_cast<EGLint>(width),
+		EGL_HEIGHT, static_cast<EGLint>(height),
+		EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(fourcc),
+		EGL_DMA_BUF_PLANE0_FD_EXT, bufferPlane.fd.get(),
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(bufferPlane.offset),
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, static_cast<EGLint>(stride),
+		EGL_NONE
+	};
+
+	return eglCreateImageKHR_(display_, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+				  nullptr, attribs);
+}
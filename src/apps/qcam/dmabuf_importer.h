@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Import dmabufs as EGL images for the OpenGL viewfinder
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+
+#ifndef EGL_NO_X11
+#define EGL_NO_X11
+#endif
+#ifndef MESA_EGL_NO_X11_HEADERS
+#define MESA_EGL_NO_X11_HEADERS
+#endif
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace libcamera {
+class FrameBuffer;
+} /* namespace libcamera */
+
+class DmaBufImporter
+{
+public:
+	static std::unique_ptr<DmaBufImporter> create();
+
+	~DmaBufImporter();
+
+	bool bindTexture(const libcamera::FrameBuffer *buffer, unsigned int plane,
+			 uint32_t fourcc, unsigned int width,
+			 unsigned int height, unsigned int stride);
+	void clear();
+
+private:
+	using ImageTargetTexture2DOES = void (*)(unsigned int target, void *image);
+
+	DmaBufImporter(EGLDisplay display);
+
+	EGLImageKHR importPlane(const libcamera::FrameBuffer *buffer,
+				unsigned int plane, uint32_t fourcc,
+				unsigned int width, unsigned int height,
+				unsigned int stride);
+
+	EGLDisplay display_;
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_;
+	ImageTargetTexture2DOES glEGLImageTargetTexture2DOES_;
+
+	/*
+	 * The buffers are reused by the camera, keep their images until the
+	 * format changes or the capture stops.
+	 */
+	std::map<std::pair<const libcamera::FrameBuffer *, unsigned int>,
+		 EGLImageKHR> images_;
+};
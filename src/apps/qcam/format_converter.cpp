@@ -7,8 +7,12 @@
 
 #include "format_converter.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <stdint.h>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include <QImage>
 
@@ -17,18 +21,6 @@
 #include "../common/image.h"
 
 #define RGBSHIFT		8
-#ifndef MAX
-#define MAX(a,b)		((a)>(b)?(a):(b))
-#endif
-#ifndef MIN
-#define MIN(a,b)		((a)<(b)?(a):(b))
-#endif
-#ifndef CLAMP
-#define CLAMP(a,low,high)	MAX((low),MIN((high),(a)))
-#endif
-#ifndef CLIP
-#define CLIP(x)			CLAMP(x,0,255)
-#endif
 
 int FormatConverter::configure(const libcamera::PixelFormat &format,
 			       const QSize &size, unsigned int stride)
@@ -202,158 +194,189 @@ void FormatConverter::convert(const Image *src, size_t size, QImage *dst)
 	};
 }
 
-static void yuv_to_rgb(int y, int u, int v, int *r, int *g, int *b)
+/*
+ * Lookup tables for the BT.601 limited range YUV to RGB conversion. The
+ * integer coefficients are scaled by 1 << RGBSHIFT, and the rounding is folded
+ * in the luma table. The clip table saturates the results, offset by
+ * kClipOffset to cover the negative values.
+ */
+static constexpr int kClipOffset = 384;
+
+static const struct YuvTables {
+	YuvTables()
+	{
+		for (int i = 0; i < 256; i++) {
+			y[i] = 298 * (i - 16) + (1 << (RGBSHIFT - 1));
+			rv[i] = 409 * (i - 128);
+			gu[i] = -100 * (i - 128);
+			gv[i] = -208 * (i - 128);
+			bu[i] = 516 * (i - 128);
+		}
+
+		for (int i = 0; i < static_cast<int>(sizeof(clip)); i++)
+			clip[i] = std::clamp(i - kClipOffset, 0, 255);
+	}
+
+	int32_t y[256];
+	int32_t rv[256];
+	int32_t gu[256];
+	int32_t gv[256];
+	int32_t bu[256];
+	uint8_t clip[1024];
+} yuvTables;
+
+static inline void writePixel(unsigned char *dst, int y, int r, int g, int b)
 {
-	int c = y - 16;
-	int d = u - 128;
-	int e = v - 128;
-	*r = CLIP(( 298 * c           + 409 * e + 128) >> RGBSHIFT);
-	*g = CLIP(( 298 * c - 100 * d - 208 * e + 128) >> RGBSHIFT);
-	*b = CLIP(( 298 * c + 516 * d           + 128) >> RGBSHIFT);
+	dst[0] = yuvTables.clip[((y + b) >> RGBSHIFT) + kClipOffset];
+	dst[1] = yuvTables.clip[((y + g) >> RGBSHIFT) + kClipOffset];
+	dst[2] = yuvTables.clip[((y + r) >> RGBSHIFT) + kClipOffset];
+	dst[3] = 0xff;
 }
 
-void FormatConverter::convertRGB(const Image *srcImage, unsigned char *dst)
+/*
+ * Convert a line to BGRA. The luma samples are YStep bytes apart, and the
+ * chroma samples CStep bytes apart, each shared by HorzSubSample pixels. The
+ * chroma contributions are computed once for all the pixels sharing them, and
+ * the steps being constants lets the compiler unroll the loops.
+ */
+template<unsigned int YStep, unsigned int CStep, unsigned int HorzSubSample>
+static void yuvToRgbLine(unsigned char *__restrict dst,
+			 const unsigned char *__restrict y,
+			 const unsigned char *__restrict cb,
+			 const unsigned char *__restrict cr,
+			 unsigned int width)
 {
-	const unsigned char *src = srcImage->data(0).data();
-	unsigned int x, y;
-	int r, g, b;
-
-	for (y = 0; y < height_; y++) {
-		for (x = 0; x < width_; x++) {
-			r = src[bpp_ * x + r_pos_];
-			g = src[bpp_ * x + g_pos_];
-			b = src[bpp_ * x + b_pos_];
-
-			dst[4 * x + 0] = b;
-			dst[4 * x + 1] = g;
-			dst[4 * x + 2] = r;
-			dst[4 * x + 3] = 0xff;
+	for (unsigned int x = 0; x < width; x += HorzSubSample) {
+		int r = yuvTables.rv[*cr];
+		int g = yuvTables.gu[*cb] + yuvTables.gv[*cr];
+		int b = yuvTables.bu[*cb];
+
+		for (unsigned int i = 0; i < HorzSubSample && x + i < width; i++) {
+			writePixel(dst, yuvTables.y[*y], r, g, b);
+			y += YStep;
+			dst += 4;
 		}
 
-		src += stride_;
-		dst += width_ * 4;
+		cb += CStep;
+		cr += CStep;
 	}
 }
 
+/*
+ * Call func(first, last) for bands of lines covering the whole image, in
+ * parallel on all CPUs. Small images are converted in the calling thread, as
+ * the thread start latency would outweigh the gain.
+ */
+template<typename Func>
+static void parallelLines(unsigned int height, Func func)
+{
+	static constexpr unsigned int kMinLinesPerBand = 64;
+
+	unsigned int numBands = std::max(std::thread::hardware_concurrency(), 1U);
+	numBands = std::clamp(height / kMinLinesPerBand, 1U, numBands);
+
+	std::vector<std::thread> threads;
+	unsigned int first = 0;
+
+	for (unsigned int band = 0; band < numBands; band++) {
+		unsigned int last = height * (band + 1) / numBands;
+
+		if (band == numBands - 1)
+			func(first, last);
+		else
+			threads.emplace_back(func, first, last);
+
+		first = last;
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+void FormatConverter::convertRGB(const Image *srcImage, unsigned char *dst)
+{
+	const unsigned char *src = srcImage->data(0).data();
+	const unsigned int bpp = bpp_;
+	const unsigned int r_pos = r_pos_;
+	const unsigned int g_pos = g_pos_;
+	const unsigned int b_pos = b_pos_;
+	const unsigned int width = width_;
+
+	parallelLines(height_, [&](unsigned int first, unsigned int last) {
+		for (unsigned int y = first; y < last; y++) {
+			const unsigned char *line = src + y * stride_;
+			unsigned char *out = dst + y * width * 4;
+
+			for (unsigned int x = 0; x < width; x++) {
+				out[4 * x + 0] = line[bpp * x + b_pos];
+				out[4 * x + 1] = line[bpp * x + g_pos];
+				out[4 * x + 2] = line[bpp * x + r_pos];
+				out[4 * x + 3] = 0xff;
+			}
+		}
+	});
+}
+
 void FormatConverter::convertYUVPacked(const Image *srcImage, unsigned char *dst)
 {
 	const unsigned char *src = srcImage->data(0).data();
-	unsigned int src_x, src_y, dst_x, dst_y;
-	unsigned int src_stride;
-	unsigned int dst_stride;
-	unsigned int cr_pos;
-	int r, g, b, y, cr, cb;
-
-	cr_pos = (cb_pos_ + 2) % 4;
-	src_stride = stride_;
-	dst_stride = width_ * 4;
-
-	for (src_y = 0, dst_y = 0; dst_y < height_; src_y++, dst_y++) {
-		for (src_x = 0, dst_x = 0; dst_x < width_; ) {
-			cb = src[src_y * src_stride + src_x * 4 + cb_pos_];
-			cr = src[src_y * src_stride + src_x * 4 + cr_pos];
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_ + 2];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			src_x++;
+	unsigned int cr_pos = (cb_pos_ + 2) % 4;
+
+	parallelLines(height_, [&](unsigned int first, unsigned int last) {
+		for (unsigned int y = first; y < last; y++) {
+			const unsigned char *line = src + y * stride_;
+
+			yuvToRgbLine<2, 4, 2>(dst + y * width_ * 4, line + y_pos_,
+					      line + cb_pos_, line + cr_pos, width_);
 		}
-	}
+	});
 }
 
 void FormatConverter::convertYUVPlanar(const Image *srcImage, unsigned char *dst)
 {
 	unsigned int c_stride = stride_ / horzSubSample_;
-	unsigned int c_inc = horzSubSample_ == 1 ? 1 : 0;
 	const unsigned char *src_y = srcImage->data(0).data();
 	const unsigned char *src_cb = srcImage->data(1).data();
 	const unsigned char *src_cr = srcImage->data(2).data();
-	int r, g, b;
 
 	if (nvSwap_)
 		std::swap(src_cb, src_cr);
 
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *line_y = src_y + y * stride_;
-		const unsigned char *line_cb = src_cb + (y / vertSubSample_) *
-					       c_stride;
-		const unsigned char *line_cr = src_cr + (y / vertSubSample_) *
-					       c_stride;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += c_inc;
-			line_cr += c_inc;
-			dst += 4;
+	/* All the supported planar formats are horizontally subsampled. */
+	parallelLines(height_, [&](unsigned int first, unsigned int last) {
+		for (unsigned int y = first; y < last; y++) {
+			unsigned int c_offset = (y / vertSubSample_) * c_stride;
 
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += 1;
-			line_cr += 1;
-			dst += 4;
+			yuvToRgbLine<1, 1, 2>(dst + y * width_ * 4,
+					      src_y + y * stride_,
+					      src_cb + c_offset,
+					      src_cr + c_offset, width_);
 		}
-	}
+	});
 }
 
 void FormatConverter::convertYUVSemiPlanar(const Image *srcImage, unsigned char *dst)
 {
 	unsigned int c_stride = stride_ * (2 / horzSubSample_);
-	unsigned int c_inc = horzSubSample_ == 1 ? 2 : 0;
 	unsigned int cb_pos = nvSwap_ ? 1 : 0;
 	unsigned int cr_pos = nvSwap_ ? 0 : 1;
 	const unsigned char *src = srcImage->data(0).data();
 	const unsigned char *src_c = srcImage->data(1).data();
-	int r, g, b;
-
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *src_y = src + y * stride_;
-		const unsigned char *src_cb = src_c + (y / vertSubSample_) *
-					      c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample_) *
-					      c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 4;
 
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 4;
+	parallelLines(height_, [&](unsigned int first, unsigned int last) {
+		for (unsigned int y = first; y < last; y++) {
+			const unsigned char *line_c = src_c + (y / vertSubSample_) * c_stride;
+			unsigned char *line_dst = dst + y * width_ * 4;
+			const unsigned char *line_y = src + y * stride_;
+
+			if (horzSubSample_ == 1)
+				yuvToRgbLine<1, 2, 1>(line_dst, line_y,
+						      line_c + cb_pos,
+						      line_c + cr_pos, width_);
+			else
+				yuvToRgbLine<1, 2, 2>(line_dst, line_y,
+						      line_c + cb_pos,
+						      line_c + cr_pos, width_);
 		}
-	}
+	});
 }
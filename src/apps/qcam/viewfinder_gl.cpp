@@ -18,6 +18,10 @@
 
 #include "../common/image.h"
 
+#ifdef HAVE_EGL
+#include "dmabuf_importer.h"
+#endif
+
 static const QList<libcamera::PixelFormat> supportedFormats{
 	/* YUV - packed (single plane) */
 	libcamera::formats::UYVY,
@@ -70,6 +74,45 @@ ViewFinderGL::~ViewFinderGL()
 	removeShader();
 }
 
+#ifdef HAVE_EGL
+/*
+ * Map the OpenGL texture formats to the DRM formats with the same memory
+ * layout, to import the planes under the same texture format as when uploading
+ * them. The luminance-alpha texture is imported as a two components RG texture.
+ */
+static uint32_t textureFourcc(GLenum format)
+{
+	constexpr uint32_t kFourccGR88 = 'G' | ('R' << 8) | ('8' << 16) | ('8' << 24);
+
+	switch (format) {
+	case GL_LUMINANCE:
+		return libcamera::formats::R8.fourcc();
+	case GL_LUMINANCE_ALPHA:
+		return kFourccGR88;
+	case GL_RGB:
+		return libcamera::formats::BGR888.fourcc();
+	case GL_RGBA:
+	default:
+		return libcamera::formats::ABGR8888.fourcc();
+	}
+}
+
+static unsigned int textureBytesPerPixel(GLenum format)
+{
+	switch (format) {
+	case GL_LUMINANCE:
+		return 1;
+	case GL_LUMINANCE_ALPHA:
+		return 2;
+	case GL_RGB:
+		return 3;
+	case GL_RGBA:
+	default:
+		return 4;
+	}
+}
+#endif
+
 const QList<libcamera::PixelFormat> &ViewFinderGL::nativeFormats() const
 {
 	return supportedFormats;
@@ -99,6 +142,12 @@ int ViewFinderGL::setFormat(const libcamera::PixelFormat &format, const QSize &s
 		colorSpace_ = colorSpace;
 	}
 
+#ifdef HAVE_EGL
+	/* The imported images depend on the format, size and stride. */
+	if (importer_)
+		importer_->clear();
+#endif
+
 	size_ = size;
 	stride_ = stride;
 
@@ -113,6 +162,12 @@ void ViewFinderGL::stop()
 		buffer_ = nullptr;
 		image_ = nullptr;
 	}
+
+#ifdef HAVE_EGL
+	/* The buffers are freed when the capture stops. */
+	if (importer_)
+		importer_->clear();
+#endif
 }
 
 QImage ViewFinderGL::getCurrentImage()
@@ -426,7 +481,17 @@ bool ViewFinderGL::createFragmentShader()
 		return false;
 	}
 
-	QString defines = fragmentShaderDefines_.join('\n') + "\n";
+	QStringList fragmentShaderDefines = fragmentShaderDefines_;
+#ifdef HAVE_EGL
+	/*
+	 * The two components textures are imported as RG textures instead of
+	 * luminance-alpha, tell the shader where to sample the second one.
+	 */
+	if (importer_)
+		fragmentShaderDefines.append("#define TEXTURE_RG");
+#endif
+
+	QString defines = fragmentShaderDefines.join('\n') + "\n";
 	QByteArray src = file.readAll();
 	src.prepend(defines.toUtf8());
 
@@ -497,6 +562,41 @@ void ViewFinderGL::configureTexture(QOpenGLTexture &texture)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+/*
+ * Bind a plane of the current buffer to a texture unit. The plane is imported
+ * from its dmabuf when possible, avoiding any CPU copy, and uploaded from the
+ * CPU mapping otherwise. The texture size is expressed in texels of the given
+ * format.
+ */
+bool ViewFinderGL::bindTexture(unsigned int index, unsigned int plane,
+			       GLenum format, unsigned int width,
+			       unsigned int height)
+{
+	glActiveTexture(GL_TEXTURE0 + index);
+	configureTexture(*textures_[index]);
+
+#ifdef HAVE_EGL
+	if (importer_) {
+		unsigned int stride = width * textureBytesPerPixel(format);
+
+		return importer_->bindTexture(buffer_, plane, textureFourcc(format),
+					      width, height, stride);
+	}
+#endif
+
+	glTexImage2D(GL_TEXTURE_2D,
+		     0,
+		     format,
+		     width,
+		     height,
+		     0,
+		     format,
+		     GL_UNSIGNED_BYTE,
+		     image_->data(plane).data());
+
+	return true;
+}
+
 void ViewFinderGL::removeShader()
 {
 	if (shaderProgram_.isLinked()) {
@@ -532,6 +632,13 @@ void ViewFinderGL::initializeGL()
 	vertexBuffer_.bind();
 	vertexBuffer_.allocate(coordinates, sizeof(coordinates));
 
+#ifdef HAVE_EGL
+	importer_ = DmaBufImporter::create();
+	if (!importer_)
+		qInfo() << "[ViewFinderGL]:"
+			<< "dmabuf import not supported, uploading frames";
+#endif
+
 	/* Create Vertex Shader */
 	if (!createVertexShader())
 		qWarning() << "[ViewFinderGL]: create vertex shader failed.";
@@ -539,7 +646,7 @@ void ViewFinderGL::initializeGL()
 	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
 }
 
-void ViewFinderGL::doRender()
+bool ViewFinderGL::doRender()
 {
 	/* Stride of the first plane, in pixels. */
 	unsigned int stridePixels;
@@ -552,31 +659,14 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::NV24:
 	case libcamera::formats::NV42:
 		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_LUMINANCE, stride_, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/* Activate texture UV/VU */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE_ALPHA,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE_ALPHA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
+		if (!bindTexture(1, 1, GL_LUMINANCE_ALPHA, stride_ / horzSubSample_,
+				 size_.height() / vertSubSample_))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		stridePixels = stride_;
@@ -584,45 +674,20 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::YUV420:
 		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_LUMINANCE, stride_, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/* Activate texture U */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
+		if (!bindTexture(1, 1, GL_LUMINANCE, stride_ / horzSubSample_,
+				 size_.height() / vertSubSample_))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		/* Activate texture V */
-		glActiveTexture(GL_TEXTURE2);
-		configureTexture(*textures_[2]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(2).data());
+		if (!bindTexture(2, 2, GL_LUMINANCE, stride_ / horzSubSample_,
+				 size_.height() / vertSubSample_))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformV_, 2);
 
 		stridePixels = stride_;
@@ -630,45 +695,20 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::YVU420:
 		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_LUMINANCE, stride_, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/* Activate texture V */
-		glActiveTexture(GL_TEXTURE2);
-		configureTexture(*textures_[2]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
+		if (!bindTexture(2, 1, GL_LUMINANCE, stride_ / horzSubSample_,
+				 size_.height() / vertSubSample_))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformV_, 2);
 
 		/* Activate texture U */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(2).data());
+		if (!bindTexture(1, 2, GL_LUMINANCE, stride_ / horzSubSample_,
+				 size_.height() / vertSubSample_))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		stridePixels = stride_;
@@ -683,17 +723,8 @@ void ViewFinderGL::doRender()
 		 * OpenGL texel size with the 4 bytes repeating pattern in YUV.
 		 * The texture width is thus half of the image_ with.
 		 */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGBA,
-			     stride_ / 4,
-			     size_.height(),
-			     0,
-			     GL_RGBA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_RGBA, stride_ / 4, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/*
@@ -713,17 +744,8 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::ARGB8888:
 	case libcamera::formats::BGRA8888:
 	case libcamera::formats::RGBA8888:
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGBA,
-			     stride_ / 4,
-			     size_.height(),
-			     0,
-			     GL_RGBA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_RGBA, stride_ / 4, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		stridePixels = stride_ / 4;
@@ -731,17 +753,8 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::BGR888:
 	case libcamera::formats::RGB888:
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGB,
-			     stride_ / 3,
-			     size_.height(),
-			     0,
-			     GL_RGB,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_RGB, stride_ / 3, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		stridePixels = stride_ / 3;
@@ -764,17 +777,8 @@ void ViewFinderGL::doRender()
 		 * are stored in a GL_LUMINANCE texture. The texture width is
 		 * equal to the stride.
 		 */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		if (!bindTexture(0, 0, GL_LUMINANCE, stride_, size_.height()))
+			return false;
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 		shaderProgram_.setUniformValue(textureUniformBayerFirstRed_,
 					       firstRed_);
@@ -805,6 +809,8 @@ void ViewFinderGL::doRender()
 	shaderProgram_.setUniformValue(textureUniformStrideFactor_,
 				       static_cast<float>(size_.width() - 1) /
 				       (stridePixels - 1));
+
+	return true;
 }
 
 void ViewFinderGL::paintGL()
@@ -819,11 +825,40 @@ void ViewFinderGL::paintGL()
 		glClearColor(0.0, 0.0, 0.0, 1.0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		doRender();
+		if (!doRender())
+			fallbackToUpload();
+
 		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 	}
 }
 
+/*
+ * Stop importing the buffers after an import failure, and render the frame
+ * again from the CPU mapping. The fragment shader samples the uploaded two
+ * components textures differently and needs to be recreated.
+ */
+void ViewFinderGL::fallbackToUpload()
+{
+#ifdef HAVE_EGL
+	qWarning() << "[ViewFinderGL]:"
+		   << "failed to import buffer, falling back to upload";
+
+	importer_.reset();
+
+	shaderProgram_.release();
+	shaderProgram_.removeShader(fragmentShader_.get());
+	fragmentShader_.reset();
+
+	if (!createFragmentShader()) {
+		qWarning() << "[ViewFinderGL]:"
+			   << "create fragment shader failed.";
+		return;
+	}
+
+	doRender();
+#endif
+}
+
 void ViewFinderGL::resizeGL(int w, int h)
 {
 	glViewport(0, 0, w, h);
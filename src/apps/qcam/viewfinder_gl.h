@@ -25,6 +25,10 @@
 
 #include "viewfinder.h"
 
+#ifdef HAVE_EGL
+class DmaBufImporter;
+#endif
+
 class ViewFinderGL : public QOpenGLWidget,
 		     public ViewFinder,
 		     protected QOpenGLFunctions
@@ -59,10 +63,13 @@ private:
 	void selectColorSpace(const libcamera::ColorSpace &colorSpace);
 
 	void configureTexture(QOpenGLTexture &texture);
+	bool bindTexture(unsigned int index, unsigned int plane, GLenum format,
+			 unsigned int width, unsigned int height);
 	bool createFragmentShader();
 	bool createVertexShader();
 	void removeShader();
-	void doRender();
+	bool doRender();
+	void fallbackToUpload();
 
 	/* Captured image size, format and buffer */
 	libcamera::FrameBuffer *buffer_;
@@ -86,6 +93,11 @@ private:
 	/* Textures */
 	std::array<std::unique_ptr<QOpenGLTexture>, 3> textures_;
 
+#ifdef HAVE_EGL
+	/* Imports the buffers when set, they are uploaded otherwise */
+	std::unique_ptr<DmaBufImporter> importer_;
+#endif
+
 	/* Common texture parameters */
 	GLuint textureMinMagFilters_;
 
@@ -490,23 +490,48 @@ gst_libcamera_configure_stream_from_caps(StreamConfiguration &stream_cfg,
 	}
 }
 
+/*
+ * Fixate the framerate of the element caps, defaulting to 30 fps when no
+ * framerate has been requested.
+ */
+static void
+fixate_framerate(GstStructure *element_caps)
+{
+	if (!gst_structure_has_field(element_caps, "framerate")) {
+		gst_structure_set(element_caps, "framerate", GST_TYPE_FRACTION,
+				  30, 1, nullptr);
+		return;
+	}
+
+	gst_structure_fixate_field_nearest_fraction(element_caps, "framerate",
+						    30, 1);
+}
+
 void gst_libcamera_get_framerate_from_caps(GstCaps *caps,
 					   GstStructure *element_caps)
 {
 	GstStructure *s = gst_caps_get_structure(caps, 0);
+	const GValue *framerate = gst_structure_get_value(s, "framerate");
+	if (!framerate)
+		return;
+
 	/*
-	 * Default to 30 fps. If the "framerate" fraction is invalid below,
-	 * libcamerasrc will set 30fps as the framerate.
+	 * All streams are captured at the same rate, restrict the framerates
+	 * to the ones accepted downstream of all pads.
 	 */
-	gint fps_n = 30, fps_d = 1;
+	const GValue *current = gst_structure_get_value(element_caps, "framerate");
+	if (!current) {
+		gst_structure_set_value(element_caps, "framerate", framerate);
+		return;
+	}
 
-	if (gst_structure_has_field_typed(s, "framerate", GST_TYPE_FRACTION)) {
-		if (!gst_structure_get_fraction(s, "framerate", &fps_n, &fps_d))
-			GST_WARNING("Invalid framerate in the caps");
+	GValue common = G_VALUE_INIT;
+	if (!gst_value_intersect(&common, current, framerate)) {
+		GST_WARNING("The pads request incompatible framerates");
+		return;
 	}
 
-	gst_structure_set(element_caps, "framerate", GST_TYPE_FRACTION,
-			  fps_n, fps_d, nullptr);
+	gst_structure_take_value(element_caps, "framerate", &common);
 }
 
 void gst_libcamera_clamp_and_set_frameduration(ControlList &initCtrls,
@@ -515,37 +540,70 @@ void gst_libcamera_clamp_and_set_frameduration(ControlList &initCtrls,
 {
 	gint fps_caps_n, fps_caps_d;
 
-	if (!gst_structure_has_field_typed(element_caps, "framerate", GST_TYPE_FRACTION))
-		return;
-
 	auto iterFrameDuration = cam_ctrls.find(&controls::FrameDurationLimits);
 	if (iterFrameDuration == cam_ctrls.end()) {
 		GST_WARNING("FrameDurationLimits not found in camera controls.");
+		fixate_framerate(element_caps);
 		return;
 	}
 
-	const GValue *framerate = gst_structure_get_value(element_caps, "framerate");
-
-	fps_caps_n = gst_value_get_fraction_numerator(framerate);
-	fps_caps_d = gst_value_get_fraction_denominator(framerate);
-
-	int64_t target_duration = (fps_caps_d * 1000000.0) / fps_caps_n;
 	int64_t min_frame_duration = iterFrameDuration->second.min().get<int64_t>();
 	int64_t max_frame_duration = iterFrameDuration->second.max().get<int64_t>();
 
+	/*
+	 * Restrict the framerates requested downstream to the range supported
+	 * by the camera, so that the framerate is picked among the ones that
+	 * can really be captured.
+	 */
+	GValue supported = G_VALUE_INIT;
+	if (min_frame_duration < max_frame_duration) {
+		g_value_init(&supported, GST_TYPE_FRACTION_RANGE);
+		gst_value_set_fraction_range_full(&supported,
+						  1000000, static_cast<gint>(max_frame_duration),
+						  1000000, static_cast<gint>(min_frame_duration));
+	} else {
+		g_value_init(&supported, GST_TYPE_FRACTION);
+		gst_value_set_fraction(&supported, 1000000,
+				       static_cast<gint>(min_frame_duration));
+	}
+
+	const GValue *requested = gst_structure_get_value(element_caps, "framerate");
+	GValue framerate = G_VALUE_INIT;
+
+	if (!requested) {
+		gst_structure_set_value(element_caps, "framerate", &supported);
+	} else if (gst_value_intersect(&framerate, requested, &supported)) {
+		gst_structure_take_value(element_caps, "framerate", &framerate);
+	} else {
+		GST_WARNING("None of the requested framerates is supported by the camera");
+	}
+
+	g_value_unset(&supported);
+
+	fixate_framerate(element_caps);
+
+	if (!gst_structure_get_fraction(element_caps, "framerate",
+					&fps_caps_n, &fps_caps_d) || !fps_caps_n)
+		return;
+
+	int64_t target_duration = (fps_caps_d * 1000000.0) / fps_caps_n;
 	int64_t frame_duration = std::clamp(target_duration,
 					    min_frame_duration,
 					    max_frame_duration);
 
 	if (frame_duration != target_duration) {
-		gint framerate_clamped = 1000000 / frame_duration;
+		gint framerate_clamped_n = 1000000;
+		gint framerate_clamped_d = static_cast<gint>(frame_duration);
+		gint gcd = gst_util_greatest_common_divisor(framerate_clamped_n,
+							    framerate_clamped_d);
 
 		/*
 		 * Update the clamped framerate which then will be exposed in
 		 * downstream caps.
 		 */
 		gst_structure_set(element_caps, "framerate", GST_TYPE_FRACTION,
-				  framerate_clamped, 1, nullptr);
+				  framerate_clamped_n / gcd,
+				  framerate_clamped_d / gcd, nullptr);
 	}
 
 	initCtrls.set(controls::FrameDurationLimits,
@@ -567,6 +625,48 @@ void gst_libcamera_framerate_to_caps(GstCaps *caps, const GstStructure *element_
 	gst_structure_set(s, "framerate", GST_TYPE_FRACTION, fps_caps_n, fps_caps_d, nullptr);
 }
 
+/*
+ * Update the plane strides and offsets of a GstVideoInfo to the layout of the
+ * frames captured by libcamera for the stream. The stride of the other planes
+ * is derived from the stride of the first plane, and the planes are stored
+ * contiguously.
+ */
+bool
+gst_libcamera_video_info_set_layout(GstVideoInfo *info,
+				    const StreamConfiguration &stream_cfg)
+{
+	const GstVideoFormatInfo *finfo = info->finfo;
+	const guint pstride = GST_VIDEO_FORMAT_INFO_PSTRIDE(finfo, 0);
+	gsize offset = 0;
+
+	if (!pstride || GST_VIDEO_FORMAT_INFO_IS_TILED(finfo))
+		return false;
+
+	for (guint plane = 0; plane < GST_VIDEO_INFO_N_PLANES(info); plane++) {
+		/* Find the first component stored in the plane. */
+		guint comp = 0;
+		for (guint i = 0; i < GST_VIDEO_FORMAT_INFO_N_COMPONENTS(finfo); i++) {
+			if (GST_VIDEO_FORMAT_INFO_PLANE(finfo, i) == plane) {
+				comp = i;
+				break;
+			}
+		}
+
+		gint stride = stream_cfg.stride * GST_VIDEO_FORMAT_INFO_PSTRIDE(finfo, comp)
+			    / (pstride << GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp));
+		gint height = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, comp,
+								 GST_VIDEO_INFO_HEIGHT(info));
+
+		GST_VIDEO_INFO_PLANE_STRIDE(info, plane) = stride;
+		GST_VIDEO_INFO_PLANE_OFFSET(info, plane) = offset;
+		offset += stride * height;
+	}
+
+	GST_VIDEO_INFO_SIZE(info) = offset;
+
+	return true;
+}
+
 #if !GST_CHECK_VERSION(1, 17, 1)
 gboolean
 gst_task_resume(GstTask *task)
@@ -18,7 +18,18 @@ struct _GstLibcameraPad {
 	GstPad parent;
 	StreamRole role;
 	GstLibcameraPool *pool;
+	/* Pool to copy frames to when downstream can't handle their layout. */
+	GstBufferPool *video_pool;
+	GstVideoInfo info;
 	GstClockTime latency;
+
+	/*
+	 * Buffers and events waiting to be pushed by the pad streaming task,
+	 * protected by the object lock.
+	 */
+	GQueue pending;
+	GCond pending_cond;
+	gboolean flushing;
 };
 
 enum {
@@ -76,10 +87,42 @@ gst_libcamera_pad_query(GstPad *pad, GstObject *parent, GstQuery *query)
 	return TRUE;
 }
 
+static gboolean
+gst_libcamera_pad_activate_mode(GstPad *pad, [[maybe_unused]] GstObject *parent,
+				[[maybe_unused]] GstPadMode mode, gboolean active)
+{
+	/*
+	 * Wake up the streaming task before deactivating the pad, as the pad
+	 * stream lock it holds while waiting for data is taken by the
+	 * deactivation.
+	 */
+	gst_libcamera_pad_set_flushing(pad, !active);
+	if (!active)
+		return gst_pad_stop_task(pad);
+
+	return TRUE;
+}
+
 static void
 gst_libcamera_pad_init(GstLibcameraPad *self)
 {
 	GST_PAD_QUERYFUNC(self) = gst_libcamera_pad_query;
+	GST_PAD_ACTIVATEMODEFUNC(self) = gst_libcamera_pad_activate_mode;
+
+	g_queue_init(&self->pending);
+	g_cond_init(&self->pending_cond);
+	self->flushing = TRUE;
+}
+
+static void
+gst_libcamera_pad_finalize(GObject *object)
+{
+	auto *self = GST_LIBCAMERA_PAD(object);
+
+	g_queue_clear_full(&self->pending, (GDestroyNotify)gst_mini_object_unref);
+	g_cond_clear(&self->pending_cond);
+
+	G_OBJECT_CLASS(gst_libcamera_pad_parent_class)->finalize(object);
 }
 
 static GType
@@ -116,6 +159,7 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 
 	object_class->set_property = gst_libcamera_pad_set_property;
 	object_class->get_property = gst_libcamera_pad_get_property;
+	object_class->finalize = gst_libcamera_pad_finalize;
 
 	auto *spec = g_param_spec_enum("stream-role", "Stream Role",
 				       "The selected stream role",
@@ -153,6 +197,33 @@ gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool)
 	self->pool = pool;
 }
 
+GstBufferPool *
+gst_libcamera_pad_get_video_pool(GstPad *pad, GstVideoInfo *info)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	if (self->video_pool && info)
+		*info = self->info;
+
+	return self->video_pool;
+}
+
+void
+gst_libcamera_pad_set_video_pool(GstPad *pad, GstBufferPool *video_pool,
+				 const GstVideoInfo *info)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	if (self->video_pool) {
+		gst_buffer_pool_set_active(self->video_pool, FALSE);
+		gst_object_unref(self->video_pool);
+	}
+
+	self->video_pool = video_pool;
+	if (info)
+		self->info = *info;
+}
+
 Stream *
 gst_libcamera_pad_get_stream(GstPad *pad)
 {
@@ -171,3 +242,60 @@ gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency)
 	GLibLocker lock(GST_OBJECT(self));
 	self->latency = latency;
 }
+
+void
+gst_libcamera_pad_queue(GstPad *pad, GstMiniObject *item)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		if (!self->flushing) {
+			g_queue_push_tail(&self->pending, item);
+			g_cond_signal(&self->pending_cond);
+			return;
+		}
+	}
+
+	gst_mini_object_unref(item);
+}
+
+GstMiniObject *
+gst_libcamera_pad_dequeue(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
+
+	while (!self->flushing && g_queue_is_empty(&self->pending))
+		g_cond_wait(&self->pending_cond, GST_OBJECT_GET_LOCK(self));
+
+	if (self->flushing)
+		return nullptr;
+
+	return static_cast<GstMiniObject *>(g_queue_pop_head(&self->pending));
+}
+
+void
+gst_libcamera_pad_set_flushing(GstPad *pad, gboolean flushing)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GQueue pending = G_QUEUE_INIT;
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		self->flushing = flushing;
+		if (flushing) {
+			pending = self->pending;
+			g_queue_init(&self->pending);
+			g_cond_broadcast(&self->pending_cond);
+		}
+	}
+
+	/*
+	 * Release the buffers without holding the lock, as this returns them
+	 * to their pool and notifies the source.
+	 */
+	g_queue_clear_full(&pending, (GDestroyNotify)gst_mini_object_unref);
+}
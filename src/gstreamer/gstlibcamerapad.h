@@ -11,6 +11,7 @@
 #include "gstlibcamerapool.h"
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include <libcamera/stream.h>
 
@@ -23,6 +24,17 @@ GstLibcameraPool *gst_libcamera_pad_get_pool(GstPad *pad);
 
 void gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool);
 
+GstBufferPool *gst_libcamera_pad_get_video_pool(GstPad *pad, GstVideoInfo *info);
+
+void gst_libcamera_pad_set_video_pool(GstPad *pad, GstBufferPool *video_pool,
+				      const GstVideoInfo *info);
+
 libcamera::Stream *gst_libcamera_pad_get_stream(GstPad *pad);
 
 void gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency);
+
+void gst_libcamera_pad_queue(GstPad *pad, GstMiniObject *item);
+
+GstMiniObject *gst_libcamera_pad_dequeue(GstPad *pad);
+
+void gst_libcamera_pad_set_flushing(GstPad *pad, gboolean flushing);
@@ -8,8 +8,13 @@
 
 #include "gstlibcamerapool.h"
 
+#include <vector>
+
+#include <libcamera/framebuffer.h>
 #include <libcamera/stream.h>
 
+#include <gst/allocators/allocators.h>
+
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
@@ -27,10 +32,162 @@ struct _GstLibcameraPool {
 	GstAtomicQueue *queue;
 	GstLibcameraAllocator *allocator;
 	Stream *stream;
+
+	/*
+	 * The downstream pool when importing, and the layout of the frames,
+	 * when importing or when video_meta is set.
+	 */
+	GstBufferPool *downstream;
+	GstVideoInfo info;
+	gboolean video_meta;
 };
 
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL)
 
+static GQuark
+gst_libcamera_pool_import_quark()
+{
+	static gsize import_quark = 0;
+
+	if (g_once_init_enter(&import_quark)) {
+		GQuark quark = g_quark_from_string("GstLibcameraImportedFrameBuffer");
+		g_once_init_leave(&import_quark, quark);
+	}
+
+	return import_quark;
+}
+
+/*
+ * Get the FrameBuffer wrapping the dmabufs of a downstream buffer. It is
+ * created the first time the buffer is seen, and attached to its first memory
+ * to be reused when the downstream pool recycles the buffer.
+ */
+static FrameBuffer *
+gst_libcamera_pool_import_buffer(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
+	if (!mem)
+		return nullptr;
+
+	auto *fb = reinterpret_cast<FrameBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem),
+									     gst_libcamera_pool_import_quark()));
+	if (fb)
+		return fb;
+
+	/* The camera writes the frames with the default layout of the caps. */
+	GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+	const guint n_planes = GST_VIDEO_INFO_N_PLANES(&self->info);
+	std::vector<FrameBuffer::Plane> planes;
+
+	for (guint i = 0; i < n_planes; i++) {
+		gsize offset = GST_VIDEO_INFO_PLANE_OFFSET(&self->info, i);
+		gsize end = i + 1 < n_planes
+			  ? GST_VIDEO_INFO_PLANE_OFFSET(&self->info, i + 1)
+			  : GST_VIDEO_INFO_SIZE(&self->info);
+
+		if (meta && (meta->offset[i] != offset ||
+			     meta->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE(&self->info, i))) {
+			GST_DEBUG_OBJECT(self, "Unsupported layout for plane %u", i);
+			return nullptr;
+		}
+
+		guint idx, length;
+		gsize skip;
+		if (!gst_buffer_find_memory(buffer, offset, end - offset,
+					    &idx, &length, &skip) || length != 1) {
+			GST_DEBUG_OBJECT(self, "Plane %u spans multiple memories", i);
+			return nullptr;
+		}
+
+		GstMemory *plane_mem = gst_buffer_peek_memory(buffer, idx);
+		if (!gst_is_dmabuf_memory(plane_mem)) {
+			GST_DEBUG_OBJECT(self, "Downstream memory is not dmabuf");
+			return nullptr;
+		}
+
+		FrameBuffer::Plane plane;
+		plane.fd = SharedFD(gst_dmabuf_memory_get_fd(plane_mem));
+		plane.offset = plane_mem->offset + skip;
+		plane.length = end - offset;
+		planes.push_back(std::move(plane));
+	}
+
+	fb = new FrameBuffer(planes);
+	gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(mem),
+				  gst_libcamera_pool_import_quark(), fb,
+				  [](gpointer data) {
+					  delete reinterpret_cast<FrameBuffer *>(data);
+				  });
+
+	return fb;
+}
+
+/*
+ * Fill an empty buffer of the pool with the memories of a buffer acquired from
+ * the downstream pool. The downstream buffer is kept alive by a parent buffer
+ * meta, and returns to its pool when the buffer is reset.
+ */
+static bool
+gst_libcamera_pool_prepare_imported_buffer(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	GstBufferPoolAcquireParams params = {};
+	params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	GstBuffer *imported;
+	if (gst_buffer_pool_acquire_buffer(self->downstream, &imported, &params) != GST_FLOW_OK)
+		return false;
+
+	if (!gst_libcamera_pool_import_buffer(self, imported)) {
+		gst_buffer_unref(imported);
+		return false;
+	}
+
+	/*
+	 * Share the memories rather than copying the buffer, which would
+	 * duplicate the memories flagged as non-shareable.
+	 */
+	for (guint i = 0; i < gst_buffer_n_memory(imported); i++)
+		gst_buffer_append_memory(buffer,
+					 gst_memory_ref(gst_buffer_peek_memory(imported, i)));
+
+	gst_buffer_add_parent_buffer_meta(buffer, imported);
+	gst_buffer_unref(imported);
+
+	return true;
+}
+
+/*
+ * Describe the layout of the frame with a GstVideoMeta. Planes stored in
+ * separate memories start at the beginning of their memory.
+ */
+static void
+gst_libcamera_pool_add_video_meta(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	const GstVideoInfo *info = &self->info;
+	const guint n_planes = GST_VIDEO_INFO_N_PLANES(info);
+	const bool per_plane = gst_buffer_n_memory(buffer) == n_planes;
+	gsize offset[GST_VIDEO_MAX_PLANES] = {};
+	gint stride[GST_VIDEO_MAX_PLANES] = {};
+	gsize mem_offset = 0;
+
+	for (guint i = 0; i < n_planes; i++) {
+		stride[i] = GST_VIDEO_INFO_PLANE_STRIDE(info, i);
+
+		if (per_plane) {
+			offset[i] = mem_offset;
+			mem_offset += gst_buffer_peek_memory(buffer, i)->size;
+		} else {
+			offset[i] = GST_VIDEO_INFO_PLANE_OFFSET(info, i);
+		}
+	}
+
+	gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE,
+				       GST_VIDEO_INFO_FORMAT(info),
+				       GST_VIDEO_INFO_WIDTH(info),
+				       GST_VIDEO_INFO_HEIGHT(info),
+				       n_planes, offset, stride);
+}
+
 static GstFlowReturn
 gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 				  [[maybe_unused]] GstBufferPoolAcquireParams *params)
@@ -40,11 +197,17 @@ gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 	if (!buf)
 		return GST_FLOW_ERROR;
 
-	if (!gst_libcamera_allocator_prepare_buffer(self->allocator, self->stream, buf)) {
+	bool prepared = self->downstream
+		      ? gst_libcamera_pool_prepare_imported_buffer(self, buf)
+		      : gst_libcamera_allocator_prepare_buffer(self->allocator, self->stream, buf);
+	if (!prepared) {
 		gst_atomic_queue_push(self->queue, buf);
 		return GST_FLOW_ERROR;
 	}
 
+	if (self->video_meta)
+		gst_libcamera_pool_add_video_meta(self, buf);
+
 	*buffer = buf;
 	return GST_FLOW_OK;
 }
@@ -54,7 +217,11 @@ gst_libcamera_pool_reset_buffer(GstBufferPool *pool, GstBuffer *buffer)
 {
 	GstBufferPoolClass *klass = GST_BUFFER_POOL_CLASS(gst_libcamera_pool_parent_class);
 
-	/* Clears all the memories and only pool the GstBuffer objects */
+	/*
+	 * Clears all the memories and only pool the GstBuffer objects. This
+	 * also drops the parent buffer meta of imported buffers, returning the
+	 * downstream buffer to its pool.
+	 */
 	gst_buffer_remove_all_memory(buffer);
 	klass->reset_buffer(pool, buffer);
 	GST_BUFFER_FLAGS(buffer) = 0;
@@ -88,7 +255,14 @@ gst_libcamera_pool_finalize(GObject *object)
 		gst_buffer_unref(buf);
 
 	gst_atomic_queue_unref(self->queue);
-	g_object_unref(self->allocator);
+
+	if (self->allocator)
+		g_object_unref(self->allocator);
+
+	if (self->downstream) {
+		gst_buffer_pool_set_active(self->downstream, FALSE);
+		gst_object_unref(self->downstream);
+	}
 
 	G_OBJECT_CLASS(gst_libcamera_pool_parent_class)->finalize(object);
 }
@@ -128,6 +302,35 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 	return pool;
 }
 
+GstLibcameraPool *
+gst_libcamera_pool_new_imported(GstBufferPool *downstream, Stream *stream,
+				const GstVideoInfo *info, gsize pool_size)
+{
+	auto *pool = GST_LIBCAMERA_POOL(g_object_new(GST_TYPE_LIBCAMERA_POOL, nullptr));
+
+	pool->downstream = GST_BUFFER_POOL(gst_object_ref(downstream));
+	pool->stream = stream;
+	pool->info = *info;
+
+	for (gsize i = 0; i < pool_size; i++) {
+		GstBuffer *buffer = gst_buffer_new();
+		gst_atomic_queue_push(pool->queue, buffer);
+	}
+
+	return pool;
+}
+
+/*
+ * Attach a GstVideoMeta describing the frame layout to the buffers, for
+ * downstream elements that support it.
+ */
+void
+gst_libcamera_pool_set_video_meta(GstLibcameraPool *self, const GstVideoInfo *info)
+{
+	self->info = *info;
+	self->video_meta = TRUE;
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
@@ -138,5 +341,11 @@ FrameBuffer *
 gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer)
 {
 	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
+
+	auto *fb = reinterpret_cast<FrameBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem),
+									     gst_libcamera_pool_import_quark()));
+	if (fb)
+		return fb;
+
 	return gst_libcamera_memory_get_frame_buffer(mem);
 }
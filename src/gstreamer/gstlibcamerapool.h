@@ -7,6 +7,9 @@
  *
  * This is a partial implementation of GstBufferPool intended for internal use
  * only. This pool cannot be configured or activated.
+ *
+ * The pool either hands out the buffers allocated by libcamera, or imports the
+ * dmabuf buffers of a pool provided by a downstream element.
  */
 
 #pragma once
@@ -14,6 +17,7 @@
 #include "gstlibcameraallocator.h"
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include <libcamera/stream.h>
 
@@ -23,6 +27,14 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_LIBCAMERA, POOL,
 GstLibcameraPool *gst_libcamera_pool_new(GstLibcameraAllocator *allocator,
 					 libcamera::Stream *stream);
 
+GstLibcameraPool *gst_libcamera_pool_new_imported(GstBufferPool *downstream,
+						  libcamera::Stream *stream,
+						  const GstVideoInfo *info,
+						  gsize pool_size);
+
+void gst_libcamera_pool_set_video_meta(GstLibcameraPool *self,
+				      const GstVideoInfo *info);
+
 libcamera::Stream *gst_libcamera_pool_get_stream(GstLibcameraPool *self);
 
 libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
@@ -12,23 +12,19 @@
  *    + Allowing application to use FLUSH/FLUSH_STOP
  *    + Prevent the main thread from accessing streaming thread
  *  - Implement GstElement::request-new-pad (multi stream)
- *    + Evaluate if a single streaming thread is fine
  *  - Add application driven request (snapshot)
- *  - Add framerate control
- *  - Add buffer importation support
  *
  *  Requires new libcamera API:
- *  - Add framerate negotiation support
  *  - Add colorimetry support
- *  - Add timestamp support
  *  - Use unique names to select the camera devices
- *  - Add GstVideoMeta support (strides and offsets)
  */
 
 #include "gstlibcamerasrc.h"
 
+#include <algorithm>
 #include <atomic>
 #include <queue>
+#include <time.h>
 #include <vector>
 
 #include <libcamera/camera.h>
@@ -126,6 +122,14 @@ struct GstLibcameraSrcState {
 	std::queue<std::unique_ptr<RequestWrap>> queuedRequests_;
 	std::queue<std::unique_ptr<RequestWrap>> completedRequests_;
 
+	/*
+	 * Each pad pushes its buffers from its own streaming task. flowLock_
+	 * protects the flow combiner they all update, and flowReturn_, the
+	 * combined flow return to be handled by the source task.
+	 */
+	GMutex flowLock_;
+	GstFlowReturn flowReturn_;
+
 	ControlList initControls_;
 	guint group_id_;
 
@@ -133,6 +137,13 @@ struct GstLibcameraSrcState {
 	void requestCompleted(Request *request);
 	int processRequest();
 	void clearRequests();
+
+	void updateFlow(GstPad *srcpad, GstFlowReturn ret);
+	int handleFlowReturn();
+
+	void startPads();
+	void pausePads();
+	void stopPads();
 };
 
 struct _GstLibcameraSrc {
@@ -193,15 +204,24 @@ int GstLibcameraSrcState::queueRequest()
 						     &buffer, nullptr);
 		if (ret != GST_FLOW_OK) {
 			/*
-			 * RequestWrap has ownership of the request, and we
-			 * won't be queueing this one due to lack of buffers.
+			 * Leave out the streams whose downstream hasn't
+			 * returned buffers yet, so that a slow branch drops
+			 * frames instead of throttling the other ones.
 			 */
-			return -ENOBUFS;
+			continue;
 		}
 
 		wrap->attachBuffer(stream, buffer);
 	}
 
+	if (wrap->buffers_.empty()) {
+		/*
+		 * RequestWrap has ownership of the request, and we won't be
+		 * queueing this one due to lack of buffers.
+		 */
+		return -ENOBUFS;
+	}
+
 	GST_TRACE_OBJECT(src_, "Requesting buffers");
 	cam_->queueRequest(wrap->request_.get());
 
@@ -214,6 +234,46 @@ int GstLibcameraSrcState::queueRequest()
 	return 0;
 }
 
+static GstClockTime
+gst_libcamera_src_monotonic_time()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return GST_TIMESPEC_TO_TIME(ts);
+}
+
+static bool
+gst_libcamera_src_clock_is_monotonic(GstClock *clock)
+{
+	if (!GST_IS_SYSTEM_CLOCK(clock))
+		return false;
+
+	GstClockType clock_type;
+	g_object_get(clock, "clock-type", &clock_type, nullptr);
+
+	return clock_type == GST_CLOCK_TYPE_MONOTONIC;
+}
+
+/*
+ * Retrieve the time at which the frames of a request have been captured, in
+ * the CLOCK_MONOTONIC time base. Use the sensor timestamp when available, and
+ * fall back to the timestamp of the first buffer otherwise.
+ */
+static GstClockTime
+gst_libcamera_src_request_timestamp(Request *request)
+{
+	const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+	if (sensorTimestamp)
+		return *sensorTimestamp;
+
+	const Request::BufferMap &buffers = request->buffers();
+	if (!buffers.empty())
+		return buffers.begin()->second->metadata().timestamp;
+
+	return gst_libcamera_src_monotonic_time();
+}
+
 void
 GstLibcameraSrcState::requestCompleted(Request *request)
 {
@@ -234,17 +294,45 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		return;
 	}
 
-	if (GST_ELEMENT_CLOCK(src_)) {
-		int64_t timestamp = request->metadata().get(controls::SensorTimestamp).value_or(0);
-
+	GstClock *clock = GST_ELEMENT_CLOCK(src_);
+	if (clock) {
+		GstClockTime timestamp = gst_libcamera_src_request_timestamp(request);
 		GstClockTime gst_base_time = GST_ELEMENT(src_)->base_time;
-		GstClockTime gst_now = gst_clock_get_time(GST_ELEMENT_CLOCK(src_));
+		GstClockTime gst_timestamp;
+		GstClockTime sys_now;
+
 		/* \todo Need to expose which reference clock the timestamp relates to. */
-		GstClockTime sys_now = g_get_monotonic_time() * 1000;
+		if (gst_libcamera_src_clock_is_monotonic(clock)) {
+			/*
+			 * The internal time of the clock is the monotonic time
+			 * the timestamp is expressed in, convert it directly.
+			 */
+			GstClockTime internal, external, rate_num, rate_denom;
+			gst_clock_get_calibration(clock, &internal, &external,
+						  &rate_num, &rate_denom);
+			gst_timestamp = gst_clock_adjust_with_calibration(clock, timestamp,
+									  internal, external,
+									  rate_num, rate_denom);
+			sys_now = gst_libcamera_src_monotonic_time();
+		} else {
+			/*
+			 * Sample the element clock between two readings of the
+			 * monotonic time, to limit the error introduced by
+			 * preemption.
+			 *
+			 * Deduced from: sys_now - timestamp == gst_now - gst_timestamp
+			 */
+			GstClockTime sys_before = gst_libcamera_src_monotonic_time();
+			GstClockTime gst_now = gst_clock_get_time(clock);
+			GstClockTime sys_after = gst_libcamera_src_monotonic_time();
+
+			sys_now = sys_before + (sys_after - sys_before) / 2;
+			gst_timestamp = gst_now - (sys_now - timestamp);
+		}
 
-		/* Deduced from: sys_now - sys_base_time == gst_now - gst_base_time */
-		GstClockTime sys_base_time = sys_now - (gst_now - gst_base_time);
-		wrap->pts_ = timestamp - sys_base_time;
+		/* Frames captured before the pipeline started playing start at 0. */
+		wrap->pts_ = gst_timestamp > gst_base_time
+			   ? gst_timestamp - gst_base_time : 0;
 		wrap->latency_ = sys_now - timestamp;
 	}
 
@@ -256,6 +344,40 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 	gst_task_resume(src_->task);
 }
 
+/*
+ * Copy a frame to a buffer of the video pool, with the default layout for the
+ * caps. The source buffer is consumed.
+ */
+static GstBuffer *
+gst_libcamera_src_copy_frame(GstBufferPool *video_pool, const GstVideoInfo *info,
+			     GstBuffer *buffer)
+{
+	GstBuffer *copy = nullptr;
+	bool copied = false;
+
+	if (gst_buffer_pool_acquire_buffer(video_pool, &copy, nullptr) == GST_FLOW_OK) {
+		GstVideoFrame src_frame, dst_frame;
+
+		if (gst_video_frame_map(&src_frame, info, buffer, GST_MAP_READ)) {
+			if (gst_video_frame_map(&dst_frame, info, copy, GST_MAP_WRITE)) {
+				copied = gst_video_frame_copy(&dst_frame, &src_frame);
+				gst_video_frame_unmap(&dst_frame);
+			}
+
+			gst_video_frame_unmap(&src_frame);
+		}
+	}
+
+	if (copied)
+		gst_buffer_copy_into(copy, buffer, GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+	else
+		g_clear_pointer(&copy, gst_buffer_unref);
+
+	gst_buffer_unref(buffer);
+
+	return copy;
+}
+
 /* Must be called with stream_lock held. */
 int GstLibcameraSrcState::processRequest()
 {
@@ -277,12 +399,12 @@ int GstLibcameraSrcState::processRequest()
 	if (!wrap)
 		return -ENOBUFS;
 
-	GstFlowReturn ret = GST_FLOW_OK;
-	gst_flow_combiner_reset(src_->flow_combiner);
-
+	/* Hand the buffers over to the streaming tasks of the pads. */
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
 		GstBuffer *buffer = wrap->detachBuffer(stream);
+		if (!buffer)
+			continue;
 
 		FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
 
@@ -296,60 +418,148 @@ int GstLibcameraSrcState::processRequest()
 		GST_BUFFER_OFFSET(buffer) = fb->metadata().sequence;
 		GST_BUFFER_OFFSET_END(buffer) = fb->metadata().sequence;
 
-		ret = gst_pad_push(srcpad, buffer);
+		gst_libcamera_pad_queue(srcpad, GST_MINI_OBJECT(buffer));
+	}
+
+	return err;
+}
+
+void GstLibcameraSrcState::clearRequests()
+{
+	GLibLocker locker(&lock_);
+	completedRequests_ = {};
+}
+
+/* Called from the streaming tasks of the pads. */
+void GstLibcameraSrcState::updateFlow(GstPad *srcpad, GstFlowReturn ret)
+{
+	{
+		GLibLocker locker(&flowLock_);
+
 		ret = gst_flow_combiner_update_pad_flow(src_->flow_combiner,
 							srcpad, ret);
+		if (ret == GST_FLOW_OK)
+			return;
+
+		flowReturn_ = ret;
+	}
+
+	gst_task_resume(src_->task);
+}
+
+/* Must be called with stream_lock held. */
+int GstLibcameraSrcState::handleFlowReturn()
+{
+	GstFlowReturn ret;
+
+	{
+		GLibLocker locker(&flowLock_);
+		ret = flowReturn_;
+		flowReturn_ = GST_FLOW_OK;
 	}
 
 	switch (ret) {
 	case GST_FLOW_OK:
-		break;
+		return 0;
 
-	case GST_FLOW_NOT_NEGOTIATED: {
-		bool reconfigure = false;
+	case GST_FLOW_NOT_NEGOTIATED:
+		/* The pads needing a reconfiguration get renegotiated. */
 		for (GstPad *srcpad : srcpads_) {
-			if (gst_pad_needs_reconfigure(srcpad)) {
-				reconfigure = true;
-				break;
-			}
+			if (gst_pad_needs_reconfigure(srcpad))
+				return 0;
 		}
 
 		/* If no pads need a reconfiguration something went wrong. */
-		if (!reconfigure)
-			err = -EPIPE;
-
-		break;
-	}
+		return -EPIPE;
 
 	case GST_FLOW_EOS: {
+		pausePads();
+
 		g_autoptr(GstEvent) eos = gst_event_new_eos();
 		guint32 seqnum = gst_util_seqnum_next();
 		gst_event_set_seqnum(eos, seqnum);
 		for (GstPad *srcpad : srcpads_)
 			gst_pad_push_event(srcpad, gst_event_ref(eos));
 
-		err = -EPIPE;
-		break;
+		return -EPIPE;
 	}
 
 	case GST_FLOW_FLUSHING:
-		err = -EPIPE;
-		break;
+		return -EPIPE;
 
 	default:
 		GST_ELEMENT_FLOW_ERROR(src_, ret);
+		return -EPIPE;
+	}
+}
 
-		err = -EPIPE;
-		break;
+static void
+gst_libcamera_src_pad_loop(gpointer user_data)
+{
+	GstPad *srcpad = GST_PAD(user_data);
+	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(GST_PAD_PARENT(srcpad));
+
+	/* Wait for the next buffer or event, which fails when flushing. */
+	GstMiniObject *item = gst_libcamera_pad_dequeue(srcpad);
+	if (!item) {
+		gst_pad_pause_task(srcpad);
+		return;
 	}
 
-	return err;
+	if (GST_IS_EVENT(item)) {
+		gst_pad_push_event(srcpad, GST_EVENT(item));
+		return;
+	}
+
+	GstBuffer *buffer = GST_BUFFER(item);
+	GstFlowReturn ret = GST_FLOW_ERROR;
+
+	GstVideoInfo info;
+	GstBufferPool *video_pool = gst_libcamera_pad_get_video_pool(srcpad, &info);
+	if (video_pool)
+		buffer = gst_libcamera_src_copy_frame(video_pool, &info, buffer);
+
+	if (buffer)
+		ret = gst_pad_push(srcpad, buffer);
+
+	self->state->updateFlow(srcpad, ret);
 }
 
-void GstLibcameraSrcState::clearRequests()
+/* Must be called with stream_lock held. */
+void GstLibcameraSrcState::startPads()
 {
-	GLibLocker locker(&lock_);
-	completedRequests_ = {};
+	{
+		GLibLocker locker(&flowLock_);
+		gst_flow_combiner_reset(src_->flow_combiner);
+		flowReturn_ = GST_FLOW_OK;
+	}
+
+	for (GstPad *srcpad : srcpads_) {
+		gst_libcamera_pad_set_flushing(srcpad, FALSE);
+		gst_pad_start_task(srcpad, gst_libcamera_src_pad_loop, srcpad,
+				   nullptr);
+	}
+}
+
+/*
+ * Must be called with stream_lock held. The buffers not pushed yet are
+ * dropped.
+ */
+void GstLibcameraSrcState::pausePads()
+{
+	for (GstPad *srcpad : srcpads_) {
+		gst_libcamera_pad_set_flushing(srcpad, TRUE);
+		gst_pad_pause_task(srcpad);
+	}
+}
+
+/* Must be called with stream_lock held. */
+void GstLibcameraSrcState::stopPads()
+{
+	for (GstPad *srcpad : srcpads_) {
+		gst_libcamera_pad_set_flushing(srcpad, TRUE);
+		gst_pad_stop_task(srcpad);
+	}
 }
 
 static bool
@@ -414,6 +624,152 @@ gst_libcamera_src_open(GstLibcameraSrc *self)
 	return true;
 }
 
+/*
+ * Try to import the buffers of the pool proposed by downstream in reply to the
+ * ALLOCATION query, to capture frames directly in the memory of the downstream
+ * elements. This requires dmabuf memory laid out with the default strides and
+ * offsets for the caps.
+ *
+ * Must be called with stream_lock held.
+ */
+static GstLibcameraPool *
+gst_libcamera_src_create_imported_pool(GstLibcameraSrc *self, GstPad *srcpad,
+				       GstCaps *caps, GstQuery *query,
+				       const GstVideoInfo *info,
+				       const StreamConfiguration &stream_cfg)
+{
+	if (!gst_query_get_n_allocation_pools(query))
+		return nullptr;
+
+	GstBufferPool *downstream = nullptr;
+	guint size, min, max;
+	gst_query_parse_nth_allocation_pool(query, 0, &downstream, &size, &min, &max);
+
+	if (!downstream)
+		return nullptr;
+
+	/* The camera needs its own buffers on top of the ones downstream holds. */
+	guint count = min + stream_cfg.bufferCount;
+	if (max && count > max) {
+		GST_DEBUG_OBJECT(self, "Downstream pool is too small to import buffers");
+		gst_object_unref(downstream);
+		return nullptr;
+	}
+
+	GstStructure *config = gst_buffer_pool_get_config(downstream);
+	gst_buffer_pool_config_set_params(config, caps,
+					  std::max<guint>(size, GST_VIDEO_INFO_SIZE(info)),
+					  count, count);
+	if (!gst_buffer_pool_set_config(downstream, config) ||
+	    !gst_buffer_pool_set_active(downstream, TRUE)) {
+		GST_DEBUG_OBJECT(self, "Failed to configure downstream pool");
+		gst_object_unref(downstream);
+		return nullptr;
+	}
+
+	GstLibcameraPool *pool = gst_libcamera_pool_new_imported(downstream,
+								 stream_cfg.stream(),
+								 info, count);
+	gst_object_unref(downstream);
+
+	/* Check that the downstream buffers can be imported. */
+	GstBuffer *buffer;
+	if (gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool), &buffer,
+					   nullptr) != GST_FLOW_OK) {
+		GST_DEBUG_OBJECT(self, "Downstream buffers can't be imported");
+		g_object_unref(pool);
+		return nullptr;
+	}
+
+	gst_buffer_unref(buffer);
+
+	GST_INFO_OBJECT(srcpad, "Importing %u buffers from downstream pool", count);
+
+	return pool;
+}
+
+/*
+ * Create a pool of system memory buffers with the default layout for the caps,
+ * to copy frames to for downstream elements that can't handle the layout of
+ * the camera frames.
+ */
+static GstBufferPool *
+gst_libcamera_src_create_video_pool(GstLibcameraSrc *self, GstCaps *caps,
+				    const GstVideoInfo *info)
+{
+	GstBufferPool *video_pool = gst_video_buffer_pool_new();
+	GstStructure *config = gst_buffer_pool_get_config(video_pool);
+	gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(info), 0, 0);
+
+	if (!gst_buffer_pool_set_config(video_pool, config) ||
+	    !gst_buffer_pool_set_active(video_pool, TRUE)) {
+		GST_ERROR_OBJECT(self, "Failed to configure video pool");
+		gst_object_unref(video_pool);
+		return nullptr;
+	}
+
+	GST_WARNING_OBJECT(self,
+			   "Downstream doesn't support video meta, frames will be copied");
+
+	return video_pool;
+}
+
+/*
+ * Create the pool of buffers for a source pad, from the ALLOCATION query
+ * reply. Buffers are imported from downstream when possible. Otherwise they
+ * are allocated by libcamera, and carry a GstVideoMeta describing their
+ * strides and offsets when downstream supports it, or are copied to the
+ * default layout when their layout differs from it.
+ *
+ * Must be called with stream_lock held.
+ */
+static GstLibcameraPool *
+gst_libcamera_src_create_pool(GstLibcameraSrc *self, GstPad *srcpad,
+			      const StreamConfiguration &stream_cfg)
+{
+	g_autoptr(GstCaps) caps = gst_pad_get_current_caps(srcpad);
+	GstVideoInfo info;
+	GstVideoInfo camera_info;
+
+	if (!caps || !gst_video_info_from_caps(&info, caps))
+		return gst_libcamera_pool_new(self->allocator, stream_cfg.stream());
+
+	camera_info = info;
+	if (!gst_libcamera_video_info_set_layout(&camera_info, stream_cfg))
+		return gst_libcamera_pool_new(self->allocator, stream_cfg.stream());
+
+	bool default_layout = gst_video_info_is_equal(&info, &camera_info);
+
+	GstQuery *query = gst_query_new_allocation(caps, TRUE);
+	if (!gst_pad_peer_query(srcpad, query))
+		GST_DEBUG_OBJECT(self, "Didn't get downstream ALLOCATION hints");
+
+	GstLibcameraPool *pool = nullptr;
+	GstBufferPool *video_pool = nullptr;
+
+	if (default_layout)
+		pool = gst_libcamera_src_create_imported_pool(self, srcpad, caps, query,
+							      &info, stream_cfg);
+
+	if (!pool) {
+		pool = gst_libcamera_pool_new(self->allocator, stream_cfg.stream());
+
+		if (gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, nullptr)) {
+			gst_libcamera_pool_set_video_meta(pool, &camera_info);
+		} else if (!default_layout) {
+			/* The video meta is needed to map the frames to copy. */
+			gst_libcamera_pool_set_video_meta(pool, &camera_info);
+			video_pool = gst_libcamera_src_create_video_pool(self, caps, &info);
+		}
+	}
+
+	gst_query_unref(query);
+
+	gst_libcamera_pad_set_video_pool(srcpad, video_pool, &info);
+
+	return pool;
+}
+
 /* Must be called with stream_lock held. */
 static bool
 gst_libcamera_src_negotiate(GstLibcameraSrc *self)
@@ -484,8 +840,9 @@ gst_libcamera_src_negotiate(GstLibcameraSrc *self)
 		GstPad *srcpad = state->srcpads_[i];
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
 
-		GstLibcameraPool *pool = gst_libcamera_pool_new(self->allocator,
-								stream_cfg.stream());
+		GstLibcameraPool *pool =
+			gst_libcamera_src_create_pool(self, srcpad, stream_cfg);
+
 		g_signal_connect_swapped(pool, "buffer-notify",
 					 G_CALLBACK(gst_task_resume), self->task);
 
@@ -507,10 +864,11 @@ gst_libcamera_src_task_run(gpointer user_data)
 	/*
 	 * Start by pausing the task. The task may also get resumed by the
 	 * buffer-notify signal when new buffers are queued back to the pool,
-	 * or by the request completion handler when a new request has
-	 * completed.  Both will resume the task after adding the buffers or
-	 * request to their respective lists, which are checked below to decide
-	 * if the task needs to be resumed for another iteration. This is thus
+	 * by the request completion handler when a new request has completed,
+	 * or by the streaming task of a pad when the flow returned downstream
+	 * isn't OK. They all resume the task after adding the buffers, request
+	 * or flow return to their respective state, which is checked below to
+	 * decide if the task needs to be resumed for another iteration. This is thus
 	 * guaranteed to be race-free, the lock taken by gst_task_pause() and
 	 * gst_task_resume() serves as a memory barrier.
 	 */
@@ -520,9 +878,17 @@ gst_libcamera_src_task_run(gpointer user_data)
 
 	g_autoptr(GstEvent) event = self->pending_eos.exchange(nullptr);
 	if (event) {
+		/* Push the event after the buffers already handed to the pads. */
 		for (GstPad *srcpad : state->srcpads_)
-			gst_pad_push_event(srcpad, gst_event_ref(event));
+			gst_libcamera_pad_queue(srcpad,
+						GST_MINI_OBJECT(gst_event_ref(event)));
+
+		return;
+	}
 
+	/* Act upon the flow returned downstream by the streaming tasks. */
+	if (state->handleFlowReturn()) {
+		gst_task_stop(self->task);
 		return;
 	}
 
@@ -542,6 +908,7 @@ gst_libcamera_src_task_run(gpointer user_data)
 	if (reconfigure) {
 		state->cam_->stop();
 		state->clearRequests();
+		state->pausePads();
 
 		if (!gst_libcamera_src_negotiate(self)) {
 			GST_ELEMENT_FLOW_ERROR(self, GST_FLOW_NOT_NEGOTIATED);
@@ -549,6 +916,7 @@ gst_libcamera_src_task_run(gpointer user_data)
 		}
 
 		state->cam_->start(&state->initControls_);
+		state->startPads();
 	}
 
 	/*
@@ -581,8 +949,8 @@ gst_libcamera_src_task_run(gpointer user_data)
 	}
 
 	/*
-	 * Process one completed request, if available, and record if further
-	 * requests are ready for processing.
+	 * Dispatch the buffers of one completed request to the pads, if
+	 * available, and record if further requests are ready for processing.
 	 */
 	ret = state->processRequest();
 	switch (ret) {
@@ -591,10 +959,6 @@ gst_libcamera_src_task_run(gpointer user_data)
 		doResume = true;
 		break;
 
-	case -EPIPE:
-		gst_task_stop(self->task);
-		return;
-
 	case -ENOBUFS:
 	default:
 		break;
@@ -678,6 +1042,8 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		gst_task_stop(task);
 		return;
 	}
+
+	state->startPads();
 }
 
 static void
@@ -690,13 +1056,20 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 
 	GST_DEBUG_OBJECT(self, "Streaming thread is about to stop");
 
+	{
+		GLibRecLocker locker(&self->stream_lock);
+		state->stopPads();
+	}
+
 	state->cam_->stop();
 	state->clearRequests();
 
 	{
 		GLibRecLocker locker(&self->stream_lock);
-		for (GstPad *srcpad : state->srcpads_)
+		for (GstPad *srcpad : state->srcpads_) {
 			gst_libcamera_pad_set_pool(srcpad, nullptr);
+			gst_libcamera_pad_set_video_pool(srcpad, nullptr, nullptr);
+		}
 	}
 
 	g_clear_object(&self->allocator);
@@ -845,6 +1218,7 @@ gst_libcamera_src_finalize(GObject *object)
 	g_rec_mutex_clear(&self->stream_lock);
 	g_clear_object(&self->task);
 	g_mutex_clear(&self->state->lock_);
+	g_mutex_clear(&self->state->flowLock_);
 	g_free(self->camera_name);
 	delete self->state;
 
@@ -864,6 +1238,7 @@ gst_libcamera_src_init(GstLibcameraSrc *self)
 	gst_task_set_lock(self->task, &self->stream_lock);
 
 	g_mutex_init(&state->lock_);
+	g_mutex_init(&state->flowLock_);
 
 	state->srcpads_.push_back(gst_pad_new_from_template(templ, "src"));
 	gst_element_add_pad(GST_ELEMENT(self), state->srcpads_.back());
@@ -57,7 +57,8 @@ static constexpr utils::Duration kMaxShutterSpeed = 60ms;
 static constexpr uint32_t knumHistogramBins = 256;
 
 Agc::Agc()
-	: minShutterSpeed_(0s), maxShutterSpeed_(0s)
+	: minShutterSpeed_(0s), maxShutterSpeed_(0s), lastExposureTime_(0s),
+	  lastGain_(0.0)
 {
 }
 
@@ -107,27 +108,70 @@ int Agc::configure(IPAContext &context,
 	minAnalogueGain_ = std::max(configuration.agc.minAnalogueGain, kMinAnalogueGain);
 	maxAnalogueGain_ = configuration.agc.maxAnalogueGain;
 
-	/* Configure the default exposure and gain. */
-	activeState.agc.gain = minAnalogueGain_;
-	activeState.agc.exposure = 10ms / configuration.sensor.lineDuration;
+	/*
+	 * Configure the default exposure and gain, or restore the last values
+	 * computed during the previous capture session if the algorithm has
+	 * already run. The exposure time is stored as a duration as the line
+	 * length may differ between sensor configurations.
+	 */
+	if (lastExposureTime_) {
+		utils::Duration exposureTime =
+			std::clamp(lastExposureTime_, minShutterSpeed_,
+				   maxShutterSpeed_);
+		activeState.agc.gain = std::clamp(lastGain_, minAnalogueGain_,
+						  maxAnalogueGain_);
+		activeState.agc.exposure = exposureTime / configuration.sensor.lineDuration;
+	} else {
+		activeState.agc.gain = minAnalogueGain_;
+		activeState.agc.exposure = 10ms / configuration.sensor.lineDuration;
+	}
 
 	context.activeState.agc.constraintMode = constraintModes().begin()->first;
 	context.activeState.agc.exposureMode = exposureModeHelpers().begin()->first;
+	context.activeState.agc.meteringMode =
+		controls().at(&controls::AeMeteringMode).def().get<int32_t>();
 
 	/* \todo Run this again when FrameDurationLimits is passed in */
 	setLimits(minShutterSpeed_, maxShutterSpeed_, minAnalogueGain_,
 		  maxAnalogueGain_);
+	setQuantization(configuration.sensor.lineDuration, context.camHelper);
+	setZoneGrid({ bdsGrid_.width, bdsGrid_.height }, 3);
 	resetFrameCount();
 
 	return 0;
 }
 
-Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
-			       const ipu3_uapi_grid_config &grid)
+/**
+ * \copydoc libcamera::ipa::Algorithm::queueRequest
+ */
+void Agc::queueRequest(IPAContext &context,
+		       [[maybe_unused]] const uint32_t frame,
+		       [[maybe_unused]] IPAFrameContext &frameContext,
+		       const ControlList &controls)
+{
+	const auto &meteringMode = controls.get(controls::AeMeteringMode);
+	if (meteringMode) {
+		if (meteringModeSupported(*meteringMode)) {
+			context.activeState.agc.meteringMode = *meteringMode;
+
+			LOG(IPU3Agc, Debug)
+				<< "Set metering mode to " << *meteringMode;
+		} else {
+			LOG(IPU3Agc, Warning)
+				<< "Ignoring unsupported metering mode "
+				<< *meteringMode;
+		}
+	}
+}
+
+void Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
+			  const ipu3_uapi_grid_config &grid)
 {
 	uint32_t hist[knumHistogramBins] = { 0 };
 
-	rgbTriples_.clear();
+	Span<double> red = zones(0);
+	Span<double> green = zones(1);
+	Span<double> blue = zones(2);
 
 	for (unsigned int cellY = 0; cellY < grid.height; cellY++) {
 		for (unsigned int cellX = 0; cellX < grid.width; cellX++) {
@@ -137,11 +181,10 @@ Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
 				reinterpret_cast<const ipu3_uapi_awb_set_item *>(
 					&stats->awb_raw_buffer.meta_data[cellPosition]);
 
-			rgbTriples_.push_back({
-				cell->R_avg,
-				(cell->Gr_avg + cell->Gb_avg) / 2,
-				cell->B_avg
-			});
+			unsigned int zone = cellY * grid.width + cellX;
+			red[zone] = cell->R_avg / 255.0;
+			green[zone] = (cell->Gr_avg + cell->Gb_avg) / 2 / 255.0;
+			blue[zone] = cell->B_avg / 255.0;
 
 			/*
 			 * Store the average green value to estimate the
@@ -152,44 +195,7 @@ Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
 		}
 	}
 
-	return Histogram(Span<uint32_t>(hist));
-}
-
-/**
- * \brief Estimate the relative luminance of the frame with a given gain
- * \param[in] gain The gain to apply in estimating luminance
- *
- * The estimation is based on the AWB statistics for the current frame. Red,
- * green and blue averages for all cells are first multiplied by the gain, and
- * then saturated to approximate the sensor behaviour at high brightness
- * values. The approximation is quite rough, as it doesn't take into account
- * non-linearities when approaching saturation.
- *
- * The relative luminance (Y) is computed from the linear RGB components using
- * the Rec. 601 formula. The values are normalized to the [0.0, 1.0] range,
- * where 1.0 corresponds to a theoretical perfect reflector of 100% reference
- * white.
- *
- * More detailed information can be found in:
- * https://en.wikipedia.org/wiki/Relative_luminance
- *
- * \return The relative luminance of the frame
- */
-double Agc::estimateLuminance(double gain) const
-{
-	double redSum = 0, greenSum = 0, blueSum = 0;
-
-	for (unsigned int i = 0; i < rgbTriples_.size(); i++) {
-		redSum += std::min(std::get<0>(rgbTriples_[i]) * gain, 255.0);
-		greenSum += std::min(std::get<1>(rgbTriples_[i]) * gain, 255.0);
-		blueSum += std::min(std::get<2>(rgbTriples_[i]) * gain, 255.0);
-	}
-
-	double ySum = redSum * rGain_ * 0.299
-		    + greenSum * gGain_ * 0.587
-		    + blueSum * bGain_ * 0.114;
-
-	return ySum / (bdsGrid_.height * bdsGrid_.width) / 255;
+	hist_.reset(Span<uint32_t>(hist));
 }
 
 /**
@@ -208,11 +214,21 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 		  const ipu3_uapi_stats_3a *stats,
 		  ControlList &metadata)
 {
-	Histogram hist = parseStatistics(stats, context.configuration.grid.bdsGrid);
+	parseStatistics(stats, context.configuration.grid.bdsGrid);
 	rGain_ = context.activeState.awb.gains.red;
 	gGain_ = context.activeState.awb.gains.blue;
 	bGain_ = context.activeState.awb.gains.green;
 
+	/*
+	 * The relative luminance (Y) is computed from the linear RGB
+	 * components of the zones using the Rec. 601 formula. The components
+	 * are saturated individually to approximate the sensor behaviour at
+	 * high brightness values.
+	 */
+	setChannelWeight(0, rGain_ * 0.299);
+	setChannelWeight(1, gGain_ * 0.587);
+	setChannelWeight(2, bGain_ * 0.114);
+
 	/*
 	 * The Agc algorithm needs to know the effective exposure value that was
 	 * applied to the sensor when the statistics were collected.
@@ -226,7 +242,8 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	double aGain, dGain;
 	std::tie(shutterTime, aGain, dGain) =
 		calculateNewEv(context.activeState.agc.constraintMode,
-			       context.activeState.agc.exposureMode, hist,
+			       context.activeState.agc.exposureMode,
+			       context.activeState.agc.meteringMode, hist_,
 			       effectiveExposureValue);
 
 	LOG(IPU3Agc, Debug)
@@ -238,6 +255,10 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	activeState.agc.exposure = shutterTime / context.configuration.sensor.lineDuration;
 	activeState.agc.gain = aGain;
 
+	/* Remember the values to seed the next capture session. */
+	lastExposureTime_ = shutterTime;
+	lastGain_ = aGain;
+
 	metadata.set(controls::AnalogueGain, frameContext.sensor.gain);
 	metadata.set(controls::ExposureTime, exposureTime.get<std::micro>());
 
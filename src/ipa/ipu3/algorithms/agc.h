@@ -32,15 +32,17 @@ public:
 
 	int init(IPAContext &context, const YamlObject &tuningData) override;
 	int configure(IPAContext &context, const IPAConfigInfo &configInfo) override;
+	void queueRequest(IPAContext &context, const uint32_t frame,
+			  IPAFrameContext &frameContext,
+			  const ControlList &controls) override;
 	void process(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
 		     const ipu3_uapi_stats_3a *stats,
 		     ControlList &metadata) override;
 
 private:
-	double estimateLuminance(double gain) const override;
-	Histogram parseStatistics(const ipu3_uapi_stats_3a *stats,
-				  const ipu3_uapi_grid_config &grid);
+	void parseStatistics(const ipu3_uapi_stats_3a *stats,
+			     const ipu3_uapi_grid_config &grid);
 
 	utils::Duration minShutterSpeed_;
 	utils::Duration maxShutterSpeed_;
@@ -53,7 +55,10 @@ private:
 	double gGain_;
 	double bGain_;
 	ipu3_uapi_grid_config bdsGrid_;
-	std::vector<std::tuple<uint8_t, uint8_t, uint8_t>> rgbTriples_;
+	Histogram hist_;
+
+	utils::Duration lastExposureTime_;
+	double lastGain_;
 };
 
 } /* namespace ipa::ipu3::algorithms */
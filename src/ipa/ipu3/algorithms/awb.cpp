@@ -215,6 +215,16 @@ int Awb::configure(IPAContext &context,
 	cellsPerZoneThreshold_ = cellsPerZoneX_ * cellsPerZoneY_ * kMaxCellSaturationRatio;
 	LOG(IPU3Awb, Debug) << "Threshold for AWB is set to " << cellsPerZoneThreshold_;
 
+	/*
+	 * The cached results are preserved across capture sessions. Start
+	 * from the gains computed during the previous session, if any, instead
+	 * of converging again from unity gains.
+	 */
+	context.activeState.awb.gains.blue = asyncResults_.blueGain;
+	context.activeState.awb.gains.green = asyncResults_.greenGain;
+	context.activeState.awb.gains.red = asyncResults_.redGain;
+	context.activeState.awb.temperatureK = asyncResults_.temperatureK;
+
 	return 0;
 }
 
@@ -353,56 +363,64 @@ void Awb::generateZones()
 /* Translate the IPU3 statistics into the default statistics zone array */
 void Awb::generateAwbStats(const ipu3_uapi_stats_3a *stats)
 {
+	const ipu3_uapi_awb_set_item *cells = stats->awb_raw_buffer.meta_data;
+
 	/*
 	 * Generate a (kAwbStatsSizeX x kAwbStatsSizeY) array from the IPU3 grid which is
 	 * (grid.width x grid.height).
+	 *
+	 * Walk the grid one zone row at a time, and accumulate the cells of
+	 * each zone in local sums over contiguous cells to avoid computing
+	 * the zone of every cell.
 	 */
-	for (unsigned int cellY = 0; cellY < kAwbStatsSizeY * cellsPerZoneY_; cellY++) {
-		for (unsigned int cellX = 0; cellX < kAwbStatsSizeX * cellsPerZoneX_; cellX++) {
-			uint32_t cellPosition = cellY * stride_ + cellX;
-			uint32_t zoneX = cellX / cellsPerZoneX_;
-			uint32_t zoneY = cellY / cellsPerZoneY_;
-
-			uint32_t awbZonePosition = zoneY * kAwbStatsSizeX + zoneX;
-
-			/* Cast the initial IPU3 structure to simplify the reading */
-			const ipu3_uapi_awb_set_item *currentCell =
-				reinterpret_cast<const ipu3_uapi_awb_set_item *>(
-					&stats->awb_raw_buffer.meta_data[cellPosition]
-				);
-
-			/*
-			 * Use cells which have less than 90%
-			 * saturation as an initial means to include
-			 * otherwise bright cells which are not fully
-			 * saturated.
-			 *
-			 * \todo The 90% saturation rate may require
-			 * further empirical measurements and
-			 * optimisation during camera tuning phases.
-			 */
-			if (currentCell->sat_ratio <= kMinCellsPerZoneRatio) {
-				/* The cell is not saturated, use the current cell */
-				awbStats_[awbZonePosition].counted++;
-				uint32_t greenValue = currentCell->Gr_avg + currentCell->Gb_avg;
-				awbStats_[awbZonePosition].sum.green += greenValue / 2;
-				awbStats_[awbZonePosition].sum.red += currentCell->R_avg;
-				awbStats_[awbZonePosition].sum.blue += currentCell->B_avg;
+	for (unsigned int zoneY = 0; zoneY < kAwbStatsSizeY; zoneY++) {
+		Accumulator *zones = &awbStats_[zoneY * kAwbStatsSizeX];
+
+		for (unsigned int zoneX = 0; zoneX < kAwbStatsSizeX; zoneX++)
+			zones[zoneX] = {};
+
+		for (unsigned int y = 0; y < cellsPerZoneY_; y++) {
+			const ipu3_uapi_awb_set_item *row =
+				&cells[(zoneY * cellsPerZoneY_ + y) * stride_];
+
+			for (unsigned int zoneX = 0; zoneX < kAwbStatsSizeX; zoneX++) {
+				const ipu3_uapi_awb_set_item *cell = &row[zoneX * cellsPerZoneX_];
+				uint32_t counted = 0;
+				uint32_t red = 0;
+				uint32_t green = 0;
+				uint32_t blue = 0;
+
+				for (unsigned int x = 0; x < cellsPerZoneX_; x++) {
+					/*
+					 * Use cells which have less than 90%
+					 * saturation as an initial means to
+					 * include otherwise bright cells which
+					 * are not fully saturated. The cells
+					 * are masked instead of skipped to
+					 * keep the loop free of branches.
+					 *
+					 * \todo The 90% saturation rate may
+					 * require further empirical
+					 * measurements and optimisation during
+					 * camera tuning phases.
+					 */
+					uint32_t valid = cell[x].sat_ratio <= kMinCellsPerZoneRatio;
+
+					counted += valid;
+					green += valid * ((cell[x].Gr_avg + cell[x].Gb_avg) / 2);
+					red += valid * cell[x].R_avg;
+					blue += valid * cell[x].B_avg;
+				}
+
+				zones[zoneX].counted += counted;
+				zones[zoneX].sum.green += green;
+				zones[zoneX].sum.red += red;
+				zones[zoneX].sum.blue += blue;
 			}
 		}
 	}
 }
 
-void Awb::clearAwbStats()
-{
-	for (unsigned int i = 0; i < kAwbStatsSizeX * kAwbStatsSizeY; i++) {
-		awbStats_[i].sum.blue = 0;
-		awbStats_[i].sum.red = 0;
-		awbStats_[i].sum.green = 0;
-		awbStats_[i].counted = 0;
-	}
-}
-
 void Awb::awbGreyWorld()
 {
 	LOG(IPU3Awb, Debug) << "Grey world AWB";
@@ -456,7 +474,6 @@ void Awb::calculateWBGains(const ipu3_uapi_stats_3a *stats)
 {
 	ASSERT(stats->stats_3a_status.awb_en);
 
-	clearAwbStats();
 	generateAwbStats(stats);
 	generateZones();
 
@@ -15,6 +15,7 @@
 #include <libcamera/controls.h>
 #include <libcamera/geometry.h>
 
+#include <libipa/camera_sensor_helper.h>
 #include <libipa/fc_queue.h>
 
 namespace libcamera {
@@ -58,6 +59,7 @@ struct IPAActiveState {
 		double gain;
 		uint32_t constraintMode;
 		uint32_t exposureMode;
+		uint32_t meteringMode;
 	} agc;
 
 	struct {
@@ -90,6 +92,8 @@ struct IPAContext {
 	FCQueue<IPAFrameContext> frameContexts;
 
 	ControlInfoMap::Map ctrlMap;
+
+	const CameraSensorHelper *camHelper;
 };
 
 } /* namespace ipa::ipu3 */
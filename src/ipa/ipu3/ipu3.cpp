@@ -39,6 +39,7 @@
 #include "algorithms/blc.h"
 #include "algorithms/tone_mapping.h"
 #include "libipa/camera_sensor_helper.h"
+#include "libipa/timing.h"
 
 #include "ipa_context.h"
 
@@ -189,7 +190,7 @@ private:
 };
 
 IPAIPU3::IPAIPU3()
-	: context_({ {}, {}, { kMaxFrameContexts }, {} })
+	: context_({ {}, {}, { kMaxFrameContexts }, {}, nullptr })
 {
 }
 
@@ -226,6 +227,7 @@ void IPAIPU3::updateSessionConfiguration(const ControlInfoMap &sensorControls)
 	context_.configuration.agc.maxShutterSpeed = maxExposure * context_.configuration.sensor.lineDuration;
 	context_.configuration.agc.minAnalogueGain = camHelper_->gain(minGain);
 	context_.configuration.agc.maxAnalogueGain = camHelper_->gain(maxGain);
+	camHelper_->setGainCodeLimits(minGain, maxGain);
 }
 
 /**
@@ -311,6 +313,8 @@ int IPAIPU3::init(const IPASettings &settings,
 		return -ENODEV;
 	}
 
+	context_.camHelper = camHelper_.get();
+
 	/* Clean context */
 	context_.configuration = {};
 	context_.configuration.sensor.lineDuration = sensorInfo.minLineLength
@@ -326,7 +330,7 @@ int IPAIPU3::init(const IPASettings &settings,
 		return ret;
 	}
 
-	std::unique_ptr<libcamera::YamlObject> data = YamlParser::parse(file);
+	std::shared_ptr<const libcamera::YamlObject> data = YamlParser::parseCached(file);
 	if (!data)
 		return -EINVAL;
 
@@ -565,8 +569,10 @@ void IPAIPU3::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 
 	IPAFrameContext &frameContext = context_.frameContexts.get(frame);
 
-	for (auto const &algo : algorithms())
+	for (auto const &algo : algorithms()) {
+		ScopedTiming timer(algorithmTiming(algo.get()).prepare);
 		algo->prepare(context_, frame, frameContext, params);
+	}
 
 	paramsBufferReady.emit(frame);
 }
@@ -588,7 +594,7 @@ void IPAIPU3::processStatsBuffer(const uint32_t frame,
 {
 	auto it = buffers_.find(bufferId);
 	if (it == buffers_.end()) {
-		LOG(IPAIPU3, Error) << "Could not find stats buffer!";
+		LOG_RATELIMITED(IPAIPU3, Error) << "Could not find stats buffer!";
 		return;
 	}
 
@@ -604,7 +610,7 @@ void IPAIPU3::processStatsBuffer(const uint32_t frame,
 	ControlList metadata(controls::controls);
 
 	for (auto const &algo : algorithms())
-		algo->process(context_, frame, frameContext, stats, metadata);
+		processAlgorithm(algo.get(), context_, frame, frameContext, stats, metadata);
 
 	setControls(frame);
 
@@ -7,7 +7,9 @@
 
 #include "agc_mean_luminance.h"
 
+#include <algorithm>
 #include <cmath>
+#include <numeric>
 
 #include <libcamera/base/log.h>
 #include <libcamera/control_ids.h>
@@ -44,6 +46,12 @@ static constexpr uint32_t kNumStartupFrames = 10;
  */
 static constexpr double kDefaultRelativeLuminanceTarget = 0.16;
 
+/*
+ * Maximum initial gain for a frame whose zones are all black, matching the
+ * largest step a single iteration of the gain estimation used to take.
+ */
+static constexpr double kMaxInitialGain = 10.0;
+
 /**
  * \struct AgcMeanLuminance::AgcConstraint
  * \brief The boundaries and target for an AeConstraintMode constraint
@@ -94,10 +102,11 @@ static constexpr double kDefaultRelativeLuminanceTarget = 0.16;
  * which itself is discovered from tuning data. The algorithm is a two-stage
  * process.
  *
- * In the first stage, an initial gain value is derived by iteratively comparing
- * the gain-adjusted mean luminance across the entire image against a target,
- * and selecting a value which pushes it as closely as possible towards the
- * target.
+ * In the first stage, an initial gain value is derived by comparing the
+ * gain-adjusted mean luminance of the image against a target, and selecting
+ * the value which drives it to the target. The mean luminance is computed from
+ * per-zone statistics weighted according to the AeMeteringMode, and the gain
+ * is solved for analytically, taking saturation of the zones into account.
  *
  * In the second stage we calculate the gain required to drive the average of a
  * section of a histogram to a target value, where the target and the boundaries
@@ -118,15 +127,16 @@ static constexpr double kDefaultRelativeLuminanceTarget = 0.16;
  * In order to be able to use this algorithm an IPA module needs to be able to
  * do the following:
  *
- * 1. Provide a luminance estimation across an entire image.
+ * 1. Provide per-zone mean values across an entire image, for one or more
+ *    channels whose weighted sum gives the luminance.
  * 2. Provide a luminance Histogram for the image to use in calculating
  *    constraint compliance. The precision of the Histogram that is available
  *    will determine the supportable precision of the constraints.
  *
  * IPA modules that want to use this class to implement their AEGC algorithm
- * should derive it and provide an overriding estimateLuminance() function for
- * this class to use. They must call parseTuningData() in init(), and must also
- * call setLimits() and resetFrameCounter() in configure(). They may then use
+ * should derive it. They must call parseTuningData() in init(), and must also
+ * call setLimits(), setZoneGrid() and resetFrameCounter() in configure(). They
+ * may then fill the zones() with the statistics of each frame and use
  * calculateNewEv() in process(). If the limits passed to setLimits() change for
  * any reason (for example, in response to a FrameDurationLimit control being
  * passed in queueRequest()) then setLimits() must be called again with the new
@@ -134,7 +144,8 @@ static constexpr double kDefaultRelativeLuminanceTarget = 0.16;
  */
 
 AgcMeanLuminance::AgcMeanLuminance()
-	: frameCount_(0), filteredExposure_(0s), relativeLuminanceTarget_(0)
+	: frameCount_(0), filteredExposure_(0s), relativeLuminanceTarget_(0),
+	  defaultMeteringMode_(0), numZones_(0)
 {
 }
 
@@ -302,12 +313,86 @@ int AgcMeanLuminance::parseExposureModes(const YamlObject &tuningData)
 	return 0;
 }
 
+int AgcMeanLuminance::parseMeteringModes(const YamlObject &tuningData)
+{
+	std::vector<ControlValue> availableMeteringModes;
+
+	const YamlObject &yamlMeteringModes = tuningData[controls::AeMeteringMode.name()];
+	if (yamlMeteringModes.isDictionary()) {
+		for (const auto &[modeName, modeDict] : yamlMeteringModes.asDict()) {
+			if (AeMeteringModeNameValueMap.find(modeName) ==
+			    AeMeteringModeNameValueMap.end()) {
+				LOG(AgcMeanLuminance, Warning)
+					<< "Skipping unknown metering mode '" << modeName << "'";
+				continue;
+			}
+
+			if (!modeDict.isDictionary()) {
+				LOG(AgcMeanLuminance, Error)
+					<< "Invalid metering mode '" << modeName << "'";
+				return -EINVAL;
+			}
+
+			std::optional<Size> size = modeDict["size"].get<Size>();
+			std::vector<double> weights =
+				modeDict["weights"].getList<double>().value_or(std::vector<double>{});
+
+			if (!size || size->isNull() || weights.size() != size->width * size->height) {
+				LOG(AgcMeanLuminance, Error)
+					<< "Invalid weights for metering mode '"
+					<< modeName << "'";
+				return -EINVAL;
+			}
+
+			if (std::accumulate(weights.begin(), weights.end(), 0.0) <= 0.0) {
+				LOG(AgcMeanLuminance, Error)
+					<< "Weights of metering mode '" << modeName
+					<< "' sum to zero";
+				return -EINVAL;
+			}
+
+			int32_t id = AeMeteringModeNameValueMap.at(modeName);
+			meteringModes_[id] = { *size, std::move(weights) };
+			availableMeteringModes.push_back(id);
+		}
+	}
+
+	/*
+	 * If the tuning data doesn't specify metering modes, provide the
+	 * centre-weighted, spot and matrix modes with weights computed from the
+	 * zone positions when the zone grid is set. An empty set of weights
+	 * selects the built-in weights.
+	 */
+	if (meteringModes_.empty()) {
+		for (int32_t id : { controls::MeteringCentreWeighted,
+				    controls::MeteringSpot,
+				    controls::MeteringMatrix }) {
+			meteringModes_[id] = {};
+			availableMeteringModes.push_back(id);
+		}
+	}
+
+	/*
+	 * Default to matrix metering when available, as it matches the
+	 * behaviour of the algorithm before metering modes were supported.
+	 */
+	defaultMeteringMode_ = meteringModes_.count(controls::MeteringMatrix)
+			     ? controls::MeteringMatrix
+			     : meteringModes_.begin()->first;
+
+	controls_[&controls::AeMeteringMode] =
+		ControlInfo(availableMeteringModes, ControlValue(defaultMeteringMode_));
+
+	return 0;
+}
+
 /**
- * \brief Parse tuning data for AeConstraintMode and AeExposureMode controls
+ * \brief Parse tuning data for AeConstraintMode, AeExposureMode and
+ * AeMeteringMode controls
  * \param[in] tuningData the YamlObject representing the tuning data
  *
  * This function parses tuning data to build the list of allowed values for the
- * AeConstraintMode and AeExposureMode controls. Those tuning data must provide
+ * AeConstraintMode, AeExposureMode and AeMeteringMode controls. Those tuning data must provide
  * the data in a specific format; the Agc algorithm's tuning data should contain
  * a dictionary called AeConstraintMode containing per-mode setting dictionaries
  * with the key being a value from \ref controls::AeConstraintModeNameValueMap.
@@ -354,6 +439,31 @@ int AgcMeanLuminance::parseExposureModes(const YamlObject &tuningData)
  *
  * \endcode
  *
+ * For the AeMeteringMode control the data should contain a dictionary called
+ * AeMeteringMode containing per-mode setting dictionaries with the key being a
+ * value from \ref controls::AeMeteringModeNameValueMap. Each mode dict should
+ * contain the size of a grid of weights with the key "size", and the weights
+ * in row-major order with the key "weights". The grid doesn't need to match
+ * the zones of the statistics, it is resampled to the zone grid passed to
+ * setZoneGrid(). For example:
+ *
+ * \code{.unparsed}
+ * algorithms:
+ *   - Agc:
+ *       AeMeteringMode:
+ *         MeteringCentreWeighted:
+ *           size: [ 3, 3 ]
+ *           weights: [ 1, 1, 1, 1, 4, 1, 1, 1, 1 ]
+ *         MeteringMatrix:
+ *           size: [ 1, 1 ]
+ *           weights: [ 1 ]
+ *
+ * \endcode
+ *
+ * If no metering mode is specified, centre-weighted, spot and matrix metering
+ * modes are provided with built-in weights, and matrix metering is the
+ * default.
+ *
  * \return 0 on success or a negative error code
  */
 int AgcMeanLuminance::parseTuningData(const YamlObject &tuningData)
@@ -366,7 +476,11 @@ int AgcMeanLuminance::parseTuningData(const YamlObject &tuningData)
 	if (ret)
 		return ret;
 
-	return parseExposureModes(tuningData);
+	ret = parseExposureModes(tuningData);
+	if (ret)
+		return ret;
+
+	return parseMeteringModes(tuningData);
 }
 
 /**
@@ -388,65 +502,262 @@ void AgcMeanLuminance::setLimits(utils::Duration minShutter,
 }
 
 /**
- * \fn AgcMeanLuminance::constraintModes()
- * \brief Get the constraint modes that have been parsed from tuning data
+ * \brief Set the ExposureModeHelper quantization for this class
+ * \param[in] lineDuration The sensor line duration
+ * \param[in] sensorHelper The camera sensor helper
+ *
+ * This function calls \ref ExposureModeHelper::setQuantization() for each
+ * ExposureModeHelper that has been created for this class.
  */
+void AgcMeanLuminance::setQuantization(utils::Duration lineDuration,
+				       const CameraSensorHelper *sensorHelper)
+{
+	for (auto &[id, helper] : exposureModeHelpers_)
+		helper->setQuantization(lineDuration, sensorHelper);
+}
 
 /**
- * \fn AgcMeanLuminance::exposureModeHelpers()
- * \brief Get the ExposureModeHelpers that have been parsed from tuning data
+ * \brief Set the grid of zones of the luminance statistics
+ * \param[in] grid The number of zones horizontally and vertically
+ * \param[in] channels The number of statistics channels per zone
+ *
+ * This function sizes the zones() arrays, resets the channel weights to an
+ * equal share of the luminance, and computes the weights of each zone for all
+ * the metering modes. It must be called in configure(), and again whenever the
+ * layout of the statistics changes.
  */
+void AgcMeanLuminance::setZoneGrid(const Size &grid, unsigned int channels)
+{
+	zoneGrid_ = grid;
+	numZones_ = grid.width * grid.height;
+	zones_.assign(numZones_ * channels, 0.0);
+	channelWeights_.assign(channels, 1.0 / channels);
+	breakpoints_.reserve(numZones_ * channels);
+
+	zoneWeights_.clear();
+
+	for (const auto &[id, mode] : meteringModes_) {
+		std::vector<double> &weights = zoneWeights_[id];
+		weights.resize(numZones_);
+
+		for (unsigned int y = 0; y < grid.height; y++) {
+			for (unsigned int x = 0; x < grid.width; x++) {
+				double &weight = weights[y * grid.width + x];
+
+				if (!mode.weights.empty()) {
+					/* Sample the tuning grid at the zone centre. */
+					unsigned int tx = (2 * x + 1) * mode.size.width / (2 * grid.width);
+					unsigned int ty = (2 * y + 1) * mode.size.height / (2 * grid.height);
+					weight = mode.weights[ty * mode.size.width + tx];
+					continue;
+				}
+
+				/* Zone centre, normalised to [-1, 1]. */
+				double cx = (2.0 * x + 1) / grid.width - 1.0;
+				double cy = (2.0 * y + 1) / grid.height - 1.0;
+				double r = std::sqrt(cx * cx + cy * cy);
+
+				switch (id) {
+				case controls::MeteringCentreWeighted:
+					weight = 1.0 + 3.0 * std::max(0.0, 1.0 - r);
+					break;
+				case controls::MeteringSpot:
+					weight = r <= 0.25 ? 1.0 : 0.0;
+					break;
+				default:
+					weight = 1.0;
+					break;
+				}
+			}
+		}
+
+		/*
+		 * Spot metering may not cover any zone on coarse grids, use the
+		 * zones closest to the centre in that case.
+		 */
+		if (std::all_of(weights.begin(), weights.end(),
+				[](double w) { return w == 0.0; })) {
+			weights[(grid.height - 1) / 2 * grid.width + (grid.width - 1) / 2] = 1.0;
+			weights[grid.height / 2 * grid.width + grid.width / 2] = 1.0;
+		}
+
+		/* Normalise the weights to sum to 1. */
+		double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+		for (double &w : weights)
+			w /= sum;
+	}
+}
 
 /**
- * \fn AgcMeanLuminance::controls()
- * \brief Get the controls that have been generated after parsing tuning data
+ * \brief Set the contribution of a statistics channel to the luminance
+ * \param[in] channel The channel index
+ * \param[in] weight The weight of the channel
+ *
+ * The luminance of a zone is the sum of its channel values multiplied by the
+ * channel weights. Derived classes with multiple channels, such as red, green
+ * and blue means, call this function for every frame to account, for
+ * instance, for the Rec. 601 luminance coefficients and white balance gains.
+ */
+void AgcMeanLuminance::setChannelWeight(unsigned int channel, double weight)
+{
+	channelWeights_[channel] = weight;
+}
+
+/**
+ * \fn AgcMeanLuminance::zones()
+ * \brief Retrieve the zone values for a statistics channel
+ * \param[in] channel The channel index
+ *
+ * The values are stored contiguously for each channel, in row-major order of
+ * the zone grid set with setZoneGrid(). Derived classes fill them with the
+ * mean of the channel in each zone, normalised to the [0.0, 1.0] range, before
+ * calling calculateNewEv().
+ *
+ * \return The zone values of the channel
+ */
+
+/**
+ * \fn AgcMeanLuminance::meteringModeSupported()
+ * \brief Check if a metering mode is supported
+ * \param[in] meteringModeIndex The index of the metering mode
+ *
+ * Derived classes shall call this function to validate the AeMeteringMode
+ * control values before using them.
+ *
+ * \return True if the metering mode has been parsed from the tuning data or
+ * is a built-in default mode, false otherwise
+ */
+
+/**
+ * \brief Retrieve the zone weights of a metering mode
+ * \param[in] meteringModeIndex The index of the metering mode
+ *
+ * Unsupported metering modes fall back to the default metering mode.
+ *
+ * \return The zone weights of the metering mode
  */
+const std::vector<double> &
+AgcMeanLuminance::meteringWeights(uint32_t meteringModeIndex) const
+{
+	auto it = zoneWeights_.find(meteringModeIndex);
+	if (it == zoneWeights_.end())
+		it = zoneWeights_.find(defaultMeteringMode_);
+
+	return it->second;
+}
 
 /**
- * \fn AgcMeanLuminance::estimateLuminance(const double gain)
  * \brief Estimate the luminance of an image, adjusted by a given gain
+ * \param[in] meteringModeIndex The index of the metering mode
  * \param[in] gain The gain with which to adjust the luminance estimate
  *
  * This function estimates the average relative luminance of the frame that
- * would be output by the sensor if an additional \a gain was applied. It is a
- * pure virtual function because estimation of luminance is a hardware-specific
- * operation, which depends wholly on the format of the stats that are delivered
- * to libcamera from the ISP. Derived classes must override this function with
- * one that calculates the normalised mean luminance value across the entire
- * image.
+ * would be output by the sensor if an additional \a gain was applied, by
+ * multiplying the zone values by the gain, saturating them to 1.0 to
+ * approximate the sensor behaviour at high brightness values, and averaging
+ * them with the weights of the metering mode. Unsupported metering modes fall
+ * back to the default metering mode.
  *
  * \return The normalised relative luminance of the image
  */
+double AgcMeanLuminance::estimateLuminance(uint32_t meteringModeIndex,
+					   double gain) const
+{
+	const std::vector<double> &weights = meteringWeights(meteringModeIndex);
+	double luminance = 0.0;
+
+	for (unsigned int c = 0; c < channelWeights_.size(); c++) {
+		const double *values = zones_.data() + c * numZones_;
+		double sum = 0.0;
+
+		for (unsigned int i = 0; i < numZones_; i++)
+			sum += weights[i] * std::min(values[i] * gain, 1.0);
+
+		luminance += channelWeights_[c] * sum;
+	}
+
+	return luminance;
+}
+
+/**
+ * \fn AgcMeanLuminance::constraintModes()
+ * \brief Get the constraint modes that have been parsed from tuning data
+ */
+
+/**
+ * \fn AgcMeanLuminance::exposureModeHelpers()
+ * \brief Get the ExposureModeHelpers that have been parsed from tuning data
+ */
+
+/**
+ * \fn AgcMeanLuminance::controls()
+ * \brief Get the controls that have been generated after parsing tuning data
+ */
 
 /**
  * \brief Estimate the initial gain needed to achieve a relative luminance
  * target
+ * \param[in] meteringModeIndex The index of the metering mode
+ *
+ * The gain-adjusted luminance is a piecewise linear function of the gain, as
+ * every zone value contributes linearly until it saturates. Solve for the
+ * target directly by walking the saturation points of the zones in increasing
+ * gain order, instead of iterating over luminance estimations.
+ *
  * \return The calculated initial gain
  */
-double AgcMeanLuminance::estimateInitialGain() const
+double AgcMeanLuminance::estimateInitialGain(uint32_t meteringModeIndex)
 {
+	const std::vector<double> &weights = meteringWeights(meteringModeIndex);
 	double yTarget = relativeLuminanceTarget_;
-	double yGain = 1.0;
 
 	/*
-	* To account for non-linearity caused by saturation, the value needs to
-	* be estimated in an iterative process, as multiplying by a gain will
-	* not increase the relative luminance by the same factor if some image
-	* regions are saturated.
-	*/
-	for (unsigned int i = 0; i < 8; i++) {
-		double yValue = estimateLuminance(yGain);
-		double extra_gain = std::min(10.0, yTarget / (yValue + .001));
-
-		yGain *= extra_gain;
-		LOG(AgcMeanLuminance, Debug) << "Y value: " << yValue
-				<< ", Y target: " << yTarget
-				<< ", gives gain " << yGain;
-
-		if (utils::abs_diff(extra_gain, 1.0) < 0.01)
+	 * Collect the gain at which each zone saturates and its contribution to
+	 * the luminance when saturated, and accumulate the slope of the
+	 * luminance with respect to the gain with no zone saturated.
+	 */
+	breakpoints_.clear();
+	double slope = 0.0;
+
+	for (unsigned int c = 0; c < channelWeights_.size(); c++) {
+		const double *values = zones_.data() + c * numZones_;
+
+		for (unsigned int i = 0; i < numZones_; i++) {
+			double weight = channelWeights_[c] * weights[i];
+			if (values[i] <= 0.0 || weight <= 0.0)
+				continue;
+
+			breakpoints_.push_back({ 1.0 / values[i], weight });
+			slope += weight * values[i];
+		}
+	}
+
+	if (slope <= 0.0) {
+		LOG(AgcMeanLuminance, Debug)
+			<< "Black frame, using gain " << kMaxInitialGain;
+		return kMaxInitialGain;
+	}
+
+	std::sort(breakpoints_.begin(), breakpoints_.end());
+
+	double saturated = 0.0;
+	double yGain = breakpoints_.back().first;
+
+	for (const auto &[gain, weight] : breakpoints_) {
+		double candidate = (yTarget - saturated) / slope;
+		if (candidate <= gain) {
+			yGain = candidate;
 			break;
+		}
+
+		slope -= weight / gain;
+		saturated += weight;
 	}
 
+	LOG(AgcMeanLuminance, Debug)
+		<< "Y value: " << estimateLuminance(meteringModeIndex, 1.0)
+		<< ", Y target: " << yTarget << ", gives gain " << yGain;
+
 	return yGain;
 }
 
@@ -516,6 +827,7 @@ utils::Duration AgcMeanLuminance::filterExposure(utils::Duration exposureValue)
  * \brief Calculate the new exposure value and splut it between shutter time and gain
  * \param[in] constraintModeIndex The index of the current constraint mode
  * \param[in] exposureModeIndex The index of the current exposure mode
+ * \param[in] meteringModeIndex The index of the current metering mode
  * \param[in] yHist A Histogram from the ISP statistics to use in constraining
  * the calculated gain
  * \param[in] effectiveExposureValue The EV applied to the frame from which the
@@ -530,6 +842,7 @@ utils::Duration AgcMeanLuminance::filterExposure(utils::Duration exposureValue)
 std::tuple<utils::Duration, double, double>
 AgcMeanLuminance::calculateNewEv(uint32_t constraintModeIndex,
 				 uint32_t exposureModeIndex,
+				 uint32_t meteringModeIndex,
 				 const Histogram &yHist,
 				 utils::Duration effectiveExposureValue)
 {
@@ -540,7 +853,7 @@ AgcMeanLuminance::calculateNewEv(uint32_t constraintModeIndex,
 	std::shared_ptr<ExposureModeHelper> exposureModeHelper =
 		exposureModeHelpers_.at(exposureModeIndex);
 
-	double gain = estimateInitialGain();
+	double gain = estimateInitialGain(meteringModeIndex);
 	gain = constraintClampGain(constraintModeIndex, yHist, gain);
 
 	/*
@@ -12,7 +12,10 @@
 #include <tuple>
 #include <vector>
 
+#include <libcamera/base/span.h>
+
 #include <libcamera/controls.h>
+#include <libcamera/geometry.h>
 
 #include "libcamera/internal/yaml_parser.h"
 
@@ -44,6 +47,8 @@ public:
 
 	void setLimits(utils::Duration minShutter, utils::Duration maxShutter,
 		       double minGain, double maxGain);
+	void setQuantization(utils::Duration lineDuration,
+			     const CameraSensorHelper *sensorHelper);
 
 	std::map<int32_t, std::vector<AgcConstraint>> constraintModes()
 	{
@@ -55,6 +60,21 @@ public:
 		return exposureModeHelpers_;
 	}
 
+	bool meteringModeSupported(int32_t meteringModeIndex) const
+	{
+		return meteringModes_.count(meteringModeIndex);
+	}
+
+	void setZoneGrid(const Size &grid, unsigned int channels = 1);
+	void setChannelWeight(unsigned int channel, double weight);
+
+	Span<double> zones(unsigned int channel)
+	{
+		return { zones_.data() + channel * numZones_, numZones_ };
+	}
+
+	double estimateLuminance(uint32_t meteringModeIndex, double gain) const;
+
 	ControlInfoMap::Map controls()
 	{
 		return controls_;
@@ -62,7 +82,8 @@ public:
 
 	std::tuple<utils::Duration, double, double>
 	calculateNewEv(uint32_t constraintModeIndex, uint32_t exposureModeIndex,
-		       const Histogram &yHist, utils::Duration effectiveExposureValue);
+		       uint32_t meteringModeIndex, const Histogram &yHist,
+		       utils::Duration effectiveExposureValue);
 
 	void resetFrameCount()
 	{
@@ -70,13 +91,18 @@ public:
 	}
 
 private:
-	virtual double estimateLuminance(const double gain) const = 0;
+	struct MeteringWeights {
+		Size size;
+		std::vector<double> weights;
+	};
 
 	void parseRelativeLuminanceTarget(const YamlObject &tuningData);
 	void parseConstraint(const YamlObject &modeDict, int32_t id);
 	int parseConstraintModes(const YamlObject &tuningData);
 	int parseExposureModes(const YamlObject &tuningData);
-	double estimateInitialGain() const;
+	int parseMeteringModes(const YamlObject &tuningData);
+	const std::vector<double> &meteringWeights(uint32_t meteringModeIndex) const;
+	double estimateInitialGain(uint32_t meteringModeIndex);
 	double constraintClampGain(uint32_t constraintModeIndex,
 				   const Histogram &hist,
 				   double gain);
@@ -88,7 +114,16 @@ private:
 
 	std::map<int32_t, std::vector<AgcConstraint>> constraintModes_;
 	std::map<int32_t, std::shared_ptr<ExposureModeHelper>> exposureModeHelpers_;
+	std::map<int32_t, MeteringWeights> meteringModes_;
+	int32_t defaultMeteringMode_;
 	ControlInfoMap::Map controls_;
+
+	Size zoneGrid_;
+	unsigned int numZones_;
+	std::vector<double> zones_;
+	std::vector<double> channelWeights_;
+	std::map<int32_t, std::vector<double>> zoneWeights_;
+	std::vector<std::pair<double, double>> breakpoints_;
 };
 
 } /* namespace ipa */
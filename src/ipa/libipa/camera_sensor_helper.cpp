@@ -7,6 +7,7 @@
  */
 #include "camera_sensor_helper.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include <libcamera/base/log.h>
@@ -111,6 +112,161 @@ double CameraSensorHelper::gain(uint32_t gainCode) const
 	}
 }
 
+/**
+ * \brief Set the range of analogue gain codes supported by the sensor
+ * \param[in] minGainCode The minimum gain code
+ * \param[in] maxGainCode The maximum gain code
+ *
+ * This function shall be called when the sensor is configured, with the limits
+ * of the V4L2 analogue gain control for the sensor mode. It precomputes the
+ * gains achievable by the sensor in that range, to speed up quantizeGain().
+ * Ranges that are too large to be tabulated are handled by computing the gain
+ * models on every call.
+ */
+void CameraSensorHelper::setGainCodeLimits(uint32_t minGainCode, uint32_t maxGainCode)
+{
+	static constexpr uint32_t kMaxGainTableSize = 4096;
+
+	gainTable_.clear();
+
+	if (maxGainCode < minGainCode ||
+	    maxGainCode - minGainCode >= kMaxGainTableSize) {
+		LOG(CameraSensorHelper, Debug)
+			<< "Not tabulating gain codes ["
+			<< minGainCode << ", " << maxGainCode << "]";
+		return;
+	}
+
+	gainTable_.reserve(maxGainCode - minGainCode + 1);
+	for (uint32_t code = minGainCode; code <= maxGainCode; code++)
+		gainTable_.emplace_back(gain(code), code);
+
+	std::sort(gainTable_.begin(), gainTable_.end());
+}
+
+/**
+ * \brief Quantize an analogue gain to a gain achievable by the sensor
+ * \param[in] gain The analogue gain
+ * \param[out] gainCode The gain code corresponding to the quantized gain
+ *
+ * This function rounds \a gain down to the largest gain that the sensor can
+ * apply, or up to the smallest achievable gain if \a gain is lower. The
+ * difference with the requested gain can then be compensated by digital gain.
+ * The gain code for the quantized gain is returned through \a gainCode if not
+ * null.
+ *
+ * The achievable gains are looked up in the table computed by
+ * setGainCodeLimits(), or computed from the gain model when no table is
+ * available.
+ *
+ * \return The quantized analogue gain
+ */
+double CameraSensorHelper::quantizeGain(double gain, uint32_t *gainCode) const
+{
+	if (gainTable_.empty()) {
+		uint32_t code = this->gainCode(gain);
+		if (gainCode)
+			*gainCode = code;
+		return this->gain(code);
+	}
+
+	auto it = std::upper_bound(gainTable_.begin(), gainTable_.end(), gain,
+				   [](double value, const auto &entry) {
+					   return value < entry.first;
+				   });
+	if (it != gainTable_.begin())
+		--it;
+
+	if (gainCode)
+		*gainCode = it->second;
+	return it->first;
+}
+
+/**
+ * \struct CameraSensorHelper::EmbeddedControls
+ * \brief Sensor controls applied to a frame, as reported in embedded data
+ *
+ * \var CameraSensorHelper::EmbeddedControls::exposure
+ * \brief The exposure time, in lines
+ *
+ * \var CameraSensorHelper::EmbeddedControls::gainCode
+ * \brief The analogue gain code
+ */
+
+/**
+ * \fn CameraSensorHelper::hasEmbeddedData()
+ * \brief Check if the helper can parse the sensor embedded data
+ *
+ * Sensors that output embedded data in the SMIA format report the exposure and
+ * gain used for each frame. When the pipeline handler captures the embedded
+ * data, IPAs should use them instead of predicting the values applied to the
+ * frame from the sensor control delays.
+ *
+ * \return True if parseEmbeddedData() is supported, false otherwise
+ */
+
+/**
+ * \brief Configure the format of the embedded data
+ * \param[in] bitsPerPixel The number of bits per pixel of the embedded data
+ * \param[in] lineLength The line length in bytes, or 0 if unknown
+ *
+ * This function shall be called when the sensor is configured, before parsing
+ * embedded data with parseEmbeddedData().
+ */
+void CameraSensorHelper::configureEmbeddedData(unsigned int bitsPerPixel,
+					       unsigned int lineLength)
+{
+	if (!embeddedDataParser_)
+		return;
+
+	embeddedDataParser_->setBitsPerPixel(bitsPerPixel);
+	embeddedDataParser_->setLineLength(lineLength);
+}
+
+/**
+ * \brief Retrieve the exposure and gain of a frame from its embedded data
+ * \param[in] buffer The embedded data of the frame
+ * \return The sensor controls applied to the frame, or std::nullopt if the
+ * helper doesn't support embedded data or parsing failed
+ */
+std::optional<CameraSensorHelper::EmbeddedControls>
+CameraSensorHelper::parseEmbeddedData(Span<const uint8_t> buffer)
+{
+	if (!embeddedDataParser_)
+		return std::nullopt;
+
+	if (embeddedDataParser_->parse(buffer) != SmiaEmbeddedDataParser::Status::Ok)
+		return std::nullopt;
+
+	auto read = [&](const std::vector<uint32_t> &regs) {
+		uint32_t value = 0;
+		for (uint32_t reg : regs)
+			value = (value << 8) | *embeddedDataParser_->value(reg);
+		return value;
+	};
+
+	return EmbeddedControls{ read(exposureRegs_), read(gainRegs_) };
+}
+
+/**
+ * \brief Set the registers reported in the sensor embedded data
+ * \param[in] exposureRegs The exposure registers, most significant byte first
+ * \param[in] gainRegs The analogue gain registers, most significant byte first
+ *
+ * Sensor-specific subclasses that support SMIA embedded data shall call this
+ * function in their constructor to enable parseEmbeddedData().
+ */
+void CameraSensorHelper::setEmbeddedDataRegisters(std::initializer_list<uint32_t> exposureRegs,
+						  std::initializer_list<uint32_t> gainRegs)
+{
+	exposureRegs_ = exposureRegs;
+	gainRegs_ = gainRegs;
+
+	std::vector<uint32_t> registers = exposureRegs_;
+	registers.insert(registers.end(), gainRegs_.begin(), gainRegs_.end());
+	embeddedDataParser_ = std::make_unique<SmiaEmbeddedDataParser>(registers);
+}
+
 /**
  * \enum CameraSensorHelper::AnalogueGainType
  * \brief The gain calculation modes as defined by the MIPI CCS
@@ -398,6 +554,7 @@ public:
 	{
 		gainType_ = AnalogueGainLinear;
 		gainConstants_.linear = { 0, 256, -1, 256 };
+		setEmbeddedDataRegisters({ 0x015a, 0x015b }, { 0x0157 });
 	}
 };
 REGISTER_CAMERA_SENSOR_HELPER("imx219", CameraSensorHelperImx219)
@@ -480,6 +637,7 @@ public:
 	{
 		gainType_ = AnalogueGainLinear;
 		gainConstants_.linear = { 0, 1024, -1, 1024 };
+		setEmbeddedDataRegisters({ 0x0202, 0x0203 }, { 0x0204, 0x0205 });
 	}
 };
 REGISTER_CAMERA_SENSOR_HELPER("imx477", CameraSensorHelperImx477)
@@ -9,11 +9,17 @@
 
 #include <stdint.h>
 
+#include <initializer_list>
 #include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/span.h>
+
+#include "embedded_data.h"
 
 namespace libcamera {
 
@@ -28,6 +34,18 @@ public:
 	virtual uint32_t gainCode(double gain) const;
 	virtual double gain(uint32_t gainCode) const;
 
+	void setGainCodeLimits(uint32_t minGainCode, uint32_t maxGainCode);
+	double quantizeGain(double gain, uint32_t *gainCode = nullptr) const;
+
+	struct EmbeddedControls {
+		uint32_t exposure;
+		uint32_t gainCode;
+	};
+
+	bool hasEmbeddedData() const { return !!embeddedDataParser_; }
+	void configureEmbeddedData(unsigned int bitsPerPixel, unsigned int lineLength);
+	std::optional<EmbeddedControls> parseEmbeddedData(Span<const uint8_t> buffer);
+
 protected:
 	enum AnalogueGainType {
 		AnalogueGainLinear,
@@ -54,8 +72,19 @@ protected:
 	AnalogueGainType gainType_;
 	AnalogueGainConstants gainConstants_;
 
+	void setEmbeddedDataRegisters(std::initializer_list<uint32_t> exposureRegs,
+				      std::initializer_list<uint32_t> gainRegs);
+
 private:
 	LIBCAMERA_DISABLE_COPY_AND_MOVE(CameraSensorHelper)
+
+	/* Achievable gains and their codes, sorted by increasing gain. */
+	std::vector<std::pair<double, uint32_t>> gainTable_;
+
+	/* Registers holding the exposure and gain code, most significant first */
+	std::vector<uint32_t> exposureRegs_;
+	std::vector<uint32_t> gainRegs_;
+	std::unique_ptr<SmiaEmbeddedDataParser> embeddedDataParser_;
 };
 
 class CameraSensorHelperFactoryBase
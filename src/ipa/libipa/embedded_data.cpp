@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2019-2021, Raspberry Pi Ltd
+ *
+ * SMIA specification based embedded data parser
+ */
+
+#include "embedded_data.h"
+
+#include <algorithm>
+
+#include <libcamera/base/log.h>
+
+/**
+ * \file embedded_data.h
+ * \brief Sensor embedded data parsing
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(EmbeddedData)
+
+namespace ipa {
+
+namespace {
+
+/*
+ * Embedded data tag bytes, from the Sony IMX219 datasheet but general to all
+ * SMIA sensors.
+ */
+constexpr unsigned int LineStart = 0x0a;
+constexpr unsigned int LineEndTag = 0x07;
+constexpr unsigned int RegHiBits = 0xaa;
+constexpr unsigned int RegLowBits = 0xa5;
+constexpr unsigned int RegValue = 0x5a;
+constexpr unsigned int RegSkip = 0x55;
+
+} /* namespace */
+
+/**
+ * \class SmiaEmbeddedDataParser
+ * \brief Parser for embedded data lines in the SMIA (and MIPI CCS) format
+ *
+ * Many sensors can output, alongside the image, embedded data lines that
+ * contain the values of a set of registers used to capture the frame. Parsing
+ * them gives the exposure time and gain actually applied to each frame,
+ * instead of relying on the delays expected from the sensor controls.
+ *
+ * The SMIA embedded data format encodes registers as a sequence of tags and
+ * data bytes, interleaved with dummy bytes that depend on the bits per pixel
+ * of the data lines. The parser is constructed with the list of registers to
+ * look for. The first parse() call searches the data for all the registers
+ * and records their offsets, subsequent calls read the values directly from
+ * the same offsets as long as the layout of the data is unchanged.
+ *
+ * Before parsing, the number of bits per pixel shall be set with
+ * setBitsPerPixel(). The number of lines and the line length are optional:
+ * if the number of lines is unknown, the size of the buffer is used as a
+ * limit instead, and if the line length is unknown the parser hunts for the
+ * start of the next line. Whenever the format of the embedded data changes,
+ * reset() shall be called before parsing again.
+ */
+
+/**
+ * \enum SmiaEmbeddedDataParser::Status
+ * \brief Status of a parse() operation
+ * \var SmiaEmbeddedDataParser::Status::Ok
+ * \brief All the registers have been found
+ * \var SmiaEmbeddedDataParser::Status::NotFound
+ * \brief Some of the registers are missing from the data
+ * \var SmiaEmbeddedDataParser::Status::Error
+ * \brief The data doesn't match the SMIA embedded data format
+ */
+
+/**
+ * \brief Construct a parser for the given \a registers
+ * \param[in] registers The addresses of the registers to look for
+ */
+SmiaEmbeddedDataParser::SmiaEmbeddedDataParser(Span<const uint32_t> registers)
+	: reset_(true), bitsPerPixel_(0), numLines_(0), lineLength_(0),
+	  registers_(registers.begin(), registers.end()), valid_(false)
+{
+	std::sort(registers_.begin(), registers_.end());
+	registers_.erase(std::unique(registers_.begin(), registers_.end()),
+			 registers_.end());
+	offsets_.resize(registers_.size());
+	values_.resize(registers_.size());
+}
+
+/**
+ * \fn SmiaEmbeddedDataParser::reset()
+ * \brief Search again for the registers on the next call to parse()
+ */
+
+/**
+ * \brief Set the number of bits per pixel of the embedded data lines
+ * \param[in] bitsPerPixel The number of bits per pixel
+ */
+void SmiaEmbeddedDataParser::setBitsPerPixel(unsigned int bitsPerPixel)
+{
+	bitsPerPixel_ = bitsPerPixel;
+	reset_ = true;
+}
+
+/**
+ * \brief Set the number of embedded data lines
+ * \param[in] numLines The number of lines, or 0 if unknown
+ */
+void SmiaEmbeddedDataParser::setNumLines(unsigned int numLines)
+{
+	numLines_ = numLines;
+	reset_ = true;
+}
+
+/**
+ * \brief Set the length of the embedded data lines
+ * \param[in] lineLength The line length in bytes, or 0 if unknown
+ */
+void SmiaEmbeddedDataParser::setLineLength(unsigned int lineLength)
+{
+	lineLength_ = lineLength;
+	reset_ = true;
+}
+
+/**
+ * \brief Parse the embedded data in \a buffer
+ * \param[in] buffer The embedded data
+ *
+ * The register values are retrieved with value() after a successful parse.
+ *
+ * \return Status::Ok if all the registers have been found, Status::NotFound if
+ * some of them are missing, or Status::Error if the data is invalid
+ */
+SmiaEmbeddedDataParser::Status SmiaEmbeddedDataParser::parse(Span<const uint8_t> buffer)
+{
+	/*
+	 * The offsets learnt from the first frame are used to read the values
+	 * directly. If the buffer doesn't match them anymore, search again
+	 * through the data for all the registers requested.
+	 */
+	if (!reset_ && readRegs(buffer))
+		return Status::Ok;
+
+	valid_ = false;
+
+	if (!bitsPerPixel_ || registers_.empty()) {
+		LOG(EmbeddedData, Error) << "Parser not configured";
+		return Status::Error;
+	}
+
+	std::fill(offsets_.begin(), offsets_.end(), Offset{});
+	addresses_.clear();
+
+	/*
+	 * > 0 means "worked partially but parse again next time",
+	 * < 0 means "hard error".
+	 *
+	 * In either case, we retry parsing on the next frame.
+	 */
+	ParseStatus ret = findRegs(buffer);
+	if (ret != ParseOk) {
+		reset_ = true;
+		return ret > 0 ? Status::NotFound : Status::Error;
+	}
+
+	reset_ = false;
+
+	if (!readRegs(buffer)) {
+		reset_ = true;
+		return Status::NotFound;
+	}
+
+	return Status::Ok;
+}
+
+/**
+ * \brief Retrieve the value of a register found by the last parse() call
+ * \param[in] reg The register address
+ * \return The register value, or std::nullopt if the register wasn't found
+ */
+std::optional<uint32_t> SmiaEmbeddedDataParser::value(uint32_t reg) const
+{
+	if (!valid_)
+		return std::nullopt;
+
+	auto it = std::lower_bound(registers_.begin(), registers_.end(), reg);
+	if (it == registers_.end() || *it != reg)
+		return std::nullopt;
+
+	return values_[it - registers_.begin()];
+}
+
+/*
+ * Read the register values at the offsets found by findRegs(). The layout of
+ * the buffer is checked first: the register addresses found by findRegs()
+ * must be unchanged, and each value must still be preceded by a register
+ * value tag. As every tag increments the register address, this is enough for
+ * the registers to be at the same offsets.
+ */
+bool SmiaEmbeddedDataParser::readRegs(Span<const uint8_t> buffer)
+{
+	valid_ = false;
+
+	if (buffer.empty() || buffer[0] != LineStart)
+		return false;
+
+	for (const auto &[offset, value] : addresses_) {
+		if (offset >= buffer.size() || buffer[offset] != value)
+			return false;
+	}
+
+	for (unsigned int i = 0; i < registers_.size(); i++) {
+		const Offset &offset = offsets_[i];
+
+		if (!offset.value || offset.value >= buffer.size() ||
+		    buffer[offset.tag] != RegValue)
+			return false;
+
+		values_[i] = buffer[offset.value];
+	}
+
+	valid_ = true;
+	return true;
+}
+
+/*
+ * Go through the embedded data to find the offsets (not values!), in the data
+ * block, where the values of the registers can subsequently be found.
+ */
+SmiaEmbeddedDataParser::ParseStatus
+SmiaEmbeddedDataParser::findRegs(Span<const uint8_t> buffer)
+{
+	if (buffer.empty() || buffer[0] != LineStart)
+		return NoLineStart;
+
+	unsigned int currentOffset = 1; /* after the LineStart */
+	unsigned int currentLineStart = 0, currentLine = 0;
+	unsigned int regNum = 0, regsDone = 0;
+
+	while (1) {
+		if (currentOffset >= buffer.size())
+			return MissingRegs;
+
+		unsigned int tagOffset = currentOffset;
+		unsigned int tag = buffer[currentOffset++];
+
+		/* Non-dummy bytes come in even-sized blocks: skip can only ever follow tag */
+		while ((bitsPerPixel_ == 10 &&
+			(currentOffset + 1 - currentLineStart) % 5 == 0) ||
+		       (bitsPerPixel_ == 12 &&
+			(currentOffset + 1 - currentLineStart) % 3 == 0) ||
+		       (bitsPerPixel_ == 14 &&
+			(currentOffset - currentLineStart) % 7 >= 4)) {
+			if (currentOffset >= buffer.size())
+				return MissingRegs;
+			if (buffer[currentOffset++] != RegSkip)
+				return BadDummy;
+		}
+
+		if (currentOffset >= buffer.size())
+			return MissingRegs;
+
+		unsigned int dataByte = buffer[currentOffset++];
+
+		if (tag == LineEndTag) {
+			if (dataByte != LineEndTag)
+				return BadLineEnd;
+
+			if (numLines_ && ++currentLine == numLines_)
+				return MissingRegs;
+
+			if (lineLength_) {
+				currentOffset = currentLineStart + lineLength_;
+
+				/* Require the whole line to be in the buffer. */
+				if (currentOffset + lineLength_ > buffer.size())
+					return MissingRegs;
+
+				if (buffer[currentOffset] != LineStart)
+					return NoLineStart;
+			} else {
+				/* Allow a zero line length to mean "hunt for the next line". */
+				while (currentOffset < buffer.size() &&
+				       buffer[currentOffset] != LineStart)
+					currentOffset++;
+
+				if (currentOffset == buffer.size())
+					return NoLineStart;
+			}
+
+			/* Increment currentOffset to after the LineStart. */
+			currentLineStart = currentOffset++;
+		} else {
+			if (tag == RegHiBits || tag == RegLowBits)
+				addresses_.emplace_back(currentOffset - 1, dataByte);
+
+			if (tag == RegHiBits)
+				regNum = (regNum & 0xff) | (dataByte << 8);
+			else if (tag == RegLowBits)
+				regNum = (regNum & 0xff00) | dataByte;
+			else if (tag == RegSkip)
+				regNum++;
+			else if (tag == RegValue) {
+				auto reg = std::lower_bound(registers_.begin(),
+							    registers_.end(), regNum);
+
+				if (reg != registers_.end() && *reg == regNum) {
+					Offset &offset = offsets_[reg - registers_.begin()];
+					offset.tag = tagOffset;
+					offset.value = currentOffset - 1;
+
+					if (++regsDone == registers_.size())
+						return ParseOk;
+				}
+				regNum++;
+			} else
+				return IllegalTag;
+		}
+	}
+}
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2019-2021, Raspberry Pi Ltd
+ *
+ * SMIA specification based embedded data parser
+ */
+
+#pragma once
+
+#include <optional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/span.h>
+
+namespace libcamera {
+
+namespace ipa {
+
+class SmiaEmbeddedDataParser
+{
+public:
+	enum class Status {
+		Ok,
+		NotFound,
+		Error,
+	};
+
+	SmiaEmbeddedDataParser(Span<const uint32_t> registers);
+
+	void reset() { reset_ = true; }
+	void setBitsPerPixel(unsigned int bitsPerPixel);
+	void setNumLines(unsigned int numLines);
+	void setLineLength(unsigned int lineLength);
+
+	Status parse(Span<const uint8_t> buffer);
+	std::optional<uint32_t> value(uint32_t reg) const;
+
+private:
+	/*
+	 * Offsets in the buffer of the tag and value bytes of a register, with
+	 * a zero value offset when the register hasn't been found.
+	 */
+	struct Offset {
+		uint32_t tag;
+		uint32_t value;
+	};
+
+	/*
+	 * Error codes > 0 are regarded as non-fatal, codes < 0 indicate a bad
+	 * data buffer.
+	 */
+	enum ParseStatus {
+		ParseOk = 0,
+		MissingRegs = 1,
+		NoLineStart = -1,
+		IllegalTag = -2,
+		BadDummy = -3,
+		BadLineEnd = -4,
+		BadPadding = -5,
+	};
+
+	ParseStatus findRegs(Span<const uint8_t> buffer);
+	bool readRegs(Span<const uint8_t> buffer);
+
+	bool reset_;
+	unsigned int bitsPerPixel_;
+	unsigned int numLines_;
+	unsigned int lineLength_;
+
+	/* Sorted register addresses, their offsets and values at the same index */
+	std::vector<uint32_t> registers_;
+	std::vector<Offset> offsets_;
+	std::vector<uint32_t> values_;
+	/* Offsets and values of the register address bytes before the last register */
+	std::vector<std::pair<uint32_t, uint8_t>> addresses_;
+	bool valid_;
+};
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
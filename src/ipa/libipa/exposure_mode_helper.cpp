@@ -7,9 +7,12 @@
 #include "exposure_mode_helper.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include <libcamera/base/log.h>
 
+#include "camera_sensor_helper.h"
+
 /**
  * \file exposure_mode_helper.h
  * \brief Helper class that performs computations relating to exposure
@@ -75,6 +78,8 @@ ExposureModeHelper::ExposureModeHelper(const Span<std::pair<utils::Duration, dou
 	maxShutter_ = 0us;
 	minGain_ = 0;
 	maxGain_ = 0;
+	lineDuration_ = 0us;
+	sensorHelper_ = nullptr;
 
 	for (const auto &[s, g] : stages) {
 		shutters_.push_back(s);
@@ -108,6 +113,29 @@ void ExposureModeHelper::setLimits(utils::Duration minShutter,
 	maxGain_ = maxGain;
 }
 
+/**
+ * \brief Quantize the split exposure to values achievable by the sensor
+ * \param[in] lineDuration The sensor line duration
+ * \param[in] sensorHelper The camera sensor helper
+ *
+ * By default the shutter time and analogue gain computed by splitExposure() are
+ * continuous values, which the sensor then rounds to a whole number of lines
+ * and to an achievable gain code. The difference is only accounted for on the
+ * next frame, when the exposure applied by the sensor is known.
+ *
+ * This function makes splitExposure() round the shutter time down to a whole
+ * number of lines of \a lineDuration and the analogue gain down to a gain
+ * achievable by the sensor, as computed by the \a sensorHelper, and compensate
+ * for the difference with digital gain. Either parameter can be set to zero or
+ * null to skip the corresponding quantization.
+ */
+void ExposureModeHelper::setQuantization(utils::Duration lineDuration,
+					 const CameraSensorHelper *sensorHelper)
+{
+	lineDuration_ = lineDuration;
+	sensorHelper_ = sensorHelper;
+}
+
 utils::Duration ExposureModeHelper::clampShutter(utils::Duration shutter) const
 {
 	return std::clamp(shutter, minShutter_, maxShutter_);
@@ -118,6 +146,21 @@ double ExposureModeHelper::clampGain(double gain) const
 	return std::clamp(gain, minGain_, maxGain_);
 }
 
+std::tuple<utils::Duration, double, double>
+ExposureModeHelper::quantize(utils::Duration exposure, utils::Duration shutter,
+			     double gain) const
+{
+	if (lineDuration_) {
+		double lines = std::floor(shutter / lineDuration_);
+		shutter = std::max<utils::Duration>(lineDuration_ * lines, minShutter_);
+	}
+
+	if (sensorHelper_)
+		gain = sensorHelper_->quantizeGain(gain);
+
+	return { shutter, gain, exposure / (shutter * gain) };
+}
+
 /**
  * \brief Split exposure time into shutter time and gain
  * \param[in] exposure Exposure time
@@ -186,14 +229,14 @@ ExposureModeHelper::splitExposure(utils::Duration exposure) const
 			shutter = clampShutter(exposure / clampGain(lastStageGain));
 			gain = clampGain(exposure / shutter);
 
-			return { shutter, gain, exposure / (shutter * gain) };
+			return quantize(exposure, shutter, gain);
 		}
 
 		if (stageShutter * stageGain >= exposure) {
 			shutter = clampShutter(exposure / clampGain(stageGain));
 			gain = clampGain(exposure / shutter);
 
-			return { shutter, gain, exposure / (shutter * gain) };
+			return quantize(exposure, shutter, gain);
 		}
 	}
 
@@ -210,7 +253,7 @@ ExposureModeHelper::splitExposure(utils::Duration exposure) const
 	shutter = clampShutter(exposure / clampGain(stageGain));
 	gain = clampGain(exposure / shutter);
 
-	return { shutter, gain, exposure / (shutter * gain) };
+	return quantize(exposure, shutter, gain);
 }
 
 /**
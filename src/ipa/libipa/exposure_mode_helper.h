@@ -18,6 +18,8 @@ namespace libcamera {
 
 namespace ipa {
 
+class CameraSensorHelper;
+
 class ExposureModeHelper
 {
 public:
@@ -26,6 +28,8 @@ public:
 
 	void setLimits(utils::Duration minShutter, utils::Duration maxShutter,
 		       double minGain, double maxGain);
+	void setQuantization(utils::Duration lineDuration,
+			     const CameraSensorHelper *sensorHelper);
 
 	std::tuple<utils::Duration, double, double>
 	splitExposure(utils::Duration exposure) const;
@@ -38,6 +42,9 @@ public:
 private:
 	utils::Duration clampShutter(utils::Duration shutter) const;
 	double clampGain(double gain) const;
+	std::tuple<utils::Duration, double, double>
+	quantize(utils::Duration exposure, utils::Duration shutter,
+		 double gain) const;
 
 	std::vector<utils::Duration> shutters_;
 	std::vector<double> gains_;
@@ -46,6 +53,9 @@ private:
 	utils::Duration maxShutter_;
 	double minGain_;
 	double maxGain_;
+
+	utils::Duration lineDuration_;
+	const CameraSensorHelper *sensorHelper_;
 };
 
 } /* namespace ipa */
@@ -20,6 +20,85 @@ namespace ipa {
  * \brief Queue of per-frame contexts
  */
 
+/**
+ * \class FrameArena
+ * \brief Per-frame memory arena
+ *
+ * Algorithms that need variable-size data for a frame, such as tables or
+ * histograms, can carve it from the arena associated with each frame context
+ * instead of allocating it separately. The memory remains valid until the
+ * frame context slot is recycled for a new frame, at which point the arena is
+ * reset in constant time.
+ *
+ * The arena grows to accommodate the largest amount of memory used by a frame.
+ * Allocations that don't fit in the arena's buffer are served from separate
+ * blocks, which are coalesced into a larger buffer when the arena is reset. In
+ * steady state the arena thus doesn't allocate any memory.
+ *
+ * Only trivially destructible types can be allocated from the arena, as the
+ * objects are never destroyed.
+ */
+
+/**
+ * \brief Construct an empty FrameArena
+ */
+FrameArena::FrameArena()
+	: size_(0), used_(0), overflowSize_(0)
+{
+}
+
+/**
+ * \fn FrameArena::alloc(size_t count)
+ * \brief Allocate an array from the arena
+ * \tparam T The type of the array elements
+ * \param[in] count The number of elements
+ *
+ * The elements are value-initialized. The memory is valid until the arena is
+ * reset.
+ *
+ * \return A span covering the allocated array
+ */
+
+/**
+ * \brief Release all the memory allocated from the arena
+ *
+ * Allocations made since the previous reset are released in constant time. If
+ * the arena's buffer overflowed, it is reallocated to fit all the memory that
+ * has been used, so that the next frames don't overflow.
+ */
+void FrameArena::reset()
+{
+	if (!overflow_.empty()) {
+		size_ += overflowSize_;
+		buffer_ = std::make_unique<uint8_t[]>(size_);
+		overflow_.clear();
+		overflowSize_ = 0;
+	}
+
+	used_ = 0;
+}
+
+/**
+ * \fn FrameArena::capacity()
+ * \brief Retrieve the size of the arena's buffer
+ * \return The size of the arena's buffer in bytes
+ */
+
+void *FrameArena::allocate(size_t size, size_t align)
+{
+	ASSERT(align <= alignof(max_align_t));
+
+	size_t offset = (used_ + align - 1) & ~(align - 1);
+	if (buffer_ && offset + size <= size_) {
+		used_ = offset + size;
+		return buffer_.get() + offset;
+	}
+
+	/* Account for the padding the allocation will need after the reset. */
+	overflowSize_ += size + align - 1;
+	return overflow_.emplace_back(std::make_unique<uint8_t[]>(size)).get();
+}
+
 /**
  * \struct FrameContext
  * \brief Context for a frame
@@ -36,6 +115,18 @@ namespace ipa {
  *
  * \var FrameContext::frame
  * \brief The frame number
+ *
+ * \var FrameContext::arena_
+ * \brief The memory arena for the frame
+ */
+
+/**
+ * \fn FrameContext::arena()
+ * \brief Retrieve the memory arena for the frame
+ *
+ * The arena is reset when the frame context is initialised for a new frame.
+ *
+ * \return The memory arena associated with the frame context
  */
 
 /**
@@ -87,6 +178,9 @@ namespace ipa {
  * IPA module-specific frame context implementations shall inherit from the
  * FrameContext base class to support the minimum required features for a
  * FrameContext.
+ *
+ * Each entry is associated with a FrameArena, reset when the entry is
+ * initialised, from which algorithms can allocate variable-size per-frame data.
  */
 
 /**
@@ -7,10 +7,15 @@
 
 #pragma once
 
+#include <memory>
+#include <stddef.h>
 #include <stdint.h>
+#include <type_traits>
 #include <vector>
 
+#include <libcamera/base/class.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/span.h>
 
 namespace libcamera {
 
@@ -21,10 +26,46 @@ namespace ipa {
 template<typename FrameContext>
 class FCQueue;
 
+class FrameArena
+{
+public:
+	FrameArena();
+
+	template<typename T>
+	Span<T> alloc(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>,
+			      "Frame arena objects are never destroyed");
+
+		T *data = static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+		std::uninitialized_value_construct_n(data, count);
+		return { data, count };
+	}
+
+	void reset();
+
+	size_t capacity() const { return size_; }
+
+private:
+	LIBCAMERA_DISABLE_COPY(FrameArena)
+
+	void *allocate(size_t size, size_t align);
+
+	std::unique_ptr<uint8_t[]> buffer_;
+	size_t size_;
+	size_t used_;
+
+	std::vector<std::unique_ptr<uint8_t[]>> overflow_;
+	size_t overflowSize_;
+};
+
 struct FrameContext {
+	FrameArena &arena() { return *arena_; }
+
 private:
 	template<typename T> friend class FCQueue;
 	uint32_t frame;
+	FrameArena *arena_;
 };
 
 template<typename FrameContext>
@@ -32,7 +73,7 @@ class FCQueue
 {
 public:
 	FCQueue(unsigned int size)
-		: contexts_(size)
+		: contexts_(size), arenas_(size)
 	{
 	}
 
@@ -44,7 +85,8 @@ public:
 
 	FrameContext &alloc(const uint32_t frame)
 	{
-		FrameContext &frameContext = contexts_[frame % contexts_.size()];
+		unsigned int index = frame % contexts_.size();
+		FrameContext &frameContext = contexts_[index];
 
 		/*
 		 * Do not re-initialise if a get() call has already fetched this
@@ -61,14 +103,15 @@ public:
 			LOG(FCQueue, Warning)
 				<< "Frame " << frame << " already initialised";
 		else
-			init(frameContext, frame);
+			init(index, frame);
 
 		return frameContext;
 	}
 
 	FrameContext &get(uint32_t frame)
 	{
-		FrameContext &frameContext = contexts_[frame % contexts_.size()];
+		unsigned int index = frame % contexts_.size();
+		FrameContext &frameContext = contexts_[index];
 
 		/*
 		 * If the IPA algorithms try to access a frame context slot which
@@ -98,19 +141,24 @@ public:
 		LOG(FCQueue, Warning)
 			<< "Obtained an uninitialised FrameContext for " << frame;
 
-		init(frameContext, frame);
+		init(index, frame);
 
 		return frameContext;
 	}
 
 private:
-	void init(FrameContext &frameContext, const uint32_t frame)
+	void init(unsigned int index, const uint32_t frame)
 	{
+		FrameContext &frameContext = contexts_[index];
+
 		frameContext = {};
 		frameContext.frame = frame;
+		frameContext.arena_ = &arenas_[index];
+		arenas_[index].reset();
 	}
 
 	std::vector<FrameContext> contexts_;
+	std::vector<FrameArena> arenas_;
 };
 
 } /* namespace ipa */
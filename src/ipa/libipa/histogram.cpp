@@ -6,6 +6,7 @@
  */
 #include "histogram.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include <libcamera/base/log.h>
@@ -26,6 +27,11 @@ namespace ipa {
  * This class stores a cumulative frequency histogram, which is a mapping that
  * counts the cumulative number of observations in all of the bins up to the
  * specified bin. It can be used to find quantiles and averages between quantiles.
+ *
+ * The cumulative frequencies weighted by the bin index are stored alongside,
+ * so that means between two points of the histogram are computed in constant
+ * time. Histograms computed every frame should be updated with reset(), which
+ * reuses the storage of the previous data.
  */
 
 /**
@@ -43,10 +49,7 @@ namespace ipa {
  */
 Histogram::Histogram(Span<const uint32_t> data)
 {
-	cumulative_.resize(data.size() + 1);
-	cumulative_[0] = 0;
-	for (const auto &[i, value] : utils::enumerate(data))
-		cumulative_[i + 1] = cumulative_[i] + value;
+	reset(data);
 }
 
 /**
@@ -56,6 +59,28 @@ Histogram::Histogram(Span<const uint32_t> data)
  * \param[in] transform The transformation function to apply to every bin
  */
 
+/**
+ * \brief Replace the histogram data
+ * \param[in] data A (non-cumulative) histogram
+ *
+ * The storage is reused when the number of bins doesn't change, making this
+ * function allocation-free in that case.
+ */
+void Histogram::reset(Span<const uint32_t> data)
+{
+	reset(data, [](uint32_t value) { return value; });
+}
+
+/**
+ * \fn Histogram::reset(Span<const uint32_t> data, Transform transform)
+ * \brief Replace the histogram data
+ * \param[in] data A (non-cumulative) histogram
+ * \param[in] transform The transformation function to apply to every bin
+ *
+ * The storage is reused when the number of bins doesn't change, making this
+ * function allocation-free in that case.
+ */
+
 /**
  * \fn Histogram::bins()
  * \brief Retrieve the number of bins currently used by the Histogram
@@ -124,10 +149,64 @@ double Histogram::quantile(double q, uint32_t first, uint32_t last) const
 	if (cumulative_[first + 1] == cumulative_[first])
 		frac = 0;
 	else
-		frac = (item - cumulative_[first]) / (cumulative_[first + 1] - cumulative_[first]);
+		frac = static_cast<double>(item - cumulative_[first]) /
+		       (cumulative_[first + 1] - cumulative_[first]);
 	return first + frac;
 }
 
+/**
+ * \brief Calculate the mean between two (fractional) bins
+ * \param[in] binLo The low bin
+ * \param[in] binHi The high bin
+ *
+ * The pixels are spread evenly throughout the bins in which they lie, as for
+ * cumulativeFrequency(). The mean is computed in constant time from the
+ * weighted cumulative frequencies.
+ *
+ * \return The mean histogram bin value between the two bins, or \a binHi if
+ * there are no pixels between the two bins
+ */
+double Histogram::interBinMean(double binLo, double binHi) const
+{
+	ASSERT(binHi >= binLo);
+
+	binLo = std::clamp(binLo, 0.0, static_cast<double>(bins()));
+	binHi = std::clamp(binHi, 0.0, static_cast<double>(bins()));
+
+	auto frequency = [&](unsigned int bin) -> double {
+		return cumulative_[bin + 1] - cumulative_[bin];
+	};
+
+	unsigned int lo = binLo;
+	unsigned int hi = binHi;
+	double sumBinFreq, cumulFreq;
+
+	if (lo == hi) {
+		/* Both points lie in the same bin. */
+		cumulFreq = lo < bins() ? frequency(lo) * (binHi - binLo) : 0;
+		sumBinFreq = lo * cumulFreq;
+	} else {
+		/* The partial low bin, the full bins and the partial high bin. */
+		double loFreq = frequency(lo) * (lo + 1 - binLo);
+		cumulFreq = loFreq + (cumulative_[hi] - cumulative_[lo + 1]);
+		sumBinFreq = lo * loFreq + (weighted_[hi] - weighted_[lo + 1]);
+
+		if (hi < bins()) {
+			double hiFreq = frequency(hi) * (binHi - hi);
+			cumulFreq += hiFreq;
+			sumBinFreq += hi * hiFreq;
+		}
+	}
+
+	if (cumulFreq == 0) {
+		/* interval had zero width or contained no weight? */
+		return binHi;
+	}
+
+	/* add 0.5 to give an average for bin mid-points */
+	return sumBinFreq / cumulFreq + 0.5;
+}
+
 /**
  * \brief Calculate the mean between two quantiles
  * \param[in] lowQuantile low Quantile
@@ -141,27 +220,13 @@ double Histogram::quantile(double q, uint32_t first, uint32_t last) const
  */
 double Histogram::interQuantileMean(double lowQuantile, double highQuantile) const
 {
-	ASSERT(highQuantile > lowQuantile);
+	ASSERT(highQuantile >= lowQuantile);
 	/* Proportion of pixels which lies below lowQuantile */
 	double lowPoint = quantile(lowQuantile);
 	/* Proportion of pixels which lies below highQuantile */
 	double highPoint = quantile(highQuantile, static_cast<uint32_t>(lowPoint));
-	double sumBinFreq = 0, cumulFreq = 0;
-
-	for (double p_next = floor(lowPoint) + 1.0;
-	     p_next <= ceil(highPoint);
-	     lowPoint = p_next, p_next += 1.0) {
-		int bin = floor(lowPoint);
-		double freq = (cumulative_[bin + 1] - cumulative_[bin])
-			* (std::min(p_next, highPoint) - lowPoint);
-
-		/* Accumulate weighted bin */
-		sumBinFreq += bin * freq;
-		/* Accumulate weights */
-		cumulFreq += freq;
-	}
-	/* add 0.5 to give an average for bin mid-points */
-	return sumBinFreq / cumulFreq + 0.5;
+
+	return interBinMean(lowPoint, highPoint);
 }
 
 } /* namespace ipa */
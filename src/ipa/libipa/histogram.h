@@ -23,27 +23,52 @@ namespace ipa {
 class Histogram
 {
 public:
-	Histogram() { cumulative_.push_back(0); }
+	Histogram() : cumulative_({ 0 }), weighted_({ 0 }) {}
 	Histogram(Span<const uint32_t> data);
 
 	template<typename Transform,
 		 std::enable_if_t<std::is_invocable_v<Transform, uint32_t>> * = nullptr>
 	Histogram(Span<const uint32_t> data, Transform transform)
 	{
+		reset(data, transform);
+	}
+
+	void reset(Span<const uint32_t> data);
+
+	template<typename Transform,
+		 std::enable_if_t<std::is_invocable_v<Transform, uint32_t>> * = nullptr>
+	void reset(Span<const uint32_t> data, Transform transform)
+	{
+		/* Resizing doesn't reallocate when the number of bins is unchanged. */
 		cumulative_.resize(data.size() + 1);
-		cumulative_[0] = 0;
-		for (const auto &[i, value] : utils::enumerate(data))
-			cumulative_[i + 1] = cumulative_[i] + transform(value);
+		weighted_.resize(data.size() + 1);
+
+		uint64_t *cumulative = cumulative_.data();
+		uint64_t *weighted = weighted_.data();
+		uint64_t sum = 0, weightedSum = 0;
+
+		cumulative[0] = 0;
+		weighted[0] = 0;
+		for (size_t i = 0; i < data.size(); i++) {
+			uint64_t value = transform(data[i]);
+			sum += value;
+			weightedSum += i * value;
+			cumulative[i + 1] = sum;
+			weighted[i + 1] = weightedSum;
+		}
 	}
 
 	size_t bins() const { return cumulative_.size() - 1; }
 	uint64_t total() const { return cumulative_[cumulative_.size() - 1]; }
 	uint64_t cumulativeFrequency(double bin) const;
 	double quantile(double q, uint32_t first = 0, uint32_t last = UINT_MAX) const;
+	double interBinMean(double binLo, double binHi) const;
 	double interQuantileMean(double lowQuantile, double hiQuantile) const;
 
 private:
 	std::vector<uint64_t> cumulative_;
+	/* Cumulative sums of the bin frequencies weighted by the bin index. */
+	std::vector<uint64_t> weighted_;
 };
 
 } /* namespace ipa */
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * Matrix and related operations
+ */
+
+#include "matrix.h"
+
+#include <libcamera/base/log.h>
+
+/**
+ * \file matrix.h
+ * \brief Matrix class
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Matrix)
+
+namespace ipa {
+
+/**
+ * \class Matrix
+ * \brief Matrix class
+ * \tparam T Type of numerical values to be stored in the matrix
+ * \tparam Rows Number of rows in the matrix
+ * \tparam Cols Number of columns in the matrix
+ *
+ * The matrix elements are stored in row-major order. All the arithmetic
+ * operations are constexpr, allowing constant matrices such as colour space
+ * conversion matrices to be computed at compile time.
+ */
+
+/**
+ * \fn Matrix::Matrix()
+ * \brief Construct a zero matrix
+ */
+
+/**
+ * \fn Matrix::Matrix(const std::array<T, Rows * Cols> &data)
+ * \brief Construct a matrix from supplied data
+ * \param[in] data Data from which to construct a matrix, in row-major order
+ */
+
+/**
+ * \fn Matrix::identity()
+ * \brief Construct an identity matrix
+ * \return The identity matrix
+ */
+
+/**
+ * \fn Matrix::readYaml
+ * \brief Populate the matrix with yaml data
+ * \param yaml Yaml data to populate the matrix with
+ *
+ * Any existing data in the matrix will be overwritten. The yaml data is
+ * expected to be a list of Rows * Cols elements of type T, in row-major order.
+ *
+ * \return 0 on success, negative error code otherwise
+ */
+
+/**
+ * \fn Span<const T, Cols> Matrix::operator[](size_t i) const
+ * \brief Index to a row in the matrix
+ * \param[in] i Index of row to retrieve
+ *
+ * This operator, together with the Span operator[], allows accessing the
+ * elements of the matrix as m[row][col].
+ *
+ * \return Row \a i from the matrix, as a Span
+ */
+
+/**
+ * \fn Span<T, Cols> Matrix::operator[](size_t i)
+ * \copydoc Matrix::operator[](size_t i) const
+ */
+
+/**
+ * \fn Matrix::at()
+ * \brief Retrieve an element of the matrix
+ * \param[in] row The row of the element
+ * \param[in] col The column of the element
+ * \return The element at \a row and \a col
+ */
+
+/**
+ * \fn Matrix::transpose()
+ * \brief Compute the transpose of the matrix
+ * \return The transposed matrix
+ */
+
+/**
+ * \fn Matrix::operator+()
+ * \brief Add two matrices together
+ * \param[in] other The other matrix
+ * \return The sum of the two matrices
+ */
+
+/**
+ * \fn Matrix::operator-()
+ * \brief Subtract one matrix from another
+ * \param[in] other The other matrix
+ * \return The difference of \a other from this matrix
+ */
+
+/**
+ * \fn Matrix::operator*(T factor) const
+ * \brief Multiply the matrix by a scalar
+ * \param[in] factor The factor
+ * \return The matrix multiplied by \a factor
+ */
+
+/**
+ * \fn Matrix::operator*(const Matrix<T, Cols, Cols2> &other) const
+ * \brief Multiply the matrix by another matrix
+ * \tparam Cols2 Number of columns of the other matrix
+ * \param[in] other The other matrix
+ * \return The product of this matrix by \a other
+ */
+
+/**
+ * \fn Matrix::operator*(const Vector<T, Cols> &v) const
+ * \brief Multiply a vector by the matrix
+ * \param[in] v The vector
+ * \return The product of the matrix by \a v
+ */
+
+/**
+ * \fn Matrix<T, Rows, Cols> operator*(T factor, const Matrix<T, Rows, Cols> &m)
+ * \brief Multiply a matrix by a scalar
+ * \param[in] factor The factor
+ * \param[in] m The matrix
+ * \return The matrix \a m multiplied by \a factor
+ */
+
+/**
+ * \fn bool operator==(const Matrix<T, Rows, Cols> &lhs, const Matrix<T, Rows, Cols> &rhs)
+ * \brief Compare matrices for equality
+ * \return True if the two matrices are equal, false otherwise
+ */
+
+/**
+ * \fn bool operator!=(const Matrix<T, Rows, Cols> &lhs, const Matrix<T, Rows, Cols> &rhs)
+ * \brief Compare matrices for inequality
+ * \return True if the two matrices are not equal, false otherwise
+ */
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * Matrix and related operations
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <type_traits>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/span.h>
+
+#include "libcamera/internal/yaml_parser.h"
+
+#include "vector.h"
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Matrix)
+
+namespace ipa {
+
+#ifndef __DOXYGEN__
+template<typename T, unsigned int Rows, unsigned int Cols,
+	 std::enable_if_t<std::is_arithmetic_v<T>> * = nullptr>
+#else
+template<typename T, unsigned int Rows, unsigned int Cols>
+#endif /* __DOXYGEN__ */
+class Matrix
+{
+public:
+	constexpr Matrix()
+		: data_{}
+	{
+	}
+
+	constexpr Matrix(const std::array<T, Rows * Cols> &data)
+		: data_(data)
+	{
+	}
+
+	static constexpr Matrix identity()
+	{
+		Matrix ret;
+		for (unsigned int i = 0; i < std::min(Rows, Cols); i++)
+			ret.data_[i * Cols + i] = static_cast<T>(1);
+		return ret;
+	}
+
+	int readYaml(const libcamera::YamlObject &yaml)
+	{
+		if (yaml.size() != Rows * Cols) {
+			LOG(Matrix, Error)
+				<< "Wrong number of values in matrix: expected "
+				<< Rows * Cols << ", got " << yaml.size();
+			return -EINVAL;
+		}
+
+		unsigned int i = 0;
+		for (const auto &x : yaml.asList()) {
+			auto value = x.get<T>();
+			if (!value) {
+				LOG(Matrix, Error) << "Failed to read matrix value";
+				return -EINVAL;
+			}
+
+			data_[i++] = *value;
+		}
+
+		return 0;
+	}
+
+	Span<const T, Cols> operator[](size_t i) const
+	{
+		ASSERT(i < Rows);
+		return Span<const T, Cols>{ &data_[i * Cols], Cols };
+	}
+
+	Span<T, Cols> operator[](size_t i)
+	{
+		ASSERT(i < Rows);
+		return Span<T, Cols>{ &data_[i * Cols], Cols };
+	}
+
+	constexpr T at(unsigned int row, unsigned int col) const
+	{
+		return data_[row * Cols + col];
+	}
+
+	constexpr Matrix<T, Cols, Rows> transpose() const
+	{
+		std::array<T, Rows * Cols> data{};
+		for (unsigned int i = 0; i < Rows; i++) {
+			for (unsigned int j = 0; j < Cols; j++)
+				data[j * Rows + i] = data_[i * Cols + j];
+		}
+		return Matrix<T, Cols, Rows>(data);
+	}
+
+	constexpr Matrix<T, Rows, Cols> operator+(const Matrix<T, Rows, Cols> &other) const
+	{
+		Matrix<T, Rows, Cols> ret;
+		for (unsigned int i = 0; i < Rows * Cols; i++)
+			ret.data_[i] = data_[i] + other.data_[i];
+		return ret;
+	}
+
+	constexpr Matrix<T, Rows, Cols> operator-(const Matrix<T, Rows, Cols> &other) const
+	{
+		Matrix<T, Rows, Cols> ret;
+		for (unsigned int i = 0; i < Rows * Cols; i++)
+			ret.data_[i] = data_[i] - other.data_[i];
+		return ret;
+	}
+
+	constexpr Matrix<T, Rows, Cols> operator*(T factor) const
+	{
+		Matrix<T, Rows, Cols> ret;
+		for (unsigned int i = 0; i < Rows * Cols; i++)
+			ret.data_[i] = data_[i] * factor;
+		return ret;
+	}
+
+	template<unsigned int Cols2>
+	constexpr Matrix<T, Rows, Cols2> operator*(const Matrix<T, Cols, Cols2> &other) const
+	{
+		/*
+		 * Accumulate the rows of the result as linear combinations of
+		 * the rows of other. The loop bounds are compile-time
+		 * constants and the innermost loop runs over contiguous
+		 * elements, which lets the compiler unroll and vectorize the
+		 * small products used by the colour processing algorithms.
+		 */
+		std::array<T, Rows * Cols2> data{};
+		for (unsigned int i = 0; i < Rows; i++) {
+			for (unsigned int k = 0; k < Cols; k++) {
+				const T a = data_[i * Cols + k];
+				for (unsigned int j = 0; j < Cols2; j++)
+					data[i * Cols2 + j] += a * other.at(k, j);
+			}
+		}
+		return Matrix<T, Rows, Cols2>(data);
+	}
+
+	constexpr Vector<T, Rows> operator*(const Vector<T, Cols> &v) const
+	{
+		std::array<T, Rows> data{};
+		for (unsigned int i = 0; i < Rows; i++) {
+			for (unsigned int j = 0; j < Cols; j++)
+				data[i] += data_[i * Cols + j] * v[j];
+		}
+		return Vector<T, Rows>(data);
+	}
+
+private:
+	std::array<T, Rows * Cols> data_;
+};
+
+template<typename T, unsigned int Rows, unsigned int Cols>
+constexpr Matrix<T, Rows, Cols> operator*(T factor, const Matrix<T, Rows, Cols> &m)
+{
+	return m * factor;
+}
+
+template<typename T, unsigned int Rows, unsigned int Cols>
+bool operator==(const Matrix<T, Rows, Cols> &lhs, const Matrix<T, Rows, Cols> &rhs)
+{
+	for (unsigned int i = 0; i < Rows; i++) {
+		for (unsigned int j = 0; j < Cols; j++) {
+			if (lhs.at(i, j) != rhs.at(i, j))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+template<typename T, unsigned int Rows, unsigned int Cols>
+bool operator!=(const Matrix<T, Rows, Cols> &lhs, const Matrix<T, Rows, Cols> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+} /* namespace ipa */
+
+#ifndef __DOXYGEN__
+template<typename T, unsigned int Rows, unsigned int Cols>
+std::ostream &operator<<(std::ostream &out, const ipa::Matrix<T, Rows, Cols> &m)
+{
+	out << "Matrix { ";
+	for (unsigned int i = 0; i < Rows; i++) {
+		out << "[ ";
+		for (unsigned int j = 0; j < Cols; j++) {
+			out << m.at(i, j);
+			out << ((j + 1 < Cols) ? ", " : " ");
+		}
+		out << ((i + 1 < Rows) ? "], " : "] ");
+	}
+	out << "}";
+
+	return out;
+}
+#endif /* __DOXYGEN__ */
+
+} /* namespace libcamera */
@@ -77,12 +77,66 @@ namespace ipa {
  * \brief The type of the IPA statistics and ISP results
  */
 
+/**
+ * \struct Module::AlgorithmTiming
+ * \brief Execution time statistics of an algorithm
+ *
+ * The statistics are named after the algorithm. The process statistics are
+ * updated by processAlgorithm(), and the prepare statistics are meant to be
+ * updated by the IPA modules with a ScopedTiming instance around the calls to
+ * the algorithm prepare() function.
+ *
+ * \var Module::AlgorithmTiming::prepare
+ * \brief Execution time statistics of the Algorithm::prepare() function
+ *
+ * \var Module::AlgorithmTiming::process
+ * \brief Execution time statistics of the Algorithm::process() function
+ */
+
+/**
+ * \fn Module::AlgorithmTiming::AlgorithmTiming()
+ * \brief Construct the execution time statistics of an algorithm
+ * \param[in] name The algorithm name
+ */
+
 /**
  * \fn Module::algorithms()
  * \brief Retrieve the list of instantiated algorithms
  * \return The list of instantiated algorithms
  */
 
+/**
+ * \fn Module::algorithmTiming()
+ * \brief Retrieve the execution time statistics of an algorithm
+ * \param[in] algo The algorithm, which must have been instantiated by the Module
+ * \return The execution time statistics of \a algo
+ */
+
+/**
+ * \fn Module::processAlgorithm()
+ * \brief Run the process() function of an algorithm at its configured rate
+ * \param[in] algo The algorithm, which must have been instantiated by the Module
+ * \param[in] context The shared IPA context
+ * \param[in] frame The frame context sequence number
+ * \param[in] frameContext The current frame's context
+ * \param[in] stats The IPA statistics and ISP results
+ * \param[out] metadata Metadata for the frame, to be filled by the algorithm
+ *
+ * Algorithms run on every frame by default. The optional "run-period" key in
+ * the algorithm tuning data lowers the rate at which their process() function
+ * is called, to one every run-period frames. This reduces the CPU usage of
+ * slowly converging algorithms, such as AWB or lens shading correction, at
+ * high frame rates.
+ *
+ * On the frames where the algorithm doesn't run, the active state keeps the
+ * results of the last run, and the metadata produced by the last run is
+ * reported again in \a metadata. The prepare() function of the algorithm is
+ * not affected and still runs for every frame.
+ *
+ * IPA modules shall call this function instead of calling Algorithm::process()
+ * directly.
+ */
+
 /**
  * \fn Module::createAlgorithms()
  * \brief Create algorithms from YAML configuration data
@@ -94,6 +148,9 @@ namespace ipa {
  * algorithms. The configuration data is expected to be correct, any error
  * causes the function to fail and return immediately.
  *
+ * In addition to the algorithm-specific keys, the configuration data of each
+ * algorithm may contain a "run-period" key, see processAlgorithm().
+ *
  * \return 0 on success, or a negative error code on failure
  */
 
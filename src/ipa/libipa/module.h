@@ -8,16 +8,25 @@
 #pragma once
 
 #include <list>
+#include <map>
 #include <memory>
+#include <optional>
+#include <stdint.h>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
 
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
 #include "libcamera/internal/yaml_parser.h"
 
 #include "algorithm.h"
+#include "timing.h"
 
 namespace libcamera {
 
@@ -36,6 +45,16 @@ public:
 	using Params = _Params;
 	using Stats = _Stats;
 
+	struct AlgorithmTiming {
+		AlgorithmTiming(const std::string &name)
+			: prepare(name + " prepare"), process(name + " process")
+		{
+		}
+
+		TimingStats prepare;
+		TimingStats process;
+	};
+
 	virtual ~Module() {}
 
 	const std::list<std::unique_ptr<Algorithm<Module>>> &algorithms() const
@@ -43,6 +62,47 @@ public:
 		return algorithms_;
 	}
 
+	AlgorithmTiming &algorithmTiming(const Algorithm<Module> *algo)
+	{
+		return algorithmData_.at(algo).timing;
+	}
+
+	void processAlgorithm(Algorithm<Module> *algo, Context &context,
+			      const uint32_t frame, FrameContext &frameContext,
+			      const Stats *stats, ControlList &metadata)
+	{
+		AlgorithmData &data = algorithmData_.at(algo);
+
+		if (data.runPeriod == 1) {
+			ScopedTiming timer(data.timing.process);
+			algo->process(context, frame, frameContext, stats, metadata);
+			return;
+		}
+
+		/*
+		 * Run the algorithm on the first frame, every runPeriod frames,
+		 * and when the frame numbers restart. On the other frames,
+		 * report the metadata produced by the last run, the active
+		 * state is left untouched and carries the results over to the
+		 * next frames.
+		 */
+		if (data.lastRun && frame >= *data.lastRun &&
+		    frame - *data.lastRun < data.runPeriod) {
+			metadata.merge(data.metadata);
+			return;
+		}
+
+		data.lastRun = frame;
+		data.metadata.clear();
+
+		{
+			ScopedTiming timer(data.timing.process);
+			algo->process(context, frame, frameContext, stats, data.metadata);
+		}
+
+		metadata.merge(data.metadata);
+	}
+
 	int createAlgorithms(Context &context, const YamlObject &algorithms)
 	{
 		const auto &list = algorithms.asList();
@@ -52,12 +112,14 @@ public:
 				LOG(IPAModuleAlgo, Error)
 					<< "Invalid YAML syntax for algorithm " << i;
 				algorithms_.clear();
+				algorithmData_.clear();
 				return -EINVAL;
 			}
 
 			int ret = createAlgorithm(context, algo);
 			if (ret) {
 				algorithms_.clear();
+				algorithmData_.clear();
 				return ret;
 			}
 		}
@@ -71,9 +133,30 @@ public:
 	}
 
 private:
+	struct AlgorithmData {
+		AlgorithmData(const std::string &name, unsigned int period)
+			: timing(name), runPeriod(period),
+			  metadata(controls::controls)
+		{
+		}
+
+		AlgorithmTiming timing;
+		unsigned int runPeriod;
+		std::optional<uint32_t> lastRun;
+		ControlList metadata;
+	};
+
 	int createAlgorithm(Context &context, const YamlObject &data)
 	{
 		const auto &[name, algoData] = *data.asDict().begin();
+
+		unsigned int runPeriod = algoData["run-period"].get<unsigned int>(1);
+		if (!runPeriod) {
+			LOG(IPAModuleAlgo, Error)
+				<< "Invalid run period for algorithm '" << name << "'";
+			return -EINVAL;
+		}
+
 		std::unique_ptr<Algorithm<Module>> algo = createAlgorithm(name);
 		if (!algo) {
 			LOG(IPAModuleAlgo, Error)
@@ -90,7 +173,14 @@ private:
 
 		LOG(IPAModuleAlgo, Debug)
 			<< "Instantiated algorithm '" << name << "'";
-
+		if (runPeriod > 1)
+			LOG(IPAModuleAlgo, Debug)
+				<< "Running algorithm '" << name << "' every "
+				<< runPeriod << " frames";
+
+		algorithmData_.emplace(std::piecewise_construct,
+				       std::forward_as_tuple(algo.get()),
+				       std::forward_as_tuple(name, runPeriod));
 		algorithms_.push_back(std::move(algo));
 		return 0;
 	}
@@ -117,6 +207,7 @@ private:
 	}
 
 	std::list<std::unique_ptr<Algorithm<Module>>> algorithms_;
+	std::map<const Algorithm<Module> *, AlgorithmData> algorithmData_;
 };
 
 } /* namespace ipa */
@@ -236,6 +236,47 @@ double Pwl::eval(double x, int *span, bool updateSpan) const
 		       (points_[index + 1].x() - points_[index].x());
 }
 
+/**
+ * \brief Evaluate the piecewise linear function at multiple positions
+ * \param[in] x The x values to input into the function
+ * \param[out] y The evaluation results
+ *
+ * Evaluate the function at all positions in \a x and store the results in the
+ * corresponding entries of \a y, which must be at least as large as \a x.
+ *
+ * The span found for each position is used as the starting guess for the next
+ * one. When the \a x values are sorted in ascending order, as is typical when
+ * filling a look-up table from a curve, the whole batch is thus evaluated in a
+ * single sweep over the function's points, in O(x.size() + points) time
+ * instead of O(x.size() * points) with individual calls to eval(). Unsorted
+ * values are supported, but don't benefit from this optimization.
+ */
+void Pwl::evalMany(Span<const double> x, Span<double> y) const
+{
+	assert(y.size() >= x.size());
+
+	int span = 0;
+	for (size_t i = 0; i < x.size(); i++)
+		y[i] = eval(x[i], &span);
+}
+
+/**
+ * \brief Sample the piecewise linear function on a uniform grid
+ * \param[in] start The first x value
+ * \param[in] step The distance between consecutive x values
+ * \param[out] y The samples
+ *
+ * Evaluate the function at positions start + i * step for i in [0,
+ * y.size()[, and store the results in \a y. This bakes the function into a
+ * uniformly sampled look-up table in linear time, see evalMany().
+ */
+void Pwl::sample(double start, double step, Span<double> y) const
+{
+	int span = 0;
+	for (size_t i = 0; i < y.size(); i++)
+		y[i] = eval(start + i * step, &span);
+}
+
 int Pwl::findSpan(double x, int span) const
 {
 	/*
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * Execution time statistics for IPA algorithms
+ */
+
+#include "timing.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+#include <libcamera/base/log.h>
+
+/**
+ * \file timing.h
+ * \brief Execution time statistics for IPA algorithms
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(IPATiming)
+
+namespace ipa {
+
+/**
+ * \class TimingStats
+ * \brief Minimum, mean and maximum execution time of an operation
+ *
+ * The TimingStats class accumulates the execution times of an operation, such
+ * as the prepare() or process() function of an algorithm, over a window of
+ * consecutive runs. At the end of every window, the minimum, mean and maximum
+ * execution times are logged to the IPATiming category with the Debug level,
+ * and made available through the min(), mean() and max() functions.
+ *
+ * A time budget can be set through the LIBCAMERA_IPA_TIMING_BUDGET environment
+ * variable, in microseconds. When set, a warning is logged at the end of every
+ * window in which the operation exceeded the budget at least once. This helps
+ * identifying the algorithms responsible for late frames.
+ */
+
+/**
+ * \var TimingStats::kDefaultWindow
+ * \brief The default number of runs the statistics are computed over
+ */
+
+/**
+ * \brief Construct a TimingStats
+ * \param[in] name The name of the operation, used in log messages
+ * \param[in] window The number of runs the statistics are computed over
+ */
+TimingStats::TimingStats(const std::string &name, unsigned int window)
+	: name_(name), window_(std::max(window, 1U)), budget_(budget()),
+	  min_(0), mean_(0), max_(0)
+{
+	reset();
+}
+
+/**
+ * \brief Record the execution time of a run
+ * \param[in] duration The execution time
+ */
+void TimingStats::add(utils::Duration duration)
+{
+	if (!count_ || duration < windowMin_)
+		windowMin_ = duration;
+	if (!count_ || duration > windowMax_)
+		windowMax_ = duration;
+
+	sum_ += duration;
+	if (budget_ && duration > budget_)
+		overBudget_++;
+
+	if (++count_ < window_)
+		return;
+
+	min_ = windowMin_;
+	mean_ = sum_ / count_;
+	max_ = windowMax_;
+
+	LOG(IPATiming, Debug)
+		<< name_ << ": min " << min_.get<std::micro>()
+		<< "us, mean " << mean_.get<std::micro>()
+		<< "us, max " << max_.get<std::micro>() << "us";
+
+	if (overBudget_)
+		LOG(IPATiming, Warning)
+			<< name_ << " exceeded its " << budget_.get<std::micro>()
+			<< "us budget in " << overBudget_ << " of the last "
+			<< count_ << " runs (max " << max_.get<std::micro>()
+			<< "us)";
+
+	reset();
+}
+
+/**
+ * \fn TimingStats::name()
+ * \brief Retrieve the name of the operation
+ * \return The name of the operation
+ */
+
+/**
+ * \fn TimingStats::min()
+ * \brief Retrieve the minimum execution time over the last complete window
+ * \return The minimum execution time, or 0 if no window has completed yet
+ */
+
+/**
+ * \fn TimingStats::mean()
+ * \brief Retrieve the mean execution time over the last complete window
+ * \return The mean execution time, or 0 if no window has completed yet
+ */
+
+/**
+ * \fn TimingStats::max()
+ * \brief Retrieve the maximum execution time over the last complete window
+ * \return The maximum execution time, or 0 if no window has completed yet
+ */
+
+utils::Duration TimingStats::budget()
+{
+	static const utils::Duration budget = []() {
+		const char *env = utils::secure_getenv("LIBCAMERA_IPA_TIMING_BUDGET");
+		if (!env)
+			return utils::Duration(0);
+
+		char *end;
+		unsigned long value = strtoul(env, &end, 10);
+		if (*end != '\0' || !value) {
+			LOG(IPATiming, Warning)
+				<< "Invalid timing budget '" << env << "'";
+			return utils::Duration(0);
+		}
+
+		return utils::Duration(std::chrono::microseconds(value));
+	}();
+
+	return budget;
+}
+
+void TimingStats::reset()
+{
+	count_ = 0;
+	overBudget_ = 0;
+	sum_ = utils::Duration(0);
+}
+
+/**
+ * \class ScopedTiming
+ * \brief Measure the execution time of a scope
+ *
+ * The ScopedTiming class samples the time when it is constructed, and records
+ * the time elapsed until its destruction to a TimingStats instance.
+ */
+
+/**
+ * \fn ScopedTiming::ScopedTiming(TimingStats &stats)
+ * \brief Start measuring the execution time of the current scope
+ * \param[in] stats The statistics to record the execution time to
+ */
+
+/**
+ * \fn ScopedTiming::~ScopedTiming()
+ * \brief Record the execution time of the scope
+ */
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * Execution time statistics for IPA algorithms
+ */
+
+#pragma once
+
+#include <string>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+namespace ipa {
+
+class TimingStats
+{
+public:
+	static constexpr unsigned int kDefaultWindow = 30;
+
+	TimingStats(const std::string &name, unsigned int window = kDefaultWindow);
+
+	void add(utils::Duration duration);
+
+	const std::string &name() const { return name_; }
+	utils::Duration min() const { return min_; }
+	utils::Duration mean() const { return mean_; }
+	utils::Duration max() const { return max_; }
+
+private:
+	static utils::Duration budget();
+
+	void reset();
+
+	std::string name_;
+	unsigned int window_;
+	utils::Duration budget_;
+
+	unsigned int count_;
+	unsigned int overBudget_;
+	utils::Duration sum_;
+	utils::Duration windowMin_;
+	utils::Duration windowMax_;
+
+	utils::Duration min_;
+	utils::Duration mean_;
+	utils::Duration max_;
+};
+
+class ScopedTiming
+{
+public:
+	ScopedTiming(TimingStats &stats)
+		: stats_(stats), start_(utils::clock::now())
+	{
+	}
+
+	~ScopedTiming()
+	{
+		stats_.add(utils::clock::now() - start_);
+	}
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(ScopedTiming)
+
+	TimingStats &stats_;
+	utils::time_point start_;
+};
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
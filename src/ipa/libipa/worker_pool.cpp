@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * Worker pool for asynchronous algorithm execution
+ */
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+/**
+ * \file worker_pool.h
+ * \brief Asynchronous execution of algorithm computations
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(IPAWorkerPool)
+
+namespace ipa {
+
+/**
+ * \class WorkerPool
+ * \brief Pool of threads running algorithm jobs
+ *
+ * Some algorithms need computations that take longer than the time budget of
+ * a frame, such as searching for the white balance colour temperature or
+ * running an autofocus scan. Running them synchronously in the process()
+ * function would delay the parameters buffer for the next frames. The
+ * WorkerPool runs such computations on a set of threads separate from the IPA
+ * thread, in the order they have been submitted.
+ *
+ * Algorithms don't normally use the WorkerPool directly, but through the
+ * AsyncJob class that tracks the completion of a job and stores its result.
+ */
+
+/**
+ * \brief Construct a WorkerPool
+ * \param[in] threads The number of worker threads
+ *
+ * At least one thread is always created.
+ */
+WorkerPool::WorkerPool(unsigned int threads)
+	: stop_(false)
+{
+	threads = std::max(threads, 1U);
+
+	for (unsigned int i = 0; i < threads; ++i)
+		threads_.emplace_back(&WorkerPool::run, this);
+}
+
+/**
+ * \brief Destroy the WorkerPool
+ *
+ * The jobs that have been submitted are all run before the worker threads are
+ * stopped.
+ */
+WorkerPool::~WorkerPool()
+{
+	{
+		std::scoped_lock lock(mutex_);
+		stop_ = true;
+	}
+
+	cv_.notify_all();
+
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+/**
+ * \brief Retrieve the WorkerPool shared by all algorithms
+ *
+ * The shared pool is created the first time this function is called. Its
+ * number of threads defaults to two, or one on single-core systems, and can be
+ * overridden with the LIBCAMERA_IPA_WORKER_THREADS environment variable.
+ *
+ * \return The shared WorkerPool
+ */
+WorkerPool &WorkerPool::instance()
+{
+	static WorkerPool pool([]() {
+		unsigned int threads = std::clamp(std::thread::hardware_concurrency(),
+						  1U, 2U);
+
+		const char *env = utils::secure_getenv("LIBCAMERA_IPA_WORKER_THREADS");
+		if (env) {
+			char *end;
+			unsigned long value = strtoul(env, &end, 10);
+			if (*end == '\0' && value > 0 && value <= 16)
+				threads = value;
+			else
+				LOG(IPAWorkerPool, Warning)
+					<< "Invalid worker threads count '" << env << "'";
+		}
+
+		LOG(IPAWorkerPool, Debug)
+			<< "Creating worker pool with " << threads << " threads";
+
+		return threads;
+	}());
+
+	return pool;
+}
+
+/**
+ * \fn WorkerPool::threads()
+ * \brief Retrieve the number of worker threads
+ * \return The number of worker threads
+ */
+
+/**
+ * \brief Submit a job to the pool
+ * \param[in] job The job function
+ *
+ * The \a job is run on one of the worker threads. Jobs are started in the
+ * order they have been submitted, but may complete in a different order when
+ * the pool has multiple threads.
+ *
+ * This function is thread-safe.
+ */
+void WorkerPool::submit(std::function<void()> job)
+{
+	{
+		std::scoped_lock lock(mutex_);
+		jobs_.push(std::move(job));
+	}
+
+	cv_.notify_one();
+}
+
+void WorkerPool::run()
+{
+	while (true) {
+		std::function<void()> job;
+
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+			if (jobs_.empty())
+				return;
+
+			job = std::move(jobs_.front());
+			jobs_.pop();
+		}
+
+		job();
+	}
+}
+
+/**
+ * \class AsyncJob
+ * \brief Asynchronous computation owned by an algorithm
+ * \tparam T The type of the computation result
+ *
+ * The AsyncJob class runs an algorithm computation on a WorkerPool and stores
+ * its result until the algorithm fetches it. At most one computation is in
+ * flight at a time: an algorithm typically submits a job from its process()
+ * function with a copy of the statistics it needs, and polls for the result
+ * in the process() function of the following frames. The result is then
+ * applied to the active state, from which it is picked up when preparing the
+ * parameters of a later frame. The delay between the frame whose statistics
+ * were used and the frame to which the result applies depends on the duration
+ * of the computation, and the IPA thread is never blocked waiting for it.
+ *
+ * The job function runs on a worker thread concurrently with the algorithm.
+ * It must not access the algorithm or IPA context state without
+ * synchronization, and should operate on the data it has been given only.
+ *
+ * The AsyncJob destructor waits for the completion of the job in flight, if
+ * any. Declaring the AsyncJob as a member of the algorithm thus ensures that
+ * the job function can safely reference data owned by the algorithm that is
+ * not modified while the job is busy, such as tuning data.
+ */
+
+/**
+ * \fn AsyncJob::AsyncJob()
+ * \brief Construct an AsyncJob
+ * \param[in] pool The worker pool to run the job on
+ */
+
+/**
+ * \fn AsyncJob::~AsyncJob()
+ * \brief Destroy the AsyncJob, waiting for the job in flight to complete
+ */
+
+/**
+ * \fn AsyncJob::busy()
+ * \brief Check if a job is in flight
+ * \return True if a job has been submitted and hasn't completed yet
+ */
+
+/**
+ * \fn AsyncJob::submit()
+ * \brief Submit a job to the worker pool
+ * \param[in] frame The frame whose data the job operates on
+ * \param[in] func The job function, returning the result
+ *
+ * The job is submitted only if no other job is in flight. Otherwise the
+ * function returns immediately without queuing \a func, as running jobs back
+ * to back on outdated data would only increase the latency of the results.
+ *
+ * A result that hasn't been fetched yet is replaced by the result of the new
+ * job when it completes. Until then, fetch() returns the previous result with
+ * the frame it was computed for.
+ *
+ * \return True if the job has been submitted, false if a job is already in
+ * flight
+ */
+
+/**
+ * \fn AsyncJob::fetch()
+ * \brief Fetch the result of the last completed job
+ * \param[out] frame The frame the job was submitted for (optional)
+ *
+ * The result is moved out of the AsyncJob, subsequent calls return
+ * std::nullopt until another job completes.
+ *
+ * \return The job result if available, std::nullopt otherwise
+ */
+
+/**
+ * \fn AsyncJob::wait()
+ * \brief Wait for the job in flight, if any, to complete
+ *
+ * This function blocks the caller. It is meant to be used when stopping or
+ * reconfiguring the algorithm, not in the per-frame processing path.
+ */
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
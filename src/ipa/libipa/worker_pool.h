@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * Worker pool for asynchronous algorithm execution
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/class.h>
+
+namespace libcamera {
+
+namespace ipa {
+
+class WorkerPool
+{
+public:
+	WorkerPool(unsigned int threads);
+	~WorkerPool();
+
+	static WorkerPool &instance();
+
+	unsigned int threads() const { return threads_.size(); }
+
+	void submit(std::function<void()> job);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(WorkerPool)
+
+	void run();
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::queue<std::function<void()>> jobs_;
+	bool stop_;
+
+	std::vector<std::thread> threads_;
+};
+
+template<typename T>
+class AsyncJob
+{
+public:
+	AsyncJob(WorkerPool &pool = WorkerPool::instance())
+		: pool_(pool), state_(std::make_shared<State>())
+	{
+	}
+
+	~AsyncJob()
+	{
+		wait();
+	}
+
+	bool busy() const
+	{
+		std::scoped_lock lock(state_->mutex);
+		return state_->busy;
+	}
+
+	bool submit(uint32_t frame, std::function<T()> func)
+	{
+		{
+			std::scoped_lock lock(state_->mutex);
+			if (state_->busy)
+				return false;
+
+			state_->busy = true;
+		}
+
+		pool_.submit([state = state_, frame, func = std::move(func)]() {
+			T result = func();
+
+			std::scoped_lock lock(state->mutex);
+			state->result = std::move(result);
+			state->frame = frame;
+			state->busy = false;
+			state->cv.notify_all();
+		});
+
+		return true;
+	}
+
+	std::optional<T> fetch(uint32_t *frame = nullptr)
+	{
+		std::scoped_lock lock(state_->mutex);
+		if (!state_->result)
+			return std::nullopt;
+
+		if (frame)
+			*frame = state_->frame;
+
+		std::optional<T> result = std::move(state_->result);
+		state_->result.reset();
+		return result;
+	}
+
+	void wait()
+	{
+		std::unique_lock lock(state_->mutex);
+		state_->cv.wait(lock, [&] { return !state_->busy; });
+	}
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(AsyncJob)
+
+	struct State {
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool busy = false;
+		uint32_t frame = 0;
+		std::optional<T> result;
+	};
+
+	WorkerPool &pool_;
+	std::shared_ptr<State> state_;
+};
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
@@ -37,6 +37,7 @@ namespace ipa::rkisp1::algorithms {
 LOG_DEFINE_CATEGORY(RkISP1Agc)
 
 Agc::Agc()
+	: lastExposureTime_(0s), lastGain_(0.0)
 {
 	supportsRaw_ = true;
 }
@@ -73,16 +74,37 @@ int Agc::init(IPAContext &context, const YamlObject &tuningData)
  */
 int Agc::configure(IPAContext &context, const IPACameraSensorInfo &configInfo)
 {
-	/* Configure the default exposure and gain. */
-	context.activeState.agc.automatic.gain = context.configuration.sensor.minAnalogueGain;
-	context.activeState.agc.automatic.exposure =
-		10ms / context.configuration.sensor.lineDuration;
+	/*
+	 * Configure the default exposure and gain. If the algorithm has
+	 * converged during a previous capture session, start from the last
+	 * computed values instead, to avoid running the convergence again when
+	 * the scene hasn't changed. The exposure time is stored as a duration
+	 * as the line length may differ between sensor configurations.
+	 */
+	const IPASessionConfiguration &configuration = context.configuration;
+	if (lastExposureTime_) {
+		utils::Duration exposureTime =
+			std::clamp(lastExposureTime_,
+				   configuration.sensor.minShutterSpeed,
+				   configuration.sensor.maxShutterSpeed);
+		context.activeState.agc.automatic.exposure =
+			exposureTime / configuration.sensor.lineDuration;
+		context.activeState.agc.automatic.gain =
+			std::clamp(lastGain_, configuration.sensor.minAnalogueGain,
+				   configuration.sensor.maxAnalogueGain);
+	} else {
+		context.activeState.agc.automatic.gain = configuration.sensor.minAnalogueGain;
+		context.activeState.agc.automatic.exposure =
+			10ms / configuration.sensor.lineDuration;
+	}
 	context.activeState.agc.manual.gain = context.activeState.agc.automatic.gain;
 	context.activeState.agc.manual.exposure = context.activeState.agc.automatic.exposure;
 	context.activeState.agc.autoEnabled = !context.configuration.raw;
 
 	context.activeState.agc.constraintMode = constraintModes().begin()->first;
 	context.activeState.agc.exposureMode = exposureModeHelpers().begin()->first;
+	context.activeState.agc.meteringMode =
+		controls().at(&controls::AeMeteringMode).def().get<int32_t>();
 
 	/*
 	 * Define the measurement window for AGC as a centered rectangle
@@ -98,6 +120,12 @@ int Agc::configure(IPAContext &context, const IPACameraSensorInfo &configInfo)
 		  context.configuration.sensor.maxShutterSpeed,
 		  context.configuration.sensor.minAnalogueGain,
 		  context.configuration.sensor.maxAnalogueGain);
+	setQuantization(context.configuration.sensor.lineDuration,
+			context.camHelper);
+
+	/* The AE statistics are computed on a square grid of zones. */
+	unsigned int gridSize = std::lround(std::sqrt(context.hw->numAeCells));
+	setZoneGrid({ gridSize, gridSize });
 
 	resetFrameCount();
 
@@ -141,6 +169,20 @@ void Agc::queueRequest(IPAContext &context,
 		LOG(RkISP1Agc, Debug) << "Set gain to " << agc.manual.gain;
 	}
 
+	const auto &meteringMode = controls.get(controls::AeMeteringMode);
+	if (meteringMode) {
+		if (meteringModeSupported(*meteringMode)) {
+			agc.meteringMode = *meteringMode;
+
+			LOG(RkISP1Agc, Debug)
+				<< "Set metering mode to " << agc.meteringMode;
+		} else {
+			LOG(RkISP1Agc, Warning)
+				<< "Ignoring unsupported metering mode "
+				<< *meteringMode;
+		}
+	}
+
 	frameContext.agc.autoEnabled = agc.autoEnabled;
 
 	if (!frameContext.agc.autoEnabled) {
@@ -153,7 +195,7 @@ void Agc::queueRequest(IPAContext &context,
  * \copydoc libcamera::ipa::Algorithm::prepare
  */
 void Agc::prepare(IPAContext &context, const uint32_t frame,
-		  IPAFrameContext &frameContext, rkisp1_params_cfg *params)
+		  IPAFrameContext &frameContext, RkISP1Params *params)
 {
 	if (frameContext.agc.autoEnabled) {
 		frameContext.agc.exposure = context.activeState.agc.automatic.exposure;
@@ -163,35 +205,31 @@ void Agc::prepare(IPAContext &context, const uint32_t frame,
 	if (frame > 0)
 		return;
 
+	auto aecConfig = params->block<BlockType::Aec>();
+	aecConfig.setEnabled(true);
+
 	/* Configure the measurement window. */
-	params->meas.aec_config.meas_window = context.configuration.agc.measureWindow;
+	aecConfig->meas_window = context.configuration.agc.measureWindow;
 	/* Use a continuous method for measure. */
-	params->meas.aec_config.autostop = RKISP1_CIF_ISP_EXP_CTRL_AUTOSTOP_0;
+	aecConfig->autostop = RKISP1_CIF_ISP_EXP_CTRL_AUTOSTOP_0;
 	/* Estimate Y as (R + G + B) x (85/256). */
-	params->meas.aec_config.mode = RKISP1_CIF_ISP_EXP_MEASURING_MODE_1;
+	aecConfig->mode = RKISP1_CIF_ISP_EXP_MEASURING_MODE_1;
 
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_AEC;
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_AEC;
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_AEC;
+	/* Configure histogram and enable the histogram measure unit. */
+	auto hstConfig = params->block<BlockType::Hst>();
+	hstConfig.setEnabled(true);
 
-	/* Configure histogram. */
-	params->meas.hst_config.meas_window = context.configuration.agc.measureWindow;
+	hstConfig->meas_window = context.configuration.agc.measureWindow;
 	/* Produce the luminance histogram. */
-	params->meas.hst_config.mode = RKISP1_CIF_ISP_HISTOGRAM_MODE_Y_HISTOGRAM;
+	hstConfig->mode = RKISP1_CIF_ISP_HISTOGRAM_MODE_Y_HISTOGRAM;
 	/* Set an average weighted histogram. */
 	Span<uint8_t> weights{
-		params->meas.hst_config.hist_weight,
+		hstConfig->hist_weight,
 		context.hw->numHistogramWeights
 	};
 	std::fill(weights.begin(), weights.end(), 1);
 	/* Step size can't be less than 3. */
-	params->meas.hst_config.histogram_predivider = 4;
-
-	/* Update the configuration for histogram. */
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_HST;
-	/* Enable the histogram measure unit. */
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_HST;
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_HST;
+	hstConfig->histogram_predivider = 4;
 }
 
 void Agc::fillMetadata(IPAContext &context, IPAFrameContext &frameContext,
@@ -210,42 +248,6 @@ void Agc::fillMetadata(IPAContext &context, IPAFrameContext &frameContext,
 	metadata.set(controls::FrameDuration, frameDuration.get<std::micro>());
 }
 
-/**
- * \brief Estimate the relative luminance of the frame with a given gain
- * \param[in] gain The gain to apply to the frame
- *
- * This function estimates the average relative luminance of the frame that
- * would be output by the sensor if an additional \a gain was applied.
- *
- * The estimation is based on the AE statistics for the current frame. Y
- * averages for all cells are first multiplied by the gain, and then saturated
- * to approximate the sensor behaviour at high brightness values. The
- * approximation is quite rough, as it doesn't take into account non-linearities
- * when approaching saturation. In this case, saturating after the conversion to
- * YUV doesn't take into account the fact that the R, G and B components
- * contribute differently to the relative luminance.
- *
- * The values are normalized to the [0.0, 1.0] range, where 1.0 corresponds to a
- * theoretical perfect reflector of 100% reference white.
- *
- * More detailed information can be found in:
- * https://en.wikipedia.org/wiki/Relative_luminance
- *
- * \return The relative luminance
- */
-double Agc::estimateLuminance(double gain) const
-{
-	double ySum = 0.0;
-
-	/* Sum the averages, saturated to 255. */
-	for (uint8_t expMean : expMeans_)
-		ySum += std::min(expMean * gain, 255.0);
-
-	/* \todo Weight with the AWB gains */
-
-	return ySum / expMeans_.size() / 255;
-}
-
 /**
  * \brief Process RkISP1 statistics, and run AGC operations
  * \param[in] context The shared IPA context
@@ -278,9 +280,18 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	ASSERT(stats->meas_type & RKISP1_CIF_ISP_STAT_AUTOEXP);
 
 	/* The lower 4 bits are fractional and meant to be discarded. */
-	Histogram hist({ params->hist.hist_bins, context.hw->numHistogramBins },
-		       [](uint32_t x) { return x >> 4; });
-	expMeans_ = { params->ae.exp_mean, context.hw->numAeCells };
+	hist_.reset({ params->hist.hist_bins, context.hw->numHistogramBins },
+		    [](uint32_t x) { return x >> 4; });
+
+	/*
+	 * Store the luminance means of the zones, normalised to [0.0, 1.0].
+	 * Saturation is approximated by the base class on these values, which
+	 * doesn't take into account the fact that the R, G and B components
+	 * contribute differently to the relative luminance.
+	 */
+	Span<double> zones = this->zones(0);
+	for (unsigned int i = 0; i < zones.size(); i++)
+		zones[i] = params->ae.exp_mean[i] / 255.0;
 
 	/*
 	 * The Agc algorithm needs to know the effective exposure value that was
@@ -296,7 +307,8 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	std::tie(shutterTime, aGain, dGain) =
 		calculateNewEv(context.activeState.agc.constraintMode,
 			       context.activeState.agc.exposureMode,
-			       hist, effectiveExposureValue);
+			       context.activeState.agc.meteringMode,
+			       hist_, effectiveExposureValue);
 
 	LOG(RkISP1Agc, Debug)
 		<< "Divided up shutter, analogue gain and digital gain are "
@@ -307,8 +319,11 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	activeState.agc.automatic.exposure = shutterTime / context.configuration.sensor.lineDuration;
 	activeState.agc.automatic.gain = aGain;
 
+	/* Remember the values to seed the next capture session. */
+	lastExposureTime_ = shutterTime;
+	lastGain_ = aGain;
+
 	fillMetadata(context, frameContext, metadata);
-	expMeans_ = {};
 }
 
 REGISTER_IPA_ALGORITHM(Agc, "Agc")
@@ -37,7 +37,7 @@ public:
 			  const ControlList &controls) override;
 	void prepare(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
-		     rkisp1_params_cfg *params) override;
+		     RkISP1Params *params) override;
 	void process(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
 		     const rkisp1_stat_buffer *stats,
@@ -46,9 +46,11 @@ public:
 private:
 	void fillMetadata(IPAContext &context, IPAFrameContext &frameContext,
 			  ControlList &metadata);
-	double estimateLuminance(double gain) const override;
 
-	Span<const uint8_t> expMeans_;
+	Histogram hist_;
+
+	utils::Duration lastExposureTime_;
+	double lastGain_;
 };
 
 } /* namespace ipa::rkisp1::algorithms */
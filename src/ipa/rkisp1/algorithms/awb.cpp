@@ -16,6 +16,9 @@
 #include <libcamera/control_ids.h>
 #include <libcamera/ipa/core_ipa_interface.h>
 
+#include "libipa/matrix.h"
+#include "libipa/vector.h"
+
 /**
  * \file awb.h
  */
@@ -35,7 +38,8 @@ LOG_DEFINE_CATEGORY(RkISP1Awb)
 constexpr double kMeanMinThreshold = 2.0;
 
 Awb::Awb()
-	: rgbMode_(false)
+	: rgbMode_(false), gains_({}), lastRedGain_(1.0), lastBlueGain_(1.0),
+	  lastTemperatureK_(0.0)
 {
 }
 
@@ -48,9 +52,14 @@ int Awb::configure(IPAContext &context,
 	context.activeState.awb.gains.manual.red = 1.0;
 	context.activeState.awb.gains.manual.blue = 1.0;
 	context.activeState.awb.gains.manual.green = 1.0;
-	context.activeState.awb.gains.automatic.red = 1.0;
-	context.activeState.awb.gains.automatic.blue = 1.0;
+	/*
+	 * Start from the gains computed during the previous capture session,
+	 * if any, to avoid converging again from unity gains.
+	 */
+	context.activeState.awb.gains.automatic.red = lastRedGain_;
+	context.activeState.awb.gains.automatic.blue = lastBlueGain_;
 	context.activeState.awb.gains.automatic.green = 1.0;
+	context.activeState.awb.temperatureK = lastTemperatureK_;
 	context.activeState.awb.autoEnabled = true;
 
 	/*
@@ -108,7 +117,7 @@ void Awb::queueRequest(IPAContext &context,
  * \copydoc libcamera::ipa::Algorithm::prepare
  */
 void Awb::prepare(IPAContext &context, const uint32_t frame,
-		  IPAFrameContext &frameContext, rkisp1_params_cfg *params)
+		  IPAFrameContext &frameContext, RkISP1Params *params)
 {
 	/*
 	 * This is the latest time we can read the active state. This is the
@@ -120,19 +129,36 @@ void Awb::prepare(IPAContext &context, const uint32_t frame,
 		frameContext.awb.gains.blue = context.activeState.awb.gains.automatic.blue;
 	}
 
-	params->others.awb_gain_config.gain_green_b = 256 * frameContext.awb.gains.green;
-	params->others.awb_gain_config.gain_blue = 256 * frameContext.awb.gains.blue;
-	params->others.awb_gain_config.gain_red = 256 * frameContext.awb.gains.red;
-	params->others.awb_gain_config.gain_green_r = 256 * frameContext.awb.gains.green;
+	rkisp1_cif_isp_awb_gain_config gains = {};
+	gains.gain_green_b = 256 * frameContext.awb.gains.green;
+	gains.gain_blue = 256 * frameContext.awb.gains.blue;
+	gains.gain_red = 256 * frameContext.awb.gains.red;
+	gains.gain_green_r = 256 * frameContext.awb.gains.green;
 
-	/* Update the gains. */
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_AWB_GAIN;
+	/*
+	 * Update the gains only when they change, the ISP keeps the previous
+	 * values otherwise. The gains block is enabled with the first frame.
+	 */
+	if (frame == 0 || gains.gain_red != gains_.gain_red ||
+	    gains.gain_green_r != gains_.gain_green_r ||
+	    gains.gain_blue != gains_.gain_blue ||
+	    gains.gain_green_b != gains_.gain_green_b) {
+		auto gainConfig = params->block<BlockType::AwbGain>();
+		*gainConfig = gains;
+		if (frame == 0)
+			gainConfig.setEnabled(true);
+
+		gains_ = gains;
+	}
 
 	/* If we have already set the AWB measurement parameters, return. */
 	if (frame > 0)
 		return;
 
-	rkisp1_cif_isp_awb_meas_config &awb_config = params->meas.awb_meas_config;
+	auto awbConfig = params->block<BlockType::Awb>();
+	awbConfig.setEnabled(true);
+
+	rkisp1_cif_isp_awb_meas_config &awb_config = *awbConfig;
 
 	/* Configure the measure window for AWB. */
 	awb_config.awb_wnd = context.configuration.awb.measureWindow;
@@ -175,23 +201,21 @@ void Awb::prepare(IPAContext &context, const uint32_t frame,
 		awb_config.min_c = 16;
 		awb_config.max_csum = 250;
 	}
-
-	/* Enable the AWB gains. */
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_AWB_GAIN;
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_AWB_GAIN;
-
-	/* Update the AWB measurement parameters and enable the AWB module. */
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_AWB;
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_AWB;
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_AWB;
 }
 
 uint32_t Awb::estimateCCT(double red, double green, double blue)
 {
 	/* Convert the RGB values to CIE tristimulus values (XYZ) */
-	double X = (-0.14282) * (red) + (1.54924) * (green) + (-0.95641) * (blue);
-	double Y = (-0.32466) * (red) + (1.57837) * (green) + (-0.73191) * (blue);
-	double Z = (-0.68202) * (red) + (0.77073) * (green) + (0.56332) * (blue);
+	static constexpr Matrix<double, 3, 3> rgbToXyz({
+		-0.14282, 1.54924, -0.95641,
+		-0.32466, 1.57837, -0.73191,
+		-0.68202, 0.77073, 0.56332
+	});
+
+	Vector<double, 3> xyz = rgbToXyz * Vector<double, 3>({ red, green, blue });
+	double X = xyz[0];
+	double Y = xyz[1];
+	double Z = xyz[2];
 
 	/* Calculate the normalized chromaticity values */
 	double x = X / (X + Y + Z);
@@ -240,12 +264,18 @@ void Awb::process(IPAContext &context,
 		 *  [1,1636, -0,4045, -0,7949]
 		 *  [1,1636,  1,9912, -0,0250]]
 		 */
-		yMean -= 16;
-		cbMean -= 128;
-		crMean -= 128;
-		redMean = 1.1636 * yMean - 0.0623 * cbMean + 1.6008 * crMean;
-		greenMean = 1.1636 * yMean - 0.4045 * cbMean - 0.7949 * crMean;
-		blueMean = 1.1636 * yMean + 1.9912 * cbMean - 0.0250 * crMean;
+		static constexpr Matrix<double, 3, 3> yuvToRgb({
+			1.1636, -0.0623, 1.6008,
+			1.1636, -0.4045, -0.7949,
+			1.1636, 1.9912, -0.0250
+		});
+		static const Vector<double, 3> yuvOffset({ 16, 128, 128 });
+
+		Vector<double, 3> rgbMeans =
+			yuvToRgb * (Vector<double, 3>({ yMean, cbMean, crMean }) - yuvOffset);
+		redMean = rgbMeans[0];
+		greenMean = rgbMeans[1];
+		blueMean = rgbMeans[2];
 
 		/*
 		 * Due to hardware rounding errors in the YCbCr means, the
@@ -305,6 +335,10 @@ void Awb::process(IPAContext &context,
 	activeState.awb.gains.automatic.blue = blueGain;
 	activeState.awb.gains.automatic.green = 1.0;
 
+	lastRedGain_ = redGain;
+	lastBlueGain_ = blueGain;
+	lastTemperatureK_ = activeState.awb.temperatureK;
+
 	frameContext.awb.temperatureK = activeState.awb.temperatureK;
 
 	metadata.set(controls::AwbEnable, frameContext.awb.autoEnabled);
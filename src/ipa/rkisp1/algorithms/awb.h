@@ -25,7 +25,7 @@ public:
 			  const ControlList &controls) override;
 	void prepare(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
-		     rkisp1_params_cfg *params) override;
+		     RkISP1Params *params) override;
 	void process(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
 		     const rkisp1_stat_buffer *stats,
@@ -35,6 +35,12 @@ private:
 	uint32_t estimateCCT(double red, double green, double blue);
 
 	bool rgbMode_;
+	rkisp1_cif_isp_awb_gain_config gains_;
+
+	/* Last automatic gains, to seed the next capture session. */
+	double lastRedGain_;
+	double lastBlueGain_;
+	double lastTemperatureK_;
 };
 
 } /* namespace ipa::rkisp1::algorithms */
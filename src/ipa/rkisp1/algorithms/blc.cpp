@@ -68,7 +68,7 @@ int BlackLevelCorrection::init([[maybe_unused]] IPAContext &context,
 void BlackLevelCorrection::prepare([[maybe_unused]] IPAContext &context,
 				   const uint32_t frame,
 				   [[maybe_unused]] IPAFrameContext &frameContext,
-				   rkisp1_params_cfg *params)
+				   RkISP1Params *params)
 {
 	if (frame > 0)
 		return;
@@ -76,15 +76,14 @@ void BlackLevelCorrection::prepare([[maybe_unused]] IPAContext &context,
 	if (!tuningParameters_)
 		return;
 
-	params->others.bls_config.enable_auto = 0;
-	params->others.bls_config.fixed_val.r = blackLevelRed_;
-	params->others.bls_config.fixed_val.gr = blackLevelGreenR_;
-	params->others.bls_config.fixed_val.gb = blackLevelGreenB_;
-	params->others.bls_config.fixed_val.b = blackLevelBlue_;
+	auto config = params->block<BlockType::Bls>();
+	config.setEnabled(true);
 
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_BLS;
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_BLS;
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_BLS;
+	config->enable_auto = 0;
+	config->fixed_val.r = blackLevelRed_;
+	config->fixed_val.gr = blackLevelGreenR_;
+	config->fixed_val.gb = blackLevelGreenB_;
+	config->fixed_val.b = blackLevelBlue_;
 }
 
 REGISTER_IPA_ALGORITHM(BlackLevelCorrection, "BlackLevelCorrection")
@@ -215,42 +215,45 @@ void Dpf::queueRequest(IPAContext &context,
  * \copydoc libcamera::ipa::Algorithm::prepare
  */
 void Dpf::prepare(IPAContext &context, const uint32_t frame,
-		  IPAFrameContext &frameContext, rkisp1_params_cfg *params)
+		  IPAFrameContext &frameContext, RkISP1Params *params)
 {
-	if (frame == 0) {
-		params->others.dpf_config = config_;
-		params->others.dpf_strength_config = strengthConfig_;
-
-		const auto &awb = context.configuration.awb;
-		const auto &lsc = context.configuration.lsc;
-		auto &mode = params->others.dpf_config.gain.mode;
-
-		/*
-		 * The DPF needs to take into account the total amount of
-		 * digital gain, which comes from the AWB and LSC modules. The
-		 * DPF hardware can be programmed with a digital gain value
-		 * manually, but can also use the gains supplied by the AWB and
-		 * LSC modules automatically when they are enabled. Use that
-		 * mode of operation as it simplifies control of the DPF.
-		 */
-		if (awb.enabled && lsc.enabled)
-			mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_AWB_LSC_GAINS;
-		else if (awb.enabled)
-			mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_AWB_GAINS;
-		else if (lsc.enabled)
-			mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_LSC_GAINS;
-		else
-			mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_DISABLED;
-
-		params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_DPF |
-					     RKISP1_CIF_ISP_MODULE_DPF_STRENGTH;
-	}
+	if (frame > 0 && !frameContext.dpf.update)
+		return;
 
-	if (frameContext.dpf.update) {
-		params->module_en_update |= RKISP1_CIF_ISP_MODULE_DPF;
-		if (frameContext.dpf.denoise)
-			params->module_ens |= RKISP1_CIF_ISP_MODULE_DPF;
-	}
+	/*
+	 * Program the configuration with the first frame, and when the
+	 * denoise filter is enabled or disabled, as the extensible parameters
+	 * format requires the block configuration to be fully populated.
+	 */
+	auto config = params->block<BlockType::Dpf>();
+	*config = config_;
+
+	const auto &awb = context.configuration.awb;
+	const auto &lsc = context.configuration.lsc;
+	auto &mode = config->gain.mode;
+
+	/*
+	 * The DPF needs to take into account the total amount of digital gain,
+	 * which comes from the AWB and LSC modules. The DPF hardware can be
+	 * programmed with a digital gain value manually, but can also use the
+	 * gains supplied by the AWB and LSC modules automatically when they
+	 * are enabled. Use that mode of operation as it simplifies control of
+	 * the DPF.
+	 */
+	if (awb.enabled && lsc.enabled)
+		mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_AWB_LSC_GAINS;
+	else if (awb.enabled)
+		mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_AWB_GAINS;
+	else if (lsc.enabled)
+		mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_LSC_GAINS;
+	else
+		mode = RKISP1_CIF_ISP_DPF_GAIN_USAGE_DISABLED;
+
+	auto strengthConfig = params->block<BlockType::DpfStrength>();
+	*strengthConfig = strengthConfig_;
+
+	if (frameContext.dpf.update)
+		config.setEnabled(frameContext.dpf.denoise);
 }
 
 REGISTER_IPA_ALGORITHM(Dpf, "Dpf")
@@ -104,7 +104,7 @@ void Filter::queueRequest(IPAContext &context,
  */
 void Filter::prepare([[maybe_unused]] IPAContext &context,
 		     [[maybe_unused]] const uint32_t frame,
-		     IPAFrameContext &frameContext, rkisp1_params_cfg *params)
+		     IPAFrameContext &frameContext, RkISP1Params *params)
 {
 	/* Check if the algorithm configuration has been updated. */
 	if (!frameContext.filter.update)
@@ -160,7 +160,10 @@ void Filter::prepare([[maybe_unused]] IPAContext &context,
 
 	uint8_t denoise = frameContext.filter.denoise;
 	uint8_t sharpness = frameContext.filter.sharpness;
-	auto &flt_config = params->others.flt_config;
+	auto config = params->block<BlockType::Flt>();
+	config.setEnabled(true);
+
+	auto &flt_config = *config;
 
 	flt_config.fac_sh0 = filt_fac_sh0[sharpness];
 	flt_config.fac_sh1 = filt_fac_sh1[sharpness];
@@ -203,10 +206,6 @@ void Filter::prepare([[maybe_unused]] IPAContext &context,
 			flt_config.fac_bl1 /= 2;
 		}
 	}
-
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_FLT;
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_FLT;
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_FLT;
 }
 
 REGISTER_IPA_ALGORITHM(Filter, "Filter")
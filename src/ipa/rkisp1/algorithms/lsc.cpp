@@ -36,6 +36,13 @@ namespace ipa::rkisp1::algorithms {
  * The Lens Shading Correction algorithm applies multipliers to all pixels
  * to compensate for the lens shading effect. The coefficients are
  * specified in a downscaled table in the YAML tuning file.
+ *
+ * Tables for intermediate color temperatures are interpolated between the
+ * sets of the tuning file once, when the algorithm is configured, to build a
+ * bank of tables spaced at most kCtStep apart. Every frame then selects the
+ * bank entry closest to the estimated color temperature, with hysteresis to
+ * avoid toggling between two neighbouring entries. The LSC configuration is
+ * only written to the parameters buffer when the selected entry changes.
  */
 
 LOG_DEFINE_CATEGORY(RkISP1Lsc)
@@ -89,8 +96,16 @@ static std::vector<uint16_t> parseTable(const YamlObject &tuningData,
 	return table;
 }
 
+/*
+ * Maximum color temperature difference between two consecutive tables of the
+ * bank, and minimum improvement of the distance to the estimated color
+ * temperature required to switch to a different table.
+ */
+static constexpr uint32_t kCtStep = 100;
+static constexpr uint32_t kCtHysteresis = 25;
+
 LensShadingCorrection::LensShadingCorrection()
-	: lastCt_({ 0, 0 })
+	: current_(0), programmed_(false)
 {
 }
 
@@ -181,22 +196,19 @@ int LensShadingCorrection::configure(IPAContext &context,
 		yGrad_[i] = std::round(32768 / ySizes_[i]);
 	}
 
+	buildBank();
+	programmed_ = false;
+
 	context.configuration.lsc.enabled = true;
 	return 0;
 }
 
-void LensShadingCorrection::setParameters(rkisp1_params_cfg *params)
+void LensShadingCorrection::setParameters(rkisp1_cif_isp_lsc_config &config)
 {
-	struct rkisp1_cif_isp_lsc_config &config = params->others.lsc_config;
-
 	memcpy(config.x_grad_tbl, xGrad_, sizeof(config.x_grad_tbl));
 	memcpy(config.y_grad_tbl, yGrad_, sizeof(config.y_grad_tbl));
 	memcpy(config.x_size_tbl, xSizes_, sizeof(config.x_size_tbl));
 	memcpy(config.y_size_tbl, ySizes_, sizeof(config.y_size_tbl));
-
-	params->module_en_update |= RKISP1_CIF_ISP_MODULE_LSC;
-	params->module_ens |= RKISP1_CIF_ISP_MODULE_LSC;
-	params->module_cfg_update |= RKISP1_CIF_ISP_MODULE_LSC;
 }
 
 void LensShadingCorrection::copyTable(rkisp1_cif_isp_lsc_config &config,
@@ -211,128 +223,119 @@ void LensShadingCorrection::copyTable(rkisp1_cif_isp_lsc_config &config,
 /*
  * Interpolate LSC parameters based on color temperature value.
  */
-void LensShadingCorrection::interpolateTable(rkisp1_cif_isp_lsc_config &config,
-					     const Components &set0,
-					     const Components &set1,
-					     const uint32_t ct)
+LensShadingCorrection::Components
+LensShadingCorrection::interpolateTable(const Components &set0,
+					const Components &set1,
+					const uint32_t ct)
 {
 	double coeff0 = (set1.ct - ct) / static_cast<double>(set1.ct - set0.ct);
 	double coeff1 = (ct - set0.ct) / static_cast<double>(set1.ct - set0.ct);
 
-	for (unsigned int i = 0; i < RKISP1_CIF_ISP_LSC_SAMPLES_MAX; ++i) {
-		for (unsigned int j = 0; j < RKISP1_CIF_ISP_LSC_SAMPLES_MAX; ++j) {
-			unsigned int sample = i * RKISP1_CIF_ISP_LSC_SAMPLES_MAX + j;
+	auto interpolate = [&](const std::vector<uint16_t> &table0,
+			       const std::vector<uint16_t> &table1) {
+		std::vector<uint16_t> table(table0.size());
+		for (unsigned int i = 0; i < table.size(); ++i)
+			table[i] = table0[i] * coeff0 + table1[i] * coeff1;
+		return table;
+	};
+
+	return {
+		ct,
+		interpolate(set0.r, set1.r),
+		interpolate(set0.gr, set1.gr),
+		interpolate(set0.gb, set1.gb),
+		interpolate(set0.b, set1.b),
+	};
+}
 
-			config.r_data_tbl[i][j] =
-				set0.r[sample] * coeff0 +
-				set1.r[sample] * coeff1;
+/*
+ * Build the bank of tables sorted by color temperature, containing the sets
+ * from the tuning file and the tables interpolated between them.
+ */
+void LensShadingCorrection::buildBank()
+{
+	bank_.clear();
 
-			config.gr_data_tbl[i][j] =
-				set0.gr[sample] * coeff0 +
-				set1.gr[sample] * coeff1;
+	for (auto iter = sets_.cbegin(); iter != sets_.cend(); ++iter) {
+		const Components &set0 = iter->second;
+		bank_.push_back(set0);
 
-			config.gb_data_tbl[i][j] =
-				set0.gb[sample] * coeff0 +
-				set1.gb[sample] * coeff1;
+		auto next = std::next(iter);
+		if (next == sets_.cend())
+			break;
 
-			config.b_data_tbl[i][j] =
-				set0.b[sample] * coeff0 +
-				set1.b[sample] * coeff1;
+		const Components &set1 = next->second;
+		unsigned int steps = utils::alignUp(set1.ct - set0.ct, kCtStep) / kCtStep;
+		for (unsigned int i = 1; i < steps; ++i) {
+			uint32_t ct = set0.ct + (set1.ct - set0.ct) * i / steps;
+			bank_.push_back(interpolateTable(set0, set1, ct));
 		}
 	}
+
+	current_ = 0;
+
+	LOG(RkISP1Lsc, Debug)
+		<< "Built " << bank_.size() << " LSC tables from "
+		<< sets_.size() << " sets";
+}
+
+/*
+ * Select the bank entry to use for the color temperature \a ct, keeping the
+ * current entry unless another one is closer by more than kCtHysteresis.
+ */
+unsigned int LensShadingCorrection::selectTable(uint32_t ct) const
+{
+	auto distance = [ct](const Components &set) {
+		return set.ct > ct ? set.ct - ct : ct - set.ct;
+	};
+
+	auto iter = std::lower_bound(bank_.begin(), bank_.end(), ct,
+				     [](const Components &set, uint32_t value) {
+					     return set.ct < value;
+				     });
+	if (iter == bank_.end())
+		--iter;
+	else if (iter != bank_.begin() && distance(*std::prev(iter)) <= distance(*iter))
+		--iter;
+
+	unsigned int nearest = std::distance(bank_.begin(), iter);
+	if (nearest == current_)
+		return current_;
+
+	if (distance(bank_[current_]) < distance(bank_[nearest]) + kCtHysteresis)
+		return current_;
+
+	return nearest;
 }
 
 /**
  * \copydoc libcamera::ipa::Algorithm::prepare
  */
 void LensShadingCorrection::prepare(IPAContext &context,
-				    const uint32_t frame,
+				    [[maybe_unused]] const uint32_t frame,
 				    [[maybe_unused]] IPAFrameContext &frameContext,
-				    rkisp1_params_cfg *params)
+				    RkISP1Params *params)
 {
-	struct rkisp1_cif_isp_lsc_config &config = params->others.lsc_config;
-
-	/*
-	 * If there is only one set, the configuration has already been done
-	 * for first frame.
-	 */
-	if (sets_.size() == 1 && frame > 0)
-		return;
-
-	/*
-	 * If there is only one set, pick it. We can ignore lastCt_, as it will
-	 * never be relevant.
-	 */
-	if (sets_.size() == 1) {
-		setParameters(params);
-		copyTable(config, sets_.cbegin()->second);
-		return;
-	}
-
-	uint32_t ct = context.activeState.awb.temperatureK;
-	ct = std::clamp(ct, sets_.cbegin()->first, sets_.crbegin()->first);
-
-	/*
-	 * If the original is the same, then it means the same adjustment would
-	 * be made. If the adjusted is the same, then it means that it's the
-	 * same as what was actually applied. Thus in these cases we can skip
-	 * reprogramming the LSC.
-	 *
-	 * original == adjusted can only happen if an interpolation
-	 * happened, or if original has an exact entry in sets_. This means
-	 * that if original != adjusted, then original was adjusted to
-	 * the nearest available entry in sets_, resulting in adjusted.
-	 * Clearly, any ct value that is in between original and adjusted
-	 * will be adjusted to the same adjusted value, so we can skip
-	 * reprogramming the LSC table.
-	 *
-	 * We also skip updating the original value, as the last one had a
-	 * larger bound and thus a larger range of ct values that will be
-	 * adjusted to the same adjusted.
-	 */
-	if ((lastCt_.original <= ct && ct <= lastCt_.adjusted) ||
-	    (lastCt_.adjusted <= ct && ct <= lastCt_.original))
-		return;
-
-	setParameters(params);
+	unsigned int index = selectTable(context.activeState.awb.temperatureK);
 
 	/*
-	 * The color temperature matches exactly one of the available LSC tables.
+	 * Leave the LSC block untouched in the parameters buffer when the
+	 * selected table hasn't changed, the ISP keeps the configuration
+	 * programmed previously.
 	 */
-	if (sets_.count(ct)) {
-		copyTable(config, sets_[ct]);
-		lastCt_ = { ct, ct };
+	if (programmed_ && index == current_)
 		return;
-	}
 
-	/* No shortcuts left; we need to round or interpolate */
-	auto iter = sets_.upper_bound(ct);
-	const Components &set1 = iter->second;
-	const Components &set0 = (--iter)->second;
-	uint32_t ct0 = set0.ct;
-	uint32_t ct1 = set1.ct;
-	uint32_t diff0 = ct - ct0;
-	uint32_t diff1 = ct1 - ct;
-	static constexpr double kThreshold = 0.1;
-	float threshold = kThreshold * (ct1 - ct0);
-
-	if (diff0 < threshold || diff1 < threshold) {
-		const Components &set = diff0 < diff1 ? set0 : set1;
-		LOG(RkISP1Lsc, Debug) << "using LSC table for " << set.ct;
-		copyTable(config, set);
-		lastCt_ = { ct, set.ct };
-		return;
-	}
+	current_ = index;
+	programmed_ = true;
 
-	/*
-	 * ct is not within 10% of the difference between the neighbouring
-	 * color temperatures, so we need to interpolate.
-	 */
 	LOG(RkISP1Lsc, Debug)
-		<< "ct is " << ct << ", interpolating between "
-		<< ct0 << " and " << ct1;
-	interpolateTable(config, set0, set1, ct);
-	lastCt_ = { ct, ct };
+		<< "Using LSC table for " << bank_[current_].ct;
+
+	auto config = params->block<BlockType::Lsc>();
+	config.setEnabled(true);
+	setParameters(*config);
+	copyTable(*config, bank_[current_]);
 }
 
 REGISTER_IPA_ALGORITHM(LensShadingCorrection, "LensShadingCorrection")
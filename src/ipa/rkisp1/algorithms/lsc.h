@@ -8,6 +8,7 @@
 #pragma once
 
 #include <map>
+#include <vector>
 
 #include "algorithm.h"
 
@@ -25,7 +26,7 @@ public:
 	int configure(IPAContext &context, const IPACameraSensorInfo &configInfo) override;
 	void prepare(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
-		     rkisp1_params_cfg *params) override;
+		     RkISP1Params *params) override;
 
 private:
 	struct Components {
@@ -36,23 +37,23 @@ private:
 		std::vector<uint16_t> b;
 	};
 
-	void setParameters(rkisp1_params_cfg *params);
+	void setParameters(rkisp1_cif_isp_lsc_config &config);
 	void copyTable(rkisp1_cif_isp_lsc_config &config, const Components &set0);
-	void interpolateTable(rkisp1_cif_isp_lsc_config &config,
-			      const Components &set0, const Components &set1,
-			      const uint32_t ct);
+	Components interpolateTable(const Components &set0,
+				    const Components &set1, const uint32_t ct);
+	void buildBank();
+	unsigned int selectTable(uint32_t ct) const;
 
 	std::map<uint32_t, Components> sets_;
+	std::vector<Components> bank_;
 	std::vector<double> xSize_;
 	std::vector<double> ySize_;
 	uint16_t xGrad_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t yGrad_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t xSizes_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t ySizes_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
-	struct {
-		uint32_t original;
-		uint32_t adjusted;
-	} lastCt_;
+	unsigned int current_;
+	bool programmed_;
 };
 
 } /* namespace ipa::rkisp1::algorithms */
@@ -105,6 +105,11 @@ namespace libcamera::ipa::rkisp1 {
  * \brief Indicates if the camera is configured to capture raw frames
  */
 
+/**
+ * \var IPASessionConfiguration::paramFormat
+ * \brief The fourcc of the parameters buffers format
+ */
+
 /**
  * \struct IPAActiveState
  * \brief Active state for algorithms
@@ -379,6 +384,9 @@ namespace libcamera::ipa::rkisp1 {
  *
  * \var IPAContext::frameContexts
  * \brief Ring buffer of per-frame contexts
+ *
+ * \var IPAContext::camHelper
+ * \brief The camera sensor helper
  */
 
 } /* namespace libcamera::ipa::rkisp1 */
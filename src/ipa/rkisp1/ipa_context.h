@@ -15,6 +15,7 @@
 #include <libcamera/controls.h>
 #include <libcamera/geometry.h>
 
+#include <libipa/camera_sensor_helper.h>
 #include <libipa/fc_queue.h>
 
 namespace libcamera {
@@ -54,6 +55,7 @@ struct IPASessionConfiguration {
 	} sensor;
 
 	bool raw;
+	uint32_t paramFormat;
 };
 
 struct IPAActiveState {
@@ -70,6 +72,7 @@ struct IPAActiveState {
 		bool autoEnabled;
 		uint32_t constraintMode;
 		uint32_t exposureMode;
+		uint32_t meteringMode;
 	} agc;
 
 	struct {
@@ -165,6 +168,8 @@ struct IPAContext {
 	FCQueue<IPAFrameContext> frameContexts;
 
 	ControlInfoMap::Map ctrlMap;
+
+	const CameraSensorHelper *camHelper;
 };
 
 } /* namespace ipa::rkisp1 */
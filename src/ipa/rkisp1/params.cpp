@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * RkISP1 ISP Parameters
+ */
+
+#include "params.h"
+
+#include <map>
+#include <stddef.h>
+#include <string.h>
+
+#include <linux/videodev2.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+/**
+ * \file params.h
+ * \brief Helper class to fill the ISP parameters buffer
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(RkISP1Params)
+
+namespace ipa::rkisp1 {
+
+/**
+ * \enum BlockType
+ * \brief Identify an ISP processing block
+ *
+ * \var BlockType::Bls
+ * \brief Black level subtraction
+ * \var BlockType::Dpcc
+ * \brief Defect pixel cluster correction
+ * \var BlockType::Sdg
+ * \brief Sensor de-gamma
+ * \var BlockType::AwbGain
+ * \brief Auto white balance gains
+ * \var BlockType::Flt
+ * \brief Filter
+ * \var BlockType::Bdm
+ * \brief Bayer demosaicing
+ * \var BlockType::Ctk
+ * \brief Cross-talk correction
+ * \var BlockType::Goc
+ * \brief Gamma out correction
+ * \var BlockType::Dpf
+ * \brief De-noise pre-filter
+ * \var BlockType::DpfStrength
+ * \brief De-noise pre-filter strength
+ * \var BlockType::Cproc
+ * \brief Color processing
+ * \var BlockType::Ie
+ * \brief Image effects
+ * \var BlockType::Lsc
+ * \brief Lens shading correction
+ * \var BlockType::Awb
+ * \brief Auto white balance measurements
+ * \var BlockType::Hst
+ * \brief Histogram measurements
+ * \var BlockType::Aec
+ * \brief Auto exposure measurements
+ * \var BlockType::Afc
+ * \brief Auto focus measurements
+ */
+
+namespace {
+
+struct BlockTypeInfo {
+	enum rkisp1_ext_params_block_type type;
+	size_t size;
+	size_t offset;
+	uint32_t enableBit;
+};
+
+#define RKISP1_BLOCK_TYPE_ENTRY(block, id, type, category, bit)			\
+	{ BlockType::block, {							\
+		RKISP1_EXT_PARAMS_BLOCK_TYPE_##id,				\
+		sizeof(struct rkisp1_cif_isp_##type##_config),			\
+		offsetof(struct rkisp1_params_cfg, category.type##_config),	\
+		RKISP1_CIF_ISP_MODULE_##bit,					\
+	} }
+
+#define RKISP1_BLOCK_TYPE_ENTRY_MEAS(block, id, type)				\
+	RKISP1_BLOCK_TYPE_ENTRY(block, id##_MEAS, type, meas, id)
+
+#define RKISP1_BLOCK_TYPE_ENTRY_OTHERS(block, id, type)				\
+	RKISP1_BLOCK_TYPE_ENTRY(block, id, type, others, id)
+
+const std::map<BlockType, BlockTypeInfo> kBlockTypeInfo = {
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Bls, BLS, bls),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Dpcc, DPCC, dpcc),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Sdg, SDG, sdg),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(AwbGain, AWB_GAIN, awb_gain),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Flt, FLT, flt),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Bdm, BDM, bdm),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Ctk, CTK, ctk),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Goc, GOC, goc),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Dpf, DPF, dpf),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(DpfStrength, DPF_STRENGTH, dpf_strength),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Cproc, CPROC, cproc),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Ie, IE, ie),
+	RKISP1_BLOCK_TYPE_ENTRY_OTHERS(Lsc, LSC, lsc),
+	RKISP1_BLOCK_TYPE_ENTRY_MEAS(Awb, AWB, awb_meas),
+	RKISP1_BLOCK_TYPE_ENTRY_MEAS(Hst, HST, hst),
+	RKISP1_BLOCK_TYPE_ENTRY_MEAS(Aec, AEC, aec),
+	RKISP1_BLOCK_TYPE_ENTRY_MEAS(Afc, AFC, afc),
+};
+
+} /* namespace */
+
+/**
+ * \class RkISP1ParamsBlockBase
+ * \brief Base class for the ISP parameters blocks
+ *
+ * An RkISP1ParamsBlockBase gives access to the configuration data of one ISP
+ * processing block in the parameters buffer, and controls whether the block
+ * is enabled or disabled. Algorithms use the type-safe RkISP1ParamsBlock
+ * derived class, obtained from RkISP1Params::block().
+ */
+
+/**
+ * \brief Construct a parameters block
+ * \param[in] params The parameters buffer the block belongs to
+ * \param[in] type The block type
+ * \param[in] data The configuration data of the block
+ */
+RkISP1ParamsBlockBase::RkISP1ParamsBlockBase(RkISP1Params *params, BlockType type,
+					     const Span<uint8_t> &data)
+	: params_(params), type_(type), data_(data)
+{
+}
+
+/**
+ * \fn RkISP1ParamsBlockBase::data()
+ * \brief Retrieve the configuration data of the block
+ * \return The configuration data of the block
+ */
+
+/**
+ * \brief Enable or disable the processing block
+ * \param[in] enabled True to enable the block, false to disable it
+ *
+ * The enable state of blocks for which this function isn't called is left
+ * unchanged by the ISP.
+ */
+void RkISP1ParamsBlockBase::setEnabled(bool enabled)
+{
+	params_->setBlockEnabled(type_, enabled);
+}
+
+/**
+ * \class RkISP1ParamsBlock
+ * \brief Type-safe access to the configuration data of an ISP parameters block
+ * \tparam B The block type
+ *
+ * The RkISP1ParamsBlock class template exposes the configuration data of the
+ * block through the kernel configuration structure matching the block type,
+ * with pointer and dereference operators.
+ */
+
+/**
+ * \typedef RkISP1ParamsBlock::Type
+ * \brief The kernel configuration structure of the block
+ */
+
+/**
+ * \fn RkISP1ParamsBlock::RkISP1ParamsBlock()
+ * \brief Construct a type-safe parameters block
+ * \param[in] params The parameters buffer the block belongs to
+ * \param[in] data The configuration data of the block
+ */
+
+/**
+ * \fn RkISP1ParamsBlock::operator->() const
+ * \brief Access the configuration data of the block
+ * \return A pointer to the configuration data of the block
+ */
+
+/**
+ * \fn RkISP1ParamsBlock::operator->()
+ * \copydoc RkISP1ParamsBlock::operator->() const
+ */
+
+/**
+ * \fn RkISP1ParamsBlock::operator*() const &
+ * \brief Access the configuration data of the block
+ * \return A reference to the configuration data of the block
+ */
+
+/**
+ * \fn RkISP1ParamsBlock::operator*() &
+ * \copydoc RkISP1ParamsBlock::operator*() const &
+ */
+
+/**
+ * \class RkISP1Params
+ * \brief Fill the ISP parameters buffer
+ *
+ * The RkISP1Params class wraps the parameters buffer of a frame and writes
+ * the configuration of the ISP processing blocks that algorithms request
+ * through block(). It supports the legacy fixed format
+ * (V4L2_META_FMT_RK_ISP1_PARAMS) and the extensible format
+ * (V4L2_META_FMT_RK_ISP1_EXT_PARAMS) of the kernel driver transparently.
+ *
+ * Only the blocks that are requested are written to the buffer. With the
+ * legacy format, the configuration structures of the other blocks are left
+ * untouched and their bits in the module update masks are cleared, so that
+ * the driver doesn't apply them. With the extensible format, the buffer only
+ * contains the requested blocks, which reduces the amount of data written by
+ * the IPA and parsed by the driver.
+ *
+ * Algorithms shall thus only request the blocks whose configuration changes
+ * for the frame.
+ */
+
+/**
+ * \brief Construct an RkISP1Params for a parameters buffer
+ * \param[in] format The V4L2 format of the parameters buffer
+ * \param[in] data The parameters buffer memory
+ */
+RkISP1Params::RkISP1Params(uint32_t format, Span<uint8_t> data)
+	: format_(format), data_(data), used_(0)
+{
+	if (format_ == V4L2_META_FMT_RK_ISP1_PARAMS) {
+		struct rkisp1_params_cfg *cfg =
+			reinterpret_cast<struct rkisp1_params_cfg *>(data_.data());
+
+		/*
+		 * The configuration of the blocks is only read by the driver
+		 * for the modules whose update bit is set, there is no need to
+		 * clear the whole buffer.
+		 */
+		cfg->module_en_update = 0;
+		cfg->module_ens = 0;
+		cfg->module_cfg_update = 0;
+
+		used_ = sizeof(*cfg);
+	} else {
+		struct rkisp1_ext_params_cfg *cfg =
+			reinterpret_cast<struct rkisp1_ext_params_cfg *>(data_.data());
+
+		cfg->version = RKISP1_EXT_PARAM_BUFFER_V1;
+		cfg->data_size = 0;
+
+		used_ = offsetof(struct rkisp1_ext_params_cfg, data);
+	}
+}
+
+/**
+ * \fn RkISP1Params::block()
+ * \brief Retrieve a parameters block to fill
+ * \tparam B The block type
+ *
+ * The configuration data of the block is cleared the first time the block is
+ * retrieved for the frame, and the block is marked as updated. Subsequent
+ * calls return the same configuration data.
+ *
+ * \return A parameters block, with empty data if the buffer is too small to
+ * hold the block
+ */
+
+/**
+ * \fn RkISP1Params::format()
+ * \brief Retrieve the V4L2 format of the parameters buffer
+ * \return The V4L2 format of the parameters buffer
+ */
+
+/**
+ * \fn RkISP1Params::size()
+ * \brief Retrieve the number of bytes used in the parameters buffer
+ * \return The size of the parameters data
+ */
+
+/**
+ * \fn RkISP1Params::isDirty()
+ * \brief Check if a block has been updated for the frame
+ * \param[in] type The block type
+ * \return True if the block has been retrieved with block(), false otherwise
+ */
+
+Span<uint8_t> RkISP1Params::block(BlockType type)
+{
+	auto infoIt = kBlockTypeInfo.find(type);
+	if (infoIt == kBlockTypeInfo.end()) {
+		LOG(RkISP1Params, Error)
+			<< "Invalid parameters block type "
+			<< utils::to_underlying(type);
+		return {};
+	}
+
+	const BlockTypeInfo &info = infoIt->second;
+
+	/* Return the block if it has already been retrieved. */
+	auto cacheIt = blocks_.find(type);
+	if (cacheIt != blocks_.end())
+		return cacheIt->second;
+
+	Span<uint8_t> data;
+
+	if (format_ == V4L2_META_FMT_RK_ISP1_PARAMS) {
+		struct rkisp1_params_cfg *cfg =
+			reinterpret_cast<struct rkisp1_params_cfg *>(data_.data());
+
+		cfg->module_cfg_update |= info.enableBit;
+
+		data = data_.subspan(info.offset, info.size);
+		memset(data.data(), 0, data.size());
+	} else {
+		/* Blocks are aligned to 8 bytes in the extensible format. */
+		size_t size = utils::alignUp(sizeof(rkisp1_ext_params_block_header) + info.size, 8);
+		if (used_ + size > data_.size()) {
+			LOG(RkISP1Params, Error)
+				<< "Out of memory to allocate block type "
+				<< utils::to_underlying(type);
+			return {};
+		}
+
+		Span<uint8_t> block = data_.subspan(used_, size);
+		used_ += size;
+
+		struct rkisp1_ext_params_cfg *cfg =
+			reinterpret_cast<struct rkisp1_ext_params_cfg *>(data_.data());
+		cfg->data_size += size;
+
+		memset(block.data(), 0, block.size());
+
+		struct rkisp1_ext_params_block_header *header =
+			reinterpret_cast<struct rkisp1_ext_params_block_header *>(block.data());
+		header->type = info.type;
+		header->size = block.size();
+
+		data = block.subspan(sizeof(*header), info.size);
+	}
+
+	blocks_[type] = data;
+
+	return data;
+}
+
+void RkISP1Params::setBlockEnabled(BlockType type, bool enabled)
+{
+	if (format_ == V4L2_META_FMT_RK_ISP1_PARAMS) {
+		const BlockTypeInfo &info = kBlockTypeInfo.at(type);
+		struct rkisp1_params_cfg *cfg =
+			reinterpret_cast<struct rkisp1_params_cfg *>(data_.data());
+
+		cfg->module_en_update |= info.enableBit;
+		if (enabled)
+			cfg->module_ens |= info.enableBit;
+		else
+			cfg->module_ens &= ~info.enableBit;
+	} else {
+		auto it = blocks_.find(type);
+		if (it == blocks_.end())
+			return;
+
+		Span<uint8_t> data = it->second;
+		struct rkisp1_ext_params_block_header *header =
+			reinterpret_cast<struct rkisp1_ext_params_block_header *>(
+				data.data() - sizeof(*header));
+		header->flags &= ~(RKISP1_EXT_PARAMS_FL_BLOCK_ENABLE |
+				   RKISP1_EXT_PARAMS_FL_BLOCK_DISABLE);
+		header->flags |= enabled ? RKISP1_EXT_PARAMS_FL_BLOCK_ENABLE
+					 : RKISP1_EXT_PARAMS_FL_BLOCK_DISABLE;
+	}
+}
+
+} /* namespace ipa::rkisp1 */
+
+} /* namespace libcamera */
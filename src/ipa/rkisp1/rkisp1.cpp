@@ -30,8 +30,10 @@
 
 #include "algorithms/algorithm.h"
 #include "libipa/camera_sensor_helper.h"
+#include "libipa/timing.h"
 
 #include "ipa_context.h"
+#include "params.h"
 
 namespace libcamera {
 
@@ -116,7 +118,7 @@ const ControlInfoMap::Map rkisp1Controls{
 } /* namespace */
 
 IPARkISP1::IPARkISP1()
-	: context_({ {}, {}, {}, { kMaxFrameContexts }, {} })
+	: context_({ {}, {}, {}, { kMaxFrameContexts }, {}, nullptr })
 {
 }
 
@@ -156,6 +158,7 @@ int IPARkISP1::init(const IPASettings &settings, unsigned int hwRevision,
 		return -ENODEV;
 	}
 
+	context_.camHelper = camHelper_.get();
 	context_.configuration.sensor.lineDuration = sensorInfo.minLineLength
 						   * 1.0s / sensorInfo.pixelRate;
 
@@ -169,7 +172,7 @@ int IPARkISP1::init(const IPASettings &settings, unsigned int hwRevision,
 		return ret;
 	}
 
-	std::unique_ptr<libcamera::YamlObject> data = YamlParser::parse(file);
+	std::shared_ptr<const libcamera::YamlObject> data = YamlParser::parseCached(file);
 	if (!data)
 		return -EINVAL;
 
@@ -235,6 +238,7 @@ int IPARkISP1::configure(const IPAConfigInfo &ipaConfig,
 	const ControlInfo vBlank = sensorControls_.find(V4L2_CID_VBLANK)->second;
 	context_.configuration.sensor.defVBlank = vBlank.def().get<int32_t>();
 	context_.configuration.sensor.size = info.outputSize;
+	context_.configuration.paramFormat = ipaConfig.paramFormat;
 	context_.configuration.sensor.lineDuration = info.minLineLength * 1.0s / info.pixelRate;
 
 	/* Update the camera controls using the new sensor settings. */
@@ -253,6 +257,7 @@ int IPARkISP1::configure(const IPAConfigInfo &ipaConfig,
 		maxExposure * context_.configuration.sensor.lineDuration;
 	context_.configuration.sensor.minAnalogueGain = camHelper_->gain(minGain);
 	context_.configuration.sensor.maxAnalogueGain = camHelper_->gain(maxGain);
+	camHelper_->setGainCodeLimits(minGain, maxGain);
 
 	context_.configuration.raw = std::any_of(streamConfig.begin(), streamConfig.end(),
 		[](auto &cfg) -> bool {
@@ -323,17 +328,15 @@ void IPARkISP1::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 {
 	IPAFrameContext &frameContext = context_.frameContexts.get(frame);
 
-	rkisp1_params_cfg *params =
-		reinterpret_cast<rkisp1_params_cfg *>(
-			mappedBuffers_.at(bufferId).planes()[0].data());
-
-	/* Prepare parameters buffer. */
-	memset(params, 0, sizeof(*params));
+	RkISP1Params params(context_.configuration.paramFormat,
+			    mappedBuffers_.at(bufferId).planes()[0]);
 
-	for (auto const &algo : algorithms())
-		algo->prepare(context_, frame, frameContext, params);
+	for (auto const &algo : algorithms()) {
+		ScopedTiming timer(algorithmTiming(algo.get()).prepare);
+		algo->prepare(context_, frame, frameContext, &params);
+	}
 
-	paramsBufferReady.emit(frame);
+	paramsBufferReady.emit(frame, params.size());
 }
 
 void IPARkISP1::processStatsBuffer(const uint32_t frame, const uint32_t bufferId,
@@ -361,7 +364,7 @@ void IPARkISP1::processStatsBuffer(const uint32_t frame, const uint32_t bufferId
 		Algorithm *algo = static_cast<Algorithm *>(a.get());
 		if (algo->disabled_)
 			continue;
-		algo->process(context_, frame, frameContext, stats, metadata);
+		processAlgorithm(algo, context_, frame, frameContext, stats, metadata);
 	}
 
 	setControls(frame);
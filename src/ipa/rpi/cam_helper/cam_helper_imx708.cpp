@@ -342,7 +342,7 @@ bool CamHelperImx708::parseAEHist(const uint8_t *ptr, size_t len, unsigned bpp)
 		return false;
 	}
 
-	aeHistLinear_ = Histogram(hist, 128);
+	aeHistLinear_.reset({ hist, 128 });
 	aeHistAverage_ = count ? (sum / count) : 0;
 
 	return count != 0;
@@ -7,12 +7,15 @@
 #pragma once
 
 #include <initializer_list>
-#include <map>
-#include <optional>
+#include <stdexcept>
 #include <stdint.h>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/span.h>
 
+#include "libipa/embedded_data.h"
+
 /*
  * Camera metadata parser class. Usage as shown below.
  *
@@ -60,7 +63,37 @@ namespace RPiController {
 class MdParser
 {
 public:
-	using RegisterMap = std::map<uint32_t, uint32_t>;
+	/*
+	 * Register values found by the parser, in a flat array. The parsers
+	 * request a handful of registers, a linear search is faster than a
+	 * tree lookup and the array doesn't allocate on every frame.
+	 */
+	class RegisterMap
+	{
+	public:
+		void clear()
+		{
+			values_.clear();
+		}
+
+		void set(uint32_t reg, uint32_t value)
+		{
+			values_.emplace_back(reg, value);
+		}
+
+		uint32_t at(uint32_t reg) const
+		{
+			for (const auto &[r, value] : values_) {
+				if (r == reg)
+					return value;
+			}
+
+			throw std::out_of_range("register not found");
+		}
+
+	private:
+		std::vector<std::pair<uint32_t, uint32_t>> values_;
+	};
 
 	/*
 	 * Parser status codes:
@@ -112,10 +145,8 @@ protected:
 };
 
 /*
- * This isn't a full implementation of a metadata parser for SMIA sensors,
- * however, it does provide the findRegs function which will prove useful and
- * make it easier to implement parsers for other SMIA-like sensors (see
- * md_parser_imx219.cpp for an example).
+ * Parser for SMIA sensors. The parsing itself is shared with other IPAs and
+ * implemented by libipa, this class only adapts it to the MdParser interface.
  */
 
 class MdParserSmia final : public MdParser
@@ -127,29 +158,8 @@ public:
 			       RegisterMap &registers) override;
 
 private:
-	/* Maps register address to offset in the buffer. */
-	using OffsetMap = std::map<uint32_t, std::optional<uint32_t>>;
-
-	/*
-	 * Note that error codes > 0 are regarded as non-fatal; codes < 0
-	 * indicate a bad data buffer. Status codes are:
-	 * ParseOk     - found all registers, much happiness
-	 * MissingRegs - some registers found; should this be a hard error?
-	 * The remaining codes are all hard errors.
-	 */
-	enum ParseStatus {
-		ParseOk      =  0,
-		MissingRegs  =  1,
-		NoLineStart  = -1,
-		IllegalTag   = -2,
-		BadDummy     = -3,
-		BadLineEnd   = -4,
-		BadPadding   = -5
-	};
-
-	ParseStatus findRegs(libcamera::Span<const uint8_t> buffer);
-
-	OffsetMap offsets_;
+	std::vector<uint32_t> registerList_;
+	libcamera::ipa::SmiaEmbeddedDataParser parser_;
 };
 
 } /* namespace RPi */
@@ -5,6 +5,7 @@
  * ISP controller
  */
 
+#include <algorithm>
 #include <assert.h>
 
 #include <libcamera/base/file.h>
@@ -128,7 +129,7 @@ int Controller::read(char const *filename)
 		return -EINVAL;
 	}
 
-	std::unique_ptr<YamlObject> root = YamlParser::parse(file);
+	std::shared_ptr<const YamlObject> root = YamlParser::parseCached(file);
 	if (!root)
 		return -EINVAL;
 
@@ -178,12 +179,27 @@ int Controller::createAlgorithm(const std::string &name, const YamlObject &param
 		return 0;
 	}
 
+	/*
+	 * The optional run_period parameter, common to all algorithms, runs
+	 * the process() function once every run_period frames only.
+	 */
+	unsigned int runPeriod = params["run_period"].get<unsigned int>(1);
+	if (!runPeriod) {
+		LOG(RPiController, Error)
+			<< "Invalid run period for \"" << name << "\"";
+		return -EINVAL;
+	}
+
 	Algorithm *algo = (*it->second)(this);
 	int ret = algo->read(params);
 	if (ret)
 		return ret;
 
 	algorithms_.push_back(AlgorithmPtr(algo));
+	prepareTimings_.emplace_back(std::string(algo->name()) + " prepare");
+	processTimings_.emplace_back(std::string(algo->name()) + " process");
+	runPeriods_.push_back(runPeriod);
+	runPhases_.push_back(0);
 	return 0;
 }
 
@@ -197,21 +213,39 @@ void Controller::switchMode(CameraMode const &cameraMode, Metadata *metadata)
 {
 	for (auto &algo : algorithms_)
 		algo->switchMode(cameraMode, metadata);
+
+	/* Run all the algorithms on the first frame after a mode switch. */
+	std::fill(runPhases_.begin(), runPhases_.end(), 0);
 	switchModeCalled_ = true;
 }
 
 void Controller::prepare(Metadata *imageMetadata)
 {
 	assert(switchModeCalled_);
-	for (auto &algo : algorithms_)
+	for (auto const &[i, algo] : utils::enumerate(algorithms_)) {
+		ipa::ScopedTiming timer(prepareTimings_[i]);
 		algo->prepare(imageMetadata);
+	}
 }
 
 void Controller::process(StatisticsPtr stats, Metadata *imageMetadata)
 {
 	assert(switchModeCalled_);
-	for (auto &algo : algorithms_)
+	for (auto const &[i, algo] : utils::enumerate(algorithms_)) {
+		/*
+		 * The algorithms report their state in the image metadata
+		 * from prepare(), which runs on every frame and carries the
+		 * results of the last process() call over to the frames where
+		 * process() is skipped.
+		 */
+		unsigned int phase = runPhases_[i];
+		runPhases_[i] = (phase + 1) % runPeriods_[i];
+		if (phase)
+			continue;
+
+		ipa::ScopedTiming timer(processTimings_[i]);
 		algo->process(stats, imageMetadata);
+	}
 }
 
 Metadata &Controller::getGlobalMetadata()
@@ -18,6 +18,8 @@
 #include <libcamera/base/utils.h>
 #include "libcamera/internal/yaml_parser.h"
 
+#include <libipa/timing.h>
+
 #include "camera_mode.h"
 #include "device_status.h"
 #include "metadata.h"
@@ -69,6 +71,12 @@ protected:
 
 	Metadata globalMetadata_;
 	std::vector<AlgorithmPtr> algorithms_;
+	/* Execution time statistics, one entry per algorithm. */
+	std::vector<libcamera::ipa::TimingStats> prepareTimings_;
+	std::vector<libcamera::ipa::TimingStats> processTimings_;
+	/* Run period of process(), and frame phase within the period. */
+	std::vector<unsigned int> runPeriods_;
+	std::vector<unsigned int> runPhases_;
 	bool switchModeCalled_;
 
 private:
@@ -9,14 +9,59 @@
 /* A simple class for carrying arbitrary metadata, for example about an image. */
 
 #include <any>
-#include <map>
 #include <mutex>
+#include <stdint.h>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/thread_annotations.h>
 
 namespace RPiController {
 
+/*
+ * Metadata tags are hashed when constructed, which the compiler does at
+ * compile time for the string literals used throughout the algorithms, so
+ * that looking up an entry compares integers rather than strings.
+ */
+class MetadataTag
+{
+public:
+	constexpr MetadataTag(const char *name)
+		: MetadataTag(std::string_view(name))
+	{
+	}
+
+	constexpr MetadataTag(std::string_view name)
+		: name_(name), hash_(hash(name))
+	{
+	}
+
+	MetadataTag(const std::string &name)
+		: MetadataTag(std::string_view(name))
+	{
+	}
+
+	constexpr std::string_view name() const { return name_; }
+	constexpr uint64_t hash() const { return hash_; }
+
+private:
+	static constexpr uint64_t hash(std::string_view name)
+	{
+		/* 64-bit FNV-1a. */
+		uint64_t value = 0xcbf29ce484222325ULL;
+		for (char c : name) {
+			value ^= static_cast<uint8_t>(c);
+			value *= 0x100000001b3ULL;
+		}
+		return value;
+	}
+
+	std::string_view name_;
+	uint64_t hash_;
+};
+
 class LIBCAMERA_TSA_CAPABILITY("mutex") Metadata
 {
 public:
@@ -25,7 +70,7 @@ public:
 	Metadata(Metadata const &other)
 	{
 		std::scoped_lock otherLock(other.mutex_);
-		data_ = other.data_;
+		copyFrom(other);
 	}
 
 	Metadata(Metadata &&other)
@@ -36,33 +81,40 @@ public:
 	}
 
 	template<typename T>
-	void set(std::string const &tag, T const &value)
+	void set(MetadataTag tag, T const &value)
 	{
 		std::scoped_lock lock(mutex_);
-		data_[tag] = value;
+		setLocked(tag, value);
 	}
 
 	template<typename T>
-	int get(std::string const &tag, T &value) const
+	int get(MetadataTag tag, T &value) const
 	{
 		std::scoped_lock lock(mutex_);
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		const Entry *entry = find(tag.hash(), tag.name());
+		if (!entry)
 			return -1;
-		value = std::any_cast<T>(it->second);
+		value = std::any_cast<T>(entry->value);
 		return 0;
 	}
 
 	void clear()
 	{
 		std::scoped_lock lock(mutex_);
-		data_.clear();
+		/*
+		 * Keep the entries, and the storage of their values, so that
+		 * setting them again for the next frame doesn't allocate.
+		 */
+		for (Entry &entry : data_)
+			entry.valid = false;
 	}
 
 	Metadata &operator=(Metadata const &other)
 	{
 		std::scoped_lock lock(mutex_, other.mutex_);
-		data_ = other.data_;
+		for (Entry &entry : data_)
+			entry.valid = false;
+		copyFrom(other);
 		return *this;
 	}
 
@@ -77,7 +129,17 @@ public:
 	void merge(Metadata &other)
 	{
 		std::scoped_lock lock(mutex_, other.mutex_);
-		data_.merge(other.data_);
+		/*
+		 * Move the values whose tag doesn't exist here, and leave the
+		 * others in place.
+		 */
+		for (Entry &entry : other.data_) {
+			if (!entry.valid || find(entry.hash, entry.name))
+				continue;
+			Entry &slot = insert(entry.hash, entry.name);
+			slot.value = std::move(entry.value);
+			entry.valid = false;
+		}
 	}
 
 	void mergeCopy(const Metadata &other)
@@ -87,27 +149,37 @@ public:
 		 * If the metadata key exists, ignore this item and copy only
 		 * unique key/value pairs.
 		 */
-		data_.insert(other.data_.begin(), other.data_.end());
+		for (const Entry &entry : other.data_) {
+			if (!entry.valid || find(entry.hash, entry.name))
+				continue;
+			insert(entry.hash, entry.name).value = entry.value;
+		}
 	}
 
 	template<typename T>
-	T *getLocked(std::string const &tag)
+	T *getLocked(MetadataTag tag)
 	{
 		/*
 		 * This allows in-place access to the Metadata contents,
 		 * for which you should be holding the lock.
 		 */
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		Entry *entry = find(tag.hash(), tag.name());
+		if (!entry)
 			return nullptr;
-		return std::any_cast<T>(&it->second);
+		return std::any_cast<T>(&entry->value);
 	}
 
 	template<typename T>
-	void setLocked(std::string const &tag, T const &value)
+	void setLocked(MetadataTag tag, T const &value)
 	{
 		/* Use this only if you're holding the lock yourself. */
-		data_[tag] = value;
+		Entry &entry = insert(tag.hash(), tag.name());
+		/* Assign in place when possible, to reuse the value's storage. */
+		T *current = std::any_cast<T>(&entry.value);
+		if (current)
+			*current = value;
+		else
+			entry.value = value;
 	}
 
 	/*
@@ -120,8 +192,54 @@ public:
 	void unlock() LIBCAMERA_TSA_RELEASE() { mutex_.unlock(); }
 
 private:
+	struct Entry {
+		uint64_t hash;
+		std::string name;
+		std::any value;
+		bool valid;
+	};
+
+	const Entry *find(uint64_t hash, std::string_view name) const
+	{
+		for (const Entry &entry : data_) {
+			if (entry.valid && entry.hash == hash && entry.name == name)
+				return &entry;
+		}
+		return nullptr;
+	}
+
+	Entry *find(uint64_t hash, std::string_view name)
+	{
+		return const_cast<Entry *>(std::as_const(*this).find(hash, name));
+	}
+
+	Entry &insert(uint64_t hash, std::string_view name)
+	{
+		/* Find the entry for the tag, whether it has been cleared or not. */
+		for (Entry &entry : data_) {
+			if (entry.hash == hash && entry.name == name) {
+				entry.valid = true;
+				return entry;
+			}
+		}
+
+		return data_.emplace_back(Entry{ hash, std::string(name), {}, true });
+	}
+
+	void copyFrom(const Metadata &other)
+	{
+		for (const Entry &entry : other.data_) {
+			if (entry.valid)
+				insert(entry.hash, entry.name).value = entry.value;
+		}
+	}
+
 	mutable std::mutex mutex_;
-	std::map<std::string, std::any> data_;
+	/*
+	 * A small flat array, there are only a few tens of tags and scanning
+	 * them is cheaper than walking a map of strings.
+	 */
+	std::vector<Entry> data_;
 };
 
 } /* namespace RPiController */
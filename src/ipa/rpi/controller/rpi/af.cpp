@@ -7,7 +7,9 @@
 
 #include "af.h"
 
+#include <algorithm>
 #include <iomanip>
+#include <iterator>
 #include <math.h>
 #include <stdlib.h>
 
@@ -34,6 +36,9 @@ LOG_DEFINE_CATEGORY(RPiAf)
  * Gain and delay values are relative to the update rate, since much (not all)
  * of the delay is in the sensor and (for CDAF) ISP, not the lens mechanism;
  * but note that algorithms are updated at no more than 30 Hz.
+ *
+ * The predictive mode is disabled by default (jumpConf = 0). The lens delay
+ * and settling time default to values typical of a VCM driven over I2C.
  */
 
 Af::RangeDependentParams::RangeDependentParams()
@@ -52,7 +57,8 @@ Af::SpeedDependentParams::SpeedDependentParams()
 	  maxSlew(2.0),
 	  pdafFrames(20),
 	  dropoutFrames(6),
-	  stepFrames(4)
+	  stepFrames(4),
+	  jumpConf(0.0)
 {
 }
 
@@ -61,6 +67,8 @@ Af::CfgParams::CfgParams()
 	  confThresh(16),
 	  confClip(512),
 	  skipFrames(5),
+	  lensDelay(2),
+	  lensSettle(0.25),
 	  map()
 {
 }
@@ -94,6 +102,10 @@ void Af::SpeedDependentParams::read(const libcamera::YamlObject &params)
 	readNumber<uint32_t>(pdafFrames, params, "pdaf_frames");
 	readNumber<uint32_t>(dropoutFrames, params, "dropout_frames");
 	readNumber<uint32_t>(stepFrames, params, "step_frames");
+
+	/* The predictive mode is optional, don't warn if it isn't configured. */
+	if (params.contains("jump_conf"))
+		readNumber<double>(jumpConf, params, "jump_conf");
 }
 
 int Af::CfgParams::read(const libcamera::YamlObject &params)
@@ -139,6 +151,12 @@ int Af::CfgParams::read(const libcamera::YamlObject &params)
 	readNumber<uint32_t>(confClip, params, "conf_clip");
 	readNumber<uint32_t>(skipFrames, params, "skip_frames");
 
+	if (params.contains("lens_delay"))
+		readNumber<uint32_t>(lensDelay, params, "lens_delay");
+	if (params.contains("lens_settle"))
+		readNumber<double>(lensSettle, params, "lens_settle");
+	lensDelay = std::clamp(lensDelay, 1u, LensHistorySize - 1);
+
 	if (params.contains("map"))
 		map.readYaml(params["map"]);
 	else
@@ -188,7 +206,13 @@ Af::Af(Controller *controller)
 	  scanMaxContrast_(0.0),
 	  scanMinContrast_(1.0e9),
 	  scanData_(),
-	  reportState_(AfState::Idle)
+	  reportState_(AfState::Idle),
+	  lensHistory_(),
+	  lensFrame_(0),
+	  lensWait_(0),
+	  jump_(false),
+	  pdafSeen_(false),
+	  refining_(false)
 {
 	/*
 	 * Reserve space for data, to reduce memory fragmentation. It's too early
@@ -454,6 +478,54 @@ double Af::findPeak(unsigned i) const
 	return f;
 }
 
+/*
+ * Lens movements take effect after a delay, so PDAF phase is measured with
+ * respect to the lens position commanded cfg_.lensDelay frames earlier, not
+ * the current one.
+ */
+double Af::exposedLensPosition() const
+{
+	return lensHistory_[(lensFrame_ + LensHistorySize - cfg_.lensDelay) %
+			    LensHistorySize];
+}
+
+/*
+ * Number of frames, following a lens movement, whose statistics are taken
+ * while the lens is still in motion or settling.
+ */
+unsigned Af::lensWaitFrames(double distance) const
+{
+	return cfg_.lensDelay - 1 + static_cast<unsigned>(std::ceil(distance * cfg_.lensSettle));
+}
+
+bool Af::doJump(double phase, double conf)
+{
+	const SpeedDependentParams &speed = cfg_.speeds[speed_];
+
+	if (speed.jumpConf <= 0.0 || conf < speed.jumpConf)
+		return false;
+
+	/*
+	 * With high confidence, move straight to the predicted in-focus
+	 * position. Small corrections are left to the feedback loop.
+	 */
+	double target = std::clamp(exposedLensPosition() + phase * speed.pdafGain,
+				   cfg_.ranges[range_].focusMin,
+				   cfg_.ranges[range_].focusMax);
+	double distance = std::abs(target - fsmooth_);
+	if (distance <= speed.stepFine)
+		return false;
+
+	ftarget_ = target;
+	jump_ = true;
+	lensWait_ = lensWaitFrames(distance);
+	reportState_ = AfState::Scanning;
+
+	LOG(RPiAf, Debug) << "Jump: " << fsmooth_ << "->" << ftarget_
+			  << " wait=" << lensWait_;
+	return true;
+}
+
 void Af::doScan(double contrast, double phase, double conf)
 {
 	/* Record lens position, contrast and phase values for the current scan */
@@ -483,8 +555,17 @@ void Af::doScan(double contrast, double phase, double conf)
 		    contrast < cfg_.speeds[speed_].contrastRatio * scanMaxContrast_) {
 			/*
 			 * Finished fine scan, or termination based on contrast.
-			 * Use quadratic peak-finding to find best contrast position.
+			 * A refinement that did not bracket the peak means the
+			 * lens was further off than PDAF suggested: do a full scan.
+			 * Otherwise use quadratic peak-finding to find best contrast
+			 * position.
 			 */
+			if (refining_ && (scanMaxIndex_ == 0 ||
+					  scanMaxIndex_ + 1 == scanData_.size())) {
+				LOG(RPiAf, Debug) << "Refinement found no peak";
+				startProgrammedScan();
+				return;
+			}
 			ftarget_ = findPeak(scanMaxIndex_);
 			scanState_ = ScanState::Settle;
 		} else
@@ -556,15 +637,28 @@ void Af::doAF(double contrast, double phase, double conf)
 		 * fall back to a CDAF-based scan. To avoid "nuisance" scans,
 		 * scan only after a number of frames with low PDAF confidence.
 		 */
-		if (conf > (dropCount_ ? 1.0 : 0.25) * cfg_.confEpsilon) {
-			doPDAF(phase, conf);
+		if (lensWait_ > 0) {
+			/* PDAF data are unreliable while the lens moves after a jump */
+			lensWait_--;
+		} else if (conf > (dropCount_ ? 1.0 : 0.25) * cfg_.confEpsilon) {
+			if (!doJump(phase, conf))
+				doPDAF(phase, conf);
 			if (stepCount_ > 0)
 				stepCount_--;
 			else if (mode_ != AfModeContinuous)
 				scanState_ = ScanState::Idle;
 			dropCount_ = 0;
-		} else if (++dropCount_ == cfg_.speeds[speed_].dropoutFrames)
-			startProgrammedScan();
+			pdafSeen_ = true;
+		} else if (++dropCount_ == cfg_.speeds[speed_].dropoutFrames) {
+			/*
+			 * In predictive mode, if PDAF had been working, the lens
+			 * should be close to focus: try a local refinement first.
+			 */
+			if (cfg_.speeds[speed_].jumpConf > 0.0 && pdafSeen_)
+				startRefinement(fsmooth_);
+			else
+				startProgrammedScan();
+		}
 	} else if (scanState_ >= ScanState::Coarse && fsmooth_ == ftarget_) {
 		/*
 		 * Scanning sequence. This means PDAF has become unavailable.
@@ -577,7 +671,8 @@ void Af::doAF(double contrast, double phase, double conf)
 			stepCount_--;
 		else if (scanState_ == ScanState::Settle) {
 			if (prevContrast_ >= cfg_.speeds[speed_].contrastRatio * scanMaxContrast_ &&
-			    scanMinContrast_ <= cfg_.speeds[speed_].contrastRatio * scanMaxContrast_)
+			    (refining_ ||
+			     scanMinContrast_ <= cfg_.speeds[speed_].contrastRatio * scanMaxContrast_))
 				reportState_ = AfState::Focused;
 			else
 				reportState_ = AfState::Failed;
@@ -587,6 +682,7 @@ void Af::doAF(double contrast, double phase, double conf)
 			else
 				scanState_ = ScanState::Idle;
 			scanData_.clear();
+			refining_ = false;
 			last_mean = 0;
 		} else if (conf >= cfg_.confEpsilon && earlyTerminationByPhase(phase)) {
 			scanState_ = ScanState::Settle;
@@ -605,7 +701,11 @@ void Af::updateLensPosition()
 				      cfg_.ranges[range_].focusMax);
 	}
 
-	if (initted_) {
+	if (initted_ && jump_) {
+		/* predictive jump: go straight to target, delay is modelled */
+		fsmooth_ = ftarget_;
+		jump_ = false;
+	} else if (initted_) {
 		/* from a known lens position: apply slew rate limit */
 		fsmooth_ = std::clamp(ftarget_,
 				      fsmooth_ - cfg_.speeds[speed_].maxSlew,
@@ -615,6 +715,7 @@ void Af::updateLensPosition()
 		fsmooth_ = ftarget_;
 		initted_ = true;
 		skipCount_ = cfg_.skipFrames;
+		std::fill(std::begin(lensHistory_), std::end(lensHistory_), fsmooth_);
 	}
 }
 
@@ -631,6 +732,9 @@ void Af::startAF()
 		scanState_ = ScanState::Pdaf;
 		scanData_.clear();
 		dropCount_ = 0;
+		lensWait_ = 0;
+		pdafSeen_ = false;
+		refining_ = false;
 		reportState_ = AfState::Scanning;
 	} else
 		startProgrammedScan();
@@ -647,17 +751,38 @@ void Af::startProgrammedScan()
 	scanData_.clear();
 	stepCount_ = cfg_.speeds[speed_].stepFrames;
 	reportState_ = AfState::Scanning;
+	refining_ = false;
 	stable_frame_count = 0;
 	last_mean = 0;
 	trigger_when_stable = false;
 	last_agc_status = false;
 }
 
+/*
+ * Short CDAF scan around the given position: this is the usual fine scan,
+ * starting just after the expected peak.
+ */
+void Af::startRefinement(double focus)
+{
+	ftarget_ = std::min(focus + 2.0 * cfg_.speeds[speed_].stepFine,
+			    cfg_.ranges[range_].focusMax);
+	updateLensPosition();
+	scanState_ = ScanState::Fine;
+	scanMaxContrast_ = 0.0;
+	scanMinContrast_ = 1.0e9;
+	scanMaxIndex_ = 0;
+	scanData_.clear();
+	stepCount_ = cfg_.speeds[speed_].stepFrames;
+	reportState_ = AfState::Scanning;
+	refining_ = true;
+}
+
 void Af::goIdle()
 {
 	scanState_ = ScanState::Idle;
 	reportState_ = AfState::Idle;
 	scanData_.clear();
+	refining_ = false;
 }
 
 /*
@@ -701,6 +826,10 @@ void Af::prepare(Metadata *imageMetadata)
 				  << " phase=" << (int)phase << " conf=" << (int)conf;
 	}
 
+	/* Record the lens setting of this frame, for the lens delay model */
+	if (initted_)
+		lensHistory_[lensFrame_++ % LensHistorySize] = fsmooth_;
+
 	/* Report status and produce new lens setting */
 	AfStatus status;
 	if (pauseFlag_)
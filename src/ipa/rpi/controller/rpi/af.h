@@ -29,6 +29,15 @@
  * "nuisance" scans. During each interval where PDAF is not working, only
  * ONE scan will be performed; CAF cannot track objects using CDAF alone.
  *
+ * Optionally (when "jump_conf" is set in the tuning file), a predictive mode
+ * is used: when PDAF confidence is high, the lens jumps directly to the
+ * position predicted from the phase, instead of converging over many frames
+ * under the slew rate limit. The phase is referred to the lens position at
+ * the time the frame was exposed, and PDAF data are ignored until the lens
+ * has settled, according to a simple model of the lens delay. When PDAF
+ * becomes unavailable, a short CDAF refinement around the current position
+ * is attempted first, falling back to a full scan only if it finds no peak.
+ *
  */
 
 namespace RPiController {
@@ -89,6 +98,7 @@ private:
 		uint32_t pdafFrames;		/* number of iterations when triggered */
 		uint32_t dropoutFrames;		/* number of non-PDAF frames to switch to CDAF */
 		uint32_t stepFrames;		/* frames to skip in between steps of a scan */
+		double jumpConf;		/* min PDAF confidence for a jump (0 to disable) */
 
 		SpeedDependentParams();
 		void read(const libcamera::YamlObject &params);
@@ -101,6 +111,8 @@ private:
 		uint32_t confThresh;	       	/* PDAF confidence cell min (sensor-specific) */
 		uint32_t confClip;	       	/* PDAF confidence cell max (sensor-specific) */
 		uint32_t skipFrames;	       	/* frames to skip at start or modeswitch */
+		uint32_t lensDelay;		/* frames from lens command to exposure */
+		double lensSettle;		/* extra settling frames per dioptre moved */
 		libcamera::ipa::Pwl map;       	/* converts dioptres -> lens driver position */
 
 		CfgParams();
@@ -132,11 +144,15 @@ private:
 	void doPDAF(double phase, double conf);
 	bool earlyTerminationByPhase(double phase);
 	double findPeak(unsigned index) const;
+	double exposedLensPosition() const;
+	unsigned lensWaitFrames(double distance) const;
+	bool doJump(double phase, double conf);
 	void doScan(double contrast, double phase, double conf);
 	void doAF(double contrast, double phase, double conf);
 	void updateLensPosition();
 	void startAF();
 	void startProgrammedScan();
+	void startRefinement(double focus);
 	void goIdle();
 
 	/* Configuration and settings */
@@ -162,6 +178,15 @@ private:
 	std::vector<ScanRecord> scanData_;
 	AfState reportState_;
 
+	/* Predictive mode state */
+	static constexpr unsigned LensHistorySize = 8;
+	double lensHistory_[LensHistorySize];
+	unsigned lensFrame_;
+	unsigned lensWait_;
+	bool jump_;
+	bool pdafSeen_;
+	bool refining_;
+
 	bool isPdafEnabled_;
 	StatisticsPtr stats_;
 	Metadata* imageMetadata_;
@@ -663,7 +663,7 @@ static double computeInitialY(StatisticsPtr &stats, AwbStatus const &awb,
 		auto &hist = stats->yHist;
 		double minBin = std::min(1.0, 1.0 / gain) * hist.bins();
 		double binMean = hist.interBinMean(0.0, minBin);
-		double numUnsaturated = hist.cumulativeFreq(minBin);
+		double numUnsaturated = hist.cumulativeFrequency(minBin);
 		/* This term is from all the pixels that won't saturate. */
 		double ySum = binMean * gain * numUnsaturated;
 		/* And add the ones that will saturate. */
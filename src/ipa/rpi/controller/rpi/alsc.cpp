@@ -156,6 +156,16 @@ int Alsc::read(const libcamera::YamlObject &params)
 	config_.minG = params["min_G"].get<uint16_t>(50);
 	config_.omega = params["omega"].get<double>(1.3);
 	config_.nIter = params["n_iter"].get<uint32_t>(config_.tableSize.width + config_.tableSize.height);
+	std::string solver = params["solver"].get<std::string>("gauss_seidel");
+	if (solver == "gauss_seidel")
+		config_.solver = AlscSolver::GaussSeidel;
+	else if (solver == "red_black")
+		config_.solver = AlscSolver::RedBlack;
+	else {
+		LOG(RPiAlsc, Error) << "Unknown solver " << solver;
+		return -EINVAL;
+	}
+	config_.parallelSolve = params["parallel_solve"].get<int>(0);
 	config_.luminanceStrength =
 		params["luminance_strength"].get<double>(1.0);
 
@@ -183,6 +193,7 @@ int Alsc::read(const libcamera::YamlObject &params)
 
 	config_.defaultCt = params["default_ct"].get<double>(4500.0);
 	config_.threshold = params["threshold"].get<double>(1e-3);
+	config_.relativeThreshold = params["relative_threshold"].get<double>(0.0);
 	config_.lambdaBound = params["lambda_bound"].get<double>(0.05);
 
 	return 0;
@@ -753,17 +764,128 @@ static void reaverage(Array2D<double> &data)
 		      [ratio](double val) { return val * ratio; });
 }
 
+/*
+ * Padded single precision copy of the matrix M and of the lambdas, for the
+ * red-black solver. The planes have a border of one zone all around the
+ * table, whose matrix coefficients are zero, so that the neighbours of every
+ * zone can be accessed without any boundary special cases.
+ */
+struct RedBlackPlanes {
+	unsigned int stride;
+	std::array<std::vector<float>, 4> m;
+	std::vector<float> lambda;
+};
+
+static void constructRedBlackPlanes(const SparseArray<double> &M,
+				    const Array2D<double> &lambda,
+				    RedBlackPlanes &planes)
+{
+	const unsigned int X = lambda.dimensions().width;
+	const unsigned int Y = lambda.dimensions().height;
+
+	planes.stride = X + 2;
+	size_t size = planes.stride * (Y + 2);
+	for (auto &m : planes.m)
+		m.assign(size, 0.0f);
+	planes.lambda.assign(size, 0.0f);
+
+	for (unsigned int y = 0; y < Y; y++) {
+		for (unsigned int x = 0; x < X; x++) {
+			unsigned int i = y * X + x;
+			unsigned int p = (y + 1) * planes.stride + x + 1;
+
+			for (unsigned int k = 0; k < 4; k++)
+				planes.m[k][p] = M[i][k];
+			planes.lambda[p] = lambda[i];
+		}
+	}
+}
+
+/*
+ * Update all the zones of one colour. The zones are coloured like a
+ * chequerboard, so the four neighbours of a zone are all of the other colour
+ * and the zones of one colour can be updated in any order. The inner loop is
+ * free of dependencies and branches, which lets the compiler vectorise it.
+ */
+static float redBlackSorHalf(RedBlackPlanes &planes, const Size &dims,
+			     unsigned int colour, float omega, float min,
+			     float max)
+{
+	const unsigned int stride = planes.stride;
+	const float *m0 = planes.m[0].data(), *m1 = planes.m[1].data();
+	const float *m2 = planes.m[2].data(), *m3 = planes.m[3].data();
+	float *lambda = planes.lambda.data();
+	float maxDiff = 0;
+
+	for (unsigned int y = 1; y <= dims.height; y++) {
+		unsigned int end = y * stride + dims.width + 1;
+
+		for (unsigned int p = y * stride + 1 + ((y + colour) & 1); p < end; p += 2) {
+			float value = m0[p] * lambda[p - stride] + m1[p] * lambda[p + 1] +
+				      m2[p] * lambda[p + stride] + m3[p] * lambda[p - 1];
+			value = std::clamp(lambda[p] + (value - lambda[p]) * omega, min, max);
+			maxDiff = std::max(maxDiff, std::abs(value - lambda[p]));
+			lambda[p] = value;
+		}
+	}
+
+	return maxDiff;
+}
+
+static void runRedBlackIterations(Array2D<double> &lambda,
+				  const SparseArray<double> &M, double omega,
+				  unsigned int nIter, double threshold,
+				  double relativeThreshold, double lambdaBound)
+{
+	const Size &dims = lambda.dimensions();
+	RedBlackPlanes planes;
+	constructRedBlackPlanes(M, lambda, planes);
+
+	const float min = 1 - lambdaBound, max = 1 + lambdaBound;
+	float firstMaxDiff = 0;
+	for (unsigned int i = 0; i < nIter; i++) {
+		float maxDiff = redBlackSorHalf(planes, dims, 0, omega, min, max);
+		maxDiff = std::max(maxDiff, redBlackSorHalf(planes, dims, 1, omega, min, max));
+		if (i == 0)
+			firstMaxDiff = maxDiff;
+		if (maxDiff < threshold || maxDiff < relativeThreshold * firstMaxDiff) {
+			LOG(RPiAlsc, Debug)
+				<< "Stop after " << i + 1 << " iterations";
+			break;
+		}
+	}
+
+	for (unsigned int y = 0; y < dims.height; y++) {
+		for (unsigned int x = 0; x < dims.width; x++)
+			lambda[y * dims.width + x] =
+				planes.lambda[(y + 1) * planes.stride + x + 1];
+	}
+}
+
 static void runMatrixIterations(const Array2D<double> &C,
 				Array2D<double> &lambda,
 				const SparseArray<double> &W,
-				SparseArray<double> &M, double omega,
-				unsigned int nIter, double threshold, double lambdaBound)
+				SparseArray<double> &M, const AlscConfig &config)
 {
 	constructM(C, W, M);
+	if (config.solver == AlscSolver::RedBlack) {
+		runRedBlackIterations(lambda, M, config.omega, config.nIter,
+				      config.threshold, config.relativeThreshold,
+				      config.lambdaBound);
+		/* We're going to normalise the lambdas so the total average is 1. */
+		reaverage(lambda);
+		return;
+	}
+
 	double lastMaxDiff = std::numeric_limits<double>::max();
-	for (unsigned int i = 0; i < nIter; i++) {
-		double maxDiff = fabs(gaussSeidel2Sor(M, omega, lambda, lambdaBound));
-		if (maxDiff < threshold) {
+	double firstMaxDiff = 0;
+	for (unsigned int i = 0; i < config.nIter; i++) {
+		double maxDiff = fabs(gaussSeidel2Sor(M, config.omega, lambda,
+						      config.lambdaBound));
+		if (i == 0)
+			firstMaxDiff = maxDiff;
+		if (maxDiff < config.threshold ||
+		    maxDiff < config.relativeThreshold * firstMaxDiff) {
 			LOG(RPiAlsc, Debug)
 				<< "Stop after " << i + 1 << " iterations";
 			break;
@@ -815,7 +937,8 @@ void Alsc::doAlsc()
 {
 	Array2D<double> &cr = tmpC_[0], &cb = tmpC_[1], &calTableR = tmpC_[2],
 			&calTableB = tmpC_[3], &calTableTmp = tmpC_[4];
-	SparseArray<double> &wr = tmpM_[0], &wb = tmpM_[1], &M = tmpM_[2];
+	SparseArray<double> &wr = tmpM_[0], &wb = tmpM_[1], &mr = tmpM_[2],
+			    &mb = tmpM_[3];
 
 	/*
 	 * Calculate our R/B ("Cr"/"Cb") colour statistics, and assess which are
@@ -841,11 +964,20 @@ void Alsc::doAlsc()
 	/* Compute weights between zones. */
 	computeW(cr, config_.sigmaCr, wr);
 	computeW(cb, config_.sigmaCb, wb);
-	/* Run Gauss-Seidel iterations over the resulting matrix, for R and B. */
-	runMatrixIterations(cr, lambdaR_, wr, M, config_.omega, config_.nIter,
-			    config_.threshold, config_.lambdaBound);
-	runMatrixIterations(cb, lambdaB_, wb, M, config_.omega, config_.nIter,
-			    config_.threshold, config_.lambdaBound);
+	/*
+	 * Run Gauss-Seidel iterations over the resulting matrix, for R and B.
+	 * The two systems are independent, and can be solved concurrently.
+	 */
+	if (config_.parallelSolve) {
+		std::thread cbThread([&]() {
+			runMatrixIterations(cb, lambdaB_, wb, mb, config_);
+		});
+		runMatrixIterations(cr, lambdaR_, wr, mr, config_);
+		cbThread.join();
+	} else {
+		runMatrixIterations(cr, lambdaR_, wr, mr, config_);
+		runMatrixIterations(cb, lambdaB_, wb, mb, config_);
+	}
 	/*
 	 * Fold the calibrated gains into our final lambda values. (Note that on
 	 * the next run, we re-start with the lambda values that don't have the
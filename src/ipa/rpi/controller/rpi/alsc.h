@@ -81,6 +81,11 @@ struct AlscCalibration {
 	Array2D<double> table;
 };
 
+enum class AlscSolver {
+	GaussSeidel, /* symmetric Gauss-Seidel sweeps, then over-relaxed */
+	RedBlack, /* red-black ordered SOR in single precision */
+};
+
 struct AlscConfig {
 	/* Only repeat the ALSC calculation every "this many" frames */
 	uint16_t framePeriod;
@@ -94,12 +99,17 @@ struct AlscConfig {
 	uint16_t minG;
 	double omega;
 	uint32_t nIter;
+	AlscSolver solver;
+	/* solve the Cr and Cb tables concurrently on two threads */
+	bool parallelSolve;
 	Array2D<double> luminanceLut;
 	double luminanceStrength;
 	std::vector<AlscCalibration> calibrationsCr;
 	std::vector<AlscCalibration> calibrationsCb;
 	double defaultCt; /* colour temperature if no metadata found */
 	double threshold; /* iteration termination threshold */
+	/* terminate once the update falls below this fraction of the first one */
+	double relativeThreshold;
 	double lambdaBound; /* upper/lower bound for lambda from a value of 1 */
 	libcamera::Size tableSize;
 };
@@ -168,7 +178,7 @@ private:
 
 	/* Temporaries for the computations */
 	std::array<Array2D<double>, 5> tmpC_;
-	std::array<SparseArray<double>, 3> tmpM_;
+	std::array<SparseArray<double>, 4> tmpM_;
 };
 
 } /* namespace RPiController */
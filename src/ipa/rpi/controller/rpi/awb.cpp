@@ -123,6 +123,18 @@ int AwbConfig::read(const libcamera::YamlObject &params)
 			LOG(RPiAwb, Error) << "AwbConfig: no AWB priors configured";
 			return ret;
 		}
+		for (unsigned int i = 0; i + 1 < priors.size(); i++) {
+			AwbPriorTable &table = priorTables.emplace_back();
+			ipa::Pwl::combine(priors[i].prior, priors[i + 1].prior,
+					  [&](double x, double y0, double y1) {
+						  if (table.ct.empty() || x - table.ct.back() >= 1e-6) {
+							  table.ct.push_back(x);
+							  table.lo.push_back(y0);
+							  table.hi.push_back(y1);
+						  }
+						  return y0;
+					  });
+		}
 	}
 	if (params.contains("modes")) {
 		for (const auto &[key, value] : params["modes"].asDict()) {
@@ -450,22 +462,37 @@ void Awb::prepareStats()
 	}
 }
 
-double Awb::computeDelta2Sum(double gainR, double gainB)
+double Awb::computeDelta2Sum(double gainR, double gainB) const
 {
 	/*
 	 * Compute the sum of the squared colour error (non-greyness) as it
-	 * appears in the log likelihood equation.
+	 * appears in the log likelihood equation. The sum is accumulated in
+	 * independent lanes so that the compiler can vectorise the loop.
 	 */
-	double delta2Sum = 0;
-	for (auto &z : zones_) {
-		double deltaR = gainR * z.R - 1 - config_.whitepointR;
-		double deltaB = gainB * z.B - 1 - config_.whitepointB;
-		double delta2 = deltaR * deltaR + deltaB * deltaB;
-		/* LOG(RPiAwb, Debug) << "deltaR " << deltaR << " deltaB " << deltaB << " delta2 " << delta2; */
-		delta2 = std::min(delta2, config_.deltaLimit);
-		delta2Sum += delta2;
+	constexpr unsigned int kLanes = 4;
+	const double offsetR = 1 + config_.whitepointR;
+	const double offsetB = 1 + config_.whitepointB;
+	const double deltaLimit = config_.deltaLimit;
+	const double *zoneR = zonesR_.data();
+	const double *zoneB = zonesB_.data();
+	const size_t numZones = zonesR_.size();
+	double sums[kLanes] = {};
+	size_t i = 0;
+
+	for (; i + kLanes <= numZones; i += kLanes) {
+		for (unsigned int j = 0; j < kLanes; j++) {
+			double deltaR = gainR * zoneR[i + j] - offsetR;
+			double deltaB = gainB * zoneB[i + j] - offsetB;
+			sums[j] += std::min(deltaR * deltaR + deltaB * deltaB, deltaLimit);
+		}
+	}
+	for (; i < numZones; i++) {
+		double deltaR = gainR * zoneR[i] - offsetR;
+		double deltaB = gainB * zoneB[i] - offsetB;
+		sums[0] += std::min(deltaR * deltaR + deltaB * deltaB, deltaLimit);
 	}
-	return delta2Sum;
+
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
 }
 
 ipa::Pwl Awb::interpolatePrior()
@@ -485,12 +512,13 @@ ipa::Pwl Awb::interpolatePrior()
 			idx++;
 		double lux0 = config_.priors[idx].lux,
 		       lux1 = config_.priors[idx + 1].lux;
-		return ipa::Pwl::combine(config_.priors[idx].prior,
-				    config_.priors[idx + 1].prior,
-				    [&](double /*x*/, double y0, double y1) {
-					    return y0 + (y1 - y0) *
-							(lux_ - lux0) / (lux1 - lux0);
-				    });
+		double alpha = (lux_ - lux0) / (lux1 - lux0);
+		const AwbPriorTable &table = config_.priorTables[idx];
+		ipa::Pwl prior;
+		for (unsigned int i = 0; i < table.ct.size(); i++)
+			prior.append(table.ct[i],
+				     table.lo[i] + (table.hi[i] - table.lo[i]) * alpha);
+		return prior;
 	}
 }
 
@@ -647,8 +675,12 @@ void Awb::awbBayes()
 	 * May as well divide out G to save computeDelta2Sum from doing it over
 	 * and over.
 	 */
-	for (auto &z : zones_)
-		z.R = z.R / (z.G + 1), z.B = z.B / (z.G + 1);
+	zonesR_.resize(zones_.size());
+	zonesB_.resize(zones_.size());
+	for (unsigned int i = 0; i < zones_.size(); i++) {
+		zonesR_[i] = zones_[i].R / (zones_[i].G + 1);
+		zonesB_[i] = zones_[i].B / (zones_[i].G + 1);
+	}
 	/*
 	 * Get the current prior, and scale according to how many zones are
 	 * valid... not entirely sure about this.
@@ -9,6 +9,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <vector>
 
 #include <libcamera/geometry.h>
 
@@ -34,6 +35,16 @@ struct AwbPrior {
 	libcamera::ipa::Pwl prior; /* maps CT to prior log likelihood for this lux level */
 };
 
+/*
+ * The priors of two consecutive lux levels, sampled at the CT values of both,
+ * so that the prior for any lux level in between is a blend of each point.
+ */
+struct AwbPriorTable {
+	std::vector<double> ct;
+	std::vector<double> lo; /* prior log likelihood at the lower lux level */
+	std::vector<double> hi; /* prior log likelihood at the upper lux level */
+};
+
 struct AwbConfig {
 	AwbConfig() : defaultMode(nullptr) {}
 	int read(const libcamera::YamlObject &params);
@@ -50,6 +61,8 @@ struct AwbConfig {
 	libcamera::ipa::Pwl ctBInverse; /* inverse of ctB */
 	/* table of illuminant priors at different lux levels */
 	std::vector<AwbPrior> priors;
+	/* precomputed tables between each pair of consecutive priors */
+	std::vector<AwbPriorTable> priorTables;
 	/* AWB "modes" (determines the search range) */
 	std::map<std::string, AwbMode> modes;
 	AwbMode *defaultMode; /* mode used if no mode selected */
@@ -163,11 +176,14 @@ private:
 	void awbBayes();
 	void awbGrey();
 	void prepareStats();
-	double computeDelta2Sum(double gainR, double gainB);
+	double computeDelta2Sum(double gainR, double gainB) const;
 	libcamera::ipa::Pwl interpolatePrior();
 	double coarseSearch(libcamera::ipa::Pwl const &prior);
 	void fineSearch(double &t, double &r, double &b, libcamera::ipa::Pwl const &prior);
 	std::vector<RGB> zones_;
+	/* R/G and B/G of the zones, laid out for computeDelta2Sum */
+	std::vector<double> zonesR_;
+	std::vector<double> zonesB_;
 	std::vector<libcamera::ipa::Pwl::Point> points_;
 	/* manual r setting */
 	double manualR_;
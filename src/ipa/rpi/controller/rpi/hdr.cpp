@@ -95,6 +95,19 @@ void HdrConfig::read(const libcamera::YamlObject &params, const std::string &mod
 	diffPower = params["diff_power"].get<uint8_t>(13);
 	if (diffPower > 15)
 		LOG(RPiHdr, Fatal) << "Bad diff_power value in HDR mode " << name;
+
+	/*
+	 * When stitching, any number of exposures can be listed in the cadence
+	 * and they get merged one after the other. The tonemap and spatial
+	 * gains are only updated from the statistics of one channel, normally
+	 * the shortest exposure as it is the least likely to be saturated.
+	 */
+	std::string defaultStatsChannel = channelMap[cadence[0]];
+	for (const auto &[channel, channelName] : channelMap) {
+		if (channelName == "short")
+			defaultStatsChannel = channelName;
+	}
+	statsChannel = params["stats_channel"].get<std::string>(defaultStatsChannel);
 }
 
 Hdr::Hdr(Controller *controller)
@@ -226,11 +239,10 @@ bool Hdr::updateTonemap([[maybe_unused]] StatisticsPtr &stats, HdrConfig &config
 	}
 
 	/*
-	 * We wouldn't update the tonemap on short frames when in multi-exposure mode. But
-	 * we still need to output the most recent tonemap. Possibly we should make the
-	 * config indicate the channels for which we should update the tonemap?
+	 * When stitching exposures we only update the tonemap on frames from the
+	 * stats channel. But we still need to output the most recent tonemap.
 	 */
-	if (delayedStatus_.mode == "MultiExposure" && delayedStatus_.channel != "short")
+	if (config.stitchEnable && delayedStatus_.channel != config.statsChannel)
 		return true;
 
 	/*
@@ -338,8 +350,8 @@ void Hdr::updateGains(StatisticsPtr &stats, HdrConfig &config)
 	if (config.spatialGainCurve.empty())
 		return;
 
-	/* When alternating exposures, only compute these gains for the short frame. */
-	if (delayedStatus_.mode == "MultiExposure" && delayedStatus_.channel != "short")
+	/* When stitching exposures, only compute these gains for the stats channel. */
+	if (config.stitchEnable && delayedStatus_.channel != config.statsChannel)
 		return;
 
 	for (unsigned int i = 0; i < numRegions_; i++) {
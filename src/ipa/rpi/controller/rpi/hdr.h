@@ -48,6 +48,7 @@ struct HdrConfig {
 
 	/* Stitch related parameters. */
 	bool stitchEnable;
+	std::string statsChannel; /* channel used to update tonemap and gains when stitching */
 	uint16_t thresholdLo;
 	uint8_t diffPower;
 	double motionThreshold;
@@ -78,6 +78,8 @@ int generateLut(const ipa::Pwl &pwl, uint32_t *lut, std::size_t lutSize,
 		return -EINVAL;
 
 	int lastY = 0;
+	/* The x values increase, start each search from the previous span. */
+	int span = 0;
 	for (unsigned int i = 0; i < lutSize; i++) {
 		int x, y;
 		if (i < 32)
@@ -87,7 +89,7 @@ int generateLut(const ipa::Pwl &pwl, uint32_t *lut, std::size_t lutSize,
 		else
 			x = std::min(65535u, (i - 48) * 2048 + 32768);
 
-		y = pwl.eval(x);
+		y = pwl.eval(x, &span);
 		if (y < 0 || (i && y < lastY)) {
 			LOG(IPARPI, Error)
 				<< "Malformed PWL for Gamma, disabling!";
@@ -264,7 +266,7 @@ private:
 	/* TDN/HDR runtime need the following state. */
 	bool tdnReset_;
 	utils::Duration lastExposure_;
-	std::map<std::string, utils::Duration> lastStitchExposures_;
+	utils::Duration lastStitchExposure_;
 	HdrStatus lastStitchHdrStatus_;
 };
 
@@ -456,8 +458,7 @@ RPiController::StatisticsPtr IpaPiSP::platformProcessStats(Span<uint8_t> mem)
 					     Statistics::ColourStatsPos::PreLsc);
 
 	/* RGB histograms are not used, so do not populate them. */
-	statistics->yHist = RPiController::Histogram(stats->agc.histogram,
-						     PISP_AGC_STATS_NUM_BINS);
+	statistics->yHist.reset({ stats->agc.histogram, PISP_AGC_STATS_NUM_BINS });
 
 	statistics->awbRegions.init({ PISP_AWB_STATS_SIZE, PISP_AWB_STATS_SIZE });
 	for (i = 0; i < statistics->awbRegions.numRegions(); i++)
@@ -823,34 +824,29 @@ bool IpaPiSP::applyStitch(const StitchStatus *stitchStatus, const DeviceStatus *
 
 	/* Check for a change of HDR mode. That forces us to start over. */
 	if (modeChange)
-		lastStitchExposures_.clear();
-
-	if (hdrStatus->channel != "short" && hdrStatus->channel != "long") {
-		/* The channel *must* be long or short, anything else does not make sense. */
-		LOG(IPARPI, Warning) << "Stitch channel is not long or short";
-		return false;
-	}
+		lastStitchExposure_ = 0s;
 
 	/* Whatever happens, we're going to output this buffer now. */
 	global.bayer_enables |= PISP_BE_BAYER_ENABLE_STITCH_OUTPUT;
 
+	/*
+	 * The stitch input buffer holds the merge of the previous exposures
+	 * of the cadence, at the scale of the previous frame. Any number of
+	 * exposures can thus be merged by stitching each frame with the
+	 * previous output.
+	 */
 	utils::Duration exposure = deviceStatus->shutterSpeed * deviceStatus->analogueGain;
-	lastStitchExposures_[hdrStatus->channel] = exposure;
-
-	/* If the other channel hasn't been seen there's nothing more we can do. */
-	std::string otherChannel = hdrStatus->channel == "short" ? "long" : "short";
-	if (lastStitchExposures_.find(otherChannel) == lastStitchExposures_.end()) {
-		/* The first channel should be "short". */
-		if (hdrStatus->channel != "short")
-			LOG(IPARPI, Warning) << "First frame is not short";
+	utils::Duration otherExposure = lastStitchExposure_;
+	lastStitchExposure_ = exposure;
+
+	/* If no previous frame has been seen there's nothing more we can do. */
+	if (otherExposure == 0s)
 		return false;
-	}
 
-	/* We have both channels, we need to enable stitching. */
+	/* We have a previous exposure, we need to enable stitching. */
 	global.bayer_enables |= PISP_BE_BAYER_ENABLE_STITCH_INPUT + PISP_BE_BAYER_ENABLE_STITCH;
 
-	utils::Duration otherExposure = lastStitchExposures_[otherChannel];
-	bool phaseLong = hdrStatus->channel == "long";
+	bool phaseLong = exposure > otherExposure;
 	double ratio = phaseLong ? otherExposure / exposure : exposure / otherExposure;
 
 	pisp_be_stitch_config stitch = {};
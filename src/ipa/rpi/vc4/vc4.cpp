@@ -207,8 +207,7 @@ RPiController::StatisticsPtr IpaVc4::platformProcessStats(Span<uint8_t> mem)
 	unsigned int i;
 
 	/* RGB histograms are not used, so do not populate them. */
-	statistics->yHist = RPiController::Histogram(stats->hist[0].g_hist,
-						     hw.numHistogramBins);
+	statistics->yHist.reset({ stats->hist[0].g_hist, hw.numHistogramBins });
 
 	/* All region sums are based on a 16-bit normalised pipeline bit-depth. */
 	unsigned int scale = Statistics::NormalisationFactorPow2 - hw.pipelineWidth;
@@ -371,15 +370,22 @@ void IpaVc4::applyGamma(const struct ContrastStatus *contrastStatus, ControlList
 {
 	const unsigned int numGammaPoints = controller_.getHardwareConfig().numGammaPoints;
 	struct bcm2835_isp_gamma gamma;
+	double x[BCM2835_NUM_GAMMA_PTS], y[BCM2835_NUM_GAMMA_PTS];
 
 	for (unsigned int i = 0; i < numGammaPoints - 1; i++) {
-		int x = i < 16 ? i * 1024
-			       : (i < 24 ? (i - 16) * 2048 + 16384
-					 : (i - 24) * 4096 + 32768);
-		gamma.x[i] = x;
-		gamma.y[i] = std::min<uint16_t>(65535, contrastStatus->gammaCurve.eval(x));
+		x[i] = i < 16 ? i * 1024
+			      : (i < 24 ? (i - 16) * 2048 + 16384
+					: (i - 24) * 4096 + 32768);
+		gamma.x[i] = x[i];
 	}
 
+	/* The x values are sorted, evaluate the curve in a single sweep. */
+	contrastStatus->gammaCurve.evalMany({ x, numGammaPoints - 1 },
+					    { y, numGammaPoints - 1 });
+
+	for (unsigned int i = 0; i < numGammaPoints - 1; i++)
+		gamma.y[i] = std::min(65535.0, y[i]);
+
 	gamma.x[numGammaPoints - 1] = 65535;
 	gamma.y[numGammaPoints - 1] = 65535;
 	gamma.enabled = 1;
@@ -5,8 +5,11 @@
  * Simple Software Image Processing Algorithm module
  */
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <numeric>
+#include <optional>
 #include <stdint.h>
 #include <sys/mman.h>
 
@@ -69,26 +72,36 @@ public:
 		 const SharedFD &fdStats,
 		 const SharedFD &fdParams,
 		 const ControlInfoMap &sensorInfoMap) override;
-	int configure(const ControlInfoMap &sensorInfoMap) override;
+	int configure(const ControlInfoMap &sensorInfoMap,
+		      StatsConfig *statsConfig) override;
 
 	int start() override;
 	void stop() override;
 
-	void processStats(const ControlList &sensorControls) override;
+	void processStats(const uint32_t frame, const uint32_t bufferId,
+			  const ControlList &sensorControls) override;
 
 private:
 	void updateExposure(double exposureMSV);
 
-	DebayerParams *params_;
-	SwIspStats *stats_;
+	DebayerParamsBuffers *params_;
+	SwIspStatsBuffers *stats_;
 	std::unique_ptr<CameraSensorHelper> camHelper_;
 	ControlInfoMap sensorInfoMap_;
 	BlackLevel blackLevel_;
 
+	void updateCcmTables(DebayerParams *params, uint8_t blackLevel,
+			     const std::array<unsigned int, 3> &gains);
+
+	static constexpr float kGamma = 0.5;
 	static constexpr unsigned int kGammaLookupSize = 1024;
 	std::array<uint8_t, kGammaLookupSize> gammaTable_;
 	int lastBlackLevel_ = -1;
 
+	std::optional<std::array<std::array<double, 3>, 3>> ccm_;
+	StatsConfig statsConfig_;
+	DebayerParams::GammaLookupTable ccmGammaTable_;
+
 	int32_t exposureMin_, exposureMax_;
 	int32_t exposure_;
 	double againMin_, againMax_, againMinStep_;
@@ -99,9 +112,9 @@ private:
 IPASoftSimple::~IPASoftSimple()
 {
 	if (stats_)
-		munmap(stats_, sizeof(SwIspStats));
+		munmap(stats_, sizeof(SwIspStatsBuffers));
 	if (params_)
-		munmap(params_, sizeof(DebayerParams));
+		munmap(params_, sizeof(DebayerParamsBuffers));
 }
 
 int IPASoftSimple::init(const IPASettings &settings,
@@ -126,7 +139,7 @@ int IPASoftSimple::init(const IPASettings &settings,
 		return ret;
 	}
 
-	std::unique_ptr<libcamera::YamlObject> data = YamlParser::parse(file);
+	std::shared_ptr<const libcamera::YamlObject> data = YamlParser::parseCached(file);
 	if (!data)
 		return -EINVAL;
 
@@ -134,6 +147,39 @@ int IPASoftSimple::init(const IPASettings &settings,
 	unsigned int version = (*data)["version"].get<uint32_t>(0);
 	LOG(IPASoft, Debug) << "Tuning file version " << version;
 
+	/*
+	 * An optional colour correction matrix can be given as a list of 9
+	 * values in row-major order, to be applied to the white balanced
+	 * linear RGB values.
+	 */
+	if (data->contains("ccm")) {
+		std::optional<std::vector<double>> ccm =
+			(*data)["ccm"].getList<double>();
+		if (!ccm || ccm->size() != 9) {
+			LOG(IPASoft, Error) << "Invalid colour correction matrix";
+			return -EINVAL;
+		}
+
+		ccm_.emplace();
+		for (unsigned int i = 0; i < 9; i++)
+			(*ccm_)[i / 3][i % 3] = (*ccm)[i];
+	}
+
+	/*
+	 * The statistics subsampling can be tuned to trade accuracy for CPU
+	 * time. The zones are not used by the algorithms yet and are disabled
+	 * by default.
+	 */
+	const YamlObject &statsData = (*data)["statistics"];
+	statsConfig_.xSkip = statsData["x-skip"].get<uint32_t>(2);
+	statsConfig_.ySkip = statsData["y-skip"].get<uint32_t>(2);
+	statsConfig_.zones = statsData["zones"].get<bool>(false);
+
+	for (unsigned int i = 0; i < DebayerParams::kGammaLookupSize; i++)
+		ccmGammaTable_[i] = UINT8_MAX *
+				    std::pow(i / (DebayerParams::kGammaLookupSize - 1.0),
+					     kGamma);
+
 	params_ = nullptr;
 	stats_ = nullptr;
 
@@ -148,25 +194,25 @@ int IPASoftSimple::init(const IPASettings &settings,
 	}
 
 	{
-		void *mem = mmap(nullptr, sizeof(DebayerParams), PROT_WRITE,
+		void *mem = mmap(nullptr, sizeof(DebayerParamsBuffers), PROT_WRITE,
 				 MAP_SHARED, fdParams.get(), 0);
 		if (mem == MAP_FAILED) {
 			LOG(IPASoft, Error) << "Unable to map Parameters";
 			return -errno;
 		}
 
-		params_ = static_cast<DebayerParams *>(mem);
+		params_ = static_cast<DebayerParamsBuffers *>(mem);
 	}
 
 	{
-		void *mem = mmap(nullptr, sizeof(SwIspStats), PROT_READ,
+		void *mem = mmap(nullptr, sizeof(SwIspStatsBuffers), PROT_READ,
 				 MAP_SHARED, fdStats.get(), 0);
 		if (mem == MAP_FAILED) {
 			LOG(IPASoft, Error) << "Unable to map Statistics";
 			return -errno;
 		}
 
-		stats_ = static_cast<SwIspStats *>(mem);
+		stats_ = static_cast<SwIspStatsBuffers *>(mem);
 	}
 
 	/*
@@ -188,10 +234,13 @@ int IPASoftSimple::init(const IPASettings &settings,
 	return 0;
 }
 
-int IPASoftSimple::configure(const ControlInfoMap &sensorInfoMap)
+int IPASoftSimple::configure(const ControlInfoMap &sensorInfoMap,
+			     StatsConfig *statsConfig)
 {
 	sensorInfoMap_ = sensorInfoMap;
 
+	*statsConfig = statsConfig_;
+
 	const ControlInfo &exposureInfo = sensorInfoMap_.find(V4L2_CID_EXPOSURE)->second;
 	const ControlInfo &gainInfo = sensorInfoMap_.find(V4L2_CID_ANALOGUE_GAIN)->second;
 
@@ -245,9 +294,18 @@ void IPASoftSimple::stop()
 {
 }
 
-void IPASoftSimple::processStats(const ControlList &sensorControls)
+void IPASoftSimple::processStats(const uint32_t frame,
+				 const uint32_t bufferId,
+				 const ControlList &sensorControls)
 {
-	SwIspStats::Histogram histogram = stats_->yHistogram;
+	if (bufferId >= kSwIspStatsBufferCount) {
+		LOG_RATELIMITED(IPASoft, Error)
+			<< "Invalid statistics buffer " << bufferId;
+		return;
+	}
+
+	const SwIspStats *stats = &(*stats_)[bufferId];
+	SwIspStats::Histogram histogram = stats->yHistogram;
 	if (ignoreUpdates_ > 0)
 		blackLevel_.update(histogram);
 	const uint8_t blackLevel = blackLevel_.get();
@@ -260,9 +318,9 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 	const uint64_t nPixels = std::accumulate(
 		histogram.begin(), histogram.end(), 0);
 	const uint64_t offset = blackLevel * nPixels;
-	const uint64_t sumR = stats_->sumR_ - offset / 4;
-	const uint64_t sumG = stats_->sumG_ - offset / 2;
-	const uint64_t sumB = stats_->sumB_ - offset / 4;
+	const uint64_t sumR = stats->sumR_ - offset / 4;
+	const uint64_t sumG = stats->sumG_ - offset / 2;
+	const uint64_t sumB = stats->sumB_ - offset / 4;
 
 	/*
 	 * Calculate red and blue gains for AWB.
@@ -276,17 +334,28 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 
 	/* Update the gamma table if needed */
 	if (blackLevel != lastBlackLevel_) {
-		constexpr float gamma = 0.5;
 		const unsigned int blackIndex = blackLevel * kGammaLookupSize / 256;
 		std::fill(gammaTable_.begin(), gammaTable_.begin() + blackIndex, 0);
 		const float divisor = kGammaLookupSize - blackIndex - 1.0;
 		for (unsigned int i = blackIndex; i < kGammaLookupSize; i++)
 			gammaTable_[i] = UINT8_MAX *
-					 std::pow((i - blackIndex) / divisor, gamma);
+					 std::pow((i - blackIndex) / divisor, kGamma);
 
 		lastBlackLevel_ = blackLevel;
 	}
 
+	/*
+	 * The parameters computed from the statistics of this frame apply to
+	 * the next frame.
+	 */
+	const uint32_t paramsFrame = frame + 1;
+	const uint32_t paramsBufferId = paramsFrame % kDebayerParamsBufferCount;
+	DebayerParams *params = &(*params_)[paramsBufferId];
+
+	params->ccmEnabled = ccm_.has_value();
+	if (ccm_)
+		updateCcmTables(params, blackLevel, { gainR, gainG, gainB });
+
 	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
 		constexpr unsigned int div =
 			DebayerParams::kRGBLookupSize * 256 / kGammaLookupSize;
@@ -294,16 +363,16 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 
 		/* Apply gamma after gain! */
 		idx = std::min({ i * gainR / div, (kGammaLookupSize - 1) });
-		params_->red[i] = gammaTable_[idx];
+		params->red[i] = gammaTable_[idx];
 
 		idx = std::min({ i * gainG / div, (kGammaLookupSize - 1) });
-		params_->green[i] = gammaTable_[idx];
+		params->green[i] = gammaTable_[idx];
 
 		idx = std::min({ i * gainB / div, (kGammaLookupSize - 1) });
-		params_->blue[i] = gammaTable_[idx];
+		params->blue[i] = gammaTable_[idx];
 	}
 
-	setIspParams.emit();
+	setIspParams.emit(paramsFrame, paramsBufferId);
 
 	/* \todo Switch to the libipa/algorithm.h API someday. */
 
@@ -334,7 +403,7 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 
 	for (unsigned int i = 0; i < histogramSize; i++) {
 		unsigned int idx = (i - (i / yHistValsPerBinMod)) / yHistValsPerBin;
-		exposureBins[idx] += stats_->yHistogram[blackLevelHistIdx + i];
+		exposureBins[idx] += stats->yHistogram[blackLevelHistIdx + i];
 	}
 
 	for (unsigned int i = 0; i < kExposureBinsCount; i++) {
@@ -374,6 +443,40 @@ void IPASoftSimple::processStats(const ControlList &sensorControls)
 			    << " black level " << static_cast<unsigned int>(blackLevel);
 }
 
+/*
+ * Fill the CCM lookup tables. Each table entry holds the contribution of an
+ * input value of one colour to the three output colours, with the black level
+ * subtracted and the white balance gain applied, in gamma lookup table units.
+ */
+void IPASoftSimple::updateCcmTables(DebayerParams *params, uint8_t blackLevel,
+				    const std::array<unsigned int, 3> &gains)
+{
+	std::array<DebayerParams::CcmLookupTable *, 3> tables = {
+		&params->redCcm, &params->greenCcm, &params->blueCcm
+	};
+	const double scale = (DebayerParams::kGammaLookupSize - 1.0) /
+			     (DebayerParams::kRGBLookupSize - 1 - blackLevel) / 256;
+
+	for (unsigned int c = 0; c < 3; c++) {
+		DebayerParams::CcmLookupTable &table = *tables[c];
+		const double gain = gains[c] * scale;
+
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			const double value = std::max(0, static_cast<int>(i) - blackLevel) * gain;
+			const auto column = [&](unsigned int row) {
+				return static_cast<int16_t>(std::clamp(
+					std::round((*ccm_)[row][c] * value),
+					static_cast<double>(INT16_MIN),
+					static_cast<double>(INT16_MAX)));
+			};
+
+			table[i] = { column(0), column(1), column(2) };
+		}
+	}
+
+	params->gammaLut = ccmGammaTable_;
+}
+
 void IPASoftSimple::updateExposure(double exposureMSV)
 {
 	/*
@@ -11,10 +11,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <iostream>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/ipa/ipa_interface.h>
 #include <libcamera/ipa/ipa_module_info.h>
@@ -48,6 +50,7 @@ public:
 
 	void queueRequest(uint32_t frame, const ControlList &controls) override;
 	void fillParamsBuffer(uint32_t frame, uint32_t bufferId) override;
+	void setProcessingTime(uint32_t processingTime) override;
 
 private:
 	void initTrace();
@@ -55,10 +58,11 @@ private:
 
 	int fd_;
 	std::map<unsigned int, MappedFrameBuffer> buffers_;
+	std::chrono::microseconds processingTime_;
 };
 
 IPAVimc::IPAVimc()
-	: fd_(-1)
+	: fd_(-1), processingTime_(0)
 {
 	initTrace();
 }
@@ -157,10 +161,25 @@ void IPAVimc::fillParamsBuffer([[maybe_unused]] uint32_t frame, uint32_t bufferI
 		return;
 	}
 
+	/* Simulate the CPU time spent by the algorithms of a real IPA. */
+	if (processingTime_.count()) {
+		utils::time_point end = utils::clock::now() + processingTime_;
+		while (utils::clock::now() < end)
+			;
+	}
+
 	Flags<ipa::vimc::TestFlag> flags;
 	paramsBufferReady.emit(bufferId, flags);
 }
 
+void IPAVimc::setProcessingTime(uint32_t processingTime)
+{
+	LOG(IPAVimc, Debug)
+		<< "Simulating " << processingTime << "us of processing time";
+
+	processingTime_ = std::chrono::microseconds(processingTime);
+}
+
 void IPAVimc::initTrace()
 {
 	struct stat fifoStat;
@@ -197,10 +216,19 @@ void IPAVimc::trace(enum ipa::vimc::IPAOperationCode operation)
  */
 
 extern "C" {
+/*
+ * The module is also built for the virtual pipeline handler, which sets
+ * IPA_VIMC_PIPELINE_NAME. The module name stays "vimc" in both cases, to share
+ * the configuration files.
+ */
+#ifndef IPA_VIMC_PIPELINE_NAME
+#define IPA_VIMC_PIPELINE_NAME "vimc"
+#endif
+
 const struct IPAModuleInfo ipaModuleInfo = {
 	IPA_MODULE_API_VERSION,
 	0,
-	"vimc",
+	IPA_VIMC_PIPELINE_NAME,
 	"vimc",
 };
 
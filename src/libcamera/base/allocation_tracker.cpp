@@ -0,0 +1,343 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Heap allocation tracking instrumentation
+ */
+
+#include <libcamera/base/allocation_tracker.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+/**
+ * \file base/allocation_tracker.h
+ * \brief Heap allocation tracking instrumentation
+ */
+
+namespace libcamera {
+
+#if HAVE_ALLOC_TRACKING
+
+namespace {
+
+/*
+ * Maximum number of threads tracked individually. Allocations from threads
+ * created after the limit is reached are accounted to the first slot.
+ */
+constexpr unsigned int kMaxThreads = 256;
+
+/*
+ * The slots are constant-initialized, they can thus be used by allocations
+ * performed during static initialization of other translation units.
+ */
+struct ThreadSlot {
+	std::atomic<uint64_t> allocations;
+	char name[16];
+};
+
+std::array<ThreadSlot, kMaxThreads> slots;
+std::atomic<unsigned int> slotCount{ 1 };
+
+/* Protects the name of the slots */
+std::mutex slotNamesMutex;
+
+thread_local ThreadSlot *currentSlot = nullptr;
+
+/*
+ * Retrieve the name of the calling thread without allocating memory, as this
+ * is called from operator new.
+ */
+void readThreadName(ThreadSlot *slot)
+{
+	char name[sizeof(slot->name)] = {};
+	prctl(PR_GET_NAME, name);
+
+	std::lock_guard<std::mutex> locker(slotNamesMutex);
+	memcpy(slot->name, name, sizeof(name));
+	slot->name[sizeof(slot->name) - 1] = '\0';
+}
+
+ThreadSlot *registerThread()
+{
+	unsigned int index = slotCount.fetch_add(1, std::memory_order_relaxed);
+	if (index >= kMaxThreads)
+		return &slots[0];
+
+	ThreadSlot *slot = &slots[index];
+	readThreadName(slot);
+	return slot;
+}
+
+ThreadSlot *threadSlot()
+{
+	if (!currentSlot)
+		currentSlot = registerThread();
+
+	return currentSlot;
+}
+
+void *allocate(std::size_t size, std::size_t alignment)
+{
+	threadSlot()->allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (!size)
+		size = 1;
+
+	while (true) {
+		void *ptr;
+
+		if (alignment <= alignof(max_align_t)) {
+			ptr = malloc(size);
+		} else if (posix_memalign(&ptr, alignment, size)) {
+			ptr = nullptr;
+		}
+
+		if (ptr)
+			return ptr;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+
+		handler();
+	}
+}
+
+void *allocateNoThrow(std::size_t size, std::size_t alignment) noexcept
+{
+	try {
+		return allocate(size, alignment);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+} /* namespace */
+
+#endif /* HAVE_ALLOC_TRACKING */
+
+/**
+ * \class AllocationTracker
+ * \brief Count heap allocations per thread
+ *
+ * Allocations performed in the steady-state capture path (message, control
+ * list or container nodes, serialization buffers, ...) impact latency and
+ * determinism. The AllocationTracker helps catching them by counting the
+ * calls to the global operator new, for every thread in the process.
+ *
+ * The tracker is an instrumentation feature, compiled in only when libcamera
+ * is built with the alloc_tracking option enabled. The operator new and
+ * operator delete replacements are then provided by libcamera-base and apply
+ * to the whole process. When the option is disabled, enabled() returns false
+ * and all the counters read as zero.
+ *
+ * Threads are identified by their name. libcamera threads are named after the
+ * name passed to the Thread constructor, other threads use the name set by
+ * the application, or inherited from their parent.
+ *
+ * \context This class is \threadsafe.
+ */
+
+/**
+ * \struct AllocationTracker::ThreadStats
+ * \brief Allocation statistics for threads sharing a name
+ *
+ * \var AllocationTracker::ThreadStats::name
+ * \brief The thread name
+ *
+ * \var AllocationTracker::ThreadStats::allocations
+ * \brief The number of allocations performed by all threads named \a name
+ */
+
+/**
+ * \brief Check if allocation tracking is compiled in
+ * \return True if allocations are counted, false otherwise
+ */
+bool AllocationTracker::enabled()
+{
+#if HAVE_ALLOC_TRACKING
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * \brief Retrieve the number of allocations performed by the process
+ * \return The number of allocations performed by all threads since the
+ * process started
+ */
+uint64_t AllocationTracker::allocations()
+{
+	uint64_t allocations = 0;
+
+#if HAVE_ALLOC_TRACKING
+	unsigned int count = std::min(slotCount.load(), kMaxThreads);
+	for (unsigned int i = 0; i < count; i++)
+		allocations += slots[i].allocations.load(std::memory_order_relaxed);
+#endif
+
+	return allocations;
+}
+
+/**
+ * \brief Retrieve the number of allocations performed by the calling thread
+ *
+ * This function is inexpensive and doesn't allocate memory. It is meant to
+ * bracket a section of code to check that it doesn't allocate.
+ *
+ * \return The number of allocations performed by the calling thread since it
+ * started
+ */
+uint64_t AllocationTracker::threadAllocations()
+{
+#if HAVE_ALLOC_TRACKING
+	return threadSlot()->allocations.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * \brief Retrieve the allocation statistics of all threads
+ *
+ * The statistics of threads that share the same name, including threads that
+ * have exited, are accumulated in a single entry.
+ *
+ * \return The allocation statistics, sorted by thread name
+ */
+std::vector<AllocationTracker::ThreadStats> AllocationTracker::threadStats()
+{
+	std::vector<ThreadStats> stats;
+
+#if HAVE_ALLOC_TRACKING
+	/* Reserve memory first to avoid skewing the counters of this thread. */
+	stats.reserve(kMaxThreads);
+
+	unsigned int count = std::min(slotCount.load(), kMaxThreads);
+
+	std::lock_guard<std::mutex> locker(slotNamesMutex);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const ThreadSlot &slot = slots[i];
+		uint64_t allocations = slot.allocations.load(std::memory_order_relaxed);
+		if (!i && !allocations)
+			continue;
+
+		std::string name = i ? slot.name : "other";
+		auto it = std::find_if(stats.begin(), stats.end(),
+				       [&](const ThreadStats &s) { return s.name == name; });
+		if (it != stats.end())
+			it->allocations += allocations;
+		else
+			stats.push_back({ std::move(name), allocations });
+	}
+
+	std::sort(stats.begin(), stats.end(),
+		  [](const ThreadStats &a, const ThreadStats &b) {
+			  return a.name < b.name;
+		  });
+#endif
+
+	return stats;
+}
+
+/**
+ * \brief Update the name of the calling thread after it has been changed
+ */
+void AllocationTracker::updateThreadName()
+{
+#if HAVE_ALLOC_TRACKING
+	readThreadName(threadSlot());
+#endif
+}
+
+} /* namespace libcamera */
+
+#if HAVE_ALLOC_TRACKING
+
+void *operator new(std::size_t size)
+{
+	return libcamera::allocate(size, 0);
+}
+
+void *operator new[](std::size_t size)
+{
+	return libcamera::allocate(size, 0);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return libcamera::allocateNoThrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return libcamera::allocateNoThrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+	return libcamera::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return libcamera::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment,
+		   const std::nothrow_t &) noexcept
+{
+	return libcamera::allocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment,
+		     const std::nothrow_t &) noexcept
+{
+	return libcamera::allocateNoThrow(size, static_cast<std::size_t>(alignment));
+}
+
+/*
+ * Both malloc() and posix_memalign() allocations are released with free(). The
+ * nothrow variants of operator delete forward to these.
+ */
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+	free(ptr);
+}
+
+#endif /* HAVE_ALLOC_TRACKING */
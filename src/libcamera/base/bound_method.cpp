@@ -6,6 +6,11 @@
  */
 
 #include <libcamera/base/bound_method.h>
+
+#include <atomic>
+#include <iterator>
+#include <new>
+
 #include <libcamera/base/message.h>
 #include <libcamera/base/object.h>
 #include <libcamera/base/semaphore.h>
@@ -18,6 +23,210 @@
 
 namespace libcamera {
 
+namespace details {
+
+/*
+ * The asynchronous method invocations allocate a bound method for
+ * Object::invokeMethod(), a pack of arguments and an InvokeMessage, and free
+ * them once the invocation completes, usually in another thread. To avoid
+ * going through the heap for every signal, the blocks are recycled per thread
+ * in a few size classes.
+ *
+ * Each thread owns a pool cache, created on first use. Blocks freed in the
+ * owning thread go back to its free lists directly. Blocks freed in other
+ * threads are pushed to a lock-free stack of the owner, collected when its
+ * free lists run empty. The cache is reference counted by the thread and the
+ * allocated blocks, and is destroyed when the thread has exited and all its
+ * blocks have been freed.
+ */
+
+namespace {
+
+constexpr std::size_t kPoolBlockSizes[] = { 64, 128, 256 };
+constexpr unsigned int kPoolSizeClasses = std::size(kPoolBlockSizes);
+constexpr unsigned int kPoolMaxFreeBlocks = 256;
+
+struct PoolCache;
+
+struct alignas(std::max_align_t) PoolBlock {
+	PoolCache *owner;
+	unsigned int sizeClass;
+};
+
+/* Free blocks are linked through their payload. */
+PoolBlock *&nextBlock(PoolBlock *block)
+{
+	return *reinterpret_cast<PoolBlock **>(block + 1);
+}
+
+struct PoolCache {
+	void put(PoolBlock *block)
+	{
+		const unsigned int sizeClass = block->sizeClass;
+
+		if (freeCount[sizeClass] >= kPoolMaxFreeBlocks) {
+			::operator delete(block);
+			return;
+		}
+
+		nextBlock(block) = freeBlocks[sizeClass];
+		freeBlocks[sizeClass] = block;
+		freeCount[sizeClass]++;
+	}
+
+	PoolBlock *get(unsigned int sizeClass)
+	{
+		if (!freeBlocks[sizeClass])
+			collect();
+
+		PoolBlock *block = freeBlocks[sizeClass];
+		if (!block)
+			return nullptr;
+
+		freeBlocks[sizeClass] = nextBlock(block);
+		freeCount[sizeClass]--;
+		return block;
+	}
+
+	void putRemote(PoolBlock *block)
+	{
+		PoolBlock *head = remoteBlocks.load(std::memory_order_relaxed);
+		do {
+			nextBlock(block) = head;
+		} while (!remoteBlocks.compare_exchange_weak(head, block,
+							     std::memory_order_release,
+							     std::memory_order_relaxed));
+	}
+
+	void collect()
+	{
+		PoolBlock *block = remoteBlocks.exchange(nullptr, std::memory_order_acquire);
+		while (block) {
+			PoolBlock *next = nextBlock(block);
+			put(block);
+			block = next;
+		}
+	}
+
+	void clear()
+	{
+		collect();
+
+		for (unsigned int i = 0; i < kPoolSizeClasses; i++) {
+			while (PoolBlock *block = freeBlocks[i]) {
+				freeBlocks[i] = nextBlock(block);
+				::operator delete(block);
+			}
+
+			freeCount[i] = 0;
+		}
+	}
+
+	void unref()
+	{
+		if (refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		clear();
+		delete this;
+	}
+
+	PoolBlock *freeBlocks[kPoolSizeClasses] = {};
+	unsigned int freeCount[kPoolSizeClasses] = {};
+
+	std::atomic<PoolBlock *> remoteBlocks{ nullptr };
+	std::atomic<unsigned int> refs{ 1 };
+	std::atomic<bool> orphaned{ false };
+};
+
+thread_local PoolCache *currentPool = nullptr;
+thread_local bool currentPoolExited = false;
+
+struct PoolCacheReleaser {
+	~PoolCacheReleaser()
+	{
+		PoolCache *cache = currentPool;
+
+		currentPool = nullptr;
+		currentPoolExited = true;
+
+		if (!cache)
+			return;
+
+		cache->orphaned.store(true, std::memory_order_release);
+		cache->clear();
+		cache->unref();
+	}
+};
+
+thread_local PoolCacheReleaser poolCacheReleaser;
+
+PoolCache *threadPool()
+{
+	if (currentPool || currentPoolExited)
+		return currentPool;
+
+	/* Odr-use the releaser to register its destructor for this thread. */
+	[[maybe_unused]] PoolCacheReleaser *releaser = &poolCacheReleaser;
+
+	currentPool = new PoolCache();
+	return currentPool;
+}
+
+} /* namespace */
+
+void *poolAllocate(std::size_t size)
+{
+	const std::size_t blockSize = size + sizeof(PoolBlock);
+	unsigned int sizeClass = 0;
+
+	while (sizeClass < kPoolSizeClasses && kPoolBlockSizes[sizeClass] < blockSize)
+		sizeClass++;
+
+	PoolCache *cache = sizeClass < kPoolSizeClasses ? threadPool() : nullptr;
+	PoolBlock *block;
+
+	if (cache) {
+		block = cache->get(sizeClass);
+		if (!block)
+			block = static_cast<PoolBlock *>(::operator new(kPoolBlockSizes[sizeClass]));
+
+		cache->refs.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		block = static_cast<PoolBlock *>(::operator new(blockSize));
+	}
+
+	block->owner = cache;
+	block->sizeClass = sizeClass;
+
+	return block + 1;
+}
+
+void poolDeallocate(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	PoolBlock *block = static_cast<PoolBlock *>(ptr) - 1;
+	PoolCache *owner = block->owner;
+
+	if (!owner) {
+		::operator delete(block);
+		return;
+	}
+
+	if (owner == currentPool)
+		owner->put(block);
+	else if (!owner->orphaned.load(std::memory_order_acquire))
+		owner->putRemote(block);
+	else
+		::operator delete(block);
+
+	owner->unref();
+}
+
+} /* namespace details */
+
 /**
  * \enum ConnectionType
  * \brief Connection type for asynchronous communication
@@ -0,0 +1,391 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Epoll-based event dispatcher
+ */
+
+#include <libcamera/base/event_dispatcher_epoll.h>
+
+#include <chrono>
+#include <iomanip>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+/**
+ * \file base/event_dispatcher_epoll.h
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Event)
+
+static const char *notifierType(EventNotifier::Type type)
+{
+	if (type == EventNotifier::Read)
+		return "read";
+	if (type == EventNotifier::Write)
+		return "write";
+	if (type == EventNotifier::Exception)
+		return "exception";
+
+	return "";
+}
+
+/**
+ * \class EventDispatcherEpoll
+ * \brief An epoll-based event dispatcher
+ *
+ * This event dispatcher keeps the file descriptors of the event notifiers
+ * registered with the kernel, and only updates the registration when the
+ * notifiers change. The cost of waiting for events is thus independent of the
+ * number of event notifiers. Timers are kept sorted by deadline, and a timerfd
+ * is armed for the earliest one.
+ *
+ * Unlike the poll-based dispatcher, file descriptors closed while their event
+ * notifiers are enabled are silently dropped by epoll. Their notifiers are not
+ * disabled automatically and shall be disabled by their owner.
+ */
+
+EventDispatcherEpoll::EventDispatcherEpoll()
+	: processingEvents_(false)
+{
+	/*
+	 * Create the epoll, event and timer fds. Failures are fatal as we
+	 * can't implement an interruptible dispatcher without them.
+	 */
+	epollfd_ = UniqueFD(epoll_create1(EPOLL_CLOEXEC));
+	if (!epollfd_.isValid())
+		LOG(Event, Fatal) << "Unable to create epoll fd";
+
+	eventfd_ = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+	if (!eventfd_.isValid())
+		LOG(Event, Fatal) << "Unable to create eventfd";
+
+	timerfd_ = UniqueFD(timerfd_create(CLOCK_MONOTONIC,
+					   TFD_CLOEXEC | TFD_NONBLOCK));
+	if (!timerfd_.isValid())
+		LOG(Event, Fatal) << "Unable to create timerfd";
+
+	for (int fd : { eventfd_.get(), timerfd_.get() }) {
+		struct epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+
+		if (epoll_ctl(epollfd_.get(), EPOLL_CTL_ADD, fd, &event) < 0)
+			LOG(Event, Fatal)
+				<< "Unable to watch fd " << fd << ": "
+				<< strerror(errno);
+	}
+}
+
+EventDispatcherEpoll::~EventDispatcherEpoll()
+{
+}
+
+void EventDispatcherEpoll::registerEventNotifier(EventNotifier *notifier)
+{
+	EventNotifierSetEpoll &set = notifiers_[notifier->fd()];
+	EventNotifier::Type type = notifier->type();
+
+	if (set.notifiers[type] && set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< "Ignoring duplicate " << notifierType(type)
+			<< " notifier for fd " << notifier->fd();
+		return;
+	}
+
+	const uint32_t previous = set.events();
+	set.notifiers[type] = notifier;
+
+	updateNotifiers(notifier->fd(), previous, set.events());
+}
+
+void EventDispatcherEpoll::unregisterEventNotifier(EventNotifier *notifier)
+{
+	auto iter = notifiers_.find(notifier->fd());
+	if (iter == notifiers_.end())
+		return;
+
+	EventNotifierSetEpoll &set = iter->second;
+	EventNotifier::Type type = notifier->type();
+
+	if (!set.notifiers[type])
+		return;
+
+	if (set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< notifierType(type) << " notifier for fd "
+			<< notifier->fd() << " is not registered";
+		return;
+	}
+
+	const uint32_t previous = set.events();
+	set.notifiers[type] = nullptr;
+
+	const uint32_t events = set.events();
+	updateNotifiers(notifier->fd(), previous, events);
+
+	if (events)
+		return;
+
+	/*
+	 * Don't race with event processing if this function is called from an
+	 * event notifier. The notifiers_ entry will be erased by
+	 * processEvents().
+	 */
+	if (processingEvents_) {
+		staleFds_.push_back(notifier->fd());
+		return;
+	}
+
+	notifiers_.erase(iter);
+}
+
+void EventDispatcherEpoll::registerTimer(Timer *timer)
+{
+	unregisterTimer(timer);
+
+	timers_.emplace(timer->deadline(), timer);
+	deadlines_[timer] = timer->deadline();
+}
+
+void EventDispatcherEpoll::unregisterTimer(Timer *timer)
+{
+	/*
+	 * The timer deadline may have been updated already, look up the
+	 * deadline the timer has been registered with.
+	 */
+	auto iter = deadlines_.find(timer);
+	if (iter == deadlines_.end())
+		return;
+
+	timers_.erase({ iter->second, timer });
+	deadlines_.erase(iter);
+}
+
+void EventDispatcherEpoll::processEvents()
+{
+	struct epoll_event events[kMaxEvents];
+	int ret;
+
+	Thread::current()->dispatchMessages();
+
+	armTimer();
+
+	/* Wait for events and process notifiers and timers. */
+	do {
+		ret = epoll_wait(epollfd_.get(), events, kMaxEvents, -1);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Event, Warning) << "epoll_wait() failed with " << strerror(-ret);
+	}
+
+	processingEvents_ = true;
+
+	for (int i = 0; i < ret; i++) {
+		const int fd = events[i].data.fd;
+
+		if (fd == eventfd_.get())
+			processInterrupt();
+		else if (fd == timerfd_.get())
+			processTimerfd();
+		else
+			processNotifiers(fd, events[i].events);
+	}
+
+	processingEvents_ = false;
+
+	/* Erase the notifiers_ entries emptied while processing events. */
+	for (int fd : staleFds_) {
+		auto iter = notifiers_.find(fd);
+		if (iter == notifiers_.end())
+			continue;
+
+		if (!iter->second.events())
+			notifiers_.erase(iter);
+	}
+
+	staleFds_.clear();
+
+	processTimers();
+}
+
+void EventDispatcherEpoll::interrupt()
+{
+	uint64_t value = 1;
+	ssize_t ret = write(eventfd_.get(), &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to interrupt event dispatcher ("
+			<< ret << ")";
+	}
+}
+
+uint32_t EventDispatcherEpoll::EventNotifierSetEpoll::events() const
+{
+	uint32_t events = 0;
+
+	if (notifiers[EventNotifier::Read])
+		events |= EPOLLIN;
+	if (notifiers[EventNotifier::Write])
+		events |= EPOLLOUT;
+	if (notifiers[EventNotifier::Exception])
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+void EventDispatcherEpoll::updateNotifiers(int fd, uint32_t previous,
+					   uint32_t events)
+{
+	if (events == previous)
+		return;
+
+	struct epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd;
+
+	const int op = !events ? EPOLL_CTL_DEL
+		       : !previous ? EPOLL_CTL_ADD
+				   : EPOLL_CTL_MOD;
+	int ret = epoll_ctl(epollfd_.get(), op, fd, &event);
+
+	/*
+	 * The kernel drops closed file descriptors from the epoll set, a new
+	 * file may thus reuse the number of a registered one, or a stale one
+	 * may have vanished.
+	 */
+	if (ret < 0 && op == EPOLL_CTL_ADD && errno == EEXIST)
+		ret = epoll_ctl(epollfd_.get(), EPOLL_CTL_MOD, fd, &event);
+	else if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+		ret = epoll_ctl(epollfd_.get(), EPOLL_CTL_ADD, fd, &event);
+	else if (ret < 0 && op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF))
+		ret = 0;
+
+	if (ret < 0)
+		LOG(Event, Warning)
+			<< "Failed to update the events of fd " << fd << ": "
+			<< strerror(errno);
+}
+
+void EventDispatcherEpoll::armTimer()
+{
+	const utils::time_point deadline = !timers_.empty()
+					 ? timers_.begin()->first
+					 : utils::time_point();
+
+	if (deadline == armedDeadline_)
+		return;
+
+	/* A zero expiration time disarms the timer, fire as soon as possible. */
+	struct itimerspec spec = {};
+	if (!timers_.empty()) {
+		spec.it_value = utils::duration_to_timespec(deadline.time_since_epoch());
+		if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec)
+			spec.it_value.tv_nsec = 1;
+
+		LOG(Event, Debug)
+			<< "next timer " << timers_.begin()->second << " expires at "
+			<< spec.it_value.tv_sec << "."
+			<< std::setfill('0') << std::setw(9)
+			<< spec.it_value.tv_nsec;
+	}
+
+	if (timerfd_settime(timerfd_.get(), TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+		LOG(Event, Error)
+			<< "Failed to arm timer: " << strerror(errno);
+		return;
+	}
+
+	armedDeadline_ = deadline;
+}
+
+void EventDispatcherEpoll::processInterrupt()
+{
+	uint64_t value;
+	ssize_t ret = read(eventfd_.get(), &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to process interrupt (" << ret << ")";
+	}
+}
+
+void EventDispatcherEpoll::processTimerfd()
+{
+	uint64_t expirations;
+	ssize_t ret = read(timerfd_.get(), &expirations, sizeof(expirations));
+	if (ret != sizeof(expirations) && !(ret < 0 && errno == EAGAIN)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to process timer (" << ret << ")";
+	}
+
+	/* The timerfd is now disarmed, arm it again for the next timer. */
+	armedDeadline_ = utils::time_point();
+}
+
+void EventDispatcherEpoll::processNotifiers(int fd, uint32_t events)
+{
+	static const struct {
+		EventNotifier::Type type;
+		uint32_t events;
+	} types[] = {
+		{ EventNotifier::Read, EPOLLIN },
+		{ EventNotifier::Write, EPOLLOUT },
+		{ EventNotifier::Exception, EPOLLPRI },
+	};
+
+	auto iter = notifiers_.find(fd);
+	if (iter == notifiers_.end())
+		return;
+
+	/*
+	 * The entry isn't erased while processing events, the reference stays
+	 * valid if the notifiers register or unregister notifiers.
+	 */
+	EventNotifierSetEpoll &set = iter->second;
+
+	for (const auto &type : types) {
+		EventNotifier *notifier = set.notifiers[type.type];
+
+		if (notifier && (events & type.events))
+			notifier->activated.emit();
+	}
+}
+
+void EventDispatcherEpoll::processTimers()
+{
+	utils::time_point now = utils::clock::now();
+
+	while (!timers_.empty()) {
+		auto [deadline, timer] = *timers_.begin();
+		if (deadline > now)
+			break;
+
+		timers_.erase(timers_.begin());
+		deadlines_.erase(timer);
+
+		timer->stop();
+		timer->timeout.emit();
+	}
+}
+
+} /* namespace libcamera */
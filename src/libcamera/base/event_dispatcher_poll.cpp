@@ -113,31 +113,28 @@ void EventDispatcherPoll::unregisterEventNotifier(EventNotifier *notifier)
 
 void EventDispatcherPoll::registerTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if ((*iter)->deadline() > timer->deadline()) {
-			timers_.insert(iter, timer);
-			return;
-		}
-	}
+	unregisterTimer(timer);
 
-	timers_.push_back(timer);
+	/*
+	 * Timers with the same deadline are inserted after the existing ones,
+	 * and thus expire in registration order.
+	 */
+	auto iter = timers_.emplace(timer->deadline(), timer);
+	timerEntries_[timer] = iter;
 }
 
 void EventDispatcherPoll::unregisterTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if (*iter == timer) {
-			timers_.erase(iter);
-			return;
-		}
+	/*
+	 * Look the timer up by pointer, its deadline may have been updated
+	 * since it has been registered.
+	 */
+	auto iter = timerEntries_.find(timer);
+	if (iter == timerEntries_.end())
+		return;
 
-		/*
-		 * As the timers list is ordered, we can stop as soon as we go
-		 * past the deadline.
-		 */
-		if ((*iter)->deadline() > timer->deadline())
-			break;
-	}
+	timers_.erase(iter->second);
+	timerEntries_.erase(iter);
 }
 
 void EventDispatcherPoll::processEvents()
@@ -202,7 +199,7 @@ short EventDispatcherPoll::EventNotifierSetPoll::events() const
 int EventDispatcherPoll::poll(std::vector<struct pollfd> *pollfds)
 {
 	/* Compute the timeout. */
-	Timer *nextTimer = !timers_.empty() ? timers_.front() : nullptr;
+	Timer *nextTimer = !timers_.empty() ? timers_.begin()->second : nullptr;
 	struct timespec timeout;
 
 	if (nextTimer) {
@@ -294,11 +291,13 @@ void EventDispatcherPoll::processTimers()
 	utils::time_point now = utils::clock::now();
 
 	while (!timers_.empty()) {
-		Timer *timer = timers_.front();
-		if (timer->deadline() > now)
+		auto [deadline, timer] = *timers_.begin();
+		if (deadline > now)
 			break;
 
-		timers_.pop_front();
+		timers_.erase(timers_.begin());
+		timerEntries_.erase(timer);
+
 		timer->stop();
 		timer->timeout.emit();
 	}
@@ -198,6 +198,17 @@ bool File::open(File::OpenMode mode)
  * \return True if the file is open, false otherwise
  */
 
+/**
+ * \fn int File::fd() const
+ * \brief Retrieve the file descriptor of the open file
+ *
+ * The file descriptor remains owned by the File. It can be used to query the
+ * properties of the file that is actually open, for instance with fstat(),
+ * which avoids races with the file being replaced on the file system.
+ *
+ * \return The file descriptor, or -1 if the file isn't open
+ */
+
 /**
  * \fn OpenMode File::openMode() const
  * \brief Retrieve the file open mode
@@ -8,14 +8,25 @@
 #include <libcamera/base/log.h>
 
 #include <array>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <syslog.h>
+#include <thread>
 #include <time.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <libcamera/logging.h>
@@ -23,6 +34,7 @@
 #include <libcamera/base/backtrace.h>
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/thread.h>
+#include <libcamera/base/unique_fd.h>
 #include <libcamera/base/utils.h>
 
 /**
@@ -52,6 +64,12 @@
  * of the file. The file must be writable and is truncated if it exists. If any
  * error occurs when opening the file, the file is ignored and the log is output
  * to std::cerr.
+ *
+ * Options may be appended to the LIBCAMERA_LOG_FILE value, separated by commas.
+ * The "async" option hands the formatted messages to a dedicated writer thread
+ * instead of writing them to the file or syslog from the thread that logs. The
+ * "binary" option stores the messages in a binary ring buffer file, decoded by
+ * the utils/decode-log.py script.
  */
 
 /**
@@ -97,6 +115,444 @@ static const char *log_severity_name(LogSeverity severity)
 		return "UNKWN";
 }
 
+/**
+ * \brief Asynchronous log writer
+ *
+ * The AsyncLogWriter class moves the cost of writing log messages out of the
+ * threads that log. Messages are queued in a bounded lock-free ring buffer
+ * and written by a dedicated thread. When the ring buffer is full, messages
+ * are dropped and counted instead of blocking the caller, and the number of
+ * dropped messages is reported in the log when space becomes available.
+ *
+ * The writer thread is a plain std::thread, as a libcamera Thread would log
+ * itself.
+ */
+class AsyncLogWriter
+{
+public:
+	using WriteFunction = std::function<void(LogSeverity, const std::string &)>;
+
+	AsyncLogWriter(WriteFunction write);
+	~AsyncLogWriter();
+
+	void push(LogSeverity severity, std::string &&str);
+	void flush();
+
+private:
+	static constexpr size_t kQueueSize = 1024;
+
+	struct Entry {
+		std::atomic<size_t> sequence;
+		LogSeverity severity;
+		std::string str;
+	};
+
+	bool pop(LogSeverity *severity, std::string *str);
+	void reportDropped();
+	void run();
+
+	WriteFunction write_;
+
+	std::array<Entry, kQueueSize> entries_;
+	alignas(64) std::atomic<size_t> enqueuePos_;
+	alignas(64) size_t dequeuePos_;
+
+	std::atomic<unsigned int> pending_;
+	std::atomic<unsigned int> dropped_;
+	std::atomic<bool> exit_;
+
+	sem_t available_;
+	std::thread thread_;
+};
+
+/**
+ * \brief Construct an asynchronous log writer
+ * \param[in] write The function that writes a message to the log output
+ *
+ * The writer thread is started immediately and calls \a write for every
+ * message.
+ */
+AsyncLogWriter::AsyncLogWriter(WriteFunction write)
+	: write_(std::move(write)), enqueuePos_(0), dequeuePos_(0),
+	  pending_(0), dropped_(0), exit_(false)
+{
+	/*
+	 * The sequence number of each entry tells which position may use it
+	 * next: the entry is free for position pos when its sequence equals
+	 * pos, and holds the message of position pos when it equals pos + 1.
+	 */
+	for (size_t i = 0; i < kQueueSize; ++i)
+		entries_[i].sequence.store(i, std::memory_order_relaxed);
+
+	sem_init(&available_, 0, 0);
+
+	thread_ = std::thread(&AsyncLogWriter::run, this);
+}
+
+/**
+ * \brief Destroy the asynchronous log writer
+ *
+ * All the queued messages are written before the writer thread is stopped.
+ */
+AsyncLogWriter::~AsyncLogWriter()
+{
+	exit_.store(true, std::memory_order_release);
+	sem_post(&available_);
+	thread_.join();
+
+	sem_destroy(&available_);
+}
+
+/**
+ * \brief Queue a message for writing
+ * \param[in] severity The message severity
+ * \param[in] str The formatted message
+ *
+ * This function never blocks. If the ring buffer is full, the message is
+ * dropped.
+ */
+void AsyncLogWriter::push(LogSeverity severity, std::string &&str)
+{
+	size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+	Entry *entry;
+
+	for (;;) {
+		entry = &entries_[pos % kQueueSize];
+		size_t sequence = entry->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) -
+				static_cast<intptr_t>(pos);
+
+		if (diff == 0) {
+			if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+							      std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			/* The ring buffer is full. */
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = enqueuePos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	entry->severity = severity;
+	entry->str = std::move(str);
+
+	pending_.fetch_add(1, std::memory_order_relaxed);
+	entry->sequence.store(pos + 1, std::memory_order_release);
+
+	sem_post(&available_);
+}
+
+/**
+ * \brief Wait until all the queued messages have been written
+ *
+ * This is used before aborting on fatal errors, to avoid losing the messages
+ * that explain the failure.
+ */
+void AsyncLogWriter::flush()
+{
+	while (pending_.load(std::memory_order_acquire))
+		sched_yield();
+}
+
+bool AsyncLogWriter::pop(LogSeverity *severity, std::string *str)
+{
+	Entry *entry = &entries_[dequeuePos_ % kQueueSize];
+	size_t sequence = entry->sequence.load(std::memory_order_acquire);
+	if (sequence != dequeuePos_ + 1)
+		return false;
+
+	*severity = entry->severity;
+	*str = std::move(entry->str);
+	entry->str.clear();
+
+	/* Release the entry for the next round of the ring buffer. */
+	entry->sequence.store(dequeuePos_ + kQueueSize, std::memory_order_release);
+	dequeuePos_++;
+
+	return true;
+}
+
+void AsyncLogWriter::run()
+{
+	LogSeverity severity;
+	std::string str;
+
+	for (;;) {
+		/*
+		 * The semaphore is posted once per message, and once to exit.
+		 * Messages may be published out of order by concurrent
+		 * producers, so drain all the published ones on every wakeup.
+		 */
+		while (sem_wait(&available_) < 0 && errno == EINTR)
+			;
+
+		bool exit = exit_.load(std::memory_order_acquire);
+
+		while (pop(&severity, &str)) {
+			reportDropped();
+			write_(severity, str);
+
+			pending_.fetch_sub(1, std::memory_order_release);
+		}
+
+		if (exit)
+			break;
+	}
+
+	reportDropped();
+}
+
+void AsyncLogWriter::reportDropped()
+{
+	unsigned int dropped = dropped_.exchange(0, std::memory_order_relaxed);
+	if (dropped)
+		write_(LogWarning, std::to_string(dropped) +
+				   " log messages dropped\n");
+}
+
+/**
+ * \brief Binary log writer
+ *
+ * The BinaryLog class stores log messages in a memory-mapped file, without
+ * formatting the message header as text and without a system call per
+ * message. The file is made of a header, a string table and a ring buffer of
+ * records.
+ *
+ * The category names and message locations are stored once in the string
+ * table, records reference them by index. Each record stores the category and
+ * location indices, the thread ID, the severity, the timestamp in nanoseconds
+ * and the message text. When the ring buffer is full, the oldest records are
+ * overwritten. As the file is shared, its contents survive a crash of the
+ * process.
+ *
+ * All integers are stored in the native byte order. The file layout is
+ * documented in utils/decode-log.py, which decodes the file to text.
+ */
+class BinaryLog
+{
+public:
+	BinaryLog(const char *path);
+	~BinaryLog();
+
+	bool isValid() const { return map_ != nullptr; }
+
+	void write(const LogCategory *category, LogSeverity severity,
+		   const utils::time_point &timestamp,
+		   const std::string &location, const std::string &msg);
+
+private:
+	static constexpr uint32_t kVersion = 1;
+	static constexpr size_t kHeaderSize = 4096;
+	static constexpr size_t kStringsSize = 1024 * 1024;
+	static constexpr size_t kRingSize = 16 * 1024 * 1024;
+	static constexpr size_t kMaxMessageSize = 64 * 1024;
+
+	static constexpr uint32_t kPadding = UINT32_MAX;
+	static constexpr uint32_t kNoString = UINT32_MAX - 1;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		uint64_t stringsOffset;
+		uint64_t stringsSize;
+		uint64_t ringOffset;
+		uint64_t ringSize;
+		uint64_t stringsUsed;
+		uint64_t head;
+		uint64_t tail;
+	};
+
+	struct Record {
+		uint32_t size;
+		uint32_t category;
+		uint32_t location;
+		uint32_t thread;
+		uint64_t timestamp;
+		uint32_t length;
+		uint8_t severity;
+		uint8_t reserved[3];
+	};
+
+	uint32_t intern(const std::string &str);
+	void reserve(size_t size);
+
+	Mutex mutex_;
+
+	UniqueFD fd_;
+	uint8_t *map_;
+	Header *header_;
+	uint8_t *strings_;
+	uint8_t *ring_;
+
+	uint32_t stringCount_;
+	std::unordered_map<std::string, uint32_t> stringIds_;
+	std::unordered_map<const LogCategory *, uint32_t> categoryIds_;
+};
+
+/**
+ * \brief Construct a binary log writer
+ * \param[in] path Full path to the log file
+ *
+ * The file is created, or truncated if it exists.
+ */
+BinaryLog::BinaryLog(const char *path)
+	: map_(nullptr), header_(nullptr), strings_(nullptr), ring_(nullptr),
+	  stringCount_(0)
+{
+	const size_t size = kHeaderSize + kStringsSize + kRingSize;
+
+	fd_ = UniqueFD(open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+	if (!fd_.isValid())
+		return;
+
+	if (ftruncate(fd_.get(), size) < 0)
+		return;
+
+	void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 fd_.get(), 0);
+	if (map == MAP_FAILED)
+		return;
+
+	map_ = static_cast<uint8_t *>(map);
+	header_ = reinterpret_cast<Header *>(map_);
+	strings_ = map_ + kHeaderSize;
+	ring_ = strings_ + kStringsSize;
+
+	header_->version = kVersion;
+	header_->headerSize = kHeaderSize;
+	header_->stringsOffset = kHeaderSize;
+	header_->stringsSize = kStringsSize;
+	header_->ringOffset = kHeaderSize + kStringsSize;
+	header_->ringSize = kRingSize;
+	header_->stringsUsed = 0;
+	header_->head = 0;
+	header_->tail = 0;
+
+	/* Index 0 is the empty string, used for messages without a category. */
+	intern(std::string());
+
+	/* Write the magic last, the header is then complete. */
+	memcpy(header_->magic, "LCLOGBIN", sizeof(header_->magic));
+}
+
+BinaryLog::~BinaryLog()
+{
+	if (map_)
+		munmap(map_, kHeaderSize + kStringsSize + kRingSize);
+}
+
+/**
+ * \brief Write a message to the binary log
+ * \param[in] category The message category, or nullptr
+ * \param[in] severity The message severity
+ * \param[in] timestamp The message timestamp
+ * \param[in] location The message location, as a "file:line" string
+ * \param[in] msg The message text
+ */
+void BinaryLog::write(const LogCategory *category, LogSeverity severity,
+		      const utils::time_point &timestamp,
+		      const std::string &location, const std::string &msg)
+{
+	MutexLocker locker(mutex_);
+
+	uint32_t categoryId = 0;
+	if (category) {
+		auto it = categoryIds_.find(category);
+		if (it != categoryIds_.end()) {
+			categoryId = it->second;
+		} else {
+			categoryId = intern(category->name());
+			categoryIds_[category] = categoryId;
+		}
+	}
+
+	const uint32_t length = std::min(msg.size(), kMaxMessageSize);
+	const size_t size = utils::alignUp(sizeof(Record) + length, 8);
+
+	reserve(size);
+
+	uint64_t offset = header_->head % kRingSize;
+	Record *record = reinterpret_cast<Record *>(ring_ + offset);
+	record->size = size;
+	record->category = categoryId;
+	record->location = intern(location);
+	record->thread = Thread::currentId();
+	record->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		timestamp.time_since_epoch()).count();
+	record->length = length;
+	record->severity = severity;
+	memset(record->reserved, 0, sizeof(record->reserved));
+	memcpy(record + 1, msg.data(), length);
+
+	header_->head += size;
+}
+
+/*
+ * Return the index of a string in the string table, adding it if needed. The
+ * entries are stored as a 16-bit length followed by the characters.
+ */
+uint32_t BinaryLog::intern(const std::string &str)
+{
+	auto it = stringIds_.find(str);
+	if (it != stringIds_.end())
+		return it->second;
+
+	const size_t length = std::min<size_t>(str.size(), UINT16_MAX);
+	if (header_->stringsUsed + sizeof(uint16_t) + length > kStringsSize)
+		return kNoString;
+
+	uint8_t *entry = strings_ + header_->stringsUsed;
+	const uint16_t len = length;
+	memcpy(entry, &len, sizeof(len));
+	memcpy(entry + sizeof(len), str.data(), length);
+
+	header_->stringsUsed += sizeof(len) + length;
+
+	uint32_t id = stringCount_++;
+	stringIds_[str] = id;
+	return id;
+}
+
+/*
+ * Make room for a record of \a size bytes at the head of the ring buffer.
+ * Records don't wrap around the end of the ring buffer, the space left at the
+ * end is filled with a padding record when it's too small. The oldest records
+ * are dropped when the ring buffer is full.
+ */
+void BinaryLog::reserve(size_t size)
+{
+	uint64_t offset = header_->head % kRingSize;
+
+	if (offset + size > kRingSize) {
+		const size_t padding = kRingSize - offset;
+
+		while (header_->head + padding - header_->tail > kRingSize) {
+			const Record *oldest = reinterpret_cast<const Record *>(
+				ring_ + header_->tail % kRingSize);
+			header_->tail += oldest->size;
+		}
+
+		/*
+		 * Record sizes are multiples of 8 bytes, the padding is large
+		 * enough for the size and category fields.
+		 */
+		Record *record = reinterpret_cast<Record *>(ring_ + offset);
+		record->size = padding;
+		record->category = kPadding;
+
+		header_->head += padding;
+	}
+
+	while (header_->head + size - header_->tail > kRingSize) {
+		const Record *oldest = reinterpret_cast<const Record *>(
+			ring_ + header_->tail % kRingSize);
+		header_->tail += oldest->size;
+	}
+}
+
 /**
  * \brief Log output
  *
@@ -107,6 +563,7 @@ class LogOutput
 public:
 	LogOutput(const char *path, bool color);
 	LogOutput(std::ostream *stream, bool color);
+	LogOutput(std::unique_ptr<BinaryLog> binary);
 	LogOutput();
 	~LogOutput();
 
@@ -114,13 +571,20 @@ public:
 	void write(const LogMessage &msg);
 	void write(const std::string &msg);
 
+	void setAsync();
+	void flush();
+
 private:
+	void output(LogSeverity severity, std::string &&str);
 	void writeSyslog(LogSeverity severity, const std::string &msg);
 	void writeStream(const std::string &msg);
 
 	std::ostream *stream_;
 	LoggingTarget target_;
 	bool color_;
+
+	std::unique_ptr<AsyncLogWriter> async_;
+	std::unique_ptr<BinaryLog> binary_;
 };
 
 /**
@@ -144,6 +608,16 @@ LogOutput::LogOutput(std::ostream *stream, bool color)
 {
 }
 
+/**
+ * \brief Construct a log output based on a binary log file
+ * \param[in] binary The binary log writer
+ */
+LogOutput::LogOutput(std::unique_ptr<BinaryLog> binary)
+	: stream_(nullptr), target_(LoggingTargetFile), color_(false),
+	  binary_(std::move(binary))
+{
+}
+
 /**
  * \brief Construct a log output to syslog
  */
@@ -155,6 +629,9 @@ LogOutput::LogOutput()
 
 LogOutput::~LogOutput()
 {
+	/* Write the queued messages before closing the output. */
+	async_.reset();
+
 	switch (target_) {
 	case LoggingTargetFile:
 		delete stream_;
@@ -167,6 +644,37 @@ LogOutput::~LogOutput()
 	}
 }
 
+/**
+ * \brief Write the messages to the output from a dedicated thread
+ *
+ * After this call, the write functions only queue the messages, except for
+ * fatal messages that are written synchronously after all the queued messages.
+ * This shall be called before the log output is shared with other threads.
+ */
+void LogOutput::setAsync()
+{
+	/* Writing to the binary log is cheap enough to be done synchronously. */
+	if (async_ || binary_)
+		return;
+
+	async_ = std::make_unique<AsyncLogWriter>(
+		[this](LogSeverity severity, const std::string &str) {
+			if (target_ == LoggingTargetSyslog)
+				writeSyslog(severity, str);
+			else
+				writeStream(str);
+		});
+}
+
+/**
+ * \brief Wait until all the queued messages have been written
+ */
+void LogOutput::flush()
+{
+	if (async_)
+		async_->flush();
+}
+
 /**
  * \brief Check if the log output is valid
  * \return True if the log output is valid
@@ -175,7 +683,7 @@ bool LogOutput::isValid() const
 {
 	switch (target_) {
 	case LoggingTargetFile:
-		return stream_->good();
+		return binary_ ? binary_->isValid() : stream_->good();
 	case LoggingTargetStream:
 		return stream_ != nullptr;
 	default:
@@ -223,6 +731,17 @@ void LogOutput::write(const LogMessage &msg)
 	LogSeverity severity = msg.severity();
 	std::string str;
 
+	if (binary_) {
+		if (msg.prefix().empty()) {
+			binary_->write(&msg.category(), severity, msg.timestamp(),
+				       msg.fileInfo(), msg.msg());
+		} else {
+			binary_->write(&msg.category(), severity, msg.timestamp(),
+				       msg.fileInfo(), msg.prefix() + ": " + msg.msg());
+		}
+		return;
+	}
+
 	if (color_) {
 		if (static_cast<unsigned int>(severity) < std::size(severityColors))
 			severityColor = severityColors[severity];
@@ -237,7 +756,7 @@ void LogOutput::write(const LogMessage &msg)
 		if (!msg.prefix().empty())
 			str += msg.prefix() + ": ";
 		str += msg.msg();
-		writeSyslog(severity, str);
+		output(severity, std::move(str));
 		break;
 	case LoggingTargetStream:
 	case LoggingTargetFile:
@@ -249,7 +768,7 @@ void LogOutput::write(const LogMessage &msg)
 		if (!msg.prefix().empty())
 			str += prefixColor + msg.prefix() + ": ";
 		str += resetColor + msg.msg();
-		writeStream(str);
+		output(severity, std::move(str));
 		break;
 	default:
 		break;
@@ -262,19 +781,41 @@ void LogOutput::write(const LogMessage &msg)
  */
 void LogOutput::write(const std::string &str)
 {
+	if (binary_) {
+		binary_->write(nullptr, LogDebug, utils::clock::now(),
+			       std::string(), str);
+		return;
+	}
+
 	switch (target_) {
 	case LoggingTargetSyslog:
-		writeSyslog(LogDebug, str);
-		break;
 	case LoggingTargetStream:
 	case LoggingTargetFile:
-		writeStream(str);
+		output(LogDebug, std::string(str));
 		break;
 	default:
 		break;
 	}
 }
 
+void LogOutput::output(LogSeverity severity, std::string &&str)
+{
+	if (async_) {
+		if (severity < LogFatal) {
+			async_->push(severity, std::move(str));
+			return;
+		}
+
+		/* Keep the ordering, the process is about to abort. */
+		async_->flush();
+	}
+
+	if (target_ == LoggingTargetSyslog)
+		writeSyslog(severity, str);
+	else
+		writeStream(str);
+}
+
 void LogOutput::writeSyslog(LogSeverity severity, const std::string &str)
 {
 	syslog(log_severity_to_syslog(severity), "%s", str.c_str());
@@ -488,11 +1029,13 @@ void Logger::backtrace()
 	std::string backtrace = Backtrace().toString(2);
 	if (backtrace.empty()) {
 		output->write("Backtrace not available\n");
+		output->flush();
 		return;
 	}
 
 	output->write("Backtrace:\n");
 	output->write(backtrace);
+	output->flush();
 }
 
 /**
@@ -601,19 +1144,52 @@ Logger::Logger()
  * is set to "syslog", then the logger output will be directed to syslog. Errors
  * are silently ignored and don't affect the logger output (set to std::cerr by
  * default).
+ *
+ * The file name may be followed by a comma-separated list of options. The
+ * "async" option writes the log messages from a dedicated thread, and the
+ * "binary" option writes them to a binary log file. Unknown options are
+ * ignored.
  */
 void Logger::parseLogFile()
 {
-	const char *file = utils::secure_getenv("LIBCAMERA_LOG_FILE");
-	if (!file)
+	const char *env = utils::secure_getenv("LIBCAMERA_LOG_FILE");
+	if (!env)
 		return;
 
-	if (!strcmp(file, "syslog")) {
-		logSetTarget(LoggingTargetSyslog);
+	std::vector<std::string> tokens;
+	for (const std::string &token : utils::split(env, ","))
+		tokens.push_back(token);
+
+	if (tokens.empty() || tokens.front().empty())
 		return;
+
+	const std::string &file = tokens.front();
+	bool async = false;
+	bool binary = false;
+
+	for (auto it = tokens.begin() + 1; it != tokens.end(); ++it) {
+		if (*it == "async")
+			async = true;
+		else if (*it == "binary")
+			binary = true;
 	}
 
-	logSetFile(file, false);
+	std::shared_ptr<LogOutput> output;
+	if (file == "syslog")
+		output = std::make_shared<LogOutput>();
+	else if (binary)
+		output = std::make_shared<LogOutput>(
+			std::make_unique<BinaryLog>(file.c_str()));
+	else
+		output = std::make_shared<LogOutput>(file.c_str(), false);
+
+	if (!output->isValid())
+		return;
+
+	if (async)
+		output->setAsync();
+
+	std::atomic_store(&output_, output);
 }
 
 /**
@@ -1042,6 +1618,69 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
 			  severity);
 }
 
+/**
+ * \class LogRateLimiter
+ * \brief Limit the rate of messages logged from a location
+ *
+ * The LogRateLimiter class backs the LOG_RATELIMITED() and LOG_ONCE() macros,
+ * and must not be used directly. It allows up to a burst of messages per
+ * interval, and discards the other messages. The first message allowed after
+ * messages have been discarded is preceded by a summary with the number of
+ * discarded messages.
+ */
+
+/**
+ * \brief Construct a LogRateLimiter
+ * \param[in] burst The number of messages allowed per interval
+ * \param[in] interval The interval duration, or 0 for an infinite interval
+ */
+LogRateLimiter::LogRateLimiter(unsigned int burst, std::chrono::milliseconds interval)
+	: burst_(burst), interval_(interval), count_(0), suppressed_(0)
+{
+}
+
+/**
+ * \brief Check if a message can be logged
+ * \param[in] category The message category
+ * \param[in] severity The message severity
+ * \param[in] fileName The file name where the message is logged from
+ * \param[in] line The line number where the message is logged from
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return True if the message can be logged, false if it shall be discarded
+ */
+bool LogRateLimiter::acquire(const LogCategory &category, LogSeverity severity,
+			     const char *fileName, unsigned int line)
+{
+	utils::time_point now = utils::clock::now();
+	unsigned int suppressed;
+
+	{
+		MutexLocker locker(mutex_);
+
+		if (interval_.count() && now - start_ >= interval_) {
+			start_ = now;
+			count_ = 0;
+		}
+
+		if (count_ >= burst_) {
+			suppressed_++;
+			return false;
+		}
+
+		count_++;
+		suppressed = suppressed_;
+		suppressed_ = 0;
+	}
+
+	if (suppressed)
+		LogMessage(fileName, line, category, severity).stream()
+			<< suppressed << " similar message(s) suppressed";
+
+	return true;
+}
+
 /**
  * \def LOG_DECLARE_CATEGORY(name)
  * \hideinitializer
@@ -1082,6 +1721,18 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
  * absent the default category is used. The  \a severity controls whether the
  * message is printed or discarded, depending on the log level for the category.
  *
+ * The severity is checked before the message is created. Discarded messages
+ * thus cost a comparison only, and the operands of the stream operators are not
+ * evaluated. Log statements shall not rely on side effects of their operands.
+ *
+ * Messages with a severity lower than the LIBCAMERA_LOG_MIN_SEVERITY macro,
+ * set by the log_level build option for libcamera, are removed at compile time
+ * and are never printed regardless of the log level. The macro defaults to
+ * the LogDebug severity if not defined before including log.h.
+ *
+ * As the macro expands to an expression that isn't a function call, it shall
+ * not be qualified with a namespace.
+ *
  * If the severity is set to Fatal, execution is aborted and the program
  * terminates immediately after printing the message.
  *
@@ -1092,6 +1743,35 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
  * possible extent
  */
 
+/**
+ * \def LOG_RATELIMITED(category, severity)
+ * \hideinitializer
+ * \brief Log a message with a rate limit
+ * \param[in] category Category
+ * \param[in] severity Severity
+ *
+ * This macro behaves as LOG(), but limits the number of messages logged from
+ * the location it is used in to 10 every 5 seconds. The other messages are
+ * discarded, and the number of discarded messages is logged before the next
+ * message that passes the limit. The operands of the stream operators are not
+ * evaluated for discarded messages.
+ *
+ * The macro is meant for messages that can be logged for every frame, such as
+ * error conditions that persist over time, to avoid flooding the log and
+ * stalling the thread that logs them.
+ */
+
+/**
+ * \def LOG_ONCE(category, severity)
+ * \hideinitializer
+ * \brief Log a message only once
+ * \param[in] category Category
+ * \param[in] severity Severity
+ *
+ * This macro behaves as LOG(), but logs only the first message from the
+ * location it is used in, for the lifetime of the process.
+ */
+
 /**
  * \def ASSERT(condition)
  * \hideinitializer
@@ -7,6 +7,8 @@
 
 #include <libcamera/base/mutex.h>
 
+#include <pthread.h>
+
 /**
  * \file base/mutex.h
  * \brief Mutex classes with clang thread safety annotation
@@ -25,8 +27,54 @@ namespace libcamera {
  *
  * See https://en.cppreference.com/w/cpp/thread/mutex for the complete API
  * documentation.
+ *
+ * Mutexes shared between threads of different scheduling priorities, such as
+ * real-time pipeline threads and normal priority application threads, are
+ * subject to priority inversion. They can be created with the
+ * Protocol::PriorityInherit protocol to boost the priority of the thread
+ * holding the lock to the priority of the highest priority thread waiting for
+ * it.
+ */
+
+/**
+ * \enum Mutex::Protocol
+ * \brief Priority protocol of the mutex
+ * \var Mutex::Protocol::None
+ * \brief The priority of the thread holding the mutex is not affected
+ * \var Mutex::Protocol::PriorityInherit
+ * \brief The thread holding the mutex inherits the priority of the highest
+ * priority thread waiting for it
+ */
+
+/**
+ * \fn Mutex::Mutex()
+ * \brief Construct a mutex with the default Protocol::None protocol
  */
 
+/**
+ * \brief Construct a mutex with the priority \a protocol
+ * \param[in] protocol The mutex priority protocol
+ *
+ * Priority inheritance relies on the mutex being implemented by a POSIX
+ * threads mutex, as is the case with the libstdc++ and libc++ implementations
+ * of std::mutex on Linux.
+ */
+Mutex::Mutex(Protocol protocol)
+{
+	if (protocol == Protocol::None)
+		return;
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+
+	pthread_mutex_t *mutex = mutex_.native_handle();
+	pthread_mutex_destroy(mutex);
+	pthread_mutex_init(mutex, &attr);
+
+	pthread_mutexattr_destroy(&attr);
+}
+
 /**
  * \class MutexLocker
  * \brief std::unique_lock wrapper with clang thread safety annotation
@@ -7,6 +7,11 @@
 
 #include <libcamera/base/semaphore.h>
 
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 /**
  * \file base/semaphore.h
  * \brief General-purpose counting semaphore
@@ -14,6 +19,24 @@
 
 namespace libcamera {
 
+namespace {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+void futexWait(std::atomic<uint32_t> *word, uint32_t value)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+		FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t> *word)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+		FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+} /* namespace */
+
 /**
  * \class Semaphore
  * \brief General-purpose counting semaphore
@@ -24,6 +47,10 @@ namespace libcamera {
  * acquire a number of resources, and blocks if not enough resources are
  * available until they get released. The release() function releases a number
  * of resources, waking up any consumer blocked on an acquire() call.
+ *
+ * The semaphore is implemented with an atomic counter and a futex. Acquiring
+ * and releasing resources doesn't involve any system call, unless a consumer
+ * has to wait for resources to become available.
  */
 
 /**
@@ -31,7 +58,7 @@ namespace libcamera {
  * \param[in] n The resource count
  */
 Semaphore::Semaphore(unsigned int n)
-	: available_(n)
+	: available_(n), waiters_(0)
 {
 }
 
@@ -41,8 +68,7 @@ Semaphore::Semaphore(unsigned int n)
  */
 unsigned int Semaphore::available()
 {
-	MutexLocker locker(mutex_);
-	return available_;
+	return available_.load(std::memory_order_relaxed);
 }
 
 /**
@@ -55,11 +81,32 @@ unsigned int Semaphore::available()
  */
 void Semaphore::acquire(unsigned int n)
 {
-	MutexLocker locker(mutex_);
-	cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
-		return available_ >= n;
-	});
-	available_ -= n;
+	uint32_t value = available_.load(std::memory_order_relaxed);
+
+	while (true) {
+		if (value >= n) {
+			if (available_.compare_exchange_weak(value, value - n,
+							     std::memory_order_acquire,
+							     std::memory_order_relaxed))
+				return;
+			continue;
+		}
+
+		/*
+		 * Register as a waiter before checking the counter again. This
+		 * pairs with the counter update and waiters check in release(),
+		 * and guarantees that either release() wakes us up, or we
+		 * notice the new resources. The futex wait additionally
+		 * returns immediately if the counter has changed.
+		 */
+		waiters_.fetch_add(1);
+		value = available_.load();
+		if (value < n)
+			futexWait(&available_, value);
+		waiters_.fetch_sub(1, std::memory_order_relaxed);
+
+		value = available_.load(std::memory_order_relaxed);
+	}
 }
 
 /**
@@ -75,11 +122,15 @@ void Semaphore::acquire(unsigned int n)
  */
 bool Semaphore::tryAcquire(unsigned int n)
 {
-	MutexLocker locker(mutex_);
-	if (available_ < n)
-		return false;
+	uint32_t value = available_.load(std::memory_order_relaxed);
+
+	do {
+		if (value < n)
+			return false;
+	} while (!available_.compare_exchange_weak(value, value - n,
+						   std::memory_order_acquire,
+						   std::memory_order_relaxed));
 
-	available_ -= n;
 	return true;
 }
 
@@ -93,12 +144,10 @@ bool Semaphore::tryAcquire(unsigned int n)
  */
 void Semaphore::release(unsigned int n)
 {
-	{
-		MutexLocker locker(mutex_);
-		available_ += n;
-	}
+	available_.fetch_add(n);
 
-	cv_.notify_all();
+	if (waiters_.load())
+		futexWakeAll(&available_);
 }
 
 } /* namespace libcamera */
@@ -20,14 +20,52 @@ namespace libcamera {
 namespace {
 
 /*
- * Mutex to protect the SignalBase::slots_ and Object::signals_ lists. If lock
- * contention needs to be decreased, this could be replaced with locks in
- * Object and SignalBase, or with a mutex pool.
+ * Mutex to protect the SignalBase::slots_ array updates and Object::signals_
+ * lists. Emitting a signal doesn't take the lock. If lock contention needs to
+ * be decreased, this could be replaced with locks in Object and SignalBase, or
+ * with a mutex pool.
  */
 Mutex signalsLock;
 
 } /* namespace */
 
+/*
+ * The slots are stored in an array that is never modified once published.
+ * Connecting or disconnecting slots creates a new array and replaces the
+ * current one, while emissions iterate over the array they have loaded when
+ * they started without taking any lock or allocating memory.
+ *
+ * The replaced arrays, and the slots that have been removed, are retired and
+ * freed once no emission is in progress. An emission increments the emissions
+ * counter before loading the array, and the array is replaced before the
+ * counter is checked, so an emission that starts after the counter has been
+ * checked is guaranteed to load the new array.
+ *
+ * The state is allocated separately from the signal, as a slot may destroy the
+ * signal being emitted. The last emission then frees the state.
+ */
+
+SignalBase::SignalBase()
+	: state_(new State{ new SlotArray{ {}, {}, nullptr }, 0, nullptr, false })
+{
+}
+
+SignalBase::~SignalBase()
+{
+	MutexLocker locker(signalsLock);
+
+	SlotArray *slots = state_->slots.exchange(nullptr, std::memory_order_seq_cst);
+	slots->removed.insert(slots->removed.end(), slots->slots.begin(),
+			      slots->slots.end());
+
+	state_->orphaned = true;
+	retire(state_, slots);
+
+	locker.unlock();
+
+	reclaim(state_);
+}
+
 void SignalBase::connect(BoundMethodBase *slot)
 {
 	MutexLocker locker(signalsLock);
@@ -35,38 +73,126 @@ void SignalBase::connect(BoundMethodBase *slot)
 	Object *object = slot->object();
 	if (object)
 		object->connect(this);
-	slots_.push_back(slot);
+
+	const SlotArray *current = state_->slots.load(std::memory_order_relaxed);
+	SlotArray *slots = new SlotArray{ current->slots, {}, nullptr };
+	slots->slots.push_back(new Slot{ slot, true });
+
+	replace(slots);
 }
 
 void SignalBase::disconnect(Object *object)
 {
-	disconnect([object](SlotList::iterator &iter) {
-		return (*iter)->match(object);
+	disconnect([object](BoundMethodBase *slot) {
+		return slot->match(object);
 	});
 }
 
-void SignalBase::disconnect(std::function<bool(SlotList::iterator &)> match)
+void SignalBase::disconnect(std::function<bool(BoundMethodBase *)> match)
 {
 	MutexLocker locker(signalsLock);
 
-	for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-		if (match(iter)) {
-			Object *object = (*iter)->object();
-			if (object)
-				object->disconnect(this);
+	const SlotArray *current = state_->slots.load(std::memory_order_relaxed);
+	SlotArray *slots = nullptr;
+
+	for (Slot *slot : current->slots) {
+		if (!match(slot->method)) {
+			if (slots)
+				slots->slots.push_back(slot);
+			continue;
+		}
 
-			delete *iter;
-			iter = slots_.erase(iter);
-		} else {
-			++iter;
+		if (!slots) {
+			slots = new SlotArray{ {}, {}, nullptr };
+			slots->slots.reserve(current->slots.size() - 1);
+			for (Slot *s : current->slots) {
+				if (s == slot)
+					break;
+				slots->slots.push_back(s);
+			}
 		}
+
+		Object *object = slot->method->object();
+		if (object)
+			object->disconnect(this);
+
+		slot->connected.store(false, std::memory_order_release);
+		slots->removed.push_back(slot);
+	}
+
+	if (slots)
+		replace(slots);
+}
+
+/*
+ * Publish a new slots array and retire the previous one. The slots removed
+ * from the signal are freed with the previous array, as in-progress emissions
+ * may still access them. Shall be called with signalsLock held.
+ */
+void SignalBase::replace(SlotArray *slots)
+{
+	SlotArray *previous = state_->slots.exchange(slots, std::memory_order_seq_cst);
+
+	/* The removed slots belong to the array that holds them. */
+	std::swap(previous->removed, slots->removed);
+
+	retire(state_, previous);
+}
+
+/*
+ * Free a slots array that has been replaced, or queue it for freeing if
+ * emissions are in progress. Shall be called with signalsLock held.
+ */
+void SignalBase::retire(State *state, SlotArray *slots)
+{
+	if (state->emissions.load(std::memory_order_seq_cst)) {
+		slots->next = state->retired.load(std::memory_order_relaxed);
+		state->retired.store(slots, std::memory_order_release);
+		return;
+	}
+
+	for (Slot *slot : slots->removed) {
+		delete slot->method;
+		delete slot;
 	}
+
+	delete slots;
 }
 
-SignalBase::SlotList SignalBase::slots()
+/*
+ * Free the retired arrays when no emission is in progress, and the state if the
+ * signal has been destroyed. This is called by the last emission to complete.
+ */
+void SignalBase::reclaim(State *state)
 {
 	MutexLocker locker(signalsLock);
-	return slots_;
+
+	/*
+	 * An emission that has started since the counter reached zero has
+	 * loaded the current array, but one that started before the last
+	 * replacement may have loaded a retired array. Leave the retired arrays
+	 * to that emission.
+	 */
+	if (state->emissions.load(std::memory_order_seq_cst))
+		return;
+
+	SlotArray *retired = state->retired.exchange(nullptr, std::memory_order_relaxed);
+	while (retired) {
+		SlotArray *next = retired->next;
+
+		for (Slot *slot : retired->removed) {
+			delete slot->method;
+			delete slot;
+		}
+
+		delete retired;
+		retired = next;
+	}
+
+	if (state->orphaned) {
+		locker.unlock();
+		delete state;
+	}
 }
 
 /**
@@ -198,6 +324,10 @@ SignalBase::SlotList SignalBase::slots()
  * of the arguments (when passed by pointer or reference), the modification is
  * thus visible to all subsequently called slots.
  *
+ * Emitting a signal doesn't take any lock and doesn't allocate memory. Slots
+ * connected during the emission are not called, and slots disconnected
+ * during the emission are not called if they haven't been called yet.
+ *
  * This function is not \threadsafe, but thread-safety is guaranteed against
  * concurrent connect() and disconnect() calls.
  */
@@ -8,17 +8,27 @@
 #include <libcamera/base/thread.h>
 
 #include <atomic>
-#include <list>
+#include <errno.h>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
+#include <libcamera/base/allocation_tracker.h>
 #include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/event_dispatcher_epoll.h>
 #include <libcamera/base/event_dispatcher_poll.h>
 #include <libcamera/base/log.h>
 #include <libcamera/base/message.h>
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/object.h>
+#include <libcamera/base/utils.h>
 
 /**
  * \page thread Thread Support
@@ -115,23 +125,112 @@ class ThreadMain;
 
 /**
  * \brief A queue of posted messages
+ *
+ * Messages are stored in an intrusive list, linked through the Message::next_
+ * pointer, without any memory allocation. The list and the
+ * Object::pendingMessages_ counters of the receivers are protected by the
+ * \ref mutex_. The counter of a receiver always matches the number of messages
+ * for that receiver in the list.
  */
 class MessageQueue
 {
 public:
+	~MessageQueue()
+	{
+		MutexLocker locker(mutex_);
+
+		while (head_) {
+			Message *msg = head_;
+			head_ = msg->next_;
+			delete msg;
+		}
+	}
+
 	/**
-	 * \brief List of queued Message instances
+	 * \brief Append a message to the tail of the queue list
+	 * \param[in] msg The message
 	 */
-	std::list<std::unique_ptr<Message>> list_;
+	void append(Message *msg) LIBCAMERA_TSA_REQUIRES(mutex_)
+	{
+		msg->next_ = nullptr;
+		msg->receiver_->pendingMessages_++;
+
+		if (tail_)
+			tail_->next_ = msg;
+		else
+			head_ = msg;
+		tail_ = msg;
+	}
+
 	/**
-	 * \brief Protects the \ref list_
+	 * \brief Position in the queue list to resume a search from
+	 *
+	 * A cursor records the last message that take() has examined without
+	 * selecting it. Messages are only appended to the queue list between
+	 * two calls, so that message remains in the list and the next search
+	 * resumes after it instead of scanning the skipped messages again. The
+	 * cursor is invalidated when any message is removed from the list in
+	 * between, and the search then restarts from the head.
 	 */
-	Mutex mutex_;
+	struct Cursor {
+		Message *prev = nullptr;
+		unsigned int generation = 0;
+	};
+
 	/**
-	 * \brief The recursion level for recursive Thread::dispatchMessages()
-	 * calls
+	 * \brief Remove the first message matching \a match from the queue list
+	 * \param[in] match The function that selects the message
+	 * \param[inout] cursor The position to resume the search from
+	 *
+	 * The \a cursor shall be used for repeated searches with the same \a match
+	 * function only.
+	 *
+	 * \return The message, or nullptr if no message matches
 	 */
-	unsigned int recursion_ = 0;
+	template<typename Match>
+	std::unique_ptr<Message> take(Match match, Cursor &cursor)
+		LIBCAMERA_TSA_REQUIRES(mutex_)
+	{
+		Message *prev = nullptr;
+
+		if (cursor.generation == generation_)
+			prev = cursor.prev;
+
+		Message *msg = prev ? prev->next_ : head_;
+		for (; msg; prev = msg, msg = msg->next_) {
+			if (!match(msg))
+				continue;
+
+			if (prev)
+				prev->next_ = msg->next_;
+			else
+				head_ = msg->next_;
+
+			if (tail_ == msg)
+				tail_ = prev;
+
+			msg->next_ = nullptr;
+			msg->receiver_->pendingMessages_--;
+
+			cursor.prev = prev;
+			cursor.generation = ++generation_;
+			return std::unique_ptr<Message>(msg);
+		}
+
+		cursor.prev = prev;
+		cursor.generation = generation_;
+		return nullptr;
+	}
+
+	/**
+	 * \brief Protects the queue list
+	 */
+	Mutex mutex_;
+
+private:
+	Message *head_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = nullptr;
+	Message *tail_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = nullptr;
+	unsigned int generation_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = 0;
 };
 
 /**
@@ -141,7 +240,9 @@ class ThreadData
 {
 public:
 	ThreadData()
-		: thread_(nullptr), running_(false), dispatcher_(nullptr)
+		: thread_(nullptr), running_(false), started_(false),
+		  dispatcher_(nullptr), hasScheduling_(false),
+		  policy_(Thread::SchedulingPolicy::Other), priority_(0)
 	{
 	}
 
@@ -153,6 +254,7 @@ private:
 
 	Thread *thread_;
 	bool running_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool started_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 	pid_t tid_;
 
 	Mutex mutex_;
@@ -164,6 +266,12 @@ private:
 	int exitCode_;
 
 	MessageQueue messages_;
+
+	std::string name_;
+	bool hasScheduling_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	Thread::SchedulingPolicy policy_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int priority_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::vector<unsigned int> cpus_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 };
 
 /**
@@ -260,13 +368,34 @@ ThreadData *ThreadData::current()
  * deleted without being processed when the Thread instance is destroyed.
  */
 
+/**
+ * \enum Thread::SchedulingPolicy
+ * \brief The scheduling policy of a thread
+ * \var Thread::SchedulingPolicy::Other
+ * \brief The default time-sharing policy (SCHED_OTHER), the priority is the
+ * nice value of the thread, from -20 (highest) to 19 (lowest)
+ * \var Thread::SchedulingPolicy::Fifo
+ * \brief The first-in first-out real-time policy (SCHED_FIFO), the priority
+ * ranges from 1 (lowest) to 99 (highest)
+ * \var Thread::SchedulingPolicy::RoundRobin
+ * \brief The round-robin real-time policy (SCHED_RR), the priority ranges
+ * from 1 (lowest) to 99 (highest)
+ */
+
 /**
  * \brief Create a thread
+ * \param[in] name The thread name
+ *
+ * The \a name identifies the role of the thread. It is set as the name of the
+ * system thread, truncated to 15 characters, and selects the scheduling
+ * settings of the thread from the LIBCAMERA_THREAD_SCHEDULING environment
+ * variable. Threads that share a role may share a name.
  */
-Thread::Thread()
+Thread::Thread(const std::string &name)
 {
 	data_ = new ThreadData;
 	data_->thread_ = this;
+	data_->name_ = name;
 }
 
 Thread::~Thread()
@@ -275,6 +404,249 @@ Thread::~Thread()
 	delete data_;
 }
 
+/**
+ * \brief Retrieve the thread name
+ * \return The name of the thread, as passed to the constructor
+ */
+const std::string &Thread::name() const
+{
+	return data_->name_;
+}
+
+namespace {
+
+int setThreadScheduling(pthread_t thread, pid_t tid,
+			Thread::SchedulingPolicy policy, int priority)
+{
+	struct sched_param param = {};
+	int ret;
+
+	if (policy == Thread::SchedulingPolicy::Other) {
+		ret = pthread_setschedparam(thread, SCHED_OTHER, &param);
+		if (ret)
+			return -ret;
+
+		/* Linux applies the nice value to the thread, not the process. */
+		if (setpriority(PRIO_PROCESS, tid, priority) < 0)
+			return -errno;
+
+		return 0;
+	}
+
+	param.sched_priority = priority;
+	ret = pthread_setschedparam(thread,
+				    policy == Thread::SchedulingPolicy::Fifo
+				    ? SCHED_FIFO : SCHED_RR,
+				    &param);
+	return -ret;
+}
+
+int setThreadCpus(pthread_t thread, const std::vector<unsigned int> &cpus)
+{
+	cpu_set_t cpuset;
+
+	CPU_ZERO(&cpuset);
+	for (unsigned int cpu : cpus) {
+		if (cpu >= CPU_SETSIZE)
+			return -EINVAL;
+		CPU_SET(cpu, &cpuset);
+	}
+
+	return -pthread_setaffinity_np(thread, sizeof(cpuset), &cpuset);
+}
+
+struct ThreadRule {
+	std::string name;
+	bool hasScheduling;
+	Thread::SchedulingPolicy policy;
+	int priority;
+	std::vector<unsigned int> cpus;
+};
+
+bool parseCpus(const std::string &str, std::vector<unsigned int> *cpus)
+{
+	for (const std::string &range : utils::split(str, ",")) {
+		std::string::size_type dash = range.find('-');
+		char *end;
+
+		unsigned long first = strtoul(range.c_str(), &end, 10);
+		if (end == range.c_str())
+			return false;
+
+		unsigned long last = first;
+		if (dash != std::string::npos) {
+			const char *str2 = range.c_str() + dash + 1;
+			last = strtoul(str2, &end, 10);
+			if (end == str2)
+				return false;
+		}
+
+		if (*end != '\0' || last < first || last >= CPU_SETSIZE)
+			return false;
+
+		for (unsigned long cpu = first; cpu <= last; ++cpu)
+			cpus->push_back(cpu);
+	}
+
+	return true;
+}
+
+/*
+ * Parse the LIBCAMERA_THREAD_SCHEDULING environment variable, a list of
+ * "name:policy:priority[:cpus]" entries separated by semicolons.
+ */
+std::vector<ThreadRule> parseThreadRules()
+{
+	std::vector<ThreadRule> rules;
+
+	const char *env = utils::secure_getenv("LIBCAMERA_THREAD_SCHEDULING");
+	if (!env)
+		return rules;
+
+	for (const std::string &entry : utils::split(env, ";")) {
+		if (entry.empty())
+			continue;
+
+		std::vector<std::string> fields;
+		for (const std::string &field : utils::split(entry, ":"))
+			fields.push_back(field);
+
+		if (fields.size() < 3 || fields.size() > 4 || fields[0].empty()) {
+			LOG(Thread, Warning)
+				<< "Invalid thread scheduling entry '" << entry << "'";
+			continue;
+		}
+
+		ThreadRule rule{ fields[0], false, Thread::SchedulingPolicy::Other, 0, {} };
+		const std::string &policy = fields[1];
+
+		if (!policy.empty()) {
+			if (policy == "other") {
+				rule.policy = Thread::SchedulingPolicy::Other;
+			} else if (policy == "fifo") {
+				rule.policy = Thread::SchedulingPolicy::Fifo;
+			} else if (policy == "rr") {
+				rule.policy = Thread::SchedulingPolicy::RoundRobin;
+			} else {
+				LOG(Thread, Warning)
+					<< "Invalid scheduling policy '" << policy << "'";
+				continue;
+			}
+
+			char *end;
+			rule.priority = strtol(fields[2].c_str(), &end, 10);
+			if (fields[2].empty() || *end != '\0') {
+				LOG(Thread, Warning)
+					<< "Invalid thread priority '" << fields[2] << "'";
+				continue;
+			}
+
+			rule.hasScheduling = true;
+		}
+
+		if (fields.size() == 4 && !parseCpus(fields[3], &rule.cpus)) {
+			LOG(Thread, Warning)
+				<< "Invalid CPU list '" << fields[3] << "'";
+			continue;
+		}
+
+		rules.push_back(std::move(rule));
+	}
+
+	return rules;
+}
+
+const ThreadRule *findThreadRule(const std::string &name)
+{
+	static const std::vector<ThreadRule> rules = parseThreadRules();
+
+	for (const ThreadRule &rule : rules) {
+		const std::string &pattern = rule.name;
+
+		/* A '*' at the end of the pattern matches any suffix. */
+		if (pattern.back() == '*') {
+			if (!name.compare(0, pattern.size() - 1, pattern, 0,
+					  pattern.size() - 1))
+				return &rule;
+		} else if (pattern == name) {
+			return &rule;
+		}
+	}
+
+	return nullptr;
+}
+
+} /* namespace */
+
+/**
+ * \brief Set the scheduling policy and priority of the thread
+ * \param[in] policy The scheduling policy
+ * \param[in] priority The priority, whose meaning depends on the \a policy
+ *
+ * The scheduling settings are applied when the thread is started, and
+ * immediately if the thread is running. Real-time policies usually require the
+ * CAP_SYS_NICE capability or an RLIMIT_RTPRIO resource limit, as do negative
+ * nice values.
+ *
+ * Settings from the LIBCAMERA_THREAD_SCHEDULING environment variable take
+ * precedence when the thread is started.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOTSUP The thread is the main thread
+ */
+int Thread::setScheduling(SchedulingPolicy policy, int priority)
+{
+	MutexLocker locker(data_->mutex_);
+
+	data_->hasScheduling_ = true;
+	data_->policy_ = policy;
+	data_->priority_ = priority;
+
+	if (data_->started_)
+		return setThreadScheduling(thread_.native_handle(), data_->tid_,
+					   policy, priority);
+
+	/* The main thread isn't started by libcamera. */
+	if (data_->running_ && !thread_.joinable())
+		return -ENOTSUP;
+
+	return 0;
+}
+
+/**
+ * \brief Set the CPU affinity of the thread
+ * \param[in] cpus The CPUs the thread is allowed to run on
+ *
+ * The affinity is applied when the thread is started, and immediately if the
+ * thread is running. An empty list of \a cpus keeps the inherited affinity
+ * when the thread is started.
+ *
+ * Settings from the LIBCAMERA_THREAD_SCHEDULING environment variable take
+ * precedence when the thread is started.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL A CPU number is out of range
+ * \retval -ENOTSUP The thread is the main thread
+ */
+int Thread::setThreadAffinity(const std::vector<unsigned int> &cpus)
+{
+	MutexLocker locker(data_->mutex_);
+
+	data_->cpus_ = cpus;
+
+	if (data_->started_)
+		return cpus.empty() ? 0 : setThreadCpus(thread_.native_handle(), cpus);
+
+	if (data_->running_ && !thread_.joinable())
+		return -ENOTSUP;
+
+	return 0;
+}
+
 /**
  * \brief Start the thread
  */
@@ -317,9 +689,63 @@ void Thread::startThread()
 	data_->tid_ = syscall(SYS_gettid);
 	currentThreadData = data_;
 
+	applySettings();
+
 	run();
 }
 
+/*
+ * Apply the name and scheduling settings to the thread, from the thread itself
+ * when it starts.
+ */
+void Thread::applySettings()
+{
+	MutexLocker locker(data_->mutex_);
+
+	data_->started_ = true;
+
+	const std::string &name = data_->name_;
+	bool hasScheduling = data_->hasScheduling_;
+	SchedulingPolicy policy = data_->policy_;
+	int priority = data_->priority_;
+	const std::vector<unsigned int> *cpus = &data_->cpus_;
+
+	const ThreadRule *rule = nullptr;
+	if (!name.empty()) {
+		pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+		AllocationTracker::updateThreadName();
+		rule = findThreadRule(name);
+	}
+
+	if (rule) {
+		if (rule->hasScheduling) {
+			hasScheduling = true;
+			policy = rule->policy;
+			priority = rule->priority;
+		}
+
+		if (!rule->cpus.empty())
+			cpus = &rule->cpus;
+	}
+
+	if (hasScheduling) {
+		int ret = setThreadScheduling(pthread_self(), data_->tid_,
+					      policy, priority);
+		if (ret < 0)
+			LOG(Thread, Warning)
+				<< "Failed to set the scheduling of thread "
+				<< name << ": " << strerror(-ret);
+	}
+
+	if (!cpus->empty()) {
+		int ret = setThreadCpus(pthread_self(), *cpus);
+		if (ret < 0)
+			LOG(Thread, Warning)
+				<< "Failed to set the affinity of thread "
+				<< name << ": " << strerror(-ret);
+	}
+}
+
 /**
  * \brief Enter the event loop
  *
@@ -379,6 +805,7 @@ void Thread::finishThread()
 
 	data_->mutex_.lock();
 	data_->running_ = false;
+	data_->started_ = false;
 	data_->mutex_.unlock();
 
 	finished.emit();
@@ -495,12 +922,32 @@ pid_t Thread::currentId()
 	return data->tid_;
 }
 
+/*
+ * Create the event dispatcher selected by the LIBCAMERA_EVENT_DISPATCHER
+ * environment variable, defaulting to the epoll-based implementation.
+ */
+static EventDispatcher *createEventDispatcher()
+{
+	const char *name = utils::secure_getenv("LIBCAMERA_EVENT_DISPATCHER");
+	if (name && std::string(name) == "poll")
+		return new EventDispatcherPoll();
+
+	if (name && std::string(name) != "epoll")
+		LOG(Thread, Warning)
+			<< "Unknown event dispatcher '" << name << "', using epoll";
+
+	return new EventDispatcherEpoll();
+}
+
 /**
  * \brief Retrieve the event dispatcher
  *
  * This function retrieves the internal event dispatcher for the thread. The
  * returned event dispatcher is valid until the thread is destroyed.
  *
+ * The event dispatcher is created on the first call. The implementation is
+ * selected by the LIBCAMERA_EVENT_DISPATCHER environment variable.
+ *
  * \context This function is \threadsafe.
  *
  * \return Pointer to the event dispatcher
@@ -508,7 +955,7 @@ pid_t Thread::currentId()
 EventDispatcher *Thread::eventDispatcher()
 {
 	if (!data_->dispatcher_.load(std::memory_order_relaxed))
-		data_->dispatcher_.store(new EventDispatcherPoll(),
+		data_->dispatcher_.store(createEventDispatcher(),
 					 std::memory_order_release);
 
 	return data_->dispatcher_.load(std::memory_order_relaxed);
@@ -543,8 +990,7 @@ void Thread::postMessage(std::unique_ptr<Message> msg, Object *receiver)
 	ASSERT(data_ == receiver->thread()->data_);
 
 	MutexLocker locker(data_->messages_.mutex_);
-	data_->messages_.list_.push_back(std::move(msg));
-	receiver->pendingMessages_++;
+	data_->messages_.append(msg.release());
 	locker.unlock();
 
 	EventDispatcher *dispatcher =
@@ -567,21 +1013,21 @@ void Thread::removeMessages(Object *receiver)
 	if (!receiver->pendingMessages_)
 		return;
 
+	/*
+	 * Move the messages to the pending deletion list to delete them after
+	 * releasing the lock.
+	 */
 	std::vector<std::unique_ptr<Message>> toDelete;
-	for (std::unique_ptr<Message> &msg : data_->messages_.list_) {
+	MessageQueue::Cursor cursor;
+	while (true) {
+		std::unique_ptr<Message> msg =
+			data_->messages_.take([receiver](const Message *m) {
+				return m->receiver_ == receiver;
+			}, cursor);
 		if (!msg)
-			continue;
-		if (msg->receiver_ != receiver)
-			continue;
+			break;
 
-		/*
-		 * Move the message to the pending deletion list to delete it
-		 * after releasing the lock. The messages list element will
-		 * contain a null pointer, and will be removed when dispatching
-		 * messages.
-		 */
 		toDelete.push_back(std::move(msg));
-		receiver->pendingMessages_--;
 	}
 
 	ASSERT(!receiver->pendingMessages_);
@@ -593,11 +1039,17 @@ void Thread::removeMessages(Object *receiver)
 /**
  * \brief Dispatch posted messages for this thread
  * \param[in] type The message type
+ * \param[in] receiver The receiver whose messages to dispatch
  *
  * This function immediately dispatches all the messages previously posted for
  * this thread with postMessage() that match the message \a type. If the \a type
  * is Message::Type::None, all messages are dispatched.
  *
+ * If a \a receiver is specified, only the messages posted for that receiver are
+ * dispatched. This allows a component to flush the messages it has queued to
+ * itself, for instance when stopping, without delivering unrelated messages
+ * posted to other objects bound to the same thread.
+ *
  * Messages shall only be dispatched from the current thread, typically within
  * the thread from the run() function. Calling this function outside of the
  * thread results in undefined behaviour.
@@ -606,53 +1058,39 @@ void Thread::removeMessages(Object *receiver)
  * same thread from an object's message handler. It guarantees delivery of
  * messages in the order they have been posted in all cases.
  */
-void Thread::dispatchMessages(Message::Type type)
+void Thread::dispatchMessages(Message::Type type, Object *receiver)
 {
 	ASSERT(data_ == ThreadData::current());
 
-	++data_->messages_.recursion_;
-
-	MutexLocker locker(data_->messages_.mutex_);
-
-	std::list<std::unique_ptr<Message>> &messages = data_->messages_.list_;
-
-	for (std::unique_ptr<Message> &msg : messages) {
-		if (!msg)
-			continue;
-
-		if (type != Message::Type::None && msg->type() != type)
-			continue;
-
-		/*
-		 * Move the message, setting the entry in the list to null. It
-		 * will cause recursive calls to ignore the entry, and the erase
-		 * loop at the end of the function to delete it from the list.
-		 */
-		std::unique_ptr<Message> message = std::move(msg);
+	MessageQueue &messages = data_->messages_;
+	MutexLocker locker(messages.mutex_);
 
-		Object *receiver = message->receiver_;
-		ASSERT(data_ == receiver->thread()->data_);
-		receiver->pendingMessages_--;
+	/*
+	 * Take the messages out of the queue one at a time, the first matching
+	 * message is always dispatched first, including when called
+	 * recursively from a message handler. The cursor resumes the search
+	 * after the messages skipped by the previous iterations, unless the
+	 * message handler has removed messages from the queue.
+	 */
+	MessageQueue::Cursor cursor;
+	while (true) {
+		std::unique_ptr<Message> message =
+			messages.take([type, receiver](const Message *msg) {
+				return (type == Message::Type::None ||
+					msg->type() == type) &&
+				       (!receiver || msg->receiver_ == receiver);
+			}, cursor);
+		if (!message)
+			break;
+
+		Object *target = message->receiver_;
+		ASSERT(data_ == target->thread()->data_);
 
 		locker.unlock();
-		receiver->message(message.get());
+		target->message(message.get());
 		message.reset();
 		locker.lock();
 	}
-
-	/*
-	 * If the recursion level is 0, erase all null messages in the list. We
-	 * can't do so during recursion, as it would invalidate the iterator of
-	 * the outer calls.
-	 */
-	if (!--data_->messages_.recursion_) {
-		for (auto iter = messages.begin(); iter != messages.end(); ) {
-			if (!*iter)
-				iter = messages.erase(iter);
-			else
-				++iter;
-		}
-	}
 }
 
 /**
@@ -677,14 +1115,17 @@ void Thread::moveObject(Object *object, ThreadData *currentData,
 	/* Move pending messages to the message queue of the new thread. */
 	if (object->pendingMessages_) {
 		unsigned int movedMessages = 0;
+		MessageQueue::Cursor cursor;
 
-		for (std::unique_ptr<Message> &msg : currentData->messages_.list_) {
+		while (true) {
+			std::unique_ptr<Message> msg =
+				currentData->messages_.take([object](const Message *m) {
+					return m->receiver_ == object;
+				}, cursor);
 			if (!msg)
-				continue;
-			if (msg->receiver_ != object)
-				continue;
+				break;
 
-			targetData->messages_.list_.push_back(std::move(msg));
+			targetData->messages_.append(msg.release());
 			movedMessages++;
 		}
 
@@ -7,14 +7,21 @@
 
 #include <libcamera/camera.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <iomanip>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/thread.h>
+#include <libcamera/base/unique_fd.h>
 
 #include <libcamera/color_space.h>
+#include <libcamera/control_ids.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
@@ -242,6 +249,77 @@ bool SensorConfiguration::isValid() const
 	return false;
 }
 
+/**
+ * \class CameraStatistics
+ * \brief Runtime performance counters of a camera
+ *
+ * The CameraStatistics class reports counters accumulated by a camera since it
+ * has been configured, to monitor the health of a camera without enabling
+ * debug logs. The counters are reset every time the camera is configured.
+ *
+ * The generic counters are maintained by libcamera for all cameras. Pipeline
+ * handlers report additional counters specific to their hardware through the
+ * \a counters map.
+ */
+
+/**
+ * \struct CameraStatistics::StreamStatistics
+ * \brief Per-stream counters
+ *
+ * \var CameraStatistics::StreamStatistics::framesCompleted
+ * \brief Number of buffers completed successfully for the stream
+ *
+ * \var CameraStatistics::StreamStatistics::framesDropped
+ * \brief Number of frames dropped for the stream
+ *
+ * Dropped frames are detected from gaps in the sequence numbers of the
+ * buffers completed for the stream within a capture session.
+ *
+ * \var CameraStatistics::StreamStatistics::framesFailed
+ * \brief Number of buffers completed with an error for the stream
+ */
+
+/**
+ * \var CameraStatistics::requestsQueued
+ * \brief Number of requests queued to the device
+ */
+
+/**
+ * \var CameraStatistics::requestsCompleted
+ * \brief Number of requests completed successfully
+ */
+
+/**
+ * \var CameraStatistics::requestsCancelled
+ * \brief Number of requests cancelled
+ */
+
+/**
+ * \var CameraStatistics::queueDepth
+ * \brief Number of requests queued to the device and not completed yet
+ */
+
+/**
+ * \var CameraStatistics::maxQueueDepth
+ * \brief Maximum value reached by the queue depth
+ */
+
+/**
+ * \var CameraStatistics::streams
+ * \brief Per-stream counters, for the streams that have completed buffers
+ */
+
+/**
+ * \var CameraStatistics::counters
+ * \brief Pipeline handler specific counters, indexed by name
+ *
+ * Counter names are composed of dot-separated components, starting with the
+ * name of the component that reports them, for instance
+ * "ipa.processing-time-us" or "v4l2.main.buffer-cache-misses". The counters
+ * depend on the pipeline handler, and applications shall not rely on the
+ * presence of any particular counter.
+ */
+
 /**
  * \class CameraConfiguration
  * \brief Hold configuration for streams of the camera
@@ -571,14 +649,131 @@ CameraConfiguration::Status CameraConfiguration::validateColorSpaces(ColorSpaceF
  * camera by calling Camera::_d().
  */
 
+/*
+ * A single-producer single-consumer queue of completed requests, signalled
+ * through an eventfd in semaphore mode. Requests are pushed by the pipeline
+ * handler thread, the only producer, and popped by the application, the only
+ * consumer, without locking: the producer only touches the tail of the linked
+ * list and the consumer its head, which always points to an already consumed
+ * node. Neither side may be called concurrently with itself.
+ *
+ * The nodes that the consumer has moved past are recycled by the producer, so
+ * that pushing a request doesn't allocate memory once the queue has reached
+ * its steady state depth. A pool of nodes is preallocated to cover the usual
+ * number of requests in flight.
+ */
+class Camera::Private::CompletionQueue
+{
+public:
+	CompletionQueue()
+	{
+		fd_ = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE));
+
+		/*
+		 * Link the preallocated nodes before the dummy head node, where
+		 * the producer finds them as already consumed nodes.
+		 */
+		Node *dummy = new Node();
+		head_.store(dummy, std::memory_order_relaxed);
+		tail_ = dummy;
+		headCopy_ = dummy;
+		first_ = dummy;
+
+		for (unsigned int i = 0; i < kPreallocatedNodes; ++i) {
+			Node *node = new Node();
+			node->next.store(first_, std::memory_order_relaxed);
+			first_ = node;
+		}
+	}
+
+	~CompletionQueue()
+	{
+		while (first_) {
+			Node *next = first_->next.load(std::memory_order_relaxed);
+			delete first_;
+			first_ = next;
+		}
+	}
+
+	bool isValid() const { return fd_.isValid(); }
+	int fd() const { return fd_.get(); }
+
+	void push(Request *request)
+	{
+		Node *node = allocNode();
+		node->next.store(nullptr, std::memory_order_relaxed);
+		node->request = request;
+
+		tail_->next.store(node, std::memory_order_release);
+		tail_ = node;
+
+		eventfd_write(fd_.get(), 1);
+	}
+
+	Request *pop()
+	{
+		/* The semaphore counts the requests available in the queue. */
+		eventfd_t value;
+		if (eventfd_read(fd_.get(), &value) < 0)
+			return nullptr;
+
+		Node *head = head_.load(std::memory_order_relaxed);
+		Node *next = head->next.load(std::memory_order_acquire);
+		ASSERT(next);
+
+		Request *request = next->request;
+		head_.store(next, std::memory_order_release);
+
+		return request;
+	}
+
+private:
+	static constexpr unsigned int kPreallocatedNodes = 16;
+
+	struct Node {
+		std::atomic<Node *> next = nullptr;
+		Request *request = nullptr;
+	};
+
+	/*
+	 * Reuse the oldest consumed node if any, the nodes from first_ up to,
+	 * and excluding, the consumer head have been consumed.
+	 */
+	Node *allocNode()
+	{
+		if (first_ == headCopy_) {
+			headCopy_ = head_.load(std::memory_order_acquire);
+			if (first_ == headCopy_)
+				return new Node();
+		}
+
+		Node *node = first_;
+		first_ = first_->next.load(std::memory_order_relaxed);
+		return node;
+	}
+
+	UniqueFD fd_;
+
+	/* Consumer side */
+	std::atomic<Node *> head_;
+
+	/* Producer side */
+	Node *tail_;
+	Node *first_;
+	Node *headCopy_;
+};
+
 /**
  * \brief Construct a Camera::Private instance
  * \param[in] pipe The pipeline handler responsible for the camera device
  */
 Camera::Private::Private(PipelineHandler *pipe)
 	: requestSequence_(0), pipe_(pipe->shared_from_this()),
-	  disconnected_(false), state_(CameraAvailable)
+	  disconnected_(false), state_(CameraAvailable), coalesceRequests_(0),
+	  mailbox_(false), latestRequest_(nullptr), standby_(false),
+	  appRequests_(0)
 {
+	coalesceTimer_.timeout.connect(this, &Private::flushCompletedRequests);
 }
 
 Camera::Private::~Private()
@@ -642,6 +837,22 @@ Camera::Private::~Private()
  * over a single capture session.
  */
 
+/**
+ * \var Camera::Private::statistics_
+ * \brief The generic counters of the camera
+ *
+ * The counters are updated by the PipelineHandler base class from the
+ * CameraManager thread, and reset when the camera is configured.
+ */
+
+/**
+ * \var Camera::Private::lastSequence_
+ * \brief The sequence number of the last buffer completed for each stream
+ *
+ * This is used to detect dropped frames, and is reset when the camera is
+ * started.
+ */
+
 static const char *const camera_state_names[] = {
 	"Available",
 	"Acquired",
@@ -650,6 +861,30 @@ static const char *const camera_state_names[] = {
 	"Running",
 };
 
+/**
+ * \brief Deliver the requests whose completion has been coalesced
+ *
+ * When completion coalescing is enabled with
+ * Camera::setCompletionCoalescing(), completed requests are accumulated and
+ * delivered together through the Camera::requestsCompleted signal. This
+ * function emits the signal for all the accumulated requests, if any. It is
+ * called when the coalescing window expires, and by the pipeline handler when
+ * the camera is stopped to ensure all requests are delivered before stop()
+ * returns.
+ */
+void Camera::Private::flushCompletedRequests()
+{
+	coalesceTimer_.stop();
+
+	if (completedRequests_.empty())
+		return;
+
+	std::vector<Request *> requests = std::move(completedRequests_);
+	completedRequests_.clear();
+
+	_o<Camera>()->requestsCompleted.emit(requests);
+}
+
 bool Camera::Private::isAcquired() const
 {
 	return state_.load(std::memory_order_acquire) != CameraAvailable;
@@ -702,6 +937,218 @@ int Camera::Private::isAccessAllowed(State low, State high,
 	return -EACCES;
 }
 
+int Camera::Private::validateRequest(const Request *request) const
+{
+	/* Requests can only be queued to the camera that created them. */
+	if (request->_d()->camera() != _o<Camera>()) {
+		LOG(Camera, Error) << "Request was not created by this camera";
+		return -EXDEV;
+	}
+
+	if (request->status() != Request::RequestPending) {
+		LOG(Camera, Error) << request->toString() << " is not valid";
+		return -EINVAL;
+	}
+
+	if (request->buffers().empty()) {
+		LOG(Camera, Error) << "Request contains no buffers";
+		return -EINVAL;
+	}
+
+	for (auto const &it : request->buffers()) {
+		const Stream *stream = it.first;
+
+		if (activeStreams_.find(stream) == activeStreams_.end()) {
+			LOG(Camera, Error) << "Invalid request";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate the buffers and requests used in standby mode. A single buffer set
+ * is allocated for the active stream with the smallest frames, to lower the
+ * memory and bandwidth used while no application request is queued.
+ */
+int Camera::Private::startStandby(const ControlList *startControls)
+{
+	constexpr unsigned int kStandbyRequests = 2;
+
+	Camera *const camera = _o<Camera>();
+	Stream *stream = nullptr;
+
+	for (const Stream *s : activeStreams_) {
+		if (!stream || s->configuration().frameSize <
+			       stream->configuration().frameSize)
+			stream = const_cast<Stream *>(s);
+	}
+
+	if (!stream)
+		return -EINVAL;
+
+	int ret = pipe_->invokeMethod(&PipelineHandler::exportFrameBuffers,
+				      ConnectionTypeBlocking, camera, stream,
+				      &standbyBuffers_);
+	if (ret < 0)
+		return ret;
+
+	for (unsigned int i = 0; i < kStandbyRequests && i < standbyBuffers_.size(); ++i) {
+		std::unique_ptr<Request> request = std::make_unique<Request>(camera);
+		pipe_->registerRequest(request.get());
+
+		ret = request->addBuffer(stream, standbyBuffers_[i].get());
+		if (ret < 0) {
+			stopStandby();
+			return ret;
+		}
+
+		idleStandbyRequests_.push_back(request.get());
+		standbyRequests_.push_back(std::move(request));
+	}
+
+	/*
+	 * Record the frame durations to restore when the application resumes
+	 * capture, from the start controls or the camera defaults.
+	 */
+	appFrameDurations_ = {};
+
+	if (startControls && startControls->contains(controls::FRAME_DURATION_LIMITS)) {
+		appFrameDurations_ = startControls->get(controls::FRAME_DURATION_LIMITS);
+	} else {
+		auto info = controlInfo_.find(&controls::FrameDurationLimits);
+		if (info != controlInfo_.end()) {
+			const ControlInfo &limits = info->second;
+
+			if (!limits.def().isNone()) {
+				appFrameDurations_ = limits.def();
+			} else if (limits.min().type() == ControlTypeInteger64 &&
+				   !limits.min().isArray()) {
+				std::array<int64_t, 2> durations = {
+					limits.min().get<int64_t>(),
+					limits.max().get<int64_t>(),
+				};
+				appFrameDurations_ = ControlValue(Span<const int64_t, 2>(durations));
+			}
+		}
+	}
+
+	appRequests_.store(0, std::memory_order_release);
+
+	return 0;
+}
+
+void Camera::Private::stopStandby()
+{
+	idleStandbyRequests_.clear();
+	standbyRequests_.clear();
+	standbyBuffers_.clear();
+}
+
+bool Camera::Private::isStandbyRequest(const Request *request) const
+{
+	return std::any_of(standbyRequests_.begin(), standbyRequests_.end(),
+			   [request](const std::unique_ptr<Request> &r) {
+				   return r.get() == request;
+			   });
+}
+
+void Camera::Private::queueStandbyRequest(Request *request)
+{
+	request->reuse(Request::ReuseBuffers);
+
+	if (standbyFrameDuration_.count() &&
+	    controlInfo_.find(&controls::FrameDurationLimits) != controlInfo_.end()) {
+		int64_t duration = standbyFrameDuration_.count();
+		request->controls().set(controls::FrameDurationLimits,
+					{ duration, duration });
+	}
+
+	pipe_->invokeMethod(&PipelineHandler::queueRequest,
+			    ConnectionTypeAuto, request);
+}
+
+/*
+ * Account for an application request being queued. The first request queued
+ * after standby restores the application frame durations, unless it sets them
+ * explicitly.
+ */
+void Camera::Private::requestQueued(Request *request)
+{
+	bool hasDurations = request->controls().contains(controls::FRAME_DURATION_LIMITS);
+
+	if (hasDurations)
+		appFrameDurations_ = request->controls().get(controls::FRAME_DURATION_LIMITS);
+
+	if (appRequests_.fetch_add(1, std::memory_order_acq_rel))
+		return;
+
+	if (!standbyRequests_.empty() && standbyFrameDuration_.count() &&
+	    !hasDurations && !appFrameDurations_.isNone())
+		request->controls().set(controls::FRAME_DURATION_LIMITS,
+					appFrameDurations_);
+}
+
+/*
+ * Account for an application request completing, and resume standby capture
+ * once the last queued application request has completed.
+ */
+void Camera::Private::appRequestCompleted()
+{
+	if (appRequests_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	if (!isRunning())
+		return;
+
+	std::vector<Request *> requests = std::move(idleStandbyRequests_);
+	idleStandbyRequests_.clear();
+
+	for (Request *request : requests)
+		queueStandbyRequest(request);
+}
+
+/*
+ * Return a completed application request through the completion queue, the
+ * requestsCompleted signal when completion coalescing is enabled, or the
+ * requestCompleted signal.
+ */
+void Camera::Private::signalRequest(Request *request)
+{
+	if (completionQueue_) {
+		completionQueue_->push(request);
+		return;
+	}
+
+	if (!coalesceRequests_) {
+		_o<Camera>()->requestCompleted.emit(request);
+		return;
+	}
+
+	completedRequests_.push_back(request);
+
+	if (completedRequests_.size() >= coalesceRequests_)
+		flushCompletedRequests();
+	else if (completedRequests_.size() == 1 && coalesceDelay_.count())
+		coalesceTimer_.start(utils::clock::now() + coalesceDelay_);
+}
+
+/*
+ * Return the request held by the mailbox, if any, to the application. The
+ * request would otherwise stay parked across capture sessions and camera
+ * configurations, where it isn't valid anymore.
+ */
+void Camera::Private::flushMailbox()
+{
+	Request *request = latestRequest_.exchange(nullptr, std::memory_order_acq_rel);
+	if (!request)
+		return;
+
+	signalRequest(request);
+	flushCompletedRequests();
+}
+
 void Camera::Private::disconnect()
 {
 	/*
@@ -885,6 +1332,16 @@ const std::string &Camera::id() const
  * \brief Signal emitted when a request queued to the camera has completed
  */
 
+/**
+ * \var Camera::requestsCompleted
+ * \brief Signal emitted when a batch of requests queued to the camera has
+ * completed
+ *
+ * This signal is only emitted when completion coalescing has been enabled with
+ * setCompletionCoalescing(), and replaces the requestCompleted signal in that
+ * case. The requests are listed in completion order.
+ */
+
 /**
  * \var Camera::disconnected
  * \brief Signal emitted when the camera is disconnected from the system
@@ -930,8 +1387,7 @@ void Camera::disconnect()
 	disconnected.emit();
 }
 
-int Camera::exportFrameBuffers(Stream *stream,
-			       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+int Camera::checkBufferExport(Stream *stream)
 {
 	Private *const d = _d();
 
@@ -945,6 +1401,18 @@ int Camera::exportFrameBuffers(Stream *stream,
 	if (d->activeStreams_.find(stream) == d->activeStreams_.end())
 		return -EINVAL;
 
+	return 0;
+}
+
+int Camera::exportFrameBuffers(Stream *stream,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	Private *const d = _d();
+
+	int ret = checkBufferExport(stream);
+	if (ret < 0)
+		return ret;
+
 	return d->pipe_->invokeMethod(&PipelineHandler::exportFrameBuffers,
 				      ConnectionTypeBlocking, this, stream,
 				      buffers);
@@ -986,7 +1454,8 @@ int Camera::acquire()
 	if (ret < 0)
 		return ret == -EACCES ? -EBUSY : ret;
 
-	if (!d->pipe_->acquire()) {
+	if (!d->pipe_->invokeMethod(&PipelineHandler::acquire,
+				    ConnectionTypeBlocking, this)) {
 		LOG(Camera, Info)
 			<< "Pipeline handler in use by another process";
 		return -EBUSY;
@@ -1020,6 +1489,8 @@ int Camera::release()
 	if (ret < 0)
 		return ret == -EACCES ? -EBUSY : ret;
 
+	d->flushMailbox();
+
 	if (d->isAcquired())
 		d->pipe_->release(this);
 
@@ -1177,18 +1648,32 @@ int Camera::configure(CameraConfiguration *config)
 
 	for (unsigned int index = 0; index < config->size(); ++index) {
 		StreamConfiguration &cfg = config->at(index);
+		if (!cfg.frameRateDivisor) {
+			LOG(Camera, Error)
+				<< "Invalid frame rate divisor for stream " << index;
+			return -EINVAL;
+		}
+
 		msg << " (" << index << ") " << cfg.toString();
+		if (cfg.frameRateDivisor > 1)
+			msg << "/" << cfg.frameRateDivisor;
 	}
 
 	LOG(Camera, Info) << msg.str();
 
+	d->flushMailbox();
+
 	ret = d->pipe_->invokeMethod(&PipelineHandler::configure,
 				     ConnectionTypeBlocking, this, config);
 	if (ret)
 		return ret;
 
+	/* The streams are owned by the pipeline handler and not const. */
+	for (const Stream *stream : d->activeStreams_)
+		const_cast<Stream *>(stream)->index_ = Stream::kInvalidIndex;
+
 	d->activeStreams_.clear();
-	for (const StreamConfiguration &cfg : *config) {
+	for (const auto &[index, cfg] : utils::enumerate(*config)) {
 		Stream *stream = cfg.stream();
 		if (!stream) {
 			LOG(Camera, Fatal)
@@ -1198,14 +1683,293 @@ int Camera::configure(CameraConfiguration *config)
 		}
 
 		stream->configuration_ = cfg;
+		stream->index_ = index;
 		d->activeStreams_.insert(stream);
 	}
 
+	d->statistics_ = {};
+
 	d->setState(Private::CameraConfigured);
 
 	return 0;
 }
 
+/**
+ * \brief Coalesce the delivery of completed requests
+ * \param[in] maxRequests The maximum number of requests to deliver at once
+ * \param[in] maxDelay The maximum delay before delivering a completed request
+ *
+ * Completed requests are by default delivered one by one through the
+ * requestCompleted signal. Applications that run many cameras or high frame
+ * rates can instead have completed requests accumulated and delivered in
+ * batches through the requestsCompleted signal, reducing the number of
+ * wakeups of their event loop.
+ *
+ * When coalescing is enabled, a batch is delivered when it contains
+ * \a maxRequests requests, or \a maxDelay after the completion of its first
+ * request if \a maxDelay isn't zero, whichever comes first. All pending
+ * requests are delivered before stop() returns. The requestCompleted signal
+ * isn't emitted while coalescing is enabled.
+ *
+ * Setting \a maxRequests to 0 or 1 disables coalescing.
+ *
+ * \context This function may only be called when the camera is in the
+ * Acquired or Configured state as defined in \ref camera_operation, and shall
+ * be synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where coalescing can be set
+ */
+int Camera::setCompletionCoalescing(unsigned int maxRequests,
+				    std::chrono::microseconds maxDelay)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraAcquired,
+				     Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	d->coalesceRequests_ = maxRequests > 1 ? maxRequests : 0;
+	d->coalesceDelay_ = maxDelay;
+
+	return 0;
+}
+
+/**
+ * \brief Enable or disable the completion queue
+ * \param[in] enable True to enable the completion queue, false to disable it
+ *
+ * The completion queue offers an alternative to the requestCompleted signal
+ * for applications that run their own event loop, such as epoll-based loops.
+ * When enabled, completed requests are added to a queue instead of being
+ * signalled, and no application code is called from the libcamera internal
+ * threads. The completionQueueFd() file descriptor becomes readable when the
+ * queue contains requests, which the application then retrieves with
+ * dequeueCompletedRequest().
+ *
+ * Neither the requestCompleted nor the requestsCompleted signal is emitted
+ * while the completion queue is enabled. The bufferCompleted signal is not
+ * affected.
+ *
+ * Disabling the completion queue discards the requests it contains without
+ * deleting them. Applications shall dequeue all completed requests before
+ * disabling it.
+ *
+ * \context This function may only be called when the camera is in the
+ * Acquired or Configured state as defined in \ref camera_operation, and shall
+ * be synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where the completion queue can
+ * be enabled or disabled
+ * \retval -ENOMEM The event file descriptor couldn't be created
+ */
+int Camera::setCompletionQueueEnabled(bool enable)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraAcquired,
+				     Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	if (!enable) {
+		d->completionQueue_.reset();
+		return 0;
+	}
+
+	if (d->completionQueue_)
+		return 0;
+
+	auto queue = std::make_unique<Private::CompletionQueue>();
+	if (!queue->isValid()) {
+		ret = -errno;
+		LOG(Camera, Error)
+			<< "Failed to create completion queue: " << strerror(-ret);
+		return -ENOMEM;
+	}
+
+	d->completionQueue_ = std::move(queue);
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the file descriptor of the completion queue
+ *
+ * The file descriptor is readable when the completion queue contains completed
+ * requests. It shall only be polled, and not read, by the application. The file
+ * descriptor is owned by the camera and stays valid until the completion queue
+ * is disabled or the camera is deleted.
+ *
+ * \context This function may be called from any thread, but shall not race
+ * with setCompletionQueueEnabled().
+ *
+ * \return The completion queue file descriptor, or -1 if the completion queue
+ * isn't enabled
+ */
+int Camera::completionQueueFd() const
+{
+	const Private *const d = _d();
+
+	return d->completionQueue_ ? d->completionQueue_->fd() : -1;
+}
+
+/**
+ * \brief Retrieve the next request from the completion queue
+ *
+ * Requests are dequeued in completion order. This function doesn't block, and
+ * doesn't take any lock shared with the libcamera internal threads.
+ *
+ * The completion queue has a single producer, the camera, and a single
+ * consumer, the caller of this function.
+ *
+ * \context This function may be called from any thread, but calls shall be
+ * serialized by the application, and shall not race with
+ * setCompletionQueueEnabled().
+ *
+ * \return The next completed request, or nullptr if the completion queue is
+ * empty or not enabled
+ */
+Request *Camera::dequeueCompletedRequest()
+{
+	Private *const d = _d();
+
+	if (!d->completionQueue_)
+		return nullptr;
+
+	return d->completionQueue_->pop();
+}
+
+/**
+ * \brief Enable or disable the latest request mailbox
+ * \param[in] enable True to enable the mailbox, false to disable it
+ *
+ * The mailbox mode is designed for applications that only need the most recent
+ * frame, such as vision workloads. When enabled, completed requests are not
+ * signalled. Instead, each completed request replaces the previous one in a
+ * single-slot mailbox, and the replaced request is automatically reused with
+ * Request::ReuseBuffers and queued back to the camera. The application
+ * retrieves the most recent completed request at its own pace with
+ * takeLatestRequest(), and queues it back with Request::reuse() and
+ * queueRequest() once done with it.
+ *
+ * With at least three requests queued to the camera, the camera keeps
+ * capturing into one request while the mailbox holds the latest one and the
+ * application processes a third, similarly to triple buffering. The latency of
+ * the frames retrieved by the application is then bounded to one frame,
+ * regardless of the processing speed of the application.
+ *
+ * Cancelled requests, including the requests completed during stop(), are
+ * signalled through the requestCompleted signal as usual to return them to
+ * the application. The request held by the mailbox, if any, is signalled the
+ * same way when the camera is started, stopped, configured or released, and
+ * when the mailbox is disabled.
+ *
+ * \context This function may only be called when the camera is in the
+ * Acquired or Configured state as defined in \ref camera_operation, and shall
+ * be synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where the mailbox can be
+ * enabled or disabled
+ */
+int Camera::setMailboxEnabled(bool enable)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraAcquired,
+				     Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	if (!enable)
+		d->flushMailbox();
+
+	d->mailbox_ = enable;
+
+	return 0;
+}
+
+/**
+ * \brief Take the most recent completed request from the mailbox
+ *
+ * Atomically retrieve the request held by the mailbox and empty it. Ownership
+ * of the request is returned to the application, which shall queue it back to
+ * the camera when done with it. A request left in the mailbox is signalled
+ * through the requestCompleted signal when the camera is stopped.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The most recent completed request, or nullptr if no request has
+ * completed since the last call
+ */
+Request *Camera::takeLatestRequest()
+{
+	return _d()->latestRequest_.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+/**
+ * \brief Enable or disable the standby mode
+ * \param[in] enable True to enable the standby mode, false to disable it
+ * \param[in] frameDuration The frame duration while in standby, 0 to leave the
+ * frame rate unchanged
+ *
+ * Starting the camera involves powering up the sensor, starting all devices
+ * and letting the image processing algorithms converge on the first frames,
+ * all of which delay the completion of the first request. Applications that
+ * capture on events can instead start the camera in standby mode, and queue
+ * requests only when frames are needed.
+ *
+ * When the standby mode is enabled, the camera allocates a small set of
+ * internal buffers for the active stream with the smallest frames when it is
+ * started, and keeps capturing to them whenever no application request is
+ * queued. The pipeline and the algorithms keep running, and application
+ * requests are processed at once when queued. The internal requests are never
+ * signalled to the application, but consume request sequence numbers.
+ *
+ * If \a frameDuration isn't zero, the internal requests set the
+ * controls::FrameDurationLimits control to it, to save power while in standby.
+ * The first application request queued after standby restores the frame
+ * durations set by the application in the start() controls or its latest
+ * request, or the camera default frame durations. Note that requests queued
+ * while an internal request is in flight may have to wait for the end of a
+ * standby frame, so long standby frame durations increase the latency of the
+ * first frame.
+ *
+ * \context This function may only be called when the camera is in the
+ * Acquired or Configured state as defined in \ref camera_operation, and shall
+ * be synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where the standby mode can be
+ * enabled or disabled
+ */
+int Camera::setStandbyEnabled(bool enable, std::chrono::microseconds frameDuration)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraAcquired,
+				     Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	d->standby_ = enable;
+	d->standbyFrameDuration_ = enable ? frameDuration
+					  : std::chrono::microseconds{};
+
+	return 0;
+}
+
 /**
  * \brief Create a request object for the camera
  * \param[in] cookie Opaque cookie for application use
@@ -1244,6 +2008,48 @@ std::unique_ptr<Request> Camera::createRequest(uint64_t cookie)
 	return request;
 }
 
+/**
+ * \brief Create a pool of requests for the camera
+ * \param[in] count The number of requests to create
+ *
+ * This function creates \a count requests as createRequest() does, with
+ * cookies set to their index in the returned pool. The requests are
+ * preallocated for the streams of the active camera configuration, so that
+ * adding one buffer per stream to them with Request::addBuffer() doesn't
+ * allocate memory. This is retained when the requests are reused with
+ * Request::reuse(), which lets applications capture frames without memory
+ * allocations in the request handling path.
+ *
+ * \context This function is \threadsafe. It may only be called when the camera
+ * is in the Configured or Running state as defined in \ref camera_operation.
+ *
+ * \return The requests, or an empty vector on error
+ */
+std::vector<std::unique_ptr<Request>> Camera::createRequestPool(unsigned int count)
+{
+	Private *const d = _d();
+
+	std::vector<std::unique_ptr<Request>> requests;
+
+	int ret = d->isAccessAllowed(Private::CameraConfigured,
+				     Private::CameraRunning);
+	if (ret < 0)
+		return requests;
+
+	requests.reserve(count);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		std::unique_ptr<Request> request = std::make_unique<Request>(this, i);
+		request->_d()->reserve(d->activeStreams_);
+
+		d->pipe_->registerRequest(request.get());
+
+		requests.push_back(std::move(request));
+	}
+
+	return requests;
+}
+
 /**
  * \brief Queue a request to the camera
  * \param[in] request The request to queue to the camera
@@ -1275,39 +2081,77 @@ int Camera::queueRequest(Request *request)
 	if (ret < 0)
 		return ret;
 
-	/* Requests can only be queued to the camera that created them. */
-	if (request->_d()->camera() != this) {
-		LOG(Camera, Error) << "Request was not created by this camera";
-		return -EXDEV;
-	}
-
-	if (request->status() != Request::RequestPending) {
-		LOG(Camera, Error) << request->toString() << " is not valid";
-		return -EINVAL;
-	}
-
 	/*
 	 * The camera state may change until the end of the function. No locking
 	 * is however needed as PipelineHandler::queueRequest() will handle
 	 * this.
 	 */
 
-	if (request->buffers().empty()) {
-		LOG(Camera, Error) << "Request contains no buffers";
-		return -EINVAL;
-	}
+	ret = d->validateRequest(request);
+	if (ret < 0)
+		return ret;
 
-	for (auto const &it : request->buffers()) {
-		const Stream *stream = it.first;
+	d->requestQueued(request);
 
-		if (d->activeStreams_.find(stream) == d->activeStreams_.end()) {
-			LOG(Camera, Error) << "Invalid request";
+	d->pipe_->invokeMethod(&PipelineHandler::queueRequest,
+			       ConnectionTypeQueued, request);
+
+	return 0;
+}
+
+/**
+ * \brief Queue multiple requests to the camera
+ * \param[in] requests The requests to queue to the camera
+ *
+ * This function queues all the \a requests to the camera for capture, in the
+ * order they are listed. It behaves as calling queueRequest() for each
+ * request, but validates all the requests first and hands them to the camera
+ * in a single operation, which lowers the overhead of queuing multiple
+ * requests, for instance when starting capture.
+ *
+ * The requests are queued atomically: if any request is invalid, or if a
+ * request is listed multiple times, no request is queued and an error is
+ * returned.
+ *
+ * \context This function is \threadsafe. It may only be called when the camera
+ * is in the Running state as defined in \ref camera_operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not running so requests can't be queued
+ * \retval -EXDEV A request does not belong to this camera
+ * \retval -EINVAL A request is invalid or listed multiple times
+ */
+int Camera::queueRequests(Span<Request *const> requests)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraRunning);
+	if (ret < 0)
+		return ret;
+
+	for (auto it = requests.begin(); it != requests.end(); ++it) {
+		ret = d->validateRequest(*it);
+		if (ret < 0)
+			return ret;
+
+		if (std::find(requests.begin(), it, *it) != it) {
+			LOG(Camera, Error)
+				<< (*it)->toString() << " is queued multiple times";
 			return -EINVAL;
 		}
 	}
 
-	d->pipe_->invokeMethod(&PipelineHandler::queueRequest,
-			       ConnectionTypeQueued, request);
+	if (requests.empty())
+		return 0;
+
+	for (Request *request : requests)
+		d->requestQueued(request);
+
+	d->pipe_->invokeMethod(&PipelineHandler::queueRequests,
+			       ConnectionTypeQueued,
+			       std::vector<Request *>(requests.begin(),
+						      requests.end()));
 
 	return 0;
 }
@@ -1342,13 +2186,32 @@ int Camera::start(const ControlList *controls)
 
 	ASSERT(d->requestSequence_ == 0);
 
+	/* Sequence numbers restart from zero in a new capture session. */
+	d->lastSequence_.clear();
+
+	d->flushMailbox();
+
+	if (d->standby_) {
+		ret = d->startStandby(controls);
+		if (ret)
+			return ret;
+	}
+
 	ret = d->pipe_->invokeMethod(&PipelineHandler::start,
 				     ConnectionTypeBlocking, this, controls);
-	if (ret)
+	if (ret) {
+		d->stopStandby();
 		return ret;
+	}
 
 	d->setState(Private::CameraRunning);
 
+	std::vector<Request *> requests = std::move(d->idleStandbyRequests_);
+	d->idleStandbyRequests_.clear();
+
+	for (Request *request : requests)
+		d->queueStandbyRequest(request);
+
 	return 0;
 }
 
@@ -1391,26 +2254,96 @@ int Camera::stop()
 
 	ASSERT(!d->pipe_->hasPendingRequests(this));
 
+	d->stopStandby();
+
 	d->setState(Private::CameraConfigured);
 
+	d->flushMailbox();
+
 	return 0;
 }
 
+/**
+ * \brief Retrieve the runtime performance counters of the camera
+ *
+ * This function returns a snapshot of the counters accumulated by the camera
+ * since it has been configured. It may be called at any time once the camera
+ * has been configured, including while the camera is running.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The camera statistics, or default counters if the camera hasn't
+ * been configured
+ */
+CameraStatistics Camera::statistics() const
+{
+	const Private *const d = _d();
+
+	if (d->isAccessAllowed(Private::CameraConfigured, Private::CameraRunning))
+		return {};
+
+	return d->pipe_->invokeMethod(&PipelineHandler::statistics,
+				      ConnectionTypeBlocking,
+				      const_cast<Camera *>(this));
+}
+
 /**
  * \brief Handle request completion and notify application
  * \param[in] request The request that has completed
  *
  * This function is called by the pipeline handler to notify the camera that
- * the request has completed. It emits the requestCompleted signal.
+ * the request has completed. It emits the requestCompleted signal, or
+ * accumulates the request for the requestsCompleted signal when completion
+ * coalescing is enabled, or adds it to the completion queue or the mailbox
+ * when enabled.
  */
 void Camera::requestComplete(Request *request)
 {
+	Private *const d = _d();
+
 	/* Disconnected cameras are still able to complete requests. */
-	if (_d()->isAccessAllowed(Private::CameraStopping, Private::CameraRunning,
-				  true))
+	if (d->isAccessAllowed(Private::CameraStopping, Private::CameraRunning,
+			       true))
 		LOG(Camera, Fatal) << "Trying to complete a request when stopped";
 
-	requestCompleted.emit(request);
+	/*
+	 * Standby requests are never signalled. They are queued back as long as
+	 * no application request is queued, and kept idle otherwise, or when
+	 * cancelled to avoid requeuing them in a loop if the device keeps
+	 * failing.
+	 */
+	if (d->isStandbyRequest(request)) {
+		if (d->isRunning() && request->status() == Request::RequestComplete &&
+		    !d->appRequests_.load(std::memory_order_acquire))
+			d->queueStandbyRequest(request);
+		else
+			d->idleStandbyRequests_.push_back(request);
+
+		return;
+	}
+
+	/*
+	 * In mailbox mode, replace the latest request and queue the stale one
+	 * back. Cancelled requests are signalled to the application below to
+	 * avoid requeuing them in a loop if the device keeps failing.
+	 */
+	if (d->mailbox_ && d->isRunning() &&
+	    request->status() == Request::RequestComplete) {
+		Request *stale = d->latestRequest_.exchange(request,
+							    std::memory_order_acq_rel);
+		if (stale) {
+			/* The stale request takes the place of the completed one. */
+			stale->reuse(Request::ReuseBuffers);
+			d->pipe_->queueRequest(stale);
+		} else {
+			d->appRequestCompleted();
+		}
+
+		return;
+	}
+
+	d->appRequestCompleted();
+	d->signalRequest(request);
 }
 
 } /* namespace libcamera */
@@ -46,8 +46,7 @@ const std::string &CameraControlValidator::name() const
  */
 bool CameraControlValidator::validate(unsigned int id) const
 {
-	const ControlInfoMap &controls = camera_->controls();
-	return controls.find(id) != controls.end();
+	return camera_->controls().contains(id);
 }
 
 } /* namespace libcamera */
@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Group of cameras capturing synchronized frames
+ */
+
+#include <libcamera/camera_group.h>
+
+#include <algorithm>
+#include <deque>
+#include <errno.h>
+#include <optional>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/request.h>
+
+/**
+ * \file camera_group.h
+ * \brief Group of cameras capturing synchronized frames
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CameraGroup)
+
+namespace {
+
+/*
+ * Maximum number of completed requests held for a camera while waiting for
+ * the other cameras. A camera that gets further ahead has its oldest request
+ * completed without a match, to avoid starving the application of requests.
+ */
+constexpr unsigned int kMaxPendingRequests = 2;
+
+std::optional<int64_t> requestTimestamp(Request *request)
+{
+	if (request->status() != Request::RequestComplete)
+		return std::nullopt;
+
+	const auto timestamp = request->metadata().get(controls::SensorTimestamp);
+	if (timestamp)
+		return *timestamp;
+
+	const Request::BufferMap &buffers = request->buffers();
+	if (buffers.empty())
+		return std::nullopt;
+
+	return buffers.begin()->second->metadata().timestamp;
+}
+
+} /* namespace */
+
+class CameraGroup::Private : public Extensible::Private
+{
+	LIBCAMERA_DECLARE_PUBLIC(CameraGroup)
+
+public:
+	struct PendingRequest {
+		Request *request;
+		int64_t timestamp;
+	};
+
+	Private(std::vector<std::shared_ptr<Camera>> cameras,
+		std::chrono::nanoseconds tolerance);
+
+	void requestComplete(unsigned int index, Request *request);
+	void flush();
+
+	std::vector<std::shared_ptr<Camera>> cameras_;
+	std::chrono::nanoseconds tolerance_;
+
+private:
+	void emit(const std::vector<std::vector<Request *>> &groups);
+	void matchRequests(std::vector<std::vector<Request *>> *groups)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+	std::vector<Request *> unmatched(unsigned int index)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	Mutex mutex_;
+	std::vector<std::deque<PendingRequest>> pending_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+CameraGroup::Private::Private(std::vector<std::shared_ptr<Camera>> cameras,
+			      std::chrono::nanoseconds tolerance)
+	: cameras_(std::move(cameras)), tolerance_(tolerance),
+	  pending_(cameras_.size())
+{
+}
+
+void CameraGroup::Private::requestComplete(unsigned int index, Request *request)
+{
+	std::vector<std::vector<Request *>> groups;
+
+	std::optional<int64_t> timestamp = requestTimestamp(request);
+
+	{
+		MutexLocker locker(mutex_);
+
+		if (!timestamp) {
+			/*
+			 * Cancelled and failed requests can't be matched,
+			 * complete them immediately.
+			 */
+			std::vector<Request *> group(cameras_.size(), nullptr);
+			group[index] = request;
+			groups.push_back(std::move(group));
+		} else {
+			pending_[index].push_back({ request, *timestamp });
+			matchRequests(&groups);
+		}
+	}
+
+	emit(groups);
+}
+
+void CameraGroup::Private::flush()
+{
+	std::vector<std::vector<Request *>> groups;
+
+	{
+		MutexLocker locker(mutex_);
+
+		for (unsigned int i = 0; i < pending_.size(); ++i) {
+			while (!pending_[i].empty())
+				groups.push_back(unmatched(i));
+		}
+	}
+
+	emit(groups);
+}
+
+void CameraGroup::Private::emit(const std::vector<std::vector<Request *>> &groups)
+{
+	CameraGroup *o = LIBCAMERA_O_PTR();
+
+	for (const std::vector<Request *> &group : groups)
+		o->requestsCompleted.emit(group);
+}
+
+void CameraGroup::Private::matchRequests(std::vector<std::vector<Request *>> *groups)
+{
+	while (true) {
+		bool complete = true;
+
+		for (unsigned int i = 0; i < pending_.size(); ++i) {
+			if (pending_[i].size() > kMaxPendingRequests) {
+				LOG(CameraGroup, Debug)
+					<< "Camera " << cameras_[i]->id()
+					<< " is ahead, completing request without match";
+				groups->push_back(unmatched(i));
+			}
+
+			if (pending_[i].empty())
+				complete = false;
+		}
+
+		if (!complete)
+			return;
+
+		/*
+		 * All cameras have a completed request. If their timestamps are
+		 * within the tolerance, complete them together. Otherwise the
+		 * oldest request can't be matched, as the next frames of the
+		 * other cameras will be even later.
+		 */
+		auto [oldest, newest] = std::minmax_element(pending_.begin(), pending_.end(),
+			[](const auto &a, const auto &b) {
+				return a.front().timestamp < b.front().timestamp;
+			});
+
+		int64_t delta = newest->front().timestamp - oldest->front().timestamp;
+		if (delta > tolerance_.count()) {
+			groups->push_back(unmatched(oldest - pending_.begin()));
+			continue;
+		}
+
+		std::vector<Request *> group;
+		for (std::deque<PendingRequest> &queue : pending_) {
+			group.push_back(queue.front().request);
+			queue.pop_front();
+		}
+
+		groups->push_back(std::move(group));
+	}
+}
+
+std::vector<Request *> CameraGroup::Private::unmatched(unsigned int index)
+{
+	std::vector<Request *> group(cameras_.size(), nullptr);
+
+	group[index] = pending_[index].front().request;
+	pending_[index].pop_front();
+
+	return group;
+}
+
+/**
+ * \class CameraGroup
+ * \brief Capture synchronized frames from multiple cameras
+ *
+ * Stereo and depth systems capture frames from multiple cameras, and need to
+ * process the frames captured at the same time together. The CameraGroup
+ * class controls a set of cameras as a unit: it starts and stops them
+ * together, queues one request to each camera at once, and completes the
+ * requests together once the frames of all cameras have been captured.
+ *
+ * Requests are matched by the time at which the sensors started exposing the
+ * frames, as reported by the controls::SensorTimestamp metadata, or by the
+ * timestamp of the first buffer of the request if the metadata isn't
+ * available. Requests whose timestamps are within the tolerance of the group
+ * are completed together through the requestsCompleted signal. Requests that
+ * can't be matched, because a camera dropped a frame, the request failed or
+ * was cancelled, are completed on their own.
+ *
+ * The cameras shall be acquired and configured by the application before
+ * using the group. The application shall not connect to the
+ * Camera::requestCompleted signal of the cameras of the group, and shall queue
+ * all requests through queueRequests().
+ *
+ * The sensors of the cameras shall be synchronized by the system, for
+ * instance by sharing a frame synchronization signal, or by running at the
+ * same frame rate after being started together. The CameraGroup doesn't
+ * configure hardware frame synchronization.
+ */
+
+/**
+ * \brief Create a group of cameras
+ * \param[in] cameras The cameras in the group
+ * \param[in] tolerance The maximum difference between the sensor timestamps of
+ * matching frames
+ */
+CameraGroup::CameraGroup(std::vector<std::shared_ptr<Camera>> cameras,
+			 std::chrono::nanoseconds tolerance)
+	: Extensible(std::make_unique<Private>(std::move(cameras), tolerance))
+{
+	Private *const d = _d();
+
+	for (unsigned int i = 0; i < d->cameras_.size(); ++i) {
+		d->cameras_[i]->requestCompleted.connect(this, [d, i](Request *request) {
+			d->requestComplete(i, request);
+		});
+	}
+}
+
+CameraGroup::~CameraGroup()
+{
+	for (const std::shared_ptr<Camera> &camera : _d()->cameras_)
+		camera->requestCompleted.disconnect(this);
+}
+
+/**
+ * \brief Retrieve the cameras in the group
+ * \return The cameras in the group, in the order of the requests in the
+ * requestsCompleted signal
+ */
+const std::vector<std::shared_ptr<Camera>> &CameraGroup::cameras() const
+{
+	return _d()->cameras_;
+}
+
+/**
+ * \brief Retrieve the frame matching tolerance
+ * \return The maximum difference between the sensor timestamps of matching
+ * frames
+ */
+std::chrono::nanoseconds CameraGroup::tolerance() const
+{
+	return _d()->tolerance_;
+}
+
+/**
+ * \brief Start all cameras in the group
+ * \param[in] controls Controls to be applied to all cameras before starting
+ *
+ * The cameras are started one after the other, as close together as possible.
+ * If a camera fails to start, the cameras already started are stopped.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraGroup::start(const ControlList *controls)
+{
+	Private *const d = _d();
+
+	for (auto it = d->cameras_.begin(); it != d->cameras_.end(); ++it) {
+		int ret = (*it)->start(controls);
+		if (ret < 0) {
+			LOG(CameraGroup, Error)
+				<< "Failed to start camera " << (*it)->id();
+
+			while (it != d->cameras_.begin())
+				(*--it)->stop();
+
+			d->flush();
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Stop all cameras in the group
+ *
+ * All cameras are stopped, and all pending requests are completed. Requests
+ * that have been captured but not matched yet are completed on their own.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraGroup::stop()
+{
+	Private *const d = _d();
+	int ret = 0;
+
+	for (const std::shared_ptr<Camera> &camera : d->cameras_) {
+		int err = camera->stop();
+		if (err < 0 && !ret)
+			ret = err;
+	}
+
+	d->flush();
+
+	return ret;
+}
+
+/**
+ * \brief Queue one request to each camera of the group
+ * \param[in] requests The requests, one per camera in the order of cameras()
+ *
+ * If queuing a request fails, the requests queued to the previous cameras
+ * stay queued and will complete without a match.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The number of requests doesn't match the number of cameras
+ */
+int CameraGroup::queueRequests(Span<Request *const> requests)
+{
+	Private *const d = _d();
+
+	if (requests.size() != d->cameras_.size()) {
+		LOG(CameraGroup, Error)
+			<< "Expected " << d->cameras_.size() << " requests, got "
+			<< requests.size();
+		return -EINVAL;
+	}
+
+	for (unsigned int i = 0; i < requests.size(); ++i) {
+		int ret = d->cameras_[i]->queueRequest(requests[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \var CameraGroup::requestsCompleted
+ * \brief Signal emitted when requests have completed
+ *
+ * The signal carries one request per camera, in the order of cameras(). The
+ * requests captured at the same time are completed together. Requests that
+ * couldn't be matched are completed on their own, with the entries of the
+ * other cameras set to nullptr.
+ */
+
+} /* namespace libcamera */
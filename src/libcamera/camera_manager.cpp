@@ -35,7 +35,7 @@ namespace libcamera {
 LOG_DEFINE_CATEGORY(Camera)
 
 CameraManager::Private::Private()
-	: initialized_(false)
+	: Thread("CameraManager"), initialized_(false)
 {
 }
 
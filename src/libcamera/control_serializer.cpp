@@ -9,10 +9,12 @@
 
 #include <algorithm>
 #include <memory>
+#include <string.h>
 #include <vector>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/span.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
@@ -31,6 +33,48 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Serializer)
 
+namespace {
+
+/*
+ * Call \a func for all entries of \a list, or, if a \a reference list is
+ * given, for the entries of \a list that differ from \a reference only.
+ * Controls present in \a reference but not in \a list are reported with an
+ * empty value. This relies on control lists being sorted by control ID.
+ */
+template<typename Func>
+void forEachEntry(const ControlList &list, const ControlList *reference,
+		  Func func)
+{
+	if (!reference) {
+		for (const auto &[id, value] : list)
+			func(id, value);
+		return;
+	}
+
+	static const ControlValue removed;
+
+	auto iter = list.begin();
+	auto ref = reference->begin();
+
+	while (iter != list.end() || ref != reference->end()) {
+		if (ref == reference->end() ||
+		    (iter != list.end() && iter->first < ref->first)) {
+			func(iter->first, iter->second);
+			++iter;
+		} else if (iter == list.end() || ref->first < iter->first) {
+			func(ref->first, removed);
+			++ref;
+		} else {
+			if (iter->second != ref->second)
+				func(iter->first, iter->second);
+			++iter;
+			++ref;
+		}
+	}
+}
+
+} /* namespace */
+
 /**
  * \class ControlSerializer
  * \brief Serializer and deserializer for control-related classes
@@ -77,6 +121,15 @@ LOG_DEFINE_CATEGORY(Serializer)
  * that constraint results in serialization or deserialization failure of the
  * ControlList.
  *
+ * To reduce the amount of data transferred for control lists that change
+ * little between consecutive messages, such as sensor controls or per-frame
+ * metadata, lists can be serialized with serializeDelta(). Only the controls
+ * that differ from the previous list serialized for the same ControlInfoMap
+ * handle and id map type are then stored, and the deserializer reconstructs
+ * the full list from the previous list it has deserialized. This requires all
+ * lists serialized with serializeDelta() to be deserialized, in order, by the
+ * same deserializer.
+ *
  * The serializer can be reset() to clear its internal state. This may be
  * performed when reconfiguring an IPA to avoid constant growth of the internal
  * state, especially if the contents of the ControlInfoMap instances change at
@@ -140,6 +193,8 @@ void ControlSerializer::reset()
 	infoMaps_.clear();
 	controlIds_.clear();
 	controlIdMaps_.clear();
+	sentLists_.clear();
+	receivedLists_.clear();
 }
 
 size_t ControlSerializer::binarySize(const ControlValue &value)
@@ -192,6 +247,20 @@ size_t ControlSerializer::binarySize(const ControlList &list)
 	return size;
 }
 
+size_t ControlSerializer::binaryDeltaSize(const ControlList &list,
+					 const ControlList &reference)
+{
+	size_t size = sizeof(struct ipa_controls_header);
+
+	forEachEntry(list, &reference,
+		     [&](unsigned int, const ControlValue &value) {
+			     size += sizeof(struct ipa_control_value_entry)
+				   + binarySize(value);
+		     });
+
+	return size;
+}
+
 void ControlSerializer::store(const ControlValue &value,
 			      ByteStreamBuffer &buffer)
 {
@@ -312,6 +381,79 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
  */
 int ControlSerializer::serialize(const ControlList &list,
 				 ByteStreamBuffer &buffer)
+{
+	ListKey key;
+	int ret = listKey(list, &key);
+	if (ret)
+		return ret;
+
+	write(list, nullptr, key, 0, 0, buffer);
+
+	if (buffer.overflow())
+		return -ENOSPC;
+
+	return 0;
+}
+
+/**
+ * \brief Serialize a ControlList in a buffer using delta encoding
+ * \param[in] list The control list to serialize
+ * \param[in] buffer The memory buffer where to serialize the ControlList
+ *
+ * Serialize the \a list into the \a buffer as the serialize() function does,
+ * but only store the controls that differ from the previous list serialized
+ * with this function for the same ControlInfoMap handle and id map type. The
+ * full list is stored for the first list, periodically to recover from lost
+ * lists, and when the delta wouldn't be smaller than the full list.
+ *
+ * The buffer shall be at least binarySize(list) bytes large. The number of
+ * bytes written to the buffer is given by the buffer offset when the function
+ * returns.
+ *
+ * \return 0 on success, a negative error code otherwise
+ * \retval -ENOENT The ControlList is related to an unknown ControlInfoMap
+ * \retval -ENOSPC Not enough space is available in the buffer
+ */
+int ControlSerializer::serializeDelta(const ControlList &list,
+				      ByteStreamBuffer &buffer)
+{
+	ListKey key;
+	int ret = listKey(list, &key);
+	if (ret)
+		return ret;
+
+	auto [iter, inserted] = sentLists_.try_emplace(key);
+	ListState &state = iter->second;
+	uint32_t sequence = state.sequence + 1;
+
+	/*
+	 * Empty values denote removed controls in delta-encoded lists, lists
+	 * that contain empty values are thus always stored in full.
+	 */
+	bool delta = !inserted && sequence % kFullListInterval;
+	if (delta)
+		delta = std::none_of(list.begin(), list.end(),
+				     [](const auto &ctrl) {
+					     return ctrl.second.isNone();
+				     }) &&
+			binaryDeltaSize(list, state.list) < binarySize(list);
+
+	uint32_t flags = IPA_CONTROLS_FLAG_TRACKED;
+	if (delta)
+		flags |= IPA_CONTROLS_FLAG_DELTA;
+
+	write(list, delta ? &state.list : nullptr, key, flags, sequence, buffer);
+
+	if (buffer.overflow())
+		return -ENOSPC;
+
+	state.list = list;
+	state.sequence = sequence;
+
+	return 0;
+}
+
+int ControlSerializer::listKey(const ControlList &list, ListKey *key) const
 {
 	/*
 	 * Find the ControlInfoMap handle for the ControlList if it has one, or
@@ -340,19 +482,37 @@ int ControlSerializer::serialize(const ControlList &list,
 	else
 		idMapType = IPA_CONTROL_ID_MAP_V4L2;
 
-	size_t entriesSize = list.size() * sizeof(struct ipa_control_value_entry);
+	*key = { infoMapHandle, idMapType };
+
+	return 0;
+}
+
+void ControlSerializer::write(const ControlList &list,
+			      const ControlList *reference, const ListKey &key,
+			      uint32_t flags, uint32_t sequence,
+			      ByteStreamBuffer &buffer)
+{
+	unsigned int numEntries = 0;
 	size_t valuesSize = 0;
-	for (const auto &ctrl : list)
-		valuesSize += binarySize(ctrl.second);
+
+	forEachEntry(list, reference,
+		     [&](unsigned int, const ControlValue &value) {
+			     numEntries++;
+			     valuesSize += binarySize(value);
+		     });
+
+	size_t entriesSize = numEntries * sizeof(struct ipa_control_value_entry);
 
 	/* Prepare the packet header. */
-	struct ipa_controls_header hdr;
+	struct ipa_controls_header hdr = {};
 	hdr.version = IPA_CONTROLS_FORMAT_VERSION;
-	hdr.handle = infoMapHandle;
-	hdr.entries = list.size();
+	hdr.handle = key.first;
+	hdr.entries = numEntries;
 	hdr.size = sizeof(hdr) + entriesSize + valuesSize;
 	hdr.data_offset = sizeof(hdr) + entriesSize;
-	hdr.id_map_type = idMapType;
+	hdr.id_map_type = static_cast<enum ipa_controls_id_map_type>(key.second);
+	hdr.flags = flags;
+	hdr.sequence = sequence;
 
 	buffer.write(&hdr);
 
@@ -360,25 +520,18 @@ int ControlSerializer::serialize(const ControlList &list,
 	ByteStreamBuffer values = buffer.carveOut(valuesSize);
 
 	/* Serialize all entries. */
-	for (const auto &ctrl : list) {
-		unsigned int id = ctrl.first;
-		const ControlValue &value = ctrl.second;
-
-		struct ipa_control_value_entry entry;
-		entry.id = id;
-		entry.type = value.type();
-		entry.is_array = value.isArray();
-		entry.count = value.numElements();
-		entry.offset = values.offset();
-		entries.write(&entry);
-
-		store(value, values);
-	}
-
-	if (buffer.overflow())
-		return -ENOSPC;
-
-	return 0;
+	forEachEntry(list, reference,
+		     [&](unsigned int id, const ControlValue &value) {
+			     struct ipa_control_value_entry entry = {};
+			     entry.id = id;
+			     entry.type = value.type();
+			     entry.is_array = value.isArray();
+			     entry.count = value.numElements();
+			     entry.offset = values.offset();
+			     entries.write(&entry);
+
+			     store(value, values);
+		     });
 }
 
 ControlValue ControlSerializer::loadControlValue(ByteStreamBuffer &buffer,
@@ -628,6 +781,44 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 			  loadControlValue(values, entry->is_array, entry->count));
 	}
 
+	if (!(hdr->flags & IPA_CONTROLS_FLAG_TRACKED))
+		return ctrls;
+
+	/*
+	 * Reconstruct delta-encoded lists from the previous list, and store
+	 * the list as the reference for the next delta-encoded list.
+	 */
+	ListState &state = receivedLists_[{ hdr->handle, hdr->id_map_type }];
+
+	if (hdr->flags & IPA_CONTROLS_FLAG_DELTA) {
+		if (hdr->sequence != state.sequence + 1) {
+			LOG(Serializer, Error)
+				<< "Can't deserialize ControlList: missing reference list";
+			return {};
+		}
+
+		ControlList delta = std::move(ctrls);
+		ctrls = ControlList(*idMap);
+
+		auto ref = state.list.begin();
+		for (auto &[id, value] : delta) {
+			for (; ref != state.list.end() && ref->first < id; ++ref)
+				ctrls.set(ref->first, ref->second);
+
+			if (ref != state.list.end() && ref->first == id)
+				++ref;
+
+			if (!value.isNone())
+				ctrls.set(id, std::move(value));
+		}
+
+		for (; ref != state.list.end(); ++ref)
+			ctrls.set(ref->first, ref->second);
+	}
+
+	state.list = ctrls;
+	state.sequence = hdr->sequence;
+
 	return ctrls;
 }
 
@@ -645,4 +836,166 @@ bool ControlSerializer::isCached(const ControlInfoMap &infoMap)
 	return infoMapHandles_.count(&infoMap);
 }
 
+/**
+ * \class ControlListView
+ * \brief Read-only view of a serialized ControlList
+ *
+ * The ControlListView class gives access to the controls stored in a binary
+ * buffer containing a ControlList serialized with ControlSerializer::serialize(),
+ * without deserializing the list. It is meant for the IPC paths that only need
+ * to access a few controls of a list, and avoids the cost of constructing a
+ * ControlList with all the values.
+ *
+ * The view references the buffer memory, which shall stay valid for the
+ * lifetime of the view. As the ControlList is not reconstructed, no ControlIdMap
+ * or ControlInfoMap is needed and controls are identified by their numerical
+ * ID only.
+ */
+
+/**
+ * \brief Construct a view of the ControlList serialized in \a buffer
+ * \param[in] buffer The memory buffer that contains the serialized list
+ *
+ * The \a buffer read position is advanced past the serialized list. If the
+ * buffer doesn't contain a valid serialized list, the view is invalid and
+ * contains no control. Lists serialized with ControlSerializer::serializeDelta()
+ * can't be accessed through a view if they have been delta-encoded, as the
+ * view has no access to the reference list.
+ */
+ControlListView::ControlListView(ByteStreamBuffer &buffer)
+	: hdr_(nullptr), entries_(nullptr), values_(nullptr), valuesSize_(0)
+{
+	const struct ipa_controls_header *hdr = buffer.read<decltype(*hdr)>();
+	if (!hdr) {
+		LOG(Serializer, Error) << "Out of data";
+		return;
+	}
+
+	if (hdr->version != IPA_CONTROLS_FORMAT_VERSION) {
+		LOG(Serializer, Error)
+			<< "Unsupported controls format version "
+			<< hdr->version;
+		return;
+	}
+
+	if (hdr->flags & IPA_CONTROLS_FLAG_DELTA) {
+		LOG(Serializer, Error)
+			<< "Can't create a view of a delta-encoded ControlList";
+		return;
+	}
+
+	if (hdr->data_offset < sizeof(*hdr) || hdr->size < hdr->data_offset ||
+	    hdr->data_offset - sizeof(*hdr) < hdr->entries * sizeof(*entries_)) {
+		LOG(Serializer, Error) << "Invalid controls header";
+		return;
+	}
+
+	ByteStreamBuffer entries = buffer.carveOut(hdr->data_offset - sizeof(*hdr));
+	ByteStreamBuffer values = buffer.carveOut(hdr->size - hdr->data_offset);
+
+	if (buffer.overflow()) {
+		LOG(Serializer, Error) << "Out of data";
+		return;
+	}
+
+	entries_ = entries.read<struct ipa_control_value_entry>(hdr->entries);
+	if (hdr->entries && !entries_) {
+		LOG(Serializer, Error) << "Out of data";
+		return;
+	}
+
+	values_ = values.base();
+	valuesSize_ = values.size();
+	hdr_ = hdr;
+}
+
+/**
+ * \fn ControlListView::isValid()
+ * \brief Check if the view references a valid serialized ControlList
+ * \return True if the view is valid, false otherwise
+ */
+
+/**
+ * \fn ControlListView::empty()
+ * \brief Identify if the list is empty
+ * \return True if the list does not contain any control, false otherwise
+ */
+
+/**
+ * \brief Retrieve the number of controls in the list
+ * \return The number of controls stored in the serialized list
+ */
+std::size_t ControlListView::size() const
+{
+	return hdr_ ? hdr_->entries : 0;
+}
+
+/**
+ * \brief Check if the list contains a control with the specified \a id
+ * \param[in] id The control numerical ID
+ * \return True if the list contains a matching control, false otherwise
+ */
+bool ControlListView::contains(unsigned int id) const
+{
+	return find(id) != nullptr;
+}
+
+/**
+ * \fn ControlListView::get(const Control<T> &ctrl) const
+ * \brief Get the value of control \a ctrl
+ * \param[in] ctrl The control
+ *
+ * The value is copied out of the serialized buffer. Array controls can't be
+ * retrieved with this function, as the returned Span would reference a
+ * temporary value, use get(unsigned int id) instead.
+ *
+ * \return A std::optional<T> containing the control value, or std::nullopt if
+ * the control \a ctrl is not present in the list
+ */
+
+/**
+ * \brief Get the value of control \a id
+ * \param[in] id The control numerical ID
+ *
+ * The value is copied out of the serialized buffer. Thanks to the inline
+ * storage of ControlValue, this doesn't allocate memory for the scalar and
+ * small array values used by most controls.
+ *
+ * \return The control value, or an empty ControlValue if the control is not
+ * present in the list or its serialized data is invalid
+ */
+ControlValue ControlListView::get(unsigned int id) const
+{
+	const struct ipa_control_value_entry *entry = find(id);
+	if (!entry)
+		return {};
+
+	ControlValue value;
+	value.reserve(static_cast<ControlType>(entry->type), entry->is_array,
+		      entry->count);
+
+	Span<uint8_t> data = value.data();
+	if (entry->offset > valuesSize_ ||
+	    valuesSize_ - entry->offset < sizeof(ControlType) + data.size()) {
+		LOG(Serializer, Error)
+			<< "Bad data, control " << utils::hex(id) << " out of bounds";
+		return {};
+	}
+
+	memcpy(data.data(), values_ + entry->offset + sizeof(ControlType),
+	       data.size());
+
+	return value;
+}
+
+const struct ipa_control_value_entry *ControlListView::find(unsigned int id) const
+{
+	for (std::size_t i = 0; i < size(); ++i) {
+		if (entries_[i].id == id)
+			return &entries_[i];
+	}
+
+	return nullptr;
+}
+
 } /* namespace libcamera */
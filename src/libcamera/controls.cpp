@@ -7,6 +7,7 @@
 
 #include <libcamera/controls.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -89,8 +90,15 @@ static constexpr size_t ControlValueSize[] = {
  * \brief Abstract type representing the value of a control
  */
 
-/** \todo Revisit the ControlValue layout when stabilizing the ABI */
-static_assert(sizeof(ControlValue) == 16, "Invalid size of ControlValue class");
+/**
+ * \todo Revisit the ControlValue layout when stabilizing the ABI
+ *
+ * Values of up to 64 bytes are stored inline, to avoid allocating memory for
+ * the small arrays commonly used in per-frame controls and metadata, such as
+ * a 3x3 colour correction matrix, a pair of frame durations or a few
+ * rectangles.
+ */
+static_assert(sizeof(ControlValue) == 72, "Invalid size of ControlValue class");
 
 /**
  * \brief Construct an empty ControlValue.
@@ -150,6 +158,53 @@ ControlValue &ControlValue::operator=(const ControlValue &other)
 	return *this;
 }
 
+/**
+ * \brief Construct a ControlValue by moving the content of \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The storage of \a other is transferred to the new instance without copying
+ * the value. \a other is left empty.
+ */
+ControlValue::ControlValue(ControlValue &&other) noexcept
+	: type_(other.type_), isArray_(other.isArray_),
+	  numElements_(other.numElements_)
+{
+	memcpy(value_, other.value_, sizeof(value_));
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+}
+
+/**
+ * \brief Replace the content of the ControlValue by moving the content of
+ * \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The storage of \a other is transferred to the instance without copying the
+ * value. \a other is left empty.
+ *
+ * \return The ControlValue with its content replaced with the one of \a other
+ */
+ControlValue &ControlValue::operator=(ControlValue &&other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	release();
+
+	type_ = other.type_;
+	isArray_ = other.isArray_;
+	numElements_ = other.numElements_;
+	memcpy(value_, other.value_, sizeof(value_));
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+
+	return *this;
+}
+
 /**
  * \fn ControlValue::type()
  * \brief Retrieve the data type of the value
@@ -652,6 +707,7 @@ ControlInfoMap::ControlInfoMap(std::initializer_list<Map::value_type> init,
 	: Map(init), idmap_(&idmap)
 {
 	ASSERT(validate());
+	buildIndex();
 }
 
 /**
@@ -666,6 +722,7 @@ ControlInfoMap::ControlInfoMap(Map &&info, const ControlIdMap &idmap)
 	: Map(std::move(info)), idmap_(&idmap)
 {
 	ASSERT(validate());
+	buildIndex();
 }
 
 /**
@@ -715,6 +772,48 @@ bool ControlInfoMap::validate()
 	return true;
 }
 
+/*
+ * Build a bitmap of the numerical IDs of the controls, to test whether a
+ * control is supported with a single bit test. This speeds up validation of
+ * the controls set in requests, and lookups of unsupported controls. The
+ * libcamera control IDs are allocated in small ranges, the bitmap is only
+ * built when the IDs span less than kMaxIndexedSpan, to avoid allocating large
+ * bitmaps for sparse IDs such as the V4L2 control IDs.
+ */
+void ControlInfoMap::buildIndex()
+{
+	static constexpr unsigned int kMaxIndexedSpan = 32768;
+
+	indexed_ = false;
+	idBase_ = 0;
+	idBits_.clear();
+
+	if (empty()) {
+		indexed_ = true;
+		return;
+	}
+
+	auto [min, max] = std::minmax_element(begin(), end(),
+		[](const value_type &a, const value_type &b) {
+			return a.first->id() < b.first->id();
+		});
+
+	unsigned int base = min->first->id();
+	unsigned int span = max->first->id() - base + 1;
+	if (span > kMaxIndexedSpan)
+		return;
+
+	idBase_ = base;
+	idBits_.resize((span + 63) / 64);
+
+	for (const auto &[id, info] : *this) {
+		unsigned int offset = id->id() - base;
+		idBits_[offset / 64] |= uint64_t(1) << (offset % 64);
+	}
+
+	indexed_ = true;
+}
+
 /**
  * \brief Access specified element by numerical ID
  * \param[in] id The numerical ID
@@ -746,15 +845,7 @@ const ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id) const
  */
 ControlInfoMap::size_type ControlInfoMap::count(unsigned int id) const
 {
-	if (!idmap_)
-		return 0;
-
-	/*
-	 * The ControlInfoMap and its idmap have a 1:1 mapping between their
-	 * entries, we can thus just count the matching entries in idmap to
-	 * avoid an additional lookup.
-	 */
-	return idmap_->count(id);
+	return contains(id) ? 1 : 0;
 }
 
 /**
@@ -765,7 +856,7 @@ ControlInfoMap::size_type ControlInfoMap::count(unsigned int id) const
  */
 ControlInfoMap::iterator ControlInfoMap::find(unsigned int id)
 {
-	if (!idmap_)
+	if (!idmap_ || (indexed_ && !contains(id)))
 		return end();
 
 	auto iter = idmap_->find(id);
@@ -783,7 +874,7 @@ ControlInfoMap::iterator ControlInfoMap::find(unsigned int id)
  */
 ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
 {
-	if (!idmap_)
+	if (!idmap_ || (indexed_ && !contains(id)))
 		return end();
 
 	auto iter = idmap_->find(id);
@@ -793,6 +884,19 @@ ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
 	return find(iter->second);
 }
 
+/**
+ * \fn ControlInfoMap::contains()
+ * \brief Check if the map contains a control by numerical ID
+ * \param[in] id The numerical ID
+ *
+ * This function is optimized for the libcamera controls. Their numerical IDs
+ * are indexed in a bitmap when the map is constructed, and the lookup is a
+ * single bit test.
+ *
+ * \return True if the map contains a control whose ID is equal to \a id,
+ * false otherwise
+ */
+
 /**
  * \fn const ControlIdMap &ControlInfoMap::idmap() const
  * \brief Retrieve the ControlId map
@@ -804,6 +908,16 @@ ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
  * \return The ControlId map
  */
 
+namespace {
+
+bool entryIdLess(const std::pair<unsigned int, ControlValue> &entry,
+		 unsigned int id)
+{
+	return entry.first < id;
+}
+
+} /* namespace */
+
 /**
  * \class ControlList
  * \brief Associate a list of ControlId with their values for an object
@@ -815,6 +929,13 @@ ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
  * Control lists are constructed with a map of all the controls supported by
  * their object, and an optional ControlValidator to further validate the
  * controls.
+ *
+ * Controls are stored in a vector sorted by numerical ID, and iterating over a
+ * ControlList thus visits the controls in ascending ID order. Clearing the list
+ * keeps the memory allocated for the vector and for the control values, which
+ * is reused when the controls are set again. Control lists reused for every
+ * frame, such as the request controls and metadata, don't allocate memory once
+ * they have been filled with the same controls a first time.
  */
 
 /**
@@ -854,6 +975,58 @@ ControlList::ControlList(const ControlInfoMap &infoMap,
 {
 }
 
+/**
+ * \brief Construct a ControlList with a copy of the controls of \a other
+ * \param[in] other The ControlList to copy
+ */
+ControlList::ControlList(const ControlList &other)
+	: validator_(other.validator_), idmap_(other.idmap_),
+	  infoMap_(other.infoMap_), controls_(other.controls_)
+{
+}
+
+/**
+ * \brief Replace the content of the ControlList with a copy of \a other
+ * \param[in] other The ControlList to copy
+ *
+ * The storage of the control values previously contained in the list is reused
+ * for the controls copied from \a other.
+ *
+ * \return The ControlList with its content replaced with the one of \a other
+ */
+ControlList &ControlList::operator=(const ControlList &other)
+{
+	if (this == &other)
+		return *this;
+
+	validator_ = other.validator_;
+	idmap_ = other.idmap_;
+	infoMap_ = other.infoMap_;
+
+	clear();
+	controls_.reserve(other.controls_.size());
+
+	/* The source controls are sorted, append them in order. */
+	for (const ControlListEntry &entry : other.controls_)
+		insert(entry.first, controls_.end()) = entry.second;
+
+	return *this;
+}
+
+/**
+ * \fn ControlList::ControlList(ControlList &&other)
+ * \brief Construct a ControlList by moving the content of \a other
+ * \param[in] other The ControlList to move
+ */
+
+/**
+ * \fn ControlList &ControlList::operator=(ControlList &&other)
+ * \brief Replace the content of the ControlList by moving the content of
+ * \a other
+ * \param[in] other The ControlList to move
+ * \return The ControlList with its content replaced with the one of \a other
+ */
+
 /**
  * \typedef ControlList::iterator
  * \brief Iterator for the controls contained within the list
@@ -903,9 +1076,29 @@ ControlList::ControlList(const ControlInfoMap &infoMap,
  */
 
 /**
- * \fn ControlList::clear()
  * \brief Removes all controls from the list
+ *
+ * The control values are kept aside, sorted by ID, to reuse their storage when
+ * the same controls are set again.
  */
+void ControlList::clear()
+{
+	auto released = released_.begin();
+
+	for (ControlListEntry &entry : controls_) {
+		released = std::lower_bound(released, released_.end(), entry.first,
+					    entryIdLess);
+
+		if (released != released_.end() && released->first == entry.first)
+			released->second = std::move(entry.second);
+		else
+			released = released_.insert(released, std::move(entry));
+
+		++released;
+	}
+
+	controls_.clear();
+}
 
 /**
  * \enum ControlList::MergePolicy
@@ -931,9 +1124,6 @@ ControlList::ControlList(const ControlInfoMap &infoMap,
  *
  * Only control lists created from the same ControlIdMap or ControlInfoMap may
  * be merged. Attempting to do otherwise results in undefined behaviour.
- *
- * \todo Reimplement or implement an overloaded version which internally uses
- * std::unordered_map::merge() and accepts a non-const argument.
  */
 void ControlList::merge(const ControlList &source, MergePolicy policy)
 {
@@ -961,6 +1151,32 @@ void ControlList::merge(const ControlList &source, MergePolicy policy)
 	}
 }
 
+/**
+ * \brief Merge the \a source into the ControlList by moving its values
+ * \param[in] source The ControlList to merge into this object
+ * \param[in] policy Controls if existing elements in *this shall be
+ * overwritten
+ *
+ * This function behaves as merge(const ControlList &source, MergePolicy policy),
+ * but moves the control values from the \a source instead of copying them.
+ * The \a source is left empty.
+ */
+void ControlList::merge(ControlList &&source, MergePolicy policy)
+{
+	for (auto &ctrl : source) {
+		if (policy == MergePolicy::KeepExisting && contains(ctrl.first)) {
+			const ControlId *id = idmap_->at(ctrl.first);
+			LOG(Controls, Warning)
+				<< "Control " << id->name() << " not overwritten";
+			continue;
+		}
+
+		set(ctrl.first, std::move(ctrl.second));
+	}
+
+	source.controls_.clear();
+}
+
 /**
  * \brief Check if the list contains a control with the specified \a id
  * \param[in] id The control numerical ID
@@ -969,7 +1185,8 @@ void ControlList::merge(const ControlList &source, MergePolicy policy)
  */
 bool ControlList::contains(unsigned int id) const
 {
-	return controls_.find(id) != controls_.end();
+	const auto iter = lookup(id);
+	return iter != controls_.end() && iter->first == id;
 }
 
 /**
@@ -1046,6 +1263,23 @@ void ControlList::set(unsigned int id, const ControlValue &value)
 	*val = value;
 }
 
+/**
+ * \brief Set the value of control \a id to \a value by moving it
+ * \param[in] id The control ID
+ * \param[in] value The control value
+ *
+ * This function behaves as set(unsigned int id, const ControlValue &value), but
+ * moves the \a value instead of copying it.
+ */
+void ControlList::set(unsigned int id, ControlValue &&value)
+{
+	ControlValue *val = find(id);
+	if (!val)
+		return;
+
+	*val = std::move(value);
+}
+
 /**
  * \fn ControlList::infoMap()
  * \brief Retrieve the ControlInfoMap used to construct the ControlList
@@ -1064,10 +1298,22 @@ void ControlList::set(unsigned int id, const ControlValue &value)
  * nullptr is returned in that case.
  */
 
+ControlList::const_iterator ControlList::lookup(unsigned int id) const
+{
+	return std::lower_bound(controls_.begin(), controls_.end(), id,
+				entryIdLess);
+}
+
+ControlList::iterator ControlList::lookup(unsigned int id)
+{
+	return std::lower_bound(controls_.begin(), controls_.end(), id,
+				entryIdLess);
+}
+
 const ControlValue *ControlList::find(unsigned int id) const
 {
-	const auto iter = controls_.find(id);
-	if (iter == controls_.end()) {
+	const auto iter = lookup(id);
+	if (iter == controls_.end() || iter->first != id) {
 		LOG(Controls, Error)
 			<< "Control " << utils::hex(id) << " not found";
 
@@ -1086,7 +1332,24 @@ ControlValue *ControlList::find(unsigned int id)
 		return nullptr;
 	}
 
-	return &controls_[id];
+	auto iter = lookup(id);
+	if (iter != controls_.end() && iter->first == id)
+		return &iter->second;
+
+	return &insert(id, iter);
+}
+
+ControlValue &ControlList::insert(unsigned int id, iterator pos)
+{
+	/* Reuse the storage of the value released by clear(), if any. */
+	ControlValue value;
+
+	auto released = std::lower_bound(released_.begin(), released_.end(), id,
+					 entryIdLess);
+	if (released != released_.end() && released->first == id)
+		value = std::move(released->second);
+
+	return controls_.insert(pos, { id, std::move(value) })->second;
 }
 
 } /* namespace libcamera */
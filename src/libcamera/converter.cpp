@@ -40,9 +40,14 @@ LOG_DEFINE_CATEGORY(Converter)
  *
  * This searches for the entity implementing the data streaming function in the
  * media graph entities and use its device node as the converter device node.
+ * Converters that are not backed by a media device pass a null \a media, and
+ * have no device node.
  */
 Converter::Converter(MediaDevice *media)
 {
+	if (!media)
+		return;
+
 	const std::vector<MediaEntity *> &entities = media->entities();
 	auto it = std::find_if(entities.begin(), entities.end(),
 			       [](MediaEntity *entity) {
@@ -137,12 +142,12 @@ Converter::~Converter()
  * \fn Converter::queueBuffers()
  * \brief Queue buffers to converter device
  * \param[in] input The frame buffer to apply the conversion
- * \param[out] outputs The container holding the output stream indexes and
- * their respective frame buffer outputs.
+ * \param[out] outputs The output frame buffers, indexed by output stream
  *
- * This function queues the \a input frame buffer on the output streams of the
- * \a outputs map key and retrieve the output frame buffer indicated by the
- * buffer map value.
+ * This function queues the \a input frame buffer on the output streams that
+ * have a non-null entry in \a outputs, and retrieves the converted frames in
+ * the corresponding output frame buffers. The \a outputs may be shorter than
+ * the number of output streams, at least one entry shall be non-null.
  *
  * \return 0 on success or a negative error code otherwise
  */
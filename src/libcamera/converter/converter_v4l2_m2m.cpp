@@ -20,6 +20,7 @@
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/media_device.h"
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
 /**
@@ -38,14 +39,26 @@ LOG_DECLARE_CATEGORY(Converter)
 V4L2M2MConverter::Stream::Stream(V4L2M2MConverter *converter, unsigned int index)
 	: converter_(converter), index_(index)
 {
-	m2m_ = std::make_unique<V4L2M2MDevice>(converter->deviceNode());
+	m2m_ = converter->acquireContext();
+	if (!m2m_)
+		return;
 
 	m2m_->output()->bufferReady.connect(this, &Stream::outputBufferReady);
 	m2m_->capture()->bufferReady.connect(this, &Stream::captureBufferReady);
+}
 
-	int ret = m2m_->open();
-	if (ret < 0)
-		m2m_.reset();
+/*
+ * Detach the M2M context from the stream, to return it to the converter for
+ * reuse by the next configuration. The stream becomes invalid.
+ */
+std::unique_ptr<V4L2M2MDevice> V4L2M2MConverter::Stream::releaseContext()
+{
+	if (m2m_) {
+		m2m_->output()->bufferReady.disconnect(this);
+		m2m_->capture()->bufferReady.disconnect(this);
+	}
+
+	return std::move(m2m_);
 }
 
 int V4L2M2MConverter::Stream::configure(const StreamConfiguration &inputCfg,
@@ -152,6 +165,8 @@ int V4L2M2MConverter::Stream::queueBuffers(FrameBuffer *input, FrameBuffer *outp
 	if (ret < 0)
 		return ret;
 
+	LIBCAMERA_TRACEPOINT(converter_queue_buffer, output);
+
 	return 0;
 }
 
@@ -162,18 +177,23 @@ std::string V4L2M2MConverter::Stream::logPrefix() const
 
 void V4L2M2MConverter::Stream::outputBufferReady(FrameBuffer *buffer)
 {
-	auto it = converter_->queue_.find(buffer);
-	if (it == converter_->queue_.end())
+	auto &queue = converter_->queue_;
+	auto it = std::find_if(queue.begin(), queue.end(),
+			       [buffer](const auto &entry) {
+				       return entry.first == buffer;
+			       });
+	if (it == queue.end())
 		return;
 
 	if (!--it->second) {
+		queue.erase(it);
 		converter_->inputBufferReady.emit(buffer);
-		converter_->queue_.erase(it);
 	}
 }
 
 void V4L2M2MConverter::Stream::captureBufferReady(FrameBuffer *buffer)
 {
+	LIBCAMERA_TRACEPOINT(converter_complete_buffer, buffer);
 	converter_->outputBufferReady.emit(buffer);
 }
 
@@ -332,7 +352,7 @@ int V4L2M2MConverter::configure(const StreamConfiguration &inputCfg,
 {
 	int ret = 0;
 
-	streams_.clear();
+	releaseStreams();
 	streams_.reserve(outputCfgs.size());
 
 	for (unsigned int i = 0; i < outputCfgs.size(); ++i) {
@@ -351,7 +371,7 @@ int V4L2M2MConverter::configure(const StreamConfiguration &inputCfg,
 	}
 
 	if (ret < 0) {
-		streams_.clear();
+		releaseStreams();
 		return ret;
 	}
 
@@ -401,33 +421,32 @@ void V4L2M2MConverter::stop()
  * \copydoc libcamera::Converter::queueBuffers
  */
 int V4L2M2MConverter::queueBuffers(FrameBuffer *input,
-				   const std::map<unsigned int, FrameBuffer *> &outputs)
+				   Span<FrameBuffer *const> outputs)
 {
-	unsigned int mask = 0;
+	unsigned int count = 0;
 	int ret;
 
 	/*
 	 * Validate the outputs as a sanity check: at least one output is
-	 * required, all outputs must reference a valid stream and no two
-	 * outputs can reference the same stream.
+	 * required and all outputs must reference a valid stream.
 	 */
-	if (outputs.empty())
+	if (outputs.size() > streams_.size())
 		return -EINVAL;
 
-	for (auto [index, buffer] : outputs) {
-		if (!buffer)
-			return -EINVAL;
-		if (index >= streams_.size())
-			return -EINVAL;
-		if (mask & (1 << index))
-			return -EINVAL;
-
-		mask |= 1 << index;
+	for (FrameBuffer *buffer : outputs) {
+		if (buffer)
+			count++;
 	}
 
+	if (!count)
+		return -EINVAL;
+
 	/* Queue the input and output buffers to all the streams. */
-	for (auto [index, buffer] : outputs) {
-		ret = streams_[index].queueBuffers(input, buffer);
+	for (unsigned int index = 0; index < outputs.size(); index++) {
+		if (!outputs[index])
+			continue;
+
+		ret = streams_[index].queueBuffers(input, outputs[index]);
 		if (ret < 0)
 			return ret;
 	}
@@ -435,15 +454,47 @@ int V4L2M2MConverter::queueBuffers(FrameBuffer *input,
 	/*
 	 * Add the input buffer to the queue, with the number of streams as a
 	 * reference count. Completion of the input buffer will be signalled by
-	 * the stream that releases the last reference.
+	 * the stream that releases the last reference. The queue only holds the
+	 * few buffers being converted, a vector avoids allocating per frame.
 	 */
-	queue_.emplace(std::piecewise_construct,
-		       std::forward_as_tuple(input),
-		       std::forward_as_tuple(outputs.size()));
+	queue_.emplace_back(input, count);
 
 	return 0;
 }
 
+/*
+ * Each stream uses its own M2M context, as V4L2 M2M devices process a single
+ * output per job. Opening a context is costly, the contexts of the previous
+ * configuration are kept and reused, and new ones are only opened when more
+ * streams are configured.
+ */
+std::unique_ptr<V4L2M2MDevice> V4L2M2MConverter::acquireContext()
+{
+	if (!contexts_.empty()) {
+		std::unique_ptr<V4L2M2MDevice> m2m = std::move(contexts_.back());
+		contexts_.pop_back();
+		return m2m;
+	}
+
+	auto m2m = std::make_unique<V4L2M2MDevice>(deviceNode());
+	int ret = m2m->open();
+	if (ret < 0)
+		return nullptr;
+
+	return m2m;
+}
+
+void V4L2M2MConverter::releaseStreams()
+{
+	for (Stream &stream : utils::reverse(streams_)) {
+		std::unique_ptr<V4L2M2MDevice> m2m = stream.releaseContext();
+		if (m2m)
+			contexts_.push_back(std::move(m2m));
+	}
+
+	streams_.clear();
+}
+
 static std::initializer_list<std::string> compatibles = {
 	"mtk-mdp",
 	"pxp",
@@ -7,10 +7,15 @@
 
 #include "libcamera/internal/delayed_controls.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/controls.h>
 
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_device.h"
 
 /**
@@ -36,6 +41,21 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  * control depth the controls are guaranteed to take effect for the correct
  * request. The control depth is determined by the control with the greatest
  * delay.
+ *
+ * Each set of controls pushed to the queue can be associated with a cookie, an
+ * opaque value chosen by the caller, which is returned along with the controls
+ * by get(). This allows pipeline handlers to identify the request, or the IPA
+ * context, that the controls in effect for a frame originate from.
+ *
+ * The values are stored in a ring buffer of frames preallocated at
+ * construction time, with the controls identified by a dense index. Queueing
+ * and applying controls thus doesn't allocate memory for the history.
+ *
+ * The applyControls() function may be called from a different thread than the
+ * other functions, for instance when frame start events are handled in a
+ * dedicated thread (see V4L2Device::setFrameStartThreadEnabled()).
+ *
+ * \context This class is \threadsafe.
  */
 
 /**
@@ -48,8 +68,9 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  * consumed during framing.
  *
  * \var ControlParams::priorityWrite
- * \brief Flag to indicate that this control must be applied ahead of, and
- * separately from the other controls.
+ * \brief Flag to indicate that this control must be applied ahead of the other
+ * controls. All priority controls are written together, before the other
+ * controls.
  *
  * Typically set for the \a V4L2_CID_VBLANK control so that the device driver
  * does not reject \a V4L2_CID_EXPOSURE control values that may be outside of
@@ -78,8 +99,8 @@ DelayedControls::DelayedControls(V4L2Device *device,
 	const ControlInfoMap &controls = device_->controls();
 
 	/*
-	 * Create a map of control ids to delays for controls exposed by the
-	 * device.
+	 * Create the list of controls exposed by the device, sorted by
+	 * numerical ID to make the dense indices deterministic.
 	 */
 	for (auto const &param : controlParams) {
 		auto it = controls.find(param.first);
@@ -92,94 +113,129 @@ DelayedControls::DelayedControls(V4L2Device *device,
 			continue;
 		}
 
-		const ControlId *id = it->first;
+		ids_.push_back(it->first);
+	}
+
+	std::sort(ids_.begin(), ids_.end(),
+		  [](const ControlId *a, const ControlId *b) {
+			  return a->id() < b->id();
+		  });
 
-		controlParams_[id] = param.second;
+	for (const ControlId *id : ids_) {
+		const ControlParams &params = controlParams.at(id->id());
+		params_.push_back(params);
 
 		LOG(DelayedControls, Debug)
-			<< "Set a delay of " << controlParams_[id].delay
-			<< " and priority write flag " << controlParams_[id].priorityWrite
+			<< "Set a delay of " << params.delay
+			<< " and priority write flag " << params.priorityWrite
 			<< " for " << id->name();
 
-		maxDelay_ = std::max(maxDelay_, controlParams_[id].delay);
+		maxDelay_ = std::max(maxDelay_, params.delay);
 	}
 
+	values_.resize(listSize * ids_.size());
+
 	reset();
 }
 
 /**
  * \brief Reset state machine
+ * \param[in] cookie The cookie associated with the initial control values
  *
  * Resets the state machine to a starting position based on control values
  * retrieved from the device.
  */
-void DelayedControls::reset()
+void DelayedControls::reset(unsigned int cookie)
 {
+	MutexLocker locker(mutex_);
+
 	queueCount_ = 1;
 	writeCount_ = 0;
+	cookies_[0] = cookie;
 
 	/* Retrieve control as reported by the device. */
 	std::vector<uint32_t> ids;
-	for (auto const &param : controlParams_)
-		ids.push_back(param.first->id());
+	for (const ControlId *id : ids_)
+		ids.push_back(id->id());
 
 	ControlList controls = device_->getControls(ids);
 
 	/* Seed the control queue with the controls reported by the device. */
-	values_.clear();
+	std::fill(values_.begin(), values_.end(), Info());
 	for (const auto &ctrl : controls) {
-		const ControlId *id = device_->controls().idmap().at(ctrl.first);
+		int index = controlIndex(ctrl.first);
+		if (index < 0)
+			continue;
+
 		/*
 		 * Do not mark this control value as updated, it does not need
 		 * to be written to to device on startup.
 		 */
-		values_[id][0] = Info(ctrl.second, false);
+		value(0, index) = Info(ctrl.second, false);
 	}
 }
 
 /**
  * \brief Push a set of controls on the queue
  * \param[in] controls List of controls to add to the device queue
+ * \param[in] cookie An opaque value to associate with \a controls
  *
  * Push a set of controls to the control queue. This increases the control queue
- * depth by one.
+ * depth by one. The \a cookie is returned by get() for the frame that the
+ * controls take effect on.
  *
  * \returns true if \a controls are accepted, or false otherwise
  */
-bool DelayedControls::push(const ControlList &controls)
+bool DelayedControls::push(const ControlList &controls, unsigned int cookie)
+{
+	MutexLocker locker(mutex_);
+
+	return pushControls(controls, cookie);
+}
+
+/*
+ * Look up the dense index of a control from its numerical ID. The number of
+ * delayed controls is small, a linear search is faster than hashing.
+ */
+int DelayedControls::controlIndex(uint32_t id) const
+{
+	for (unsigned int i = 0; i < ids_.size(); i++) {
+		if (ids_[i]->id() == id)
+			return i;
+	}
+
+	return -1;
+}
+
+bool DelayedControls::pushControls(const ControlList &controls, unsigned int cookie)
 {
 	/* Copy state from previous frame. */
-	for (auto &ctrl : values_) {
-		Info &info = ctrl.second[queueCount_];
-		info = values_[ctrl.first][queueCount_ - 1];
+	for (unsigned int i = 0; i < ids_.size(); i++) {
+		Info &info = value(queueCount_, i);
+		info = value(queueCount_ - 1, i);
 		info.updated = false;
 	}
 
 	/* Update with new controls. */
-	const ControlIdMap &idmap = device_->controls().idmap();
 	for (const auto &control : controls) {
-		const auto &it = idmap.find(control.first);
-		if (it == idmap.end()) {
-			LOG(DelayedControls, Warning)
+		int index = controlIndex(control.first);
+		if (index < 0) {
+			LOG_RATELIMITED(DelayedControls, Warning)
 				<< "Unknown control " << control.first;
 			return false;
 		}
 
-		const ControlId *id = it->second;
-
-		if (controlParams_.find(id) == controlParams_.end())
-			return false;
-
-		Info &info = values_[id][queueCount_];
+		Info &info = value(queueCount_, index);
 
 		info = Info(control.second);
 
 		LOG(DelayedControls, Debug)
-			<< "Queuing " << id->name()
+			<< "Queuing " << ids_[index]->name()
 			<< " to " << info.toString()
 			<< " at index " << queueCount_;
 	}
 
+	cookies_[queueCount_ % listSize] = cookie;
 	queueCount_++;
 
 	return true;
@@ -198,16 +254,21 @@ bool DelayedControls::push(const ControlList &controls)
  * push(). The max history from the current sequence number that yields valid
  * values are thus 16 minus number of controls pushed.
  *
+ * If \a cookie is not null, it is set to the cookie that was pushed along with
+ * the controls.
+ *
  * \return The controls at \a sequence number
  */
-ControlList DelayedControls::get(uint32_t sequence)
+ControlList DelayedControls::get(uint32_t sequence, unsigned int *cookie)
 {
+	MutexLocker locker(mutex_);
+
 	unsigned int index = std::max<int>(0, sequence - maxDelay_);
 
 	ControlList out(device_->controls());
-	for (const auto &ctrl : values_) {
-		const ControlId *id = ctrl.first;
-		const Info &info = ctrl.second[index];
+	for (unsigned int i = 0; i < ids_.size(); i++) {
+		const ControlId *id = ids_[i];
+		const Info &info = value(index, i);
 
 		out.set(id->id(), info);
 
@@ -217,6 +278,9 @@ ControlList DelayedControls::get(uint32_t sequence)
 			<< " at index " << index;
 	}
 
+	if (cookie)
+		*cookie = cookies_[index % listSize];
+
 	return out;
 }
 
@@ -231,28 +295,30 @@ ControlList DelayedControls::get(uint32_t sequence)
  */
 void DelayedControls::applyControls(uint32_t sequence)
 {
+	MutexLocker locker(mutex_);
+
 	LOG(DelayedControls, Debug) << "frame " << sequence << " started";
 
 	/*
 	 * Create control list peeking ahead in the value queue to ensure
 	 * values are set in time to satisfy the sensor delay.
 	 */
+	ControlList priority(device_->controls());
 	ControlList out(device_->controls());
-	for (auto &ctrl : values_) {
-		const ControlId *id = ctrl.first;
-		unsigned int delayDiff = maxDelay_ - controlParams_[id].delay;
+	for (unsigned int i = 0; i < ids_.size(); i++) {
+		const ControlId *id = ids_[i];
+		const ControlParams &params = params_[i];
+		unsigned int delayDiff = maxDelay_ - params.delay;
 		unsigned int index = std::max<int>(0, writeCount_ - delayDiff);
-		Info &info = ctrl.second[index];
+		Info &info = value(index, i);
 
 		if (info.updated) {
-			if (controlParams_[id].priorityWrite) {
+			if (params.priorityWrite) {
 				/*
-				 * This control must be written now, it could
-				 * affect validity of the other controls.
+				 * This control must be written before the
+				 * others, it could affect their validity.
 				 */
-				ControlList priority(device_->controls());
 				priority.set(id->id(), info);
-				device_->setControls(&priority);
 			} else {
 				/*
 				 * Batch up the list of controls and write them
@@ -276,10 +342,30 @@ void DelayedControls::applyControls(uint32_t sequence)
 	while (writeCount_ > queueCount_) {
 		LOG(DelayedControls, Debug)
 			<< "Queue is empty, auto queue no-op.";
-		push({});
+		pushControls({}, cookies_[(queueCount_ - 1) % listSize]);
 	}
 
+	/*
+	 * Write all the priority controls in a single ioctl, followed by all
+	 * the other controls in a second one. Empty lists don't reach the
+	 * device, a frame thus costs at most two ioctls.
+	 */
+	utils::time_point start = utils::clock::now();
+
+	device_->setControls(&priority);
 	device_->setControls(&out);
+
+	LIBCAMERA_TRACEPOINT(delayed_controls_apply, device_->deviceNode().c_str(),
+			     sequence, priority.size() + out.size());
+
+	if (priority.empty() && out.empty())
+		return;
+
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+		utils::clock::now() - start);
+	LOG(DelayedControls, Debug)
+		<< "Controls for frame " << sequence << " written in "
+		<< duration.count() << " us";
 }
 
 } /* namespace libcamera */
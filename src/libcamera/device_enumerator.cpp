@@ -7,9 +7,13 @@
 
 #include "libcamera/internal/device_enumerator.h"
 
+#include <algorithm>
+#include <atomic>
 #include <string.h>
+#include <thread>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include "libcamera/internal/device_enumerator_sysfs.h"
 #include "libcamera/internal/device_enumerator_udev.h"
@@ -217,21 +221,74 @@ DeviceEnumerator::~DeviceEnumerator()
  */
 std::unique_ptr<MediaDevice> DeviceEnumerator::createDevice(const std::string &deviceNode)
 {
-	std::unique_ptr<MediaDevice> media = std::make_unique<MediaDevice>(deviceNode);
-
-	int ret = media->populate();
-	if (ret < 0) {
-		LOG(DeviceEnumerator, Info)
-			<< "Unable to populate media device " << deviceNode
-			<< " (" << strerror(-ret) << "), skipping";
-		return nullptr;
-	}
+	return std::move(createDevices({ deviceNode }).front());
+}
 
-	LOG(DeviceEnumerator, Debug)
-		<< "New media device \"" << media->driver()
-		<< "\" created from " << deviceNode;
+/**
+ * \brief Create media device instances for multiple device nodes
+ * \param[in] deviceNodes paths to the media devices to create
+ *
+ * Create media devices for all the \a deviceNodes as createDevice() does. The
+ * media graphs are populated concurrently from a pool of worker threads, as
+ * querying the topology of each media device from the kernel dominates the
+ * enumeration time on systems with many media devices. The results are
+ * returned in the order of \a deviceNodes, independently of the order in
+ * which the workers complete.
+ *
+ * The worker threads only populate the media devices, the device enumerator
+ * shall complete their initialization and add them to the system with
+ * addDevice() from its own thread.
+ *
+ * \return A vector of media device instances, with the same size and order
+ * as \a deviceNodes, in which media devices that failed to be created are
+ * nullptr
+ */
+std::vector<std::unique_ptr<MediaDevice>>
+DeviceEnumerator::createDevices(const std::vector<std::string> &deviceNodes)
+{
+	std::vector<std::unique_ptr<MediaDevice>> devices;
+	std::vector<int> results(deviceNodes.size());
+
+	for (const std::string &deviceNode : deviceNodes)
+		devices.push_back(std::make_unique<MediaDevice>(deviceNode));
+
+	/* Populate the media devices, from a pool of workers if useful. */
+	std::atomic<unsigned int> next = 0;
+	auto worker = [&]() {
+		for (unsigned int i = next++; i < devices.size(); i = next++)
+			results[i] = devices[i]->populate();
+	};
+
+	const unsigned int count =
+		std::min<std::size_t>(std::thread::hardware_concurrency(),
+				      devices.size());
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < count; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	for (auto [i, media] : utils::enumerate(devices)) {
+		int ret = results[i];
+		if (ret < 0) {
+			LOG(DeviceEnumerator, Info)
+				<< "Unable to populate media device "
+				<< deviceNodes[i] << " (" << strerror(-ret)
+				<< "), skipping";
+			media.reset();
+			continue;
+		}
+
+		LOG(DeviceEnumerator, Debug)
+			<< "New media device \"" << media->driver()
+			<< "\" created from " << deviceNodes[i];
+	}
 
-	return media;
+	return devices;
 }
 
 /**
@@ -7,6 +7,7 @@
 
 #include "libcamera/internal/device_enumerator_sysfs.h"
 
+#include <algorithm>
 #include <dirent.h>
 #include <fcntl.h>
 #include <fstream>
@@ -16,6 +17,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/log.h>
 
@@ -53,6 +55,8 @@ int DeviceEnumeratorSysfs::enumerate()
 		return -ENODEV;
 	}
 
+	std::vector<std::string> devnodes;
+
 	while ((ent = readdir(dir)) != nullptr) {
 		if (strncmp(ent->d_name, "media", 5))
 			continue;
@@ -73,7 +77,18 @@ int DeviceEnumeratorSysfs::enumerate()
 			continue;
 		}
 
-		std::unique_ptr<MediaDevice> media = createDevice(devnode);
+		devnodes.push_back(std::move(devnode));
+	}
+
+	closedir(dir);
+
+	/* Add the devices in a deterministic order, sorted by index. */
+	std::sort(devnodes.begin(), devnodes.end(),
+		  [](const std::string &a, const std::string &b) {
+			  return a.size() != b.size() ? a.size() < b.size() : a < b;
+		  });
+
+	for (std::unique_ptr<MediaDevice> &media : createDevices(devnodes)) {
 		if (!media)
 			continue;
 
@@ -88,8 +103,6 @@ int DeviceEnumeratorSysfs::enumerate()
 		addDevice(std::move(media));
 	}
 
-	closedir(dir);
-
 	return 0;
 }
 
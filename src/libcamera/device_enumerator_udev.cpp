@@ -13,10 +13,10 @@
 #include <list>
 #include <map>
 #include <string.h>
-#include <string_view>
 #include <sys/ioctl.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
@@ -28,16 +28,26 @@ namespace libcamera {
 LOG_DECLARE_CATEGORY(DeviceEnumerator)
 
 DeviceEnumeratorUdev::DeviceEnumeratorUdev()
-	: udev_(nullptr), monitor_(nullptr), notifier_(nullptr)
+	: udev_(nullptr), monitorUdev_(nullptr), monitor_(nullptr),
+	  notifier_(nullptr), hotplugThread_("Hotplug")
 {
 }
 
 DeviceEnumeratorUdev::~DeviceEnumeratorUdev()
 {
+	/*
+	 * Stop the hotplug thread before destroying the notifier that lives
+	 * in it. Events that haven't been processed yet are discarded.
+	 */
+	hotplugThread_.exit();
+	hotplugThread_.wait();
+
 	delete notifier_;
 
 	if (monitor_)
 		udev_monitor_unref(monitor_);
+	if (monitorUdev_)
+		udev_unref(monitorUdev_);
 	if (udev_)
 		udev_unref(udev_);
 }
@@ -53,7 +63,15 @@ int DeviceEnumeratorUdev::init()
 	if (!udev_)
 		return -ENODEV;
 
-	monitor_ = udev_monitor_new_from_netlink(udev_, "udev");
+	/*
+	 * The udev library isn't thread-safe. The monitor is used from the
+	 * hotplug thread, give it its own context.
+	 */
+	monitorUdev_ = udev_new();
+	if (!monitorUdev_)
+		return -ENODEV;
+
+	monitor_ = udev_monitor_new_from_netlink(monitorUdev_, "udev");
 	if (!monitor_)
 		return -ENODEV;
 
@@ -76,52 +94,58 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 	if (!subsystem)
 		return -ENODEV;
 
-	if (!strcmp(subsystem, "media")) {
-		std::unique_ptr<MediaDevice> media =
-			createDevice(udev_device_get_devnode(dev));
-		if (!media)
-			return -ENODEV;
-
-		DependencyMap deps;
-		int ret = populateMediaDevice(media.get(), &deps);
-		if (ret < 0) {
-			LOG(DeviceEnumerator, Warning)
-				<< "Failed to populate media device "
-				<< media->deviceNode()
-				<< " (" << media->driver() << "), skipping";
-			return ret;
-		}
+	if (!strcmp(subsystem, "media"))
+		return addMediaDevice(createDevice(udev_device_get_devnode(dev)));
 
-		if (!deps.empty()) {
-			LOG(DeviceEnumerator, Debug)
-				<< "Defer media device " << media->deviceNode()
-				<< " due to " << deps.size()
-				<< " missing dependencies";
+	if (!strcmp(subsystem, "video4linux")) {
+		addV4L2Device(udev_device_get_devnum(dev));
+		return 0;
+	}
 
-			pending_.emplace_back(std::move(media), std::move(deps));
-			MediaDeviceDeps *mediaDeps = &pending_.back();
-			for (const auto &dep : mediaDeps->deps_)
-				devMap_[dep.first] = mediaDeps;
+	return -ENODEV;
+}
 
-			return 0;
-		}
+int DeviceEnumeratorUdev::addMediaDevice(std::unique_ptr<MediaDevice> media)
+{
+	if (!media)
+		return -ENODEV;
 
-		addDevice(std::move(media));
-		return 0;
+	DependencyMap deps;
+	int ret = populateMediaDevice(media.get(), &deps);
+	if (ret < 0) {
+		LOG(DeviceEnumerator, Warning)
+			<< "Failed to populate media device "
+			<< media->deviceNode()
+			<< " (" << media->driver() << "), skipping";
+		return ret;
 	}
 
-	if (!strcmp(subsystem, "video4linux")) {
-		addV4L2Device(udev_device_get_devnum(dev));
+	if (!deps.empty()) {
+		LOG(DeviceEnumerator, Debug)
+			<< "Defer media device " << media->deviceNode()
+			<< " due to " << deps.size()
+			<< " missing dependencies";
+
+		pending_.emplace_back(std::move(media), std::move(deps));
+		MediaDeviceDeps *mediaDeps = &pending_.back();
+		for (const auto &dep : mediaDeps->deps_)
+			devMap_[dep.first] = mediaDeps;
+
 		return 0;
 	}
 
-	return -ENODEV;
+	addDevice(std::move(media));
+	return 0;
 }
 
 int DeviceEnumeratorUdev::enumerate()
 {
 	struct udev_enumerate *udev_enum = nullptr;
 	struct udev_list_entry *ents, *ent;
+	std::vector<struct udev_device *> devices;
+	std::vector<std::string> mediaNodes;
+	std::vector<std::unique_ptr<MediaDevice>> media;
+	unsigned int mediaIndex = 0;
 	int ret;
 
 	udev_enum = udev_enumerate_new(udev_);
@@ -170,10 +194,29 @@ int DeviceEnumeratorUdev::enumerate()
 			continue;
 		}
 
-		if (addUdevDevice(dev) < 0)
+		devices.push_back(dev);
+
+		const char *subsystem = udev_device_get_subsystem(dev);
+		if (subsystem && !strcmp(subsystem, "media"))
+			mediaNodes.push_back(devnode);
+	}
+
+	/*
+	 * Populate all the media devices concurrently first, and then add all
+	 * devices in the order in which udev reported them, as the device
+	 * enumerator state isn't thread-safe.
+	 */
+	media = createDevices(mediaNodes);
+
+	for (struct udev_device *dev : devices) {
+		const char *subsystem = udev_device_get_subsystem(dev);
+		int err = subsystem && !strcmp(subsystem, "media")
+			? addMediaDevice(std::move(media[mediaIndex++]))
+			: addUdevDevice(dev);
+		if (err < 0)
 			LOG(DeviceEnumerator, Warning)
 				<< "Failed to add device for '"
-				<< syspath << "', skipping";
+				<< udev_device_get_syspath(dev) << "', skipping";
 
 		udev_device_unref(dev);
 	}
@@ -187,9 +230,19 @@ done:
 	if (ret < 0)
 		return ret;
 
+	/*
+	 * Receive the hotplug events and populate the new media devices in a
+	 * separate thread, as querying the media graph of a device can take a
+	 * long time and would block the processing of the events of the other
+	 * cameras.
+	 */
 	int fd = udev_monitor_get_fd(monitor_);
 	notifier_ = new EventNotifier(fd, EventNotifier::Read);
-	notifier_->activated.connect(this, &DeviceEnumeratorUdev::udevNotify);
+	notifier_->activated.connect(this, &DeviceEnumeratorUdev::udevNotify,
+				     ConnectionTypeDirect);
+
+	hotplugThread_.start();
+	notifier_->moveToThread(&hotplugThread_);
 
 	return 0;
 }
@@ -329,24 +382,82 @@ int DeviceEnumeratorUdev::addV4L2Device(dev_t devnum)
 	return 0;
 }
 
+/**
+ * \brief Receive a udev hotplug event
+ *
+ * This function is called in the hotplug thread. It creates and populates the
+ * media device for media device additions, and queues the event for
+ * processing in the enumerator thread, which owns the enumerator state.
+ */
 void DeviceEnumeratorUdev::udevNotify()
 {
 	struct udev_device *dev = udev_monitor_receive_device(monitor_);
-	std::string_view action(udev_device_get_action(dev));
-	std::string_view deviceNode(udev_device_get_devnode(dev));
+	if (!dev)
+		return;
+
+	const char *action = udev_device_get_action(dev);
+	const char *subsystem = udev_device_get_subsystem(dev);
+	const char *deviceNode = udev_device_get_devnode(dev);
 
 	LOG(DeviceEnumerator, Debug)
-		<< action << " device " << deviceNode;
+		<< (action ? action : "") << " device "
+		<< (deviceNode ? deviceNode : "");
 
-	if (action == "add") {
-		addUdevDevice(dev);
-	} else if (action == "remove") {
-		const char *subsystem = udev_device_get_subsystem(dev);
-		if (subsystem && !strcmp(subsystem, "media"))
-			removeDevice(std::string(deviceNode));
+	HotplugEvent event{};
+	if (action && !strcmp(action, "add"))
+		event.add = true;
+	else if (!action || strcmp(action, "remove"))
+		goto done;
+
+	if (!subsystem || !deviceNode)
+		goto done;
+
+	event.subsystem = subsystem;
+	event.deviceNode = deviceNode;
+	event.devnum = udev_device_get_devnum(dev);
+
+	if (event.add && event.subsystem == "media")
+		event.media = createDevice(event.deviceNode);
+
+	{
+		MutexLocker locker(eventsLock_);
+		events_.push(std::move(event));
 	}
 
+	invokeMethod(&DeviceEnumeratorUdev::processHotplugEvents,
+		     ConnectionTypeQueued);
+
+done:
 	udev_device_unref(dev);
 }
 
+/**
+ * \brief Process the queued udev hotplug events
+ *
+ * This function is called in the enumerator thread, and processes the events
+ * queued by udevNotify() in the order they have been received.
+ */
+void DeviceEnumeratorUdev::processHotplugEvents()
+{
+	std::queue<HotplugEvent> events;
+
+	{
+		MutexLocker locker(eventsLock_);
+		events.swap(events_);
+	}
+
+	while (!events.empty()) {
+		HotplugEvent &event = events.front();
+
+		if (event.add && event.subsystem == "media")
+			addMediaDevice(std::move(event.media));
+		else if (event.add && event.subsystem == "video4linux")
+			addV4L2Device(event.devnum);
+		else if (!event.add && event.subsystem == "media")
+			removeDevice(event.deviceNode);
+
+		events.pop();
+	}
+}
+
 } /* namespace libcamera */
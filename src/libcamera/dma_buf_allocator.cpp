@@ -78,6 +78,18 @@ LOG_DEFINE_CATEGORY(DmaBufAllocator)
  * \brief A bitwise combination of DmaBufAllocator::DmaBufAllocatorFlag values
  */
 
+/**
+ * \enum DmaBufAllocator::AllocFlag
+ * \brief Flags to control buffer allocation
+ * \var DmaBufAllocator::AllocFlag::HugePages
+ * \brief Back the buffers with huge pages when supported by the provider
+ */
+
+/**
+ * \typedef DmaBufAllocator::AllocFlags
+ * \brief A bitwise combination of DmaBufAllocator::AllocFlag values
+ */
+
 /**
  * \brief Construct a DmaBufAllocator of a given type
  * \param[in] type The type(s) of the dma-buf providers to allocate from
@@ -133,24 +145,30 @@ DmaBufAllocator::~DmaBufAllocator() = default;
 #define F_ADD_SEALS		1033
 #define F_SEAL_SHRINK		0x0002
 #endif
+#ifndef MFD_HUGE_2MB
+#define MFD_HUGE_2MB		(21U << 26)
+#endif
 #endif
 
-UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
+UniqueFD DmaBufAllocator::createMemfd(const char *name, std::size_t size,
+				      bool hugePages)
 {
-	/* Size must be a multiple of the page size. Round it up. */
-	std::size_t pageMask = sysconf(_SC_PAGESIZE) - 1;
-	size = (size + pageMask) & ~pageMask;
+	unsigned int flags = MFD_ALLOW_SEALING | MFD_CLOEXEC;
+	if (hugePages)
+		flags |= MFD_HUGETLB | MFD_HUGE_2MB;
 
 #if HAVE_MEMFD_CREATE
-	int ret = memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC);
+	int ret = memfd_create(name, flags);
 #else
-	int ret = syscall(SYS_memfd_create, name, MFD_ALLOW_SEALING | MFD_CLOEXEC);
+	int ret = syscall(SYS_memfd_create, name, flags);
 #endif
 	if (ret < 0) {
+		/* Running out of huge pages isn't an error, the caller falls back. */
 		ret = errno;
-		LOG(DmaBufAllocator, Error)
-			<< "Failed to allocate memfd storage for " << name
-			<< ": " << strerror(ret);
+		if (!hugePages)
+			LOG(DmaBufAllocator, Error)
+				<< "Failed to allocate memfd storage for " << name
+				<< ": " << strerror(ret);
 		return {};
 	}
 
@@ -159,9 +177,10 @@ UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
 	ret = ftruncate(memfd.get(), size);
 	if (ret < 0) {
 		ret = errno;
-		LOG(DmaBufAllocator, Error)
-			<< "Failed to set memfd size for " << name
-			<< ": " << strerror(ret);
+		if (!hugePages)
+			LOG(DmaBufAllocator, Error)
+				<< "Failed to set memfd size for " << name
+				<< ": " << strerror(ret);
 		return {};
 	}
 
@@ -175,14 +194,20 @@ UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
 		return {};
 	}
 
+	return memfd;
+}
+
+UniqueFD DmaBufAllocator::createUDmaBuf(const char *name, const UniqueFD &memfd,
+					std::size_t offset, std::size_t size)
+{
 	struct udmabuf_create create;
 
 	create.memfd = memfd.get();
 	create.flags = UDMABUF_FLAGS_CLOEXEC;
-	create.offset = 0;
+	create.offset = offset;
 	create.size = size;
 
-	ret = ::ioctl(providerHandle_.get(), UDMABUF_CREATE, &create);
+	int ret = ::ioctl(providerHandle_.get(), UDMABUF_CREATE, &create);
 	if (ret < 0) {
 		ret = errno;
 		LOG(DmaBufAllocator, Error)
@@ -195,6 +220,74 @@ UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
 	return UniqueFD(ret);
 }
 
+UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
+{
+	/* Size must be a multiple of the page size. Round it up. */
+	std::size_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+	size = (size + pageMask) & ~pageMask;
+
+	UniqueFD memfd = createMemfd(name, size, false);
+	if (!memfd.isValid())
+		return {};
+
+	return createUDmaBuf(name, memfd, 0, size);
+}
+
+std::vector<UniqueFD>
+DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size,
+				  unsigned int count, AllocFlags flags)
+{
+	static constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
+
+	std::vector<UniqueFD> fds;
+	UniqueFD memfd;
+	std::size_t bufferSize = 0;
+
+	/*
+	 * Carve all buffers out of a single memfd. Each buffer must start on a
+	 * page boundary, which is 2MiB when backed by huge pages. Fall back to
+	 * regular pages if no huge page is available.
+	 */
+	if (flags & AllocFlag::HugePages) {
+		std::size_t hugeSize = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+		memfd = createMemfd(name, hugeSize * count, true);
+		if (memfd.isValid()) {
+			UniqueFD fd = createUDmaBuf(name, memfd, 0, hugeSize);
+			if (fd.isValid())
+				fds.push_back(std::move(fd));
+			else
+				memfd.reset();
+		}
+
+		if (memfd.isValid())
+			bufferSize = hugeSize;
+		else
+			LOG(DmaBufAllocator, Debug)
+				<< "Huge pages unavailable for " << name
+				<< ", using regular pages";
+	}
+
+	if (!memfd.isValid()) {
+		std::size_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+		bufferSize = (size + pageMask) & ~pageMask;
+
+		memfd = createMemfd(name, bufferSize * count, false);
+		if (!memfd.isValid())
+			return {};
+	}
+
+	for (unsigned int i = fds.size(); i < count; ++i) {
+		UniqueFD fd = createUDmaBuf(name, memfd, i * bufferSize, bufferSize);
+		if (!fd.isValid())
+			return {};
+
+		fds.push_back(std::move(fd));
+	}
+
+	return fds;
+}
+
 UniqueFD DmaBufAllocator::allocFromHeap(const char *name, std::size_t size)
 {
 	struct dma_heap_allocation_data alloc = {};
@@ -243,4 +336,147 @@ UniqueFD DmaBufAllocator::alloc(const char *name, std::size_t size)
 		return allocFromHeap(name, size);
 }
 
+/**
+ * \brief Allocate multiple dma-bufs of the same size from the DmaBufAllocator
+ * \param [in] name The name to set for the allocated buffers
+ * \param [in] size The size of each buffer to allocate
+ * \param [in] count The number of buffers to allocate
+ * \param [in] flags Flags to control the allocation
+ *
+ * Allocates \a count dma-bufs with read/write access. With the udmabuf
+ * provider, all the buffers are carved out of a single memfd, which replaces
+ * one memfd allocation per buffer with a single allocation. If \a flags
+ * contains AllocFlag::HugePages, the memfd is backed by 2MiB huge pages when
+ * available, which lowers the TLB pressure when the CPU accesses the buffers.
+ * The allocation falls back to regular pages otherwise. Dma-heap providers
+ * allocate each buffer separately and ignore the \a flags.
+ *
+ * If any allocation fails, return an empty vector.
+ *
+ * \return The UniqueFDs of the allocated buffers
+ */
+std::vector<UniqueFD> DmaBufAllocator::alloc(const char *name, std::size_t size,
+					     unsigned int count, AllocFlags flags)
+{
+	if (!name || !count)
+		return {};
+
+	if (type_ == DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
+		return allocFromUDmaBuf(name, size, count, flags);
+
+	std::vector<UniqueFD> fds;
+	for (unsigned int i = 0; i < count; ++i) {
+		UniqueFD fd = allocFromHeap(name, size);
+		if (!fd.isValid())
+			return {};
+
+		fds.push_back(std::move(fd));
+	}
+
+	return fds;
+}
+
+/**
+ * \class DmaSyncer
+ * \brief Helper class for dma-buf's synchronization
+ *
+ * This class wraps a userspace dma-buf's synchronization process with an
+ * object's lifetime.
+ *
+ * It's used when the user needs to access a dma-buf with CPU, mostly mapped
+ * with MappedFrameBuffer, so that the buffer is synchronized between CPU and
+ * ISP. The synchronization is started when the object is constructed and
+ * ended when it is destroyed.
+ *
+ * File descriptors that don't refer to a dma-buf, such as memfds, don't need
+ * any synchronization and are ignored.
+ */
+
+/**
+ * \enum DmaSyncer::SyncType
+ * \brief Read and/or write access via the CPU map
+ * \var DmaSyncer::Read
+ * \brief Indicates that the mapped dma-buf will be read by the client via the
+ * CPU map
+ * \var DmaSyncer::Write
+ * \brief Indicates that the mapped dma-buf will be written by the client via the
+ * CPU map
+ * \var DmaSyncer::ReadWrite
+ * \brief Indicates that the mapped dma-buf will be read and written by the
+ * client via the CPU map
+ */
+
+/**
+ * \brief Construct the DmaSyncer and start the synchronization
+ * \param[in] fd The dma-buf's file descriptor to synchronize
+ * \param[in] type Read and/or write access via the CPU map
+ */
+DmaSyncer::DmaSyncer(SharedFD fd, SyncType type)
+	: fd_(fd)
+{
+	switch (type) {
+	case SyncType::Read:
+		flags_ = DMA_BUF_SYNC_READ;
+		break;
+	case SyncType::Write:
+		flags_ = DMA_BUF_SYNC_WRITE;
+		break;
+	case SyncType::ReadWrite:
+		flags_ = DMA_BUF_SYNC_RW;
+		break;
+	}
+
+	sync(DMA_BUF_SYNC_START);
+}
+
+/**
+ * \fn DmaSyncer::DmaSyncer(DmaSyncer &&other)
+ * \param[in] other The other instance
+ * \brief Enable move on class DmaSyncer
+ */
+
+/**
+ * \fn DmaSyncer::operator=(DmaSyncer &&other)
+ * \param[in] other The other instance
+ * \brief Enable move on class DmaSyncer
+ */
+
+/**
+ * \brief End the synchronization
+ */
+DmaSyncer::~DmaSyncer()
+{
+	/* A moved-from instance has no file descriptor and nothing to end */
+	if (fd_.isValid())
+		sync(DMA_BUF_SYNC_END);
+}
+
+void DmaSyncer::sync(uint64_t step)
+{
+	struct dma_buf_sync sync = {
+		.flags = flags_ | step
+	};
+
+	int ret;
+	do {
+		ret = ioctl(fd_.get(), DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret && (errno == EINTR || errno == EAGAIN));
+
+	if (!ret)
+		return;
+
+	ret = errno;
+
+	/* Not a dma-buf, the memory is coherent */
+	if (ret == ENOTTY) {
+		fd_ = SharedFD();
+		return;
+	}
+
+	LOG(DmaBufAllocator, Error)
+		<< "Unable to sync dma fd: " << fd_.get()
+		<< ", err: " << strerror(ret)
+		<< ", flags: " << sync.flags;
+}
+
 } /* namespace libcamera */
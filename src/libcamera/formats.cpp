@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <unordered_map>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
@@ -976,6 +977,40 @@ const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
 	} },
 };
 
+/*
+ * Index of the pixel format information by pixel format, V4L2 pixel format
+ * and name, for constant time lookups in the frame processing paths.
+ */
+struct PixelFormatInfoIndex {
+	struct PixelFormatHash {
+		size_t operator()(const PixelFormat &format) const noexcept
+		{
+			return format.fourcc() ^ std::hash<uint64_t>{}(format.modifier());
+		}
+	};
+
+	PixelFormatInfoIndex()
+	{
+		for (const auto &[format, info] : pixelFormatInfo) {
+			formats.emplace(format, &info);
+			names.emplace(info.name, &info);
+
+			for (const V4L2PixelFormat &v4l2Format : info.v4l2Formats)
+				v4l2Formats.emplace(v4l2Format, &info);
+		}
+	}
+
+	std::unordered_map<PixelFormat, const PixelFormatInfo *, PixelFormatHash> formats;
+	std::unordered_map<V4L2PixelFormat, const PixelFormatInfo *> v4l2Formats;
+	std::unordered_map<std::string, const PixelFormatInfo *> names;
+};
+
+const PixelFormatInfoIndex &pixelFormatInfoIndex()
+{
+	static const PixelFormatInfoIndex index;
+	return index;
+}
+
 } /* namespace */
 
 /**
@@ -992,15 +1027,16 @@ const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
  */
 const PixelFormatInfo &PixelFormatInfo::info(const PixelFormat &format)
 {
-	const auto iter = pixelFormatInfo.find(format);
-	if (iter == pixelFormatInfo.end()) {
+	const auto &formats = pixelFormatInfoIndex().formats;
+	const auto iter = formats.find(format);
+	if (iter == formats.end()) {
 		LOG(Formats, Warning)
 			<< "Unsupported pixel format "
 			<< utils::hex(format.fourcc());
 		return pixelFormatInfoInvalid;
 	}
 
-	return iter->second;
+	return *iter->second;
 }
 
 /**
@@ -1011,15 +1047,12 @@ const PixelFormatInfo &PixelFormatInfo::info(const PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
 {
-	PixelFormat pixelFormat = format.toPixelFormat(false);
-	if (!pixelFormat.isValid())
+	const auto &v4l2Formats = pixelFormatInfoIndex().v4l2Formats;
+	const auto iter = v4l2Formats.find(format);
+	if (iter == v4l2Formats.end())
 		return pixelFormatInfoInvalid;
 
-	const auto iter = pixelFormatInfo.find(pixelFormat);
-	if (iter == pixelFormatInfo.end())
-		return pixelFormatInfoInvalid;
-
-	return iter->second;
+	return *iter->second;
 }
 
 /**
@@ -1030,12 +1063,12 @@ const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const std::string &name)
 {
-	for (const auto &info : pixelFormatInfo) {
-		if (info.second.name == name)
-			return info.second;
-	}
+	const auto &names = pixelFormatInfoIndex().names;
+	const auto iter = names.find(name);
+	if (iter == names.end())
+		return pixelFormatInfoInvalid;
 
-	return pixelFormatInfoInvalid;
+	return *iter->second;
 }
 
 /**
@@ -8,11 +8,17 @@
 #include <libcamera/framebuffer.h>
 #include "libcamera/internal/framebuffer.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/shared_fd.h>
 
+#include <libcamera/fence.h>
+
 /**
  * \file libcamera/framebuffer.h
  * \brief Frame buffer handling
@@ -201,6 +207,27 @@ FrameBuffer::Private::~Private()
  * indicate that the metadata is invalid.
  */
 
+/**
+ * \brief Signal the completion fence of the buffer
+ *
+ * Signal and drop the fence created by FrameBuffer::createCompletionFence(), if
+ * any. This function is called by the Request when the buffer completes,
+ * either successfully or with an error.
+ */
+void FrameBuffer::Private::signalCompletionFence()
+{
+	if (!completionFence_.isValid())
+		return;
+
+	if (eventfd_write(completionFence_.get(), 1) < 0) {
+		int ret = errno;
+		LOG(Buffer, Error)
+			<< "Failed to signal completion fence: " << strerror(ret);
+	}
+
+	completionFence_.reset();
+}
+
 /**
  * \fn FrameBuffer::Private::metadata()
  * \brief Retrieve the dynamic metadata
@@ -433,4 +460,50 @@ std::unique_ptr<Fence> FrameBuffer::releaseFence()
 	return std::move(_d()->fence_);
 }
 
+/**
+ * \brief Create a Fence signalled when the buffer completes
+ *
+ * This function creates a fence that is signalled by the libcamera core as
+ * soon as the buffer completes, successfully or not, from the pipeline handler
+ * thread. Consumers that wait on the fence, such as a thread that imports the
+ * buffer in a GPU context, can thus start processing the buffer without
+ * waiting for the Camera::bufferCompleted and Camera::requestCompleted
+ * signals to be dispatched to the application thread. The buffer metadata
+ * shall still be checked to find out if the frame has been captured
+ * successfully.
+ *
+ * The fence is a software fence backed by an eventfd. It becomes readable
+ * when signalled, and can be polled or read like any other file descriptor.
+ * It can't be imported as a sync_file by graphics APIs.
+ *
+ * The function shall be called before the request containing the buffer is
+ * queued, once for every capture. Calling it again before the buffer completes
+ * replaces the previous fence, which will then never be signalled.
+ *
+ * \return A unique pointer to the Fence, or nullptr if the fence can't be
+ * created
+ */
+std::unique_ptr<Fence> FrameBuffer::createCompletionFence()
+{
+	UniqueFD fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+	if (!fd.isValid()) {
+		int ret = errno;
+		LOG(Buffer, Error)
+			<< "Failed to create completion fence: " << strerror(ret);
+		return nullptr;
+	}
+
+	UniqueFD fenceFd(fcntl(fd.get(), F_DUPFD_CLOEXEC, 0));
+	if (!fenceFd.isValid()) {
+		int ret = errno;
+		LOG(Buffer, Error)
+			<< "Failed to duplicate completion fence: " << strerror(ret);
+		return nullptr;
+	}
+
+	_d()->completionFence_ = std::move(fd);
+
+	return std::make_unique<Fence>(std::move(fenceFd));
+}
+
 } /* namespace libcamera */
@@ -7,6 +7,7 @@
 
 #include <libcamera/framebuffer_allocator.h>
 
+#include <algorithm>
 #include <errno.h>
 
 #include <libcamera/base/log.h>
@@ -52,6 +53,14 @@ LOG_DEFINE_CATEGORY(Allocator)
  *
  * Usage of the FrameBufferAllocator is optional, if all buffers for a camera
  * are provided externally applications shall not use this class.
+ *
+ * Allocating buffers is costly, and may fragment the memory of platforms that
+ * use contiguous memory allocators. Applications that switch between camera
+ * configurations, for instance between preview and still capture, can enable
+ * buffer pooling with setPoolingEnabled() to keep buffers across
+ * configurations. Buffers freed with free() are then kept in a pool, and
+ * handed back by allocate() when the stream is configured again with the same
+ * pixel format, size, stride and frame size.
  */
 
 /**
@@ -92,14 +101,45 @@ int FrameBufferAllocator::allocate(Stream *stream)
 		return -EBUSY;
 	}
 
-	int ret = camera_->exportFrameBuffers(stream, &it->second);
-	if (ret == -EINVAL)
-		LOG(Allocator, Error)
-			<< "Stream is not part of " << camera_->id()
-			<< " active configuration";
+	int ret = camera_->checkBufferExport(stream);
+	if (ret < 0) {
+		if (ret == -EINVAL)
+			LOG(Allocator, Error)
+				<< "Stream is not part of " << camera_->id()
+				<< " active configuration";
+
+		buffers_.erase(it);
+		return ret;
+	}
+
+	const StreamConfiguration &config = stream->configuration();
+
+	if (pooling_) {
+		auto entry = std::find_if(pool_.begin(), pool_.end(),
+					  [&](const PoolEntry &e) {
+						  return e.stream == stream &&
+							 isCompatible(e, config);
+					  });
+		if (entry != pool_.end()) {
+			LOG(Allocator, Debug)
+				<< "Reusing " << entry->buffers.size()
+				<< " pooled buffers for " << config.toString();
+
+			it->second = std::move(entry->buffers);
+			pool_.erase(entry);
+			configs_[stream] = config;
+
+			return it->second.size();
+		}
+	}
 
-	if (ret < 0)
+	ret = camera_->exportFrameBuffers(stream, &it->second);
+	if (ret < 0) {
 		buffers_.erase(it);
+		return ret;
+	}
+
+	configs_[stream] = config;
 
 	return ret;
 }
@@ -108,7 +148,8 @@ int FrameBufferAllocator::allocate(Stream *stream)
  * \brief Free buffers previously allocated for a \a stream
  * \param[in] stream The stream
  *
- * Free buffers allocated with allocate().
+ * Free buffers allocated with allocate(). When buffer pooling is enabled, the
+ * buffers are kept by the allocator for reuse by a later allocate() call.
  *
  * This invalidates the buffers returned by buffers().
  *
@@ -122,11 +163,60 @@ int FrameBufferAllocator::free(Stream *stream)
 	if (iter == buffers_.end())
 		return -EINVAL;
 
+	auto config = configs_.find(stream);
+
+	if (pooling_ && config != configs_.end()) {
+		/* Replace any pooled buffers with the same configuration. */
+		auto entry = std::find_if(pool_.begin(), pool_.end(),
+					  [&](const PoolEntry &e) {
+						  return e.stream == stream &&
+							 isCompatible(e, config->second);
+					  });
+		if (entry != pool_.end())
+			pool_.erase(entry);
+
+		pool_.push_back({ stream, config->second, std::move(iter->second) });
+	}
+
 	buffers_.erase(iter);
+	if (config != configs_.end())
+		configs_.erase(config);
 
 	return 0;
 }
 
+/**
+ * \brief Enable or disable buffer pooling
+ * \param[in] enable True to enable buffer pooling, false to disable it
+ *
+ * When buffer pooling is enabled, buffers freed with free() are kept by the
+ * allocator instead of being deleted. A subsequent allocate() call for the
+ * same stream, configured with the same pixel format, size, stride and frame
+ * size as when the buffers were allocated, hands the pooled buffers back
+ * instead of allocating new ones. This speeds up switching between camera
+ * configurations at the expense of keeping the memory allocated.
+ *
+ * Disabling buffer pooling deletes all the pooled buffers. Pooled buffers are
+ * also deleted when the allocator is destroyed.
+ */
+void FrameBufferAllocator::setPoolingEnabled(bool enable)
+{
+	pooling_ = enable;
+
+	if (!enable)
+		pool_.clear();
+}
+
+bool FrameBufferAllocator::isCompatible(const PoolEntry &entry,
+					const StreamConfiguration &config)
+{
+	return entry.config.pixelFormat == config.pixelFormat &&
+	       entry.config.size == config.size &&
+	       entry.config.stride == config.stride &&
+	       entry.config.frameSize == config.frameSize &&
+	       entry.buffers.size() >= config.bufferCount;
+}
+
 /**
  * \fn FrameBufferAllocator::allocated()
  * \brief Check if the allocator has allocated buffers for any stream
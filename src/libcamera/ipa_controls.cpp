@@ -129,6 +129,18 @@
  * As for the ControlList packet, empty spaces may be present between the end of
  * the entries array and the data section, and after the data section. They
  * shall be ignored when parsing the packet.
+ *
+ * ControlList packets may be delta-encoded to reduce the amount of data
+ * transferred when consecutive lists only differ by a few controls. A packet
+ * with the IPA_CONTROLS_FLAG_TRACKED flag set shall be stored by the receiver
+ * as the reference list for the handle and id map type of the packet. A packet
+ * with the IPA_CONTROLS_FLAG_DELTA flag set only contains the controls that
+ * differ from the reference list, and is applied to the last reference list
+ * received for the same handle and id map type. Controls removed from the
+ * reference list are stored as entries of type ControlTypeNone with no data.
+ * The ipa_controls_header::sequence field of tracked packets is incremented
+ * by one for every packet, allowing the receiver to detect missing reference
+ * lists.
  */
 
 namespace libcamera {
@@ -138,6 +150,17 @@ namespace libcamera {
  * \brief The current control serialization format version
  */
 
+/**
+ * \def IPA_CONTROLS_FLAG_TRACKED
+ * \brief The ControlList packet shall be stored as the reference list for
+ * delta-encoded packets
+ */
+
+/**
+ * \def IPA_CONTROLS_FLAG_DELTA
+ * \brief The ControlList packet is delta-encoded against the reference list
+ */
+
 /**
  * \var ipa_controls_id_map_type
  * \brief Enumerates the different control id map types
@@ -182,8 +205,11 @@ namespace libcamera {
  * Offset in bytes from the beginning of the packet of the data section start
  * \var ipa_controls_header::id_map_type
  * The id map type as defined by the ipa_controls_id_map_type enumeration
- * \var ipa_controls_header::reserved
- * Reserved for future extensions
+ * \var ipa_controls_header::flags
+ * Packet flags, a combination of the IPA_CONTROLS_FLAG_* values, or 0 for
+ * ControlInfoMap packets and ControlList packets that are not tracked
+ * \var ipa_controls_header::sequence
+ * Sequence number of tracked ControlList packets, 0 otherwise
  */
 
 static_assert(sizeof(ipa_controls_header) == 32,
@@ -48,6 +48,22 @@ namespace {
  * generated IPA proxies.
  */
 
+/**
+ * \fn template<typename T> void writePOD(std::vector<uint8_t> &vec, size_t pos, T val)
+ * \brief Write POD at a position of a byte vector, in little-endian order
+ * \tparam T Type of POD to write
+ * \param[in] vec Byte vector to write to
+ * \param[in] pos Index in \a vec to write at
+ * \param[in] val Value to write
+ *
+ * The \a vec byte vector must be large enough to store \a val at index \a pos.
+ * This function is used to fill size fields reserved in the byte vector once
+ * the size of the data that follows them is known.
+ *
+ * This function is meant to be used by the IPA data serializer, and the
+ * generated IPA proxies.
+ */
+
 /**
  * \fn template<typename T> T readPOD(std::vector<uint8_t>::iterator it, size_t pos,
  * 				      std::vector<uint8_t>::iterator end)
@@ -98,10 +114,50 @@ namespace {
  * \a cs is only necessary if the object type \a T or its members contain
  * ControlList or ControlInfoMap.
  *
+ * The byte vector is allocated once, with the size computed by
+ * serializedSize().
+ *
  * \return Tuple of byte vector and fd vector, that is the serialized form
  * of \a data
  */
 
+/**
+ * \fn template<typename T> IPADataSerializer<T>::serialize(
+ * 	const T &data,
+ * 	std::vector<uint8_t> *dataVec,
+ * 	std::vector<SharedFD> *fdsVec,
+ * 	ControlSerializer *cs = nullptr)
+ * \brief Serialize an object at the end of a byte vector and fd vector
+ * \tparam T Type of object to serialize
+ * \param[in] data Object to serialize
+ * \param[inout] dataVec Byte vector to append the serialized data to
+ * \param[inout] fdsVec Fd vector to append the serialized fds to
+ * \param[in] cs ControlSerializer
+ *
+ * This function serializes \a data in place, without allocating intermediate
+ * vectors for the object or its members. Callers that serialize multiple
+ * objects should reserve the total size of \a dataVec, as computed by
+ * serializedSize(), to avoid reallocations.
+ *
+ * \a cs is only necessary if the object type \a T or its members contain
+ * ControlList or ControlInfoMap.
+ */
+
+/**
+ * \fn template<typename T> IPADataSerializer<T>::serializedSize(
+ * 	const T &data,
+ * 	ControlSerializer *cs = nullptr)
+ * \brief Compute the size of the serialized form of an object
+ * \tparam T Type of object to serialize
+ * \param[in] data Object to serialize
+ * \param[in] cs ControlSerializer
+ *
+ * The size is exact for all types but ControlList, for which it is an upper
+ * bound as the list is delta-encoded when serialized.
+ *
+ * \return The size of the serialized \a data, in bytes
+ */
+
 /**
  * \fn template<typename T> IPADataSerializer<T>::deserialize(
  * 	const std::vector<uint8_t> &data,
@@ -197,7 +253,23 @@ IPADataSerializer<type>::serialize(const type &data,			\
 	dataVec.reserve(sizeof(type));					\
 	appendPOD<type>(dataVec, data);					\
 									\
-	return { dataVec, {} };						\
+	return { std::move(dataVec), {} };				\
+}									\
+									\
+template<>								\
+void IPADataSerializer<type>::serialize(const type &data,		\
+					std::vector<uint8_t> *dataVec,	\
+					[[maybe_unused]] std::vector<SharedFD> *fdsVec, \
+					[[maybe_unused]] ControlSerializer *cs) \
+{									\
+	appendPOD<type>(*dataVec, data);				\
+}									\
+									\
+template<>								\
+size_t IPADataSerializer<type>::serializedSize([[maybe_unused]] const type &data, \
+					       [[maybe_unused]] ControlSerializer *cs) \
+{									\
+	return sizeof(type);						\
 }									\
 									\
 template<>								\
@@ -258,6 +330,22 @@ IPADataSerializer<std::string>::serialize(const std::string &data,
 	return { { data.cbegin(), data.end() }, {} };
 }
 
+template<>
+void IPADataSerializer<std::string>::serialize(const std::string &data,
+					       std::vector<uint8_t> *dataVec,
+					       [[maybe_unused]] std::vector<SharedFD> *fdsVec,
+					       [[maybe_unused]] ControlSerializer *cs)
+{
+	dataVec->insert(dataVec->end(), data.cbegin(), data.cend());
+}
+
+template<>
+size_t IPADataSerializer<std::string>::serializedSize(const std::string &data,
+						      [[maybe_unused]] ControlSerializer *cs)
+{
+	return data.size();
+}
+
 template<>
 std::string
 IPADataSerializer<std::string>::deserialize(const std::vector<uint8_t> &data,
@@ -305,53 +393,95 @@ IPADataSerializer<std::string>::deserialize(std::vector<uint8_t>::const_iterator
  *
  * If data.infoMap() is nullptr, then the default controls::controls will
  * be used. The serialized ControlInfoMap will have zero length.
+ *
+ * The ControlList is delta-encoded against the previous ControlList serialized
+ * with the same ControlSerializer, see ControlSerializer::serializeDelta().
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
-IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerializer *cs)
+void IPADataSerializer<ControlList>::serialize(const ControlList &data,
+					       std::vector<uint8_t> *dataVec,
+					       [[maybe_unused]] std::vector<SharedFD> *fdsVec,
+					       ControlSerializer *cs)
 {
 	if (!cs)
 		LOG(IPADataSerializer, Fatal)
 			<< "ControlSerializer not provided for serialization of ControlList";
 
-	size_t size;
-	std::vector<uint8_t> infoData;
-	int ret;
-
 	/*
 	 * \todo Revisit this opportunistic serialization of the
 	 * ControlInfoMap, as it could be fragile
 	 */
-	if (data.infoMap() && !cs->isCached(*data.infoMap())) {
-		size = cs->binarySize(*data.infoMap());
-		infoData.resize(size);
-		ByteStreamBuffer buffer(infoData.data(), infoData.size());
-		ret = cs->serialize(*data.infoMap(), buffer);
+	const ControlInfoMap *infoMap = data.infoMap();
+	if (infoMap && cs->isCached(*infoMap))
+		infoMap = nullptr;
+
+	size_t infoDataSize = infoMap ? cs->binarySize(*infoMap) : 0;
+	size_t listDataSize = cs->binarySize(data);
+
+	/*
+	 * Serialize the ControlInfoMap and ControlList in place, to avoid
+	 * allocating and copying intermediate buffers.
+	 */
+	size_t pos = dataVec->size();
+	dataVec->resize(pos + 8 + infoDataSize + listDataSize);
+	writePOD<uint32_t>(*dataVec, pos, infoDataSize);
+
+	uint8_t *infoData = dataVec->data() + pos + 8;
+	int ret;
+
+	if (infoMap) {
+		ByteStreamBuffer buffer(infoData, infoDataSize);
+		ret = cs->serialize(*infoMap, buffer);
 
 		if (ret < 0 || buffer.overflow()) {
 			LOG(IPADataSerializer, Error) << "Failed to serialize ControlList's ControlInfoMap";
-			return { {}, {} };
+			dataVec->resize(pos);
+			return;
 		}
 	}
 
-	size = cs->binarySize(data);
-	std::vector<uint8_t> listData(size);
-	ByteStreamBuffer buffer(listData.data(), listData.size());
-	ret = cs->serialize(data, buffer);
+	/*
+	 * Delta-encode the list against the previous list sent through the
+	 * ControlSerializer, and shrink the buffer to the serialized size.
+	 */
+	ByteStreamBuffer buffer(infoData + infoDataSize, listDataSize);
+	ret = cs->serializeDelta(data, buffer);
 
 	if (ret < 0 || buffer.overflow()) {
 		LOG(IPADataSerializer, Error) << "Failed to serialize ControlList";
-		return { {}, {} };
+		dataVec->resize(pos);
+		return;
 	}
 
+	writePOD<uint32_t>(*dataVec, pos + 4, buffer.offset());
+	dataVec->resize(pos + 8 + infoDataSize + buffer.offset());
+}
+
+template<>
+std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
+IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerializer *cs)
+{
 	std::vector<uint8_t> dataVec;
-	dataVec.reserve(8 + infoData.size() + listData.size());
-	appendPOD<uint32_t>(dataVec, infoData.size());
-	appendPOD<uint32_t>(dataVec, listData.size());
-	dataVec.insert(dataVec.end(), infoData.begin(), infoData.end());
-	dataVec.insert(dataVec.end(), listData.begin(), listData.end());
+	std::vector<SharedFD> fdsVec;
+
+	serialize(data, &dataVec, &fdsVec, cs);
+
+	return { std::move(dataVec), {} };
+}
 
-	return { dataVec, {} };
+template<>
+size_t IPADataSerializer<ControlList>::serializedSize(const ControlList &data,
+						      ControlSerializer *cs)
+{
+	if (!cs)
+		LOG(IPADataSerializer, Fatal)
+			<< "ControlSerializer not provided for serialization of ControlList";
+
+	const ControlInfoMap *infoMap = data.infoMap();
+	if (infoMap && cs->isCached(*infoMap))
+		infoMap = nullptr;
+
+	return 8 + (infoMap ? cs->binarySize(*infoMap) : 0) + cs->binarySize(data);
 }
 
 template<>
@@ -431,29 +561,52 @@ IPADataSerializer<ControlList>::deserialize(std::vector<uint8_t>::const_iterator
  * X bytes - Serialized ControlInfoMap (using ControlSerializer)
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
-IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
-					     ControlSerializer *cs)
+void IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
+						  std::vector<uint8_t> *dataVec,
+						  [[maybe_unused]] std::vector<SharedFD> *fdsVec,
+						  ControlSerializer *cs)
 {
 	if (!cs)
 		LOG(IPADataSerializer, Fatal)
 			<< "ControlSerializer not provided for serialization of ControlInfoMap";
 
 	size_t size = cs->binarySize(map);
-	std::vector<uint8_t> infoData(size);
-	ByteStreamBuffer buffer(infoData.data(), infoData.size());
+	size_t pos = dataVec->size();
+
+	dataVec->resize(pos + 4 + size);
+	writePOD<uint32_t>(*dataVec, pos, size);
+
+	ByteStreamBuffer buffer(dataVec->data() + pos + 4, size);
 	int ret = cs->serialize(map, buffer);
 
 	if (ret < 0 || buffer.overflow()) {
 		LOG(IPADataSerializer, Error) << "Failed to serialize ControlInfoMap";
-		return { {}, {} };
+		dataVec->resize(pos);
 	}
+}
 
+template<>
+std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
+IPADataSerializer<ControlInfoMap>::serialize(const ControlInfoMap &map,
+					     ControlSerializer *cs)
+{
 	std::vector<uint8_t> dataVec;
-	appendPOD<uint32_t>(dataVec, infoData.size());
-	dataVec.insert(dataVec.end(), infoData.begin(), infoData.end());
+	std::vector<SharedFD> fdsVec;
+
+	serialize(map, &dataVec, &fdsVec, cs);
 
-	return { dataVec, {} };
+	return { std::move(dataVec), {} };
+}
+
+template<>
+size_t IPADataSerializer<ControlInfoMap>::serializedSize(const ControlInfoMap &map,
+							 ControlSerializer *cs)
+{
+	if (!cs)
+		LOG(IPADataSerializer, Fatal)
+			<< "ControlSerializer not provided for serialization of ControlInfoMap";
+
+	return 4 + cs->binarySize(map);
 }
 
 template<>
@@ -521,24 +674,39 @@ IPADataSerializer<ControlInfoMap>::deserialize(std::vector<uint8_t>::const_itera
  * and it will be recursively consumed as necessary.
  */
 template<>
-std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
-IPADataSerializer<SharedFD>::serialize(const SharedFD &data,
-				       [[maybe_unused]] ControlSerializer *cs)
+void IPADataSerializer<SharedFD>::serialize(const SharedFD &data,
+					    std::vector<uint8_t> *dataVec,
+					    std::vector<SharedFD> *fdsVec,
+					    [[maybe_unused]] ControlSerializer *cs)
 {
-	std::vector<uint8_t> dataVec;
-	std::vector<SharedFD> fdVec;
-
 	/*
 	 * Store as uint32_t to prepare for conversion from validity flag
 	 * to index, and for alignment.
 	 */
-	appendPOD<uint32_t>(dataVec, data.isValid());
+	appendPOD<uint32_t>(*dataVec, data.isValid());
 
 	if (data.isValid())
-		fdVec.push_back(data);
+		fdsVec->push_back(data);
+}
+
+template<>
+std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
+IPADataSerializer<SharedFD>::serialize(const SharedFD &data, ControlSerializer *cs)
+{
+	std::vector<uint8_t> dataVec;
+	std::vector<SharedFD> fdVec;
 
+	dataVec.reserve(4);
+	serialize(data, &dataVec, &fdVec, cs);
+
+	return { std::move(dataVec), std::move(fdVec) };
+}
 
-	return { dataVec, fdVec };
+template<>
+size_t IPADataSerializer<SharedFD>::serializedSize([[maybe_unused]] const SharedFD &data,
+						   [[maybe_unused]] ControlSerializer *cs)
+{
+	return 4;
 }
 
 template<>
@@ -572,25 +740,37 @@ SharedFD IPADataSerializer<SharedFD>::deserialize(const std::vector<uint8_t> &da
  * 4 bytes - uint32_t Offset
  * 4 bytes - uint32_t Length
  */
+template<>
+void IPADataSerializer<FrameBuffer::Plane>::serialize(const FrameBuffer::Plane &data,
+						      std::vector<uint8_t> *dataVec,
+						      std::vector<SharedFD> *fdsVec,
+						      [[maybe_unused]] ControlSerializer *cs)
+{
+	IPADataSerializer<SharedFD>::serialize(data.fd, dataVec, fdsVec);
+
+	appendPOD<uint32_t>(*dataVec, data.offset);
+	appendPOD<uint32_t>(*dataVec, data.length);
+}
+
 template<>
 std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
 IPADataSerializer<FrameBuffer::Plane>::serialize(const FrameBuffer::Plane &data,
-						 [[maybe_unused]] ControlSerializer *cs)
+						 ControlSerializer *cs)
 {
 	std::vector<uint8_t> dataVec;
 	std::vector<SharedFD> fdsVec;
 
-	std::vector<uint8_t> fdBuf;
-	std::vector<SharedFD> fdFds;
-	std::tie(fdBuf, fdFds) =
-		IPADataSerializer<SharedFD>::serialize(data.fd);
-	dataVec.insert(dataVec.end(), fdBuf.begin(), fdBuf.end());
-	fdsVec.insert(fdsVec.end(), fdFds.begin(), fdFds.end());
+	dataVec.reserve(12);
+	serialize(data, &dataVec, &fdsVec, cs);
 
-	appendPOD<uint32_t>(dataVec, data.offset);
-	appendPOD<uint32_t>(dataVec, data.length);
+	return { std::move(dataVec), std::move(fdsVec) };
+}
 
-	return { dataVec, fdsVec };
+template<>
+size_t IPADataSerializer<FrameBuffer::Plane>::serializedSize([[maybe_unused]] const FrameBuffer::Plane &data,
+							     [[maybe_unused]] ControlSerializer *cs)
+{
+	return 12;
 }
 
 template<>
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <dirent.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <libcamera/base/file.h>
@@ -42,7 +43,9 @@ LOG_DEFINE_CATEGORY(IPAManager)
  * Module isolation is based on the module licence. Open-source modules are
  * loaded without isolation, while closed-source module are forcefully isolated.
  * The isolation mechanism ensures that no code from a closed-source module is
- * ever run in the libcamera process.
+ * ever run in the libcamera process. The proxy worker process of isolated
+ * modules is further restricted from using system calls that IPA modules have
+ * no use for, as described in the IPASandbox class documentation.
  *
  * To create an IPA context, pipeline handlers call the IPAManager::createIPA()
  * function. For a directly loaded module, the manager calls the module's
@@ -292,6 +295,12 @@ IPAModule *IPAManager::module(PipelineHandler *pipe, uint32_t minVersion,
  */
 #endif
 
+/*
+ * Verifying the signature requires hashing the whole IPA module. The result is
+ * cached for the lifetime of the IPAManager, and reused as long as the IPA
+ * module file isn't replaced or modified. The change time can't be set from
+ * userspace, which guarantees that any modification of the file is detected.
+ */
 bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 {
 #if HAVE_IPA_PUBKEY
@@ -303,6 +312,30 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 		return false;
 	}
 
+	struct stat st;
+	if (stat(ipa->path().c_str(), &st) < 0)
+		return false;
+
+	auto sameTime = [](const struct timespec &a, const struct timespec &b) {
+		return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+	};
+
+	auto iter = signatures_.find(ipa);
+	if (iter != signatures_.end()) {
+		const SignatureStatus &status = iter->second;
+
+		if (status.dev == st.st_dev && status.ino == st.st_ino &&
+		    status.size == st.st_size &&
+		    sameTime(status.mtime, st.st_mtim) &&
+		    sameTime(status.ctime, st.st_ctim)) {
+			LOG(IPAManager, Debug)
+				<< "IPA module " << ipa->path() << " signature is "
+				<< (status.valid ? "valid" : "not valid")
+				<< " (cached)";
+			return status.valid;
+		}
+	}
+
 	File file{ ipa->path() };
 	if (!file.open(File::OpenModeFlag::ReadOnly))
 		return false;
@@ -317,6 +350,9 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 		<< "IPA module " << ipa->path() << " signature is "
 		<< (valid ? "valid" : "not valid");
 
+	signatures_[ipa] = { st.st_dev, st.st_ino, st.st_size,
+			     st.st_mtim, st.st_ctim, valid };
+
 	return valid;
 #else
 	return false;
@@ -51,7 +51,8 @@ LOG_DEFINE_CATEGORY(IPAProxy)
  * \param[in] ipam The IPA module
  */
 IPAProxy::IPAProxy(IPAModule *ipam)
-	: valid_(false), state_(ProxyStopped), ipam_(ipam)
+	: valid_(false), state_(ProxyStopped), ipam_(ipam), calls_(0),
+	  processingTime_(0)
 {
 }
 
@@ -214,6 +215,47 @@ std::string IPAProxy::resolvePath(const std::string &file) const
 	return std::string();
 }
 
+/**
+ * \struct IPAProxy::Statistics
+ * \brief Processing time statistics of the IPA
+ *
+ * \var IPAProxy::Statistics::calls
+ * \brief Number of asynchronous calls processed by the IPA
+ *
+ * \var IPAProxy::Statistics::processingTime
+ * \brief Cumulated time spent by the IPA processing the asynchronous calls
+ */
+
+/**
+ * \brief Retrieve the processing time statistics of the IPA
+ *
+ * The statistics are only recorded when the IPA runs in a thread. They stay
+ * null for IPA modules isolated in a separate process.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The IPA processing time statistics
+ */
+IPAProxy::Statistics IPAProxy::statistics() const
+{
+	return {
+		calls_.load(std::memory_order_relaxed),
+		std::chrono::nanoseconds(processingTime_.load(std::memory_order_relaxed)),
+	};
+}
+
+/**
+ * \brief Record the processing time of an asynchronous IPA call
+ * \param[in] duration The time spent by the IPA processing the call
+ *
+ * This function is called by the generated proxies from the IPA thread.
+ */
+void IPAProxy::recordCall(utils::Duration duration)
+{
+	calls_.fetch_add(1, std::memory_order_relaxed);
+	processingTime_.fetch_add(duration.get<std::nano>(), std::memory_order_relaxed);
+}
+
 /**
  * \var IPAProxy::valid_
  * \brief Flag to indicate if the IPAProxy instance is valid
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas On Board
+ *
+ * System call restrictions for isolated IPA modules
+ */
+
+#include "libcamera/internal/ipa_sandbox.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <sched.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <vector>
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+/**
+ * \file ipa_sandbox.h
+ * \brief System call restrictions for isolated IPA modules
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(IPASandbox)
+
+namespace {
+
+#if defined(__x86_64__)
+constexpr uint32_t kAuditArch = AUDIT_ARCH_X86_64;
+#elif defined(__i386__)
+constexpr uint32_t kAuditArch = AUDIT_ARCH_I386;
+#elif defined(__aarch64__)
+constexpr uint32_t kAuditArch = AUDIT_ARCH_AARCH64;
+#elif defined(__arm__) && __BYTE_ORDER == __LITTLE_ENDIAN
+constexpr uint32_t kAuditArch = AUDIT_ARCH_ARM;
+#elif defined(__riscv) && __riscv_xlen == 64
+constexpr uint32_t kAuditArch = AUDIT_ARCH_RISCV64;
+#else
+#define IPA_SANDBOX_UNSUPPORTED
+#endif
+
+#ifndef IPA_SANDBOX_UNSUPPORTED
+
+/*
+ * System calls that an IPA module has no legitimate use for. They allow
+ * escaping the worker process, acting on other processes, reaching the
+ * network or changing the system configuration.
+ */
+const long deniedSyscalls[] = {
+#ifdef __NR_fork
+	__NR_fork,
+#endif
+#ifdef __NR_vfork
+	__NR_vfork,
+#endif
+	__NR_execve,
+	__NR_execveat,
+	__NR_ptrace,
+	__NR_process_vm_readv,
+	__NR_process_vm_writev,
+	__NR_kill,
+	__NR_socket,
+	__NR_connect,
+	__NR_bind,
+	__NR_listen,
+	__NR_accept4,
+#ifdef __NR_accept
+	__NR_accept,
+#endif
+	__NR_mount,
+	__NR_umount2,
+	__NR_pivot_root,
+	__NR_chroot,
+	__NR_unshare,
+	__NR_setns,
+	__NR_setuid,
+	__NR_setgid,
+	__NR_setreuid,
+	__NR_setregid,
+	__NR_setresuid,
+	__NR_setresgid,
+	__NR_setgroups,
+	__NR_init_module,
+	__NR_finit_module,
+	__NR_delete_module,
+	__NR_kexec_load,
+	__NR_reboot,
+	__NR_swapon,
+	__NR_swapoff,
+	__NR_bpf,
+	__NR_perf_event_open,
+	__NR_keyctl,
+	__NR_add_key,
+	__NR_request_key,
+	__NR_personality,
+	__NR_userfaultfd,
+};
+
+constexpr uint32_t kArgLowOffset = offsetof(struct seccomp_data, args[0])
+#if __BYTE_ORDER == __BIG_ENDIAN
+				 + sizeof(uint32_t)
+#endif
+	;
+
+std::vector<struct sock_filter> buildFilter()
+{
+	std::vector<struct sock_filter> filter;
+
+	auto stmt = [&](uint16_t code, uint32_t k) {
+		filter.push_back(BPF_STMT(code, k));
+	};
+	auto jump = [&](uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+		filter.push_back(BPF_JUMP(code, k, jt, jf));
+	};
+
+	const uint32_t deny = SECCOMP_RET_ERRNO | (EPERM & SECCOMP_RET_DATA);
+
+	/* Deny all system calls from foreign architectures. */
+	stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+	jump(BPF_JMP | BPF_JEQ | BPF_K, kAuditArch, 1, 0);
+	stmt(BPF_RET | BPF_K, deny);
+
+	stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+
+#if defined(__x86_64__)
+	/* Deny the x32 ABI, which shares the x86-64 architecture token. */
+	jump(BPF_JMP | BPF_JGE | BPF_K, 0x40000000, 0, 1);
+	stmt(BPF_RET | BPF_K, deny);
+#endif
+
+	for (long nr : deniedSyscalls) {
+		jump(BPF_JMP | BPF_JEQ | BPF_K, nr, 0, 1);
+		stmt(BPF_RET | BPF_K, deny);
+	}
+
+	/*
+	 * clone3() passes its flags in memory, which seccomp can't inspect.
+	 * Report it as unimplemented to make the C library fall back to
+	 * clone(), and allow clone() for the creation of threads only.
+	 */
+#ifdef __NR_clone3
+	jump(BPF_JMP | BPF_JEQ | BPF_K, __NR_clone3, 0, 1);
+	stmt(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | (ENOSYS & SECCOMP_RET_DATA));
+#endif
+
+	jump(BPF_JMP | BPF_JEQ | BPF_K, __NR_clone, 0, 3);
+	stmt(BPF_LD | BPF_W | BPF_ABS, kArgLowOffset);
+	jump(BPF_JMP | BPF_JSET | BPF_K, CLONE_THREAD, 1, 0);
+	stmt(BPF_RET | BPF_K, deny);
+
+	stmt(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+
+	return filter;
+}
+
+#endif /* IPA_SANDBOX_UNSUPPORTED */
+
+} /* namespace */
+
+/**
+ * \class IPASandbox
+ * \brief Restrict the system calls available to isolated IPA modules
+ *
+ * IPA modules that are not signed run in a separate proxy worker process.
+ * Process isolation protects the memory of the libcamera process, but the
+ * worker still has all the privileges of the application. The IPASandbox
+ * class further restricts the worker with a seccomp filter that denies the
+ * system calls an IPA module has no use for, such as starting programs,
+ * creating processes, tracing other processes or opening network sockets.
+ * Denied system calls fail with EPERM.
+ *
+ * The filter uses a deny list, as the system calls needed by IPA modules to
+ * load their tuning files, map buffers, communicate with the pipeline handler
+ * and create threads vary between modules and C libraries.
+ *
+ * As the socket() and connect() system calls are denied, logging to syslog from
+ * the worker process only works if the connection to the system logger has
+ * been established before the sandbox is entered.
+ */
+
+/**
+ * \brief Apply the system call restrictions to the calling process
+ *
+ * The restrictions apply to the calling thread and all threads it creates
+ * afterwards. This function shall thus be called by the proxy worker before it
+ * creates any thread, and before it runs any code from the IPA module other
+ * than its constructors. The restrictions can't be lifted once applied.
+ *
+ * The sandbox can be disabled for debugging purposes by setting the
+ * LIBCAMERA_IPA_NO_SANDBOX environment variable to a non-empty value.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOTSUP The sandbox isn't supported on this architecture
+ */
+int IPASandbox::enter()
+{
+	const char *disable = utils::secure_getenv("LIBCAMERA_IPA_NO_SANDBOX");
+	if (disable && disable[0] != '\0') {
+		LOG(IPASandbox, Warning)
+			<< "IPA sandbox disabled through environment variable";
+		return 0;
+	}
+
+#ifdef IPA_SANDBOX_UNSUPPORTED
+	LOG(IPASandbox, Warning)
+		<< "IPA sandbox not supported on this architecture";
+	return -ENOTSUP;
+#else
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+		int ret = -errno;
+		LOG(IPASandbox, Error)
+			<< "Failed to set no_new_privs: " << strerror(-ret);
+		return ret;
+	}
+
+	std::vector<struct sock_filter> filter = buildFilter();
+	struct sock_fprog prog = {
+		.len = static_cast<unsigned short>(filter.size()),
+		.filter = filter.data(),
+	};
+
+	if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0) < 0) {
+		int ret = -errno;
+		LOG(IPASandbox, Error)
+			<< "Failed to install seccomp filter: " << strerror(-ret);
+		return ret;
+	}
+
+	LOG(IPASandbox, Debug) << "IPA sandbox enabled";
+
+	return 0;
+#endif
+}
+
+} /* namespace libcamera */
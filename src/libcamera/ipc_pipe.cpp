@@ -7,6 +7,10 @@
 
 #include "libcamera/internal/ipc_pipe.h"
 
+#include <errno.h>
+#include <string.h>
+#include <utility>
+
 #include <libcamera/base/log.h>
 
 /**
@@ -18,6 +22,200 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(IPCPipe)
 
+namespace {
+
+uint32_t readHandle(const IPCUnixSocket::Payload &payload, size_t *offset)
+{
+	uint32_t value;
+	memcpy(&value, payload.data.data() + *offset, sizeof(value));
+	*offset += sizeof(value);
+	return value;
+}
+
+void appendHandle(IPCUnixSocket::Payload *payload, uint32_t value)
+{
+	const uint8_t *ptr = reinterpret_cast<const uint8_t *>(&value);
+	payload->data.insert(payload->data.end(), ptr, ptr + sizeof(value));
+}
+
+} /* namespace */
+
+/**
+ * \class IPCFdTable
+ * \brief Table of the file descriptors exchanged over an IPC channel
+ *
+ * Every file descriptor passed through an IPC channel costs the sender a
+ * SCM_RIGHTS transfer and the receiver a new file descriptor that is closed
+ * when the message is destroyed. The IPA interfaces typically pass the same
+ * buffers with every frame, which turns this into a per-frame cost.
+ *
+ * The IPCFdTable caches the file descriptors exchanged over a channel, on both
+ * ends of the channel. The first time a file descriptor is sent, it is
+ * transferred along with a handle that the receiver stores it under. The
+ * following messages only carry the handle, which the receiver resolves to
+ * the file descriptor it has kept. Each end of a channel uses a single
+ * IPCFdTable for the messages it sends and receives, and the handles of the
+ * two directions are independent.
+ *
+ * The sender keeps a reference to the file descriptors it has sent, which
+ * guarantees that their numbers are not reused for other files while they are
+ * in the table. The table holds at most 64 sent file descriptors. When it
+ * is full, the least recently sent file descriptor is evicted, and the
+ * receiver is notified to release it with the next message. Both ends shall
+ * clear() their table at the same point of the message stream to release all
+ * file descriptors at once.
+ *
+ * The table is serialized in the payload, after the message header, as the
+ * number of file descriptors of the message followed by their handles, and
+ * the number of released handles followed by the handles. Handles of file
+ * descriptors transferred with the message have their most significant bit
+ * set.
+ */
+
+/**
+ * \brief Construct an empty IPCFdTable
+ */
+IPCFdTable::IPCFdTable()
+	: nextHandle_(0), useCount_(0)
+{
+}
+
+/**
+ * \brief Encode the file descriptors of a message in a payload
+ * \param[in] fds The file descriptors of the message
+ * \param[inout] payload The payload to encode the file descriptors in
+ *
+ * This function appends the handles of \a fds and of the released file
+ * descriptors to the data of \a payload, and the file descriptors not sent
+ * previously to the file descriptors of \a payload. The payloads shall be
+ * decoded in the order they are encoded.
+ */
+void IPCFdTable::encode(const std::vector<SharedFD> &fds,
+			IPCUnixSocket::Payload *payload)
+{
+	appendHandle(payload, fds.size());
+
+	for (const SharedFD &fd : fds) {
+		auto iter = sent_.find(fd.get());
+		if (iter != sent_.end()) {
+			iter->second.lastUse = ++useCount_;
+			appendHandle(payload, iter->second.handle);
+			continue;
+		}
+
+		if (sent_.size() >= kMaxEntries)
+			evict();
+
+		uint32_t handle = nextHandle_++ & ~kNewHandle;
+		sent_.emplace(fd.get(), Entry{ handle, fd, ++useCount_ });
+
+		appendHandle(payload, handle | kNewHandle);
+		payload->fds.push_back(fd.get());
+	}
+
+	/*
+	 * The receiver resolves the handles before releasing, an entry can
+	 * thus be evicted by the message that references it.
+	 */
+	appendHandle(payload, released_.size());
+	for (uint32_t handle : released_)
+		appendHandle(payload, handle);
+
+	released_.clear();
+}
+
+/**
+ * \brief Decode the file descriptors of a message from a payload
+ * \param[in] payload The payload to decode the file descriptors from
+ * \param[inout] offset The offset of the table in the payload data
+ * \param[out] fds The file descriptors of the message
+ *
+ * This function resolves the handles stored at \a offset in the data of
+ * \a payload, takes ownership of the file descriptors transferred with
+ * \a payload, and releases the file descriptors evicted by the sender. The
+ * \a offset is updated to point to the message data that follows the table.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The table is malformed or references an unknown handle
+ */
+int IPCFdTable::decode(IPCUnixSocket::Payload &payload, size_t *offset,
+		       std::vector<SharedFD> *fds)
+{
+	/*
+	 * Take ownership of all the transferred file descriptors first, to
+	 * close the ones that are not consumed if the table is malformed.
+	 */
+	std::vector<SharedFD> newFds;
+	newFds.reserve(payload.fds.size());
+	for (int32_t &fd : payload.fds)
+		newFds.push_back(SharedFD(std::move(fd)));
+
+	auto newFd = newFds.begin();
+	size_t size = payload.data.size();
+
+	if (size - *offset < 4)
+		return -EINVAL;
+
+	size_t numFds = readHandle(payload, offset);
+	if ((size - *offset) / 4 < numFds + 1)
+		return -EINVAL;
+
+	fds->reserve(numFds);
+
+	for (size_t i = 0; i < numFds; ++i) {
+		uint32_t handle = readHandle(payload, offset);
+
+		if (!(handle & kNewHandle)) {
+			auto iter = received_.find(handle);
+			if (iter == received_.end())
+				return -EINVAL;
+
+			fds->push_back(iter->second);
+			continue;
+		}
+
+		if (newFd == newFds.end())
+			return -EINVAL;
+
+		received_[handle & ~kNewHandle] = *newFd;
+		fds->push_back(std::move(*newFd++));
+	}
+
+	size_t numReleased = readHandle(payload, offset);
+	if ((size - *offset) / 4 < numReleased)
+		return -EINVAL;
+
+	for (size_t i = 0; i < numReleased; ++i)
+		received_.erase(readHandle(payload, offset));
+
+	return 0;
+}
+
+/**
+ * \brief Release all the file descriptors of the table
+ *
+ * The two ends of the channel shall clear their table at the same point of
+ * the message stream, when no message is in flight in either direction.
+ */
+void IPCFdTable::clear()
+{
+	sent_.clear();
+	received_.clear();
+	released_.clear();
+}
+
+void IPCFdTable::evict()
+{
+	auto oldest = sent_.begin();
+	for (auto iter = sent_.begin(); iter != sent_.end(); ++iter) {
+		if (iter->second.lastUse < oldest->second.lastUse)
+			oldest = iter;
+	}
+
+	released_.push_back(oldest->second.handle);
+	sent_.erase(oldest);
+}
+
 /**
  * \struct IPCMessage::Header
  * \brief Container for an IPCMessage header
@@ -45,6 +243,15 @@ LOG_DEFINE_CATEGORY(IPCPipe)
  * \brief IPC message to be passed through IPC message pipe
  */
 
+/**
+ * \var IPCMessage::kCmdBatch
+ * \brief Command code of a message that batches multiple messages
+ *
+ * The data of a batch message stores the batched messages, see append() and
+ * split(). The command code is reserved and shall not be used by IPA
+ * interfaces.
+ */
+
 /**
  * \brief Construct an empty IPCMessage instance
  */
@@ -74,50 +281,140 @@ IPCMessage::IPCMessage(const Header &header)
 /**
  * \brief Construct an IPCMessage instance from an IPC payload
  * \param[in] payload The IPCUnixSocket payload to construct from
+ * \param[in] fdTable The file descriptors table of the channel
  *
  * This essentially converts an IPCUnixSocket payload into an IPCMessage.
  * The header is extracted from the payload into the IPCMessage's header field.
  *
+ * If \a fdTable is not null, the file descriptors of the message are decoded
+ * from the table serialized in \a payload. The payload shall have been created
+ * with the fd table of the other end of the channel.
+ *
  * If the IPCUnixSocket payload had any valid file descriptors, then they will
  * all be invalidated.
  */
-IPCMessage::IPCMessage(IPCUnixSocket::Payload &payload)
+IPCMessage::IPCMessage(IPCUnixSocket::Payload &payload, IPCFdTable *fdTable)
 {
+	size_t offset = sizeof(header_);
+
 	memcpy(&header_, payload.data.data(), sizeof(header_));
-	data_ = std::vector<uint8_t>(payload.data.begin() + sizeof(header_),
+
+	if (fdTable) {
+		if (fdTable->decode(payload, &offset, &fds_) < 0)
+			LOG(IPCPipe, Error) << "Invalid file descriptors table";
+	} else {
+		for (int32_t &fd : payload.fds)
+			fds_.push_back(SharedFD(std::move(fd)));
+	}
+
+	data_ = std::vector<uint8_t>(payload.data.begin() + offset,
 				     payload.data.end());
-	for (int32_t &fd : payload.fds)
-		fds_.push_back(SharedFD(std::move(fd)));
 }
 
 /**
  * \brief Create an IPCUnixSocket payload from the IPCMessage
+ * \param[in] fdTable The file descriptors table of the channel
  *
  * This essentially converts the IPCMessage into an IPCUnixSocket payload.
  *
+ * If \a fdTable is not null, the file descriptors of the message are encoded
+ * with the table, and only the file descriptors not sent previously through
+ * the channel are transferred with the payload.
+ *
  * \todo Resolve the layering violation (add other converters later?)
  */
-IPCUnixSocket::Payload IPCMessage::payload() const
+IPCUnixSocket::Payload IPCMessage::payload(IPCFdTable *fdTable) const
 {
 	IPCUnixSocket::Payload payload;
 
-	payload.data.resize(sizeof(Header) + data_.size());
+	payload.data.reserve(sizeof(Header) + data_.size() +
+			     (fdTable ? 8 + fds_.size() * 4 : 0));
 	payload.fds.reserve(fds_.size());
 
+	payload.data.resize(sizeof(Header));
 	memcpy(payload.data.data(), &header_, sizeof(Header));
 
-	if (data_.size() > 0) {
-		/* \todo Make this work without copy */
-		memcpy(payload.data.data() + sizeof(Header),
-		       data_.data(), data_.size());
+	if (fdTable) {
+		fdTable->encode(fds_, &payload);
+	} else {
+		for (const SharedFD &fd : fds_)
+			payload.fds.push_back(fd.get());
 	}
 
-	for (const SharedFD &fd : fds_)
-		payload.fds.push_back(fd.get());
+	/* \todo Make this work without copy */
+	payload.data.insert(payload.data.end(), data_.begin(), data_.end());
 
 	return payload;
 }
 
+/**
+ * \brief Append a message to a batch message
+ * \param[in] message The message to append
+ *
+ * This function stores the header, data and file descriptors of \a message at
+ * the end of the data and file descriptors of this message, to be retrieved
+ * with split() on the receiving side. This message shall have the kCmdBatch
+ * command code.
+ */
+void IPCMessage::append(const IPCMessage &message)
+{
+	const BatchEntry entry = {
+		message.header(),
+		static_cast<uint32_t>(message.data().size()),
+		static_cast<uint32_t>(message.fds().size()),
+	};
+	const uint8_t *ptr = reinterpret_cast<const uint8_t *>(&entry);
+
+	data_.insert(data_.end(), ptr, ptr + sizeof(entry));
+	data_.insert(data_.end(), message.data().begin(), message.data().end());
+	fds_.insert(fds_.end(), message.fds().begin(), message.fds().end());
+}
+
+/**
+ * \brief Split a batch message into the messages it contains
+ *
+ * This function is the counterpart of append(). It shall only be called on
+ * messages with the kCmdBatch command code.
+ *
+ * \return The batched messages in the order they have been appended, or an
+ * empty vector if the batch message is malformed
+ */
+std::vector<IPCMessage> IPCMessage::split() const
+{
+	std::vector<IPCMessage> messages;
+	size_t offset = 0;
+	size_t fd = 0;
+
+	while (offset < data_.size()) {
+		BatchEntry entry;
+
+		if (data_.size() - offset < sizeof(entry)) {
+			LOG(IPCPipe, Error) << "Truncated batch message";
+			return {};
+		}
+
+		memcpy(&entry, data_.data() + offset, sizeof(entry));
+		offset += sizeof(entry);
+
+		if (entry.dataSize > data_.size() - offset ||
+		    entry.numFds > fds_.size() - fd) {
+			LOG(IPCPipe, Error) << "Truncated batch message";
+			return {};
+		}
+
+		IPCMessage &message = messages.emplace_back(entry.header);
+		message.data_.assign(data_.begin() + offset,
+				     data_.begin() + offset + entry.dataSize);
+		message.fds_.assign(fds_.begin() + fd,
+				    fds_.begin() + fd + entry.numFds);
+
+		offset += entry.dataSize;
+		fd += entry.numFds;
+	}
+
+	return messages;
+}
+
 /**
  * \fn IPCMessage::header()
  * \brief Returns a reference to the header
@@ -155,13 +452,19 @@ IPCUnixSocket::Payload IPCMessage::payload() const
  * Virtual class to model an IPC message pipe for use by IPA proxies for IPA
  * isolation. sendSync() and sendAsync() must be implemented, and the recvMessage
  * signal must be emitted whenever new data is available.
+ *
+ * Asynchronous messages can also be queued with queueAsync(), to be sent
+ * together in a single batch message when flush() is called. This lowers the
+ * number of context switches when multiple asynchronous calls are made in a
+ * row. To guarantee message ordering, implementations of sendSync() and
+ * sendAsync() shall flush() queued messages before sending their message.
  */
 
 /**
  * \brief Construct an IPCPipe instance
  */
 IPCPipe::IPCPipe()
-	: connected_(false)
+	: connected_(false), batch_(IPCMessage::kCmdBatch)
 {
 }
 
@@ -204,6 +507,55 @@ IPCPipe::~IPCPipe()
  * \return Zero on success, negative error code otherwise
  */
 
+/**
+ * \brief Queue a message to be sent over IPC asynchronously
+ * \param[in] data Data to send
+ *
+ * This function appends the message to the batch of queued messages, which is
+ * sent by the next call to flush(), sendSync() or sendAsync(). The receiver
+ * shall split() the batch message with the IPCMessage::kCmdBatch command code
+ * and process the messages it contains in order.
+ */
+void IPCPipe::queueAsync(const IPCMessage &data)
+{
+	batch_.append(data);
+}
+
+/**
+ * \fn IPCPipe::hasQueued()
+ * \brief Check if messages have been queued with queueAsync()
+ * \return True if messages are waiting for flush(), false otherwise
+ */
+
+/**
+ * \brief Send the messages queued with queueAsync()
+ *
+ * The queued messages are sent as a single batch message with sendAsync(). The
+ * function does nothing if no message is queued.
+ *
+ * \return Zero on success, negative error code otherwise
+ */
+int IPCPipe::flush()
+{
+	if (!hasQueued())
+		return 0;
+
+	/*
+	 * Swap the batch out before sending it, as sendAsync() flushes queued
+	 * messages, and back in to reuse the memory of its vectors.
+	 */
+	IPCMessage batch(IPCMessage::kCmdBatch);
+	std::swap(batch, batch_);
+
+	int ret = sendAsync(batch);
+
+	batch.data().clear();
+	batch.fds().clear();
+	std::swap(batch, batch_);
+
+	return ret;
+}
+
 /**
  * \var IPCPipe::recv
  * \brief Signal to be emitted when a message is received over IPC
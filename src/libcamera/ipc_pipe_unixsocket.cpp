@@ -7,6 +7,7 @@
 
 #include "libcamera/internal/ipc_pipe_unixsocket.h"
 
+#include <string.h>
 #include <vector>
 
 #include <libcamera/base/event_dispatcher.h>
@@ -24,58 +25,121 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(IPCPipe)
 
-IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
-				     const char *ipaProxyWorkerPath)
-	: IPCPipe()
+namespace {
+
+int startWorker(const char *ipaModulePath, const char *ipaProxyWorkerPath,
+		std::unique_ptr<Process> *proc,
+		std::unique_ptr<IPCUnixSocket> *socket)
 {
 	std::vector<int> fds;
 	std::vector<std::string> args;
 	args.push_back(ipaModulePath);
 
-	socket_ = std::make_unique<IPCUnixSocket>();
-	UniqueFD fd = socket_->create();
+	auto sock = std::make_unique<IPCUnixSocket>();
+	UniqueFD fd = sock->create();
 	if (!fd.isValid()) {
 		LOG(IPCPipe, Error) << "Failed to create socket";
-		return;
+		return -EIO;
 	}
-	socket_->readyRead.connect(this, &IPCPipeUnixSocket::readyRead);
+
+	if (sock->setupSharedMemory() < 0)
+		LOG(IPCPipe, Warning)
+			<< "Failed to set up shared memory, using the socket";
+
 	args.push_back(std::to_string(fd.get()));
 	fds.push_back(fd.get());
 
-	proc_ = std::make_unique<Process>();
-	int ret = proc_->start(ipaProxyWorkerPath, args, fds);
+	auto process = std::make_unique<Process>();
+	int ret = process->start(ipaProxyWorkerPath, args, fds);
 	if (ret) {
 		LOG(IPCPipe, Error)
 			<< "Failed to start proxy worker process";
-		return;
+		return ret;
 	}
 
+	*proc = std::move(process);
+	*socket = std::move(sock);
+
+	return 0;
+}
+
+} /* namespace */
+
+IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
+				     const char *ipaProxyWorkerPath)
+	: IPCPipe()
+{
+	ProcessManager *manager = ProcessManager::instance();
+	spareKey_ = std::string(ipaProxyWorkerPath) + ":" + ipaModulePath;
+
+	/*
+	 * Take over the proxy worker started ahead of time for this IPA
+	 * module if there's one, as it has already gone through exec() and
+	 * loaded the module. The worker doesn't send any message before it
+	 * receives the first call, so nothing can have been missed.
+	 */
+	if (manager->takeSpare(spareKey_, &proc_, &socket_)) {
+		LOG(IPCPipe, Debug) << "Using pre-started proxy worker";
+	} else {
+		int ret = startWorker(ipaModulePath, ipaProxyWorkerPath,
+				      &proc_, &socket_);
+		if (ret)
+			return;
+	}
+
+	socket_->readyRead.connect(this, &IPCPipeUnixSocket::readyRead);
 	connected_ = true;
+
+	/* Start a worker for the next user of the same IPA module. */
+	std::unique_ptr<Process> spareProc;
+	std::unique_ptr<IPCUnixSocket> spareSocket;
+	if (!startWorker(ipaModulePath, ipaProxyWorkerPath, &spareProc,
+			 &spareSocket))
+		manager->addSpare(spareKey_, std::move(spareProc),
+				  std::move(spareSocket));
 }
 
 IPCPipeUnixSocket::~IPCPipeUnixSocket()
 {
+	/*
+	 * Terminate the spare worker when the last pipe for the IPA module is
+	 * destroyed, it would otherwise outlive the cameras using the module.
+	 */
+	ProcessManager::instance()->releaseSpare(spareKey_);
 }
 
 int IPCPipeUnixSocket::sendSync(const IPCMessage &in, IPCMessage *out)
 {
 	IPCUnixSocket::Payload response;
 
-	int ret = call(in.payload(), &response, in.header().cookie);
+	int ret = flush();
+	if (ret)
+		return ret;
+
+	ret = call(in.payload(&fdTable_), &response, in.header().cookie);
 	if (ret) {
 		LOG(IPCPipe, Error) << "Failed to call sync";
 		return ret;
 	}
 
+	/*
+	 * Decode the response even if the caller doesn't need it, to keep the
+	 * file descriptors table in sync with the worker.
+	 */
+	IPCMessage message(response, &fdTable_);
 	if (out)
-		*out = IPCMessage(response);
+		*out = std::move(message);
 
 	return 0;
 }
 
 int IPCPipeUnixSocket::sendAsync(const IPCMessage &data)
 {
-	int ret = socket_->send(data.payload());
+	int ret = flush();
+	if (ret)
+		return ret;
+
+	ret = socket_->send(data.payload(&fdTable_));
 	if (ret) {
 		LOG(IPCPipe, Error) << "Failed to call async";
 		return ret;
@@ -93,15 +157,19 @@ void IPCPipeUnixSocket::readyRead()
 		return;
 	}
 
-	/* \todo Use span to avoid the double copy when callData is found. */
 	if (payload.data.size() < sizeof(IPCMessage::Header)) {
 		LOG(IPCPipe, Error) << "Not enough data received";
 		return;
 	}
 
-	IPCMessage ipcMessage(payload);
+	/*
+	 * Look the cookie up in the header only, responses are converted to
+	 * an IPCMessage by sendSync().
+	 */
+	IPCMessage::Header header;
+	memcpy(&header, payload.data.data(), sizeof(header));
 
-	auto callData = callData_.find(ipcMessage.header().cookie);
+	auto callData = callData_.find(header.cookie);
 	if (callData != callData_.end()) {
 		*callData->second.response = std::move(payload);
 		callData->second.done = true;
@@ -109,6 +177,7 @@ void IPCPipeUnixSocket::readyRead()
 	}
 
 	/* Received unexpected data, this means it's a call from the IPA. */
+	IPCMessage ipcMessage(payload, &fdTable_);
 	recv.emit(ipcMessage);
 }
 
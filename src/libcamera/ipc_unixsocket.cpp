@@ -7,7 +7,9 @@
 
 #include "libcamera/internal/ipc_unixsocket.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <poll.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -15,6 +17,9 @@
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/shared_fd.h>
+
+#include "libcamera/internal/shared_mem_object.h"
 
 /**
  * \file ipc_unixsocket.h
@@ -25,6 +30,44 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(IPCUnixSocket)
 
+namespace {
+
+/* Size of the payload ring buffer in each direction. */
+constexpr std::size_t kRingSize = 1024 * 1024;
+
+/* The number of file descriptors is stored in the 8-bit Header::fds field. */
+constexpr unsigned int kMaxFds = 255;
+
+} /* namespace */
+
+/*
+ * A single-producer single-consumer ring buffer of message payloads. The ring
+ * position of the producer is announced with the message header sent over the
+ * socket, only the consumer position needs to be shared.
+ */
+struct IPCUnixSocket::Ring {
+	Ring()
+		: tail(0)
+	{
+	}
+
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) uint8_t data[kRingSize];
+};
+
+struct IPCUnixSocket::Rings {
+	/*
+	 * The user-provided constructor avoids zero-initialization of the ring
+	 * buffers, the memfd contents are zeroed by the kernel.
+	 */
+	Rings()
+	{
+	}
+
+	/* The first ring carries messages from the side that called create(). */
+	Ring ring[2];
+};
+
 /**
  * \struct IPCUnixSocket::Payload
  * \brief Container for an IPC payload
@@ -65,11 +108,19 @@ LOG_DEFINE_CATEGORY(IPCUnixSocket)
  * it to the other side by passing the file descriptor to bind(). At that point
  * the channel is operation and communication is bidirectional and symmmetrical.
  *
+ * By default, every message is transported as two datagrams, a header and the
+ * payload data with the file descriptors. The side that created the channel
+ * can call setupSharedMemory() to transport the payload data through ring
+ * buffers in shared memory instead. Messages are then transported as a single
+ * datagram that carries the header and the file descriptors only, which saves
+ * a system call and a copy of the data through the kernel for each message.
+ *
  * \context This class is \threadbound.
  */
 
 IPCUnixSocket::IPCUnixSocket()
-	: headerReceived_(false), notifier_(nullptr)
+	: headerReceived_(false), notifier_(nullptr), tx_(nullptr),
+	  rx_(nullptr), txHead_(0), rxTail_(0)
 {
 }
 
@@ -148,6 +199,8 @@ void IPCUnixSocket::close()
 	delete notifier_;
 	notifier_ = nullptr;
 
+	releaseSharedMemory();
+
 	fd_.reset();
 	headerReceived_ = false;
 }
@@ -161,6 +214,52 @@ bool IPCUnixSocket::isBound() const
 	return fd_.isValid();
 }
 
+/**
+ * \brief Transport message payloads through shared memory
+ *
+ * This function allocates ring buffers in shared memory to transport the
+ * payload data of messages in both directions, and shares them with the
+ * remote side of the channel. It shall be called on the side that created the
+ * channel with create(), the remote side maps the ring buffers automatically.
+ * As the ring buffers are shared through the channel itself, the function can
+ * be called before the remote side binds to the channel.
+ *
+ * Messages whose payload data don't fit in the free space of the ring buffer
+ * are transported through the socket. Message ordering is preserved in all
+ * cases.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int IPCUnixSocket::setupSharedMemory()
+{
+	if (!isBound())
+		return -ENOTCONN;
+
+	if (mem_)
+		return 0;
+
+	auto rings = std::make_unique<SharedMemObject<Rings>>("ipc_unixsocket");
+	if (!*rings) {
+		LOG(IPCUnixSocket, Error) << "Failed to allocate shared memory";
+		return -ENOMEM;
+	}
+
+	Header hdr = {};
+	hdr.fds = 1;
+	hdr.type = MessageSetup;
+
+	const int32_t fd = rings->fd().get();
+	int ret = sendData(&hdr, sizeof(hdr), &fd, 1);
+	if (ret < 0)
+		return ret;
+
+	tx_ = &(*rings)->ring[0];
+	rx_ = &(*rings)->ring[1];
+	mem_ = std::move(rings);
+
+	return 0;
+}
+
 /**
  * \brief Send a message payload
  * \param[in] payload Message payload to send
@@ -185,6 +284,12 @@ int IPCUnixSocket::send(const Payload &payload)
 	if (!hdr.data && !hdr.fds)
 		return -EINVAL;
 
+	if (tx_) {
+		ret = sendRing(payload);
+		if (ret != -ENOSPC)
+			return ret;
+	}
+
 	ret = ::send(fd_.get(), &hdr, sizeof(hdr), 0);
 	if (ret < 0) {
 		ret = -errno;
@@ -221,6 +326,15 @@ int IPCUnixSocket::receive(Payload *payload)
 	if (!headerReceived_)
 		return -EAGAIN;
 
+	if (header_.type == MessageRing) {
+		int ret = receiveRing(payload);
+
+		headerReceived_ = false;
+		notifier_->setEnabled(true);
+
+		return ret;
+	}
+
 	payload->data.resize(header_.data);
 	payload->fds.resize(header_.fds);
 
@@ -314,23 +428,187 @@ int IPCUnixSocket::recvData(void *buffer, size_t length,
 	return 0;
 }
 
+int IPCUnixSocket::sendRing(const Payload &payload)
+{
+	const std::size_t size = payload.data.size();
+	const uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+	if (kRingSize - (txHead_ - tail) < size)
+		return -ENOSPC;
+
+	if (size) {
+		const std::size_t offset = txHead_ % kRingSize;
+		const std::size_t first = std::min(size, kRingSize - offset);
+
+		memcpy(&tx_->data[offset], payload.data.data(), first);
+		memcpy(&tx_->data[0], payload.data.data() + first, size - first);
+	}
+
+	Header hdr = {};
+	hdr.data = size;
+	hdr.fds = payload.fds.size();
+	hdr.type = MessageRing;
+
+	int ret = sendData(&hdr, sizeof(hdr), payload.fds.data(), hdr.fds);
+	if (ret < 0)
+		return ret;
+
+	txHead_ += size;
+
+	return 0;
+}
+
+int IPCUnixSocket::receiveRing(Payload *payload)
+{
+	const std::size_t size = header_.data;
+
+	if (!rx_ || size > kRingSize || header_.fds != fds_.size()) {
+		LOG(IPCUnixSocket, Error) << "Invalid message";
+
+		closeFds();
+
+		return -EBADMSG;
+	}
+
+	payload->data.resize(size);
+
+	if (size) {
+		const std::size_t offset = rxTail_ % kRingSize;
+		const std::size_t first = std::min(size, kRingSize - offset);
+
+		memcpy(payload->data.data(), &rx_->data[offset], first);
+		memcpy(payload->data.data() + first, &rx_->data[0], size - first);
+	}
+
+	rxTail_ += size;
+	rx_->tail.store(rxTail_, std::memory_order_release);
+
+	payload->fds.assign(fds_.begin(), fds_.end());
+	fds_.clear();
+
+	return 0;
+}
+
+int IPCUnixSocket::recvHeader()
+{
+	struct iovec iov[1];
+	iov[0].iov_base = &header_;
+	iov[0].iov_len = sizeof(header_);
+
+	alignas(struct cmsghdr) char buf[CMSG_SPACE(kMaxFds * sizeof(int32_t))];
+
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+
+	ssize_t ret = recvmsg(fd_.get(), &msg, 0);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to receive header: " << strerror(-ret);
+		return ret;
+	}
+
+	fds_.clear();
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		const std::size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+		const std::size_t pos = fds_.size();
+
+		fds_.resize(pos + num);
+		memcpy(&fds_[pos], CMSG_DATA(cmsg), num * sizeof(int32_t));
+	}
+
+	if (ret != sizeof(header_) || msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC) ||
+	    header_.type > MessageSetup ||
+	    (header_.type == MessageSocket && !fds_.empty())) {
+		LOG(IPCUnixSocket, Error) << "Invalid message header";
+
+		closeFds();
+
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+void IPCUnixSocket::mapSharedMemory()
+{
+	if (fds_.size() != 1) {
+		LOG(IPCUnixSocket, Error) << "Invalid shared memory setup";
+
+		closeFds();
+
+		return;
+	}
+
+	SharedFD fd(std::move(fds_[0]));
+	fds_.clear();
+
+	if (mem_) {
+		LOG(IPCUnixSocket, Error) << "Shared memory already set up";
+		return;
+	}
+
+	auto mem = std::make_unique<SharedMem>(fd, sizeof(Rings));
+	if (!*mem) {
+		LOG(IPCUnixSocket, Error) << "Failed to map shared memory";
+		return;
+	}
+
+	Rings *rings = reinterpret_cast<Rings *>(mem->mem().data());
+	tx_ = &rings->ring[1];
+	rx_ = &rings->ring[0];
+	mem_ = std::move(mem);
+}
+
+void IPCUnixSocket::closeFds()
+{
+	for (int32_t fd : fds_)
+		::close(fd);
+	fds_.clear();
+}
+
+void IPCUnixSocket::releaseSharedMemory()
+{
+	closeFds();
+
+	mem_.reset();
+	tx_ = nullptr;
+	rx_ = nullptr;
+	txHead_ = 0;
+	rxTail_ = 0;
+}
+
 void IPCUnixSocket::dataNotifier()
 {
 	int ret;
 
 	if (!headerReceived_) {
-		/* Receive the header. */
-		ret = ::recv(fd_.get(), &header_, sizeof(header_), 0);
-		if (ret < 0) {
-			ret = -errno;
-			LOG(IPCUnixSocket, Error)
-				<< "Failed to receive header: " << strerror(-ret);
+		ret = recvHeader();
+		if (ret < 0)
+			return;
+
+		if (header_.type == MessageSetup) {
+			mapSharedMemory();
 			return;
 		}
 
 		headerReceived_ = true;
 	}
 
+	/* Ring messages are complete once the header has been received. */
+	if (header_.type == MessageRing) {
+		notifier_->setEnabled(false);
+		readyRead.emit();
+		return;
+	}
+
 	/*
 	 * If the payload has arrived, disable the notifier and emit the
 	 * readyRead signal. The notifier will be reenabled by the receive()
@@ -14,6 +14,9 @@
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+
+#include "libcamera/internal/framebuffer.h"
 
 /**
  * \file libcamera/internal/mapped_framebuffer.h
@@ -144,51 +147,47 @@ MappedBuffer::~MappedBuffer()
  *
  * MappedBuffer derived classes shall store the mappings they create in this
  * vector which is parsed during destruct to unmap any memory mappings which
- * completed successfully.
- */
-
-/**
- * \class MappedFrameBuffer
- * \brief Map a FrameBuffer using the MappedBuffer interface
- */
-
-/**
- * \enum MappedFrameBuffer::MapFlag
- * \brief Specify the mapping mode for the FrameBuffer
- * \var MappedFrameBuffer::Read
- * \brief Create a read-only mapping
- * \var MappedFrameBuffer::Write
- * \brief Create a write-only mapping
- * \var MappedFrameBuffer::ReadWrite
- * \brief Create a mapping that can be both read and written
- */
-
-/**
- * \typedef MappedFrameBuffer::MapFlags
- * \brief A bitwise combination of MappedFrameBuffer::MapFlag values
+ * completed successfully. Derived classes that manage the lifetime of their
+ * mappings separately, such as MappedFrameBuffer, leave it empty.
  */
 
 /**
- * \brief Map all planes of a FrameBuffer
- * \param[in] buffer FrameBuffer to be mapped
- * \param[in] flags Protection flags to apply to map
+ * \class FrameBufferMapping
+ * \brief Memory mappings of a FrameBuffer shared by MappedFrameBuffer instances
  *
- * Construct an object to map a frame buffer for CPU access. The mapping can be
- * made as Read only, Write only or support Read and Write operations by setting
- * the MapFlag flags accordingly.
+ * The mapping is cached in the FrameBuffer::Private and referenced by all the
+ * MappedFrameBuffer instances created for the frame buffer. The memory is
+ * unmapped when the last reference is dropped, either when the frame buffer is
+ * destroyed or when the last MappedFrameBuffer is destroyed, whichever comes
+ * last.
  */
-MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
+class FrameBufferMapping
 {
-	ASSERT(!buffer->planes().empty());
-	planes_.reserve(buffer->planes().size());
+public:
+	FrameBufferMapping(int protection)
+		: prot(protection)
+	{
+	}
 
-	int mmapFlags = 0;
+	~FrameBufferMapping()
+	{
+		for (MappedBuffer::Plane &map : maps)
+			munmap(map.data(), map.size());
+	}
 
-	if (flags & MapFlag::Read)
-		mmapFlags |= PROT_READ;
+	int map(const FrameBuffer *buffer);
 
-	if (flags & MapFlag::Write)
-		mmapFlags |= PROT_WRITE;
+	const int prot;
+	std::vector<MappedBuffer::Plane> maps;
+	std::vector<MappedBuffer::Plane> planes;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(FrameBufferMapping)
+};
+
+int FrameBufferMapping::map(const FrameBuffer *buffer)
+{
+	planes.reserve(buffer->planes().size());
 
 	struct MappedBufferInfo {
 		uint8_t *address = nullptr;
@@ -212,7 +211,7 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 					   << "buffer length=" << length
 					   << ", plane offset=" << plane.offset
 					   << ", plane length=" << plane.length;
-			return;
+			return -EINVAL;
 		}
 		size_t &mapLength = mappedBuffers[fd].mapLength;
 		mapLength = std::max(mapLength,
@@ -223,21 +222,177 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 		const int fd = plane.fd.get();
 		auto &info = mappedBuffers[fd];
 		if (!info.address) {
-			void *address = mmap(nullptr, info.mapLength, mmapFlags,
+			void *address = mmap(nullptr, info.mapLength, prot,
 					     MAP_SHARED, fd, 0);
 			if (address == MAP_FAILED) {
-				error_ = -errno;
+				int ret = -errno;
 				LOG(Buffer, Error) << "Failed to mmap plane: "
-						   << strerror(-error_);
-				return;
+						   << strerror(-ret);
+				return ret;
 			}
 
 			info.address = static_cast<uint8_t *>(address);
-			maps_.emplace_back(info.address, info.mapLength);
+			maps.emplace_back(info.address, info.mapLength);
+		}
+
+		planes.emplace_back(info.address + plane.offset, plane.length);
+	}
+
+	return 0;
+}
+
+/**
+ * \class MappedFrameBuffer
+ * \brief Map a FrameBuffer using the MappedBuffer interface
+ *
+ * Mapping a frame buffer is expensive, it costs an mmap() call, a munmap()
+ * call and the page faults to populate the page tables on the first access to
+ * the memory. As frame buffers are usually recycled for the whole capture
+ * session, the mappings are cached in the FrameBuffer and shared by all the
+ * MappedFrameBuffer instances created for it. Only the first MappedFrameBuffer
+ * maps the memory, subsequent instances reuse the existing mapping. The memory
+ * is unmapped when both the FrameBuffer and all the MappedFrameBuffer
+ * instances have been destroyed.
+ *
+ * A cached mapping is reused when it grants all the access rights requested
+ * by the flags. Otherwise the buffer is mapped again with the union of the
+ * access rights, and the new mapping replaces the cached one. Instances that
+ * reference the previous mapping keep it alive until they are destroyed.
+ *
+ * Persistent mappings don't ensure cache coherency between the CPU and the
+ * devices that access the buffer. Users that access the memory of a dma-buf
+ * with the CPU while the buffer is also used by a device shall bracket the
+ * accesses with DMA_BUF_IOCTL_SYNC. This can be done by calling beginAccess()
+ * and endAccess() around each access, which suits mappings kept for multiple
+ * frames, or by passing the MapFlag::Sync flag, which synchronizes the buffer
+ * for the lifetime of the MappedFrameBuffer.
+ *
+ * Bracketing the CPU accesses allows exporters to allocate cacheable memory
+ * for buffers only accessed through a MappedFrameBuffer, as the caches are
+ * then cleaned and invalidated when needed. Reading cacheable memory with the
+ * CPU is typically several times faster than reading uncached memory.
+ */
+
+/**
+ * \enum MappedFrameBuffer::MapFlag
+ * \brief Specify the mapping mode for the FrameBuffer
+ * \var MappedFrameBuffer::Read
+ * \brief Create a read-only mapping
+ * \var MappedFrameBuffer::Write
+ * \brief Create a write-only mapping
+ * \var MappedFrameBuffer::ReadWrite
+ * \brief Create a mapping that can be both read and written
+ * \var MappedFrameBuffer::Sync
+ * \brief Synchronize the dma-bufs for CPU access for the lifetime of the
+ * mapping, in the direction given by the Read and Write flags
+ */
+
+/**
+ * \typedef MappedFrameBuffer::MapFlags
+ * \brief A bitwise combination of MappedFrameBuffer::MapFlag values
+ */
+
+/**
+ * \brief Map all planes of a FrameBuffer
+ * \param[in] buffer FrameBuffer to be mapped
+ * \param[in] flags Protection flags to apply to map
+ *
+ * Construct an object to map a frame buffer for CPU access. The mapping can be
+ * made as Read only, Write only or support Read and Write operations by setting
+ * the MapFlag flags accordingly. The mapping is shared with the other
+ * MappedFrameBuffer instances for the same \a buffer when possible.
+ *
+ * If the MapFlag::Sync flag is set, a CPU access synchronization is started
+ * on the dma-bufs of the \a buffer, and it is ended when the MappedFrameBuffer
+ * is destroyed.
+ *
+ * This function is thread-safe, the same frame buffer can be mapped
+ * concurrently from multiple threads.
+ */
+MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
+{
+	ASSERT(!buffer->planes().empty());
+
+	int prot = 0;
+
+	if (flags & MapFlag::Read)
+		prot |= PROT_READ;
+
+	if (flags & MapFlag::Write)
+		prot |= PROT_WRITE;
+
+	const FrameBuffer::Private *data = buffer->_d();
+
+	{
+		MutexLocker locker(data->mappingLock_);
+
+		const std::shared_ptr<FrameBufferMapping> &cached = data->mapping_;
+		if (!cached || (cached->prot & prot) != prot) {
+			if (cached)
+				prot |= cached->prot;
+
+			auto mapping = std::make_shared<FrameBufferMapping>(prot);
+			error_ = mapping->map(buffer);
+			if (error_)
+				return;
+
+			data->mapping_ = std::move(mapping);
 		}
 
-		planes_.emplace_back(info.address + plane.offset, plane.length);
+		mapping_ = data->mapping_;
+	}
+
+	planes_ = mapping_->planes;
+
+	if ((flags & MapFlag::ReadWrite) == MapFlag::ReadWrite)
+		syncType_ = DmaSyncer::SyncType::ReadWrite;
+	else if (flags & MapFlag::Write)
+		syncType_ = DmaSyncer::SyncType::Write;
+	else
+		syncType_ = DmaSyncer::SyncType::Read;
+
+	int lastFd = -1;
+	for (const FrameBuffer::Plane &plane : buffer->planes()) {
+		/* The planes usually share the same dma-buf */
+		if (plane.fd.get() == lastFd)
+			continue;
+
+		lastFd = plane.fd.get();
+		fds_.push_back(plane.fd);
 	}
+
+	if (flags & MapFlag::Sync)
+		beginAccess();
+}
+
+/**
+ * \brief Start a CPU access to the mapped memory
+ *
+ * Synchronize the dma-bufs of the frame buffer for CPU access, in the
+ * direction given by the Read and Write flags of the mapping. The memory shall
+ * only be accessed with the CPU between a call to this function and the
+ * corresponding endAccess() call. Calling this function while an access is
+ * already in progress has no effect.
+ */
+void MappedFrameBuffer::beginAccess()
+{
+	if (!syncers_.empty())
+		return;
+
+	for (const SharedFD &fd : fds_)
+		syncers_.emplace_back(fd, syncType_);
+}
+
+/**
+ * \brief End a CPU access to the mapped memory
+ *
+ * Complete the CPU access started by beginAccess(), making the CPU writes
+ * visible to the devices. This function has no effect if no access is in
+ * progress.
+ */
+void MappedFrameBuffer::endAccess()
+{
+	syncers_.clear();
 }
 
 } /* namespace libcamera */
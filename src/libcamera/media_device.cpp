@@ -20,6 +20,8 @@
 
 #include <libcamera/base/log.h>
 
+#include "libcamera/internal/media_request.h"
+
 /**
  * \file media_device.h
  * \brief Provide a representation of a Linux kernel Media Controller device
@@ -217,6 +219,8 @@ int MediaDevice::populate()
 
 	driver_ = info.driver;
 	model_ = info.model;
+	serial_ = info.serial;
+	busInfo_ = info.bus_info;
 	version_ = info.media_version;
 	hwRevision_ = info.hw_revision;
 
@@ -302,6 +306,22 @@ done:
  * \return The MediaDevice model name
  */
 
+/**
+ * \fn MediaDevice::serial()
+ * \brief Retrieve the media device serial number
+ *
+ * The serial number is optional, media devices that don't report one return
+ * an empty string.
+ *
+ * \return The MediaDevice serial number
+ */
+
+/**
+ * \fn MediaDevice::busInfo()
+ * \brief Retrieve the location of the media device in the system
+ * \return The MediaDevice bus information
+ */
+
 /**
  * \fn MediaDevice::version()
  * \brief Retrieve the media device API version
@@ -453,6 +473,36 @@ int MediaDevice::disableLinks()
 	return 0;
 }
 
+/**
+ * \brief Allocate a media request
+ *
+ * Allocate a new media request that bundles buffers and controls for the
+ * video devices and subdevices of the media device, to be applied atomically
+ * by the kernel. The media device shall be acquired.
+ *
+ * \return A new media request on success, or nullptr if the media device isn't
+ * acquired or doesn't support requests
+ */
+std::unique_ptr<MediaRequest> MediaDevice::allocateRequest()
+{
+	if (!fd_.isValid()) {
+		LOG(MediaDevice, Error)
+			<< "Media device must be acquired to allocate requests";
+		return nullptr;
+	}
+
+	int requestFd;
+	int ret = ioctl(fd_.get(), MEDIA_IOC_REQUEST_ALLOC, &requestFd);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to allocate media request: " << strerror(-ret);
+		return nullptr;
+	}
+
+	return std::make_unique<MediaRequest>(this, UniqueFD(requestFd));
+}
+
 /**
  * \var MediaDevice::disconnected
  * \brief Signal emitted when the media device is disconnected from the system
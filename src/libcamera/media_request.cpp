@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Media Controller request
+ */
+
+#include "libcamera/internal/media_request.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <linux/media.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+
+/**
+ * \file media_request.h
+ * \brief Media Controller requests
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(MediaDevice)
+
+/**
+ * \class MediaRequest
+ * \brief A Media Controller request bundling operations on multiple devices
+ *
+ * Media requests group buffers and controls on the video devices and
+ * subdevices of a media device, and apply them atomically when the request is
+ * queued. They are allocated with MediaDevice::allocateRequest().
+ *
+ * Once allocated, a request is in the Idle state. Buffers are added to the
+ * request with V4L2VideoDevice::queueBuffer() and controls are added with
+ * V4L2Device::setControls(), passing the request to both functions. The
+ * request is then queued to the device with queue(), which moves it to the
+ * Queued state. When the device completes the request, the request moves to
+ * the Complete state and the completed signal is emitted. The buffers are
+ * still dequeued from their video devices as usual.
+ *
+ * A completed request can be reused after being reinitialized with reinit().
+ *
+ * Support for media requests depends on the drivers, pipeline handlers shall
+ * check the V4L2_BUF_CAP_SUPPORTS_REQUESTS capability of the video devices
+ * before using them.
+ */
+
+/**
+ * \enum MediaRequest::Status
+ * \brief The state of a media request
+ * \var MediaRequest::Status::Idle
+ * The request is being prepared and hasn't been queued
+ * \var MediaRequest::Status::Queued
+ * The request has been queued to the device
+ * \var MediaRequest::Status::Complete
+ * The request has been completed by the device
+ */
+
+/**
+ * \brief Construct a MediaRequest
+ * \param[in] media The media device the request has been allocated from
+ * \param[in] fd The request file descriptor
+ *
+ * Media requests shall be allocated with MediaDevice::allocateRequest().
+ */
+MediaRequest::MediaRequest(MediaDevice *media, UniqueFD fd)
+	: media_(media), fd_(std::move(fd)), status_(Status::Idle)
+{
+	/* Request completion is signalled by an exception (POLLPRI) event. */
+	notifier_ = std::make_unique<EventNotifier>(fd_.get(),
+						    EventNotifier::Exception);
+	notifier_->activated.connect(this, &MediaRequest::requestReady);
+	notifier_->setEnabled(false);
+}
+
+MediaRequest::~MediaRequest() = default;
+
+/**
+ * \fn MediaRequest::media()
+ * \brief Retrieve the media device the request belongs to
+ * \return The media device
+ */
+
+/**
+ * \fn MediaRequest::fd()
+ * \brief Retrieve the request file descriptor
+ * \return The request file descriptor
+ */
+
+/**
+ * \fn MediaRequest::status()
+ * \brief Retrieve the request status
+ * \return The request status
+ */
+
+/**
+ * \var MediaRequest::completed
+ * \brief A Signal emitted when the device completes the request
+ */
+
+/**
+ * \brief Queue the request to the device
+ *
+ * All the buffers and controls added to the request are applied atomically by
+ * the device.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request isn't in the Idle state
+ */
+int MediaRequest::queue()
+{
+	if (status_ != Status::Idle)
+		return -EBUSY;
+
+	if (::ioctl(fd_.get(), MEDIA_REQUEST_IOC_QUEUE) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to queue media request: " << strerror(-ret);
+		return ret;
+	}
+
+	status_ = Status::Queued;
+	notifier_->setEnabled(true);
+
+	return 0;
+}
+
+/**
+ * \brief Reinitialize the request to make it reusable
+ *
+ * Release all the buffers and controls associated with the request, and move
+ * it back to the Idle state. Requests can't be reinitialized while queued.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request is queued
+ */
+int MediaRequest::reinit()
+{
+	if (status_ == Status::Queued)
+		return -EBUSY;
+
+	if (::ioctl(fd_.get(), MEDIA_REQUEST_IOC_REINIT) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to reinitialize media request: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	status_ = Status::Idle;
+
+	return 0;
+}
+
+void MediaRequest::requestReady()
+{
+	notifier_->setEnabled(false);
+	status_ = Status::Complete;
+
+	completed.emit(this);
+}
+
+} /* namespace libcamera */
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <vector>
@@ -30,35 +31,85 @@
 #include "libcamera/internal/v4l2_videodevice.h"
 
 #include "linux/media-bus-format.h"
+#include "linux/v4l2-controls.h"
 
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(ISI)
 
+class ISICameraData;
 class PipelineHandlerISI;
 
+class ISIPipeAllocator
+{
+public:
+	/*
+	 * Width of the ISI channel line buffers. Wider input images require
+	 * chaining a channel with the next one.
+	 */
+	static constexpr unsigned int kLineBufferWidth = 2048;
+
+	/*
+	 * Estimated memory write bandwidth of the ISI, in bytes per second.
+	 *
+	 * \todo Make this SoC-specific.
+	 */
+	static constexpr uint64_t kMaxBandwidth = 2000000000;
+
+	struct Allocation {
+		/* The pipe assigned to each stream, in configuration order. */
+		std::vector<unsigned int> pipes;
+		bool chained;
+		unsigned int xbarSink;
+		uint64_t bandwidth;
+	};
+
+	void init(unsigned int numPipes) { owners_.assign(numPipes, nullptr); }
+
+	unsigned int available(const ISICameraData *camera, bool chained) const;
+	std::optional<std::vector<unsigned int>>
+	allocate(const ISICameraData *camera, unsigned int numStreams,
+		 bool chained) const;
+
+	void commit(const ISICameraData *camera, Allocation allocation);
+	void release(const ISICameraData *camera);
+
+	uint64_t bandwidth(const ISICameraData *exclude) const;
+	const std::map<const ISICameraData *, Allocation> &allocations() const
+	{
+		return allocations_;
+	}
+
+private:
+	bool isFree(const ISICameraData *camera, unsigned int pipe) const
+	{
+		return !owners_[pipe] || owners_[pipe] == camera;
+	}
+
+	std::vector<const ISICameraData *> owners_;
+	std::map<const ISICameraData *, Allocation> allocations_;
+};
+
 class ISICameraData : public Camera::Private
 {
 public:
 	ISICameraData(PipelineHandler *ph)
 		: Camera::Private(ph)
 	{
-		/*
-		 * \todo Assume 2 channels only for now, as that's the number of
-		 * available channels on i.MX8MP.
-		 */
-		streams_.resize(2);
 	}
 
 	PipelineHandlerISI *pipe();
 
 	int init();
 
-	unsigned int pipeIndex(const Stream *stream)
+	unsigned int pipeIndex(const Stream *stream) const
 	{
-		return stream - &*streams_.begin();
+		return streamPipes_.at(stream);
 	}
 
+	uint64_t bandwidth(const CameraConfiguration &config,
+			   const Size &inputSize) const;
+
 	unsigned int getRawMediaBusFormat(PixelFormat *pixelFormat) const;
 	unsigned int getYuvMediaBusFormat(const PixelFormat &pixelFormat) const;
 	unsigned int getMediaBusFormat(PixelFormat *pixelFormat) const;
@@ -69,8 +120,11 @@ public:
 	std::vector<Stream> streams_;
 
 	std::vector<Stream *> enabledStreams_;
+	std::map<const Stream *, unsigned int> streamPipes_;
 
 	unsigned int xbarSink_;
+
+	ISIPipeAllocator *allocator_;
 };
 
 class ISICameraConfiguration : public CameraConfiguration
@@ -114,6 +168,7 @@ public:
 
 protected:
 	void stopDevice(Camera *camera) override;
+	void releaseDevice(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
 
@@ -143,6 +198,8 @@ private:
 
 	std::unique_ptr<V4L2Subdevice> crossbar_;
 	std::vector<Pipe> pipes_;
+
+	ISIPipeAllocator pipeAllocator_;
 };
 
 /* -----------------------------------------------------------------------------
@@ -170,6 +227,131 @@ int ISICameraData::init()
 	return 0;
 }
 
+/*
+ * Estimate the memory bandwidth, in bytes per second, required by the streams
+ * of the configuration when the sensor outputs frames of \a inputSize.
+ *
+ * The sensor pixel rate includes the blanking, the frame rate derived from it
+ * is an upper bound. Return 0 if the sensor doesn't report its pixel rate.
+ */
+uint64_t ISICameraData::bandwidth(const CameraConfiguration &config,
+				  const Size &inputSize) const
+{
+	const ControlInfoMap &controls = sensor_->controls();
+	auto it = controls.find(V4L2_CID_PIXEL_RATE);
+	if (it == controls.end() || inputSize.isNull())
+		return 0;
+
+	uint64_t pixelRate = it->second.max().get<int64_t>();
+	uint64_t bandwidth = 0;
+
+	for (const StreamConfiguration &cfg : config)
+		bandwidth += static_cast<uint64_t>(cfg.frameSize) * pixelRate
+			   / inputSize.width / inputSize.height;
+
+	return bandwidth;
+}
+
+/* -----------------------------------------------------------------------------
+ * ISI Pipe Allocator
+ */
+
+/*
+ * The ISI pipes are shared by all the cameras connected to the crossbar
+ * switch. The allocator assigns pipes to the streams of all cameras and keeps
+ * track of the memory bandwidth they consume.
+ *
+ * When the input image is wider than the line buffer, the ISI driver chains
+ * the pipe with the next one to combine their line buffers. The next pipe
+ * must then be left unused, and is reserved along with the pipe it's chained
+ * to.
+ */
+
+/* Count the streams the camera could use, excluding pipes of other cameras. */
+unsigned int ISIPipeAllocator::available(const ISICameraData *camera,
+					 bool chained) const
+{
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < owners_.size(); ++i) {
+		if (!isFree(camera, i))
+			continue;
+
+		if (chained) {
+			if (i + 1 >= owners_.size() || !isFree(camera, i + 1))
+				continue;
+			++i;
+		}
+
+		++count;
+	}
+
+	return count;
+}
+
+/*
+ * Compute the pipes to assign to \a numStreams streams of the camera. The
+ * pipes currently assigned to the camera are considered free, as they are
+ * released when the camera is reconfigured.
+ */
+std::optional<std::vector<unsigned int>>
+ISIPipeAllocator::allocate(const ISICameraData *camera, unsigned int numStreams,
+			   bool chained) const
+{
+	std::vector<unsigned int> pipes;
+
+	for (unsigned int i = 0; i < owners_.size() && pipes.size() < numStreams; ++i) {
+		if (!isFree(camera, i))
+			continue;
+
+		if (chained) {
+			if (i + 1 >= owners_.size() || !isFree(camera, i + 1))
+				continue;
+			pipes.push_back(i++);
+		} else {
+			pipes.push_back(i);
+		}
+	}
+
+	if (pipes.size() < numStreams)
+		return std::nullopt;
+
+	return pipes;
+}
+
+void ISIPipeAllocator::commit(const ISICameraData *camera, Allocation allocation)
+{
+	release(camera);
+
+	for (unsigned int pipe : allocation.pipes) {
+		owners_[pipe] = camera;
+		if (allocation.chained)
+			owners_[pipe + 1] = camera;
+	}
+
+	allocations_[camera] = std::move(allocation);
+}
+
+void ISIPipeAllocator::release(const ISICameraData *camera)
+{
+	std::replace(owners_.begin(), owners_.end(), camera,
+		     static_cast<const ISICameraData *>(nullptr));
+	allocations_.erase(camera);
+}
+
+/* Compute the bandwidth consumed by all cameras but \a exclude. */
+uint64_t ISIPipeAllocator::bandwidth(const ISICameraData *exclude) const
+{
+	uint64_t total = 0;
+
+	for (const auto &[camera, allocation] : allocations_) {
+		if (camera != exclude)
+			total += allocation.bandwidth;
+	}
+
+	return total;
+}
+
 /*
  * Get a RAW Bayer media bus format compatible with the requested pixelFormat.
  *
@@ -500,26 +682,33 @@ CameraConfiguration::Status ISICameraConfiguration::validate()
 	if (config_.empty())
 		return Invalid;
 
-	/* Cap the number of streams to the number of available ISI pipes. */
-	if (config_.size() > availableStreams.size()) {
-		config_.resize(availableStreams.size());
+	/*
+	 * Cap the number of streams to the number of ISI pipes not used by
+	 * other cameras.
+	 */
+	const ISIPipeAllocator *allocator = data_->allocator_;
+	unsigned int maxStreams = std::min<unsigned int>(availableStreams.size(),
+							 allocator->available(data_, false));
+	if (!maxStreams) {
+		LOG(ISI, Error) << "All ISI pipes are in use by other cameras";
+		return Invalid;
+	}
+
+	if (config_.size() > maxStreams) {
+		config_.resize(maxStreams);
 		status = Adjusted;
 	}
 
 	/*
-	 * If more than a single stream is requested, the maximum allowed input
-	 * image width is 2048. Cap the maximum image size accordingly.
-	 *
-	 * \todo The (size > 1) check only applies to i.MX8MP which has 2 ISI
-	 * channels. SoCs with more channels than the i.MX8MP are capable of
-	 * supporting more streams with input width > 2048 by chaining
-	 * successive channels together. Define a policy for channels allocation
-	 * to fully support other SoCs.
+	 * Input images wider than the line buffer require chaining each pipe
+	 * with the next one. If not enough pipes are free for all streams, cap
+	 * the maximum image width accordingly.
 	 */
 	CameraSensor *sensor = data_->sensor_.get();
 	Size maxResolution = sensor->resolution();
-	if (config_.size() > 1)
-		maxResolution.width = std::min(2048U, maxResolution.width);
+	if (maxResolution.width > ISIPipeAllocator::kLineBufferWidth &&
+	    allocator->available(data_, true) < config_.size())
+		maxResolution.width = ISIPipeAllocator::kLineBufferWidth;
 
 	/* Validate streams according to the format of the first one. */
 	const PixelFormatInfo info = PixelFormatInfo::info(config_[0].pixelFormat);
@@ -600,6 +789,19 @@ CameraConfiguration::Status ISICameraConfiguration::validate()
 
 	LOG(ISI, Debug) << "Selected sensor format: " << sensorFormat_;
 
+	/*
+	 * Report configurations that exceed the ISI memory bandwidth. They are
+	 * not rejected, as the bandwidth is estimated from the maximum sensor
+	 * frame rate, but will likely result in frame drops.
+	 */
+	uint64_t bandwidth = data_->bandwidth(*this, sensorFormat_.size)
+			   + allocator->bandwidth(data_);
+	if (bandwidth > ISIPipeAllocator::kMaxBandwidth)
+		LOG(ISI, Warning)
+			<< "Estimated bandwidth " << bandwidth / 1000000
+			<< " MB/s exceeds the ISI bandwidth of "
+			<< ISIPipeAllocator::kMaxBandwidth / 1000000 << " MB/s";
+
 	return status;
 }
 
@@ -816,26 +1018,57 @@ int PipelineHandlerISI::configure(Camera *camera, CameraConfiguration *c)
 	const MediaPad *sensorSrc = data->sensor_->entity()->getPadByIndex(0);
 	sensorSrc->links()[0]->setEnabled(true);
 
+	/* Assign ISI pipes to the streams, sharing them with other cameras. */
+	ISIPipeAllocator::Allocation allocation;
+	allocation.chained = camConfig->sensorFormat_.size.width >
+			     ISIPipeAllocator::kLineBufferWidth;
+	allocation.xbarSink = data->xbarSink_;
+	allocation.bandwidth = data->bandwidth(*c, camConfig->sensorFormat_.size);
+
+	std::optional<std::vector<unsigned int>> pipes =
+		pipeAllocator_.allocate(data, c->size(), allocation.chained);
+	if (!pipes) {
+		LOG(ISI, Error)
+			<< "Not enough free ISI pipes for " << c->size()
+			<< (allocation.chained ? " chained" : "") << " stream(s)";
+		return -EBUSY;
+	}
+
+	allocation.pipes = std::move(*pipes);
+
 	/*
-	 * Reset the crossbar switch routing and enable one route for each
-	 * requested stream configuration.
-	 *
-	 * \todo Handle concurrent usage of multiple cameras by adjusting the
-	 * routing table instead of resetting it.
+	 * Program the crossbar switch with one route per stream of all the
+	 * cameras, preserving the routes of the other cameras.
 	 */
 	V4L2Subdevice::Routing routing = {};
 	unsigned int xbarFirstSource = crossbar_->entity()->pads().size() / 2 + 1;
 
-	for (const auto &[idx, config] : utils::enumerate(*c)) {
-		uint32_t sourcePad = xbarFirstSource + idx;
-		routing.emplace_back(V4L2Subdevice::Stream{ data->xbarSink_, 0 },
-				     V4L2Subdevice::Stream{ sourcePad, 0 },
-				     V4L2_SUBDEV_ROUTE_FL_ACTIVE);
+	auto addRoutes = [&](const ISIPipeAllocator::Allocation &alloc) {
+		for (unsigned int pipe : alloc.pipes)
+			routing.emplace_back(V4L2Subdevice::Stream{ alloc.xbarSink, 0 },
+					     V4L2Subdevice::Stream{ xbarFirstSource + pipe, 0 },
+					     V4L2_SUBDEV_ROUTE_FL_ACTIVE);
+	};
+
+	for (const auto &[other, alloc] : pipeAllocator_.allocations()) {
+		if (other != data)
+			addRoutes(alloc);
 	}
+	addRoutes(allocation);
 
 	int ret = crossbar_->setRouting(&routing, V4L2Subdevice::ActiveFormat);
-	if (ret)
+	if (ret) {
+		LOG(ISI, Error)
+			<< "Failed to route the crossbar switch, all cameras must "
+			<< "be configured before starting any of them";
 		return ret;
+	}
+
+	data->streamPipes_.clear();
+	for (const auto &[idx, config] : utils::enumerate(*c))
+		data->streamPipes_[config.stream()] = allocation.pipes[idx];
+
+	pipeAllocator_.commit(data, std::move(allocation));
 
 	/* Apply format to the sensor and CSIS receiver. */
 	V4L2SubdeviceFormat format = camConfig->sensorFormat_;
@@ -938,6 +1171,11 @@ int PipelineHandlerISI::start(Camera *camera,
 	return 0;
 }
 
+void PipelineHandlerISI::releaseDevice(Camera *camera)
+{
+	pipeAllocator_.release(cameraData(camera));
+}
+
 void PipelineHandlerISI::stopDevice(Camera *camera)
 {
 	ISICameraData *data = cameraData(camera);
@@ -1017,6 +1255,8 @@ bool PipelineHandlerISI::match(DeviceEnumerator *enumerator)
 		return false;
 	}
 
+	pipeAllocator_.init(pipes_.size());
+
 	/*
 	 * Loop over all the crossbar switch sink pads to find connected CSI-2
 	 * receivers and camera sensors.
@@ -1060,6 +1300,10 @@ bool PipelineHandlerISI::match(DeviceEnumerator *enumerator)
 		data->sensor_ = std::make_unique<CameraSensor>(sensor);
 		data->csis_ = std::make_unique<V4L2Subdevice>(csi);
 		data->xbarSink_ = sink;
+		data->allocator_ = &pipeAllocator_;
+
+		/* Each camera can use all the pipes not used by other cameras. */
+		data->streams_.resize(pipes_.size());
 
 		ret = data->init();
 		if (ret) {
@@ -1087,7 +1331,7 @@ bool PipelineHandlerISI::match(DeviceEnumerator *enumerator)
 PipelineHandlerISI::Pipe *PipelineHandlerISI::pipeFromStream(Camera *camera,
 							     const Stream *stream)
 {
-	ISICameraData *data = cameraData(camera);
+	const ISICameraData *data = cameraData(camera);
 	unsigned int pipeIndex = data->pipeIndex(stream);
 
 	ASSERT(pipeIndex < pipes_.size());
@@ -340,14 +340,23 @@ int CIO2Device::exportBuffers(unsigned int count,
 
 int CIO2Device::start()
 {
-	int ret = output_->exportBuffers(kBufferCount, &buffers_);
-	if (ret < 0)
-		return ret;
+	int ret;
 
-	ret = output_->importBuffers(kBufferCount);
-	if (ret)
-		LOG(IPU3, Error) << "Failed to import CIO2 buffers";
+	/*
+	 * The internal buffers are kept across stop() and start() cycles, and
+	 * released by freeBuffers() when the configuration changes.
+	 */
+	if (buffers_.empty()) {
+		ret = output_->exportBuffers(kBufferCount, &buffers_);
+		if (ret < 0)
+			return ret;
+
+		ret = output_->importBuffers(kBufferCount);
+		if (ret)
+			LOG(IPU3, Error) << "Failed to import CIO2 buffers";
+	}
 
+	availableBuffers_ = {};
 	for (std::unique_ptr<FrameBuffer> &buffer : buffers_)
 		availableBuffers_.push(buffer.get());
 
@@ -368,15 +377,9 @@ int CIO2Device::start()
 
 int CIO2Device::stop()
 {
-	int ret;
-
 	csi2_->setFrameStartEnabled(false);
 
-	ret = output_->streamOff();
-
-	freeBuffers();
-
-	return ret;
+	return output_->streamOff();
 }
 
 FrameBuffer *CIO2Device::queueBuffer(Request *request, FrameBuffer *rawBuffer)
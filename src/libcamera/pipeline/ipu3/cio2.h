@@ -52,6 +52,7 @@ public:
 
 	int start();
 	int stop();
+	void freeBuffers();
 
 	CameraSensor *sensor() { return sensor_.get(); }
 	const CameraSensor *sensor() const { return sensor_.get(); }
@@ -64,8 +65,6 @@ public:
 	Signal<> bufferAvailable;
 
 private:
-	void freeBuffers();
-
 	void cio2BufferReady(FrameBuffer *buffer);
 
 	std::unique_ptr<CameraSensor> sensor_;
@@ -7,6 +7,8 @@
 
 #include "frames.h"
 
+#include <algorithm>
+
 #include <libcamera/framebuffer.h>
 #include <libcamera/request.h>
 
@@ -19,25 +21,44 @@ namespace libcamera {
 LOG_DECLARE_CATEGORY(IPU3)
 
 IPU3Frames::IPU3Frames()
+	: paramStarvations_(0), statStarvations_(0)
 {
 }
 
 void IPU3Frames::init(const std::vector<std::unique_ptr<FrameBuffer>> &paramBuffers,
 		      const std::vector<std::unique_ptr<FrameBuffer>> &statBuffers)
 {
+	availableParamBuffers_.clear();
+	availableParamBuffers_.reserve(paramBuffers.size());
 	for (const std::unique_ptr<FrameBuffer> &buffer : paramBuffers)
-		availableParamBuffers_.push(buffer.get());
+		availableParamBuffers_.push_back(buffer.get());
 
+	availableStatBuffers_.clear();
+	availableStatBuffers_.reserve(statBuffers.size());
 	for (const std::unique_ptr<FrameBuffer> &buffer : statBuffers)
-		availableStatBuffers_.push(buffer.get());
-
-	frameInfo_.clear();
+		availableStatBuffers_.push_back(buffer.get());
+
+	/*
+	 * The number of frames in flight is bounded by the number of
+	 * parameters and statistics buffers. Size the ring to twice that, to
+	 * leave room for frames that complete out of order before their slot
+	 * gets reused.
+	 */
+	size_t capacity = std::max<size_t>(std::max(paramBuffers.size(),
+						    statBuffers.size()), 1);
+	frames_.clear();
+	frames_.resize(capacity * 2);
+	for (Info &info : frames_)
+		info.request = nullptr;
+
+	paramStarvations_ = 0;
+	statStarvations_ = 0;
 }
 
 void IPU3Frames::clear()
 {
-	availableParamBuffers_ = {};
-	availableStatBuffers_ = {};
+	availableParamBuffers_.clear();
+	availableStatBuffers_.clear();
 }
 
 IPU3Frames::Info *IPU3Frames::create(Request *request)
@@ -46,47 +67,53 @@ IPU3Frames::Info *IPU3Frames::create(Request *request)
 
 	if (availableParamBuffers_.empty()) {
 		LOG(IPU3, Debug) << "Parameters buffer underrun";
+		paramStarvations_++;
 		return nullptr;
 	}
 
 	if (availableStatBuffers_.empty()) {
 		LOG(IPU3, Debug) << "Statistics buffer underrun";
+		statStarvations_++;
+		return nullptr;
+	}
+
+	Info &info = slot(id);
+	if (info.request) {
+		LOG(IPU3, Debug)
+			<< "Frame " << info.id << " still in flight, delaying "
+			<< id;
 		return nullptr;
 	}
 
-	FrameBuffer *paramBuffer = availableParamBuffers_.front();
-	FrameBuffer *statBuffer = availableStatBuffers_.front();
+	FrameBuffer *paramBuffer = availableParamBuffers_.back();
+	FrameBuffer *statBuffer = availableStatBuffers_.back();
 
 	paramBuffer->_d()->setRequest(request);
 	statBuffer->_d()->setRequest(request);
 
-	availableParamBuffers_.pop();
-	availableStatBuffers_.pop();
+	availableParamBuffers_.pop_back();
+	availableStatBuffers_.pop_back();
 
-	/* \todo Remove the dynamic allocation of Info */
-	std::unique_ptr<Info> info = std::make_unique<Info>();
+	info.id = id;
+	info.request = request;
+	info.rawBuffer = nullptr;
+	info.paramBuffer = paramBuffer;
+	info.statBuffer = statBuffer;
+	info.effectiveSensorControls.clear();
+	info.paramDequeued = false;
+	info.metadataProcessed = false;
 
-	info->id = id;
-	info->request = request;
-	info->rawBuffer = nullptr;
-	info->paramBuffer = paramBuffer;
-	info->statBuffer = statBuffer;
-	info->paramDequeued = false;
-	info->metadataProcessed = false;
-
-	frameInfo_[id] = std::move(info);
-
-	return frameInfo_[id].get();
+	return &info;
 }
 
 void IPU3Frames::remove(IPU3Frames::Info *info)
 {
 	/* Return params and stat buffer for reuse. */
-	availableParamBuffers_.push(info->paramBuffer);
-	availableStatBuffers_.push(info->statBuffer);
+	availableParamBuffers_.push_back(info->paramBuffer);
+	availableStatBuffers_.push_back(info->statBuffer);
 
-	/* Delete the extended frame information. */
-	frameInfo_.erase(info->id);
+	/* Release the slot. */
+	info->request = nullptr;
 }
 
 bool IPU3Frames::tryComplete(IPU3Frames::Info *info)
@@ -111,10 +138,11 @@ bool IPU3Frames::tryComplete(IPU3Frames::Info *info)
 
 IPU3Frames::Info *IPU3Frames::find(unsigned int id)
 {
-	const auto &itInfo = frameInfo_.find(id);
-
-	if (itInfo != frameInfo_.end())
-		return itInfo->second.get();
+	if (!frames_.empty()) {
+		Info &info = slot(id);
+		if (info.request && info.id == id)
+			return &info;
+	}
 
 	LOG(IPU3, Fatal) << "Can't find tracking information for frame " << id;
 
@@ -123,16 +151,17 @@ IPU3Frames::Info *IPU3Frames::find(unsigned int id)
 
 IPU3Frames::Info *IPU3Frames::find(FrameBuffer *buffer)
 {
-	for (auto const &itInfo : frameInfo_) {
-		Info *info = itInfo.second.get();
+	for (Info &info : frames_) {
+		if (!info.request)
+			continue;
 
-		for (auto const itBuffers : info->request->buffers())
+		for (auto const itBuffers : info.request->buffers())
 			if (itBuffers.second == buffer)
-				return info;
+				return &info;
 
-		if (info->rawBuffer == buffer || info->paramBuffer == buffer ||
-		    info->statBuffer == buffer)
-			return info;
+		if (info.rawBuffer == buffer || info.paramBuffer == buffer ||
+		    info.statBuffer == buffer)
+			return &info;
 	}
 
 	LOG(IPU3, Fatal) << "Can't find tracking information from buffer";
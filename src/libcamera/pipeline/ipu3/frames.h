@@ -7,9 +7,8 @@
 
 #pragma once
 
-#include <map>
 #include <memory>
-#include <queue>
+#include <stdint.h>
 #include <vector>
 
 #include <libcamera/base/signal.h>
@@ -55,13 +54,25 @@ public:
 	Info *find(unsigned int id);
 	Info *find(FrameBuffer *buffer);
 
+	uint64_t paramStarvations() const { return paramStarvations_; }
+	uint64_t statStarvations() const { return statStarvations_; }
+
 	Signal<> bufferAvailable;
 
 private:
-	std::queue<FrameBuffer *> availableParamBuffers_;
-	std::queue<FrameBuffer *> availableStatBuffers_;
+	Info &slot(unsigned int id) { return frames_[id % frames_.size()]; }
+
+	std::vector<FrameBuffer *> availableParamBuffers_;
+	std::vector<FrameBuffer *> availableStatBuffers_;
+
+	/*
+	 * Frames in flight, indexed by request sequence. A slot is free when
+	 * its request is null.
+	 */
+	std::vector<Info> frames_;
 
-	std::map<unsigned int, std::unique_ptr<Info>> frameInfo_;
+	uint64_t paramStarvations_;
+	uint64_t statStarvations_;
 };
 
 } /* namespace libcamera */
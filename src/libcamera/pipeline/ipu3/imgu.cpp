@@ -10,10 +10,13 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <map>
+#include <tuple>
 
 #include <linux/media-bus-format.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/utils.h>
 
 #include <libcamera/formats.h>
@@ -53,21 +56,46 @@ const std::vector<float> gdcScalingFactors = {
 	14.25, 14.5, 14.75, 15, 15.25, 15.5, 15.75, 16,
 };
 
-std::vector<ImgUDevice::PipeConfig> pipeConfigs;
+/*
+ * The pipe configuration only depends on the input and output sizes. Cache the
+ * computed configurations, as the pipeline handler validates the same
+ * configurations repeatedly, especially when the Android HAL probes the camera
+ * capabilities.
+ */
+constexpr unsigned int kMaxCachedPipeConfigs = 64;
 
-struct FOV {
-	float w;
-	float h;
+using PipeConfigKey = std::tuple<Size, Size, Size>;
 
-	bool isLarger(const FOV &other)
-	{
-		if (w > other.w)
-			return true;
-		if (w == other.w && h > other.h)
-			return true;
-		return false;
-	}
-};
+Mutex pipeConfigsLock;
+std::map<PipeConfigKey, ImgUDevice::PipeConfig> cachedPipeConfigs
+	LIBCAMERA_TSA_GUARDED_BY(pipeConfigsLock);
+
+/*
+ * The original procedure collects all the valid configurations and selects
+ * the one with the largest field of view. The field of view of a
+ * configuration is
+ *
+ *   fov = (in - (in - iif) - (bds - gdc) * bds_sf) / in
+ *       = gdc * bds_sf / in
+ *
+ * as bds = iif / bds_sf for all valid configurations. The GDC size is fixed for
+ * a given pipe, the configuration with the largest field of view is thus the
+ * first one found with the largest BDS scaling factor. The search records that
+ * configuration only, and skips the scaling factors that can't improve it.
+ */
+void addPipeConfig(ImgUDevice::PipeConfig *best, float bdsSF, const Size &iif,
+		   const Size &bds, const Size &gdc)
+{
+	if (!best->isNull() && bdsSF <= best->bds_sf)
+		return;
+
+	*best = { bdsSF, iif, bds, gdc };
+}
+
+bool isPrunedScaleFactor(const ImgUDevice::PipeConfig &best, float bdsSF)
+{
+	return !best.isNull() && bdsSF <= best.bds_sf;
+}
 
 /* Approximate a scaling factor sf to the closest one available in a range. */
 float findScaleFactor(float sf, const std::vector<float> &range,
@@ -106,7 +134,7 @@ bool isSameRatio(const Size &in, const Size &out)
 }
 
 void calculateBDSHeight(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc,
-			unsigned int bdsWidth, float bdsSF)
+			unsigned int bdsWidth, float bdsSF, ImgUDevice::PipeConfig *best)
 {
 	unsigned int minIFHeight = iif.height - ImgUDevice::kIFMaxCropHeight;
 	unsigned int minBDSHeight = gdc.height + ImgUDevice::kFilterHeight * 2;
@@ -158,8 +186,8 @@ void calculateBDSHeight(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc
 		if (foundIfHeight) {
 			unsigned int bdsIntHeight = static_cast<unsigned int>(bdsHeight);
 
-			pipeConfigs.push_back({ bdsSF, { iif.width, foundIfHeight },
-						{ bdsWidth, bdsIntHeight }, gdc });
+			addPipeConfig(best, bdsSF, { iif.width, foundIfHeight },
+				      { bdsWidth, bdsIntHeight }, gdc);
 			return;
 		}
 	} else {
@@ -170,10 +198,15 @@ void calculateBDSHeight(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc
 			if (std::fmod(ifHeight, 1.0) == 0 && std::fmod(bdsHeight, 1.0) == 0) {
 				unsigned int bdsIntHeight = static_cast<unsigned int>(bdsHeight);
 
+				/*
+				 * All the heights share the same field of
+				 * view, only the first one can be selected.
+				 */
 				if (!(ifHeight % ImgUDevice::kIFAlignHeight) &&
 				    !(bdsIntHeight % ImgUDevice::kBDSAlignHeight)) {
-					pipeConfigs.push_back({ bdsSF, { iif.width, ifHeight },
-								{ bdsWidth, bdsIntHeight }, gdc });
+					addPipeConfig(best, bdsSF, { iif.width, ifHeight },
+						      { bdsWidth, bdsIntHeight }, gdc);
+					return;
 				}
 			}
 
@@ -182,13 +215,19 @@ void calculateBDSHeight(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc
 	}
 }
 
-void calculateBDS(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc, float bdsSF)
+void calculateBDS(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc, float bdsSF,
+		  ImgUDevice::PipeConfig *best)
 {
 	unsigned int minBDSWidth = gdc.width + ImgUDevice::kFilterWidth * 2;
 	unsigned int minBDSHeight = gdc.height + ImgUDevice::kFilterHeight * 2;
 
 	float sf = bdsSF;
 	while (sf <= ImgUDevice::kBDSSfMax && sf >= ImgUDevice::kBDSSfMin) {
+		if (isPrunedScaleFactor(*best, sf)) {
+			sf += ImgUDevice::kBDSSfStep;
+			continue;
+		}
+
 		float bdsWidth = static_cast<float>(iif.width) / sf;
 		float bdsHeight = static_cast<float>(iif.height) / sf;
 
@@ -198,7 +237,7 @@ void calculateBDS(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc, floa
 			unsigned int bdsIntHeight = static_cast<unsigned int>(bdsHeight);
 			if (!(bdsIntWidth % ImgUDevice::kBDSAlignWidth) && bdsWidth >= minBDSWidth &&
 			    !(bdsIntHeight % ImgUDevice::kBDSAlignHeight) && bdsHeight >= minBDSHeight)
-				calculateBDSHeight(pipe, iif, gdc, bdsIntWidth, sf);
+				calculateBDSHeight(pipe, iif, gdc, bdsIntWidth, sf, best);
 		}
 
 		sf += ImgUDevice::kBDSSfStep;
@@ -206,6 +245,10 @@ void calculateBDS(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc, floa
 
 	sf = bdsSF;
 	while (sf <= ImgUDevice::kBDSSfMax && sf >= ImgUDevice::kBDSSfMin) {
+		/* The scaling factors only decrease from here. */
+		if (isPrunedScaleFactor(*best, sf))
+			break;
+
 		float bdsWidth = static_cast<float>(iif.width) / sf;
 		float bdsHeight = static_cast<float>(iif.height) / sf;
 
@@ -215,7 +258,7 @@ void calculateBDS(ImgUDevice::Pipe *pipe, const Size &iif, const Size &gdc, floa
 			unsigned int bdsIntHeight = static_cast<unsigned int>(bdsHeight);
 			if (!(bdsIntWidth % ImgUDevice::kBDSAlignWidth) && bdsWidth >= minBDSWidth &&
 			    !(bdsIntHeight % ImgUDevice::kBDSAlignHeight) && bdsHeight >= minBDSHeight)
-				calculateBDSHeight(pipe, iif, gdc, bdsIntWidth, sf);
+				calculateBDSHeight(pipe, iif, gdc, bdsIntWidth, sf, best);
 		}
 
 		sf -= ImgUDevice::kBDSSfStep;
@@ -254,21 +297,51 @@ Size calculateGDC(ImgUDevice::Pipe *pipe)
 	return gdc;
 }
 
-FOV calcFOV(const Size &in, const ImgUDevice::PipeConfig &pipe)
+ImgUDevice::PipeConfig searchPipeConfig(ImgUDevice::Pipe *pipe)
 {
-	FOV fov{};
+	const Size &in = pipe->input;
+	ImgUDevice::PipeConfig best{};
+
+	Size gdc = calculateGDC(pipe);
 
-	float inW = static_cast<float>(in.width);
-	float inH = static_cast<float>(in.height);
-	float ifCropW = static_cast<float>(in.width - pipe.iif.width);
-	float ifCropH = static_cast<float>(in.height - pipe.iif.height);
-	float gdcCropW = static_cast<float>(pipe.bds.width - pipe.gdc.width) * pipe.bds_sf;
-	float gdcCropH = static_cast<float>(pipe.bds.height - pipe.gdc.height) * pipe.bds_sf;
+	float bdsSF = static_cast<float>(in.width) / gdc.width;
+	float sf = findScaleFactor(bdsSF, bdsScalingFactors, true);
 
-	fov.w = (inW - (ifCropW + gdcCropW)) / inW;
-	fov.h = (inH - (ifCropH + gdcCropH)) / inH;
+	/* Search the configurations by scaling width and height. */
+	unsigned int ifWidth = utils::alignUp(in.width, ImgUDevice::kIFAlignWidth);
+	unsigned int ifHeight = utils::alignUp(in.height, ImgUDevice::kIFAlignHeight);
+	unsigned int minIfWidth = in.width - ImgUDevice::kIFMaxCropWidth;
+	unsigned int minIfHeight = in.height - ImgUDevice::kIFMaxCropHeight;
+	while (ifWidth >= minIfWidth) {
+		while (ifHeight >= minIfHeight) {
+			Size iif{ ifWidth, ifHeight };
+			calculateBDS(pipe, iif, gdc, sf, &best);
+			ifHeight -= ImgUDevice::kIFAlignHeight;
+		}
 
-	return fov;
+		ifWidth -= ImgUDevice::kIFAlignWidth;
+	}
+
+	/* Repeat search by scaling width first. */
+	ifWidth = utils::alignUp(in.width, ImgUDevice::kIFAlignWidth);
+	ifHeight = utils::alignUp(in.height, ImgUDevice::kIFAlignHeight);
+	minIfWidth = in.width - ImgUDevice::kIFMaxCropWidth;
+	minIfHeight = in.height - ImgUDevice::kIFMaxCropHeight;
+	while (ifHeight >= minIfHeight) {
+		/*
+		 * \todo This procedure is probably broken:
+		 * https://github.com/intel/intel-ipu3-pipecfg/issues/2
+		 */
+		while (ifWidth >= minIfWidth) {
+			Size iif{ ifWidth, ifHeight };
+			calculateBDS(pipe, iif, gdc, sf, &best);
+			ifWidth -= ImgUDevice::kIFAlignWidth;
+		}
+
+		ifHeight -= ImgUDevice::kIFAlignHeight;
+	}
+
+	return best;
 }
 
 } /* namespace */
@@ -383,8 +456,6 @@ int ImgUDevice::init(MediaDevice *media, unsigned int index)
  */
 ImgUDevice::PipeConfig ImgUDevice::calculatePipeConfig(Pipe *pipe)
 {
-	pipeConfigs.clear();
-
 	LOG(IPU3, Debug) << "Calculating pipe configuration for: ";
 	LOG(IPU3, Debug) << "input: " << pipe->input;
 	LOG(IPU3, Debug) << "main: " << pipe->main;
@@ -401,69 +472,43 @@ ImgUDevice::PipeConfig ImgUDevice::calculatePipeConfig(Pipe *pipe)
 		return {};
 	}
 
-	Size gdc = calculateGDC(pipe);
+	PipeConfigKey key{ pipe->input, pipe->main, pipe->viewfinder };
+	PipeConfig pipeConfig;
+	bool cached = false;
 
-	float bdsSF = static_cast<float>(in.width) / gdc.width;
-	float sf = findScaleFactor(bdsSF, bdsScalingFactors, true);
+	{
+		MutexLocker locker(pipeConfigsLock);
 
-	/* Populate the configurations vector by scaling width and height. */
-	unsigned int ifWidth = utils::alignUp(in.width, ImgUDevice::kIFAlignWidth);
-	unsigned int ifHeight = utils::alignUp(in.height, ImgUDevice::kIFAlignHeight);
-	unsigned int minIfWidth = in.width - ImgUDevice::kIFMaxCropWidth;
-	unsigned int minIfHeight = in.height - ImgUDevice::kIFMaxCropHeight;
-	while (ifWidth >= minIfWidth) {
-		while (ifHeight >= minIfHeight) {
-			Size iif{ ifWidth, ifHeight };
-			calculateBDS(pipe, iif, gdc, sf);
-			ifHeight -= ImgUDevice::kIFAlignHeight;
+		auto it = cachedPipeConfigs.find(key);
+		if (it != cachedPipeConfigs.end()) {
+			pipeConfig = it->second;
+			cached = true;
 		}
-
-		ifWidth -= ImgUDevice::kIFAlignWidth;
 	}
 
-	/* Repeat search by scaling width first. */
-	ifWidth = utils::alignUp(in.width, ImgUDevice::kIFAlignWidth);
-	ifHeight = utils::alignUp(in.height, ImgUDevice::kIFAlignHeight);
-	minIfWidth = in.width - ImgUDevice::kIFMaxCropWidth;
-	minIfHeight = in.height - ImgUDevice::kIFMaxCropHeight;
-	while (ifHeight >= minIfHeight) {
-		/*
-		 * \todo This procedure is probably broken:
-		 * https://github.com/intel/intel-ipu3-pipecfg/issues/2
-		 */
-		while (ifWidth >= minIfWidth) {
-			Size iif{ ifWidth, ifHeight };
-			calculateBDS(pipe, iif, gdc, sf);
-			ifWidth -= ImgUDevice::kIFAlignWidth;
-		}
+	if (!cached) {
+		pipeConfig = searchPipeConfig(pipe);
 
-		ifHeight -= ImgUDevice::kIFAlignHeight;
+		MutexLocker locker(pipeConfigsLock);
+
+		if (cachedPipeConfigs.size() >= kMaxCachedPipeConfigs)
+			cachedPipeConfigs.clear();
+
+		cachedPipeConfigs[key] = pipeConfig;
 	}
 
-	if (pipeConfigs.size() == 0) {
+	if (pipeConfig.isNull()) {
 		LOG(IPU3, Error) << "Failed to calculate pipe configuration";
 		return {};
 	}
 
-	FOV bestFov = calcFOV(pipe->input, pipeConfigs[0]);
-	unsigned int bestIndex = 0;
-	unsigned int p = 0;
-	for (auto pipeConfig : pipeConfigs) {
-		FOV fov = calcFOV(pipe->input, pipeConfig);
-		if (fov.isLarger(bestFov)) {
-			bestFov = fov;
-			bestIndex = p;
-		}
-
-		++p;
-	}
-
-	LOG(IPU3, Debug) << "Computed pipe configuration: ";
-	LOG(IPU3, Debug) << "IF: " << pipeConfigs[bestIndex].iif;
-	LOG(IPU3, Debug) << "BDS: " << pipeConfigs[bestIndex].bds;
-	LOG(IPU3, Debug) << "GDC: " << pipeConfigs[bestIndex].gdc;
+	LOG(IPU3, Debug) << "Computed pipe configuration"
+			 << (cached ? " (cached)" : "") << ": ";
+	LOG(IPU3, Debug) << "IF: " << pipeConfig.iif;
+	LOG(IPU3, Debug) << "BDS: " << pipeConfig.bds;
+	LOG(IPU3, Debug) << "GDC: " << pipeConfig.gdc;
 
-	return pipeConfigs[bestIndex];
+	return pipeConfig;
 }
 
 /**
@@ -66,7 +66,7 @@ public:
 
 	int init(MediaDevice *media, unsigned int index);
 
-	PipeConfig calculatePipeConfig(Pipe *pipe);
+	static PipeConfig calculatePipeConfig(Pipe *pipe);
 
 	int configure(const PipeConfig &pipeConfig, V4L2DeviceFormat *inputFormat);
 
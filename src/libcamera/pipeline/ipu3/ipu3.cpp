@@ -5,6 +5,7 @@
  * Pipeline handler for Intel IPU3
  */
 
+#include <array>
 #include <algorithm>
 #include <iomanip>
 #include <memory>
@@ -51,7 +52,8 @@ class IPU3CameraData : public Camera::Private
 {
 public:
 	IPU3CameraData(PipelineHandler *pipe)
-		: Camera::Private(pipe)
+		: Camera::Private(pipe), imgu_(nullptr), streaming_(false),
+		  buffersAllocated_(false)
 	{
 	}
 
@@ -67,6 +69,14 @@ public:
 
 	CIO2Device cio2_;
 	ImgUDevice *imgu_;
+	bool streaming_;
+
+	/*
+	 * The internal buffers and their IPA mappings are kept across stop()
+	 * and start() cycles, until the camera is reconfigured or released.
+	 */
+	std::vector<IPABuffer> ipaBuffers_;
+	bool buffersAllocated_;
 
 	Stream outStream_;
 	Stream vfStream_;
@@ -148,25 +158,36 @@ public:
 
 	bool match(DeviceEnumerator *enumerator) override;
 
+protected:
+	void releaseDevice(Camera *camera) override;
+
 private:
 	IPU3CameraData *cameraData(Camera *camera)
 	{
 		return static_cast<IPU3CameraData *>(camera->_d());
 	}
 
+	ImgUDevice *imgu(unsigned int index)
+	{
+		return index ? &imgu1_ : &imgu0_;
+	}
+
 	int initControls(IPU3CameraData *data);
 	int updateControls(IPU3CameraData *data);
 	int registerCameras();
 
+	int assignImgU(IPU3CameraData *data);
+	void releaseImgU(IPU3CameraData *data);
+	int isolateImgU(IPU3CameraData *data);
+
 	int allocateBuffers(Camera *camera);
 	int freeBuffers(Camera *camera);
 
 	ImgUDevice imgu0_;
 	ImgUDevice imgu1_;
+	std::array<IPU3CameraData *, 2> imguUsers_;
 	MediaDevice *cio2MediaDev_;
 	MediaDevice *imguMediaDev_;
-
-	std::vector<IPABuffer> ipaBuffers_;
 };
 
 IPU3CameraConfiguration::IPU3CameraConfiguration(IPU3CameraData *data)
@@ -373,7 +394,7 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 
 	/* Only compute the ImgU configuration if a YUV stream has been requested. */
 	if (yuvCount) {
-		pipeConfig_ = data_->imgu_->calculatePipeConfig(&pipe);
+		pipeConfig_ = ImgUDevice::calculatePipeConfig(&pipe);
 		if (pipeConfig_.isNull()) {
 			LOG(IPU3, Error) << "Failed to calculate pipe configuration: "
 					 << "unsupported resolutions.";
@@ -385,7 +406,8 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 }
 
 PipelineHandlerIPU3::PipelineHandlerIPU3(CameraManager *manager)
-	: PipelineHandler(manager), cio2MediaDev_(nullptr), imguMediaDev_(nullptr)
+	: PipelineHandler(manager), imguUsers_{}, cio2MediaDev_(nullptr),
+	  imguMediaDev_(nullptr)
 {
 }
 
@@ -485,41 +507,25 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	Stream *outStream = &data->outStream_;
 	Stream *vfStream = &data->vfStream_;
 	CIO2Device *cio2 = &data->cio2_;
-	ImgUDevice *imgu = data->imgu_;
+	ImgUDevice *imgu;
 	V4L2DeviceFormat outputFormat;
 	int ret;
 
+	/* The internal buffers depend on the configuration, release them. */
+	if (data->buffersAllocated_)
+		freeBuffers(camera);
+
 	/*
-	 * FIXME: enabled links in one ImgU pipe interfere with capture
-	 * operations on the other one. This can be easily triggered by
-	 * capturing from one camera and then trying to capture from the other
-	 * one right after, without disabling media links on the first used
-	 * pipe.
-	 *
-	 * The tricky part here is where to disable links on the ImgU instance
-	 * which is currently not in use:
-	 * 1) Link enable/disable cannot be done at start()/stop() time as video
-	 * devices needs to be linked first before format can be configured on
-	 * them.
-	 * 2) As link enable has to be done at the least in configure(),
-	 * before configuring formats, the only place where to disable links
-	 * would be 'stop()', but the Camera class state machine allows
-	 * start()<->stop() sequences without any configure() in between.
-	 *
-	 * As of now, disable all links in the ImgU media graph before
-	 * configuring the device, to allow alternate the usage of the two
-	 * ImgU pipes.
-	 *
-	 * As a consequence, a Camera using an ImgU shall be configured before
-	 * any start()/stop() sequence. An application that wants to
-	 * pre-configure all the camera and then start/stop them alternatively
-	 * without going through any re-configuration (a sequence that is
-	 * allowed by the Camera state machine) would now fail on the IPU3.
+	 * Each camera uses one of the two ImgU pipes for the duration of its
+	 * acquisition. The pipe is assigned at the first configuration and
+	 * released when the camera is released.
 	 */
-	ret = imguMediaDev_->disableLinks();
+	ret = assignImgU(data);
 	if (ret)
 		return ret;
 
+	imgu = data->imgu_;
+
 	/*
 	 * \todo Enable links selectively based on the requested streams.
 	 * As of now, enable all links unconditionally.
@@ -527,7 +533,7 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	 * stream which is for raw capture, in which case no buffers will
 	 * ever be queued to the ImgU.
 	 */
-	ret = data->imgu_->enableLinks(true);
+	ret = isolateImgU(data);
 	if (ret)
 		return ret;
 
@@ -679,19 +685,16 @@ int PipelineHandlerIPU3::allocateBuffers(Camera *camera)
 
 	for (const std::unique_ptr<FrameBuffer> &buffer : imgu->paramBuffers_) {
 		buffer->setCookie(ipaBufferId++);
-		ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
+		data->ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
 	}
 
 	for (const std::unique_ptr<FrameBuffer> &buffer : imgu->statBuffers_) {
 		buffer->setCookie(ipaBufferId++);
-		ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
+		data->ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
 	}
 
-	data->ipa_->mapBuffers(ipaBuffers_);
-
-	data->frameInfos_.init(imgu->paramBuffers_, imgu->statBuffers_);
-	data->frameInfos_.bufferAvailable.connect(
-		data, &IPU3CameraData::queuePendingRequests);
+	data->ipa_->mapBuffers(data->ipaBuffers_);
+	data->buffersAllocated_ = true;
 
 	return 0;
 }
@@ -703,13 +706,16 @@ int PipelineHandlerIPU3::freeBuffers(Camera *camera)
 	data->frameInfos_.clear();
 
 	std::vector<unsigned int> ids;
-	for (IPABuffer &ipabuf : ipaBuffers_)
+	for (IPABuffer &ipabuf : data->ipaBuffers_)
 		ids.push_back(ipabuf.id);
 
 	data->ipa_->unmapBuffers(ids);
-	ipaBuffers_.clear();
+	data->ipaBuffers_.clear();
 
 	data->imgu_->freeBuffers();
+	data->cio2_.freeBuffers();
+
+	data->buffersAllocated_ = false;
 
 	return 0;
 }
@@ -721,16 +727,31 @@ int PipelineHandlerIPU3::start(Camera *camera, [[maybe_unused]] const ControlLis
 	ImgUDevice *imgu = data->imgu_;
 	int ret;
 
+	/*
+	 * The links of our ImgU pipe may have been disabled by the
+	 * configuration of another camera since we have been configured.
+	 */
+	ret = isolateImgU(data);
+	if (ret)
+		return ret;
+
 	/* Disable test pattern mode on the sensor, if any. */
 	ret = cio2->sensor()->setTestPatternMode(
 		controls::draft::TestPatternModeEnum::TestPatternModeOff);
 	if (ret)
 		return ret;
 
-	/* Allocate buffers for internal pipeline usage. */
-	ret = allocateBuffers(camera);
-	if (ret)
-		return ret;
+	/*
+	 * Allocate buffers for internal pipeline usage, unless they have been
+	 * kept from a previous capture session with the same configuration.
+	 */
+	if (!data->buffersAllocated_) {
+		ret = allocateBuffers(camera);
+		if (ret)
+			return ret;
+	}
+
+	data->frameInfos_.init(imgu->paramBuffers_, imgu->statBuffers_);
 
 	ret = data->ipa_->start();
 	if (ret)
@@ -750,6 +771,8 @@ int PipelineHandlerIPU3::start(Camera *camera, [[maybe_unused]] const ControlLis
 	if (ret)
 		goto error;
 
+	data->streaming_ = true;
+
 	return 0;
 
 error:
@@ -770,13 +793,143 @@ void PipelineHandlerIPU3::stopDevice(Camera *camera)
 	data->cancelPendingRequests();
 
 	data->ipa_->stop();
+	data->streaming_ = false;
 
 	ret |= data->imgu_->stop();
 	ret |= data->cio2_.stop();
 	if (ret)
 		LOG(IPU3, Warning) << "Failed to stop camera " << camera->id();
 
-	freeBuffers(camera);
+	/*
+	 * Report the parameters and statistics buffer starvations, to help
+	 * tuning the number of buffers.
+	 */
+	if (data->frameInfos_.paramStarvations() || data->frameInfos_.statStarvations())
+		LOG(IPU3, Debug)
+			<< "Requests delayed by parameters buffer starvation "
+			<< data->frameInfos_.paramStarvations()
+			<< " times, by statistics buffer starvation "
+			<< data->frameInfos_.statStarvations() << " times";
+
+	data->frameInfos_.clear();
+}
+
+void PipelineHandlerIPU3::releaseDevice(Camera *camera)
+{
+	IPU3CameraData *data = cameraData(camera);
+
+	if (data->buffersAllocated_)
+		freeBuffers(camera);
+
+	releaseImgU(data);
+}
+
+/**
+ * \brief Assign an ImgU pipe to a camera
+ * \param[in] data The camera data
+ *
+ * The two ImgU pipes are firmware contexts of the same ImgU hardware and
+ * offer identical capabilities. Any free pipe is thus suitable, and the first
+ * one is picked. The pipe stays assigned to the camera until the camera is
+ * released, which allows up to two cameras to stream concurrently.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY Both ImgU pipes are in use by other cameras
+ */
+int PipelineHandlerIPU3::assignImgU(IPU3CameraData *data)
+{
+	if (data->imgu_)
+		return 0;
+
+	auto iter = std::find(imguUsers_.begin(), imguUsers_.end(), nullptr);
+	if (iter == imguUsers_.end()) {
+		LOG(IPU3, Error)
+			<< "No ImgU pipe available, both are in use by other cameras";
+		return -EBUSY;
+	}
+
+	unsigned int index = iter - imguUsers_.begin();
+	ImgUDevice *imgu = this->imgu(index);
+
+	/*
+	 * Connect video devices' 'bufferReady' signals to their slot to
+	 * implement the image processing pipeline.
+	 *
+	 * Frames produced by the CIO2 unit are passed to the associated ImgU
+	 * input where they get processed and returned through the ImgU main
+	 * and secondary outputs.
+	 */
+	imgu->input_->bufferReady.connect(&data->cio2_,
+					  &CIO2Device::tryReturnBuffer);
+	imgu->output_->bufferReady.connect(data,
+					   &IPU3CameraData::imguOutputBufferReady);
+	imgu->viewfinder_->bufferReady.connect(data,
+					       &IPU3CameraData::imguOutputBufferReady);
+	imgu->param_->bufferReady.connect(data,
+					  &IPU3CameraData::paramBufferReady);
+	imgu->stat_->bufferReady.connect(data,
+					 &IPU3CameraData::statBufferReady);
+
+	*iter = data;
+	data->imgu_ = imgu;
+
+	LOG(IPU3, Debug)
+		<< "Assigned ImgU pipe " << index << " to camera "
+		<< data->cio2_.sensor()->id();
+
+	return 0;
+}
+
+void PipelineHandlerIPU3::releaseImgU(IPU3CameraData *data)
+{
+	if (!data->imgu_)
+		return;
+
+	ImgUDevice *imgu = data->imgu_;
+
+	imgu->input_->bufferReady.disconnect(&data->cio2_);
+	imgu->output_->bufferReady.disconnect(data);
+	imgu->viewfinder_->bufferReady.disconnect(data);
+	imgu->param_->bufferReady.disconnect(data);
+	imgu->stat_->bufferReady.disconnect(data);
+
+	imgu->enableLinks(false);
+
+	for (IPU3CameraData *&user : imguUsers_) {
+		if (user == data)
+			user = nullptr;
+	}
+
+	data->imgu_ = nullptr;
+}
+
+/**
+ * \brief Enable the links of the ImgU pipe assigned to a camera
+ * \param[in] data The camera data
+ *
+ * Enabled links in one ImgU pipe interfere with capture operations on the
+ * other one. This function disables the links of the other pipe if it isn't
+ * streaming, and enables the links of the pipe assigned to the camera. The
+ * links of a streaming pipe are never touched, to let two cameras capture
+ * concurrently.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int PipelineHandlerIPU3::isolateImgU(IPU3CameraData *data)
+{
+	int ret;
+
+	for (unsigned int i = 0; i < imguUsers_.size(); ++i) {
+		IPU3CameraData *user = imguUsers_[i];
+		if (user == data || (user && user->streaming_))
+			continue;
+
+		ret = imgu(i)->enableLinks(false);
+		if (ret)
+			return ret;
+	}
+
+	return data->imgu_->enableLinks(true);
 }
 
 void IPU3CameraData::cancelPendingRequests()
@@ -1052,7 +1205,7 @@ int PipelineHandlerIPU3::registerCameras()
 	 * in a compatible format.
 	 */
 	unsigned int numCameras = 0;
-	for (unsigned int id = 0; id < 4 && numCameras < 2; ++id) {
+	for (unsigned int id = 0; id < 4; ++id) {
 		std::unique_ptr<IPU3CameraData> data =
 			std::make_unique<IPU3CameraData>(this);
 		std::set<Stream *> streams = {
@@ -1100,36 +1253,17 @@ int PipelineHandlerIPU3::registerCameras()
 					   << cio2->sensor()->id()
 					   << ". Assume rotation 0";
 
-		/**
-		 * \todo Dynamically assign ImgU and output devices to each
-		 * stream and camera; as of now, limit support to two cameras
-		 * only, and assign imgu0 to the first one and imgu1 to the
-		 * second.
-		 */
-		data->imgu_ = numCameras ? &imgu1_ : &imgu0_;
-
 		/*
-		 * Connect video devices' 'bufferReady' signals to their
-		 * slot to implement the image processing pipeline.
-		 *
-		 * Frames produced by the CIO2 unit are passed to the
-		 * associated ImgU input where they get processed and
-		 * returned through the ImgU main and secondary outputs.
+		 * Connect the CIO2 'bufferReady' signal to its slot. The ImgU
+		 * signals are connected when an ImgU pipe gets assigned to
+		 * the camera at configure time.
 		 */
 		data->cio2_.bufferReady().connect(data.get(),
 					&IPU3CameraData::cio2BufferReady);
 		data->cio2_.bufferAvailable.connect(
 			data.get(), &IPU3CameraData::queuePendingRequests);
-		data->imgu_->input_->bufferReady.connect(&data->cio2_,
-					&CIO2Device::tryReturnBuffer);
-		data->imgu_->output_->bufferReady.connect(data.get(),
-					&IPU3CameraData::imguOutputBufferReady);
-		data->imgu_->viewfinder_->bufferReady.connect(data.get(),
-					&IPU3CameraData::imguOutputBufferReady);
-		data->imgu_->param_->bufferReady.connect(data.get(),
-					&IPU3CameraData::paramBufferReady);
-		data->imgu_->stat_->bufferReady.connect(data.get(),
-					&IPU3CameraData::statBufferReady);
+		data->frameInfos_.bufferAvailable.connect(
+			data.get(), &IPU3CameraData::queuePendingRequests);
 
 		/* Create and register the Camera instance. */
 		const std::string &cameraId = cio2->sensor()->id();
@@ -1025,7 +1025,10 @@ bool PipelineHandlerMaliC55::match(DeviceEnumerator *enumerator)
 	 * MEDIA_ENT_F_VID_IF_BRIDGE - A CSI-2 receiver
 	 * MEDIA_ENT_F_IO_V4L - An input device
 	 *
-	 * The last one will be unsupported for now. The TPG is relatively easy,
+	 * The last one will be unsupported for now. Feeding frames from memory
+	 * to the ISP would enable offline reprocessing of RAW frames, but it
+	 * requires an input stream concept in the libcamera API, which only
+	 * models capture streams today. The TPG is relatively easy,
 	 * we just register a Camera for it. If we have a CSI-2 receiver we need
 	 * to check its sink pad and register Cameras for anything connected to
 	 * it (probably...there are some complex situations in which that might
@@ -1050,7 +1053,13 @@ bool PipelineHandlerMaliC55::match(DeviceEnumerator *enumerator)
 
 			break;
 		case MEDIA_ENT_F_IO_V4L:
-			LOG(MaliC55, Warning) << "Memory input not yet supported";
+			/*
+			 * \todo Support reprocessing of application-provided
+			 * RAW buffers through the memory input.
+			 */
+			LOG(MaliC55, Warning)
+				<< "Memory input " << link->source()->entity()->name()
+				<< " not yet supported";
 			break;
 		default:
 			LOG(MaliC55, Error) << "Unsupported entity function";
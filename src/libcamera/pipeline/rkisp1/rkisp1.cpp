@@ -110,7 +110,7 @@ public:
 	std::unique_ptr<ipa::rkisp1::IPAProxyRkISP1> ipa_;
 
 private:
-	void paramFilled(unsigned int frame);
+	void paramFilled(unsigned int frame, unsigned int bytesused);
 	void setSensorControls(unsigned int frame,
 			       const ControlList &sensorControls);
 
@@ -156,11 +156,16 @@ public:
 
 	int start(Camera *camera, const ControlList *controls) override;
 	void stopDevice(Camera *camera) override;
+	void releaseDevice(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
 
 	bool match(DeviceEnumerator *enumerator) override;
 
+protected:
+	void statisticsDevice(Camera *camera,
+			      std::map<std::string, uint64_t> *counters) override;
+
 private:
 	static constexpr Size kRkISP1PreviewSize = { 1920, 1080 };
 
@@ -200,6 +205,13 @@ private:
 	std::vector<std::unique_ptr<FrameBuffer>> statBuffers_;
 	std::queue<FrameBuffer *> availableParamBuffers_;
 	std::queue<FrameBuffer *> availableStatBuffers_;
+	/*
+	 * Internal buffers are kept across stop() and start() cycles, and
+	 * across configure() when the new configuration doesn't affect them.
+	 */
+	bool buffersAllocated_;
+	unsigned int bufferCount_;
+	V4L2PixelFormat paramFormat_;
 
 	Camera *activeCamera_;
 
@@ -262,8 +274,10 @@ int RkISP1Frames::destroy(unsigned int frame)
 	if (!info)
 		return -ENOENT;
 
-	pipe_->availableParamBuffers_.push(info->paramBuffer);
-	pipe_->availableStatBuffers_.push(info->statBuffer);
+	if (info->paramBuffer) {
+		pipe_->availableParamBuffers_.push(info->paramBuffer);
+		pipe_->availableStatBuffers_.push(info->statBuffer);
+	}
 
 	frameInfo_.erase(info->frame);
 
@@ -277,8 +291,10 @@ void RkISP1Frames::clear()
 	for (const auto &entry : frameInfo_) {
 		RkISP1FrameInfo *info = entry.second;
 
-		pipe_->availableParamBuffers_.push(info->paramBuffer);
-		pipe_->availableStatBuffers_.push(info->statBuffer);
+		if (info->paramBuffer) {
+			pipe_->availableParamBuffers_.push(info->paramBuffer);
+			pipe_->availableStatBuffers_.push(info->statBuffer);
+		}
 
 		delete info;
 	}
@@ -379,15 +395,14 @@ int RkISP1CameraData::loadIPA(unsigned int hwRevision)
 	return 0;
 }
 
-void RkISP1CameraData::paramFilled(unsigned int frame)
+void RkISP1CameraData::paramFilled(unsigned int frame, unsigned int bytesused)
 {
 	PipelineHandlerRkISP1 *pipe = RkISP1CameraData::pipe();
 	RkISP1FrameInfo *info = frameInfo_.find(frame);
 	if (!info)
 		return;
 
-	info->paramBuffer->_d()->metadata().planes()[0].bytesused =
-		sizeof(struct rkisp1_params_cfg);
+	info->paramBuffer->_d()->metadata().planes()[0].bytesused = bytesused;
 	pipe->param_->queueBuffer(info->paramBuffer);
 	pipe->stat_->queueBuffer(info->statBuffer);
 
@@ -489,11 +504,24 @@ CameraConfiguration::Status RkISP1CameraConfiguration::validate()
 	/*
 	 * Simultaneous capture of raw and processed streams isn't possible. If
 	 * there is any raw stream, cap the number of streams to one.
+	 *
+	 * The main and self paths are both fed by the single ISP source pad,
+	 * whose format selects between processing and bypassing the ISP. Raw
+	 * capture configures the ISP in bypass mode, which leaves no processed
+	 * output for the other path, and none of the supported ISP versions
+	 * has a separate raw tap.
+	 *
+	 * \todo Support concurrent raw and processed capture, matching the
+	 * buffers by sequence number, once a platform exposes a raw output
+	 * independent of the ISP source pad.
 	 */
 	if (config_.size() > 1) {
 		for (const auto &cfg : config_) {
 			if (PixelFormatInfo::info(cfg.pixelFormat).colourEncoding ==
 			    PixelFormatInfo::ColourEncodingRAW) {
+				LOG(RkISP1, Debug)
+					<< "Raw capture bypasses the ISP, "
+					<< "dropping processed streams";
 				config_.resize(1);
 				status = Adjusted;
 				break;
@@ -603,7 +631,8 @@ CameraConfiguration::Status RkISP1CameraConfiguration::validate()
  */
 
 PipelineHandlerRkISP1::PipelineHandlerRkISP1(CameraManager *manager)
-	: PipelineHandler(manager), hasSelfPath_(true)
+	: PipelineHandler(manager), hasSelfPath_(true), buffersAllocated_(false),
+	  bufferCount_(0)
 {
 }
 
@@ -666,7 +695,8 @@ PipelineHandlerRkISP1::generateConfiguration(Camera *camera,
 		case StreamRole::Raw:
 			if (roles.size() > 1) {
 				LOG(RkISP1, Error)
-					<< "Can't capture both raw and processed streams";
+					<< "Can't capture both raw and processed streams, "
+					<< "raw capture bypasses the ISP";
 				return nullptr;
 			}
 
@@ -719,6 +749,26 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 	CameraSensor *sensor = data->sensor_.get();
 	int ret;
 
+	/*
+	 * The parameters and statistics buffers don't depend on the sensor
+	 * mode or the stream sizes, only on their number and on whether the
+	 * ISP is bypassed. Keep them when switching between configurations
+	 * that only differ in resolution or format, to avoid reallocating
+	 * and mapping them again in the IPA.
+	 */
+	if (buffersAllocated_) {
+		const PixelFormatInfo &info =
+			PixelFormatInfo::info(config->at(0).pixelFormat);
+		bool raw = info.colourEncoding == PixelFormatInfo::ColourEncodingRAW;
+		unsigned int count = 0;
+
+		for (const StreamConfiguration &cfg : *config)
+			count = std::max(count, cfg.bufferCount);
+
+		if (raw != isRaw_ || count != bufferCount_)
+			freeBuffers(camera);
+	}
+
 	ret = initLinks(camera, sensor, *config);
 	if (ret)
 		return ret;
@@ -799,17 +849,41 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 			return ret;
 	}
 
-	V4L2DeviceFormat paramFormat;
-	paramFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_PARAMS);
-	ret = param_->setFormat(&paramFormat);
-	if (ret)
-		return ret;
+	/*
+	 * The metadata formats can't be changed while buffers are allocated,
+	 * and never change between configurations. Only set them when the
+	 * buffers have been released.
+	 */
+	if (!buffersAllocated_) {
+		/*
+		 * Use the extensible parameters format when the driver
+		 * supports it, it allows the IPA to only write the blocks that
+		 * change. Drivers that don't support it return the fixed
+		 * format.
+		 */
+		V4L2DeviceFormat paramFormat;
+		paramFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_EXT_PARAMS);
+		ret = param_->setFormat(&paramFormat);
+		if (ret)
+			return ret;
 
-	V4L2DeviceFormat statFormat;
-	statFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_STAT_3A);
-	ret = stat_->setFormat(&statFormat);
-	if (ret)
-		return ret;
+		if (paramFormat.fourcc != V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_EXT_PARAMS)) {
+			paramFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_PARAMS);
+			ret = param_->setFormat(&paramFormat);
+			if (ret)
+				return ret;
+		}
+
+		paramFormat_ = paramFormat.fourcc;
+
+		LOG(RkISP1, Debug) << "Using parameters format " << paramFormat_;
+
+		V4L2DeviceFormat statFormat;
+		statFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_STAT_3A);
+		ret = stat_->setFormat(&statFormat);
+		if (ret)
+			return ret;
+	}
 
 	/* Inform IPA of stream configuration and sensor controls. */
 	ipa::rkisp1::IPAConfigInfo ipaConfig{};
@@ -819,6 +893,7 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 		return ret;
 
 	ipaConfig.sensorControls = data->sensor_->controls();
+	ipaConfig.paramFormat = paramFormat_.fourcc();
 
 	ret = data->ipa_->configure(ipaConfig, streamConfig, &data->controlInfo_);
 	if (ret) {
@@ -878,6 +953,8 @@ int PipelineHandlerRkISP1::allocateBuffers(Camera *camera)
 	}
 
 	data->ipa_->mapBuffers(data->ipaBuffers_);
+	buffersAllocated_ = true;
+	bufferCount_ = maxCount;
 
 	return 0;
 
@@ -914,6 +991,8 @@ int PipelineHandlerRkISP1::freeBuffers(Camera *camera)
 	if (stat_->releaseBuffers())
 		LOG(RkISP1, Error) << "Failed to release stat buffers";
 
+	buffersAllocated_ = false;
+
 	return 0;
 }
 
@@ -922,10 +1001,15 @@ int PipelineHandlerRkISP1::start(Camera *camera, [[maybe_unused]] const ControlL
 	RkISP1CameraData *data = cameraData(camera);
 	int ret;
 
-	/* Allocate buffers for internal pipeline usage. */
-	ret = allocateBuffers(camera);
-	if (ret)
-		return ret;
+	/*
+	 * Allocate buffers for internal pipeline usage, unless they have been
+	 * kept from a previous capture session with the same configuration.
+	 */
+	if (!buffersAllocated_) {
+		ret = allocateBuffers(camera);
+		if (ret)
+			return ret;
+	}
 
 	ret = data->ipa_->start();
 	if (ret) {
@@ -1015,11 +1099,25 @@ void PipelineHandlerRkISP1::stopDevice(Camera *camera)
 	ASSERT(data->queuedRequests_.empty());
 	data->frameInfo_.clear();
 
-	freeBuffers(camera);
-
 	activeCamera_ = nullptr;
 }
 
+void PipelineHandlerRkISP1::releaseDevice(Camera *camera)
+{
+	if (buffersAllocated_)
+		freeBuffers(camera);
+}
+
+void PipelineHandlerRkISP1::statisticsDevice(Camera *camera,
+					     std::map<std::string, uint64_t> *counters)
+{
+	RkISP1CameraData *data = cameraData(camera);
+
+	addStatistics(counters, "ipa", data->ipa_.get());
+	addStatistics(counters, "param", param_.get());
+	addStatistics(counters, "stat", stat_.get());
+}
+
 int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera, Request *request)
 {
 	RkISP1CameraData *data = cameraData(camera);
@@ -1177,6 +1275,16 @@ bool PipelineHandlerRkISP1::match(DeviceEnumerator *enumerator)
 	if (isp_->open() < 0)
 		return false;
 
+	/*
+	 * The frame start events are only consumed by DelayedControls, which
+	 * is thread-safe. Optionally handle them in a dedicated real-time
+	 * thread to apply the sensor controls without depending on the load of
+	 * the pipeline handler thread.
+	 */
+	const char *frameStartThread = utils::secure_getenv("LIBCAMERA_FRAME_START_THREAD");
+	if (frameStartThread && *frameStartThread != '\0')
+		isp_->setFrameStartThreadEnabled(true);
+
 	/* Locate and open the optional CSI-2 receiver. */
 	ispSink_ = isp_->entity()->getPadByIndex(0);
 	if (!ispSink_ || ispSink_->links().empty())
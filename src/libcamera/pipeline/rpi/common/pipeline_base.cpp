@@ -7,7 +7,9 @@
 
 #include "pipeline_base.h"
 
+#include <algorithm>
 #include <chrono>
+#include <string.h>
 #include <sys/stat.h>
 
 #include <linux/media-bus-format.h>
@@ -22,6 +24,7 @@
 
 #include "libcamera/internal/camera_lens.h"
 #include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 
 using namespace std::chrono_literals;
@@ -722,6 +725,8 @@ void PipelineHandlerBase::stopDevice(Camera *camera)
 	data->state_ = CameraData::State::Stopped;
 	data->platformStop();
 
+	data->clearZslFrames();
+
 	for (auto const stream : data->streams_)
 		stream->dev()->streamOff();
 
@@ -765,6 +770,15 @@ int PipelineHandlerBase::queueRequestDevice(Camera *camera, Request *request)
 			stream->setExportedBuffer(buffer);
 		}
 
+		/*
+		 * A RAW buffer filled from a retained frame is completed
+		 * straight away. An internal buffer is still queued to keep one
+		 * frame per request flowing through the pipeline.
+		 */
+		if (buffer && stream == data->zslStream_ &&
+		    data->completeZslBuffer(request, buffer))
+			buffer = nullptr;
+
 		/*
 		 * If no buffer is provided by the request for this stream, we
 		 * queue a nullptr to the stream to signify that it must use an
@@ -782,7 +796,7 @@ int PipelineHandlerBase::queueRequestDevice(Camera *camera, Request *request)
 	}
 
 	/* Push the request to the back of the queue. */
-	data->requestQueue_.push(request);
+	data->requestQueue_.push_back(request);
 	data->handleState();
 
 	return 0;
@@ -824,13 +838,13 @@ int PipelineHandlerBase::registerCamera(std::unique_ptr<RPi::CameraData> &camera
 	 * Setup our delayed control writer with the sensor default
 	 * gain and exposure delays. Mark VBLANK for priority write.
 	 */
-	std::unordered_map<uint32_t, RPi::DelayedControls::ControlParams> params = {
+	std::unordered_map<uint32_t, DelayedControls::ControlParams> params = {
 		{ V4L2_CID_ANALOGUE_GAIN, { result.sensorConfig.gainDelay, false } },
 		{ V4L2_CID_EXPOSURE, { result.sensorConfig.exposureDelay, false } },
 		{ V4L2_CID_HBLANK, { result.sensorConfig.hblankDelay, false } },
 		{ V4L2_CID_VBLANK, { result.sensorConfig.vblankDelay, true } }
 	};
-	data->delayedCtrls_ = std::make_unique<RPi::DelayedControls>(data->sensor_->device(), params);
+	data->delayedCtrls_ = std::make_unique<DelayedControls>(data->sensor_->device(), params);
 	data->sensorMetadata_ = result.sensorConfig.sensorMetadata;
 
 	/* Register initial controls that the Raspberry Pi IPA can handle. */
@@ -1002,6 +1016,8 @@ void CameraData::freeBuffers()
 		bufferIds_.clear();
 	}
 
+	clearZslFrames();
+
 	for (auto const stream : streams_)
 		stream->releaseBuffers();
 
@@ -1108,6 +1124,8 @@ int CameraData::loadPipelineConfiguration()
 	config_ = {
 		.disableStartupFrameDrops = false,
 		.cameraTimeoutValue = 0,
+		.internalBufferBudget = 0,
+		.zslFrames = 0,
 	};
 
 	/* Initial configuration of the platform, in case no config file is present */
@@ -1128,7 +1146,7 @@ int CameraData::loadPipelineConfiguration()
 
 	LOG(RPI, Info) << "Using configuration file '" << filename << "'";
 
-	std::unique_ptr<YamlObject> root = YamlParser::parse(file);
+	std::shared_ptr<const YamlObject> root = YamlParser::parseCached(file);
 	if (!root) {
 		LOG(RPI, Warning) << "Failed to parse configuration file, using defaults";
 		return 0;
@@ -1149,6 +1167,12 @@ int CameraData::loadPipelineConfiguration()
 	config_.cameraTimeoutValue =
 		phConfig["camera_timeout_value_ms"].get<unsigned int>(config_.cameraTimeoutValue);
 
+	config_.internalBufferBudget =
+		phConfig["internal_buffer_budget_mb"].get<unsigned int>(config_.internalBufferBudget);
+
+	config_.zslFrames =
+		phConfig["zsl_frames"].get<unsigned int>(config_.zslFrames);
+
 	if (config_.cameraTimeoutValue) {
 		/* Disable the IPA signal to control timeout and set the user requested value. */
 		ipa_->setCameraTimeout.disconnect();
@@ -1257,9 +1281,12 @@ void CameraData::metadataReady(const ControlList &metadata)
 	if (!isRunning())
 		return;
 
-	/* Add to the Request metadata buffer what the IPA has provided. */
-	/* Last thing to do is to fill up the request metadata. */
-	Request *request = requestQueue_.front();
+	/*
+	 * Add to the Request metadata buffer what the IPA has provided. The
+	 * metadata belongs to the request being processed by the IPA, which
+	 * follows the requests already handed to the ISP.
+	 */
+	Request *request = requestQueue_.at(ispRequests_);
 	request->metadata().merge(metadata);
 
 	/*
@@ -1429,8 +1456,67 @@ void CameraData::clearIncompleteRequests()
 		}
 
 		pipe()->completeRequest(request);
-		requestQueue_.pop();
+		requestQueue_.pop_front();
+	}
+
+	ispRequests_ = 0;
+}
+
+/*
+ * Fill the RAW buffer of a request with the retained frame closest to the
+ * requested ZslTimestamp, and complete it. Return false if the request doesn't
+ * ask for a zero shutter lag capture or no frame can be used, in which case the
+ * buffer is captured as usual.
+ */
+bool CameraData::completeZslBuffer(Request *request, FrameBuffer *buffer)
+{
+	const auto timestamp = request->controls().get(controls::draft::ZslTimestamp);
+	if (!timestamp || zslFrames_.empty())
+		return false;
+
+	const uint64_t target = std::max<int64_t>(*timestamp, 0);
+	const auto distance = [target](const FrameBuffer *b) {
+		uint64_t ts = b->metadata().timestamp;
+		return ts > target ? ts - target : target - ts;
+	};
+
+	FrameBuffer *frame =
+		*std::min_element(zslFrames_.begin(), zslFrames_.end(),
+				  [&](const FrameBuffer *a, const FrameBuffer *b) {
+					  return distance(a) < distance(b);
+				  });
+
+	MappedFrameBuffer src(frame, MappedFrameBuffer::MapFlag::Read);
+	MappedFrameBuffer dst(buffer, MappedFrameBuffer::MapFlag::Write);
+	if (!src.isValid() || !dst.isValid() ||
+	    src.planes().size() != dst.planes().size()) {
+		LOG(RPI, Error) << "Failed to map buffers for ZSL capture";
+		return false;
+	}
+
+	for (unsigned int i = 0; i < src.planes().size(); i++) {
+		Span<uint8_t> in = src.planes()[i];
+		Span<uint8_t> out = dst.planes()[i];
+		memcpy(out.data(), in.data(), std::min(in.size(), out.size()));
 	}
+
+	buffer->_d()->metadata() = frame->metadata();
+
+	LOG(RPI, Debug) << "ZSL capture of frame " << frame->metadata().sequence
+			<< ", timestamp " << frame->metadata().timestamp;
+
+	pipe()->completeBuffer(request, buffer);
+
+	return true;
+}
+
+void CameraData::clearZslFrames()
+{
+	/*
+	 * The retained buffers are made available again by Stream::resetBuffers()
+	 * when the camera is restarted.
+	 */
+	zslFrames_.clear();
 }
 
 void CameraData::handleStreamBuffer(FrameBuffer *buffer, RPi::Stream *stream)
@@ -1438,10 +1524,20 @@ void CameraData::handleStreamBuffer(FrameBuffer *buffer, RPi::Stream *stream)
 	/*
 	 * It is possible to be here without a pending request, so check
 	 * that we actually have one to action, otherwise we just return
-	 * buffer back to the stream.
+	 * buffer back to the stream. When requests are being processed by the
+	 * ISP ahead of the IPA, the buffer may belong to any of them.
 	 */
-	Request *request = requestQueue_.empty() ? nullptr : requestQueue_.front();
-	if (!dropFrameCount_ && request && request->findBuffer(stream) == buffer) {
+	Request *request = nullptr;
+	unsigned int count = std::min<std::size_t>(std::max(ispRequests_, 1u),
+						   requestQueue_.size());
+	for (unsigned int i = 0; i < count; ++i) {
+		if (requestQueue_[i]->findBuffer(stream) == buffer) {
+			request = requestQueue_[i];
+			break;
+		}
+	}
+
+	if (!dropFrameCount_ && request) {
 		/*
 		 * Tag the buffer as completed, returning it to the
 		 * application.
@@ -1449,6 +1545,16 @@ void CameraData::handleStreamBuffer(FrameBuffer *buffer, RPi::Stream *stream)
 		LOG(RPI, Debug) << "Completing request buffer for stream "
 				<< stream->name();
 		pipe()->completeBuffer(request, buffer);
+	} else if (stream == zslStream_ && zslCapacity_ && !dropFrameCount_) {
+		/*
+		 * Retain the most recent RAW frames for zero shutter lag
+		 * capture, recycling the oldest one.
+		 */
+		zslFrames_.push_back(buffer);
+		if (zslFrames_.size() > zslCapacity_) {
+			stream->returnBuffer(zslFrames_.front());
+			zslFrames_.pop_front();
+		}
 	} else {
 		/*
 		 * This buffer was not part of the Request (which happens if an
@@ -1464,6 +1570,13 @@ void CameraData::handleStreamBuffer(FrameBuffer *buffer, RPi::Stream *stream)
 
 void CameraData::handleState()
 {
+	/*
+	 * Requests handed to the ISP ahead of the IPA complete independently
+	 * of the IPA state.
+	 */
+	if (ispRequests_)
+		checkIspRequestsCompleted();
+
 	switch (state_) {
 	case State::Stopped:
 	case State::Busy:
@@ -1505,7 +1618,7 @@ void CameraData::checkRequestCompleted()
 				<< request->sequence();
 
 		pipe()->completeRequest(request);
-		requestQueue_.pop();
+		requestQueue_.pop_front();
 		requestCompleted = true;
 	}
 
@@ -1526,6 +1639,97 @@ void CameraData::checkRequestCompleted()
 	}
 }
 
+/*
+ * Reduce the number of internal buffers allocated for the RAW stream to fit
+ * the internal buffer memory budget, if one is configured. The buffer counts
+ * of the other streams are required for the pipeline to operate and are left
+ * untouched, and the RAW buffer count is never reduced below minRawBuffers.
+ *
+ * The RAW buffers requested for zero shutter lag capture are added before
+ * applying the budget, and the number of frames retained is limited to the
+ * buffers left over the minimum.
+ */
+void CameraData::applyBufferBudget(BufferAllocations &allocations,
+				   Stream *rawStream, unsigned int minRawBuffers)
+{
+	const uint64_t budget = static_cast<uint64_t>(config_.internalBufferBudget) << 20;
+	unsigned int *rawCount = nullptr;
+	uint64_t rawSize = 0;
+	uint64_t fixedSize = 0;
+
+	for (auto &[stream, count] : allocations) {
+		if (stream->getFlags() & StreamFlag::ImportOnly)
+			continue;
+
+		V4L2DeviceFormat format;
+		if (stream->dev()->getFormat(&format))
+			continue;
+
+		uint64_t size = 0;
+		for (unsigned int i = 0; i < format.planesCount; i++)
+			size += format.planes[i].size;
+
+		if (stream == rawStream) {
+			count += config_.zslFrames;
+			rawCount = &count;
+			rawSize = size;
+		} else {
+			fixedSize += size * count;
+		}
+	}
+
+	if (budget && rawCount && rawSize &&
+	    fixedSize + rawSize * *rawCount > budget) {
+		uint64_t available = budget > fixedSize ? budget - fixedSize : 0;
+		unsigned int count = std::min<uint64_t>(available / rawSize, *rawCount);
+
+		*rawCount = std::max(count, std::min(minRawBuffers, *rawCount));
+
+		LOG(RPI, Debug)
+			<< "Reducing " << rawStream->name() << " buffers to "
+			<< *rawCount << " to fit the internal buffer budget";
+	}
+
+	zslStream_ = rawStream;
+	zslCapacity_ = 0;
+	if (rawCount) {
+		unsigned int reserved = std::min(std::max(minRawBuffers, 1U), *rawCount);
+		zslCapacity_ = std::min(config_.zslFrames, *rawCount - reserved);
+	}
+
+	uint64_t total = fixedSize + (rawCount ? rawSize * *rawCount : 0);
+
+	if (budget && total > budget)
+		LOG(RPI, Warning)
+			<< "Internal buffers require " << (total >> 20)
+			<< " MiB, exceeding the " << config_.internalBufferBudget
+			<< " MiB budget";
+	else
+		LOG(RPI, Info)
+			<< "Allocating " << (total >> 20) << " MiB of internal buffers"
+			<< (rawCount ? ", " + std::to_string(*rawCount) + " RAW" : "");
+}
+
+void CameraData::checkIspRequestsCompleted()
+{
+	/*
+	 * The metadata of these requests has been filled by the IPA already,
+	 * complete them in order as soon as all their buffers are done.
+	 */
+	while (ispRequests_) {
+		Request *request = requestQueue_.front();
+		if (request->hasPendingBuffers())
+			return;
+
+		LOG(RPI, Debug) << "Completing request sequence: "
+				<< request->sequence();
+
+		pipe()->completeRequest(request);
+		requestQueue_.pop_front();
+		ispRequests_--;
+	}
+}
+
 void CameraData::fillRequestMetadata(const ControlList &bufferControls, Request *request)
 {
 	request->metadata().set(controls::SensorTimestamp,
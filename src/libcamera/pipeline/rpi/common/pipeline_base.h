@@ -5,6 +5,7 @@
  * Pipeline handler base class for Raspberry Pi devices
  */
 
+#include <deque>
 #include <map>
 #include <memory>
 #include <optional>
@@ -20,6 +21,7 @@
 #include "libcamera/internal/bayer_format.h"
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
@@ -30,7 +32,6 @@
 #include <libcamera/ipa/raspberrypi_ipa_interface.h>
 #include <libcamera/ipa/raspberrypi_ipa_proxy.h>
 
-#include "delayed_controls.h"
 #include "rpi_stream.h"
 
 using namespace std::chrono_literals;
@@ -48,7 +49,8 @@ class CameraData : public Camera::Private
 public:
 	CameraData(PipelineHandler *pipe)
 		: Camera::Private(pipe), state_(State::Stopped),
-		  dropFrameCount_(0), buffersAllocated_(false),
+		  ispRequests_(0), dropFrameCount_(0), buffersAllocated_(false),
+		  zslStream_(nullptr), zslCapacity_(0),
 		  ispOutputCount_(0), ispOutputTotal_(0)
 	{
 	}
@@ -68,6 +70,10 @@ public:
 	void freeBuffers();
 	virtual void platformFreeBuffers() = 0;
 
+	using BufferAllocations = std::vector<std::pair<Stream *, unsigned int>>;
+	void applyBufferBudget(BufferAllocations &allocations, Stream *rawStream,
+			       unsigned int minRawBuffers);
+
 	void enumerateVideoDevices(MediaLink *link, const std::string &frontend);
 
 	int loadPipelineConfiguration();
@@ -89,6 +95,8 @@ public:
 	void frameStarted(uint32_t sequence);
 
 	void clearIncompleteRequests();
+	bool completeZslBuffer(Request *request, FrameBuffer *buffer);
+	void clearZslFrames();
 	void handleStreamBuffer(FrameBuffer *buffer, Stream *stream);
 	void handleState();
 
@@ -96,7 +104,7 @@ public:
 	virtual V4L2VideoDevice::Formats rawFormats() const = 0;
 	virtual V4L2VideoDevice *frontendDevice() = 0;
 
-	virtual int platformPipelineConfigure(const std::unique_ptr<YamlObject> &root) = 0;
+	virtual int platformPipelineConfigure(const std::shared_ptr<const YamlObject> &root) = 0;
 
 	std::unique_ptr<ipa::RPi::IPAProxyRPi> ipa_;
 
@@ -129,7 +137,14 @@ public:
 		return state_ != State::Stopped && state_ != State::Error;
 	}
 
-	std::queue<Request *> requestQueue_;
+	std::deque<Request *> requestQueue_;
+	/*
+	 * Number of requests at the front of requestQueue_ that have been
+	 * completed by the IPA and are being processed by the ISP while the
+	 * IPA works on the next request. This is always zero for pipeline
+	 * handlers that process one request at a time.
+	 */
+	unsigned int ispRequests_;
 
 	/* For handling digital zoom. */
 	IPACameraSensorInfo sensorInfo_;
@@ -148,6 +163,14 @@ public:
 	/* Have internal buffers been allocated? */
 	bool buffersAllocated_;
 
+	/*
+	 * The most recent RAW frames retained for zero shutter lag capture,
+	 * oldest first, and the maximum number of frames to retain.
+	 */
+	Stream *zslStream_;
+	std::deque<FrameBuffer *> zslFrames_;
+	unsigned int zslCapacity_;
+
 	struct Config {
 		/*
 		 * Override any request from the IPA to drop a number of startup
@@ -159,6 +182,16 @@ public:
 		 * on frame durations.
 		 */
 		unsigned int cameraTimeoutValue;
+		/*
+		 * Maximum memory, in MiB, used by the internal buffers of the
+		 * camera. 0 for no limit.
+		 */
+		unsigned int internalBufferBudget;
+		/*
+		 * Number of additional RAW buffers allocated to retain the
+		 * most recent frames for zero shutter lag capture.
+		 */
+		unsigned int zslFrames;
 	};
 
 	Config config_;
@@ -174,6 +207,7 @@ protected:
 
 private:
 	void checkRequestCompleted();
+	void checkIspRequestsCompleted();
 };
 
 class PipelineHandlerBase : public PipelineHandler
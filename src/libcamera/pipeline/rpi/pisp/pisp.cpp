@@ -718,7 +718,7 @@ public:
 	CameraConfiguration::Status
 	platformValidate(RPi::RPiCameraConfiguration *rpiConfig) const override;
 
-	int platformPipelineConfigure(const std::unique_ptr<YamlObject> &root) override;
+	int platformPipelineConfigure(const std::shared_ptr<const YamlObject> &root) override;
 
 	void platformStart() override;
 	void platformStop() override;
@@ -736,6 +736,9 @@ public:
 	RPi::Device<Cfe, 4> cfe_;
 	RPi::Device<Isp, 8> isp_;
 
+	/* Maximum number of requests queued to the Backend. */
+	static constexpr unsigned int kMaxIspRequests = 2;
+
 	const libpisp::PiSPVariant &pispVariant_;
 
 	/* Frontend/Backend objects shared with the IPA. */
@@ -796,6 +799,20 @@ private:
 
 	void tryRunPipeline() override;
 
+	/*
+	 * Run the IPA on the next request while the Backend processes the
+	 * previous one. The Backend configuration is stored in a per-frame
+	 * config buffer, the IPA can thus prepare the configuration for a
+	 * frame without affecting the frames already queued to the Backend.
+	 * Lookahead is disabled while frames are being dropped, as dropped
+	 * frames are tracked through the Backend output count of a single
+	 * frame.
+	 */
+	bool lookaheadEnabled() const
+	{
+		return beEnabled_ && !dropFrameCount_;
+	}
+
 	struct CfeJob {
 		ControlList sensorControls;
 		unsigned int delayContext;
@@ -936,6 +953,7 @@ bool PipelineHandlerPiSP::match(DeviceEnumerator *enumerator)
 int PipelineHandlerPiSP::prepareBuffers(Camera *camera)
 {
 	PiSPCameraData *data = cameraData(camera);
+	RPi::CameraData::BufferAllocations allocations;
 	unsigned int numRawBuffers = 0;
 	int ret;
 
@@ -982,6 +1000,13 @@ int PipelineHandlerPiSP::prepareBuffers(Camera *camera)
 		} else if (!data->beEnabled_) {
 			/* Backend not enabled, we don't need to allocate buffers. */
 			numBuffers = 0;
+		} else if (stream == &data->isp_[Isp::Config]) {
+			/*
+			 * Allocate one config buffer per request queued to the
+			 * Backend, and a spare one as a request may complete
+			 * before its config buffer gets dequeued.
+			 */
+			numBuffers = PiSPCameraData::kMaxIspRequests + 1;
 		} else if (stream == &data->isp_[Isp::TdnOutput] && data->config_.disableTdn) {
 			/* TDN is explicitly disabled. */
 			continue;
@@ -993,6 +1018,12 @@ int PipelineHandlerPiSP::prepareBuffers(Camera *camera)
 			numBuffers = 2;
 		}
 
+		allocations.emplace_back(stream, numBuffers);
+	}
+
+	data->applyBufferBudget(allocations, &data->cfe_[Cfe::Output0], 2);
+
+	for (auto const &[stream, numBuffers] : allocations) {
 		LOG(RPI, Debug) << "Preparing " << numBuffers
 				<< " buffers for stream " << stream->name();
 
@@ -1307,7 +1338,7 @@ PiSPCameraData::platformValidate(RPi::RPiCameraConfiguration *rpiConfig) const
 	return status;
 }
 
-int PiSPCameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject> &root)
+int PiSPCameraData::platformPipelineConfigure(const std::shared_ptr<const YamlObject> &root)
 {
 	config_ = {
 		.numCfeConfigStatsBuffers = 12,
@@ -1693,7 +1724,9 @@ void PiSPCameraData::cfeBufferDequeue(FrameBuffer *buffer)
 		 * Lookup the sensor controls used for this frame sequence from
 		 * DelayedControl and queue them along with the frame buffer.
 		 */
-		auto [ctrl, delayContext] = delayedCtrls_->get(buffer->metadata().sequence);
+		unsigned int delayContext;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence,
+						      &delayContext);
 		/*
 		 * Add the frame timestamp to the ControlList for the IPA to use
 		 * as it does not receive the FrameBuffer object.
@@ -1832,7 +1865,17 @@ void PiSPCameraData::prepareIspComplete(const ipa::RPi::BufferIds &buffers, bool
 	} else
 		prepareBe(bayerId, stitchSwapBuffers);
 
-	state_ = State::IpaComplete;
+	/*
+	 * With lookahead, the request is handed over to the Backend and the
+	 * IPA is ready to process the next one.
+	 */
+	if (lookaheadEnabled()) {
+		ispRequests_++;
+		state_ = State::Idle;
+	} else {
+		state_ = State::IpaComplete;
+	}
+
 	handleState();
 }
 
@@ -2235,13 +2278,21 @@ void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
 void PiSPCameraData::tryRunPipeline()
 {
 	/* If any of our request or buffer queues are empty, we cannot proceed. */
-	if (state_ != State::Idle || requestQueue_.empty() || !cfeJobComplete())
+	if (state_ != State::Idle || requestQueue_.size() <= ispRequests_ ||
+	    !cfeJobComplete())
+		return;
+
+	/*
+	 * Limit the number of requests queued to the Backend, the IPA waits
+	 * for the oldest one to complete before preparing a third frame.
+	 */
+	if (ispRequests_ && (!lookaheadEnabled() || ispRequests_ >= kMaxIspRequests))
 		return;
 
 	CfeJob &job = cfeJobQueue_.front();
 
-	/* Take the first request from the queue and action the IPA. */
-	Request *request = requestQueue_.front();
+	/* Take the first request not yet processed and action the IPA. */
+	Request *request = requestQueue_[ispRequests_];
 
 	/* See if a new ScalerCrop value needs to be applied. */
 	applyScalerCrop(request->controls());
@@ -2270,7 +2321,7 @@ void PiSPCameraData::tryRunPipeline()
 	params.buffers.bayer = RPi::MaskBayerData | bayerId;
 	params.buffers.stats = RPi::MaskStats | statsId;
 	params.buffers.embedded = 0;
-	params.ipaContext = requestQueue_.front()->sequence();
+	params.ipaContext = request->sequence();
 	params.delayContext = job.delayContext;
 	params.sensorControls = std::move(job.sensorControls);
 	params.requestControls = request->controls();
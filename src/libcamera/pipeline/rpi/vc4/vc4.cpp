@@ -67,7 +67,7 @@ public:
 
 	CameraConfiguration::Status platformValidate(RPi::RPiCameraConfiguration *rpiConfig) const override;
 
-	int platformPipelineConfigure(const std::unique_ptr<YamlObject> &root) override;
+	int platformPipelineConfigure(const std::shared_ptr<const YamlObject> &root) override;
 
 	void platformStart() override;
 	void platformStop() override;
@@ -233,6 +233,7 @@ int PipelineHandlerVc4::prepareBuffers(Camera *camera)
 	unsigned int minTotalUnicamBuffers = data->config_.minTotalUnicamBuffers;
 	unsigned int numRawBuffers = 0, minIspBuffers = 1;
 	unsigned int maxFrameSize = 0;
+	RPi::CameraData::BufferAllocations allocations;
 	int ret;
 
 	if (data->unicam_[Unicam::Image].getFlags() & StreamFlag::External) {
@@ -333,12 +334,19 @@ int PipelineHandlerVc4::prepareBuffers(Camera *camera)
 			LOG(RPI, Debug) << "Other numBuffers " << numBuffers;
 		}
 
-		LOG(RPI, Debug) << "Preparing " << numBuffers
-				<< " buffers for stream " << stream->name();
-
 		if (maxFrameSize > 30000000)
 			numBuffers = 1;
 
+		allocations.emplace_back(stream, numBuffers);
+	}
+
+	data->applyBufferBudget(allocations, &data->unicam_[Unicam::Image],
+				minUnicamBuffers);
+
+	for (auto const &[stream, numBuffers] : allocations) {
+		LOG(RPI, Debug) << "Preparing " << numBuffers
+				<< " buffers for stream " << stream->name();
+
 		ret = stream->prepareBuffers(numBuffers);
 		if (ret < 0)
 			return ret;
@@ -546,7 +554,7 @@ CameraConfiguration::Status Vc4CameraData::platformValidate(RPi::RPiCameraConfig
 	return status;
 }
 
-int Vc4CameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject> &root)
+int Vc4CameraData::platformPipelineConfigure(const std::shared_ptr<const YamlObject> &root)
 {
 	config_ = {
 		.minUnicamBuffers = 2,
@@ -831,7 +839,9 @@ void Vc4CameraData::unicamBufferDequeue(FrameBuffer *buffer)
 		 * Lookup the sensor controls used for this frame sequence from
 		 * DelayedControl and queue them along with the frame buffer.
 		 */
-		auto [ctrl, delayContext] = delayedCtrls_->get(buffer->metadata().sequence);
+		unsigned int delayContext;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence,
+						      &delayContext);
 		/*
 		 * Add the frame timestamp to the ControlList for the IPA to use
 		 * as it does not receive the FrameBuffer object.
@@ -22,6 +22,8 @@
 #include <linux/media-bus-format.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/message.h>
+#include <libcamera/base/thread.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
@@ -32,8 +34,10 @@
 #include "libcamera/internal/camera_sensor.h"
 #include "libcamera/internal/converter.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/software_isp/converter_cpu.h"
 #include "libcamera/internal/software_isp/software_isp.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
@@ -151,7 +155,16 @@ LOG_DEFINE_CATEGORY(SimplePipeline)
  * present, the pipeline handler enumerates, for each pipeline configuration,
  * the pixel formats and sizes that the converter can produce for the output of
  * the capture video node, and stores the information in the outputFormats and
- * outputSizes of the SimpleCameraData::Configuration structure.
+ * outputSizes of the SimpleCameraData::Configuration structure. Platforms
+ * without a converter device fall back to the CPU converter, which offers the
+ * same services in software for the YUV and RGB formats, unless the Software
+ * ISP is enabled.
+ *
+ * When the Software ISP is enabled, it debayers the raw Bayer formats captured
+ * by the video node. If a converter is also present, the raw formats that the
+ * converter can't process are debayered by the Software ISP to an intermediate
+ * buffer, possibly with binning to lower the CPU usage, and the converter then
+ * scales and converts the intermediate frames to the output streams.
  *
  * Concurrent Access to Cameras
  * ----------------------------
@@ -188,7 +201,8 @@ struct SimplePipelineInfo {
 	/*
 	 * Using Software ISP is to be enabled per driver.
 	 *
-	 * The Software ISP can't be used together with the converters.
+	 * When used together with a converter, the Software ISP only
+	 * processes the formats that the converter can't handle.
 	 */
 	bool swIspEnabled;
 };
@@ -261,6 +275,12 @@ public:
 		Size captureSize;
 		std::vector<PixelFormat> outputFormats;
 		SizeRange outputSizes;
+		/*
+		 * The Soft ISP output format and sizes when chaining the Soft
+		 * ISP and the converter, ispFormat is invalid otherwise.
+		 */
+		PixelFormat ispFormat;
+		SizeRange ispSizes;
 	};
 
 	std::vector<Stream> streams_;
@@ -276,21 +296,93 @@ public:
 	std::vector<Configuration> configs_;
 	std::map<PixelFormat, std::vector<const Configuration *>> formats_;
 
+	/*
+	 * A FIFO of the request buffers waiting for conversion. Each entry is
+	 * an array of buffers indexed by stream, with null entries for the
+	 * streams that are not part of the request. The entries are stored in
+	 * a ring allocated at configuration time, which only grows if more
+	 * requests than expected are queued.
+	 */
+	class ConversionQueue
+	{
+	public:
+		ConversionQueue()
+			: capacity_(0), numStreams_(0), head_(0), size_(0),
+			  maxDepth_(0)
+		{
+		}
+
+		void reset(unsigned int capacity, unsigned int numStreams);
+
+		bool empty() const { return size_ == 0; }
+		unsigned int size() const { return size_; }
+		unsigned int maxDepth() const { return maxDepth_; }
+
+		Span<FrameBuffer *> push();
+		Span<FrameBuffer *const> front() const;
+		void pop();
+
+	private:
+		void grow();
+
+		std::vector<FrameBuffer *> buffers_;
+		unsigned int capacity_;
+		unsigned int numStreams_;
+		unsigned int head_;
+		unsigned int size_;
+		unsigned int maxDepth_;
+	};
+
 	std::vector<std::unique_ptr<FrameBuffer>> conversionBuffers_;
-	std::queue<std::map<unsigned int, FrameBuffer *>> conversionQueue_;
+	ConversionQueue conversionQueue_;
 	bool useConversion_;
 
 	std::unique_ptr<Converter> converter_;
 	std::unique_ptr<SoftwareIsp> swIsp_;
 
+	/*
+	 * When the Soft ISP is chained with the converter, it debayers the
+	 * captured frames to the intermediate ispBuffers_, which are then
+	 * handed to the converter with the request buffers held in ispQueue_.
+	 */
+	bool chainedIsp_;
+	std::vector<std::unique_ptr<FrameBuffer>> ispBuffers_;
+	std::queue<FrameBuffer *> availableIspBuffers_;
+	ConversionQueue ispQueue_;
+
+	/*
+	 * When capturing RAW frames without conversion, the Soft ISP still
+	 * gathers their statistics to run the IPA algorithms, and the request
+	 * buffers are completed once they have been processed.
+	 */
+	bool statsOnly_;
+
+	/*
+	 * When the Soft ISP produces the outputs from the captured frames, it
+	 * implements the ScalerCrop control by processing a part of the frame
+	 * only. The crop rectangles are expressed relative to analogCrop_, the
+	 * sensor area captured in frames of captureSize_.
+	 */
+	Rectangle analogCrop_;
+	Size captureSize_;
+	Rectangle scalerCrop_;
+
+	void connectIspOutput();
+	void flushIsp();
+	void ispInputDone(FrameBuffer *buffer);
+	void configureScalerCrop(const Size &captureSize, const Size &outputSize);
+	Rectangle ispCrop(Request *request);
+
 private:
 	void tryPipeline(unsigned int code, const Size &size);
 	static std::vector<const MediaPad *> routedSourcePads(MediaPad *sink);
 
 	void conversionInputDone(FrameBuffer *buffer);
 	void conversionOutputDone(FrameBuffer *buffer);
+	void ispOutputDone(FrameBuffer *buffer);
+	void cancelOutputs(Span<FrameBuffer *const> outputs);
 
-	void ispStatsReady();
+	void ispStatsReady(uint32_t frame, uint32_t bufferId);
 	void setSensorControls(const ControlList &sensorControls);
 };
 
@@ -307,7 +399,9 @@ public:
 	}
 
 	bool needConversion() const { return needConversion_; }
+	const Size &ispSize() const { return ispSize_; }
 	const Transform &combinedTransform() const { return combinedTransform_; }
+	const Transform &ispTransform() const { return ispTransform_; }
 
 private:
 	/*
@@ -320,7 +414,9 @@ private:
 
 	const SimpleCameraData::Configuration *pipeConfig_;
 	bool needConversion_;
+	Size ispSize_;
 	Transform combinedTransform_;
+	Transform ispTransform_;
 };
 
 class SimplePipelineHandler : public PipelineHandler
@@ -344,9 +440,13 @@ public:
 	V4L2Subdevice *subdev(const MediaEntity *entity);
 	MediaDevice *converter() { return converter_; }
 	bool swIspEnabled() const { return swIspEnabled_; }
+	bool lazyProbe() const { return lazyProbe_; }
 
 protected:
 	int queueRequestDevice(Camera *camera, Request *request) override;
+	bool acquireDevice(Camera *camera) override;
+	void statisticsDevice(Camera *camera,
+			      std::map<std::string, uint64_t> *counters) override;
 
 private:
 	static constexpr unsigned int kNumInternalBuffers = 3;
@@ -373,6 +473,7 @@ private:
 
 	MediaDevice *converter_;
 	bool swIspEnabled_;
+	bool lazyProbe_;
 };
 
 /* -----------------------------------------------------------------------------
@@ -382,7 +483,8 @@ private:
 SimpleCameraData::SimpleCameraData(SimplePipelineHandler *pipe,
 				   unsigned int numStreams,
 				   MediaEntity *sensor)
-	: Camera::Private(pipe), streams_(numStreams)
+	: Camera::Private(pipe), streams_(numStreams), chainedIsp_(false),
+	  statsOnly_(false)
 {
 	int ret;
 
@@ -508,25 +610,40 @@ int SimpleCameraData::init()
 	SimplePipelineHandler *pipe = SimpleCameraData::pipe();
 	int ret;
 
-	/* Open the converter, if any. */
+	/*
+	 * Open the converter, if any. Fall back to the CPU converter when the
+	 * platform has no converter device and the Soft ISP isn't enabled.
+	 */
 	MediaDevice *converter = pipe->converter();
 	if (converter) {
 		converter_ = ConverterFactoryBase::create(converter);
-		if (!converter_) {
+		if (!converter_)
 			LOG(SimplePipeline, Warning)
 				<< "Failed to create converter, disabling format conversion";
+	} else if (!pipe->swIspEnabled()) {
+		converter_ = std::make_unique<ConverterCpu>();
+		if (!converter_->isValid()) {
+			LOG(SimplePipeline, Warning)
+				<< "Failed to create CPU converter, disabling format conversion";
 			converter_.reset();
-		} else {
-			converter_->inputBufferReady.connect(this, &SimpleCameraData::conversionInputDone);
-			converter_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+			streams_.resize(1);
 		}
 	}
 
+	if (converter_) {
+		converter_->inputBufferReady.connect(this, &SimpleCameraData::conversionInputDone);
+		converter_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+	}
+
 	/*
-	 * Instantiate Soft ISP if this is enabled for the given driver and no converter is used.
+	 * Instantiate Soft ISP if this is enabled for the given driver. When a
+	 * converter is also used, the Soft ISP debayers the formats that the
+	 * converter can't process, and the converter then scales and converts
+	 * the debayered frames.
 	 */
-	if (!converter_ && pipe->swIspEnabled()) {
-		swIsp_ = std::make_unique<SoftwareIsp>(pipe, sensor_.get());
+	if (pipe->swIspEnabled()) {
+		swIsp_ = std::make_unique<SoftwareIsp>(pipe, sensor_.get(),
+						       pipe->lazyProbe());
 		if (!swIsp_->isValid()) {
 			LOG(SimplePipeline, Warning)
 				<< "Failed to create software ISP, disabling software debayering";
@@ -542,14 +659,18 @@ int SimpleCameraData::init()
 			 * synchronously. Instead, connect the signal to a lambda function
 			 * bound explicitly to the pipe, which is bound to the pipeline
 			 * handler thread. The function then simply forwards the call to
-			 * conversionInputDone().
+			 * ispInputDone().
 			 */
 			swIsp_->inputBufferReady.connect(pipe, [this](FrameBuffer *buffer) {
-				this->conversionInputDone(buffer);
+				this->ispInputDone(buffer);
 			});
-			swIsp_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
 			swIsp_->ispStatsReady.connect(this, &SimpleCameraData::ispStatsReady);
 			swIsp_->setSensorControls.connect(this, &SimpleCameraData::setSensorControls);
+			connectIspOutput();
+
+			/* The Soft ISP may produce a secondary, downscaled output. */
+			if (!converter_)
+				streams_.resize(swIsp_->maxOutputs());
 		}
 	}
 
@@ -643,9 +764,37 @@ void SimpleCameraData::tryPipeline(unsigned int code, const Size &size)
 		config.captureFormat = pixelFormat;
 		config.captureSize = format.size;
 
-		if (converter_) {
+		if (converter_ && swIsp_ && converter_->formats(pixelFormat).empty())
+			config.ispSizes = swIsp_->sizes(pixelFormat, format.size);
+
+		if (!config.ispSizes.max.isNull()) {
+			/*
+			 * The converter can't process the captured format, pick
+			 * the first Soft ISP output format it can convert.
+			 */
+			for (PixelFormat ispFormat : swIsp_->formats(pixelFormat)) {
+				std::vector<PixelFormat> formats = converter_->formats(ispFormat);
+				if (formats.empty())
+					continue;
+
+				config.ispFormat = ispFormat;
+				config.outputFormats = std::move(formats);
+				config.outputSizes = converter_->sizes(config.ispSizes.max);
+				break;
+			}
+
+			if (!config.ispFormat.isValid()) {
+				config.outputFormats = { pixelFormat };
+				config.outputSizes = config.captureSize;
+			}
+		} else if (converter_) {
 			config.outputFormats = converter_->formats(pixelFormat);
 			config.outputSizes = converter_->sizes(format.size);
+			if (config.outputFormats.empty()) {
+				/* Capture the formats the converter can't process as-is. */
+				config.outputFormats = { pixelFormat };
+				config.outputSizes = config.captureSize;
+			}
 		} else if (swIsp_) {
 			config.outputFormats = swIsp_->formats(pixelFormat);
 			config.outputSizes = swIsp_->sizes(pixelFormat, format.size);
@@ -812,16 +961,8 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 		if (conversionQueue_.empty())
 			return;
 
-		Request *request = nullptr;
-		for (auto &item : conversionQueue_.front()) {
-			FrameBuffer *outputBuffer = item.second;
-			request = outputBuffer->request();
-			pipe->completeBuffer(request, outputBuffer);
-		}
+		cancelOutputs(conversionQueue_.front());
 		conversionQueue_.pop();
-
-		if (request)
-			pipe->completeRequest(request);
 		return;
 	}
 
@@ -836,12 +977,11 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 	Request *request = buffer->request();
 
 	if (useConversion_ && !conversionQueue_.empty()) {
-		const std::map<unsigned int, FrameBuffer *> &outputs =
-			conversionQueue_.front();
-		if (!outputs.empty()) {
-			FrameBuffer *outputBuffer = outputs.begin()->second;
-			if (outputBuffer)
+		for (FrameBuffer *outputBuffer : conversionQueue_.front()) {
+			if (outputBuffer) {
 				request = outputBuffer->request();
+				break;
+			}
 		}
 	}
 
@@ -860,22 +1000,129 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 			return;
 		}
 
+		if (chainedIsp_) {
+			/*
+			 * Debayer to an intermediate buffer, the request
+			 * buffers are handed to the converter when the Soft
+			 * ISP completes.
+			 */
+			if (availableIspBuffers_.empty()) {
+				LOG(SimplePipeline, Warning)
+					<< "No Soft ISP buffer available, dropping frame";
+				video_->queueBuffer(buffer);
+				cancelOutputs(conversionQueue_.front());
+				conversionQueue_.pop();
+				return;
+			}
+
+			FrameBuffer *ispBuffer = availableIspBuffers_.front();
+			availableIspBuffers_.pop();
+
+			Span<FrameBuffer *const> outputs = conversionQueue_.front();
+			std::copy(outputs.begin(), outputs.end(), ispQueue_.push().begin());
+			conversionQueue_.pop();
+
+			swIsp_->queueBuffers(buffer, { &ispBuffer, 1 });
+			return;
+		}
+
 		if (converter_)
 			converter_->queueBuffers(buffer, conversionQueue_.front());
 		else
-			swIsp_->queueBuffers(buffer, conversionQueue_.front());
+			swIsp_->queueBuffers(buffer, conversionQueue_.front(),
+					     ispCrop(request));
 
 		conversionQueue_.pop();
 		return;
 	}
 
+	/* Gather the statistics of RAW frames before completing the request. */
+	if (statsOnly_) {
+		swIsp_->queueStats(buffer);
+		return;
+	}
+
 	/* Otherwise simply complete the request. */
 	pipe->completeBuffer(request, buffer);
 	pipe->completeRequest(request);
 }
 
+void SimpleCameraData::ispInputDone(FrameBuffer *buffer)
+{
+	/* The input is the request buffer when only gathering statistics. */
+	if (statsOnly_) {
+		Request *request = buffer->request();
+		pipe()->completeBuffer(request, buffer);
+		pipe()->completeRequest(request);
+		return;
+	}
+
+	/* Queue the input buffer back for capture. */
+	video_->queueBuffer(buffer);
+}
+
+/*
+ * Expose the ScalerCrop control when the Soft ISP produces the outputs from
+ * the captured frames itself and supports cropping them.
+ */
+void SimpleCameraData::configureScalerCrop(const Size &captureSize,
+					   const Size &outputSize)
+{
+	IPACameraSensorInfo sensorInfo{};
+
+	if (swIsp_->cropWindow(Rectangle(captureSize)).isNull())
+		return;
+
+	if (sensor_->sensorInfo(&sensorInfo) < 0)
+		return;
+
+	analogCrop_ = sensorInfo.analogCrop;
+	captureSize_ = captureSize;
+	scalerCrop_ = analogCrop_;
+
+	/* The smallest crop is processed without scaling. */
+	Rectangle minCrop = Rectangle(outputSize).scaledBy(analogCrop_.size(),
+							   captureSize_);
+
+	controlInfo_ = ControlInfoMap({
+		{ &controls::ScalerCrop,
+		  ControlInfo(minCrop, analogCrop_, analogCrop_) },
+	}, controls::controls);
+}
+
+/*
+ * Update the crop rectangle from the request controls, and return it in the
+ * coordinates of the captured frames. The area processed by the Soft ISP is
+ * reported in the request metadata.
+ */
+Rectangle SimpleCameraData::ispCrop(Request *request)
+{
+	if (analogCrop_.isNull() || !request)
+		return {};
+
+	const auto &scalerCrop = request->controls().get(controls::ScalerCrop);
+	if (scalerCrop)
+		scalerCrop_ = scalerCrop->enclosedIn(analogCrop_);
+
+	Rectangle crop = scalerCrop_.translatedBy(-analogCrop_.topLeft())
+				    .scaledBy(captureSize_, analogCrop_.size());
+	Rectangle window = swIsp_->cropWindow(crop);
+
+	request->metadata().set(controls::ScalerCrop,
+				window.scaledBy(analogCrop_.size(), captureSize_)
+				      .translatedBy(analogCrop_.topLeft()));
+
+	return window;
+}
+
 void SimpleCameraData::conversionInputDone(FrameBuffer *buffer)
 {
+	/* Return the intermediate buffer to the Soft ISP. */
+	if (chainedIsp_) {
+		availableIspBuffers_.push(buffer);
+		return;
+	}
+
 	/* Queue the input buffer back for capture. */
 	video_->queueBuffer(buffer);
 }
@@ -890,10 +1137,161 @@ void SimpleCameraData::conversionOutputDone(FrameBuffer *buffer)
 		pipe->completeRequest(request);
 }
 
-void SimpleCameraData::ispStatsReady()
+/*
+ * Connect the Soft ISP output. When chained with the converter, the
+ * intermediate buffers are queued to the converter, whose devices are bound to
+ * the pipeline handler thread, while the Soft ISP completes its output buffers
+ * in the ISP thread. Deliver them to the pipeline handler thread in that case,
+ * the same way as the Soft ISP input buffers.
+ */
+void SimpleCameraData::connectIspOutput()
+{
+	swIsp_->outputBufferReady.disconnect();
+
+	if (chainedIsp_)
+		swIsp_->outputBufferReady.connect(pipe(), [this](FrameBuffer *buffer) {
+			this->ispOutputDone(buffer);
+		});
+	else
+		swIsp_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+}
+
+void SimpleCameraData::ispOutputDone(FrameBuffer *buffer)
+{
+	if (ispQueue_.empty()) {
+		availableIspBuffers_.push(buffer);
+		return;
+	}
+
+	Span<FrameBuffer *const> outputs = ispQueue_.front();
+
+	if (buffer->metadata().status != FrameMetadata::FrameSuccess ||
+	    converter_->queueBuffers(buffer, outputs) < 0) {
+		availableIspBuffers_.push(buffer);
+		cancelOutputs(outputs);
+	}
+
+	ispQueue_.pop();
+}
+
+/*
+ * Stop the Soft ISP chained with the converter. The Soft ISP completes the
+ * frames it hasn't processed when stopping, process their completion before
+ * stopping the converter to complete all the request buffers.
+ */
+void SimpleCameraData::flushIsp()
+{
+	swIsp_->stop();
+
+	Thread::current()->dispatchMessages(Message::Type::InvokeMessage, pipe());
+
+	while (!ispQueue_.empty()) {
+		cancelOutputs(ispQueue_.front());
+		ispQueue_.pop();
+	}
+}
+
+/* Complete the request buffers of a frame that can't be produced */
+void SimpleCameraData::cancelOutputs(Span<FrameBuffer *const> outputs)
+{
+	SimplePipelineHandler *pipe = SimpleCameraData::pipe();
+	Request *request = nullptr;
+
+	/*
+	 * Completing the buffers may queue new requests, which can grow the
+	 * conversion queue and invalidate the outputs. Copy them first, this
+	 * is only used on the error paths.
+	 */
+	std::vector<FrameBuffer *> buffers(outputs.begin(), outputs.end());
+
+	for (FrameBuffer *outputBuffer : buffers) {
+		if (!outputBuffer)
+			continue;
+
+		outputBuffer->_d()->cancel();
+		request = outputBuffer->request();
+		pipe->completeBuffer(request, outputBuffer);
+	}
+
+	if (request)
+		pipe->completeRequest(request);
+}
+
+/*
+ * Drop all entries and allocate the ring for \a capacity entries of
+ * \a numStreams buffers.
+ */
+void SimpleCameraData::ConversionQueue::reset(unsigned int capacity,
+					      unsigned int numStreams)
+{
+	capacity_ = std::max(capacity, 1U);
+	numStreams_ = numStreams;
+	head_ = 0;
+	size_ = 0;
+	maxDepth_ = 0;
+	buffers_.assign(capacity_ * numStreams_, nullptr);
+}
+
+/* Append an entry to the queue and return its buffers, all set to null */
+Span<FrameBuffer *> SimpleCameraData::ConversionQueue::push()
+{
+	if (size_ == capacity_)
+		grow();
+
+	unsigned int index = (head_ + size_) % capacity_;
+	size_++;
+
+	if (size_ > maxDepth_) {
+		maxDepth_ = size_;
+		LOG(SimplePipeline, Debug)
+			<< "Conversion queue depth increased to " << maxDepth_;
+	}
+
+	Span<FrameBuffer *> entry{ &buffers_[index * numStreams_], numStreams_ };
+	std::fill(entry.begin(), entry.end(), nullptr);
+
+	return entry;
+}
+
+Span<FrameBuffer *const> SimpleCameraData::ConversionQueue::front() const
+{
+	ASSERT(!empty());
+
+	return { &buffers_[head_ * numStreams_], numStreams_ };
+}
+
+void SimpleCameraData::ConversionQueue::pop()
+{
+	ASSERT(!empty());
+
+	head_ = (head_ + 1) % capacity_;
+	size_--;
+}
+
+/* Double the capacity, keeping the entries in order from the start */
+void SimpleCameraData::ConversionQueue::grow()
+{
+	std::vector<FrameBuffer *> buffers(capacity_ * 2 * numStreams_, nullptr);
+
+	for (unsigned int i = 0; i < size_; i++) {
+		auto entry = buffers_.begin() + (head_ + i) % capacity_ * numStreams_;
+		std::copy(entry, entry + numStreams_,
+			  buffers.begin() + i * numStreams_);
+	}
+
+	LOG(SimplePipeline, Debug)
+		<< "Growing conversion queue to " << capacity_ * 2 << " entries";
+
+	buffers_ = std::move(buffers);
+	capacity_ *= 2;
+	head_ = 0;
+}
+
+void SimpleCameraData::ispStatsReady(uint32_t frame, uint32_t bufferId)
 {
 	/* \todo Use the DelayedControls class */
-	swIsp_->processStats(sensor_->getControls({ V4L2_CID_ANALOGUE_GAIN,
+	swIsp_->processStats(frame, bufferId,
+			     sensor_->getControls({ V4L2_CID_ANALOGUE_GAIN,
 						    V4L2_CID_EXPOSURE }));
 }
 
@@ -988,6 +1386,23 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 
 	Orientation requestedOrientation = orientation;
 	combinedTransform_ = sensor->computeTransform(&orientation);
+
+	/*
+	 * When the sensor can't produce the requested orientation, let the
+	 * Soft ISP flip the images while debayering them. The orientation
+	 * reported by computeTransform() is then the mounting orientation.
+	 */
+	const Orientation sensorOrientation = orientation;
+	ispTransform_ = Transform::Identity;
+	if (orientation != requestedOrientation && data_->swIsp_ &&
+	    !data_->converter_) {
+		Transform transform = requestedOrientation / orientation;
+		if (data_->swIsp_->supportsTransform(transform)) {
+			ispTransform_ = transform;
+			orientation = requestedOrientation;
+		}
+	}
+
 	if (orientation != requestedOrientation)
 		status = Adjusted;
 
@@ -1076,9 +1491,73 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 	 */
 	needConversion_ = config_.size() > 1;
 
+	/*
+	 * When chaining the Soft ISP and the converter, debayer with 4x or 2x
+	 * binning when the intermediate frame is still large enough for all
+	 * streams, to bound the CPU usage. The converter handles the scaling.
+	 */
+	ispSize_ = {};
+	if (pipeConfig_->ispFormat.isValid()) {
+		const SizeRange &ispSizes = pipeConfig_->ispSizes;
+		const Size &captureSize = pipeConfig_->captureSize;
+
+		needConversion_ = true;
+		ispSize_ = ispSizes.max;
+
+		for (unsigned int scale : { 4U, 2U }) {
+			Size size = adjustSize({ captureSize.width / scale,
+						 captureSize.height / scale },
+					       ispSizes);
+			if (size.width >= maxStreamSize.width &&
+			    size.height >= maxStreamSize.height) {
+				ispSize_ = size;
+				break;
+			}
+		}
+	}
+
 	for (unsigned int i = 0; i < config_.size(); ++i) {
 		StreamConfiguration &cfg = config_[i];
 
+		/*
+		 * The secondary output of the Soft ISP is an integer downscale
+		 * of the main output, in the same pixel format and with even
+		 * dimensions.
+		 */
+		if (i > 0 && data_->swIsp_ && !data_->converter_) {
+			const StreamConfiguration &mainCfg = config_[0];
+
+			if (cfg.pixelFormat != mainCfg.pixelFormat) {
+				LOG(SimplePipeline, Debug) << "Adjusting pixel format";
+				cfg.pixelFormat = mainCfg.pixelFormat;
+				status = Adjusted;
+			}
+
+			const auto downscale = [](unsigned int main, unsigned int req) {
+				unsigned int step = std::max(1U, req ? main / req : 1U);
+				return (main / step) & ~1U;
+			};
+
+			Size adjustedSize{ downscale(mainCfg.size.width, cfg.size.width),
+					   downscale(mainCfg.size.height, cfg.size.height) };
+			if (cfg.size != adjustedSize) {
+				LOG(SimplePipeline, Debug)
+					<< "Adjusting size from " << cfg.size
+					<< " to " << adjustedSize;
+				cfg.size = adjustedSize;
+				status = Adjusted;
+			}
+
+			std::tie(cfg.stride, cfg.frameSize) =
+				data_->swIsp_->strideAndFrameSize(cfg.pixelFormat,
+								  cfg.size);
+			if (cfg.stride == 0)
+				return Invalid;
+
+			cfg.bufferCount = 3;
+			continue;
+		}
+
 		/* Adjust the pixel format and size. */
 		auto it = std::find(pipeConfig_->outputFormats.begin(),
 				    pipeConfig_->outputFormats.end(),
@@ -1141,6 +1620,13 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 		cfg.bufferCount = 3;
 	}
 
+	/* Raw streams are captured as-is, without the Soft ISP transform. */
+	if (ispTransform_ != Transform::Identity && !needConversion_) {
+		ispTransform_ = Transform::Identity;
+		orientation = sensorOrientation;
+		status = Adjusted;
+	}
+
 	return status;
 }
 
@@ -1151,6 +1637,12 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 SimplePipelineHandler::SimplePipelineHandler(CameraManager *manager)
 	: PipelineHandler(manager), converter_(nullptr)
 {
+	/*
+	 * In lazy probe mode, defer loading the software ISP IPA module until
+	 * the camera is acquired.
+	 */
+	const char *lazy = utils::secure_getenv("LIBCAMERA_LAZY_PROBE");
+	lazyProbe_ = lazy && *lazy != '\0';
 }
 
 std::unique_ptr<CameraConfiguration>
@@ -1266,6 +1758,11 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	/* Configure the converter if needed. */
 	std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs;
 	data->useConversion_ = config->needConversion();
+	unsigned int queueDepth = 0;
+
+	/* Only the Soft ISP supports the ScalerCrop control. */
+	data->analogCrop_ = {};
+	data->controlInfo_ = ControlInfoMap();
 
 	for (unsigned int i = 0; i < config->size(); ++i) {
 		StreamConfiguration &cfg = config->at(i);
@@ -1274,10 +1771,13 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 
 		if (data->useConversion_)
 			outputCfgs.push_back(cfg);
+
+		queueDepth = std::max(queueDepth, cfg.bufferCount);
 	}
 
-	if (outputCfgs.empty())
-		return 0;
+	/* Size the conversion queues for the expected requests in flight. */
+	data->conversionQueue_.reset(queueDepth, config->size());
+	data->ispQueue_.reset(kNumInternalBuffers, config->size());
 
 	StreamConfiguration inputCfg;
 	inputCfg.pixelFormat = pipeConfig->captureFormat;
@@ -1285,10 +1785,74 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	inputCfg.stride = captureFormat.planes[0].bpl;
 	inputCfg.bufferCount = kNumInternalBuffers;
 
-	return data->converter_
-		       ? data->converter_->configure(inputCfg, outputCfgs)
-		       : data->swIsp_->configure(inputCfg, outputCfgs,
-						 data->sensor_->controls());
+	/*
+	 * RAW frames are delivered to the application untouched. When the Soft
+	 * ISP can process them, let it gather their statistics to run the
+	 * auto-exposure and other IPA algorithms without debayering.
+	 */
+	data->statsOnly_ = false;
+	if (outputCfgs.empty()) {
+		if (!data->swIsp_ || data->converter_ ||
+		    data->swIsp_->formats(inputCfg.pixelFormat).empty())
+			return 0;
+
+		ret = data->swIsp_->configure(inputCfg, {},
+					      data->sensor_->controls());
+		if (ret < 0) {
+			LOG(SimplePipeline, Warning)
+				<< "Statistics unavailable for "
+				<< inputCfg.pixelFormat << " capture";
+			return 0;
+		}
+
+		data->statsOnly_ = true;
+		return 0;
+	}
+
+	data->chainedIsp_ = pipeConfig->ispFormat.isValid();
+	data->ispBuffers_.clear();
+	if (data->swIsp_)
+		data->connectIspOutput();
+
+	if (data->chainedIsp_) {
+		/* Debayer to the intermediate format, and convert from it. */
+		StreamConfiguration ispCfg;
+		ispCfg.pixelFormat = pipeConfig->ispFormat;
+		ispCfg.size = config->ispSize();
+		std::tie(ispCfg.stride, ispCfg.frameSize) =
+			data->swIsp_->strideAndFrameSize(ispCfg.pixelFormat,
+							 ispCfg.size);
+		ispCfg.bufferCount = kNumInternalBuffers;
+
+		LOG(SimplePipeline, Debug)
+			<< "Chaining Soft ISP and converter through "
+			<< ispCfg.toString();
+
+		ret = data->swIsp_->configure(inputCfg, { ispCfg },
+					      data->sensor_->controls());
+		if (ret < 0)
+			return ret;
+
+		ret = data->swIsp_->exportBuffers(0, kNumInternalBuffers,
+						  &data->ispBuffers_);
+		if (ret < 0)
+			return ret;
+
+		return data->converter_->configure(ispCfg, outputCfgs);
+	}
+
+	if (data->converter_)
+		return data->converter_->configure(inputCfg, outputCfgs);
+
+	ret = data->swIsp_->configure(inputCfg, outputCfgs,
+				      data->sensor_->controls(),
+				      config->ispTransform());
+	if (ret < 0)
+		return ret;
+
+	data->configureScalerCrop(inputCfg.size, outputCfgs[0].get().size);
+
+	return 0;
 }
 
 int SimplePipelineHandler::exportFrameBuffers(Camera *camera, Stream *stream,
@@ -1328,10 +1892,20 @@ int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlL
 	if (data->useConversion_) {
 		/*
 		 * When using the converter allocate a fixed number of internal
-		 * buffers.
+		 * buffers. The Soft ISP and the CPU converter bracket their CPU
+		 * accesses to the buffers with dma-buf syncs, they can be
+		 * cached.
 		 */
+		const bool cpuAccess = data->swIsp_
+				     ? !data->converter_ || data->chainedIsp_
+				     : data->converter_ && !converter_;
+
+		V4L2VideoDevice::BufferFlags flags;
+		if (cpuAccess)
+			flags |= V4L2VideoDevice::BufferFlag::NonCoherent;
+
 		ret = video->allocateBuffers(kNumInternalBuffers,
-					     &data->conversionBuffers_);
+					     &data->conversionBuffers_, flags);
 	} else {
 		/* Otherwise, prepare for using buffers from the only stream. */
 		Stream *stream = &data->streams_[0];
@@ -1351,12 +1925,21 @@ int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlL
 	}
 
 	if (data->useConversion_) {
-		if (data->converter_)
+		if (data->chainedIsp_) {
+			data->availableIspBuffers_ = {};
+			for (std::unique_ptr<FrameBuffer> &buffer : data->ispBuffers_)
+				data->availableIspBuffers_.push(buffer.get());
+
 			ret = data->converter_->start();
-		else if (data->swIsp_)
+			if (!ret)
+				ret = data->swIsp_->start();
+		} else if (data->converter_) {
+			ret = data->converter_->start();
+		} else if (data->swIsp_) {
 			ret = data->swIsp_->start();
-		else
+		} else {
 			ret = 0;
+		}
 
 		if (ret < 0) {
 			stop(camera);
@@ -1366,6 +1949,12 @@ int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlL
 		/* Queue all internal buffers for capture. */
 		for (std::unique_ptr<FrameBuffer> &buffer : data->conversionBuffers_)
 			video->queueBuffer(buffer.get());
+	} else if (data->statsOnly_) {
+		ret = data->swIsp_->start();
+		if (ret < 0) {
+			stop(camera);
+			return ret;
+		}
 	}
 
 	return 0;
@@ -1377,10 +1966,21 @@ void SimplePipelineHandler::stopDevice(Camera *camera)
 	V4L2VideoDevice *video = data->video_;
 
 	if (data->useConversion_) {
+		if (data->chainedIsp_)
+			data->flushIsp();
+
 		if (data->converter_)
 			data->converter_->stop();
 		else if (data->swIsp_)
 			data->swIsp_->stop();
+	} else if (data->statsOnly_) {
+		/*
+		 * Complete the requests whose buffers the Soft ISP has
+		 * returned from its thread before stopping.
+		 */
+		data->swIsp_->stop();
+		Thread::current()->dispatchMessages(Message::Type::InvokeMessage,
+						    data->pipe());
 	}
 
 	video->streamOff();
@@ -1390,37 +1990,75 @@ void SimplePipelineHandler::stopDevice(Camera *camera)
 
 	data->conversionBuffers_.clear();
 
+	if (data->useConversion_)
+		LOG(SimplePipeline, Debug)
+			<< "Maximum conversion queue depth: "
+			<< data->conversionQueue_.maxDepth();
+
 	releasePipeline(data);
 }
 
+void SimplePipelineHandler::statisticsDevice(Camera *camera,
+					     std::map<std::string, uint64_t> *counters)
+{
+	SimpleCameraData *data = cameraData(camera);
+
+	addStatistics(counters, "video", data->video_);
+
+	if (!data->swIsp_)
+		return;
+
+	SoftwareIsp::Statistics stats = data->swIsp_->statistics();
+
+	(*counters)["softisp.frames-processed"] = stats.framesProcessed;
+	(*counters)["softisp.frames-dropped"] = stats.framesDropped;
+	(*counters)["softisp.processing-time-us"] = stats.processingTime.get<std::micro>();
+	(*counters)["ipa.calls"] = stats.ipa.calls;
+	(*counters)["ipa.processing-time-us"] = stats.ipa.processingTime.get<std::micro>();
+}
+
 int SimplePipelineHandler::queueRequestDevice(Camera *camera, Request *request)
 {
 	SimpleCameraData *data = cameraData(camera);
 	int ret;
 
-	std::map<unsigned int, FrameBuffer *> buffers;
+	/*
+	 * If conversion is needed, push the buffers to the converter queue,
+	 * they will be handed to the converter in the capture completion
+	 * handler.
+	 */
+	if (data->useConversion_) {
+		Span<FrameBuffer *> buffers = data->conversionQueue_.push();
 
-	for (auto &[stream, buffer] : request->buffers()) {
-		/*
-		 * If conversion is needed, push the buffer to the converter
-		 * queue, it will be handed to the converter in the capture
-		 * completion handler.
-		 */
-		if (data->useConversion_) {
-			buffers.emplace(data->streamIndex(stream), buffer);
-		} else {
-			ret = data->video_->queueBuffer(buffer);
-			if (ret < 0)
-				return ret;
-		}
+		for (auto &[stream, buffer] : request->buffers())
+			buffers[data->streamIndex(stream)] = buffer;
+
+		return 0;
 	}
 
-	if (data->useConversion_)
-		data->conversionQueue_.push(std::move(buffers));
+	for (auto &[stream, buffer] : request->buffers()) {
+		ret = data->video_->queueBuffer(buffer);
+		if (ret < 0)
+			return ret;
+	}
 
 	return 0;
 }
 
+bool SimplePipelineHandler::acquireDevice(Camera *camera)
+{
+	SimpleCameraData *data = cameraData(camera);
+
+	/* Load the software ISP IPA module if it has been deferred. */
+	if (data->swIsp_ && data->swIsp_->loadIPA() < 0) {
+		LOG(SimplePipeline, Error)
+			<< "Failed to initialize the software ISP";
+		return false;
+	}
+
+	return true;
+}
+
 /* -----------------------------------------------------------------------------
  * Match and Setup
  */
@@ -1545,6 +2183,10 @@ bool SimplePipelineHandler::match(DeviceEnumerator *enumerator)
 
 	swIspEnabled_ = info->swIspEnabled;
 
+	/* The CPU converter replaces the missing converter device. */
+	if (!converter_ && !swIspEnabled_)
+		numStreams = ConverterCpu::kMaxStreams;
+
 	/* Locate the sensors. */
 	std::vector<MediaEntity *> sensors = locateSensors();
 	if (sensors.empty()) {
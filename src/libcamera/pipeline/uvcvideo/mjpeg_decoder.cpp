@@ -0,0 +1,409 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Software MJPEG decoder for the uvcvideo pipeline
+ */
+
+#include "mjpeg_decoder.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <setjmp.h>
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/object.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(UVC)
+
+namespace {
+
+struct JpegErrorManager : public jpeg_error_mgr {
+	JpegErrorManager()
+	{
+		jpeg_std_error(this);
+		error_exit = errorExit;
+		output_message = outputMessage;
+	}
+
+	static void errorExit(j_common_ptr cinfo)
+	{
+		JpegErrorManager *self =
+			static_cast<JpegErrorManager *>(cinfo->err);
+		longjmp(self->escape_, 1);
+	}
+
+	static void outputMessage(j_common_ptr cinfo)
+	{
+		char message[JMSG_LENGTH_MAX];
+
+		cinfo->err->format_message(cinfo, message);
+		LOG(UVC, Debug) << "libjpeg: " << message;
+	}
+
+	jmp_buf escape_;
+};
+
+} /* namespace */
+
+/*
+ * The worker lives in the decoder thread and decodes one frame per
+ * invocation. The decompressor is created once and reused for all frames to
+ * avoid reallocating the libjpeg internal state every frame.
+ */
+class MjpegDecoder::Worker : public Object
+{
+public:
+	Worker(MjpegDecoder *decoder)
+		: decoder_(decoder)
+	{
+		cinfo_.err = &errorManager_;
+		jpeg_create_decompress(&cinfo_);
+	}
+
+	~Worker()
+	{
+		jpeg_destroy_decompress(&cinfo_);
+	}
+
+	void configure(const PixelFormat &format, const Size &size)
+	{
+		const PixelFormatInfo &info = PixelFormatInfo::info(format);
+
+		format_ = format;
+		size_ = size;
+		strides_[0] = info.stride(size.width, 0);
+		strides_[1] = info.numPlanes() > 1 ? info.stride(size.width, 1) : 0;
+
+		/* Room for two interleaved YCbCr 4:4:4 lines. */
+		lines_.resize(size.width * 3 * 2);
+	}
+
+	void decode(FrameBuffer *input, FrameBuffer *output);
+	void flush() {}
+
+private:
+	/*
+	 * UVC cameras report the size of the compressed frame in the payload,
+	 * don't feed libjpeg with the padding at the end of the buffer.
+	 */
+	static size_t bytesused(const FrameBuffer *buffer, const MappedFrameBuffer &mapped)
+	{
+		return std::min<size_t>(buffer->metadata().planes()[0].bytesused,
+					mapped.planes()[0].size());
+	}
+
+	int decompress(Span<const uint8_t> data, MappedFrameBuffer &out);
+	void storeYUYV(const uint8_t *src, uint8_t *dst);
+	void storeNV12(const uint8_t *src0, const uint8_t *src1,
+		       uint8_t *y0, uint8_t *y1, uint8_t *uv);
+
+	MjpegDecoder *decoder_;
+
+	struct jpeg_decompress_struct cinfo_;
+	JpegErrorManager errorManager_;
+
+	PixelFormat format_;
+	Size size_;
+	unsigned int strides_[2];
+	std::vector<uint8_t> lines_;
+};
+
+void MjpegDecoder::Worker::decode(FrameBuffer *input, FrameBuffer *output)
+{
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+
+	if (!decoder_->running_) {
+		metadata.status = FrameMetadata::FrameCancelled;
+		decoder_->inputBufferReady.emit(input);
+		decoder_->outputBufferReady.emit(output);
+		return;
+	}
+
+	metadata.status = FrameMetadata::FrameError;
+
+	{
+		MappedFrameBuffer in(input, MappedFrameBuffer::MapFlag::Read |
+					    MappedFrameBuffer::MapFlag::Sync);
+		MappedFrameBuffer out(output, MappedFrameBuffer::MapFlag::Write |
+					      MappedFrameBuffer::MapFlag::Sync);
+
+		if (!in.isValid() || !out.isValid())
+			LOG(UVC, Error) << "Failed to map MJPEG decoder buffers";
+		else if (!decompress(in.planes()[0].first(bytesused(input, in)), out))
+			metadata.status = FrameMetadata::FrameSuccess;
+	}
+
+	for (unsigned int i = 0; i < output->planes().size(); i++)
+		metadata.planes()[i].bytesused = output->planes()[i].length;
+
+	decoder_->inputBufferReady.emit(input);
+	decoder_->outputBufferReady.emit(output);
+}
+
+int MjpegDecoder::Worker::decompress(Span<const uint8_t> data,
+				     MappedFrameBuffer &out)
+{
+	/*
+	 * The output plane pointers and the line buffers are the only local
+	 * state used after a libjpeg error, and are not modified after setjmp.
+	 */
+	uint8_t *const y = out.planes()[0].data();
+	uint8_t *const uv = out.planes().size() > 1
+			  ? out.planes()[1].data()
+			  : y + strides_[0] * size_.height;
+	uint8_t *const lines = lines_.data();
+
+	if (setjmp(errorManager_.escape_)) {
+		jpeg_abort_decompress(&cinfo_);
+		LOG(UVC, Debug) << "Failed to decode MJPEG frame";
+		return -EINVAL;
+	}
+
+	jpeg_mem_src(&cinfo_, data.data(), data.size());
+	jpeg_read_header(&cinfo_, TRUE);
+
+	if (cinfo_.image_width != size_.width ||
+	    cinfo_.image_height != size_.height) {
+		LOG(UVC, Error)
+			<< "MJPEG frame size " << cinfo_.image_width << "x"
+			<< cinfo_.image_height << " doesn't match " << size_;
+		jpeg_abort_decompress(&cinfo_);
+		return -EINVAL;
+	}
+
+	/*
+	 * Decode to interleaved YCbCr to skip the colour space conversion.
+	 * Fancy upsampling is disabled as the chroma is subsampled again
+	 * right away: with replicated chroma samples, averaging them restores
+	 * the original 4:2:0 or 4:2:2 values exactly.
+	 */
+	cinfo_.out_color_space = JCS_YCbCr;
+	cinfo_.do_fancy_upsampling = FALSE;
+
+	jpeg_start_decompress(&cinfo_);
+
+	if (format_ == formats::YUYV) {
+		while (cinfo_.output_scanline < cinfo_.output_height) {
+			uint8_t *dst = y + strides_[0] * cinfo_.output_scanline;
+			JSAMPROW row = lines;
+
+			jpeg_read_scanlines(&cinfo_, &row, 1);
+			storeYUYV(lines, dst);
+		}
+	} else {
+		const unsigned int lineSize = size_.width * 3;
+
+		while (cinfo_.output_scanline < cinfo_.output_height) {
+			unsigned int line = cinfo_.output_scanline;
+			JSAMPROW rows[2] = { lines, lines + lineSize };
+			JDIMENSION read = 0;
+
+			while (read < 2)
+				read += jpeg_read_scanlines(&cinfo_, rows + read,
+							    2 - read);
+
+			storeNV12(rows[0], rows[1], y + strides_[0] * line,
+				  y + strides_[0] * (line + 1),
+				  uv + strides_[1] * (line / 2));
+		}
+	}
+
+	jpeg_finish_decompress(&cinfo_);
+
+	return 0;
+}
+
+void MjpegDecoder::Worker::storeYUYV(const uint8_t *src, uint8_t *dst)
+{
+	for (unsigned int x = 0; x < size_.width; x += 2) {
+		dst[0] = src[0];
+		dst[1] = (src[1] + src[4] + 1) >> 1;
+		dst[2] = src[3];
+		dst[3] = (src[2] + src[5] + 1) >> 1;
+
+		src += 6;
+		dst += 4;
+	}
+}
+
+void MjpegDecoder::Worker::storeNV12(const uint8_t *src0, const uint8_t *src1,
+				     uint8_t *y0, uint8_t *y1, uint8_t *uv)
+{
+	for (unsigned int x = 0; x < size_.width; x += 2) {
+		y0[0] = src0[0];
+		y0[1] = src0[3];
+		y1[0] = src1[0];
+		y1[1] = src1[3];
+		uv[0] = (src0[1] + src0[4] + src1[1] + src1[4] + 2) >> 2;
+		uv[1] = (src0[2] + src0[5] + src1[2] + src1[5] + 2) >> 2;
+
+		src0 += 6;
+		src1 += 6;
+		y0 += 2;
+		y1 += 2;
+		uv += 2;
+	}
+}
+
+/*
+ * The MjpegDecoder decodes MJPEG frames captured by UVC cameras to NV12 or
+ * YUYV in a dedicated thread, for platforms that lack a hardware JPEG
+ * decoder. It mimics the Converter API to keep the pipeline handler agnostic
+ * of the decoder implementation. The inputBufferReady and outputBufferReady
+ * signals are emitted from the decoder thread.
+ *
+ * Decoding relies on libjpeg, which uses SIMD instructions for the IDCT and
+ * upsampling when libcamera is linked against libjpeg-turbo.
+ */
+MjpegDecoder::MjpegDecoder()
+	: thread_("MjpegDecoder"),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf),
+	  running_(false)
+{
+	worker_ = std::make_unique<Worker>(this);
+	worker_->moveToThread(&thread_);
+}
+
+MjpegDecoder::~MjpegDecoder()
+{
+	stop();
+}
+
+std::vector<PixelFormat> MjpegDecoder::formats(PixelFormat input) const
+{
+	if (input != formats::MJPEG)
+		return {};
+
+	return { formats::NV12, formats::YUYV };
+}
+
+std::tuple<unsigned int, unsigned int>
+MjpegDecoder::strideAndFrameSize(const PixelFormat &pixelFormat,
+				 const Size &size) const
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(pixelFormat);
+
+	return { info.stride(size.width, 0), info.frameSize(size) };
+}
+
+int MjpegDecoder::configure(const StreamConfiguration &inputCfg,
+			    const StreamConfiguration &outputCfg)
+{
+	std::vector<PixelFormat> outputFormats = formats(inputCfg.pixelFormat);
+	if (std::find(outputFormats.begin(), outputFormats.end(),
+		      outputCfg.pixelFormat) == outputFormats.end()) {
+		LOG(UVC, Error)
+			<< "Unsupported MJPEG decoder conversion from "
+			<< inputCfg.pixelFormat << " to " << outputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	if (outputCfg.size != inputCfg.size ||
+	    outputCfg.size.width % 2 || outputCfg.size.height % 2) {
+		LOG(UVC, Error) << "Unsupported MJPEG decoder output size "
+				<< outputCfg.size;
+		return -EINVAL;
+	}
+
+	outputFormat_ = outputCfg.pixelFormat;
+	size_ = outputCfg.size;
+
+	worker_->configure(outputFormat_, size_);
+
+	return 0;
+}
+
+int MjpegDecoder::exportBuffers(unsigned int count,
+				std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(outputFormat_);
+	if (!info.isValid())
+		return -EINVAL;
+
+	std::vector<UniqueFD> fds = dmaHeap_.alloc("mjpeg-decoder",
+						   info.frameSize(size_), count);
+	if (fds.size() != count) {
+		LOG(UVC, Error) << "Failed to allocate MJPEG decoder buffers";
+		return -ENOMEM;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		SharedFD fd(std::move(fds[i]));
+
+		/* All planes are stored contiguously in a single dma_buf. */
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+		for (unsigned int p = 0; p < info.numPlanes(); p++) {
+			unsigned int planeSize = info.planeSize(size_, p);
+
+			FrameBuffer::Plane plane;
+			plane.fd = fd;
+			plane.offset = offset;
+			plane.length = planeSize;
+			planes.push_back(std::move(plane));
+
+			offset += planeSize;
+		}
+
+		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(planes)));
+	}
+
+	return count;
+}
+
+int MjpegDecoder::start()
+{
+	running_ = true;
+	thread_.start();
+
+	return 0;
+}
+
+/*
+ * Stop the decoder. The frame being decoded is completed, and the frames
+ * still waiting to be decoded are returned with their output buffer marked as
+ * cancelled.
+ */
+void MjpegDecoder::stop()
+{
+	running_ = false;
+
+	if (!thread_.isRunning())
+		return;
+
+	worker_->invokeMethod(&Worker::flush, ConnectionTypeBlocking);
+
+	thread_.exit();
+	thread_.wait();
+}
+
+int MjpegDecoder::queueBuffers(FrameBuffer *input, FrameBuffer *output)
+{
+	if (!running_)
+		return -EBUSY;
+
+	worker_->invokeMethod(&Worker::decode, ConnectionTypeQueued,
+			      input, output);
+
+	return 0;
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Software MJPEG decoder for the uvcvideo pipeline
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/signal.h>
+#include <libcamera/base/thread.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+#include "libcamera/internal/dma_buf_allocator.h"
+
+namespace libcamera {
+
+class FrameBuffer;
+struct StreamConfiguration;
+
+class MjpegDecoder
+{
+public:
+	MjpegDecoder();
+	~MjpegDecoder();
+
+	bool isValid() const { return dmaHeap_.isValid(); }
+
+	std::vector<PixelFormat> formats(PixelFormat input) const;
+	std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &pixelFormat, const Size &size) const;
+
+	int configure(const StreamConfiguration &inputCfg,
+		      const StreamConfiguration &outputCfg);
+	int exportBuffers(unsigned int count,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
+	int start();
+	void stop();
+
+	int queueBuffers(FrameBuffer *input, FrameBuffer *output);
+
+	Signal<FrameBuffer *> inputBufferReady;
+	Signal<FrameBuffer *> outputBufferReady;
+
+private:
+	class Worker;
+
+	Thread thread_;
+	std::unique_ptr<Worker> worker_;
+	DmaBufAllocator dmaHeap_;
+
+	PixelFormat outputFormat_;
+	Size size_;
+
+	std::atomic<bool> running_;
+};
+
+} /* namespace libcamera */
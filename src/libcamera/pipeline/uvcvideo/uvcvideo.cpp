@@ -6,54 +6,181 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <deque>
+#include <endian.h>
 #include <fstream>
 #include <iomanip>
+#include <iterator>
 #include <math.h>
 #include <memory>
+#include <queue>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
 #include <tuple>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/message.h>
+#include <libcamera/base/thread.h>
 #include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
+#include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/camera.h"
+#include "libcamera/internal/converter/converter_v4l2_m2m.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/sysfs.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
+#if HAVE_LIBJPEG
+#include "mjpeg_decoder.h"
+#endif
+
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(UVC)
 
+namespace {
+
+/*
+ * Memory-to-memory JPEG decoders that can decode the MJPEG frames captured by
+ * UVC cameras, in order of preference.
+ */
+constexpr std::array<const char *, 2> kJpegDecoders = {
+	"mtk-jpeg",
+	"mxc-jpeg",
+};
+
+/* UVC payload header flags, as exposed in the V4L2_META_FMT_UVC blocks. */
+constexpr uint8_t kUVCStreamPTS = 1 << 2;
+constexpr uint8_t kUVCStreamSCR = 1 << 3;
+
+/*
+ * Size of the fields of a V4L2_META_FMT_UVC block preceding the payload
+ * header data: the system timestamp, the USB SOF and the payload header
+ * length and flags.
+ */
+constexpr unsigned int kUVCMetadataHeaderSize = 12;
+
+constexpr unsigned int kMetadataBufferCount = 8;
+constexpr unsigned int kMaxPendingTimings = 16;
+
+/* Bound the device latency to reject inconsistent PTS and SCR values. */
+constexpr uint64_t kMaxDeviceLatency = 100000000;
+
+uint32_t readLe32(const uint8_t *data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return le32toh(value);
+}
+
+} /* namespace */
+
 class UVCCameraData : public Camera::Private
 {
 public:
 	UVCCameraData(PipelineHandler *pipe)
-		: Camera::Private(pipe)
+		: Camera::Private(pipe), useConverter_(false), decoding_(false),
+		  clockFrequency_(0), lastTimestamp_(0), intervals_{}
 	{
 	}
 
-	int init(MediaDevice *media);
+	int init(MediaDevice *media, MediaDevice *jpegDecoder);
 	void addControl(uint32_t cid, const ControlInfo &v4l2info,
 			ControlInfoMap::Map *ctrls);
 	void bufferReady(FrameBuffer *buffer);
 
 	const std::string &id() const { return id_; }
 
+	bool isDecoded(const PixelFormat &format) const
+	{
+		return decodedFormats_.count(format);
+	}
+
+	std::tuple<unsigned int, unsigned int>
+	decodedStrideAndFrameSize(const PixelFormat &pixelFormat, const Size &size);
+	int configureDecoder(const StreamConfiguration &inputCfg,
+			     StreamConfiguration &outputCfg);
+	int exportDecodedBuffers(unsigned int count,
+				 std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+	int startDecoder();
+	void stopDecoder();
+
+	int startMetadata();
+	void stopMetadata();
+
 	std::unique_ptr<V4L2VideoDevice> video_;
 	Stream stream_;
 	std::map<PixelFormat, std::vector<SizeRange>> formats_;
 
+	/*
+	 * Formats not supported natively by the camera, produced by decoding
+	 * the MJPEG frames with the hardware converter_ when available, or
+	 * with the software decoder_ otherwise.
+	 */
+	std::set<PixelFormat> decodedFormats_;
+	std::unique_ptr<Converter> converter_;
+#if HAVE_LIBJPEG
+	std::unique_ptr<MjpegDecoder> decoder_;
+#endif
+	bool useConverter_;
+
+	bool decoding_;
+	std::vector<std::unique_ptr<FrameBuffer>> mjpegBuffers_;
+	std::queue<Request *> pendingRequests_;
+
+	/*
+	 * The UVC metadata video node, if any, carries the UVC payload headers
+	 * used to compute precise frame timestamps.
+	 */
+	std::unique_ptr<V4L2VideoDevice> metadata_;
+	std::vector<std::unique_ptr<FrameBuffer>> metadataBuffers_;
+
 private:
+	struct FrameTiming {
+		uint32_t sequence;
+		uint64_t timestamp;
+	};
+
+	struct IntervalStats {
+		unsigned int count;
+		double sum;
+		double sumSquares;
+		uint64_t min;
+		uint64_t max;
+	};
+
 	bool generateId();
+	void initMetadata(MediaDevice *media);
+	void readClockFrequency();
+	void initDecoder(MediaDevice *jpegDecoder);
+	int queueDecode(FrameBuffer *input, FrameBuffer *output);
+	void decodeInputDone(FrameBuffer *buffer);
+	void decodeOutputDone(FrameBuffer *buffer);
+
+	uint64_t frameTimestamp(const FrameBuffer *buffer) const;
+	void metadataBufferReady(FrameBuffer *buffer);
+	void processFrame(FrameBuffer *buffer, uint64_t timestamp);
+	void flushFrames();
+
+	uint32_t clockFrequency_;
+	std::deque<FrameTiming> timings_;
+	std::deque<FrameBuffer *> waitingBuffers_;
+
+	uint64_t lastTimestamp_;
+	IntervalStats intervals_;
 
 	std::string id_;
 };
@@ -88,6 +215,10 @@ public:
 
 	bool match(DeviceEnumerator *enumerator) override;
 
+protected:
+	void statisticsDevice(Camera *camera,
+			      std::map<std::string, uint64_t> *counters) override;
+
 private:
 	int processControl(ControlList *controls, unsigned int id,
 			   const ControlValue &value);
@@ -154,16 +285,27 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 
 	cfg.bufferCount = 4;
 
+	/* Decoded formats are captured in MJPEG. */
+	bool decoded = data_->isDecoded(cfg.pixelFormat);
+
 	V4L2DeviceFormat format;
-	format.fourcc = data_->video_->toV4L2PixelFormat(cfg.pixelFormat);
+	format.fourcc = data_->video_->toV4L2PixelFormat(decoded ? formats::MJPEG
+								 : cfg.pixelFormat);
 	format.size = cfg.size;
 
 	int ret = data_->video_->tryFormat(&format);
 	if (ret)
 		return Invalid;
 
-	cfg.stride = format.planes[0].bpl;
-	cfg.frameSize = format.planes[0].size;
+	if (decoded) {
+		std::tie(cfg.stride, cfg.frameSize) =
+			data_->decodedStrideAndFrameSize(cfg.pixelFormat, cfg.size);
+		if (!cfg.stride)
+			return Invalid;
+	} else {
+		cfg.stride = format.planes[0].bpl;
+		cfg.frameSize = format.planes[0].size;
+	}
 
 	if (cfg.colorSpace != format.colorSpace) {
 		cfg.colorSpace = format.colorSpace;
@@ -192,7 +334,13 @@ PipelineHandlerUVC::generateConfiguration(Camera *camera,
 	StreamFormats formats(data->formats_);
 	StreamConfiguration cfg(formats);
 
-	cfg.pixelFormat = formats.pixelformats().front();
+	/* Default to a format captured natively, decoding costs resources. */
+	const std::vector<PixelFormat> pixelFormats = formats.pixelformats();
+	auto native = std::find_if(pixelFormats.begin(), pixelFormats.end(),
+				   [data](const PixelFormat &format) {
+					   return !data->isDecoded(format);
+				   });
+	cfg.pixelFormat = native != pixelFormats.end() ? *native : pixelFormats.front();
 	cfg.size = formats.sizes(cfg.pixelFormat).back();
 	cfg.bufferCount = 4;
 
@@ -209,8 +357,11 @@ int PipelineHandlerUVC::configure(Camera *camera, CameraConfiguration *config)
 	StreamConfiguration &cfg = config->at(0);
 	int ret;
 
+	bool decoded = data->isDecoded(cfg.pixelFormat);
+	PixelFormat captureFormat = decoded ? formats::MJPEG : cfg.pixelFormat;
+
 	V4L2DeviceFormat format;
-	format.fourcc = data->video_->toV4L2PixelFormat(cfg.pixelFormat);
+	format.fourcc = data->video_->toV4L2PixelFormat(captureFormat);
 	format.size = cfg.size;
 
 	ret = data->video_->setFormat(&format);
@@ -218,9 +369,24 @@ int PipelineHandlerUVC::configure(Camera *camera, CameraConfiguration *config)
 		return ret;
 
 	if (format.size != cfg.size ||
-	    format.fourcc != data->video_->toV4L2PixelFormat(cfg.pixelFormat))
+	    format.fourcc != data->video_->toV4L2PixelFormat(captureFormat))
 		return -EINVAL;
 
+	if (decoded) {
+		StreamConfiguration inputCfg;
+		inputCfg.pixelFormat = captureFormat;
+		inputCfg.size = format.size;
+		inputCfg.stride = format.planes[0].bpl;
+		inputCfg.frameSize = format.planes[0].size;
+		inputCfg.bufferCount = cfg.bufferCount;
+
+		ret = data->configureDecoder(inputCfg, cfg);
+		if (ret)
+			return ret;
+	}
+
+	data->decoding_ = decoded;
+
 	cfg.setStream(&data->stream_);
 
 	return 0;
@@ -232,6 +398,9 @@ int PipelineHandlerUVC::exportFrameBuffers(Camera *camera, Stream *stream,
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = stream->configuration().bufferCount;
 
+	if (data->decoding_)
+		return data->exportDecodedBuffers(count, buffers);
+
 	return data->video_->exportBuffers(count, buffers);
 }
 
@@ -239,25 +408,92 @@ int PipelineHandlerUVC::start(Camera *camera, [[maybe_unused]] const ControlList
 {
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = data->stream_.configuration().bufferCount;
+	int ret;
+
+	/* Frames are timestamped with the V4L2 timestamps if this fails. */
+	data->startMetadata();
+
+	if (!data->decoding_) {
+		ret = data->video_->importBuffers(count);
+		if (ret < 0)
+			goto error;
 
-	int ret = data->video_->importBuffers(count);
+		ret = data->video_->streamOn();
+		if (ret < 0)
+			goto error;
+
+		return 0;
+	}
+
+	/*
+	 * When decoding, the MJPEG frames are captured to internal buffers
+	 * that are queued to the device all the time, and paired with the
+	 * requests as they get captured.
+	 */
+	ret = data->video_->allocateBuffers(count, &data->mjpegBuffers_);
 	if (ret < 0)
-		return ret;
+		goto error;
 
-	ret = data->video_->streamOn();
-	if (ret < 0) {
-		data->video_->releaseBuffers();
-		return ret;
+	ret = data->startDecoder();
+	if (ret < 0)
+		goto error;
+
+	for (std::unique_ptr<FrameBuffer> &buffer : data->mjpegBuffers_) {
+		ret = data->video_->queueBuffer(buffer.get());
+		if (ret < 0)
+			goto error;
 	}
 
+	ret = data->video_->streamOn();
+	if (ret < 0)
+		goto error;
+
 	return 0;
+
+error:
+	if (data->decoding_)
+		data->stopDecoder();
+	data->video_->releaseBuffers();
+	data->mjpegBuffers_.clear();
+	data->stopMetadata();
+
+	return ret;
 }
 
 void PipelineHandlerUVC::stopDevice(Camera *camera)
 {
 	UVCCameraData *data = cameraData(camera);
+
+	/* Stop the metadata first to complete the frames waiting for it. */
+	data->stopMetadata();
+
+	if (data->decoding_)
+		data->stopDecoder();
+
 	data->video_->streamOff();
+
+	/* Cancel the requests still waiting for an MJPEG frame. */
+	while (!data->pendingRequests_.empty()) {
+		Request *request = data->pendingRequests_.front();
+		data->pendingRequests_.pop();
+
+		FrameBuffer *buffer = request->findBuffer(&data->stream_);
+		buffer->_d()->cancel();
+		completeBuffer(request, buffer);
+		completeRequest(request);
+	}
+
 	data->video_->releaseBuffers();
+	data->mjpegBuffers_.clear();
+}
+
+void PipelineHandlerUVC::statisticsDevice(Camera *camera,
+					  std::map<std::string, uint64_t> *counters)
+{
+	UVCCameraData *data = cameraData(camera);
+
+	addStatistics(counters, "video", data->video_.get());
+	addStatistics(counters, "metadata", data->metadata_.get());
 }
 
 int PipelineHandlerUVC::processControl(ControlList *controls, unsigned int id,
@@ -377,6 +613,11 @@ int PipelineHandlerUVC::queueRequestDevice(Camera *camera, Request *request)
 	if (ret < 0)
 		return ret;
 
+	if (data->decoding_) {
+		data->pendingRequests_.push(request);
+		return 0;
+	}
+
 	ret = data->video_->queueBuffer(buffer);
 	if (ret < 0)
 		return ret;
@@ -393,9 +634,18 @@ bool PipelineHandlerUVC::match(DeviceEnumerator *enumerator)
 	if (!media)
 		return false;
 
+	/* Acquire a hardware JPEG decoder, if any, to decode MJPEG frames. */
+	MediaDevice *jpegDecoder = nullptr;
+	for (const char *driver : kJpegDecoders) {
+		DeviceMatch jpegMatch(driver);
+		jpegDecoder = acquireMediaDevice(enumerator, jpegMatch);
+		if (jpegDecoder)
+			break;
+	}
+
 	std::unique_ptr<UVCCameraData> data = std::make_unique<UVCCameraData>(this);
 
-	if (data->init(media))
+	if (data->init(media, jpegDecoder))
 		return false;
 
 	/* Create and register the camera. */
@@ -411,7 +661,7 @@ bool PipelineHandlerUVC::match(DeviceEnumerator *enumerator)
 	return true;
 }
 
-int UVCCameraData::init(MediaDevice *media)
+int UVCCameraData::init(MediaDevice *media, MediaDevice *jpegDecoder)
 {
 	int ret;
 
@@ -434,6 +684,8 @@ int UVCCameraData::init(MediaDevice *media)
 
 	video_->bufferReady.connect(this, &UVCCameraData::bufferReady);
 
+	initMetadata(media);
+
 	/* Generate the camera ID. */
 	if (!generateId()) {
 		LOG(UVC, Error) << "Failed to generate camera ID";
@@ -466,6 +718,8 @@ int UVCCameraData::init(MediaDevice *media)
 		return -EINVAL;
 	}
 
+	initDecoder(jpegDecoder);
+
 	/* Populate the camera properties. */
 	properties_.set(properties::Model, utils::toAscii(media->model()));
 
@@ -697,13 +951,538 @@ void UVCCameraData::addControl(uint32_t cid, const ControlInfo &v4l2Info,
 	ctrls->emplace(id, info);
 }
 
+void UVCCameraData::initDecoder(MediaDevice *jpegDecoder)
+{
+	auto mjpeg = formats_.find(formats::MJPEG);
+	if (mjpeg == formats_.end())
+		return;
+
+	std::vector<PixelFormat> outputFormats;
+
+	if (jpegDecoder) {
+		converter_ = std::make_unique<V4L2M2MConverter>(jpegDecoder);
+		if (converter_->isValid()) {
+			outputFormats = converter_->formats(formats::MJPEG);
+			converter_->inputBufferReady.connect(this, &UVCCameraData::decodeInputDone);
+			converter_->outputBufferReady.connect(this, &UVCCameraData::decodeOutputDone);
+		} else {
+			LOG(UVC, Warning)
+				<< "Failed to create JPEG decoder "
+				<< jpegDecoder->driver();
+			converter_.reset();
+		}
+	}
+
+#if HAVE_LIBJPEG
+	decoder_ = std::make_unique<MjpegDecoder>();
+	if (decoder_->isValid()) {
+		for (const PixelFormat &format : decoder_->formats(formats::MJPEG)) {
+			if (std::find(outputFormats.begin(), outputFormats.end(),
+				      format) == outputFormats.end())
+				outputFormats.push_back(format);
+		}
+
+		/* The decoder signals are emitted from the decoder thread. */
+		decoder_->inputBufferReady.connect(pipe(), [this](FrameBuffer *buffer) {
+			decodeInputDone(buffer);
+		});
+		decoder_->outputBufferReady.connect(pipe(), [this](FrameBuffer *buffer) {
+			decodeOutputDone(buffer);
+		});
+	} else {
+		LOG(UVC, Warning) << "Failed to create software MJPEG decoder";
+		decoder_.reset();
+	}
+#endif
+
+	/* The decoders output 4:2:x formats and require even sizes. */
+	std::vector<SizeRange> sizes;
+	for (const SizeRange &range : mjpeg->second) {
+		if (range.min.width % 2 || range.min.height % 2 ||
+		    range.max.width % 2 || range.max.height % 2)
+			continue;
+
+		sizes.push_back(range);
+	}
+
+	if (sizes.empty())
+		return;
+
+	/* Only expose the formats that the camera can't produce natively. */
+	for (const PixelFormat &format : outputFormats) {
+		if (formats_.count(format))
+			continue;
+
+		formats_[format] = sizes;
+		decodedFormats_.insert(format);
+
+		LOG(UVC, Debug) << "Decoding MJPEG to " << format;
+	}
+}
+
+std::tuple<unsigned int, unsigned int>
+UVCCameraData::decodedStrideAndFrameSize(const PixelFormat &pixelFormat,
+					 const Size &size)
+{
+	/*
+	 * Use the hardware decoder only if it can produce the output, the
+	 * configuration falls back to the software decoder otherwise, whose
+	 * stride and frame size may differ.
+	 */
+	if (converter_) {
+		std::vector<PixelFormat> formats = converter_->formats(formats::MJPEG);
+		if (std::find(formats.begin(), formats.end(), pixelFormat) != formats.end() &&
+		    converter_->sizes(size).contains(size))
+			return converter_->strideAndFrameSize(pixelFormat, size);
+	}
+
+#if HAVE_LIBJPEG
+	if (decoder_)
+		return decoder_->strideAndFrameSize(pixelFormat, size);
+#endif
+
+	return { 0, 0 };
+}
+
+int UVCCameraData::configureDecoder(const StreamConfiguration &inputCfg,
+				    StreamConfiguration &outputCfg)
+{
+	useConverter_ = false;
+
+	/* Prefer the hardware decoder, fall back to software on failure. */
+	if (converter_) {
+		std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs{ outputCfg };
+		int ret = converter_->configure(inputCfg, outputCfgs);
+		if (!ret) {
+			useConverter_ = true;
+			return 0;
+		}
+
+		LOG(UVC, Debug)
+			<< "JPEG decoder can't produce " << outputCfg.toString();
+	}
+
+#if HAVE_LIBJPEG
+	if (decoder_) {
+		/*
+		 * The configuration has been validated for the hardware decoder
+		 * if it supports the output format and size. Make sure the
+		 * software decoder produces the same layout.
+		 */
+		auto [stride, frameSize] =
+			decoder_->strideAndFrameSize(outputCfg.pixelFormat,
+						     outputCfg.size);
+		if (outputCfg.stride != stride || outputCfg.frameSize != frameSize) {
+			LOG(UVC, Error)
+				<< "Software JPEG decoder can't produce stride "
+				<< outputCfg.stride << " and frame size "
+				<< outputCfg.frameSize;
+			return -EINVAL;
+		}
+
+		return decoder_->configure(inputCfg, outputCfg);
+	}
+#endif
+
+	return -EINVAL;
+}
+
+int UVCCameraData::exportDecodedBuffers(unsigned int count,
+					std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (useConverter_)
+		return converter_->exportBuffers(0, count, buffers);
+
+#if HAVE_LIBJPEG
+	return decoder_->exportBuffers(count, buffers);
+#else
+	return -EINVAL;
+#endif
+}
+
+int UVCCameraData::startDecoder()
+{
+	if (useConverter_)
+		return converter_->start();
+
+#if HAVE_LIBJPEG
+	return decoder_->start();
+#else
+	return -EINVAL;
+#endif
+}
+
+void UVCCameraData::stopDecoder()
+{
+	if (useConverter_) {
+		converter_->stop();
+		return;
+	}
+
+#if HAVE_LIBJPEG
+	decoder_->stop();
+
+	/* Process the buffers the decoder has queued to the pipeline handler. */
+	Thread::current()->dispatchMessages(Message::Type::InvokeMessage, pipe());
+#endif
+}
+
+int UVCCameraData::queueDecode(FrameBuffer *input, FrameBuffer *output)
+{
+	if (useConverter_)
+		return converter_->queueBuffers(input, { &output, 1 });
+
+#if HAVE_LIBJPEG
+	return decoder_->queueBuffers(input, output);
+#else
+	return -EINVAL;
+#endif
+}
+
+void UVCCameraData::decodeInputDone(FrameBuffer *buffer)
+{
+	/* Buffers cancelled by the decoder are released at stop time. */
+	if (buffer->metadata().status == FrameMetadata::FrameCancelled)
+		return;
+
+	video_->queueBuffer(buffer);
+}
+
+void UVCCameraData::decodeOutputDone(FrameBuffer *buffer)
+{
+	Request *request = buffer->request();
+
+	pipe()->completeBuffer(request, buffer);
+	pipe()->completeRequest(request);
+}
+
+void UVCCameraData::initMetadata(MediaDevice *media)
+{
+	/*
+	 * The uvcvideo driver exposes the UVC payload headers through a
+	 * metadata capture video node, alongside the default video node.
+	 */
+	for (MediaEntity *entity : media->entities()) {
+		if (entity->function() != MEDIA_ENT_F_IO_V4L ||
+		    entity->flags() & MEDIA_ENT_FL_DEFAULT)
+			continue;
+
+		std::unique_ptr<V4L2VideoDevice> video =
+			std::make_unique<V4L2VideoDevice>(entity);
+		if (video->open() || !video->caps().isMetaCapture())
+			continue;
+
+		V4L2DeviceFormat format;
+		format.fourcc = V4L2PixelFormat(V4L2_META_FMT_UVC);
+		if (video->setFormat(&format) ||
+		    format.fourcc != V4L2PixelFormat(V4L2_META_FMT_UVC))
+			continue;
+
+		metadata_ = std::move(video);
+		break;
+	}
+
+	if (!metadata_) {
+		LOG(UVC, Debug) << "No UVC metadata video node found";
+		return;
+	}
+
+	metadata_->bufferReady.connect(this, &UVCCameraData::metadataBufferReady);
+
+	readClockFrequency();
+
+	LOG(UVC, Debug)
+		<< "Using UVC metadata from " << metadata_->deviceNode()
+		<< ", device clock " << clockFrequency_ << " Hz";
+}
+
+/*
+ * Retrieve the frequency of the device clock that the PTS and SCR values of
+ * the UVC payload headers are expressed in. It is only reported by the
+ * dwClockFrequency field of the class-specific VideoControl interface header
+ * descriptor, read from the raw USB descriptors exposed in sysfs.
+ */
+void UVCCameraData::readClockFrequency()
+{
+	const std::string path = video_->devicePath();
+
+	/* The device path is the USB VideoControl interface. */
+	std::string name = utils::basename(path.c_str());
+	std::string::size_type pos = name.rfind('.');
+	if (pos == std::string::npos)
+		return;
+
+	unsigned int interface = strtoul(name.c_str() + pos + 1, nullptr, 10);
+
+	std::ifstream file(path + "/../descriptors", std::ios::binary);
+	if (!file.is_open())
+		return;
+
+	std::vector<uint8_t> desc{ std::istreambuf_iterator<char>(file),
+				   std::istreambuf_iterator<char>() };
+
+	int current = -1;
+	bool videoControl = false;
+
+	for (size_t offset = 0; offset + 2 <= desc.size();) {
+		const uint8_t *d = &desc[offset];
+		uint8_t length = d[0];
+
+		if (length < 2 || offset + length > desc.size())
+			break;
+
+		/* Standard interface descriptor. */
+		if (d[1] == 0x04 && length >= 9) {
+			current = d[2];
+			videoControl = d[5] == 0x0e && d[6] == 0x01;
+		}
+
+		/* Class-specific VC_HEADER descriptor. */
+		if (d[1] == 0x24 && d[2] == 0x01 && length >= 11 && videoControl &&
+		    current == static_cast<int>(interface)) {
+			clockFrequency_ = readLe32(&d[7]);
+			return;
+		}
+
+		offset += length;
+	}
+}
+
+int UVCCameraData::startMetadata()
+{
+	lastTimestamp_ = 0;
+	intervals_ = { 0, 0.0, 0.0, UINT64_MAX, 0 };
+
+	if (!metadata_)
+		return 0;
+
+	int ret = metadata_->allocateBuffers(kMetadataBufferCount, &metadataBuffers_);
+	if (ret < 0)
+		goto error;
+
+	for (std::unique_ptr<FrameBuffer> &buffer : metadataBuffers_) {
+		ret = metadata_->queueBuffer(buffer.get());
+		if (ret < 0)
+			goto error;
+	}
+
+	ret = metadata_->streamOn();
+	if (ret < 0)
+		goto error;
+
+	return 0;
+
+error:
+	LOG(UVC, Warning) << "Failed to start UVC metadata capture";
+	metadata_->releaseBuffers();
+	metadataBuffers_.clear();
+
+	return ret;
+}
+
+void UVCCameraData::stopMetadata()
+{
+	if (!metadataBuffers_.empty()) {
+		metadata_->streamOff();
+		metadata_->releaseBuffers();
+		metadataBuffers_.clear();
+
+		flushFrames();
+	}
+
+	if (intervals_.count) {
+		double mean = intervals_.sum / intervals_.count;
+		double variance = intervals_.sumSquares / intervals_.count - mean * mean;
+
+		LOG(UVC, Debug)
+			<< "Frame interval over " << intervals_.count
+			<< " frames: mean " << mean / 1000 << " us, jitter "
+			<< std::sqrt(std::max(variance, 0.0)) / 1000 << " us, min "
+			<< intervals_.min / 1000 << " us, max "
+			<< intervals_.max / 1000 << " us";
+	}
+}
+
+/*
+ * Compute the frame timestamp from the first block of a metadata buffer. The
+ * block carries the system time at which the first packet of the frame was
+ * received, and the UVC payload header of that packet. The PTS is the device
+ * clock at the start of exposure and the SCR the device clock when the packet
+ * was sent, their difference is subtracted from the reception time to
+ * estimate the start of exposure.
+ *
+ * Return 0 if the metadata is invalid.
+ */
+uint64_t UVCCameraData::frameTimestamp(const FrameBuffer *buffer) const
+{
+	if (buffer->metadata().status != FrameMetadata::FrameSuccess)
+		return 0;
+
+	MappedFrameBuffer mapped(buffer, MappedFrameBuffer::MapFlag::Read);
+	if (!mapped.isValid())
+		return 0;
+
+	Span<const uint8_t> data = mapped.planes()[0];
+	size_t size = std::min<size_t>(data.size(),
+				       buffer->metadata().planes()[0].bytesused);
+	if (size < kUVCMetadataHeaderSize)
+		return 0;
+
+	uint64_t ns;
+	memcpy(&ns, data.data(), sizeof(ns));
+
+	uint8_t length = data[10];
+	uint8_t flags = data[11];
+
+	/* The PTS precedes the SCR, whose first 4 bytes are the STC. */
+	if (!clockFrequency_ || (flags & (kUVCStreamPTS | kUVCStreamSCR)) !=
+				(kUVCStreamPTS | kUVCStreamSCR) ||
+	    length < 12 || size < kUVCMetadataHeaderSize + 10)
+		return ns;
+
+	uint32_t pts = readLe32(&data[kUVCMetadataHeaderSize]);
+	uint32_t stc = readLe32(&data[kUVCMetadataHeaderSize + 4]);
+
+	uint64_t latency = static_cast<uint64_t>(stc - pts) * 1000000000
+			 / clockFrequency_;
+	if (latency > kMaxDeviceLatency || latency >= ns)
+		return ns;
+
+	return ns - latency;
+}
+
+void UVCCameraData::metadataBufferReady(FrameBuffer *buffer)
+{
+	if (buffer->metadata().status == FrameMetadata::FrameCancelled)
+		return;
+
+	FrameTiming timing{ buffer->metadata().sequence, frameTimestamp(buffer) };
+	metadata_->queueBuffer(buffer);
+
+	/*
+	 * The metadata and video buffers of a frame share the same sequence
+	 * number, but can be dequeued in any order. Complete the frames that
+	 * were waiting for this metadata, or for metadata that got lost.
+	 */
+	while (!waitingBuffers_.empty()) {
+		FrameBuffer *frame = waitingBuffers_.front();
+		uint32_t sequence = frame->metadata().sequence;
+
+		if (sequence > timing.sequence)
+			return;
+
+		waitingBuffers_.pop_front();
+
+		if (sequence == timing.sequence && timing.timestamp) {
+			processFrame(frame, timing.timestamp);
+			return;
+		}
+
+		processFrame(frame, frame->metadata().timestamp);
+	}
+
+	timings_.push_back(timing);
+	if (timings_.size() > kMaxPendingTimings)
+		timings_.pop_front();
+}
+
 void UVCCameraData::bufferReady(FrameBuffer *buffer)
 {
+	const FrameMetadata &metadata = buffer->metadata();
+
+	if (metadataBuffers_.empty() ||
+	    metadata.status == FrameMetadata::FrameCancelled) {
+		processFrame(buffer, metadata.timestamp);
+		return;
+	}
+
+	/* Drop the timings of frames whose video buffer got lost. */
+	while (!timings_.empty() && timings_.front().sequence < metadata.sequence)
+		timings_.pop_front();
+
+	if (timings_.empty()) {
+		waitingBuffers_.push_back(buffer);
+		return;
+	}
+
+	uint64_t timestamp = metadata.timestamp;
+	if (timings_.front().sequence == metadata.sequence) {
+		if (timings_.front().timestamp)
+			timestamp = timings_.front().timestamp;
+		timings_.pop_front();
+	}
+
+	processFrame(buffer, timestamp);
+}
+
+/* Complete the frames waiting for metadata with their V4L2 timestamp. */
+void UVCCameraData::flushFrames()
+{
+	while (!waitingBuffers_.empty()) {
+		FrameBuffer *buffer = waitingBuffers_.front();
+		waitingBuffers_.pop_front();
+
+		processFrame(buffer, buffer->metadata().timestamp);
+	}
+
+	timings_.clear();
+}
+
+void UVCCameraData::processFrame(FrameBuffer *buffer, uint64_t timestamp)
+{
+	const FrameMetadata &metadata = buffer->metadata();
+	int64_t frameDuration = 0;
+
+	if (metadata.status == FrameMetadata::FrameSuccess) {
+		if (lastTimestamp_ && timestamp > lastTimestamp_) {
+			uint64_t interval = timestamp - lastTimestamp_;
+
+			intervals_.count++;
+			intervals_.sum += interval;
+			intervals_.sumSquares += static_cast<double>(interval) * interval;
+			intervals_.min = std::min(intervals_.min, interval);
+			intervals_.max = std::max(intervals_.max, interval);
+
+			frameDuration = interval / 1000;
+		}
+
+		lastTimestamp_ = timestamp;
+	}
+
+	if (decoding_) {
+		if (metadata.status == FrameMetadata::FrameCancelled)
+			return;
+
+		/* Drop the frame if no request is waiting for it. */
+		if (metadata.status != FrameMetadata::FrameSuccess ||
+		    pendingRequests_.empty()) {
+			video_->queueBuffer(buffer);
+			return;
+		}
+
+		Request *request = pendingRequests_.front();
+		pendingRequests_.pop();
+
+		request->metadata().set(controls::SensorTimestamp, timestamp);
+		if (frameDuration)
+			request->metadata().set(controls::FrameDuration, frameDuration);
+
+		FrameBuffer *output = request->findBuffer(&stream_);
+		if (queueDecode(buffer, output) < 0) {
+			output->_d()->metadata().status = FrameMetadata::FrameError;
+			pipe()->completeBuffer(request, output);
+			pipe()->completeRequest(request);
+			video_->queueBuffer(buffer);
+		}
+
+		return;
+	}
+
 	Request *request = buffer->request();
 
-	/* \todo Use the UVC metadata to calculate a more precise timestamp */
-	request->metadata().set(controls::SensorTimestamp,
-				buffer->metadata().timestamp);
+	request->metadata().set(controls::SensorTimestamp, timestamp);
+	if (frameDuration)
+		request->metadata().set(controls::FrameDuration, frameDuration);
 
 	pipe()->completeBuffer(request, buffer);
 	pipe()->completeRequest(request);
@@ -98,6 +98,10 @@ public:
 
 	bool match(DeviceEnumerator *enumerator) override;
 
+protected:
+	void statisticsDevice(Camera *camera,
+			      std::map<std::string, uint64_t> *counters) override;
+
 private:
 	int processControls(VimcCameraData *data, Request *request);
 
@@ -395,6 +399,15 @@ void PipelineHandlerVimc::stopDevice(Camera *camera)
 	data->video_->releaseBuffers();
 }
 
+void PipelineHandlerVimc::statisticsDevice(Camera *camera,
+					   std::map<std::string, uint64_t> *counters)
+{
+	VimcCameraData *data = cameraData(camera);
+
+	addStatistics(counters, "video", data->video_.get());
+	addStatistics(counters, "ipa", data->ipa_.get());
+}
+
 int PipelineHandlerVimc::processControls(VimcCameraData *data, Request *request)
 {
 	ControlList controls(data->sensor_->controls());
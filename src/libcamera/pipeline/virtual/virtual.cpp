@@ -0,0 +1,954 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Pipeline handler for virtual cameras
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <queue>
+#include <set>
+#include <string.h>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/file.h>
+#include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/color_space.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/formats.h>
+#include <libcamera/property_ids.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+
+#include <libcamera/ipa/ipa_interface.h>
+#include <libcamera/ipa/ipa_module_info.h>
+#include <libcamera/ipa/vimc_ipa_interface.h>
+#include <libcamera/ipa/vimc_ipa_proxy.h>
+
+#include "libcamera/internal/camera.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/yaml_parser.h"
+
+/*
+ * The virtual pipeline handler creates cameras that don't rely on any kernel
+ * device. Frames are generated from memory, at a configurable resolution and
+ * frame rate, and run through the vimc IPA module with a configurable
+ * processing time. This allows benchmarking and stress-testing the request,
+ * buffer and IPA handling of libcamera at high frame rates, deterministically
+ * and without hardware.
+ *
+ * The cameras are described in a YAML file, whose path is given by the
+ * LIBCAMERA_VIRTUAL_CONFIG_FILE environment variable. No virtual camera is
+ * created when the variable isn't set. The file format is
+ *
+ * %YAML 1.1
+ * ---
+ * version: 1
+ * cameras:
+ *   - id: Virtual0                  # Camera ID, mandatory
+ *     model: Virtual Camera         # Camera model, optional
+ *     size: [ 1280, 720 ]           # Frame size, mandatory
+ *     frame_rate: 240               # Frame rate in fps, mandatory
+ *     format: NV12                  # NV12 (default) or XRGB8888
+ *     file: /path/to/frames.yuv     # Raw frames to cycle through, optional
+ *     ipa_processing_time: 500      # IPA processing time in µs, optional
+ *
+ * When no file is specified, the frames contain colour bars. Otherwise the
+ * file contains one or more frames in the configured format and size, stored
+ * back to back with no padding, and loaded in memory when the camera is
+ * configured.
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Virtual)
+
+namespace {
+
+constexpr unsigned int kBufferCount = 4;
+constexpr unsigned int kParamsBufferId = 1;
+constexpr unsigned int kParamsBufferSize = 4096;
+constexpr Size kMinSize{ 16, 16 };
+constexpr Size kMaxSize{ 8192, 8192 };
+
+struct VirtualCameraConfig {
+	std::string id;
+	std::string model;
+	PixelFormat format;
+	Size size;
+	unsigned int frameRate;
+	std::string file;
+	unsigned int ipaProcessingTime;
+};
+
+/*
+ * Fill a frame with eight vertical colour bars: white, yellow, cyan, green,
+ * magenta, red, blue and black.
+ */
+std::vector<uint8_t> generateColourBars(const PixelFormat &format, const Size &size)
+{
+	static constexpr std::array<std::array<uint8_t, 3>, 8> kBars = { {
+		{ 255, 255, 255 },
+		{ 255, 255, 0 },
+		{ 0, 255, 255 },
+		{ 0, 255, 0 },
+		{ 255, 0, 255 },
+		{ 255, 0, 0 },
+		{ 0, 0, 255 },
+		{ 0, 0, 0 },
+	} };
+
+	const PixelFormatInfo &info = PixelFormatInfo::info(format);
+	std::vector<uint8_t> frame(info.frameSize(size));
+
+	auto bar = [&](unsigned int x) -> const std::array<uint8_t, 3> & {
+		return kBars[x * kBars.size() / size.width];
+	};
+
+	if (format == formats::XRGB8888) {
+		unsigned int stride = info.stride(size.width, 0);
+
+		for (unsigned int x = 0; x < size.width; ++x) {
+			const auto &[r, g, b] = bar(x);
+			uint8_t *pixel = &frame[x * 4];
+
+			pixel[0] = b;
+			pixel[1] = g;
+			pixel[2] = r;
+			pixel[3] = 0xff;
+		}
+
+		for (unsigned int y = 1; y < size.height; ++y)
+			memcpy(&frame[y * stride], &frame[0], stride);
+
+		return frame;
+	}
+
+	/* NV12, with BT.601 limited range encoding. */
+	unsigned int stride = info.stride(size.width, 0);
+	uint8_t *luma = frame.data();
+	uint8_t *chroma = luma + info.planeSize(size, 0);
+
+	for (unsigned int x = 0; x < size.width; ++x) {
+		const auto &[r, g, b] = bar(x);
+
+		luma[x] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+
+		if (x % 2)
+			continue;
+
+		chroma[x] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		chroma[x + 1] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+
+	for (unsigned int y = 1; y < size.height; ++y)
+		memcpy(&luma[y * stride], luma, stride);
+
+	for (unsigned int y = 1; y < (size.height + 1) / 2; ++y)
+		memcpy(&chroma[y * stride], chroma, stride);
+
+	return frame;
+}
+
+} /* namespace */
+
+/*
+ * The frame source runs in its own thread, and produces one frame per frame
+ * interval. Each frame is written to the buffer of the oldest queued request,
+ * or dropped if no request is queued, as a real sensor would do.
+ */
+class VirtualFrameSource : public Thread
+{
+public:
+	VirtualFrameSource(const std::string &name)
+		: Thread(name), stopping_(false), frames_(0), dropped_(0)
+	{
+	}
+
+	void configure(const PixelFormat &format, const Size &size,
+		       std::vector<uint8_t> frames, utils::Duration frameDuration);
+
+	void startStreaming();
+	std::vector<Request *> stopStreaming();
+
+	void queueRequest(Request *request, FrameBuffer *buffer);
+
+	uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+	uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+	Signal<Request *, uint64_t> frameReady;
+
+protected:
+	void run() override;
+
+private:
+	struct Job {
+		Request *request;
+		FrameBuffer *buffer;
+	};
+
+	void fill(const Job &job, unsigned int sequence, uint64_t timestamp);
+
+	std::vector<unsigned int> planeSizes_;
+	size_t frameSize_;
+	std::vector<uint8_t> data_;
+	std::chrono::nanoseconds frameDuration_;
+
+	/* Only accessed by the frame source thread while it is running. */
+	std::map<FrameBuffer *, std::unique_ptr<MappedFrameBuffer>> mappings_;
+
+	Mutex mutex_;
+	ConditionVariable cv_;
+	bool stopping_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::queue<Job> jobs_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	std::atomic<uint64_t> frames_;
+	std::atomic<uint64_t> dropped_;
+};
+
+void VirtualFrameSource::configure(const PixelFormat &format, const Size &size,
+				   std::vector<uint8_t> frames,
+				   utils::Duration frameDuration)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(format);
+
+	planeSizes_.clear();
+	for (unsigned int i = 0; i < info.numPlanes(); ++i)
+		planeSizes_.push_back(info.planeSize(size, i));
+
+	frameSize_ = info.frameSize(size);
+	data_ = std::move(frames);
+	frameDuration_ = std::chrono::duration_cast<std::chrono::nanoseconds>(frameDuration);
+}
+
+void VirtualFrameSource::startStreaming()
+{
+	{
+		MutexLocker locker(mutex_);
+		stopping_ = false;
+	}
+
+	frames_ = 0;
+	dropped_ = 0;
+
+	start();
+}
+
+std::vector<Request *> VirtualFrameSource::stopStreaming()
+{
+	{
+		MutexLocker locker(mutex_);
+		stopping_ = true;
+	}
+
+	cv_.notify_one();
+	wait();
+
+	mappings_.clear();
+
+	/* Return the requests that haven't been processed. */
+	std::vector<Request *> requests;
+
+	MutexLocker locker(mutex_);
+	while (!jobs_.empty()) {
+		requests.push_back(jobs_.front().request);
+		jobs_.pop();
+	}
+
+	return requests;
+}
+
+void VirtualFrameSource::queueRequest(Request *request, FrameBuffer *buffer)
+{
+	MutexLocker locker(mutex_);
+	jobs_.push({ request, buffer });
+}
+
+void VirtualFrameSource::run()
+{
+	utils::time_point next = utils::clock::now();
+	unsigned int sequence = 0;
+
+	MutexLocker locker(mutex_);
+
+	while (true) {
+		next += frameDuration_;
+
+		/*
+		 * If the frame source has fallen behind by more than a frame,
+		 * skip the missed frame intervals instead of producing the
+		 * frames back to back.
+		 */
+		utils::time_point now = utils::clock::now();
+		if (now > next + frameDuration_)
+			next = now;
+
+		cv_.wait_for(locker, next - now, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return stopping_;
+		});
+		if (stopping_)
+			break;
+
+		uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			next.time_since_epoch()).count();
+
+		frames_.fetch_add(1, std::memory_order_relaxed);
+
+		if (jobs_.empty()) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			sequence++;
+			continue;
+		}
+
+		Job job = jobs_.front();
+		jobs_.pop();
+
+		locker.unlock();
+
+		fill(job, sequence++, timestamp);
+		frameReady.emit(job.request, timestamp);
+
+		locker.lock();
+	}
+}
+
+void VirtualFrameSource::fill(const Job &job, unsigned int sequence,
+			      uint64_t timestamp)
+{
+	FrameBuffer *buffer = job.buffer;
+	FrameMetadata &metadata = buffer->_d()->metadata();
+
+	auto it = mappings_.find(buffer);
+	if (it == mappings_.end()) {
+		auto mapping = std::make_unique<MappedFrameBuffer>(buffer,
+								   MappedFrameBuffer::MapFlag::Write);
+		it = mappings_.emplace(buffer, std::move(mapping)).first;
+	}
+
+	const MappedFrameBuffer &mapping = *it->second;
+	if (!mapping.isValid() || mapping.planes().size() != planeSizes_.size()) {
+		LOG(Virtual, Error) << "Failed to map buffer";
+		metadata.status = FrameMetadata::FrameError;
+		return;
+	}
+
+	unsigned int frameCount = data_.size() / frameSize_;
+	const uint8_t *src = &data_[(sequence % frameCount) * frameSize_];
+
+	for (auto [i, plane] : utils::enumerate(mapping.planes())) {
+		size_t size = std::min<size_t>(plane.size(), planeSizes_[i]);
+		memcpy(plane.data(), src, size);
+		src += planeSizes_[i];
+
+		metadata.planes()[i].bytesused = size;
+	}
+
+	metadata.status = FrameMetadata::FrameSuccess;
+	metadata.sequence = sequence;
+	metadata.timestamp = timestamp;
+}
+
+class VirtualCameraData : public Camera::Private, public Object
+{
+public:
+	VirtualCameraData(PipelineHandler *pipe, const VirtualCameraConfig &config)
+		: Camera::Private(pipe), config_(config), source_(config.id)
+	{
+	}
+
+	int init(DmaBufAllocator &allocator);
+	int loadFrames(const StreamConfiguration &cfg);
+
+	void frameReady(Request *request, uint64_t timestamp);
+	void paramsBufferReady(unsigned int id, const Flags<ipa::vimc::TestFlag> flags);
+
+	VirtualCameraConfig config_;
+	utils::Duration frameDuration_;
+	Stream stream_;
+
+	VirtualFrameSource source_;
+
+	std::unique_ptr<ipa::vimc::IPAProxyVimc> ipa_;
+	std::unique_ptr<FrameBuffer> paramsBuffer_;
+	std::queue<Request *> ipaRequests_;
+};
+
+class VirtualCameraConfiguration : public CameraConfiguration
+{
+public:
+	VirtualCameraConfiguration(VirtualCameraData *data);
+
+	Status validate() override;
+
+private:
+	VirtualCameraData *data_;
+};
+
+class PipelineHandlerVirtual : public PipelineHandler
+{
+public:
+	PipelineHandlerVirtual(CameraManager *manager);
+
+	std::unique_ptr<CameraConfiguration> generateConfiguration(Camera *camera,
+								   Span<const StreamRole> roles) override;
+	int configure(Camera *camera, CameraConfiguration *config) override;
+
+	int exportFrameBuffers(Camera *camera, Stream *stream,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
+
+	int start(Camera *camera, const ControlList *controls) override;
+	void stopDevice(Camera *camera) override;
+
+	int queueRequestDevice(Camera *camera, Request *request) override;
+
+	bool match(DeviceEnumerator *enumerator) override;
+
+protected:
+	void statisticsDevice(Camera *camera,
+			      std::map<std::string, uint64_t> *counters) override;
+
+private:
+	int parseConfiguration(const std::string &filename,
+			       std::vector<VirtualCameraConfig> *configs);
+
+	VirtualCameraData *cameraData(Camera *camera)
+	{
+		return static_cast<VirtualCameraData *>(camera->_d());
+	}
+
+	/*
+	 * The virtual cameras are not backed by media devices that the
+	 * enumerator would report only once, make sure they are created a
+	 * single time.
+	 */
+	static bool created_;
+
+	DmaBufAllocator dmaHeap_;
+};
+
+bool PipelineHandlerVirtual::created_ = false;
+
+VirtualCameraConfiguration::VirtualCameraConfiguration(VirtualCameraData *data)
+	: CameraConfiguration(), data_(data)
+{
+}
+
+CameraConfiguration::Status VirtualCameraConfiguration::validate()
+{
+	const VirtualCameraConfig &config = data_->config_;
+	Status status = Valid;
+
+	if (config_.empty())
+		return Invalid;
+
+	if (orientation != Orientation::Rotate0) {
+		orientation = Orientation::Rotate0;
+		status = Adjusted;
+	}
+
+	/* Cap the number of entries to the available streams. */
+	if (config_.size() > 1) {
+		config_.resize(1);
+		status = Adjusted;
+	}
+
+	StreamConfiguration &cfg = config_[0];
+
+	/* The frames are generated in a single format and size. */
+	if (cfg.pixelFormat != config.format) {
+		LOG(Virtual, Debug) << "Adjusting format to " << config.format;
+		cfg.pixelFormat = config.format;
+		status = Adjusted;
+	}
+
+	if (cfg.size != config.size) {
+		LOG(Virtual, Debug) << "Adjusting size to " << config.size;
+		cfg.size = config.size;
+		status = Adjusted;
+	}
+
+	ColorSpace colorSpace = config.format == formats::NV12
+			      ? ColorSpace::Smpte170m : ColorSpace::Srgb;
+	if (cfg.colorSpace != colorSpace) {
+		cfg.colorSpace = colorSpace;
+		status = Adjusted;
+	}
+
+	if (!cfg.bufferCount)
+		cfg.bufferCount = kBufferCount;
+
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	cfg.stride = info.stride(cfg.size.width, 0);
+	cfg.frameSize = info.frameSize(cfg.size);
+
+	return status;
+}
+
+PipelineHandlerVirtual::PipelineHandlerVirtual(CameraManager *manager)
+	: PipelineHandler(manager),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
+{
+}
+
+std::unique_ptr<CameraConfiguration>
+PipelineHandlerVirtual::generateConfiguration(Camera *camera,
+					      Span<const StreamRole> roles)
+{
+	VirtualCameraData *data = cameraData(camera);
+	std::unique_ptr<CameraConfiguration> config =
+		std::make_unique<VirtualCameraConfiguration>(data);
+
+	if (roles.empty())
+		return config;
+
+	std::map<PixelFormat, std::vector<SizeRange>> formats;
+	formats[data->config_.format] = { SizeRange(data->config_.size) };
+
+	StreamConfiguration cfg(formats);
+	cfg.pixelFormat = data->config_.format;
+	cfg.size = data->config_.size;
+	cfg.bufferCount = kBufferCount;
+
+	config->addConfiguration(cfg);
+
+	config->validate();
+
+	return config;
+}
+
+int PipelineHandlerVirtual::configure(Camera *camera, CameraConfiguration *config)
+{
+	VirtualCameraData *data = cameraData(camera);
+	StreamConfiguration &cfg = config->at(0);
+
+	int ret = data->loadFrames(cfg);
+	if (ret)
+		return ret;
+
+	cfg.setStream(&data->stream_);
+
+	if (data->ipa_) {
+		std::map<unsigned int, IPAStream> streamConfig;
+		streamConfig.emplace(std::piecewise_construct,
+				     std::forward_as_tuple(0),
+				     std::forward_as_tuple(cfg.pixelFormat, cfg.size));
+
+		IPACameraSensorInfo sensorInfo{};
+		sensorInfo.model = data->config_.model;
+		sensorInfo.activeAreaSize = cfg.size;
+		sensorInfo.analogCrop = Rectangle(cfg.size);
+		sensorInfo.outputSize = cfg.size;
+
+		ret = data->ipa_->configure(sensorInfo, streamConfig, {});
+		if (ret)
+			return ret;
+
+		data->ipa_->setProcessingTime(data->config_.ipaProcessingTime);
+	}
+
+	return 0;
+}
+
+int PipelineHandlerVirtual::exportFrameBuffers([[maybe_unused]] Camera *camera,
+					       Stream *stream,
+					       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	const StreamConfiguration &cfg = stream->configuration();
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	unsigned int count = cfg.bufferCount;
+
+	if (!dmaHeap_.isValid())
+		return -ENODEV;
+
+	std::vector<UniqueFD> fds = dmaHeap_.alloc("frame", cfg.frameSize, count);
+	if (fds.size() != count) {
+		LOG(Virtual, Error) << "Failed to allocate dma_bufs";
+		return -ENOMEM;
+	}
+
+	for (UniqueFD &ufd : fds) {
+		SharedFD fd(std::move(ufd));
+
+		/* All planes are stored contiguously in a single dma_buf. */
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+		for (unsigned int i = 0; i < info.numPlanes(); ++i) {
+			FrameBuffer::Plane plane;
+			plane.fd = fd;
+			plane.offset = offset;
+			plane.length = info.planeSize(cfg.size, i);
+			planes.push_back(std::move(plane));
+
+			offset += plane.length;
+		}
+
+		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(planes)));
+	}
+
+	return count;
+}
+
+int PipelineHandlerVirtual::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	if (data->ipa_) {
+		/* Map the parameters buffer to the IPA, as in the vimc pipeline. */
+		data->ipa_->mapBuffers({ { kParamsBufferId,
+					   data->paramsBuffer_->planes() } });
+
+		int ret = data->ipa_->start();
+		if (ret) {
+			data->ipa_->unmapBuffers({ kParamsBufferId });
+			return ret;
+		}
+	}
+
+	data->source_.startStreaming();
+
+	return 0;
+}
+
+void PipelineHandlerVirtual::stopDevice(Camera *camera)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	std::vector<Request *> requests = data->source_.stopStreaming();
+
+	/* Deliver the frames that the source has completed before stopping. */
+	Thread::current()->dispatchMessages(Message::Type::InvokeMessage, data);
+
+	if (data->ipa_) {
+		data->ipa_->stop();
+		data->ipa_->unmapBuffers({ kParamsBufferId });
+
+		/* Complete the frames still being processed by the IPA. */
+		Thread::current()->dispatchMessages(Message::Type::InvokeMessage, data);
+
+		while (!data->ipaRequests_.empty()) {
+			Request *request = data->ipaRequests_.front();
+			data->ipaRequests_.pop();
+
+			completeBuffer(request, request->findBuffer(&data->stream_));
+			completeRequest(request);
+		}
+	}
+
+	for (Request *request : requests) {
+		FrameBuffer *buffer = request->findBuffer(&data->stream_);
+		buffer->_d()->cancel();
+		completeBuffer(request, buffer);
+		completeRequest(request);
+	}
+}
+
+void PipelineHandlerVirtual::statisticsDevice(Camera *camera,
+					      std::map<std::string, uint64_t> *counters)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	(*counters)["source.frames"] = data->source_.frames();
+	(*counters)["source.frames-dropped"] = data->source_.dropped();
+
+	if (data->ipa_)
+		addStatistics(counters, "ipa", data->ipa_.get());
+}
+
+int PipelineHandlerVirtual::queueRequestDevice(Camera *camera, Request *request)
+{
+	VirtualCameraData *data = cameraData(camera);
+	FrameBuffer *buffer = request->findBuffer(&data->stream_);
+	if (!buffer) {
+		LOG(Virtual, Error)
+			<< "Attempt to queue request with invalid stream";
+
+		return -ENOENT;
+	}
+
+	data->source_.queueRequest(request, buffer);
+
+	if (data->ipa_)
+		data->ipa_->queueRequest(request->sequence(), request->controls());
+
+	return 0;
+}
+
+int PipelineHandlerVirtual::parseConfiguration(const std::string &filename,
+					       std::vector<VirtualCameraConfig> *configs)
+{
+	File file(filename);
+	if (!file.open(File::OpenModeFlag::ReadOnly)) {
+		LOG(Virtual, Error)
+			<< "Failed to open configuration file '" << filename << "'";
+		return -ENOENT;
+	}
+
+	std::unique_ptr<YamlObject> root = YamlParser::parse(file);
+	if (!root) {
+		LOG(Virtual, Error) << "Failed to parse configuration file";
+		return -EINVAL;
+	}
+
+	std::optional<double> version = (*root)["version"].get<double>();
+	if (!version || *version != 1.0) {
+		LOG(Virtual, Error) << "Unsupported configuration file version";
+		return -EINVAL;
+	}
+
+	const YamlObject &cameras = (*root)["cameras"];
+	if (!cameras.isList()) {
+		LOG(Virtual, Error) << "Configuration file has no cameras list";
+		return -EINVAL;
+	}
+
+	std::set<std::string> ids;
+
+	for (const YamlObject &camera : cameras.asList()) {
+		VirtualCameraConfig config;
+
+		std::optional<std::string> id = camera["id"].get<std::string>();
+		if (!id || id->empty() || !ids.insert(*id).second) {
+			LOG(Virtual, Error) << "Missing or duplicated camera ID";
+			return -EINVAL;
+		}
+
+		config.id = *id;
+		config.model = camera["model"].get<std::string>("Virtual Camera");
+
+		std::optional<Size> size = camera["size"].get<Size>();
+		if (!size || size->width % 2 || size->height % 2 ||
+		    !SizeRange(kMinSize, kMaxSize).contains(*size)) {
+			LOG(Virtual, Error)
+				<< "Camera " << config.id << ": invalid frame size";
+			return -EINVAL;
+		}
+
+		config.size = *size;
+
+		config.frameRate = camera["frame_rate"].get<uint32_t>(0);
+		if (!config.frameRate) {
+			LOG(Virtual, Error)
+				<< "Camera " << config.id << ": invalid frame rate";
+			return -EINVAL;
+		}
+
+		std::string format = camera["format"].get<std::string>("NV12");
+		config.format = PixelFormat::fromString(format);
+		if (config.format != formats::NV12 &&
+		    config.format != formats::XRGB8888) {
+			LOG(Virtual, Error)
+				<< "Camera " << config.id
+				<< ": unsupported format " << format;
+			return -EINVAL;
+		}
+
+		config.file = camera["file"].get<std::string>("");
+		config.ipaProcessingTime = camera["ipa_processing_time"].get<uint32_t>(0);
+
+		configs->push_back(std::move(config));
+	}
+
+	return 0;
+}
+
+bool PipelineHandlerVirtual::match([[maybe_unused]] DeviceEnumerator *enumerator)
+{
+	if (created_)
+		return false;
+
+	created_ = true;
+
+	const char *configFile = utils::secure_getenv("LIBCAMERA_VIRTUAL_CONFIG_FILE");
+	if (!configFile || *configFile == '\0')
+		return false;
+
+	std::vector<VirtualCameraConfig> configs;
+	if (parseConfiguration(configFile, &configs) < 0)
+		return false;
+
+	if (!dmaHeap_.isValid()) {
+		LOG(Virtual, Error) << "No dma-buf provider available";
+		return false;
+	}
+
+	bool registered = false;
+
+	for (const VirtualCameraConfig &config : configs) {
+		std::unique_ptr<VirtualCameraData> data =
+			std::make_unique<VirtualCameraData>(this, config);
+
+		if (data->init(dmaHeap_))
+			continue;
+
+		/* Create and register the camera. */
+		std::set<Stream *> streams{ &data->stream_ };
+		std::shared_ptr<Camera> camera =
+			Camera::create(std::move(data), config.id, streams);
+		registerCamera(std::move(camera));
+
+		registered = true;
+	}
+
+	return registered;
+}
+
+int VirtualCameraData::init(DmaBufAllocator &allocator)
+{
+	frameDuration_ = utils::Duration(std::chrono::seconds(1)) / config_.frameRate;
+
+	source_.frameReady.connect(this, &VirtualCameraData::frameReady);
+
+	ipa_ = IPAManager::createIPA<ipa::vimc::IPAProxyVimc>(pipe(), 0, 0);
+	if (ipa_) {
+		UniqueFD fd = allocator.alloc("params", kParamsBufferSize);
+		if (!fd.isValid())
+			return -ENOMEM;
+
+		FrameBuffer::Plane plane;
+		plane.fd = SharedFD(std::move(fd));
+		plane.offset = 0;
+		plane.length = kParamsBufferSize;
+		paramsBuffer_ = std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{ plane });
+
+		ipa_->paramsBufferReady.connect(this, &VirtualCameraData::paramsBufferReady);
+
+		std::string conf = ipa_->configurationFile("vimc.conf");
+		Flags<ipa::vimc::TestFlag> outFlags;
+		int ret = ipa_->init(IPASettings{ conf, config_.model },
+				     ipa::vimc::IPAOperationInit, {}, &outFlags);
+		if (ret) {
+			LOG(Virtual, Error)
+				<< "Camera " << config_.id
+				<< ": failed to initialize the IPA";
+			return ret;
+		}
+	} else {
+		LOG(Virtual, Warning)
+			<< "Camera " << config_.id
+			<< ": no matching IPA found, running without IPA";
+	}
+
+	/* Initialise the supported controls. */
+	int64_t frameDuration = frameDuration_.get<std::micro>();
+	ControlInfoMap::Map ctrls;
+	ctrls.emplace(&controls::FrameDurationLimits,
+		      ControlInfo(frameDuration, frameDuration, frameDuration));
+	controlInfo_ = ControlInfoMap(std::move(ctrls), controls::controls);
+
+	/* Initialize the camera properties. */
+	properties_.set(properties::Location, properties::CameraLocationExternal);
+	properties_.set(properties::Model, config_.model);
+	properties_.set(properties::PixelArraySize, config_.size);
+	properties_.set(properties::PixelArrayActiveAreas,
+			{ Rectangle(config_.size) });
+
+	return 0;
+}
+
+int VirtualCameraData::loadFrames(const StreamConfiguration &cfg)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	size_t frameSize = info.frameSize(cfg.size);
+	std::vector<uint8_t> frames;
+
+	if (config_.file.empty()) {
+		frames = generateColourBars(cfg.pixelFormat, cfg.size);
+	} else {
+		File file(config_.file);
+		if (!file.open(File::OpenModeFlag::ReadOnly)) {
+			LOG(Virtual, Error)
+				<< "Failed to open frames file " << config_.file;
+			return -ENOENT;
+		}
+
+		ssize_t size = file.size();
+		if (size <= 0 || size % frameSize) {
+			LOG(Virtual, Error)
+				<< "Frames file " << config_.file
+				<< " doesn't contain " << cfg.size << "-"
+				<< cfg.pixelFormat << " frames";
+			return -EINVAL;
+		}
+
+		frames.resize(size);
+		if (file.read(frames) != size) {
+			LOG(Virtual, Error)
+				<< "Failed to read frames file " << config_.file;
+			return -EIO;
+		}
+
+		LOG(Virtual, Debug)
+			<< "Loaded " << size / frameSize << " frames from "
+			<< config_.file;
+	}
+
+	source_.configure(cfg.pixelFormat, cfg.size, std::move(frames),
+			  frameDuration_);
+
+	return 0;
+}
+
+void VirtualCameraData::frameReady(Request *request, uint64_t timestamp)
+{
+	PipelineHandlerVirtual *pipe =
+		static_cast<PipelineHandlerVirtual *>(this->pipe());
+
+	request->metadata().set(controls::SensorTimestamp, timestamp);
+	request->metadata().set(controls::FrameDuration,
+				frameDuration_.get<std::micro>());
+
+	/*
+	 * Complete the request when the IPA has processed the frame, to include
+	 * the IPA processing time and IPC round trip in the request latency.
+	 */
+	if (ipa_) {
+		ipaRequests_.push(request);
+		ipa_->fillParamsBuffer(request->sequence(), kParamsBufferId);
+		return;
+	}
+
+	pipe->completeBuffer(request, request->findBuffer(&stream_));
+	pipe->completeRequest(request);
+}
+
+void VirtualCameraData::paramsBufferReady([[maybe_unused]] unsigned int id,
+					  [[maybe_unused]] const Flags<ipa::vimc::TestFlag> flags)
+{
+	PipelineHandlerVirtual *pipe =
+		static_cast<PipelineHandlerVirtual *>(this->pipe());
+
+	/* The IPA processes the frames in order. */
+	if (ipaRequests_.empty())
+		return;
+
+	Request *request = ipaRequests_.front();
+	ipaRequests_.pop();
+
+	pipe->completeBuffer(request, request->findBuffer(&stream_));
+	pipe->completeRequest(request);
+}
+
+REGISTER_PIPELINE_HANDLER(PipelineHandlerVirtual, "virtual")
+
+} /* namespace libcamera */
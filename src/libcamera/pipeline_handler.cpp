@@ -7,6 +7,7 @@
 
 #include "libcamera/internal/pipeline_handler.h"
 
+#include <algorithm>
 #include <chrono>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
@@ -26,6 +27,7 @@
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/request.h"
 #include "libcamera/internal/tracepoints.h"
+#include "libcamera/internal/v4l2_videodevice.h"
 
 /**
  * \file pipeline_handler.h
@@ -145,9 +147,11 @@ MediaDevice *PipelineHandler::acquireMediaDevice(DeviceEnumerator *enumerator,
 
 /**
  * \brief Acquire exclusive access to the pipeline handler for the process
+ * \param[in] camera The camera for which to acquire the pipeline handler
  *
  * This function locks all the media devices used by the pipeline to ensure
- * that no other process can access them concurrently.
+ * that no other process can access them concurrently, and then calls
+ * acquireDevice() for the \a camera.
  *
  * Access to a pipeline handler may be acquired recursively from within the
  * same process. Every successful acquire() call shall be matched with a
@@ -157,26 +161,30 @@ MediaDevice *PipelineHandler::acquireMediaDevice(DeviceEnumerator *enumerator,
  * Pipeline handlers shall not call this function directly as the Camera class
  * handles access internally.
  *
- * \context This function is \threadsafe.
+ * \context This function is called from the CameraManager thread.
  *
  * \return True if the pipeline handler was acquired, false if another process
- * has already acquired it
+ * has already acquired it or if acquireDevice() failed
  * \sa release()
  */
-bool PipelineHandler::acquire()
+bool PipelineHandler::acquire(Camera *camera)
 {
 	MutexLocker locker(lock_);
 
-	if (useCount_) {
-		++useCount_;
-		return true;
+	if (!useCount_) {
+		for (std::shared_ptr<MediaDevice> &media : mediaDevices_) {
+			if (!media->lock()) {
+				unlockMediaDevices();
+				return false;
+			}
+		}
 	}
 
-	for (std::shared_ptr<MediaDevice> &media : mediaDevices_) {
-		if (!media->lock()) {
+	if (!acquireDevice(camera)) {
+		if (!useCount_)
 			unlockMediaDevices();
-			return false;
-		}
+
+		return false;
 	}
 
 	++useCount_;
@@ -212,6 +220,25 @@ void PipelineHandler::release(Camera *camera)
 	--useCount_;
 }
 
+/**
+ * \brief Acquire resources associated with this camera
+ * \param[in] camera The camera for which to acquire resources
+ *
+ * Pipeline handlers may override this in order to perform initialization
+ * operations when a camera is acquired, such as deferring the allocation of
+ * resources that are not needed to enumerate cameras from match() until they
+ * are used. Failures prevent the camera from being acquired.
+ *
+ * This function is called with the media devices locked, from the
+ * CameraManager thread.
+ *
+ * \return True on success, false otherwise
+ */
+bool PipelineHandler::acquireDevice([[maybe_unused]] Camera *camera)
+{
+	return true;
+}
+
 /**
  * \brief Release resources associated with this camera
  * \param[in] camera The camera for which to release resources
@@ -344,6 +371,9 @@ void PipelineHandler::stop(Camera *camera)
 	Camera::Private *data = camera->_d();
 	ASSERT(data->queuedRequests_.empty());
 
+	/* Deliver the completed requests held for coalescing. */
+	data->flushCompletedRequests();
+
 	data->requestSequence_ = 0;
 }
 
@@ -419,6 +449,29 @@ void PipelineHandler::queueRequest(Request *request)
 	request->_d()->prepare(300ms);
 }
 
+/**
+ * \brief Queue multiple requests
+ * \param[in] requests The requests to queue
+ *
+ * This function queues multiple capture requests to the pipeline handler, in
+ * order, as if queueRequest() was called for each of them. All the requests
+ * are added to the internal list of waiting requests before any of them is
+ * prepared.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::queueRequests(const std::vector<Request *> &requests)
+{
+	for (Request *request : requests) {
+		LIBCAMERA_TRACEPOINT(request_queue, request);
+
+		waitingRequests_.push(request);
+	}
+
+	for (Request *request : requests)
+		request->_d()->prepare(300ms);
+}
+
 /**
  * \brief Queue one requests to the device
  */
@@ -432,11 +485,37 @@ void PipelineHandler::doQueueRequest(Request *request)
 
 	request->_d()->sequence_ = data->requestSequence_++;
 
+	CameraStatistics &stats = data->statistics_;
+	stats.requestsQueued++;
+	stats.maxQueueDepth = std::max<unsigned int>(stats.maxQueueDepth,
+						     data->queuedRequests_.size());
+
 	if (request->_d()->cancelled_) {
 		completeRequest(request);
 		return;
 	}
 
+	/*
+	 * Skip the buffers of the streams that have a frame rate divisor when
+	 * they're not captured for this request, the pipeline handler then
+	 * doesn't produce the corresponding output. Requests that only contain
+	 * skipped buffers are completed immediately.
+	 */
+	uint32_t sequence = request->_d()->sequence_;
+	for (const Stream *stream : camera->streams()) {
+		unsigned int divisor = stream->configuration().frameRateDivisor;
+		if (divisor <= 1 || !(sequence % divisor))
+			continue;
+
+		if (request->findBuffer(stream))
+			request->_d()->skipBuffer(stream);
+	}
+
+	if (!request->hasPendingBuffers()) {
+		completeRequest(request);
+		return;
+	}
+
 	int ret = queueRequestDevice(camera, request);
 	if (ret) {
 		request->_d()->cancel();
@@ -499,6 +578,42 @@ void PipelineHandler::doQueueRequests()
 bool PipelineHandler::completeBuffer(Request *request, FrameBuffer *buffer)
 {
 	Camera *camera = request->_d()->camera();
+	Camera::Private *data = camera->_d();
+
+	const Stream *stream = nullptr;
+	for (const auto &[s, b] : request->buffers()) {
+		if (b == buffer) {
+			stream = s;
+			break;
+		}
+	}
+
+	if (stream) {
+		CameraStatistics::StreamStatistics &stats =
+			data->statistics_.streams[stream];
+		const FrameMetadata &metadata = buffer->metadata();
+
+		switch (metadata.status) {
+		case FrameMetadata::FrameSuccess: {
+			stats.framesCompleted++;
+
+			auto [iter, inserted] = data->lastSequence_.try_emplace(stream,
+										metadata.sequence);
+			if (!inserted) {
+				if (metadata.sequence > iter->second + 1)
+					stats.framesDropped += metadata.sequence - iter->second - 1;
+				iter->second = metadata.sequence;
+			}
+			break;
+		}
+		case FrameMetadata::FrameError:
+			stats.framesFailed++;
+			break;
+		default:
+			break;
+		}
+	}
+
 	camera->bufferCompleted.emit(request, buffer);
 	return request->_d()->completeBuffer(buffer);
 }
@@ -532,10 +647,104 @@ void PipelineHandler::completeRequest(Request *request)
 
 		ASSERT(!req->hasPendingBuffers());
 		data->queuedRequests_.pop_front();
+
+		if (req->status() == Request::RequestCancelled)
+			data->statistics_.requestsCancelled++;
+		else
+			data->statistics_.requestsCompleted++;
+
 		camera->requestComplete(req);
 	}
 }
 
+/**
+ * \brief Retrieve the runtime performance counters of a camera
+ * \param[in] camera The camera
+ *
+ * This function returns the generic counters maintained for the \a camera,
+ * completed with the pipeline handler specific counters reported by
+ * statisticsDevice().
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return The camera statistics
+ */
+CameraStatistics PipelineHandler::statistics(Camera *camera)
+{
+	Camera::Private *data = camera->_d();
+
+	CameraStatistics stats = data->statistics_;
+	stats.queueDepth = data->queuedRequests_.size();
+
+	statisticsDevice(camera, &stats.counters);
+
+	return stats;
+}
+
+/**
+ * \brief Report the pipeline handler specific counters of a camera
+ * \param[in] camera The camera
+ * \param[out] counters The counters, indexed by name
+ *
+ * Pipeline handlers may override this function to report counters specific to
+ * their hardware, such as the IPA or ISP processing times, through the
+ * CameraStatistics::counters map. The addStatistics() helpers report the
+ * counters of the common components. The default implementation reports no
+ * counter.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::statisticsDevice([[maybe_unused]] Camera *camera,
+				       [[maybe_unused]] std::map<std::string, uint64_t> *counters)
+{
+}
+
+/**
+ * \brief Report the processing time counters of an IPA
+ * \param[out] counters The counters, indexed by name
+ * \param[in] name The name prefix of the counters
+ * \param[in] ipa The IPA proxy
+ *
+ * Add the "<name>.calls" and "<name>.processing-time-us" counters to
+ * \a counters.
+ */
+void PipelineHandler::addStatistics(std::map<std::string, uint64_t> *counters,
+				    const std::string &name, const IPAProxy *ipa)
+{
+	if (!ipa)
+		return;
+
+	IPAProxy::Statistics stats = ipa->statistics();
+
+	(*counters)[name + ".calls"] = stats.calls;
+	(*counters)[name + ".processing-time-us"] = stats.processingTime.get<std::micro>();
+}
+
+/**
+ * \brief Report the counters of a video device
+ * \param[out] counters The counters, indexed by name
+ * \param[in] name The name prefix of the counters
+ * \param[in] video The video device
+ *
+ * Add the "<name>.buffer-cache-hits", "<name>.buffer-cache-misses",
+ * "<name>.buffer-cache-evictions" and "<name>.dequeue-timeouts" counters to
+ * \a counters.
+ */
+void PipelineHandler::addStatistics(std::map<std::string, uint64_t> *counters,
+				    const std::string &name,
+				    const V4L2VideoDevice *video)
+{
+	if (!video)
+		return;
+
+	V4L2VideoDevice::Statistics stats = video->statistics();
+
+	(*counters)[name + ".buffer-cache-hits"] = stats.cache.hits;
+	(*counters)[name + ".buffer-cache-misses"] = stats.cache.misses;
+	(*counters)[name + ".buffer-cache-evictions"] = stats.cache.evictions;
+	(*counters)[name + ".dequeue-timeouts"] = stats.dequeueTimeouts;
+}
+
 /**
  * \brief Retrieve the absolute path to a platform configuration file
  * \param[in] subdir The pipeline handler specific subdirectory name
@@ -605,9 +814,14 @@ void PipelineHandler::registerCamera(std::shared_ptr<Camera> camera)
 {
 	cameras_.push_back(camera);
 
-	if (mediaDevices_.empty())
-		LOG(Pipeline, Fatal)
-			<< "Registering camera with no media devices!";
+	if (mediaDevices_.empty()) {
+		/*
+		 * Virtual cameras have no media device, and thus no system
+		 * device to report.
+		 */
+		manager_->_d()->addCamera(std::move(camera));
+		return;
+	}
 
 	/*
 	 * Walk the entity list and map the devnums of all capture video nodes
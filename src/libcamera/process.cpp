@@ -24,6 +24,8 @@
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
 
+#include "libcamera/internal/ipc_unixsocket.h"
+
 /**
  * \file process.h
  * \brief Process object
@@ -39,6 +41,12 @@ LOG_DEFINE_CATEGORY(Process)
  *
  * The ProcessManager singleton keeps track of all created Process instances,
  * and manages the signal handling involved in terminating processes.
+ *
+ * It also keeps a pool of spare processes, started ahead of time and connected
+ * through an IPC channel, that users can take over to avoid the process start
+ * latency. At most one spare process is kept for each key. The spare process
+ * for a key is terminated when its last user releases it, and all spare
+ * processes are terminated when the ProcessManager is destroyed.
  */
 
 namespace {
@@ -145,6 +153,8 @@ ProcessManager::ProcessManager()
 
 ProcessManager::~ProcessManager()
 {
+	spares_.clear();
+
 	sigaction(SIGCHLD, &oldsa_, NULL);
 
 	delete sigEvent_;
@@ -190,6 +200,86 @@ const struct sigaction &ProcessManager::oldsa() const
 }
 
 
+/**
+ * \brief Store a spare process
+ * \param[in] key The key identifying the kind of process
+ * \param[in] process The process
+ * \param[in] socket The IPC channel connected to the process
+ *
+ * This function adds the \a process and its IPC channel \a socket to the pool
+ * of spare processes, for later retrieval with takeSpare(). Any spare process
+ * already stored for the same \a key is terminated and replaced. The \a
+ * process is terminated immediately if the \a key has no user.
+ */
+void ProcessManager::addSpare(const std::string &key,
+			      std::unique_ptr<Process> process,
+			      std::unique_ptr<IPCUnixSocket> socket)
+{
+	if (!spareUsers_.count(key))
+		return;
+
+	spares_[key] = { std::move(process), std::move(socket) };
+}
+
+/**
+ * \brief Take a spare process out of the pool
+ * \param[in] key The key identifying the kind of process
+ * \param[out] process The process
+ * \param[out] socket The IPC channel connected to the process
+ *
+ * Spare processes that have terminated since they were stored are discarded.
+ *
+ * This function registers the caller as a user of the spare processes for \a
+ * key, regardless of whether a spare process is available. Every call shall be
+ * balanced by a call to releaseSpare() when the caller doesn't need spare
+ * processes for \a key anymore.
+ *
+ * \return True if a running spare process has been returned in \a process and
+ * \a socket, false otherwise
+ */
+bool ProcessManager::takeSpare(const std::string &key,
+			       std::unique_ptr<Process> *process,
+			       std::unique_ptr<IPCUnixSocket> *socket)
+{
+	spareUsers_[key]++;
+
+	auto it = spares_.find(key);
+	if (it == spares_.end())
+		return false;
+
+	Spare spare = std::move(it->second);
+	spares_.erase(it);
+
+	if (spare.process->exitStatus() != Process::NotExited)
+		return false;
+
+	*process = std::move(spare.process);
+	*socket = std::move(spare.socket);
+
+	return true;
+}
+
+/**
+ * \brief Release the spare processes for a key
+ * \param[in] key The key identifying the kind of process
+ *
+ * This function unregisters a user of the spare processes for \a key,
+ * previously registered by takeSpare(). When the last user is unregistered,
+ * the spare process stored for \a key, if any, is terminated.
+ */
+void ProcessManager::releaseSpare(const std::string &key)
+{
+	auto it = spareUsers_.find(key);
+	if (it == spareUsers_.end())
+		return;
+
+	if (--it->second)
+		return;
+
+	spareUsers_.erase(it);
+	spares_.erase(key);
+}
+
 /**
  * \class Process
  * \brief Process object
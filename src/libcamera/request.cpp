@@ -7,8 +7,13 @@
 
 #include "libcamera/internal/request.h"
 
+#include <algorithm>
+#include <array>
+#include <errno.h>
 #include <map>
 #include <sstream>
+#include <string.h>
+#include <sys/epoll.h>
 
 #include <libcamera/base/log.h>
 
@@ -92,10 +97,12 @@ bool Request::Private::completeBuffer(FrameBuffer *buffer)
 {
 	LIBCAMERA_TRACEPOINT(request_complete_buffer, this, buffer);
 
-	int ret = pending_.erase(buffer);
-	ASSERT(ret == 1);
+	auto it = std::find(pending_.begin(), pending_.end(), buffer);
+	ASSERT(it != pending_.end());
+	pending_.erase(it);
 
 	buffer->_d()->setRequest(nullptr);
+	buffer->_d()->signalCompletionFence();
 
 	if (buffer->metadata().status == FrameMetadata::FrameCancelled)
 		cancelled_ = true;
@@ -103,6 +110,34 @@ bool Request::Private::completeBuffer(FrameBuffer *buffer)
 	return !hasPendingBuffers();
 }
 
+/**
+ * \brief Skip the buffer of a stream for this request
+ * \param[in] stream The stream
+ *
+ * Remove the buffer for \a stream from the request before it gets queued to
+ * the pipeline handler, and mark it as cancelled. This is used for streams
+ * with a frame rate divisor, on the frames for which the stream isn't
+ * captured. The buffer is added back to the request when the request
+ * completes, and doesn't affect the request status.
+ */
+void Request::Private::skipBuffer(const Stream *stream)
+{
+	Request *request = _o<Request>();
+
+	auto it = request->bufferMap_.find(stream);
+	ASSERT(it != request->bufferMap_.end());
+
+	FrameBuffer *buffer = it->second;
+	skippedNodes_.push_back(request->bufferMap_.extract(it));
+
+	pending_.erase(std::find(pending_.begin(), pending_.end(), buffer));
+
+	buffer->_d()->cancel();
+	buffer->_d()->setRequest(nullptr);
+	buffer->_d()->signalCompletionFence();
+	camera_->bufferCompleted.emit(request, buffer);
+}
+
 /**
  * \brief Complete a queued request
  *
@@ -119,9 +154,13 @@ void Request::Private::complete()
 
 	request->status_ = cancelled_ ? RequestCancelled : RequestComplete;
 
+	for (Request::BufferMap::node_type &node : skippedNodes_)
+		request->bufferMap_.insert(std::move(node));
+	skippedNodes_.clear();
+
 	LOG(Request, Debug) << request->toString();
 
-	LIBCAMERA_TRACEPOINT(request_complete, this);
+	LIBCAMERA_TRACEPOINT(request_complete, request);
 }
 
 void Request::Private::doCancelRequest()
@@ -130,13 +169,38 @@ void Request::Private::doCancelRequest()
 
 	for (FrameBuffer *buffer : pending_) {
 		buffer->_d()->cancel();
+		buffer->_d()->signalCompletionFence();
 		camera_->bufferCompleted.emit(request, buffer);
 	}
 
 	cancelled_ = true;
 	pending_.clear();
-	notifiers_.clear();
-	timer_.reset();
+	abortFences();
+}
+
+/**
+ * \brief Preallocate the request internal data for a set of streams
+ * \param[in] streams The streams the request will capture from
+ *
+ * Reserve memory for one buffer per stream in \a streams, to avoid memory
+ * allocations when buffers are added to the request with Request::addBuffer().
+ * The memory is retained when the request is reused.
+ */
+void Request::Private::reserve(const std::set<const Stream *> &streams)
+{
+	pending_.reserve(streams.size());
+	spareNodes_.reserve(streams.size());
+	if (streamBuffers_.size() < streams.size())
+		streamBuffers_.resize(streams.size());
+
+	Request::BufferMap map;
+	for (const Stream *stream : streams) {
+		if (spareNodes_.size() >= streams.size())
+			break;
+
+		map.emplace(stream, nullptr);
+		spareNodes_.push_back(map.extract(map.begin()));
+	}
 }
 
 /**
@@ -149,9 +213,10 @@ void Request::Private::doCancelRequest()
  */
 void Request::Private::cancel()
 {
-	LIBCAMERA_TRACEPOINT(request_cancel, this);
-
 	Request *request = _o<Request>();
+
+	LIBCAMERA_TRACEPOINT(request_cancel, request);
+
 	ASSERT(request->status() == RequestPending);
 
 	doCancelRequest();
@@ -169,8 +234,7 @@ void Request::Private::reset()
 	cancelled_ = false;
 	prepared_ = false;
 	pending_.clear();
-	notifiers_.clear();
-	timer_.reset();
+	abortFences();
 }
 
 /*
@@ -202,9 +266,13 @@ void Request::Private::emitPrepareCompleted()
  * the asynchronous event completion.
  *
  * As we currently only handle fences, the function emits the prepared signal
- * immediately if there are no fences to wait on. Otherwise the prepared signal
- * is emitted when all fences have been signalled or the optional timeout has
- * expired.
+ * immediately if there are no fences to wait on, or if all the fences have
+ * already been signalled. Otherwise the prepared signal is emitted when all
+ * fences have been signalled or the optional timeout has expired.
+ *
+ * All the fences of the request are monitored through a single epoll instance,
+ * retained across request reuse, and a single event notifier. Waiting on
+ * fences thus doesn't cost one event notifier per buffer.
  *
  * If not all the fences have been correctly signalled or the optional timeout
  * has expired the Request will be cancelled and the Request::prepared signal
@@ -215,34 +283,59 @@ void Request::Private::emitPrepareCompleted()
  */
 void Request::Private::prepare(std::chrono::milliseconds timeout)
 {
-	/* Create and connect one notifier for each synchronization fence. */
 	for (FrameBuffer *buffer : pending_) {
 		const Fence *fence = buffer->_d()->fence();
 		if (!fence)
 			continue;
 
-		std::unique_ptr<EventNotifier> notifier =
-			std::make_unique<EventNotifier>(fence->fd().get(),
-							EventNotifier::Read);
+		if (!fencesFd_.isValid()) {
+			fencesFd_ = UniqueFD(epoll_create1(EPOLL_CLOEXEC));
+			if (!fencesFd_.isValid()) {
+				int ret = errno;
+				LOG(Request, Error)
+					<< "Failed to create fences epoll instance: "
+					<< strerror(ret);
+				cancel();
+				emitPrepareCompleted();
+				return;
+			}
+		}
 
-		notifier->activated.connect(this, [this, buffer] {
-							notifierActivated(buffer);
-					    });
+		struct epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = buffer;
+
+		if (epoll_ctl(fencesFd_.get(), EPOLL_CTL_ADD, fence->fd().get(),
+			      &event) < 0) {
+			int ret = errno;
+			LOG(Request, Error)
+				<< "Failed to wait on fence: " << strerror(ret);
+			cancel();
+			emitPrepareCompleted();
+			return;
+		}
 
-		notifiers_[buffer] = std::move(notifier);
+		pendingFences_++;
 	}
 
-	if (notifiers_.empty()) {
+	/*
+	 * Process the fences that have already been signalled, and complete
+	 * the preparation synchronously if no fence is left.
+	 */
+	if (processFences()) {
 		emitPrepareCompleted();
 		return;
 	}
 
 	/*
-	 * In case a timeout is specified, create a timer and set it up.
-	 *
-	 * The timer must be created here instead of in the Request constructor,
-	 * in order to be bound to the pipeline handler thread.
+	 * Create the notifier and the timer here instead of in the Request
+	 * constructor, in order to bind them to the pipeline handler thread.
 	 */
+	notifier_ = std::make_unique<EventNotifier>(fencesFd_.get(),
+						    EventNotifier::Read);
+	notifier_->activated.connect(this, &Request::Private::fencesActivated);
+
+	/* In case a timeout is specified, create a timer and set it up. */
 	if (timeout != 0ms) {
 		timer_ = std::make_unique<Timer>();
 		timer_->timeout.connect(this, &Request::Private::timeout);
@@ -263,35 +356,72 @@ void Request::Private::prepare(std::chrono::milliseconds timeout)
  * if they have failed preparing.
  */
 
-void Request::Private::notifierActivated(FrameBuffer *buffer)
+/*
+ * Release the fences that have been signalled. Return true if all the fences
+ * have been signalled, false otherwise.
+ */
+bool Request::Private::processFences()
 {
-	/* Close the fence if successfully signalled. */
-	ASSERT(buffer);
-	buffer->releaseFence();
+	Request *request = _o<Request>();
+	std::array<struct epoll_event, 8> events;
 
-	/* Remove the entry from the map and check if other fences are pending. */
-	auto it = notifiers_.find(buffer);
-	ASSERT(it != notifiers_.end());
-	notifiers_.erase(it);
+	while (pendingFences_) {
+		int ret = epoll_wait(fencesFd_.get(), events.data(),
+				     events.size(), 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+
+		for (int i = 0; i < ret; ++i) {
+			FrameBuffer *buffer = static_cast<FrameBuffer *>(events[i].data.ptr);
+			const Fence *fence = buffer->_d()->fence();
+
+			/* Close the fence if successfully signalled. */
+			epoll_ctl(fencesFd_.get(), EPOLL_CTL_DEL,
+				  fence->fd().get(), nullptr);
+			buffer->releaseFence();
+			pendingFences_--;
+
+			LOG(Request, Debug)
+				<< "Request " << request->cookie() << " buffer "
+				<< buffer << " fence signalled";
+		}
+	}
 
-	Request *request = _o<Request>();
-	LOG(Request, Debug)
-		<< "Request " << request->cookie() << " buffer " << buffer
-		<< " fence signalled";
+	return !pendingFences_;
+}
 
-	if (!notifiers_.empty())
+void Request::Private::fencesActivated()
+{
+	if (!processFences())
 		return;
 
 	/* All fences completed, delete the timer and emit the prepared signal. */
+	notifier_.reset();
 	timer_.reset();
 	emitPrepareCompleted();
 }
 
+void Request::Private::abortFences()
+{
+	notifier_.reset();
+	timer_.reset();
+
+	/*
+	 * Drop the epoll instance to stop monitoring the fences that are left
+	 * in the buffers, a new one will be created when needed.
+	 */
+	if (pendingFences_) {
+		fencesFd_.reset();
+		pendingFences_ = 0;
+	}
+}
+
 void Request::Private::timeout()
 {
 	/* A timeout can only happen if there are fences not yet signalled. */
-	ASSERT(!notifiers_.empty());
-	notifiers_.clear();
+	ASSERT(pendingFences_);
 
 	Request *request = _o<Request>();
 	LOG(Request, Debug) << "Request prepare timeout: " << request->cookie();
@@ -389,10 +519,18 @@ void Request::reuse(ReuseFlag flags)
 		for (auto pair : bufferMap_) {
 			FrameBuffer *buffer = pair.second;
 			buffer->_d()->setRequest(this);
-			_d()->pending_.insert(buffer);
+			_d()->pending_.push_back(buffer);
 		}
 	} else {
-		bufferMap_.clear();
+		/*
+		 * Keep the map nodes to reuse them in addBuffer(), avoiding
+		 * memory allocations when the request is reused.
+		 */
+		while (!bufferMap_.empty())
+			_d()->spareNodes_.push_back(bufferMap_.extract(bufferMap_.begin()));
+
+		std::fill(_d()->streamBuffers_.begin(), _d()->streamBuffers_.end(),
+			  std::pair<const Stream *, FrameBuffer *>{});
 	}
 
 	status_ = RequestPending;
@@ -474,8 +612,35 @@ int Request::addBuffer(const Stream *stream, FrameBuffer *buffer,
 	}
 
 	buffer->_d()->setRequest(this);
-	_d()->pending_.insert(buffer);
-	bufferMap_[stream] = buffer;
+	_d()->pending_.push_back(buffer);
+
+	std::vector<BufferMap::node_type> &spareNodes = _d()->spareNodes_;
+	if (!spareNodes.empty()) {
+		BufferMap::node_type node = std::move(spareNodes.back());
+		spareNodes.pop_back();
+
+		node.key() = stream;
+		node.mapped() = buffer;
+		bufferMap_.insert(std::move(node));
+	} else {
+		bufferMap_[stream] = buffer;
+	}
+
+	/*
+	 * Store the buffer in the slot of the stream too, for fast lookups in
+	 * findBuffer(). The slot of a stream may be occupied by another stream
+	 * if the camera has been reconfigured since the buffer of that stream
+	 * was added, in which case lookups fall back to the map.
+	 */
+	const unsigned int index = stream->index();
+	if (index != Stream::kInvalidIndex) {
+		std::vector<std::pair<const Stream *, FrameBuffer *>> &slots =
+			_d()->streamBuffers_;
+		if (index >= slots.size())
+			slots.resize(index + 1);
+		if (!slots[index].first)
+			slots[index] = { stream, buffer };
+	}
 
 	/*
 	 * Make sure the fence has been extracted from the buffer
@@ -504,11 +669,22 @@ int Request::addBuffer(const Stream *stream, FrameBuffer *buffer,
 /**
  * \brief Return the buffer associated with a stream
  * \param[in] stream The stream the buffer is associated to
+ *
+ * Buffers are stored in a flat array indexed by Stream::index() in addition to
+ * the buffer map, the lookup is thus a constant-time operation for the streams
+ * of the active camera configuration.
+ *
  * \return The buffer associated with the stream, or nullptr if the stream is
  * not part of this request
  */
 FrameBuffer *Request::findBuffer(const Stream *stream) const
 {
+	const std::vector<std::pair<const Stream *, FrameBuffer *>> &slots =
+		_d()->streamBuffers_;
+	const unsigned int index = stream ? stream->index() : Stream::kInvalidIndex;
+	if (index < slots.size() && slots[index].first == stream)
+		return slots[index].second;
+
 	const auto it = bufferMap_.find(stream);
 	if (it == bufferMap_.end())
 		return nullptr;
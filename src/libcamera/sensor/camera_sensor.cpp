@@ -23,6 +23,7 @@
 
 #include "libcamera/internal/bayer_format.h"
 #include "libcamera/internal/camera_lens.h"
+#include "libcamera/internal/camera_sensor_cache.h"
 #include "libcamera/internal/camera_sensor_properties.h"
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/sysfs.h"
@@ -36,6 +37,56 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(CameraSensor)
 
+/**
+ * \struct CameraSensorMode
+ * \brief A sensor output mode and its timing limits
+ *
+ * The CameraSensor class records one CameraSensorMode for every media bus code
+ * and frame size supported by the sensor. The timing fields are probed by
+ * applying the mode to the sensor at initialization time, and are set to 0
+ * when the sensor doesn't report them.
+ *
+ * \var CameraSensorMode::code
+ * \brief The media bus code
+ *
+ * \var CameraSensorMode::size
+ * \brief The sensor output size
+ *
+ * \var CameraSensorMode::bitsPerPixel
+ * \brief The number of bits per pixel on the bus
+ *
+ * \var CameraSensorMode::analogCrop
+ * \brief The analogue crop rectangle, relative to the active pixel area
+ *
+ * \var CameraSensorMode::binning
+ * \brief The horizontal and vertical ratios between the analogue crop
+ * rectangle and the output size
+ *
+ * The ratio is 1 for modes that don't bin or skip pixels.
+ *
+ * \var CameraSensorMode::pixelRate
+ * \brief The pixel rate in pixels per second
+ *
+ * \var CameraSensorMode::minLineLength
+ * \brief The minimum line length in pixels, including the horizontal blanking
+ *
+ * \var CameraSensorMode::minFrameLength
+ * \brief The minimum frame length in lines, including the vertical blanking
+ */
+
+/**
+ * \brief Compute the maximum frame rate of the mode
+ * \return The maximum frame rate in frames per second, or 0 if unknown
+ */
+float CameraSensorMode::maxFrameRate() const
+{
+	uint64_t frameLength = static_cast<uint64_t>(minLineLength) * minFrameLength;
+	if (!pixelRate || !frameLength)
+		return 0.0f;
+
+	return static_cast<float>(pixelRate) / frameLength;
+}
+
 /**
  * \class CameraSensor
  * \brief A camera sensor based on V4L2 subdevices
@@ -121,8 +172,18 @@ int CameraSensor::init()
 		ctrls.set(V4L2_CID_VFLIP, 0);
 	subdev_->setControls(&ctrls);
 
-	/* Enumerate, sort and cache media bus codes and sizes. */
-	formats_ = subdev_->formats(pad_);
+	/*
+	 * Enumerate, sort and cache media bus codes and sizes. The enumeration
+	 * is skipped if the formats are found in the persistent sensor cache.
+	 */
+	CameraSensorCache cache;
+	formats_ = cache.formats(entity_, pad_);
+	if (formats_.empty()) {
+		formats_ = subdev_->formats(pad_);
+		if (!formats_.empty())
+			cache.setFormats(entity_, pad_, formats_);
+	}
+
 	if (formats_.empty()) {
 		LOG(CameraSensor, Error) << "No image format found";
 		return -EINVAL;
@@ -184,6 +245,8 @@ int CameraSensor::init()
 	if (ret)
 		return ret;
 
+	initModes();
+
 	/*
 	 * Set HBLANK to the minimum to start with a well-defined line length,
 	 * allowing IPA modules that do not modify HBLANK to use the sensor
@@ -543,6 +606,76 @@ int CameraSensor::initProperties()
  *
  * \todo Handle MEDIA_ENT_F_FLASH too.
  */
+/*
+ * Record the timing limits of every sensor mode. The pixel rate and blanking
+ * limits depend on the configured format, so each mode is applied in turn and
+ * the original format restored afterwards.
+ */
+void CameraSensor::initModes()
+{
+	V4L2SubdeviceFormat current{};
+	int ret = subdev_->getFormat(pad_, &current);
+	if (ret)
+		return;
+
+	for (unsigned int code : mbusCodes_) {
+		for (const SizeRange &range : formats_.at(code)) {
+			CameraSensorMode mode{};
+			mode.code = code;
+			mode.size = range.max;
+			mode.bitsPerPixel = MediaBusFormatInfo::info(code).bitsPerPixel;
+			mode.analogCrop = Rectangle(activeArea_.size());
+			mode.binning = Size(1, 1);
+
+			V4L2SubdeviceFormat format{};
+			format.code = code;
+			format.size = range.max;
+
+			ret = subdev_->setFormat(pad_, &format);
+			if (ret || format.code != code || format.size != range.max) {
+				modes_.push_back(mode);
+				continue;
+			}
+
+			subdev_->updateControlInfo();
+
+			Rectangle crop;
+			if (!subdev_->getSelection(pad_, V4L2_SEL_TGT_CROP, &crop)) {
+				mode.analogCrop = crop;
+				mode.analogCrop.x -= activeArea_.x;
+				mode.analogCrop.y -= activeArea_.y;
+			}
+
+			mode.binning = Size(std::max(mode.analogCrop.width / mode.size.width, 1U),
+					    std::max(mode.analogCrop.height / mode.size.height, 1U));
+
+			ControlList ctrls = subdev_->getControls({ V4L2_CID_PIXEL_RATE });
+			if (!ctrls.empty())
+				mode.pixelRate = ctrls.get(V4L2_CID_PIXEL_RATE).get<int64_t>();
+
+			const ControlInfoMap &infoMap = subdev_->controls();
+			auto hblank = infoMap.find(V4L2_CID_HBLANK);
+			auto vblank = infoMap.find(V4L2_CID_VBLANK);
+			if (hblank != infoMap.end() && vblank != infoMap.end()) {
+				mode.minLineLength = mode.size.width
+						   + hblank->second.min().get<int32_t>();
+				mode.minFrameLength = mode.size.height
+						    + vblank->second.min().get<int32_t>();
+			}
+
+			LOG(CameraSensor, Debug)
+				<< "Mode " << MediaBusFormatInfo::info(code).name
+				<< "/" << mode.size << ": binning " << mode.binning
+				<< ", max " << mode.maxFrameRate() << " fps";
+
+			modes_.push_back(mode);
+		}
+	}
+
+	subdev_->setFormat(pad_, &current);
+	subdev_->updateControlInfo();
+}
+
 int CameraSensor::discoverAncillaryDevices()
 {
 	int ret;
@@ -663,10 +796,22 @@ Size CameraSensor::resolution() const
 	return std::min(sizes_.back(), activeArea_.size());
 }
 
+/**
+ * \fn CameraSensor::modes()
+ * \brief Retrieve the sensor modes
+ *
+ * The modes are listed in increasing media bus code order, and record the
+ * pixel rate and blanking limits the sensor reported for each of them at
+ * initialization time.
+ *
+ * \return The sensor modes
+ */
+
 /**
  * \brief Retrieve the best sensor format for a desired output
  * \param[in] mbusCodes The list of acceptable media bus codes
  * \param[in] size The desired size
+ * \param[in] minFrameRate The minimum desired frame rate, 0 to ignore
  *
  * Media bus codes are selected from \a mbusCodes, which lists all acceptable
  * codes in decreasing order of preference. Media bus codes supported by the
@@ -689,6 +834,11 @@ Size CameraSensor::resolution() const
  * When multiple media bus codes can produce the same size, the code at the
  * lowest position in \a mbusCodes is selected.
  *
+ * If \a minFrameRate is not zero, the modes whose maximum frame rate is known
+ * to be lower than \a minFrameRate are skipped. This favours the smaller binned
+ * modes over the full resolution modes that can't sustain the desired frame
+ * rate. When no mode can reach \a minFrameRate, the frame rate is ignored.
+ *
  * The use of this function is optional, as the above criteria may not match the
  * needs of all pipeline handlers. Pipeline handlers may implement custom
  * sensor format selection when needed.
@@ -700,7 +850,7 @@ Size CameraSensor::resolution() const
  * and size on success, or an empty format otherwise.
  */
 V4L2SubdeviceFormat CameraSensor::getFormat(const std::vector<unsigned int> &mbusCodes,
-					    const Size &size) const
+					    const Size &size, float minFrameRate) const
 {
 	unsigned int desiredArea = size.width * size.height;
 	unsigned int bestArea = UINT_MAX;
@@ -720,6 +870,18 @@ V4L2SubdeviceFormat CameraSensor::getFormat(const std::vector<unsigned int> &mbu
 			if (sz.width < size.width || sz.height < size.height)
 				continue;
 
+			if (minFrameRate > 0.0f) {
+				auto mode = std::find_if(modes_.begin(), modes_.end(),
+							 [&](const CameraSensorMode &m) {
+								 return m.code == code && m.size == sz;
+							 });
+				if (mode != modes_.end()) {
+					float maxFrameRate = mode->maxFrameRate();
+					if (maxFrameRate && maxFrameRate < minFrameRate)
+						continue;
+				}
+			}
+
 			float ratio = static_cast<float>(sz.width) / sz.height;
 			float ratioDiff = fabsf(ratio - desiredRatio);
 			unsigned int area = sz.width * sz.height;
@@ -737,6 +899,12 @@ V4L2SubdeviceFormat CameraSensor::getFormat(const std::vector<unsigned int> &mbu
 		}
 	}
 
+	if (!bestSize && minFrameRate > 0.0f) {
+		LOG(CameraSensor, Debug)
+			<< "No format reaches " << minFrameRate << " fps";
+		return getFormat(mbusCodes, size);
+	}
+
 	if (!bestSize) {
 		LOG(CameraSensor, Debug) << "No supported format or size found";
 		return {};
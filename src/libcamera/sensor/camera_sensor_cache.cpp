@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Persistent cache of camera sensor capabilities
+ */
+
+#include "libcamera/internal/camera_sensor_cache.h"
+
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libcamera/base/file.h>
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+#include "libcamera/internal/media_device.h"
+#include "libcamera/internal/media_object.h"
+#include "libcamera/internal/yaml_parser.h"
+
+/**
+ * \file camera_sensor_cache.h
+ * \brief Persistent cache of camera sensor capabilities
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(CameraSensor)
+
+/**
+ * \class CameraSensorCache
+ * \brief A file-backed cache of the formats supported by camera sensors
+ *
+ * Enumerating the media bus codes and frame sizes supported by a camera
+ * sensor requires one VIDIOC_SUBDEV_ENUM_MBUS_CODE ioctl per media bus code
+ * and one VIDIOC_SUBDEV_ENUM_FRAME_SIZE ioctl per frame size, which dominates
+ * the CameraSensor initialization time for sensors that support many formats.
+ * As the result only depends on the sensor driver, this class stores it in a
+ * file to be reused by subsequent processes.
+ *
+ * The cache is optional and disabled by default. It is enabled by setting the
+ * LIBCAMERA_SENSOR_CACHE_FILE environment variable to the path of the cache
+ * file, which is created if it doesn't exist. Sensors are identified by the
+ * driver, model, serial number, bus information, version and hardware
+ * revision of their media device, and by their entity name and pad. The
+ * media device version is usually the kernel version, kernel upgrades thus
+ * invalidate the cached entries. The cache file shall be removed manually when
+ * a sensor driver is modified without changing the kernel version.
+ *
+ * A cache file that can't be parsed is ignored and replaced by a new one the
+ * next time an entry is added.
+ */
+
+/**
+ * \brief Construct a CameraSensorCache
+ *
+ * Construct a cache backed by the file pointed to by the
+ * LIBCAMERA_SENSOR_CACHE_FILE environment variable and load its contents. The
+ * cache is disabled if the variable isn't set.
+ */
+CameraSensorCache::CameraSensorCache()
+{
+	const char *path = utils::secure_getenv("LIBCAMERA_SENSOR_CACHE_FILE");
+	if (!path || *path == '\0')
+		return;
+
+	path_ = path;
+	load();
+}
+
+/**
+ * \fn CameraSensorCache::isEnabled()
+ * \brief Check if the cache is enabled
+ * \return True if a cache file has been configured, false otherwise
+ */
+
+/**
+ * \brief Retrieve the cached formats of a camera sensor
+ * \param[in] entity The media entity of the camera sensor
+ * \param[in] pad The pad of the entity
+ *
+ * \return The formats cached for the \a pad of the \a entity as
+ * V4L2Subdevice::formats() would return them, or an empty map if the sensor
+ * isn't found in the cache
+ */
+V4L2Subdevice::Formats CameraSensorCache::formats(const MediaEntity *entity,
+						  unsigned int pad) const
+{
+	auto iter = sensors_.find(key(entity, pad));
+	if (iter == sensors_.end())
+		return {};
+
+	LOG(CameraSensor, Debug)
+		<< "Using cached formats for '" << entity->name() << "'";
+
+	return iter->second;
+}
+
+/**
+ * \brief Store the formats of a camera sensor in the cache
+ * \param[in] entity The media entity of the camera sensor
+ * \param[in] pad The pad of the entity
+ * \param[in] formats The formats supported by the \a pad of the \a entity
+ *
+ * Add the \a formats to the cache and write the cache file. Failures to write
+ * the file are logged and otherwise ignored.
+ */
+void CameraSensorCache::setFormats(const MediaEntity *entity, unsigned int pad,
+				   const V4L2Subdevice::Formats &formats)
+{
+	if (!isEnabled())
+		return;
+
+	std::string sensorKey = key(entity, pad);
+	if (sensorKey.empty())
+		return;
+
+	sensors_[sensorKey] = formats;
+
+	int ret = save();
+	if (ret)
+		LOG(CameraSensor, Warning)
+			<< "Failed to write sensor cache file " << path_
+			<< ": " << strerror(-ret);
+}
+
+std::string CameraSensorCache::key(const MediaEntity *entity, unsigned int pad)
+{
+	const MediaDevice *media = entity->device();
+
+	std::string key = media->driver() + "/" + media->model() + "/"
+			+ media->serial() + "/" + media->busInfo() + "/"
+			+ std::to_string(media->version()) + "/"
+			+ std::to_string(media->hwRevision()) + "/"
+			+ entity->name() + "/" + std::to_string(pad);
+
+	/*
+	 * The key is stored as a YAML double-quoted string, skip sensors whose
+	 * identification would need escaping.
+	 */
+	for (char c : key) {
+		if (c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20)
+			return {};
+	}
+
+	return key;
+}
+
+void CameraSensorCache::load()
+{
+	File file(path_);
+	if (!file.exists())
+		return;
+
+	if (!file.open(File::OpenModeFlag::ReadOnly)) {
+		LOG(CameraSensor, Warning)
+			<< "Failed to open sensor cache file " << path_;
+		return;
+	}
+
+	std::unique_ptr<YamlObject> root = YamlParser::parse(file);
+	if (!root || (*root)["version"].get<uint32_t>() != 1u) {
+		LOG(CameraSensor, Warning)
+			<< "Ignoring invalid sensor cache file " << path_;
+		return;
+	}
+
+	for (const auto &[sensorKey, value] : (*root)["sensors"].asDict()) {
+		V4L2Subdevice::Formats formats;
+
+		for (const YamlObject &format : value.asList()) {
+			std::optional<uint32_t> code = format["code"].get<uint32_t>();
+			if (!code)
+				continue;
+
+			std::vector<SizeRange> &sizes = formats[*code];
+
+			for (const YamlObject &range : format["sizes"].asList()) {
+				std::optional<std::vector<uint32_t>> values =
+					range.getList<uint32_t>();
+				if (!values || values->size() != 4)
+					continue;
+
+				sizes.emplace_back(Size{ (*values)[0], (*values)[1] },
+						   Size{ (*values)[2], (*values)[3] });
+			}
+
+			/* Drop incomplete entries, the sensor will be probed. */
+			if (sizes.empty()) {
+				formats.clear();
+				break;
+			}
+		}
+
+		if (!formats.empty())
+			sensors_[sensorKey] = std::move(formats);
+	}
+
+	LOG(CameraSensor, Debug)
+		<< "Loaded " << sensors_.size() << " sensor(s) from cache file "
+		<< path_;
+}
+
+int CameraSensorCache::save() const
+{
+	/*
+	 * Write to a temporary file and rename it, to ensure that concurrent
+	 * readers never see a partially written cache file.
+	 */
+	std::string tmpPath = path_ + "." + std::to_string(getpid());
+
+	{
+		std::ofstream out(tmpPath, std::ios::trunc);
+		if (!out)
+			return -errno;
+
+		out << "# libcamera camera sensor cache, generated automatically" << std::endl
+		    << "version: 1" << std::endl
+		    << "sensors:" << std::endl;
+
+		for (const auto &[sensorKey, formats] : sensors_) {
+			out << "  \"" << sensorKey << "\":" << std::endl;
+
+			for (const auto &[code, sizes] : formats) {
+				out << "    - code: " << code << std::endl
+				    << "      sizes:" << std::endl;
+
+				for (const SizeRange &range : sizes)
+					out << "        - [ " << range.min.width << ", "
+					    << range.min.height << ", "
+					    << range.max.width << ", "
+					    << range.max.height << " ]" << std::endl;
+			}
+		}
+
+		if (!out) {
+			unlink(tmpPath.c_str());
+			return -EIO;
+		}
+	}
+
+	if (rename(tmpPath.c_str(), path_.c_str()) < 0) {
+		int ret = -errno;
+		unlink(tmpPath.c_str());
+		return ret;
+	}
+
+	return 0;
+}
+
+} /* namespace libcamera */
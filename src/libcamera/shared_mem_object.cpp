@@ -13,6 +13,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -85,6 +86,31 @@ SharedMem::SharedMem(const std::string &name, std::size_t size)
 	mem_ = { static_cast<uint8_t *>(mem), size };
 }
 
+/**
+ * \brief Construct a SharedMem mapping existing shared memory
+ * \param[in] fd File descriptor of the shared memory
+ * \param[in] size Size of the shared memory to map
+ *
+ * This constructor maps the first \a size bytes of shared memory allocated by
+ * another SharedMem instance, usually in a different process, and received
+ * through \a fd. Mapping fails if the backing file is smaller than \a size.
+ */
+SharedMem::SharedMem(const SharedFD &fd, std::size_t size)
+{
+	struct stat st;
+	if (!fd.isValid() || fstat(fd.get(), &st) < 0 ||
+	    static_cast<std::size_t>(st.st_size) < size)
+		return;
+
+	void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 fd.get(), 0);
+	if (mem == MAP_FAILED)
+		return;
+
+	fd_ = fd;
+	mem_ = { static_cast<uint8_t *>(mem), size };
+}
+
 /**
  * \brief Move constructor for SharedMem
  * \param[in] rhs The object to move
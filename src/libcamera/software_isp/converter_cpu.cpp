@@ -0,0 +1,779 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * CPU based format converter
+ */
+
+#include "libcamera/internal/software_isp/converter_cpu.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <numeric>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/message.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/tracepoints.h"
+
+#include "mapped_buffer_cache.h"
+#include "rgb_to_yuv.h"
+
+/**
+ * \file converter_cpu.h
+ * \brief CPU based format converter
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Converter)
+
+namespace {
+
+/*
+ * Accessors to the pixels of an input line, for each supported input format.
+ * The chroma of the YUV formats is shared by pairs of pixels, and the YUV
+ * values of the RGB formats are computed on the fly.
+ */
+
+class LineYUYV
+{
+public:
+	static constexpr bool kRGB = false;
+
+	LineYUYV(const std::array<const uint8_t *, 2> &planes, unsigned int stride,
+		 unsigned int y)
+		: line_(planes[0] + y * stride)
+	{
+	}
+
+	uint8_t y(unsigned int x) const { return line_[x * 2]; }
+	uint8_t u(unsigned int x) const { return line_[(x & ~1U) * 2 + 1]; }
+	uint8_t v(unsigned int x) const { return line_[(x & ~1U) * 2 + 3]; }
+
+private:
+	const uint8_t *line_;
+};
+
+class LineNV12
+{
+public:
+	static constexpr bool kRGB = false;
+
+	LineNV12(const std::array<const uint8_t *, 2> &planes, unsigned int stride,
+		 unsigned int y)
+		: y_(planes[0] + y * stride), uv_(planes[1] + y / 2 * stride)
+	{
+	}
+
+	uint8_t y(unsigned int x) const { return y_[x]; }
+	uint8_t u(unsigned int x) const { return uv_[x & ~1U]; }
+	uint8_t v(unsigned int x) const { return uv_[(x & ~1U) + 1]; }
+
+private:
+	const uint8_t *y_;
+	const uint8_t *uv_;
+};
+
+template<unsigned int R, unsigned int B>
+class LineRGB
+{
+public:
+	static constexpr bool kRGB = true;
+
+	LineRGB(const std::array<const uint8_t *, 2> &planes, unsigned int stride,
+		unsigned int y)
+		: line_(planes[0] + y * stride)
+	{
+	}
+
+	uint8_t r(unsigned int x) const { return line_[x * 3 + R]; }
+	uint8_t g(unsigned int x) const { return line_[x * 3 + 1]; }
+	uint8_t b(unsigned int x) const { return line_[x * 3 + B]; }
+
+	uint8_t y(unsigned int x) const { return rgbToY(r(x), g(x), b(x)); }
+	uint8_t u(unsigned int x) const { return rgbToU(r(x), g(x), b(x)); }
+	uint8_t v(unsigned int x) const { return rgbToV(r(x), g(x), b(x)); }
+
+private:
+	const uint8_t *line_;
+};
+
+/* RGB888 is stored as B, G, R in memory, and BGR888 as R, G, B */
+using LineRGB888 = LineRGB<2, 0>;
+using LineBGR888 = LineRGB<0, 2>;
+
+/*
+ * Retrieve the plane pointers of a mapped buffer. The planes of buffers that
+ * store all the planes in a single FrameBuffer plane follow each other.
+ */
+template<typename T>
+void planePointers(const MappedFrameBuffer *mapped, const PixelFormat &format,
+		   unsigned int stride, unsigned int height,
+		   std::array<T *, 2> *planes)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(format);
+	const std::vector<MappedBuffer::Plane> &mappedPlanes = mapped->planes();
+
+	for (unsigned int i = 0; i < planes->size(); i++) {
+		if (i < mappedPlanes.size())
+			(*planes)[i] = mappedPlanes[i].data();
+		else if (i < info.numPlanes())
+			(*planes)[i] = (*planes)[i - 1] +
+				       info.planeSize(height, i - 1, stride);
+		else
+			(*planes)[i] = nullptr;
+	}
+}
+
+} /* namespace */
+
+/**
+ * \class ConverterCpu
+ * \brief Format converter running on the CPU
+ *
+ * The ConverterCpu scales and converts frames with the CPU, for platforms
+ * without a memory-to-memory converter device. It converts the YUYV, NV12,
+ * RGB888 and BGR888 formats to the NV12 and YUYV formats, converts between
+ * the RGB888 and BGR888 formats, and scales the frames down with
+ * nearest-neighbour sampling. It produces up to kMaxStreams outputs from the
+ * same input frame.
+ *
+ * The frames are processed one at a time in a worker thread, to not block the
+ * thread calling queueBuffers(). Like the CPU debayering of the Software ISP,
+ * the output lines are split in stripes converted concurrently, one per CPU
+ * by default. The LIBCAMERA_SOFTISP_THREADS environment variable caps the
+ * number of stripes of both. The buffers are completed in the thread that
+ * created the converter.
+ */
+
+/**
+ * \var ConverterCpu::kMaxStreams
+ * \brief The maximum number of output streams
+ */
+
+/**
+ * \brief Construct a ConverterCpu instance
+ */
+ConverterCpu::ConverterCpu()
+	: Converter(nullptr),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf),
+	  inputStride_(0), inputPlanes_{}, outputPlanes_{},
+	  inputMappings_(std::make_unique<MappedBufferCache>(MappedFrameBuffer::MapFlag::Read)),
+	  outputMappings_(std::make_unique<MappedBufferCache>(MappedFrameBuffer::MapFlag::Write)),
+	  stripeCount_(1), thread_("ConverterCPU"), busy_(false), running_(false)
+{
+	maxStripes_ = std::thread::hardware_concurrency();
+
+	const char *threads = utils::secure_getenv("LIBCAMERA_SOFTISP_THREADS");
+	if (threads)
+		maxStripes_ = strtoul(threads, nullptr, 10);
+
+	maxStripes_ = std::clamp(maxStripes_, 1U, kMaxStripes);
+
+	worker_ = std::make_unique<Worker>(this);
+	worker_->moveToThread(&thread_);
+
+	if (!dmaHeap_.isValid())
+		LOG(Converter, Error) << "Failed to create DmaBufAllocator object";
+}
+
+ConverterCpu::~ConverterCpu()
+{
+	stop();
+
+	for (std::unique_ptr<Thread> &thread : stripeThreads_) {
+		thread->exit();
+		thread->wait();
+	}
+
+	/* The workers must be destroyed before the threads they are bound to */
+	stripeWorkers_.clear();
+}
+
+void ConverterCpu::Worker::process(Job job)
+{
+	converter_->process(job);
+}
+
+void ConverterCpu::StripeWorker::process(unsigned int stripe)
+{
+	converter_->processStripe(stripe);
+	converter_->stripesDone_.release();
+}
+
+/**
+ * \fn ConverterCpu::loadConfiguration()
+ * \copydoc libcamera::Converter::loadConfiguration
+ */
+
+/**
+ * \fn ConverterCpu::isValid()
+ * \copydoc libcamera::Converter::isValid
+ */
+
+/**
+ * \copydoc libcamera::Converter::formats
+ *
+ * All the output formats are also supported as input formats. The \a input
+ * format is listed first, to favour configurations that don't need conversion.
+ */
+std::vector<PixelFormat> ConverterCpu::formats(PixelFormat input)
+{
+	if (input == formats::YUYV)
+		return { formats::YUYV, formats::NV12 };
+	if (input == formats::NV12)
+		return { formats::NV12, formats::YUYV };
+	if (input == formats::RGB888)
+		return { formats::RGB888, formats::BGR888, formats::NV12, formats::YUYV };
+	if (input == formats::BGR888)
+		return { formats::BGR888, formats::RGB888, formats::NV12, formats::YUYV };
+
+	return {};
+}
+
+/**
+ * \copydoc libcamera::Converter::sizes
+ *
+ * The output sizes have even dimensions, as required by the chroma
+ * subsampling of the YUV formats, and don't exceed the \a input size.
+ */
+SizeRange ConverterCpu::sizes(const Size &input)
+{
+	const Size max = input.alignedDownTo(2, 2);
+
+	return { Size(32, 32).boundedTo(max), max, 2, 2 };
+}
+
+/**
+ * \copydoc libcamera::Converter::strideAndFrameSize
+ */
+std::tuple<unsigned int, unsigned int>
+ConverterCpu::strideAndFrameSize(const PixelFormat &pixelFormat,
+				 const Size &size)
+{
+	if (formats(pixelFormat).empty())
+		return std::make_tuple(0, 0);
+
+	/* Round up to a multiple of 8 for 64 bits alignment */
+	const PixelFormatInfo &info = PixelFormatInfo::info(pixelFormat);
+	unsigned int stride = info.stride(size.width, 0, 8);
+
+	/* All planes of the supported multi-planar formats share the stride */
+	unsigned int frameSize = 0;
+	for (unsigned int i = 0; i < info.numPlanes(); i++)
+		frameSize += info.planeSize(size.height, i, stride);
+
+	return std::make_tuple(stride, frameSize);
+}
+
+/**
+ * \copydoc libcamera::Converter::configure
+ */
+int ConverterCpu::configure(const StreamConfiguration &inputCfg,
+			    const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+{
+	const std::vector<PixelFormat> outputFormats = formats(inputCfg.pixelFormat);
+	if (outputFormats.empty()) {
+		LOG(Converter, Error)
+			<< "Unsupported input format " << inputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	if (outputCfgs.empty() || outputCfgs.size() > kMaxStreams) {
+		LOG(Converter, Error)
+			<< "Invalid number of outputs " << outputCfgs.size();
+		return -EINVAL;
+	}
+
+	inputFormat_ = inputCfg.pixelFormat;
+	inputSize_ = inputCfg.size;
+	inputStride_ = inputCfg.stride;
+
+	const SizeRange outputSizes = sizes(inputSize_);
+
+	outputs_.clear();
+
+	for (const StreamConfiguration &cfg : outputCfgs) {
+		if (std::find(outputFormats.begin(), outputFormats.end(),
+			      cfg.pixelFormat) == outputFormats.end() ||
+		    !outputSizes.contains(cfg.size)) {
+			LOG(Converter, Error)
+				<< "Unsupported conversion from " << inputCfg.toString()
+				<< " to " << cfg.toString();
+			return -EINVAL;
+		}
+
+		Output output;
+		output.format = cfg.pixelFormat;
+		output.size = cfg.size;
+		std::tie(output.stride, std::ignore) =
+			strideAndFrameSize(cfg.pixelFormat, cfg.size);
+
+		if (cfg.stride != output.stride) {
+			LOG(Converter, Error)
+				<< "Invalid output stride " << cfg.stride
+				<< " (" << output.stride << ")";
+			return -EINVAL;
+		}
+
+		const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+		for (unsigned int i = 0; i < info.numPlanes(); i++)
+			output.planeSizes.push_back(info.planeSize(cfg.size.height, i,
+								   output.stride));
+
+		/* Sample the input pixel at the centre of each output pixel */
+		output.xMap.resize(cfg.size.width);
+		for (unsigned int x = 0; x < cfg.size.width; x++)
+			output.xMap[x] = (2 * x + 1) * inputSize_.width / (2 * cfg.size.width);
+
+		output.yMap.resize(cfg.size.height);
+		for (unsigned int y = 0; y < cfg.size.height; y++)
+			output.yMap[y] = (2 * y + 1) * inputSize_.height / (2 * cfg.size.height);
+
+		output.convert = selectConvertFn(cfg.pixelFormat, cfg.size != inputSize_);
+
+		outputs_.push_back(std::move(output));
+	}
+
+	inputMappings_->clear();
+	outputMappings_->clear();
+
+	configureStripes();
+
+	return 0;
+}
+
+/**
+ * \copydoc libcamera::Converter::exportBuffers
+ */
+int ConverterCpu::exportBuffers(unsigned int output, unsigned int count,
+				std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (output >= outputs_.size())
+		return -EINVAL;
+
+	const std::vector<unsigned int> &planeSizes = outputs_[output].planeSizes;
+	const unsigned int frameSize = std::accumulate(planeSizes.begin(),
+						       planeSizes.end(), 0U);
+
+	std::vector<UniqueFD> fds = dmaHeap_.alloc("frame", frameSize, count);
+	if (fds.size() != count) {
+		LOG(Converter, Error) << "Failed to allocate dma_bufs";
+		return -ENOMEM;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		SharedFD fd(std::move(fds[i]));
+
+		/* All planes are stored contiguously in a single dma_buf */
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+		for (unsigned int planeSize : planeSizes) {
+			FrameBuffer::Plane plane;
+			plane.fd = fd;
+			plane.offset = offset;
+			plane.length = planeSize;
+			planes.push_back(std::move(plane));
+
+			offset += planeSize;
+		}
+
+		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(planes)));
+	}
+
+	return count;
+}
+
+/**
+ * \copydoc libcamera::Converter::start
+ */
+int ConverterCpu::start()
+{
+	running_ = true;
+	thread_.start();
+
+	return 0;
+}
+
+/**
+ * \copydoc libcamera::Converter::stop
+ *
+ * The frame being processed is completed, and the frames still waiting for
+ * processing are returned with their output buffers marked as cancelled.
+ */
+void ConverterCpu::stop()
+{
+	running_ = false;
+
+	/* Wait for the frame being processed, no new frame gets dispatched */
+	if (thread_.isRunning()) {
+		worker_->invokeMethod(&Worker::sync, ConnectionTypeBlocking);
+
+		thread_.exit();
+		thread_.wait();
+
+		/* Complete the frame, whose completion is queued to this object */
+		Thread::current()->dispatchMessages(Message::Type::InvokeMessage, this);
+	}
+
+	std::deque<Job> jobs;
+	jobs.swap(pendingJobs_);
+	busy_ = false;
+
+	for (const Job &job : jobs)
+		cancelJob(job);
+}
+
+/**
+ * \copydoc libcamera::Converter::queueBuffers
+ */
+int ConverterCpu::queueBuffers(FrameBuffer *input,
+			       Span<FrameBuffer *const> outputs)
+{
+	if (outputs.size() > outputs_.size())
+		return -EINVAL;
+
+	Job job{ input, {} };
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < outputs.size(); i++) {
+		job.outputs[i] = outputs[i];
+		if (outputs[i])
+			count++;
+	}
+
+	if (!count)
+		return -EINVAL;
+
+	for (FrameBuffer *output : outputs) {
+		if (output)
+			LIBCAMERA_TRACEPOINT(converter_queue_buffer, output);
+	}
+
+	pendingJobs_.push_back(job);
+	dispatchJob();
+
+	return 0;
+}
+
+template<typename Src>
+ConverterCpu::ConvertFn ConverterCpu::convertFn(const PixelFormat &format,
+						bool scaled)
+{
+	if (format == formats::NV12)
+		return scaled ? &convertNV12<Src, true> : &convertNV12<Src, false>;
+	if (format == formats::YUYV)
+		return scaled ? &convertYUYV<Src, true> : &convertYUYV<Src, false>;
+
+	if constexpr (Src::kRGB) {
+		if (format == formats::RGB888)
+			return scaled ? &convertRGB<Src, 2, 0, true>
+				      : &convertRGB<Src, 2, 0, false>;
+		if (format == formats::BGR888)
+			return scaled ? &convertRGB<Src, 0, 2, true>
+				      : &convertRGB<Src, 0, 2, false>;
+	}
+
+	return nullptr;
+}
+
+/*
+ * The conversion functions are instantiated separately for the unscaled
+ * outputs, which read the input pixels in order and let the compiler vectorize
+ * the inner loops. The scaled outputs look the input pixels up in the xMap.
+ */
+
+template<typename Src, bool scaled>
+void ConverterCpu::convertNV12(const Output &output,
+			       const std::array<const uint8_t *, 2> &in,
+			       unsigned int inStride,
+			       const std::array<uint8_t *, 2> &out,
+			       unsigned int begin, unsigned int end)
+{
+	const unsigned int width = output.size.width;
+	const unsigned int *xMap = output.xMap.data();
+
+	for (unsigned int y = begin; y < end; y += 2) {
+		const Src src0(in, inStride, output.yMap[y]);
+		const Src src1(in, inStride, output.yMap[y + 1]);
+		uint8_t *y0 = out[0] + y * output.stride;
+		uint8_t *y1 = y0 + output.stride;
+		uint8_t *uv = out[1] + y / 2 * output.stride;
+
+		for (unsigned int x = 0; x < width; x++) {
+			const unsigned int sx = scaled ? xMap[x] : x;
+
+			y0[x] = src0.y(sx);
+			y1[x] = src1.y(sx);
+		}
+
+		/* Chroma is sampled at the top-left pixel of the 2x2 blocks */
+		for (unsigned int x = 0; x < width; x += 2) {
+			const unsigned int sx = scaled ? xMap[x] : x;
+
+			uv[x] = src0.u(sx);
+			uv[x + 1] = src0.v(sx);
+		}
+	}
+}
+
+template<typename Src, bool scaled>
+void ConverterCpu::convertYUYV(const Output &output,
+			       const std::array<const uint8_t *, 2> &in,
+			       unsigned int inStride,
+			       const std::array<uint8_t *, 2> &out,
+			       unsigned int begin, unsigned int end)
+{
+	const unsigned int width = output.size.width;
+	const unsigned int *xMap = output.xMap.data();
+
+	for (unsigned int y = begin; y < end; y++) {
+		const Src src(in, inStride, output.yMap[y]);
+		uint8_t *dst = out[0] + y * output.stride;
+
+		/* Chroma is sampled at the left pixel of the 2x1 blocks */
+		for (unsigned int x = 0; x < width; x += 2) {
+			const unsigned int sx0 = scaled ? xMap[x] : x;
+			const unsigned int sx1 = scaled ? xMap[x + 1] : x + 1;
+
+			dst[x * 2] = src.y(sx0);
+			dst[x * 2 + 1] = src.u(sx0);
+			dst[x * 2 + 2] = src.y(sx1);
+			dst[x * 2 + 3] = src.v(sx0);
+		}
+	}
+}
+
+template<typename Src, unsigned int R, unsigned int B, bool scaled>
+void ConverterCpu::convertRGB(const Output &output,
+			      const std::array<const uint8_t *, 2> &in,
+			      unsigned int inStride,
+			      const std::array<uint8_t *, 2> &out,
+			      unsigned int begin, unsigned int end)
+{
+	const unsigned int width = output.size.width;
+	const unsigned int *xMap = output.xMap.data();
+
+	for (unsigned int y = begin; y < end; y++) {
+		const Src src(in, inStride, output.yMap[y]);
+		uint8_t *dst = out[0] + y * output.stride;
+
+		for (unsigned int x = 0; x < width; x++) {
+			const unsigned int sx = scaled ? xMap[x] : x;
+
+			dst[x * 3 + R] = src.r(sx);
+			dst[x * 3 + 1] = src.g(sx);
+			dst[x * 3 + B] = src.b(sx);
+		}
+	}
+}
+
+/* Copy the lines of outputs in the input format and size */
+void ConverterCpu::copy(const Output &output,
+			const std::array<const uint8_t *, 2> &in,
+			unsigned int inStride,
+			const std::array<uint8_t *, 2> &out,
+			unsigned int begin, unsigned int end)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(output.format);
+
+	for (unsigned int i = 0; i < info.numPlanes(); i++) {
+		const unsigned int subSampling = info.planes[i].verticalSubSampling;
+		const unsigned int length = info.stride(output.size.width, i, 1);
+
+		for (unsigned int y = begin / subSampling; y < end / subSampling; y++)
+			memcpy(out[i] + y * output.stride, in[i] + y * inStride,
+			       length);
+	}
+}
+
+ConverterCpu::ConvertFn ConverterCpu::selectConvertFn(const PixelFormat &format,
+						      bool scaled) const
+{
+	if (format == inputFormat_ && !scaled)
+		return &copy;
+
+	if (inputFormat_ == formats::YUYV)
+		return convertFn<LineYUYV>(format, scaled);
+	if (inputFormat_ == formats::NV12)
+		return convertFn<LineNV12>(format, scaled);
+	if (inputFormat_ == formats::RGB888)
+		return convertFn<LineRGB888>(format, scaled);
+	if (inputFormat_ == formats::BGR888)
+		return convertFn<LineBGR888>(format, scaled);
+
+	return nullptr;
+}
+
+/*
+ * Split the output lines in stripes of whole line pairs, as required by the
+ * NV12 chroma subsampling, and create the worker threads. The first stripe is
+ * processed by the converter thread, the other stripes by the workers.
+ */
+void ConverterCpu::configureStripes()
+{
+	unsigned int pairs = UINT_MAX;
+	for (const Output &output : outputs_)
+		pairs = std::min(pairs, output.size.height / 2);
+
+	stripeCount_ = std::max(1U, std::min(maxStripes_, pairs));
+
+	while (stripeWorkers_.size() < stripeCount_ - 1) {
+		std::unique_ptr<Thread> thread = std::make_unique<Thread>("ConverterStripe");
+		std::unique_ptr<StripeWorker> worker = std::make_unique<StripeWorker>(this);
+
+		worker->moveToThread(thread.get());
+		thread->start();
+
+		stripeThreads_.push_back(std::move(thread));
+		stripeWorkers_.push_back(std::move(worker));
+	}
+
+	LOG(Converter, Debug)
+		<< "Converting frames in " << stripeCount_ << " stripe(s)";
+}
+
+void ConverterCpu::process(const Job &job)
+{
+	FrameBuffer *input = job.input;
+
+	MappedFrameBuffer *in = inputMappings_->map(input);
+	std::array<MappedFrameBuffer *, kMaxStreams> outs{};
+	bool mapped = in != nullptr;
+
+	for (unsigned int i = 0; i < outputs_.size(); i++) {
+		FrameBuffer *buffer = job.outputs[i];
+		if (!buffer)
+			continue;
+
+		FrameMetadata &metadata = buffer->_d()->metadata();
+		metadata.status = input->metadata().status;
+		metadata.sequence = input->metadata().sequence;
+		metadata.timestamp = input->metadata().timestamp;
+
+		outs[i] = outputMappings_->map(buffer);
+		if (!outs[i])
+			mapped = false;
+	}
+
+	if (!mapped) {
+		LOG(Converter, Error) << "mmap-ing buffer(s) failed";
+		for (FrameBuffer *buffer : job.outputs) {
+			if (buffer)
+				buffer->_d()->metadata().status = FrameMetadata::FrameError;
+		}
+
+		invokeMethod(&ConverterCpu::jobDone, ConnectionTypeQueued, job);
+		return;
+	}
+
+	planePointers(in, inputFormat_, inputStride_, inputSize_.height,
+		      &inputPlanes_);
+	in->beginAccess();
+
+	for (unsigned int i = 0; i < outputs_.size(); i++) {
+		const Output &output = outputs_[i];
+
+		outputPlanes_[i] = {};
+		if (!outs[i])
+			continue;
+
+		planePointers(outs[i], output.format, output.stride,
+			      output.size.height, &outputPlanes_[i]);
+		outs[i]->beginAccess();
+	}
+
+	for (unsigned int i = 1; i < stripeCount_; i++)
+		stripeWorkers_[i - 1]->invokeMethod(&StripeWorker::process,
+						    ConnectionTypeQueued, i);
+
+	processStripe(0);
+
+	stripesDone_.acquire(stripeCount_ - 1);
+
+	in->endAccess();
+	for (MappedFrameBuffer *out : outs) {
+		if (out)
+			out->endAccess();
+	}
+
+	invokeMethod(&ConverterCpu::jobDone, ConnectionTypeQueued, job);
+}
+
+void ConverterCpu::processStripe(unsigned int stripe)
+{
+	for (unsigned int i = 0; i < outputs_.size(); i++) {
+		const Output &output = outputs_[i];
+		if (!outputPlanes_[i][0])
+			continue;
+
+		const unsigned int pairs = output.size.height / 2;
+		const unsigned int begin = pairs * stripe / stripeCount_ * 2;
+		const unsigned int end = pairs * (stripe + 1) / stripeCount_ * 2;
+
+		output.convert(output, inputPlanes_, inputStride_,
+			       outputPlanes_[i], begin, end);
+	}
+}
+
+void ConverterCpu::jobDone(Job job)
+{
+	busy_ = false;
+
+	for (FrameBuffer *buffer : job.outputs) {
+		if (!buffer)
+			continue;
+
+		LIBCAMERA_TRACEPOINT(converter_complete_buffer, buffer);
+		outputBufferReady.emit(buffer);
+	}
+
+	inputBufferReady.emit(job.input);
+
+	dispatchJob();
+}
+
+void ConverterCpu::dispatchJob()
+{
+	if (!running_ || busy_ || pendingJobs_.empty())
+		return;
+
+	busy_ = true;
+	worker_->invokeMethod(&Worker::process, ConnectionTypeQueued,
+			      pendingJobs_.front());
+	pendingJobs_.pop_front();
+}
+
+void ConverterCpu::cancelJob(const Job &job)
+{
+	for (FrameBuffer *output : job.outputs) {
+		if (!output)
+			continue;
+
+		FrameMetadata &metadata = output->_d()->metadata();
+		metadata.status = FrameMetadata::FrameCancelled;
+		metadata.sequence = job.input->metadata().sequence;
+		metadata.timestamp = job.input->metadata().timestamp;
+
+		outputBufferReady.emit(output);
+	}
+
+	inputBufferReady.emit(job.input);
+}
+
+} /* namespace libcamera */
@@ -11,6 +11,8 @@
 
 #include "debayer.h"
 
+#include "libcamera/internal/tracepoints.h"
+
 namespace libcamera {
 
 /**
@@ -23,11 +25,49 @@ namespace libcamera {
  * \brief Size of a color lookup table
  */
 
+/**
+ * \var DebayerParams::kGammaLookupSize
+ * \brief Size of the gamma lookup table
+ */
+
+/**
+ * \struct DebayerParams::CcmColumn
+ * \brief Contribution of an input color to the red, green and blue outputs
+ *
+ * The values are expressed in gamma lookup table indices, i.e. in the
+ * [0, kGammaLookupSize - 1] range for a fully saturated output.
+ */
+
+/**
+ * \var DebayerParams::CcmColumn::r
+ * \brief Contribution to the red output
+ */
+
+/**
+ * \var DebayerParams::CcmColumn::g
+ * \brief Contribution to the green output
+ */
+
+/**
+ * \var DebayerParams::CcmColumn::b
+ * \brief Contribution to the blue output
+ */
+
 /**
  * \typedef DebayerParams::ColorLookupTable
  * \brief Type of the lookup tables for red, green, blue values
  */
 
+/**
+ * \typedef DebayerParams::CcmLookupTable
+ * \brief Type of the lookup tables for the color correction matrix columns
+ */
+
+/**
+ * \typedef DebayerParams::GammaLookupTable
+ * \brief Type of the gamma lookup table
+ */
+
 /**
  * \var DebayerParams::red
  * \brief Lookup table for red color, mapping input values to output values
@@ -43,11 +83,63 @@ namespace libcamera {
  * \brief Lookup table for blue color, mapping input values to output values
  */
 
+/**
+ * \var DebayerParams::ccmEnabled
+ * \brief Apply a color correction matrix
+ *
+ * When false, the red, green and blue lookup tables map the interpolated
+ * values directly to output values, with black level, gains and gamma all
+ * folded in the tables.
+ *
+ * When true, the redCcm, greenCcm and blueCcm lookup tables are used instead.
+ * They map the interpolated values, with black level and gains applied, to
+ * the matching column of the color correction matrix. The columns are summed
+ * per output channel and the result is mapped to the output value through the
+ * gamma lookup table.
+ */
+
+/**
+ * \var DebayerParams::redCcm
+ * \brief Lookup table for red color, mapping input values to CCM column
+ */
+
+/**
+ * \var DebayerParams::greenCcm
+ * \brief Lookup table for green color, mapping input values to CCM column
+ */
+
+/**
+ * \var DebayerParams::blueCcm
+ * \brief Lookup table for blue color, mapping input values to CCM column
+ */
+
+/**
+ * \var DebayerParams::gammaLut
+ * \brief Gamma lookup table, mapping CCM output values to output values
+ */
+
+/**
+ * \var kDebayerParamsBufferCount
+ * \brief Number of parameters buffers shared between the Software ISP and IPA
+ *
+ * The IPA fills the parameters for a frame in one of the buffers and
+ * signals which frame the buffer applies to. This allows the IPA to prepare
+ * parameters ahead of the frames they apply to.
+ */
+
+/**
+ * \typedef DebayerParamsBuffers
+ * \brief Ring of parameters buffers shared between the Software ISP and IPA
+ */
+
 /**
  * \class Debayer
  * \brief Base debayering class
  *
  * Base class that provides functions for setting up the debayering process.
+ *
+ * The debayering runs in the Software ISP worker thread, the process()
+ * function is invoked asynchronously through Object::invokeMethod().
  */
 
 LOG_DEFINE_CATEGORY(Debayer)
@@ -57,10 +149,12 @@ Debayer::~Debayer()
 }
 
 /**
- * \fn int Debayer::configure(const StreamConfiguration &inputCfg, const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+ * \fn int Debayer::configure(const StreamConfiguration &inputCfg, const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs, Transform transform)
  * \brief Configure the debayer object according to the passed in parameters.
  * \param[in] inputCfg The input configuration.
  * \param[in] outputCfgs The output configurations.
+ * \param[in] transform The transform to apply to the output images, shall be
+ * supported as reported by supportsTransform().
  *
  * \return 0 on success, a negative errno on failure.
  */
@@ -94,14 +188,131 @@ Debayer::~Debayer()
  */
 
 /**
- * \fn void Debayer::process(FrameBuffer *input, FrameBuffer *output, DebayerParams params)
+ * \fn void Debayer::process(FrameBuffer *input, FrameBuffer *output, FrameBuffer *secondary, const DebayerParams *params)
  * \brief Process the bayer data into the requested format.
  * \param[in] input The input buffer.
- * \param[in] output The output buffer.
+ * \param[in] output The output buffer, or nullptr.
+ * \param[in] secondary The secondary output buffer, or nullptr.
  * \param[in] params The parameters to be used in debayering.
  *
- * \note DebayerParams is passed by value deliberately so that a copy is passed
- * when this is run in another thread by invokeMethod().
+ * The \a params point to a per-frame parameters buffer, which must not be
+ * modified until processing of the frame completes.
+ *
+ * At least one of \a output and \a secondary shall be set. The \a secondary
+ * buffer is only supported by implementations whose maxOutputs() is larger
+ * than one, and the \a output buffer is mandatory for other implementations.
+ */
+
+/**
+ * \fn void Debayer::processStats(FrameBuffer *input, FrameBuffer *output, FrameBuffer *secondary)
+ * \brief Gather the statistics of a frame without debayering it
+ * \param[in] input The input buffer
+ * \param[in] output The output buffer, or nullptr
+ * \param[in] secondary The secondary output buffer, or nullptr
+ *
+ * This is used to drop frames when the processing falls behind the frame
+ * rate, while still feeding the statistics to the IPA. The \a output and
+ * \a secondary buffers are completed with the FrameMetadata::FrameCancelled
+ * status.
+ */
+
+/**
+ * \brief Stop the processing
+ *
+ * This function is called in the worker thread when streaming stops, after
+ * the last frame has been processed. Implementations can release the
+ * resources associated with the buffers of the session. The default
+ * implementation does nothing.
+ */
+void Debayer::stop()
+{
+}
+
+/**
+ * \brief Get the input area processed for a crop rectangle
+ * \param[in] crop The crop rectangle, in input frame coordinates
+ *
+ * Implementations that support cropping the input per frame, for digital zoom,
+ * return the area of the input frame they process to produce the outputs when
+ * setCrop() is called with \a crop. The area may differ from \a crop, as the
+ * output size is fixed and the implementation may not support arbitrary
+ * scaling ratios. The default implementation doesn't support cropping and
+ * returns a null rectangle.
+ *
+ * This function may be called from any thread, but not concurrently with
+ * configure().
+ *
+ * \return The processed area of the input, or a null rectangle if cropping
+ * isn't supported
+ */
+Rectangle Debayer::cropWindow([[maybe_unused]] const Rectangle &crop) const
+{
+	return {};
+}
+
+/**
+ * \brief Set the crop rectangle for the next frames
+ * \param[in] crop The crop rectangle, in input frame coordinates
+ *
+ * The crop rectangle applies to all the frames processed after this call,
+ * until the next call. A null rectangle selects the default crop of the
+ * configuration. The default implementation does nothing.
+ */
+void Debayer::setCrop([[maybe_unused]] const Rectangle &crop)
+{
+}
+
+/**
+ * \struct Debayer::Statistics
+ * \brief Processing time statistics of the debayer
+ *
+ * \var Debayer::Statistics::frames
+ * \brief Number of frames processed
+ *
+ * \var Debayer::Statistics::processingTime
+ * \brief Cumulated processing time of the frames
+ */
+
+/**
+ * \brief Retrieve the processing time statistics of the debayer
+ *
+ * The statistics are recorded by reportTiming().
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The debayer statistics
+ */
+Debayer::Statistics Debayer::statistics() const
+{
+	return {
+		frames_.load(std::memory_order_relaxed),
+		std::chrono::nanoseconds(processingTime_.load(std::memory_order_relaxed)),
+	};
+}
+
+/**
+ * \fn Debayer::maxOutputs()
+ * \brief Get the maximum number of outputs produced from a single input
+ *
+ * Implementations that support a secondary output produce it in the same pass
+ * as the main output, as an integer-downscaled copy of the main output in the
+ * same pixel format. The secondary output configuration is the second entry
+ * of the output configurations passed to configure().
+ *
+ * \return The maximum number of outputs
+ */
+
+/**
+ * \fn Debayer::supportsTransform()
+ * \brief Check if the debayer object can apply a transform to the outputs
+ * \param[in] transform The transform
+ *
+ * Implementations that can flip the images while debayering them avoid a
+ * separate pass over the output frames to honour the requested orientation
+ * when the sensor can't flip the images itself. The default implementation
+ * only supports the identity transform.
+ *
+ * \return True if \a transform is supported, false otherwise
  */
 
 /**
@@ -113,6 +324,43 @@ Debayer::~Debayer()
  * \return The valid size ranges or an empty range if there are none.
  */
 
+/**
+ * \fn const SharedFD &Debayer::getStatsFD()
+ * \brief Get the file descriptor for the statistics
+ *
+ * \return The file descriptor pointing to the statistics
+ */
+
+/**
+ * \fn void Debayer::setStatsSampling(unsigned int xSkip, unsigned int ySkip, bool zones)
+ * \brief Configure the subsampling of the statistics
+ * \param[in] xSkip Horizontal skip factor, in 2x2 blocks
+ * \param[in] ySkip Vertical skip factor, in line pairs
+ * \param[in] zones Accumulate the statistics in a grid of zones
+ *
+ * \sa SwStatsCpu::setSampling()
+ */
+
+/**
+ * \fn unsigned int Debayer::frameSize(unsigned int output)
+ * \brief Get the output frame size
+ * \param[in] output The output index
+ *
+ * This may only be called after a successful configure() call.
+ *
+ * \return The output frame size
+ */
+
+/**
+ * \fn const std::vector<unsigned int> &Debayer::planeSizes(unsigned int output)
+ * \brief Get the sizes of the output frame planes
+ * \param[in] output The output index
+ *
+ * This may only be called after a successful configure() call.
+ *
+ * \return The sizes of the output frame planes, in bytes
+ */
+
 /**
  * \var Signal<FrameBuffer *> Debayer::inputBufferReady
  * \brief Signals when the input buffer is ready.
@@ -123,4 +371,82 @@ Debayer::~Debayer()
  * \brief Signals when the output buffer is ready.
  */
 
+/**
+ * \struct Debayer::FrameTiming
+ * \brief Time spent in the processing stages of a frame
+ *
+ * With the CPU implementation, the statistics are accumulated line by line
+ * while debayering, and the \a debayer stage includes that time. The \a stats
+ * stage then only covers the collection of the frame statistics.
+ *
+ * \var Debayer::FrameTiming::setup
+ * \brief Time to map the buffers and to update the lookup tables
+ * \var Debayer::FrameTiming::debayer
+ * \brief Time to debayer the frame
+ * \var Debayer::FrameTiming::stats
+ * \brief Time to gather and publish the statistics
+ * \var Debayer::FrameTiming::signals
+ * \brief Time spent emitting the buffer ready signals
+ */
+
+/**
+ * \brief Report the processing time of a frame
+ * \param[in] frame The frame sequence number
+ * \param[in] timestamp The frame capture timestamp, in nanoseconds
+ * \param[in] timing The time spent in each processing stage
+ *
+ * This function shall be called by the implementations at the end of
+ * process() for every frame. It emits the debayer_frame_timing tracepoint,
+ * and warns when the processing time exceeds the frame interval for several
+ * consecutive frames, as the software ISP then falls behind the sensor and
+ * frames get dropped.
+ */
+void Debayer::reportTiming(uint32_t frame, uint64_t timestamp,
+			   const FrameTiming &timing)
+{
+	const utils::Duration total = timing.setup + timing.debayer +
+				      timing.stats + timing.signals;
+
+	frames_.fetch_add(1, std::memory_order_relaxed);
+	processingTime_.fetch_add(total.get<std::nano>(), std::memory_order_relaxed);
+
+	LIBCAMERA_TRACEPOINT(debayer_frame_timing, frame,
+			     static_cast<uint64_t>(timing.setup.get<std::nano>()),
+			     static_cast<uint64_t>(timing.debayer.get<std::nano>()),
+			     static_cast<uint64_t>(timing.stats.get<std::nano>()),
+			     static_cast<uint64_t>(timing.signals.get<std::nano>()));
+
+	LOG(Debayer, Debug)
+		<< "Frame " << frame << " processed in " << total
+		<< " (setup " << timing.setup << ", debayer " << timing.debayer
+		<< ", stats " << timing.stats << ", signals " << timing.signals
+		<< ")";
+
+	const uint64_t lastTimestamp = lastTimestamp_;
+	lastTimestamp_ = timestamp;
+
+	if (!lastTimestamp || timestamp <= lastTimestamp)
+		return;
+
+	const utils::Duration interval = std::chrono::nanoseconds(timestamp - lastTimestamp);
+	if (total <= interval) {
+		if (behind_)
+			LOG(Debayer, Info)
+				<< "Processing caught up with the frame rate at frame "
+				<< frame;
+
+		lateFrames_ = 0;
+		behind_ = false;
+		return;
+	}
+
+	if (++lateFrames_ < kLateFramesThreshold || behind_)
+		return;
+
+	LOG(Debayer, Warning)
+		<< "Processing falls behind the frame rate: frame " << frame
+		<< " took " << total << " for a frame interval of " << interval;
+	behind_ = true;
+}
+
 } /* namespace libcamera */
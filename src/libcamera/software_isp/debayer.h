@@ -11,13 +11,19 @@
 
 #pragma once
 
+#include <atomic>
 #include <stdint.h>
+#include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/stream.h>
+#include <libcamera/transform.h>
 
 #include "libcamera/internal/software_isp/debayer_params.h"
 
@@ -27,28 +33,78 @@ class FrameBuffer;
 
 LOG_DECLARE_CATEGORY(Debayer)
 
-class Debayer
+class Debayer : public Object
 {
 public:
+	struct Statistics {
+		uint64_t frames;
+		utils::Duration processingTime;
+	};
+
 	virtual ~Debayer() = 0;
 
 	virtual int configure(const StreamConfiguration &inputCfg,
-			      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs) = 0;
+			      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+			      Transform transform) = 0;
 
 	virtual std::vector<PixelFormat> formats(PixelFormat inputFormat) = 0;
 
 	virtual std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size) = 0;
 
-	virtual void process(FrameBuffer *input, FrameBuffer *output, DebayerParams params) = 0;
+	virtual void process(FrameBuffer *input, FrameBuffer *output,
+			     FrameBuffer *secondary,
+			     const DebayerParams *params) = 0;
+	virtual void processStats(FrameBuffer *input, FrameBuffer *output,
+				  FrameBuffer *secondary) = 0;
+	virtual void stop();
+
+	virtual Rectangle cropWindow(const Rectangle &crop) const;
+	virtual void setCrop(const Rectangle &crop);
+
+	virtual unsigned int maxOutputs() const { return 1; }
+	virtual bool supportsTransform(Transform transform) const
+	{
+		return transform == Transform::Identity;
+	}
 
 	virtual SizeRange sizes(PixelFormat inputFormat, const Size &inputSize) = 0;
 
+	virtual const SharedFD &getStatsFD() = 0;
+	virtual void setStatsSampling(unsigned int xSkip, unsigned int ySkip,
+				      bool zones) = 0;
+
+	virtual unsigned int frameSize(unsigned int output) = 0;
+	virtual const std::vector<unsigned int> &planeSizes(unsigned int output) = 0;
+
 	Signal<FrameBuffer *> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
 
+	Statistics statistics() const;
+
+protected:
+	struct FrameTiming {
+		utils::Duration setup;
+		utils::Duration debayer;
+		utils::Duration stats;
+		utils::Duration signals;
+	};
+
+	void reportTiming(uint32_t frame, uint64_t timestamp,
+			  const FrameTiming &timing);
+
 private:
+	/* Consecutive frames processed slower than the frame rate */
+	static constexpr unsigned int kLateFramesThreshold = 3;
+
 	virtual Size patternSize(PixelFormat inputFormat) = 0;
+
+	uint64_t lastTimestamp_ = 0;
+	unsigned int lateFrames_ = 0;
+	bool behind_ = false;
+
+	std::atomic<uint64_t> frames_ = 0;
+	std::atomic<uint64_t> processingTime_ = 0;
 };
 
 } /* namespace libcamera */
@@ -11,15 +11,24 @@
 
 #include "debayer_cpu.h"
 
+#include <algorithm>
+#include <numeric>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#include <libcamera/base/utils.h>
 
 #include <libcamera/formats.h>
 
 #include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/formats.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 
+#include "rgb_to_yuv.h"
+
 namespace libcamera {
 
 /**
@@ -34,8 +43,14 @@ namespace libcamera {
  * \param[in] stats Pointer to the stats object to use
  */
 DebayerCpu::DebayerCpu(std::unique_ptr<SwStatsCpu> stats)
-	: stats_(std::move(stats))
+	: stats_(std::move(stats)),
+	  inputMappings_(MappedFrameBuffer::MapFlag::Read),
+	  outputMappings_(MappedFrameBuffer::MapFlag::Write)
 {
+	simdIsa_ = DebayerSimd::detectIsa();
+	LOG(Debayer, Debug)
+		<< "Using SIMD instruction set " << DebayerSimd::isaName(simdIsa_);
+
 	/*
 	 * Reading from uncached buffers may be very slow.
 	 * In such a case, it's better to copy input buffer data to normal memory.
@@ -43,21 +58,78 @@ DebayerCpu::DebayerCpu(std::unique_ptr<SwStatsCpu> stats)
 	 * enable_input_memcpy_ makes this behavior configurable.  At the moment, we
 	 * always set it to true as the safer choice but this should be changed in
 	 * future.
+	 *
+	 * The lines are copied with streaming loads when the CPU supports them,
+	 * as they read uncached memory more efficiently than memcpy(). The
+	 * LIBCAMERA_SOFTISP_INPUT environment variable overrides the default.
 	 */
 	enableInputMemcpy_ = true;
+	copyLine_ = DebayerSimd::streamCopyFn(simdIsa_);
+	if (!copyLine_)
+		copyLine_ = copyLineMemcpy;
+
+	const char *input = utils::secure_getenv("LIBCAMERA_SOFTISP_INPUT");
+	if (input) {
+		std::string mode(input);
+
+		if (mode == "direct") {
+			enableInputMemcpy_ = false;
+		} else if (mode == "memcpy") {
+			copyLine_ = copyLineMemcpy;
+		} else if (mode != "stream") {
+			LOG(Debayer, Warning)
+				<< "Unknown input mode '" << mode << "'";
+		}
+	}
+
+	if (!enableInputMemcpy_)
+		LOG(Debayer, Debug) << "Reading the input lines in place";
+	else if (copyLine_ != copyLineMemcpy)
+		LOG(Debayer, Debug) << "Copying the input lines with streaming loads";
 
 	/* Initialize color lookup tables */
 	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
 		red_[i] = green_[i] = blue_[i] = i;
+	ccmEnabled_ = false;
+	scale_ = 1;
+	unpackLine_ = nullptr;
+	unpackShift_ = 0;
+	secondaryXStep_ = 1;
+	secondaryYStep_ = 1;
+	hflip_ = false;
+	vflip_ = false;
+
+	/*
+	 * The window is split in stripes processed concurrently, one per CPU
+	 * by default. The number of stripes can be overridden with the
+	 * LIBCAMERA_SOFTISP_THREADS environment variable, 1 disables
+	 * multi-threaded processing.
+	 */
+	maxStripes_ = std::thread::hardware_concurrency();
+
+	const char *threads = utils::secure_getenv("LIBCAMERA_SOFTISP_THREADS");
+	if (threads)
+		maxStripes_ = strtoul(threads, nullptr, 10);
 
-	for (unsigned int i = 0; i < kMaxLineBuffers; i++)
-		lineBuffers_[i] = nullptr;
+	maxStripes_ = std::clamp(maxStripes_, 1U, kMaxStripes);
 }
 
 DebayerCpu::~DebayerCpu()
 {
-	for (unsigned int i = 0; i < kMaxLineBuffers; i++)
-		free(lineBuffers_[i]);
+	for (std::unique_ptr<Thread> &thread : stripeThreads_) {
+		thread->exit();
+		thread->wait();
+	}
+
+	/* The workers must be destroyed before the threads they are bound to */
+	stripeWorkers_.clear();
+}
+
+void DebayerCpu::StripeWorker::process(Stripe *stripe, const uint8_t *src,
+				       uint8_t *dst)
+{
+	debayer_->processStripe(*stripe, src, dst);
+	debayer_->stripesDone_.release();
 }
 
 #define DECLARE_SRC_POINTERS(pixel_t)                            \
@@ -65,15 +137,37 @@ DebayerCpu::~DebayerCpu()
 	const pixel_t *curr = (const pixel_t *)src[1] + xShift_; \
 	const pixel_t *next = (const pixel_t *)src[2] + xShift_;
 
+/*
+ * Store a pixel, either through the per-channel lookup tables only, or
+ * through the CCM lookup tables and the gamma lookup table. The CCM lookup
+ * tables hold the contribution of each input channel to the output channels,
+ * with black level and gains already applied, in fixed point gamma lookup
+ * table units.
+ */
+#define STORE_PIXEL(b_, g_, r_)                                                  \
+	if constexpr (ccmEnabled) {                                              \
+		const DebayerParams::CcmColumn &bCol = blueCcm_[b_];             \
+		const DebayerParams::CcmColumn &gCol = greenCcm_[g_];            \
+		const DebayerParams::CcmColumn &rCol = redCcm_[r_];              \
+		constexpr int gammaMax = DebayerParams::kGammaLookupSize - 1;    \
+		*dst++ = gammaLut_[std::clamp(bCol.b + gCol.b + rCol.b, 0, gammaMax)]; \
+		*dst++ = gammaLut_[std::clamp(bCol.g + gCol.g + rCol.g, 0, gammaMax)]; \
+		*dst++ = gammaLut_[std::clamp(bCol.r + gCol.r + rCol.r, 0, gammaMax)]; \
+	} else {                                                                 \
+		*dst++ = blue_[b_];                                              \
+		*dst++ = green_[g_];                                             \
+		*dst++ = red_[r_];                                               \
+	}
+
 /*
  * RGR
  * GBG
  * RGR
  */
-#define BGGR_BGR888(p, n, div)                                                                \
-	*dst++ = blue_[curr[x] / (div)];                                                      \
-	*dst++ = green_[(prev[x] + curr[x - p] + curr[x + n] + next[x]) / (4 * (div))];       \
-	*dst++ = red_[(prev[x - p] + prev[x + n] + next[x - p] + next[x + n]) / (4 * (div))]; \
+#define BGGR_BGR888(p, n, div)                                                        \
+	STORE_PIXEL(curr[x] / (div),                                                  \
+		    (prev[x] + curr[x - p] + curr[x + n] + next[x]) / (4 * (div)),    \
+		    (prev[x - p] + prev[x + n] + next[x - p] + next[x + n]) / (4 * (div))) \
 	x++;
 
 /*
@@ -81,10 +175,10 @@ DebayerCpu::~DebayerCpu()
  * RGR
  * GBG
  */
-#define GRBG_BGR888(p, n, div)                                    \
-	*dst++ = blue_[(prev[x] + next[x]) / (2 * (div))];        \
-	*dst++ = green_[curr[x] / (div)];                         \
-	*dst++ = red_[(curr[x - p] + curr[x + n]) / (2 * (div))]; \
+#define GRBG_BGR888(p, n, div)                             \
+	STORE_PIXEL((prev[x] + next[x]) / (2 * (div)),     \
+		    curr[x] / (div),                       \
+		    (curr[x - p] + curr[x + n]) / (2 * (div))) \
 	x++;
 
 /*
@@ -92,10 +186,10 @@ DebayerCpu::~DebayerCpu()
  * BGB
  * GRG
  */
-#define GBRG_BGR888(p, n, div)                                     \
-	*dst++ = blue_[(curr[x - p] + curr[x + n]) / (2 * (div))]; \
-	*dst++ = green_[curr[x] / (div)];                          \
-	*dst++ = red_[(prev[x] + next[x]) / (2 * (div))];          \
+#define GBRG_BGR888(p, n, div)                             \
+	STORE_PIXEL((curr[x - p] + curr[x + n]) / (2 * (div)), \
+		    curr[x] / (div),                       \
+		    (prev[x] + next[x]) / (2 * (div)))     \
 	x++;
 
 /*
@@ -103,12 +197,13 @@ DebayerCpu::~DebayerCpu()
  * GRG
  * BGB
  */
-#define RGGB_BGR888(p, n, div)                                                                 \
-	*dst++ = blue_[(prev[x - p] + prev[x + n] + next[x - p] + next[x + n]) / (4 * (div))]; \
-	*dst++ = green_[(prev[x] + curr[x - p] + curr[x + n] + next[x]) / (4 * (div))];        \
-	*dst++ = red_[curr[x] / (div)];                                                        \
+#define RGGB_BGR888(p, n, div)                                                         \
+	STORE_PIXEL((prev[x - p] + prev[x + n] + next[x - p] + next[x + n]) / (4 * (div)), \
+		    (prev[x] + curr[x - p] + curr[x + n] + next[x]) / (4 * (div)),     \
+		    curr[x] / (div))                                                   \
 	x++;
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	DECLARE_SRC_POINTERS(uint8_t)
@@ -119,6 +214,7 @@ void DebayerCpu::debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	DECLARE_SRC_POINTERS(uint8_t)
@@ -129,6 +225,7 @@ void DebayerCpu::debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	DECLARE_SRC_POINTERS(uint16_t)
@@ -140,6 +237,7 @@ void DebayerCpu::debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	DECLARE_SRC_POINTERS(uint16_t)
@@ -151,6 +249,7 @@ void DebayerCpu::debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	DECLARE_SRC_POINTERS(uint16_t)
@@ -162,6 +261,7 @@ void DebayerCpu::debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	DECLARE_SRC_POINTERS(uint16_t)
@@ -173,6 +273,7 @@ void DebayerCpu::debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	const int widthInBytes = window_.width * 5 / 4;
@@ -198,6 +299,7 @@ void DebayerCpu::debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	const int widthInBytes = window_.width * 5 / 4;
@@ -218,6 +320,7 @@ void DebayerCpu::debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	const int widthInBytes = window_.width * 5 / 4;
@@ -238,6 +341,7 @@ void DebayerCpu::debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+template<bool ccmEnabled>
 void DebayerCpu::debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[])
 {
 	const int widthInBytes = window_.width * 5 / 4;
@@ -258,6 +362,84 @@ void DebayerCpu::debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+/*
+ * The SIMD variants split the work in two: the colour interpolation is done
+ * with SIMD instructions in chunks of kSimdChunkSize pixels, producing lookup
+ * table indices, which are then run through the colour lookup tables.
+ */
+template<bool ccmEnabled>
+void DebayerCpu::debayerSimd_BGR888(uint8_t *dst, const uint8_t *src[],
+				    DebayerSimd::InterpolateFn interpolate)
+{
+	uint16_t blue[kSimdChunkSize];
+	uint16_t green[kSimdChunkSize];
+	uint16_t red[kSimdChunkSize];
+
+	for (unsigned int x = 0; x < window_.width; x += kSimdChunkSize) {
+		const unsigned int width = std::min(kSimdChunkSize, window_.width - x);
+
+		interpolate(src, xShift_ + x, width, blue, green, red);
+
+		for (unsigned int i = 0; i < width; i++) {
+			STORE_PIXEL(blue[i], green[i], red[i])
+		}
+	}
+}
+
+template<bool ccmEnabled>
+void DebayerCpu::debayerSimd0_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	debayerSimd_BGR888<ccmEnabled>(dst, src, simdInterpolate0_);
+}
+
+template<bool ccmEnabled>
+void DebayerCpu::debayerSimd1_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	debayerSimd_BGR888<ccmEnabled>(dst, src, simdInterpolate1_);
+}
+
+/*
+ * The binned variants produce one output pixel from a block of scale x scale
+ * input pixels, i.e. from 1 (scale 2) or 2x2 (scale 4) Bayer quads, without
+ * interpolation. The src array holds the scale input lines of the block, and
+ * binBlue_ and binRed_ the position of the blue and red pixels in the quads.
+ */
+template<unsigned int bitDepth, unsigned int scale, bool ccmEnabled>
+void DebayerCpu::debayerBinned_BGR888(uint8_t *dst, const uint8_t *src[])
+{
+	using pixel_t = std::conditional_t<bitDepth == 8, uint8_t, uint16_t>;
+	/* Number of quads per output pixel, horizontally and vertically */
+	constexpr unsigned int quads = scale / 2;
+	constexpr unsigned int div = (1 << (bitDepth - 8)) * quads * quads;
+	const unsigned int width = window_.width / scale;
+	const pixel_t *blueLines[quads];
+	const pixel_t *redLines[quads];
+
+	for (unsigned int i = 0; i < quads; i++) {
+		blueLines[i] = (const pixel_t *)src[i * 2 + binBlue_.y];
+		redLines[i] = (const pixel_t *)src[i * 2 + binRed_.y];
+	}
+
+	for (unsigned int x = 0; x < width; x++) {
+		unsigned int b = 0;
+		unsigned int g = 0;
+		unsigned int r = 0;
+
+		for (unsigned int i = 0; i < quads; i++) {
+			for (unsigned int j = 0; j < quads; j++) {
+				const unsigned int col = (x * quads + j) * 2;
+
+				b += blueLines[i][col + binBlue_.x];
+				g += blueLines[i][col + 1 - binBlue_.x];
+				g += redLines[i][col + 1 - binRed_.x];
+				r += redLines[i][col + binRed_.x];
+			}
+		}
+
+		STORE_PIXEL(b / div, g / (2 * div), r / div)
+	}
+}
+
 static bool isStandardBayerOrder(BayerFormat::Order order)
 {
 	return order == BayerFormat::BGGR || order == BayerFormat::GBRG ||
@@ -280,7 +462,8 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 		config.bpp = (bayerFormat.bitDepth + 7) & ~7;
 		config.patternSize.width = 2;
 		config.patternSize.height = 2;
-		config.outputFormats = std::vector<PixelFormat>({ formats::RGB888, formats::BGR888 });
+		config.outputFormats = std::vector<PixelFormat>({ formats::RGB888, formats::BGR888,
+								  formats::NV12, formats::YUYV });
 		return 0;
 	}
 
@@ -290,7 +473,20 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 		config.bpp = 10;
 		config.patternSize.width = 4; /* 5 bytes per *4* pixels */
 		config.patternSize.height = 2;
-		config.outputFormats = std::vector<PixelFormat>({ formats::RGB888, formats::BGR888 });
+		config.outputFormats = std::vector<PixelFormat>({ formats::RGB888, formats::BGR888,
+								  formats::NV12, formats::YUYV });
+		return 0;
+	}
+
+	/* Unpacked to 12 bits per pixel when copying the input lines */
+	if ((bayerFormat.bitDepth == 12 || bayerFormat.bitDepth == 14) &&
+	    bayerFormat.packing == BayerFormat::Packing::CSI2 &&
+	    isStandardBayerOrder(bayerFormat.order)) {
+		config.bpp = bayerFormat.bitDepth;
+		config.patternSize.width = 4; /* Whole 3 or 7 bytes groups */
+		config.patternSize.height = 2;
+		config.outputFormats = std::vector<PixelFormat>({ formats::RGB888, formats::BGR888,
+								  formats::NV12, formats::YUYV });
 		return 0;
 	}
 
@@ -306,6 +502,16 @@ int DebayerCpu::getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &c
 		return 0;
 	}
 
+	if (outputFormat == formats::NV12) {
+		config.bpp = 8; /* Luma plane only, the chroma plane has the same stride */
+		return 0;
+	}
+
+	if (outputFormat == formats::YUYV) {
+		config.bpp = 16;
+		return 0;
+	}
+
 	LOG(Debayer, Info)
 		<< "Unsupported output format " << outputFormat.toString();
 	return -EINVAL;
@@ -337,6 +543,7 @@ int DebayerCpu::setupStandardBayerOrder(BayerFormat::Order order)
 	return 0;
 }
 
+template<bool ccmEnabled>
 int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputFormat)
 {
 	BayerFormat bayerFormat =
@@ -344,6 +551,7 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 
 	xShift_ = 0;
 	swapRedBlueGains_ = false;
+	store_ = nullptr;
 
 	auto invalidFmt = []() -> int {
 		LOG(Debayer, Error) << "Unsupported input output format combination";
@@ -351,9 +559,25 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 	};
 
 	switch (outputFormat) {
+	case formats::NV12:
+		/* Debayer to RGB888 line buffers and convert pairs of lines */
+		store_ = &DebayerCpu::storeNV12;
+		break;
+	case formats::YUYV:
+		store_ = &DebayerCpu::storeYUYV;
+		break;
 	case formats::RGB888:
+		/*
+		 * The secondary output is sampled from the RGB888 line
+		 * buffers, debayer to them and copy the lines to the output.
+		 */
+		if (!secondarySize_.isNull())
+			store_ = &DebayerCpu::storeRGB;
 		break;
 	case formats::BGR888:
+		if (!secondarySize_.isNull())
+			store_ = &DebayerCpu::storeRGB;
+
 		/* Swap R and B in bayer order to generate BGR888 instead of RGB888 */
 		swapRedBlueGains_ = true;
 
@@ -378,24 +602,55 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 		return invalidFmt();
 	}
 
+	/*
+	 * The flips are applied when storing the RGB888 line buffers to the
+	 * output, the input Bayer order is thus unaffected.
+	 */
+	if ((hflip_ || vflip_) && !store_)
+		store_ = &DebayerCpu::storeRGB;
+
+	/* The unpacked input lines hold 12 bits unpacked data */
+	if (unpackLine_) {
+		bayerFormat.bitDepth = 12;
+		bayerFormat.packing = BayerFormat::Packing::None;
+	}
+
 	if ((bayerFormat.bitDepth == 8 || bayerFormat.bitDepth == 10 || bayerFormat.bitDepth == 12) &&
 	    bayerFormat.packing == BayerFormat::Packing::None &&
 	    isStandardBayerOrder(bayerFormat.order)) {
 		switch (bayerFormat.bitDepth) {
 		case 8:
-			debayer0_ = &DebayerCpu::debayer8_BGBG_BGR888;
-			debayer1_ = &DebayerCpu::debayer8_GRGR_BGR888;
+			debayer0_ = &DebayerCpu::debayer8_BGBG_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer8_GRGR_BGR888<ccmEnabled>;
 			break;
 		case 10:
-			debayer0_ = &DebayerCpu::debayer10_BGBG_BGR888;
-			debayer1_ = &DebayerCpu::debayer10_GRGR_BGR888;
+			debayer0_ = &DebayerCpu::debayer10_BGBG_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer10_GRGR_BGR888<ccmEnabled>;
 			break;
 		case 12:
-			debayer0_ = &DebayerCpu::debayer12_BGBG_BGR888;
-			debayer1_ = &DebayerCpu::debayer12_GRGR_BGR888;
+			debayer0_ = &DebayerCpu::debayer12_BGBG_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer12_GRGR_BGR888<ccmEnabled>;
 			break;
 		}
+
+		/*
+		 * Use the SIMD line functions when available, the scalar ones
+		 * above are kept as a fallback. setupStandardBayerOrder() may
+		 * swap debayer0_ and debayer1_, which also swaps the SIMD
+		 * interpolation functions they use.
+		 */
+		simdInterpolate0_ = DebayerSimd::interpolateFn(simdIsa_, bayerFormat.bitDepth, true);
+		simdInterpolate1_ = DebayerSimd::interpolateFn(simdIsa_, bayerFormat.bitDepth, false);
+		if (simdInterpolate0_ && simdInterpolate1_) {
+			debayer0_ = &DebayerCpu::debayerSimd0_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayerSimd1_BGR888<ccmEnabled>;
+		}
+
 		setupStandardBayerOrder(bayerFormat.order);
+
+		if (scale_ > 1)
+			return setupBinning<ccmEnabled>(bayerFormat);
+
 		return 0;
 	}
 
@@ -403,20 +658,20 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 	    bayerFormat.packing == BayerFormat::Packing::CSI2) {
 		switch (bayerFormat.order) {
 		case BayerFormat::BGGR:
-			debayer0_ = &DebayerCpu::debayer10P_BGBG_BGR888;
-			debayer1_ = &DebayerCpu::debayer10P_GRGR_BGR888;
+			debayer0_ = &DebayerCpu::debayer10P_BGBG_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer10P_GRGR_BGR888<ccmEnabled>;
 			return 0;
 		case BayerFormat::GBRG:
-			debayer0_ = &DebayerCpu::debayer10P_GBGB_BGR888;
-			debayer1_ = &DebayerCpu::debayer10P_RGRG_BGR888;
+			debayer0_ = &DebayerCpu::debayer10P_GBGB_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer10P_RGRG_BGR888<ccmEnabled>;
 			return 0;
 		case BayerFormat::GRBG:
-			debayer0_ = &DebayerCpu::debayer10P_GRGR_BGR888;
-			debayer1_ = &DebayerCpu::debayer10P_BGBG_BGR888;
+			debayer0_ = &DebayerCpu::debayer10P_GRGR_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer10P_BGBG_BGR888<ccmEnabled>;
 			return 0;
 		case BayerFormat::RGGB:
-			debayer0_ = &DebayerCpu::debayer10P_RGRG_BGR888;
-			debayer1_ = &DebayerCpu::debayer10P_GBGB_BGR888;
+			debayer0_ = &DebayerCpu::debayer10P_RGRG_BGR888<ccmEnabled>;
+			debayer1_ = &DebayerCpu::debayer10P_GBGB_BGR888<ccmEnabled>;
 			return 0;
 		default:
 			break;
@@ -426,12 +681,76 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 	return invalidFmt();
 }
 
+template<bool ccmEnabled>
+int DebayerCpu::setupBinning(const BayerFormat &bayerFormat)
+{
+	switch (bayerFormat.order) {
+	case BayerFormat::BGGR:
+		binBlue_ = Point(0, 0);
+		binRed_ = Point(1, 1);
+		break;
+	case BayerFormat::GBRG:
+		binBlue_ = Point(1, 0);
+		binRed_ = Point(0, 1);
+		break;
+	case BayerFormat::GRBG:
+		binBlue_ = Point(0, 1);
+		binRed_ = Point(1, 0);
+		break;
+	case BayerFormat::RGGB:
+		binBlue_ = Point(1, 1);
+		binRed_ = Point(0, 0);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (bayerFormat.bitDepth * 10 + scale_) {
+	case 82:
+		binned_ = &DebayerCpu::debayerBinned_BGR888<8, 2, ccmEnabled>;
+		break;
+	case 84:
+		binned_ = &DebayerCpu::debayerBinned_BGR888<8, 4, ccmEnabled>;
+		break;
+	case 102:
+		binned_ = &DebayerCpu::debayerBinned_BGR888<10, 2, ccmEnabled>;
+		break;
+	case 104:
+		binned_ = &DebayerCpu::debayerBinned_BGR888<10, 4, ccmEnabled>;
+		break;
+	case 122:
+		binned_ = &DebayerCpu::debayerBinned_BGR888<12, 2, ccmEnabled>;
+		break;
+	case 124:
+		binned_ = &DebayerCpu::debayerBinned_BGR888<12, 4, ccmEnabled>;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 int DebayerCpu::configure(const StreamConfiguration &inputCfg,
-			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+			  Transform transform)
 {
+	if (!supportsTransform(transform)) {
+		LOG(Debayer, Error)
+			<< "Unsupported transform " << transformToString(transform);
+		return -EINVAL;
+	}
+
+	hflip_ = !!(transform & Transform::HFlip);
+	vflip_ = !!(transform & Transform::VFlip);
+
 	if (getInputConfig(inputCfg.pixelFormat, inputConfig_) != 0)
 		return -EINVAL;
 
+	/* The buffers of the previous session aren't used anymore */
+	inputMappings_.clear();
+	outputMappings_.clear();
+
 	if (stats_->configure(inputCfg) != 0)
 		return -EINVAL;
 
@@ -446,13 +765,54 @@ int DebayerCpu::configure(const StreamConfiguration &inputCfg,
 
 	inputConfig_.stride = inputCfg.stride;
 
-	if (outputCfgs.size() != 1) {
+	/*
+	 * The CSI-2 packed 12 and 14 bits formats are unpacked to 12 bits per
+	 * pixel when copying the input lines to the line buffers, and then
+	 * processed as unpacked 12 bits data. The 10 bits packed format has
+	 * dedicated functions reading the packed data in place.
+	 */
+	const BayerFormat inputFormat = BayerFormat::fromPixelFormat(inputCfg.pixelFormat);
+	unpackLine_ = nullptr;
+	unpackShift_ = 0;
+	if (inputFormat.packing == BayerFormat::Packing::CSI2 &&
+	    inputFormat.bitDepth > 10) {
+		unpackLine_ = RawUnpack::unpackFn(simdIsa_, inputFormat.bitDepth);
+		unpackShift_ = inputFormat.bitDepth - 12;
+	}
+
+	if (outputCfgs.size() > maxOutputs()) {
 		LOG(Debayer, Error)
 			<< "Unsupported number of output streams: "
 			<< outputCfgs.size();
 		return -EINVAL;
 	}
 
+	/* pad with patternSize.Width on both left and right side */
+	const unsigned int lineBufferBpp = unpackLine_ ? 16 : inputConfig_.bpp;
+	inputPadding_ = inputConfig_.patternSize.width * inputConfig_.bpp / 8;
+	lineBufferPadding_ = inputConfig_.patternSize.width * lineBufferBpp / 8;
+
+	inputSize_ = inputCfg.size;
+	inputPixelFormat_ = inputCfg.pixelFormat;
+	window_ = {};
+
+	/*
+	 * Without any output, only the statistics of the whole input frame are
+	 * gathered with processStats(), for the RAW frames consumed as-is.
+	 */
+	if (outputCfgs.empty()) {
+		if (hflip_ || vflip_)
+			return -EINVAL;
+
+		secondarySize_ = {};
+		outputSize_ = {};
+		store_ = nullptr;
+		scale_ = 1;
+		maxScale_ = 1;
+
+		return applyWindow(Rectangle(inputSize_), scale_);
+	}
+
 	const StreamConfiguration &outputCfg = outputCfgs[0];
 	SizeRange outSizeRange = sizes(inputCfg.pixelFormat, inputCfg.size);
 	std::tie(outputConfig_.stride, outputConfig_.frameSize) =
@@ -466,34 +826,192 @@ int DebayerCpu::configure(const StreamConfiguration &inputCfg,
 		return -EINVAL;
 	}
 
-	if (setDebayerFunctions(inputCfg.pixelFormat, outputCfg.pixelFormat) != 0)
+	const PixelFormatInfo &outputInfo = PixelFormatInfo::info(outputCfg.pixelFormat);
+	outputConfig_.planeSizes.clear();
+	for (unsigned int i = 0; i < outputInfo.numPlanes(); i++)
+		outputConfig_.planeSizes.push_back(
+			outputInfo.planeSize(outputCfg.size.height, i, outputConfig_.stride));
+
+	secondarySize_ = {};
+	if (outputCfgs.size() > 1) {
+		int ret = configureSecondary(outputCfg, outputCfgs[1]);
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * Output sizes fitting in the input size 4 or 2 times are produced by
+	 * binning the Bayer quads, processing the whole field of view at a
+	 * fraction of the cost of debayering every pixel. This is only
+	 * supported for unpacked formats, and for the formats unpacked when
+	 * copying the input lines.
+	 */
+	scale_ = 1;
+	if (inputFormat.packing == BayerFormat::Packing::None || unpackLine_) {
+		for (unsigned int scale : { 4U, 2U }) {
+			if (outputCfg.size.width * scale <= inputCfg.size.width &&
+			    outputCfg.size.height * scale <= inputCfg.size.height) {
+				scale_ = scale;
+				break;
+			}
+		}
+	}
+
+	maxScale_ = scale_;
+	outputSize_ = outputCfg.size;
+
+	outputPixelFormat_ = outputCfg.pixelFormat;
+	ccmEnabled_ = false;
+
+	if (setDebayerFunctions<false>(inputPixelFormat_, outputPixelFormat_) != 0)
 		return -EINVAL;
 
-	window_.x = ((inputCfg.size.width - outputCfg.size.width) / 2) &
-		    ~(inputConfig_.patternSize.width - 1);
-	window_.y = ((inputCfg.size.height - outputCfg.size.height) / 2) &
-		    ~(inputConfig_.patternSize.height - 1);
-	window_.width = outputCfg.size.width;
-	window_.height = outputCfg.size.height;
+	return applyWindow(cropWindow(Rectangle(inputSize_)), scale_);
+}
+
+/*
+ * Make window the area of the input used to produce the output, processed
+ * with the given binning factor.
+ */
+int DebayerCpu::applyWindow(const Rectangle &window, unsigned int scale)
+{
+	if (scale != scale_) {
+		scale_ = scale;
+
+		int ret = ccmEnabled_
+			? setDebayerFunctions<true>(inputPixelFormat_, outputPixelFormat_)
+			: setDebayerFunctions<false>(inputPixelFormat_, outputPixelFormat_);
+		if (ret)
+			return ret;
+	}
+
+	window_ = window;
 
 	/* Don't pass x,y since process() already adjusts src before passing it */
 	stats_->setWindow(Rectangle(window_.size()));
 
-	/* pad with patternSize.Width on both left and right side */
-	lineBufferPadding_ = inputConfig_.patternSize.width * inputConfig_.bpp / 8;
-	lineBufferLength_ = window_.width * inputConfig_.bpp / 8 +
+	const unsigned int lineBufferBpp = unpackLine_ ? 16 : inputConfig_.bpp;
+	lineBufferLength_ = window_.width * lineBufferBpp / 8 +
 			    2 * lineBufferPadding_;
-	for (unsigned int i = 0;
-	     i < (inputConfig_.patternSize.height + 1) && enableInputMemcpy_;
-	     i++) {
-		free(lineBuffers_[i]);
-		lineBuffers_[i] = (uint8_t *)malloc(lineBufferLength_);
-		if (!lineBuffers_[i])
-			return -ENOMEM;
+
+	return configureStripes();
+}
+
+/*
+ * The secondary output is an integer-downscaled copy of the main output in the
+ * same pixel format. It is produced by sampling the centre pixel of each block
+ * of secondaryXStep_ x secondaryYStep_ pixels of the main output, from the
+ * RGB888 line buffers of the stripes, while the lines are still hot in the
+ * cache. The dimensions of the secondary output must be even to produce pairs
+ * of lines for the YUV formats.
+ */
+int DebayerCpu::configureSecondary(const StreamConfiguration &outputCfg,
+				   const StreamConfiguration &secondaryCfg)
+{
+	const Size &size = secondaryCfg.size;
+
+	if (secondaryCfg.pixelFormat != outputCfg.pixelFormat ||
+	    size.isNull() || size.width % 2 || size.height % 2 ||
+	    size.width > outputCfg.size.width ||
+	    size.height > outputCfg.size.height) {
+		LOG(Debayer, Error)
+			<< "Invalid secondary output " << secondaryCfg.toString()
+			<< " for main output " << outputCfg.toString();
+		return -EINVAL;
+	}
+
+	std::tie(secondaryConfig_.stride, secondaryConfig_.frameSize) =
+		strideAndFrameSize(secondaryCfg.pixelFormat, size);
+	if (secondaryConfig_.stride != secondaryCfg.stride) {
+		LOG(Debayer, Error)
+			<< "Invalid secondary output stride " << secondaryCfg.stride
+			<< " (" << secondaryConfig_.stride << ")";
+		return -EINVAL;
 	}
 
-	measuredFrames_ = 0;
-	frameProcessTime_ = 0;
+	const PixelFormatInfo &info = PixelFormatInfo::info(secondaryCfg.pixelFormat);
+	secondaryConfig_.planeSizes.clear();
+	for (unsigned int i = 0; i < info.numPlanes(); i++)
+		secondaryConfig_.planeSizes.push_back(
+			info.planeSize(size.height, i, secondaryConfig_.stride));
+
+	secondaryXStep_ = outputCfg.size.width / size.width;
+	secondaryYStep_ = outputCfg.size.height / size.height;
+	secondarySize_ = size;
+
+	return 0;
+}
+
+/*
+ * Split the window in stripes with a height multiple of the pattern height,
+ * and allocate the per-stripe line buffers and worker threads. The first
+ * stripe is processed by the thread calling process(), the other stripes by
+ * the workers.
+ */
+int DebayerCpu::configureStripes()
+{
+	const unsigned int patternHeight = inputConfig_.patternSize.height;
+
+	/*
+	 * The stripes are made of blocks of whole Bayer patterns. When the
+	 * secondary output is enabled, the blocks also hold whole pairs of
+	 * sampled lines, so that each pair is produced by a single stripe.
+	 */
+	unsigned int blockHeight = patternHeight;
+	if (!secondarySize_.isNull())
+		blockHeight = std::lcm(patternHeight, 2 * secondaryYStep_);
+
+	/* Binning consumes scale_ input lines for each output line */
+	const unsigned int blockLines = blockHeight * scale_;
+	const unsigned int blocks = std::max(window_.height / blockLines, 1U);
+	const unsigned int count = std::clamp(maxStripes_, 1U, blocks);
+
+	stripes_.clear();
+	stripes_.resize(count);
+
+	for (unsigned int i = 0; i < count; i++) {
+		Stripe &stripe = stripes_[i];
+
+		/* The last stripe also processes the lines left after the blocks */
+		const unsigned int end = i == count - 1
+				       ? window_.height
+				       : blocks * (i + 1) / count * blockLines;
+
+		stripe.index = i;
+		stripe.y = blocks * i / count * blockLines;
+		stripe.height = end - stripe.y;
+
+		/* Binning needs a buffer for each line of the block */
+		const unsigned int lineBuffers = std::max(patternHeight + 1, scale_);
+		for (unsigned int j = 0; j < lineBuffers && copyInput(); j++)
+			stripe.lineBuffers[j].resize(lineBufferLength_);
+
+		for (std::vector<uint8_t> &line : stripe.rgbLines)
+			line.resize(store_ ? window_.width / scale_ * 3 : 0);
+
+		for (std::vector<uint8_t> &line : stripe.secondaryLines)
+			line.resize(secondarySize_.width * 3);
+	}
+
+	stats_->setStripeCount(count);
+
+	while (stripeWorkers_.size() < count - 1) {
+		std::unique_ptr<Thread> thread = std::make_unique<Thread>("SoftISPStripe");
+		std::unique_ptr<StripeWorker> worker = std::make_unique<StripeWorker>(this);
+
+		worker->moveToThread(thread.get());
+		thread->start();
+
+		stripeThreads_.push_back(std::move(thread));
+		stripeWorkers_.push_back(std::move(worker));
+	}
+
+	LOG(Debayer, Debug)
+		<< "Processing frames in " << count << " stripe(s)"
+		<< (scale_ > 1 ? ", binning " + std::to_string(scale_) + "x" : "")
+		<< (!secondarySize_.isNull()
+			    ? ", secondary output " + secondarySize_.toString()
+			    : "");
 
 	return 0;
 }
@@ -533,24 +1051,48 @@ DebayerCpu::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size
 	/* round up to multiple of 8 for 64 bits alignment */
 	unsigned int stride = (size.width * config.bpp / 8 + 7) & ~7;
 
-	return std::make_tuple(stride, stride * size.height);
+	/* All planes of the supported multi-planar formats share the stride */
+	const PixelFormatInfo &info = PixelFormatInfo::info(outputFormat);
+	unsigned int frameSize = 0;
+	for (unsigned int i = 0; i < info.numPlanes(); i++)
+		frameSize += info.planeSize(size.height, i, stride);
+
+	return std::make_tuple(stride, frameSize);
+}
+
+void DebayerCpu::copyLineMemcpy(uint8_t *dst, const uint8_t *src, unsigned int length)
+{
+	memcpy(dst, src, length);
 }
 
-void DebayerCpu::setupInputMemcpy(const uint8_t *linePointers[])
+/*
+ * Copy the pixels of the input line at src to the line buffer at dst,
+ * unpacking them for the formats processed unpacked.
+ */
+void DebayerCpu::copyInputLine(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+	if (unpackLine_)
+		unpackLine_(reinterpret_cast<uint16_t *>(dst), src, pixels, unpackShift_);
+	else
+		copyLine_(dst, src, pixels * inputConfig_.bpp / 8);
+}
+
+void DebayerCpu::setupInputMemcpy(Stripe &stripe, const uint8_t *linePointers[])
 {
 	const unsigned int patternHeight = inputConfig_.patternSize.height;
+	const unsigned int pixels = window_.width + 2 * inputConfig_.patternSize.width;
 
-	if (!enableInputMemcpy_)
+	if (!copyInput())
 		return;
 
 	for (unsigned int i = 0; i < patternHeight; i++) {
-		memcpy(lineBuffers_[i], linePointers[i + 1] - lineBufferPadding_,
-		       lineBufferLength_);
-		linePointers[i + 1] = lineBuffers_[i] + lineBufferPadding_;
+		copyInputLine(stripe.lineBuffers[i].data(), linePointers[i + 1] - inputPadding_,
+			      pixels);
+		linePointers[i + 1] = stripe.lineBuffers[i].data() + lineBufferPadding_;
 	}
 
-	/* Point lineBufferIndex_ to first unused lineBuffer */
-	lineBufferIndex_ = patternHeight;
+	/* Point lineBufferIndex to first unused lineBuffer */
+	stripe.lineBufferIndex = patternHeight;
 }
 
 void DebayerCpu::shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src)
@@ -564,86 +1106,119 @@ void DebayerCpu::shiftLinePointers(const uint8_t *linePointers[], const uint8_t
 				      (patternHeight / 2) * (int)inputConfig_.stride;
 }
 
-void DebayerCpu::memcpyNextLine(const uint8_t *linePointers[])
+void DebayerCpu::memcpyNextLine(Stripe &stripe, const uint8_t *linePointers[])
 {
 	const unsigned int patternHeight = inputConfig_.patternSize.height;
+	const unsigned int pixels = window_.width + 2 * inputConfig_.patternSize.width;
 
-	if (!enableInputMemcpy_)
+	if (!copyInput())
 		return;
 
-	memcpy(lineBuffers_[lineBufferIndex_], linePointers[patternHeight] - lineBufferPadding_,
-	       lineBufferLength_);
-	linePointers[patternHeight] = lineBuffers_[lineBufferIndex_] + lineBufferPadding_;
+	uint8_t *lineBuffer = stripe.lineBuffers[stripe.lineBufferIndex].data();
+	copyInputLine(lineBuffer, linePointers[patternHeight] - inputPadding_, pixels);
+	linePointers[patternHeight] = lineBuffer + lineBufferPadding_;
+
+	stripe.lineBufferIndex = (stripe.lineBufferIndex + 1) % (patternHeight + 1);
+}
+
+void DebayerCpu::processStripe(Stripe &stripe, const uint8_t *src, uint8_t *dst)
+{
+	if (scale_ > 1)
+		processBinned(stripe, src, dst);
+	else if (inputConfig_.patternSize.height == 2)
+		process2(stripe, src, dst);
+	else
+		process4(stripe, src, dst);
+}
 
-	lineBufferIndex_ = (lineBufferIndex_ + 1) % (patternHeight + 1);
+/*
+ * The output buffer is not mapped when only the secondary output is requested,
+ * skip the pointer arithmetic on the null destination in that case.
+ */
+static inline uint8_t *advance(uint8_t *dst, unsigned int offset)
+{
+	return dst ? dst + offset : dst;
 }
 
-void DebayerCpu::process2(const uint8_t *src, uint8_t *dst)
+/*
+ * The stripes read the input lines surrounding them, the lines are only read
+ * and stripes can thus overlap in the input without any synchronization.
+ */
+void DebayerCpu::process2(Stripe &stripe, const uint8_t *src, uint8_t *dst)
 {
-	unsigned int yEnd = window_.y + window_.height;
+	const unsigned int yStart = window_.y + stripe.y;
+	const bool lastStripe = stripe.index == stripes_.size() - 1;
+	unsigned int yEnd = yStart + stripe.height;
 	/* Holds [0] previous- [1] current- [2] next-line */
 	const uint8_t *linePointers[3];
 
-	/* Adjust src to top left corner of the window */
-	src += window_.y * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	/* Adjust src to top left corner of the stripe */
+	src += yStart * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	dst = advance(dst, stripe.y * outputConfig_.stride);
 
 	/* [x] becomes [x - 1] after initial shiftLinePointers() call */
-	if (window_.y) {
+	if (yStart) {
 		linePointers[1] = src - inputConfig_.stride; /* previous-line */
 		linePointers[2] = src;
 	} else {
-		/* window_.y == 0, use the next line as prev line */
+		/* yStart == 0, use the next line as prev line */
 		linePointers[1] = src + inputConfig_.stride;
 		linePointers[2] = src;
-		/* Last 2 lines also need special handling */
-		yEnd -= 2;
 	}
 
-	setupInputMemcpy(linePointers);
+	/* With window_.y == 0 the last 2 lines also need special handling */
+	if (window_.y == 0 && lastStripe)
+		yEnd -= 2;
+
+	setupInputMemcpy(stripe, linePointers);
 
-	for (unsigned int y = window_.y; y < yEnd; y += 2) {
+	for (unsigned int y = yStart; y < yEnd; y += 2) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(y, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(y, linePointers, stripe.index);
+		(this->*debayer0_)(lineDst(stripe, 0, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer1_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		(this->*debayer1_)(lineDst(stripe, 1, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
+		storeLines(stripe, y - window_.y);
 	}
 
-	if (window_.y == 0) {
+	if (window_.y == 0 && lastStripe) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(yEnd, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(yEnd, linePointers, stripe.index);
+		(this->*debayer0_)(lineDst(stripe, 0, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
 
 		shiftLinePointers(linePointers, src);
 		/* next line may point outside of src, use prev. */
 		linePointers[2] = linePointers[0];
-		(this->*debayer1_)(dst, linePointers);
+		(this->*debayer1_)(lineDst(stripe, 1, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
+		storeLines(stripe, yEnd - window_.y);
 	}
 }
 
-void DebayerCpu::process4(const uint8_t *src, uint8_t *dst)
+void DebayerCpu::process4(Stripe &stripe, const uint8_t *src, uint8_t *dst)
 {
-	const unsigned int yEnd = window_.y + window_.height;
+	const unsigned int yStart = window_.y + stripe.y;
+	const unsigned int yEnd = yStart + stripe.height;
 	/*
 	 * This holds pointers to [0] 2-lines-up [1] 1-line-up [2] current-line
 	 * [3] 1-line-down [4] 2-lines-down.
 	 */
 	const uint8_t *linePointers[5];
 
-	/* Adjust src to top left corner of the window */
-	src += window_.y * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	/* Adjust src to top left corner of the stripe */
+	src += yStart * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	dst = advance(dst, stripe.y * outputConfig_.stride);
 
 	/* [x] becomes [x - 1] after initial shiftLinePointers() call */
 	linePointers[1] = src - 2 * inputConfig_.stride;
@@ -651,101 +1226,490 @@ void DebayerCpu::process4(const uint8_t *src, uint8_t *dst)
 	linePointers[3] = src;
 	linePointers[4] = src + inputConfig_.stride;
 
-	setupInputMemcpy(linePointers);
+	setupInputMemcpy(stripe, linePointers);
 
-	for (unsigned int y = window_.y; y < yEnd; y += 4) {
+	for (unsigned int y = yStart; y < yEnd; y += 4) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(y, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(y, linePointers, stripe.index);
+		(this->*debayer0_)(lineDst(stripe, 0, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer1_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		(this->*debayer1_)(lineDst(stripe, 1, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
+		storeLines(stripe, y - window_.y);
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine2(y, linePointers);
-		(this->*debayer2_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine2(y, linePointers, stripe.index);
+		(this->*debayer2_)(lineDst(stripe, 0, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer3_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		(this->*debayer3_)(lineDst(stripe, 1, dst), linePointers);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+		dst = advance(dst, outputConfig_.stride);
+		storeLines(stripe, y - window_.y + 2);
 	}
 }
 
-static inline int64_t timeDiff(timespec &after, timespec &before)
+/*
+ * The binned lines don't need the surrounding lines for interpolation, the
+ * lines of each block are read (and copied if needed) without a sliding
+ * window.
+ */
+void DebayerCpu::processBinned(Stripe &stripe, const uint8_t *src, uint8_t *dst)
 {
-	return (after.tv_sec - before.tv_sec) * 1000000000LL +
-	       (int64_t)after.tv_nsec - (int64_t)before.tv_nsec;
+	const unsigned int yStart = window_.y + stripe.y;
+	const unsigned int yEnd = yStart + stripe.height;
+	/* Holds the (scale_) lines of the block being binned */
+	const uint8_t *linePointers[kMaxLineBuffers];
+
+	/* Adjust src to top left corner of the stripe */
+	src += yStart * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	dst = advance(dst, stripe.y / scale_ * outputConfig_.stride);
+
+	for (unsigned int y = yStart, line = 0; y < yEnd; y += scale_, line ^= 1) {
+		for (unsigned int i = 0; i < scale_; i++) {
+			linePointers[i] = src;
+			if (copyInput()) {
+				copyInputLine(stripe.lineBuffers[i].data(), src, window_.width);
+				linePointers[i] = stripe.lineBuffers[i].data();
+			}
+			src += inputConfig_.stride;
+		}
+
+		/* Gather the statistics from the input, one line pair at a time */
+		for (unsigned int i = 0; i < scale_; i += 2) {
+			const uint8_t *statsLines[3] = {
+				nullptr, linePointers[i], linePointers[i + 1]
+			};
+			stats_->processLine0(y + i, statsLines, stripe.index);
+		}
+
+		(this->*binned_)(lineDst(stripe, line, dst), linePointers);
+		dst = advance(dst, outputConfig_.stride);
+
+		if (line == 1)
+			storeLines(stripe, (y - window_.y) / scale_ - 1);
+	}
+}
+
+/*
+ * YUV output formats are produced by debayering pairs of lines to RGB888 in
+ * the stripe line buffers, and converting them to the output while they are
+ * still hot in the cache.
+ */
+uint8_t *DebayerCpu::lineDst(Stripe &stripe, unsigned int line, uint8_t *dst)
+{
+	return store_ ? stripe.rgbLines[line].data() : dst;
+}
+
+/* Reverse the order of the pixels of a RGB888 line in place */
+static void mirrorLine(uint8_t *line, unsigned int width)
+{
+	uint8_t *left = line;
+	uint8_t *right = line + (width - 1) * 3;
+
+	for (; left < right; left += 3, right -= 3) {
+		std::swap(left[0], right[0]);
+		std::swap(left[1], right[1]);
+		std::swap(left[2], right[2]);
+	}
+}
+
+void DebayerCpu::storeLines(Stripe &stripe, unsigned int y)
+{
+	if (!store_)
+		return;
+
+	const unsigned int width = window_.width / scale_;
+
+	/* Mirror the lines while they are hot in the cache */
+	if (hflip_) {
+		mirrorLine(stripe.rgbLines[0].data(), width);
+		mirrorLine(stripe.rgbLines[1].data(), width);
+	}
+
+	/* Store the line pairs bottom up, in reverse order, when flipping */
+	const unsigned int line0 = vflip_ ? 1 : 0;
+	const uint8_t *const rgb[2] = {
+		stripe.rgbLines[line0].data(), stripe.rgbLines[line0 ^ 1].data()
+	};
+
+	if (outputPlanes_[0])
+		store_(rgb, width, outputPlanes_, outputConfig_.stride,
+		       vflip_ ? window_.height / scale_ - 2 - y : y);
+
+	if (secondaryPlanes_[0])
+		storeSecondary(stripe, y);
 }
 
-void DebayerCpu::process(FrameBuffer *input, FrameBuffer *output, DebayerParams params)
+/*
+ * Sample the centre pixel of each secondary output block from the 2 RGB888
+ * lines starting at main output line y, and store the secondary lines once a
+ * pair has been gathered. The stripes hold whole pairs of secondary lines, the
+ * secondary line buffers can thus be per stripe.
+ */
+void DebayerCpu::storeSecondary(Stripe &stripe, unsigned int y)
 {
-	timespec frameStartTime;
+	for (unsigned int line = 0; line < 2; line++) {
+		const unsigned int row = y + line;
+		if (row % secondaryYStep_ != secondaryYStep_ / 2)
+			continue;
+
+		const unsigned int sy = row / secondaryYStep_;
+		if (sy >= secondarySize_.height)
+			continue;
+
+		const uint8_t *src = stripe.rgbLines[line].data() +
+				     secondaryXStep_ / 2 * 3;
+		uint8_t *dst = stripe.secondaryLines[sy % 2].data();
+
+		for (unsigned int x = 0; x < secondarySize_.width; x++) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst += 3;
+			src += secondaryXStep_ * 3;
+		}
 
-	if (measuredFrames_ < DebayerCpu::kLastFrameToMeasure) {
-		frameStartTime = {};
-		clock_gettime(CLOCK_MONOTONIC_RAW, &frameStartTime);
+		if (sy % 2) {
+			const unsigned int line0 = vflip_ ? 1 : 0;
+			const uint8_t *const rgb[2] = {
+				stripe.secondaryLines[line0].data(),
+				stripe.secondaryLines[line0 ^ 1].data()
+			};
+
+			store_(rgb, secondarySize_.width, secondaryPlanes_,
+			       secondaryConfig_.stride,
+			       vflip_ ? secondarySize_.height - 1 - sy : sy - 1);
+		}
 	}
+}
+
+void DebayerCpu::storeRGB(const uint8_t *const rgb[2], unsigned int width,
+			  const std::array<uint8_t *, 2> &planes,
+			  unsigned int stride, unsigned int y)
+{
+	for (unsigned int line = 0; line < 2; line++)
+		memcpy(planes[0] + (y + line) * stride, rgb[line], width * 3);
+}
 
-	green_ = params.green;
-	red_ = swapRedBlueGains_ ? params.blue : params.red;
-	blue_ = swapRedBlueGains_ ? params.red : params.blue;
+void DebayerCpu::storeNV12(const uint8_t *const rgb[2], unsigned int width,
+			   const std::array<uint8_t *, 2> &planes,
+			   unsigned int stride, unsigned int y)
+{
+	const uint8_t *rgb0 = rgb[0];
+	const uint8_t *rgb1 = rgb[1];
+	uint8_t *y0 = planes[0] + y * stride;
+	uint8_t *y1 = y0 + stride;
+	uint8_t *uv = planes[1] + y / 2 * stride;
+
+	/* RGB888 is stored as B, G, R in memory */
+	for (unsigned int x = 0; x < width; x += 2) {
+		const uint8_t *p0 = rgb0 + x * 3;
+		const uint8_t *p1 = rgb1 + x * 3;
+
+		y0[x] = rgbToY(p0[2], p0[1], p0[0]);
+		y0[x + 1] = rgbToY(p0[5], p0[4], p0[3]);
+		y1[x] = rgbToY(p1[2], p1[1], p1[0]);
+		y1[x + 1] = rgbToY(p1[5], p1[4], p1[3]);
+
+		/* Chroma is subsampled over 2x2 blocks */
+		const int b = (p0[0] + p0[3] + p1[0] + p1[3] + 2) >> 2;
+		const int g = (p0[1] + p0[4] + p1[1] + p1[4] + 2) >> 2;
+		const int r = (p0[2] + p0[5] + p1[2] + p1[5] + 2) >> 2;
+
+		*uv++ = rgbToU(r, g, b);
+		*uv++ = rgbToV(r, g, b);
+	}
+}
+
+void DebayerCpu::storeYUYV(const uint8_t *const rgb[2], unsigned int width,
+			   const std::array<uint8_t *, 2> &planes,
+			   unsigned int stride, unsigned int y)
+{
+	for (unsigned int line = 0; line < 2; line++) {
+		uint8_t *dst = planes[0] + (y + line) * stride;
+
+		/* Chroma is subsampled over 2x1 blocks */
+		for (unsigned int x = 0; x < width; x += 2) {
+			const uint8_t *p = rgb[line] + x * 3;
+			const int b = (p[0] + p[3] + 1) >> 1;
+			const int g = (p[1] + p[4] + 1) >> 1;
+			const int r = (p[2] + p[5] + 1) >> 1;
+
+			*dst++ = rgbToY(p[2], p[1], p[0]);
+			*dst++ = rgbToU(r, g, b);
+			*dst++ = rgbToY(p[5], p[4], p[3]);
+			*dst++ = rgbToV(r, g, b);
+		}
+	}
+}
+
+void DebayerCpu::process(FrameBuffer *input, FrameBuffer *output,
+			 FrameBuffer *secondary, const DebayerParams *params)
+{
+	const utils::time_point frameStartTime = utils::clock::now();
+
+	/* Switch the line functions when the CCM gets enabled or disabled */
+	if (params->ccmEnabled != ccmEnabled_) {
+		ccmEnabled_ = params->ccmEnabled;
+		if (ccmEnabled_)
+			setDebayerFunctions<true>(inputPixelFormat_, outputPixelFormat_);
+		else
+			setDebayerFunctions<false>(inputPixelFormat_, outputPixelFormat_);
+	}
+
+	if (ccmEnabled_) {
+		/*
+		 * With swapped red and blue, both the input channels (the
+		 * tables) and the output channels (the columns) are swapped.
+		 */
+		const auto swapColumn = [](const DebayerParams::CcmColumn &c) {
+			return DebayerParams::CcmColumn{ c.b, c.g, c.r };
+		};
+
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			if (swapRedBlueGains_) {
+				redCcm_[i] = swapColumn(params->blueCcm[i]);
+				greenCcm_[i] = swapColumn(params->greenCcm[i]);
+				blueCcm_[i] = swapColumn(params->redCcm[i]);
+			} else {
+				redCcm_[i] = params->redCcm[i];
+				greenCcm_[i] = params->greenCcm[i];
+				blueCcm_[i] = params->blueCcm[i];
+			}
+		}
+
+		gammaLut_ = params->gammaLut;
+	} else {
+		green_ = params->green;
+		red_ = swapRedBlueGains_ ? params->blue : params->red;
+		blue_ = swapRedBlueGains_ ? params->red : params->blue;
+	}
+
+	FrameBuffer *const outputs[] = { output, secondary };
 
 	/* Copy metadata from the input buffer */
-	FrameMetadata &metadata = output->_d()->metadata();
-	metadata.status = input->metadata().status;
-	metadata.sequence = input->metadata().sequence;
-	metadata.timestamp = input->metadata().timestamp;
-
-	MappedFrameBuffer in(input, MappedFrameBuffer::MapFlag::Read);
-	MappedFrameBuffer out(output, MappedFrameBuffer::MapFlag::Write);
-	if (!in.isValid() || !out.isValid()) {
+	for (FrameBuffer *buffer : outputs) {
+		if (!buffer)
+			continue;
+
+		FrameMetadata &metadata = buffer->_d()->metadata();
+		metadata.status = input->metadata().status;
+		metadata.sequence = input->metadata().sequence;
+		metadata.timestamp = input->metadata().timestamp;
+	}
+
+	MappedFrameBuffer *in = inputMappings_.map(input);
+	MappedFrameBuffer *out = output ? outputMappings_.map(output) : nullptr;
+	MappedFrameBuffer *sec = secondary ? outputMappings_.map(secondary) : nullptr;
+	if (!in || (output && !out) || (secondary && !sec)) {
 		LOG(Debayer, Error) << "mmap-ing buffer(s) failed";
-		metadata.status = FrameMetadata::FrameError;
+		for (FrameBuffer *buffer : outputs) {
+			if (buffer)
+				buffer->_d()->metadata().status = FrameMetadata::FrameError;
+		}
+		emitBuffers(input, output, secondary);
 		return;
 	}
 
+	MappedFrameBuffer *const mappings[] = { in, out, sec };
+	for (MappedFrameBuffer *mapped : mappings) {
+		if (mapped)
+			mapped->beginAccess();
+	}
+
 	stats_->startFrame();
 
-	if (inputConfig_.patternSize.height == 2)
-		process2(in.planes()[0].data(), out.planes()[0].data());
-	else
-		process4(in.planes()[0].data(), out.planes()[0].data());
-
-	metadata.planes()[0].bytesused = out.planes()[0].size();
-
-	/* Measure before emitting signals */
-	if (measuredFrames_ < DebayerCpu::kLastFrameToMeasure &&
-	    ++measuredFrames_ > DebayerCpu::kFramesToSkip) {
-		timespec frameEndTime = {};
-		clock_gettime(CLOCK_MONOTONIC_RAW, &frameEndTime);
-		frameProcessTime_ += timeDiff(frameEndTime, frameStartTime);
-		if (measuredFrames_ == DebayerCpu::kLastFrameToMeasure) {
-			const unsigned int measuredFrames = DebayerCpu::kLastFrameToMeasure -
-							    DebayerCpu::kFramesToSkip;
-			LOG(Debayer, Info)
-				<< "Processed " << measuredFrames
-				<< " frames in " << frameProcessTime_ / 1000 << "us, "
-				<< frameProcessTime_ / (1000 * measuredFrames)
-				<< " us/frame";
+	const utils::time_point debayerStartTime = utils::clock::now();
+
+	const uint8_t *src = in->planes()[0].data();
+	uint8_t *dst = out ? out->planes()[0].data() : nullptr;
+
+	const auto setPlanes = [](std::array<uint8_t *, 2> &planes,
+				  const MappedFrameBuffer *mapped) {
+		for (unsigned int i = 0; i < planes.size(); i++)
+			planes[i] = mapped && i < mapped->planes().size()
+				  ? mapped->planes()[i].data() : nullptr;
+	};
+
+	setPlanes(outputPlanes_, out);
+	setPlanes(secondaryPlanes_, sec);
+
+	for (unsigned int i = 1; i < stripes_.size(); i++)
+		stripeWorkers_[i - 1]->invokeMethod(&StripeWorker::process,
+						    ConnectionTypeQueued,
+						    &stripes_[i], src, dst);
+
+	processStripe(stripes_[0], src, dst);
+
+	stripesDone_.acquire(stripes_.size() - 1);
+
+	for (MappedFrameBuffer *mapped : mappings) {
+		if (mapped)
+			mapped->endAccess();
+	}
+
+	for (const auto &[buffer, mapped] : { std::pair{ output, out },
+					      std::pair{ secondary, sec } }) {
+		if (!buffer)
+			continue;
+
+		FrameMetadata &metadata = buffer->_d()->metadata();
+		for (unsigned int i = 0; i < metadata.planes().size(); i++)
+			metadata.planes()[i].bytesused = mapped->planes()[i].size();
+	}
+
+	const utils::time_point statsStartTime = utils::clock::now();
+
+	const uint32_t frame = input->metadata().sequence;
+	const uint64_t timestamp = input->metadata().timestamp;
+
+	stats_->finishFrame(frame);
+
+	const utils::time_point signalsStartTime = utils::clock::now();
+
+	emitBuffers(input, output, secondary);
+
+	reportTiming(frame, timestamp,
+		     { debayerStartTime - frameStartTime,
+		       statsStartTime - debayerStartTime,
+		       signalsStartTime - statsStartTime,
+		       utils::clock::now() - signalsStartTime });
+}
+
+void DebayerCpu::processStats(FrameBuffer *input, FrameBuffer *output,
+			      FrameBuffer *secondary)
+{
+	for (FrameBuffer *buffer : { output, secondary }) {
+		if (!buffer)
+			continue;
+
+		FrameMetadata &metadata = buffer->_d()->metadata();
+		metadata.status = FrameMetadata::FrameCancelled;
+		metadata.sequence = input->metadata().sequence;
+		metadata.timestamp = input->metadata().timestamp;
+	}
+
+	MappedFrameBuffer *in = inputMappings_.map(input);
+	if (in) {
+		in->beginAccess();
+
+		const unsigned int stride = inputConfig_.stride;
+		const uint8_t *src = in->planes()[0].data() + window_.y * stride +
+				     window_.x * inputConfig_.bpp / 8;
+
+		/* Visit the same line pairs as the debayering functions */
+		stats_->startFrame();
+
+		for (unsigned int y = 0; y < window_.height; y += 2, src += 2 * stride) {
+			const uint8_t *linePointers[3] = { nullptr, src, src + stride };
+
+			/* Skip the lines subsampled out before unpacking them */
+			if (!stats_->isLineSampled(window_.y + y))
+				continue;
+
+			/* The statistics of the unpacked formats use unpacked lines */
+			for (unsigned int i = 1; i < 3 && unpackLine_; i++) {
+				uint8_t *line = stripes_[0].lineBuffers[i].data();
+				copyInputLine(line, linePointers[i], window_.width);
+				linePointers[i] = line;
+			}
+
+			stats_->processLine0(window_.y + y, linePointers);
 		}
+
+		in->endAccess();
+
+		stats_->finishFrame(input->metadata().sequence);
+	} else {
+		LOG(Debayer, Error) << "mmap-ing input buffer failed";
 	}
 
-	stats_->finishFrame();
-	outputBufferReady.emit(output);
+	emitBuffers(input, output, secondary);
+}
+
+void DebayerCpu::emitBuffers(FrameBuffer *input, FrameBuffer *output,
+			     FrameBuffer *secondary)
+{
+	if (output)
+		outputBufferReady.emit(output);
+	if (secondary)
+		outputBufferReady.emit(secondary);
 	inputBufferReady.emit(input);
 }
 
+/*
+ * The horizontal and vertical flips, and their combination as a 180 degrees
+ * rotation, are applied to the debayered lines. Transpositions would require
+ * buffering the whole output and aren't supported.
+ */
+bool DebayerCpu::supportsTransform(Transform transform) const
+{
+	return !(transform & Transform::Transpose);
+}
+
+/*
+ * The output size is fixed, the crop rectangle selects the binning factor and
+ * the position of the window. The largest binning factor up to the one used
+ * for the uncropped frame that fits in the crop rectangle is used, and the
+ * window is centred on the crop rectangle. Crop rectangles smaller than the
+ * output size are processed without binning, with the window of the output
+ * size.
+ */
+Rectangle DebayerCpu::cropWindow(const Rectangle &crop) const
+{
+	if (outputSize_.isNull())
+		return {};
+
+	unsigned int scale = 1;
+	for (unsigned int s : { 4U, 2U }) {
+		if (s <= maxScale_ &&
+		    outputSize_.width * s <= crop.width &&
+		    outputSize_.height * s <= crop.height) {
+			scale = s;
+			break;
+		}
+	}
+
+	const Size size(outputSize_.width * scale, outputSize_.height * scale);
+	const Point centre = crop.center();
+	const Size &pattern = inputConfig_.patternSize;
+
+	int x = std::clamp<int>(centre.x - static_cast<int>(size.width / 2), 0,
+				inputSize_.width - size.width);
+	int y = std::clamp<int>(centre.y - static_cast<int>(size.height / 2), 0,
+				inputSize_.height - size.height);
+
+	return Rectangle(x & ~(pattern.width - 1), y & ~(pattern.height - 1), size);
+}
+
+void DebayerCpu::setCrop(const Rectangle &crop)
+{
+	Rectangle window = cropWindow(crop.isNull() ? Rectangle(inputSize_) : crop);
+	if (window.isNull() || window == window_)
+		return;
+
+	unsigned int scale = window.width / outputSize_.width;
+	if (applyWindow(window, scale))
+		LOG(Debayer, Error) << "Failed to apply crop " << crop;
+}
+
+void DebayerCpu::stop()
+{
+	inputMappings_.clear();
+	outputMappings_.clear();
+}
+
 SizeRange DebayerCpu::sizes(PixelFormat inputFormat, const Size &inputSize)
 {
 	Size patternSize = this->patternSize(inputFormat);
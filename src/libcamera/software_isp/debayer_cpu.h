@@ -11,47 +11,63 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <stdint.h>
 #include <vector>
 
 #include <libcamera/base/object.h>
+#include <libcamera/base/semaphore.h>
+#include <libcamera/base/thread.h>
 
 #include "libcamera/internal/bayer_format.h"
 
 #include "debayer.h"
+#include "debayer_cpu_simd.h"
+#include "mapped_buffer_cache.h"
+#include "raw_unpack.h"
 #include "swstats_cpu.h"
 
 namespace libcamera {
 
-class DebayerCpu : public Debayer, public Object
+class DebayerCpu : public Debayer
 {
 public:
 	DebayerCpu(std::unique_ptr<SwStatsCpu> stats);
 	~DebayerCpu();
 
 	int configure(const StreamConfiguration &inputCfg,
-		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs);
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+		      Transform transform);
 	Size patternSize(PixelFormat inputFormat);
 	std::vector<PixelFormat> formats(PixelFormat input);
 	std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
-	void process(FrameBuffer *input, FrameBuffer *output, DebayerParams params);
+	void process(FrameBuffer *input, FrameBuffer *output,
+		     FrameBuffer *secondary, const DebayerParams *params);
+	void processStats(FrameBuffer *input, FrameBuffer *output,
+			  FrameBuffer *secondary);
+	void stop();
+	Rectangle cropWindow(const Rectangle &crop) const;
+	void setCrop(const Rectangle &crop);
+	unsigned int maxOutputs() const { return 2; }
+	bool supportsTransform(Transform transform) const;
 	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
 
-	/**
-	 * \brief Get the file descriptor for the statistics
-	 *
-	 * \return the file descriptor pointing to the statistics
-	 */
 	const SharedFD &getStatsFD() { return stats_->getStatsFD(); }
+	void setStatsSampling(unsigned int xSkip, unsigned int ySkip, bool zones)
+	{
+		stats_->setSampling(xSkip, ySkip, zones);
+	}
 
-	/**
-	 * \brief Get the output frame size
-	 *
-	 * \return The output frame size
-	 */
-	unsigned int frameSize() { return outputConfig_.frameSize; }
+	unsigned int frameSize(unsigned int output)
+	{
+		return output ? secondaryConfig_.frameSize : outputConfig_.frameSize;
+	}
+	const std::vector<unsigned int> &planeSizes(unsigned int output)
+	{
+		return output ? secondaryConfig_.planeSizes : outputConfig_.planeSizes;
+	}
 
 private:
 	/**
@@ -85,19 +101,40 @@ private:
 	using debayerFn = void (DebayerCpu::*)(uint8_t *dst, const uint8_t *src[]);
 
 	/* 8-bit raw bayer format */
+	template<bool ccmEnabled>
 	void debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
 	void debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
 	/* unpacked 10-bit raw bayer format */
+	template<bool ccmEnabled>
 	void debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
 	void debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
 	/* unpacked 12-bit raw bayer format */
+	template<bool ccmEnabled>
 	void debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
 	void debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
 	/* CSI-2 packed 10-bit raw bayer format (all the 4 orders) */
+	template<bool ccmEnabled>
 	void debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
 	void debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
 	void debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
 	void debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	/* SIMD interpolated unpacked raw bayer formats */
+	template<bool ccmEnabled>
+	void debayerSimd0_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
+	void debayerSimd1_BGR888(uint8_t *dst, const uint8_t *src[]);
+	template<bool ccmEnabled>
+	void debayerSimd_BGR888(uint8_t *dst, const uint8_t *src[],
+				DebayerSimd::InterpolateFn interpolate);
+	/* Binned unpacked raw bayer formats */
+	template<unsigned int bitDepth, unsigned int scale, bool ccmEnabled>
+	void debayerBinned_BGR888(uint8_t *dst, const uint8_t *src[]);
 
 	struct DebayerInputConfig {
 		Size patternSize;
@@ -110,44 +147,144 @@ private:
 		unsigned int bpp; /* Memory used per pixel, not precision */
 		unsigned int stride;
 		unsigned int frameSize;
+		std::vector<unsigned int> planeSizes;
 	};
 
+	/* Max. supported Bayer pattern height is 4, debayering this requires 5 lines */
+	static constexpr unsigned int kMaxLineBuffers = 5;
+
+	/*
+	 * The window is split in horizontal stripes processed concurrently.
+	 * Each stripe has its own line buffers and statistics accumulators.
+	 */
+	struct Stripe {
+		unsigned int index;
+		unsigned int y; /* Offset of the first line relative to window_.y */
+		unsigned int height;
+		std::vector<uint8_t> lineBuffers[kMaxLineBuffers];
+		unsigned int lineBufferIndex;
+		std::vector<uint8_t> rgbLines[2]; /* For YUV output formats */
+		std::vector<uint8_t> secondaryLines[2]; /* Sampled from rgbLines */
+	};
+
+	class StripeWorker : public Object
+	{
+	public:
+		StripeWorker(DebayerCpu *debayer)
+			: debayer_(debayer)
+		{
+		}
+
+		void process(Stripe *stripe, const uint8_t *src, uint8_t *dst);
+
+	private:
+		DebayerCpu *debayer_;
+	};
+
+	/*
+	 * Called to convert 2 RGB888 lines of \a width pixels to the output
+	 * \a planes, starting at output line y.
+	 */
+	using storeFn = void (*)(const uint8_t *const rgb[2], unsigned int width,
+				 const std::array<uint8_t *, 2> &planes,
+				 unsigned int stride, unsigned int y);
+
+	static void storeRGB(const uint8_t *const rgb[2], unsigned int width,
+			     const std::array<uint8_t *, 2> &planes,
+			     unsigned int stride, unsigned int y);
+	static void storeNV12(const uint8_t *const rgb[2], unsigned int width,
+			      const std::array<uint8_t *, 2> &planes,
+			      unsigned int stride, unsigned int y);
+	static void storeYUYV(const uint8_t *const rgb[2], unsigned int width,
+			      const std::array<uint8_t *, 2> &planes,
+			      unsigned int stride, unsigned int y);
+
 	int getInputConfig(PixelFormat inputFormat, DebayerInputConfig &config);
 	int getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &config);
 	int setupStandardBayerOrder(BayerFormat::Order order);
+	template<bool ccmEnabled>
 	int setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputFormat);
-	void setupInputMemcpy(const uint8_t *linePointers[]);
+	template<bool ccmEnabled>
+	int setupBinning(const BayerFormat &bayerFormat);
+	int configureSecondary(const StreamConfiguration &outputCfg,
+			       const StreamConfiguration &secondaryCfg);
+	int applyWindow(const Rectangle &window, unsigned int scale);
+	int configureStripes();
+	static void copyLineMemcpy(uint8_t *dst, const uint8_t *src, unsigned int length);
+	/* The unpacked formats are always read through the line buffers */
+	bool copyInput() const { return enableInputMemcpy_ || unpackLine_; }
+	void copyInputLine(uint8_t *dst, const uint8_t *src, unsigned int pixels);
+	void setupInputMemcpy(Stripe &stripe, const uint8_t *linePointers[]);
 	void shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src);
-	void memcpyNextLine(const uint8_t *linePointers[]);
-	void process2(const uint8_t *src, uint8_t *dst);
-	void process4(const uint8_t *src, uint8_t *dst);
+	void memcpyNextLine(Stripe &stripe, const uint8_t *linePointers[]);
+	uint8_t *lineDst(Stripe &stripe, unsigned int line, uint8_t *dst);
+	void storeLines(Stripe &stripe, unsigned int y);
+	void storeSecondary(Stripe &stripe, unsigned int y);
+	void emitBuffers(FrameBuffer *input, FrameBuffer *output,
+			 FrameBuffer *secondary);
+	void processStripe(Stripe &stripe, const uint8_t *src, uint8_t *dst);
+	void process2(Stripe &stripe, const uint8_t *src, uint8_t *dst);
+	void process4(Stripe &stripe, const uint8_t *src, uint8_t *dst);
+	void processBinned(Stripe &stripe, const uint8_t *src, uint8_t *dst);
 
-	/* Max. supported Bayer pattern height is 4, debayering this requires 5 lines */
-	static constexpr unsigned int kMaxLineBuffers = 5;
+	/* Number of pixels interpolated with SIMD at a time */
+	static constexpr unsigned int kSimdChunkSize = 128;
+	/* Max. number of stripes processed concurrently */
+	static constexpr unsigned int kMaxStripes = 8;
 
 	DebayerParams::ColorLookupTable red_;
 	DebayerParams::ColorLookupTable green_;
 	DebayerParams::ColorLookupTable blue_;
+	DebayerParams::CcmLookupTable redCcm_;
+	DebayerParams::CcmLookupTable greenCcm_;
+	DebayerParams::CcmLookupTable blueCcm_;
+	DebayerParams::GammaLookupTable gammaLut_;
+	bool ccmEnabled_;
 	debayerFn debayer0_;
 	debayerFn debayer1_;
 	debayerFn debayer2_;
 	debayerFn debayer3_;
+	storeFn store_;
+	debayerFn binned_;
+	unsigned int scale_; /* Binning factor, 1 when not binning */
+	unsigned int maxScale_; /* Binning factor of the uncropped frame */
+	Point binBlue_; /* Position of the blue pixel in the Bayer quad */
+	Point binRed_; /* Position of the red pixel in the Bayer quad */
+	std::array<uint8_t *, 2> outputPlanes_;
+	std::array<uint8_t *, 2> secondaryPlanes_;
+	DebayerSimd::Isa simdIsa_;
+	DebayerSimd::InterpolateFn simdInterpolate0_;
+	DebayerSimd::InterpolateFn simdInterpolate1_;
 	Rectangle window_;
+	Size inputSize_;
+	Size outputSize_;
 	DebayerInputConfig inputConfig_;
 	DebayerOutputConfig outputConfig_;
+	DebayerOutputConfig secondaryConfig_;
+	Size secondarySize_; /* Null when the secondary output is disabled */
+	unsigned int secondaryXStep_; /* Sampling steps in the main output */
+	unsigned int secondaryYStep_;
+	bool hflip_; /* Mirror the output lines */
+	bool vflip_; /* Store the output lines bottom up */
+	PixelFormat inputPixelFormat_;
+	PixelFormat outputPixelFormat_;
 	std::unique_ptr<SwStatsCpu> stats_;
-	uint8_t *lineBuffers_[kMaxLineBuffers];
+	MappedBufferCache inputMappings_;
+	MappedBufferCache outputMappings_;
 	unsigned int lineBufferLength_;
 	unsigned int lineBufferPadding_;
-	unsigned int lineBufferIndex_;
+	unsigned int inputPadding_; /* Padding of the input lines, in bytes */
+	unsigned int maxStripes_;
+	std::vector<Stripe> stripes_;
+	std::vector<std::unique_ptr<Thread>> stripeThreads_;
+	std::vector<std::unique_ptr<StripeWorker>> stripeWorkers_;
+	Semaphore stripesDone_;
 	unsigned int xShift_; /* Offset of 0/1 applied to window_.x */
 	bool enableInputMemcpy_;
+	DebayerSimd::CopyFn copyLine_;
+	RawUnpack::UnpackFn unpackLine_; /* For the formats processed unpacked */
+	unsigned int unpackShift_;
 	bool swapRedBlueGains_;
-	unsigned int measuredFrames_;
-	int64_t frameProcessTime_;
-	/* Skip 30 frames for things to stabilize then measure 30 frames */
-	static constexpr unsigned int kFramesToSkip = 30;
-	static constexpr unsigned int kLastFrameToMeasure = 60;
 };
 
 } /* namespace libcamera */
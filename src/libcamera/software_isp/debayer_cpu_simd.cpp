@@ -0,0 +1,519 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * SIMD helpers for CPU based debayering
+ */
+
+#include "debayer_cpu_simd.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * \file debayer_cpu_simd.h
+ * \brief SIMD helpers for CPU based debayering
+ *
+ * The DebayerCpu inner loops consist of two parts: interpolating the missing
+ * colour components from the neighbouring pixels, and applying the colour
+ * lookup tables. The first part is pure integer arithmetic on adjacent
+ * pixels and maps well onto SIMD instructions, the second part is a table
+ * lookup that can't be vectorized efficiently and stays in DebayerCpu.
+ *
+ * The functions in this file implement the interpolation part for unpacked
+ * 8, 10 and 12 bits per pixel 2x2 Bayer patterns. They produce, for each
+ * output pixel, the blue, green and red lookup table indices, exactly
+ * matching the values computed by the scalar DebayerCpu functions.
+ *
+ * The file also provides the streaming copies used to read the input lines
+ * from uncached buffers into the DebayerCpu line buffers.
+ */
+
+namespace libcamera {
+
+namespace DebayerSimd {
+
+/**
+ * \enum Isa
+ * \brief SIMD instruction set used to interpolate Bayer data
+ * \var Isa::None
+ * \brief No SIMD instruction set available, use the scalar implementation
+ * \var Isa::Neon
+ * \brief ARM NEON (Advanced SIMD)
+ * \var Isa::Sse41
+ * \brief x86 SSE4.1
+ * \var Isa::Avx2
+ * \brief x86 AVX2
+ */
+
+/**
+ * \typedef InterpolateFn
+ * \brief Interpolate one chunk of a Bayer line to lookup table indices
+ * \param[in] src The input lines, as for DebayerCpu::debayerFn
+ * \param[in] x The offset in pixels of the first pixel to process
+ * \param[in] width The number of pixels to process
+ * \param[out] blue The blue lookup table indices, \a width entries
+ * \param[out] green The green lookup table indices, \a width entries
+ * \param[out] red The red lookup table indices, \a width entries
+ *
+ * The pixel at offset \a x must be the first (even) pixel of a Bayer pattern
+ * block.
+ */
+
+/**
+ * \typedef CopyFn
+ * \brief Copy a line of input data to a line buffer
+ * \param[out] dst The destination line buffer
+ * \param[in] src The source line
+ * \param[in] length The number of bytes to copy
+ */
+
+namespace {
+
+/*
+ * Lines of a 2x2 Bayer pattern are either BGBG (bgLine == true) or GRGR lines
+ * (bgLine == false), with the pattern order normalized by DebayerCpu. Shift
+ * converts the input bit depth to the 8 bits lookup table index.
+ */
+template<typename pixel_t, unsigned int Shift, bool BgLine>
+void interpolateScalar(const pixel_t *prev, const pixel_t *curr,
+		       const pixel_t *next, int start, int end,
+		       uint16_t *blue, uint16_t *green, uint16_t *red)
+{
+	for (int i = start; i < end; i++) {
+		const unsigned int c = curr[i] >> Shift;
+		const unsigned int h = (curr[i - 1] + curr[i + 1]) >> (Shift + 1);
+		const unsigned int v = (prev[i] + next[i]) >> (Shift + 1);
+		const unsigned int cross = (prev[i] + curr[i - 1] + curr[i + 1] + next[i]) >> (Shift + 2);
+		const unsigned int diag = (prev[i - 1] + prev[i + 1] + next[i - 1] + next[i + 1]) >> (Shift + 2);
+		const bool odd = i & 1;
+
+		if (BgLine) {
+			blue[i] = odd ? h : c;
+			green[i] = odd ? c : cross;
+			red[i] = odd ? v : diag;
+		} else {
+			blue[i] = odd ? diag : v;
+			green[i] = odd ? cross : c;
+			red[i] = odd ? c : h;
+		}
+	}
+}
+
+#if defined(__ARM_NEON)
+
+inline uint16x8_t neonLoad(const uint8_t *p)
+{
+	return vmovl_u8(vld1_u8(p));
+}
+
+inline uint16x8_t neonLoad(const uint16_t *p)
+{
+	return vld1q_u16(p);
+}
+
+template<unsigned int Shift>
+inline uint16x8_t neonShift(uint16x8_t v)
+{
+	if constexpr (Shift == 0)
+		return v;
+	else
+		return vshrq_n_u16(v, Shift);
+}
+
+template<typename pixel_t, unsigned int Shift, bool BgLine>
+void interpolateNeon(const uint8_t *src[], unsigned int x, unsigned int width,
+		     uint16_t *blue, uint16_t *green, uint16_t *red)
+{
+	const pixel_t *prev = reinterpret_cast<const pixel_t *>(src[0]) + x;
+	const pixel_t *curr = reinterpret_cast<const pixel_t *>(src[1]) + x;
+	const pixel_t *next = reinterpret_cast<const pixel_t *>(src[2]) + x;
+	static const uint16_t oddLanes[8] = { 0, 0xffff, 0, 0xffff, 0, 0xffff, 0, 0xffff };
+	const uint16x8_t odd = vld1q_u16(oddLanes);
+	const int end = width & ~7U;
+
+	for (int i = 0; i < end; i += 8) {
+		uint16x8_t c = neonLoad(curr + i);
+		uint16x8_t h = vaddq_u16(neonLoad(curr + i - 1), neonLoad(curr + i + 1));
+		uint16x8_t v = vaddq_u16(neonLoad(prev + i), neonLoad(next + i));
+		uint16x8_t cross = neonShift<Shift + 2>(vaddq_u16(h, v));
+		uint16x8_t diag = vaddq_u16(vaddq_u16(neonLoad(prev + i - 1), neonLoad(prev + i + 1)),
+					    vaddq_u16(neonLoad(next + i - 1), neonLoad(next + i + 1)));
+		diag = neonShift<Shift + 2>(diag);
+		c = neonShift<Shift>(c);
+		h = neonShift<Shift + 1>(h);
+		v = neonShift<Shift + 1>(v);
+
+		if (BgLine) {
+			vst1q_u16(blue + i, vbslq_u16(odd, h, c));
+			vst1q_u16(green + i, vbslq_u16(odd, c, cross));
+			vst1q_u16(red + i, vbslq_u16(odd, v, diag));
+		} else {
+			vst1q_u16(blue + i, vbslq_u16(odd, diag, v));
+			vst1q_u16(green + i, vbslq_u16(odd, cross, c));
+			vst1q_u16(red + i, vbslq_u16(odd, c, h));
+		}
+	}
+
+	interpolateScalar<pixel_t, Shift, BgLine>(prev, curr, next, end, width,
+						  blue, green, red);
+}
+
+#endif /* __ARM_NEON */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.1"))) inline __m128i sseLoad(const uint8_t *p)
+{
+	return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("sse4.1"))) inline __m128i sseLoad(const uint16_t *p)
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+__attribute__((target("sse4.1"))) inline void sseStore(uint16_t *p, __m128i v)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+template<typename pixel_t, unsigned int Shift, bool BgLine>
+__attribute__((target("sse4.1")))
+void interpolateSse41(const uint8_t *src[], unsigned int x, unsigned int width,
+		      uint16_t *blue, uint16_t *green, uint16_t *red)
+{
+	const pixel_t *prev = reinterpret_cast<const pixel_t *>(src[0]) + x;
+	const pixel_t *curr = reinterpret_cast<const pixel_t *>(src[1]) + x;
+	const pixel_t *next = reinterpret_cast<const pixel_t *>(src[2]) + x;
+	const int end = width & ~7U;
+
+	/* _mm_blend_epi16() takes odd lanes from its second operand with 0xaa */
+	for (int i = 0; i < end; i += 8) {
+		__m128i c = sseLoad(curr + i);
+		__m128i h = _mm_add_epi16(sseLoad(curr + i - 1), sseLoad(curr + i + 1));
+		__m128i v = _mm_add_epi16(sseLoad(prev + i), sseLoad(next + i));
+		__m128i cross = _mm_srli_epi16(_mm_add_epi16(h, v), Shift + 2);
+		__m128i diag = _mm_add_epi16(_mm_add_epi16(sseLoad(prev + i - 1), sseLoad(prev + i + 1)),
+					     _mm_add_epi16(sseLoad(next + i - 1), sseLoad(next + i + 1)));
+		diag = _mm_srli_epi16(diag, Shift + 2);
+		c = _mm_srli_epi16(c, Shift);
+		h = _mm_srli_epi16(h, Shift + 1);
+		v = _mm_srli_epi16(v, Shift + 1);
+
+		if (BgLine) {
+			sseStore(blue + i, _mm_blend_epi16(c, h, 0xaa));
+			sseStore(green + i, _mm_blend_epi16(cross, c, 0xaa));
+			sseStore(red + i, _mm_blend_epi16(diag, v, 0xaa));
+		} else {
+			sseStore(blue + i, _mm_blend_epi16(v, diag, 0xaa));
+			sseStore(green + i, _mm_blend_epi16(c, cross, 0xaa));
+			sseStore(red + i, _mm_blend_epi16(h, c, 0xaa));
+		}
+	}
+
+	interpolateScalar<pixel_t, Shift, BgLine>(prev, curr, next, end, width,
+						  blue, green, red);
+}
+
+__attribute__((target("avx2"))) inline __m256i avxLoad(const uint8_t *p)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("avx2"))) inline __m256i avxLoad(const uint16_t *p)
+{
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+__attribute__((target("avx2"))) inline void avxStore(uint16_t *p, __m256i v)
+{
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+}
+
+template<typename pixel_t, unsigned int Shift, bool BgLine>
+__attribute__((target("avx2")))
+void interpolateAvx2(const uint8_t *src[], unsigned int x, unsigned int width,
+		     uint16_t *blue, uint16_t *green, uint16_t *red)
+{
+	const pixel_t *prev = reinterpret_cast<const pixel_t *>(src[0]) + x;
+	const pixel_t *curr = reinterpret_cast<const pixel_t *>(src[1]) + x;
+	const pixel_t *next = reinterpret_cast<const pixel_t *>(src[2]) + x;
+	const int end = width & ~15U;
+
+	/* The blend immediate applies to each 128-bit lane independently */
+	for (int i = 0; i < end; i += 16) {
+		__m256i c = avxLoad(curr + i);
+		__m256i h = _mm256_add_epi16(avxLoad(curr + i - 1), avxLoad(curr + i + 1));
+		__m256i v = _mm256_add_epi16(avxLoad(prev + i), avxLoad(next + i));
+		__m256i cross = _mm256_srli_epi16(_mm256_add_epi16(h, v), Shift + 2);
+		__m256i diag = _mm256_add_epi16(_mm256_add_epi16(avxLoad(prev + i - 1), avxLoad(prev + i + 1)),
+						_mm256_add_epi16(avxLoad(next + i - 1), avxLoad(next + i + 1)));
+		diag = _mm256_srli_epi16(diag, Shift + 2);
+		c = _mm256_srli_epi16(c, Shift);
+		h = _mm256_srli_epi16(h, Shift + 1);
+		v = _mm256_srli_epi16(v, Shift + 1);
+
+		if (BgLine) {
+			avxStore(blue + i, _mm256_blend_epi16(c, h, 0xaa));
+			avxStore(green + i, _mm256_blend_epi16(cross, c, 0xaa));
+			avxStore(red + i, _mm256_blend_epi16(diag, v, 0xaa));
+		} else {
+			avxStore(blue + i, _mm256_blend_epi16(v, diag, 0xaa));
+			avxStore(green + i, _mm256_blend_epi16(c, cross, 0xaa));
+			avxStore(red + i, _mm256_blend_epi16(h, c, 0xaa));
+		}
+	}
+
+	interpolateScalar<pixel_t, Shift, BgLine>(prev, curr, next, end, width,
+						  blue, green, red);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+/*
+ * Streaming copies of the input lines. The input buffers are often mapped
+ * uncached or write-combined, where each load is a separate bus transaction.
+ * Reading in 64 bytes blocks, with non-temporal loads where available, lets
+ * the CPU fetch full bursts and keeps the input from evicting the line
+ * buffers and lookup tables from the cache. The unaligned head and the tail
+ * of the line are copied with memcpy().
+ */
+constexpr unsigned int kStreamBlockSize = 64;
+
+#if defined(__ARM_NEON)
+
+void streamCopyNeon(uint8_t *dst, const uint8_t *src, unsigned int length)
+{
+	const unsigned int head = std::min<unsigned int>(-reinterpret_cast<uintptr_t>(src) & 15,
+							 length);
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	length -= head;
+
+	for (; length >= kStreamBlockSize; length -= kStreamBlockSize) {
+#if defined(__aarch64__)
+		/* LDNP is a load pair with a non-temporal hint */
+		__asm__ volatile("ldnp q0, q1, [%[src]]\n\t"
+				 "ldnp q2, q3, [%[src], #32]\n\t"
+				 "stp q0, q1, [%[dst]]\n\t"
+				 "stp q2, q3, [%[dst], #32]\n\t"
+				 :
+				 : [src] "r"(src), [dst] "r"(dst)
+				 : "v0", "v1", "v2", "v3", "memory");
+#else
+		const uint8x16_t v0 = vld1q_u8(src);
+		const uint8x16_t v1 = vld1q_u8(src + 16);
+		const uint8x16_t v2 = vld1q_u8(src + 32);
+		const uint8x16_t v3 = vld1q_u8(src + 48);
+
+		vst1q_u8(dst, v0);
+		vst1q_u8(dst + 16, v1);
+		vst1q_u8(dst + 32, v2);
+		vst1q_u8(dst + 48, v3);
+#endif
+		src += kStreamBlockSize;
+		dst += kStreamBlockSize;
+	}
+
+	memcpy(dst, src, length);
+}
+
+#endif /* __ARM_NEON */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* MOVNTDQA fetches whole cache lines from write-combining memory */
+__attribute__((target("sse4.1")))
+void streamCopySse41(uint8_t *dst, const uint8_t *src, unsigned int length)
+{
+	const unsigned int head = std::min<unsigned int>(-reinterpret_cast<uintptr_t>(src) & 15,
+							 length);
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	length -= head;
+
+	for (; length >= kStreamBlockSize; length -= kStreamBlockSize) {
+		__m128i *in = reinterpret_cast<__m128i *>(const_cast<uint8_t *>(src));
+		__m128i *out = reinterpret_cast<__m128i *>(dst);
+
+		const __m128i v0 = _mm_stream_load_si128(in);
+		const __m128i v1 = _mm_stream_load_si128(in + 1);
+		const __m128i v2 = _mm_stream_load_si128(in + 2);
+		const __m128i v3 = _mm_stream_load_si128(in + 3);
+
+		_mm_storeu_si128(out, v0);
+		_mm_storeu_si128(out + 1, v1);
+		_mm_storeu_si128(out + 2, v2);
+		_mm_storeu_si128(out + 3, v3);
+
+		src += kStreamBlockSize;
+		dst += kStreamBlockSize;
+	}
+
+	memcpy(dst, src, length);
+}
+
+__attribute__((target("avx2")))
+void streamCopyAvx2(uint8_t *dst, const uint8_t *src, unsigned int length)
+{
+	const unsigned int head = std::min<unsigned int>(-reinterpret_cast<uintptr_t>(src) & 31,
+							 length);
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	length -= head;
+
+	for (; length >= kStreamBlockSize; length -= kStreamBlockSize) {
+		__m256i *in = reinterpret_cast<__m256i *>(const_cast<uint8_t *>(src));
+		__m256i *out = reinterpret_cast<__m256i *>(dst);
+
+		const __m256i v0 = _mm256_stream_load_si256(in);
+		const __m256i v1 = _mm256_stream_load_si256(in + 1);
+
+		_mm256_storeu_si256(out, v0);
+		_mm256_storeu_si256(out + 1, v1);
+
+		src += kStreamBlockSize;
+		dst += kStreamBlockSize;
+	}
+
+	memcpy(dst, src, length);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+/*
+ * Select the kernel instance for the given bit depth and line type. The bit
+ * depth is converted to 8 bits by shifting right by (bitDepth - 8).
+ */
+#define DEBAYER_SIMD_SELECT(kernel, bitDepth, bgLine)                                  \
+	switch (bitDepth) {                                                            \
+	case 8:                                                                        \
+		return bgLine ? kernel<uint8_t, 0, true> : kernel<uint8_t, 0, false>;  \
+	case 10:                                                                       \
+		return bgLine ? kernel<uint16_t, 2, true> : kernel<uint16_t, 2, false>; \
+	case 12:                                                                       \
+		return bgLine ? kernel<uint16_t, 4, true> : kernel<uint16_t, 4, false>; \
+	default:                                                                       \
+		return nullptr;                                                        \
+	}
+
+} /* namespace */
+
+/**
+ * \brief Detect the best SIMD instruction set supported by the CPU
+ * \return The SIMD instruction set, or Isa::None if none is supported
+ */
+Isa detectIsa()
+{
+#if defined(__ARM_NEON)
+	/* NEON is mandatory on AArch64 and implied by __ARM_NEON on ARM */
+	return Isa::Neon;
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return Isa::Avx2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return Isa::Sse41;
+	return Isa::None;
+#else
+	return Isa::None;
+#endif
+}
+
+/**
+ * \brief Retrieve a printable name for a SIMD instruction set
+ * \param[in] isa The SIMD instruction set
+ * \return The instruction set name
+ */
+const char *isaName(Isa isa)
+{
+	switch (isa) {
+	case Isa::Neon:
+		return "NEON";
+	case Isa::Sse41:
+		return "SSE4.1";
+	case Isa::Avx2:
+		return "AVX2";
+	case Isa::None:
+	default:
+		return "none";
+	}
+}
+
+/**
+ * \brief Get the interpolation function for a Bayer line
+ * \param[in] isa The SIMD instruction set
+ * \param[in] bitDepth The unpacked Bayer data bit depth (8, 10 or 12)
+ * \param[in] bgLine True for BGBG lines, false for GRGR lines
+ *
+ * The Bayer order is expected to have been normalized to BGGR by the caller,
+ * by adjusting the line start offset and swapping the line functions.
+ *
+ * \return The interpolation function, or nullptr if the combination of \a isa
+ * and \a bitDepth isn't supported
+ */
+InterpolateFn interpolateFn(Isa isa, unsigned int bitDepth, bool bgLine)
+{
+	switch (isa) {
+#if defined(__ARM_NEON)
+	case Isa::Neon:
+		DEBAYER_SIMD_SELECT(interpolateNeon, bitDepth, bgLine)
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	case Isa::Sse41:
+		DEBAYER_SIMD_SELECT(interpolateSse41, bitDepth, bgLine)
+	case Isa::Avx2:
+		DEBAYER_SIMD_SELECT(interpolateAvx2, bitDepth, bgLine)
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+/**
+ * \brief Get the streaming line copy function
+ * \param[in] isa The SIMD instruction set
+ *
+ * The streaming copy reads the source in large blocks with non-temporal loads
+ * where the instruction set provides them. It is meant to copy the input
+ * lines from uncached or write-combined buffers to the line buffers, and
+ * produces the same result as memcpy().
+ *
+ * \return The copy function, or nullptr if \a isa has no streaming copy
+ */
+CopyFn streamCopyFn(Isa isa)
+{
+	switch (isa) {
+#if defined(__ARM_NEON)
+	case Isa::Neon:
+		return streamCopyNeon;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	case Isa::Sse41:
+		return streamCopySse41;
+	case Isa::Avx2:
+		return streamCopyAvx2;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+} /* namespace DebayerSimd */
+
+} /* namespace libcamera */
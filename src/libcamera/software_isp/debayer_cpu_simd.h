@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * SIMD helpers for CPU based debayering
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace libcamera {
+
+namespace DebayerSimd {
+
+enum class Isa {
+	None,
+	Neon,
+	Sse41,
+	Avx2,
+};
+
+using InterpolateFn = void (*)(const uint8_t *src[], unsigned int x,
+			       unsigned int width, uint16_t *blue,
+			       uint16_t *green, uint16_t *red);
+
+using CopyFn = void (*)(uint8_t *dst, const uint8_t *src, unsigned int length);
+
+Isa detectIsa();
+const char *isaName(Isa isa);
+
+InterpolateFn interpolateFn(Isa isa, unsigned int bitDepth, bool bgLine);
+
+CopyFn streamCopyFn(Isa isa);
+
+} /* namespace DebayerSimd */
+
+} /* namespace libcamera */
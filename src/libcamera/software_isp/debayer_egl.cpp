@@ -0,0 +1,995 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * GPU based debayering class
+ */
+
+#include "debayer_egl.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+#include <libcamera/base/utils.h>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+/**
+ * \class DebayerEGL
+ * \brief Class for debayering on the GPU
+ *
+ * Implementation of the Debayer interface using OpenGL ES 3.0 through a
+ * surfaceless EGL context. Each output pixel is interpolated by a fragment
+ * shader from the neighbouring input pixels, and the colour lookup tables or
+ * the colour correction matrix and gamma lookup table are applied in the same
+ * pass.
+ *
+ * When the EGL implementation supports importing dmabufs, the input and
+ * output buffers are imported as EGL images and the GPU accesses them without
+ * any copy. Otherwise, or if an import fails, the input is uploaded to a
+ * texture and the output read back to the output buffer.
+ *
+ * The statistics are gathered on the CPU by SwStatsCpu, which only reads the
+ * subsampled lines of the input buffer, while the GPU debayers the frame.
+ *
+ * The GPU only supports the standard Bayer orders, unpacked in 8, 10 or 12
+ * bits, or CSI-2 packed in 10 bits, and produces 32 bits RGB output formats.
+ */
+
+namespace {
+
+/* Full screen triangle, the output pixels are addressed with gl_FragCoord */
+const char *kVertexShader = R"(#version 300 es
+void main()
+{
+	vec2 pos = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1));
+	gl_Position = vec4(pos - 1.0, 0.0, 1.0);
+}
+)";
+
+/*
+ * The input is stored in a R8 texture for 8 bits and CSI-2 packed data, or in
+ * a RG8 texture holding the low and high bytes for unpacked 10 and 12 bits
+ * data. The input texture is thus as wide as the input stride in bytes or in
+ * 16 bits words.
+ *
+ * The interpolation matches the CPU implementation: the missing colours are
+ * the average of the horizontal, vertical, cross or diagonal neighbours.
+ */
+const char *kFragmentShader = R"(
+precision highp float;
+precision highp int;
+
+uniform highp sampler2D inputTexture;
+uniform highp sampler2D lut;
+uniform highp isampler2D ccm;
+uniform highp sampler2D gammaLut;
+
+uniform ivec2 windowOffset;
+uniform ivec2 inputSize;
+uniform ivec2 redPosition;
+uniform int lutShift;
+uniform bool ccmEnabled;
+uniform bool swapRedBlue;
+
+out vec4 fragColor;
+
+float byteAt(ivec2 pos)
+{
+	return floor(texelFetch(inputTexture, pos, 0).r * 255.0 + 0.5);
+}
+
+float pixel(ivec2 pos)
+{
+	pos = clamp(pos, ivec2(0), inputSize - 1);
+
+#if defined(PACKED)
+	/*
+	 * 4 pixels are stored in 5 bytes, the 5th byte holding the LSBs. Only
+	 * the MSBs are used, as by the CPU implementation.
+	 */
+	return byteAt(ivec2((pos.x >> 2) * 5 + (pos.x & 3), pos.y));
+#elif defined(WIDE)
+	vec2 bytes = floor(texelFetch(inputTexture, pos, 0).rg * 255.0 + 0.5);
+	return bytes.r + bytes.g * 256.0;
+#else
+	return byteAt(pos);
+#endif
+}
+
+void main()
+{
+	ivec2 pos = ivec2(gl_FragCoord.xy) + windowOffset;
+
+	float c = pixel(pos);
+	float h = (pixel(pos + ivec2(-1, 0)) + pixel(pos + ivec2(1, 0))) * 0.5;
+	float v = (pixel(pos + ivec2(0, -1)) + pixel(pos + ivec2(0, 1))) * 0.5;
+	float cross = (h + v) * 0.5;
+	float diag = (pixel(pos + ivec2(-1, -1)) + pixel(pos + ivec2(1, -1)) +
+		      pixel(pos + ivec2(-1, 1)) + pixel(pos + ivec2(1, 1))) * 0.25;
+
+	/* Position in the Bayer pattern relative to the red pixel */
+	ivec2 phase = (pos & 1) ^ redPosition;
+	vec3 rgb;
+
+	if (phase == ivec2(0, 0))
+		rgb = vec3(c, cross, diag);
+	else if (phase == ivec2(1, 1))
+		rgb = vec3(diag, cross, c);
+	else if (phase.y == 0)
+		rgb = vec3(h, c, v);
+	else
+		rgb = vec3(v, c, h);
+
+	ivec3 index = clamp(ivec3(rgb) >> lutShift, 0, 255);
+	vec3 result;
+
+	if (ccmEnabled) {
+		ivec3 sum = texelFetch(ccm, ivec2(index.r, 0), 0).rgb +
+			    texelFetch(ccm, ivec2(index.g, 1), 0).rgb +
+			    texelFetch(ccm, ivec2(index.b, 2), 0).rgb;
+		sum = clamp(sum, 0, 1023);
+		result = vec3(texelFetch(gammaLut, ivec2(sum.r, 0), 0).r,
+			      texelFetch(gammaLut, ivec2(sum.g, 0), 0).r,
+			      texelFetch(gammaLut, ivec2(sum.b, 0), 0).r);
+	} else {
+		result = vec3(texelFetch(lut, ivec2(index.r, 0), 0).r,
+			      texelFetch(lut, ivec2(index.g, 0), 0).g,
+			      texelFetch(lut, ivec2(index.b, 0), 0).b);
+	}
+
+	fragColor = vec4(swapRedBlue ? result.bgr : result, 1.0);
+}
+)";
+
+/*
+ * DRM_FORMAT_GR88, with the low byte in the red and the high byte in the green
+ * component. libcamera has no matching pixel format.
+ */
+constexpr uint32_t kFourccGR88 = 'G' | ('R' << 8) | ('8' << 16) | ('8' << 24);
+
+enum TextureUnit {
+	InputUnit = 0,
+	LutUnit = 1,
+	CcmUnit = 2,
+	GammaUnit = 3,
+	/* Not sampled, keeps the output texture away from the shader inputs */
+	OutputUnit = 4,
+};
+
+bool hasExtension(const char *extensions, const char *name)
+{
+	if (!extensions)
+		return false;
+
+	for (const auto &extension : utils::split(extensions, " ")) {
+		if (extension == name)
+			return true;
+	}
+
+	return false;
+}
+
+bool isStandardBayerOrder(BayerFormat::Order order)
+{
+	return order == BayerFormat::BGGR || order == BayerFormat::GBRG ||
+	       order == BayerFormat::GRBG || order == BayerFormat::RGGB;
+}
+
+bool isSupportedInput(const BayerFormat &format)
+{
+	if (!isStandardBayerOrder(format.order))
+		return false;
+
+	if (format.packing == BayerFormat::Packing::None)
+		return format.bitDepth == 8 || format.bitDepth == 10 ||
+		       format.bitDepth == 12;
+
+	return format.packing == BayerFormat::Packing::CSI2 &&
+	       format.bitDepth == 10;
+}
+
+void setTextureParameters(GLuint texture)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+} /* namespace */
+
+/**
+ * \brief Constructs a DebayerEGL object
+ * \param[in] stats Pointer to the stats object to use
+ *
+ * The object is unusable until init() succeeds.
+ */
+DebayerEGL::DebayerEGL(std::unique_ptr<SwStatsCpu> stats)
+	: stats_(std::move(stats)),
+	  inputMappings_(MappedFrameBuffer::MapFlag::Read),
+	  outputMappings_(MappedFrameBuffer::MapFlag::Write),
+	  display_(EGL_NO_DISPLAY),
+	  context_(EGL_NO_CONTEXT), eglCreateImageKHR_(nullptr),
+	  eglDestroyImageKHR_(nullptr), glEGLImageTargetTexture2DOES_(nullptr),
+	  maxTextureSize_(0), importInput_(false), importOutput_(false),
+	  program_(0), inputTexture_(0), uploadTexture_(0), outputTexture_(0),
+	  readbackTexture_(0), framebuffer_(0), lutTexture_(0), ccmTexture_(0),
+	  gammaTexture_(0), ccmEnabledUniform_(-1), swapRedBlueUniform_(-1),
+	  inputImage_(EGL_NO_IMAGE_KHR), outputImage_(EGL_NO_IMAGE_KHR),
+	  inputStride_(0), inputTexelSize_(1), outputStride_(0), frameSize_(0)
+{
+}
+
+DebayerEGL::~DebayerEGL()
+{
+	if (context_ == EGL_NO_CONTEXT)
+		return;
+
+	if (!makeCurrent()) {
+		destroyObjects();
+		releaseCurrent();
+	}
+
+	eglDestroyContext(display_, context_);
+
+	/*
+	 * The display is shared with all other EGL users in the process, don't
+	 * terminate it.
+	 */
+}
+
+/**
+ * \brief Initialize the EGL display and OpenGL ES context
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int DebayerEGL::init()
+{
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+			eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (getPlatformDisplay)
+			display_ = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+						      EGL_DEFAULT_DISPLAY, nullptr);
+	}
+
+	if (display_ == EGL_NO_DISPLAY)
+		display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, nullptr, nullptr)) {
+		LOG(Debayer, Error)
+			<< "Failed to initialize EGL display: 0x"
+			<< utils::hex(eglGetError());
+		return -ENODEV;
+	}
+
+	const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+	if (!hasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+		LOG(Debayer, Error) << "EGL surfaceless contexts not supported";
+		return -ENOTSUP;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_ES_API)) {
+		LOG(Debayer, Error) << "OpenGL ES not supported";
+		return -ENOTSUP;
+	}
+
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	if (!hasExtension(extensions, "EGL_KHR_no_config_context") &&
+	    !hasExtension(extensions, "EGL_MESA_configless_context")) {
+		const EGLint configAttribs[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+			EGL_SURFACE_TYPE, EGL_DONT_CARE,
+			EGL_NONE
+		};
+		EGLint count = 0;
+
+		if (!eglChooseConfig(display_, configAttribs, &config, 1, &count) ||
+		    count == 0) {
+			LOG(Debayer, Error) << "No EGL config for OpenGL ES 3.0";
+			return -ENOTSUP;
+		}
+	}
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_CLIENT_VERSION, 3,
+		EGL_NONE
+	};
+	context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context_ == EGL_NO_CONTEXT) {
+		LOG(Debayer, Error)
+			<< "Failed to create OpenGL ES 3.0 context: 0x"
+			<< utils::hex(eglGetError());
+		return -ENOTSUP;
+	}
+
+	int ret = makeCurrent();
+	if (ret)
+		return ret;
+
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize_);
+
+	const char *glExtensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+	if (hasExtension(extensions, "EGL_EXT_image_dma_buf_import") &&
+	    hasExtension(glExtensions, "GL_OES_EGL_image")) {
+		eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+			eglGetProcAddress("eglCreateImageKHR"));
+		eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+			eglGetProcAddress("eglDestroyImageKHR"));
+		glEGLImageTargetTexture2DOES_ = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(
+			eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+	}
+
+	LOG(Debayer, Info)
+		<< "Using GPU " << glGetString(GL_RENDERER) << ", "
+		<< (glEGLImageTargetTexture2DOES_ ? "with" : "without")
+		<< " dmabuf import";
+
+	releaseCurrent();
+
+	return 0;
+}
+
+int DebayerEGL::makeCurrent()
+{
+	if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+		LOG(Debayer, Error)
+			<< "Failed to make the EGL context current: 0x"
+			<< utils::hex(eglGetError());
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * The context is made current in the thread that uses it, configure() runs in
+ * the pipeline handler thread and process() in the Software ISP worker thread.
+ */
+void DebayerEGL::releaseCurrent()
+{
+	eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void DebayerEGL::destroyObjects()
+{
+	const GLuint textures[] = {
+		inputTexture_, uploadTexture_, outputTexture_, readbackTexture_,
+		lutTexture_, ccmTexture_, gammaTexture_,
+	};
+
+	glDeleteTextures(std::size(textures), textures);
+	glDeleteFramebuffers(1, &framebuffer_);
+	glDeleteProgram(program_);
+
+	inputTexture_ = uploadTexture_ = outputTexture_ = readbackTexture_ = 0;
+	lutTexture_ = ccmTexture_ = gammaTexture_ = 0;
+	framebuffer_ = 0;
+	program_ = 0;
+}
+
+GLuint DebayerEGL::compileShader(GLenum type, const std::string &source)
+{
+	GLuint shader = glCreateShader(type);
+	const char *str = source.c_str();
+	GLint status;
+
+	glShaderSource(shader, 1, &str, nullptr);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status)
+		return shader;
+
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	std::string log(std::max(length, 1), '\0');
+	glGetShaderInfoLog(shader, log.size(), nullptr, log.data());
+
+	LOG(Debayer, Error) << "Failed to compile shader: " << log.c_str();
+	glDeleteShader(shader);
+
+	return 0;
+}
+
+int DebayerEGL::createProgram()
+{
+	std::string fragmentSource = "#version 300 es\n";
+	if (inputFormat_.packing == BayerFormat::Packing::CSI2)
+		fragmentSource += "#define PACKED\n";
+	else if (inputFormat_.bitDepth > 8)
+		fragmentSource += "#define WIDE\n";
+	fragmentSource += kFragmentShader;
+
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, kVertexShader);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+	if (!vertexShader || !fragmentShader) {
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return -EINVAL;
+	}
+
+	program_ = glCreateProgram();
+	glAttachShader(program_, vertexShader);
+	glAttachShader(program_, fragmentShader);
+	glLinkProgram(program_);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint status;
+	glGetProgramiv(program_, GL_LINK_STATUS, &status);
+	if (!status) {
+		LOG(Debayer, Error) << "Failed to link shader program";
+		return -EINVAL;
+	}
+
+	glUseProgram(program_);
+
+	glUniform1i(glGetUniformLocation(program_, "inputTexture"), InputUnit);
+	glUniform1i(glGetUniformLocation(program_, "lut"), LutUnit);
+	glUniform1i(glGetUniformLocation(program_, "ccm"), CcmUnit);
+	glUniform1i(glGetUniformLocation(program_, "gammaLut"), GammaUnit);
+
+	/* The red pixel position in the 2x2 pattern */
+	int redX = 0, redY = 0;
+	switch (inputFormat_.order) {
+	case BayerFormat::BGGR:
+		redX = redY = 1;
+		break;
+	case BayerFormat::GBRG:
+		redY = 1;
+		break;
+	case BayerFormat::GRBG:
+		redX = 1;
+		break;
+	default:
+		break;
+	}
+
+	/* The lookup tables are indexed with 8 bits values */
+	const int lutShift = inputFormat_.packing == BayerFormat::Packing::CSI2
+				     ? 0
+				     : inputFormat_.bitDepth - 8;
+
+	/*
+	 * The CPU implementation shifts the window by one pixel for the orders
+	 * starting with a green pixel on the blue line, match it to produce
+	 * the same image.
+	 */
+	const int xShift = redX ? 0 : 1;
+
+	glUniform2i(glGetUniformLocation(program_, "windowOffset"),
+		    window_.x + xShift, window_.y);
+	glUniform2i(glGetUniformLocation(program_, "inputSize"),
+		    inputSize_.width, inputSize_.height);
+	glUniform2i(glGetUniformLocation(program_, "redPosition"), redX, redY);
+	glUniform1i(glGetUniformLocation(program_, "lutShift"), lutShift);
+
+	ccmEnabledUniform_ = glGetUniformLocation(program_, "ccmEnabled");
+	swapRedBlueUniform_ = glGetUniformLocation(program_, "swapRedBlue");
+
+	return 0;
+}
+
+int DebayerEGL::createTextures()
+{
+	GLuint textures[4];
+
+	glGenTextures(std::size(textures), textures);
+	inputTexture_ = textures[0];
+	lutTexture_ = textures[1];
+	ccmTexture_ = textures[2];
+	gammaTexture_ = textures[3];
+
+	for (GLuint texture : textures)
+		setTextureParameters(texture);
+
+	glBindTexture(GL_TEXTURE_2D, lutTexture_);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, DebayerParams::kRGBLookupSize, 1);
+	glBindTexture(GL_TEXTURE_2D, ccmTexture_);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16I, DebayerParams::kRGBLookupSize, 3);
+	glBindTexture(GL_TEXTURE_2D, gammaTexture_);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, DebayerParams::kGammaLookupSize, 1);
+
+	glGenTextures(1, &outputTexture_);
+	setTextureParameters(outputTexture_);
+	glGenFramebuffers(1, &framebuffer_);
+
+	if (glGetError() != GL_NO_ERROR) {
+		LOG(Debayer, Error) << "Failed to create textures";
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int DebayerEGL::configure(const StreamConfiguration &inputCfg,
+			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+			  Transform transform)
+{
+	if (!supportsTransform(transform)) {
+		LOG(Debayer, Error)
+			<< "Unsupported transform " << transformToString(transform);
+		return -EINVAL;
+	}
+
+	inputFormat_ = BayerFormat::fromPixelFormat(inputCfg.pixelFormat);
+	if (!isSupportedInput(inputFormat_)) {
+		LOG(Debayer, Error)
+			<< "Unsupported input format " << inputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	/* The buffers of the previous session aren't used anymore */
+	inputMappings_.clear();
+	outputMappings_.clear();
+
+	if (stats_->configure(inputCfg) != 0)
+		return -EINVAL;
+
+	const Size pattern = patternSize(inputCfg.pixelFormat);
+	const Size &statsPatternSize = stats_->patternSize();
+	if (pattern.width != statsPatternSize.width ||
+	    pattern.height != statsPatternSize.height) {
+		LOG(Debayer, Error)
+			<< "mismatching stats and debayer pattern sizes for "
+			<< inputCfg.pixelFormat.toString();
+		return -EINVAL;
+	}
+
+	if (outputCfgs.size() != 1) {
+		LOG(Debayer, Error)
+			<< "Unsupported number of output streams: "
+			<< outputCfgs.size();
+		return -EINVAL;
+	}
+
+	const StreamConfiguration &outputCfg = outputCfgs[0];
+	SizeRange outSizeRange = sizes(inputCfg.pixelFormat, inputCfg.size);
+	std::tie(outputStride_, frameSize_) =
+		strideAndFrameSize(outputCfg.pixelFormat, outputCfg.size);
+
+	if (!outSizeRange.contains(outputCfg.size) || outputStride_ != outputCfg.stride) {
+		LOG(Debayer, Error)
+			<< "Invalid output size/stride: "
+			<< "\n  " << outputCfg.size << " (" << outSizeRange << ")"
+			<< "\n  " << outputCfg.stride << " (" << outputStride_ << ")";
+		return -EINVAL;
+	}
+
+	inputSize_ = inputCfg.size;
+	inputStride_ = inputCfg.stride;
+	inputTexelSize_ = inputFormat_.packing == BayerFormat::Packing::None &&
+					  inputFormat_.bitDepth > 8
+				  ? 2
+				  : 1;
+	outputFormat_ = outputCfg.pixelFormat;
+	outputSize_ = outputCfg.size;
+	planeSizes_ = { frameSize_ };
+
+	const unsigned int maxSize = maxTextureSize_;
+	if (inputStride_ / inputTexelSize_ > maxSize || inputSize_.height > maxSize ||
+	    outputSize_.width > maxSize || outputSize_.height > maxSize) {
+		LOG(Debayer, Error)
+			<< "Frame size exceeds the maximum GPU texture size "
+			<< maxSize;
+		return -EINVAL;
+	}
+
+	window_.x = ((inputSize_.width - outputSize_.width) / 2) &
+		    ~(pattern.width - 1);
+	window_.y = ((inputSize_.height - outputSize_.height) / 2) &
+		    ~(pattern.height - 1);
+	window_.width = outputSize_.width;
+	window_.height = outputSize_.height;
+
+	stats_->setWindow(Rectangle(window_.size()));
+	stats_->setStripeCount(1);
+
+	importInput_ = glEGLImageTargetTexture2DOES_ != nullptr;
+	importOutput_ = glEGLImageTargetTexture2DOES_ != nullptr;
+
+	int ret = makeCurrent();
+	if (ret)
+		return ret;
+
+	destroyObjects();
+
+	ret = createProgram();
+	if (!ret)
+		ret = createTextures();
+
+	releaseCurrent();
+
+	return ret;
+}
+
+/**
+ * \brief Get the width and height at which the bayer pattern repeats
+ * \param[in] inputFormat The input format
+ *
+ * \return Pattern size or an empty size for unsupported inputFormats
+ */
+Size DebayerEGL::patternSize(PixelFormat inputFormat)
+{
+	BayerFormat bayerFormat = BayerFormat::fromPixelFormat(inputFormat);
+
+	if (!isSupportedInput(bayerFormat))
+		return {};
+
+	/* 5 bytes per 4 pixels for the CSI-2 packed format */
+	if (bayerFormat.packing == BayerFormat::Packing::CSI2)
+		return { 4, 2 };
+
+	return { 2, 2 };
+}
+
+std::vector<PixelFormat> DebayerEGL::formats(PixelFormat inputFormat)
+{
+	if (patternSize(inputFormat).isNull())
+		return {};
+
+	return { formats::XRGB8888, formats::ARGB8888,
+		 formats::XBGR8888, formats::ABGR8888 };
+}
+
+std::tuple<unsigned int, unsigned int>
+DebayerEGL::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size)
+{
+	if (outputFormat != formats::XRGB8888 && outputFormat != formats::ARGB8888 &&
+	    outputFormat != formats::XBGR8888 && outputFormat != formats::ABGR8888)
+		return std::make_tuple(0, 0);
+
+	/* Align the stride to the largest common GPU render target pitch alignment */
+	unsigned int stride = utils::alignUp(size.width * 4, 256);
+
+	return std::make_tuple(stride, stride * size.height);
+}
+
+EGLImageKHR DebayerEGL::importImage(const FrameBuffer::Plane &plane, uint32_t fourcc,
+				    unsigned int width, unsigned int height,
+				    unsigned int stride)
+{
+	const EGLint attribs[] = {
+		EGL_WIDTH, static_cast<EGLint>(width),
+		EGL_HEIGHT, static_cast<EGLint>(height),
+		EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(fourcc),
+		EGL_DMA_BUF_PLANE0_FD_EXT, plane.fd.get(),
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(plane.offset),
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, static_cast<EGLint>(stride),
+		EGL_NONE
+	};
+
+	return eglCreateImageKHR_(display_, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+				  nullptr, attribs);
+}
+
+/*
+ * Bind the input buffer to the input texture unit, importing the dmabuf or
+ * uploading the mapped data.
+ */
+bool DebayerEGL::bindInput(const FrameBuffer *input, const uint8_t *data)
+{
+	const unsigned int width = inputStride_ / inputTexelSize_;
+	const unsigned int height = inputSize_.height;
+
+	glActiveTexture(GL_TEXTURE0 + InputUnit);
+
+	if (importInput_) {
+		const uint32_t fourcc = inputTexelSize_ == 2 ? kFourccGR88
+							      : formats::R8.fourcc();
+
+		inputImage_ = importImage(input->planes()[0], fourcc, width, height,
+					  inputStride_);
+		if (inputImage_ != EGL_NO_IMAGE_KHR) {
+			glBindTexture(GL_TEXTURE_2D, inputTexture_);
+			glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, inputImage_);
+			if (glGetError() == GL_NO_ERROR)
+				return true;
+		}
+
+		LOG(Debayer, Warning)
+			<< "Failed to import input buffer, falling back to upload";
+		importInput_ = false;
+	}
+
+	if (!uploadTexture_) {
+		glGenTextures(1, &uploadTexture_);
+		setTextureParameters(uploadTexture_);
+		glTexStorage2D(GL_TEXTURE_2D, 1, inputTexelSize_ == 2 ? GL_RG8 : GL_R8,
+			       width, height);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, uploadTexture_);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+			inputTexelSize_ == 2 ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, data);
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+/*
+ * Bind the output buffer, or the read back texture, to the framebuffer. The
+ * RGBA read back produces R, G, B, A bytes, the red and blue components are
+ * swapped in the shader for the XRGB8888 and ARGB8888 formats stored as
+ * B, G, R, A bytes.
+ */
+bool DebayerEGL::bindOutput(const FrameBuffer *output)
+{
+	glActiveTexture(GL_TEXTURE0 + OutputUnit);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+
+	if (importOutput_) {
+		outputImage_ = importImage(output->planes()[0], outputFormat_.fourcc(),
+					   outputSize_.width, outputSize_.height,
+					   outputStride_);
+		if (outputImage_ != EGL_NO_IMAGE_KHR) {
+			glBindTexture(GL_TEXTURE_2D, outputTexture_);
+			glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, outputImage_);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					       GL_TEXTURE_2D, outputTexture_, 0);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+				glUniform1i(swapRedBlueUniform_, false);
+				return true;
+			}
+		}
+
+		LOG(Debayer, Warning)
+			<< "Failed to import output buffer, falling back to read back";
+		importOutput_ = false;
+	}
+
+	if (!readbackTexture_) {
+		glGenTextures(1, &readbackTexture_);
+		setTextureParameters(readbackTexture_);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, outputSize_.width,
+			       outputSize_.height);
+	}
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			       GL_TEXTURE_2D, readbackTexture_, 0);
+	glUniform1i(swapRedBlueUniform_,
+		    outputFormat_ == formats::XRGB8888 || outputFormat_ == formats::ARGB8888);
+
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void DebayerEGL::updateLookupTables(const DebayerParams *params)
+{
+	glUniform1i(ccmEnabledUniform_, params->ccmEnabled);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (params->ccmEnabled) {
+		std::array<int16_t, DebayerParams::kRGBLookupSize * 3 * 4> ccm;
+		const DebayerParams::CcmLookupTable *tables[] = {
+			&params->redCcm, &params->greenCcm, &params->blueCcm,
+		};
+
+		for (unsigned int row = 0; row < 3; row++) {
+			for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+				const DebayerParams::CcmColumn &column = (*tables[row])[i];
+				int16_t *texel = &ccm[(row * DebayerParams::kRGBLookupSize + i) * 4];
+
+				texel[0] = column.r;
+				texel[1] = column.g;
+				texel[2] = column.b;
+				texel[3] = 0;
+			}
+		}
+
+		glActiveTexture(GL_TEXTURE0 + CcmUnit);
+		glBindTexture(GL_TEXTURE_2D, ccmTexture_);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DebayerParams::kRGBLookupSize, 3,
+				GL_RGBA_INTEGER, GL_SHORT, ccm.data());
+
+		glActiveTexture(GL_TEXTURE0 + GammaUnit);
+		glBindTexture(GL_TEXTURE_2D, gammaTexture_);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DebayerParams::kGammaLookupSize, 1,
+				GL_RED, GL_UNSIGNED_BYTE, params->gammaLut.data());
+	} else {
+		std::array<uint8_t, DebayerParams::kRGBLookupSize * 4> lut;
+
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			lut[i * 4] = params->red[i];
+			lut[i * 4 + 1] = params->green[i];
+			lut[i * 4 + 2] = params->blue[i];
+			lut[i * 4 + 3] = 0;
+		}
+
+		glActiveTexture(GL_TEXTURE0 + LutUnit);
+		glBindTexture(GL_TEXTURE_2D, lutTexture_);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DebayerParams::kRGBLookupSize, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, lut.data());
+	}
+}
+
+/* Gather the statistics on the CPU, only the sampled lines are read */
+void DebayerEGL::gatherStats(const uint8_t *src, uint32_t frame)
+{
+	const uint8_t *linePointers[3];
+
+	const unsigned int xOffset = inputFormat_.packing == BayerFormat::Packing::CSI2
+					     ? window_.x * 5 / 4
+					     : window_.x * inputTexelSize_;
+
+	src += window_.y * inputStride_ + xOffset;
+
+	stats_->startFrame();
+
+	for (unsigned int y = 0; y < static_cast<unsigned int>(window_.height); y += 2) {
+		linePointers[1] = src + y * inputStride_;
+		linePointers[2] = linePointers[1] + inputStride_;
+		linePointers[0] = y ? linePointers[1] - inputStride_ : linePointers[2];
+
+		stats_->processLine0(y, linePointers);
+	}
+
+	stats_->finishFrame(frame);
+}
+
+void DebayerEGL::process(FrameBuffer *input, FrameBuffer *output,
+			 [[maybe_unused]] FrameBuffer *secondary,
+			 const DebayerParams *params)
+{
+	const utils::time_point frameStartTime = utils::clock::now();
+
+	/* Only a single output is supported */
+	ASSERT(output && !secondary);
+
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.status = input->metadata().status;
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+
+	/* The input is always mapped for the statistics */
+	const MappedFrameBuffer *in = inputMappings_.map(input);
+	if (!in || makeCurrent()) {
+		LOG(Debayer, Error) << "Failed to prepare the input buffer";
+		metadata.status = FrameMetadata::FrameError;
+		outputBufferReady.emit(output);
+		inputBufferReady.emit(input);
+		return;
+	}
+
+	inputImage_ = EGL_NO_IMAGE_KHR;
+	outputImage_ = EGL_NO_IMAGE_KHR;
+
+	glUseProgram(program_);
+	updateLookupTables(params);
+
+	std::vector<DmaSyncer> dmaSyncers;
+	for (const FrameBuffer::Plane &plane : input->planes())
+		dmaSyncers.emplace_back(plane.fd, DmaSyncer::SyncType::Read);
+
+	bool ok = bindInput(input, in->planes()[0].data()) && bindOutput(output);
+
+	const utils::time_point debayerStartTime = utils::clock::now();
+
+	if (ok) {
+		glViewport(0, 0, outputSize_.width, outputSize_.height);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	const utils::time_point statsStartTime = utils::clock::now();
+
+	/* Overlap the statistics with the GPU processing */
+	gatherStats(in->planes()[0].data(), input->metadata().sequence);
+
+	const utils::time_point statsEndTime = utils::clock::now();
+
+	if (ok && !importOutput_) {
+		const MappedFrameBuffer *out = outputMappings_.map(output);
+		if (out) {
+			for (const FrameBuffer::Plane &plane : output->planes())
+				dmaSyncers.emplace_back(plane.fd, DmaSyncer::SyncType::Write);
+
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			glPixelStorei(GL_PACK_ROW_LENGTH, outputStride_ / 4);
+			glReadPixels(0, 0, outputSize_.width, outputSize_.height,
+				     GL_RGBA, GL_UNSIGNED_BYTE, out->planes()[0].data());
+			glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		} else {
+			ok = false;
+		}
+	} else {
+		glFinish();
+	}
+
+	dmaSyncers.clear();
+
+	if (glGetError() != GL_NO_ERROR)
+		ok = false;
+
+	if (inputImage_ != EGL_NO_IMAGE_KHR)
+		eglDestroyImageKHR_(display_, inputImage_);
+	if (outputImage_ != EGL_NO_IMAGE_KHR)
+		eglDestroyImageKHR_(display_, outputImage_);
+
+	releaseCurrent();
+
+	if (!ok) {
+		LOG(Debayer, Error) << "GPU processing failed";
+		metadata.status = FrameMetadata::FrameError;
+	}
+
+	metadata.planes()[0].bytesused = frameSize_;
+
+	const uint32_t frame = input->metadata().sequence;
+	const uint64_t timestamp = input->metadata().timestamp;
+	const utils::time_point signalsStartTime = utils::clock::now();
+
+	outputBufferReady.emit(output);
+	inputBufferReady.emit(input);
+
+	/* The GPU time includes waiting for the draw after the statistics */
+	reportTiming(frame, timestamp,
+		     { debayerStartTime - frameStartTime,
+		       (statsStartTime - debayerStartTime) +
+			       (signalsStartTime - statsEndTime),
+		       statsEndTime - statsStartTime,
+		       utils::clock::now() - signalsStartTime });
+}
+
+void DebayerEGL::processStats(FrameBuffer *input, FrameBuffer *output,
+			      [[maybe_unused]] FrameBuffer *secondary)
+{
+	ASSERT(output && !secondary);
+
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.status = FrameMetadata::FrameCancelled;
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+
+	/* The statistics are gathered on the CPU, the GPU isn't involved */
+	const MappedFrameBuffer *in = inputMappings_.map(input);
+	if (in) {
+		std::vector<DmaSyncer> dmaSyncers;
+		for (const FrameBuffer::Plane &plane : input->planes())
+			dmaSyncers.emplace_back(plane.fd, DmaSyncer::SyncType::Read);
+
+		gatherStats(in->planes()[0].data(), input->metadata().sequence);
+	} else {
+		LOG(Debayer, Error) << "Failed to map the input buffer";
+	}
+
+	outputBufferReady.emit(output);
+	inputBufferReady.emit(input);
+}
+
+void DebayerEGL::stop()
+{
+	inputMappings_.clear();
+	outputMappings_.clear();
+}
+
+SizeRange DebayerEGL::sizes(PixelFormat inputFormat, const Size &inputSize)
+{
+	Size pattern = patternSize(inputFormat);
+
+	if (pattern.isNull())
+		return {};
+
+	/* Keep a border of a pattern width on both sides as the CPU does */
+	if (inputSize.width < 3 * pattern.width ||
+	    inputSize.height < pattern.height) {
+		LOG(Debayer, Warning)
+			<< "Input format size too small: " << inputSize.toString();
+		return {};
+	}
+
+	return SizeRange(Size(pattern.width, pattern.height),
+			 Size((inputSize.width - 2 * pattern.width) & ~(pattern.width - 1),
+			      inputSize.height & ~(pattern.height - 1)),
+			 pattern.width, pattern.height);
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * GPU based debayering header
+ */
+
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/* Don't pull in the X11 headers, their macros clash with libcamera names */
+#ifndef EGL_NO_X11
+#define EGL_NO_X11
+#endif
+#ifndef MESA_EGL_NO_X11_HEADERS
+#define MESA_EGL_NO_X11_HEADERS
+#endif
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/bayer_format.h"
+
+#include "debayer.h"
+#include "mapped_buffer_cache.h"
+#include "swstats_cpu.h"
+
+namespace libcamera {
+
+class DebayerEGL : public Debayer
+{
+public:
+	DebayerEGL(std::unique_ptr<SwStatsCpu> stats);
+	~DebayerEGL();
+
+	int init();
+
+	int configure(const StreamConfiguration &inputCfg,
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+		      Transform transform);
+	Size patternSize(PixelFormat inputFormat);
+	std::vector<PixelFormat> formats(PixelFormat input);
+	std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
+	void process(FrameBuffer *input, FrameBuffer *output,
+		     FrameBuffer *secondary, const DebayerParams *params);
+	void processStats(FrameBuffer *input, FrameBuffer *output,
+			  FrameBuffer *secondary);
+	void stop();
+	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
+
+	const SharedFD &getStatsFD() { return stats_->getStatsFD(); }
+	void setStatsSampling(unsigned int xSkip, unsigned int ySkip, bool zones)
+	{
+		stats_->setSampling(xSkip, ySkip, zones);
+	}
+
+	unsigned int frameSize([[maybe_unused]] unsigned int output) { return frameSize_; }
+	const std::vector<unsigned int> &planeSizes([[maybe_unused]] unsigned int output)
+	{
+		return planeSizes_;
+	}
+
+private:
+	int makeCurrent();
+	void releaseCurrent();
+	void destroyObjects();
+
+	GLuint compileShader(GLenum type, const std::string &source);
+	int createProgram();
+	int createTextures();
+
+	EGLImageKHR importImage(const FrameBuffer::Plane &plane, uint32_t fourcc,
+				unsigned int width, unsigned int height,
+				unsigned int stride);
+	bool bindInput(const FrameBuffer *input, const uint8_t *data);
+	bool bindOutput(const FrameBuffer *output);
+	void updateLookupTables(const DebayerParams *params);
+	void gatherStats(const uint8_t *src, uint32_t frame);
+
+	std::unique_ptr<SwStatsCpu> stats_;
+	MappedBufferCache inputMappings_;
+	MappedBufferCache outputMappings_;
+
+	EGLDisplay display_;
+	EGLContext context_;
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_;
+	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES_;
+	GLint maxTextureSize_;
+
+	/* Import the buffers as EGL images, cleared if an import fails */
+	bool importInput_;
+	bool importOutput_;
+
+	GLuint program_;
+	GLuint inputTexture_;
+	GLuint uploadTexture_;
+	GLuint outputTexture_;
+	GLuint readbackTexture_;
+	GLuint framebuffer_;
+	GLuint lutTexture_;
+	GLuint ccmTexture_;
+	GLuint gammaTexture_;
+	GLint ccmEnabledUniform_;
+	GLint swapRedBlueUniform_;
+	EGLImageKHR inputImage_;
+	EGLImageKHR outputImage_;
+
+	BayerFormat inputFormat_;
+	unsigned int inputStride_;
+	Size inputSize_;
+	unsigned int inputTexelSize_;
+
+	PixelFormat outputFormat_;
+	unsigned int outputStride_;
+	Size outputSize_;
+	unsigned int frameSize_;
+	std::vector<unsigned int> planeSizes_;
+
+	Rectangle window_;
+};
+
+} /* namespace libcamera */
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Cache of frame buffer memory mappings
+ */
+
+#include "mapped_buffer_cache.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libcamera/base/log.h>
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Buffer)
+
+/**
+ * \class MappedBufferCache
+ * \brief Keep frame buffers mapped across frames
+ *
+ * Mapping and unmapping the input and output buffers for every frame costs
+ * two system calls per buffer, and the page faults to populate the page
+ * tables again on the first access. The frame buffers are recycled from a
+ * small pool for the whole capture session, this class keeps their mappings
+ * alive and returns the existing mapping when a buffer comes back.
+ *
+ * A FrameBuffer may be destroyed and another one allocated at the same
+ * address. The cache identifies the memory of each plane by its file, offset
+ * and length, and maps the buffer again when they change. As the cached
+ * mapping holds a reference to the old file, a new file can't reuse its
+ * identity.
+ *
+ * The cache doesn't handle CPU cache coherency, users shall bracket the
+ * accesses to the mapped memory with MappedFrameBuffer::beginAccess() and
+ * MappedFrameBuffer::endAccess().
+ */
+
+/**
+ * \brief Construct a MappedBufferCache
+ * \param[in] flags The mapping flags for all the buffers
+ */
+MappedBufferCache::MappedBufferCache(MappedFrameBuffer::MapFlags flags)
+	: flags_(flags)
+{
+}
+
+/**
+ * \brief Get the mapping of a frame buffer
+ * \param[in] buffer The frame buffer
+ *
+ * Return the cached mapping for \a buffer, or map it if it isn't in the cache.
+ *
+ * \return The mapped buffer, or nullptr if the buffer can't be mapped
+ */
+MappedFrameBuffer *MappedBufferCache::map(const FrameBuffer *buffer)
+{
+	if (!planeIds(buffer, &ids_))
+		return nullptr;
+
+	auto it = entries_.find(buffer);
+	if (it != entries_.end()) {
+		if (it->second.planes == ids_)
+			return it->second.mapping.get();
+
+		/* The buffer has been replaced by another one at the same address */
+		entries_.erase(it);
+	}
+
+	if (entries_.size() >= kMaxEntries)
+		entries_.clear();
+
+	auto mapping = std::make_unique<MappedFrameBuffer>(buffer, flags_);
+	if (!mapping->isValid())
+		return nullptr;
+
+	Entry &entry = entries_[buffer];
+	entry.planes = ids_;
+	entry.mapping = std::move(mapping);
+
+	return entry.mapping.get();
+}
+
+/**
+ * \brief Unmap all the buffers
+ *
+ * This shall be called when the buffers of the previous session are not used
+ * anymore, typically when the processing is configured.
+ */
+void MappedBufferCache::clear()
+{
+	entries_.clear();
+}
+
+bool MappedBufferCache::planeIds(const FrameBuffer *buffer, std::vector<PlaneId> *ids)
+{
+	struct stat st = {};
+	int lastFd = -1;
+
+	ids->clear();
+
+	for (const FrameBuffer::Plane &plane : buffer->planes()) {
+		const int fd = plane.fd.get();
+
+		/* The planes usually share the same file */
+		if (fd != lastFd && fstat(fd, &st) < 0) {
+			int ret = errno;
+			LOG(Buffer, Error)
+				<< "Failed to stat plane: " << strerror(ret);
+			return false;
+		}
+
+		lastFd = fd;
+		ids->emplace_back(st.st_dev, st.st_ino, plane.offset, plane.length);
+	}
+
+	return true;
+}
+
+} /* namespace libcamera */
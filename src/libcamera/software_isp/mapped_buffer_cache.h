@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Cache of frame buffer memory mappings
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <sys/types.h>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+class MappedBufferCache
+{
+public:
+	MappedBufferCache(MappedFrameBuffer::MapFlags flags);
+
+	MappedFrameBuffer *map(const FrameBuffer *buffer);
+	void clear();
+
+private:
+	/* Bounds the mappings kept for buffers that are not used anymore */
+	static constexpr unsigned int kMaxEntries = 32;
+
+	/* Identifies the memory of a plane, the file, offset and length */
+	using PlaneId = std::tuple<dev_t, ino_t, unsigned int, unsigned int>;
+
+	struct Entry {
+		std::vector<PlaneId> planes;
+		std::unique_ptr<MappedFrameBuffer> mapping;
+	};
+
+	static bool planeIds(const FrameBuffer *buffer, std::vector<PlaneId> *ids);
+
+	MappedFrameBuffer::MapFlags flags_;
+	std::map<const FrameBuffer *, Entry> entries_;
+	std::vector<PlaneId> ids_;
+};
+
+} /* namespace libcamera */
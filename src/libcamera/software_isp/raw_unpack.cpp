@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Unpacking of CSI-2 packed raw Bayer lines
+ */
+
+#include "raw_unpack.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * \file raw_unpack.h
+ * \brief Unpacking of CSI-2 packed raw Bayer lines
+ *
+ * The CSI-2 packed raw formats store groups of pixels in whole bytes: the 8
+ * most significant bits of each pixel of the group, followed by the least
+ * significant bits of all the pixels of the group packed in little endian
+ * order. The 10 and 14 bits formats use groups of 4 pixels in 5 and 7 bytes,
+ * the 12 bits format groups of 2 pixels in 3 bytes.
+ *
+ * The functions in this file unpack lines of these formats to 16 bits per
+ * pixel. The SIMD implementations gather the bytes of each pixel with a byte
+ * shuffle, and extract the least significant bits with a multiplication by
+ * a per-lane power of two, producing 8 pixels from 16 input bytes at a time.
+ */
+
+namespace libcamera {
+
+namespace RawUnpack {
+
+/**
+ * \typedef UnpackFn
+ * \brief Unpack a line of CSI-2 packed raw data to 16 bits per pixel
+ * \param[out] dst The unpacked pixels, \a pixels entries
+ * \param[in] src The packed line, starting at the beginning of a group
+ * \param[in] pixels The number of pixels to unpack
+ * \param[in] shift The number of bits to shift the unpacked values right by
+ *
+ * The \a shift allows unpacking data to a lower bit depth, for instance to
+ * process a 14 bits format as 12 bits data.
+ */
+
+namespace {
+
+using DebayerSimd::Isa;
+
+template<unsigned int Bits>
+constexpr unsigned int kGroupPixels = Bits == 12 ? 2 : 4;
+
+template<unsigned int Bits>
+constexpr unsigned int kGroupBytes = kGroupPixels<Bits> * Bits / 8;
+
+/* Unpack the pixel i of the group starting at group */
+template<unsigned int Bits>
+inline unsigned int unpackPixel(const uint8_t *group, unsigned int i)
+{
+	constexpr unsigned int lsbBits = Bits - 8;
+	const uint8_t *lsb = group + kGroupPixels<Bits>;
+	const unsigned int bit = i * lsbBits;
+
+	/* The least significant bits of a 14 bits pixel may span two bytes */
+	unsigned int value = lsb[bit / 8] >> (bit % 8);
+	if (bit % 8 + lsbBits > 8)
+		value |= lsb[bit / 8 + 1] << (8 - bit % 8);
+
+	return (group[i] << lsbBits) | (value & ((1 << lsbBits) - 1));
+}
+
+template<unsigned int Bits>
+void unpackScalar(uint16_t *dst, const uint8_t *src, unsigned int pixels,
+		  unsigned int shift)
+{
+	constexpr unsigned int groupPixels = kGroupPixels<Bits>;
+	unsigned int i = 0;
+
+	for (; i + groupPixels <= pixels; i += groupPixels) {
+		for (unsigned int j = 0; j < groupPixels; j++)
+			dst[i + j] = unpackPixel<Bits>(src, j) >> shift;
+		src += kGroupBytes<Bits>;
+	}
+
+	for (unsigned int j = 0; i < pixels; i++, j++)
+		dst[i] = unpackPixel<Bits>(src, j) >> shift;
+}
+
+/*
+ * Byte shuffles and multipliers unpacking 8 pixels from the first (Bits)
+ * bytes of a 16 bytes vector. The msb shuffle moves the most significant
+ * bits of each pixel to the low byte of its 16 bits lane. The lsb shuffle
+ * moves the byte(s) holding its least significant bits to the lane, and the
+ * multiplier shifts them to the top of the lane, where they are extracted
+ * with a right shift by (16 - (Bits - 8)). Indices of -1 zero the byte.
+ */
+struct ShuffleTables {
+	int8_t msb[16];
+	int8_t lsb[16];
+	uint16_t mul[8];
+};
+
+constexpr ShuffleTables kShuffleTables[] = {
+	/* 10 bits, 2 groups of 4 pixels in 5 bytes */
+	{
+		{ 0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1 },
+		{ 4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1 },
+		{ 1 << 14, 1 << 12, 1 << 10, 1 << 8, 1 << 14, 1 << 12, 1 << 10, 1 << 8 },
+	},
+	/* 12 bits, 4 groups of 2 pixels in 3 bytes */
+	{
+		{ 0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1 },
+		{ 2, -1, 2, -1, 5, -1, 5, -1, 8, -1, 8, -1, 11, -1, 11, -1 },
+		{ 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8 },
+	},
+	/* 14 bits, 2 groups of 4 pixels in 7 bytes */
+	{
+		{ 0, -1, 1, -1, 2, -1, 3, -1, 7, -1, 8, -1, 9, -1, 10, -1 },
+		{ 4, 5, 4, 5, 5, 6, 5, 6, 11, 12, 11, 12, 12, 13, 12, 13 },
+		{ 1 << 10, 1 << 4, 1 << 6, 1 << 0, 1 << 10, 1 << 4, 1 << 6, 1 << 0 },
+	},
+};
+
+template<unsigned int Bits>
+constexpr const ShuffleTables &shuffleTables()
+{
+	return kShuffleTables[(Bits - 10) / 2];
+}
+
+/*
+ * The vector loops read 16 bytes to unpack 8 pixels from (Bits) bytes. They
+ * stop before reading past the last whole group of the line, the remaining
+ * pixels are unpacked by the scalar implementation.
+ */
+template<unsigned int Bits>
+constexpr unsigned int packedLength(unsigned int pixels)
+{
+	return pixels / kGroupPixels<Bits> * kGroupBytes<Bits>;
+}
+
+#if defined(__aarch64__)
+
+template<unsigned int Bits>
+void unpackNeon(uint16_t *dst, const uint8_t *src, unsigned int pixels,
+		unsigned int shift)
+{
+	constexpr unsigned int lsbBits = Bits - 8;
+	const ShuffleTables &tables = shuffleTables<Bits>();
+	const uint8x16_t msbShuffle = vreinterpretq_u8_s8(vld1q_s8(tables.msb));
+	const uint8x16_t lsbShuffle = vreinterpretq_u8_s8(vld1q_s8(tables.lsb));
+	const uint16x8_t mul = vld1q_u16(tables.mul);
+	const int16x8_t count = vdupq_n_s16(-static_cast<int16_t>(shift));
+	const unsigned int length = packedLength<Bits>(pixels);
+	unsigned int i = 0;
+
+	/* Out of range indices (-1) make vqtbl1q_u8() return 0 */
+	for (; i + 8 <= pixels && i / 8 * Bits + 16 <= length; i += 8) {
+		const uint8x16_t in = vld1q_u8(src + i / 8 * Bits);
+		uint16x8_t msb = vreinterpretq_u16_u8(vqtbl1q_u8(in, msbShuffle));
+		uint16x8_t lsb = vreinterpretq_u16_u8(vqtbl1q_u8(in, lsbShuffle));
+
+		msb = vshlq_n_u16(msb, lsbBits);
+		lsb = vshrq_n_u16(vmulq_u16(lsb, mul), 16 - lsbBits);
+
+		vst1q_u16(dst + i, vshlq_u16(vorrq_u16(msb, lsb), count));
+	}
+
+	unpackScalar<Bits>(dst + i, src + i / 8 * Bits, pixels - i, shift);
+}
+
+#endif /* __aarch64__ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+template<unsigned int Bits>
+__attribute__((target("sse4.1")))
+void unpackSse41(uint16_t *dst, const uint8_t *src, unsigned int pixels,
+		 unsigned int shift)
+{
+	constexpr unsigned int lsbBits = Bits - 8;
+	const ShuffleTables &tables = shuffleTables<Bits>();
+	const __m128i msbShuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.msb));
+	const __m128i lsbShuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.lsb));
+	const __m128i mul = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.mul));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	const unsigned int length = packedLength<Bits>(pixels);
+	unsigned int i = 0;
+
+	/* Indices with the top bit set (-1) make _mm_shuffle_epi8() return 0 */
+	for (; i + 8 <= pixels && i / 8 * Bits + 16 <= length; i += 8) {
+		const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i / 8 * Bits));
+		__m128i msb = _mm_shuffle_epi8(in, msbShuffle);
+		__m128i lsb = _mm_shuffle_epi8(in, lsbShuffle);
+
+		msb = _mm_slli_epi16(msb, lsbBits);
+		lsb = _mm_srli_epi16(_mm_mullo_epi16(lsb, mul), 16 - lsbBits);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+				 _mm_srl_epi16(_mm_or_si128(msb, lsb), count));
+	}
+
+	unpackScalar<Bits>(dst + i, src + i / 8 * Bits, pixels - i, shift);
+}
+
+template<unsigned int Bits>
+__attribute__((target("avx2")))
+void unpackAvx2(uint16_t *dst, const uint8_t *src, unsigned int pixels,
+		unsigned int shift)
+{
+	constexpr unsigned int lsbBits = Bits - 8;
+	const ShuffleTables &tables = shuffleTables<Bits>();
+	const __m256i msbShuffle = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.msb)));
+	const __m256i lsbShuffle = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.lsb)));
+	const __m256i mul = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.mul)));
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	const unsigned int length = packedLength<Bits>(pixels);
+	unsigned int i = 0;
+
+	/*
+	 * The shuffles operate on each 128 bits lane independently, load the
+	 * bytes of the first 8 pixels in the low lane and of the next 8 pixels
+	 * in the high lane.
+	 */
+	for (; i + 16 <= pixels && i / 8 * Bits + Bits + 16 <= length; i += 16) {
+		const uint8_t *in = src + i / 8 * Bits;
+		const __m256i v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + Bits)), 1);
+		__m256i msb = _mm256_shuffle_epi8(v, msbShuffle);
+		__m256i lsb = _mm256_shuffle_epi8(v, lsbShuffle);
+
+		msb = _mm256_slli_epi16(msb, lsbBits);
+		lsb = _mm256_srli_epi16(_mm256_mullo_epi16(lsb, mul), 16 - lsbBits);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+				    _mm256_srl_epi16(_mm256_or_si256(msb, lsb), count));
+	}
+
+	unpackSse41<Bits>(dst + i, src + i / 8 * Bits, pixels - i, shift);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+#define RAW_UNPACK_SELECT(kernel, bitDepth) \
+	switch (bitDepth) {                 \
+	case 10:                            \
+		return kernel<10>;          \
+	case 12:                            \
+		return kernel<12>;          \
+	case 14:                            \
+		return kernel<14>;          \
+	default:                            \
+		return nullptr;             \
+	}
+
+} /* namespace */
+
+/**
+ * \brief Get the unpacking function for a CSI-2 packed raw format
+ * \param[in] isa The SIMD instruction set
+ * \param[in] bitDepth The packed format bit depth (10, 12 or 14)
+ *
+ * The scalar implementation is returned when \a isa has no unpacking
+ * function. All implementations produce the same result.
+ *
+ * \return The unpacking function, or nullptr if \a bitDepth isn't supported
+ */
+UnpackFn unpackFn(Isa isa, unsigned int bitDepth)
+{
+	switch (isa) {
+#if defined(__aarch64__)
+	case Isa::Neon:
+		RAW_UNPACK_SELECT(unpackNeon, bitDepth)
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	case Isa::Sse41:
+		RAW_UNPACK_SELECT(unpackSse41, bitDepth)
+	case Isa::Avx2:
+		RAW_UNPACK_SELECT(unpackAvx2, bitDepth)
+#endif
+	default:
+		RAW_UNPACK_SELECT(unpackScalar, bitDepth)
+	}
+}
+
+} /* namespace RawUnpack */
+
+} /* namespace libcamera */
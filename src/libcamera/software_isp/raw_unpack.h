@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Unpacking of CSI-2 packed raw Bayer lines
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "debayer_cpu_simd.h"
+
+namespace libcamera {
+
+namespace RawUnpack {
+
+using UnpackFn = void (*)(uint16_t *dst, const uint8_t *src,
+			  unsigned int pixels, unsigned int shift);
+
+UnpackFn unpackFn(DebayerSimd::Isa isa, unsigned int bitDepth);
+
+} /* namespace RawUnpack */
+
+} /* namespace libcamera */
@@ -7,12 +7,16 @@
 
 #include "libcamera/internal/software_isp/software_isp.h"
 
+#include <algorithm>
 #include <cmath>
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <libcamera/base/utils.h>
+
 #include <libcamera/formats.h>
 #include <libcamera/stream.h>
 
@@ -21,8 +25,12 @@
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/software_isp/debayer_params.h"
+#include "libcamera/internal/tracepoints.h"
 
 #include "debayer_cpu.h"
+#if HAVE_SOFTISP_GPU
+#include "debayer_egl.h"
+#endif
 
 /**
  * \file software_isp.cpp
@@ -51,6 +59,9 @@ LOG_DEFINE_CATEGORY(SoftwareIsp)
 /**
  * \var SoftwareIsp::ispStatsReady
  * \brief A signal emitted when the statistics for IPA are ready
+ *
+ * The signal carries the frame sequence number and the index of the shared
+ * statistics buffer, to be passed to processStats().
  */
 
 /**
@@ -64,89 +75,210 @@ LOG_DEFINE_CATEGORY(SoftwareIsp)
  * \param[in] pipe The pipeline handler in use
  * \param[in] sensor Pointer to the CameraSensor instance owned by the pipeline
  * handler
+ * \param[in] lazyIPA Defer loading the IPA module until loadIPA() is called
+ *
+ * The IPA module is loaded by the constructor unless \a lazyIPA is true.
+ * Deferring the IPA loading allows pipeline handlers to enumerate the formats
+ * supported by the software ISP without paying for the IPA module creation,
+ * which may spawn a process for isolated IPA modules, until it is needed.
  */
-SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
-	: dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor,
+			 bool lazyIPA)
+	: pipe_(pipe), sensor_(sensor), ispWorkerThread_("SoftISP"),
+	  lastParamsBufferId_(0),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
 		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
-		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf),
+	  numOutputs_(0),
+	  dropPolicy_(DropPolicy::None), maxQueuedFrames_(0),
+	  busy_(false), running_(false), framesDropped_(0)
 {
-	/*
-	 * debayerParams_ must be initialized because the initial value is used for
-	 * the first two frames, i.e. until stats processing starts providing its
-	 * own parameters.
-	 *
-	 * \todo This should be handled in the same place as the related
-	 * operations, in the IPA module.
-	 */
-	std::array<uint8_t, 256> gammaTable;
-	for (unsigned int i = 0; i < 256; i++)
-		gammaTable[i] = UINT8_MAX * std::pow(i / 256.0, 0.5);
-	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
-		debayerParams_.red[i] = gammaTable[i];
-		debayerParams_.green[i] = gammaTable[i];
-		debayerParams_.blue[i] = gammaTable[i];
-	}
+	parseDropPolicy();
 
 	if (!dmaHeap_.isValid()) {
 		LOG(SoftwareIsp, Error) << "Failed to create DmaBufAllocator object";
 		return;
 	}
 
-	sharedParams_ = SharedMemObject<DebayerParams>("softIsp_params");
+	sharedParams_ = SharedMemObject<DebayerParamsBuffers>("softIsp_params");
 	if (!sharedParams_) {
 		LOG(SoftwareIsp, Error) << "Failed to create shared memory for parameters";
 		return;
 	}
 
-	auto stats = std::make_unique<SwStatsCpu>();
-	if (!stats->isValid()) {
-		LOG(SoftwareIsp, Error) << "Failed to create SwStatsCpu object";
-		return;
+	/*
+	 * The parameters buffers must be initialized because the initial value
+	 * is used for the first frames, i.e. until stats processing starts
+	 * providing its own parameters.
+	 *
+	 * \todo This should be handled in the same place as the related
+	 * operations, in the IPA module.
+	 */
+	std::array<uint8_t, 256> gammaTable;
+	for (unsigned int i = 0; i < 256; i++)
+		gammaTable[i] = UINT8_MAX * std::pow(i / 256.0, 0.5);
+	for (DebayerParams &params : *sharedParams_) {
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			params.red[i] = gammaTable[i];
+			params.green[i] = gammaTable[i];
+			params.blue[i] = gammaTable[i];
+		}
+		params.ccmEnabled = false;
 	}
-	stats->statsReady.connect(this, &SoftwareIsp::statsReady);
 
-	debayer_ = std::make_unique<DebayerCpu>(std::move(stats));
+	debayer_ = createDebayer();
+	if (!debayer_)
+		return;
+
 	debayer_->inputBufferReady.connect(this, &SoftwareIsp::inputReady);
 	debayer_->outputBufferReady.connect(this, &SoftwareIsp::outputReady);
 
-	ipa_ = IPAManager::createIPA<ipa::soft::IPAProxySoft>(pipe, 0, 0);
+	debayer_->moveToThread(&ispWorkerThread_);
+
+	if (!lazyIPA)
+		loadIPA();
+}
+
+/**
+ * \brief Load and initialize the IPA module
+ *
+ * This function creates the IPA module when it has been deferred at
+ * construction time. It shall be called before configure(), and has no effect
+ * if the IPA module is already loaded. If the IPA module can't be loaded, the
+ * software ISP becomes invalid.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int SoftwareIsp::loadIPA()
+{
+	if (ipa_)
+		return 0;
+
+	if (!debayer_)
+		return -ENODEV;
+
+	ipa_ = IPAManager::createIPA<ipa::soft::IPAProxySoft>(pipe_, 0, 0);
 	if (!ipa_) {
 		LOG(SoftwareIsp, Error)
 			<< "Creating IPA for software ISP failed";
 		debayer_.reset();
-		return;
+		return -ENOENT;
 	}
 
 	/*
 	 * The API tuning file is made from the sensor name. If the tuning file
 	 * isn't found, fall back to the 'uncalibrated' file.
 	 */
-	std::string ipaTuningFile = ipa_->configurationFile(sensor->model() + ".yaml");
+	std::string ipaTuningFile = ipa_->configurationFile(sensor_->model() + ".yaml");
 	if (ipaTuningFile.empty())
 		ipaTuningFile = ipa_->configurationFile("uncalibrated.yaml");
 
-	int ret = ipa_->init(IPASettings{ ipaTuningFile, sensor->model() },
+	int ret = ipa_->init(IPASettings{ ipaTuningFile, sensor_->model() },
 			     debayer_->getStatsFD(),
 			     sharedParams_.fd(),
-			     sensor->controls());
+			     sensor_->controls());
 	if (ret) {
 		LOG(SoftwareIsp, Error) << "IPA init failed";
+		ipa_.reset();
 		debayer_.reset();
-		return;
+		return ret;
 	}
 
 	ipa_->setIspParams.connect(this, &SoftwareIsp::saveIspParams);
 	ipa_->setSensorControls.connect(this, &SoftwareIsp::setSensorCtrls);
 
-	debayer_->moveToThread(&ispWorkerThread_);
+	return 0;
 }
 
 SoftwareIsp::~SoftwareIsp()
 {
-	/* make sure to destroy the DebayerCpu before the ispWorkerThread_ is gone */
+	/* make sure to destroy the Debayer before the ispWorkerThread_ is gone */
 	debayer_.reset();
 }
 
+/*
+ * Create the debayering implementation selected by the LIBCAMERA_SOFTISP_MODE
+ * environment variable, falling back to the CPU when the GPU can't be used.
+ */
+std::unique_ptr<Debayer> SoftwareIsp::createDebayer()
+{
+	auto createStats = [this]() -> std::unique_ptr<SwStatsCpu> {
+		auto stats = std::make_unique<SwStatsCpu>();
+		if (!stats->isValid()) {
+			LOG(SoftwareIsp, Error) << "Failed to create SwStatsCpu object";
+			return nullptr;
+		}
+
+		stats->statsReady.connect(this, &SoftwareIsp::statsReady);
+		return stats;
+	};
+
+	const char *mode = utils::secure_getenv("LIBCAMERA_SOFTISP_MODE");
+	if (mode && std::string(mode) == "gpu") {
+#if HAVE_SOFTISP_GPU
+		auto stats = createStats();
+		if (!stats)
+			return nullptr;
+
+		auto debayer = std::make_unique<DebayerEGL>(std::move(stats));
+		if (!debayer->init())
+			return debayer;
+
+		LOG(SoftwareIsp, Warning)
+			<< "GPU debayering unavailable, falling back to CPU";
+#else
+		LOG(SoftwareIsp, Warning)
+			<< "GPU debayering not supported by this build, using CPU";
+#endif
+	} else if (mode && std::string(mode) != "cpu") {
+		LOG(SoftwareIsp, Warning)
+			<< "Unknown software ISP mode '" << mode << "', using CPU";
+	}
+
+	auto stats = createStats();
+	if (!stats)
+		return nullptr;
+
+	return std::make_unique<DebayerCpu>(std::move(stats));
+}
+
+/*
+ * Select how frames are dropped when the processing falls behind, from the
+ * LIBCAMERA_SOFTISP_DROP_POLICY and LIBCAMERA_SOFTISP_QUEUE_DEPTH environment
+ * variables.
+ */
+void SoftwareIsp::parseDropPolicy()
+{
+	const char *policy = utils::secure_getenv("LIBCAMERA_SOFTISP_DROP_POLICY");
+	if (!policy)
+		return;
+
+	const std::string name(policy);
+	if (name == "oldest") {
+		dropPolicy_ = DropPolicy::DropOldest;
+	} else if (name == "newest") {
+		dropPolicy_ = DropPolicy::DropNewest;
+	} else if (name == "stats") {
+		dropPolicy_ = DropPolicy::StatsOnly;
+	} else {
+		if (name != "none")
+			LOG(SoftwareIsp, Warning)
+				<< "Unknown frame drop policy '" << name
+				<< "', processing all frames";
+		return;
+	}
+
+	maxQueuedFrames_ = kDefaultQueueDepth;
+
+	const char *depth = utils::secure_getenv("LIBCAMERA_SOFTISP_QUEUE_DEPTH");
+	if (depth)
+		maxQueuedFrames_ = std::max(strtoul(depth, nullptr, 10), 1UL);
+
+	LOG(SoftwareIsp, Debug)
+		<< "Frame drop policy '" << name << "', queue depth "
+		<< maxQueuedFrames_;
+}
+
 /**
  * \fn int SoftwareIsp::loadConfiguration([[maybe_unused]] const std::string &filename)
  * \brief Load a configuration from a file
@@ -159,15 +291,18 @@ SoftwareIsp::~SoftwareIsp()
 
 /**
  * \brief Process the statistics gathered
+ * \param[in] frame The frame number
+ * \param[in] bufferId ID of the statistics buffer
  * \param[in] sensorControls The sensor controls
  *
  * Requests the IPA to calculate new parameters for ISP and new control
  * values for the sensor.
  */
-void SoftwareIsp::processStats(const ControlList &sensorControls)
+void SoftwareIsp::processStats(const uint32_t frame, const uint32_t bufferId,
+			       const ControlList &sensorControls)
 {
 	ASSERT(ipa_);
-	ipa_->processStats(sensorControls);
+	ipa_->processStats(frame, bufferId, sensorControls);
 }
 
 /**
@@ -224,19 +359,86 @@ SoftwareIsp::strideAndFrameSize(const PixelFormat &outputFormat, const Size &siz
  * \param[in] inputCfg The input configuration
  * \param[in] outputCfgs The output configurations
  * \param[in] sensorControls ControlInfoMap of the controls supported by the sensor
+ * \param[in] transform The transform to apply to the output images
+ *
+ * When \a outputCfgs is empty, the Software ISP only gathers the statistics of
+ * the frames queued with queueStats() to run the IPA algorithms, for the RAW
+ * streams captured without processing. Only the CPU debayering implementation
+ * supports this mode.
+ *
+ * The \a transform is applied in addition to the transform applied by the
+ * sensor, and shall be supported as reported by supportsTransform().
+ *
  * \return 0 on success, a negative errno on failure
  */
 int SoftwareIsp::configure(const StreamConfiguration &inputCfg,
 			   const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
-			   const ControlInfoMap &sensorControls)
+			   const ControlInfoMap &sensorControls,
+			   Transform transform)
 {
 	ASSERT(ipa_ && debayer_);
 
-	int ret = ipa_->configure(sensorControls);
+	ipa::soft::StatsConfig statsConfig;
+	int ret = ipa_->configure(sensorControls, &statsConfig);
 	if (ret < 0)
 		return ret;
 
-	return debayer_->configure(inputCfg, outputCfgs);
+	debayer_->setStatsSampling(statsConfig.xSkip, statsConfig.ySkip,
+				   statsConfig.zones);
+
+	numOutputs_ = 0;
+	ret = debayer_->configure(inputCfg, outputCfgs, transform);
+	if (ret)
+		return ret;
+
+	numOutputs_ = outputCfgs.size();
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the maximum number of output streams
+ *
+ * The CPU debayering implementation can produce a secondary, downscaled copy
+ * of the main output in the same pixel format. Stream 0 is the main output,
+ * stream 1 the secondary output.
+ *
+ * \return The maximum number of output streams supported by the Software ISP
+ */
+unsigned int SoftwareIsp::maxOutputs() const
+{
+	return debayer_ ? debayer_->maxOutputs() : 1;
+}
+
+/**
+ * \brief Check if the Software ISP can apply a transform to the outputs
+ * \param[in] transform The transform
+ *
+ * The CPU debayering implementation supports the horizontal and vertical
+ * flips, applied while debayering the frames at no additional memory pass.
+ *
+ * \return True if \a transform is supported, false otherwise
+ */
+bool SoftwareIsp::supportsTransform(Transform transform) const
+{
+	return debayer_ && debayer_->supportsTransform(transform);
+}
+
+/**
+ * \brief Get the input area processed for a crop rectangle
+ * \param[in] crop The crop rectangle, in input frame coordinates
+ *
+ * The output size is fixed by the configuration, the Software ISP processes
+ * the area of the input closest to \a crop that it can scale to the output
+ * size. This function can be used to validate a crop rectangle before passing
+ * it to queueBuffers(), and to report the area actually processed.
+ *
+ * \return The processed area of the input, or a null rectangle if cropping
+ * isn't supported
+ */
+Rectangle SoftwareIsp::cropWindow(const Rectangle &crop) const
+{
+	return debayer_ ? debayer_->cropWindow(crop) : Rectangle{};
 }
 
 /**
@@ -252,25 +454,42 @@ int SoftwareIsp::exportBuffers(unsigned int output, unsigned int count,
 {
 	ASSERT(debayer_ != nullptr);
 
-	/* single output for now */
-	if (output >= 1)
+	if (output >= numOutputs_)
 		return -EINVAL;
 
+	/*
+	 * Allocate all buffers at once, to carve them out of a single memory
+	 * allocation when the dma-buf provider supports it. Huge pages lower
+	 * the TLB pressure of the CPU debayering, use them if requested.
+	 */
+	DmaBufAllocator::AllocFlags flags;
+	const char *hugePages = utils::secure_getenv("LIBCAMERA_SOFTISP_HUGEPAGES");
+	if (hugePages && *hugePages != '\0')
+		flags |= DmaBufAllocator::AllocFlag::HugePages;
+
+	std::vector<UniqueFD> fds = dmaHeap_.alloc("frame", debayer_->frameSize(output),
+						   count, flags);
+	if (fds.size() != count) {
+		LOG(SoftwareIsp, Error) << "failed to allocate dma_bufs";
+		return -ENOMEM;
+	}
+
 	for (unsigned int i = 0; i < count; i++) {
-		const std::string name = "frame-" + std::to_string(i);
-		const size_t frameSize = debayer_->frameSize();
-
-		FrameBuffer::Plane outPlane;
-		outPlane.fd = SharedFD(dmaHeap_.alloc(name.c_str(), frameSize));
-		if (!outPlane.fd.isValid()) {
-			LOG(SoftwareIsp, Error)
-				<< "failed to allocate a dma_buf";
-			return -ENOMEM;
+		SharedFD fd(std::move(fds[i]));
+
+		/* All planes are stored contiguously in a single dma_buf */
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+		for (unsigned int planeSize : debayer_->planeSizes(output)) {
+			FrameBuffer::Plane outPlane;
+			outPlane.fd = fd;
+			outPlane.offset = offset;
+			outPlane.length = planeSize;
+			planes.push_back(std::move(outPlane));
+
+			offset += planeSize;
 		}
-		outPlane.offset = 0;
-		outPlane.length = frameSize;
 
-		std::vector<FrameBuffer::Plane> planes{ outPlane };
 		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(planes)));
 	}
 
@@ -280,35 +499,32 @@ int SoftwareIsp::exportBuffers(unsigned int output, unsigned int count,
 /**
  * \brief Queue buffers to Software ISP
  * \param[in] input The input framebuffer
- * \param[in] outputs The container holding the output stream indexes and
- * their respective frame buffer outputs
+ * \param[in] outputs The output frame buffers, indexed by output stream, with
+ * null entries for the streams that aren't requested
+ * \param[in] crop The area of the input to process, in input frame coordinates
+ *
+ * The \a crop rectangle is adjusted as reported by cropWindow(). A null
+ * rectangle keeps the crop of the previous frame.
+ *
  * \return 0 on success, a negative errno on failure
  */
 int SoftwareIsp::queueBuffers(FrameBuffer *input,
-			      const std::map<unsigned int, FrameBuffer *> &outputs)
+			      Span<FrameBuffer *const> outputs,
+			      const Rectangle &crop)
 {
-	unsigned int mask = 0;
-
 	/*
 	 * Validate the outputs as a sanity check: at least one output is
-	 * required, all outputs must reference a valid stream and no two
-	 * outputs can reference the same stream.
+	 * required and all outputs must reference a valid stream.
 	 */
-	if (outputs.empty())
+	if (outputs.size() > numOutputs_)
 		return -EINVAL;
 
-	for (auto [index, buffer] : outputs) {
-		if (!buffer)
-			return -EINVAL;
-		if (index >= 1) /* only single stream atm */
-			return -EINVAL;
-		if (mask & (1 << index))
-			return -EINVAL;
-
-		mask |= 1 << index;
-	}
+	FrameBuffer *output = outputs.size() > 0 ? outputs[0] : nullptr;
+	FrameBuffer *secondary = outputs.size() > 1 ? outputs[1] : nullptr;
+	if (!output && !secondary)
+		return -EINVAL;
 
-	process(input, outputs.at(0));
+	process(input, output, secondary, crop);
 
 	return 0;
 }
@@ -319,39 +535,227 @@ int SoftwareIsp::queueBuffers(FrameBuffer *input,
  */
 int SoftwareIsp::start()
 {
+	paramsFrames_.fill(std::nullopt);
+
 	int ret = ipa_->start();
 	if (ret)
 		return ret;
 
+	{
+		MutexLocker locker(lock_);
+		running_ = true;
+	}
+
 	ispWorkerThread_.start();
 	return 0;
 }
 
 /**
  * \brief Stops the Software ISP streaming operation
+ *
+ * The frame being processed is completed, and the frames still waiting for
+ * processing are returned with their output buffers marked as cancelled.
  */
 void SoftwareIsp::stop()
 {
+	{
+		MutexLocker locker(lock_);
+		running_ = false;
+	}
+
+	/* Wait for the frame being processed, no new frame gets dispatched */
+	if (ispWorkerThread_.isRunning())
+		debayer_->invokeMethod(&Debayer::stop, ConnectionTypeBlocking);
+
 	ispWorkerThread_.exit();
 	ispWorkerThread_.wait();
 
 	ipa_->stop();
+
+	std::deque<Job> jobs;
+	{
+		MutexLocker locker(lock_);
+		jobs.swap(pendingJobs_);
+		busy_ = false;
+	}
+
+	for (const Job &job : jobs)
+		cancelJob(job);
+}
+
+/**
+ * \brief Queue a frame to the Software ISP to only gather its statistics
+ * \param[in] input The input framebuffer
+ *
+ * The statistics of \a input are computed in the ISP worker thread and passed
+ * to the IPA, and the \a input buffer is then returned unmodified through the
+ * inputBufferReady signal. The frames are queued with the ones passed to
+ * process(), and subject to the same drop policy.
+ */
+void SoftwareIsp::queueStats(FrameBuffer *input)
+{
+	MutexLocker locker(lock_);
+
+	pendingJobs_.push_back({ input, nullptr, nullptr, nullptr, {} });
+
+	if (!busy_)
+		dispatchJob();
 }
 
 /**
  * \brief Passes the input framebuffer to the ISP worker to process
  * \param[in] input The input framebuffer
  * \param[out] output The framebuffer to write the processed frame to
+ * \param[out] secondary The framebuffer to write the secondary output to
+ * \param[in] crop The area of the input to process, null to keep the crop of
+ * the previous frame
+ *
+ * Either of \a output and \a secondary may be null when the corresponding
+ * stream isn't requested, but not both.
+ *
+ * The frames are processed one at a time in the order they are queued. When
+ * the processing falls behind the frame rate, the frames accumulate in a queue
+ * whose depth is bounded according to the LIBCAMERA_SOFTISP_DROP_POLICY
+ * environment variable. By default, all the frames are processed.
+ */
+void SoftwareIsp::process(FrameBuffer *input, FrameBuffer *output,
+			  FrameBuffer *secondary, const Rectangle &crop)
+{
+	const uint32_t frame = input->metadata().sequence;
+
+	/*
+	 * Use the parameters prepared for the most recent frame not newer than
+	 * the input frame. If the IPA hasn't caught up yet, keep using the last
+	 * parameters that have been applied.
+	 */
+	std::optional<uint32_t> paramsFrame;
+	for (unsigned int i = 0; i < kDebayerParamsBufferCount; i++) {
+		const std::optional<uint32_t> &f = paramsFrames_[i];
+		if (!f || *f > frame || (paramsFrame && *f <= *paramsFrame))
+			continue;
+
+		paramsFrame = f;
+		lastParamsBufferId_ = i;
+	}
+
+	const DebayerParams *params = &(*sharedParams_)[lastParamsBufferId_];
+
+	if (output)
+		LIBCAMERA_TRACEPOINT(software_isp_queue_buffer, frame, output);
+	if (secondary)
+		LIBCAMERA_TRACEPOINT(software_isp_queue_buffer, frame, secondary);
+
+	MutexLocker locker(lock_);
+
+	pendingJobs_.push_back({ input, output, secondary, params, crop });
+
+	/*
+	 * When a frame is being processed, the queue is trimmed on its
+	 * completion, in the worker thread, to complete the dropped frames in
+	 * the same thread as all the others.
+	 */
+	if (!busy_)
+		dispatchJob();
+}
+
+void SoftwareIsp::dispatchJob()
+{
+	if (!running_ || pendingJobs_.empty())
+		return;
+
+	const Job job = pendingJobs_.front();
+	pendingJobs_.pop_front();
+	busy_ = true;
+
+	if (!job.crop.isNull())
+		debayer_->invokeMethod(&Debayer::setCrop, ConnectionTypeQueued,
+				       job.crop);
+
+	if (job.params)
+		debayer_->invokeMethod(&Debayer::process, ConnectionTypeQueued,
+				       job.input, job.output, job.secondary,
+				       job.params);
+	else
+		debayer_->invokeMethod(&Debayer::processStats, ConnectionTypeQueued,
+				       job.input, job.output, job.secondary);
+}
+
+/*
+ * Bound the number of frames waiting for processing according to the drop
+ * policy. The frames to drop are moved to \a dropped.
  */
-void SoftwareIsp::process(FrameBuffer *input, FrameBuffer *output)
+void SoftwareIsp::trimJobs(std::vector<Job> *dropped)
 {
-	debayer_->invokeMethod(&DebayerCpu::process,
-			       ConnectionTypeQueued, input, output, debayerParams_);
+	if (dropPolicy_ == DropPolicy::None ||
+	    pendingJobs_.size() <= maxQueuedFrames_)
+		return;
+
+	unsigned int excess = pendingJobs_.size() - maxQueuedFrames_;
+
+	switch (dropPolicy_) {
+	case DropPolicy::DropOldest:
+		for (; excess; excess--) {
+			dropped->push_back(pendingJobs_.front());
+			pendingJobs_.pop_front();
+		}
+		break;
+
+	case DropPolicy::DropNewest:
+		for (; excess; excess--) {
+			dropped->push_back(pendingJobs_.back());
+			pendingJobs_.pop_back();
+		}
+		break;
+
+	case DropPolicy::StatsOnly:
+		/*
+		 * Only gather the statistics of the oldest frames, to keep the
+		 * IPA algorithms running at the sensor frame rate.
+		 */
+		for (auto it = pendingJobs_.begin(); excess; ++it, excess--) {
+			if (it->params)
+				framesDropped_++;
+			it->params = nullptr;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	framesDropped_ += dropped->size();
+
+	if (!dropped->empty())
+		LOG(SoftwareIsp, Debug)
+			<< "Dropping " << dropped->size() << " frame(s)";
+}
+
+/* Return the buffers of a frame that won't be processed */
+void SoftwareIsp::cancelJob(const Job &job)
+{
+	for (FrameBuffer *output : { job.output, job.secondary }) {
+		if (!output)
+			continue;
+
+		FrameMetadata &metadata = output->_d()->metadata();
+		metadata.status = FrameMetadata::FrameCancelled;
+		metadata.sequence = job.input->metadata().sequence;
+		metadata.timestamp = job.input->metadata().timestamp;
+
+		outputBufferReady.emit(output);
+	}
+
+	inputBufferReady.emit(job.input);
 }
 
-void SoftwareIsp::saveIspParams()
+void SoftwareIsp::saveIspParams(uint32_t frame, uint32_t bufferId)
 {
-	debayerParams_ = *sharedParams_;
+	if (bufferId >= kDebayerParamsBufferCount) {
+		LOG(SoftwareIsp, Error) << "Invalid parameters buffer " << bufferId;
+		return;
+	}
+
+	paramsFrames_[bufferId] = frame;
 }
 
 void SoftwareIsp::setSensorCtrls(const ControlList &sensorControls)
@@ -359,18 +763,73 @@ void SoftwareIsp::setSensorCtrls(const ControlList &sensorControls)
 	setSensorControls.emit(sensorControls);
 }
 
-void SoftwareIsp::statsReady()
+void SoftwareIsp::statsReady(uint32_t frame, uint32_t bufferId)
 {
-	ispStatsReady.emit();
+	ispStatsReady.emit(frame, bufferId);
 }
 
 void SoftwareIsp::inputReady(FrameBuffer *input)
 {
 	inputBufferReady.emit(input);
+
+	/* The frame is complete, proceed with the next one */
+	std::vector<Job> dropped;
+	{
+		MutexLocker locker(lock_);
+		busy_ = false;
+		trimJobs(&dropped);
+		dispatchJob();
+	}
+
+	for (const Job &job : dropped)
+		cancelJob(job);
+}
+
+/**
+ * \struct SoftwareIsp::Statistics
+ * \brief Runtime statistics of the Software ISP
+ *
+ * \var SoftwareIsp::Statistics::framesProcessed
+ * \brief Number of frames processed by the debayer
+ *
+ * \var SoftwareIsp::Statistics::framesDropped
+ * \brief Number of frames dropped, or processed for statistics only,
+ * according to the drop policy
+ *
+ * \var SoftwareIsp::Statistics::processingTime
+ * \brief Cumulated processing time of the frames by the debayer
+ *
+ * \var SoftwareIsp::Statistics::ipa
+ * \brief Processing time statistics of the IPA
+ */
+
+/**
+ * \brief Retrieve the runtime statistics of the Software ISP
+ * \return The Software ISP statistics
+ */
+SoftwareIsp::Statistics SoftwareIsp::statistics()
+{
+	Statistics stats = {};
+
+	if (debayer_) {
+		Debayer::Statistics debayerStats = debayer_->statistics();
+		stats.framesProcessed = debayerStats.frames;
+		stats.processingTime = debayerStats.processingTime;
+	}
+
+	if (ipa_)
+		stats.ipa = ipa_->statistics();
+
+	MutexLocker locker(lock_);
+	stats.framesDropped = framesDropped_;
+
+	return stats;
 }
 
 void SoftwareIsp::outputReady(FrameBuffer *output)
 {
+	LIBCAMERA_TRACEPOINT(software_isp_complete_buffer,
+			     output->metadata().sequence, output);
 	outputBufferReady.emit(output);
 }
 
@@ -11,6 +11,8 @@
 
 #include "swstats_cpu.h"
 
+#include <algorithm>
+
 #include <libcamera/base/log.h>
 
 #include <libcamera/stream.h>
@@ -62,22 +64,39 @@ namespace libcamera {
  */
 
 /**
- * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[])
+ * \fn bool SwStatsCpu::isLineSampled(unsigned int y) const
+ * \brief Check if a line contributes to the statistics
+ * \param[in] y The y coordinate
+ *
+ * Lines outside of the window, or skipped by the vertical subsampling, are
+ * ignored by processLine0() and processLine2(). Callers can use this function
+ * to avoid preparing those lines.
+ *
+ * \return True if the line is sampled, false otherwise
+ */
+
+/**
+ * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[], unsigned int stripe)
  * \brief Process line 0
  * \param[in] y The y coordinate.
  * \param[in] src The input data.
+ * \param[in] stripe The index of the stripe the line belongs to
  *
  * This function processes line 0 for input formats with
  * patternSize height == 1.
  * It'll process line 0 and 1 for input formats with patternSize height >= 2.
  * This function may only be called after a successful setWindow() call.
+ *
+ * Lines of different stripes may be processed concurrently from different
+ * threads, see setStripeCount().
  */
 
 /**
- * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[])
+ * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[], unsigned int stripe)
  * \brief Process line 2 and 3
  * \param[in] y The y coordinate.
  * \param[in] src The input data.
+ * \param[in] stripe The index of the stripe the line belongs to
  *
  * This function processes line 2 and 3 for input formats with
  * patternSize height == 4.
@@ -85,13 +104,19 @@ namespace libcamera {
  */
 
 /**
- * \var Signal<> SwStatsCpu::statsReady
+ * \var Signal<uint32_t, uint32_t> SwStatsCpu::statsReady
  * \brief Signals that the statistics are ready
+ *
+ * The signal carries the frame sequence number and the index of the
+ * statistics buffer in the shared SwIspStatsBuffers ring.
  */
 
 /**
  * \typedef SwStatsCpu::statsProcessFn
  * \brief Called when there is data to get statistics from
+ * \param[out] stats The statistics to accumulate into
+ * \param[out] zones The row of zones to accumulate into, or nullptr when the
+ * zones are disabled
  * \param[in] src The input data
  *
  * These functions take an array of (patternSize_.height + 1) src
@@ -103,11 +128,33 @@ namespace libcamera {
  * See the documentation of DebayerCpu::debayerFn for more details.
  */
 
+/**
+ * \var SwStatsCpu::scalarStats0_
+ * \brief Scalar line function for the input format, used when the SIMD
+ * functions don't support the format or the sampling step
+ */
+
+/**
+ * \var SwStatsCpu::accumulate_
+ * \brief SIMD accumulation function used by statsBGGRSimdLine0()
+ */
+
 /**
  * \var unsigned int SwStatsCpu::ySkipMask_
  * \brief Skip lines where this bitmask is set in y
  */
 
+/**
+ * \var unsigned int SwStatsCpu::xStep_
+ * \brief Step between the sampled 2x2 blocks, in pixels or bytes for packed
+ * formats
+ */
+
+/**
+ * \var std::vector<unsigned int> SwStatsCpu::zoneEnds_
+ * \brief End of each zone column, in the same units as xStep_
+ */
+
 /**
  * \var Rectangle SwStatsCpu::window_
  * \brief Statistics window, set by setWindow(), used every line
@@ -130,11 +177,15 @@ namespace libcamera {
 LOG_DEFINE_CATEGORY(SwStatsCpu)
 
 SwStatsCpu::SwStatsCpu()
-	: sharedStats_("softIsp_stats")
+	: scalarStats0_(nullptr), accumulate_(nullptr), bitDepth_(0),
+	  xSkip_(2), ySkip_(2), zonesEnabled_(false),
+	  sharedStats_("softIsp_stats"), partialStats_(1)
 {
 	if (!sharedStats_)
 		LOG(SwStatsCpu, Error)
 			<< "Failed to create shared memory for statistics";
+
+	simdIsa_ = DebayerSimd::detectIsa();
 }
 
 static constexpr unsigned int kRedYMul = 77; /* 0.299 * 256 */
@@ -147,24 +198,47 @@ static constexpr unsigned int kBlueYMul = 29; /* 0.114 * 256 */
                                           \
 	uint64_t sumR = 0;                \
 	uint64_t sumG = 0;                \
-	uint64_t sumB = 0;
+	uint64_t sumB = 0;                \
+	uint32_t zoneR = 0;               \
+	uint32_t zoneG = 0;               \
+	uint32_t zoneB = 0;               \
+	uint32_t zoneCount = 0;           \
+	unsigned int x = 0;
 
 #define SWSTATS_ACCUMULATE_LINE_STATS(div) \
-	sumR += r;                         \
-	sumG += g;                         \
-	sumB += b;                         \
+	zoneR += r;                        \
+	zoneG += g;                        \
+	zoneB += b;                        \
+	zoneCount++;                       \
                                            \
 	yVal = r * kRedYMul;               \
 	yVal += g * kGreenYMul;            \
 	yVal += b * kBlueYMul;             \
-	stats_.yHistogram[yVal * SwIspStats::kYHistogramSize / (256 * 256 * (div))]++;
+	stats.yHistogram[yVal * SwIspStats::kYHistogramSize / (256 * 256 * (div))]++;
+
+/*
+ * The samples of a line are accumulated per zone column, zoneEnds_ holding
+ * a single column covering the whole window when the zones are disabled.
+ */
+#define SWSTATS_FINISH_ZONE_STATS(zone) \
+	sumR += zoneR;                  \
+	sumG += zoneG;                  \
+	sumB += zoneB;                  \
+	if (zones) {                    \
+		zones[zone].sumR += zoneR;     \
+		zones[zone].sumG += zoneG;     \
+		zones[zone].sumB += zoneB;     \
+		zones[zone].count += zoneCount; \
+	}                               \
+	zoneR = zoneG = zoneB = zoneCount = 0;
 
 #define SWSTATS_FINISH_LINE_STATS() \
-	stats_.sumR_ += sumR;       \
-	stats_.sumG_ += sumG;       \
-	stats_.sumB_ += sumB;
+	stats.sumR_ += sumR;        \
+	stats.sumG_ += sumG;        \
+	stats.sumB_ += sumB;
 
-void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR8Line0(SwIspStats &stats, SwIspStats::Zone *zones,
+				 const uint8_t *src[])
 {
 	const uint8_t *src0 = src[1] + window_.x;
 	const uint8_t *src1 = src[2] + window_.x;
@@ -174,22 +248,27 @@ void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
-		b = src0[x];
-		g = src0[x + 1];
-		g2 = src1[x];
-		r = src1[x + 1];
+	/* x += xStep_ sample every xSkip 2x2 block */
+	for (unsigned int zone = 0; zone < zoneEnds_.size(); zone++) {
+		for (; x < zoneEnds_[zone]; x += xStep_) {
+			b = src0[x];
+			g = src0[x + 1];
+			g2 = src1[x];
+			r = src1[x + 1];
 
-		g = (g + g2) / 2;
+			g = (g + g2) / 2;
 
-		SWSTATS_ACCUMULATE_LINE_STATS(1)
+			SWSTATS_ACCUMULATE_LINE_STATS(1)
+		}
+
+		SWSTATS_FINISH_ZONE_STATS(zone)
 	}
 
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR10Line0(SwIspStats &stats, SwIspStats::Zone *zones,
+				  const uint8_t *src[])
 {
 	const uint16_t *src0 = (const uint16_t *)src[1] + window_.x;
 	const uint16_t *src1 = (const uint16_t *)src[2] + window_.x;
@@ -199,23 +278,28 @@ void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
-		b = src0[x];
-		g = src0[x + 1];
-		g2 = src1[x];
-		r = src1[x + 1];
+	/* x += xStep_ sample every xSkip 2x2 block */
+	for (unsigned int zone = 0; zone < zoneEnds_.size(); zone++) {
+		for (; x < zoneEnds_[zone]; x += xStep_) {
+			b = src0[x];
+			g = src0[x + 1];
+			g2 = src1[x];
+			r = src1[x + 1];
 
-		g = (g + g2) / 2;
+			g = (g + g2) / 2;
+
+			/* divide Y by 4 for 10 -> 8 bpp value */
+			SWSTATS_ACCUMULATE_LINE_STATS(4)
+		}
 
-		/* divide Y by 4 for 10 -> 8 bpp value */
-		SWSTATS_ACCUMULATE_LINE_STATS(4)
+		SWSTATS_FINISH_ZONE_STATS(zone)
 	}
 
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR12Line0(SwIspStats &stats, SwIspStats::Zone *zones,
+				  const uint8_t *src[])
 {
 	const uint16_t *src0 = (const uint16_t *)src[1] + window_.x;
 	const uint16_t *src1 = (const uint16_t *)src[2] + window_.x;
@@ -225,69 +309,137 @@ void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
-		b = src0[x];
-		g = src0[x + 1];
-		g2 = src1[x];
-		r = src1[x + 1];
+	/* x += xStep_ sample every xSkip 2x2 block */
+	for (unsigned int zone = 0; zone < zoneEnds_.size(); zone++) {
+		for (; x < zoneEnds_[zone]; x += xStep_) {
+			b = src0[x];
+			g = src0[x + 1];
+			g2 = src1[x];
+			r = src1[x + 1];
 
-		g = (g + g2) / 2;
+			g = (g + g2) / 2;
 
-		/* divide Y by 16 for 12 -> 8 bpp value */
-		SWSTATS_ACCUMULATE_LINE_STATS(16)
+			/* divide Y by 16 for 12 -> 8 bpp value */
+			SWSTATS_ACCUMULATE_LINE_STATS(16)
+		}
+
+		SWSTATS_FINISH_ZONE_STATS(zone)
 	}
 
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR10PLine0(SwIspStats &stats, SwIspStats::Zone *zones,
+				   const uint8_t *src[])
 {
 	const uint8_t *src0 = src[1] + window_.x * 5 / 4;
 	const uint8_t *src1 = src[2] + window_.x * 5 / 4;
-	const int widthInBytes = window_.width * 5 / 4;
 
 	if (swapLines_)
 		std::swap(src0, src1);
 
 	SWSTATS_START_LINE_STATS(uint8_t)
 
-	/* x += 5 sample every other 2x2 block */
-	for (int x = 0; x < widthInBytes; x += 5) {
-		/* BGGR */
-		b = src0[x];
-		g = src0[x + 1];
-		g2 = src1[x];
-		r = src1[x + 1];
-		g = (g + g2) / 2;
-		/* Data is already 8 bits, divide by 1 */
-		SWSTATS_ACCUMULATE_LINE_STATS(1)
+	/* x += xStep_ sample every xSkip 2x2 block, in bytes */
+	for (unsigned int zone = 0; zone < zoneEnds_.size(); zone++) {
+		for (; x < zoneEnds_[zone]; x += xStep_) {
+			/* BGGR */
+			b = src0[x];
+			g = src0[x + 1];
+			g2 = src1[x];
+			r = src1[x + 1];
+			g = (g + g2) / 2;
+			/* Data is already 8 bits, divide by 1 */
+			SWSTATS_ACCUMULATE_LINE_STATS(1)
+		}
+
+		SWSTATS_FINISH_ZONE_STATS(zone)
 	}
 
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsGBRG10PLine0(const uint8_t *src[])
+void SwStatsCpu::statsGBRG10PLine0(SwIspStats &stats, SwIspStats::Zone *zones,
+				   const uint8_t *src[])
 {
 	const uint8_t *src0 = src[1] + window_.x * 5 / 4;
 	const uint8_t *src1 = src[2] + window_.x * 5 / 4;
-	const int widthInBytes = window_.width * 5 / 4;
 
 	if (swapLines_)
 		std::swap(src0, src1);
 
 	SWSTATS_START_LINE_STATS(uint8_t)
 
-	/* x += 5 sample every other 2x2 block */
-	for (int x = 0; x < widthInBytes; x += 5) {
-		/* GBRG */
-		g = src0[x];
-		b = src0[x + 1];
-		r = src1[x];
-		g2 = src1[x + 1];
-		g = (g + g2) / 2;
-		/* Data is already 8 bits, divide by 1 */
-		SWSTATS_ACCUMULATE_LINE_STATS(1)
+	/* x += xStep_ sample every xSkip 2x2 block, in bytes */
+	for (unsigned int zone = 0; zone < zoneEnds_.size(); zone++) {
+		for (; x < zoneEnds_[zone]; x += xStep_) {
+			/* GBRG */
+			g = src0[x];
+			b = src0[x + 1];
+			r = src1[x];
+			g2 = src1[x + 1];
+			g = (g + g2) / 2;
+			/* Data is already 8 bits, divide by 1 */
+			SWSTATS_ACCUMULATE_LINE_STATS(1)
+		}
+
+		SWSTATS_FINISH_ZONE_STATS(zone)
+	}
+
+	SWSTATS_FINISH_LINE_STATS()
+}
+
+/*
+ * The SIMD variant accumulates the sums of chunks of kSimdChunkSize samples
+ * with SIMD instructions, producing the histogram bin of each sample. The
+ * bins are then counted in kSubHistograms interleaved histograms, to avoid
+ * serializing on consecutive increments of the same bin, which are merged
+ * once per line.
+ */
+void SwStatsCpu::statsBGGRSimdLine0(SwIspStats &stats, SwIspStats::Zone *zones,
+				    const uint8_t *src[])
+{
+	const unsigned int bpp = bitDepth_ > 8 ? 2 : 1;
+	const uint8_t *src0 = src[1] + window_.x * bpp;
+	const uint8_t *src1 = src[2] + window_.x * bpp;
+	uint16_t histograms[kSubHistograms][SwIspStats::kYHistogramSize] = {};
+	uint8_t bins[kSimdChunkSize];
+	uint64_t sumR = 0;
+	uint64_t sumG = 0;
+	uint64_t sumB = 0;
+	unsigned int x = 0;
+
+	if (swapLines_)
+		std::swap(src0, src1);
+
+	for (unsigned int zone = 0; zone < zoneEnds_.size(); zone++) {
+		uint32_t sums[3] = {};
+		uint32_t zoneCount = 0;
+
+		while (x < zoneEnds_[zone]) {
+			const unsigned int count =
+				std::min(kSimdChunkSize,
+					 (zoneEnds_[zone] - x + xStep_ - 1) / xStep_);
+
+			accumulate_(src0 + x * bpp, src1 + x * bpp, count, sums, bins);
+
+			for (unsigned int i = 0; i < count; i++)
+				histograms[i % kSubHistograms][bins[i]]++;
+
+			x += count * xStep_;
+			zoneCount += count;
+		}
+
+		uint32_t zoneB = sums[0];
+		uint32_t zoneG = sums[1];
+		uint32_t zoneR = sums[2];
+
+		SWSTATS_FINISH_ZONE_STATS(zone)
+	}
+
+	for (unsigned int i = 0; i < SwIspStats::kYHistogramSize; i++) {
+		for (unsigned int j = 0; j < kSubHistograms; j++)
+			stats.yHistogram[i] += histograms[j][i];
 	}
 
 	SWSTATS_FINISH_LINE_STATS()
@@ -303,21 +455,60 @@ void SwStatsCpu::startFrame(void)
 	if (window_.width == 0)
 		LOG(SwStatsCpu, Error) << "Calling startFrame() without setWindow()";
 
-	stats_.sumR_ = 0;
-	stats_.sumB_ = 0;
-	stats_.sumG_ = 0;
-	stats_.yHistogram.fill(0);
+	for (PartialStats &partial : partialStats_) {
+		SwIspStats &stats = partial.stats;
+
+		stats.sumR_ = 0;
+		stats.sumB_ = 0;
+		stats.sumG_ = 0;
+		stats.yHistogram.fill(0);
+		stats.zones.fill({});
+	}
 }
 
 /**
  * \brief Finish statistics calculation for the current frame
+ * \param[in] frame The frame sequence number
  *
- * This may only be called after a successful setWindow() call.
+ * Merge the statistics gathered for all stripes into the shared statistics
+ * buffer for \a frame and emit the statsReady signal. The buffer is selected
+ * from the SwIspStatsBuffers ring based on the frame sequence number, leaving
+ * the statistics of the previous frames untouched while the IPA processes
+ * them.
+ *
+ * This may only be called after a successful setWindow() call, once all
+ * stripes have been processed.
  */
-void SwStatsCpu::finishFrame(void)
+void SwStatsCpu::finishFrame(uint32_t frame)
 {
-	*sharedStats_ = stats_;
-	statsReady.emit();
+	const uint32_t bufferId = frame % kSwIspStatsBufferCount;
+	SwIspStats &sharedStats = (*sharedStats_)[bufferId];
+
+	sharedStats = partialStats_[0].stats;
+
+	for (unsigned int i = 1; i < partialStats_.size(); i++) {
+		const SwIspStats &stats = partialStats_[i].stats;
+
+		sharedStats.sumR_ += stats.sumR_;
+		sharedStats.sumG_ += stats.sumG_;
+		sharedStats.sumB_ += stats.sumB_;
+		for (unsigned int j = 0; j < SwIspStats::kYHistogramSize; j++)
+			sharedStats.yHistogram[j] += stats.yHistogram[j];
+
+		if (!zonesEnabled_)
+			continue;
+
+		for (unsigned int j = 0; j < stats.zones.size(); j++) {
+			SwIspStats::Zone &zone = sharedStats.zones[j];
+
+			zone.sumR += stats.zones[j].sumR;
+			zone.sumG += stats.zones[j].sumG;
+			zone.sumB += stats.zones[j].sumB;
+			zone.count += stats.zones[j].count;
+		}
+	}
+
+	statsReady.emit(frame, bufferId);
 }
 
 /**
@@ -352,7 +543,6 @@ int SwStatsCpu::setupStandardBayerOrder(BayerFormat::Order order)
 
 	patternSize_.height = 2;
 	patternSize_.width = 2;
-	ySkipMask_ = 0x02; /* Skip every 3th and 4th line */
 	return 0;
 }
 
@@ -360,6 +550,10 @@ int SwStatsCpu::setupStandardBayerOrder(BayerFormat::Order order)
  * \brief Configure the statistics object for the passed in input format
  * \param[in] inputCfg The input format
  *
+ * The lines of the CSI-2 packed 12 and 14 bits formats are expected to be
+ * unpacked to 12 bits per pixel, with 16 bits per pixel in memory, before
+ * being passed to processLine0() and processLine2().
+ *
  * \return 0 on success, a negative errno value on failure
  */
 int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
@@ -371,35 +565,57 @@ int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
 	    setupStandardBayerOrder(bayerFormat.order) == 0) {
 		switch (bayerFormat.bitDepth) {
 		case 8:
-			stats0_ = &SwStatsCpu::statsBGGR8Line0;
+			scalarStats0_ = &SwStatsCpu::statsBGGR8Line0;
+			bitDepth_ = 8;
+			updateSampling();
 			return 0;
 		case 10:
-			stats0_ = &SwStatsCpu::statsBGGR10Line0;
+			scalarStats0_ = &SwStatsCpu::statsBGGR10Line0;
+			bitDepth_ = 10;
+			updateSampling();
 			return 0;
 		case 12:
-			stats0_ = &SwStatsCpu::statsBGGR12Line0;
+			scalarStats0_ = &SwStatsCpu::statsBGGR12Line0;
+			bitDepth_ = 12;
+			updateSampling();
 			return 0;
 		}
 	}
 
+	/*
+	 * The CSI-2 packed 12 and 14 bits formats are unpacked to 12 bits per
+	 * pixel by the caller before gathering the statistics.
+	 */
+	if ((bayerFormat.bitDepth == 12 || bayerFormat.bitDepth == 14) &&
+	    bayerFormat.packing == BayerFormat::Packing::CSI2 &&
+	    setupStandardBayerOrder(bayerFormat.order) == 0) {
+		scalarStats0_ = &SwStatsCpu::statsBGGR12Line0;
+		bitDepth_ = 12;
+		patternSize_.width = 4; /* Whole 3 or 7 bytes groups */
+		updateSampling();
+		return 0;
+	}
+
 	if (bayerFormat.bitDepth == 10 &&
 	    bayerFormat.packing == BayerFormat::Packing::CSI2) {
+		/* The SIMD functions only handle unpacked formats */
+		bitDepth_ = 0;
 		patternSize_.height = 2;
 		patternSize_.width = 4; /* 5 bytes per *4* pixels */
-		/* Skip every 3th and 4th line, sample every other 2x2 block */
-		ySkipMask_ = 0x02;
 		xShift_ = 0;
 
 		switch (bayerFormat.order) {
 		case BayerFormat::BGGR:
 		case BayerFormat::GRBG:
-			stats0_ = &SwStatsCpu::statsBGGR10PLine0;
+			scalarStats0_ = &SwStatsCpu::statsBGGR10PLine0;
 			swapLines_ = bayerFormat.order == BayerFormat::GRBG;
+			updateSampling();
 			return 0;
 		case BayerFormat::GBRG:
 		case BayerFormat::RGGB:
-			stats0_ = &SwStatsCpu::statsGBRG10PLine0;
+			scalarStats0_ = &SwStatsCpu::statsGBRG10PLine0;
 			swapLines_ = bayerFormat.order == BayerFormat::RGGB;
+			updateSampling();
 			return 0;
 		default:
 			break;
@@ -427,6 +643,78 @@ void SwStatsCpu::setWindow(const Rectangle &window)
 	window_.width -= xShift_;
 	window_.width &= ~(patternSize_.width - 1);
 	window_.height &= ~(patternSize_.height - 1);
+
+	updateSampling();
+}
+
+/**
+ * \brief Set the number of stripes the frame is split in
+ * \param[in] count The number of stripes
+ *
+ * Statistics are accumulated separately for each stripe, allowing the lines of
+ * different stripes to be processed concurrently. The partial statistics are
+ * merged by finishFrame(). The default is a single stripe.
+ */
+void SwStatsCpu::setStripeCount(unsigned int count)
+{
+	partialStats_.resize(std::max(count, 1U));
+}
+
+/**
+ * \brief Configure the subsampling of the statistics
+ * \param[in] xSkip Sample one 2x2 block every \a xSkip blocks horizontally
+ * \param[in] ySkip Sample one line pair every \a ySkip line pairs
+ * \param[in] zones Accumulate the sums in a grid of zones
+ *
+ * The skip factors are rounded down to a power of two, and clamped to the
+ * [1, 16] range. For the CSI-2 10 bits packed format \a xSkip is at least 2. The
+ * default is to sample every other block of every other line pair, with the
+ * zones disabled.
+ *
+ * Subsampling makes the statistics cost independent of the sensor resolution,
+ * the zones allow region based algorithms in the IPA at the expense of a
+ * slightly higher cost per sample. The sampling configuration is kept across
+ * configure() calls.
+ */
+void SwStatsCpu::setSampling(unsigned int xSkip, unsigned int ySkip, bool zones)
+{
+	const auto powerOfTwo = [](unsigned int value) {
+		value = std::clamp(value, 1U, 16U);
+		return 1U << (31 - __builtin_clz(value));
+	};
+
+	xSkip_ = powerOfTwo(xSkip);
+	ySkip_ = powerOfTwo(ySkip);
+	zonesEnabled_ = zones;
+
+	updateSampling();
+}
+
+/*
+ * Compute the sampling steps and zone limits from the sampling configuration,
+ * the pattern size and the window.
+ */
+void SwStatsCpu::updateSampling()
+{
+	/* Only the 10 bits packed format is processed without unpacking */
+	const bool packed = !bitDepth_;
+	const unsigned int xSkip = packed ? std::max(xSkip_, 2U) : xSkip_;
+
+	/* The y coordinate of a line pair is even, skip on the next bits */
+	ySkipMask_ = (ySkip_ - 1) << 1;
+	/* 2 pixels per block for unpacked formats, 5 bytes per 2 blocks for packed */
+	xStep_ = packed ? 5 * xSkip / 2 : 2 * xSkip;
+
+	const unsigned int width = packed ? window_.width * 5 / 4 : window_.width;
+	const unsigned int columns = zonesEnabled_ ? SwIspStats::kZoneGridWidth : 1;
+
+	zoneEnds_.resize(columns);
+	for (unsigned int i = 0; i < columns; i++)
+		zoneEnds_[i] = width * (i + 1) / columns;
+
+	/* Use the SIMD functions when they support the format and step */
+	accumulate_ = SwStatsSimd::accumulateFn(simdIsa_, bitDepth_, xStep_);
+	stats0_ = accumulate_ ? &SwStatsCpu::statsBGGRSimdLine0 : scalarStats0_;
 }
 
 } /* namespace libcamera */
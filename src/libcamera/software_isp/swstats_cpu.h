@@ -11,7 +11,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <stdint.h>
+#include <vector>
 
 #include <libcamera/base/signal.h>
 
@@ -21,6 +23,8 @@
 #include "libcamera/internal/shared_mem_object.h"
 #include "libcamera/internal/software_isp/swisp_stats.h"
 
+#include "swstats_cpu_simd.h"
+
 namespace libcamera {
 
 class PixelFormat;
@@ -40,49 +44,100 @@ public:
 
 	int configure(const StreamConfiguration &inputCfg);
 	void setWindow(const Rectangle &window);
+	void setStripeCount(unsigned int count);
+	void setSampling(unsigned int xSkip, unsigned int ySkip, bool zones);
 	void startFrame();
-	void finishFrame();
+	void finishFrame(uint32_t frame);
+
+	bool isLineSampled(unsigned int y) const
+	{
+		return !(y & ySkipMask_) && y >= static_cast<unsigned int>(window_.y) &&
+		       y < window_.y + window_.height;
+	}
 
-	void processLine0(unsigned int y, const uint8_t *src[])
+	void processLine0(unsigned int y, const uint8_t *src[], unsigned int stripe = 0)
 	{
-		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
-		    y >= (window_.y + window_.height))
+		if (!isLineSampled(y))
 			return;
 
-		(this->*stats0_)(src);
+		SwIspStats &stats = partialStats_[stripe].stats;
+		(this->*stats0_)(stats, zoneRow(stats, y), src);
 	}
 
-	void processLine2(unsigned int y, const uint8_t *src[])
+	void processLine2(unsigned int y, const uint8_t *src[], unsigned int stripe = 0)
 	{
-		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
-		    y >= (window_.y + window_.height))
+		if (!isLineSampled(y))
 			return;
 
-		(this->*stats2_)(src);
+		SwIspStats &stats = partialStats_[stripe].stats;
+		(this->*stats2_)(stats, zoneRow(stats, y), src);
 	}
 
-	Signal<> statsReady;
+	Signal<uint32_t, uint32_t> statsReady;
 
 private:
-	using statsProcessFn = void (SwStatsCpu::*)(const uint8_t *src[]);
+	using statsProcessFn = void (SwStatsCpu::*)(SwIspStats &stats,
+						    SwIspStats::Zone *zones,
+						    const uint8_t *src[]);
+
+	/* Aligned to avoid false sharing between stripes processed concurrently */
+	struct alignas(64) PartialStats {
+		SwIspStats stats;
+	};
+
+	SwIspStats::Zone *zoneRow(SwIspStats &stats, unsigned int y)
+	{
+		if (!zonesEnabled_)
+			return nullptr;
+
+		unsigned int row = (y - window_.y) * SwIspStats::kZoneGridHeight /
+				   window_.height;
+		row = std::min(row, SwIspStats::kZoneGridHeight - 1);
+
+		return &stats.zones[row * SwIspStats::kZoneGridWidth];
+	}
 
 	int setupStandardBayerOrder(BayerFormat::Order order);
+	void updateSampling();
 	/* Bayer 8 bpp unpacked */
-	void statsBGGR8Line0(const uint8_t *src[]);
+	void statsBGGR8Line0(SwIspStats &stats, SwIspStats::Zone *zones,
+			     const uint8_t *src[]);
 	/* Bayer 10 bpp unpacked */
-	void statsBGGR10Line0(const uint8_t *src[]);
+	void statsBGGR10Line0(SwIspStats &stats, SwIspStats::Zone *zones,
+			      const uint8_t *src[]);
 	/* Bayer 12 bpp unpacked */
-	void statsBGGR12Line0(const uint8_t *src[]);
+	void statsBGGR12Line0(SwIspStats &stats, SwIspStats::Zone *zones,
+			      const uint8_t *src[]);
 	/* Bayer 10 bpp packed */
-	void statsBGGR10PLine0(const uint8_t *src[]);
-	void statsGBRG10PLine0(const uint8_t *src[]);
+	void statsBGGR10PLine0(SwIspStats &stats, SwIspStats::Zone *zones,
+			       const uint8_t *src[]);
+	void statsGBRG10PLine0(SwIspStats &stats, SwIspStats::Zone *zones,
+			       const uint8_t *src[]);
+	/* Bayer 8, 10 and 12 bpp unpacked, SIMD accelerated */
+	void statsBGGRSimdLine0(SwIspStats &stats, SwIspStats::Zone *zones,
+				const uint8_t *src[]);
+
+	static constexpr unsigned int kSimdChunkSize = 256;
+	static constexpr unsigned int kSubHistograms = 4;
 
 	/* Variables set by configure(), used every line */
 	statsProcessFn stats0_;
 	statsProcessFn stats2_;
 	bool swapLines_;
 
+	DebayerSimd::Isa simdIsa_;
+	statsProcessFn scalarStats0_;
+	SwStatsSimd::AccumulateFn accumulate_;
+	unsigned int bitDepth_;
+
 	unsigned int ySkipMask_;
+	unsigned int xStep_;
+	std::vector<unsigned int> zoneEnds_;
+
+	/* Sampling configuration, set by setSampling() */
+	unsigned int xSkip_;
+	unsigned int ySkip_;
+	bool zonesEnabled_;
 
 	Rectangle window_;
 
@@ -90,8 +145,8 @@ private:
 
 	unsigned int xShift_;
 
-	SharedMemObject<SwIspStats> sharedStats_;
-	SwIspStats stats_;
+	SharedMemObject<SwIspStatsBuffers> sharedStats_;
+	std::vector<PartialStats> partialStats_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,401 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * SIMD helpers for CPU based software statistics
+ */
+
+#include "swstats_cpu_simd.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * \file swstats_cpu_simd.h
+ * \brief SIMD helpers for CPU based software statistics
+ *
+ * The SwStatsCpu line functions sample one 2x2 Bayer block every xSkip
+ * blocks, accumulate the red, green and blue sums and build a luminance
+ * histogram. The sums and the luminance computation map well onto SIMD
+ * instructions, with the sums accumulated in 32-bit lanes and reduced once
+ * per call. The histogram update is a scattered increment that can't be
+ * vectorized, the functions in this file only compute the histogram bin of
+ * each sample and leave the histogram update to SwStatsCpu.
+ *
+ * The functions support unpacked 8, 10 and 12 bits per pixel Bayer data,
+ * sampling every block or every other block, and produce exactly the same
+ * values as the scalar SwStatsCpu functions. The instruction set detection is
+ * shared with DebayerSimd.
+ */
+
+namespace libcamera {
+
+namespace SwStatsSimd {
+
+/**
+ * \typedef AccumulateFn
+ * \brief Accumulate the statistics of a run of 2x2 Bayer blocks
+ * \param[in] src0 The first sampled block in the BGBG line
+ * \param[in] src1 The first sampled block in the GRGR line
+ * \param[in] count The number of blocks to sample
+ * \param[inout] sums The blue, green and red sums to accumulate into
+ * \param[out] bins The luminance histogram bin of each sample, \a count
+ * entries, in an unspecified order
+ *
+ * The Bayer order is expected to have been normalized to BGGR by the caller,
+ * by adjusting the line start offset and swapping the lines.
+ */
+
+namespace {
+
+static constexpr unsigned int kRedYMul = 77; /* 0.299 * 256 */
+static constexpr unsigned int kGreenYMul = 150; /* 0.587 * 256 */
+static constexpr unsigned int kBlueYMul = 29; /* 0.114 * 256 */
+
+/*
+ * Step is the distance between the sampled blocks in pixels, Shift converts
+ * the luminance to a histogram bin: the luminance of an 8 bits sample is
+ * scaled by 256, and the histogram has 64 bins.
+ */
+template<typename pixel_t, unsigned int Shift, unsigned int Step>
+void accumulateScalar(const pixel_t *src0, const pixel_t *src1,
+		      unsigned int start, unsigned int count, uint32_t sums[3],
+		      uint8_t *bins)
+{
+	for (unsigned int i = start; i < count; i++) {
+		const unsigned int b = src0[i * Step];
+		const unsigned int g = (src0[i * Step + 1] + src1[i * Step]) / 2;
+		const unsigned int r = src1[i * Step + 1];
+
+		sums[0] += b;
+		sums[1] += g;
+		sums[2] += r;
+
+		bins[i] = (r * kRedYMul + g * kGreenYMul + b * kBlueYMul) >> (10 + Shift);
+	}
+}
+
+/*
+ * The vector loops load all the pixels of the blocks they process, including
+ * the skipped ones after the last sampled block. Stop one block early when
+ * skipping to avoid reading past the end of the line.
+ */
+template<unsigned int Step>
+constexpr unsigned int vectorEnd(unsigned int count, unsigned int lanes)
+{
+	const unsigned int end = Step == 2 ? count : (count ? count - 1 : 0);
+	return end - end % lanes;
+}
+
+#if defined(__ARM_NEON)
+
+/* Deinterleave the even and odd pixels of 8 blocks */
+template<unsigned int Step>
+inline void neonLoad(const uint8_t *p, uint16x8_t &even, uint16x8_t &odd)
+{
+	if constexpr (Step == 2) {
+		uint8x8x2_t v = vld2_u8(p);
+		even = vmovl_u8(v.val[0]);
+		odd = vmovl_u8(v.val[1]);
+	} else {
+		uint8x8x4_t v = vld4_u8(p);
+		even = vmovl_u8(v.val[0]);
+		odd = vmovl_u8(v.val[1]);
+	}
+}
+
+template<unsigned int Step>
+inline void neonLoad(const uint16_t *p, uint16x8_t &even, uint16x8_t &odd)
+{
+	if constexpr (Step == 2) {
+		uint16x8x2_t v = vld2q_u16(p);
+		even = v.val[0];
+		odd = v.val[1];
+	} else {
+		uint16x8x4_t v = vld4q_u16(p);
+		even = v.val[0];
+		odd = v.val[1];
+	}
+}
+
+inline uint32_t neonReduce(uint32x4_t v)
+{
+	uint32x2_t sum = vadd_u32(vget_low_u32(v), vget_high_u32(v));
+	return vget_lane_u32(vpadd_u32(sum, sum), 0);
+}
+
+template<unsigned int Shift>
+inline uint16x4_t neonBins(uint16x4_t r, uint16x4_t g, uint16x4_t b)
+{
+	uint32x4_t y = vmull_n_u16(r, kRedYMul);
+	y = vmlal_n_u16(y, g, kGreenYMul);
+	y = vmlal_n_u16(y, b, kBlueYMul);
+	return vshrn_n_u32(y, 10 + Shift);
+}
+
+template<typename pixel_t, unsigned int Shift, unsigned int Step>
+void accumulateNeon(const uint8_t *src0, const uint8_t *src1,
+		    unsigned int count, uint32_t sums[3], uint8_t *bins)
+{
+	const pixel_t *line0 = reinterpret_cast<const pixel_t *>(src0);
+	const pixel_t *line1 = reinterpret_cast<const pixel_t *>(src1);
+	const unsigned int end = vectorEnd<Step>(count, 8);
+	uint32x4_t sumB = vdupq_n_u32(0);
+	uint32x4_t sumG = vdupq_n_u32(0);
+	uint32x4_t sumR = vdupq_n_u32(0);
+
+	for (unsigned int i = 0; i < end; i += 8) {
+		uint16x8_t b, g, g2, r;
+
+		neonLoad<Step>(line0 + i * Step, b, g);
+		neonLoad<Step>(line1 + i * Step, g2, r);
+		g = vhaddq_u16(g, g2);
+
+		sumB = vpadalq_u16(sumB, b);
+		sumG = vpadalq_u16(sumG, g);
+		sumR = vpadalq_u16(sumR, r);
+
+		uint16x8_t y = vcombine_u16(neonBins<Shift>(vget_low_u16(r), vget_low_u16(g),
+							    vget_low_u16(b)),
+					    neonBins<Shift>(vget_high_u16(r), vget_high_u16(g),
+							    vget_high_u16(b)));
+		vst1_u8(bins + i, vmovn_u16(y));
+	}
+
+	sums[0] += neonReduce(sumB);
+	sums[1] += neonReduce(sumG);
+	sums[2] += neonReduce(sumR);
+
+	accumulateScalar<pixel_t, Shift, Step>(line0, line1, end, count, sums, bins);
+}
+
+#endif /* __ARM_NEON */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * Load 4 blocks with the pixels of each one in a 32-bit lane, the even pixel
+ * in the low 16 bits and the odd pixel in the high 16 bits.
+ */
+template<unsigned int Step>
+__attribute__((target("sse4.1"))) inline __m128i sseLoad(const uint8_t *p)
+{
+	if constexpr (Step == 2) {
+		return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+	} else {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		return _mm_cvtepu8_epi16(_mm_shuffle_epi8(v, _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+									   -1, -1, -1, -1, -1, -1, -1, -1)));
+	}
+}
+
+template<unsigned int Step>
+__attribute__((target("sse4.1"))) inline __m128i sseLoad(const uint16_t *p)
+{
+	const __m128i *v = reinterpret_cast<const __m128i *>(p);
+
+	if constexpr (Step == 2)
+		return _mm_loadu_si128(v);
+	else
+		return _mm_unpacklo_epi64(_mm_shuffle_epi32(_mm_loadu_si128(v), 0x08),
+					  _mm_shuffle_epi32(_mm_loadu_si128(v + 1), 0x08));
+}
+
+__attribute__((target("sse4.1"))) inline uint32_t sseReduce(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+	return _mm_cvtsi128_si32(v);
+}
+
+template<typename pixel_t, unsigned int Shift, unsigned int Step>
+__attribute__((target("sse4.1")))
+void accumulateSse41(const uint8_t *src0, const uint8_t *src1,
+		     unsigned int count, uint32_t sums[3], uint8_t *bins)
+{
+	const pixel_t *line0 = reinterpret_cast<const pixel_t *>(src0);
+	const pixel_t *line1 = reinterpret_cast<const pixel_t *>(src1);
+	const unsigned int end = vectorEnd<Step>(count, 4);
+	const __m128i low = _mm_set1_epi32(0xffff);
+	/* r * kRedYMul + g * kGreenYMul with r in the low and g in the high half */
+	const __m128i rgMul = _mm_set1_epi32(kRedYMul | (kGreenYMul << 16));
+	const __m128i bMul = _mm_set1_epi32(kBlueYMul);
+	__m128i sumB = _mm_setzero_si128();
+	__m128i sumG = _mm_setzero_si128();
+	__m128i sumR = _mm_setzero_si128();
+
+	for (unsigned int i = 0; i < end; i += 4) {
+		const __m128i bg = sseLoad<Step>(line0 + i * Step);
+		const __m128i gr = sseLoad<Step>(line1 + i * Step);
+		const __m128i b = _mm_and_si128(bg, low);
+		const __m128i r = _mm_srli_epi32(gr, 16);
+		const __m128i g = _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(bg, 16),
+							       _mm_and_si128(gr, low)), 1);
+
+		sumB = _mm_add_epi32(sumB, b);
+		sumG = _mm_add_epi32(sumG, g);
+		sumR = _mm_add_epi32(sumR, r);
+
+		__m128i y = _mm_madd_epi16(_mm_or_si128(r, _mm_slli_epi32(g, 16)), rgMul);
+		y = _mm_add_epi32(y, _mm_madd_epi16(b, bMul));
+		y = _mm_srli_epi32(y, 10 + Shift);
+		y = _mm_packus_epi16(_mm_packus_epi32(y, y), y);
+
+		const uint32_t packed = _mm_cvtsi128_si32(y);
+		memcpy(bins + i, &packed, sizeof(packed));
+	}
+
+	sums[0] += sseReduce(sumB);
+	sums[1] += sseReduce(sumG);
+	sums[2] += sseReduce(sumR);
+
+	accumulateScalar<pixel_t, Shift, Step>(line0, line1, end, count, sums, bins);
+}
+
+/*
+ * Load 8 blocks as sseLoad() does. The blocks are not in order for Step 4 and
+ * 16 bits pixels, which doesn't matter for sums and histograms.
+ */
+template<unsigned int Step>
+__attribute__((target("avx2"))) inline __m256i avxLoad(const uint8_t *p)
+{
+	if constexpr (Step == 2) {
+		return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+	} else {
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		const __m256i pairs = _mm256_and_si256(v, _mm256_set1_epi32(0xffff));
+		const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(pairs),
+							_mm256_extracti128_si256(pairs, 1));
+		return _mm256_cvtepu8_epi16(packed);
+	}
+}
+
+template<unsigned int Step>
+__attribute__((target("avx2"))) inline __m256i avxLoad(const uint16_t *p)
+{
+	const __m256i *v = reinterpret_cast<const __m256i *>(p);
+
+	if constexpr (Step == 2)
+		return _mm256_loadu_si256(v);
+	else
+		return _mm256_unpacklo_epi64(_mm256_shuffle_epi32(_mm256_loadu_si256(v), 0x08),
+					     _mm256_shuffle_epi32(_mm256_loadu_si256(v + 1), 0x08));
+}
+
+__attribute__((target("avx2"))) inline uint32_t avxReduce(__m256i v)
+{
+	return sseReduce(_mm_add_epi32(_mm256_castsi256_si128(v),
+				       _mm256_extracti128_si256(v, 1)));
+}
+
+template<typename pixel_t, unsigned int Shift, unsigned int Step>
+__attribute__((target("avx2")))
+void accumulateAvx2(const uint8_t *src0, const uint8_t *src1,
+		    unsigned int count, uint32_t sums[3], uint8_t *bins)
+{
+	const pixel_t *line0 = reinterpret_cast<const pixel_t *>(src0);
+	const pixel_t *line1 = reinterpret_cast<const pixel_t *>(src1);
+	const unsigned int end = vectorEnd<Step>(count, 8);
+	const __m256i low = _mm256_set1_epi32(0xffff);
+	const __m256i rgMul = _mm256_set1_epi32(kRedYMul | (kGreenYMul << 16));
+	const __m256i bMul = _mm256_set1_epi32(kBlueYMul);
+	__m256i sumB = _mm256_setzero_si256();
+	__m256i sumG = _mm256_setzero_si256();
+	__m256i sumR = _mm256_setzero_si256();
+
+	for (unsigned int i = 0; i < end; i += 8) {
+		const __m256i bg = avxLoad<Step>(line0 + i * Step);
+		const __m256i gr = avxLoad<Step>(line1 + i * Step);
+		const __m256i b = _mm256_and_si256(bg, low);
+		const __m256i r = _mm256_srli_epi32(gr, 16);
+		const __m256i g = _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(bg, 16),
+								     _mm256_and_si256(gr, low)), 1);
+
+		sumB = _mm256_add_epi32(sumB, b);
+		sumG = _mm256_add_epi32(sumG, g);
+		sumR = _mm256_add_epi32(sumR, r);
+
+		__m256i y = _mm256_madd_epi16(_mm256_or_si256(r, _mm256_slli_epi32(g, 16)), rgMul);
+		y = _mm256_add_epi32(y, _mm256_madd_epi16(b, bMul));
+		y = _mm256_srli_epi32(y, 10 + Shift);
+
+		/* The packs operate on each 128-bit lane independently */
+		y = _mm256_packus_epi16(_mm256_packus_epi32(y, y), y);
+		const uint32_t packed[2] = {
+			static_cast<uint32_t>(_mm_cvtsi128_si32(_mm256_castsi256_si128(y))),
+			static_cast<uint32_t>(_mm_cvtsi128_si32(_mm256_extracti128_si256(y, 1))),
+		};
+		memcpy(bins + i, packed, sizeof(packed));
+	}
+
+	sums[0] += avxReduce(sumB);
+	sums[1] += avxReduce(sumG);
+	sums[2] += avxReduce(sumR);
+
+	accumulateScalar<pixel_t, Shift, Step>(line0, line1, end, count, sums, bins);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+/*
+ * Select the kernel instance for the given bit depth and step. The luminance
+ * is converted to 8 bits by shifting right by (bitDepth - 8).
+ */
+#define SWSTATS_SIMD_SELECT(kernel, bitDepth, step)                                     \
+	switch (bitDepth) {                                                             \
+	case 8:                                                                         \
+		return step == 2 ? kernel<uint8_t, 0, 2> : kernel<uint8_t, 0, 4>;       \
+	case 10:                                                                        \
+		return step == 2 ? kernel<uint16_t, 2, 2> : kernel<uint16_t, 2, 4>;     \
+	case 12:                                                                        \
+		return step == 2 ? kernel<uint16_t, 4, 2> : kernel<uint16_t, 4, 4>;     \
+	default:                                                                        \
+		return nullptr;                                                         \
+	}
+
+} /* namespace */
+
+/**
+ * \brief Get the statistics accumulation function for Bayer line pairs
+ * \param[in] isa The SIMD instruction set
+ * \param[in] bitDepth The unpacked Bayer data bit depth (8, 10 or 12)
+ * \param[in] step The distance between the sampled blocks, in pixels
+ *
+ * Only \a step values of 2 and 4, sampling every block or every other block,
+ * are supported. Sparser sampling doesn't benefit from SIMD instructions.
+ *
+ * \return The accumulation function, or nullptr if the combination of \a isa,
+ * \a bitDepth and \a step isn't supported
+ */
+AccumulateFn accumulateFn(DebayerSimd::Isa isa, unsigned int bitDepth,
+			  unsigned int step)
+{
+	if (step != 2 && step != 4)
+		return nullptr;
+
+	switch (isa) {
+#if defined(__ARM_NEON)
+	case DebayerSimd::Isa::Neon:
+		SWSTATS_SIMD_SELECT(accumulateNeon, bitDepth, step)
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	case DebayerSimd::Isa::Sse41:
+		SWSTATS_SIMD_SELECT(accumulateSse41, bitDepth, step)
+	case DebayerSimd::Isa::Avx2:
+		SWSTATS_SIMD_SELECT(accumulateAvx2, bitDepth, step)
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+} /* namespace SwStatsSimd */
+
+} /* namespace libcamera */
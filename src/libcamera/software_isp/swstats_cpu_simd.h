@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * SIMD helpers for CPU based software statistics
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "debayer_cpu_simd.h"
+
+namespace libcamera {
+
+namespace SwStatsSimd {
+
+using AccumulateFn = void (*)(const uint8_t *src0, const uint8_t *src1,
+			      unsigned int count, uint32_t sums[3],
+			      uint8_t *bins);
+
+AccumulateFn accumulateFn(DebayerSimd::Isa isa, unsigned int bitDepth,
+			  unsigned int step);
+
+} /* namespace SwStatsSimd */
+
+} /* namespace libcamera */
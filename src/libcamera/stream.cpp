@@ -281,7 +281,7 @@ SizeRange StreamFormats::range(const PixelFormat &pixelformat) const
  */
 StreamConfiguration::StreamConfiguration()
 	: pixelFormat(0), stride(0), frameSize(0), bufferCount(0),
-	  stream_(nullptr)
+	  frameRateDivisor(1), stream_(nullptr)
 {
 }
 
@@ -290,7 +290,7 @@ StreamConfiguration::StreamConfiguration()
  */
 StreamConfiguration::StreamConfiguration(const StreamFormats &formats)
 	: pixelFormat(0), stride(0), frameSize(0), bufferCount(0),
-	  stream_(nullptr), formats_(formats)
+	  frameRateDivisor(1), stream_(nullptr), formats_(formats)
 {
 }
 
@@ -330,6 +330,29 @@ StreamConfiguration::StreamConfiguration(const StreamFormats &formats)
  * \brief Requested number of buffers to allocate for the stream
  */
 
+/**
+ * \var StreamConfiguration::frameRateDivisor
+ * \brief Divisor of the camera frame rate for the stream
+ *
+ * Streams that don't need to be captured at the full frame rate of the camera,
+ * such as a high resolution stream used for analytics alongside a video
+ * stream, can set the frameRateDivisor to a value larger than 1. The stream
+ * is then only captured for one request out of frameRateDivisor, starting with
+ * the first request queued after the camera is started.
+ *
+ * Applications can keep adding buffers for the stream to every request. The
+ * buffers of the requests for which the stream is skipped are not processed
+ * by the pipeline handler, and are returned with their status set to
+ * FrameMetadata::FrameCancelled, without affecting the request status.
+ * Pipeline handlers don't produce the corresponding output on those frames,
+ * saving memory bandwidth and processing time. Requests that only contain
+ * buffers for skipped streams are completed immediately, and their controls
+ * are not applied.
+ *
+ * The value defaults to 1, capturing the stream for every request. A value of
+ * 0 is invalid.
+ */
+
 /**
  * \var StreamConfiguration::colorSpace
  * \brief The ColorSpace for this stream
@@ -459,6 +482,7 @@ std::ostream &operator<<(std::ostream &out, StreamRole role)
  * \brief Construct a stream with default parameters
  */
 Stream::Stream()
+	: index_(kInvalidIndex)
 {
 }
 
@@ -468,6 +492,25 @@ Stream::Stream()
  * \return The active configuration of the stream
  */
 
+/**
+ * \var Stream::kInvalidIndex
+ * \brief Index value of streams that are not part of the camera configuration
+ */
+
+/**
+ * \fn Stream::index()
+ * \brief Retrieve the index of the stream in the active camera configuration
+ *
+ * The index is the position of the stream configuration in the
+ * CameraConfiguration applied by the last successful call to
+ * Camera::configure(). It is lower than the number of streams in the
+ * configuration, and can be used to store per-stream data in flat arrays
+ * instead of maps indexed by Stream pointers.
+ *
+ * \return The index of the stream, or Stream::kInvalidIndex if the stream isn't
+ * part of the active camera configuration
+ */
+
 /**
  * \var Stream::configuration_
  * \brief The stream configuration
@@ -477,4 +520,13 @@ Stream::Stream()
  * next call to Camera::configure() regardless of if it includes the stream.
  */
 
+/**
+ * \var Stream::index_
+ * \brief The index of the stream in the active camera configuration
+ *
+ * The index is set by any successful call to Camera::configure() that includes
+ * the stream, and reset to Stream::kInvalidIndex by calls that don't include
+ * it.
+ */
+
 } /* namespace libcamera */
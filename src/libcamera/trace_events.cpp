@@ -0,0 +1,424 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * In-process tracing backend with Chrome trace events
+ */
+
+#include "libcamera/internal/trace_events.h"
+
+#include <errno.h>
+#include <fstream>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+
+/**
+ * \file trace_events.h
+ * \brief In-process tracing backend with Chrome trace events
+ *
+ * When libcamera is compiled with the trace-events tracing backend, the
+ * tracepoints are recorded by libcamera itself instead of lttng, and written
+ * to the file specified by the LIBCAMERA_TRACE_FILE environment variable in
+ * the Chrome JSON trace event format. The file can be loaded in the Perfetto
+ * UI or in chrome://tracing.
+ *
+ * The tracepoint definitions are shared with the lttng backend. This header
+ * provides the TRACEPOINT_* and ctf_* macros that translate them to inline
+ * functions in the libcamera::trace_events namespace, which the
+ * LIBCAMERA_TRACEPOINT() macro calls.
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(TraceEvents)
+
+namespace {
+
+/* Tracepoints recorded as the beginning and end of a span. */
+const struct {
+	const char *begin;
+	const char *end;
+	const char *span;
+	bool async;
+} spanTracepoints[] = {
+	{ "ipa_call_begin", "ipa_call_end", "ipa_call", false },
+	{ "ipa_frame_call_begin", "ipa_frame_call_end", "ipa_frame_call", false },
+	{ "v4l2_queue_buffer", "v4l2_dequeue_buffer", "v4l2", true },
+	{ "converter_queue_buffer", "converter_complete_buffer", "converter", true },
+	{ "software_isp_queue_buffer", "software_isp_complete_buffer", "software_isp", true },
+};
+
+/* Flush the events to the file when the buffer reaches this size. */
+constexpr size_t kFlushSize = 64 * 1024;
+
+void appendString(std::string *out, const char *str)
+{
+	*out += '"';
+
+	for (; str && *str; ++str) {
+		char c = *str;
+
+		if (c == '"' || c == '\\') {
+			*out += '\\';
+			*out += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char escape[7];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			*out += escape;
+		} else {
+			*out += c;
+		}
+	}
+
+	*out += '"';
+}
+
+void appendMetadata(std::string *out, const char *name, pid_t pid, pid_t tid,
+		    const std::string &value)
+{
+	*out += "{\"name\":\"";
+	*out += name;
+	*out += "\",\"ph\":\"M\",\"pid\":" + std::to_string(pid);
+	if (tid)
+		*out += ",\"tid\":" + std::to_string(tid);
+	*out += ",\"args\":{\"name\":";
+	appendString(out, value.c_str());
+	*out += "}}";
+}
+
+} /* namespace */
+
+/**
+ * \class TraceEventType
+ * \brief Static description of a tracepoint for the trace events backend
+ *
+ * Every tracepoint function holds a static TraceEventType instance, that
+ * stores the tracepoint name and the trace event phase it is recorded with.
+ * Most tracepoints are recorded as instant events. The tracepoints that mark
+ * the beginning and end of a processing stage are recorded as spans: the IPA
+ * calls as spans on the calling thread, and the buffer processing by the
+ * video devices, the converters and the software ISP as asynchronous spans
+ * identified by their buffer argument.
+ */
+
+/**
+ * \enum TraceEventType::Phase
+ * \brief The trace event phase
+ * \var TraceEventType::Instant
+ * \brief Instant event
+ * \var TraceEventType::Begin
+ * \brief Beginning of a span on the current thread
+ * \var TraceEventType::End
+ * \brief End of a span on the current thread
+ * \var TraceEventType::AsyncBegin
+ * \brief Beginning of an asynchronous span
+ * \var TraceEventType::AsyncEnd
+ * \brief End of an asynchronous span
+ */
+
+/**
+ * \brief Construct a TraceEventType for the tracepoint \a name
+ * \param[in] name The tracepoint name
+ */
+TraceEventType::TraceEventType(const char *name)
+	: name_(name), spanName_(name), phase_(Instant)
+{
+	for (const auto &tp : spanTracepoints) {
+		if (!strcmp(name, tp.begin))
+			phase_ = tp.async ? AsyncBegin : Begin;
+		else if (!strcmp(name, tp.end))
+			phase_ = tp.async ? AsyncEnd : End;
+		else
+			continue;
+
+		spanName_ = tp.span;
+		break;
+	}
+}
+
+/**
+ * \fn TraceEventType::name()
+ * \brief Retrieve the tracepoint name
+ * \return The tracepoint name
+ */
+
+/**
+ * \fn TraceEventType::spanName()
+ * \brief Retrieve the name the event is recorded with
+ *
+ * The span events are recorded with the name of the span, shared by their
+ * beginning and end tracepoints. Other events are recorded with the tracepoint
+ * name.
+ *
+ * \return The event name
+ */
+
+/**
+ * \fn TraceEventType::phase()
+ * \brief Retrieve the phase of the event
+ * \return The event phase
+ */
+
+/**
+ * \class TraceEvent
+ * \brief A trace event being recorded
+ *
+ * The tracepoint functions construct a TraceEvent, which samples the current
+ * time, add the tracepoint fields as arguments and commit the event to the
+ * trace file.
+ */
+
+/**
+ * \brief Construct a TraceEvent for a tracepoint
+ * \param[in] type The tracepoint description
+ */
+TraceEvent::TraceEvent(const TraceEventType &type)
+	: type_(type), timestamp_(utils::clock::now()), id_(0)
+{
+}
+
+/**
+ * \fn TraceEvent::addArg(const char *name, T value)
+ * \brief Add an integer argument to the event
+ * \param[in] name The argument name
+ * \param[in] value The argument value
+ */
+
+/**
+ * \brief Add a string argument to the event
+ * \param[in] name The argument name
+ * \param[in] value The argument value
+ */
+void TraceEvent::addArg(const char *name, const char *value)
+{
+	addKey(name);
+	appendString(&args_, value);
+}
+
+/**
+ * \brief Add an hexadecimal integer argument to the event
+ * \param[in] name The argument name
+ * \param[in] value The argument value
+ *
+ * The "buffer" argument identifies the asynchronous spans.
+ */
+void TraceEvent::addArgHex(const char *name, uint64_t value)
+{
+	char str[19];
+	snprintf(str, sizeof(str), "0x%" PRIx64, value);
+
+	addKey(name);
+	appendString(&args_, str);
+
+	if (!strcmp(name, "buffer"))
+		id_ = value;
+}
+
+/**
+ * \brief Add an enumerated argument to the event
+ * \param[in] name The argument name
+ * \param[in] str The name of the enumerated value, or nullptr if unknown
+ * \param[in] value The numerical value
+ *
+ * The argument is recorded as the name of the value if known, and as a number
+ * otherwise.
+ */
+void TraceEvent::addArgEnum(const char *name, const char *str, int64_t value)
+{
+	if (!str) {
+		addSigned(name, value);
+		return;
+	}
+
+	addKey(name);
+	appendString(&args_, str);
+}
+
+/**
+ * \brief Write the event to the trace file
+ */
+void TraceEvent::commit()
+{
+	static const char phases[] = { 'i', 'B', 'E', 'b', 'e' };
+	TraceEvents *events = TraceEvents::instance();
+	pid_t tid = Thread::currentId();
+	char str[128];
+
+	std::string event = "{\"name\":";
+	appendString(&event, type_.spanName().c_str());
+
+	int64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		timestamp_.time_since_epoch()).count();
+	snprintf(str, sizeof(str),
+		 ",\"cat\":\"libcamera\",\"ph\":\"%c\",\"ts\":%" PRId64 ".%03" PRId64
+		 ",\"pid\":%d,\"tid\":%d",
+		 phases[type_.phase()], ts / 1000, ts % 1000, events->pid(), tid);
+	event += str;
+
+	switch (type_.phase()) {
+	case TraceEventType::Instant:
+		event += ",\"s\":\"t\"";
+		break;
+	case TraceEventType::AsyncBegin:
+	case TraceEventType::AsyncEnd:
+		snprintf(str, sizeof(str), ",\"id\":\"0x%" PRIx64 "\"", id_);
+		event += str;
+		break;
+	default:
+		break;
+	}
+
+	event += ",\"args\":{";
+	event += args_;
+	event += "}}";
+
+	events->write(event, tid);
+}
+
+void TraceEvent::addSigned(const char *name, int64_t value)
+{
+	addKey(name);
+	args_ += std::to_string(value);
+}
+
+void TraceEvent::addUnsigned(const char *name, uint64_t value)
+{
+	addKey(name);
+	args_ += std::to_string(value);
+}
+
+void TraceEvent::addKey(const char *name)
+{
+	if (!args_.empty())
+		args_ += ',';
+
+	appendString(&args_, name);
+	args_ += ':';
+}
+
+/**
+ * \class TraceEvents
+ * \brief Writer of the trace events file
+ *
+ * The TraceEvents singleton opens the file specified by the
+ * LIBCAMERA_TRACE_FILE environment variable, and writes the trace events to
+ * it in the JSON array format. Tracing is disabled when the variable isn't
+ * set.
+ *
+ * The events are buffered in memory and written to the file in chunks, to
+ * limit the impact of tracing on the traced threads. The name of every
+ * thread, as set when constructing its Thread instance, is recorded as
+ * metadata with the first event of the thread.
+ */
+
+TraceEvents::TraceEvents()
+	: enabled_(false), file_(nullptr), pid_(getpid())
+{
+	const char *path = utils::secure_getenv("LIBCAMERA_TRACE_FILE");
+	if (!path)
+		return;
+
+	FILE *file = fopen(path, "we");
+	if (!file) {
+		LOG(TraceEvents, Error)
+			<< "Failed to open trace file " << path << ": "
+			<< strerror(errno);
+		return;
+	}
+
+	std::string comm;
+	std::ifstream("/proc/self/comm") >> comm;
+
+	MutexLocker locker(mutex_);
+
+	buffer_ = "[\n";
+	appendMetadata(&buffer_, "process_name", pid_, 0, comm);
+
+	file_ = file;
+	enabled_.store(true, std::memory_order_release);
+}
+
+TraceEvents::~TraceEvents()
+{
+	if (!file_)
+		return;
+
+	enabled_.store(false, std::memory_order_release);
+
+	MutexLocker locker(mutex_);
+
+	buffer_ += "\n]\n";
+	flush();
+
+	fclose(file_);
+	file_ = nullptr;
+}
+
+/**
+ * \brief Retrieve the trace events writer instance
+ * \return The TraceEvents singleton
+ */
+TraceEvents *TraceEvents::instance()
+{
+	static TraceEvents instance;
+	return &instance;
+}
+
+/**
+ * \brief Check if tracing is enabled
+ * \context This function is \threadsafe.
+ * \return True if the trace events are recorded, false otherwise
+ */
+bool TraceEvents::enabled()
+{
+	return instance()->enabled_.load(std::memory_order_acquire);
+}
+
+/**
+ * \fn TraceEvents::pid()
+ * \brief Retrieve the process ID the events are recorded with
+ * \return The process ID
+ */
+
+/**
+ * \brief Write a trace event
+ * \param[in] event The event, formatted as a JSON object
+ * \param[in] tid The ID of the thread that recorded the event
+ *
+ * \context This function is \threadsafe.
+ */
+void TraceEvents::write(const std::string &event, pid_t tid)
+{
+	MutexLocker locker(mutex_);
+
+	if (!file_)
+		return;
+
+	if (threads_.insert(tid).second) {
+		Thread *thread = Thread::current();
+		if (thread && !thread->name().empty()) {
+			buffer_ += ",\n";
+			appendMetadata(&buffer_, "thread_name", pid_, tid,
+				       thread->name());
+		}
+	}
+
+	buffer_ += ",\n";
+	buffer_ += event;
+
+	if (buffer_.size() >= kFlushSize)
+		flush();
+}
+
+void TraceEvents::flush()
+{
+	fwrite(buffer_.data(), 1, buffer_.size(), file_);
+	fflush(file_);
+	buffer_.clear();
+}
+
+} /* namespace libcamera */
@@ -15,6 +15,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 #include <vector>
 
@@ -22,10 +23,13 @@
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
 #include <libcamera/base/utils.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/media_request.h"
 #include "libcamera/internal/sysfs.h"
+#include "libcamera/internal/tracepoints.h"
 
 /**
  * \file v4l2_device.h
@@ -35,6 +39,7 @@
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(V4L2)
+LOG_DEFINE_CATEGORY(FrameStart)
 
 /**
  * \class V4L2Device
@@ -143,6 +148,9 @@ void V4L2Device::close()
 	if (!isOpen())
 		return;
 
+	setFrameStartEnabled(false);
+	setFrameStartThreadEnabled(false);
+
 	delete fdEventNotifier_;
 
 	fd_.reset();
@@ -260,11 +268,17 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
 /**
  * \brief Write controls to the device
  * \param[in] ctrls The list of controls to write
+ * \param[in] request An optional media request to add the controls to
  *
  * This function writes the value of all controls contained in \a ctrls, and
  * stores the values actually applied to the device in the corresponding
  * \a ctrls entry.
  *
+ * If a media \a request is specified, the controls are not applied
+ * immediately but stored in the request, and applied by the device when the
+ * request is queued. The values stored in \a ctrls are then the values stored
+ * in the request.
+ *
  * If any control in \a ctrls is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), is read-only, if any other error
  * occurs during validation of the requested controls, no control is written and
@@ -279,7 +293,7 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int V4L2Device::setControls(ControlList *ctrls)
+int V4L2Device::setControls(ControlList *ctrls, MediaRequest *request)
 {
 	if (ctrls->empty())
 		return 0;
@@ -344,6 +358,11 @@ int V4L2Device::setControls(ControlList *ctrls)
 	v4l2ExtCtrls.controls = v4l2Ctrls.data();
 	v4l2ExtCtrls.count = v4l2Ctrls.size();
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	}
+
 	int ret = ioctl(VIDIOC_S_EXT_CTRLS, &v4l2ExtCtrls);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
@@ -435,12 +454,58 @@ int V4L2Device::setFrameStartEnabled(bool enable)
 	if (enable && ret)
 		return ret;
 
-	fdEventNotifier_->setEnabled(enable);
+	fdEventNotifier_->invokeMethod(&EventNotifier::setEnabled,
+				       ConnectionTypeBlocking, enable);
 	frameStartEnabled_ = enable;
 
 	return ret;
 }
 
+/**
+ * \brief Enable or disable handling of frame start events in a dedicated thread
+ * \param[in] enable True to handle frame start events in a dedicated thread
+ *
+ * By default, frame start events are handled in the thread of the V4L2Device,
+ * and the frameStart signal is thus emitted with a latency that depends on the
+ * load of that thread. When the dedicated thread is enabled, the events are
+ * handled in a "FrameStart" thread with a real-time scheduling policy, and the
+ * frameStart signal is emitted from that thread. Receivers that are not bound
+ * to a thread, such as DelayedControls, are then called in the dedicated
+ * thread and shall be thread-safe. The scheduling of the thread can be
+ * overridden with the LIBCAMERA_THREAD_SCHEDULING environment variable.
+ *
+ * This function shall be called while frame start events are disabled.
+ *
+ * \return 0 on success, a negative error code otherwise
+ * \retval -EBUSY Frame start events are enabled
+ */
+int V4L2Device::setFrameStartThreadEnabled(bool enable)
+{
+	if (frameStartEnabled_)
+		return -EBUSY;
+
+	if (enable == !!frameStartThread_)
+		return 0;
+
+	if (enable) {
+		frameStartThread_ = std::make_unique<Thread>("FrameStart");
+		frameStartThread_->setScheduling(Thread::SchedulingPolicy::Fifo, 10);
+		frameStartThread_->start();
+
+		fdEventNotifier_->moveToThread(frameStartThread_.get());
+	} else {
+		fdEventNotifier_->invokeMethod(&EventNotifier::moveToThread,
+					       ConnectionTypeBlocking,
+					       Thread::current());
+
+		frameStartThread_->exit();
+		frameStartThread_->wait();
+		frameStartThread_.reset();
+	}
+
+	return 0;
+}
+
 /**
  * \var V4L2Device::frameStart
  * \brief A Signal emitted when capture of a frame has started
@@ -763,7 +828,31 @@ void V4L2Device::eventAvailable()
 		return;
 	}
 
+	/*
+	 * Record how late the event is dispatched, and how long the frame start
+	 * handlers take to complete, relative to the event timestamp. Events
+	 * are timestamped with CLOCK_MONOTONIC.
+	 */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	int64_t eventTime = event.timestamp.tv_sec * 1000000000LL
+			  + event.timestamp.tv_nsec;
+	int64_t dispatchTime = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+	LIBCAMERA_TRACEPOINT(v4l2_frame_start, deviceNode_.c_str(),
+			     event.u.frame_sync.frame_sequence);
+
 	frameStart.emit(event.u.frame_sync.frame_sequence);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t completionTime = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+	LOG(FrameStart, Debug)
+		<< "Frame " << event.u.frame_sync.frame_sequence
+		<< " started at " << eventTime << " ns, dispatched after "
+		<< (dispatchTime - eventTime) / 1000 << " us, handled after "
+		<< (completionTime - eventTime) / 1000 << " us";
 }
 
 static const std::map<uint32_t, ColorSpace> v4l2ToColorSpace = {
@@ -904,6 +993,18 @@ template std::optional<ColorSpace> V4L2Device::toColorSpace(const struct v4l2_pi
 template std::optional<ColorSpace> V4L2Device::toColorSpace(const struct v4l2_mbus_framefmt &,
 							    PixelFormatInfo::ColourEncoding);
 
+/*
+ * The LOG() macro can't be used in the static member functions of a Loggable
+ * class, as it would call the non-static Loggable::_log() function.
+ */
+static void logUnrecognisedColorSpace(const char *field,
+				      const std::optional<ColorSpace> &colorSpace)
+{
+	LOG(V4L2, Warning)
+		<< "Unrecognised " << field << " in "
+		<< ColorSpace::toString(colorSpace);
+}
+
 /**
  * \brief Fill in the color space fields of a V4L2 format from a ColorSpace
  * \param[in] colorSpace The ColorSpace to be converted
@@ -954,9 +1055,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itPrimaries != primariesToV4l2.end()) {
 		v4l2Format.colorspace = itPrimaries->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
-			<< "Unrecognised primaries in "
-			<< ColorSpace::toString(colorSpace);
+		logUnrecognisedColorSpace("primaries", colorSpace);
 		ret = -EINVAL;
 	}
 
@@ -964,9 +1063,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itTransfer != transferFunctionToV4l2.end()) {
 		v4l2Format.xfer_func = itTransfer->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
-			<< "Unrecognised transfer function in "
-			<< ColorSpace::toString(colorSpace);
+		logUnrecognisedColorSpace("transfer function", colorSpace);
 		ret = -EINVAL;
 	}
 
@@ -974,9 +1071,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itYcbcrEncoding != ycbcrEncodingToV4l2.end()) {
 		v4l2Format.ycbcr_enc = itYcbcrEncoding->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
-			<< "Unrecognised YCbCr encoding in "
-			<< ColorSpace::toString(colorSpace);
+		logUnrecognisedColorSpace("YCbCr encoding", colorSpace);
 		ret = -EINVAL;
 	}
 
@@ -984,9 +1079,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itRange != rangeToV4l2.end()) {
 		v4l2Format.quantization = itRange->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
-			<< "Unrecognised quantization in "
-			<< ColorSpace::toString(colorSpace);
+		logUnrecognisedColorSpace("quantization", colorSpace);
 		ret = -EINVAL;
 	}
 
@@ -1022,6 +1022,8 @@ int V4L2Subdevice::open()
 	if (ret)
 		return ret;
 
+	formatsCache_.clear();
+
 	/*
 	 * Try to query the subdev capabilities. The VIDIOC_SUBDEV_QUERYCAP API
 	 * was introduced in kernel v5.8, ENOTTY errors must be ignored to
@@ -1170,6 +1172,12 @@ int V4L2Subdevice::setSelection(const Stream &stream, unsigned int target,
  * Enumerate all media bus codes and frame sizes supported by the subdevice on
  * a \a stream.
  *
+ * The enumeration results are cached per stream, as they are queried
+ * repeatedly when generating and validating configurations. As the formats
+ * supported on a pad may depend on the formats of other pads and on the
+ * routing table, the cache is invalidated when the active format or routing
+ * table is set.
+ *
  * \return A list of the supported device formats
  */
 V4L2Subdevice::Formats V4L2Subdevice::formats(const Stream &stream)
@@ -1181,6 +1189,11 @@ V4L2Subdevice::Formats V4L2Subdevice::formats(const Stream &stream)
 		return {};
 	}
 
+	const auto key = std::make_pair(stream.pad, stream.stream);
+	auto cached = formatsCache_.find(key);
+	if (cached != formatsCache_.end())
+		return cached->second;
+
 	for (unsigned int code : enumPadCodes(stream)) {
 		std::vector<SizeRange> sizes = enumPadSizes(stream, code);
 		if (sizes.empty())
@@ -1195,6 +1208,10 @@ V4L2Subdevice::Formats V4L2Subdevice::formats(const Stream &stream)
 		}
 	}
 
+	/* Don't cache failures, they may be transient. */
+	if (!formats.empty())
+		formatsCache_[key] = formats;
+
 	return formats;
 }
 
@@ -1313,6 +1330,9 @@ int V4L2Subdevice::setFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 			subdevFmt.format.flags |= V4L2_MBUS_FRAMEFMT_SET_CSC;
 	}
 
+	if (whence == ActiveFormat)
+		formatsCache_.clear();
+
 	int ret = ioctl(VIDIOC_SUBDEV_S_FMT, &subdevFmt);
 	if (ret) {
 		LOG(V4L2, Error)
@@ -1527,6 +1547,9 @@ int V4L2Subdevice::setRouting(Routing *routing, Whence whence)
 		return 0;
 	}
 
+	if (whence == ActiveFormat)
+		formatsCache_.clear();
+
 	std::vector<struct v4l2_subdev_route> routes{ routing->size() };
 
 	for (const auto &[i, route] : utils::enumerate(*routing))
@@ -31,6 +31,8 @@
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/media_request.h"
+#include "libcamera/internal/tracepoints.h"
 
 /**
  * \file v4l2_videodevice.h
@@ -161,7 +163,35 @@ LOG_DECLARE_CATEGORY(V4L2)
  * The V4L2BufferCache class keeps a map of previous dmabufs to V4L2 buffer
  * index associations to help selecting V4L2 buffers. It tracks, for every
  * entry, if the V4L2 buffer is in use, and offers lookup of the best free V4L2
- * buffer for a set of dmabufs.
+ * buffer for a set of dmabufs. The entries are indexed by a hash of their
+ * dmabufs, cache hits are thus found in constant time.
+ *
+ * Entries can also be pinned to a FrameBuffer with pin(). A pinned entry is
+ * only used for its FrameBuffer, and the FrameBuffer always uses the pinned
+ * entry, regardless of the order in which buffers are queued.
+ *
+ * The cache counts hits, misses and evictions, available through
+ * statistics(). An eviction happens when a V4L2 buffer previously used with
+ * different dmabufs has to be selected, as a result of more FrameBuffer
+ * instances being used than there are V4L2 buffers. The kernel then has to
+ * unmap the old dmabufs and map the new ones.
+ */
+
+/**
+ * \struct V4L2BufferCache::Statistics
+ * \brief Usage statistics of a V4L2BufferCache
+ *
+ * \var V4L2BufferCache::Statistics::hits
+ * \brief Number of lookups that found a V4L2 buffer previously used with the
+ * same dmabufs
+ *
+ * \var V4L2BufferCache::Statistics::misses
+ * \brief Number of lookups that didn't find a V4L2 buffer previously used
+ * with the same dmabufs
+ *
+ * \var V4L2BufferCache::Statistics::evictions
+ * \brief Number of misses that replaced the dmabufs associated with a V4L2
+ * buffer
  */
 
 /**
@@ -173,7 +203,7 @@ LOG_DECLARE_CATEGORY(V4L2)
  * buffer import, with buffers added to the cache as they are queued.
  */
 V4L2BufferCache::V4L2BufferCache(unsigned int numEntries)
-	: lastUsedCounter_(1), missCounter_(0)
+	: lastUsedCounter_(1)
 {
 	cache_.resize(numEntries);
 }
@@ -187,18 +217,24 @@ V4L2BufferCache::V4L2BufferCache(unsigned int numEntries)
  * allocated.
  */
 V4L2BufferCache::V4L2BufferCache(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
-	: lastUsedCounter_(1), missCounter_(0)
+	: lastUsedCounter_(1)
 {
-	for (const std::unique_ptr<FrameBuffer> &buffer : buffers)
-		cache_.emplace_back(true,
-				    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
-				    *buffer.get());
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		const Entry &entry =
+			cache_.emplace_back(true,
+					    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
+					    *buffer.get());
+		index_[entry.key_] = cache_.size() - 1;
+	}
 }
 
 V4L2BufferCache::~V4L2BufferCache()
 {
-	if (missCounter_ > cache_.size())
-		LOG(V4L2, Debug) << "Cache misses: " << missCounter_;
+	if (stats_.misses > cache_.size())
+		LOG(V4L2, Debug)
+			<< "Cache hits: " << stats_.hits
+			<< ", misses: " << stats_.misses
+			<< ", evictions: " << stats_.evictions;
 }
 
 /**
@@ -221,46 +257,94 @@ bool V4L2BufferCache::isEmpty() const
  * Find the best V4L2 buffer index to be used for the FrameBuffer \a buffer
  * based on previous mappings of frame buffers to V4L2 buffers. If a free V4L2
  * buffer previously used with the same dmabufs as \a buffer is found in the
- * cache, return its index. Otherwise return the index of the first free V4L2
- * buffer and record its association with the dmabufs of \a buffer.
+ * cache, return its index. Otherwise return the index of the least recently
+ * used free V4L2 buffer that isn't pinned, and record its association with the
+ * dmabufs of \a buffer. If \a buffer has been pinned, the pinned V4L2 buffer
+ * is returned.
  *
- * \return The index of the best V4L2 buffer, or -ENOENT if no free V4L2 buffer
- * is available
+ * \return The index of the best V4L2 buffer, or a negative error code
+ * otherwise
+ * \retval -ENOENT No free V4L2 buffer is available
+ * \retval -EBUSY The V4L2 buffer pinned to \a buffer is in use
  */
 int V4L2BufferCache::get(const FrameBuffer &buffer)
 {
+	const uint64_t hash = key(buffer);
 	bool hit = false;
 	int use = -1;
-	uint64_t oldest = UINT64_MAX;
 
-	for (unsigned int index = 0; index < cache_.size(); index++) {
-		const Entry &entry = cache_[index];
+	/* Look up the V4L2 buffer last used with the same dmabufs. */
+	auto iter = index_.find(hash);
+	if (iter != index_.end()) {
+		const Entry &entry = cache_[iter->second];
 
-		if (!entry.free_)
-			continue;
-
-		/* Try to find a cache hit by comparing the planes. */
 		if (entry == buffer) {
-			hit = true;
-			use = index;
-			break;
+			if (entry.free_) {
+				hit = true;
+				use = iter->second;
+			} else if (entry.pinned_) {
+				return -EBUSY;
+			}
 		}
+	}
 
-		if (entry.lastUsed_ < oldest) {
-			use = index;
-			oldest = entry.lastUsed_;
+	/*
+	 * Otherwise, search for a free V4L2 buffer used with the same dmabufs
+	 * in case of hash collisions, and fall back to the least recently used
+	 * free V4L2 buffer.
+	 */
+	if (!hit) {
+		uint64_t oldest = UINT64_MAX;
+
+		for (unsigned int index = 0; index < cache_.size(); index++) {
+			const Entry &entry = cache_[index];
+
+			if (entry.pinned_) {
+				if (!(entry == buffer))
+					continue;
+
+				if (!entry.free_)
+					return -EBUSY;
+
+				hit = true;
+				use = index;
+				break;
+			}
+
+			if (!entry.free_)
+				continue;
+
+			if (entry == buffer) {
+				hit = true;
+				use = index;
+				break;
+			}
+
+			if (entry.lastUsed_ < oldest) {
+				use = index;
+				oldest = entry.lastUsed_;
+			}
 		}
 	}
 
-	if (!hit)
-		missCounter_++;
+	if (hit)
+		stats_.hits++;
+	else
+		stats_.misses++;
 
 	if (use < 0)
 		return -ENOENT;
 
-	cache_[use] = Entry(false,
-			    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
-			    buffer);
+	if (hit) {
+		Entry &entry = cache_[use];
+
+		entry.free_ = false;
+		entry.lastUsed_ = lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel);
+		index_[hash] = use;
+		return use;
+	}
+
+	assign(use, buffer, false);
 
 	return use;
 }
@@ -275,13 +359,125 @@ void V4L2BufferCache::put(unsigned int index)
 	cache_[index].free_ = true;
 }
 
+/**
+ * \brief Pin a V4L2 buffer to a FrameBuffer
+ * \param[in] buffer The FrameBuffer
+ *
+ * Reserve a V4L2 buffer for the dmabufs of \a buffer until the cache is
+ * destroyed. The V4L2 buffer previously used with the same dmabufs is picked
+ * if available, otherwise the least recently used free V4L2 buffer that isn't
+ * pinned. Pinning a buffer that is already pinned returns the same V4L2
+ * buffer.
+ *
+ * \return The index of the pinned V4L2 buffer, or -ENOSPC if all V4L2 buffers
+ * are pinned or in use
+ */
+int V4L2BufferCache::pin(const FrameBuffer &buffer)
+{
+	int match = -1;
+	int use = -1;
+	uint64_t oldest = UINT64_MAX;
+
+	for (unsigned int index = 0; index < cache_.size(); index++) {
+		const Entry &entry = cache_[index];
+
+		if (entry == buffer) {
+			if (entry.pinned_)
+				return index;
+
+			if (match < 0)
+				match = index;
+			continue;
+		}
+
+		if (!entry.pinned_ && entry.free_ && entry.lastUsed_ < oldest) {
+			use = index;
+			oldest = entry.lastUsed_;
+		}
+	}
+
+	if (match >= 0) {
+		use = match;
+	} else {
+		if (use < 0)
+			return -ENOSPC;
+
+		assign(use, buffer, true);
+	}
+
+	/*
+	 * Drop the other free entries associated with the same dmabufs, the
+	 * pinned entry must be the only match for the buffer.
+	 */
+	for (unsigned int index = 0; index < cache_.size(); index++) {
+		Entry &entry = cache_[index];
+
+		if (index != static_cast<unsigned int>(use) && entry.free_ &&
+		    entry == buffer)
+			entry = Entry();
+	}
+
+	cache_[use].pinned_ = true;
+	index_[cache_[use].key_] = use;
+
+	return use;
+}
+
+/**
+ * \fn V4L2BufferCache::statistics()
+ * \brief Retrieve the cache usage statistics
+ *
+ * The statistics help sizing the number of V4L2 buffers, as evictions occur
+ * when more FrameBuffer instances are cycled through than the cache has
+ * entries.
+ *
+ * \return The cache usage statistics
+ */
+
+uint64_t V4L2BufferCache::key(const FrameBuffer &buffer)
+{
+	/* FNV-1a hash of the plane dmabuf file descriptors and lengths. */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	auto mix = [&hash](uint64_t value) {
+		hash ^= value;
+		hash *= 0x100000001b3ULL;
+	};
+
+	for (const FrameBuffer::Plane &plane : buffer.planes()) {
+		mix(static_cast<uint32_t>(plane.fd.get()));
+		mix(plane.length);
+	}
+
+	return hash;
+}
+
+void V4L2BufferCache::assign(unsigned int index, const FrameBuffer &buffer,
+			     bool free)
+{
+	Entry &entry = cache_[index];
+
+	if (!entry.empty()) {
+		stats_.evictions++;
+
+		auto old = index_.find(entry.key_);
+		if (old != index_.end() && old->second == index)
+			index_.erase(old);
+	}
+
+	entry = Entry(free, lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
+		      buffer);
+	index_[entry.key_] = index;
+}
+
 V4L2BufferCache::Entry::Entry()
-	: free_(true), lastUsed_(0)
+	: free_(true), pinned_(false), lastUsed_(0), key_(0)
 {
 }
 
 V4L2BufferCache::Entry::Entry(bool free, uint64_t lastUsed, const FrameBuffer &buffer)
-	: free_(free), lastUsed_(lastUsed)
+	: free_(free), pinned_(false), lastUsed_(lastUsed),
+	  key_(V4L2BufferCache::key(buffer))
 {
 	for (const FrameBuffer::Plane &plane : buffer.planes())
 		planes_.emplace_back(plane);
@@ -534,8 +730,9 @@ std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f)
  */
 V4L2VideoDevice::V4L2VideoDevice(const std::string &deviceNode)
 	: V4L2Device(deviceNode), formatInfo_(nullptr), cache_(nullptr),
-	  fdBufferNotifier_(nullptr), state_(State::Stopped),
-	  watchdogDuration_(0.0)
+	  fdBufferNotifier_(nullptr), nonBlocking_(false),
+	  state_(State::Stopped),
+	  watchdogDuration_(0.0), dequeueTimeouts_(0)
 {
 	/*
 	 * We default to an MMAP based CAPTURE video device, however this will
@@ -575,6 +772,8 @@ int V4L2VideoDevice::open()
 	if (ret < 0)
 		return ret;
 
+	nonBlocking_ = true;
+
 	ret = ioctl(VIDIOC_QUERYCAP, &caps_);
 	if (ret < 0) {
 		LOG(V4L2, Error)
@@ -676,6 +875,13 @@ int V4L2VideoDevice::open(SharedFD handle, enum v4l2_buf_type type)
 		return ret;
 	}
 
+	/*
+	 * Buffers can only be drained in a loop if dequeuing doesn't block,
+	 * which depends on how the caller opened the handle.
+	 */
+	ret = fcntl(fd(), F_GETFL);
+	nonBlocking_ = ret >= 0 && (ret & O_NONBLOCK);
+
 	ret = ioctl(VIDIOC_QUERYCAP, &caps_);
 	if (ret < 0) {
 		LOG(V4L2, Error)
@@ -762,6 +968,7 @@ void V4L2VideoDevice::close()
 	delete fdBufferNotifier_;
 
 	formatInfo_ = nullptr;
+	formatsCache_.clear();
 
 	V4L2Device::close();
 }
@@ -856,6 +1063,7 @@ int V4L2VideoDevice::setFormat(V4L2DeviceFormat *format)
 
 	format_ = *format;
 	formatInfo_ = &PixelFormatInfo::info(format_.fourcc);
+	formatsCache_.clear();
 
 	return 0;
 }
@@ -1073,12 +1281,20 @@ int V4L2VideoDevice::trySetFormatSingleplane(V4L2DeviceFormat *format, bool set)
  * If the \a code argument is not zero, only formats compatible with that media
  * bus code will be enumerated.
  *
+ * The enumeration results are cached per media bus code and invalidated when
+ * the format is set. Memory-to-memory devices are not cached, as the formats
+ * supported on one queue depend on the format set on the other queue.
+ *
  * \return A list of the supported video device formats
  */
 V4L2VideoDevice::Formats V4L2VideoDevice::formats(uint32_t code)
 {
 	Formats formats;
 
+	auto cached = formatsCache_.find(code);
+	if (cached != formatsCache_.end())
+		return cached->second;
+
 	for (V4L2PixelFormat pixelFormat : enumPixelformats(code)) {
 		std::vector<SizeRange> sizes = enumSizes(pixelFormat);
 		if (sizes.empty())
@@ -1094,6 +1310,10 @@ V4L2VideoDevice::Formats V4L2VideoDevice::formats(uint32_t code)
 		formats.emplace(pixelFormat, sizes);
 	}
 
+	/* Don't cache failures, they may be transient. */
+	if (!caps_.isM2M() && !formats.empty())
+		formatsCache_[code] = formats;
+
 	return formats;
 }
 
@@ -1227,7 +1447,8 @@ int V4L2VideoDevice::setSelection(unsigned int target, Rectangle *rect)
 }
 
 int V4L2VideoDevice::requestBuffers(unsigned int count,
-				    enum v4l2_memory memoryType)
+				    enum v4l2_memory memoryType,
+				    BufferFlags flags)
 {
 	struct v4l2_requestbuffers rb = {};
 	int ret;
@@ -1235,6 +1456,8 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
 	rb.count = count;
 	rb.type = bufferType_;
 	rb.memory = memoryType;
+	if (flags & BufferFlag::NonCoherent)
+		rb.flags = V4L2_MEMORY_FLAG_NON_COHERENT;
 
 	ret = ioctl(VIDIOC_REQBUFS, &rb);
 	if (ret < 0) {
@@ -1251,15 +1474,42 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
 		return -ENOMEM;
 	}
 
+	/* The flag is cleared by drivers that don't support cache hints. */
+	if (count && (flags & BufferFlag::NonCoherent) &&
+	    !(rb.flags & V4L2_MEMORY_FLAG_NON_COHERENT))
+		LOG(V4L2, Debug) << "Non-coherent buffers not supported";
+
 	LOG(V4L2, Debug) << rb.count << " buffers requested.";
 
 	return 0;
 }
 
+/**
+ * \enum V4L2VideoDevice::BufferFlag
+ * \brief Flags for the allocation of buffers by the video device
+ * \var V4L2VideoDevice::BufferFlag::NonCoherent
+ * \brief Allocate non-coherent memory, cacheable by the CPU
+ *
+ * Non-coherent buffers are cached by the CPU, which speeds up CPU accesses
+ * considerably on platforms where the coherent memory is uncached. The CPU
+ * caches are maintained by the kernel when queuing and dequeuing the buffers,
+ * and when bracketing CPU accesses with DMA_BUF_IOCTL_SYNC, as done by
+ * MappedFrameBuffer::beginAccess() and MappedFrameBuffer::endAccess(). The
+ * flag shall thus only be used when all the CPU consumers of the buffers
+ * synchronize their accesses. It is ignored by drivers that don't support
+ * memory cache hints.
+ */
+
+/**
+ * \typedef V4L2VideoDevice::BufferFlags
+ * \brief A bitwise combination of V4L2VideoDevice::BufferFlag values
+ */
+
 /**
  * \brief Allocate and export buffers from the video device
  * \param[in] count Number of buffers to allocate
  * \param[out] buffers Vector to store allocated buffers
+ * \param[in] flags Flags for the allocation of the buffers
  *
  * This function wraps buffer allocation with the V4L2 MMAP memory type. It
  * requests \a count buffers from the driver, allocating the corresponding
@@ -1285,9 +1535,10 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
  * \retval -EBUSY buffers have already been allocated or imported
  */
 int V4L2VideoDevice::allocateBuffers(unsigned int count,
-				     std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+				     std::vector<std::unique_ptr<FrameBuffer>> *buffers,
+				     BufferFlags flags)
 {
-	int ret = createBuffers(count, buffers);
+	int ret = createBuffers(count, buffers, flags);
 	if (ret < 0)
 		return ret;
 
@@ -1301,6 +1552,7 @@ int V4L2VideoDevice::allocateBuffers(unsigned int count,
  * \brief Export buffers from the video device
  * \param[in] count Number of buffers to allocate
  * \param[out] buffers Vector to store allocated buffers
+ * \param[in] flags Flags for the allocation of the buffers
  *
  * This function allocates \a count buffer from the video device and exports
  * them as dmabuf objects, stored in \a buffers. Unlike allocateBuffers(), this
@@ -1334,9 +1586,10 @@ int V4L2VideoDevice::allocateBuffers(unsigned int count,
  * \retval -EBUSY buffers have already been allocated or imported
  */
 int V4L2VideoDevice::exportBuffers(unsigned int count,
-				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+				   std::vector<std::unique_ptr<FrameBuffer>> *buffers,
+				   BufferFlags flags)
 {
-	int ret = createBuffers(count, buffers);
+	int ret = createBuffers(count, buffers, flags);
 	if (ret < 0)
 		return ret;
 
@@ -1346,14 +1599,15 @@ int V4L2VideoDevice::exportBuffers(unsigned int count,
 }
 
 int V4L2VideoDevice::createBuffers(unsigned int count,
-				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+				   std::vector<std::unique_ptr<FrameBuffer>> *buffers,
+				   BufferFlags flags)
 {
 	if (cache_) {
 		LOG(V4L2, Error) << "Buffers already allocated";
 		return -EINVAL;
 	}
 
-	int ret = requestBuffers(count, V4L2_MEMORY_MMAP);
+	int ret = requestBuffers(count, V4L2_MEMORY_MMAP, flags);
 	if (ret < 0)
 		return ret;
 
@@ -1523,6 +1777,43 @@ int V4L2VideoDevice::importBuffers(unsigned int count)
 	return 0;
 }
 
+/**
+ * \brief Pin a V4L2 buffer to an imported buffer
+ * \param[in] buffer The buffer to pin
+ *
+ * When importing buffers, queueBuffer() picks a V4L2 buffer for each
+ * FrameBuffer based on the previous associations between the V4L2 buffers
+ * and dmabufs. If the FrameBuffer instances are queued in a different order
+ * than they are dequeued, or if more FrameBuffer instances than V4L2 buffers
+ * are used, this may require the kernel to unmap and remap dmabufs.
+ *
+ * This function binds \a buffer to a V4L2 buffer until releaseBuffers() is
+ * called. The V4L2 buffer is then always used to queue \a buffer, and never
+ * used for any other FrameBuffer. Pinning as many buffers as have been
+ * prepared with importBuffers() guarantees that queueing buffers never causes
+ * dmabufs to be remapped.
+ *
+ * This function shall only be called after importBuffers().
+ *
+ * \return The index of the pinned V4L2 buffer on success or a negative error
+ * code otherwise
+ * \retval -EINVAL Buffers haven't been prepared with importBuffers()
+ * \retval -ENOSPC All V4L2 buffers are pinned or in use
+ */
+int V4L2VideoDevice::pinBuffer(const FrameBuffer *buffer)
+{
+	if (!cache_ || memoryType_ != V4L2_MEMORY_DMABUF) {
+		LOG(V4L2, Error) << "Buffers not prepared for import";
+		return -EINVAL;
+	}
+
+	int ret = cache_->pin(*buffer);
+	if (ret < 0)
+		LOG(V4L2, Error) << "No V4L2 buffer available to pin";
+
+	return ret;
+}
+
 /**
  * \brief Release resources allocated by allocateBuffers() or importBuffers()
  *
@@ -1547,6 +1838,7 @@ int V4L2VideoDevice::releaseBuffers()
 /**
  * \brief Queue a buffer to the video device
  * \param[in] buffer The buffer to be queued
+ * \param[in] request An optional media request to add the buffer to
  *
  * For capture video devices the \a buffer will be filled with data by the
  * device. For output video devices the \a buffer shall contain valid data and
@@ -1556,12 +1848,15 @@ int V4L2VideoDevice::releaseBuffers()
  * The best available V4L2 buffer is picked for \a buffer using the V4L2 buffer
  * cache.
  *
+ * If a media \a request is specified, the buffer is added to the request and
+ * only processed by the device once the request is queued.
+ *
  * Note that queueBuffer() will fail if the device is in the process of being
  * stopped from a streaming state through streamOff().
  *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
+int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer, MediaRequest *request)
 {
 	struct v4l2_plane v4l2Planes[VIDEO_MAX_PLANES] = {};
 	struct v4l2_buffer buf = {};
@@ -1591,6 +1886,11 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 	buf.memory = memoryType_;
 	buf.field = V4L2_FIELD_NONE;
 
+	if (request) {
+		buf.flags |= V4L2_BUF_FLAG_REQUEST_FD;
+		buf.request_fd = request->fd();
+	}
+
 	bool multiPlanar = V4L2_TYPE_IS_MULTIPLANAR(buf.type);
 	const std::vector<FrameBuffer::Plane> &planes = buffer->planes();
 	const unsigned int numV4l2Planes = format_.planesCount;
@@ -1708,6 +2008,9 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 
 	queuedBuffers_[buf.index] = buffer;
 
+	LIBCAMERA_TRACEPOINT(v4l2_queue_buffer, deviceNode().c_str(), buffer,
+			     buf.index);
+
 	return 0;
 }
 
@@ -1722,19 +2025,32 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
  */
 void V4L2VideoDevice::bufferAvailable()
 {
-	FrameBuffer *buffer = dequeueBuffer();
-	if (!buffer)
-		return;
+	/*
+	 * Drain all the buffers that have completed since the last wakeup to
+	 * avoid going back to the event loop once per buffer. The loop stops
+	 * when no more buffer is ready, or when no buffer is queued anymore,
+	 * which also happens if a bufferReady handler stops streaming.
+	 */
+	do {
+		FrameBuffer *buffer = dequeueBuffer();
+		if (!buffer)
+			return;
 
-	/* Notify anyone listening to the device. */
-	bufferReady.emit(buffer);
+		LIBCAMERA_TRACEPOINT(v4l2_dequeue_buffer, deviceNode().c_str(),
+				     buffer);
+
+		/* Notify anyone listening to the device. */
+		bufferReady.emit(buffer);
+	} while (nonBlocking_ && !queuedBuffers_.empty());
 }
 
 /**
  * \brief Dequeue the next available buffer from the video device
  *
  * This function dequeues the next available buffer from the device. If no
- * buffer is available to be dequeued it will return nullptr immediately.
+ * buffer is available to be dequeued it will return nullptr immediately
+ * without logging an error, provided the device has been opened in
+ * non-blocking mode.
  *
  * \return A pointer to the dequeued buffer on success, or nullptr otherwise
  */
@@ -1755,8 +2071,11 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 	}
 
 	ret = ioctl(VIDIOC_DQBUF, &buf);
+	if (ret == -EAGAIN)
+		return nullptr;
+
 	if (ret < 0) {
-		LOG(V4L2, Error)
+		LOG_RATELIMITED(V4L2, Error)
 			<< "Failed to dequeue buffer: " << strerror(-ret);
 		return nullptr;
 	}
@@ -1777,7 +2096,7 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 	 */
 	auto it = queuedBuffers_.find(buf.index);
 	if (it == queuedBuffers_.end()) {
-		LOG(V4L2, Error)
+		LOG_RATELIMITED(V4L2, Error)
 			<< "Dequeued unexpected buffer index " << buf.index;
 
 		return nullptr;
@@ -1834,7 +2153,7 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 		 * bytes used than its length.
 		 */
 		if (numV4l2Planes != 1) {
-			LOG(V4L2, Error)
+			LOG_RATELIMITED(V4L2, Error)
 				<< "Invalid number of planes (" << numV4l2Planes
 				<< " != " << buffer->planes().size() << ")";
 
@@ -1855,7 +2174,7 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 
 		for (auto [i, plane] : utils::enumerate(buffer->planes())) {
 			if (!remaining) {
-				LOG(V4L2, Error)
+				LOG_RATELIMITED(V4L2, Error)
 					<< "Dequeued buffer (" << bytesused
 					<< " bytes) too small for plane lengths "
 					<< utils::join(buffer->planes(), "/",
@@ -2004,12 +2323,40 @@ void V4L2VideoDevice::setDequeueTimeout(utils::Duration timeout)
  */
 void V4L2VideoDevice::watchdogExpired()
 {
-	LOG(V4L2, Warning)
+	LOG_RATELIMITED(V4L2, Warning)
 		<< "Dequeue timer of " << watchdogDuration_ << " has expired!";
 
+	dequeueTimeouts_++;
+
 	dequeueTimeout.emit();
 }
 
+/**
+ * \struct V4L2VideoDevice::Statistics
+ * \brief Usage statistics of a V4L2VideoDevice
+ *
+ * \var V4L2VideoDevice::Statistics::cache
+ * \brief Statistics of the buffer cache for the current set of buffers
+ *
+ * \var V4L2VideoDevice::Statistics::dequeueTimeouts
+ * \brief Number of times the dequeue watchdog timer has expired
+ */
+
+/**
+ * \brief Retrieve the usage statistics of the video device
+ * \return The video device statistics
+ */
+V4L2VideoDevice::Statistics V4L2VideoDevice::statistics() const
+{
+	Statistics stats;
+
+	if (cache_)
+		stats.cache = cache_->statistics();
+	stats.dequeueTimeouts = dequeueTimeouts_;
+
+	return stats;
+}
+
 /**
  * \brief Create a new video device instance from \a entity in media device
  * \a media
@@ -7,10 +7,16 @@
 
 #include "libcamera/internal/yaml_parser.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <endian.h>
 #include <errno.h>
+#include <string.h>
 #include <functional>
 #include <limits>
+#include <list>
+#include <mutex>
+#include <sys/stat.h>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/log.h>
@@ -511,9 +517,20 @@ private:
 				  const std::function<int(EventPtr event)> &parseItem);
 	int parseNextYamlObject(YamlObject &yamlObject, EventPtr event);
 
+	bool isBinary() const;
+	uint32_t readBinary32(uint32_t offset) const;
+	int parseBinaryContent(YamlObject &yamlObject);
+	int parseBinaryObject(YamlObject &yamlObject, uint32_t offset,
+			      uint32_t limit);
+	int readBinaryString(std::string &value, uint32_t offset, uint32_t limit);
+
 	bool parserValid_;
 	yaml_parser_t parser_;
 	std::string tuning_data;
+
+	File *file_;
+	Span<uint8_t> map_;
+	size_t binaryNodesBudget_;
 };
 
 /**
@@ -524,7 +541,7 @@ private:
  * helper functions to do event-based parsing for YAML files.
  */
 YamlParserContext::YamlParserContext()
-	: parserValid_(false)
+	: parserValid_(false), file_(nullptr), binaryNodesBudget_(0)
 {
 }
 
@@ -538,6 +555,9 @@ YamlParserContext::~YamlParserContext()
 		yaml_parser_delete(&parser_);
 		parserValid_ = false;
 	}
+
+	if (!map_.empty())
+		file_->unmap(map_.data());
 }
 
 /**
@@ -549,6 +569,9 @@ YamlParserContext::~YamlParserContext()
  * with a file to create an internal parser. The file needs to stay valid until
  * parsing completes.
  *
+ * The file contents are memory-mapped when possible, and unmapped when the
+ * YamlParserContext is destroyed.
+ *
  * \return 0 on success or a negative error code otherwise
  * \retval -EINVAL The parser has failed to initialize
  */
@@ -560,7 +583,19 @@ int YamlParserContext::init(File &file)
 		return -EINVAL;
 	}
 	parserValid_ = true;
-	yaml_parser_set_input(&parser_, &YamlParserContext::yamlRead, &file);
+
+	/*
+	 * Map the whole file and parse it from memory, to avoid going through
+	 * the read callback for every small chunk of input. Fall back to
+	 * reading files that can't be mapped, such as pipes or empty files.
+	 */
+	map_ = file.map();
+	if (!map_.empty()) {
+		file_ = &file;
+		yaml_parser_set_input_string(&parser_, map_.data(), map_.size());
+	} else {
+		yaml_parser_set_input(&parser_, &YamlParserContext::yamlRead, &file);
+	}
 
 	return 0;
 }
@@ -626,6 +661,9 @@ YamlParserContext::EventPtr YamlParserContext::nextEvent()
  */
 int YamlParserContext::parseContent(YamlObject &yamlObject)
 {
+	if (isBinary())
+		return parseBinaryContent(yamlObject);
+
 	/* Check start of the YAML file. */
 	EventPtr event = nextEvent();
 	if (!event || event->type != YAML_STREAM_START_EVENT)
@@ -789,6 +827,206 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 	}
 }
 
+/*
+ * Compiled YAML files, generated by utils/tuning/compile_tuning.py, store the
+ * tree of nodes in a binary format that can be loaded without tokenizing the
+ * text. All fields are little-endian 32-bit integers, and all nodes are
+ * aligned to 4 bytes.
+ *
+ * The file starts with a header made of the magic number, the format version,
+ * the total file size and the offset of the root node. Each node starts with
+ * its type (0 for values, 1 for lists and 2 for dictionaries) and a count:
+ *
+ * - Values store the length of the scalar string in bytes, followed by the
+ *   string itself.
+ * - Lists store the number of elements, followed by the offset of each
+ *   element.
+ * - Dictionaries store the number of entries, followed by pairs of offsets to
+ *   the key, which must be a value node, and to the entry value.
+ *
+ * Nodes only reference nodes stored before them in the file, which guarantees
+ * that loading terminates even when the file is corrupted. Nodes referenced
+ * through YAML aliases are stored once but expanded in the YamlObject tree. The
+ * number of expanded nodes is limited to kBinaryMaxExpansion times the number
+ * of nodes the file can hold, to bound the memory consumed by files that
+ * reference the same nodes repeatedly.
+ */
+namespace {
+
+constexpr uint8_t kBinaryMagic[4] = { 'L', 'C', 'T', 'B' };
+constexpr uint32_t kBinaryVersion = 1;
+constexpr uint32_t kBinaryHeaderSize = 16;
+constexpr uint32_t kBinaryNodeSize = 8;
+constexpr size_t kBinaryMaxExpansion = 16;
+
+enum BinaryNodeType : uint32_t {
+	BinaryNodeValue = 0,
+	BinaryNodeList = 1,
+	BinaryNodeDictionary = 2,
+};
+
+} /* namespace */
+
+bool YamlParserContext::isBinary() const
+{
+	return map_.size() >= sizeof(kBinaryMagic) &&
+	       !memcmp(map_.data(), kBinaryMagic, sizeof(kBinaryMagic));
+}
+
+uint32_t YamlParserContext::readBinary32(uint32_t offset) const
+{
+	uint32_t value;
+	memcpy(&value, map_.data() + offset, sizeof(value));
+	return le32toh(value);
+}
+
+int YamlParserContext::parseBinaryContent(YamlObject &yamlObject)
+{
+	if (map_.size() < kBinaryHeaderSize) {
+		LOG(YamlParser, Error) << "Truncated compiled YAML file";
+		return -EINVAL;
+	}
+
+	uint32_t version = readBinary32(4);
+	if (version != kBinaryVersion) {
+		LOG(YamlParser, Error)
+			<< "Unsupported compiled YAML format version " << version;
+		return -EINVAL;
+	}
+
+	if (readBinary32(8) != map_.size()) {
+		LOG(YamlParser, Error) << "Invalid compiled YAML file size";
+		return -EINVAL;
+	}
+
+	binaryNodesBudget_ = map_.size() / kBinaryNodeSize * kBinaryMaxExpansion;
+
+	return parseBinaryObject(yamlObject, readBinary32(12), map_.size());
+}
+
+int YamlParserContext::readBinaryString(std::string &value, uint32_t offset,
+					uint32_t limit)
+{
+	if (offset < kBinaryHeaderSize || offset % 4 || offset >= limit ||
+	    limit - offset < kBinaryNodeSize ||
+	    readBinary32(offset) != BinaryNodeValue) {
+		LOG(YamlParser, Error)
+			<< "Invalid value node offset " << offset
+			<< " in compiled YAML file";
+		return -EINVAL;
+	}
+
+	uint32_t length = readBinary32(offset + 4);
+	if (length > map_.size() - offset - kBinaryNodeSize) {
+		LOG(YamlParser, Error)
+			<< "Invalid value length " << length
+			<< " in compiled YAML file";
+		return -EINVAL;
+	}
+
+	value.assign(reinterpret_cast<const char *>(map_.data() + offset + 8),
+		     length);
+	return 0;
+}
+
+int YamlParserContext::parseBinaryObject(YamlObject &yamlObject,
+					 uint32_t offset, uint32_t limit)
+{
+	if (offset < kBinaryHeaderSize || offset % 4 || offset >= limit ||
+	    limit - offset < kBinaryNodeSize) {
+		LOG(YamlParser, Error)
+			<< "Invalid node offset " << offset
+			<< " in compiled YAML file";
+		return -EINVAL;
+	}
+
+	if (!binaryNodesBudget_) {
+		LOG(YamlParser, Error)
+			<< "Too many nodes referenced in compiled YAML file";
+		return -EINVAL;
+	}
+
+	binaryNodesBudget_--;
+
+	uint32_t type = readBinary32(offset);
+	uint32_t count = readBinary32(offset + 4);
+	uint32_t available = map_.size() - offset - kBinaryNodeSize;
+	uint32_t entries = offset + kBinaryNodeSize;
+
+	switch (type) {
+	case BinaryNodeValue:
+		yamlObject.type_ = YamlObject::Type::Value;
+		return readBinaryString(yamlObject.value_, offset, limit);
+
+	case BinaryNodeList: {
+		if (count > available / 4) {
+			LOG(YamlParser, Error)
+				<< "Invalid list size " << count
+				<< " in compiled YAML file";
+			return -EINVAL;
+		}
+
+		yamlObject.type_ = YamlObject::Type::List;
+		auto &list = yamlObject.list_;
+		list.reserve(count);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			list.emplace_back(std::string{}, std::make_unique<YamlObject>());
+			int ret = parseBinaryObject(*list.back().value,
+						    readBinary32(entries + i * 4),
+						    offset);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	case BinaryNodeDictionary: {
+		if (count > available / 8) {
+			LOG(YamlParser, Error)
+				<< "Invalid dictionary size " << count
+				<< " in compiled YAML file";
+			return -EINVAL;
+		}
+
+		yamlObject.type_ = YamlObject::Type::Dictionary;
+		auto &list = yamlObject.list_;
+		list.reserve(count);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			std::string key;
+			int ret = readBinaryString(key, readBinary32(entries + i * 8),
+						   offset);
+			if (ret) {
+				LOG(YamlParser, Error)
+					<< "Invalid key in compiled YAML file";
+				return ret;
+			}
+
+			auto &elem = list.emplace_back(std::move(key),
+						       std::make_unique<YamlObject>());
+			ret = parseBinaryObject(*elem.value,
+						readBinary32(entries + i * 8 + 4),
+						offset);
+			if (ret)
+				return ret;
+		}
+
+		auto &dictionary = yamlObject.dictionary_;
+		for (const auto &elem : list)
+			dictionary.emplace(elem.key, elem.value.get());
+
+		return 0;
+	}
+
+	default:
+		LOG(YamlParser, Error)
+			<< "Invalid node type " << type << " in compiled YAML file";
+		return -EINVAL;
+	}
+}
+
 #endif /* __DOXYGEN__ */
 
 /**
@@ -839,6 +1077,13 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
  *
  * The parser preserves the order of items in the YAML file, for both lists and
  * dictionaries.
+ *
+ * In addition to YAML and JSON text, the parser loads files compiled to a
+ * binary representation of the YAML tree by the utils/tuning/compile_tuning.py
+ * script. The format is detected automatically from the file contents.
+ * Compiled files are loaded without tokenizing the text, which speeds up the
+ * initialization of IPA modules with large tuning files. The text files remain
+ * the source of truth, and compiled files are generated from them.
  */
 
 /**
@@ -887,5 +1132,81 @@ std::unique_ptr<YamlObject> YamlParser::parse(std::string json)
 	return root;
 }
 
+/**
+ * \brief Parse a YAML file as a YamlObject, reusing previous parse results
+ * \param[in] file The YAML file to parse
+ *
+ * This function behaves as parse(File &), but keeps the result in a cache
+ * shared by all users of the parser. Subsequent calls for the same file return
+ * the cached YamlObject without reading the file again, as long as the file
+ * hasn't been modified. Files are identified by their device and inode numbers,
+ * and considered modified when their size or modification time changes.
+ *
+ * The cache holds a small number of files. It is meant for the tuning and
+ * configuration files that are parsed every time a camera is opened.
+ *
+ * The returned YamlObject is shared and must not be modified.
+ *
+ * \return Pointer to result YamlObject on success or nullptr otherwise
+ */
+std::shared_ptr<const YamlObject> YamlParser::parseCached(File &file)
+{
+	struct CacheEntry {
+		dev_t dev;
+		ino_t ino;
+		off_t size;
+		struct timespec mtime;
+		std::shared_ptr<const YamlObject> root;
+	};
+
+	static constexpr unsigned int kMaxCacheEntries = 8;
+	static std::mutex mutex;
+	/* Sorted from the most to the least recently used file. */
+	static std::list<CacheEntry> cache;
+
+	/*
+	 * Identify the file through the open descriptor, as the path may now
+	 * point to a different file than the one being parsed.
+	 */
+	struct stat st;
+	if (fstat(file.fd(), &st) < 0)
+		return parse(file);
+
+	auto matches = [&st](const CacheEntry &entry) {
+		return entry.dev == st.st_dev && entry.ino == st.st_ino &&
+		       entry.size == st.st_size &&
+		       entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+		       entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+	};
+
+	{
+		std::scoped_lock lock(mutex);
+
+		auto it = std::find_if(cache.begin(), cache.end(), matches);
+		if (it != cache.end()) {
+			LOG(YamlParser, Debug)
+				<< "Using cached content of " << file.fileName();
+			cache.splice(cache.begin(), cache, it);
+			return it->root;
+		}
+	}
+
+	std::shared_ptr<const YamlObject> root = parse(file);
+	if (!root)
+		return nullptr;
+
+	std::scoped_lock lock(mutex);
+
+	/* Drop stale entries for the same file. */
+	cache.remove_if([&st](const CacheEntry &entry) {
+		return entry.dev == st.st_dev && entry.ino == st.st_ino;
+	});
+
+	cache.push_front({ st.st_dev, st.st_ino, st.st_size, st.st_mtim, root });
+	if (cache.size() > kMaxCacheEntries)
+		cache.pop_back();
+
+	return root;
+}
 
 } /* namespace libcamera */
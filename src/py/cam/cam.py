@@ -282,9 +282,9 @@ class CaptureState:
 
             crcs = []
             if ctx.opt_crc:
-                with libcamera.utils.MappedFrameBuffer(fb) as mfb:
-                    plane_crcs = [binascii.crc32(p) for p in mfb.planes]
-                    crcs.append(plane_crcs)
+                mfb = libcamera.utils.MappedFrameBuffer.get(fb)
+                plane_crcs = [binascii.crc32(p) for p in mfb.planes]
+                crcs.append(plane_crcs)
 
             meta = fb.metadata
 
@@ -296,11 +296,11 @@ class CaptureState:
                           crcs))
 
             if ctx.opt_save_frames:
-                with libcamera.utils.MappedFrameBuffer(fb) as mfb:
-                    filename = 'frame-{}-{}-{}.data'.format(ctx.id, stream_name, ctx.reqs_completed)
-                    with open(filename, 'wb') as f:
-                        for p in mfb.planes:
-                            f.write(p)
+                mfb = libcamera.utils.MappedFrameBuffer.get(fb)
+                filename = 'frame-{}-{}-{}.data'.format(ctx.id, stream_name, ctx.reqs_completed)
+                with open(filename, 'wb') as f:
+                    for p in mfb.planes:
+                        f.write(p)
 
         self.renderer.request_handler(ctx, req)
 
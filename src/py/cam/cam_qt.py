@@ -57,7 +57,7 @@ class QtRenderer:
         for ctx in self.contexts:
             for stream in ctx.streams:
                 for buf in ctx.allocator.buffers(stream):
-                    mfb = libcamera.utils.MappedFrameBuffer(buf).mmap()
+                    mfb = libcamera.utils.MappedFrameBuffer.get(buf)
                     buf_mmap_map[buf] = mfb
 
         self.buf_mmap_map = buf_mmap_map
@@ -73,6 +73,63 @@ def demosaic(data, r0, g0, g1, b0):
     return output
 
 
+def pisp_comp1_dequantize(q, qmode):
+    return np.select([qmode == 0, qmode == 1, qmode == 2],
+                     [np.where(q < 320, 16 * q, 32 * (q - 160)),
+                      64 * q,
+                      128 * q],
+                     np.minimum(0xffff, np.where(q < 94, 256 * q, 512 * (q - 47))))
+
+
+def pisp_comp1_sub_block(w):
+    # Decode the four samples stored in each 32-bit word
+    qmode = w & 3
+
+    field0 = (w >> 2) & 511
+    field1 = (w >> 11) & 127
+    field2 = (w >> 18) & 127
+    field3 = (w >> 25) & 127
+
+    split = (qmode == 2) & (field0 >= 384)
+    q1 = np.where(split, field0, np.where(field1 >= 64, field0, field0 + 64 - field1))
+    q2 = np.where(split, field1 + 384, np.where(field1 >= 64, field0 + field1 - 64, field0))
+    p1 = np.maximum(0, q1 - 64)
+    p2 = np.maximum(0, q2 - 64)
+    p1 = np.where(qmode == 2, np.minimum(384, p1), p1)
+    p2 = np.where(qmode == 2, np.minimum(384, p2), p2)
+    q0 = p1 + field2
+    q3 = p2 + field3
+
+    pack0 = (w >> 2) & 32767
+    pack1 = (w >> 17) & 32767
+    mode3 = qmode == 3
+    q0 = np.where(mode3, (pack0 & 15) + 16 * ((pack0 >> 8) // 11), q0)
+    q1 = np.where(mode3, (pack0 >> 4) % 176, q1)
+    q2 = np.where(mode3, (pack1 & 15) + 16 * ((pack1 >> 8) // 11), q2)
+    q3 = np.where(mode3, (pack1 >> 4) % 176, q3)
+
+    return np.stack([pisp_comp1_dequantize(q, qmode) for q in [q0, q1, q2, q3]], axis=-1)
+
+
+# Decompress the PiSP compressed RAW format to 16-bit samples. Each block of
+# 8 pixels is stored in two little-endian 32-bit words, the first one holding
+# the even pixels and the second one the odd pixels.
+def pisp_comp1_decompress(data, w, h):
+    stride = data.size // h
+    blocks = (w + 7) // 8
+
+    words = data.reshape((h, stride))[:, :blocks * 8].copy().view('<u4')
+    words = words.astype(np.int64).reshape((h, blocks, 2))
+
+    out = np.empty((h, blocks, 8), dtype=np.int64)
+    out[:, :, 0::2] = pisp_comp1_sub_block(words[:, :, 0])
+    out[:, :, 1::2] = pisp_comp1_sub_block(words[:, :, 1])
+
+    out = np.minimum(0xffff, out + 2048)
+
+    return out.reshape((h, blocks * 8))[:, :w].astype(np.uint16)
+
+
 def to_rgb(fmt, size, data):
     w = size.width
     h = size.height
@@ -112,12 +169,18 @@ def to_rgb(fmt, size, data):
         # drop alpha component
         rgb = np.delete(rgb, np.s_[0::4], axis=2)
 
-    elif str(fmt).startswith('S'):
+    elif str(fmt).startswith('S') or str(fmt).endswith('_PISP_COMP1'):
         fmt = str(fmt)
-        bayer_pattern = fmt[1:5]
-        bitspp = int(fmt[5:])
+        if fmt.endswith('_PISP_COMP1'):
+            bayer_pattern = fmt[0:4]
+            bitspp = 16
+        else:
+            bayer_pattern = fmt[1:5]
+            bitspp = int(fmt[5:])
 
-        if bitspp == 8:
+        if fmt.endswith('_PISP_COMP1'):
+            data = pisp_comp1_decompress(data, w, h)
+        elif bitspp == 8:
             data = data.reshape((h, w))
             data = data.astype(np.uint16)
         elif bitspp in [10, 12]:
@@ -153,6 +216,7 @@ def to_rgb(fmt, size, data):
 
 # A naive format conversion to 24-bit RGB
 def mfb_to_rgb(mfb: libcamera.utils.MappedFrameBuffer, cfg: libcam.StreamConfiguration):
-    data = np.array(mfb.planes[0], dtype=np.uint8)
+    # Wrap the mapping without copying, to_rgb() doesn't modify the data
+    data = np.frombuffer(mfb.planes[0], dtype=np.uint8)
     rgb = to_rgb(cfg.pixel_format, cfg.size, data)
     return rgb
@@ -7,6 +7,7 @@
 
 #include <errno.h>
 #include <memory>
+#include <poll.h>
 #include <sys/eventfd.h>
 #include <system_error>
 #include <unistd.h>
@@ -60,7 +61,11 @@ py::list PyCameraManager::cameras()
 	return l;
 }
 
-std::vector<py::object> PyCameraManager::getReadyRequests()
+/*
+ * Return at most maxRequests completed requests, or all of them if maxRequests
+ * is 0. The eventfd stays signalled when requests are left in the queue.
+ */
+std::vector<py::object> PyCameraManager::getReadyRequests(unsigned int maxRequests)
 {
 	int ret = readFd();
 
@@ -70,9 +75,12 @@ std::vector<py::object> PyCameraManager::getReadyRequests()
 	if (ret != 0)
 		throw std::system_error(-ret, std::generic_category());
 
+	std::vector<Request *> requests = getCompletedRequests(maxRequests);
+
 	std::vector<py::object> py_reqs;
+	py_reqs.reserve(requests.size());
 
-	for (Request *request : getCompletedRequests()) {
+	for (Request *request : requests) {
 		py::object o = py::cast(request);
 		/* Decrease the ref increased in Camera.queue_request() */
 		o.dec_ref();
@@ -82,6 +90,36 @@ std::vector<py::object> PyCameraManager::getReadyRequests()
 	return py_reqs;
 }
 
+/*
+ * Wait for completed requests for up to timeout milliseconds, or indefinitely
+ * if timeout is negative, and return them. The GIL is released while waiting,
+ * so other Python threads keep running.
+ */
+std::vector<py::object> PyCameraManager::waitReadyRequests(int timeout,
+							   unsigned int maxRequests)
+{
+	int ret;
+
+	{
+		py::gil_scoped_release release;
+
+		struct pollfd pfd = { eventFd_.get(), POLLIN, 0 };
+
+		do {
+			ret = poll(&pfd, 1, timeout);
+		} while (ret < 0 && errno == EINTR);
+	}
+
+	if (ret < 0)
+		throw std::system_error(errno, std::generic_category(),
+					"Failed to wait for requests");
+
+	if (ret == 0)
+		return std::vector<py::object>();
+
+	return getReadyRequests(maxRequests);
+}
+
 /* Note: Called from another thread */
 void PyCameraManager::handleRequestCompleted(Request *req)
 {
@@ -122,10 +160,22 @@ void PyCameraManager::pushRequest(Request *req)
 	completedRequests_.push_back(req);
 }
 
-std::vector<Request *> PyCameraManager::getCompletedRequests()
+std::vector<Request *> PyCameraManager::getCompletedRequests(unsigned int maxRequests)
 {
 	std::vector<Request *> v;
 	MutexLocker guard(completedRequestsMutex_);
-	swap(v, completedRequests_);
+
+	if (!maxRequests || maxRequests >= completedRequests_.size()) {
+		swap(v, completedRequests_);
+		return v;
+	}
+
+	auto end = completedRequests_.begin() + maxRequests;
+	v.assign(completedRequests_.begin(), end);
+	completedRequests_.erase(completedRequests_.begin(), end);
+
+	/* Keep the eventfd signalled for the remaining requests. */
+	writeFd();
+
 	return v;
 }
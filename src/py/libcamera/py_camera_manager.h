@@ -26,7 +26,9 @@ public:
 
 	int eventFd() const { return eventFd_.get(); }
 
-	std::vector<pybind11::object> getReadyRequests();
+	std::vector<pybind11::object> getReadyRequests(unsigned int maxRequests);
+	std::vector<pybind11::object> waitReadyRequests(int timeout,
+							unsigned int maxRequests);
 
 	void handleRequestCompleted(Request *req);
 
@@ -41,5 +43,5 @@ private:
 	void writeFd();
 	int readFd();
 	void pushRequest(Request *req);
-	std::vector<Request *> getCompletedRequests();
+	std::vector<Request *> getCompletedRequests(unsigned int maxRequests);
 };
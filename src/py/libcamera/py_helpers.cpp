@@ -5,6 +5,9 @@
 
 #include "py_helpers.h"
 
+#include <string>
+#include <unordered_map>
+
 #include <libcamera/libcamera.h>
 
 #include <pybind11/functional.h>
@@ -95,3 +98,82 @@ ControlValue pyToControlValue(const py::object &ob, ControlType type)
 		throw std::runtime_error("Control type not implemented");
 	}
 }
+
+/*
+ * Retrieve the Python object wrapping a ControlId. The objects are cached, as
+ * creating a new wrapper for every control of every request is costly. The
+ * cache is intentionally leaked, as the Python objects it contains can't be
+ * destroyed after the interpreter is finalized.
+ */
+py::object controlIdToPy(const ControlId *id)
+{
+	static auto *cache = new std::unordered_map<const ControlId *, py::object>();
+
+	auto it = cache->find(id);
+	if (it != cache->end())
+		return it->second;
+
+	py::object ob = py::cast(id, py::return_value_policy::reference);
+	cache->emplace(id, ob);
+	return ob;
+}
+
+PyControlListView::PyControlListView(const ControlList &list, const ControlIdMap &idmap)
+	: list_(&list), idmap_(list.idMap() ? list.idMap() : &idmap)
+{
+}
+
+bool PyControlListView::contains(const ControlId &id) const
+{
+	return list_->contains(id.id());
+}
+
+py::object PyControlListView::get(const ControlId &id) const
+{
+	if (!list_->contains(id.id()))
+		throw py::key_error(id.name());
+
+	return controlValueToPy(list_->get(id.id()));
+}
+
+py::object PyControlListView::get(const ControlId &id, const py::object &def) const
+{
+	if (!list_->contains(id.id()))
+		return def;
+
+	return controlValueToPy(list_->get(id.id()));
+}
+
+const ControlId *PyControlListView::controlId(unsigned int id) const
+{
+	auto it = idmap_->find(id);
+	if (it == idmap_->end())
+		throw std::runtime_error("Unknown control id " + std::to_string(id));
+
+	return it->second;
+}
+
+py::list PyControlListView::keys() const
+{
+	py::list l;
+	for (const auto &[key, cv] : *list_)
+		l.append(controlIdToPy(controlId(key)));
+	return l;
+}
+
+py::list PyControlListView::values() const
+{
+	py::list l;
+	for (const auto &[key, cv] : *list_)
+		l.append(controlValueToPy(cv));
+	return l;
+}
+
+py::list PyControlListView::items() const
+{
+	py::list l;
+	for (const auto &[key, cv] : *list_)
+		l.append(py::make_tuple(controlIdToPy(controlId(key)),
+					controlValueToPy(cv)));
+	return l;
+}
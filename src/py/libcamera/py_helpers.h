@@ -11,3 +11,34 @@
 
 pybind11::object controlValueToPy(const libcamera::ControlValue &cv);
 libcamera::ControlValue pyToControlValue(const pybind11::object &ob, libcamera::ControlType type);
+
+pybind11::object controlIdToPy(const libcamera::ControlId *id);
+
+/*
+ * A read-only mapping over a ControlList, keyed by ControlId. The values are
+ * converted to Python objects only when accessed, instead of converting the
+ * whole list upfront. The view refers to the list, which must outlive it.
+ */
+class PyControlListView
+{
+public:
+	PyControlListView(const libcamera::ControlList &list,
+			  const libcamera::ControlIdMap &idmap);
+
+	size_t size() const { return list_->size(); }
+	bool contains(const libcamera::ControlId &id) const;
+
+	pybind11::object get(const libcamera::ControlId &id) const;
+	pybind11::object get(const libcamera::ControlId &id,
+			     const pybind11::object &def) const;
+
+	pybind11::list keys() const;
+	pybind11::list values() const;
+	pybind11::list items() const;
+
+private:
+	const libcamera::ControlId *controlId(unsigned int id) const;
+
+	const libcamera::ControlList *list_;
+	const libcamera::ControlIdMap *idmap_;
+};
@@ -123,6 +123,7 @@ PYBIND11_MODULE(_libcamera, m)
 	auto pyStream = py::class_<Stream>(m, "Stream");
 	auto pyControlId = py::class_<ControlId>(m, "ControlId");
 	auto pyControlInfo = py::class_<ControlInfo>(m, "ControlInfo");
+	auto pyControlListView = py::class_<PyControlListView>(m, "ControlListView");
 	auto pyRequest = py::class_<Request>(m, "Request");
 	auto pyRequestStatus = py::enum_<Request::Status>(pyRequest, "Status");
 	auto pyRequestReuse = py::enum_<Request::ReuseFlag>(pyRequest, "Reuse");
@@ -154,7 +155,10 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_property_readonly("cameras", &PyCameraManager::cameras)
 
 		.def_property_readonly("event_fd", &PyCameraManager::eventFd)
-		.def("get_ready_requests", &PyCameraManager::getReadyRequests);
+		.def("get_ready_requests", &PyCameraManager::getReadyRequests,
+		     py::arg("max_requests") = 0)
+		.def("wait_ready_requests", &PyCameraManager::waitReadyRequests,
+		     py::arg("timeout") = -1, py::arg("max_requests") = 0);
 
 	pyCamera
 		.def_property_readonly("id", &Camera::id)
@@ -345,6 +349,7 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_readwrite("stride", &StreamConfiguration::stride)
 		.def_readwrite("frame_size", &StreamConfiguration::frameSize)
 		.def_readwrite("buffer_count", &StreamConfiguration::bufferCount)
+		.def_readwrite("frame_rate_divisor", &StreamConfiguration::frameRateDivisor)
 		.def_property_readonly("formats", &StreamConfiguration::formats,
 				       py::return_value_policy::reference_internal)
 		.def_readwrite("color_space", &StreamConfiguration::colorSpace);
@@ -436,6 +441,19 @@ PYBIND11_MODULE(_libcamera, m)
 				.format(self.toString());
 		});
 
+	pyControlListView
+		.def("__len__", &PyControlListView::size)
+		.def("__contains__", &PyControlListView::contains)
+		.def("__getitem__", py::overload_cast<const ControlId &>(&PyControlListView::get, py::const_))
+		.def("__iter__", [](const PyControlListView &self) {
+			return py::iter(self.keys());
+		})
+		.def("get", py::overload_cast<const ControlId &, const py::object &>(&PyControlListView::get, py::const_),
+		     py::arg("id"), py::arg("default") = py::none())
+		.def("keys", &PyControlListView::keys)
+		.def("values", &PyControlListView::values)
+		.def("items", &PyControlListView::items);
+
 	pyRequest
 		/* \todo Fence is not supported, so we cannot expose addBuffer() directly */
 		.def("add_buffer", [](Request &self, const Stream *stream, FrameBuffer *buffer) {
@@ -452,19 +470,28 @@ PYBIND11_MODULE(_libcamera, m)
 		.def("set_control", [](Request &self, const ControlId &id, py::object value) {
 			self.controls().set(id.id(), pyToControlValue(value, id.type()));
 		})
-		.def_property_readonly("metadata", [](Request &self) {
-			/* Convert ControlList to std container */
-
-			std::unordered_map<const ControlId *, py::object> ret;
+		.def("set_controls", [](Request &self, const py::dict &controls) {
+			/*
+			 * Set all the controls in a single call, avoiding the
+			 * overhead of one Python to C++ transition per control.
+			 */
+			ControlList &list = self.controls();
 
-			for (const auto &[key, cv] : self.metadata()) {
-				const ControlId *id = controls::controls.at(key);
-				py::object ob = controlValueToPy(cv);
-				ret[id] = ob;
+			for (const auto &[key, value] : controls) {
+				const ControlId &id = key.cast<const ControlId &>();
+				list.set(id.id(), pyToControlValue(py::reinterpret_borrow<py::object>(value),
+								   id.type()));
 			}
-
-			return ret;
 		})
+		/*
+		 * The metadata is exposed as a view converting values when they
+		 * are accessed, which keeps the request alive. The keep_alive
+		 * attribute must be given to the cpp_function, property extras
+		 * are not applied when calling the getter.
+		 */
+		.def_property_readonly("metadata", py::cpp_function([](Request &self) {
+			return PyControlListView(self.metadata(), controls::controls);
+		}, py::keep_alive<0, 1>()))
 		/*
 		 * \todo As we add a keep_alive to the fb in addBuffers(), we
 		 * can only allow reuse with ReuseBuffers.
@@ -2,16 +2,42 @@
 # Copyright (C) 2022, Tomi Valkeinen <tomi.valkeinen@ideasonboard.com>
 
 import libcamera
+import weakref
 from typing import Tuple
 
 class MappedFrameBuffer:
     """
     Provides memoryviews for the FrameBuffer's planes
     """
+
+    # Persistent mappings, released with the FrameBuffer they map
+    __persistent = weakref.WeakKeyDictionary()
+
     def __init__(self, fb: libcamera.FrameBuffer):
         self.__fb = fb
         self.__planes = ()
         self.__maps = ()
+        self.__is_persistent = False
+
+    @classmethod
+    def get(cls, fb: libcamera.FrameBuffer) -> 'MappedFrameBuffer':
+        """
+        Return a persistent mapping of the FrameBuffer, created on first use
+
+        Mapping a buffer is costly, and the buffers are reused by the camera
+        for every frame. The persistent mapping is kept until the FrameBuffer
+        is destroyed, and can't be unmapped explicitly. Views of its planes
+        are zero-copy and remain valid as long as they are referenced.
+        """
+        mfb = cls.__persistent.get(fb)
+        if mfb is None:
+            mfb = cls(fb).mmap()
+            mfb.__is_persistent = True
+            # Don't keep the key of the weak dictionary alive
+            mfb.__fb = weakref.proxy(fb)
+            cls.__persistent[fb] = mfb
+
+        return mfb
 
     def __enter__(self):
         return self.mmap()
@@ -83,6 +109,9 @@ class MappedFrameBuffer:
         if not self.__planes:
             raise RuntimeError('MappedFrameBuffer not mmapped')
 
+        if self.__is_persistent:
+            raise RuntimeError('Persistent MappedFrameBuffer can\'t be unmapped')
+
         for p in self.__planes:
             p.release()
 
@@ -100,6 +129,22 @@ class MappedFrameBuffer:
 
         return self.__planes
 
+    def plane_view(self, index: int, stride: int) -> memoryview:
+        """
+        Return a zero-copy two-dimensional view of a plane
+
+        The view has one row per line of the plane, each row being stride
+        bytes long. It supports the buffer protocol, numpy.asarray() wraps it
+        in an ndarray with the matching strides without copying the data.
+        Lines are cropped to the active pixels by slicing the view or array.
+        """
+        plane = self.planes[index]
+        rows = len(plane) // stride
+        if not rows:
+            raise ValueError(f'stride {stride} larger than plane {index}')
+
+        return plane[:rows * stride].cast('B', (rows, stride))
+
     @property
     def fb(self):
         return self.__fb
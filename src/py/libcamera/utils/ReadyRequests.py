@@ -0,0 +1,36 @@
+# SPDX-License-Identifier: LGPL-2.1-or-later
+# Copyright (C) 2024, Google Inc.
+
+import asyncio
+import libcamera
+
+
+async def wait_ready_requests(cm: libcamera.CameraManager, max_requests: int = 0) -> list:
+    """
+    Wait for completed requests from an asyncio event loop
+
+    The CameraManager event fd is watched by the running event loop, no thread
+    is blocked and no polling is involved. Returns at most max_requests
+    requests, or all the completed requests if max_requests is 0. Requests
+    left in the queue are returned by the next call without waiting.
+    """
+    reqs = cm.get_ready_requests(max_requests)
+    if reqs:
+        return reqs
+
+    loop = asyncio.get_running_loop()
+    event = asyncio.Event()
+    fd = cm.event_fd
+
+    loop.add_reader(fd, event.set)
+
+    try:
+        while True:
+            await event.wait()
+            event.clear()
+
+            reqs = cm.get_ready_requests(max_requests)
+            if reqs:
+                return reqs
+    finally:
+        loop.remove_reader(fd)
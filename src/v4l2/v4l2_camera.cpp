@@ -7,10 +7,16 @@
 
 #include "v4l2_camera.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+#include "libcamera/internal/formats.h"
 
 using namespace libcamera;
 
@@ -18,7 +24,8 @@ LOG_DECLARE_CATEGORY(V4L2Compat)
 
 V4L2Camera::V4L2Camera(std::shared_ptr<Camera> camera)
 	: camera_(camera), isRunning_(false), bufferAllocator_(nullptr),
-	  efd_(-1), bufferAvailableCount_(0)
+	  bufferCount_(0), minBufferCount_(0), completedHead_(0),
+	  completedTail_(0), efd_(-1), bufferWaiters_(0)
 {
 	camera_->requestCompleted.connect(this, &V4L2Camera::requestComplete);
 }
@@ -43,13 +50,25 @@ int V4L2Camera::open(StreamConfiguration *streamConfig)
 
 	bufferAllocator_ = new FrameBufferAllocator(camera_);
 
+	/* The default number of buffers is the one the pipeline needs. */
+	minBufferCount_ = config_->at(0).bufferCount;
+
 	*streamConfig = config_->at(0);
 	return 0;
 }
 
 void V4L2Camera::close()
 {
+	{
+		MutexLocker locker(requestMutex_);
+		idleRequests_.clear();
+		queuedBuffers_.clear();
+		freeSpares_.clear();
+	}
+
 	requestPool_.clear();
+	importedBuffers_.clear();
+	mappedBuffers_.clear();
 
 	delete bufferAllocator_;
 	bufferAllocator_ = nullptr;
@@ -67,42 +86,167 @@ void V4L2Camera::unbind()
 	efd_ = -1;
 }
 
-std::vector<V4L2Camera::Buffer> V4L2Camera::completedBuffers()
+void V4L2Camera::requestComplete(Request *request)
 {
-	std::vector<Buffer> v;
+	if (request->status() == Request::RequestCancelled)
+		return;
+
+	unsigned int index;
+	{
+		MutexLocker locker(requestMutex_);
+		index = requestBuffers_[request->cookie()];
+	}
 
-	MutexLocker lock(bufferLock_);
-	for (std::unique_ptr<Buffer> &metadata : completedBuffers_)
-		v.push_back(*metadata.get());
-	completedBuffers_.clear();
+	const FrameMetadata &fmd = buffer(index)->metadata();
+	metadata_[index] = fmd;
+
+	/* Share the frame before its buffer can be queued again. */
+	if (fmd.status == FrameMetadata::FrameSuccess)
+		frameCompleted.emit(index);
+
+	int completed = -1;
+	if (index < bufferCount_) {
+		completed = index;
+	} else if (fmd.status == FrameMetadata::FrameSuccess) {
+		completed = takeQueuedBuffer();
+		if (completed >= 0) {
+			metadata_[completed] = fmd;
+			if (copyFrame(index, completed) < 0)
+				metadata_[completed].status = FrameMetadata::FrameError;
+		}
+	}
 
-	return v;
+	request->reuse();
+
+	{
+		MutexLocker locker(requestMutex_);
+
+		if (index >= bufferCount_)
+			freeSpares_.push_back(index);
+
+		idleRequests_.push_back(request);
+		queueRequests();
+	}
+
+	if (completed >= 0)
+		completeBuffer(completed);
 }
 
-void V4L2Camera::requestComplete(Request *request)
+/*
+ * Take the first application buffer waiting for a request, to copy a frame
+ * captured in a spare buffer to it. This only happens when all requests are
+ * queued to the camera.
+ */
+int V4L2Camera::takeQueuedBuffer()
 {
-	if (request->status() == Request::RequestCancelled)
-		return;
+	MutexLocker locker(requestMutex_);
 
-	/* We only have one stream at the moment. */
-	bufferLock_.lock();
-	FrameBuffer *buffer = request->buffers().begin()->second;
-	std::unique_ptr<Buffer> metadata =
-		std::make_unique<Buffer>(request->cookie(), buffer->metadata());
-	completedBuffers_.push_back(std::move(metadata));
-	bufferLock_.unlock();
+	if (queuedBuffers_.empty())
+		return -1;
+
+	unsigned int index = queuedBuffers_.front();
+	queuedBuffers_.pop_front();
+
+	return index;
+}
+
+void V4L2Camera::completeBuffer(unsigned int index)
+{
+	/*
+	 * The buffer metadata is retrieved with bufferMetadata() when the
+	 * buffer is dequeued, only its index needs to be recorded.
+	 */
+	unsigned int tail = completedTail_.load(std::memory_order_relaxed);
+	completedBuffers_[tail % completedBuffers_.size()] = index;
+	completedTail_.store(tail + 1);
 
 	uint64_t data = 1;
 	int ret = ::write(efd_, &data, sizeof(data));
 	if (ret != sizeof(data))
 		LOG(V4L2Compat, Error) << "Failed to signal eventfd POLLIN";
 
-	request->reuse();
-	{
-		MutexLocker locker(bufferMutex_);
-		bufferAvailableCount_++;
+	/*
+	 * Synchronize with the condition check of the waiters, if any. The
+	 * sequentially consistent accesses to completedTail_ and
+	 * bufferWaiters_ guarantee that either a waiter sees the new buffer,
+	 * or it is seen here.
+	 */
+	if (bufferWaiters_.load()) {
+		{
+			MutexLocker locker(bufferMutex_);
+		}
+		bufferCV_.notify_all();
 	}
-	bufferCV_.notify_all();
+}
+
+/*
+ * Queue the idle requests to the camera, with the application buffers
+ * waiting for a request first, in the order they have been queued, and with
+ * spare buffers otherwise.
+ */
+int V4L2Camera::queueRequests()
+{
+	if (!isRunning_)
+		return 0;
+
+	Stream *stream = config_->at(0).stream();
+
+	while (!idleRequests_.empty()) {
+		unsigned int index;
+		if (!queuedBuffers_.empty()) {
+			index = queuedBuffers_.front();
+			queuedBuffers_.pop_front();
+		} else if (!freeSpares_.empty()) {
+			index = freeSpares_.back();
+			freeSpares_.pop_back();
+		} else {
+			break;
+		}
+
+		Request *request = idleRequests_.back();
+		idleRequests_.pop_back();
+
+		requestBuffers_[request->cookie()] = index;
+
+		int ret = request->addBuffer(stream, buffer(index));
+		if (ret < 0) {
+			LOG(V4L2Compat, Error) << "Can't set buffer for request";
+			ret = -ENOMEM;
+		} else {
+			ret = camera_->queueRequest(request);
+			if (ret < 0)
+				LOG(V4L2Compat, Error) << "Can't queue request";
+		}
+
+		if (ret < 0) {
+			request->reuse();
+			idleRequests_.push_back(request);
+
+			if (index < bufferCount_)
+				queuedBuffers_.push_front(index);
+			else
+				freeSpares_.push_back(index);
+
+			return ret == -EACCES ? -EBUSY : ret;
+		}
+	}
+
+	return 0;
+}
+
+void V4L2Camera::resetRequests()
+{
+	queuedBuffers_.clear();
+	idleRequests_.clear();
+	freeSpares_.clear();
+
+	for (std::unique_ptr<Request> &request : requestPool_) {
+		request->reuse();
+		idleRequests_.push_back(request.get());
+	}
+
+	for (unsigned int i = bufferCount_; i < requestPool_.size(); i++)
+		freeSpares_.push_back(i);
 }
 
 int V4L2Camera::configure(StreamConfiguration *streamConfigOut,
@@ -113,7 +257,7 @@ int V4L2Camera::configure(StreamConfiguration *streamConfigOut,
 	streamConfig.size.width = size.width;
 	streamConfig.size.height = size.height;
 	streamConfig.pixelFormat = pixelformat;
-	streamConfig.bufferCount = bufferCount;
+	streamConfig.bufferCount = std::max(bufferCount, minBufferCount_);
 	/* \todo memoryType (interval vs external) */
 
 	CameraConfiguration::Status validation = config_->validate();
@@ -156,15 +300,25 @@ int V4L2Camera::validateConfiguration(const PixelFormat &pixelFormat,
 	return 0;
 }
 
-int V4L2Camera::allocBuffers(unsigned int count)
+/*
+ * Create the requests for bufferCount application buffers, and use the
+ * buffers beyond them, up to requestCount, as spares. Return the number of
+ * application buffers.
+ */
+int V4L2Camera::createRequests(unsigned int bufferCount,
+			       unsigned int requestCount)
 {
-	Stream *stream = config_->at(0).stream();
+	bufferCount_ = bufferCount;
 
-	int ret = bufferAllocator_->allocate(stream);
-	if (ret < 0)
-		return ret;
+	completedBuffers_.assign(bufferCount, 0);
+	completedHead_ = 0;
+	completedTail_ = 0;
 
-	for (unsigned int i = 0; i < count; i++) {
+	requestBuffers_.assign(requestCount, 0);
+	metadata_.resize(requestCount);
+	mappedBuffers_.resize(requestCount);
+
+	for (unsigned int i = 0; i < requestCount; i++) {
 		std::unique_ptr<Request> request = camera_->createRequest(i);
 		if (!request) {
 			requestPool_.clear();
@@ -173,30 +327,226 @@ int V4L2Camera::allocBuffers(unsigned int count)
 		requestPool_.push_back(std::move(request));
 	}
 
-	return ret;
+	MutexLocker locker(requestMutex_);
+	resetRequests();
+
+	return bufferCount;
+}
+
+int V4L2Camera::allocBuffers(unsigned int count)
+{
+	Stream *stream = config_->at(0).stream();
+
+	int ret = bufferAllocator_->allocate(stream);
+	if (ret < 0)
+		return ret;
+
+	return createRequests(std::min<unsigned int>(count, ret), ret);
+}
+
+/*
+ * Prepare for capturing to dmabufs provided by the application, which are
+ * imported with importBuffer() when queued. Spare buffers are allocated if
+ * the application requests fewer buffers than the pipeline needs.
+ */
+int V4L2Camera::importBuffers(unsigned int count)
+{
+	unsigned int requestCount = config_->at(0).bufferCount;
+
+	if (count < requestCount) {
+		Stream *stream = config_->at(0).stream();
+
+		int ret = bufferAllocator_->allocate(stream);
+		if (ret < 0)
+			return ret;
+
+		requestCount = ret;
+	}
+
+	count = std::min(count, requestCount);
+	importedBuffers_.resize(count);
+
+	return createRequests(count, requestCount);
+}
+
+int V4L2Camera::importBuffer(unsigned int index, int fd)
+{
+	if (index >= importedBuffers_.size())
+		return -EINVAL;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	/*
+	 * Applications usually queue the same dmabuf for a given index, reuse
+	 * the buffer imported previously if it still wraps the same dmabuf.
+	 */
+	std::unique_ptr<FrameBuffer> &buffer = importedBuffers_[index];
+	if (buffer) {
+		struct stat current;
+		if (!fstat(buffer->planes()[0].fd.get(), &current) &&
+		    current.st_ino == st.st_ino)
+			return 0;
+	}
+
+	SharedFD dmabuf(fd);
+	if (!dmabuf.isValid())
+		return -EBADF;
+
+	const StreamConfiguration &cfg = config_->at(0);
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	std::vector<FrameBuffer::Plane> planes;
+
+	/*
+	 * The V4L2 single-planar API stores all the colour planes contiguously
+	 * in the dmabuf, split it in one FrameBuffer plane per colour plane.
+	 */
+	if (info.isValid() && info.numPlanes() > 1) {
+		unsigned int offset = 0;
+
+		planes.resize(info.numPlanes());
+		for (auto [i, plane] : utils::enumerate(planes)) {
+			unsigned int stride = cfg.stride
+					    * info.planes[i].bytesPerGroup
+					    / info.planes[0].bytesPerGroup;
+
+			plane.fd = dmabuf;
+			plane.offset = offset;
+			plane.length = info.planeSize(cfg.size.height, i, stride);
+			offset += plane.length;
+		}
+	} else {
+		FrameBuffer::Plane plane;
+		plane.fd = dmabuf;
+		plane.offset = 0;
+		plane.length = cfg.frameSize;
+		planes.push_back(std::move(plane));
+	}
+
+	buffer = std::make_unique<FrameBuffer>(planes);
+	mappedBuffers_[index].reset();
+
+	return 0;
 }
 
 void V4L2Camera::freeBuffers()
 {
-	pendingRequests_.clear();
+	{
+		MutexLocker locker(requestMutex_);
+		idleRequests_.clear();
+		queuedBuffers_.clear();
+		freeSpares_.clear();
+	}
+
 	requestPool_.clear();
+	importedBuffers_.clear();
+	mappedBuffers_.clear();
+	bufferCount_ = 0;
 
 	Stream *stream = config_->at(0).stream();
 	bufferAllocator_->free(stream);
 }
 
+FrameBuffer *V4L2Camera::buffer(unsigned int index)
+{
+	if (index < importedBuffers_.size())
+		return importedBuffers_[index].get();
+
+	Stream *stream = config_->at(0).stream();
+	const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
+		bufferAllocator_->buffers(stream);
+
+	return index < buffers.size() ? buffers[index].get() : nullptr;
+}
+
 int V4L2Camera::getBufferFd(unsigned int index)
 {
 	Stream *stream = config_->at(0).stream();
 	const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
 		bufferAllocator_->buffers(stream);
 
-	if (buffers.size() <= index)
+	if (index >= bufferCount_ || index >= buffers.size())
 		return -1;
 
 	return buffers[index]->planes()[0].fd.get();
 }
 
+MappedFrameBuffer *V4L2Camera::mappedBuffer(unsigned int index)
+{
+	const FrameBuffer *buffer = V4L2Camera::buffer(index);
+	if (!buffer || index >= mappedBuffers_.size())
+		return nullptr;
+
+	std::unique_ptr<MappedFrameBuffer> &mapped = mappedBuffers_[index];
+	if (!mapped) {
+		mapped = std::make_unique<MappedFrameBuffer>(buffer,
+							     MappedFrameBuffer::MapFlag::ReadWrite);
+		if (!mapped->isValid()) {
+			LOG(V4L2Compat, Error)
+				<< "Failed to map buffer " << index << ": "
+				<< strerror(-mapped->error());
+			mapped.reset();
+		}
+	}
+
+	return mapped.get();
+}
+
+/*
+ * Copy the frame captured in a buffer to memory provided by the application or
+ * by a reader, storing the planes contiguously. Return the number of bytes
+ * used by the frame, or a negative error code.
+ */
+int V4L2Camera::copyBuffer(unsigned int index, void *dst, size_t length)
+{
+	const MappedFrameBuffer *mapped = mappedBuffer(index);
+	if (!mapped)
+		return -EINVAL;
+
+	Span<const FrameMetadata::Plane> metadata = metadata_[index].planes();
+	uint8_t *out = static_cast<uint8_t *>(dst);
+	size_t offset = 0;
+	size_t bytesused = 0;
+
+	for (auto [i, plane] : utils::enumerate(mapped->planes())) {
+		if (offset >= length || i >= metadata.size())
+			break;
+
+		size_t size = std::min<size_t>(metadata[i].bytesused, plane.size());
+		size = std::min(size, length - offset);
+
+		memcpy(out + offset, plane.data(), size);
+
+		bytesused = offset + size;
+		offset += plane.size();
+	}
+
+	return bytesused;
+}
+
+/* Copy the frame captured in a spare buffer to an application buffer. */
+int V4L2Camera::copyFrame(unsigned int src, unsigned int dst)
+{
+	const MappedFrameBuffer *in = mappedBuffer(src);
+	const MappedFrameBuffer *out = mappedBuffer(dst);
+	if (!in || !out)
+		return -EINVAL;
+
+	Span<const FrameMetadata::Plane> metadata = metadata_[src].planes();
+	unsigned int count = std::min({ in->planes().size(), out->planes().size(),
+					metadata.size() });
+
+	for (unsigned int i = 0; i < count; i++) {
+		size_t size = std::min<size_t>({ metadata[i].bytesused,
+						 in->planes()[i].size(),
+						 out->planes()[i].size() });
+		memcpy(out->planes()[i].data(), in->planes()[i].data(), size);
+	}
+
+	return 0;
+}
+
 int V4L2Camera::streamOn()
 {
 	if (isRunning_)
@@ -206,92 +556,126 @@ int V4L2Camera::streamOn()
 	if (ret < 0)
 		return ret == -EACCES ? -EBUSY : ret;
 
-	isRunning_ = true;
+	MutexLocker locker(requestMutex_);
 
-	for (Request *req : pendingRequests_) {
-		/* \todo What should we do if this returns -EINVAL? */
-		ret = camera_->queueRequest(req);
-		if (ret < 0)
-			return ret == -EACCES ? -EBUSY : ret;
-	}
-
-	pendingRequests_.clear();
+	isRunning_ = true;
 
-	return 0;
+	return queueRequests();
 }
 
 int V4L2Camera::streamOff()
 {
 	if (!isRunning_) {
-		for (std::unique_ptr<Request> &req : requestPool_)
-			req->reuse();
+		MutexLocker locker(requestMutex_);
+		resetRequests();
 
 		return 0;
 	}
 
-	pendingRequests_.clear();
+	/* Don't queue the requests that complete while stopping. */
+	{
+		MutexLocker locker(requestMutex_);
+		isRunning_ = false;
+	}
 
 	int ret = camera_->stop();
-	if (ret < 0)
-		return ret == -EACCES ? -EBUSY : ret;
 
 	{
 		MutexLocker locker(bufferMutex_);
-		isRunning_ = false;
 	}
 	bufferCV_.notify_all();
 
+	if (ret < 0)
+		return ret == -EACCES ? -EBUSY : ret;
+
+	{
+		MutexLocker locker(requestMutex_);
+		resetRequests();
+	}
+
+	/* Drop the buffers that haven't been dequeued. */
+	completedHead_.store(completedTail_.load());
+
 	return 0;
 }
 
 int V4L2Camera::qbuf(unsigned int index)
 {
-	if (index >= requestPool_.size()) {
+	if (index >= bufferCount_) {
 		LOG(V4L2Compat, Error) << "Invalid index";
 		return -EINVAL;
 	}
-	Request *request = requestPool_[index].get();
 
-	Stream *stream = config_->at(0).stream();
-	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
-	int ret = request->addBuffer(stream, buffer);
-	if (ret < 0) {
-		LOG(V4L2Compat, Error) << "Can't set buffer for request";
-		return -ENOMEM;
+	if (!buffer(index)) {
+		LOG(V4L2Compat, Error) << "Buffer not imported";
+		return -EINVAL;
 	}
 
-	if (!isRunning_) {
-		pendingRequests_.push_back(request);
-		return 0;
-	}
+	MutexLocker locker(requestMutex_);
 
-	ret = camera_->queueRequest(request);
+	queuedBuffers_.push_back(index);
+
+	int ret = queueRequests();
 	if (ret < 0) {
-		LOG(V4L2Compat, Error) << "Can't queue request";
-		return ret == -EACCES ? -EBUSY : ret;
+		auto iter = std::find(queuedBuffers_.begin(),
+				      queuedBuffers_.end(), index);
+		if (iter != queuedBuffers_.end())
+			queuedBuffers_.erase(iter);
 	}
 
-	return 0;
+	return ret;
+}
+
+/*
+ * Dequeue the buffer that completed first and return its index, or return
+ * -EAGAIN if no buffer has completed. Concurrent calls must be serialized by
+ * the caller.
+ */
+int V4L2Camera::dequeueBuffer()
+{
+	unsigned int head = completedHead_.load(std::memory_order_relaxed);
+	if (head == completedTail_.load(std::memory_order_acquire))
+		return -EAGAIN;
+
+	unsigned int index = completedBuffers_[head % completedBuffers_.size()];
+	completedHead_.store(head + 1, std::memory_order_release);
+
+	return index;
+}
+
+bool V4L2Camera::isBufferCompleted(unsigned int index) const
+{
+	unsigned int tail = completedTail_.load(std::memory_order_acquire);
+
+	for (unsigned int i = completedHead_.load(std::memory_order_relaxed);
+	     i != tail; i++) {
+		if (completedBuffers_[i % completedBuffers_.size()] == index)
+			return true;
+	}
+
+	return false;
+}
+
+const FrameMetadata *V4L2Camera::bufferMetadata(unsigned int index) const
+{
+	return index < metadata_.size() ? &metadata_[index] : nullptr;
 }
 
 void V4L2Camera::waitForBufferAvailable()
 {
 	MutexLocker locker(bufferMutex_);
-	bufferCV_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(bufferMutex_) {
-			       return bufferAvailableCount_ >= 1 || !isRunning_;
+
+	bufferWaiters_++;
+	bufferCV_.wait(locker, [&]() {
+			       return isBufferAvailable() || !isRunning_;
 		       });
-	if (isRunning_)
-		bufferAvailableCount_--;
+	bufferWaiters_--;
 }
 
-bool V4L2Camera::isBufferAvailable()
+bool V4L2Camera::isBufferAvailable() const
 {
-	MutexLocker locker(bufferMutex_);
-	if (bufferAvailableCount_ < 1)
-		return false;
-
-	bufferAvailableCount_--;
-	return true;
+	return completedHead_.load(std::memory_order_relaxed) !=
+	       completedTail_.load();
 }
 
 bool V4L2Camera::isRunning()
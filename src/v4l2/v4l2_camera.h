@@ -7,30 +7,25 @@
 
 #pragma once
 
+#include <atomic>
 #include <deque>
 #include <utility>
+#include <vector>
 
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/semaphore.h>
 #include <libcamera/base/shared_fd.h>
+#include <libcamera/base/signal.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer.h>
 #include <libcamera/framebuffer_allocator.h>
 
+#include "libcamera/internal/mapped_framebuffer.h"
+
 class V4L2Camera
 {
 public:
-	struct Buffer {
-		Buffer(unsigned int index, const libcamera::FrameMetadata &data)
-			: index_(index), data_(data)
-		{
-		}
-
-		unsigned int index_;
-		libcamera::FrameMetadata data_;
-	};
-
 	V4L2Camera(std::shared_ptr<libcamera::Camera> camera);
 	~V4L2Camera();
 
@@ -39,8 +34,6 @@ public:
 	void bind(int efd);
 	void unbind();
 
-	std::vector<Buffer> completedBuffers() LIBCAMERA_TSA_EXCLUDES(bufferLock_);
-
 	int configure(libcamera::StreamConfiguration *streamConfigOut,
 		      const libcamera::Size &size,
 		      const libcamera::PixelFormat &pixelformat,
@@ -50,40 +43,98 @@ public:
 				  libcamera::StreamConfiguration *streamConfigOut);
 
 	int allocBuffers(unsigned int count);
+	int importBuffers(unsigned int count);
+	int importBuffer(unsigned int index, int fd);
 	void freeBuffers();
 	int getBufferFd(unsigned int index);
+	int copyBuffer(unsigned int index, void *dst, size_t length);
 
 	int streamOn();
 	int streamOff();
 
 	int qbuf(unsigned int index);
+	int dequeueBuffer();
+	bool isBufferCompleted(unsigned int index) const;
+	const libcamera::FrameMetadata *bufferMetadata(unsigned int index) const;
 
 	void waitForBufferAvailable() LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
-	bool isBufferAvailable() LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
+	bool isBufferAvailable() const;
 
 	bool isRunning();
 
+	libcamera::Signal<unsigned int> frameCompleted;
+
 private:
 	void requestComplete(libcamera::Request *request)
-		LIBCAMERA_TSA_EXCLUDES(bufferLock_);
+		LIBCAMERA_TSA_EXCLUDES(bufferMutex_, requestMutex_);
+	int createRequests(unsigned int bufferCount, unsigned int requestCount);
+	int queueRequests() LIBCAMERA_TSA_REQUIRES(requestMutex_);
+	void resetRequests() LIBCAMERA_TSA_REQUIRES(requestMutex_);
+	int takeQueuedBuffer() LIBCAMERA_TSA_EXCLUDES(requestMutex_);
+	void completeBuffer(unsigned int index) LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
+	libcamera::FrameBuffer *buffer(unsigned int index);
+	libcamera::MappedFrameBuffer *mappedBuffer(unsigned int index);
+	int copyFrame(unsigned int src, unsigned int dst);
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 
-	bool isRunning_;
+	std::atomic<bool> isRunning_;
 
-	libcamera::Mutex bufferLock_;
 	libcamera::FrameBufferAllocator *bufferAllocator_;
 
-	std::vector<std::unique_ptr<libcamera::Request>> requestPool_;
+	/*
+	 * The number of requests, and of buffers queued to the camera, is the
+	 * number of buffers the pipeline handler needs, independently of the
+	 * number of buffers requested by the application. The buffers
+	 * allocated beyond the application buffers are spares, queued when the
+	 * application doesn't have enough buffers queued to keep the pipeline
+	 * fed. A frame captured in a spare buffer is copied to an application
+	 * buffer if one is waiting for a request, and dropped otherwise.
+	 *
+	 * Buffers are identified by an index, the application buffers first,
+	 * the spare buffers next.
+	 */
+	unsigned int bufferCount_;
+	unsigned int minBufferCount_;
 
-	std::deque<libcamera::Request *> pendingRequests_;
-	std::deque<std::unique_ptr<Buffer>> completedBuffers_
-		LIBCAMERA_TSA_GUARDED_BY(bufferLock_);
+	std::vector<std::unique_ptr<libcamera::Request>> requestPool_;
+	/* Index of the buffer used by each request, indexed by cookie. */
+	std::vector<unsigned int> requestBuffers_;
+	/* Metadata of the frame captured or copied in each buffer. */
+	std::vector<libcamera::FrameMetadata> metadata_;
+
+	/* Buffers imported from dmabufs, replacing the allocated ones. */
+	std::vector<std::unique_ptr<libcamera::FrameBuffer>> importedBuffers_;
+	/* Mappings of the buffers, to copy frames between them and to users. */
+	std::vector<std::unique_ptr<libcamera::MappedFrameBuffer>> mappedBuffers_;
+
+	libcamera::Mutex requestMutex_;
+	std::vector<libcamera::Request *> idleRequests_
+		LIBCAMERA_TSA_GUARDED_BY(requestMutex_);
+	std::deque<unsigned int> queuedBuffers_
+		LIBCAMERA_TSA_GUARDED_BY(requestMutex_);
+	std::vector<unsigned int> freeSpares_
+		LIBCAMERA_TSA_GUARDED_BY(requestMutex_);
+
+	/*
+	 * Indices of the completed buffers, in completion order. This is a
+	 * lock-free single producer, single consumer ring, filled by the
+	 * camera thread and emptied by the proxy, which serializes its
+	 * accesses. It is sized to the number of application buffers, which
+	 * can't complete again before being dequeued and queued back.
+	 */
+	std::vector<unsigned int> completedBuffers_;
+	std::atomic<unsigned int> completedHead_;
+	std::atomic<unsigned int> completedTail_;
 
 	int efd_;
 
+	/*
+	 * The mutex is only taken by the camera thread when the proxy waits
+	 * for a buffer to complete.
+	 */
 	libcamera::Mutex bufferMutex_;
 	libcamera::ConditionVariable bufferCV_;
-	unsigned int bufferAvailableCount_ LIBCAMERA_TSA_GUARDED_BY(bufferMutex_);
+	std::atomic<unsigned int> bufferWaiters_;
 };
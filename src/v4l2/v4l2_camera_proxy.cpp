@@ -37,12 +37,20 @@ using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(V4L2Compat)
 
+/* Number of buffers allocated to emulate the read() I/O method. */
+static constexpr unsigned int kReadBufferCount = 4;
+
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
-	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
-	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr)
+	: refcount_(0), index_(index), bufferCount_(0),
+	  memory_(V4L2_MEMORY_MMAP), readMode_(false), vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr),
+	  proxyMutex_(Mutex::Protocol::PriorityInherit),
+	  queueMutex_(Mutex::Protocol::PriorityInherit),
+	  readersMutex_(Mutex::Protocol::PriorityInherit)
 {
 	querycap(camera);
+
+	vcam_->frameCompleted.connect(this, &V4L2CameraProxy::shareFrame);
 }
 
 int V4L2CameraProxy::open(V4L2CameraFile *file)
@@ -51,6 +59,7 @@ int V4L2CameraProxy::open(V4L2CameraFile *file)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker queueLocker(queueMutex_);
 
 	if (refcount_++) {
 		files_.insert(file);
@@ -61,10 +70,10 @@ int V4L2CameraProxy::open(V4L2CameraFile *file)
 	 * We open the camera here, once, and keep it open until the last
 	 * V4L2CameraFile is closed. The proxy is initially not owned by any
 	 * file. The first file that calls reqbufs with count > 0 or s_fmt
-	 * will become the owner, and no other file will be allowed to call
-	 * buffer-related ioctls (except querybuf), set the format, or start or
-	 * stop the stream until ownership is released with a call to reqbufs
-	 * with count = 0.
+	 * will become the owner, and no other file will be allowed to
+	 * configure the camera until ownership is released with a call to
+	 * reqbufs with count = 0. The other files can capture copies of the
+	 * owner's stream in the meantime.
 	 */
 
 	int ret = vcam_->open(&streamConfig_);
@@ -86,9 +95,18 @@ void V4L2CameraProxy::close(V4L2CameraFile *file)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker queueLocker(queueMutex_);
 
 	files_.erase(file);
 
+	if (readers_.count(file)) {
+		MutexLocker readersLocker(readersMutex_);
+		readers_.erase(file);
+	}
+
+	if (readMode_ && hasOwnership(file))
+		readStop();
+
 	release(file);
 
 	if (--refcount_ > 0)
@@ -104,6 +122,16 @@ void *V4L2CameraProxy::mmap(V4L2CameraFile *file, void *addr, size_t length,
 		<< "[" << file->description() << "] " << __func__ << "()";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker queueLocker(queueMutex_);
+
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader)
+		return reader->mmap(addr, length, prot, flags, offset);
+
+	if (memory_ != V4L2_MEMORY_MMAP) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
 
 	/*
 	 * Mimic the videobuf2 behaviour, which requires PROT_READ and
@@ -149,6 +177,11 @@ int V4L2CameraProxy::munmap(V4L2CameraFile *file, void *addr, size_t length)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker queueLocker(queueMutex_);
+
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader)
+		return reader->munmap(addr, length);
 
 	auto iter = mmaps_.find(addr);
 	if (iter == mmaps_.end() || length != sizeimage_) {
@@ -173,7 +206,14 @@ bool V4L2CameraProxy::validateBufferType(uint32_t type)
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	/*
+	 * Buffers are allocated by libcamera for MMAP and USERPTR, the frames
+	 * being copied to the user pointers when dequeued, and imported for
+	 * DMABUF.
+	 */
+	return memory == V4L2_MEMORY_MMAP ||
+	       memory == V4L2_MEMORY_USERPTR ||
+	       memory == V4L2_MEMORY_DMABUF;
 }
 
 void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
@@ -210,42 +250,65 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 	capabilities_.version = KERNEL_VERSION(5, 2, 0);
 	capabilities_.device_caps = V4L2_CAP_VIDEO_CAPTURE
 				  | V4L2_CAP_STREAMING
+				  | V4L2_CAP_READWRITE
 				  | V4L2_CAP_EXT_PIX_FORMAT;
 	capabilities_.capabilities = capabilities_.device_caps
 				   | V4L2_CAP_DEVICE_CAPS;
 	memset(capabilities_.reserved, 0, sizeof(capabilities_.reserved));
 }
 
-void V4L2CameraProxy::updateBuffers()
-{
-	std::vector<V4L2Camera::Buffer> completedBuffers = vcam_->completedBuffers();
-	for (const V4L2Camera::Buffer &buffer : completedBuffers) {
-		const FrameMetadata &fmd = buffer.data_;
-		struct v4l2_buffer &buf = buffers_[buffer.index_];
-
-		switch (fmd.status) {
-		case FrameMetadata::FrameSuccess:
-			buf.bytesused = std::accumulate(fmd.planes().begin(),
-							fmd.planes().end(), 0,
-							[](unsigned int total, const auto &plane) {
-								return total + plane.bytesused;
-							});
-			buf.field = V4L2_FIELD_NONE;
-			buf.timestamp.tv_sec = fmd.timestamp / 1000000000;
-			buf.timestamp.tv_usec = (fmd.timestamp / 1000) % 1000000;
-			buf.sequence = fmd.sequence;
-
-			buf.flags |= V4L2_BUF_FLAG_DONE;
-			break;
-		case FrameMetadata::FrameError:
-			buf.flags |= V4L2_BUF_FLAG_ERROR;
-			break;
-		default:
-			break;
-		}
+void V4L2CameraProxy::updateBuffer(unsigned int index)
+{
+	const FrameMetadata *fmd = vcam_->bufferMetadata(index);
+	if (!fmd)
+		return;
+
+	struct v4l2_buffer &buf = buffers_[index];
+
+	switch (fmd->status) {
+	case FrameMetadata::FrameSuccess:
+		buf.bytesused = std::accumulate(fmd->planes().begin(),
+						fmd->planes().end(), 0,
+						[](unsigned int total, const auto &plane) {
+							return total + plane.bytesused;
+						});
+		buf.field = V4L2_FIELD_NONE;
+		buf.timestamp.tv_sec = fmd->timestamp / 1000000000;
+		buf.timestamp.tv_usec = (fmd->timestamp / 1000) % 1000000;
+		buf.sequence = fmd->sequence;
+
+		buf.flags |= V4L2_BUF_FLAG_DONE;
+		break;
+	case FrameMetadata::FrameError:
+		buf.flags |= V4L2_BUF_FLAG_ERROR;
+		break;
+	default:
+		break;
 	}
 }
 
+/*
+ * Called in the camera thread when a frame completes, before the owner is
+ * notified.
+ */
+void V4L2CameraProxy::shareFrame(unsigned int index)
+{
+	MutexLocker locker(readersMutex_);
+
+	for (const auto &reader : readers_)
+		reader.second->shareFrame(vcam_.get(), index);
+}
+
+void V4L2CameraProxy::clearEvent(V4L2CameraFile *file)
+{
+	/* Bypass the read() interception, the eventfd is the camera fd. */
+	uint64_t data;
+	int ret = V4L2CompatManager::instance()->fops().read(file->efd(), &data,
+							      sizeof(data));
+	if (ret != sizeof(data))
+		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+}
+
 int V4L2CameraProxy::vidioc_querycap(V4L2CameraFile *file, struct v4l2_capability *arg)
 {
 	LOG(V4L2Compat, Debug)
@@ -357,6 +420,23 @@ int V4L2CameraProxy::vidioc_s_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
+	if (readMode_)
+		return -EBUSY;
+
+	/* The readers can only capture the format set by the owner. */
+	if (isReader(file)) {
+		int ret = tryFormat(arg);
+		if (ret < 0)
+			return ret;
+
+		if (!isCurrentFormat(arg->fmt.pix))
+			return -EBUSY;
+
+		arg->fmt.pix = v4l2PixFormat_;
+
+		return 0;
+	}
+
 	int ret = acquire(file);
 	if (ret < 0)
 		return ret;
@@ -365,6 +445,10 @@ int V4L2CameraProxy::vidioc_s_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 	if (ret < 0)
 		return ret;
 
+	/* The buffers of the readers are sized for the current format. */
+	if (!readers_.empty() && !isCurrentFormat(arg->fmt.pix))
+		return -EBUSY;
+
 	Size size(arg->fmt.pix.width, arg->fmt.pix.height);
 	V4L2PixelFormat v4l2Format = V4L2PixelFormat(arg->fmt.pix.pixelformat);
 	ret = vcam_->configure(&streamConfig_, size, v4l2Format.toPixelFormat(),
@@ -392,6 +476,13 @@ int V4L2CameraProxy::vidioc_try_fmt(V4L2CameraFile *file, struct v4l2_format *ar
 	return 0;
 }
 
+bool V4L2CameraProxy::isCurrentFormat(const struct v4l2_pix_format &pix)
+{
+	return pix.width == v4l2PixFormat_.width &&
+	       pix.height == v4l2PixFormat_.height &&
+	       pix.pixelformat == v4l2PixFormat_.pixelformat;
+}
+
 enum v4l2_priority V4L2CameraProxy::maxPriority()
 {
 	auto max = std::max_element(files_.begin(), files_.end(),
@@ -487,10 +578,16 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
-	if (!hasOwnership(file) && owner_)
+	if (isReader(file))
+		return readerReqbufs(file, arg);
+
+	/* Streaming I/O can't be used while capturing with read(). */
+	if (readMode_)
 		return -EBUSY;
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_USERPTR
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF;
 	arg->flags = 0;
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
@@ -520,22 +617,34 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 
 	setFmtFromConfig(streamConfig_);
 
-	arg->count = streamConfig_.bufferCount;
-	bufferCount_ = arg->count;
+	memory_ = arg->memory;
 
-	ret = vcam_->allocBuffers(arg->count);
+	/*
+	 * The camera may use more buffers than requested, to keep the
+	 * pipeline fed, but only the requested buffers are exposed.
+	 */
+	if (memory_ == V4L2_MEMORY_DMABUF)
+		ret = vcam_->importBuffers(arg->count);
+	else
+		ret = vcam_->allocBuffers(arg->count);
 	if (ret < 0) {
 		arg->count = 0;
 		return ret;
 	}
 
+	arg->count = ret;
+	bufferCount_ = arg->count;
+
 	buffers_.resize(arg->count);
 	for (unsigned int i = 0; i < arg->count; i++) {
 		struct v4l2_buffer buf = {};
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.length = v4l2PixFormat_.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		buf.memory = memory_;
+		if (memory_ == V4L2_MEMORY_MMAP)
+			buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		else if (memory_ == V4L2_MEMORY_DMABUF)
+			buf.m.fd = -1;
 		buf.index = i;
 		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
 
@@ -549,11 +658,57 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	return 0;
 }
 
+int V4L2CameraProxy::readerReqbufs(V4L2CameraFile *file, struct v4l2_requestbuffers *arg)
+{
+	/* The frames are copied to the readers, in buffers allocated here. */
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->flags = 0;
+	memset(arg->reserved, 0, sizeof(arg->reserved));
+
+	if (arg->memory != V4L2_MEMORY_MMAP)
+		return -EINVAL;
+
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader) {
+		if (reader->isMapped() || reader->isStreaming())
+			return -EBUSY;
+
+		MutexLocker locker(readersMutex_);
+		readers_.erase(file);
+	}
+
+	if (arg->count == 0)
+		return 0;
+
+	reader = std::make_shared<V4L2CameraReader>(file->efd());
+
+	unsigned int count = std::min<unsigned int>(arg->count, VIDEO_MAX_FRAME);
+	int ret = reader->allocBuffers(count, sizeimage_);
+	if (ret < 0) {
+		arg->count = 0;
+		return ret;
+	}
+
+	arg->count = count;
+
+	LOG(V4L2Compat, Debug)
+		<< "Allocated " << arg->count << " buffers to share the stream";
+
+	MutexLocker locker(readersMutex_);
+	readers_[file] = std::move(reader);
+
+	return 0;
+}
+
 int V4L2CameraProxy::vidioc_querybuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 {
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader)
+		return reader->querybuf(arg);
+
 	if (arg->index >= bufferCount_)
 		return -EINVAL;
 
@@ -561,7 +716,8 @@ int V4L2CameraProxy::vidioc_querybuf(V4L2CameraFile *file, struct v4l2_buffer *a
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
-	updateBuffers();
+	if (vcam_->isBufferCompleted(arg->index))
+		updateBuffer(arg->index);
 
 	*arg = buffers_[arg->index];
 
@@ -584,7 +740,7 @@ int V4L2CameraProxy::vidioc_prepare_buf(V4L2CameraFile *file, struct v4l2_buffer
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    arg->memory != memory_)
 		return -EINVAL;
 
 	struct v4l2_buffer &buffer = buffers_[arg->index];
@@ -606,6 +762,13 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 		<< "[" << file->description() << "] " << __func__
 		<< "(index=" << arg->index << ")";
 
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader)
+		return reader->qbuf(arg);
+
+	if (readMode_)
+		return -EBUSY;
+
 	if (arg->index >= bufferCount_)
 		return -EINVAL;
 
@@ -616,15 +779,45 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 		return -EBUSY;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory) ||
+	    arg->memory != memory_ ||
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
-	int ret = vcam_->qbuf(arg->index);
+	struct v4l2_buffer &buffer = buffers_[arg->index];
+	int ret;
+
+	switch (memory_) {
+	case V4L2_MEMORY_USERPTR:
+		if (!arg->m.userptr || arg->length < sizeimage_)
+			return -EINVAL;
+
+		buffer.m.userptr = arg->m.userptr;
+		buffer.length = arg->length;
+		break;
+
+	case V4L2_MEMORY_DMABUF:
+		/* A zero length means the whole dmabuf, as in videobuf2. */
+		if (arg->length && arg->length < sizeimage_)
+			return -EINVAL;
+
+		ret = vcam_->importBuffer(arg->index, arg->m.fd);
+		if (ret < 0)
+			return ret;
+
+		buffer.m.fd = arg->m.fd;
+		buffer.length = arg->length ? arg->length : sizeimage_;
+		break;
+
+	default:
+		break;
+	}
+
+	ret = vcam_->qbuf(arg->index);
 	if (ret < 0)
 		return ret;
 
-	buffers_[arg->index].flags |= V4L2_BUF_FLAG_QUEUED;
+	buffer.flags &= ~V4L2_BUF_FLAG_ERROR;
+	buffer.flags |= V4L2_BUF_FLAG_QUEUED;
 
 	arg->flags = buffers_[arg->index].flags;
 
@@ -637,6 +830,22 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
+	/*
+	 * The reader synchronizes its buffers itself, don't block the other
+	 * files while waiting for a frame.
+	 */
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader) {
+		lock->unlock();
+		int ret = reader->dqbuf(arg, file->nonBlocking());
+		lock->lock();
+
+		return ret;
+	}
+
+	if (readMode_)
+		return -EBUSY;
+
 	if (arg->index >= bufferCount_)
 		return -EINVAL;
 
@@ -647,37 +856,59 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    arg->memory != memory_)
 		return -EINVAL;
 
-	if (!file->nonBlocking()) {
+	int index;
+	while ((index = vcam_->dequeueBuffer()) < 0) {
+		if (file->nonBlocking())
+			return -EAGAIN;
+
 		lock->unlock();
 		vcam_->waitForBufferAvailable();
 		lock->lock();
-	} else if (!vcam_->isBufferAvailable())
-		return -EAGAIN;
 
-	/*
-	 * We need to check here again in case stream was turned off while we
-	 * were blocked on waitForBufferAvailable().
-	 */
-	if (!vcam_->isRunning())
-		return -EINVAL;
+		/*
+		 * We need to check here again in case stream was turned off
+		 * while we were blocked on waitForBufferAvailable().
+		 */
+		if (!vcam_->isRunning())
+			return -EINVAL;
+	}
 
-	updateBuffers();
+	updateBuffer(index);
 
-	struct v4l2_buffer &buf = buffers_[currentBuf_];
+	struct v4l2_buffer &buf = buffers_[index];
 
 	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_PREPARED);
-	buf.length = sizeimage_;
-	*arg = buf;
 
-	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
+	switch (memory_) {
+	case V4L2_MEMORY_MMAP:
+		buf.length = sizeimage_;
+		break;
 
-	uint64_t data;
-	int ret = ::read(file->efd(), &data, sizeof(data));
-	if (ret != sizeof(data))
-		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+	case V4L2_MEMORY_USERPTR:
+		if (!(buf.flags & V4L2_BUF_FLAG_ERROR)) {
+			int ret = vcam_->copyBuffer(index,
+						    reinterpret_cast<void *>(buf.m.userptr),
+						    buf.length);
+			if (ret < 0) {
+				LOG(V4L2Compat, Error)
+					<< "Failed to copy buffer " << index;
+				buf.flags |= V4L2_BUF_FLAG_ERROR;
+			} else {
+				buf.bytesused = ret;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	*arg = buf;
+
+	clearEvent(file);
 
 	return 0;
 }
@@ -690,8 +921,8 @@ int V4L2CameraProxy::vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffe
 	if (!hasOwnership(file))
 		return -EBUSY;
 
-	/* \todo Verify that the memory type is MMAP when adding DMABUF support */
-	if (!validateBufferType(arg->type))
+	/* Only the buffers allocated by libcamera can be exported. */
+	if (!validateBufferType(arg->type) || memory_ != V4L2_MEMORY_MMAP)
 		return -EINVAL;
 
 	if (arg->index >= bufferCount_)
@@ -702,9 +933,14 @@ int V4L2CameraProxy::vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffe
 
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
+	int fd = vcam_->getBufferFd(arg->index);
+	if (fd < 0)
+		return -EINVAL;
+
 	/* \todo honor the O_ACCMODE flags passed to this function */
-	arg->fd = fcntl(vcam_->getBufferFd(arg->index),
-			arg->flags & O_CLOEXEC ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+	arg->fd = fcntl(fd, arg->flags & O_CLOEXEC ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+	if (arg->fd < 0)
+		return -errno;
 
 	return 0;
 }
@@ -714,23 +950,28 @@ int V4L2CameraProxy::vidioc_streamon(V4L2CameraFile *file, int *arg)
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
-	if (bufferCount_ == 0)
-		return -EINVAL;
-
 	if (!validateBufferType(*arg))
 		return -EINVAL;
 
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader)
+		return reader->streamOn();
+
+	if (readMode_)
+		return -EBUSY;
+
+	if (bufferCount_ == 0)
+		return -EINVAL;
+
 	if (!hasOwnership(file))
 		return -EBUSY;
 
 	if (vcam_->isRunning())
 		return 0;
 
-	currentBuf_ = 0;
-
 	return vcam_->streamOn();
 }
 
@@ -745,6 +986,15 @@ int V4L2CameraProxy::vidioc_streamoff(V4L2CameraFile *file, int *arg)
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
+	std::shared_ptr<V4L2CameraReader> reader = V4L2CameraProxy::reader(file);
+	if (reader) {
+		reader->streamOff();
+		return 0;
+	}
+
+	if (readMode_)
+		return -EBUSY;
+
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
@@ -778,35 +1028,29 @@ const std::set<unsigned long> V4L2CameraProxy::supportedIoctls_ = {
 	VIDIOC_STREAMOFF,
 };
 
-int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long longRequest, void *arg)
+int V4L2CameraProxy::queueIoctl(V4L2CameraFile *file, unsigned int request, void *arg)
 {
-	MutexLocker locker(proxyMutex_);
-
-	/*
-	 * The Linux Kernel only processes 32 bits of an IOCTL.
-	 *
-	 * Prevent unexpected sign-extensions that could occur if applications
-	 * use a signed int for the ioctl request, which would sign-extend to
-	 * an incorrect value for unsigned longs on 64 bit architectures by
-	 * explicitly casting as an unsigned int here.
-	 */
-	unsigned int request = longRequest;
-
-	if (!arg && (_IOC_DIR(request) & _IOC_WRITE)) {
-		errno = EFAULT;
-		return -1;
-	}
-
-	if (supportedIoctls_.find(request) == supportedIoctls_.end()) {
-		errno = ENOTTY;
-		return -1;
+	int ret;
+	switch (request) {
+	case VIDIOC_QUERYBUF:
+		ret = vidioc_querybuf(file, static_cast<struct v4l2_buffer *>(arg));
+		break;
+	case VIDIOC_QBUF:
+		ret = vidioc_qbuf(file, static_cast<struct v4l2_buffer *>(arg));
+		break;
+	case VIDIOC_DQBUF:
+		ret = vidioc_dqbuf(file, static_cast<struct v4l2_buffer *>(arg), &queueMutex_);
+		break;
+	default:
+		ret = -ENOTTY;
+		break;
 	}
 
-	if (!arg && (_IOC_DIR(request) & _IOC_READ)) {
-		errno = EFAULT;
-		return -1;
-	}
+	return ret;
+}
 
+int V4L2CameraProxy::deviceIoctl(V4L2CameraFile *file, unsigned int request, void *arg)
+{
 	int ret;
 	switch (request) {
 	case VIDIOC_QUERYCAP:
@@ -845,15 +1089,6 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long longRequest, void
 	case VIDIOC_REQBUFS:
 		ret = vidioc_reqbufs(file, static_cast<struct v4l2_requestbuffers *>(arg));
 		break;
-	case VIDIOC_QUERYBUF:
-		ret = vidioc_querybuf(file, static_cast<struct v4l2_buffer *>(arg));
-		break;
-	case VIDIOC_QBUF:
-		ret = vidioc_qbuf(file, static_cast<struct v4l2_buffer *>(arg));
-		break;
-	case VIDIOC_DQBUF:
-		ret = vidioc_dqbuf(file, static_cast<struct v4l2_buffer *>(arg), &proxyMutex_);
-		break;
 	case VIDIOC_EXPBUF:
 		ret = vidioc_expbuf(file, static_cast<struct v4l2_exportbuffer *>(arg));
 		break;
@@ -868,6 +1103,188 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long longRequest, void
 		break;
 	}
 
+	return ret;
+}
+
+int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long longRequest, void *arg)
+{
+	/*
+	 * The Linux Kernel only processes 32 bits of an IOCTL.
+	 *
+	 * Prevent unexpected sign-extensions that could occur if applications
+	 * use a signed int for the ioctl request, which would sign-extend to
+	 * an incorrect value for unsigned longs on 64 bit architectures by
+	 * explicitly casting as an unsigned int here.
+	 */
+	unsigned int request = longRequest;
+
+	if (!arg && (_IOC_DIR(request) & _IOC_WRITE)) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (supportedIoctls_.find(request) == supportedIoctls_.end()) {
+		errno = ENOTTY;
+		return -1;
+	}
+
+	if (!arg && (_IOC_DIR(request) & _IOC_READ)) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	int ret;
+	switch (request) {
+	case VIDIOC_QUERYBUF:
+	case VIDIOC_QBUF:
+	case VIDIOC_DQBUF: {
+		MutexLocker locker(queueMutex_);
+		ret = queueIoctl(file, request, arg);
+		break;
+	}
+	default: {
+		MutexLocker locker(proxyMutex_);
+		MutexLocker queueLocker(queueMutex_);
+		ret = deviceIoctl(file, request, arg);
+		break;
+	}
+	}
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Emulate the read() I/O method with MMAP buffers, which are all queued when
+ * the stream is started by the first read() call.
+ */
+int V4L2CameraProxy::readStart(V4L2CameraFile *file)
+{
+	if (isReader(file))
+		return -EBUSY;
+
+	/* read() can't be used once buffers have been requested. */
+	if (bufferCount_ > 0)
+		return -EBUSY;
+
+	struct v4l2_requestbuffers reqbufs = {};
+	reqbufs.count = kReadBufferCount;
+	reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbufs.memory = V4L2_MEMORY_MMAP;
+
+	int ret = vidioc_reqbufs(file, &reqbufs);
+	if (ret < 0)
+		return ret;
+
+	for (unsigned int i = 0; i < bufferCount_ && ret >= 0; i++)
+		ret = vcam_->qbuf(i);
+
+	if (ret >= 0)
+		ret = vcam_->streamOn();
+
+	if (ret < 0) {
+		vcam_->streamOff();
+		freeBuffers();
+		release(file);
+		return ret;
+	}
+
+	readMode_ = true;
+
+	return 0;
+}
+
+void V4L2CameraProxy::readStop()
+{
+	vcam_->streamOff();
+	freeBuffers();
+
+	readMode_ = false;
+}
+
+/*
+ * Dequeue all the completed buffers and return the index of the most recent
+ * successful frame, queuing the other buffers back right away. A slow reader
+ * thus drops frames instead of holding the buffers the camera needs. Return
+ * -EAGAIN if no frame is available.
+ */
+int V4L2CameraProxy::dequeueLatestBuffer(V4L2CameraFile *file)
+{
+	int latest = -EAGAIN;
+	int index;
+
+	while ((index = vcam_->dequeueBuffer()) >= 0) {
+		clearEvent(file);
+
+		const FrameMetadata *fmd = vcam_->bufferMetadata(index);
+		if (!fmd || fmd->status != FrameMetadata::FrameSuccess) {
+			vcam_->qbuf(index);
+			continue;
+		}
+
+		if (latest >= 0) {
+			LOG(V4L2Compat, Debug) << "Dropping frame " << latest;
+			vcam_->qbuf(latest);
+		}
+
+		latest = index;
+	}
+
+	return latest;
+}
+
+ssize_t V4L2CameraProxy::read(V4L2CameraFile *file, void *buf, size_t count)
+{
+	LOG(V4L2Compat, Debug)
+		<< "[" << file->description() << "] " << __func__
+		<< "(count=" << count << ")";
+
+	MutexLocker locker(proxyMutex_);
+	MutexLocker queueLocker(queueMutex_);
+
+	int ret = 0;
+	if (!readMode_)
+		ret = readStart(file);
+	else if (!hasOwnership(file))
+		ret = -EBUSY;
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	int index;
+	while ((index = dequeueLatestBuffer(file)) < 0) {
+		if (file->nonBlocking()) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		queueLocker.unlock();
+		locker.unlock();
+		vcam_->waitForBufferAvailable();
+		locker.lock();
+		queueLocker.lock();
+
+		/* The stream may have been stopped while waiting. */
+		if (!readMode_ || !vcam_->isRunning()) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	/*
+	 * The frame is copied from the mapping of the buffer kept by the
+	 * camera, and the remainder of the frame is discarded if the user
+	 * buffer is too small, as done by videobuf2.
+	 */
+	ret = vcam_->copyBuffer(index, buf, count);
+	vcam_->qbuf(index);
+
 	if (ret < 0) {
 		errno = -ret;
 		return -1;
@@ -881,6 +1298,22 @@ bool V4L2CameraProxy::hasOwnership(V4L2CameraFile *file)
 	return owner_ == file;
 }
 
+/*
+ * A file is a reader when it has allocated buffers to share the stream, or
+ * when another file owns the camera.
+ */
+bool V4L2CameraProxy::isReader(V4L2CameraFile *file)
+{
+	return readers_.count(file) || (owner_ && owner_ != file);
+}
+
+std::shared_ptr<V4L2CameraReader> V4L2CameraProxy::reader(V4L2CameraFile *file)
+{
+	auto iter = readers_.find(file);
+
+	return iter != readers_.end() ? iter->second : nullptr;
+}
+
 /**
  * \brief Acquire exclusive ownership of the V4L2Camera
  *
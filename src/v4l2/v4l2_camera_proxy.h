@@ -19,6 +19,7 @@
 #include <libcamera/camera.h>
 
 #include "v4l2_camera.h"
+#include "v4l2_camera_reader.h"
 
 class V4L2CameraFile;
 
@@ -27,15 +28,20 @@ class V4L2CameraProxy
 public:
 	V4L2CameraProxy(unsigned int index, std::shared_ptr<libcamera::Camera> camera);
 
-	int open(V4L2CameraFile *file) LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
-	void close(V4L2CameraFile *file) LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
+	int open(V4L2CameraFile *file)
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, queueMutex_);
+	void close(V4L2CameraFile *file)
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, queueMutex_);
 	void *mmap(V4L2CameraFile *file, void *addr, size_t length, int prot,
-		   int flags, off64_t offset) LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
+		   int flags, off64_t offset)
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, queueMutex_);
 	int munmap(V4L2CameraFile *file, void *addr, size_t length)
-		LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, queueMutex_);
 
 	int ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
-		LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, queueMutex_);
+	ssize_t read(V4L2CameraFile *file, void *buf, size_t count)
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, queueMutex_);
 
 private:
 	bool validateBufferType(uint32_t type);
@@ -44,8 +50,22 @@ private:
 	void querycap(std::shared_ptr<libcamera::Camera> camera);
 	int tryFormat(struct v4l2_format *arg);
 	enum v4l2_priority maxPriority();
-	void updateBuffers();
+	bool isCurrentFormat(const struct v4l2_pix_format &pix);
+	void updateBuffer(unsigned int index);
 	void freeBuffers();
+	void shareFrame(unsigned int index) LIBCAMERA_TSA_EXCLUDES(readersMutex_);
+	void clearEvent(V4L2CameraFile *file);
+
+	int readStart(V4L2CameraFile *file)
+		LIBCAMERA_TSA_REQUIRES(proxyMutex_, queueMutex_);
+	void readStop() LIBCAMERA_TSA_REQUIRES(proxyMutex_, queueMutex_);
+	int dequeueLatestBuffer(V4L2CameraFile *file)
+		LIBCAMERA_TSA_REQUIRES(queueMutex_);
+
+	int queueIoctl(V4L2CameraFile *file, unsigned int request, void *arg)
+		LIBCAMERA_TSA_REQUIRES(queueMutex_);
+	int deviceIoctl(V4L2CameraFile *file, unsigned int request, void *arg)
+		LIBCAMERA_TSA_REQUIRES(proxyMutex_, queueMutex_);
 
 	int vidioc_querycap(V4L2CameraFile *file, struct v4l2_capability *arg);
 	int vidioc_enum_framesizes(V4L2CameraFile *file, struct v4l2_frmsizeenum *arg);
@@ -68,7 +88,12 @@ private:
 	int vidioc_streamon(V4L2CameraFile *file, int *arg);
 	int vidioc_streamoff(V4L2CameraFile *file, int *arg);
 
+	int readerReqbufs(V4L2CameraFile *file, struct v4l2_requestbuffers *arg)
+		LIBCAMERA_TSA_EXCLUDES(readersMutex_);
+
 	bool hasOwnership(V4L2CameraFile *file);
+	bool isReader(V4L2CameraFile *file);
+	std::shared_ptr<V4L2CameraReader> reader(V4L2CameraFile *file);
 	int acquire(V4L2CameraFile *file);
 	void release(V4L2CameraFile *file);
 
@@ -79,8 +104,8 @@ private:
 
 	libcamera::StreamConfiguration streamConfig_;
 	unsigned int bufferCount_;
-	unsigned int currentBuf_;
 	unsigned int sizeimage_;
+	uint32_t memory_;
 
 	struct v4l2_capability capabilities_;
 	struct v4l2_pix_format v4l2PixFormat_;
@@ -88,6 +113,9 @@ private:
 	std::vector<struct v4l2_buffer> buffers_;
 	std::map<void *, unsigned int> mmaps_;
 
+	/* Set when the owner captures with read() instead of streaming I/O. */
+	bool readMode_;
+
 	std::set<V4L2CameraFile *> files_;
 
 	std::unique_ptr<V4L2Camera> vcam_;
@@ -97,12 +125,34 @@ private:
 	 * When there is no owner, anybody can call any ioctl before reqbufs.
 	 * The first file to call reqbufs with count > 0 or s_fmt will become
 	 * the owner, and when the owner calls reqbufs with count = 0 it will
-	 * release ownership. Any buffer-related ioctl (except querybuf) or
-	 * s_fmt that is called by a non-owner while there exists an owner
-	 * will return -EBUSY.
+	 * release ownership. The other files that call reqbufs while there
+	 * exists an owner become readers of the owner's stream, see
+	 * readers_.
 	 */
 	V4L2CameraFile *owner_;
 
-	/* This mutex is to serialize access to the proxy. */
+	/*
+	 * The readers receive copies of the frames captured for the owner,
+	 * in MMAP buffers of their own, when they have buffers queued. They
+	 * can't change the format, and the owner can't change it either while
+	 * readers exist. The map is modified with all the mutexes held, and
+	 * accessed by the camera thread with the readers mutex only.
+	 */
+	std::map<V4L2CameraFile *, std::shared_ptr<V4L2CameraReader>> readers_;
+
+	/*
+	 * The proxy mutex serializes the configuration of the proxy, and the
+	 * queue mutex the accesses to the buffers. The ioctls that only
+	 * operate on buffers (VIDIOC_QUERYBUF, VIDIOC_QBUF and VIDIOC_DQBUF)
+	 * take the queue mutex only, so that queuing and dequeuing buffers
+	 * from different threads doesn't contend with the other ioctls. All
+	 * other operations take both mutexes, the proxy mutex first.
+	 *
+	 * The mutexes are shared between the application threads and the
+	 * libcamera threads, which may run with real-time priorities. Use
+	 * priority inheritance to avoid priority inversion.
+	 */
 	libcamera::Mutex proxyMutex_;
+	libcamera::Mutex queueMutex_;
+	libcamera::Mutex readersMutex_;
 };
@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * V4L2 compatibility shared stream reader
+ */
+
+#include "v4l2_camera_reader.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "v4l2_camera.h"
+#include "v4l2_compat_manager.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(V4L2Compat)
+
+V4L2CameraReader::V4L2CameraReader(int efd)
+	: efd_(efd), memory_(nullptr), size_(0), sizeimage_(0),
+	  bufferCount_(0), streaming_(false)
+{
+}
+
+V4L2CameraReader::~V4L2CameraReader()
+{
+	if (memory_)
+		V4L2CompatManager::instance()->fops().munmap(memory_, size_);
+}
+
+/*
+ * Allocate the buffers in a single memfd, the buffer at index i being stored
+ * at offset i * sizeimage, which is also the offset used to mmap() it.
+ */
+int V4L2CameraReader::allocBuffers(unsigned int count, unsigned int sizeimage)
+{
+#if HAVE_MEMFD_CREATE
+	int fd = memfd_create("v4l2-compat", MFD_CLOEXEC);
+#else
+	int fd = syscall(SYS_memfd_create, "v4l2-compat", MFD_CLOEXEC);
+#endif
+	if (fd < 0)
+		return -errno;
+
+	memfd_ = UniqueFD(fd);
+
+	size_t size = static_cast<size_t>(count) * sizeimage;
+	if (ftruncate(memfd_.get(), size) < 0)
+		return -errno;
+
+	void *mem = V4L2CompatManager::instance()->fops().mmap(nullptr, size,
+							       PROT_READ | PROT_WRITE,
+							       MAP_SHARED,
+							       memfd_.get(), 0);
+	if (mem == MAP_FAILED)
+		return -errno;
+
+	memory_ = static_cast<uint8_t *>(mem);
+	size_ = size;
+	sizeimage_ = sizeimage;
+	bufferCount_ = count;
+
+	MutexLocker locker(mutex_);
+
+	buffers_.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		struct v4l2_buffer buf = {};
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.length = sizeimage;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.m.offset = i * sizeimage;
+		buf.index = i;
+		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+		buffers_[i] = buf;
+	}
+
+	return 0;
+}
+
+bool V4L2CameraReader::isStreaming()
+{
+	MutexLocker locker(mutex_);
+
+	return streaming_;
+}
+
+void *V4L2CameraReader::mmap(void *addr, size_t length, int prot, int flags,
+			     off64_t offset)
+{
+	if (!(prot & PROT_READ) || !(flags & MAP_SHARED)) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	unsigned int index = offset / sizeimage_;
+	if (static_cast<off64_t>(index) * sizeimage_ != offset ||
+	    index >= bufferCount_ || length != sizeimage_) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	void *map = V4L2CompatManager::instance()->fops().mmap(addr, length, prot,
+							       flags, memfd_.get(),
+							       offset);
+	if (map == MAP_FAILED)
+		return map;
+
+	MutexLocker locker(mutex_);
+
+	buffers_[index].flags |= V4L2_BUF_FLAG_MAPPED;
+	mmaps_[map] = index;
+
+	return map;
+}
+
+int V4L2CameraReader::munmap(void *addr, size_t length)
+{
+	auto iter = mmaps_.find(addr);
+	if (iter == mmaps_.end() || length != sizeimage_) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (V4L2CompatManager::instance()->fops().munmap(addr, length))
+		LOG(V4L2Compat, Error) << "Failed to unmap " << addr
+				       << " with length " << length;
+
+	MutexLocker locker(mutex_);
+
+	buffers_[iter->second].flags &= ~V4L2_BUF_FLAG_MAPPED;
+	mmaps_.erase(iter);
+
+	return 0;
+}
+
+int V4L2CameraReader::querybuf(struct v4l2_buffer *arg)
+{
+	MutexLocker locker(mutex_);
+
+	if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	    arg->index >= buffers_.size())
+		return -EINVAL;
+
+	*arg = buffers_[arg->index];
+
+	return 0;
+}
+
+int V4L2CameraReader::qbuf(struct v4l2_buffer *arg)
+{
+	MutexLocker locker(mutex_);
+
+	if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	    arg->memory != V4L2_MEMORY_MMAP ||
+	    arg->index >= buffers_.size())
+		return -EINVAL;
+
+	struct v4l2_buffer &buf = buffers_[arg->index];
+	if (buf.flags & V4L2_BUF_FLAG_QUEUED)
+		return -EINVAL;
+
+	buf.flags &= ~(V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_ERROR);
+	buf.flags |= V4L2_BUF_FLAG_QUEUED;
+	queued_.push_back(arg->index);
+
+	arg->flags = buf.flags;
+
+	return 0;
+}
+
+int V4L2CameraReader::dqbuf(struct v4l2_buffer *arg, bool nonBlocking)
+{
+	MutexLocker locker(mutex_);
+
+	if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+	    arg->memory != V4L2_MEMORY_MMAP || !streaming_)
+		return -EINVAL;
+
+	if (done_.empty()) {
+		if (nonBlocking)
+			return -EAGAIN;
+
+		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return !done_.empty() || !streaming_;
+		});
+
+		/* The stream may have been turned off while waiting. */
+		if (!streaming_)
+			return -EINVAL;
+	}
+
+	unsigned int index = done_.front();
+	done_.pop_front();
+
+	struct v4l2_buffer &buf = buffers_[index];
+	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
+
+	*arg = buf;
+
+	uint64_t data;
+	int ret = V4L2CompatManager::instance()->fops().read(efd_, &data,
+							      sizeof(data));
+	if (ret != sizeof(data))
+		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+
+	return 0;
+}
+
+int V4L2CameraReader::streamOn()
+{
+	MutexLocker locker(mutex_);
+
+	streaming_ = true;
+
+	return 0;
+}
+
+void V4L2CameraReader::streamOff()
+{
+	{
+		MutexLocker locker(mutex_);
+
+		if (!streaming_)
+			return;
+
+		streaming_ = false;
+
+		/* Clear the eventfd counts of the buffers not dequeued. */
+		const V4L2CompatManager::FileOperations &fops =
+			V4L2CompatManager::instance()->fops();
+		for (size_t i = 0; i < done_.size(); i++) {
+			uint64_t data;
+			if (fops.read(efd_, &data, sizeof(data)) != sizeof(data))
+				break;
+		}
+
+		queued_.clear();
+		done_.clear();
+
+		for (struct v4l2_buffer &buf : buffers_)
+			buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
+	}
+
+	cv_.notify_all();
+}
+
+/*
+ * Copy the frame completed in the camera buffer at index to the first
+ * buffer queued by the reader. The frame is dropped if the reader has no
+ * buffer queued, the owner of the camera never waits for the readers.
+ */
+void V4L2CameraReader::shareFrame(V4L2Camera *camera, unsigned int index)
+{
+	{
+		MutexLocker locker(mutex_);
+
+		if (!streaming_ || queued_.empty())
+			return;
+
+		const FrameMetadata *fmd = camera->bufferMetadata(index);
+		if (!fmd || fmd->status != FrameMetadata::FrameSuccess)
+			return;
+
+		unsigned int readerIndex = queued_.front();
+		queued_.pop_front();
+
+		struct v4l2_buffer &buf = buffers_[readerIndex];
+
+		int ret = camera->copyBuffer(index, memory_ + buf.m.offset,
+					     buf.length);
+		if (ret < 0) {
+			LOG(V4L2Compat, Error)
+				<< "Failed to share buffer " << index;
+			buf.bytesused = 0;
+			buf.flags |= V4L2_BUF_FLAG_ERROR;
+		} else {
+			buf.bytesused = ret;
+		}
+
+		buf.field = V4L2_FIELD_NONE;
+		buf.timestamp.tv_sec = fmd->timestamp / 1000000000;
+		buf.timestamp.tv_usec = (fmd->timestamp / 1000) % 1000000;
+		buf.sequence = fmd->sequence;
+		buf.flags |= V4L2_BUF_FLAG_DONE;
+
+		done_.push_back(readerIndex);
+
+		/*
+		 * Signal the eventfd with the lock held, so that dqbuf() never
+		 * finds a done buffer without its count.
+		 */
+		uint64_t data = 1;
+		if (::write(efd_, &data, sizeof(data)) != sizeof(data))
+			LOG(V4L2Compat, Error) << "Failed to signal eventfd POLLIN";
+	}
+
+	cv_.notify_all();
+}
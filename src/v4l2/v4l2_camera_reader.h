@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * V4L2 compatibility shared stream reader
+ */
+
+#pragma once
+
+#include <deque>
+#include <linux/videodev2.h>
+#include <map>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/unique_fd.h>
+
+class V4L2Camera;
+
+/*
+ * A reader receives copies of the frames captured for the file that owns the
+ * camera, in buffers of its own. This allows additional files to capture the
+ * stream the owner has configured, without reconfiguring the camera.
+ */
+class V4L2CameraReader
+{
+public:
+	V4L2CameraReader(int efd);
+	~V4L2CameraReader();
+
+	int allocBuffers(unsigned int count, unsigned int sizeimage);
+	unsigned int bufferCount() const { return bufferCount_; }
+
+	bool isMapped() const { return !mmaps_.empty(); }
+	bool isStreaming() LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	void *mmap(void *addr, size_t length, int prot, int flags,
+		   off64_t offset) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int munmap(void *addr, size_t length) LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	int querybuf(struct v4l2_buffer *arg) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int qbuf(struct v4l2_buffer *arg) LIBCAMERA_TSA_EXCLUDES(mutex_);
+	int dqbuf(struct v4l2_buffer *arg, bool nonBlocking)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	int streamOn() LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void streamOff() LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+	void shareFrame(V4L2Camera *camera, unsigned int index)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+
+private:
+	int efd_;
+
+	libcamera::UniqueFD memfd_;
+	uint8_t *memory_;
+	size_t size_;
+	unsigned int sizeimage_;
+	unsigned int bufferCount_;
+
+	/* Only accessed from the proxy, which serializes the calls. */
+	std::map<void *, unsigned int> mmaps_;
+
+	libcamera::Mutex mutex_;
+	libcamera::ConditionVariable cv_;
+
+	std::vector<struct v4l2_buffer> buffers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::deque<unsigned int> queued_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::deque<unsigned int> done_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool streaming_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
@@ -30,6 +30,9 @@ using namespace libcamera;
 
 extern "C" {
 
+/* Provided by glibc, but not declared in any public header */
+[[noreturn]] void __chk_fail(void);
+
 LIBCAMERA_PUBLIC int open(const char *path, int oflag, ...)
 {
 	mode_t mode = 0;
@@ -104,6 +107,22 @@ LIBCAMERA_PUBLIC int close(int fd)
 	return V4L2CompatManager::instance()->close(fd);
 }
 
+LIBCAMERA_PUBLIC ssize_t read(int fd, void *buf, size_t count)
+{
+	return V4L2CompatManager::instance()->read(fd, buf, count);
+}
+
+/* _FORTIFY_SOURCE redirects read to __read_chk */
+LIBCAMERA_PUBLIC ssize_t __read_chk(int fd, void *buf, size_t count,
+				    size_t buflen)
+{
+	/* Match the glibc implementation and abort on buffer overflows. */
+	if (count > buflen)
+		__chk_fail();
+
+	return read(fd, buf, count);
+}
+
 LIBCAMERA_PUBLIC void *mmap(void *addr, size_t length, int prot, int flags,
 			    int fd, off_t offset)
 {
@@ -46,6 +46,7 @@ V4L2CompatManager::V4L2CompatManager()
 	get_symbol(fops_.openat, "openat64");
 	get_symbol(fops_.dup, "dup");
 	get_symbol(fops_.close, "close");
+	get_symbol(fops_.read, "read");
 	get_symbol(fops_.ioctl, "ioctl");
 	get_symbol(fops_.mmap, "mmap64");
 	get_symbol(fops_.munmap, "munmap");
@@ -209,6 +210,15 @@ int V4L2CompatManager::close(int fd)
 	return fops_.close(fd);
 }
 
+ssize_t V4L2CompatManager::read(int fd, void *buf, size_t count)
+{
+	std::shared_ptr<V4L2CameraFile> file = cameraFile(fd);
+	if (!file)
+		return fops_.read(fd, buf, count);
+
+	return file->proxy()->read(file.get(), buf, count);
+}
+
 void *V4L2CompatManager::mmap(void *addr, size_t length, int prot, int flags,
 			      int fd, off64_t offset)
 {
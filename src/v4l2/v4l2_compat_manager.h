@@ -25,6 +25,7 @@ public:
 					      int oflag, ...);
 		using dup_func_t = int (*)(int oldfd);
 		using close_func_t = int (*)(int fd);
+		using read_func_t = ssize_t (*)(int fd, void *buf, size_t count);
 		using ioctl_func_t = int (*)(int fd, unsigned long request, ...);
 		using mmap_func_t = void *(*)(void *addr, size_t length, int prot,
 					      int flags, int fd, off64_t offset);
@@ -33,6 +34,7 @@ public:
 		openat_func_t openat;
 		dup_func_t dup;
 		close_func_t close;
+		read_func_t read;
 		ioctl_func_t ioctl;
 		mmap_func_t mmap;
 		munmap_func_t munmap;
@@ -46,6 +48,7 @@ public:
 
 	int dup(int oldfd);
 	int close(int fd);
+	ssize_t read(int fd, void *buf, size_t count);
 	void *mmap(void *addr, size_t length, int prot, int flags,
 		   int fd, off64_t offset);
 	int munmap(void *addr, size_t length);
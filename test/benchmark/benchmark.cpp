@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * libcamera benchmark base class
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/unique_fd.h>
+
+using namespace libcamera;
+using namespace std::chrono;
+
+namespace {
+
+/* Duration of each measurement run */
+constexpr nanoseconds kRunDuration = milliseconds(100);
+
+/* Number of runs, the median is reported */
+constexpr unsigned int kRuns = 5;
+
+} /* namespace */
+
+void Benchmark::setBenchmarkArgs(int argc, char *argv[])
+{
+	args_.assign(argv + 1, argv + argc);
+}
+
+/*
+ * Run the function with a number of iterations that lasts about kRunDuration,
+ * kRuns times, and print the median and minimum time per iteration. The
+ * number of iterations is first calibrated by doubling it until the function
+ * runs for a tenth of kRunDuration.
+ */
+void Benchmark::measure(const std::string &name, const Function &func)
+{
+	uint64_t iterations = 1;
+	nanoseconds elapsed;
+
+	while (true) {
+		auto start = steady_clock::now();
+		func(iterations);
+		elapsed = steady_clock::now() - start;
+
+		if (elapsed >= kRunDuration / 10 || iterations >= (1U << 30))
+			break;
+
+		iterations *= 2;
+	}
+
+	if (elapsed < kRunDuration)
+		iterations = std::max<uint64_t>(iterations * kRunDuration.count() /
+						std::max<int64_t>(elapsed.count(), 1), 1);
+
+	std::vector<double> samples;
+
+	for (unsigned int i = 0; i < kRuns; i++) {
+		auto start = steady_clock::now();
+		func(iterations);
+		elapsed = steady_clock::now() - start;
+
+		samples.push_back(static_cast<double>(elapsed.count()) / iterations);
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	std::cout << std::left << std::setw(48) << name << std::right
+		  << std::fixed << std::setprecision(1)
+		  << std::setw(14) << samples[kRuns / 2] << " ns/op"
+		  << " (min " << samples.front() << ", "
+		  << iterations << " iterations)" << std::endl;
+}
+
+/*
+ * Create a frame buffer backed by a memfd, with all planes stored
+ * contiguously in the same file.
+ */
+std::unique_ptr<FrameBuffer>
+Benchmark::createBuffer(const std::vector<unsigned int> &planeSizes)
+{
+	size_t size = std::accumulate(planeSizes.begin(), planeSizes.end(), 0UL);
+
+#if HAVE_MEMFD_CREATE
+	int ret = memfd_create("benchmark", MFD_CLOEXEC);
+#else
+	int ret = syscall(SYS_memfd_create, "benchmark", MFD_CLOEXEC);
+#endif
+	if (ret < 0)
+		return nullptr;
+
+	UniqueFD memfd(ret);
+	if (ftruncate(memfd.get(), size) < 0)
+		return nullptr;
+
+	SharedFD fd(std::move(memfd));
+	std::vector<FrameBuffer::Plane> planes;
+	unsigned int offset = 0;
+
+	for (unsigned int planeSize : planeSizes) {
+		FrameBuffer::Plane plane;
+		plane.fd = fd;
+		plane.offset = offset;
+		plane.length = planeSize;
+		planes.push_back(plane);
+
+		offset += planeSize;
+	}
+
+	return std::make_unique<FrameBuffer>(planes);
+}
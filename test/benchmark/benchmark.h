@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * libcamera benchmark base class
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+
+#include "test.h"
+
+class Benchmark : public Test
+{
+public:
+	void setBenchmarkArgs(int argc, char *argv[]);
+
+protected:
+	/*
+	 * A benchmark function runs the measured operation the given number
+	 * of times.
+	 */
+	using Function = std::function<void(unsigned int iterations)>;
+
+	void measure(const std::string &name, const Function &func);
+
+	template<typename T>
+	static void doNotOptimize(const T &value)
+	{
+		asm volatile("" : : "g"(&value) : "memory");
+	}
+
+	static std::unique_ptr<libcamera::FrameBuffer>
+	createBuffer(const std::vector<unsigned int> &planeSizes);
+
+	const std::vector<std::string> &args() const { return args_; }
+
+private:
+	std::vector<std::string> args_;
+};
+
+#define BENCHMARK_REGISTER(Klass)					\
+int main(int argc, char *argv[])					\
+{									\
+	Klass klass;							\
+	klass.setArgs(argc, argv);					\
+	klass.setBenchmarkArgs(argc, argv);				\
+	return klass.execute();						\
+}
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Benchmark the control lists and their serialization
+ */
+
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class ControlsBenchmark : public Benchmark
+{
+protected:
+	int init() override
+	{
+		ControlInfoMap::Map map;
+		map[&controls::AeEnable] = ControlInfo(false, true, true);
+		map[&controls::ExposureTime] = ControlInfo(1, 100000, 10000);
+		map[&controls::AnalogueGain] = ControlInfo(1.0f, 16.0f, 1.0f);
+		map[&controls::DigitalGain] = ControlInfo(1.0f, 16.0f, 1.0f);
+		map[&controls::Brightness] = ControlInfo(-1.0f, 1.0f, 0.0f);
+		map[&controls::Contrast] = ControlInfo(0.0f, 2.0f, 1.0f);
+		map[&controls::Saturation] = ControlInfo(0.0f, 2.0f, 1.0f);
+		map[&controls::AwbEnable] = ControlInfo(false, true, true);
+		map[&controls::ColourGains] = ControlInfo(0.0f, 8.0f);
+		map[&controls::ColourTemperature] = ControlInfo(2500, 10000, 5000);
+		map[&controls::ColourCorrectionMatrix] = ControlInfo(-8.0f, 8.0f);
+		map[&controls::FrameDurationLimits] =
+			ControlInfo(int64_t(33333), int64_t(1000000), int64_t(33333));
+		map[&controls::SensorTimestamp] = ControlInfo(int64_t(0), INT64_MAX);
+		map[&controls::Lux] = ControlInfo(0.0f, 100000.0f);
+
+		infoMap_ = ControlInfoMap(std::move(map), controls::controls);
+
+		return TestPass;
+	}
+
+	/* Fill the list with the typical metadata of a frame. */
+	void fill(ControlList &list, unsigned int frame)
+	{
+		list.set(controls::AeEnable, true);
+		list.set(controls::ExposureTime, 10000 + frame % 100);
+		list.set(controls::AnalogueGain, 2.0f);
+		list.set(controls::DigitalGain, 1.0f);
+		list.set(controls::Brightness, 0.0f);
+		list.set(controls::Contrast, 1.0f);
+		list.set(controls::Saturation, 1.0f);
+		list.set(controls::AwbEnable, true);
+		list.set(controls::ColourGains, { 1.5f, 1.8f });
+		list.set(controls::ColourTemperature, 5000);
+		list.set(controls::ColourCorrectionMatrix,
+			 { 1.6f, -0.4f, -0.2f, -0.3f, 1.5f, -0.2f, 0.0f, -0.6f, 1.6f });
+		list.set(controls::FrameDurationLimits, { int64_t(33333), int64_t(33333) });
+		list.set(controls::SensorTimestamp, int64_t(frame) * 33333000);
+		list.set(controls::Lux, 400.0f);
+	}
+
+	int run() override
+	{
+		measure("ControlList::set (scalar)", [&](unsigned int iterations) {
+			ControlList list(infoMap_);
+			for (unsigned int i = 0; i < iterations; i++)
+				list.set(controls::ExposureTime, i);
+			doNotOptimize(list);
+		});
+
+		measure("ControlList::set (array)", [&](unsigned int iterations) {
+			ControlList list(infoMap_);
+			for (unsigned int i = 0; i < iterations; i++)
+				list.set(controls::ColourGains,
+					 { static_cast<float>(i), 1.0f });
+			doNotOptimize(list);
+		});
+
+		measure("ControlList::get", [&](unsigned int iterations) {
+			ControlList list(infoMap_);
+			fill(list, 0);
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(list.get(controls::ExposureTime));
+		});
+
+		measure("ControlList fill (14 controls)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				ControlList list(infoMap_);
+				fill(list, i);
+				doNotOptimize(list);
+			}
+		});
+
+		ControlList source(infoMap_);
+		fill(source, 0);
+
+		measure("ControlList::merge (empty)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				ControlList list(infoMap_);
+				list.merge(source);
+				doNotOptimize(list);
+			}
+		});
+
+		measure("ControlList::merge (overwrite)", [&](unsigned int iterations) {
+			ControlList list(infoMap_);
+			fill(list, 1);
+			for (unsigned int i = 0; i < iterations; i++)
+				list.merge(source, ControlList::MergePolicy::OverwriteExisting);
+			doNotOptimize(list);
+		});
+
+		int ret = runControlSerializer(source);
+		if (ret != TestPass)
+			return ret;
+
+		return runIPADataSerializer(source);
+	}
+
+	int runControlSerializer(const ControlList &list)
+	{
+		ControlSerializer serializer(ControlSerializer::Role::Proxy);
+		ControlSerializer deserializer(ControlSerializer::Role::Worker);
+
+		/* Serialize the info map first to register its handle. */
+		std::vector<uint8_t> infoData(serializer.binarySize(infoMap_));
+		ByteStreamBuffer infoBuffer(infoData.data(), infoData.size());
+		if (serializer.serialize(infoMap_, infoBuffer) < 0) {
+			std::cerr << "Failed to serialize ControlInfoMap" << std::endl;
+			return TestFail;
+		}
+
+		infoBuffer = ByteStreamBuffer(const_cast<const uint8_t *>(infoData.data()),
+					      infoData.size());
+		deserializer.deserialize<ControlInfoMap>(infoBuffer);
+
+		std::vector<uint8_t> data(serializer.binarySize(list));
+
+		measure("ControlSerializer::binarySize", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(serializer.binarySize(list));
+		});
+
+		measure("ControlSerializer::serialize", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				ByteStreamBuffer buffer(data.data(), data.size());
+				serializer.serialize(list, buffer);
+				doNotOptimize(data);
+			}
+		});
+
+		measure("ControlSerializer::serializeDelta", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				ByteStreamBuffer buffer(data.data(), data.size());
+				serializer.serializeDelta(list, buffer);
+				doNotOptimize(data);
+			}
+		});
+
+		ByteStreamBuffer buffer(data.data(), data.size());
+		if (serializer.serialize(list, buffer) < 0) {
+			std::cerr << "Failed to serialize ControlList" << std::endl;
+			return TestFail;
+		}
+
+		measure("ControlSerializer::deserialize", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				ByteStreamBuffer in(const_cast<const uint8_t *>(data.data()),
+						    data.size());
+				doNotOptimize(deserializer.deserialize<ControlList>(in));
+			}
+		});
+
+		return TestPass;
+	}
+
+	int runIPADataSerializer(const ControlList &list)
+	{
+		ControlSerializer cs(ControlSerializer::Role::Proxy);
+		IPADataSerializer<ControlInfoMap>::serialize(infoMap_, &cs);
+
+		measure("IPADataSerializer<ControlList> round trip", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				std::vector<uint8_t> data;
+				std::tie(data, std::ignore) =
+					IPADataSerializer<ControlList>::serialize(list, &cs);
+				doNotOptimize(IPADataSerializer<ControlList>::deserialize(data, &cs));
+			}
+		});
+
+		/* The size of a histogram, as sent with the statistics. */
+		const std::vector<uint32_t> vector(256, 42);
+
+		measure("IPADataSerializer<std::vector<uint32_t>> round trip", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				std::vector<uint8_t> data;
+				std::tie(data, std::ignore) =
+					IPADataSerializer<std::vector<uint32_t>>::serialize(vector);
+				doNotOptimize(IPADataSerializer<std::vector<uint32_t>>::deserialize(data));
+			}
+		});
+
+		const std::map<uint32_t, int32_t> map = {
+			{ 0x00980900, 100 }, { 0x00980901, 200 },
+			{ 0x00980902, 300 }, { 0x00980911, 10000 },
+			{ 0x009e0903, 256 },
+		};
+
+		measure("IPADataSerializer<std::map<uint32_t, int32_t>> round trip", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				std::vector<uint8_t> data;
+				std::tie(data, std::ignore) =
+					IPADataSerializer<std::map<uint32_t, int32_t>>::serialize(map);
+				doNotOptimize(IPADataSerializer<std::map<uint32_t, int32_t>>::deserialize(data));
+			}
+		});
+
+		return TestPass;
+	}
+
+private:
+	ControlInfoMap infoMap_;
+};
+
+BENCHMARK_REGISTER(ControlsBenchmark)
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Benchmark the libipa histogram and piecewise linear functions
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "libipa/histogram.h"
+#include "libipa/pwl.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+using namespace libcamera::ipa;
+
+class LibipaBenchmark : public Benchmark
+{
+protected:
+	int init() override
+	{
+		/* A luminance histogram of a 640x480 image. */
+		std::mt19937 generator(42);
+		std::normal_distribution<double> dist(96.0, 40.0);
+
+		histogramData_.resize(256);
+		for (unsigned int i = 0; i < 640 * 480; i++) {
+			int bin = std::lround(dist(generator));
+			histogramData_[std::clamp(bin, 0, 255)]++;
+		}
+
+		/* A gamma curve, as found in the tuning files. */
+		std::vector<Pwl::Point> points;
+		for (unsigned int i = 0; i <= 32; i++) {
+			double x = i / 32.0;
+			points.push_back(Pwl::Point({ x * 65535, std::pow(x, 1 / 2.2) * 65535 }));
+		}
+		gamma_ = Pwl(points);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		measure("Histogram construction (256 bins)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				Histogram histogram(histogramData_);
+				doNotOptimize(histogram);
+			}
+		});
+
+		Histogram histogram(histogramData_);
+
+		measure("Histogram::quantile", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(histogram.quantile((i % 100) / 100.0));
+		});
+
+		measure("Histogram::interQuantileMean", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(histogram.interQuantileMean(0.02, 0.98));
+		});
+
+		measure("Pwl::eval", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(gamma_.eval(i % 65536));
+		});
+
+		measure("Pwl::eval (span hint)", [&](unsigned int iterations) {
+			int span = -1;
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(gamma_.eval(i % 65536, &span));
+		});
+
+		/* Fill a 1024 entries lookup table, as the software ISP does. */
+		std::vector<double> lut(1024);
+
+		measure("Pwl::sample (1024 points)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				gamma_.sample(0.0, 64.0, lut);
+				doNotOptimize(lut);
+			}
+		});
+
+		measure("Pwl::inverse", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(gamma_.inverse());
+		});
+
+		measure("Pwl::compose", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				doNotOptimize(gamma_.compose(gamma_));
+		});
+
+		return TestPass;
+	}
+
+private:
+	std::vector<uint32_t> histogramData_;
+	Pwl gamma_;
+};
+
+BENCHMARK_REGISTER(LibipaBenchmark)
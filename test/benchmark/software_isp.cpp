@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Benchmark the software ISP debayering and statistics
+ */
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#include "swstats_cpu.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class SoftwareIspBenchmark : public Benchmark
+{
+protected:
+	int init() override
+	{
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+			uint8_t value = i;
+			int16_t gain = i;
+
+			params_.red[i] = value;
+			params_.green[i] = value;
+			params_.blue[i] = value;
+			params_.redCcm[i] = { gain, 0, 0 };
+			params_.greenCcm[i] = { 0, gain, 0 };
+			params_.blueCcm[i] = { 0, 0, gain };
+		}
+
+		for (unsigned int i = 0; i < DebayerParams::kGammaLookupSize; i++)
+			params_.gammaLut[i] = i * 256 / DebayerParams::kGammaLookupSize;
+
+		return TestPass;
+	}
+
+	StreamConfiguration inputConfig(const PixelFormat &format)
+	{
+		const PixelFormatInfo &info = PixelFormatInfo::info(format);
+
+		StreamConfiguration cfg;
+		cfg.pixelFormat = format;
+		cfg.size = kInputSize;
+		cfg.stride = info.stride(kInputSize.width, 0, 1);
+		cfg.frameSize = info.frameSize(kInputSize, 1);
+
+		return cfg;
+	}
+
+	int measureDebayer(const PixelFormat &input, const PixelFormat &output,
+			   bool ccm)
+	{
+		DebayerCpu debayer(std::make_unique<SwStatsCpu>());
+
+		StreamConfiguration inputCfg = inputConfig(input);
+		StreamConfiguration outputCfg;
+		outputCfg.pixelFormat = output;
+		outputCfg.size = debayer.sizes(input, kInputSize).max;
+		std::tie(outputCfg.stride, outputCfg.frameSize) =
+			debayer.strideAndFrameSize(output, outputCfg.size);
+
+		if (debayer.configure(inputCfg, { outputCfg }, Transform::Identity) < 0) {
+			std::cerr << "Failed to configure debayering from "
+				  << input << " to " << output << std::endl;
+			return TestFail;
+		}
+
+		std::unique_ptr<FrameBuffer> in = createBuffer({ inputCfg.frameSize });
+		std::unique_ptr<FrameBuffer> out = createBuffer(debayer.planeSizes(0));
+		if (!in || !out) {
+			std::cerr << "Failed to create buffers" << std::endl;
+			return TestFail;
+		}
+
+		params_.ccmEnabled = ccm;
+
+		measure("DebayerCpu " + input.toString() + " -> " + output.toString() +
+			(ccm ? " (CCM)" : ""),
+			[&](unsigned int iterations) {
+				for (unsigned int i = 0; i < iterations; i++)
+					debayer.process(in.get(), out.get(), nullptr, &params_);
+			});
+
+		debayer.stop();
+
+		return TestPass;
+	}
+
+	int measureStats(const PixelFormat &input)
+	{
+		SwStatsCpu stats;
+
+		StreamConfiguration inputCfg = inputConfig(input);
+		if (!stats.isValid() || stats.configure(inputCfg) < 0) {
+			std::cerr << "Failed to configure statistics for "
+				  << input << std::endl;
+			return TestFail;
+		}
+
+		stats.setWindow(Rectangle(kInputSize));
+
+		std::vector<uint8_t> frame(inputCfg.frameSize);
+		const unsigned int stride = inputCfg.stride;
+
+		/* Visit the line pairs as the debayering functions do. */
+		measure("SwStatsCpu " + input.toString(), [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				const uint8_t *src = frame.data();
+
+				stats.startFrame();
+
+				for (unsigned int y = 0; y < kInputSize.height; y += 2) {
+					const uint8_t *linePointers[3] = { nullptr, src, src + stride };
+					stats.processLine0(y, linePointers);
+					src += 2 * stride;
+				}
+
+				stats.finishFrame(i);
+			}
+		});
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const std::vector<PixelFormat> inputs = {
+			formats::SBGGR8,
+			formats::SBGGR10,
+			formats::SBGGR12,
+			formats::SBGGR10_CSI2P,
+		};
+
+		for (const PixelFormat &input : inputs) {
+			DebayerCpu debayer(std::make_unique<SwStatsCpu>());
+
+			for (const PixelFormat &output : debayer.formats(input)) {
+				int ret = measureDebayer(input, output, false);
+				if (ret != TestPass)
+					return ret;
+			}
+
+			int ret = measureDebayer(input, formats::RGB888, true);
+			if (ret != TestPass)
+				return ret;
+
+			ret = measureStats(input);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		/*
+		 * The CSI-2 packed 12 and 14 bits formats are unpacked when
+		 * copying the input lines, the statistics can't be measured on
+		 * the packed frame.
+		 */
+		for (const PixelFormat &input : { formats::SBGGR12_CSI2P,
+						  formats::SBGGR14_CSI2P }) {
+			int ret = measureDebayer(input, formats::RGB888, false);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		return TestPass;
+	}
+
+private:
+	static constexpr Size kInputSize{ 1920, 1080 };
+
+	DebayerParams params_;
+};
+
+BENCHMARK_REGISTER(SoftwareIspBenchmark)
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Benchmark the cross-thread signals and messages
+ */
+
+#include <memory>
+
+#include <libcamera/base/message.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/semaphore.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/thread.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class Receiver : public Object
+{
+public:
+	Receiver(Semaphore *semaphore)
+		: semaphore_(semaphore), value_(0)
+	{
+	}
+
+	void slot(unsigned int value)
+	{
+		value_ = value;
+		semaphore_->release();
+	}
+
+protected:
+	void message(Message *msg) override
+	{
+		if (msg->type() != Message::None) {
+			Object::message(msg);
+			return;
+		}
+
+		semaphore_->release();
+	}
+
+private:
+	Semaphore *semaphore_;
+	unsigned int value_;
+};
+
+class ThreadsBenchmark : public Benchmark
+{
+protected:
+	int run() override
+	{
+		Semaphore semaphore;
+		Signal<unsigned int> signal;
+
+		/* The receiver lives in the current thread, the call is direct. */
+		Receiver local(&semaphore);
+		signal.connect(&local, &Receiver::slot);
+
+		measure("Signal::emit (direct)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				signal.emit(i);
+			semaphore.acquire(iterations);
+		});
+
+		signal.disconnect(&local);
+
+		/*
+		 * The receiver lives in another thread, each emission queues a
+		 * message. The measurement includes the delivery of all the
+		 * messages.
+		 */
+		Thread thread;
+		Receiver remote(&semaphore);
+		remote.moveToThread(&thread);
+		thread.start();
+
+		signal.connect(&remote, &Receiver::slot);
+
+		measure("Signal::emit (queued)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				signal.emit(i);
+			semaphore.acquire(iterations);
+		});
+
+		measure("Signal::emit (queued, round trip)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				signal.emit(i);
+				semaphore.acquire();
+			}
+		});
+
+		signal.disconnect(&remote);
+
+		measure("Thread::postMessage", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				remote.postMessage(std::make_unique<Message>(Message::None));
+			semaphore.acquire(iterations);
+		});
+
+		measure("Thread::postMessage (round trip)", [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				remote.postMessage(std::make_unique<Message>(Message::None));
+				semaphore.acquire();
+			}
+		});
+
+		thread.exit(0);
+		thread.wait();
+
+		return TestPass;
+	}
+};
+
+BENCHMARK_REGISTER(ThreadsBenchmark)
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Benchmark the V4L2 buffer cache lookups
+ */
+
+#include <array>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class V4L2BufferCacheBenchmark : public Benchmark
+{
+protected:
+	int init() override
+	{
+		/* Two planes, as with the NV12 buffers of most video streams. */
+		for (unsigned int i = 0; i < kNumBuffers; i++) {
+			std::unique_ptr<FrameBuffer> buffer =
+				createBuffer({ 1920 * 1080, 1920 * 1080 / 2 });
+			if (!buffer) {
+				std::cerr << "Failed to create buffers" << std::endl;
+				return TestFail;
+			}
+
+			buffers_.push_back(std::move(buffer));
+		}
+
+		std::mt19937 generator(42);
+		std::uniform_int_distribution<unsigned int> dist(0, kNumBuffers - 1);
+		for (unsigned int &index : randomOrder_)
+			index = dist(generator);
+
+		return TestPass;
+	}
+
+	void measureCache(const std::string &name, unsigned int numEntries,
+			  bool random)
+	{
+		V4L2BufferCache cache(numEntries);
+
+		measure(name, [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++) {
+				unsigned int n = random
+					       ? randomOrder_[i % randomOrder_.size()]
+					       : i % kNumBuffers;
+				int index = cache.get(*buffers_[n]);
+				cache.put(index);
+			}
+		});
+	}
+
+	int run() override
+	{
+		measureCache("V4L2BufferCache::get (sequential)", kNumBuffers, false);
+		measureCache("V4L2BufferCache::get (random)", kNumBuffers, true);
+		measureCache("V4L2BufferCache::get (random, evicting)", kNumBuffers / 2, true);
+
+		return TestPass;
+	}
+
+private:
+	static constexpr unsigned int kNumBuffers = 8;
+
+	std::vector<std::unique_ptr<FrameBuffer>> buffers_;
+	std::array<unsigned int, 1024> randomOrder_;
+};
+
+BENCHMARK_REGISTER(V4L2BufferCacheBenchmark)
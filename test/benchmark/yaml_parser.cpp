@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Benchmark the YAML parser on the IPA tuning files
+ */
+
+#include <glob.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/file.h>
+
+#include "libcamera/internal/yaml_parser.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+class YamlParserBenchmark : public Benchmark
+{
+protected:
+	int init() override
+	{
+		if (args().empty()) {
+			std::cout << "No IPA source directory specified" << std::endl;
+			return TestSkip;
+		}
+
+		const std::string &ipaDir = args()[0];
+
+		for (const char *pattern : { "/*/data/*.yaml", "/rpi/*/data/*.json" }) {
+			glob_t matches;
+			if (glob((ipaDir + pattern).c_str(), 0, nullptr, &matches))
+				continue;
+
+			for (size_t i = 0; i < matches.gl_pathc; i++)
+				files_.push_back(matches.gl_pathv[i]);
+
+			globfree(&matches);
+		}
+
+		if (files_.empty()) {
+			std::cout << "No tuning file found in " << ipaDir << std::endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const std::string &ipaDir = args()[0];
+
+		for (const std::string &path : files_) {
+			/* The parser reads the file, reopen it on every iteration. */
+			File file(path);
+			if (!file.open(File::OpenModeFlag::ReadOnly) ||
+			    !YamlParser::parse(file)) {
+				std::cerr << "Failed to parse " << path << std::endl;
+				return TestFail;
+			}
+
+			measure("YamlParser::parse " + path.substr(ipaDir.size() + 1),
+				[&](unsigned int iterations) {
+					for (unsigned int i = 0; i < iterations; i++) {
+						File f(path);
+						f.open(File::OpenModeFlag::ReadOnly);
+						doNotOptimize(YamlParser::parse(f));
+					}
+				});
+		}
+
+		return TestPass;
+	}
+
+private:
+	std::vector<std::string> files_;
+};
+
+BENCHMARK_REGISTER(YamlParserBenchmark)
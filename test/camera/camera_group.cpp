@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Camera group test
+ */
+
+#include <atomic>
+#include <iostream>
+
+#include <libcamera/camera_group.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CameraGroupTest : public CameraTest, public Test
+{
+public:
+	CameraGroupTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	void requestsComplete(const std::vector<Request *> &requests)
+	{
+		if (requests.size() != 1 || !requests[0]) {
+			invalidGroup_ = true;
+			return;
+		}
+
+		Request *request = requests[0];
+
+		if (request->status() == Request::RequestComplete) {
+			completedRequests_++;
+
+			if (request->sequence() < lastSequence_)
+				invalidGroup_ = true;
+			lastSequence_ = request->sequence();
+		}
+
+		if (request->status() == Request::RequestComplete && requeue_) {
+			request->reuse(Request::ReuseBuffers);
+			group_->queueRequests({ &request, 1 });
+		} else {
+			returnedRequests_++;
+		}
+
+		dispatcher_->interrupt();
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		std::vector<std::unique_ptr<Request>> requests;
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests.push_back(std::move(request));
+		}
+
+		/*
+		 * The vimc pipeline handler exposes a single camera. Test the
+		 * group operation with one camera, all requests must then be
+		 * completed on their own.
+		 */
+		group_ = std::make_unique<CameraGroup>(std::vector<std::shared_ptr<Camera>>{ camera_ },
+						       1ms);
+		group_->requestsCompleted.connect(this, &CameraGroupTest::requestsComplete);
+
+		if (group_->cameras().size() != 1 || group_->cameras()[0] != camera_ ||
+		    group_->tolerance() != 1ms) {
+			cout << "Invalid group parameters" << endl;
+			return TestFail;
+		}
+
+		if (group_->start()) {
+			cout << "Failed to start the camera group" << endl;
+			return TestFail;
+		}
+
+		/* Queuing a number of requests different than the cameras must fail. */
+		Request *pair[] = { requests[0].get(), requests[1].get() };
+		if (group_->queueRequests(pair) != -EINVAL) {
+			cout << "Invalid number of requests queued to the group"
+			     << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests) {
+			Request *req = request.get();
+			if (group_->queueRequests({ &req, 1 })) {
+				cout << "Failed to queue request to the group" << endl;
+				return TestFail;
+			}
+		}
+
+		unsigned int nFrames = requests.size() * 2;
+
+		Timer timer;
+		timer.start(500ms * nFrames);
+		while (timer.isRunning() && completedRequests_ < nFrames)
+			dispatcher_->processEvents();
+
+		requeue_ = false;
+
+		if (completedRequests_ < nFrames) {
+			cout << "Failed to capture enough frames (got "
+			     << completedRequests_ << " expected at least "
+			     << nFrames << ")" << endl;
+			return TestFail;
+		}
+
+		/* Stopping the group must complete all pending requests. */
+		if (group_->stop()) {
+			cout << "Failed to stop the camera group" << endl;
+			return TestFail;
+		}
+
+		if (returnedRequests_ != requests.size()) {
+			cout << "Pending requests not completed on stop" << endl;
+			return TestFail;
+		}
+
+		if (invalidGroup_) {
+			cout << "Invalid group of requests completed" << endl;
+			return TestFail;
+		}
+
+		group_.reset();
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+	std::unique_ptr<CameraGroup> group_;
+
+	unsigned int completedRequests_ = 0;
+	unsigned int returnedRequests_ = 0;
+	uint32_t lastSequence_ = 0;
+	std::atomic<bool> requeue_ = true;
+	bool invalidGroup_ = false;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CameraGroupTest)
@@ -9,6 +9,7 @@
 
 #include <libcamera/framebuffer_allocator.h>
 
+#include <libcamera/base/allocation_tracker.h>
 #include <libcamera/base/event_dispatcher.h>
 #include <libcamera/base/thread.h>
 #include <libcamera/base/timer.h>
@@ -140,6 +141,8 @@ protected:
 
 		unsigned int nFrames = allocator_->buffers(stream).size() * 2;
 
+		uint64_t allocations = AllocationTracker::allocations();
+
 		Timer timer;
 		timer.start(500ms * nFrames);
 		while (timer.isRunning()) {
@@ -160,6 +163,13 @@ protected:
 			return TestFail;
 		}
 
+		if (AllocationTracker::enabled()) {
+			allocations = AllocationTracker::allocations() - allocations;
+			cout << "Allocations per request: "
+			     << static_cast<double>(allocations) / completeRequestsCount_
+			     << endl;
+		}
+
 		if (camera_->stop()) {
 			cout << "Failed to stop camera" << endl;
 			return TestFail;
@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Camera completion queue test
+ */
+
+#include <iostream>
+
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CompletionQueueTest : public CameraTest, public Test
+{
+public:
+	CompletionQueueTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	void requestComplete([[maybe_unused]] Request *request)
+	{
+		signalledRequests_++;
+	}
+
+	void queueReady()
+	{
+		/* Drain the queue, the notifier is level-triggered. */
+		while (Request *request = camera_->dequeueCompletedRequest()) {
+			if (request->status() != Request::RequestComplete) {
+				cancelledRequests_++;
+				continue;
+			}
+
+			if (request->sequence() < lastSequence_)
+				outOfOrder_ = true;
+			lastSequence_ = request->sequence();
+
+			completedRequests_++;
+
+			if (!running_)
+				continue;
+
+			request->reuse(Request::ReuseBuffers);
+			camera_->queueRequest(request);
+		}
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		StreamConfiguration &cfg = config_->at(0);
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->completionQueueFd() != -1) {
+			cout << "Completion queue enabled by default" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		if (camera_->setCompletionQueueEnabled(true)) {
+			cout << "Failed to enable the completion queue" << endl;
+			return TestFail;
+		}
+
+		int fd = camera_->completionQueueFd();
+		if (fd < 0) {
+			cout << "Invalid completion queue fd" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		camera_->requestCompleted.connect(this, &CompletionQueueTest::requestComplete);
+
+		EventNotifier notifier(fd, EventNotifier::Read);
+		notifier.activated.connect(this, &CompletionQueueTest::queueReady);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		running_ = true;
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		/*
+		 * Capture more frames than there are requests, to recycle the
+		 * preallocated nodes of the queue.
+		 */
+		const unsigned int nFrames = 40;
+
+		Timer timer;
+		timer.start(500ms * nFrames);
+		while (timer.isRunning()) {
+			dispatcher_->processEvents();
+			if (completedRequests_ > nFrames)
+				break;
+		}
+
+		notifier.setEnabled(false);
+		running_ = false;
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		/* Requests cancelled by stop() are queued as well. */
+		queueReady();
+
+		if (completedRequests_ < nFrames) {
+			cout << "Failed to capture enough frames (got "
+			     << completedRequests_ << " expected at least "
+			     << nFrames << ")" << endl;
+			return TestFail;
+		}
+
+		if (signalledRequests_) {
+			cout << "Requests signalled with the completion queue enabled"
+			     << endl;
+			return TestFail;
+		}
+
+		if (outOfOrder_) {
+			cout << "Requests dequeued out of order" << endl;
+			return TestFail;
+		}
+
+		if (camera_->dequeueCompletedRequest()) {
+			cout << "Completion queue not empty after draining" << endl;
+			return TestFail;
+		}
+
+		if (camera_->setCompletionQueueEnabled(false) ||
+		    camera_->completionQueueFd() != -1) {
+			cout << "Failed to disable the completion queue" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	unsigned int completedRequests_ = 0;
+	unsigned int cancelledRequests_ = 0;
+	unsigned int signalledRequests_ = 0;
+	uint32_t lastSequence_ = 0;
+	bool outOfOrder_ = false;
+	bool running_ = false;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CompletionQueueTest)
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Camera latest request mailbox test
+ */
+
+#include <iostream>
+
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class MailboxTest : public CameraTest, public Test
+{
+public:
+	MailboxTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	void requestComplete(Request *request)
+	{
+		if (request->status() == Request::RequestComplete)
+			completedRequests_++;
+		else
+			cancelledRequests_++;
+
+		dispatcher_->interrupt();
+	}
+
+	void wait(std::chrono::milliseconds duration)
+	{
+		Timer timer;
+		timer.start(duration);
+		while (timer.isRunning())
+			dispatcher_->processEvents();
+	}
+
+	int startCapture()
+	{
+		completedRequests_ = 0;
+		cancelledRequests_ = 0;
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			request->reuse(Request::ReuseBuffers);
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		unsigned int count = requests_.size();
+
+		camera_->requestCompleted.connect(this, &MailboxTest::requestComplete);
+
+		if (camera_->setMailboxEnabled(true)) {
+			cout << "Failed to enable the mailbox" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Without the application queuing requests back, the camera must
+		 * keep capturing by recycling the requests replaced in the
+		 * mailbox.
+		 */
+		ret = startCapture();
+		if (ret != TestPass)
+			return ret;
+
+		Request *latest = nullptr;
+
+		Timer timer;
+		timer.start(500ms * count * 2);
+		while (timer.isRunning()) {
+			wait(100ms);
+
+			latest = camera_->takeLatestRequest();
+			if (!latest)
+				continue;
+
+			FrameBuffer *buffer = latest->buffers().begin()->second;
+			if (buffer->metadata().sequence >= count * 2)
+				break;
+
+			latest->reuse(Request::ReuseBuffers);
+			camera_->queueRequest(latest);
+			latest = nullptr;
+		}
+
+		if (!latest) {
+			cout << "Requests not replaced in the mailbox" << endl;
+			return TestFail;
+		}
+
+		if (completedRequests_) {
+			cout << "Completed requests signalled in mailbox mode" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Queue the request back and let a new one reach the mailbox.
+		 * Stopping the camera must then return the parked request to the
+		 * application.
+		 */
+		latest->reuse(Request::ReuseBuffers);
+		camera_->queueRequest(latest);
+
+		wait(300ms);
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->takeLatestRequest()) {
+			cout << "Request left in the mailbox after stop" << endl;
+			return TestFail;
+		}
+
+		if (!completedRequests_ ||
+		    completedRequests_ + cancelledRequests_ != count) {
+			cout << "Requests not returned on stop (completed "
+			     << completedRequests_ << ", cancelled "
+			     << cancelledRequests_ << ")" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * With the mailbox disabled, completed requests must be
+		 * signalled again.
+		 */
+		if (camera_->setMailboxEnabled(false)) {
+			cout << "Failed to disable the mailbox" << endl;
+			return TestFail;
+		}
+
+		ret = startCapture();
+		if (ret != TestPass)
+			return ret;
+
+		timer.start(500ms * count);
+		while (timer.isRunning() && completedRequests_ < count)
+			dispatcher_->processEvents();
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completedRequests_ != count) {
+			cout << "Requests not signalled with the mailbox disabled"
+			     << endl;
+			return TestFail;
+		}
+
+		if (camera_->takeLatestRequest()) {
+			cout << "Request held by the disabled mailbox" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	unsigned int completedRequests_ = 0;
+	unsigned int cancelledRequests_ = 0;
+};
+
+} /* namespace */
+
+TEST_REGISTER(MailboxTest)
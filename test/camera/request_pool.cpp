@@ -0,0 +1,207 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Camera request pool test
+ */
+
+#include <iostream>
+
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/allocation_tracker.h>
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class RequestPoolTest : public CameraTest, public Test
+{
+public:
+	RequestPoolTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		completedRequests_++;
+
+		/* The buffers must be retained when reusing the request. */
+		FrameBuffer *buffer = request->buffers().begin()->second;
+		request->reuse(Request::ReuseBuffers);
+
+		if (request->buffers().size() != 1 ||
+		    request->buffers().begin()->second != buffer)
+			buffersLost_ = true;
+
+		camera_->queueRequest(request);
+
+		dispatcher_->interrupt();
+	}
+
+	int addBuffers(Stream *stream)
+	{
+		uint64_t allocations = AllocationTracker::threadAllocations();
+
+		unsigned int i = 0;
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			if (requests_[i++]->addBuffer(stream, buffer.get())) {
+				cout << "Failed to associate buffer with request" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Adding buffers to pooled requests must not allocate memory. */
+		if (AllocationTracker::enabled() &&
+		    AllocationTracker::threadAllocations() != allocations) {
+			cout << "Memory allocated when adding buffers" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		StreamConfiguration &cfg = config_->at(0);
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (!camera_->createRequestPool(4).empty()) {
+			cout << "Request pool created before configuration" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		unsigned int count = allocator_->buffers(stream).size();
+
+		requests_ = camera_->createRequestPool(count);
+		if (requests_.size() != count) {
+			cout << "Failed to create request pool" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < count; ++i) {
+			if (requests_[i]->cookie() != i) {
+				cout << "Invalid request cookie" << endl;
+				return TestFail;
+			}
+		}
+
+		ret = addBuffers(stream);
+		if (ret != TestPass)
+			return ret;
+
+		camera_->requestCompleted.connect(this, &RequestPoolTest::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		unsigned int nFrames = count * 2;
+
+		Timer timer;
+		timer.start(500ms * nFrames);
+		while (timer.isRunning()) {
+			dispatcher_->processEvents();
+			if (completedRequests_ > nFrames)
+				break;
+		}
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completedRequests_ < nFrames) {
+			cout << "Failed to capture enough frames (got "
+			     << completedRequests_ << " expected at least "
+			     << nFrames << ")" << endl;
+			return TestFail;
+		}
+
+		if (buffersLost_) {
+			cout << "Buffers not retained when reusing requests" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Reusing the requests without their buffers must keep their
+		 * storage, for the buffers to be added without allocation.
+		 */
+		for (std::unique_ptr<Request> &request : requests_) {
+			request->reuse();
+			if (!request->buffers().empty()) {
+				cout << "Buffers retained when reusing requests" << endl;
+				return TestFail;
+			}
+		}
+
+		return addBuffers(stream);
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	unsigned int completedRequests_ = 0;
+	bool buffersLost_ = false;
+};
+
+} /* namespace */
+
+TEST_REGISTER(RequestPoolTest)
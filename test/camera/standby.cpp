@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Camera standby mode test
+ */
+
+#include <iostream>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class StandbyTest : public CameraTest, public Test
+{
+public:
+	StandbyTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	void requestComplete(Request *request)
+	{
+		if (request->status() == Request::RequestComplete)
+			completedRequests_.push_back(request);
+		else
+			cancelledRequests_++;
+
+		dispatcher_->interrupt();
+	}
+
+	void wait(std::chrono::milliseconds duration)
+	{
+		Timer timer;
+		timer.start(duration);
+		while (timer.isRunning())
+			dispatcher_->processEvents();
+	}
+
+	int capture(Request *request)
+	{
+		size_t expected = completedRequests_.size() + 1;
+
+		request->reuse(Request::ReuseBuffers);
+		if (camera_->queueRequest(request)) {
+			cout << "Failed to queue request" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The first request after standby restores the application
+		 * frame durations.
+		 */
+		if (hasFrameDurations_ &&
+		    !request->controls().contains(controls::FRAME_DURATION_LIMITS)) {
+			cout << "Frame durations not restored after standby" << endl;
+			return TestFail;
+		}
+
+		Timer timer;
+		timer.start(1000ms);
+		while (timer.isRunning() && completedRequests_.size() < expected)
+			dispatcher_->processEvents();
+
+		if (completedRequests_.size() != expected ||
+		    completedRequests_.back() != request) {
+			cout << "Request not completed in standby mode" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		std::unique_ptr<Request> request = camera_->createRequest();
+		if (!request ||
+		    request->addBuffer(stream, allocator_->buffers(stream)[0].get())) {
+			cout << "Failed to create request" << endl;
+			return TestFail;
+		}
+
+		camera_->requestCompleted.connect(this, &StandbyTest::requestComplete);
+
+		hasFrameDurations_ = camera_->controls().count(&controls::FrameDurationLimits);
+
+		if (camera_->setStandbyEnabled(true, 100ms)) {
+			cout << "Failed to enable the standby mode" << endl;
+			return TestFail;
+		}
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->setStandbyEnabled(false) != -EACCES) {
+			cout << "Standby mode changed while running" << endl;
+			return TestFail;
+		}
+
+		/* Internal requests must not be signalled. */
+		wait(500ms);
+
+		if (!completedRequests_.empty() || cancelledRequests_) {
+			cout << "Standby requests signalled to the application"
+			     << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Application requests must be processed while in standby, and
+		 * the camera must keep capturing between them.
+		 */
+		ret = capture(request.get());
+		if (ret != TestPass)
+			return ret;
+
+		if (!request->sequence()) {
+			cout << "No frame captured in standby mode" << endl;
+			return TestFail;
+		}
+
+		uint32_t sequence = request->sequence();
+
+		wait(500ms);
+
+		if (completedRequests_.size() != 1 || cancelledRequests_) {
+			cout << "Standby requests signalled after resuming standby"
+			     << endl;
+			return TestFail;
+		}
+
+		ret = capture(request.get());
+		if (ret != TestPass)
+			return ret;
+
+		if (request->sequence() <= sequence + 1) {
+			cout << "Standby capture not resumed after a request"
+			     << endl;
+			return TestFail;
+		}
+
+		/* Stopping must not signal the internal requests either. */
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completedRequests_.size() != 2 || cancelledRequests_) {
+			cout << "Standby requests signalled on stop" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	std::vector<Request *> completedRequests_;
+	unsigned int cancelledRequests_ = 0;
+	bool hasFrameDurations_ = false;
+};
+
+} /* namespace */
+
+TEST_REGISTER(StandbyTest)
@@ -42,6 +42,10 @@ protected:
 		if (camera_->queueRequest(&request) != -EACCES)
 			return TestFail;
 
+		std::vector<Request *> requests{ &request };
+		if (camera_->queueRequests(requests) != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		if (camera_->release())
 			return TestFail;
@@ -156,6 +160,28 @@ protected:
 		if (camera_->queueRequest(request.get()))
 			return TestFail;
 
+		std::vector<std::unique_ptr<Request>> batch;
+		for (unsigned int i = 1; i < 3; ++i) {
+			std::unique_ptr<Request> req = camera_->createRequest();
+			if (!req)
+				return TestFail;
+
+			if (req->addBuffer(stream, allocator_->buffers(stream)[i].get()))
+				return TestFail;
+
+			batch.push_back(std::move(req));
+		}
+
+		/* Batches with a duplicated request are rejected as a whole. */
+		std::vector<Request *> requests{ batch[0].get(), batch[1].get(),
+						 batch[0].get() };
+		if (camera_->queueRequests(requests) != -EINVAL)
+			return TestFail;
+
+		requests.pop_back();
+		if (camera_->queueRequests(requests))
+			return TestFail;
+
 		/* Test valid state transitions, end in Available state. */
 		if (camera_->stop())
 			return TestFail;
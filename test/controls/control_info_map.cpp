@@ -64,6 +64,11 @@ protected:
 
 		infoMap.at(controls::Brightness.id());
 
+		if (!infoMap.contains(controls::Brightness.id())) {
+			cerr << "contains() on valid ID failed" << endl;
+			return TestFail;
+		}
+
 		/* Test looking up an invalid control by numerical ID. */
 		if (infoMap.count(12345) != 0) {
 			cerr << "count() on invalid ID failed" << endl;
@@ -75,6 +80,11 @@ protected:
 			return TestFail;
 		}
 
+		if (infoMap.contains(12345)) {
+			cerr << "contains() on invalid ID failed" << endl;
+			return TestFail;
+		}
+
 		/* Test looking up a control on a default-constructed infoMap */
 		const ControlInfoMap emptyInfoMap;
 		if (emptyInfoMap.find(12345) != emptyInfoMap.end()) {
@@ -82,6 +92,11 @@ protected:
 			return TestFail;
 		}
 
+		if (emptyInfoMap.contains(12345)) {
+			cerr << "contains() on empty ControlInfoMap failed" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
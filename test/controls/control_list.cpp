@@ -246,6 +246,30 @@ protected:
 			return TestFail;
 		}
 
+		/* Controls are iterated in ascending ID order. */
+		unsigned int previous = 0;
+		for (const auto &[id, value] : mergeList) {
+			if (id <= previous) {
+				cout << "Controls are not sorted by ID" << endl;
+				return TestFail;
+			}
+
+			previous = id;
+		}
+
+		/*
+		 * Clear the list and set the controls again, verifying that
+		 * the previous values don't leak into the new ones.
+		 */
+		mergeList.clear();
+		mergeList.set(controls::Saturation, 0.2f);
+
+		if (mergeList.size() != 1 || mergeList.get(controls::Brightness) ||
+		    mergeList.get(controls::Saturation) != 0.2f) {
+			cout << "Invalid list content after clearing it" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
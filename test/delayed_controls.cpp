@@ -267,6 +267,48 @@ protected:
 		return TestPass;
 	}
 
+	int cookies()
+	{
+		std::unordered_map<uint32_t, DelayedControls::ControlParams> delays = {
+			{ V4L2_CID_BRIGHTNESS, { 1, false } },
+			{ V4L2_CID_CONTRAST, { 2, true } },
+		};
+		std::unique_ptr<DelayedControls> delayed =
+			std::make_unique<DelayedControls>(dev_.get(), delays);
+		ControlList ctrls;
+
+		delayed->reset(1000);
+
+		/* Trigger the first frame start event */
+		delayed->applyControls(0);
+
+		/*
+		 * The cookie follows the controls it has been pushed with, and
+		 * is thus delayed by the maximum control delay.
+		 */
+		for (unsigned int i = 1; i < 100; i++) {
+			ctrls.set(V4L2_CID_BRIGHTNESS, static_cast<int32_t>(i));
+			ctrls.set(V4L2_CID_CONTRAST, static_cast<int32_t>(i));
+			delayed->push(ctrls, 1000 + i);
+
+			delayed->applyControls(i);
+
+			unsigned int cookie;
+			delayed->get(i, &cookie);
+			unsigned int expected = 1000 + (i < 2 ? 0 : i - 2);
+			if (cookie != expected) {
+				cerr << "Failed cookie"
+				     << " frame " << i
+				     << " expected " << expected
+				     << " got " << cookie
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
 	int run() override
 	{
 		int ret;
@@ -291,6 +333,11 @@ protected:
 		if (ret)
 			return ret;
 
+		/* Test cookies associated with the controls. */
+		ret = cookies();
+		if (ret)
+			return ret;
+
 		return TestPass;
 	}
 
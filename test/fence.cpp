@@ -6,6 +6,7 @@
  */
 
 #include <iostream>
+#include <map>
 #include <memory>
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -49,6 +50,7 @@ private:
 	Timer fenceTimer_;
 
 	std::vector<std::unique_ptr<Request>> requests_;
+	std::map<uint64_t, std::unique_ptr<Fence>> completionFences_;
 	std::unique_ptr<CameraConfiguration> config_;
 	std::unique_ptr<FrameBufferAllocator> allocator_;
 
@@ -195,6 +197,18 @@ int FenceTest::validateRequest(Request *request)
 		return TestFail;
 	}
 
+	/* The completion fence, if any, should have been signalled. */
+	auto it = completionFences_.find(cookie);
+	if (it != completionFences_.end()) {
+		eventfd_t value;
+		if (eventfd_read(it->second->fd().get(), &value) < 0) {
+			cerr << "Completion fence not signalled: " << cookie << endl;
+			return TestFail;
+		}
+
+		completionFences_.erase(it);
+	}
+
 	return TestPass;
 }
 
@@ -222,6 +236,10 @@ void FenceTest::requestRequeue(Request *request)
 		request->addBuffer(stream, buffer);
 	}
 
+	std::unique_ptr<Fence> completionFence = buffer->createCompletionFence();
+	if (completionFence)
+		completionFences_[request->cookie()] = std::move(completionFence);
+
 	camera_->queueRequest(request);
 }
 
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * AgcMeanLuminance tests
+ */
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include <libcamera/base/file.h>
+
+#include <libcamera/control_ids.h>
+
+#include "libcamera/internal/yaml_parser.h"
+
+#include "libipa/agc_mean_luminance.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace libcamera::ipa;
+
+/*
+ * Weigh the left zone only in centre-weighted mode and the right zone only in
+ * spot mode. Matrix metering isn't specified, centre-weighted metering is the
+ * default mode.
+ */
+static const string tuningYaml =
+	"AeMeteringMode:\n"
+	"  MeteringCentreWeighted:\n"
+	"    size: [ 2, 1 ]\n"
+	"    weights: [ 1, 0 ]\n"
+	"  MeteringSpot:\n"
+	"    size: [ 2, 1 ]\n"
+	"    weights: [ 0, 1 ]\n";
+
+class AgcMeanLuminanceTest : public Test
+{
+protected:
+	int init()
+	{
+		tuningFile_ = "/tmp/libcamera.test.XXXXXX";
+		int fd = mkstemp(&tuningFile_.front());
+		if (fd == -1)
+			return TestFail;
+
+		int ret = write(fd, tuningYaml.c_str(), tuningYaml.size());
+		close(fd);
+
+		if (ret != static_cast<int>(tuningYaml.size()))
+			return TestFail;
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		File file(tuningFile_);
+		if (!file.open(File::OpenModeFlag::ReadOnly)) {
+			cerr << "Failed to open tuning file" << endl;
+			return TestFail;
+		}
+
+		std::unique_ptr<YamlObject> tuningData = YamlParser::parse(file);
+		if (!tuningData) {
+			cerr << "Failed to parse tuning data" << endl;
+			return TestFail;
+		}
+
+		AgcMeanLuminance agc;
+		if (agc.parseTuningData(*tuningData)) {
+			cerr << "Failed to parse AGC tuning data" << endl;
+			return TestFail;
+		}
+
+		if (!agc.meteringModeSupported(controls::MeteringCentreWeighted) ||
+		    !agc.meteringModeSupported(controls::MeteringSpot)) {
+			cerr << "Metering modes from tuning data not supported" << endl;
+			return TestFail;
+		}
+
+		if (agc.meteringModeSupported(controls::MeteringMatrix) ||
+		    agc.meteringModeSupported(42)) {
+			cerr << "Unknown metering modes reported as supported" << endl;
+			return TestFail;
+		}
+
+		int32_t defaultMode = agc.controls().at(&controls::AeMeteringMode)
+					      .def().get<int32_t>();
+		if (defaultMode != controls::MeteringCentreWeighted) {
+			cerr << "Incorrect default metering mode " << defaultMode
+			     << endl;
+			return TestFail;
+		}
+
+		agc.setZoneGrid({ 2, 1 });
+		agc.zones(0)[0] = 0.2;
+		agc.zones(0)[1] = 0.6;
+
+		if (!equal(agc.estimateLuminance(controls::MeteringCentreWeighted, 1.0), 0.2) ||
+		    !equal(agc.estimateLuminance(controls::MeteringSpot, 1.0), 0.6)) {
+			cerr << "Incorrect luminance for metering modes" << endl;
+			return TestFail;
+		}
+
+		/* Unsupported metering modes must fall back to the default mode. */
+		if (!equal(agc.estimateLuminance(controls::MeteringMatrix, 1.0), 0.2) ||
+		    !equal(agc.estimateLuminance(42, 1.0), 0.2)) {
+			cerr << "Unsupported metering mode not handled" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup()
+	{
+		unlink(tuningFile_.c_str());
+	}
+
+private:
+	static bool equal(double a, double b)
+	{
+		return std::abs(a - b) < 1e-6;
+	}
+
+	string tuningFile_;
+};
+
+TEST_REGISTER(AgcMeanLuminanceTest)
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * SMIA embedded data parser tests
+ */
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include "libipa/camera_sensor_helper.h"
+#include "libipa/embedded_data.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace libcamera::ipa;
+
+namespace {
+
+/*
+ * Build embedded data lines in the SMIA format, inserting the dummy bytes of
+ * the 10 bits per pixel packing.
+ */
+class EmbeddedDataBuilder
+{
+public:
+	EmbeddedDataBuilder()
+		: data_({ 0x0a }), lineStart_(0)
+	{
+	}
+
+	EmbeddedDataBuilder &address(uint16_t reg)
+	{
+		pair(0xaa, reg >> 8);
+		pair(0xa5, reg & 0xff);
+		return *this;
+	}
+
+	EmbeddedDataBuilder &value(uint8_t value)
+	{
+		pair(0x5a, value);
+		return *this;
+	}
+
+	EmbeddedDataBuilder &skip()
+	{
+		pair(0x55, 0xff);
+		return *this;
+	}
+
+	EmbeddedDataBuilder &tag(uint8_t tag, uint8_t data)
+	{
+		pair(tag, data);
+		return *this;
+	}
+
+	EmbeddedDataBuilder &endLine()
+	{
+		pair(0x07, 0x07);
+		lineStart_ = data_.size();
+		data_.push_back(0x0a);
+		return *this;
+	}
+
+	const vector<uint8_t> &data() const { return data_; }
+
+private:
+	void pair(uint8_t tag, uint8_t data)
+	{
+		data_.push_back(tag);
+		while ((data_.size() + 1 - lineStart_) % 5 == 0)
+			data_.push_back(0x55);
+		data_.push_back(data);
+	}
+
+	vector<uint8_t> data_;
+	size_t lineStart_;
+};
+
+vector<uint8_t> imx219Data(uint16_t exposure, uint8_t gain, bool endLine = true)
+{
+	EmbeddedDataBuilder builder;
+
+	builder.address(0x0157)
+		.value(gain)
+		.skip()
+		.skip()
+		.value(exposure >> 8)
+		.value(exposure & 0xff);
+
+	if (endLine)
+		builder.endLine();
+
+	return builder.data();
+}
+
+} /* namespace */
+
+class EmbeddedDataTest : public Test
+{
+protected:
+	int testParser()
+	{
+		const uint32_t registers[] = { 0x015b, 0x0157, 0x015a };
+		SmiaEmbeddedDataParser parser(registers);
+
+		vector<uint8_t> data = imx219Data(1000, 128);
+
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::Error) {
+			cerr << "Unconfigured parser didn't fail" << endl;
+			return TestFail;
+		}
+
+		parser.setBitsPerPixel(10);
+		parser.setLineLength(0);
+
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::Ok ||
+		    parser.value(0x0157) != 128u || parser.value(0x015a) != 0x03u ||
+		    parser.value(0x015b) != 0xe8u) {
+			cerr << "Failed to parse embedded data" << endl;
+			return TestFail;
+		}
+
+		if (parser.value(0x0158)) {
+			cerr << "Value returned for an unrequested register" << endl;
+			return TestFail;
+		}
+
+		/* Subsequent frames are read at the same offsets. */
+		data = imx219Data(2000, 64);
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::Ok ||
+		    parser.value(0x0157) != 64u || parser.value(0x015a) != 0x07u ||
+		    parser.value(0x015b) != 0xd0u) {
+			cerr << "Failed to parse subsequent embedded data" << endl;
+			return TestFail;
+		}
+
+		/* A change of layout must be detected and searched again. */
+		data = EmbeddedDataBuilder()
+			       .address(0x0155)
+			       .skip()
+			       .skip()
+			       .value(32)
+			       .skip()
+			       .skip()
+			       .value(0x01)
+			       .value(0x00)
+			       .endLine()
+			       .data();
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::Ok ||
+		    parser.value(0x0157) != 32u || parser.value(0x015a) != 0x01u ||
+		    parser.value(0x015b) != 0x00u) {
+			cerr << "Failed to parse embedded data with a new layout" << endl;
+			return TestFail;
+		}
+
+		/* Truncated buffers must not be read past their end. */
+		data = imx219Data(1000, 128, false);
+		for (size_t size = 0; size < data.size(); ++size) {
+			Span<const uint8_t> truncated(data.data(), size);
+			if (parser.parse(truncated) == SmiaEmbeddedDataParser::Status::Ok ||
+			    parser.value(0x0157)) {
+				cerr << "Truncated embedded data parsed successfully"
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		/* Missing registers aren't a hard error. */
+		data = EmbeddedDataBuilder().address(0x0157).value(128).endLine().data();
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::NotFound) {
+			cerr << "Missing registers not reported" << endl;
+			return TestFail;
+		}
+
+		/* Corrupted data must be rejected. */
+		data = imx219Data(1000, 128);
+		data[0] = 0x00;
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::Error) {
+			cerr << "Embedded data without line start parsed successfully"
+			     << endl;
+			return TestFail;
+		}
+
+		data = EmbeddedDataBuilder().address(0x0157).tag(0x42, 0).data();
+		if (parser.parse(data) != SmiaEmbeddedDataParser::Status::Error) {
+			cerr << "Embedded data with an illegal tag parsed successfully"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testSensorHelper()
+	{
+		std::unique_ptr<CameraSensorHelper> helper =
+			CameraSensorHelperFactoryBase::create("imx219");
+		if (!helper || !helper->hasEmbeddedData()) {
+			cerr << "imx219 helper doesn't support embedded data" << endl;
+			return TestFail;
+		}
+
+		helper->configureEmbeddedData(10, 0);
+
+		auto controls = helper->parseEmbeddedData(imx219Data(1000, 128));
+		if (!controls || controls->exposure != 1000 || controls->gainCode != 128) {
+			cerr << "Failed to parse imx219 embedded data" << endl;
+			return TestFail;
+		}
+
+		if (helper->parseEmbeddedData({})) {
+			cerr << "Empty embedded data parsed successfully" << endl;
+			return TestFail;
+		}
+
+		helper = CameraSensorHelperFactoryBase::create("ov5640");
+		if (!helper || helper->hasEmbeddedData() ||
+		    helper->parseEmbeddedData(imx219Data(1000, 128))) {
+			cerr << "ov5640 helper reports embedded data support" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (testParser() != TestPass)
+			return TestFail;
+
+		return testSensorHelper();
+	}
+};
+
+TEST_REGISTER(EmbeddedDataTest)
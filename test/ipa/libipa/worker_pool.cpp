@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * WorkerPool and AsyncJob tests
+ */
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+#include "libipa/worker_pool.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace libcamera::ipa;
+
+class WorkerPoolTest : public Test
+{
+protected:
+	int run()
+	{
+		WorkerPool pool(2);
+		AsyncJob<unsigned int> job(pool);
+		uint32_t frame = 0;
+
+		if (!job.submit(1, []() { return 10u; })) {
+			cerr << "Failed to submit job" << endl;
+			return TestFail;
+		}
+
+		job.wait();
+
+		/*
+		 * Submit a second job and block it until the result of the first
+		 * job has been fetched. The result must be reported with the
+		 * frame it was computed for, not the frame of the job in flight.
+		 */
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool release = false;
+
+		if (!job.submit(2, [&]() {
+			    std::unique_lock lock(mutex);
+			    cv.wait(lock, [&] { return release; });
+			    return 20u;
+		    })) {
+			cerr << "Failed to submit second job" << endl;
+			return TestFail;
+		}
+
+		bool submitted = job.submit(3, []() { return 30u; });
+		std::optional<unsigned int> first = job.fetch(&frame);
+		uint32_t firstFrame = frame;
+		bool fetchedTwice = job.fetch().has_value();
+
+		/* Release the second job before checking the results. */
+		{
+			std::scoped_lock lock(mutex);
+			release = true;
+		}
+		cv.notify_one();
+
+		job.wait();
+
+		std::optional<unsigned int> second = job.fetch(&frame);
+
+		if (submitted) {
+			cerr << "Job submitted while another job is in flight" << endl;
+			return TestFail;
+		}
+
+		if (!first || *first != 10 || firstFrame != 1) {
+			cerr << "Incorrect result for the first job" << endl;
+			return TestFail;
+		}
+
+		if (fetchedTwice) {
+			cerr << "Result fetched twice" << endl;
+			return TestFail;
+		}
+
+		if (!second || *second != 20 || frame != 2) {
+			cerr << "Incorrect result for the second job" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(WorkerPoolTest)
@@ -389,6 +389,20 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Transport the payload data of the next messages through
+		 * shared memory.
+		 */
+		if (ipc_.setupSharedMemory()) {
+			cerr << "Failed to set up shared memory" << endl;
+			return TestFail;
+		}
+
+		if (testReverse()) {
+			cerr << "Shared memory reverse array test failed" << endl;
+			return TestFail;
+		}
+
 		/* Test fire and forget, this tests sending data and FDs. */
 		if (testCmp()) {
 			cerr << "Cmp test failed" << endl;
@@ -9,6 +9,7 @@
 #include <fcntl.h>
 #include <iostream>
 #include <limits.h>
+#include <set>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -34,6 +35,8 @@ enum {
 	CmdExit = 0,
 	CmdGetSync = 1,
 	CmdSetAsync = 2,
+	CmdSetFd = 3,
+	CmdGetFdCount = 4,
 };
 
 const int32_t kInitialValue = 1337;
@@ -76,8 +79,20 @@ private:
 			return;
 		}
 
-		IPCMessage ipcMessage(message);
+		IPCMessage ipcMessage(message, &fdTable_);
+		if (ipcMessage.header().cmd == IPCMessage::kCmdBatch) {
+			for (IPCMessage &batched : ipcMessage.split())
+				dispatch(batched);
+			return;
+		}
+
+		dispatch(ipcMessage);
+	}
+
+	void dispatch(IPCMessage &ipcMessage)
+	{
 		uint32_t cmd = ipcMessage.header().cmd;
+		int ret;
 
 		switch (cmd) {
 		case CmdExit: {
@@ -93,7 +108,7 @@ private:
 			tie(buf, ignore) = IPADataSerializer<int32_t>::serialize(value_);
 			response.data().insert(response.data().end(), buf.begin(), buf.end());
 
-			ret = ipc_.send(response.payload());
+			ret = ipc_.send(response.payload(&fdTable_));
 			if (ret < 0) {
 				cerr << "Reply failed" << endl;
 				stop(ret);
@@ -105,6 +120,33 @@ private:
 			value_ = IPADataSerializer<int32_t>::deserialize(ipcMessage.data());
 			break;
 		}
+
+		case CmdSetFd: {
+			fds_.push_back(IPADataSerializer<SharedFD>::deserialize(ipcMessage.data(),
+										ipcMessage.fds()));
+			break;
+		}
+
+		case CmdGetFdCount: {
+			IPCMessage::Header header = { cmd, ipcMessage.header().cookie };
+			IPCMessage response(header);
+
+			/* Count the distinct file descriptors received. */
+			std::set<int> fds;
+			for (const SharedFD &fd : fds_)
+				fds.insert(fd.get());
+
+			vector<uint8_t> buf;
+			tie(buf, ignore) = IPADataSerializer<int32_t>::serialize(fds.size());
+			response.data().insert(response.data().end(), buf.begin(), buf.end());
+
+			ret = ipc_.send(response.payload(&fdTable_));
+			if (ret < 0) {
+				cerr << "Reply failed" << endl;
+				stop(ret);
+			}
+			break;
+		}
 		}
 	}
 
@@ -115,8 +157,10 @@ private:
 	}
 
 	int32_t value_;
+	vector<SharedFD> fds_;
 
 	IPCUnixSocket ipc_;
+	IPCFdTable fdTable_;
 	EventDispatcher *dispatcher_;
 	int exitCode_;
 	bool exit_;
@@ -144,6 +188,14 @@ protected:
 		return 0;
 	}
 
+	void queueValue(int32_t val)
+	{
+		IPCMessage msg(CmdSetAsync);
+		tie(msg.data(), ignore) = IPADataSerializer<int32_t>::serialize(val);
+
+		ipc_->queueAsync(msg);
+	}
+
 	int getValue()
 	{
 		IPCMessage msg(CmdGetSync);
@@ -158,6 +210,28 @@ protected:
 		return IPADataSerializer<int32_t>::deserialize(buf.data());
 	}
 
+	void queueFd(const SharedFD &fd)
+	{
+		IPCMessage msg(CmdSetFd);
+		tie(msg.data(), msg.fds()) = IPADataSerializer<SharedFD>::serialize(fd);
+
+		ipc_->queueAsync(msg);
+	}
+
+	int getFdCount()
+	{
+		IPCMessage msg(CmdGetFdCount);
+		IPCMessage buf;
+
+		int ret = ipc_->sendSync(msg, &buf);
+		if (ret < 0) {
+			cerr << "Failed to call get fd count" << endl;
+			return ret;
+		}
+
+		return IPADataSerializer<int32_t>::deserialize(buf.data());
+	}
+
 	int exit()
 	{
 		IPCMessage msg(CmdExit);
@@ -199,6 +273,40 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Queue multiple calls, they must be sent in order before the
+		 * synchronous call.
+		 */
+		queueValue(kInitialValue);
+		queueValue(kChangedValue + 1);
+
+		ret = getValue();
+		if (ret != kChangedValue + 1) {
+			cerr << "Wrong queued value, expected " << kChangedValue + 1
+			     << ", got " << ret << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Send the same file descriptor multiple times, it must be
+		 * transferred once and reused by the receiver.
+		 */
+		SharedFD fd(UniqueFD(open("/dev/null", O_RDONLY | O_CLOEXEC)));
+		if (!fd.isValid()) {
+			cerr << "Failed to open /dev/null" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < 3; i++)
+			queueFd(fd);
+
+		ret = getFdCount();
+		if (ret != 1) {
+			cerr << "Wrong file descriptors count, expected 1, got "
+			     << ret << endl;
+			return TestFail;
+		}
+
 		ret = exit();
 		if (ret < 0) {
 			cerr << "Failed to exit: " << strerror(-ret) << endl;
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Unix socket IPC pipe spare worker test
+ */
+
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/utils.h>
+
+#include "libcamera/internal/ipc_pipe.h"
+#include "libcamera/internal/ipc_pipe_unixsocket.h"
+#include "libcamera/internal/process.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace libcamera;
+
+enum {
+	CmdGetPid = 1,
+};
+
+class UnixSocketSpareTestWorker
+{
+public:
+	UnixSocketSpareTestWorker()
+	{
+		dispatcher_ = Thread::current()->eventDispatcher();
+		ipc_.readyRead.connect(this, &UnixSocketSpareTestWorker::readyRead);
+	}
+
+	int run(UniqueFD fd)
+	{
+		if (ipc_.bind(std::move(fd))) {
+			cerr << "Failed to connect to IPC channel" << endl;
+			return EXIT_FAILURE;
+		}
+
+		/* Run until terminated by the parent. */
+		while (true)
+			dispatcher_->processEvents();
+
+		return EXIT_SUCCESS;
+	}
+
+private:
+	void readyRead()
+	{
+		IPCUnixSocket::Payload message;
+		if (ipc_.receive(&message))
+			return;
+
+		IPCMessage ipcMessage(message, &fdTable_);
+		if (ipcMessage.header().cmd != CmdGetPid)
+			return;
+
+		IPCMessage::Header header = { CmdGetPid, ipcMessage.header().cookie };
+		IPCMessage response(header);
+
+		int32_t pid = getpid();
+		response.data().resize(sizeof(pid));
+		memcpy(response.data().data(), &pid, sizeof(pid));
+
+		ipc_.send(response.payload(&fdTable_));
+	}
+
+	IPCUnixSocket ipc_;
+	IPCFdTable fdTable_;
+	EventDispatcher *dispatcher_;
+};
+
+class UnixSocketSpareTest : public Test
+{
+protected:
+	/* Retrieve the child processes that haven't terminated. */
+	set<pid_t> liveWorkers()
+	{
+		set<pid_t> workers;
+
+		DIR *dir = opendir("/proc");
+		if (!dir)
+			return workers;
+
+		while (struct dirent *entry = readdir(dir)) {
+			pid_t pid = atoi(entry->d_name);
+			if (pid <= 0)
+				continue;
+
+			ifstream stat("/proc/" + to_string(pid) + "/stat");
+			string line;
+			if (!getline(stat, line))
+				continue;
+
+			/* The state and parent PID follow the command name. */
+			size_t pos = line.rfind(')');
+			if (pos == string::npos)
+				continue;
+
+			char state;
+			pid_t ppid;
+			if (sscanf(line.c_str() + pos + 1, " %c %d", &state, &ppid) != 2)
+				continue;
+
+			if (ppid == getpid() && state != 'Z' && state != 'X')
+				workers.insert(pid);
+		}
+
+		closedir(dir);
+
+		return workers;
+	}
+
+	/* Wait for the number of live workers to reach the expected value. */
+	set<pid_t> waitWorkers(size_t count)
+	{
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		set<pid_t> workers = liveWorkers();
+
+		Timer timeout;
+		timeout.start(1000ms);
+		while (workers.size() != count && timeout.isRunning()) {
+			dispatcher->processEvents();
+			workers = liveWorkers();
+		}
+
+		return workers;
+	}
+
+	pid_t workerPid(IPCPipeUnixSocket &ipc)
+	{
+		IPCMessage msg(CmdGetPid);
+		IPCMessage response;
+
+		if (ipc.sendSync(msg, &response) < 0 ||
+		    response.data().size() != sizeof(int32_t))
+			return -1;
+
+		int32_t pid;
+		memcpy(&pid, response.data().data(), sizeof(pid));
+		return pid;
+	}
+
+	int run()
+	{
+		/*
+		 * Creating a pipe must start its worker and a spare worker for
+		 * the next pipe of the same IPA module.
+		 */
+		auto first = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		if (!first->isConnected()) {
+			cerr << "Failed to create first IPCPipe" << endl;
+			return TestFail;
+		}
+
+		set<pid_t> workers = waitWorkers(2);
+		if (workers.size() != 2) {
+			cerr << "Expected 2 workers, got " << workers.size() << endl;
+			return TestFail;
+		}
+
+		pid_t firstPid = workerPid(*first);
+		if (!workers.count(firstPid)) {
+			cerr << "Invalid first worker PID " << firstPid << endl;
+			return TestFail;
+		}
+
+		workers.erase(firstPid);
+		pid_t sparePid = *workers.begin();
+
+		/* The second pipe must take the spare worker over. */
+		auto second = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		if (!second->isConnected()) {
+			cerr << "Failed to create second IPCPipe" << endl;
+			return TestFail;
+		}
+
+		pid_t secondPid = workerPid(*second);
+		if (secondPid != sparePid) {
+			cerr << "Spare worker not used by the second pipe" << endl;
+			return TestFail;
+		}
+
+		workers = waitWorkers(3);
+		if (workers.size() != 3) {
+			cerr << "Expected 3 workers, got " << workers.size() << endl;
+			return TestFail;
+		}
+
+		/* The spare worker must be kept while the module is in use. */
+		first.reset();
+
+		workers = waitWorkers(2);
+		if (workers.size() != 2 || !workers.count(secondPid)) {
+			cerr << "Spare worker not kept while the module is in use"
+			     << endl;
+			return TestFail;
+		}
+
+		/* Destroying the last pipe must terminate the spare worker. */
+		second.reset();
+
+		workers = waitWorkers(0);
+		if (!workers.empty()) {
+			cerr << "Spare worker not terminated with the last pipe"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	ProcessManager processManager_;
+};
+
+/*
+ * Can't use TEST_REGISTER() as single binary needs to act as both client and
+ * server
+ */
+int main(int argc, char **argv)
+{
+	/* IPCPipeUnixSocket passes IPA module path in argv[1] */
+	if (argc == 3) {
+		UniqueFD ipcfd = UniqueFD(std::stoi(argv[2]));
+		UnixSocketSpareTestWorker worker;
+		return worker.run(std::move(ipcfd));
+	}
+
+	UnixSocketSpareTest test;
+	test.setArgs(argc, argv);
+	return test.execute();
+}
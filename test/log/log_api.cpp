@@ -133,6 +133,42 @@ protected:
 		return TestPass;
 	}
 
+	int testRateLimit()
+	{
+		stringstream log;
+		logSetStream(&log);
+		logSetLevel("LogAPITest", "DEBUG");
+
+		for (unsigned int i = 0; i < 20; ++i)
+			LOG_RATELIMITED(LogAPITest, Info) << "limited " << i;
+
+		for (unsigned int i = 0; i < 5; ++i)
+			LOG_ONCE(LogAPITest, Info) << "once " << i;
+
+		unsigned int limited = 0;
+		unsigned int once = 0;
+		string line;
+		while (getline(log, line)) {
+			if (line.find("limited") != string::npos)
+				limited++;
+			else if (line.find("once") != string::npos)
+				once++;
+		}
+
+		if (limited != 10) {
+			cout << "Incorrect number of rate-limited lines: "
+			     << limited << endl;
+			return TestFail;
+		}
+
+		if (once != 1) {
+			cout << "Incorrect number of once lines: " << once << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
 	int run() override
 	{
 		int ret = testFile();
@@ -143,6 +179,10 @@ protected:
 		if (ret != TestPass)
 			return TestFail;
 
+		ret = testRateLimit();
+		if (ret != TestPass)
+			return TestFail;
+
 		ret = testTarget();
 		if (ret != TestPass)
 			return TestFail;
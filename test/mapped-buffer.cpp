@@ -103,6 +103,20 @@ protected:
 			return TestFail;
 		}
 
+		/* Bracket CPU accesses, repeated calls have no effect. */
+		rw_map.beginAccess();
+		rw_map.beginAccess();
+		rw_map.planes()[0][0] = 0xa5;
+		rw_map.endAccess();
+		rw_map.endAccess();
+
+		rw_map.beginAccess();
+		if (rw_map.planes()[0][0] != 0xa5) {
+			cout << "CPU write lost across accesses" << endl;
+			return TestFail;
+		}
+		rw_map.endAccess();
+
 		return TestPass;
 	}
 
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <libcamera/base/message.h>
 #include <libcamera/base/object.h>
@@ -93,6 +94,55 @@ private:
 	bool success_;
 };
 
+class OrderMessage : public Message
+{
+public:
+	OrderMessage(Message::Type type, unsigned int id)
+		: Message(type), id_(id)
+	{
+	}
+
+	unsigned int id() const { return id_; }
+
+private:
+	unsigned int id_;
+};
+
+class OrderMessageReceiver : public Object
+{
+public:
+	OrderMessageReceiver(Message::Type repostType)
+		: repostType_(repostType)
+	{
+	}
+
+	const std::vector<unsigned int> &ids() const { return ids_; }
+	void reset() { ids_.clear(); }
+
+protected:
+	void message(Message *msg)
+	{
+		if (msg->type() < Message::UserMessage) {
+			Object::message(msg);
+			return;
+		}
+
+		unsigned int id = static_cast<OrderMessage *>(msg)->id();
+		ids_.push_back(id);
+
+		/*
+		 * Post a new message from the handler of the first message of
+		 * the repost type, it must be delivered by the same dispatch.
+		 */
+		if (msg->type() == repostType_ && id == 1)
+			postMessage(std::make_unique<OrderMessage>(repostType_, 100));
+	}
+
+private:
+	Message::Type repostType_;
+	std::vector<unsigned int> ids_;
+};
+
 class MessageTest : public Test
 {
 protected:
@@ -154,6 +204,63 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Test dispatching of messages of a single type, interleaved
+		 * with messages of another type. Only the messages of the
+		 * requested type shall be delivered, in posting order, including
+		 * messages posted by the handlers.
+		 */
+		OrderMessageReceiver orderReceiver(msgType[1]);
+
+		for (unsigned int i = 0; i < 8; ++i)
+			orderReceiver.postMessage(std::make_unique<OrderMessage>(msgType[i % 2], i));
+
+		Thread::current()->dispatchMessages(msgType[1]);
+
+		std::vector<unsigned int> expected = { 1, 3, 5, 7, 100 };
+		if (orderReceiver.ids() != expected) {
+			cout << "Typed message delivery failed" << endl;
+			return TestFail;
+		}
+
+		orderReceiver.reset();
+		Thread::current()->dispatchMessages(msgType[0]);
+
+		expected = { 0, 2, 4, 6 };
+		if (orderReceiver.ids() != expected) {
+			cout << "Remaining message delivery failed" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test dispatching of the messages of a single receiver. The
+		 * messages posted to other receivers shall stay queued.
+		 */
+		OrderMessageReceiver otherReceiver(msgType[1]);
+
+		orderReceiver.reset();
+
+		for (unsigned int i = 0; i < 4; ++i) {
+			OrderMessageReceiver &target = i % 2 ? orderReceiver : otherReceiver;
+			target.postMessage(std::make_unique<OrderMessage>(msgType[0], i));
+		}
+
+		Thread::current()->dispatchMessages(msgType[0], &orderReceiver);
+
+		expected = { 1, 3 };
+		if (orderReceiver.ids() != expected || !otherReceiver.ids().empty()) {
+			cout << "Receiver message delivery failed" << endl;
+			return TestFail;
+		}
+
+		Thread::current()->dispatchMessages(msgType[0]);
+
+		expected = { 0, 2 };
+		if (otherReceiver.ids() != expected) {
+			cout << "Other receiver message delivery failed" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
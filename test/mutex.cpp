@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Mutex test
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace libcamera;
+
+namespace {
+
+bool setScheduler(int policy, int priority)
+{
+	struct sched_param param = {};
+	param.sched_priority = priority;
+
+	return !pthread_setschedparam(pthread_self(), policy, &param);
+}
+
+/* Busy-loop for the given duration, measured on the given clock. */
+void spin(clockid_t clock, chrono::nanoseconds duration)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	chrono::nanoseconds end = chrono::seconds(ts.tv_sec) +
+				  chrono::nanoseconds(ts.tv_nsec) + duration;
+
+	do {
+		clock_gettime(clock, &ts);
+	} while (chrono::seconds(ts.tv_sec) + chrono::nanoseconds(ts.tv_nsec) < end);
+}
+
+} /* namespace */
+
+class MutexTest : public Test
+{
+protected:
+	int testContention(Mutex::Protocol protocol)
+	{
+		constexpr unsigned int kThreads = 4;
+		constexpr unsigned int kIterations = 10000;
+
+		Mutex mutex(protocol);
+		ConditionVariable cv;
+		unsigned int count = 0;
+
+		vector<thread> threads;
+		for (unsigned int i = 0; i < kThreads; ++i) {
+			threads.emplace_back([&]() {
+				for (unsigned int j = 0; j < kIterations; ++j) {
+					MutexLocker locker(mutex);
+					count++;
+					cv.notify_all();
+				}
+			});
+		}
+
+		bool done;
+		{
+			MutexLocker locker(mutex);
+			done = cv.wait_for(locker, 5s, [&]() {
+				return count == kThreads * kIterations;
+			});
+		}
+
+		for (thread &t : threads)
+			t.join();
+
+		if (!done) {
+			cout << "Mutex failed to serialize " << kThreads
+			     << " threads, count " << count << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Run a low, a medium and a high priority real-time thread on a single
+	 * CPU. The low priority thread holds the mutex that the high priority
+	 * thread waits for, while the medium priority thread keeps the CPU
+	 * busy. Without priority inheritance, the high priority thread can only
+	 * take the mutex once the medium priority thread completes.
+	 */
+	int testPriorityInheritance()
+	{
+		struct sched_param mainParam;
+		int mainPolicy;
+		pthread_getschedparam(pthread_self(), &mainPolicy, &mainParam);
+
+		cpu_set_t mainCpus;
+		sched_getaffinity(0, sizeof(mainCpus), &mainCpus);
+
+		/*
+		 * The threads inherit the scheduling policy and the CPU
+		 * affinity of the main thread. The main thread runs at the
+		 * highest priority and sleeps to let the other threads run in
+		 * sequence.
+		 */
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(sched_getcpu(), &cpus);
+
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) ||
+		    !setScheduler(SCHED_FIFO, 4)) {
+			sched_setaffinity(0, sizeof(mainCpus), &mainCpus);
+			cout << "Real-time scheduling not permitted, skipping priority inheritance test"
+			     << endl;
+			return TestSkip;
+		}
+
+		Mutex mutex(Mutex::Protocol::PriorityInherit);
+		atomic<bool> mediumDone = false;
+		bool inversion = false;
+
+		thread low([&]() {
+			setScheduler(SCHED_FIFO, 1);
+
+			MutexLocker locker(mutex);
+			spin(CLOCK_THREAD_CPUTIME_ID, 50ms);
+		});
+
+		this_thread::sleep_for(10ms);
+
+		thread high([&]() {
+			setScheduler(SCHED_FIFO, 3);
+
+			MutexLocker locker(mutex);
+			inversion = mediumDone;
+		});
+
+		this_thread::sleep_for(10ms);
+
+		thread medium([&]() {
+			setScheduler(SCHED_FIFO, 2);
+
+			spin(CLOCK_MONOTONIC, 300ms);
+			mediumDone = true;
+		});
+
+		low.join();
+		high.join();
+		medium.join();
+
+		pthread_setschedparam(pthread_self(), mainPolicy, &mainParam);
+		sched_setaffinity(0, sizeof(mainCpus), &mainCpus);
+
+		if (inversion) {
+			cout << "Priority inversion with a priority inheritance mutex"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/* Test mutual exclusion with both protocols. */
+		if (testContention(Mutex::Protocol::None) != TestPass)
+			return TestFail;
+
+		if (testContention(Mutex::Protocol::PriorityInherit) != TestPass)
+			return TestFail;
+
+		/* Test that priority inheritance prevents priority inversion. */
+		return testPriorityInheritance();
+	}
+};
+
+TEST_REGISTER(MutexTest)
@@ -4,8 +4,10 @@
 # Copyright (C) 2022, Tomi Valkeinen <tomi.valkeinen@ideasonboard.com>
 
 from collections import defaultdict
+import asyncio
 import gc
 import libcamera as libcam
+import libcamera.utils
 import selectors
 import typing
 import unittest
@@ -193,6 +195,8 @@ class SimpleCaptureMethods(CameraTesterBase):
             buffer = allocator.buffers(stream)[i]
             req.add_buffer(stream, buffer)
 
+            req.set_controls({libcam.controls.Brightness: 0.5})
+
             reqs.append(req)
 
         buffer = None
@@ -225,6 +229,14 @@ class SimpleCaptureMethods(CameraTesterBase):
         for i, req in enumerate(reqs):
             self.assertTrue(i == req.cookie)
 
+            meta = req.metadata
+            self.assertEqual(len(meta), len(meta.keys()))
+            for ctrl, val in meta.items():
+                self.assertTrue(ctrl in meta)
+                self.assertEqual(meta[ctrl], val)
+                self.assertEqual(meta.get(ctrl), val)
+
+        meta = None
         reqs = None
         gc.collect()
 
@@ -298,6 +310,68 @@ class SimpleCaptureMethods(CameraTesterBase):
 
         cam.stop()
 
+    def test_asyncio(self):
+        cm = self.cm
+        cam = self.cam
+
+        camconfig = cam.generate_configuration([libcam.StreamRole.StillCapture])
+        self.assertTrue(camconfig.size == 1)
+
+        streamconfig = camconfig.at(0)
+
+        cam.configure(camconfig)
+
+        stream = streamconfig.stream
+
+        allocator = libcam.FrameBufferAllocator(cam)
+        num_bufs = allocator.allocate(stream)
+        self.assertTrue(num_bufs > 0)
+
+        num_bufs = len(allocator.buffers(stream))
+
+        reqs = []
+        for i in range(num_bufs):
+            req = cam.create_request(i)
+            self.assertIsNotNone(req)
+
+            buffer = allocator.buffers(stream)[i]
+            req.add_buffer(stream, buffer)
+
+            reqs.append(req)
+
+        buffer = None
+
+        cam.start()
+
+        for req in reqs:
+            cam.queue_request(req)
+
+        reqs = None
+        gc.collect()
+
+        async def capture():
+            reqs = []
+
+            while len(reqs) < num_bufs:
+                # Retrieve the requests one by one to test batching
+                ready_reqs = await libcamera.utils.wait_ready_requests(cm, 1)
+                self.assertTrue(len(ready_reqs) == 1)
+                reqs += ready_reqs
+
+            return reqs
+
+        reqs = asyncio.run(capture())
+
+        self.assertTrue(len(reqs) == num_bufs)
+
+        for i, req in enumerate(reqs):
+            self.assertTrue(i == req.cookie)
+
+        reqs = None
+        gc.collect()
+
+        cam.stop()
+
 
 # Recursively expand slist's objects into olist, using seen to track already
 # processed objects.
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Semaphore test
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <libcamera/base/semaphore.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace libcamera;
+
+class SemaphoreTest : public Test
+{
+protected:
+	int testTryAcquire()
+	{
+		Semaphore semaphore(2);
+
+		if (semaphore.available() != 2) {
+			cout << "Invalid initial resource count" << endl;
+			return TestFail;
+		}
+
+		if (semaphore.tryAcquire(3)) {
+			cout << "Acquired more resources than available" << endl;
+			return TestFail;
+		}
+
+		if (!semaphore.tryAcquire(2) || semaphore.available() != 0) {
+			cout << "Failed to acquire available resources" << endl;
+			return TestFail;
+		}
+
+		if (semaphore.tryAcquire()) {
+			cout << "Acquired a resource from an empty semaphore" << endl;
+			return TestFail;
+		}
+
+		semaphore.release(3);
+		if (semaphore.available() != 3) {
+			cout << "Invalid resource count after release" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testBlockingAcquire()
+	{
+		Semaphore semaphore;
+		atomic<bool> acquired = false;
+
+		/* The consumer must wait until enough resources are released. */
+		thread consumer([&]() {
+			semaphore.acquire(2);
+			acquired = true;
+		});
+
+		this_thread::sleep_for(50ms);
+		semaphore.release();
+		this_thread::sleep_for(50ms);
+
+		if (acquired) {
+			semaphore.release();
+			consumer.join();
+			cout << "Acquired resources before they were released" << endl;
+			return TestFail;
+		}
+
+		semaphore.release();
+
+		for (unsigned int i = 0; i < 100 && !acquired; ++i)
+			this_thread::sleep_for(10ms);
+
+		if (!acquired) {
+			/* Unblock the consumer to join it. */
+			semaphore.release(2);
+			consumer.join();
+			cout << "Consumer not woken up by release()" << endl;
+			return TestFail;
+		}
+
+		consumer.join();
+
+		if (semaphore.available() != 0) {
+			cout << "Invalid resource count after acquire" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testProducersConsumers()
+	{
+		constexpr unsigned int kThreads = 4;
+		constexpr unsigned int kIterations = 100000;
+
+		Semaphore semaphore;
+		atomic<unsigned int> consumed = 0;
+		vector<thread> threads;
+
+		/*
+		 * Consumers waiting for resources concurrently with
+		 * producers releasing them must neither miss a wake-up nor
+		 * acquire more resources than released.
+		 */
+		for (unsigned int i = 0; i < kThreads; ++i) {
+			threads.emplace_back([&]() {
+				for (unsigned int j = 0; j < kIterations; ++j) {
+					semaphore.acquire();
+					consumed++;
+				}
+			});
+
+			threads.emplace_back([&]() {
+				for (unsigned int j = 0; j < kIterations; ++j)
+					semaphore.release();
+			});
+		}
+
+		for (thread &t : threads)
+			t.join();
+
+		if (consumed != kThreads * kIterations ||
+		    semaphore.available() != 0) {
+			cout << "Invalid resource count after concurrent use, consumed "
+			     << consumed << ", available " << semaphore.available()
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (testTryAcquire() != TestPass)
+			return TestFail;
+
+		if (testBlockingAcquire() != TestPass)
+			return TestFail;
+
+		return testProducersConsumers();
+	}
+};
+
+TEST_REGISTER(SemaphoreTest)
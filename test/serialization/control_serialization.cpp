@@ -169,6 +169,22 @@ protected:
 			return TestFail;
 		}
 
+		/* Access the serialized list through a view. */
+		buffer = ByteStreamBuffer(const_cast<const uint8_t *>(listData.data()),
+					  listData.size());
+
+		ControlListView view(buffer);
+		if (!view.isValid() || view.size() != list.size()) {
+			cerr << "Failed to create ControlListView" << endl;
+			return TestFail;
+		}
+
+		if (view.get(controls::Contrast) != 1.2f ||
+		    view.contains(controls::ExposureTime.id())) {
+			cerr << "ControlListView doesn't match original" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
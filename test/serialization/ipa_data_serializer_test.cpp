@@ -70,7 +70,14 @@ int testVectorSerdes(const std::vector<T> &in,
 	std::vector<uint8_t> buf;
 	std::vector<SharedFD> fds;
 
+	size_t size = IPADataSerializer<std::vector<T>>::serializedSize(in, cs);
 	std::tie(buf, fds) = IPADataSerializer<std::vector<T>>::serialize(in, cs);
+	if (buf.size() > size) {
+		cerr << "Serialized vector size " << buf.size()
+		     << " exceeds computed size " << size << endl;
+		return TestFail;
+	}
+
 	std::vector<T> out = IPADataSerializer<std::vector<T>>::deserialize(buf, fds, cs);
 	if (in == out)
 		return TestPass;
@@ -90,7 +97,14 @@ int testMapSerdes(const std::map<K, V> &in,
 	std::vector<uint8_t> buf;
 	std::vector<SharedFD> fds;
 
+	size_t size = IPADataSerializer<std::map<K, V>>::serializedSize(in, cs);
 	std::tie(buf, fds) = IPADataSerializer<std::map<K, V>>::serialize(in, cs);
+	if (buf.size() > size) {
+		cerr << "Serialized map size " << buf.size()
+		     << " exceeds computed size " << size << endl;
+		return TestFail;
+	}
+
 	std::map<K, V> out = IPADataSerializer<std::map<K, V>>::deserialize(buf, fds, cs);
 	if (in == out)
 		return TestPass;
@@ -186,6 +200,24 @@ private:
 			return TestFail;
 		}
 
+		/*
+		 * Serialize a list that changes one control and drops another
+		 * one, which is delta-encoded against the previous list.
+		 */
+		ControlList deltaList(infoMap);
+		deltaList.set(controls::Brightness, 0.5f);
+		deltaList.set(controls::Contrast, 1.5f);
+
+		std::tie(listBuf, std::ignore) =
+			IPADataSerializer<ControlList>::serialize(deltaList, &cs);
+
+		listOut = IPADataSerializer<ControlList>::deserialize(listBuf, &cs);
+
+		if (!SerializationTest::equals(deltaList, listOut)) {
+			cerr << "Deserialized delta list doesn't match original" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -5,6 +5,8 @@
  * Threads test
  */
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <memory>
@@ -12,6 +14,7 @@
 #include <thread>
 #include <time.h>
 
+#include <libcamera/base/allocation_tracker.h>
 #include <libcamera/base/thread.h>
 
 #include "test.h"
@@ -66,6 +69,37 @@ private:
 	bool &cancelled_;
 };
 
+class AllocationThread : public Thread
+{
+public:
+	static constexpr unsigned int kAllocations = 10;
+
+	AllocationThread()
+		: Thread("AllocationTest"), allocations_(0)
+	{
+	}
+
+	uint64_t allocations() const { return allocations_; }
+
+protected:
+	void run()
+	{
+		uint64_t start = AllocationTracker::threadAllocations();
+
+		/* Store the pointers to prevent the compiler from eliding them. */
+		for (unsigned int i = 0; i < kAllocations; i++) {
+			sink_ = new int(i);
+			delete sink_.load();
+		}
+
+		allocations_ = AllocationTracker::threadAllocations() - start;
+	}
+
+private:
+	std::atomic<int *> sink_;
+	uint64_t allocations_;
+};
+
 class ThreadTest : public Test
 {
 protected:
@@ -165,6 +199,32 @@ protected:
 			return TestFail;
 		}
 
+		/* Test allocation tracking, when compiled in. */
+		if (AllocationTracker::enabled()) {
+			AllocationThread allocThread;
+			allocThread.start();
+			allocThread.wait();
+
+			if (allocThread.allocations() != AllocationThread::kAllocations) {
+				cout << "Expected " << AllocationThread::kAllocations
+				     << " allocations, got " << allocThread.allocations()
+				     << endl;
+				return TestFail;
+			}
+
+			std::vector<AllocationTracker::ThreadStats> stats =
+				AllocationTracker::threadStats();
+			auto it = std::find_if(stats.begin(), stats.end(),
+					       [](const AllocationTracker::ThreadStats &s) {
+						       return s.name == "AllocationTest";
+					       });
+			if (it == stats.end() ||
+			    it->allocations < AllocationThread::kAllocations) {
+				cout << "Allocations not accounted to the thread" << endl;
+				return TestFail;
+			}
+		}
+
 		return TestPass;
 	}
 
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * libcamera V4L2 API tests
+ *
+ * Capture from a video device opened from a blocking file handle
+ */
+
+#include <fcntl.h>
+#include <iostream>
+
+#include <libcamera/framebuffer.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/unique_fd.h>
+
+#include "v4l2_videodevice_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+class BlockingHandleTest : public V4L2VideoDeviceTest
+{
+public:
+	BlockingHandleTest()
+		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames_(0),
+		  wakeupFrames_(0), stalled_(false)
+	{
+	}
+
+	void receiveBuffer(FrameBuffer *buffer)
+	{
+		frames_++;
+
+		/*
+		 * The video device must not drain buffers in a loop when the
+		 * handle is blocking, as dequeuing would then wait for the
+		 * next frame instead of returning to the event loop. Detect
+		 * this by counting the buffers delivered without going
+		 * through the event loop, and stop requeuing them to let the
+		 * test complete.
+		 */
+		if (frames_ - wakeupFrames_ > 2 * kBufferCount) {
+			stalled_ = true;
+			return;
+		}
+
+		capture_->queueBuffer(buffer);
+	}
+
+protected:
+	static constexpr unsigned int kBufferCount = 4;
+
+	int init()
+	{
+		int ret = V4L2VideoDeviceTest::init();
+		if (ret != TestPass)
+			return ret;
+
+		/* Reopen the device from a blocking file handle. */
+		UniqueFD fd(::open(capture_->deviceNode().c_str(), O_RDWR));
+		if (!fd.isValid()) {
+			std::cout << "Failed to open video device" << std::endl;
+			return TestFail;
+		}
+
+		capture_->close();
+
+		ret = capture_->open(SharedFD(std::move(fd)),
+				     V4L2_BUF_TYPE_VIDEO_CAPTURE);
+		if (ret) {
+			std::cout << "Failed to open video device from handle"
+				  << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		int ret;
+
+		ret = capture_->allocateBuffers(kBufferCount, &buffers_);
+		if (ret < 0) {
+			std::cout << "Failed to allocate buffers" << std::endl;
+			return TestFail;
+		}
+
+		capture_->bufferReady.connect(this, &BlockingHandleTest::receiveBuffer);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (capture_->queueBuffer(buffer.get())) {
+				std::cout << "Failed to queue buffer" << std::endl;
+				return TestFail;
+			}
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		const unsigned int nFrames = 30;
+
+		timeout.start(500ms * nFrames);
+		while (timeout.isRunning()) {
+			wakeupFrames_ = frames_;
+			dispatcher->processEvents();
+			if (frames_ > nFrames || stalled_)
+				break;
+		}
+
+		ret = capture_->streamOff();
+		if (ret)
+			return TestFail;
+
+		if (stalled_) {
+			std::cout << "Buffers drained from a blocking handle"
+				  << std::endl;
+			return TestFail;
+		}
+
+		if (frames_ < nFrames) {
+			std::cout << "Failed to capture " << nFrames
+				  << " frames within timeout." << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+	unsigned int wakeupFrames_;
+	bool stalled_;
+};
+
+TEST_REGISTER(BlockingHandleTest)
@@ -5,6 +5,7 @@
  * Test the buffer cache different operation modes
  */
 
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <vector>
@@ -155,6 +156,90 @@ public:
 		return TestPass;
 	}
 
+	/*
+	 * Test that the cache statistics count hits, misses and evictions
+	 * when cycling through more buffers than the cache has entries.
+	 */
+	int testStatistics(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
+	{
+		const unsigned int numEntries = buffers.size() / 2;
+		V4L2BufferCache cache(numEntries);
+
+		for (unsigned int i = 0; i < numEntries * 2; i++) {
+			int index = cache.get(*buffers[i % numEntries].get());
+			cache.put(index);
+		}
+
+		const V4L2BufferCache::Statistics &stats = cache.statistics();
+		if (stats.hits != numEntries || stats.misses != numEntries ||
+		    stats.evictions != 0) {
+			std::cout << "Invalid statistics with enough entries"
+				  << std::endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < buffers.size(); i++) {
+			int index = cache.get(*buffers[i].get());
+			cache.put(index);
+		}
+
+		if (stats.hits != numEntries * 2 ||
+		    stats.misses != numEntries * 2 ||
+		    stats.evictions != numEntries) {
+			std::cout << "Invalid statistics with too few entries"
+				  << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Test that pinned buffers always use their pinned index, and that
+	 * the pinned indexes are never used for other buffers.
+	 */
+	int testPinned(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
+	{
+		const unsigned int numEntries = buffers.size() / 2;
+		const unsigned int numPinned = numEntries / 2;
+		V4L2BufferCache cache(numEntries);
+		std::vector<int> pinned;
+
+		for (unsigned int i = 0; i < numPinned; i++) {
+			int index = cache.pin(*buffers[i].get());
+			if (index < 0) {
+				std::cout << "Failed to pin buffer" << std::endl;
+				return TestFail;
+			}
+
+			pinned.push_back(index);
+		}
+
+		std::uniform_int_distribution<> dist(0, buffers.size() - 1);
+
+		for (unsigned int i = 0; i < buffers.size() * 100; i++) {
+			unsigned int nBuffer = dist(generator_);
+			int index = cache.get(*buffers[nBuffer].get());
+			if (index < 0) {
+				std::cout << "Failed lookup from cache"
+					  << std::endl;
+				return TestFail;
+			}
+
+			bool isPinned = std::find(pinned.begin(), pinned.end(),
+						  index) != pinned.end();
+			if (nBuffer < numPinned ? index != pinned[nBuffer] : isPinned) {
+				std::cout << "Pinned index used for the wrong buffer"
+					  << std::endl;
+				return TestFail;
+			}
+
+			cache.put(index);
+		}
+
+		return TestPass;
+	}
+
 	int init() override
 	{
 		std::random_device rd;
@@ -240,6 +325,12 @@ public:
 		if (testIsEmpty(buffers) != TestPass)
 			return TestFail;
 
+		if (testStatistics(buffers) != TestPass)
+			return TestFail;
+
+		if (testPinned(buffers) != TestPass)
+			return TestFail;
+
 		return TestPass;
 	}
 
@@ -6,10 +6,13 @@
  */
 
 #include <array>
+#include <endian.h>
 #include <iostream>
 #include <map>
 #include <string>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/utils.h>
@@ -46,6 +49,67 @@ static const string testYaml =
 static const string invalidYaml =
 	"Invalid : - YAML : - Content";
 
+/*
+ * Build files in the compiled YAML format, as generated by
+ * utils/tuning/compile_tuning.py.
+ */
+class CompiledYaml
+{
+public:
+	CompiledYaml()
+		: data_(16, '\0')
+	{
+	}
+
+	uint32_t value(const string &value)
+	{
+		return node(0, value.size(), value);
+	}
+
+	uint32_t list(const vector<uint32_t> &elements)
+	{
+		string payload;
+		for (uint32_t element : elements)
+			payload += field(element);
+
+		return node(1, elements.size(), payload);
+	}
+
+	uint32_t dictionary(const vector<pair<uint32_t, uint32_t>> &entries)
+	{
+		string payload;
+		for (const auto &[key, value] : entries)
+			payload += field(key) + field(value);
+
+		return node(2, entries.size(), payload);
+	}
+
+	uint32_t node(uint32_t type, uint32_t count, const string &payload)
+	{
+		uint32_t offset = data_.size();
+
+		data_ += field(type) + field(count) + payload;
+		data_.resize((data_.size() + 3) / 4 * 4, '\0');
+
+		return offset;
+	}
+
+	string compile(uint32_t root, const char *magic = "LCTB") const
+	{
+		return string(magic, 4) + field(1) + field(data_.size()) +
+		       field(root) + data_.substr(16);
+	}
+
+private:
+	static string field(uint32_t value)
+	{
+		value = htole32(value);
+		return string(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	string data_;
+};
+
 class YamlParserTest : public Test
 {
 protected:
@@ -557,6 +621,119 @@ protected:
 			return TestFail;
 		}
 
+		return testCompiledYaml();
+	}
+
+	std::unique_ptr<YamlObject> parseCompiled(const string &content)
+	{
+		string filename;
+		if (!createFile(content, filename))
+			return nullptr;
+
+		File file{ filename };
+		std::unique_ptr<YamlObject> root;
+		if (file.open(File::OpenModeFlag::ReadOnly))
+			root = YamlParser::parse(file);
+
+		unlink(filename.c_str());
+
+		return root;
+	}
+
+	int testCompiledYaml()
+	{
+		/* Test a compiled file with a node shared through an alias. */
+		CompiledYaml yaml;
+
+		uint32_t one = yaml.value("1");
+		uint32_t size = yaml.list({ yaml.value("1920"), yaml.value("1080") });
+		uint32_t dictionary = yaml.dictionary({
+			{ yaml.value("one"), one },
+			{ yaml.value("two"), yaml.value("2") },
+		});
+		uint32_t root = yaml.dictionary({
+			{ yaml.value("string"), yaml.value("libcamera") },
+			{ yaml.value("size"), size },
+			{ yaml.value("dictionary"), dictionary },
+			{ yaml.value("alias"), one },
+		});
+
+		string compiled = yaml.compile(root);
+
+		std::unique_ptr<YamlObject> obj = parseCompiled(compiled);
+		if (!obj || !obj->isDictionary() || obj->size() != 4) {
+			cerr << "Failed to parse compiled YAML file" << std::endl;
+			return TestFail;
+		}
+
+		if ((*obj)["string"].get<string>() != "libcamera" ||
+		    (*obj)["size"].get<Size>() != Size(1920, 1080) ||
+		    (*obj)["dictionary"]["one"].get<int32_t>() != 1 ||
+		    (*obj)["dictionary"]["two"].get<int32_t>() != 2 ||
+		    (*obj)["alias"].get<int32_t>() != 1) {
+			cerr << "Invalid compiled YAML file content" << std::endl;
+			return TestFail;
+		}
+
+		/* Test a compiled file with an invalid magic number. */
+		if (parseCompiled(yaml.compile(root, "LCTX"))) {
+			cerr << "Compiled YAML file with invalid magic parsed successfully"
+			     << std::endl;
+			return TestFail;
+		}
+
+		/* Test truncated compiled files. */
+		if (parseCompiled(compiled.substr(0, 12)) ||
+		    parseCompiled(compiled.substr(0, compiled.size() - 4))) {
+			cerr << "Truncated compiled YAML file parsed successfully"
+			     << std::endl;
+			return TestFail;
+		}
+
+		/* Test compiled files with counts exceeding the file size. */
+		CompiledYaml corruptList;
+		root = corruptList.node(1, 0x40000000, "");
+		if (parseCompiled(corruptList.compile(root))) {
+			cerr << "Compiled YAML file with corrupt list parsed successfully"
+			     << std::endl;
+			return TestFail;
+		}
+
+		CompiledYaml corruptValue;
+		root = corruptValue.node(0, 0xffffffff, "libcamera");
+		if (parseCompiled(corruptValue.compile(root))) {
+			cerr << "Compiled YAML file with corrupt value parsed successfully"
+			     << std::endl;
+			return TestFail;
+		}
+
+		/* Test forward references, which could create loops. */
+		CompiledYaml loop;
+		root = loop.node(1, 1, string(4, '\0'));
+		string looped = loop.compile(root);
+		uint32_t self = htole32(root);
+		looped.replace(root + 8, 4, reinterpret_cast<const char *>(&self), 4);
+		if (parseCompiled(looped)) {
+			cerr << "Compiled YAML file with a loop parsed successfully"
+			     << std::endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test a compiled file that references the same nodes
+		 * repeatedly, expanding to 2^32 nodes.
+		 */
+		CompiledYaml expansion;
+		root = expansion.value("libcamera");
+		for (unsigned int i = 0; i < 32; ++i)
+			root = expansion.list({ root, root });
+
+		if (parseCompiled(expansion.compile(root))) {
+			cerr << "Compiled YAML file with excessive expansion parsed successfully"
+			     << std::endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Copyright (C) 2024, Google Inc.
+#
+# Decode a libcamera binary log file to text
+#
+# Binary log files are written when the LIBCAMERA_LOG_FILE environment variable
+# contains the "binary" option. The file is made of three regions, all integers
+# being stored in the byte order of the machine that wrote the log:
+#
+# - The header, at offset 0, described by HEADER.
+# - The string table, at header.strings_offset, storing header.strings_used
+#   bytes of strings. Each string is stored as a 16-bit length followed by its
+#   characters, strings are referenced by their index in the table.
+# - The ring buffer of records, at header.ring_offset. Records are addressed by
+#   a position that grows forever, their offset in the ring buffer is the
+#   position modulo header.ring_size. The valid records span from header.tail
+#   to header.head. Each record is described by RECORD and followed by the
+#   message text, padded to a multiple of 8 bytes. A record with a category
+#   set to PADDING fills the end of the ring buffer, the next record starts at
+#   the beginning of the ring buffer.
+
+import argparse
+import collections
+import struct
+import sys
+
+HEADER = struct.Struct('=8sIIQQQQQQQ')
+Header = collections.namedtuple('Header', [
+    'magic', 'version', 'header_size', 'strings_offset', 'strings_size',
+    'ring_offset', 'ring_size', 'strings_used', 'head', 'tail'])
+
+RECORD = struct.Struct('=IIIIQIB3x')
+Record = collections.namedtuple('Record', [
+    'size', 'category', 'location', 'thread', 'timestamp', 'length',
+    'severity'])
+
+MAGIC = b'LCLOGBIN'
+VERSION = 1
+PADDING = 0xffffffff
+
+SEVERITIES = ['DEBUG', ' INFO', ' WARN', 'ERROR', 'FATAL']
+
+
+def parse_strings(data, header):
+    strings = []
+    offset = header.strings_offset
+    end = offset + header.strings_used
+
+    while offset < end:
+        length, = struct.unpack_from('=H', data, offset)
+        offset += 2
+        strings.append(data[offset:offset + length].decode(errors='replace'))
+        offset += length
+
+    return strings
+
+
+def parse_records(data, header):
+    ring = data[header.ring_offset:header.ring_offset + header.ring_size]
+    position = header.tail
+
+    while position < header.head:
+        offset = position % header.ring_size
+        record = Record(*RECORD.unpack_from(ring, offset))
+        if not record.size:
+            raise RuntimeError(f'Invalid record at position {position}')
+
+        position += record.size
+
+        if record.category == PADDING:
+            continue
+
+        start = offset + RECORD.size
+        text = ring[start:start + record.length].decode(errors='replace')
+        yield record, text
+
+
+def format_timestamp(ns):
+    secs = ns // 1000000000
+    return f'{secs // 3600}:{(secs // 60) % 60:02}:{secs % 60:02}.{ns % 1000000000:09}'
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+            description='Decode a libcamera binary log file to text')
+    parser.add_argument('-c', '--category', type=str, action='append',
+                        help='Only print messages of the category (may be repeated)')
+    parser.add_argument('-s', '--severity', type=int, default=0,
+                        help='Only print messages with a severity higher than or equal to the value (0 to 4)')
+    parser.add_argument('log_file', type=str, help='Path to the binary log file')
+    args = parser.parse_args(argv[1:])
+
+    with open(args.log_file, 'rb') as f:
+        data = f.read()
+
+    header = Header(*HEADER.unpack_from(data, 0))
+    if header.magic != MAGIC:
+        print(f'{args.log_file}: not a libcamera binary log file', file=sys.stderr)
+        return 1
+
+    if header.version != VERSION:
+        print(f'{args.log_file}: unsupported version {header.version}', file=sys.stderr)
+        return 1
+
+    strings = parse_strings(data, header)
+
+    def string(index):
+        return strings[index] if index < len(strings) else '?'
+
+    for record, text in parse_records(data, header):
+        category = string(record.category)
+        if args.category and category not in args.category:
+            continue
+
+        if record.severity < args.severity:
+            continue
+
+        # Messages without a category, such as backtraces, are raw text.
+        if not record.category:
+            print(text, end='')
+            continue
+
+        if record.severity < len(SEVERITIES):
+            severity = SEVERITIES[record.severity]
+        else:
+            severity = 'UNKWN'
+
+        print(f'[{format_timestamp(record.timestamp)}] [{record.thread}] '
+              f'{severity} {category} {string(record.location)} {text}', end='')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
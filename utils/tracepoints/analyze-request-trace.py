@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Copyright (C) 2024, Google Inc.
+#
+# Reconstruct per-request latency breakdowns from libcamera lttng traces
+#
+# Every completed request is broken down in a sequence of milestones, from its
+# queueing by the application to its completion: queueing to the device, V4L2
+# buffer queue, frame start, delayed controls application, V4L2 buffer dequeue,
+# converter or software ISP processing. The time spent between consecutive
+# milestones is reported per request, and summarized over the whole trace. The
+# time spent in the IPA calls for the request's frame is reported separately.
+#
+# Requests are associated with their buffers through the request buffer
+# completion events, and with their frame number through the first IPA call
+# carrying a frame number that follows the request queueing to the device.
+
+import argparse
+import bt2
+import statistics as stats
+import sys
+
+NO_FRAME = 0xffffffff
+
+
+class RequestRecord:
+    def __init__(self, request, cookie, timestamp):
+        self.request = request
+        self.cookie = cookie
+        self.queued = timestamp
+        self.device_queued = None
+        self.completed = None
+        self.frame = None
+        self.buffers = {}
+
+    def milestones(self, trace):
+        ms = [('queue', self.queued)]
+        if self.device_queued is not None:
+            ms.append(('device queue', self.device_queued))
+
+        sequence = self.frame
+        for buffer, completed in self.buffers.items():
+            for name, timestamp, node, seq in trace.buffer_events.get(buffer, []):
+                if timestamp < self.queued or timestamp > completed:
+                    continue
+                ms.append((f'{name} {node}' if node else name, timestamp))
+                if sequence is None and seq is not None:
+                    sequence = seq
+
+        if sequence is not None:
+            for name, events in (('frame start', trace.frame_starts),
+                                 ('controls apply', trace.controls_applied)):
+                timestamp = events.get(sequence)
+                if timestamp is not None and timestamp >= self.queued:
+                    ms.append((name, timestamp))
+
+        if self.completed is not None:
+            ms.append(('complete', self.completed))
+
+        ms.sort(key=lambda m: m[1])
+        return ms
+
+
+class Trace:
+    def __init__(self, pipeline):
+        self.pipeline = pipeline
+
+        # request -> RequestRecord, for the requests in flight
+        self.in_flight = {}
+        # Request queued to the device, waiting for its frame number
+        self.pending_frame = None
+        # Completed requests
+        self.requests = []
+
+        # buffer -> [(event, timestamp, node, sequence)]
+        self.buffer_events = {}
+        # sequence -> timestamp
+        self.frame_starts = {}
+        self.controls_applied = {}
+
+        # (pipeline, function, frame) -> [begin timestamps]
+        self.ipa_begin = {}
+        # frame -> {function -> duration}
+        self.ipa_durations = {}
+
+    def buffer_event(self, buffer, name, timestamp, node=None, sequence=None):
+        self.buffer_events.setdefault(buffer, []).append((name, timestamp, node, sequence))
+
+    def handle(self, name, payload, timestamp):
+        if name == 'request_queue':
+            request = int(payload['request'])
+            record = RequestRecord(request, int(payload['cookie']), timestamp)
+            self.in_flight[request] = record
+
+        elif name == 'request_device_queue':
+            record = self.in_flight.get(int(payload['request']))
+            if record:
+                record.device_queued = timestamp
+                self.pending_frame = record
+
+        elif name == 'request_complete_buffer':
+            record = self.in_flight.get(int(payload['request']))
+            if record:
+                record.buffers[int(payload['buffer'])] = timestamp
+
+        elif name == 'request_complete':
+            record = self.in_flight.pop(int(payload['request']), None)
+            if record:
+                record.completed = timestamp
+                self.requests.append(record)
+
+        elif name == 'v4l2_queue_buffer':
+            self.buffer_event(int(payload['buffer']), 'qbuf', timestamp,
+                              str(payload['device_node']))
+
+        elif name == 'v4l2_dequeue_buffer':
+            self.buffer_event(int(payload['buffer']), 'dqbuf', timestamp,
+                              str(payload['device_node']), int(payload['sequence']))
+
+        elif name == 'v4l2_frame_start':
+            self.frame_starts.setdefault(int(payload['sequence']), timestamp)
+
+        elif name == 'delayed_controls_apply':
+            self.controls_applied.setdefault(int(payload['sequence']), timestamp)
+
+        elif name in ('converter_queue_buffer', 'converter_complete_buffer'):
+            event = 'converter ' + name.split('_')[1]
+            self.buffer_event(int(payload['buffer']), event, timestamp)
+
+        elif name in ('software_isp_queue_buffer', 'software_isp_complete_buffer'):
+            event = 'soft isp ' + name.split('_')[2]
+            self.buffer_event(int(payload['buffer']), event, timestamp)
+
+        elif name.startswith('ipa_frame_'):
+            self.handle_ipa(name, payload, timestamp)
+
+    def handle_ipa(self, name, payload, timestamp):
+        pipeline = str(payload['pipeline_name'])
+        if self.pipeline is not None and pipeline != self.pipeline:
+            return
+
+        func = str(payload['function_name'])
+        frame = int(payload['frame'])
+        if frame == NO_FRAME:
+            return
+
+        if name == 'ipa_frame_call_queue':
+            if self.pending_frame:
+                self.pending_frame.frame = frame
+                self.pending_frame = None
+
+        elif name == 'ipa_frame_call_begin':
+            self.ipa_begin.setdefault((pipeline, func, frame), []).append(timestamp)
+
+        elif name == 'ipa_frame_call_end':
+            begin = self.ipa_begin.get((pipeline, func, frame))
+            if not begin:
+                return
+
+            durations = self.ipa_durations.setdefault(frame, {})
+            durations[func] = durations.get(func, 0) + timestamp - begin.pop()
+
+
+def us(ns):
+    return f'{ns / 1000:.1f}'
+
+
+def print_table(rows):
+    widths = [max([len(row[i]) for row in rows]) for i in range(len(rows[0]))]
+    for row in rows:
+        fmt = [row[i].rjust(widths[i]) for i in range(1, len(row))]
+        print(' '.join([row[0].ljust(widths[0])] + fmt))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+            description='Reconstruct per-request latency breakdowns from libcamera traces')
+    parser.add_argument('-p', '--pipeline', type=str,
+                        help='Name of pipeline to filter IPA calls for')
+    parser.add_argument('-r', '--requests', action='store_true',
+                        help='Print the breakdown of every request')
+    parser.add_argument('trace_path', type=str,
+                        help='Path to lttng trace (eg. ~/lttng-traces/demo-20201029-184003)')
+    args = parser.parse_args(argv[1:])
+
+    trace = Trace(args.pipeline)
+
+    for msg in bt2.TraceCollectionMessageIterator(args.trace_path):
+        if type(msg) is not bt2._EventMessageConst:
+            continue
+
+        name = msg.event.name
+        if not name.startswith('libcamera:'):
+            continue
+
+        trace.handle(name[len('libcamera:'):], msg.event.payload_field,
+                     msg.default_clock_snapshot.ns_from_origin)
+
+    if not trace.requests:
+        print('No completed request found in trace')
+        return 1
+
+    # stage -> samples[], in order of first appearance
+    samples = {}
+
+    for record in trace.requests:
+        ms = record.milestones(trace)
+        stages = [(f'{prev[0]} -> {cur[0]}', cur[1] - prev[1])
+                  for prev, cur in zip(ms, ms[1:])]
+
+        durations = trace.ipa_durations.get(record.frame, {}) \
+            if record.frame is not None else {}
+        stages += [(f'ipa {func}', duration) for func, duration in durations.items()]
+
+        for stage, duration in stages:
+            samples.setdefault(stage, []).append(duration)
+
+        if args.requests:
+            frame = record.frame if record.frame is not None else '-'
+            total = ms[-1][1] - ms[0][1]
+            print(f'request {record.request:#x} cookie {record.cookie} frame {frame}: '
+                  f'{us(total)} us')
+            for stage, duration in stages:
+                print(f'    {stage}: {us(duration)} us')
+
+    rows = [['stage (us)', 'count', 'min', 'mean', 'p95', 'max']]
+    for stage, values in samples.items():
+        values.sort()
+        p95 = values[min(len(values) - 1, len(values) * 95 // 100)]
+        rows.append([stage, str(len(values)), us(values[0]),
+                     us(stats.mean(values)), us(p95), us(values[-1])])
+
+    if args.requests:
+        print()
+    print_table(rows)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
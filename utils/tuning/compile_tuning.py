@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2024, Ideas on Board Oy
+#
+# Compile a YAML or JSON tuning file to the libcamera binary YAML format
+#
+# The compiled file stores the tree of YAML nodes in a form that libcamera
+# loads without tokenizing the text. Scalars are stored as the strings that
+# appear in the source file, so values are interpreted identically. The text
+# file remains the source of truth, and the compiled file must be regenerated
+# when it changes.
+#
+# All fields are little-endian 32-bit integers, and nodes are aligned to 4
+# bytes. The file starts with a header:
+#
+#   magic 'LCTB', version, total file size, root node offset
+#
+# followed by the nodes, each starting with its type and a count:
+#
+#   value (0):      length in bytes, string bytes
+#   list (1):       number of elements, element node offsets
+#   dictionary (2): number of entries, (key node offset, value node offset)
+#
+# Nodes reference only nodes stored before them.
+
+import argparse
+import struct
+import sys
+
+import yaml
+
+MAGIC = b'LCTB'
+VERSION = 1
+HEADER_SIZE = 16
+
+NODE_VALUE = 0
+NODE_LIST = 1
+NODE_DICTIONARY = 2
+
+
+class Compiler(object):
+    def __init__(self):
+        self.data = bytearray(HEADER_SIZE)
+        self.offsets = {}
+
+    def emit(self, node_type, count, payload):
+        offset = len(self.data)
+        self.data += struct.pack('<II', node_type, count) + payload
+        self.data += bytes(-len(self.data) % 4)
+        return offset
+
+    def node(self, node):
+        # Nodes referenced through YAML aliases are stored once.
+        if id(node) in self.offsets:
+            return self.offsets[id(node)]
+
+        if isinstance(node, yaml.ScalarNode):
+            value = node.value.encode('utf-8')
+            offset = self.emit(NODE_VALUE, len(value), value)
+        elif isinstance(node, yaml.SequenceNode):
+            children = [self.node(child) for child in node.value]
+            offset = self.emit(NODE_LIST, len(children),
+                               struct.pack(f'<{len(children)}I', *children))
+        elif isinstance(node, yaml.MappingNode):
+            entries = []
+            for key, value in node.value:
+                if not isinstance(key, yaml.ScalarNode):
+                    raise ValueError(f'Non-scalar key at {key.start_mark}')
+                entries += [self.node(key), self.node(value)]
+            offset = self.emit(NODE_DICTIONARY, len(entries) // 2,
+                               struct.pack(f'<{len(entries)}I', *entries))
+        else:
+            raise ValueError(f'Unsupported node at {node.start_mark}')
+
+        self.offsets[id(node)] = offset
+        return offset
+
+    def compile(self, root):
+        offset = self.node(root)
+        self.data[0:HEADER_SIZE] = MAGIC + struct.pack('<III', VERSION,
+                                                       len(self.data), offset)
+        return bytes(self.data)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description='Compile a YAML or JSON tuning file to the libcamera binary format')
+    parser.add_argument('input', type=argparse.FileType('r'),
+                        help='Input tuning file')
+    parser.add_argument('output', type=argparse.FileType('wb'),
+                        help='Output compiled file')
+    args = parser.parse_args(argv[1:])
+
+    root = yaml.compose(args.input, Loader=yaml.SafeLoader)
+    if root is None:
+        print(f'{args.input.name}: empty document', file=sys.stderr)
+        return 1
+
+    try:
+        data = Compiler().compile(root)
+    except ValueError as e:
+        print(f'{args.input.name}: {e}', file=sys.stderr)
+        return 1
+
+    args.output.write(data)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -6,6 +6,7 @@
 
 import binascii
 import numpy as np
+import os
 from pathlib import Path
 import pyexiv2 as pyexif
 import rawpy as raw
@@ -16,8 +17,12 @@ import libtuning.utils as utils
 
 
 class Image:
-    def __init__(self, path: Path):
+    # @param path Path to the image file
+    # @param cache_dir Directory in which to cache the decoded raw data, or None
+    #        to disable caching
+    def __init__(self, path: Path, cache_dir=None):
         self.path = path
+        self.cache_dir = Path(cache_dir) if cache_dir is not None else None
         self.lsc_only = False
         self.color = -1
         self.lux = -1
@@ -87,9 +92,40 @@ class Image:
         cfa_pattern = metadata[f'Exif.{subimage}.CFAPattern'].value
         self.order = bayer_case[cfa_pattern]
 
-    def _read_image_dng(self):
+    # The cache file name encodes the size and modification time of the image
+    # file, to invalidate the cache entry when the file is replaced.
+    def _cache_path(self):
+        if self.cache_dir is None:
+            return None
+
+        st = self.path.stat()
+        return self.cache_dir.joinpath(f'{self.path.stem}-{st.st_size}-{st.st_mtime_ns}.npy')
+
+    def _decode_raw(self):
+        cache_path = self._cache_path()
+        if cache_path is not None and cache_path.exists():
+            try:
+                return np.load(cache_path)
+            except Exception as e:
+                utils.eprint(f'Ignoring invalid cache entry {cache_path}: {e}')
+
         raw_im = raw.imread(str(self.path))
-        raw_data = raw_im.raw_image
+        raw_data = raw_im.raw_image.copy()
+        raw_im.close()
+
+        if cache_path is not None:
+            # Write to a temporary file first, concurrent workers must never
+            # see a partially written entry.
+            self.cache_dir.mkdir(parents=True, exist_ok=True)
+            tmp_path = cache_path.with_suffix(f'.{os.getpid()}.tmp')
+            with open(tmp_path, 'wb') as f:
+                np.save(f, raw_data)
+            os.replace(tmp_path, cache_path)
+
+        return raw_data
+
+    def _read_image_dng(self):
+        raw_data = self._decode_raw()
         shift = 16 - self.sigbits
         c0 = np.left_shift(raw_data[0::2, 0::2].astype(np.int64), shift)
         c1 = np.left_shift(raw_data[0::2, 1::2].astype(np.int64), shift)
@@ -157,6 +157,10 @@ class Tuner(object):
         # we want a better logging infrastructure with log levels
         parser.add_argument('-l', '--log', type=str, default=None,
                             help='Output log file (optional)')
+        parser.add_argument('-j', '--jobs', type=int, default=None,
+                            help='Number of images to process in parallel (optional, defaults to the number of CPUs)')
+        parser.add_argument('--cache-dir', type=str, default=None,
+                            help='Directory in which to cache decoded images across runs (optional)')
         return parser.parse_args(argv[1:])
 
     def run(self, argv):
@@ -176,6 +180,10 @@ class Tuner(object):
             self.config = {'general': {}}
             disable = []
 
+        # The command line takes precedence over the config file
+        if args.jobs is not None:
+            self.config['general']['jobs'] = args.jobs
+
         # Remove disabled modules
         for module in disable:
             if module in self.modules:
@@ -190,7 +198,8 @@ class Tuner(object):
         # Only one LSC module allowed
         has_only_lsc = has_lsc and len(self.modules) == 1
 
-        images = utils.load_images(args.input, self.config, not has_only_lsc, has_lsc)
+        images = utils.load_images(args.input, self.config, not has_only_lsc, has_lsc,
+                                   args.cache_dir)
         if images is None or len(images) == 0:
             eprint(f'No images were found, or able to load')
             return -1
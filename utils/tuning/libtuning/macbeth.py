@@ -8,11 +8,95 @@
 # \todo Add debugging
 
 import cv2
+import functools
 import os
 from pathlib import Path
 import numpy as np
+from sklearn import cluster
+import warnings
 
 from libtuning.image import Image
+import libtuning.utils as utils
+
+
+class MacbethError(Exception):
+    pass
+
+
+# Size of the border and squares of the normalised macbeth chart
+_scale = 2
+_b_bord_x, _b_bord_y = _scale * 8.5, _scale * 13
+_s_bord = 6 * _scale
+_side = 41 * _scale
+
+
+# @brief Construct the normalised macbeth chart corners and square vertices
+# @param c_err Fraction of the square side by which to shrink the squares
+# @return (square_verts, mac_norm)
+#
+# The 24 squares are ordered by stacking macbeth chart columns from left to
+# right. The result is cached, do not modify it.
+@functools.lru_cache
+def get_square_verts(c_err=0.05):
+    x_max = _side * 6 + 5 * _s_bord + 2 * _b_bord_x
+    y_max = _side * 4 + 3 * _s_bord + 2 * _b_bord_y
+    mac_norm = np.array([[(0, 0), (0, y_max), (x_max, y_max), (x_max, 0)]],
+                        np.float32)
+
+    c_off = _side * c_err
+    square_0 = np.array(((0, 0), (0, _side), (_side, _side), (_side, 0)), np.float32)
+    square_0 += np.array((_b_bord_x, _b_bord_y), np.float32)
+    square_0 += np.array(((c_off, c_off), (c_off, -c_off),
+                          (-c_off, -c_off), (-c_off, c_off)), np.float32)
+
+    # Offset of the top-left corner of each square, column by column
+    cols, rows = np.meshgrid(np.arange(6), np.arange(4), indexing='ij')
+    offsets = np.stack((cols.flatten(), rows.flatten()), axis=1) * (_side + _s_bord)
+    square_verts = square_0[np.newaxis, :, :] + offsets[:, np.newaxis, :]
+
+    return square_verts.astype(np.float32), mac_norm
+
+
+# @brief Construct the centres of the normalised macbeth chart squares
+# @param c_err See get_square_verts()
+def get_square_centres(c_err=0.05):
+    verts, _ = get_square_verts(c_err)
+    return np.mean(verts, axis=1).astype(np.float32)
+
+
+# @brief Compute the perspective transforms mapping quadrilaterals src to dst
+# @param src Array of source vertices, of shape (N, 4, 2)
+# @param dst Array of destination vertices, of shape (N, 4, 2)
+# @return An array of N 3x3 transformation matrices
+#
+# This is a batched equivalent of cv2.getPerspectiveTransform(), solving the
+# N linear systems in a single call instead of looping in Python.
+def get_perspective_transforms(src, dst):
+    n = src.shape[0]
+    x, y = src[:, :, 0].astype(np.float64), src[:, :, 1].astype(np.float64)
+    u, v = dst[:, :, 0].astype(np.float64), dst[:, :, 1].astype(np.float64)
+    one = np.ones_like(x)
+    zero = np.zeros_like(x)
+
+    a = np.empty((n, 8, 8))
+    a[:, 0::2] = np.stack((x, y, one, zero, zero, zero, -x * u, -y * u), axis=2)
+    a[:, 1::2] = np.stack((zero, zero, zero, x, y, one, -x * v, -y * v), axis=2)
+    b = np.empty((n, 8))
+    b[:, 0::2] = u
+    b[:, 1::2] = v
+
+    h = np.linalg.solve(a, b[:, :, np.newaxis])[:, :, 0]
+    return np.concatenate((h, np.ones((n, 1))), axis=1).reshape(n, 3, 3)
+
+
+# @brief Apply the perspective transforms to a set of points
+# @param points Array of points, of shape (M, 2)
+# @param mats Array of N 3x3 transformation matrices
+# @return An array of shape (N, M, 2) containing the transformed points
+def perspective_transform(points, mats):
+    homogeneous = np.concatenate((points, np.ones((points.shape[0], 1))), axis=1)
+    out = np.einsum('nij,mj->nmi', mats, homogeneous)
+    return out[:, :, :2] / out[:, :, 2:]
 
 
 # Reshape image to fixed width without distorting returns image and scale
@@ -136,7 +220,6 @@ def get_macbeth_chart(img, ref_data):
         # Obtain coordinates of nomralised macbeth and squares
         square_verts, mac_norm = get_square_verts(0.06)
         # For each square guess, find 24 possible macbeth chart centres
-        mac_mids = []
         squares_raw = []
         for i in range(len(squares)):
             square = squares[i]
@@ -157,16 +240,21 @@ def get_macbeth_chart(img, ref_data):
             square = np.reshape(square, (4, 2)).astype(np.float32)
             squares[i] = square
 
-            # Find 24 possible macbeth chart centres by trasnforming normalised
-            # macbeth square vertices onto candidate square vertices found in image
-            for j in range(len(square_verts)):
-                verts = square_verts[j]
-                p_mat = cv2.getPerspectiveTransform(verts, square)
-                mac_guess = cv2.perspectiveTransform(mac_norm, p_mat)
-                mac_guess = np.round(mac_guess).astype(np.int32)
+        # Find 24 possible macbeth chart centres by transforming normalised
+        # macbeth square vertices onto candidate square vertices found in
+        # image. All the transforms are computed at once, the candidate
+        # (square, vertices) pairs being enumerated square by square.
+        n_verts = len(square_verts)
+        mac_mids = []
+        if len(squares) > 0:
+            dst = np.repeat(np.array(squares), n_verts, axis=0)
+            src = np.tile(square_verts, (len(squares), 1, 1))
+            p_mats = get_perspective_transforms(src, dst)
+            mac_guess = perspective_transform(mac_norm[0], p_mats)
+            mac_guess = np.round(mac_guess).astype(np.int32)
+            mids = np.mean(mac_guess, axis=1)
 
-                mac_mid = np.mean(mac_guess, axis=1)
-                mac_mids.append([mac_mid, (i, j)])
+            mac_mids = [[mids[k], divmod(k, n_verts)] for k in range(len(mids))]
 
         if len(mac_mids) == 0:
             raise MacbethError(
@@ -177,10 +265,6 @@ def get_macbeth_chart(img, ref_data):
                 '- Quadrilaterals in image background\n'
             )
 
-        # Reshape data
-        for i in range(len(mac_mids)):
-            mac_mids[i][0] = mac_mids[i][0][0]
-
         # Find where midpoints cluster to identify most likely macbeth centres
         clustering = cluster.AgglomerativeClustering(
             n_clusters=None,
@@ -226,7 +310,7 @@ def get_macbeth_chart(img, ref_data):
             if clus_list[i][1] < clus_len_max * clus_tol:
                 clus_list = clus_list[:i]
                 break
-            cent = np.mean(clus_list[i][0], axis=0)[0]
+            cent = np.mean([x[0] for x in clus_list[i][0]], axis=0)
             clus_list[i].append(cent)
 
         # Get centres of each normalised square
@@ -369,20 +453,15 @@ def get_macbeth_chart(img, ref_data):
 
     # Catch macbeth errors and continue with code
     except MacbethError as error:
-        eprint(error)
+        utils.eprint(error)
         return (0, None, None, False)
 
 
-def find_macbeth(img, mac_config):
-    small_chart = mac_config['small']
-    show = mac_config['show']
-
-    # Catch the warnings
-    warnings.simplefilter("ignore")
-    warnings.warn("runtime", RuntimeWarning)
-
-    # Reference macbeth chart is created that will be correlated with the
-    # located macbeth chart guess to produce a confidence value for the match.
+# Reference macbeth chart is created that will be correlated with the located
+# macbeth chart guess to produce a confidence value for the match. It is loaded
+# once per process and shared by all images.
+@functools.lru_cache
+def _get_ref_data():
     script_dir = Path(os.path.realpath(os.path.dirname(__file__)))
     macbeth_ref_path = script_dir.joinpath('macbeth_ref.pgm')
     ref = cv2.imread(str(macbeth_ref_path), flags=cv2.IMREAD_GRAYSCALE)
@@ -393,7 +472,18 @@ def find_macbeth(img, mac_config):
     rc3 = (ref_w, ref_h)
     rc4 = (ref_w, 0)
     ref_corns = np.array((rc1, rc2, rc3, rc4), np.float32)
-    ref_data = (ref, ref_w, ref_h, ref_corns)
+    return (ref, ref_w, ref_h, ref_corns)
+
+
+def find_macbeth(img, mac_config, name):
+    small_chart = mac_config['small']
+    show = mac_config['show']
+
+    # Catch the warnings
+    warnings.simplefilter("ignore")
+    warnings.warn("runtime", RuntimeWarning)
+
+    ref_data = _get_ref_data()
 
     # Locate macbeth chart
     cor, mac, coords, ret = get_macbeth_chart(img, ref_data)
@@ -456,7 +546,7 @@ def find_macbeth(img, mac_config):
         w_inc = int(w * pair['inc'])
         h_inc = int(h * pair['inc'])
 
-        loop = ((1 - pair['sel']) / pair['inc']) + 1
+        loop = round((1 - pair['sel']) / pair['inc']) + 1
         # For each subselection, look for a macbeth chart
         for i in range(loop):
             for j in range(loop):
@@ -486,7 +576,7 @@ def find_macbeth(img, mac_config):
 
     coords_fit = coords
     if cor < 0.75:
-        eprint(f'Warning: Low confidence {cor:.3f} for macbeth chart in {img.path.name}')
+        utils.eprint(f'Warning: Low confidence {cor:.3f} for macbeth chart in {name}')
 
     if show:
         draw_macbeth_results(img, coords_fit)
@@ -499,18 +589,19 @@ def locate_macbeth(image: Image, config: dict):
     av_chan = (np.mean(np.array(image.channels), axis=0) / (2**16))
     av_val = np.mean(av_chan)
     if av_val < image.blacklevel_16 / (2**16) + 1 / 64:
-        eprint(f'Image {image.path.name} too dark')
+        utils.eprint(f'Image {image.path.name} too dark')
         return None
 
-    macbeth = find_macbeth(av_chan, config['general']['macbeth'])
+    mac_config = config['general'].get('macbeth', {'small': 0, 'show': 0})
+    macbeth = find_macbeth(av_chan, mac_config, image.path.name)
 
     if macbeth is None:
-        eprint(f'No macbeth chart found in {image.path.name}')
+        utils.eprint(f'No macbeth chart found in {image.path.name}')
         return None
 
     mac_cen_coords = macbeth[1]
     if not image.get_patches(mac_cen_coords):
-        eprint(f'Macbeth patches have saturated in {image.path.name}')
+        utils.eprint(f'Macbeth patches have saturated in {image.path.name}')
         return None
 
     return macbeth
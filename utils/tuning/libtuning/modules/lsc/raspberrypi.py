@@ -89,8 +89,10 @@ class ALSCRaspberryPi(LSC):
         list_cb = []
         list_cg = []
         count = 0
-        for image in self._enumerate_lsc_images(images):
-            col, cr, cb, cg = self._do_single_alsc(image, do_alsc_colour)
+        results = utils.map_images(lambda image: self._do_single_alsc(image, do_alsc_colour),
+                                   self._enumerate_lsc_images(images),
+                                   utils.get_jobs(general_conf))
+        for col, cr, cb, cg in results:
             list_col.append(col)
             list_cr.append(cr)
             list_cb.append(cb)
@@ -46,7 +46,7 @@ class LSCRkISP1(LSC):
     # @return List of dictionaries of color temperature, red table, red's green
     #         table, blue's green table, and blue table
 
-    def _do_all_lsc(self, images: list) -> list:
+    def _do_all_lsc(self, images: list, jobs: int) -> list:
         output_list = []
         output_map_func = lt.gradient.Linear().map
 
@@ -57,8 +57,9 @@ class LSCRkISP1(LSC):
         list_cb = []
         list_cgr = []
         list_cgb = []
-        for image in self._enumerate_lsc_images(images):
-            col, cr, cb, cgr, cgb = self._do_single_lsc(image)
+        results = utils.map_images(self._do_single_lsc,
+                                   self._enumerate_lsc_images(images), jobs)
+        for col, cr, cb, cgr, cgb in results:
             list_col.append(col)
             list_cr.append(cr)
             list_cb.append(cb)
@@ -104,7 +105,7 @@ class LSCRkISP1(LSC):
         output['x-size'] = size_gradient.distribute(0.5, 8)
         output['y-size'] = size_gradient.distribute(0.5, 8)
 
-        output['sets'] = self._do_all_lsc(images)
+        output['sets'] = self._do_all_lsc(images, utils.get_jobs(config['general']))
 
         # \todo Validate images from greyscale camera and force grescale mode
         # \todo Debug functionality
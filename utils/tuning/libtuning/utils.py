@@ -5,6 +5,7 @@
 #
 # Utilities for libtuning
 
+from concurrent.futures import ProcessPoolExecutor, ThreadPoolExecutor
 import decimal
 import math
 import numpy as np
@@ -31,6 +32,33 @@ def get_module_by_type_name(modules, name):
     return None
 
 
+# @brief Get the number of workers to use for per-image processing
+# @param general_config The 'general' section of the configuration dictionary
+# @return The number of workers, at least 1
+def get_jobs(general_config: dict) -> int:
+    jobs = general_config.get('jobs')
+    if jobs is None:
+        jobs = os.cpu_count() or 1
+    return max(int(jobs), 1)
+
+
+# @brief Apply a function to every image, in parallel when possible
+# @param func Function to call on each image
+# @param images List of images to process
+# @param jobs Number of worker threads to use
+# @return A list of the results of func, in the order of images
+#
+# Threads are used as the per-image work is dominated by numpy operations that
+# release the GIL, and images don't have to be copied to the workers.
+def map_images(func, images: list, jobs: int) -> list:
+    images = list(images)
+    if jobs <= 1 or len(images) <= 1:
+        return [func(image) for image in images]
+
+    with ThreadPoolExecutor(max_workers=min(jobs, len(images))) as executor:
+        return list(executor.map(func, images))
+
+
 # Private utility functions
 
 
@@ -60,6 +88,55 @@ def _validate_images(images):
     return True
 
 
+# @brief Load a single image file and locate its macbeth chart
+# @return An Image instance, or None if the image should be skipped
+#
+# This is run in worker processes by load_images(), and must thus not depend on
+# any state other than its arguments.
+def _load_image(f: Path, config: dict, load_nonlsc: bool, load_lsc: bool,
+                cache_dir):
+    color, lux, lsc_only = _parse_image_filename(f)
+    if color is None:
+        return None
+
+    # Skip lsc image if we don't need it
+    if lsc_only and not load_lsc:
+        eprint(f'Skipping {f.name} as this tuner has no LSC module')
+        return None
+
+    # Skip non-lsc image if we don't need it
+    if not lsc_only and not load_nonlsc:
+        eprint(f'Skipping {f.name} as this tuner only has an LSC module')
+        return None
+
+    # Load image
+    try:
+        image = Image(f, cache_dir)
+    except Exception as e:
+        eprint(f'Failed to load image {f.name}: {e}')
+        return None
+
+    # Populate simple fields
+    image.lsc_only = lsc_only
+    image.color = color
+    image.lux = lux
+
+    # Black level comes from the TIFF tags, but they are overridable by the
+    # config file.
+    if 'blacklevel' in config['general']:
+        image.blacklevel_16 = config['general']['blacklevel']
+
+    if lsc_only:
+        return image
+
+    # Handle macbeth
+    macbeth = locate_macbeth(image, config)
+    if macbeth is None:
+        return None
+
+    return image
+
+
 # Public utility functions
 
 
@@ -68,56 +145,30 @@ def _validate_images(images):
 # @param config Configuration dictionary
 # @param load_nonlsc Whether or not to load non-lsc images
 # @param load_lsc Whether or not to load lsc-only images
+# @param cache_dir Directory in which to cache decoded images, or None
 # @return A list of Image instances
-def load_images(input_dir: str, config: dict, load_nonlsc: bool, load_lsc: bool) -> list:
+#
+# The images are processed in parallel by worker processes, see get_jobs().
+def load_images(input_dir: str, config: dict, load_nonlsc: bool, load_lsc: bool,
+                cache_dir: str = None) -> list:
     files = _list_image_files(input_dir)
     if len(files) == 0:
         eprint(f'No images found in {input_dir}')
         return None
 
-    images = []
-    for f in files:
-        color, lux, lsc_only = _parse_image_filename(f)
-        if color is None:
-            continue
-
-        # Skip lsc image if we don't need it
-        if lsc_only and not load_lsc:
-            eprint(f'Skipping {f.name} as this tuner has no LSC module')
-            continue
-
-        # Skip non-lsc image if we don't need it
-        if not lsc_only and not load_nonlsc:
-            eprint(f'Skipping {f.name} as this tuner only has an LSC module')
-            continue
-
-        # Load image
-        try:
-            image = Image(f)
-        except Exception as e:
-            eprint(f'Failed to load image {f.name}: {e}')
-            continue
-
-        # Populate simple fields
-        image.lsc_only = lsc_only
-        image.color = color
-        image.lux = lux
-
-        # Black level comes from the TIFF tags, but they are overridable by the
-        # config file.
-        if 'blacklevel' in config['general']:
-            image.blacklevel_16 = config['general']['blacklevel']
-
-        if lsc_only:
-            images.append(image)
-            continue
-
-        # Handle macbeth
-        macbeth = locate_macbeth(config)
-        if macbeth is None:
-            continue
-
-        images.append(image)
+    jobs = min(get_jobs(config['general']), len(files))
+    args = (config, load_nonlsc, load_lsc, cache_dir)
+
+    # Decoding and macbeth detection are CPU bound and mostly run Python code,
+    # so use processes instead of threads to distribute the images.
+    if jobs > 1:
+        with ProcessPoolExecutor(max_workers=jobs) as executor:
+            futures = [executor.submit(_load_image, f, *args) for f in files]
+            images = [future.result() for future in futures]
+    else:
+        images = [_load_image(f, *args) for f in files]
+
+    images = [image for image in images if image is not None]
 
     if not _validate_images(images):
         return None